@@ -26,6 +26,8 @@
 
 package org.collectd.api;
 
+import java.util.List;
+
 /**
  * Java API to internal functions of collectd.
  *
@@ -175,6 +177,32 @@ public class Collectd
   native public static int registerWrite (String name,
       CollectdWriteInterface object);
 
+  /**
+   * Java representation of collectd/src/plugin.h:plugin_register_write_batch
+   *
+   * Value lists are collected until {@code batchSize} of them are queued or
+   * the oldest one has waited for {@code lingerMs} milliseconds, whichever
+   * happens first.
+   *
+   * @return Zero when successful, non-zero otherwise.
+   * @see CollectdWriteBatchInterface
+   */
+  native public static int registerWriteBatch (String name,
+      CollectdWriteBatchInterface object, int batchSize, long lingerMs);
+
+  /**
+   * Registers a batch write callback with a batch size of 1000 value lists
+   * and a linger time of one second.
+   *
+   * @return Zero when successful, non-zero otherwise.
+   * @see #registerWriteBatch(String, CollectdWriteBatchInterface, int, long)
+   */
+  public static int registerWriteBatch (String name,
+      CollectdWriteBatchInterface object)
+  {
+    return (registerWriteBatch (name, object, 1000, 1000));
+  }
+
   /**
    * Java representation of collectd/src/plugin.h:plugin_register_flush
    *
@@ -236,6 +264,17 @@ public class Collectd
    */
   native public static int dispatchValues (ValueList vl);
 
+  /**
+   * Java representation of
+   * collectd/src/plugin.h:plugin_dispatch_values_batch
+   *
+   * Dispatches all value lists with a single call into the daemon. If one of
+   * them cannot be converted, none are dispatched.
+   *
+   * @return Zero when successful, non-zero otherwise.
+   */
+  native public static int dispatchValues (List<ValueList> vl);
+
   /**
    * Java representation of collectd/src/plugin.h:plugin_dispatch_notification
    *
@@ -42,6 +42,7 @@ import javax.management.remote.JMXConnectorFactory;
 
 import org.collectd.api.Collectd;
 import org.collectd.api.PluginData;
+import org.collectd.api.ValueList;
 import org.collectd.api.OConfigValue;
 import org.collectd.api.OConfigItem;
 
@@ -236,6 +237,7 @@ class GenericJMXConfConnection
   public void query () /* {{{ */
   {
     PluginData pd;
+    List<ValueList> vl_list;
 
     // try to connect
     connect ();
@@ -251,18 +253,25 @@ class GenericJMXConfConnection
     pd.setHost (this.getHost ());
     pd.setPlugin ("GenericJMX");
 
+    /* All values read from this connection are dispatched with one call, so
+     * that the boundary between Java and C is crossed only once per read. */
+    vl_list = new ArrayList<ValueList> ();
+
     for (int i = 0; i < this._mbeans.size (); i++)
     {
       int status;
 
       status = this._mbeans.get (i).query (this._mbean_connection, pd,
-          this._instance_prefix);
+          this._instance_prefix, vl_list);
       if (status != 0)
       {
         disconnect ();
-        return;
+        break;
       }
     } /* for */
+
+    if (vl_list.size () > 0)
+      Collectd.dispatchValues (vl_list);
   } /* }}} void query */
 
   public String toString ()
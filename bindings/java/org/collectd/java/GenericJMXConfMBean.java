@@ -37,6 +37,7 @@ import javax.management.MalformedObjectNameException;
 
 import org.collectd.api.Collectd;
 import org.collectd.api.PluginData;
+import org.collectd.api.ValueList;
 import org.collectd.api.OConfigValue;
 import org.collectd.api.OConfigItem;
 
@@ -160,7 +161,7 @@ class GenericJMXConfMBean
   } /* }}} */
 
   public int query (MBeanServerConnection conn, PluginData pd, /* {{{ */
-      String instance_prefix)
+      String instance_prefix, List<ValueList> out)
   {
     Set<ObjectName> names;
     Iterator<ObjectName> iter;
@@ -233,7 +234,7 @@ class GenericJMXConfMBean
       Collectd.logDebug ("GenericJMXConfMBean: instance = " + instance.toString ());
 
       for (int i = 0; i < this._values.size (); i++)
-        this._values.get (i).query (conn, objName, pd_tmp);
+        this._values.get (i).query (conn, objName, pd_tmp, out);
     }
 
     return (0);
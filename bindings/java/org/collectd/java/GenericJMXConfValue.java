@@ -201,7 +201,7 @@ class GenericJMXConfValue
   } /* }}} List<Number> genericCompositeToNumber */
 
   private void submitTable (List<Object> objects, ValueList vl, /* {{{ */
-      String instancePrefix)
+      String instancePrefix, List<ValueList> out)
   {
     List<CompositeData> cdlist;
     Set<String> keySet = null;
@@ -257,12 +257,12 @@ class GenericJMXConfValue
         vl.setTypeInstance (instancePrefix + key);
       vl.setValues (values);
 
-      Collectd.dispatchValues (vl);
+      out.add (new ValueList (vl));
     }
   } /* }}} void submitTable */
 
   private void submitScalar (List<Object> objects, ValueList vl, /* {{{ */
-      String instancePrefix)
+      String instancePrefix, List<ValueList> out)
   {
     List<Number> values;
 
@@ -280,7 +280,7 @@ class GenericJMXConfValue
       vl.setTypeInstance (instancePrefix);
     vl.setValues (values);
 
-    Collectd.dispatchValues (vl);
+    out.add (new ValueList (vl));
   } /* }}} void submitScalar */
 
   private Object queryAttributeRecursive (CompositeData parent, /* {{{ */
@@ -558,16 +558,17 @@ class GenericJMXConfValue
   } /* }}} GenericJMXConfValue (OConfigItem ci) */
 
   /**
-   * Query values via JMX according to the object's configuration and dispatch
-   * them to collectd.
+   * Query values via JMX according to the object's configuration and append
+   * them to a list, which the caller dispatches to collectd.
    *
    * @param conn    Connection to the MBeanServer.
    * @param objName Object name of the MBean to query.
    * @param pd      Preset naming components. The members host, plugin and
    *                plugin instance will be used.
+   * @param out     List the value lists are appended to.
    */
   public void query (MBeanServerConnection conn, ObjectName objName, /* {{{ */
-      PluginData pd)
+      PluginData pd, List<ValueList> out)
   {
     ValueList vl;
     List<DataSource> dsrc;
@@ -655,9 +656,9 @@ class GenericJMXConfValue
     }
 
     if (this._is_table)
-      submitTable (values, vl, instancePrefix);
+      submitTable (values, vl, instancePrefix, out);
     else
-      submitScalar (values, vl, instancePrefix);
+      submitScalar (values, vl, instancePrefix, out);
   } /* }}} void query */
 } /* class GenericJMXConfValue */
 
@@ -40,6 +40,7 @@ our @ISA = qw( Exporter );
 our %EXPORT_TAGS = (
 	'plugin' => [ qw(
 			plugin_register
+			plugin_register_write_batch
 			plugin_unregister
 			plugin_dispatch_values
 			plugin_get_interval
@@ -311,6 +312,35 @@ sub plugin_register {
 	return 1;
 }
 
+# Collectd::plugin_register_write_batch (name, sub[, batch_size[, linger]]).
+#
+# Like plugin_register (TYPE_WRITE, name, sub), but sub receives a reference to
+# an array of [ type, data set, value list ] triples, holding up to batch_size
+# (default: 1000) value lists. linger (default: 1.0) is the number of seconds
+# to wait for a batch to fill up.
+sub plugin_register_write_batch {
+	my $name       = shift;
+	my $data       = shift;
+	my $batch_size = shift;
+	my $linger     = shift;
+
+	if (! ((defined $name) && (defined $data) && (! ref $data))) {
+		ERROR ("Usage: Collectd::plugin_register_write_batch "
+			. "(name, sub[, batch_size[, linger]])");
+		return;
+	}
+
+	my $pkg = scalar caller;
+	if ($data !~ m/^$pkg\:\:/) {
+		$data = $pkg . "::" . $data;
+	}
+
+	$batch_size = 1000 if (! defined $batch_size);
+	$linger = 1.0 if (! defined $linger);
+
+	return _plugin_register_write_batch ($name, $data, $batch_size, $linger);
+}
+
 sub plugin_unregister {
 	my $type = shift;
 	my $name = shift;
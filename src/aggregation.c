@@ -36,6 +36,13 @@
 #define AGG_MATCHES_ALL(str) (strcmp("/.*/", str) == 0)
 #define AGG_FUNC_PLACEHOLDER "%{aggregation}"
 
+/* Number of partial aggregates per instance. Each writing thread updates "its"
+ * partial aggregate, so that writers only contend if there are more of them
+ * than partial aggregates. */
+#ifndef AGG_PARTIALS_NUM
+#define AGG_PARTIALS_NUM 8
+#endif
+
 struct aggregation_s /* {{{ */
 {
   lookup_identifier_t ident;
@@ -57,14 +64,11 @@ struct aggregation_s /* {{{ */
 }; /* }}} */
 typedef struct aggregation_s aggregation_t;
 
-struct agg_instance_s;
-typedef struct agg_instance_s agg_instance_t;
-struct agg_instance_s /* {{{ */
+/* Aggregate of the values written by some of the threads since the last read.
+ * The partial aggregates of an instance are merged by agg_instance_read(). */
+struct agg_partial_s /* {{{ */
 {
   pthread_mutex_t lock;
-  lookup_identifier_t ident;
-
-  int ds_type;
 
   derive_t num;
   gauge_t sum;
@@ -72,6 +76,18 @@ struct agg_instance_s /* {{{ */
 
   gauge_t min;
   gauge_t max;
+}; /* }}} */
+typedef struct agg_partial_s agg_partial_t;
+
+struct agg_instance_s;
+typedef struct agg_instance_s agg_instance_t;
+struct agg_instance_s /* {{{ */
+{
+  agg_partial_t partials[AGG_PARTIALS_NUM];
+
+  lookup_identifier_t ident;
+
+  int ds_type;
 
   rate_to_value_state_t *state_num;
   rate_to_value_state_t *state_sum;
@@ -88,6 +104,13 @@ static lookup_t *lookup = NULL;
 static pthread_mutex_t agg_instance_list_lock = PTHREAD_MUTEX_INITIALIZER;
 static agg_instance_t *agg_instance_list_head = NULL;
 
+/* Each writing thread is assigned the next partial aggregate index on its
+ * first write. */
+static pthread_once_t agg_thread_once = PTHREAD_ONCE_INIT;
+static pthread_key_t agg_thread_key;
+static pthread_mutex_t agg_thread_lock = PTHREAD_MUTEX_INITIALIZER;
+static size_t agg_thread_num = 0;
+
 static _Bool agg_is_regex(char const *str) /* {{{ */
 {
   size_t len;
@@ -105,6 +128,44 @@ static _Bool agg_is_regex(char const *str) /* {{{ */
     return 0;
 } /* }}} _Bool agg_is_regex */
 
+static void agg_thread_key_create(void) /* {{{ */
+{
+  pthread_key_create(&agg_thread_key, free);
+} /* }}} void agg_thread_key_create */
+
+/* Returns the index of the calling thread's partial aggregates. */
+static size_t agg_thread_partial(void) /* {{{ */
+{
+  size_t *idx;
+
+  pthread_once(&agg_thread_once, agg_thread_key_create);
+
+  idx = pthread_getspecific(agg_thread_key);
+  if (idx == NULL) {
+    idx = malloc(sizeof(*idx));
+    if (idx == NULL)
+      return 0;
+
+    pthread_mutex_lock(&agg_thread_lock);
+    *idx = agg_thread_num % AGG_PARTIALS_NUM;
+    agg_thread_num++;
+    pthread_mutex_unlock(&agg_thread_lock);
+
+    pthread_setspecific(agg_thread_key, idx);
+  }
+
+  return *idx;
+} /* }}} size_t agg_thread_partial */
+
+static void agg_partial_reset(agg_partial_t *p) /* {{{ */
+{
+  p->num = 0;
+  p->sum = 0.0;
+  p->squares_sum = 0.0;
+  p->min = NAN;
+  p->max = NAN;
+} /* }}} void agg_partial_reset */
+
 static void agg_destroy(aggregation_t *agg) /* {{{ */
 {
   sfree(agg);
@@ -136,10 +197,13 @@ static void agg_instance_destroy(agg_instance_t *inst) /* {{{ */
   sfree(inst->state_max);
   sfree(inst->state_stddev);
 
+  for (size_t i = 0; i < AGG_PARTIALS_NUM; i++)
+    pthread_mutex_destroy(&inst->partials[i].lock);
+
   memset(inst, 0, sizeof(*inst));
   inst->ds_type = -1;
-  inst->min = NAN;
-  inst->max = NAN;
+  for (size_t i = 0; i < AGG_PARTIALS_NUM; i++)
+    agg_partial_reset(&inst->partials[i]);
 } /* }}} void agg_instance_destroy */
 
 static int agg_instance_create_name(agg_instance_t *inst, /* {{{ */
@@ -236,15 +300,15 @@ static agg_instance_t *agg_instance_create(data_set_t const *ds, /* {{{ */
     ERROR("aggregation plugin: calloc() failed.");
     return NULL;
   }
-  pthread_mutex_init(&inst->lock, /* attr = */ NULL);
+  for (size_t i = 0; i < AGG_PARTIALS_NUM; i++) {
+    pthread_mutex_init(&inst->partials[i].lock, /* attr = */ NULL);
+    agg_partial_reset(&inst->partials[i]);
+  }
 
   inst->ds_type = ds->ds[0].type;
 
   agg_instance_create_name(inst, vl, agg);
 
-  inst->min = NAN;
-  inst->max = NAN;
-
 #define INIT_STATE(field)                                                      \
   do {                                                                         \
     inst->state_##field = NULL;                                                \
@@ -276,10 +340,10 @@ static agg_instance_t *agg_instance_create(data_set_t const *ds, /* {{{ */
   return inst;
 } /* }}} agg_instance_t *agg_instance_create */
 
-/* Update the num, sum, min, max, ... fields of the aggregation instance, if
- * the rate of the value list is available. Value lists with more than one data
- * source are not supported and will return an error. Returns zero on success
- * and non-zero otherwise. */
+/* Update the num, sum, min, max, ... fields of the calling thread's partial
+ * aggregate of the instance, if the rate of the value list is available. Value
+ * lists with more than one data source are not supported and will return an
+ * error. Returns zero on success and non-zero otherwise. */
 static int agg_instance_update(agg_instance_t *inst, /* {{{ */
                                data_set_t const *ds, value_list_t const *vl) {
   gauge_t *rate;
@@ -306,18 +370,20 @@ static int agg_instance_update(agg_instance_t *inst, /* {{{ */
     return 0;
   }
 
-  pthread_mutex_lock(&inst->lock);
+  agg_partial_t *p = &inst->partials[agg_thread_partial()];
+
+  pthread_mutex_lock(&p->lock);
 
-  inst->num++;
-  inst->sum += rate[0];
-  inst->squares_sum += (rate[0] * rate[0]);
+  p->num++;
+  p->sum += rate[0];
+  p->squares_sum += (rate[0] * rate[0]);
 
-  if (isnan(inst->min) || (inst->min > rate[0]))
-    inst->min = rate[0];
-  if (isnan(inst->max) || (inst->max < rate[0]))
-    inst->max = rate[0];
+  if (isnan(p->min) || (p->min > rate[0]))
+    p->min = rate[0];
+  if (isnan(p->max) || (p->max < rate[0]))
+    p->max = rate[0];
 
-  pthread_mutex_unlock(&inst->lock);
+  pthread_mutex_unlock(&p->lock);
 
   sfree(rate);
   return 0;
@@ -392,32 +458,43 @@ static int agg_instance_read(agg_instance_t *inst, cdtime_t t) /* {{{ */
     }                                                                          \
   } while (0)
 
-  pthread_mutex_lock(&inst->lock);
+  /* Merge and reset the partial aggregates. Each one is locked only while it
+   * is copied, so writers are not blocked while the values are dispatched. */
+  agg_partial_t sum;
+  agg_partial_reset(&sum);
+
+  for (size_t i = 0; i < AGG_PARTIALS_NUM; i++) {
+    agg_partial_t *p = &inst->partials[i];
+
+    pthread_mutex_lock(&p->lock);
+    if (p->num > 0) {
+      sum.num += p->num;
+      sum.sum += p->sum;
+      sum.squares_sum += p->squares_sum;
+      if (isnan(sum.min) || (sum.min > p->min))
+        sum.min = p->min;
+      if (isnan(sum.max) || (sum.max < p->max))
+        sum.max = p->max;
+      agg_partial_reset(p);
+    }
+    pthread_mutex_unlock(&p->lock);
+  }
 
-  READ_FUNC(num, (gauge_t)inst->num);
+  READ_FUNC(num, (gauge_t)sum.num);
 
   /* All other aggregations are only defined when there have been any values
    * at all. */
-  if (inst->num > 0) {
-    READ_FUNC(sum, inst->sum);
-    READ_FUNC(average, (inst->sum / ((gauge_t)inst->num)));
-    READ_FUNC(min, inst->min);
-    READ_FUNC(max, inst->max);
+  if (sum.num > 0) {
+    READ_FUNC(sum, sum.sum);
+    READ_FUNC(average, (sum.sum / ((gauge_t)sum.num)));
+    READ_FUNC(min, sum.min);
+    READ_FUNC(max, sum.max);
     READ_FUNC(stddev,
-              sqrt((((gauge_t)inst->num) * inst->squares_sum) -
-                   (inst->sum * inst->sum)) /
-                  ((gauge_t)inst->num));
+              sqrt((((gauge_t)sum.num) * sum.squares_sum) -
+                   (sum.sum * sum.sum)) /
+                  ((gauge_t)sum.num));
   }
 
-  /* Reset internal state. */
-  inst->num = 0;
-  inst->sum = 0.0;
-  inst->squares_sum = 0.0;
-  inst->min = NAN;
-  inst->max = NAN;
-
-  pthread_mutex_unlock(&inst->lock);
-
   meta_data_destroy(vl.meta);
   vl.meta = NULL;
 
@@ -693,7 +770,13 @@ static int agg_read(void) /* {{{ */
   t = cdtime();
   success = 0;
 
+  /* New instances are only ever prepended to the list and instances are not
+   * removed while the plugin is running, so the list can be walked from a
+   * snapshot of its head without holding the lock. Instances created in the
+   * meantime are read next time. */
   pthread_mutex_lock(&agg_instance_list_lock);
+  agg_instance_t *head = agg_instance_list_head;
+  pthread_mutex_unlock(&agg_instance_list_lock);
 
   /* agg_instance_list_head only holds data, after the "write" callback has
    * been called with a matching value list at least once. So on startup,
@@ -701,13 +784,10 @@ static int agg_read(void) /* {{{ */
    * the read() callback is called first, agg_instance_list_head is NULL and
    * "success" may be zero. This is expected and should not result in an error.
    * Therefore we need to handle this case separately. */
-  if (agg_instance_list_head == NULL) {
-    pthread_mutex_unlock(&agg_instance_list_lock);
+  if (head == NULL)
     return 0;
-  }
 
-  for (agg_instance_t *this = agg_instance_list_head; this != NULL;
-       this = this->next) {
+  for (agg_instance_t *this = head; this != NULL; this = this->next) {
     int status;
 
     status = agg_instance_read(this, t);
@@ -719,8 +799,6 @@ static int agg_read(void) /* {{{ */
       success++;
   }
 
-  pthread_mutex_unlock(&agg_instance_list_lock);
-
   return (success > 0) ? 0 : -1;
 } /* }}} int agg_read */
 
@@ -31,8 +31,10 @@
 #include "common.h"
 #include "plugin.h"
 #include "utils_cmd_putval.h"
+#include "utils_complain.h"
 #include "utils_format_graphite.h"
 #include "utils_format_json.h"
+#include "utils_format_protobuf.h"
 
 #include <amqp.h>
 #include <amqp_framing.h>
@@ -59,12 +61,34 @@ int amqp_socket_close(amqp_socket_t *);
 #define CAMQP_FORMAT_COMMAND 1
 #define CAMQP_FORMAT_JSON 2
 #define CAMQP_FORMAT_GRAPHITE 3
+#define CAMQP_FORMAT_PROTOBUF 4
 
 #define CAMQP_CHANNEL 1
 
+/* Defaults of the publishing options. */
+#define CAMQP_BATCH_TIMEOUT_DEFAULT TIME_T_TO_CDTIME_T(1)
+#define CAMQP_QUEUE_LIMIT_DEFAULT 1024
+/* How long the publishing thread waits for outstanding confirms on shutdown. */
+#define CAMQP_SHUTDOWN_TIMEOUT TIME_T_TO_CDTIME_T(5)
+/* How long the idle publishing thread blocks while waiting for confirms. */
+#define CAMQP_CONFIRM_POLL_INTERVAL MS_TO_CDTIME_T(10)
+
 /*
  * Data types
  */
+/* A message waiting to be published, or waiting for its confirm. The body of a
+ * batch holds one or more formatted value lists. */
+struct camqp_message_s {
+  char *routing_key;
+  char *body;
+  size_t body_size;
+  size_t body_fill;
+  cdtime_t time;
+  uint64_t delivery_tag;
+  struct camqp_message_s *next;
+};
+typedef struct camqp_message_s camqp_message_t;
+
 struct camqp_config_s {
   _Bool publish;
   char *name;
@@ -90,6 +114,34 @@ struct camqp_config_s {
   char *postfix;
   char escape_char;
   unsigned int graphite_flags;
+  /* Batches are sent when they exceed batch_size bytes or are older than
+   * batch_timeout. A batch_size of zero puts each value list in its own
+   * message. */
+  size_t batch_size;
+  cdtime_t batch_timeout;
+  /* Maximum number of unconfirmed messages, zero disables publisher
+   * confirms. */
+  int confirm_window;
+  int queue_limit;
+
+  /* The batch being filled, "queue" holds the complete batches the publishing
+   * thread has yet to send. All three are protected by "lock". */
+  camqp_message_t *batch;
+  camqp_message_t *queue_head;
+  camqp_message_t *queue_tail;
+  int queue_length;
+  c_complain_t queue_complaint;
+
+  /* Only used by the publishing thread. */
+  camqp_message_t *inflight_head;
+  camqp_message_t *inflight_tail;
+  int inflight_num;
+  uint64_t delivery_tag;
+
+  pthread_t publish_thread;
+  _Bool publish_thread_running;
+  _Bool publish_thread_loop;
+  pthread_cond_t publish_cond;
 
   /* subscribe only */
   char *exchange_type;
@@ -120,6 +172,19 @@ static _Bool subscriber_threads_running = 1;
 /*
  * Functions
  */
+static void camqp_message_free(camqp_message_t *m) /* {{{ */
+{
+  while (m != NULL) {
+    camqp_message_t *next = m->next;
+
+    sfree(m->routing_key);
+    sfree(m->body);
+    sfree(m);
+
+    m = next;
+  }
+} /* }}} void camqp_message_free */
+
 static void camqp_close_connection(camqp_config_t *conf) /* {{{ */
 {
   int sockfd;
@@ -142,8 +207,24 @@ static void camqp_config_free(void *ptr) /* {{{ */
   if (conf == NULL)
     return;
 
+  if (conf->publish_thread_running) {
+    pthread_mutex_lock(&conf->lock);
+    conf->publish_thread_loop = 0;
+    pthread_cond_signal(&conf->publish_cond);
+    pthread_mutex_unlock(&conf->lock);
+
+    pthread_join(conf->publish_thread, /* retval = */ NULL);
+    conf->publish_thread_running = 0;
+  }
+
   camqp_close_connection(conf);
 
+  camqp_message_free(conf->batch);
+  camqp_message_free(conf->queue_head);
+  camqp_message_free(conf->inflight_head);
+  pthread_cond_destroy(&conf->publish_cond);
+  pthread_mutex_destroy(&conf->lock);
+
   sfree(conf->name);
   sfree(conf->host);
   sfree(conf->vhost);
@@ -492,6 +573,19 @@ static int camqp_connect(camqp_config_t *conf) /* {{{ */
        "on %s:%i.",
        CONF(conf, vhost), CONF(conf, host), conf->port);
 
+  if (conf->publish && (conf->confirm_window > 0)) {
+    amqp_confirm_select(conf->connection, CAMQP_CHANNEL);
+    if (camqp_is_error(conf)) {
+      char errbuf[1024];
+      ERROR("amqp plugin: amqp_confirm_select failed: %s",
+            camqp_strerror(conf, errbuf, sizeof(errbuf)));
+      camqp_close_connection(conf);
+      return -1;
+    }
+    /* Delivery tags are counted per channel. */
+    conf->delivery_tag = 0;
+  }
+
   status = camqp_create_exchange(conf);
   if (status != 0)
     return status;
@@ -526,18 +620,12 @@ static int camqp_shutdown(void) /* {{{ */
 /*
  * Subscribing code
  */
-static int camqp_read_body(camqp_config_t *conf, /* {{{ */
-                           size_t body_size, const char *content_type) {
-  char body[body_size + 1];
-  char *body_ptr;
-  size_t received;
+static int camqp_receive_body(camqp_config_t *conf, /* {{{ */
+                              char *body, size_t body_size) {
+  size_t received = 0;
   amqp_frame_t frame;
   int status;
 
-  memset(body, 0, sizeof(body));
-  body_ptr = &body[0];
-  received = 0;
-
   while (received < body_size) {
     status = amqp_simple_wait_frame(conf->connection, &frame);
     if (status < 0) {
@@ -557,29 +645,53 @@ static int camqp_read_body(camqp_config_t *conf, /* {{{ */
       return -1;
     }
 
-    memcpy(body_ptr, frame.payload.body_fragment.bytes,
+    memcpy(body + received, frame.payload.body_fragment.bytes,
            frame.payload.body_fragment.len);
-    body_ptr += frame.payload.body_fragment.len;
     received += frame.payload.body_fragment.len;
   } /* while (received < body_size) */
 
-  if (strcasecmp("text/collectd", content_type) == 0) {
-    status = cmd_handle_putval(stderr, body);
-    if (status != 0)
-      ERROR("amqp plugin: cmd_handle_putval failed with status %i.", status);
+  return 0;
+} /* }}} int camqp_receive_body */
+
+static int camqp_read_body(camqp_config_t *conf, /* {{{ */
+                           size_t body_size, const char *content_type) {
+  int status;
+
+  /* Batches may be large, so the body isn't kept on the stack. */
+  char *body = calloc(1, body_size + 1);
+  if (body == NULL) {
+    ERROR("amqp plugin: calloc failed.");
+    return ENOMEM;
+  }
+
+  status = camqp_receive_body(conf, body, body_size);
+  if (status != 0) {
+    sfree(body);
     return status;
+  }
+
+  if (strcasecmp("text/collectd", content_type) == 0) {
+    /* Batches hold one PUTVAL command per line. */
+    char *saveptr = NULL;
+    for (char *line = strtok_r(body, "\n", &saveptr); line != NULL;
+         line = strtok_r(NULL, "\n", &saveptr)) {
+      int tmp = cmd_handle_putval(stderr, line);
+      if (tmp != 0) {
+        ERROR("amqp plugin: cmd_handle_putval failed with status %i.", tmp);
+        status = tmp;
+      }
+    }
   } else if (strcasecmp("application/json", content_type) == 0) {
     ERROR("amqp plugin: camqp_read_body: Parsing JSON data has not "
           "been implemented yet. FIXME!");
-    return 0;
   } else {
     ERROR("amqp plugin: camqp_read_body: Unknown content type \"%s\".",
           content_type);
-    return EINVAL;
+    status = EINVAL;
   }
 
-  /* not reached */
-  return 0;
+  sfree(body);
+  return status;
 } /* }}} int camqp_read_body */
 
 static int camqp_read_header(camqp_config_t *conf) /* {{{ */
@@ -697,14 +809,255 @@ static int camqp_subscribe_init(camqp_config_t *conf) /* {{{ */
 /*
  * Publishing code
  */
-/* XXX: You must hold "conf->lock" when calling this function! */
-static int camqp_write_locked(camqp_config_t *conf, /* {{{ */
-                              const char *buffer, const char *routing_key) {
+/* Returns the in-flight messages to the front of the queue so they are
+ * published again, e.g. after the connection was lost.
+ * XXX: You must hold "conf->lock" when calling this function! */
+static void camqp_requeue_inflight_locked(camqp_config_t *conf) /* {{{ */
+{
+  if (conf->inflight_head == NULL)
+    return;
+
+  conf->inflight_tail->next = conf->queue_head;
+  conf->queue_head = conf->inflight_head;
+  if (conf->queue_tail == NULL)
+    conf->queue_tail = conf->inflight_tail;
+  conf->queue_length += conf->inflight_num;
+
+  conf->inflight_head = NULL;
+  conf->inflight_tail = NULL;
+  conf->inflight_num = 0;
+} /* }}} void camqp_requeue_inflight_locked */
+
+/* Moves the current batch to the queue of the publishing thread.
+ * XXX: You must hold "conf->lock" when calling this function! */
+static void camqp_batch_seal_locked(camqp_config_t *conf) /* {{{ */
+{
+  camqp_message_t *m = conf->batch;
+
+  if (m == NULL)
+    return;
+  conf->batch = NULL;
+
+  /* format_json_value_list_append() puts a comma before every object. */
+  if (conf->format == CAMQP_FORMAT_JSON) {
+    m->body[0] = '[';
+    m->body[m->body_fill++] = ']';
+    m->body[m->body_fill] = 0;
+  }
+
+  if (conf->queue_length >= conf->queue_limit) {
+    c_complain(LOG_ERR, &conf->queue_complaint,
+               "amqp plugin: Publish \"%s\": The queue is full, dropping "
+               "messages.",
+               conf->name);
+    camqp_message_free(m);
+    return;
+  }
+  c_release(LOG_INFO, &conf->queue_complaint,
+            "amqp plugin: Publish \"%s\": The queue is no longer full.",
+            conf->name);
+
+  if (conf->queue_tail == NULL)
+    conf->queue_head = m;
+  else
+    conf->queue_tail->next = m;
+  conf->queue_tail = m;
+  conf->queue_length++;
+
+  pthread_cond_signal(&conf->publish_cond);
+} /* }}} void camqp_batch_seal_locked */
+
+/* Appends a formatted value list to the batch for "routing_key".
+ * XXX: You must hold "conf->lock" when calling this function! */
+static int camqp_batch_append_locked(camqp_config_t *conf, /* {{{ */
+                                     const char *routing_key,
+                                     const char *buffer, size_t buffer_len) {
+  /* Batches only hold value lists with the same routing key. */
+  if ((conf->batch != NULL) &&
+      (strcmp(conf->batch->routing_key, routing_key) != 0))
+    camqp_batch_seal_locked(conf);
+
+  camqp_message_t *m = conf->batch;
+  if (m == NULL) {
+    m = calloc(1, sizeof(*m));
+    if (m == NULL)
+      return ENOMEM;
+    m->routing_key = strdup(routing_key);
+    if (m->routing_key == NULL) {
+      sfree(m);
+      return ENOMEM;
+    }
+    m->time = cdtime();
+    conf->batch = m;
+  }
+
+  /* Room for the separator, the closing bracket and the null byte. */
+  size_t needed = m->body_fill + buffer_len + 3;
+  if (needed > m->body_size) {
+    size_t size = (m->body_size > 0) ? m->body_size : 1024;
+    while (size < needed)
+      size *= 2;
+
+    char *tmp = realloc(m->body, size);
+    if (tmp == NULL)
+      return ENOMEM;
+    m->body = tmp;
+    m->body_size = size;
+  }
+
+  /* PUTVAL commands are one per line. JSON objects and Graphite lines bring
+   * their own separator and protobuf value lists are simply concatenated. */
+  if ((conf->format == CAMQP_FORMAT_COMMAND) && (m->body_fill > 0))
+    m->body[m->body_fill++] = '\n';
+  memcpy(m->body + m->body_fill, buffer, buffer_len);
+  m->body_fill += buffer_len;
+  m->body[m->body_fill] = 0;
+
+  if (m->body_fill >= conf->batch_size)
+    camqp_batch_seal_locked(conf);
+
+  return 0;
+} /* }}} int camqp_batch_append_locked */
+
+#ifdef HAVE_AMQP_TCP_SOCKET
+/* Removes the messages confirmed by an ack or nack from the in-flight list.
+ * Nacked messages are published again. */
+static void camqp_confirm(camqp_config_t *conf, /* {{{ */
+                          uint64_t delivery_tag, _Bool multiple, _Bool ack) {
+  camqp_message_t *nacked = NULL;
+  camqp_message_t *nacked_last = NULL;
+  int nacked_num = 0;
+
+  camqp_message_t **next = &conf->inflight_head;
+  camqp_message_t *prev = NULL;
+  while ((*next != NULL) && ((*next)->delivery_tag <= delivery_tag)) {
+    camqp_message_t *m = *next;
+
+    if (!multiple && (m->delivery_tag != delivery_tag)) {
+      prev = m;
+      next = &m->next;
+      continue;
+    }
+
+    *next = m->next;
+    conf->inflight_num--;
+    m->next = NULL;
+
+    if (ack) {
+      camqp_message_free(m);
+      continue;
+    }
+
+    if (nacked_last == NULL)
+      nacked = m;
+    else
+      nacked_last->next = m;
+    nacked_last = m;
+    nacked_num++;
+  }
+  if (*next == NULL)
+    conf->inflight_tail = prev;
+
+  if (nacked == NULL)
+    return;
+
+  WARNING("amqp plugin: Publish \"%s\": The broker rejected %i message(s), "
+          "publishing them again.",
+          conf->name, nacked_num);
+
+  pthread_mutex_lock(&conf->lock);
+  nacked_last->next = conf->queue_head;
+  if (conf->queue_head == NULL)
+    conf->queue_tail = nacked_last;
+  conf->queue_head = nacked;
+  conf->queue_length += nacked_num;
+  pthread_mutex_unlock(&conf->lock);
+} /* }}} void camqp_confirm */
+
+/* Processes the confirms received from the broker, waiting up to "timeout"
+ * for the first one. */
+static int camqp_read_confirms(camqp_config_t *conf, /* {{{ */
+                               cdtime_t timeout) {
+  struct timeval tv = CDTIME_T_TO_TIMEVAL(timeout);
+
+  while (conf->inflight_head != NULL) {
+    amqp_frame_t frame;
+    int status;
+
+    amqp_maybe_release_buffers(conf->connection);
+    status = amqp_simple_wait_frame_noblock(conf->connection, &frame, &tv);
+    if (status == AMQP_STATUS_TIMEOUT)
+      return 0;
+    if (status != AMQP_STATUS_OK) {
+      ERROR("amqp plugin: amqp_simple_wait_frame_noblock failed: %s",
+            amqp_error_string2(status));
+      return -1;
+    }
+
+    /* Don't wait for any further frames. */
+    tv = (struct timeval){0};
+
+    if (frame.frame_type != AMQP_FRAME_METHOD)
+      continue;
+
+    if (frame.payload.method.id == AMQP_BASIC_ACK_METHOD) {
+      amqp_basic_ack_t *m = frame.payload.method.decoded;
+      camqp_confirm(conf, m->delivery_tag, m->multiple, /* ack = */ 1);
+    } else if (frame.payload.method.id == AMQP_BASIC_NACK_METHOD) {
+      amqp_basic_nack_t *m = frame.payload.method.decoded;
+      camqp_confirm(conf, m->delivery_tag, m->multiple, /* ack = */ 0);
+    } else if ((frame.payload.method.id == AMQP_CHANNEL_CLOSE_METHOD) ||
+               (frame.payload.method.id == AMQP_CONNECTION_CLOSE_METHOD)) {
+      ERROR("amqp plugin: Publish \"%s\": The broker closed the %s.",
+            conf->name,
+            (frame.payload.method.id == AMQP_CHANNEL_CLOSE_METHOD)
+                ? "channel"
+                : "connection");
+      return -1;
+    }
+  }
+
+  return 0;
+} /* }}} int camqp_read_confirms */
+#endif /* HAVE_AMQP_TCP_SOCKET */
+
+/* Puts a message back to the front of the queue. */
+static void camqp_unpop(camqp_config_t *conf, camqp_message_t *m) /* {{{ */
+{
+  pthread_mutex_lock(&conf->lock);
+  m->next = conf->queue_head;
+  conf->queue_head = m;
+  if (conf->queue_tail == NULL)
+    conf->queue_tail = m;
+  conf->queue_length++;
+  pthread_mutex_unlock(&conf->lock);
+} /* }}} void camqp_unpop */
+
+/* Publishes one message. The message is freed once it has been sent or, with
+ * confirms enabled, once it has been confirmed. Upon failure, it is put back
+ * into the queue. Only called by the publishing thread, which owns
+ * "conf->connection". */
+static int camqp_publish(camqp_config_t *conf, camqp_message_t *m) /* {{{ */
+{
   int status;
 
   status = camqp_connect(conf);
-  if (status != 0)
+  if (status != 0) {
+    camqp_unpop(conf, m);
     return status;
+  }
+
+#ifdef HAVE_AMQP_TCP_SOCKET
+  /* Wait for confirms while the window is full. */
+  while ((conf->confirm_window > 0) &&
+         (conf->inflight_num >= conf->confirm_window)) {
+    status = camqp_read_confirms(conf, conf->batch_timeout);
+    if (status != 0) {
+      camqp_unpop(conf, m);
+      return status;
+    }
+  }
+#endif
 
   amqp_basic_properties_t props = {._flags = AMQP_BASIC_CONTENT_TYPE_FLAG |
                                              AMQP_BASIC_DELIVERY_MODE_FLAG |
@@ -718,28 +1071,153 @@ static int camqp_write_locked(camqp_config_t *conf, /* {{{ */
     props.content_type = amqp_cstring_bytes("application/json");
   else if (conf->format == CAMQP_FORMAT_GRAPHITE)
     props.content_type = amqp_cstring_bytes("text/graphite");
+  else if (conf->format == CAMQP_FORMAT_PROTOBUF)
+    props.content_type = amqp_cstring_bytes("application/x-protobuf");
   else
     assert(23 == 42);
 
   status = amqp_basic_publish(
       conf->connection,
       /* channel = */ 1, amqp_cstring_bytes(CONF(conf, exchange)),
-      amqp_cstring_bytes(routing_key),
+      amqp_cstring_bytes(m->routing_key),
       /* mandatory = */ 0,
-      /* immediate = */ 0, &props, amqp_cstring_bytes(buffer));
+      /* immediate = */ 0, &props,
+      (amqp_bytes_t){.len = m->body_fill, .bytes = m->body});
   if (status != 0) {
     ERROR("amqp plugin: amqp_basic_publish failed with status %i.", status);
-    camqp_close_connection(conf);
+    camqp_unpop(conf, m);
+    return status;
   }
 
-  return status;
-} /* }}} int camqp_write_locked */
+  if (conf->confirm_window == 0) {
+    camqp_message_free(m);
+    return 0;
+  }
+
+  m->delivery_tag = ++conf->delivery_tag;
+  m->next = NULL;
+  if (conf->inflight_tail == NULL)
+    conf->inflight_head = m;
+  else
+    conf->inflight_tail->next = m;
+  conf->inflight_tail = m;
+  conf->inflight_num++;
+
+#ifdef HAVE_AMQP_TCP_SOCKET
+  /* Process the confirms which have arrived in the meantime. */
+  return camqp_read_confirms(conf, /* timeout = */ 0);
+#else
+  return 0;
+#endif
+} /* }}} int camqp_publish */
+
+static void *camqp_publish_thread(void *arg) /* {{{ */
+{
+  camqp_config_t *conf = arg;
+  cdtime_t shutdown_deadline = 0;
+
+  pthread_mutex_lock(&conf->lock);
+  while (conf->publish_thread_loop || (conf->batch != NULL) ||
+         (conf->queue_head != NULL)) {
+    cdtime_t now = cdtime();
+
+    if ((conf->batch != NULL) &&
+        (!conf->publish_thread_loop ||
+         ((conf->batch->time + conf->batch_timeout) <= now)))
+      camqp_batch_seal_locked(conf);
+
+    if (conf->queue_head == NULL) {
+      cdtime_t deadline = now + conf->batch_timeout;
+      if (conf->batch != NULL)
+        deadline = conf->batch->time + conf->batch_timeout;
+
+      if (conf->inflight_head != NULL) {
+        /* Poll for confirms, but come back soon for new messages. */
+        cdtime_t timeout = deadline - now;
+        if (timeout > CAMQP_CONFIRM_POLL_INTERVAL)
+          timeout = CAMQP_CONFIRM_POLL_INTERVAL;
+
+        pthread_mutex_unlock(&conf->lock);
+#ifdef HAVE_AMQP_TCP_SOCKET
+        int status = camqp_read_confirms(conf, timeout);
+#else
+        int status = 0;
+#endif
+        if (status != 0)
+          camqp_close_connection(conf);
+        pthread_mutex_lock(&conf->lock);
+        if (status != 0)
+          camqp_requeue_inflight_locked(conf);
+      } else {
+        pthread_cond_timedwait(&conf->publish_cond, &conf->lock,
+                               &CDTIME_T_TO_TIMESPEC(deadline));
+      }
+      continue;
+    }
+
+    camqp_message_t *m = conf->queue_head;
+    conf->queue_head = m->next;
+    if (conf->queue_head == NULL)
+      conf->queue_tail = NULL;
+    conf->queue_length--;
+    m->next = NULL;
+    pthread_mutex_unlock(&conf->lock);
+
+    int status = camqp_publish(conf, m);
+    if (status != 0)
+      camqp_close_connection(conf);
+
+    pthread_mutex_lock(&conf->lock);
+    if (status == 0)
+      continue;
+
+    /* Everything which has not been confirmed is published again after
+     * reconnecting. */
+    camqp_requeue_inflight_locked(conf);
+
+    if (!conf->publish_thread_loop) {
+      if (shutdown_deadline == 0)
+        shutdown_deadline = cdtime() + CAMQP_SHUTDOWN_TIMEOUT;
+      else if (cdtime() >= shutdown_deadline)
+        break;
+    }
+
+    cdtime_t delay = (conf->connection_retry_delay > 0)
+                         ? TIME_T_TO_CDTIME_T(conf->connection_retry_delay)
+                         : conf->batch_timeout;
+    pthread_cond_timedwait(&conf->publish_cond, &conf->lock,
+                           &CDTIME_T_TO_TIMESPEC(cdtime() + delay));
+  }
+
+  if ((conf->queue_head != NULL) || (conf->batch != NULL))
+    WARNING("amqp plugin: Publish \"%s\": Dropping %i unpublished "
+            "message(s).",
+            conf->name, conf->queue_length + ((conf->batch != NULL) ? 1 : 0));
+  pthread_mutex_unlock(&conf->lock);
+
+#ifdef HAVE_AMQP_TCP_SOCKET
+  /* Wait for the outstanding confirms. */
+  shutdown_deadline = cdtime() + CAMQP_SHUTDOWN_TIMEOUT;
+  while ((conf->inflight_head != NULL) && (conf->connection != NULL) &&
+         (cdtime() < shutdown_deadline)) {
+    if (camqp_read_confirms(conf, shutdown_deadline - cdtime()) != 0)
+      break;
+  }
+#endif
+  if (conf->inflight_head != NULL)
+    WARNING("amqp plugin: Publish \"%s\": %i message(s) were not confirmed "
+            "by the broker.",
+            conf->name, conf->inflight_num);
+
+  return NULL;
+} /* }}} void *camqp_publish_thread */
 
 static int camqp_write(const data_set_t *ds, const value_list_t *vl, /* {{{ */
                        user_data_t *user_data) {
   camqp_config_t *conf = user_data->data;
   char routing_key[6 * DATA_MAX_NAME_LEN];
   char buffer[8192];
+  size_t buffer_len;
   int status;
 
   if ((ds == NULL) || (vl == NULL) || (conf == NULL))
@@ -768,13 +1246,18 @@ static int camqp_write(const data_set_t *ds, const value_list_t *vl, /* {{{ */
       ERROR("amqp plugin: cmd_create_putval failed with status %i.", status);
       return status;
     }
+    buffer_len = strlen(buffer);
   } else if (conf->format == CAMQP_FORMAT_JSON) {
-    size_t bfree = sizeof(buffer);
-    size_t bfill = 0;
+    json_buffer_t b = {.data = buffer, .size = sizeof(buffer), .fixed = 1};
 
-    format_json_initialize(buffer, &bfill, &bfree);
-    format_json_value_list(buffer, &bfill, &bfree, ds, vl, conf->store_rates);
-    format_json_finalize(buffer, &bfill, &bfree);
+    status = format_json_value_list_append(&b, ds, vl, conf->store_rates);
+    if (status != 0) {
+      ERROR("amqp plugin: format_json_value_list_append failed with status "
+            "%i.",
+            status);
+      return status;
+    }
+    buffer_len = b.fill;
   } else if (conf->format == CAMQP_FORMAT_GRAPHITE) {
     status =
         format_graphite(buffer, sizeof(buffer), ds, vl, conf->prefix,
@@ -783,18 +1266,59 @@ static int camqp_write(const data_set_t *ds, const value_list_t *vl, /* {{{ */
       ERROR("amqp plugin: format_graphite failed with status %i.", status);
       return status;
     }
+    buffer_len = strlen(buffer);
+  } else if (conf->format == CAMQP_FORMAT_PROTOBUF) {
+    size_t buffer_free = sizeof(buffer);
+    buffer_len = 0;
+    status = format_protobuf_value_list(buffer, &buffer_len, &buffer_free, ds,
+                                        vl, conf->store_rates);
+    if (status != 0) {
+      ERROR("amqp plugin: format_protobuf_value_list failed with status %i.",
+            status);
+      return status;
+    }
   } else {
     ERROR("amqp plugin: Invalid format (%i).", conf->format);
     return -1;
   }
 
   pthread_mutex_lock(&conf->lock);
-  status = camqp_write_locked(conf, buffer, routing_key);
+
+  /* The thread is started here rather than during configuration, because the
+   * daemon may fork in between. */
+  if (!conf->publish_thread_running) {
+    conf->publish_thread_loop = 1;
+    status = plugin_thread_create(&conf->publish_thread, /* attr = */ NULL,
+                                  camqp_publish_thread, conf, "amqp publish");
+    if (status != 0) {
+      pthread_mutex_unlock(&conf->lock);
+      ERROR("amqp plugin: Starting the publishing thread failed: %s",
+            STRERROR(status));
+      return status;
+    }
+    conf->publish_thread_running = 1;
+  }
+
+  status = camqp_batch_append_locked(conf, routing_key, buffer, buffer_len);
   pthread_mutex_unlock(&conf->lock);
 
+  if (status != 0)
+    ERROR("amqp plugin: Adding the value list to the batch failed.");
   return status;
 } /* }}} int camqp_write */
 
+static int camqp_flush(cdtime_t __attribute__((unused)) timeout, /* {{{ */
+                       const char __attribute__((unused)) * identifier,
+                       user_data_t *user_data) {
+  camqp_config_t *conf = user_data->data;
+
+  pthread_mutex_lock(&conf->lock);
+  camqp_batch_seal_locked(conf);
+  pthread_mutex_unlock(&conf->lock);
+
+  return 0;
+} /* }}} int camqp_flush */
+
 /*
  * Config handling
  */
@@ -815,6 +1339,8 @@ static int camqp_config_set_format(oconfig_item_t *ci, /* {{{ */
     conf->format = CAMQP_FORMAT_JSON;
   else if (strcasecmp("Graphite", string) == 0)
     conf->format = CAMQP_FORMAT_GRAPHITE;
+  else if (strcasecmp("Protobuf", string) == 0)
+    conf->format = CAMQP_FORMAT_PROTOBUF;
   else {
     WARNING("amqp plugin: Invalid format string: %s", string);
   }
@@ -852,6 +1378,11 @@ static int camqp_config_connection(oconfig_item_t *ci, /* {{{ */
   conf->delivery_mode = CAMQP_DM_VOLATILE;
   conf->store_rates = 0;
   conf->graphite_flags = 0;
+  conf->batch_size = 0;
+  conf->batch_timeout = CAMQP_BATCH_TIMEOUT_DEFAULT;
+  conf->confirm_window = 0;
+  conf->queue_limit = CAMQP_QUEUE_LIMIT_DEFAULT;
+  C_COMPLAIN_INIT(&conf->queue_complaint);
   /* publish & graphite only */
   conf->prefix = NULL;
   conf->postfix = NULL;
@@ -864,6 +1395,7 @@ static int camqp_config_connection(oconfig_item_t *ci, /* {{{ */
   /* general */
   conf->connection = NULL;
   pthread_mutex_init(&conf->lock, /* attr = */ NULL);
+  pthread_cond_init(&conf->publish_cond, /* attr = */ NULL);
   /* }}} */
 
   status = cf_util_get_string(ci, &conf->name);
@@ -937,6 +1469,39 @@ static int camqp_config_connection(oconfig_item_t *ci, /* {{{ */
                 "only one character. Others will be ignored.");
       conf->escape_char = tmp_buff[0];
       sfree(tmp_buff);
+    } else if ((strcasecmp("BatchSize", child->key) == 0) && publish) {
+      int tmp = 0;
+      status = cf_util_get_int(child, &tmp);
+      if ((status == 0) && (tmp < 0)) {
+        ERROR("amqp plugin: \"BatchSize\" must not be negative.");
+        status = -1;
+      }
+      conf->batch_size = (size_t)tmp;
+    } else if ((strcasecmp("BatchTimeout", child->key) == 0) && publish) {
+      status = cf_util_get_cdtime(child, &conf->batch_timeout);
+      if ((status == 0) && (conf->batch_timeout == 0)) {
+        ERROR("amqp plugin: \"BatchTimeout\" must be greater than zero.");
+        status = -1;
+      }
+    } else if ((strcasecmp("ConfirmWindow", child->key) == 0) && publish) {
+      status = cf_util_get_int(child, &conf->confirm_window);
+      if ((status == 0) && (conf->confirm_window < 0)) {
+        ERROR("amqp plugin: \"ConfirmWindow\" must not be negative.");
+        status = -1;
+      }
+#ifndef HAVE_AMQP_TCP_SOCKET
+      if ((status == 0) && (conf->confirm_window > 0)) {
+        ERROR("amqp plugin: \"ConfirmWindow\" requires rabbitmq-c 0.4 or "
+              "later.");
+        status = -1;
+      }
+#endif
+    } else if ((strcasecmp("QueueLimit", child->key) == 0) && publish) {
+      status = cf_util_get_int(child, &conf->queue_limit);
+      if ((status == 0) && (conf->queue_limit < 1)) {
+        ERROR("amqp plugin: \"QueueLimit\" must be at least 1.");
+        status = -1;
+      }
     } else if (strcasecmp("ConnectionRetryDelay", child->key) == 0)
       status = cf_util_get_int(child, &conf->connection_retry_delay);
     else
@@ -981,6 +1546,11 @@ static int camqp_config_connection(oconfig_item_t *ci, /* {{{ */
       camqp_config_free(conf);
       return status;
     }
+
+    plugin_register_flush(cbname, camqp_flush,
+                          &(user_data_t){
+                              .data = conf,
+                          });
   } else {
     status = camqp_subscribe_init(conf);
     if (status != 0) {
@@ -28,6 +28,7 @@
 
 #include "common.h"
 #include "plugin.h"
+#include "utils_curl_engine.h"
 
 #include <curl/curl.h>
 
@@ -55,6 +56,9 @@ struct apache_s {
 
 typedef struct apache_s apache_t;
 
+/* Transfers of all instances run on one thread through the curl engine. */
+static _Bool apache_async = 0;
+
 /* TODO: Remove this prototype */
 static int apache_read_host(user_data_t *user_data);
 
@@ -74,6 +78,7 @@ static void apache_free(void *arg) {
   sfree(st->server);
   sfree(st->apache_buffer);
   if (st->curl) {
+    curl_engine_cancel(st->curl);
     curl_easy_cleanup(st->curl);
     st->curl = NULL;
   }
@@ -151,6 +156,7 @@ static size_t apache_header_callback(void *buf, size_t size, size_t nmemb,
 
 /* Configuration handling functiions
  * <Plugin apache>
+ *   Asynchronous false
  *   <Instance "instance_name">
  *     URL ...
  *   </Instance>
@@ -245,6 +251,8 @@ static int config(oconfig_item_t *ci) {
 
     if (strcasecmp("Instance", child->key) == 0)
       config_add(child);
+    else if (strcasecmp("Asynchronous", child->key) == 0)
+      cf_util_get_boolean(child, &apache_async);
     else
       WARNING("apache plugin: The configuration option "
               "\"%s\" is not allowed here. Did you "
@@ -477,7 +485,8 @@ static void submit_scoreboard(char *buf, apache_t *st) {
   }
 }
 
-static int apache_read_host(user_data_t *user_data) /* {{{ */
+/* Parses the status page and dispatches the values. */
+static int apache_read_done(apache_t *st, CURLcode curl_status) /* {{{ */
 {
   char *ptr;
   char *saveptr;
@@ -486,30 +495,12 @@ static int apache_read_host(user_data_t *user_data) /* {{{ */
   char *fields[4];
   int fields_num;
 
-  apache_t *st;
-
-  st = user_data->data;
-
   int status;
 
   char *content_type;
   static const char *text_plain = "text/plain";
 
-  assert(st->url != NULL);
-  /* (Assured by `config_add') */
-
-  if (st->curl == NULL) {
-    status = init_host(st);
-    if (status != 0)
-      return -1;
-  }
-  assert(st->curl != NULL);
-
-  st->apache_buffer_fill = 0;
-
-  curl_easy_setopt(st->curl, CURLOPT_URL, st->url);
-
-  if (curl_easy_perform(st->curl) != CURLE_OK) {
+  if (curl_status != CURLE_OK) {
     ERROR("apache: curl_easy_perform failed: %s", st->apache_curl_error);
     return -1;
   }
@@ -557,6 +548,50 @@ static int apache_read_host(user_data_t *user_data) /* {{{ */
 
   st->apache_buffer_fill = 0;
 
+  return 0;
+} /* }}} int apache_read_done */
+
+/* Called on the curl engine's thread when an asynchronous transfer is done. */
+static void apache_async_done(CURL *curl, CURLcode status, /* {{{ */
+                              void *user_data) {
+  apache_read_done(user_data, status);
+} /* }}} void apache_async_done */
+
+static int apache_read_host(user_data_t *user_data) /* {{{ */
+{
+  apache_t *st = user_data->data;
+  int status;
+
+  assert(st->url != NULL);
+  /* (Assured by `config_add') */
+
+  if (st->curl == NULL) {
+    status = init_host(st);
+    if (status != 0)
+      return -1;
+  }
+  assert(st->curl != NULL);
+
+  /* The buffer belongs to the engine until the transfer is done. */
+  if (apache_async && curl_engine_busy(st->curl)) {
+    WARNING("apache plugin: Request for %s still in progress, skipping.",
+            st->url);
+    return 0;
+  }
+
+  st->apache_buffer_fill = 0;
+
+  curl_easy_setopt(st->curl, CURLOPT_URL, st->url);
+
+  if (!apache_async)
+    return apache_read_done(st, curl_easy_perform(st->curl));
+
+  status = curl_engine_submit(st->curl, apache_async_done, st);
+  if (status != 0) {
+    ERROR("apache plugin: Submitting request for %s failed: %s", st->url,
+          STRERROR(status));
+    return -1;
+  }
   return 0;
 } /* }}} int apache_read_host */
 
@@ -565,10 +600,24 @@ static int apache_init(void) /* {{{ */
   /* Call this while collectd is still single-threaded to avoid
    * initialization issues in libgcrypt. */
   curl_global_init(CURL_GLOBAL_SSL);
+
+  if (apache_async && (curl_engine_acquire() != 0)) {
+    ERROR("apache plugin: Starting the curl engine failed.");
+    apache_async = 0;
+    return -1;
+  }
   return 0;
 } /* }}} int apache_init */
 
+static int apache_shutdown(void) /* {{{ */
+{
+  if (apache_async)
+    curl_engine_release();
+  return 0;
+} /* }}} int apache_shutdown */
+
 void module_register(void) {
   plugin_register_complex_config("apache", config);
   plugin_register_init("apache", apache_init);
+  plugin_register_shutdown("apache", apache_shutdown);
 } /* void module_register */
@@ -349,7 +349,7 @@ static int sysfs_file_to_buffer(char const *dir, /* {{{ */
 
   snprintf(filename, sizeof(filename), "%s/%s/%s", dir, power_supply, basename);
 
-  status = (int)read_file_contents(filename, buffer, buffer_size - 1);
+  status = (int)read_file_cached(filename, buffer, buffer_size - 1);
   if (status < 0)
     return status;
 
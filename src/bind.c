@@ -125,6 +125,17 @@ static size_t bind_buffer_size = 0;
 static size_t bind_buffer_fill = 0;
 static char bind_curl_error[CURL_ERROR_SIZE];
 
+/* XPath expressions compiled by bind_xpath_eval(). All expressions are
+ * constants, so this list stays short. */
+struct bind_xpath_s;
+typedef struct bind_xpath_s bind_xpath_t;
+struct bind_xpath_s {
+  char *expression;
+  xmlXPathCompExpr *comp;
+  bind_xpath_t *next;
+};
+static bind_xpath_t *xpath_cache = NULL;
+
 /* Translation table for the `nsstats' values. */
 static const translation_info_t nsstats_translation_table[] = /* {{{ */
     {
@@ -265,6 +276,33 @@ static void submit(time_t ts, const char *plugin_instance, /* {{{ */
   plugin_dispatch_values(&vl);
 } /* }}} void submit */
 
+/* Like xmlXPathEvalExpression(), but compiles each expression only once. The
+ * expressions are evaluated for every zone and view of every read. */
+static xmlXPathObject *bind_xpath_eval(const char *expression, /* {{{ */
+                                       xmlXPathContext *ctx) {
+  for (bind_xpath_t *x = xpath_cache; x != NULL; x = x->next)
+    if (strcmp(expression, x->expression) == 0)
+      return xmlXPathCompiledEval(x->comp, ctx);
+
+  xmlXPathCompExpr *comp = xmlXPathCompile(BAD_CAST expression);
+  if (comp == NULL)
+    return NULL;
+
+  bind_xpath_t *x = calloc(1, sizeof(*x));
+  if ((x == NULL) || ((x->expression = strdup(expression)) == NULL)) {
+    xmlXPathObject *obj = xmlXPathCompiledEval(comp, ctx);
+    xmlXPathFreeCompExpr(comp);
+    sfree(x);
+    return obj;
+  }
+
+  x->comp = comp;
+  x->next = xpath_cache;
+  xpath_cache = x;
+
+  return xmlXPathCompiledEval(comp, ctx);
+} /* }}} xmlXPathObject *bind_xpath_eval */
+
 static size_t bind_curl_callback(void *buf, size_t size, /* {{{ */
                                  size_t nmemb,
                                  void __attribute__((unused)) * stream) {
@@ -395,7 +433,7 @@ static int bind_xml_read_timestamp(const char *xpath_expression, /* {{{ */
   char *tmp;
   struct tm tm = {0};
 
-  xpathObj = xmlXPathEvalExpression(BAD_CAST xpath_expression, xpathCtx);
+  xpathObj = bind_xpath_eval(xpath_expression, xpathCtx);
   if (xpathObj == NULL) {
     ERROR("bind plugin: Unable to evaluate XPath expression `%s'.",
           xpath_expression);
@@ -477,7 +515,7 @@ static int bind_parse_generic_name_value(const char *xpath_expression, /* {{{ */
   xmlXPathObject *xpathObj = NULL;
   int num_entries;
 
-  xpathObj = xmlXPathEvalExpression(BAD_CAST xpath_expression, xpathCtx);
+  xpathObj = bind_xpath_eval(xpath_expression, xpathCtx);
   if (xpathObj == NULL) {
     ERROR("bind plugin: Unable to evaluate XPath expression `%s'.",
           xpath_expression);
@@ -558,7 +596,7 @@ static int bind_parse_generic_value_list(const char *xpath_expression, /* {{{ */
   xmlXPathObject *xpathObj = NULL;
   int num_entries;
 
-  xpathObj = xmlXPathEvalExpression(BAD_CAST xpath_expression, xpathCtx);
+  xpathObj = bind_xpath_eval(xpath_expression, xpathCtx);
   if (xpathObj == NULL) {
     ERROR("bind plugin: Unable to evaluate XPath expression `%s'.",
           xpath_expression);
@@ -620,7 +658,7 @@ static int bind_parse_generic_name_attr_value_list(
   xmlXPathObject *xpathObj = NULL;
   int num_entries;
 
-  xpathObj = xmlXPathEvalExpression(BAD_CAST xpath_expression, xpathCtx);
+  xpathObj = bind_xpath_eval(xpath_expression, xpathCtx);
   if (xpathObj == NULL) {
     ERROR("bind plugin: Unable to evaluate XPath expression `%s'.",
           xpath_expression);
@@ -691,7 +729,7 @@ static int bind_xml_stats_handle_zone(int version, xmlDoc *doc, /* {{{ */
     xmlFree(n);
     xmlFree(c);
   } else {
-    path_obj = xmlXPathEvalExpression(BAD_CAST "name", path_ctx);
+    path_obj = bind_xpath_eval("name", path_ctx);
     if (path_obj == NULL) {
       ERROR("bind plugin: xmlXPathEvalExpression failed.");
       return -1;
@@ -772,7 +810,7 @@ static int bind_xml_stats_search_zones(int version, xmlDoc *doc, /* {{{ */
     return -1;
   }
 
-  zone_nodes = xmlXPathEvalExpression(BAD_CAST "zones/zone", path_ctx);
+  zone_nodes = bind_xpath_eval("zones/zone", path_ctx);
   if (zone_nodes == NULL) {
     ERROR("bind plugin: Cannot find any <view> tags.");
     xmlXPathFreeContext(zone_path_context);
@@ -818,7 +856,7 @@ static int bind_xml_stats_handle_view(int version, xmlDoc *doc, /* {{{ */
     view_name = NULL;
   } else {
     xmlXPathObject *path_obj;
-    path_obj = xmlXPathEvalExpression(BAD_CAST "name", path_ctx);
+    path_obj = bind_xpath_eval("name", path_ctx);
     if (path_obj == NULL) {
       ERROR("bind plugin: xmlXPathEvalExpression failed.");
       return -1;
@@ -938,7 +976,7 @@ static int bind_xml_stats_search_views(int version, xmlDoc *doc, /* {{{ */
     return -1;
   }
 
-  view_nodes = xmlXPathEvalExpression(BAD_CAST "views/view", xpathCtx);
+  view_nodes = bind_xpath_eval("views/view", xpathCtx);
   if (view_nodes == NULL) {
     ERROR("bind plugin: Cannot find any <view> tags.");
     xmlXPathFreeContext(view_path_context);
@@ -1325,7 +1363,7 @@ static int bind_xml(const char *data) /* {{{ */
   // version 3.* of statistics XML (since BIND9.9)
   //
 
-  xpathObj = xmlXPathEvalExpression(BAD_CAST "/statistics", xpathCtx);
+  xpathObj = bind_xpath_eval("/statistics", xpathCtx);
   if (xpathObj == NULL || xpathObj->nodesetval == NULL ||
       xpathObj->nodesetval->nodeNr == 0) {
     DEBUG("bind plugin: Statistics appears not to be v3");
@@ -1377,7 +1415,7 @@ static int bind_xml(const char *data) /* {{{ */
   // versions 1.* or 2.* of statistics XML
   //
 
-  xpathObj = xmlXPathEvalExpression(BAD_CAST "/isc/bind/statistics", xpathCtx);
+  xpathObj = bind_xpath_eval("/isc/bind/statistics", xpathCtx);
   if (xpathObj == NULL) {
     ERROR("bind plugin: Cannot find the <statistics> tag.");
     xmlXPathFreeContext(xpathCtx);
@@ -1636,6 +1674,14 @@ static int bind_shutdown(void) /* {{{ */
     curl = NULL;
   }
 
+  while (xpath_cache != NULL) {
+    bind_xpath_t *next = xpath_cache->next;
+    xmlXPathFreeCompExpr(xpath_cache->comp);
+    sfree(xpath_cache->expression);
+    sfree(xpath_cache);
+    xpath_cache = next;
+  }
+
   return 0;
 } /* }}} int bind_shutdown */
 
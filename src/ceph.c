@@ -30,6 +30,7 @@
 
 #include "common.h"
 #include "plugin.h"
+#include "utils_avltree.h"
 
 #include <arpa/inet.h>
 #include <errno.h>
@@ -118,6 +119,8 @@ struct ceph_daemon {
   uint32_t *ds_types;
   /** Track ds names to match with types */
   char **ds_names;
+  /** Maps ds names to their index in ds_names and ds_types */
+  c_avl_tree_t *ds_index;
 
   /**
    * Keep track of last data for latency values so we can calculate rate
@@ -126,6 +129,8 @@ struct ceph_daemon {
   struct last_data **last_poll_data;
   /** index of last poll data */
   int last_idx;
+  /** Maps ds names to their index in last_poll_data */
+  c_avl_tree_t *last_poll_index;
 };
 
 /******* JSON parsing *******/
@@ -166,6 +171,27 @@ static struct ceph_daemon **g_daemons = NULL;
 /** Number of elements in g_daemons */
 static size_t g_num_daemons = 0;
 
+/**
+ * With "ParseThreads", the counter data of the daemons is parsed by that many
+ * threads once all responses have been received. The read callback is one of
+ * them.
+ */
+static int parse_threads_num = 1;
+static pthread_t *parse_workers = NULL;
+static size_t parse_workers_num = 0;
+
+static pthread_mutex_t parse_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t parse_start_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t parse_done_cond = PTHREAD_COND_INITIALIZER;
+static unsigned long parse_generation = 0;
+static size_t parse_busy = 0;
+static _Bool parse_shutdown = 0;
+
+/** The connections being parsed and the next one to parse */
+static struct cconn *parse_io_array = NULL;
+static size_t parse_io_num = 0;
+static size_t parse_next = 0;
+
 /**
  * A set of data that we build up in memory while parsing the JSON.
  */
@@ -238,6 +264,9 @@ struct cconn {
 
   /** Keep data important to yajl processing */
   struct yajl_struct yajl;
+
+  /** The counter data has been read and waits to be parsed */
+  _Bool json_ready;
 };
 
 static int ceph_cb_null(void *ctx) { return CEPH_CB_CONTINUE; }
@@ -386,7 +415,11 @@ static void ceph_daemon_free(struct ceph_daemon *d) {
   sfree(d->last_poll_data);
   d->last_poll_data = NULL;
   d->last_idx = 0;
+  if (d->last_poll_index != NULL)
+    c_avl_destroy(d->last_poll_index);
 
+  if (d->ds_index != NULL)
+    c_avl_destroy(d->ds_index);
   for (int i = 0; i < d->ds_num; i++) {
     sfree(d->ds_names[i]);
   }
@@ -585,6 +618,16 @@ static int ceph_daemon_add_ds_entry(struct ceph_daemon *d, const char *name,
   }
 
   sstrncpy(d->ds_names[d->ds_num], ds_name, DATA_MAX_NAME_LEN - 1);
+
+  if (d->ds_index == NULL) {
+    d->ds_index = c_avl_create((int (*)(const void *, const void *))strcmp);
+    if (d->ds_index == NULL)
+      return -ENOMEM;
+  }
+  /* The first counter of a name wins, just like a linear search would. */
+  c_avl_insert(d->ds_index, d->ds_names[d->ds_num],
+               (void *)(intptr_t)d->ds_num);
+
   d->ds_num = (d->ds_num + 1);
 
   return 0;
@@ -708,6 +751,15 @@ static int ceph_config(oconfig_item_t *ci) {
       if (ret) {
         return ret;
       }
+    } else if (strcasecmp("ParseThreads", child->key) == 0) {
+      ret = cf_util_get_int(child, &parse_threads_num);
+      if (ret) {
+        return ret;
+      }
+      if (parse_threads_num < 1) {
+        ERROR("ceph plugin: ParseThreads must be at least 1.");
+        return -EINVAL;
+      }
     } else {
       WARNING("ceph plugin: ignoring unknown option %s", child->key);
     }
@@ -763,6 +815,16 @@ static int add_last(struct ceph_daemon *d, const char *ds_n, double cur_sum,
            sizeof(d->last_poll_data[d->last_idx]->ds_name));
   d->last_poll_data[d->last_idx]->last_sum = cur_sum;
   d->last_poll_data[d->last_idx]->last_count = cur_count;
+
+  if (d->last_poll_index == NULL) {
+    d->last_poll_index =
+        c_avl_create((int (*)(const void *, const void *))strcmp);
+    if (d->last_poll_index == NULL)
+      return -ENOMEM;
+  }
+  c_avl_insert(d->last_poll_index, d->last_poll_data[d->last_idx]->ds_name,
+               (void *)(intptr_t)d->last_idx);
+
   d->last_idx = (d->last_idx + 1);
   return 0;
 }
@@ -772,7 +834,7 @@ static int add_last(struct ceph_daemon *d, const char *ds_n, double cur_sum,
  */
 static int update_last(struct ceph_daemon *d, const char *ds_n, int index,
                        double cur_sum, uint64_t cur_count) {
-  if ((d->last_idx > index) &&
+  if ((index >= 0) && (d->last_idx > index) &&
       (strcmp(d->last_poll_data[index]->ds_name, ds_n) == 0)) {
     d->last_poll_data[index]->last_sum = cur_sum;
     d->last_poll_data[index]->last_count = cur_count;
@@ -800,12 +862,13 @@ static int update_last(struct ceph_daemon *d, const char *ds_n, int index,
  * get rearranged), resort to searching for counter name
  */
 static int backup_search_for_last_avg(struct ceph_daemon *d, const char *ds_n) {
-  for (int i = 0; i < d->last_idx; i++) {
-    if (strcmp(d->last_poll_data[i]->ds_name, ds_n) == 0) {
-      return i;
-    }
+  void *index;
+
+  if ((d->last_poll_index == NULL) ||
+      (c_avl_get(d->last_poll_index, ds_n, &index) != 0)) {
+    return -1;
   }
-  return -1;
+  return (int)(intptr_t)index;
 }
 
 /**
@@ -850,12 +913,12 @@ static double get_last_avg(struct ceph_daemon *d, const char *ds_n, int index,
  * If using index guess failed, resort to searching for counter name
  */
 static uint32_t backup_search_for_type(struct ceph_daemon *d, char *ds_name) {
-  for (int i = 0; i < d->ds_num; i++) {
-    if (strcmp(d->ds_names[i], ds_name) == 0) {
-      return d->ds_types[i];
-    }
+  void *index;
+
+  if ((d->ds_index == NULL) || (c_avl_get(d->ds_index, ds_name, &index) != 0)) {
+    return DSET_TYPE_UNFOUND;
   }
-  return DSET_TYPE_UNFOUND;
+  return d->ds_types[(intptr_t)index];
 }
 
 /**
@@ -1024,6 +1087,7 @@ static void cconn_close(struct cconn *io) {
   io->json_len = 0;
   sfree(io->json);
   io->json = NULL;
+  io->json_ready = 0;
 }
 
 /* Process incoming JSON counter data */
@@ -1232,6 +1296,15 @@ static int cconn_handle_event(struct cconn *io) {
     }
     io->amt += ret;
     if (io->amt >= io->json_len) {
+      if (io->request_type == ASOK_REQ_DATA) {
+        /* Parsed by cconn_parse_all() once all daemons have responded. */
+        int res;
+        RETRY_ON_EINTR(res, close(io->asok));
+        io->asok = -1;
+        io->json_ready = 1;
+        io->request_type = ASOK_REQ_NONE;
+        return 0;
+      }
       ret = cconn_process_json(io);
       if (ret) {
         return ret;
@@ -1289,6 +1362,124 @@ static int cconn_prepare(struct cconn *io, struct pollfd *fds) {
   }
 }
 
+/** Parse the counter data of connections until none is left. Runs in the read
+ * callback and in all parse threads.
+ */
+static void cconn_parse_run(void) {
+  while (42) {
+    size_t i = __atomic_fetch_add(&parse_next, 1, __ATOMIC_RELAXED);
+    if (i >= parse_io_num) {
+      break;
+    }
+
+    struct cconn *io = parse_io_array + i;
+    if (!io->json_ready) {
+      continue;
+    }
+
+    io->request_type = ASOK_REQ_DATA;
+    int ret = cconn_process_json(io);
+    if (ret) {
+      WARNING("ceph plugin: cconn_process_json(name=%s): error %d",
+              io->d->name, ret);
+    }
+    io->request_type = ASOK_REQ_NONE;
+  }
+}
+
+static void *cconn_parse_worker(__attribute__((unused)) void *arg) {
+  unsigned long generation = 0;
+
+  pthread_mutex_lock(&parse_lock);
+  while (!parse_shutdown) {
+    if (generation == parse_generation) {
+      pthread_cond_wait(&parse_start_cond, &parse_lock);
+      continue;
+    }
+    generation = parse_generation;
+    pthread_mutex_unlock(&parse_lock);
+
+    cconn_parse_run();
+
+    pthread_mutex_lock(&parse_lock);
+    parse_busy--;
+    if (parse_busy == 0) {
+      pthread_cond_signal(&parse_done_cond);
+    }
+  }
+  pthread_mutex_unlock(&parse_lock);
+
+  return NULL;
+}
+
+static void cconn_parse_workers_start(void) {
+  size_t num = (size_t)parse_threads_num;
+  if (num > g_num_daemons) {
+    num = g_num_daemons;
+  }
+  if (num < 2) {
+    return;
+  }
+
+  parse_workers = calloc(num - 1, sizeof(*parse_workers));
+  if (parse_workers == NULL) {
+    ERROR("ceph plugin: calloc failed");
+    return;
+  }
+
+  parse_shutdown = 0;
+  for (size_t i = 1; i < num; i++) {
+    int status = plugin_thread_create(&parse_workers[parse_workers_num],
+                                      /* attr = */ NULL, cconn_parse_worker,
+                                      /* arg = */ NULL, "ceph parse");
+    if (status != 0) {
+      WARNING("ceph plugin: Starting parse thread #%" PRIsz " failed: %s", i,
+              STRERROR(status));
+      break;
+    }
+    parse_workers_num++;
+  }
+}
+
+static void cconn_parse_workers_stop(void) {
+  pthread_mutex_lock(&parse_lock);
+  parse_shutdown = 1;
+  pthread_cond_broadcast(&parse_start_cond);
+  pthread_mutex_unlock(&parse_lock);
+
+  for (size_t i = 0; i < parse_workers_num; i++) {
+    pthread_join(parse_workers[i], /* retval = */ NULL);
+  }
+  sfree(parse_workers);
+  parse_workers_num = 0;
+}
+
+/** Parse the counter data received from all daemons, using the parse threads
+ * if there are any.
+ */
+static void cconn_parse_all(struct cconn *io_array, size_t io_num) {
+  parse_io_array = io_array;
+  parse_io_num = io_num;
+  __atomic_store_n(&parse_next, 0, __ATOMIC_RELAXED);
+
+  pthread_mutex_lock(&parse_lock);
+  parse_busy = parse_workers_num;
+  parse_generation++;
+  pthread_cond_broadcast(&parse_start_cond);
+  pthread_mutex_unlock(&parse_lock);
+
+  cconn_parse_run();
+
+  pthread_mutex_lock(&parse_lock);
+  while (parse_busy > 0) {
+    pthread_cond_wait(&parse_done_cond, &parse_lock);
+  }
+  pthread_mutex_unlock(&parse_lock);
+
+  parse_io_array = NULL;
+  parse_io_num = 0;
+}
+
 /** Returns the difference between two struct timevals in milliseconds.
  * On overflow, we return max/min int.
  */
@@ -1396,6 +1587,10 @@ static int cconn_main_loop(uint32_t request_type) {
     }
   }
 done:
+  /* Responses which arrived before a timeout are parsed as well. */
+  if (request_type == ASOK_REQ_DATA) {
+    cconn_parse_all(io_array, g_num_daemons);
+  }
   for (size_t i = 0; i < g_num_daemons; ++i) {
     cconn_close(io_array + i);
   }
@@ -1434,10 +1629,17 @@ static int ceph_init(void) {
     return ENOENT;
   }
 
-  return cconn_main_loop(ASOK_REQ_VERSION);
+  int ret = cconn_main_loop(ASOK_REQ_VERSION);
+  if (ret) {
+    return ret;
+  }
+
+  cconn_parse_workers_start();
+  return 0;
 }
 
 static int ceph_shutdown(void) {
+  cconn_parse_workers_stop();
   for (size_t i = 0; i < g_num_daemons; ++i) {
     ceph_daemon_free(g_daemons[i]);
   }
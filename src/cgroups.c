@@ -28,80 +28,385 @@
 #include "utils_ignorelist.h"
 #include "utils_mount.h"
 
-static char const *config_keys[] = {"CGroup", "IgnoreSelected"};
+#if HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif
+#if HAVE_SYS_RESOURCE_H
+#include <sys/resource.h>
+#endif
+
+/*
+ * The cgroup tree is kept between reads: the first two levels below the
+ * mount point are held open as directory fds and the files of the cgroups
+ * are read with pread(2) on fds which are opened once. With inotify, the
+ * directories are only listed again when cgroups have been created or
+ * removed in them.
+ */
+typedef enum {
+  CG_CPUACCT_STAT = 0, /* cgroup v1 */
+  CG_CPU_STAT,         /* cgroup v2 */
+  CG_MEMORY_CURRENT,
+  CG_IO_STAT,
+  CG_CPU_PRESSURE,
+  CG_MEMORY_PRESSURE,
+  CG_IO_PRESSURE,
+  CG_FILES_NUM
+} cg_file_t;
+
+static char const *const cg_file_names[CG_FILES_NUM] = {
+    "cpuacct.stat",  "cpu.stat",        "memory.current", "io.stat",
+    "cpu.pressure",  "memory.pressure", "io.pressure",
+};
+
+/* States of cg_node_t.files[] other than an open fd. */
+#define CG_FILE_UNKNOWN -1  /* not opened yet */
+#define CG_FILE_ABSENT -2   /* does not exist, e.g. controller not enabled */
+#define CG_FILE_UNCACHED -3 /* opened on every read, see MaxOpenFiles */
+
+struct cg_node_s;
+typedef struct cg_node_s cg_node_t;
+struct cg_node_s {
+  char *name;
+  /* Directory fd and inotify watch of the mount point and its
+   * sub-directories. Reported cgroups are opened relative to their parent
+   * and have neither. */
+  int fd;
+  int wd;
+  _Bool dirty;
+  int files[CG_FILES_NUM];
+
+  cg_node_t *children;
+  size_t children_num;
+};
+
+static char const *config_keys[] = {"CGroup", "IgnoreSelected",
+                                    "MaxOpenFiles"};
 static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 
 static ignorelist_t *il_cgroup = NULL;
 
+static cu_mount_cache_t *mount_cache = NULL;
+static char *cg_root_path = NULL;
+static _Bool cg_unified = 0;
+static cg_node_t cg_root = {.fd = -1, .wd = -1};
+
+static int cg_inotify_fd = -1;
+
+/* Number of file fds held open and the limit thereof. */
+static size_t cg_files_open = 0;
+static size_t cg_files_max = 0;
+static _Bool cg_files_max_configured = 0;
+
+static long cg_clock_ticks = 100;
+
+#define CG_BATCH_SIZE 256
+static value_list_t cg_batch[CG_BATCH_SIZE];
+static value_t cg_batch_values[CG_BATCH_SIZE][2];
+static size_t cg_batch_num = 0;
+
+static void cg_batch_flush(void) /* {{{ */
+{
+  if (cg_batch_num == 0)
+    return;
+
+  plugin_dispatch_values_batch(cg_batch, cg_batch_num);
+  cg_batch_num = 0;
+} /* }}} void cg_batch_flush */
+
 __attribute__((nonnull(1))) __attribute__((nonnull(2))) static void
-cgroups_submit_one(char const *plugin_instance, char const *type_instance,
-                   value_t value) {
-  value_list_t vl = VALUE_LIST_INIT;
-
-  vl.values = &value;
-  vl.values_len = 1;
-  sstrncpy(vl.plugin, "cgroups", sizeof(vl.plugin));
-  sstrncpy(vl.plugin_instance, plugin_instance, sizeof(vl.plugin_instance));
-  sstrncpy(vl.type, "cpu", sizeof(vl.type));
-  sstrncpy(vl.type_instance, type_instance, sizeof(vl.type_instance));
-
-  plugin_dispatch_values(&vl);
+cgroups_submit(char const *plugin_instance, char const *type,
+               char const *type_instance, value_t const *values,
+               size_t values_len) {
+  value_list_t *vl;
+
+  if (cg_batch_num >= CG_BATCH_SIZE)
+    cg_batch_flush();
+
+  vl = cg_batch + cg_batch_num;
+  *vl = (value_list_t)VALUE_LIST_INIT;
+  vl->values = cg_batch_values[cg_batch_num];
+  memcpy(vl->values, values, values_len * sizeof(*values));
+  vl->values_len = values_len;
+  sstrncpy(vl->plugin, "cgroups", sizeof(vl->plugin));
+  sstrncpy(vl->plugin_instance, plugin_instance, sizeof(vl->plugin_instance));
+  sstrncpy(vl->type, type, sizeof(vl->type));
+  if (type_instance != NULL)
+    sstrncpy(vl->type_instance, type_instance, sizeof(vl->type_instance));
+
+  cg_batch_num++;
+} /* void cgroups_submit */
+
+static void cgroups_submit_one(char const *plugin_instance, char const *type,
+                               char const *type_instance, value_t value) {
+  cgroups_submit(plugin_instance, type, type_instance, &value, 1);
 } /* void cgroups_submit_one */
 
-/*
- * This callback reads the user/system CPU time for each cgroup.
- */
-static int read_cpuacct_procs(const char *dirname, char const *cgroup_name,
-                              void *user_data) {
-  char abs_path[PATH_MAX];
-  struct stat statbuf;
-  char buf[1024];
-  int status;
+static void cg_node_init(cg_node_t *node, char const *name) /* {{{ */
+{
+  memset(node, 0, sizeof(*node));
+  node->name = (name != NULL) ? strdup(name) : NULL;
+  node->fd = -1;
+  node->wd = -1;
+  node->dirty = 1;
+  for (size_t i = 0; i < CG_FILES_NUM; i++)
+    node->files[i] = CG_FILE_UNKNOWN;
+} /* }}} void cg_node_init */
+
+static void cg_node_reset(cg_node_t *node) /* {{{ */
+{
+  for (size_t i = 0; i < node->children_num; i++)
+    cg_node_reset(node->children + i);
+  sfree(node->children);
+  node->children_num = 0;
+
+  for (size_t i = 0; i < CG_FILES_NUM; i++) {
+    if (node->files[i] >= 0) {
+      close(node->files[i]);
+      cg_files_open--;
+    }
+    node->files[i] = CG_FILE_UNKNOWN;
+  }
+
+#if HAVE_SYS_INOTIFY_H
+  /* Fails if the directory is gone, in which case the kernel has removed the
+   * watch already. */
+  if ((node->wd >= 0) && (cg_inotify_fd >= 0))
+    inotify_rm_watch(cg_inotify_fd, node->wd);
+#endif
+  node->wd = -1;
+
+  if (node->fd >= 0)
+    close(node->fd);
+  node->fd = -1;
+
+  sfree(node->name);
+} /* }}} void cg_node_reset */
+
+static void cg_node_watch(cg_node_t *node, char const *path) /* {{{ */
+{
+#if HAVE_SYS_INOTIFY_H
+  if (cg_inotify_fd < 0)
+    return;
+
+  node->wd = inotify_add_watch(cg_inotify_fd, path,
+                               IN_CREATE | IN_DELETE | IN_MOVED_FROM |
+                                   IN_MOVED_TO | IN_ONLYDIR);
+  if (node->wd < 0)
+    WARNING("cgroups plugin: inotify_add_watch (\"%s\") failed: %s", path,
+            STRERRNO);
+#endif
+} /* }}} void cg_node_watch */
+
+static int cg_node_compare(void const *a, void const *b) /* {{{ */
+{
+  return strcmp(((cg_node_t const *)a)->name, ((cg_node_t const *)b)->name);
+} /* }}} int cg_node_compare */
+
+/* Lists the sub-directories of `node' again. Children which still exist are
+ * kept, including their open fds. `depth' is zero for the mount point. */
+static int cg_node_scan(cg_node_t *node, char const *path, /* {{{ */
+                        int depth) {
+  cg_node_t *children = NULL;
+  size_t children_num = 0;
+  size_t children_size = 0;
+  _Bool *kept = NULL;
+  struct dirent *ent;
+  DIR *dh;
+  int fd;
+
+  if (node->children_num > 0) {
+    kept = calloc(node->children_num, sizeof(*kept));
+    if (kept == NULL) {
+      ERROR("cgroups plugin: calloc failed.");
+      return -1;
+    }
+  }
 
-  FILE *fh;
+  fd = openat(node->fd, ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0) {
+    ERROR("cgroups plugin: open (\"%s\") failed: %s", path, STRERRNO);
+    sfree(kept);
+    return -1;
+  }
 
-  if (ignorelist_match(il_cgroup, cgroup_name))
-    return 0;
+  dh = fdopendir(fd);
+  if (dh == NULL) {
+    ERROR("cgroups plugin: fdopendir (\"%s\") failed: %s", path, STRERRNO);
+    close(fd);
+    sfree(kept);
+    return -1;
+  }
+
+  while ((ent = readdir(dh)) != NULL) {
+    cg_node_t key = {.name = ent->d_name};
+    cg_node_t *old;
+    cg_node_t *child;
 
-  snprintf(abs_path, sizeof(abs_path), "%s/%s", dirname, cgroup_name);
+    if (ent->d_name[0] == '.')
+      continue;
+
+    if (ent->d_type == DT_UNKNOWN) {
+      struct stat statbuf;
+      if ((fstatat(node->fd, ent->d_name, &statbuf, AT_SYMLINK_NOFOLLOW) !=
+           0) ||
+          !S_ISDIR(statbuf.st_mode))
+        continue;
+    } else if (ent->d_type != DT_DIR) {
+      continue;
+    }
 
-  status = lstat(abs_path, &statbuf);
-  if (status != 0) {
-    ERROR("cgroups plugin: stat (\"%s\") failed.", abs_path);
+    if ((depth > 0) && ignorelist_match(il_cgroup, ent->d_name))
+      continue;
+
+    if (children_num >= children_size) {
+      size_t new_size = (children_size == 0) ? 16 : 2 * children_size;
+      cg_node_t *tmp = realloc(children, new_size * sizeof(*tmp));
+      if (tmp == NULL) {
+        ERROR("cgroups plugin: realloc failed.");
+        break;
+      }
+      children = tmp;
+      children_size = new_size;
+    }
+    child = children + children_num;
+
+    old = NULL;
+    if (node->children_num > 0)
+      old = bsearch(&key, node->children, node->children_num,
+                    sizeof(*node->children), cg_node_compare);
+    if (old != NULL) {
+      /* Move the existing node over, including its name. */
+      *child = *old;
+      kept[old - node->children] = 1;
+
+      /* Controllers may have been enabled since the files were looked
+       * for. */
+      for (size_t i = 0; i < CG_FILES_NUM; i++)
+        if (child->files[i] == CG_FILE_ABSENT)
+          child->files[i] = CG_FILE_UNKNOWN;
+
+      children_num++;
+      continue;
+    }
+
+    cg_node_init(child, ent->d_name);
+    if (child->name == NULL) {
+      ERROR("cgroups plugin: strdup failed.");
+      break;
+    }
+
+    if (depth == 0) {
+      char child_path[PATH_MAX];
+
+      child->fd = openat(node->fd, ent->d_name,
+                         O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+      if (child->fd < 0) {
+        /* Removed in the meantime. */
+        sfree(child->name);
+        continue;
+      }
+
+      snprintf(child_path, sizeof(child_path), "%s/%s", path, ent->d_name);
+      cg_node_watch(child, child_path);
+    }
+
+    children_num++;
+  }
+
+  closedir(dh);
+
+  /* Children which are gone. */
+  for (size_t i = 0; i < node->children_num; i++)
+    if (!kept[i])
+      cg_node_reset(node->children + i);
+  sfree(node->children);
+  sfree(kept);
+
+  if (children_num > 0)
+    qsort(children, children_num, sizeof(*children), cg_node_compare);
+  node->children = children;
+  node->children_num = children_num;
+  node->dirty = 0;
+
+  return 0;
+} /* }}} int cg_node_scan */
+
+/* Reads file `file' of the cgroup `node' into `buffer'. Returns the number of
+ * bytes read or a negative value if the file cannot be read. */
+static ssize_t cg_node_read(cg_node_t *parent, cg_node_t *node, /* {{{ */
+                            cg_file_t file, char *buffer,
+                            size_t buffer_size) {
+  int fd = node->files[file];
+  ssize_t status;
+
+  if (fd == CG_FILE_ABSENT)
     return -1;
+
+  if (fd < 0) {
+    char path[PATH_MAX];
+
+    snprintf(path, sizeof(path), "%s/%s", node->name, cg_file_names[file]);
+    fd = openat(parent->fd, path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      /* Files of controllers which are not enabled do not exist. If the
+       * cgroup itself is gone, inotify has told us already. */
+      if (errno == ENOENT)
+        node->files[file] = CG_FILE_ABSENT;
+      else
+        parent->dirty = 1;
+      return -1;
+    }
+
+    if ((node->files[file] == CG_FILE_UNKNOWN) &&
+        (cg_files_open < cg_files_max)) {
+      node->files[file] = fd;
+      cg_files_open++;
+    } else {
+      node->files[file] = CG_FILE_UNCACHED;
+    }
   }
 
-  /* We are only interested in directories, so skip everything else. */
-  if (!S_ISDIR(statbuf.st_mode))
-    return 0;
+  status = pread(fd, buffer, buffer_size - 1, 0);
+  if (node->files[file] == CG_FILE_UNCACHED)
+    close(fd);
 
-  snprintf(abs_path, sizeof(abs_path), "%s/%s/cpuacct.stat", dirname,
-           cgroup_name);
-  fh = fopen(abs_path, "r");
-  if (fh == NULL) {
-    ERROR("cgroups plugin: fopen (\"%s\") failed: %s", abs_path, STRERRNO);
+  if (status < 0) {
+    /* ENODEV is returned once the cgroup has been removed. */
+    if (errno != ENODEV)
+      ERROR("cgroups plugin: reading \"%s/%s\" failed: %s", node->name,
+            cg_file_names[file], STRERRNO);
+    parent->dirty = 1;
     return -1;
   }
 
-  while (fgets(buf, sizeof(buf), fh) != NULL) {
+  buffer[status] = 0;
+  return status;
+} /* }}} ssize_t cg_node_read */
+
+/*
+ * Expected format of cpuacct.stat:
+ *
+ *   user: 12345
+ *   system: 23456
+ *
+ * Or:
+ *
+ *   user 12345
+ *   system 23456
+ */
+static void cg_read_cpuacct_stat(char const *name, char *buffer) /* {{{ */
+{
+  char *saveptr = NULL;
+
+  for (char *line = strtok_r(buffer, "\n", &saveptr); line != NULL;
+       line = strtok_r(NULL, "\n", &saveptr)) {
     char *fields[8];
-    int numfields = 0;
+    int numfields;
     char *key;
     size_t key_len;
     value_t value;
 
-    /* Expected format:
-     *
-     *   user: 12345
-     *   system: 23456
-     *
-     * Or:
-     *
-     *   user 12345
-     *   system 23456
-     */
-    strstripnewline(buf);
-    numfields = strsplit(buf, fields, STATIC_ARRAY_SIZE(fields));
+    numfields = strsplit(line, fields, STATIC_ARRAY_SIZE(fields));
     if (numfields != 2)
       continue;
 
@@ -114,55 +419,290 @@ static int read_cpuacct_procs(const char *dirname, char const *cgroup_name,
     if (key[key_len - 1] == ':')
       key[key_len - 1] = 0;
 
-    status = parse_value(fields[1], &value, DS_TYPE_DERIVE);
-    if (status != 0)
+    if (parse_value(fields[1], &value, DS_TYPE_DERIVE) != 0)
       continue;
 
-    cgroups_submit_one(cgroup_name, key, value);
+    cgroups_submit_one(name, "cpu", key, value);
   }
+} /* }}} void cg_read_cpuacct_stat */
+
+/* cpu.stat reports microseconds ("user_usec 12345"). They are converted to
+ * clock ticks, the unit of cpuacct.stat, so the values are comparable. */
+static void cg_read_cpu_stat(char const *name, char *buffer) /* {{{ */
+{
+  char *saveptr = NULL;
+
+  for (char *line = strtok_r(buffer, "\n", &saveptr); line != NULL;
+       line = strtok_r(NULL, "\n", &saveptr)) {
+    char *fields[4];
+    char const *type_instance;
+    value_t value;
 
-  fclose(fh);
-  return 0;
-} /* int read_cpuacct_procs */
+    if (strsplit(line, fields, STATIC_ARRAY_SIZE(fields)) != 2)
+      continue;
 
-/*
- * Gets called for every file/folder in /sys/fs/cgroup/cpu,cpuacct (or
- * wherever cpuacct is mounted on the system). Calls walk_directory with the
- * read_cpuacct_procs callback on every folder it finds, such as "system".
- */
-static int read_cpuacct_root(const char *dirname, const char *filename,
-                             void *user_data) {
-  char abs_path[PATH_MAX];
-  struct stat statbuf;
-  int status;
+    if (strcmp(fields[0], "user_usec") == 0)
+      type_instance = "user";
+    else if (strcmp(fields[0], "system_usec") == 0)
+      type_instance = "system";
+    else
+      continue;
+
+    if (parse_value(fields[1], &value, DS_TYPE_DERIVE) != 0)
+      continue;
+    value.derive = value.derive / 1000000 * cg_clock_ticks +
+                   value.derive % 1000000 * cg_clock_ticks / 1000000;
+
+    cgroups_submit_one(name, "cpu", type_instance, value);
+  }
+} /* }}} void cg_read_cpu_stat */
+
+/* io.stat has one line per device:
+ *   8:0 rbytes=90430464 wbytes=299008000 rios=8950 wios=1252 dbytes=0 dios=0
+ * The counters are summed up over all devices. */
+static void cg_read_io_stat(char const *name, char *buffer) /* {{{ */
+{
+  value_t octets[2] = {{.derive = 0}, {.derive = 0}};
+  value_t ops[2] = {{.derive = 0}, {.derive = 0}};
+  char *saveptr = NULL;
+  _Bool found = 0;
+
+  for (char *line = strtok_r(buffer, "\n", &saveptr); line != NULL;
+       line = strtok_r(NULL, "\n", &saveptr)) {
+    char *fields[16];
+    int numfields;
+
+    numfields = strsplit(line, fields, STATIC_ARRAY_SIZE(fields));
+    for (int i = 1; i < numfields; i++) {
+      char *value = strchr(fields[i], '=');
+      value_t *dst;
+
+      if (value == NULL)
+        continue;
+      *value = 0;
+      value++;
+
+      if (strcmp(fields[i], "rbytes") == 0)
+        dst = octets + 0;
+      else if (strcmp(fields[i], "wbytes") == 0)
+        dst = octets + 1;
+      else if (strcmp(fields[i], "rios") == 0)
+        dst = ops + 0;
+      else if (strcmp(fields[i], "wios") == 0)
+        dst = ops + 1;
+      else
+        continue;
+
+      dst->derive += (derive_t)strtoull(value, NULL, 10);
+      found = 1;
+    }
+  }
+
+  if (!found)
+    return;
+
+  cgroups_submit(name, "disk_octets", NULL, octets, STATIC_ARRAY_SIZE(octets));
+  cgroups_submit(name, "disk_ops", NULL, ops, STATIC_ARRAY_SIZE(ops));
+} /* }}} void cg_read_io_stat */
+
+/* Pressure stall information:
+ *   some avg10=0.00 avg60=0.00 avg300=0.00 total=1234567
+ *   full avg10=0.00 avg60=0.00 avg300=0.00 total=1234567
+ * The total stall time, in microseconds, is reported in milliseconds. */
+static void cg_read_pressure(char const *name, char const *resource, /* {{{ */
+                             char *buffer) {
+  char *saveptr = NULL;
+
+  for (char *line = strtok_r(buffer, "\n", &saveptr); line != NULL;
+       line = strtok_r(NULL, "\n", &saveptr)) {
+    char *fields[8];
+    int numfields;
+    char type_instance[DATA_MAX_NAME_LEN];
+
+    numfields = strsplit(line, fields, STATIC_ARRAY_SIZE(fields));
+    for (int i = 1; i < numfields; i++) {
+      if (strncmp(fields[i], "total=", strlen("total=")) != 0)
+        continue;
+
+      snprintf(type_instance, sizeof(type_instance), "%s-%s", resource,
+               fields[0]);
+      cgroups_submit_one(
+          name, "total_time_in_ms", type_instance,
+          (value_t){.derive = (derive_t)strtoull(fields[i] + strlen("total="),
+                                                 NULL, 10) /
+                              1000});
+      break;
+    }
+  }
+} /* }}} void cg_read_pressure */
+
+static void cg_read_cgroup(cg_node_t *parent, cg_node_t *node) /* {{{ */
+{
+  char buffer[8192];
+
+  if (!cg_unified) {
+    if (cg_node_read(parent, node, CG_CPUACCT_STAT, buffer, sizeof(buffer)) >=
+        0)
+      cg_read_cpuacct_stat(node->name, buffer);
+    return;
+  }
+
+  if (cg_node_read(parent, node, CG_CPU_STAT, buffer, sizeof(buffer)) >= 0)
+    cg_read_cpu_stat(node->name, buffer);
+
+  if (cg_node_read(parent, node, CG_MEMORY_CURRENT, buffer, sizeof(buffer)) >=
+      0) {
+    value_t value;
+    if (parse_value(buffer, &value, DS_TYPE_GAUGE) == 0)
+      cgroups_submit_one(node->name, "memory", "used", value);
+  }
 
-  snprintf(abs_path, sizeof(abs_path), "%s/%s", dirname, filename);
+  if (cg_node_read(parent, node, CG_IO_STAT, buffer, sizeof(buffer)) >= 0)
+    cg_read_io_stat(node->name, buffer);
+
+  if (cg_node_read(parent, node, CG_CPU_PRESSURE, buffer, sizeof(buffer)) >= 0)
+    cg_read_pressure(node->name, "cpu", buffer);
+  if (cg_node_read(parent, node, CG_MEMORY_PRESSURE, buffer,
+                   sizeof(buffer)) >= 0)
+    cg_read_pressure(node->name, "memory", buffer);
+  if (cg_node_read(parent, node, CG_IO_PRESSURE, buffer, sizeof(buffer)) >= 0)
+    cg_read_pressure(node->name, "io", buffer);
+} /* }}} void cg_read_cgroup */
+
+/* Marks the directories in which cgroups have been created or removed. */
+static void cg_process_events(void) /* {{{ */
+{
+#if HAVE_SYS_INOTIFY_H
+  char buffer[4096]
+      __attribute__((aligned(__alignof__(struct inotify_event))));
+
+  while (cg_inotify_fd >= 0) {
+    ssize_t len = read(cg_inotify_fd, buffer, sizeof(buffer));
+    if (len <= 0) {
+      if ((len < 0) && (errno == EINTR))
+        continue;
+      return;
+    }
+
+    for (char *ptr = buffer; ptr < buffer + len;) {
+      struct inotify_event const *ev = (void *)ptr;
+      ptr += sizeof(*ev) + ev->len;
+
+      if (ev->mask & IN_Q_OVERFLOW) {
+        cg_root.dirty = 1;
+        for (size_t i = 0; i < cg_root.children_num; i++)
+          cg_root.children[i].dirty = 1;
+        continue;
+      }
+
+      if (!(ev->mask & IN_ISDIR))
+        continue;
+
+      if (ev->wd == cg_root.wd) {
+        cg_root.dirty = 1;
+        continue;
+      }
+      for (size_t i = 0; i < cg_root.children_num; i++) {
+        if (cg_root.children[i].wd == ev->wd) {
+          cg_root.children[i].dirty = 1;
+          break;
+        }
+      }
+    }
+  }
+#endif
+} /* }}} void cg_process_events */
+
+/* Looks up the cgroup mount point. The cpuacct hierarchy of cgroup v1 is
+ * preferred over the unified hierarchy, which on hybrid systems usually has
+ * no controllers. */
+static int cg_select_mount(cu_mount_t *mnt_list) /* {{{ */
+{
+  cu_mount_t *v1 = NULL;
+  cu_mount_t *v2 = NULL;
+  cu_mount_t *mnt;
+
+  for (cu_mount_t *mnt_ptr = mnt_list; mnt_ptr != NULL;
+       mnt_ptr = mnt_ptr->next) {
+    if ((v1 == NULL) && (strcmp(mnt_ptr->type, "cgroup") == 0) &&
+        cu_mount_checkoption(mnt_ptr->options, "cpuacct", /* full = */ 1))
+      v1 = mnt_ptr;
+    else if ((v2 == NULL) && (strcmp(mnt_ptr->type, "cgroup2") == 0))
+      v2 = mnt_ptr;
+  }
+
+  mnt = (v1 != NULL) ? v1 : v2;
+  if (mnt == NULL) {
+    WARNING("cgroups plugin: Unable to find cgroup "
+            "mount-point with the \"cpuacct\" option or a cgroup2 "
+            "mount-point.");
+    return -1;
+  }
+
+  if ((cg_root_path != NULL) && (strcmp(cg_root_path, mnt->dir) == 0) &&
+      (cg_root.fd >= 0))
+    return 0;
 
-  status = lstat(abs_path, &statbuf);
-  if (status != 0) {
-    ERROR("cgroups plugin: stat (%s) failed.", abs_path);
+  /* cg_root is initialized along with cg_root_path. */
+  if (cg_root_path != NULL)
+    cg_node_reset(&cg_root);
+  sfree(cg_root_path);
+
+  cg_root_path = strdup(mnt->dir);
+  if (cg_root_path == NULL) {
+    ERROR("cgroups plugin: strdup failed.");
     return -1;
   }
+  cg_unified = (mnt == v2);
 
-  if (S_ISDIR(statbuf.st_mode)) {
-    status = walk_directory(abs_path, read_cpuacct_procs,
-                            /* user_data = */ NULL,
-                            /* include_hidden = */ 0);
-    return status;
+  cg_node_init(&cg_root, NULL);
+  cg_root.fd = open(cg_root_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (cg_root.fd < 0) {
+    ERROR("cgroups plugin: open (\"%s\") failed: %s", cg_root_path,
+          STRERRNO);
+    return -1;
   }
+  cg_node_watch(&cg_root, cg_root_path);
 
   return 0;
-}
+} /* }}} int cg_select_mount */
 
 static int cgroups_init(void) {
   if (il_cgroup == NULL)
     il_cgroup = ignorelist_create(1);
 
+  cg_clock_ticks = sysconf(_SC_CLK_TCK);
+  if (cg_clock_ticks <= 0)
+    cg_clock_ticks = 100;
+
+  /* By default, at most a quarter of the fds this process may open are used
+   * for caching cgroup files. */
+  if (!cg_files_max_configured) {
+    cg_files_max = 256;
+#if HAVE_SYS_RESOURCE_H
+    struct rlimit rl;
+    if ((getrlimit(RLIMIT_NOFILE, &rl) == 0) &&
+        (rl.rlim_cur != RLIM_INFINITY))
+      cg_files_max = (size_t)(rl.rlim_cur / 4);
+#endif
+  }
+
+#if HAVE_SYS_INOTIFY_H
+  if (cg_inotify_fd < 0) {
+    cg_inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (cg_inotify_fd < 0)
+      WARNING("cgroups plugin: inotify_init1 failed, the cgroup tree will be "
+              "listed on every read: %s",
+              STRERRNO);
+  }
+#endif
+
   return 0;
 }
 
 static int cgroups_config(const char *key, const char *value) {
-  cgroups_init();
+  if (il_cgroup == NULL)
+    il_cgroup = ignorelist_create(1);
 
   if (strcasecmp(key, "CGroup") == 0) {
     if (ignorelist_add(il_cgroup, value))
@@ -174,51 +714,99 @@ static int cgroups_config(const char *key, const char *value) {
     else
       ignorelist_set_invert(il_cgroup, 1);
     return 0;
+  } else if (strcasecmp(key, "MaxOpenFiles") == 0) {
+    int tmp = atoi(value);
+    if (tmp < 0) {
+      WARNING("cgroups plugin: MaxOpenFiles must not be negative.");
+      return 1;
+    }
+    cg_files_max = (size_t)tmp;
+    cg_files_max_configured = 1;
+    return 0;
   }
 
   return -1;
 }
 
 static int cgroups_read(void) {
-  cu_mount_t *mnt_list = NULL;
-  _Bool cgroup_found = 0;
+  cu_mount_t *mnt_list;
+  _Bool changed = 0;
+
+  if (mount_cache == NULL) {
+    mount_cache = cu_mount_cache_create();
+    if (mount_cache == NULL) {
+      ERROR("cgroups plugin: cu_mount_cache_create failed.");
+      return -1;
+    }
+  }
 
-  if (cu_mount_getlist(&mnt_list) == NULL) {
+  mnt_list = cu_mount_cache_get(mount_cache, &changed);
+  if (mnt_list == NULL) {
     ERROR("cgroups plugin: cu_mount_getlist failed.");
     return -1;
   }
 
-  for (cu_mount_t *mnt_ptr = mnt_list; mnt_ptr != NULL;
-       mnt_ptr = mnt_ptr->next) {
-    /* Find the cgroup mountpoint which contains the cpuacct
-     * controller. */
-    if ((strcmp(mnt_ptr->type, "cgroup") != 0) ||
-        !cu_mount_checkoption(mnt_ptr->options, "cpuacct", /* full = */ 1))
-      continue;
+  if ((changed || (cg_root.fd < 0)) && (cg_select_mount(mnt_list) != 0))
+    return -1;
 
-    walk_directory(mnt_ptr->dir, read_cpuacct_root,
-                   /* user_data = */ NULL,
-                   /* include_hidden = */ 0);
-    cgroup_found = 1;
-    /* It doesn't make sense to check other cpuacct mount-points
-     * (if any), they contain the same data. */
-    break;
+  if (cg_inotify_fd < 0) {
+    cg_root.dirty = 1;
+    for (size_t i = 0; i < cg_root.children_num; i++)
+      cg_root.children[i].dirty = 1;
+  } else {
+    cg_process_events();
   }
 
-  cu_mount_freelist(mnt_list);
-
-  if (!cgroup_found) {
-    WARNING("cgroups plugin: Unable to find cgroup "
-            "mount-point with the \"cpuacct\" option.");
+  if (cg_root.dirty && (cg_node_scan(&cg_root, cg_root_path, 0) != 0))
     return -1;
+
+  for (size_t i = 0; i < cg_root.children_num; i++) {
+    cg_node_t *dir = cg_root.children + i;
+
+    if (dir->dirty) {
+      char path[PATH_MAX];
+
+      snprintf(path, sizeof(path), "%s/%s", cg_root_path, dir->name);
+      if (cg_node_scan(dir, path, 1) != 0) {
+        cg_root.dirty = 1;
+        continue;
+      }
+    }
+
+    for (size_t j = 0; j < dir->children_num; j++)
+      cg_read_cgroup(dir, dir->children + j);
   }
 
+  cg_batch_flush();
+
+  return 0;
+} /* int cgroups_read */
+
+static int cgroups_shutdown(void) {
+  if (cg_root_path != NULL)
+    cg_node_reset(&cg_root);
+  sfree(cg_root_path);
+
+#if HAVE_SYS_INOTIFY_H
+  if (cg_inotify_fd >= 0) {
+    close(cg_inotify_fd);
+    cg_inotify_fd = -1;
+  }
+#endif
+
+  cu_mount_cache_destroy(mount_cache);
+  mount_cache = NULL;
+
+  ignorelist_free(il_cgroup);
+  il_cgroup = NULL;
+
   return 0;
-} /* int cgroup_read */
+} /* int cgroups_shutdown */
 
 void module_register(void) {
   plugin_register_config("cgroups", cgroups_config, config_keys,
                          config_keys_num);
   plugin_register_init("cgroups", cgroups_init);
   plugin_register_read("cgroups", cgroups_read);
+  plugin_register_shutdown("cgroups", cgroups_shutdown);
 } /* void module_register */
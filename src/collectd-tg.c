@@ -33,11 +33,14 @@
 #endif
 
 #include <errno.h>
+#include <inttypes.h>
 #include <math.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <sys/time.h>
 #include <time.h>
 #include <unistd.h>
@@ -51,17 +54,37 @@
 #define DEF_NUM_PLUGINS 20
 #define DEF_NUM_VALUES 100000
 #define DEF_INTERVAL 10.0
+#define DEF_NUM_THREADS 1
+#define DEF_SOCK "unix:" LOCALSTATEDIR "/run/" PACKAGE_NAME "-unixsock"
 
 static int conf_num_hosts = DEF_NUM_HOSTS;
 static int conf_num_plugins = DEF_NUM_PLUGINS;
 static int conf_num_values = DEF_NUM_VALUES;
+static int conf_num_threads = DEF_NUM_THREADS;
 static double conf_interval = DEF_INTERVAL;
-static const char *conf_destination = NET_DEFAULT_V6_ADDR;
+static double conf_rate = 0.0;
+static _Bool conf_unixsock = 0;
+static const char *conf_destination = NULL;
 static const char *conf_service = NET_DEFAULT_PORT;
 
-static lcc_network_t *net;
+/* Each sender thread owns a share of the value lists and its own
+ * connection, so that threads never contend with each other. */
+struct sender_s {
+  pthread_t thread;
+  c_heap_t *values_heap;
+  lcc_network_t *net;
+  lcc_connection_t *con;
+  int num_values;
 
-static c_heap_t *values_heap = NULL;
+  /* How far the thread fell behind its schedule, in seconds. */
+  double max_lag;
+};
+typedef struct sender_s sender_t;
+
+static sender_t *senders = NULL;
+
+static uint64_t values_sent = 0;
+static uint64_t values_failed = 0;
 
 static struct sigaction sigint_action;
 static struct sigaction sigterm_action;
@@ -81,8 +104,14 @@ __attribute__((noreturn)) static void exit_usage(int exit_status) /* {{{ */
       "    -H <number>    Number of hosts to emulate. (Default: %i)\n"
       "    -p <number>    Number of plugins to emulate. (Default: %i)\n"
       "    -i <seconds>   Interval of each value in seconds. (Default: %.3f)\n"
-      "    -d <dest>      Destination address of the network packets.\n"
-      "                   (Default: %s)\n"
+      "    -r <rate>      Send this many values per second in total, ignoring\n"
+      "                   the interval. (Default: off)\n"
+      "    -T <number>    Number of sender threads. (Default: %i)\n"
+      "    -m <mode>      Protocol to use, \"network\" or \"unixsock\".\n"
+      "                   (Default: network)\n"
+      "    -d <dest>      Destination address of the network packets, or\n"
+      "                   the address of the unixsock plugin's socket.\n"
+      "                   (Default: %s or %s)\n"
       "    -D <port>      Destination port of the network packets.\n"
       "                   (Default: %s)\n"
       "    -h             Print usage information (this output).\n"
@@ -90,7 +119,7 @@ __attribute__((noreturn)) static void exit_usage(int exit_status) /* {{{ */
       "Copyright (C) 2010-2012  Florian Forster\n"
       "Licensed under the MIT license.\n",
       DEF_NUM_VALUES, DEF_NUM_HOSTS, DEF_NUM_PLUGINS, DEF_INTERVAL,
-      NET_DEFAULT_V6_ADDR, NET_DEFAULT_PORT);
+      DEF_NUM_THREADS, NET_DEFAULT_V6_ADDR, DEF_SOCK, NET_DEFAULT_PORT);
   exit(exit_status);
 } /* }}} void exit_usage */
 
@@ -211,7 +240,18 @@ static void destroy_value_list(lcc_value_list_t *vl) /* {{{ */
   free(vl);
 } /* }}} void destroy_value_list */
 
-static int send_value(lcc_value_list_t *vl) /* {{{ */
+static void putval_callback(lcc_connection_t *c, int status, /* {{{ */
+                            const char *message, char **lines,
+                            size_t lines_num, void *user_data) {
+  if (status == 0)
+    return;
+
+  if (__atomic_fetch_add(&values_failed, 1, __ATOMIC_RELAXED) == 0)
+    fprintf(stderr, "PUTVAL failed with status %i: %s\n", status,
+            (message != NULL) ? message : lcc_strerror(c));
+} /* }}} void putval_callback */
+
+static int send_value(sender_t *s, lcc_value_list_t *vl) /* {{{ */
 {
   int status;
 
@@ -221,9 +261,21 @@ static int send_value(lcc_value_list_t *vl) /* {{{ */
   else
     vl->values[0].derive += (derive_t)get_boundet_random(0, 100);
 
-  status = lcc_network_values_send(net, vl);
+  if (s->con != NULL) {
+    status = lcc_pipeline_putval(s->con, vl, putval_callback, NULL);
+    if (status != 0)
+      fprintf(stderr, "lcc_pipeline_putval failed: %s\n",
+              lcc_strerror(s->con));
+  } else {
+    status = lcc_network_values_send(s->net, vl);
+    if (status != 0)
+      fprintf(stderr, "lcc_network_values_send failed with status %i.\n",
+              status);
+  }
+
   if (status != 0)
-    fprintf(stderr, "lcc_network_values_send failed with status %i.\n", status);
+    __atomic_fetch_add(&values_failed, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&values_sent, 1, __ATOMIC_RELAXED);
 
   vl->time += vl->interval;
 
@@ -282,7 +334,7 @@ static int read_options(int argc, char **argv) /* {{{ */
 {
   int opt;
 
-  while ((opt = getopt(argc, argv, "n:H:p:i:d:D:h")) != -1) {
+  while ((opt = getopt(argc, argv, "n:H:p:i:r:T:m:d:D:h")) != -1) {
     switch (opt) {
     case 'n':
       get_integer_opt(optarg, &conf_num_values);
@@ -300,6 +352,23 @@ static int read_options(int argc, char **argv) /* {{{ */
       get_double_opt(optarg, &conf_interval);
       break;
 
+    case 'r':
+      get_double_opt(optarg, &conf_rate);
+      break;
+
+    case 'T':
+      get_integer_opt(optarg, &conf_num_threads);
+      break;
+
+    case 'm':
+      if (strcasecmp("unixsock", optarg) == 0)
+        conf_unixsock = 1;
+      else if (strcasecmp("network", optarg) == 0)
+        conf_unixsock = 0;
+      else
+        exit_usage(EXIT_FAILURE);
+      break;
+
     case 'd':
       conf_destination = optarg;
       break;
@@ -316,39 +385,64 @@ static int read_options(int argc, char **argv) /* {{{ */
     } /* switch (opt) */
   }   /* while (getopt) */
 
+  if ((conf_num_threads < 1) || (conf_num_values < conf_num_threads)) {
+    fprintf(stderr, "Need at least one value list per thread.\n");
+    exit(EXIT_FAILURE);
+  }
+  if (conf_rate < 0.0) {
+    fprintf(stderr, "The rate must not be negative.\n");
+    exit(EXIT_FAILURE);
+  }
+
+  if (conf_destination == NULL)
+    conf_destination = conf_unixsock ? DEF_SOCK : NET_DEFAULT_V6_ADDR;
+
   return 0;
 } /* }}} int read_options */
 
-int main(int argc, char **argv) /* {{{ */
+static void sleep_until(double when) /* {{{ */
 {
-  double last_time;
-  int values_sent = 0;
-
-  read_options(argc, argv);
-
-  sigint_action.sa_handler = signal_handler;
-  sigaction(SIGINT, &sigint_action, /* old = */ NULL);
-
-  sigterm_action.sa_handler = signal_handler;
-  sigaction(SIGTERM, &sigterm_action, /* old = */ NULL);
+  double now = dtime();
+
+  while (loop && (now < when)) {
+    /* Wake up regularly to notice a signal caught by another thread. */
+    double diff = (when - now < 0.1) ? when - now : 0.1;
+    struct timespec ts = {
+        .tv_sec = (time_t)diff,
+    };
+    ts.tv_nsec = (long)((diff - ((double)ts.tv_sec)) * 1e9);
+
+    nanosleep(&ts, /* remaining = */ NULL);
+    now = dtime();
+  }
+} /* }}} void sleep_until */
 
-  values_heap = c_heap_create(compare_time);
-  if (values_heap == NULL) {
+static int sender_init(sender_t *s) /* {{{ */
+{
+  s->values_heap = c_heap_create(compare_time);
+  if (s->values_heap == NULL) {
     fprintf(stderr, "c_heap_create failed.\n");
-    exit(EXIT_FAILURE);
+    return -1;
   }
 
-  net = lcc_network_create();
-  if (net == NULL) {
-    fprintf(stderr, "lcc_network_create failed.\n");
-    exit(EXIT_FAILURE);
+  if (conf_unixsock) {
+    if (lcc_connect(conf_destination, &s->con) != 0) {
+      fprintf(stderr, "Unable to connect to \"%s\".\n", conf_destination);
+      return -1;
+    }
   } else {
     lcc_server_t *srv;
 
-    srv = lcc_server_create(net, conf_destination, conf_service);
+    s->net = lcc_network_create();
+    if (s->net == NULL) {
+      fprintf(stderr, "lcc_network_create failed.\n");
+      return -1;
+    }
+
+    srv = lcc_server_create(s->net, conf_destination, conf_service);
     if (srv == NULL) {
       fprintf(stderr, "lcc_server_create failed.\n");
-      exit(EXIT_FAILURE);
+      return -1;
     }
 
     lcc_server_set_ttl(srv, 42);
@@ -358,67 +452,173 @@ int main(int argc, char **argv) /* {{{ */
 #endif
   }
 
-  fprintf(stdout, "Creating %i values ... ", conf_num_values);
-  fflush(stdout);
-  for (int i = 0; i < conf_num_values; i++) {
+  for (int i = 0; i < s->num_values; i++) {
     lcc_value_list_t *vl;
 
     vl = create_value_list();
     if (vl == NULL) {
       fprintf(stderr, "create_value_list failed.\n");
-      exit(EXIT_FAILURE);
+      return -1;
     }
 
-    c_heap_insert(values_heap, vl);
+    c_heap_insert(s->values_heap, vl);
   }
-  fprintf(stdout, "done\n");
 
-  last_time = 0;
+  return 0;
+} /* }}} int sender_init */
+
+static void sender_destroy(sender_t *s) /* {{{ */
+{
+  if (s->values_heap != NULL) {
+    while (42) {
+      lcc_value_list_t *vl = c_heap_get_root(s->values_heap);
+      if (vl == NULL)
+        break;
+      destroy_value_list(vl);
+    }
+    c_heap_destroy(s->values_heap);
+  }
+
+  if (s->con != NULL) {
+    lcc_pipeline_wait(s->con);
+    lcc_disconnect(s->con);
+  }
+  if (s->net != NULL)
+    lcc_network_destroy(s->net);
+} /* }}} void sender_destroy */
+
+static void *sender_thread(void *arg) /* {{{ */
+{
+  sender_t *s = arg;
+  /* With a fixed rate, each thread sends on its own schedule of
+   * evenly spaced slots. The schedule does not move when sending is slow
+   * ("open loop"), so a slow receiver shows up as lag rather than as a
+   * silently lower rate. */
+  double rate = conf_rate / (double)conf_num_threads;
+  double start = dtime();
+  uint64_t slot = 0;
+  double last_time = 0;
+
   while (loop) {
-    lcc_value_list_t *vl = c_heap_get_root(values_heap);
+    lcc_value_list_t *vl = c_heap_get_root(s->values_heap);
 
     if (vl == NULL)
       break;
 
-    if (vl->time != last_time) {
-      printf("%i values have been sent.\n", values_sent);
+    if (rate > 0.0) {
+      double when = start + ((double)slot) / rate;
+      double lag = dtime() - when;
 
+      if (lag > s->max_lag)
+        s->max_lag = lag;
+      else if (lag < 0.0) {
+        if (s->con != NULL)
+          lcc_pipeline_flush(s->con);
+        sleep_until(when);
+      }
+      slot++;
+    } else if (vl->time != last_time) {
       /* Check if we need to sleep */
-      double now = dtime();
+      if ((s->con != NULL) && (dtime() < vl->time))
+        lcc_pipeline_flush(s->con);
+      sleep_until(vl->time);
+      last_time = vl->time;
+    }
 
-      while (now < vl->time) {
-        double diff = vl->time - now;
-        struct timespec ts = {
-            .tv_sec = (time_t)diff,
-        };
-        ts.tv_nsec = (long)((diff - ((double)ts.tv_sec)) * 1e9);
+    if (!loop) {
+      c_heap_insert(s->values_heap, vl);
+      break;
+    }
 
-        nanosleep(&ts, /* remaining = */ NULL);
-        now = dtime();
+    send_value(s, vl);
 
-        if (!loop)
-          break;
-      }
-      last_time = vl->time;
+    c_heap_insert(s->values_heap, vl);
+  }
+
+  return NULL;
+} /* }}} void *sender_thread */
+
+int main(int argc, char **argv) /* {{{ */
+{
+  uint64_t last_sent = 0;
+  double start_time;
+  double last_time;
+  double max_lag = 0.0;
+  int status;
+
+  read_options(argc, argv);
+
+  sigint_action.sa_handler = signal_handler;
+  sigaction(SIGINT, &sigint_action, /* old = */ NULL);
+
+  sigterm_action.sa_handler = signal_handler;
+  sigaction(SIGTERM, &sigterm_action, /* old = */ NULL);
+
+  senders = calloc(conf_num_threads, sizeof(*senders));
+  if (senders == NULL) {
+    fprintf(stderr, "calloc failed.\n");
+    exit(EXIT_FAILURE);
+  }
+
+  fprintf(stdout, "Creating %i values ... ", conf_num_values);
+  fflush(stdout);
+  for (int i = 0; i < conf_num_threads; i++) {
+    senders[i].num_values = conf_num_values / conf_num_threads;
+    if (i < (conf_num_values % conf_num_threads))
+      senders[i].num_values++;
+
+    if (sender_init(senders + i) != 0)
+      exit(EXIT_FAILURE);
+  }
+  fprintf(stdout, "done\n");
+
+  start_time = dtime();
+  for (int i = 0; i < conf_num_threads; i++) {
+    status = pthread_create(&senders[i].thread, /* attr = */ NULL,
+                            sender_thread, senders + i);
+    if (status != 0) {
+      fprintf(stderr, "pthread_create failed: %s\n", strerror(status));
+      exit(EXIT_FAILURE);
     }
+  }
 
-    send_value(vl);
-    values_sent++;
+  last_time = start_time;
+  while (loop) {
+    uint64_t sent;
+    double now;
+
+    sleep_until(last_time + 1.0);
+    now = dtime();
+
+    sent = __atomic_load_n(&values_sent, __ATOMIC_RELAXED);
+    printf("%" PRIu64 " values have been sent (%.1f values/s).\n", sent,
+           ((double)(sent - last_sent)) / (now - last_time));
+    fflush(stdout);
 
-    c_heap_insert(values_heap, vl);
+    last_sent = sent;
+    last_time = now;
   }
 
   fprintf(stdout, "Shutting down.\n");
   fflush(stdout);
 
-  while (42) {
-    lcc_value_list_t *vl = c_heap_get_root(values_heap);
-    if (vl == NULL)
-      break;
-    destroy_value_list(vl);
+  for (int i = 0; i < conf_num_threads; i++) {
+    pthread_join(senders[i].thread, /* retval = */ NULL);
+    if (senders[i].max_lag > max_lag)
+      max_lag = senders[i].max_lag;
+    sender_destroy(senders + i);
   }
-  c_heap_destroy(values_heap);
+  free(senders);
+
+  last_time = dtime();
+  printf("Sent %" PRIu64 " values in %.3f seconds (%.1f values/s), "
+         "%" PRIu64 " failed.\n",
+         values_sent, last_time - start_time,
+         ((double)values_sent) / (last_time - start_time), values_failed);
+  if (conf_rate > 0.0)
+    printf("Senders fell behind the requested rate by at most %.3f "
+           "seconds.\n",
+           max_lag);
 
-  lcc_network_destroy(net);
   exit(EXIT_SUCCESS);
 } /* }}} int main */
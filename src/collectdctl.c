@@ -32,6 +32,7 @@
 #include <unistd.h>
 
 #include <assert.h>
+#include <ctype.h>
 #include <errno.h>
 
 #if NAN_STATIC_DEFAULT
@@ -77,6 +78,9 @@
 
 #define DEFAULT_SOCK LOCALSTATEDIR "/run/" PACKAGE_NAME "-unixsock"
 
+/* Number of identifiers queried at once by "getval --batch". */
+#define GETVAL_BATCH_SIZE 1000
+
 extern char *optarg;
 extern int optind;
 
@@ -94,8 +98,9 @@ __attribute__((noreturn)) static void exit_usage(const char *name, int status) {
       "\nAvailable commands:\n\n"
 
       " * getval <identifier>\n"
+      " * getval --batch\n"
       " * flush [timeout=<seconds>] [plugin=<name>] [identifier=<id>]\n"
-      " * listval\n"
+      " * listval [<pattern>]\n"
       " * putval <identifier> [interval=<seconds>] <value-list(s)>\n"
 
       "\nIdentifiers:\n\n"
@@ -107,6 +112,10 @@ __attribute__((noreturn)) static void exit_usage(const char *name, int status) {
       "Hostname defaults to the local hostname if omitted (e.g., "
       "uptime/uptime).\n"
       "No error is returned if the specified identifier does not exist.\n"
+      "With --batch, getval reads one identifier per line from stdin and\n"
+      "queries them in bulk.\n"
+      "Listval only lists identifiers matching <pattern>, a shell wildcard\n"
+      "pattern, if given.\n"
 
       "\n" PACKAGE_NAME " " PACKAGE_VERSION ", http://collectd.org/\n"
       "by Florian octo Forster <octo@collectd.org>\n"
@@ -182,6 +191,94 @@ static int parse_identifier(lcc_connection_t *c, const char *value,
   return 0;
 } /* parse_identifier */
 
+/* Queries the values of "num" identifiers with a single command and prints
+ * one line per identifier: its name as given, followed by its values. */
+static int getval_batch_query(lcc_connection_t *c, lcc_identifier_t *idents,
+                              char **names, size_t num) {
+  size_t values_num[GETVAL_BATCH_SIZE];
+  gauge_t *values[GETVAL_BATCH_SIZE];
+  int status[GETVAL_BATCH_SIZE];
+  int failed = 0;
+
+  assert(num <= GETVAL_BATCH_SIZE);
+
+  /* The status of each identifier is only set if the command as a whole
+   * succeeded. */
+  status[0] = 1;
+  if ((lcc_getval_multi(c, idents, num, values_num, values, status) != 0) &&
+      (status[0] == 1)) {
+    fprintf(stderr, "ERROR: %s\n", lcc_strerror(c));
+    return -1;
+  }
+
+  for (size_t i = 0; i < num; i++) {
+    if (status[i] != 0) {
+      fprintf(stderr, "ERROR: getval: No such value: %s\n", names[i]);
+      failed++;
+      continue;
+    }
+
+    printf("%s", names[i]);
+    for (size_t j = 0; j < values_num[i]; j++)
+      printf(" %e", values[i][j]);
+    printf("\n");
+    free(values[i]);
+  }
+
+  return (failed > 0) ? -1 : 0;
+} /* getval_batch_query */
+
+static int getval_batch(lcc_connection_t *c) {
+  lcc_identifier_t idents[GETVAL_BATCH_SIZE];
+  char *names[GETVAL_BATCH_SIZE];
+  size_t num = 0;
+  char line[1024];
+  int failed = 0;
+
+  while (fgets(line, sizeof(line), stdin) != NULL) {
+    char *name = line;
+    size_t len;
+
+    while ((*name == ' ') || (*name == '\t'))
+      name++;
+    len = strlen(name);
+    while ((len > 0) && isspace((unsigned char)name[len - 1]))
+      name[--len] = '\0';
+    if (len == 0)
+      continue;
+
+    memset(idents + num, 0, sizeof(*idents));
+    if (parse_identifier(c, name, idents + num) != 0) {
+      failed++;
+      continue;
+    }
+
+    names[num] = strdup(name);
+    if (names[num] == NULL) {
+      fprintf(stderr, "ERROR: Failed to allocate memory.\n");
+      failed++;
+      break;
+    }
+    num++;
+
+    if (num == GETVAL_BATCH_SIZE) {
+      if (getval_batch_query(c, idents, names, num) != 0)
+        failed++;
+      while (num > 0)
+        free(names[--num]);
+    }
+  }
+
+  if (num > 0) {
+    if (getval_batch_query(c, idents, names, num) != 0)
+      failed++;
+    while (num > 0)
+      free(names[--num]);
+  }
+
+  return (failed > 0) ? -1 : 0;
+} /* getval_batch */
+
 static int getval(lcc_connection_t *c, int argc, char **argv) {
   lcc_identifier_t ident;
 
@@ -193,6 +290,9 @@ static int getval(lcc_connection_t *c, int argc, char **argv) {
 
   assert(strcasecmp(argv[0], "getval") == 0);
 
+  if ((argc == 2) && (strcmp(argv[1], "--batch") == 0))
+    return getval_batch(c);
+
   if (argc != 2) {
     fprintf(stderr, "ERROR: getval: Missing identifier.\n");
     return -1;
@@ -337,48 +437,35 @@ static int flush(lcc_connection_t *c, int argc, char **argv) {
 #undef BAIL_OUT
 } /* flush */
 
-static int listval(lcc_connection_t *c, int argc, char **argv) {
-  lcc_identifier_t *ret_ident = NULL;
-  size_t ret_ident_num = 0;
+static int listval_print(lcc_connection_t *c __attribute__((unused)),
+                         double time __attribute__((unused)),
+                         const char *ident,
+                         void *user_data __attribute__((unused))) {
+  if (printf("%s\n", ident) < 0)
+    return -1;
+  return 0;
+} /* listval_print */
 
+static int listval(lcc_connection_t *c, int argc, char **argv) {
   int status;
 
   assert(strcasecmp(argv[0], "listval") == 0);
 
-  if (argc != 1) {
-    fprintf(stderr, "ERROR: listval: Does not accept any arguments.\n");
+  if (argc > 2) {
+    fprintf(stderr, "ERROR: listval: Accepts at most one pattern.\n");
     return -1;
   }
 
-#define BAIL_OUT(s)                                                            \
-  do {                                                                         \
-    if (ret_ident != NULL)                                                     \
-      free(ret_ident);                                                         \
-    ret_ident_num = 0;                                                         \
-    return s;                                                                  \
-  } while (0)
-
-  status = lcc_listval(c, &ret_ident, &ret_ident_num);
+  /* Identifiers are printed as they arrive instead of being collected first,
+   * which matters for caches with millions of values. */
+  status = lcc_listval_stream(c, (argc == 2) ? argv[1] : NULL, listval_print,
+                              NULL);
   if (status != 0) {
     fprintf(stderr, "ERROR: %s\n", lcc_strerror(c));
-    BAIL_OUT(status);
+    return status;
   }
 
-  for (size_t i = 0; i < ret_ident_num; ++i) {
-    char id[1024];
-
-    status = lcc_identifier_to_string(c, id, sizeof(id), ret_ident + i);
-    if (status != 0) {
-      fprintf(stderr, "ERROR: listval: Failed to convert returned "
-                      "identifier to a string: %s\n",
-              lcc_strerror(c));
-      continue;
-    }
-
-    printf("%s\n", id);
-  }
-  BAIL_OUT(0);
-#undef BAIL_OUT
+  return 0;
 } /* listval */
 
 static int putval(lcc_connection_t *c, int argc, char **argv) {
@@ -536,7 +623,9 @@ int main(int argc, char **argv) {
   while (42) {
     int opt;
 
-    opt = getopt(argc, argv, "s:h");
+    /* Stop at the command, so that its options (e.g. "getval --batch") are
+     * not taken for ours. */
+    opt = getopt(argc, argv, "+s:h");
 
     if (opt == -1)
       break;
@@ -36,6 +36,8 @@
 
 #include <fcntl.h>
 
+#include <poll.h>
+
 #include <signal.h>
 
 #include <stdio.h>
@@ -46,6 +48,7 @@
 #include <syslog.h>
 
 #include <sys/resource.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/types.h>
@@ -55,6 +58,8 @@
 
 #include <unistd.h>
 
+#include "utils_fdstore.h"
+
 #ifndef PREFIX
 #define PREFIX "/opt/" PACKAGE_NAME
 #endif
@@ -77,6 +82,19 @@ static int restart = 0;
 static const char *pidfile = NULL;
 static pid_t collectd_pid = 0;
 
+/* Sockets handed over by collectd, kept open while it is being restarted so
+ * that incoming data queues up in the kernel instead of being dropped. */
+typedef struct {
+  char *name;
+  int fd;
+  int claimed; /* requested or stored by the running instance */
+} stored_fd_t;
+
+static int handoff = 0;
+static int store_ctl[2] = {-1, -1};
+static stored_fd_t *store = NULL;
+static size_t store_num = 0;
+
 __attribute__((noreturn)) static void exit_usage(const char *name) {
   printf("Usage: %s <options> [-- <collectd options>]\n"
 
@@ -84,6 +102,7 @@ __attribute__((noreturn)) static void exit_usage(const char *name) {
          "  -h         Display this help and exit.\n"
          "  -c <path>  Path to the collectd binary.\n"
          "  -P <file>  PID-file.\n"
+         "  -k         Keep listening sockets open across restarts.\n"
 
          "\nFor <collectd options> see collectd.conf(5).\n"
 
@@ -191,6 +210,186 @@ static int daemonize(void) {
   return 0;
 } /* daemonize */
 
+static int store_init(void) {
+  if (0 != socketpair(AF_UNIX, SOCK_SEQPACKET, 0, store_ctl)) {
+    syslog(LOG_ERR, "Error: socketpair() failed: %s", strerror(errno));
+    return -1;
+  }
+
+  /* Our end must not leak into collectd, which inherits the other one. */
+  fcntl(store_ctl[0], F_SETFD, FD_CLOEXEC);
+  fcntl(store_ctl[0], F_SETFL, fcntl(store_ctl[0], F_GETFL) | O_NONBLOCK);
+  return 0;
+} /* store_init */
+
+static stored_fd_t *store_lookup(const char *name) {
+  for (size_t i = 0; i < store_num; ++i)
+    if (0 == strcmp(store[i].name, name))
+      return store + i;
+  return NULL;
+} /* store_lookup */
+
+static int store_send(const char *reply, int fd) {
+  struct iovec iov = {.iov_base = (void *)reply, .iov_len = strlen(reply)};
+  union {
+    struct cmsghdr hdr;
+    char buf[CMSG_SPACE(sizeof(int))];
+  } control;
+  struct msghdr msg;
+
+  memset(&control, 0, sizeof(control));
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+
+  if (0 <= fd) {
+    struct cmsghdr *cmsg;
+
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+  }
+
+  if (0 > sendmsg(store_ctl[0], &msg, 0)) {
+    syslog(LOG_ERR, "Error: sendmsg() failed: %s", strerror(errno));
+    return -1;
+  }
+  return 0;
+} /* store_send */
+
+static void store_put(const char *name, int fd) {
+  stored_fd_t *entry = store_lookup(name);
+
+  if (NULL == entry) {
+    stored_fd_t *tmp = realloc(store, (store_num + 1) * sizeof(*store));
+    char *name_copy = strdup(name);
+
+    if ((NULL == tmp) || (NULL == name_copy)) {
+      syslog(LOG_ERR, "Error: out of memory, not keeping socket %s", name);
+      if (NULL != tmp)
+        store = tmp;
+      free(name_copy);
+      close(fd);
+      return;
+    }
+
+    store = tmp;
+    entry = store + store_num;
+    ++store_num;
+
+    entry->name = name_copy;
+    entry->fd = -1;
+    syslog(LOG_INFO, "Info: keeping socket %s", name);
+  }
+
+  if (0 <= entry->fd)
+    close(entry->fd);
+  entry->fd = fd;
+  entry->claimed = 1;
+} /* store_put */
+
+/* Handles all pending requests of collectd. */
+static void store_handle(void) {
+  while (42) {
+    char buffer[FDSTORE_NAME_MAX + 1];
+    struct iovec iov = {.iov_base = buffer, .iov_len = sizeof(buffer) - 1};
+    union {
+      struct cmsghdr hdr;
+      char buf[CMSG_SPACE(sizeof(int))];
+    } control;
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    ssize_t len;
+    int fd = -1;
+
+    memset(&control, 0, sizeof(control));
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    len = recvmsg(store_ctl[0], &msg, 0);
+    if (0 > len) {
+      if ((EAGAIN != errno) && (EWOULDBLOCK != errno) && (EINTR != errno))
+        syslog(LOG_ERR, "Error: recvmsg() failed: %s", strerror(errno));
+      return;
+    } else if (0 == len) {
+      return;
+    }
+    buffer[len] = '\0';
+
+    cmsg = CMSG_FIRSTHDR(&msg);
+    if ((NULL != cmsg) && (SOL_SOCKET == cmsg->cmsg_level) &&
+        (SCM_RIGHTS == cmsg->cmsg_type) &&
+        (CMSG_LEN(sizeof(int)) == cmsg->cmsg_len)) {
+      memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+      fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+
+    if ((FDSTORE_CMD_PUT == buffer[0]) && (1 < len) && (0 <= fd)) {
+      store_put(buffer + 1, fd);
+    } else if ((FDSTORE_CMD_GET == buffer[0]) && (1 < len)) {
+      stored_fd_t *entry = store_lookup(buffer + 1);
+
+      if (0 <= fd)
+        close(fd);
+
+      if (NULL != entry) {
+        entry->claimed = 1;
+        store_send("1", entry->fd);
+      } else {
+        store_send("0", -1);
+      }
+    } else {
+      syslog(LOG_WARNING, "Warning: ignoring invalid request from collectd");
+      if (0 <= fd)
+        close(fd);
+    }
+  }
+} /* store_handle */
+
+/* Closes the sockets not used by the collectd instance which just exited,
+ * e.g. because the configuration has changed. */
+static void store_expire(void) {
+  size_t i = 0;
+
+  while (i < store_num) {
+    if (store[i].claimed) {
+      store[i].claimed = 0;
+      ++i;
+      continue;
+    }
+
+    syslog(LOG_INFO, "Info: closing unused socket %s", store[i].name);
+    close(store[i].fd);
+    free(store[i].name);
+
+    --store_num;
+    memmove(store + i, store + i + 1, (store_num - i) * sizeof(*store));
+  }
+} /* store_expire */
+
+static void store_destroy(void) {
+  for (size_t i = 0; i < store_num; ++i) {
+    close(store[i].fd);
+    free(store[i].name);
+  }
+  free(store);
+  store = NULL;
+  store_num = 0;
+
+  if (0 <= store_ctl[0])
+    close(store_ctl[0]);
+  if (0 <= store_ctl[1])
+    close(store_ctl[1]);
+} /* store_destroy */
+
 static int collectd_start(char **argv) {
   pid_t pid = 0;
 
@@ -202,6 +401,13 @@ static int collectd_start(char **argv) {
     return 0;
   }
 
+  if (handoff) {
+    char buffer[16];
+
+    snprintf(buffer, sizeof(buffer), "%i", store_ctl[1]);
+    setenv(FDSTORE_ENV, buffer, /* overwrite = */ 1);
+  }
+
   execvp(argv[0], argv);
   syslog(LOG_ERR, "Error: execvp(%s) failed: %s", argv[0], strerror(errno));
   exit(-1);
@@ -228,6 +434,43 @@ static void sig_hup_handler(int __attribute__((unused)) signo) {
   return;
 } /* sig_hup_handler */
 
+static void sig_chld_handler(int __attribute__((unused)) signo) {
+  /* only there to interrupt poll() */
+  return;
+} /* sig_chld_handler */
+
+/* Waits for collectd to terminate while serving its requests to the socket
+ * store. */
+static void collectd_wait_handoff(int *status) {
+  int stopped = 0;
+
+  while (42) {
+    struct pollfd pfd = {.fd = store_ctl[0], .events = POLLIN};
+    pid_t pid = waitpid(collectd_pid, status, WNOHANG);
+
+    if (collectd_pid == pid)
+      break;
+    else if ((0 > pid) && (EINTR != errno)) {
+      syslog(LOG_ERR, "Error: waitpid() failed: %s", strerror(errno));
+      break;
+    }
+
+    if ((0 == stopped) && ((0 != loop) || (0 != restart))) {
+      collectd_stop();
+      stopped = 1;
+    }
+
+    /* SIGCHLD interrupts poll(), the timeout only covers the race with
+     * waitpid() above. */
+    if (0 < poll(&pfd, 1, 1000))
+      store_handle();
+  }
+
+  /* requests sent just before collectd exited */
+  store_handle();
+  store_expire();
+} /* collectd_wait_handoff */
+
 static void log_status(int status) {
   if (WIFEXITED(status)) {
     if (0 == WEXITSTATUS(status))
@@ -280,7 +523,7 @@ int main(int argc, char **argv) {
 
   /* parse command line options */
   while (42) {
-    int c = getopt(argc, argv, "hc:P:");
+    int c = getopt(argc, argv, "hc:P:k");
 
     if (-1 == c)
       break;
@@ -292,6 +535,9 @@ int main(int argc, char **argv) {
     case 'P':
       pidfile = optarg;
       break;
+    case 'k':
+      handoff = 1;
+      break;
     case 'h':
     default:
       exit_usage(argv[0]);
@@ -352,6 +598,21 @@ int main(int argc, char **argv) {
     return 1;
   }
 
+  if (handoff) {
+    sa.sa_handler = sig_chld_handler;
+
+    if (0 != sigaction(SIGCHLD, &sa, NULL)) {
+      syslog(LOG_ERR, "Error: sigaction() failed: %s", strerror(errno));
+      free(collectd_argv);
+      return 1;
+    }
+
+    if (0 != store_init()) {
+      free(collectd_argv);
+      return 1;
+    }
+  }
+
   while (0 == loop) {
     int status = 0;
 
@@ -361,10 +622,13 @@ int main(int argc, char **argv) {
     }
 
     assert(0 < collectd_pid);
-    while ((collectd_pid != waitpid(collectd_pid, &status, 0)) &&
-           (EINTR == errno))
-      if ((0 != loop) || (0 != restart))
-        collectd_stop();
+    if (handoff)
+      collectd_wait_handoff(&status);
+    else
+      while ((collectd_pid != waitpid(collectd_pid, &status, 0)) &&
+             (EINTR == errno))
+        if ((0 != loop) || (0 != restart))
+          collectd_stop();
 
     collectd_pid = 0;
 
@@ -380,6 +644,7 @@ int main(int argc, char **argv) {
 
   syslog(LOG_INFO, "Info: shutting down collectdmon");
 
+  store_destroy();
   pidfile_delete();
   closelog();
 
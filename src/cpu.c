@@ -130,7 +130,11 @@ static mach_msg_type_number_t cpu_list_len;
 /* #endif PROCESSOR_CPU_LOAD_INFO */
 
 #elif defined(KERNEL_LINUX)
-/* no variables needed */
+/* /proc/stat is kept open and re-read with pread(2) into a buffer which is
+ * only as large as the "cpu" lines at the beginning of the file. */
+static int proc_stat_fd = -1;
+static char *proc_stat_buffer = NULL;
+static size_t proc_stat_buffer_size = 0;
 /* #endif KERNEL_LINUX */
 
 #elif defined(HAVE_LIBKSTAT)
@@ -197,10 +201,28 @@ static _Bool report_percent = 0;
 static _Bool report_num_cpu = 0;
 static _Bool report_guest = 0;
 static _Bool subtract_guest = 1;
+static size_t report_top_cpus = 0;
+
+/* Value lists are dispatched in batches, so that hosts with hundreds of CPUs
+ * do not lock the write queue thousands of times per interval. */
+#define CPU_BATCH_SIZE 256
+static value_list_t cpu_batch[CPU_BATCH_SIZE];
+static value_t cpu_batch_values[CPU_BATCH_SIZE];
+static size_t cpu_batch_num = 0;
+
+struct cpu_top_s {
+  size_t cpu_num;
+  gauge_t active;
+};
+typedef struct cpu_top_s cpu_top_t;
+
+static cpu_top_t *cpu_top = NULL;
+static size_t cpu_top_size = 0;
 
-static const char *config_keys[] = {"ReportByCpu",      "ReportByState",
-                                    "ReportNumCpu",     "ValuesPercentage",
-                                    "ReportGuestState", "SubtractGuestState"};
+static const char *config_keys[] = {
+    "ReportByCpu",      "ReportByState",    "ReportNumCpu",
+    "ValuesPercentage", "ReportGuestState", "SubtractGuestState",
+    "ReportTopCpus"};
 static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 
 static int cpu_config(char const *key, char const *value) /* {{{ */
@@ -217,7 +239,14 @@ static int cpu_config(char const *key, char const *value) /* {{{ */
     report_guest = IS_TRUE(value) ? 1 : 0;
   else if (strcasecmp(key, "SubtractGuestState") == 0)
     subtract_guest = IS_TRUE(value) ? 1 : 0;
-  else
+  else if (strcasecmp(key, "ReportTopCpus") == 0) {
+    int num = atoi(value);
+    if (num < 0) {
+      ERROR("cpu plugin: ReportTopCpus must not be negative.");
+      return -1;
+    }
+    report_top_cpus = (size_t)num;
+  } else
     return -1;
 
   return 0;
@@ -317,22 +346,43 @@ static int init(void) {
   return 0;
 } /* int init */
 
-static void submit_value(int cpu_num, int cpu_state, const char *type,
-                         value_t value) {
-  value_list_t vl = VALUE_LIST_INIT;
+static void cpu_batch_flush(void) /* {{{ */
+{
+  if (cpu_batch_num == 0)
+    return;
 
-  vl.values = &value;
-  vl.values_len = 1;
+  plugin_dispatch_values_batch(cpu_batch, cpu_batch_num);
+  cpu_batch_num = 0;
+} /* }}} void cpu_batch_flush */
 
-  sstrncpy(vl.plugin, "cpu", sizeof(vl.plugin));
-  sstrncpy(vl.type, type, sizeof(vl.type));
-  sstrncpy(vl.type_instance, cpu_state_names[cpu_state],
-           sizeof(vl.type_instance));
+static void cpu_batch_add(int cpu_num, const char *type, /* {{{ */
+                          const char *type_instance, value_t value) {
+  value_list_t *vl;
+
+  if (cpu_batch_num >= CPU_BATCH_SIZE)
+    cpu_batch_flush();
+
+  vl = cpu_batch + cpu_batch_num;
+  *vl = (value_list_t)VALUE_LIST_INIT;
+  vl->values = cpu_batch_values + cpu_batch_num;
+  vl->values[0] = value;
+  vl->values_len = 1;
+
+  sstrncpy(vl->plugin, "cpu", sizeof(vl->plugin));
+  sstrncpy(vl->type, type, sizeof(vl->type));
+  if (type_instance != NULL)
+    sstrncpy(vl->type_instance, type_instance, sizeof(vl->type_instance));
 
   if (cpu_num >= 0) {
-    snprintf(vl.plugin_instance, sizeof(vl.plugin_instance), "%i", cpu_num);
+    snprintf(vl->plugin_instance, sizeof(vl->plugin_instance), "%i", cpu_num);
   }
-  plugin_dispatch_values(&vl);
+
+  cpu_batch_num++;
+} /* }}} void cpu_batch_add */
+
+static void submit_value(int cpu_num, int cpu_state, const char *type,
+                         value_t value) {
+  cpu_batch_add(cpu_num, type, cpu_state_names[cpu_state], value);
 }
 
 static void submit_percent(int cpu_num, int cpu_state, gauge_t value) {
@@ -486,15 +536,7 @@ static void cpu_commit_one(int cpu_num, /* {{{ */
 /* Commits the number of cores */
 static void cpu_commit_num_cpu(gauge_t value) /* {{{ */
 {
-  value_list_t vl = VALUE_LIST_INIT;
-
-  vl.values = &(value_t){.gauge = value};
-  vl.values_len = 1;
-
-  sstrncpy(vl.plugin, "cpu", sizeof(vl.plugin));
-  sstrncpy(vl.type, "count", sizeof(vl.type));
-
-  plugin_dispatch_values(&vl);
+  cpu_batch_add(-1, "count", NULL, (value_t){.gauge = value});
 } /* }}} void cpu_commit_num_cpu */
 
 /* Resets the internal aggregation. This is called by the read callback after
@@ -522,6 +564,68 @@ static void cpu_commit_without_aggregation(void) /* {{{ */
   }
 } /* }}} void cpu_commit_without_aggregation */
 
+/* Commits the values of one CPU. Requires aggregate() to have been called. */
+static void cpu_commit_cpu(size_t cpu_num) /* {{{ */
+{
+  cpu_state_t *this_cpu_states = get_cpu_state(cpu_num, 0);
+  gauge_t local_rates[COLLECTD_CPU_STATE_MAX] = {
+      NAN, NAN, NAN, NAN, NAN, NAN, NAN, NAN, NAN, NAN, NAN, NAN};
+
+  for (size_t state = 0; state < COLLECTD_CPU_STATE_MAX; state++)
+    if (this_cpu_states[state].has_value)
+      local_rates[state] = this_cpu_states[state].rate;
+
+  cpu_commit_one((int)cpu_num, local_rates);
+} /* }}} void cpu_commit_cpu */
+
+/* Sorts by decreasing "active" rate; CPUs without a rate go last. */
+static int cpu_top_compare(void const *a, void const *b) /* {{{ */
+{
+  cpu_top_t const *ta = a;
+  cpu_top_t const *tb = b;
+
+  if (isnan(ta->active) != isnan(tb->active))
+    return isnan(ta->active) ? 1 : -1;
+  if (ta->active > tb->active)
+    return -1;
+  if (ta->active < tb->active)
+    return 1;
+  return (ta->cpu_num < tb->cpu_num) ? -1 : (ta->cpu_num > tb->cpu_num);
+} /* }}} int cpu_top_compare */
+
+/* Commits the global aggregation and the "report_top_cpus" busiest CPUs.
+ * Requires aggregate() to have been called. */
+static void cpu_commit_top(gauge_t *global_rates) /* {{{ */
+{
+  size_t num = report_top_cpus;
+
+  cpu_commit_one(-1, global_rates);
+
+  if (cpu_top_size < global_cpu_num) {
+    cpu_top_t *tmp = realloc(cpu_top, global_cpu_num * sizeof(*cpu_top));
+    if (tmp == NULL) {
+      ERROR("cpu plugin: realloc failed.");
+      return;
+    }
+    cpu_top = tmp;
+    cpu_top_size = global_cpu_num;
+  }
+
+  for (size_t cpu_num = 0; cpu_num < global_cpu_num; cpu_num++) {
+    cpu_state_t *s = get_cpu_state(cpu_num, COLLECTD_CPU_STATE_ACTIVE);
+
+    cpu_top[cpu_num] = (cpu_top_t){
+        .cpu_num = cpu_num, .active = s->has_value ? s->rate : NAN,
+    };
+  }
+  qsort(cpu_top, global_cpu_num, sizeof(*cpu_top), cpu_top_compare);
+
+  if (num > global_cpu_num)
+    num = global_cpu_num;
+  for (size_t i = 0; i < num; i++)
+    cpu_commit_cpu(cpu_top[i].cpu_num);
+} /* }}} void cpu_commit_top */
+
 /* Aggregates the internal state and dispatches the metrics. */
 static void cpu_commit(void) /* {{{ */
 {
@@ -532,7 +636,8 @@ static void cpu_commit(void) /* {{{ */
   if (report_num_cpu)
     cpu_commit_num_cpu((gauge_t)global_cpu_num);
 
-  if (report_by_state && report_by_cpu && !report_percent) {
+  if (report_by_state && report_by_cpu && !report_percent &&
+      (report_top_cpus == 0)) {
     cpu_commit_without_aggregation();
     return;
   }
@@ -544,17 +649,13 @@ static void cpu_commit(void) /* {{{ */
     return;
   }
 
-  for (size_t cpu_num = 0; cpu_num < global_cpu_num; cpu_num++) {
-    cpu_state_t *this_cpu_states = get_cpu_state(cpu_num, 0);
-    gauge_t local_rates[COLLECTD_CPU_STATE_MAX] = {
-        NAN, NAN, NAN, NAN, NAN, NAN, NAN, NAN, NAN, NAN, NAN, NAN};
-
-    for (size_t state = 0; state < COLLECTD_CPU_STATE_MAX; state++)
-      if (this_cpu_states[state].has_value)
-        local_rates[state] = this_cpu_states[state].rate;
-
-    cpu_commit_one((int)cpu_num, local_rates);
+  if (report_top_cpus > 0) {
+    cpu_commit_top(global_rates);
+    return;
   }
+
+  for (size_t cpu_num = 0; cpu_num < global_cpu_num; cpu_num++)
+    cpu_commit_cpu(cpu_num);
 } /* }}} void cpu_commit */
 
 /* Adds a derive value to the internal state. This should be used by each read
@@ -589,6 +690,66 @@ static int cpu_stage(size_t cpu_num, size_t state, derive_t d,
   return 0;
 } /* }}} int cpu_stage */
 
+#if defined(KERNEL_LINUX) && !PROCESSOR_CPU_LOAD_INFO
+/* Reads /proc/stat into proc_stat_buffer. Only the "cpu" lines at the
+ * beginning of the file are needed, so the buffer is grown only until it
+ * holds a complete line following them; the rest of the file, mostly
+ * interrupt counters, is not copied. */
+static int cpu_read_proc_stat(void) /* {{{ */
+{
+  if (proc_stat_fd < 0) {
+    proc_stat_fd = open("/proc/stat", O_RDONLY | O_CLOEXEC);
+    if (proc_stat_fd < 0) {
+      ERROR("cpu plugin: open (/proc/stat) failed: %s", STRERRNO);
+      return -1;
+    }
+  }
+
+  if (proc_stat_buffer == NULL) {
+    proc_stat_buffer = malloc(4096);
+    if (proc_stat_buffer == NULL) {
+      ERROR("cpu plugin: malloc failed.");
+      return -1;
+    }
+    proc_stat_buffer_size = 4096;
+  }
+
+  while (42) {
+    ssize_t len = pread(proc_stat_fd, proc_stat_buffer,
+                        proc_stat_buffer_size - 1, /* offset = */ 0);
+    if (len < 0) {
+      ERROR("cpu plugin: reading /proc/stat failed: %s", STRERRNO);
+      close(proc_stat_fd);
+      proc_stat_fd = -1;
+      return -1;
+    }
+    proc_stat_buffer[len] = 0;
+
+    if ((size_t)len < proc_stat_buffer_size - 1)
+      return 0;
+
+    /* The buffer is full. It is large enough if the "cpu" lines are
+     * followed by the beginning of another line. */
+    for (char *ptr = strchr(proc_stat_buffer, '\n'); ptr != NULL;
+         ptr = strchr(ptr, '\n')) {
+      ptr++;
+      if ((proc_stat_buffer + len) - ptr < 3)
+        break;
+      if (strncmp(ptr, "cpu", 3) != 0)
+        return 0;
+    }
+
+    char *tmp = realloc(proc_stat_buffer, 2 * proc_stat_buffer_size);
+    if (tmp == NULL) {
+      ERROR("cpu plugin: realloc failed.");
+      return -1;
+    }
+    proc_stat_buffer = tmp;
+    proc_stat_buffer_size *= 2;
+  }
+} /* }}} int cpu_read_proc_stat */
+#endif
+
 static int cpu_read(void) {
   cdtime_t now = cdtime();
 
@@ -630,53 +791,62 @@ static int cpu_read(void) {
 /* }}} #endif PROCESSOR_CPU_LOAD_INFO */
 
 #elif defined(KERNEL_LINUX) /* {{{ */
-  int cpu;
-  FILE *fh;
-  char buf[1024];
+  char *next;
 
-  char *fields[11];
-  int numfields;
-
-  if ((fh = fopen("/proc/stat", "r")) == NULL) {
-    ERROR("cpu plugin: fopen (/proc/stat) failed: %s", STRERRNO);
+  if (cpu_read_proc_stat() != 0)
     return -1;
-  }
 
-  while (fgets(buf, 1024, fh) != NULL) {
-    if (strncmp(buf, "cpu", 3))
-      continue;
-    if ((buf[3] < '0') || (buf[3] > '9'))
+  for (char *line = proc_stat_buffer; *line != 0; line = next) {
+    derive_t fields[10];
+    size_t fields_num = 0;
+    size_t cpu;
+    char *ptr;
+
+    next = strchr(line, '\n');
+    if (next == NULL)
+      next = line + strlen(line);
+    else
+      *(next++) = 0;
+
+    /* The "cpu" lines are at the beginning of the file. */
+    if (strncmp(line, "cpu", 3) != 0)
+      break;
+    if (!isdigit((unsigned char)line[3]))
       continue;
 
-    numfields = strsplit(buf, fields, STATIC_ARRAY_SIZE(fields));
-    if (numfields < 5)
+    cpu = (size_t)strtoul(line + 3, &ptr, 10);
+    while (fields_num < STATIC_ARRAY_SIZE(fields)) {
+      char *endptr;
+      unsigned long long value = strtoull(ptr, &endptr, 10);
+      if (endptr == ptr)
+        break;
+      fields[fields_num++] = (derive_t)value;
+      ptr = endptr;
+    }
+    if (fields_num < 4)
       continue;
 
-    cpu = atoi(fields[0] + 3);
-
     /* Do not stage User and Nice immediately: we may need to alter them later:
      */
-    long long user_value = atoll(fields[1]);
-    long long nice_value = atoll(fields[2]);
-    cpu_stage(cpu, COLLECTD_CPU_STATE_SYSTEM, (derive_t)atoll(fields[3]), now);
-    cpu_stage(cpu, COLLECTD_CPU_STATE_IDLE, (derive_t)atoll(fields[4]), now);
-
-    if (numfields >= 8) {
-      cpu_stage(cpu, COLLECTD_CPU_STATE_WAIT, (derive_t)atoll(fields[5]), now);
-      cpu_stage(cpu, COLLECTD_CPU_STATE_INTERRUPT, (derive_t)atoll(fields[6]),
-                now);
-      cpu_stage(cpu, COLLECTD_CPU_STATE_SOFTIRQ, (derive_t)atoll(fields[7]),
-                now);
+    derive_t user_value = fields[0];
+    derive_t nice_value = fields[1];
+    cpu_stage(cpu, COLLECTD_CPU_STATE_SYSTEM, fields[2], now);
+    cpu_stage(cpu, COLLECTD_CPU_STATE_IDLE, fields[3], now);
+
+    if (fields_num >= 7) {
+      cpu_stage(cpu, COLLECTD_CPU_STATE_WAIT, fields[4], now);
+      cpu_stage(cpu, COLLECTD_CPU_STATE_INTERRUPT, fields[5], now);
+      cpu_stage(cpu, COLLECTD_CPU_STATE_SOFTIRQ, fields[6], now);
     }
 
-    if (numfields >= 9) { /* Steal (since Linux 2.6.11) */
-      cpu_stage(cpu, COLLECTD_CPU_STATE_STEAL, (derive_t)atoll(fields[8]), now);
+    if (fields_num >= 8) { /* Steal (since Linux 2.6.11) */
+      cpu_stage(cpu, COLLECTD_CPU_STATE_STEAL, fields[7], now);
     }
 
-    if (numfields >= 10) { /* Guest (since Linux 2.6.24) */
+    if (fields_num >= 9) { /* Guest (since Linux 2.6.24) */
       if (report_guest) {
-        long long value = atoll(fields[9]);
-        cpu_stage(cpu, COLLECTD_CPU_STATE_GUEST, (derive_t)value, now);
+        derive_t value = fields[8];
+        cpu_stage(cpu, COLLECTD_CPU_STATE_GUEST, value, now);
         /* Guest is included in User; optionally subtract Guest from User: */
         if (subtract_guest) {
           user_value -= value;
@@ -686,10 +856,10 @@ static int cpu_read(void) {
       }
     }
 
-    if (numfields >= 11) { /* Guest_nice (since Linux 2.6.33) */
+    if (fields_num >= 10) { /* Guest_nice (since Linux 2.6.33) */
       if (report_guest) {
-        long long value = atoll(fields[10]);
-        cpu_stage(cpu, COLLECTD_CPU_STATE_GUEST_NICE, (derive_t)value, now);
+        derive_t value = fields[9];
+        cpu_stage(cpu, COLLECTD_CPU_STATE_GUEST_NICE, value, now);
         /* Guest_nice is included in Nice; optionally subtract Guest_nice from
            Nice: */
         if (subtract_guest) {
@@ -701,10 +871,9 @@ static int cpu_read(void) {
     }
 
     /* Eventually stage User and Nice: */
-    cpu_stage(cpu, COLLECTD_CPU_STATE_USER, (derive_t)user_value, now);
-    cpu_stage(cpu, COLLECTD_CPU_STATE_NICE, (derive_t)nice_value, now);
+    cpu_stage(cpu, COLLECTD_CPU_STATE_USER, user_value, now);
+    cpu_stage(cpu, COLLECTD_CPU_STATE_NICE, nice_value, now);
   }
-  fclose(fh);
 /* }}} #endif defined(KERNEL_LINUX) */
 
 #elif defined(HAVE_LIBKSTAT) /* {{{ */
@@ -874,12 +1043,30 @@ static int cpu_read(void) {
 #endif                       /* }}} HAVE_PERFSTAT */
 
   cpu_commit();
+  cpu_batch_flush();
   cpu_reset();
   return 0;
 }
 
+static int cpu_shutdown(void) {
+#if defined(KERNEL_LINUX) && !PROCESSOR_CPU_LOAD_INFO
+  if (proc_stat_fd >= 0) {
+    close(proc_stat_fd);
+    proc_stat_fd = -1;
+  }
+  sfree(proc_stat_buffer);
+  proc_stat_buffer_size = 0;
+#endif
+
+  sfree(cpu_top);
+  cpu_top_size = 0;
+
+  return 0;
+} /* int cpu_shutdown */
+
 void module_register(void) {
   plugin_register_init("cpu", init);
   plugin_register_config("cpu", cpu_config, config_keys, config_keys_num);
   plugin_register_read("cpu", cpu_read);
+  plugin_register_shutdown("cpu", cpu_shutdown);
 } /* void module_register */
@@ -74,7 +74,7 @@ static int cpufreq_read(void) {
              "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_cur_freq", i);
 
     value_t v;
-    if (parse_value_file(filename, &v, DS_TYPE_GAUGE) != 0) {
+    if (parse_value_file_cached(filename, &v, DS_TYPE_GAUGE) != 0) {
       WARNING("cpufreq plugin: Reading \"%s\" failed.", filename);
       continue;
     }
@@ -24,9 +24,24 @@
  *   Sven Trenkel <collectd at semidefinite.de>
  **/
 
-/* Some python versions don't include this by default. */
+/* Some python versions don't include this by default. Since Python 3.11 it
+ * lives in "cpython/" and is included by <Python.h>. */
 
+#if PY_VERSION_HEX < 0x030B0000
 #include <longintrepr.h>
+#endif
+
+/* Python 3.12 allows sub-interpreters to have their own GIL. If available,
+ * modules can be loaded into separate interpreters (see the "Interpreter"
+ * block in collectd-python(5)) which run in parallel. */
+#if PY_VERSION_HEX >= 0x030C0000
+#define CPY_SUBINTERPRETERS 1
+#else
+#define CPY_SUBINTERPRETERS 0
+#endif
+
+/* One interpreter: the main one or a sub-interpreter. Defined in python.c. */
+typedef struct cpy_interp_s cpy_interp_t;
 
 /* These two macros are basically Py_BEGIN_ALLOW_THREADS and
  * Py_BEGIN_ALLOW_THREADS
@@ -41,9 +56,39 @@
  * swap
  * the current thread state with the new one. This means this thread is now
  * allowed
- * to execute Python code. */
+ * to execute Python code.
+ *
+ * The argument is the interpreter the callback belongs to. The PyGILState API
+ * only knows about the main interpreter, so with sub-interpreters a thread
+ * state for the requested interpreter is created and destroyed explicitly. A
+ * thread already running in that interpreter just keeps going. */
+
+#if CPY_SUBINTERPRETERS
+
+typedef struct {
+  PyThreadState *saved;  /* thread state of another interpreter, if any */
+  PyThreadState *tstate; /* thread state created by cpy_interp_lock() */
+} cpy_lock_t;
+
+void cpy_interp_lock(cpy_lock_t *lock, cpy_interp_t *interp);
+void cpy_interp_unlock(cpy_lock_t *lock);
+
+#define CPY_LOCK_THREADS(interp)                                               \
+  {                                                                            \
+    cpy_lock_t cpy_lock;                                                       \
+    cpy_interp_lock(&cpy_lock, (interp));
+
+#define CPY_RETURN_FROM_THREADS                                                \
+  cpy_interp_unlock(&cpy_lock);                                                \
+  return
+
+#define CPY_RELEASE_THREADS                                                    \
+  cpy_interp_unlock(&cpy_lock);                                                \
+  }
+
+#else /* !CPY_SUBINTERPRETERS */
 
-#define CPY_LOCK_THREADS                                                       \
+#define CPY_LOCK_THREADS(interp)                                               \
   {                                                                            \
     PyGILState_STATE gil_state;                                                \
     gil_state = PyGILState_Ensure();
@@ -56,6 +101,8 @@
   PyGILState_Release(gil_state);                                               \
   }
 
+#endif /* CPY_SUBINTERPRETERS */
+
 /* This macro is a shortcut for calls like
  * x = PyObject_Repr(x);
  * This can't be done like this example because this would leak
@@ -139,10 +186,60 @@ static inline PyObject *cpy_string_to_unicode_or_bytes(const char *buf) {
 #endif
 }
 
+/* Appends a C string to "*ret". Python objects must not be shared between
+ * interpreters, so these strings are not cached in static variables. */
+static inline void cpy_strcat_string(PyObject **ret, const char *str) {
+  PyObject *tmp = cpy_string_to_unicode_or_bytes(str); /* New reference. */
+  if (tmp == NULL) {
+    Py_CLEAR(*ret);
+    return;
+  }
+  CPY_STRCAT_AND_DEL(ret, tmp);
+}
+
+/* Instances of heap types hold a reference to their type, which has to be
+ * visited by tp_traverse and released by tp_dealloc of the type implementing
+ * these slots. These functions return true if the collectd type implementing
+ * "func" for "self" is a heap type. Python subclasses of the static types take
+ * care of the reference themselves. */
+static inline int cpy_heap_dealloc(PyObject *self, destructor func) {
+  PyTypeObject *t = Py_TYPE(self);
+  while (t != NULL && t->tp_dealloc != func)
+    t = t->tp_base;
+  return (t != NULL) && (t->tp_flags & Py_TPFLAGS_HEAPTYPE);
+}
+
+static inline int cpy_heap_traverse(PyObject *self, traverseproc func) {
+  PyTypeObject *t = Py_TYPE(self);
+  while (t != NULL && t->tp_traverse != func)
+    t = t->tp_base;
+  return (t != NULL) && (t->tp_flags & Py_TPFLAGS_HEAPTYPE);
+}
+
 void cpy_log_exception(const char *context);
 
+/* Implements collectd.dispatch_many(), see pyvalues.c. */
+PyObject *cpy_dispatch_many(PyObject *self, PyObject *args);
+
 /* Python object declarations. */
 
+/* The collectd types of one interpreter. The main interpreter uses the static
+ * types declared below. Static types can't be shared between interpreters with
+ * their own GIL, so sub-interpreters create heap types from the PyType_Spec
+ * declarations instead. */
+typedef struct {
+  PyTypeObject *config;
+  PyTypeObject *plugin_data;
+  PyTypeObject *values;
+  PyTypeObject *notification;
+  PyTypeObject *signed_;
+  PyTypeObject *unsigned_;
+} cpy_types_t;
+
+/* Returns the types of the interpreter of the calling thread. You must hold
+ * the GIL to call this function. */
+cpy_types_t const *cpy_types(void);
+
 typedef struct {
   // clang-format off
   PyObject_HEAD         /* No semicolon! */
@@ -153,6 +250,9 @@ typedef struct {
   // clang-format on
 } Config;
 extern PyTypeObject ConfigType;
+#if CPY_SUBINTERPRETERS
+extern PyType_Spec ConfigSpec;
+#endif
 
 typedef struct {
   // clang-format off
@@ -166,8 +266,11 @@ typedef struct {
   char type_instance[DATA_MAX_NAME_LEN];
 } PluginData;
 extern PyTypeObject PluginDataType;
+#if CPY_SUBINTERPRETERS
+extern PyType_Spec PluginDataSpec;
+#endif
 #define PluginData_New()                                                       \
-  PyObject_CallFunctionObjArgs((PyObject *)&PluginDataType, (void *)0)
+  PyObject_CallFunctionObjArgs((PyObject *)cpy_types()->plugin_data, (void *)0)
 
 typedef struct {
   PluginData data;
@@ -176,8 +279,11 @@ typedef struct {
   double interval;
 } Values;
 extern PyTypeObject ValuesType;
+#if CPY_SUBINTERPRETERS
+extern PyType_Spec ValuesSpec;
+#endif
 #define Values_New()                                                           \
-  PyObject_CallFunctionObjArgs((PyObject *)&ValuesType, (void *)0)
+  PyObject_CallFunctionObjArgs((PyObject *)cpy_types()->values, (void *)0)
 
 typedef struct {
   PluginData data;
@@ -186,11 +292,21 @@ typedef struct {
   char message[NOTIF_MAX_MSG_LEN];
 } Notification;
 extern PyTypeObject NotificationType;
+#if CPY_SUBINTERPRETERS
+extern PyType_Spec NotificationSpec;
+#endif
 #define Notification_New()                                                     \
-  PyObject_CallFunctionObjArgs((PyObject *)&NotificationType, (void *)0)
+  PyObject_CallFunctionObjArgs((PyObject *)cpy_types()->notification,         \
+                               (void *)0)
 
 typedef PyLongObject Signed;
 extern PyTypeObject SignedType;
+#if CPY_SUBINTERPRETERS
+extern PyType_Spec SignedSpec;
+#endif
 
 typedef PyLongObject Unsigned;
 extern PyTypeObject UnsignedType;
+#if CPY_SUBINTERPRETERS
+extern PyType_Spec UnsignedSpec;
+#endif
@@ -25,17 +25,49 @@
 
 #include "common.h"
 #include "plugin.h"
+#include "utils_avltree.h"
 #include "utils_cache.h"
 
+/* Lines are buffered in memory up to this size per open file. */
+#define CSV_BUFFER_MAX 65536
+/* Open files are closed when they haven't been written for this many
+ * intervals, e.g. the files of the previous day. */
+#define CSV_IDLE_FACTOR 4
+
+/* An open file of the cache. The files are kept in a list ordered by the time
+ * of their last write, most recent first. */
+struct csv_file_s;
+typedef struct csv_file_s csv_file_t;
+struct csv_file_s {
+  char *filename;
+  int fd;
+  char *buffer;
+  size_t buffer_fill;
+  size_t buffer_size;
+  cdtime_t first_buffered;
+  cdtime_t last_write;
+  cdtime_t interval;
+  csv_file_t *prev;
+  csv_file_t *next;
+};
+
 /*
  * Private variables
  */
-static const char *config_keys[] = {"DataDir", "StoreRates"};
+static const char *config_keys[] = {"DataDir", "StoreRates", "MaxOpenFiles"};
 static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 
 static char *datadir = NULL;
 static int store_rates = 0;
 static int use_stdio = 0;
+static size_t max_open_files = 0;
+
+/* The open files, keyed by file name. Protected by files_lock. */
+static c_avl_tree_t *files = NULL;
+static csv_file_t *files_head = NULL;
+static csv_file_t *files_tail = NULL;
+static cdtime_t next_flush = 0;
+static pthread_mutex_t files_lock = PTHREAD_MUTEX_INITIALIZER;
 
 static int value_list_to_string(char *buffer, int buffer_len,
                                 const data_set_t *ds, const value_list_t *vl) {
@@ -96,14 +128,63 @@ static int value_list_to_string(char *buffer, int buffer_len,
   return 0;
 } /* int value_list_to_string */
 
+/* Appends "-%Y-%m-%d" of the current local time. localtime_r() is pretty
+ * expensive, so the suffix is only formatted again once the day is over. */
+static int csv_date_suffix(char *buffer, size_t buffer_size) /* {{{ */
+{
+  static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+  static char suffix[32];
+  static time_t valid_from = 0;
+  static time_t valid_until = 0;
+
+  time_t now = time(NULL);
+  int status = 0;
+
+  pthread_mutex_lock(&lock);
+  if ((now < valid_from) || (now >= valid_until)) {
+    struct tm struct_tm;
+
+    if (localtime_r(&now, &struct_tm) == NULL) {
+      ERROR("csv plugin: localtime_r failed");
+      status = -1;
+    } else if (strftime(suffix, sizeof(suffix), "-%Y-%m-%d", &struct_tm) ==
+               0) {
+      /* yep, it returns zero on error. */
+      ERROR("csv plugin: strftime failed");
+      status = -1;
+    } else {
+      /* Midnight of the next day. mktime() normalizes the day of month. */
+      struct_tm.tm_mday++;
+      struct_tm.tm_hour = 0;
+      struct_tm.tm_min = 0;
+      struct_tm.tm_sec = 0;
+      struct_tm.tm_isdst = -1;
+      valid_from = now;
+      valid_until = mktime(&struct_tm);
+      if (valid_until <= now)
+        valid_until = now + 1;
+    }
+  }
+
+  if (status == 0) {
+    /* "-2013-07-12" => 11 bytes */
+    if (strlen(suffix) >= buffer_size) {
+      ERROR("csv plugin: Buffer too small.");
+      status = ENOMEM;
+    } else
+      sstrncpy(buffer, suffix, buffer_size);
+  }
+  pthread_mutex_unlock(&lock);
+
+  return status;
+} /* }}} int csv_date_suffix */
+
 static int value_list_to_filename(char *buffer, size_t buffer_size,
                                   value_list_t const *vl) {
   int status;
 
   char *ptr = buffer;
   size_t ptr_size = buffer_size;
-  time_t now;
-  struct tm struct_tm;
 
   if (datadir != NULL) {
     size_t len = strlen(datadir) + 1;
@@ -129,28 +210,7 @@ static int value_list_to_filename(char *buffer, size_t buffer_size,
   ptr_size -= strlen(ptr);
   ptr += strlen(ptr);
 
-  /* "-2013-07-12" => 11 bytes */
-  if (ptr_size < 12) {
-    ERROR("csv plugin: Buffer too small.");
-    return ENOMEM;
-  }
-
-  /* TODO: Find a way to minimize the calls to `localtime_r',
-   * since they are pretty expensive.. */
-  now = time(NULL);
-  if (localtime_r(&now, &struct_tm) == NULL) {
-    ERROR("csv plugin: localtime_r failed");
-    return -1;
-  }
-
-  status = strftime(ptr, ptr_size, "-%Y-%m-%d", &struct_tm);
-  if (status == 0) /* yep, it returns zero on error. */
-  {
-    ERROR("csv plugin: strftime failed");
-    return -1;
-  }
-
-  return 0;
+  return csv_date_suffix(ptr, ptr_size);
 } /* int value_list_to_filename */
 
 static int csv_create_file(const char *filename, const data_set_t *ds) {
@@ -175,6 +235,238 @@ static int csv_create_file(const char *filename, const data_set_t *ds) {
   return 0;
 } /* int csv_create_file */
 
+/* Creates the file with a header line if it doesn't exist yet. */
+static int csv_check_file(const char *filename, const data_set_t *ds) {
+  struct stat statbuf;
+
+  if (stat(filename, &statbuf) == -1) {
+    if (errno == ENOENT) {
+      if (csv_create_file(filename, ds))
+        return -1;
+    } else {
+      ERROR("stat(%s) failed: %s", filename, STRERRNO);
+      return -1;
+    }
+  } else if (!S_ISREG(statbuf.st_mode)) {
+    ERROR("stat(%s): Not a regular file!", filename);
+    return -1;
+  }
+
+  return 0;
+} /* int csv_check_file */
+
+/* files_lock must be held when calling this function. The buffered lines are
+ * written under a write lock, like the uncached writes, and dropped if that
+ * fails. */
+static int csv_file_flush(csv_file_t *f) /* {{{ */
+{
+  struct flock fl = {
+      .l_pid = getpid(), .l_type = F_WRLCK, .l_whence = SEEK_SET,
+  };
+  int status;
+
+  if (f->buffer_fill == 0)
+    return 0;
+
+  status = fcntl(f->fd, F_SETLK, &fl);
+  if (status != 0) {
+    ERROR("csv plugin: flock (%s) failed: %s", f->filename, STRERRNO);
+    f->buffer_fill = 0;
+    return -1;
+  }
+
+  status = swrite(f->fd, f->buffer, f->buffer_fill);
+  if (status != 0)
+    ERROR("csv plugin: write (%s) failed: %s", f->filename, STRERRNO);
+
+  fl.l_type = F_UNLCK;
+  fcntl(f->fd, F_SETLK, &fl);
+
+  f->buffer_fill = 0;
+  return status;
+} /* }}} int csv_file_flush */
+
+/* files_lock must be held when calling this function. */
+static void csv_file_close(csv_file_t *f) /* {{{ */
+{
+  csv_file_flush(f);
+  close(f->fd);
+
+  c_avl_remove(files, f->filename, NULL, NULL);
+  if (f->prev != NULL)
+    f->prev->next = f->next;
+  else
+    files_head = f->next;
+  if (f->next != NULL)
+    f->next->prev = f->prev;
+  else
+    files_tail = f->prev;
+
+  sfree(f->buffer);
+  sfree(f->filename);
+  sfree(f);
+} /* }}} void csv_file_close */
+
+/* files_lock must be held when calling this function. */
+static csv_file_t *csv_file_get(const char *filename, /* {{{ */
+                                const data_set_t *ds) {
+  csv_file_t *f = NULL;
+
+  if (files == NULL) {
+    files = c_avl_create((int (*)(const void *, const void *))strcmp);
+    if (files == NULL)
+      return NULL;
+  }
+
+  if (c_avl_get(files, filename, (void *)&f) == 0) {
+    /* Move to the front of the list. */
+    if (f->prev != NULL) {
+      f->prev->next = f->next;
+      if (f->next != NULL)
+        f->next->prev = f->prev;
+      else
+        files_tail = f->prev;
+      f->prev = NULL;
+      f->next = files_head;
+      files_head->prev = f;
+      files_head = f;
+    }
+    return f;
+  }
+
+  if (csv_check_file(filename, ds) != 0)
+    return NULL;
+
+  while ((files_tail != NULL) &&
+         ((size_t)c_avl_size(files) >= max_open_files))
+    csv_file_close(files_tail);
+
+  f = calloc(1, sizeof(*f));
+  if (f == NULL)
+    return NULL;
+  f->filename = strdup(filename);
+  if (f->filename == NULL) {
+    sfree(f);
+    return NULL;
+  }
+
+  f->fd = open(filename, O_WRONLY | O_APPEND | O_CLOEXEC);
+  if (f->fd < 0) {
+    ERROR("csv plugin: open (%s) failed: %s", filename, STRERRNO);
+    sfree(f->filename);
+    sfree(f);
+    return NULL;
+  }
+
+  if (c_avl_insert(files, f->filename, f) != 0) {
+    close(f->fd);
+    sfree(f->filename);
+    sfree(f);
+    return NULL;
+  }
+
+  f->next = files_head;
+  if (files_head != NULL)
+    files_head->prev = f;
+  files_head = f;
+  if (files_tail == NULL)
+    files_tail = f;
+
+  return f;
+} /* }}} csv_file_t *csv_file_get */
+
+/* files_lock must be held when calling this function. Flushes the open files
+ * and closes the ones which are no longer written to. */
+static void csv_files_flush(cdtime_t timeout, cdtime_t now) /* {{{ */
+{
+  csv_file_t *f = files_head;
+
+  while (f != NULL) {
+    csv_file_t *next = f->next;
+
+    if ((f->buffer_fill > 0) &&
+        ((timeout == 0) || ((f->first_buffered + timeout) <= now)))
+      csv_file_flush(f);
+    if ((f->last_write + CSV_IDLE_FACTOR * f->interval) < now)
+      csv_file_close(f);
+
+    f = next;
+  }
+} /* }}} void csv_files_flush */
+
+/* Appends the line to the file's buffer. All buffers are written once per
+ * interval or when they are full. */
+static int csv_write_cached(const char *filename, /* {{{ */
+                            const data_set_t *ds, const value_list_t *vl,
+                            const char *line) {
+  size_t len = strlen(line);
+  cdtime_t now = cdtime();
+  int status = 0;
+
+  pthread_mutex_lock(&files_lock);
+
+  csv_file_t *f = csv_file_get(filename, ds);
+  if (f == NULL) {
+    pthread_mutex_unlock(&files_lock);
+    return -1;
+  }
+
+  if ((f->buffer_fill + len + 1) > CSV_BUFFER_MAX)
+    status = csv_file_flush(f);
+
+  if ((f->buffer_fill + len + 1) > f->buffer_size) {
+    size_t size = (f->buffer_size > 0) ? f->buffer_size : 256;
+    while (size < (f->buffer_fill + len + 1))
+      size *= 2;
+
+    char *tmp = realloc(f->buffer, size);
+    if (tmp == NULL) {
+      ERROR("csv plugin: realloc failed.");
+      pthread_mutex_unlock(&files_lock);
+      return -1;
+    }
+    f->buffer = tmp;
+    f->buffer_size = size;
+  }
+
+  if (f->buffer_fill == 0)
+    f->first_buffered = now;
+  memcpy(f->buffer + f->buffer_fill, line, len);
+  f->buffer[f->buffer_fill + len] = '\n';
+  f->buffer_fill += len + 1;
+  f->last_write = now;
+  f->interval = (vl->interval > 0) ? vl->interval : plugin_get_interval();
+
+  if (now >= next_flush) {
+    csv_files_flush(/* timeout = */ 0, now);
+    next_flush = now + plugin_get_interval();
+  }
+
+  pthread_mutex_unlock(&files_lock);
+  return status;
+} /* }}} int csv_write_cached */
+
+static int csv_flush(cdtime_t timeout, /* {{{ */
+                     const char __attribute__((unused)) * identifier,
+                     user_data_t __attribute__((unused)) * user_data) {
+  pthread_mutex_lock(&files_lock);
+  csv_files_flush(timeout, cdtime());
+  pthread_mutex_unlock(&files_lock);
+  return 0;
+} /* }}} int csv_flush */
+
+static int csv_shutdown(void) /* {{{ */
+{
+  pthread_mutex_lock(&files_lock);
+  while (files_head != NULL)
+    csv_file_close(files_head);
+  if (files != NULL)
+    c_avl_destroy(files);
+  files = NULL;
+  pthread_mutex_unlock(&files_lock);
+  return 0;
+} /* }}} int csv_shutdown */
+
 static int csv_config(const char *key, const char *value) {
   if (strcasecmp("DataDir", key) == 0) {
     if (datadir != NULL) {
@@ -205,6 +497,13 @@ static int csv_config(const char *key, const char *value) {
       store_rates = 1;
     else
       store_rates = 0;
+  } else if (strcasecmp("MaxOpenFiles", key) == 0) {
+    int tmp = atoi(value);
+    if (tmp < 0) {
+      ERROR("csv plugin: Invalid MaxOpenFiles: %s", value);
+      return 1;
+    }
+    max_open_files = (size_t)tmp;
   } else {
     return -1;
   }
@@ -213,7 +512,6 @@ static int csv_config(const char *key, const char *value) {
 
 static int csv_write(const data_set_t *ds, const value_list_t *vl,
                      user_data_t __attribute__((unused)) * user_data) {
-  struct stat statbuf;
   char filename[512];
   char values[4096];
   FILE *csv;
@@ -251,18 +549,11 @@ static int csv_write(const data_set_t *ds, const value_list_t *vl,
     return 0;
   }
 
-  if (stat(filename, &statbuf) == -1) {
-    if (errno == ENOENT) {
-      if (csv_create_file(filename, ds))
-        return -1;
-    } else {
-      ERROR("stat(%s) failed: %s", filename, STRERRNO);
-      return -1;
-    }
-  } else if (!S_ISREG(statbuf.st_mode)) {
-    ERROR("stat(%s): Not a regular file!", filename);
+  if (max_open_files > 0)
+    return csv_write_cached(filename, ds, vl, values);
+
+  if (csv_check_file(filename, ds) != 0)
     return -1;
-  }
 
   csv = fopen(filename, "a");
   if (csv == NULL) {
@@ -294,4 +585,6 @@ static int csv_write(const data_set_t *ds, const value_list_t *vl,
 void module_register(void) {
   plugin_register_config("csv", csv_config, config_keys, config_keys_num);
   plugin_register_write("csv", csv_write, /* user_data = */ NULL);
+  plugin_register_flush("csv", csv_flush, /* user_data = */ NULL);
+  plugin_register_shutdown("csv", csv_shutdown);
 } /* void module_register */
@@ -25,6 +25,7 @@
 
 #include "common.h"
 #include "plugin.h"
+#include "utils_curl_engine.h"
 #include "utils_curl_stats.h"
 #include "utils_match.h"
 #include "utils_time.h"
@@ -76,6 +77,7 @@ struct web_page_s /* {{{ */
   char *buffer;
   size_t buffer_size;
   size_t buffer_fill;
+  cdtime_t start;
 
   web_match_t *matches;
 
@@ -87,6 +89,8 @@ struct web_page_s /* {{{ */
  */
 /* static CURLM *curl = NULL; */
 static web_page_t *pages_g = NULL;
+/* Transfers of all pages run on one thread through the curl engine. */
+static _Bool cc_async = 0;
 
 /*
  * Private functions
@@ -143,8 +147,10 @@ static void cc_web_page_free(web_page_t *wp) /* {{{ */
   if (wp == NULL)
     return;
 
-  if (wp->curl != NULL)
+  if (wp->curl != NULL) {
+    curl_engine_cancel(wp->curl);
     curl_easy_cleanup(wp->curl);
+  }
   wp->curl = NULL;
 
   sfree(wp->plugin_name);
@@ -541,6 +547,9 @@ static int cc_config(oconfig_item_t *ci) /* {{{ */
         success++;
       else
         errors++;
+    } else if (strcasecmp("Asynchronous", child->key) == 0) {
+      if (cf_util_get_boolean(child, &cc_async) != 0)
+        errors++;
     } else {
       WARNING("curl plugin: Option `%s' not allowed here.", child->key);
       errors++;
@@ -562,6 +571,12 @@ static int cc_init(void) /* {{{ */
     return -1;
   }
   curl_global_init(CURL_GLOBAL_SSL);
+
+  if (cc_async && (curl_engine_acquire() != 0)) {
+    ERROR("curl plugin: Starting the curl engine failed.");
+    cc_async = 0;
+    return -1;
+  }
   return 0;
 } /* }}} int cc_init */
 
@@ -609,19 +624,9 @@ static void cc_submit_response_time(const web_page_t *wp, /* {{{ */
   plugin_dispatch_values(&vl);
 } /* }}} void cc_submit_response_time */
 
-static int cc_read_page(web_page_t *wp) /* {{{ */
+/* Handles the outcome of a transfer and dispatches the values. */
+static int cc_page_done(web_page_t *wp, CURLcode status) /* {{{ */
 {
-  int status;
-  cdtime_t start = 0;
-
-  if (wp->response_time)
-    start = cdtime();
-
-  wp->buffer_fill = 0;
-
-  curl_easy_setopt(wp->curl, CURLOPT_URL, wp->url);
-
-  status = curl_easy_perform(wp->curl);
   if (status != CURLE_OK) {
     ERROR("curl plugin: curl_easy_perform failed with status %i: %s", status,
           wp->curl_errbuf);
@@ -629,7 +634,7 @@ static int cc_read_page(web_page_t *wp) /* {{{ */
   }
 
   if (wp->response_time)
-    cc_submit_response_time(wp, CDTIME_T_TO_DOUBLE(cdtime() - start));
+    cc_submit_response_time(wp, CDTIME_T_TO_DOUBLE(cdtime() - wp->start));
   if (wp->stats != NULL)
     curl_stats_dispatch(wp->stats, wp->curl, NULL, "curl", wp->instance);
 
@@ -648,8 +653,7 @@ static int cc_read_page(web_page_t *wp) /* {{{ */
   for (web_match_t *wm = wp->matches; wm != NULL; wm = wm->next) {
     cu_match_value_t *mv;
 
-    status = match_apply(wm->match, wp->buffer);
-    if (status != 0) {
+    if (match_apply(wm->match, wp->buffer) != 0) {
       WARNING("curl plugin: match_apply failed.");
       continue;
     }
@@ -664,13 +668,48 @@ static int cc_read_page(web_page_t *wp) /* {{{ */
     match_value_reset(mv);
   } /* for (wm = wp->matches; wm != NULL; wm = wm->next) */
 
+  return 0;
+} /* }}} int cc_page_done */
+
+/* Called on the curl engine's thread when an asynchronous transfer is done. */
+static void cc_async_done(CURL *curl, CURLcode status, /* {{{ */
+                          void *user_data) {
+  cc_page_done(user_data, status);
+} /* }}} void cc_async_done */
+
+static int cc_read_page(web_page_t *wp) /* {{{ */
+{
+  if (wp->response_time)
+    wp->start = cdtime();
+
+  wp->buffer_fill = 0;
+
+  curl_easy_setopt(wp->curl, CURLOPT_URL, wp->url);
+
+  if (!cc_async)
+    return cc_page_done(wp, curl_easy_perform(wp->curl));
+
+  int status = curl_engine_submit(wp->curl, cc_async_done, wp);
+  if (status != 0) {
+    ERROR("curl plugin: Submitting request for %s failed: %s", wp->url,
+          STRERROR(status));
+    return -1;
+  }
   return 0;
 } /* }}} int cc_read_page */
 
 static int cc_read(void) /* {{{ */
 {
-  for (web_page_t *wp = pages_g; wp != NULL; wp = wp->next)
+  for (web_page_t *wp = pages_g; wp != NULL; wp = wp->next) {
+    /* The page's buffer belongs to the engine until the transfer is done. */
+    if (cc_async && curl_engine_busy(wp->curl)) {
+      WARNING("curl plugin: Request for %s still in progress, skipping.",
+              wp->url);
+      continue;
+    }
+
     cc_read_page(wp);
+  }
 
   return 0;
 } /* }}} int cc_read */
@@ -680,6 +719,9 @@ static int cc_shutdown(void) /* {{{ */
   cc_web_page_free(pages_g);
   pages_g = NULL;
 
+  if (cc_async)
+    curl_engine_release();
+
   return 0;
 } /* }}} int cc_shutdown */
 
@@ -27,6 +27,7 @@
 #include "plugin.h"
 #include "utils_avltree.h"
 #include "utils_complain.h"
+#include "utils_curl_engine.h"
 #include "utils_curl_stats.h"
 
 #include <sys/types.h>
@@ -106,7 +107,11 @@ struct cj_s /* {{{ */
 
   yajl_handle yajl;
   c_avl_tree_t *tree;
+  cj_tree_entry_t root;
   int depth;
+  /* If non-zero, the depth of the outermost map or array no configured key
+   * descends into. Everything below it is skipped by the callbacks. */
+  int skip_depth;
   cj_state_t state[YAJL_MAX_DEPTH];
 };
 typedef struct cj_s cj_t; /* }}} */
@@ -117,6 +122,9 @@ typedef size_t yajl_len_t;
 typedef unsigned int yajl_len_t;
 #endif
 
+/* Transfers of all URLs run on one thread through the curl engine. */
+static _Bool cj_async = 0;
+
 static int cj_read(user_data_t *ud);
 static void cj_submit_impl(cj_t *db, cj_key_t *key, value_t *value);
 
@@ -227,25 +235,33 @@ static void cj_advance_array(cj_t *db) {
 #define CJ_CB_CONTINUE 1
 
 static int cj_cb_null(void *ctx) {
-  cj_advance_array(ctx);
+  cj_t *db = (cj_t *)ctx;
+
+  if (db->skip_depth == 0)
+    cj_advance_array(db);
   return CJ_CB_CONTINUE;
 }
 
 static int cj_cb_number(void *ctx, const char *number, yajl_len_t number_len) {
   cj_t *db = (cj_t *)ctx;
 
+  if (db->skip_depth != 0)
+    return CJ_CB_CONTINUE;
+
+  if (db->state[db->depth].entry == NULL) {
+    cj_advance_array(ctx);
+    return CJ_CB_CONTINUE;
+  }
+
   /* Create a null-terminated version of the string. */
   char buffer[number_len + 1];
   memcpy(buffer, number, number_len);
   buffer[sizeof(buffer) - 1] = 0;
 
-  if (db->state[db->depth].entry == NULL ||
-      db->state[db->depth].entry->type != KEY) {
-    if (db->state[db->depth].entry != NULL) {
-      NOTICE("curl_json plugin: Found \"%s\", but the configuration expects a "
-             "map.",
-             buffer);
-    }
+  if (db->state[db->depth].entry->type != KEY) {
+    NOTICE("curl_json plugin: Found \"%s\", but the configuration expects a "
+           "map.",
+           buffer);
     cj_advance_array(ctx);
     return CJ_CB_CONTINUE;
   }
@@ -271,6 +287,9 @@ static int cj_cb_number(void *ctx, const char *number, yajl_len_t number_len) {
  * NULL. */
 static int cj_cb_map_key(void *ctx, unsigned char const *in_name,
                          yajl_len_t in_name_len) {
+  if (((cj_t *)ctx)->skip_depth != 0)
+    return CJ_CB_CONTINUE;
+
   char name[in_name_len + 1];
 
   memmove(name, in_name, in_name_len);
@@ -296,6 +315,15 @@ static int cj_cb_boolean(void *ctx, int boolVal) {
 
 static int cj_cb_end(void *ctx) {
   cj_t *db = (cj_t *)ctx;
+
+  if (db->skip_depth != 0) {
+    if (db->depth > db->skip_depth) {
+      db->depth--;
+      return CJ_CB_CONTINUE;
+    }
+    db->skip_depth = 0;
+  }
+
   memset(&db->state[db->depth], 0, sizeof(db->state[db->depth]));
   db->depth--;
   cj_advance_array(ctx);
@@ -311,6 +339,13 @@ static int cj_cb_start_map(void *ctx) {
     return CJ_CB_ABORT;
   }
   db->depth++;
+
+  /* No configured key below this map: skip it without looking at its keys. */
+  if ((db->skip_depth == 0) &&
+      ((db->state[db->depth - 1].entry == NULL) ||
+       (db->state[db->depth - 1].entry->type != TREE)))
+    db->skip_depth = db->depth;
+
   return CJ_CB_CONTINUE;
 }
 
@@ -325,6 +360,15 @@ static int cj_cb_start_array(void *ctx) {
     return CJ_CB_ABORT;
   }
   db->depth++;
+
+  if (db->skip_depth != 0)
+    return CJ_CB_CONTINUE;
+  if ((db->state[db->depth - 1].entry == NULL) ||
+      (db->state[db->depth - 1].entry->type != TREE)) {
+    db->skip_depth = db->depth;
+    return CJ_CB_CONTINUE;
+  }
+
   db->state[db->depth].in_array = 1;
   db->state[db->depth].index = 0;
 
@@ -390,10 +434,16 @@ static void cj_free(void *arg) /* {{{ */
   if (db == NULL)
     return;
 
-  if (db->curl != NULL)
+  if (db->curl != NULL) {
+    curl_engine_cancel(db->curl);
     curl_easy_cleanup(db->curl);
+  }
   db->curl = NULL;
 
+  if (db->yajl != NULL)
+    yajl_free(db->yajl);
+  db->yajl = NULL;
+
   if (db->tree != NULL)
     cj_tree_free(db->tree);
   db->tree = NULL;
@@ -771,6 +821,9 @@ static int cj_config(oconfig_item_t *ci) /* {{{ */
         success++;
       else
         errors++;
+    } else if (strcasecmp("Asynchronous", child->key) == 0) {
+      if (cf_util_get_boolean(child, &cj_async) != 0)
+        errors++;
     } else {
       WARNING("curl_json plugin: Option `%s' not allowed here.", child->key);
       errors++;
@@ -856,15 +909,12 @@ static int cj_sock_perform(cj_t *db) /* {{{ */
   return 0;
 } /* }}} int cj_sock_perform */
 
-static int cj_curl_perform(cj_t *db) /* {{{ */
+/* Checks the outcome of a transfer and dispatches the cURL statistics. */
+static int cj_curl_check(cj_t *db, CURLcode status) /* {{{ */
 {
-  int status;
   long rc;
   char *url;
 
-  curl_easy_setopt(db->curl, CURLOPT_URL, db->url);
-
-  status = curl_easy_perform(db->curl);
   if (status != CURLE_OK) {
     ERROR("curl_json plugin: curl_easy_perform failed with status %i: %s (%s)",
           status, db->curl_errbuf, db->url);
@@ -885,22 +935,58 @@ static int cj_curl_perform(cj_t *db) /* {{{ */
     return -1;
   }
   return 0;
+} /* }}} int cj_curl_check */
+
+static int cj_curl_perform(cj_t *db) /* {{{ */
+{
+  curl_easy_setopt(db->curl, CURLOPT_URL, db->url);
+
+  return cj_curl_check(db, curl_easy_perform(db->curl));
 } /* }}} int cj_curl_perform */
 
-static int cj_perform(cj_t *db) /* {{{ */
+static int cj_parse_complete(cj_t *db) /* {{{ */
 {
   int status;
-  yajl_handle yprev = db->yajl;
 
-  db->yajl = yajl_alloc(&ycallbacks,
 #if HAVE_YAJL_V2
-                        /* alloc funcs = */ NULL,
+  status = yajl_complete_parse(db->yajl);
 #else
-                        /* alloc funcs = */ NULL, NULL,
+  status = yajl_parse_complete(db->yajl);
 #endif
-                        /* context = */ (void *)db);
-  if (db->yajl == NULL) {
+  if (status != yajl_status_ok) {
+    unsigned char *errmsg;
+
+    errmsg = yajl_get_error(db->yajl, /* verbose = */ 0,
+                            /* jsonText = */ NULL, /* jsonTextLen = */ 0);
+    ERROR("curl_json plugin: yajl_parse_complete failed: %s", (char *)errmsg);
+    yajl_free_error(db->yajl, errmsg);
+    return -1;
+  }
+
+  return 0;
+} /* }}} int cj_parse_complete */
+
+static yajl_handle cj_yajl_alloc(cj_t *db) /* {{{ */
+{
+  yajl_handle yajl = yajl_alloc(&ycallbacks,
+#if HAVE_YAJL_V2
+                                /* alloc funcs = */ NULL,
+#else
+                                /* alloc funcs = */ NULL, NULL,
+#endif
+                                /* context = */ (void *)db);
+  if (yajl == NULL)
     ERROR("curl_json plugin: yajl_alloc failed.");
+  return yajl;
+} /* }}} yajl_handle cj_yajl_alloc */
+
+static int cj_perform(cj_t *db) /* {{{ */
+{
+  int status;
+  yajl_handle yprev = db->yajl;
+
+  db->yajl = cj_yajl_alloc(db);
+  if (db->yajl == NULL) {
     db->yajl = yprev;
     return -1;
   }
@@ -915,27 +1001,47 @@ static int cj_perform(cj_t *db) /* {{{ */
     return -1;
   }
 
-#if HAVE_YAJL_V2
-  status = yajl_complete_parse(db->yajl);
-#else
-  status = yajl_parse_complete(db->yajl);
-#endif
-  if (status != yajl_status_ok) {
-    unsigned char *errmsg;
+  status = cj_parse_complete(db);
 
-    errmsg = yajl_get_error(db->yajl, /* verbose = */ 0,
-                            /* jsonText = */ NULL, /* jsonTextLen = */ 0);
-    ERROR("curl_json plugin: yajl_parse_complete failed: %s", (char *)errmsg);
-    yajl_free_error(db->yajl, errmsg);
+  yajl_free(db->yajl);
+  db->yajl = yprev;
+  return status;
+} /* }}} int cj_perform */
+
+/* Called on the curl engine's thread when an asynchronous transfer is done.
+ * The JSON has already been parsed and dispatched by the write callback. */
+static void cj_async_done(CURL *curl, CURLcode status, /* {{{ */
+                          void *user_data) {
+  cj_t *db = user_data;
+
+  if (cj_curl_check(db, status) == 0)
+    cj_parse_complete(db);
+
+  yajl_free(db->yajl);
+  db->yajl = NULL;
+  db->state[0].entry = NULL;
+} /* }}} void cj_async_done */
+
+static int cj_read_async(cj_t *db) /* {{{ */
+{
+  db->yajl = cj_yajl_alloc(db);
+  if (db->yajl == NULL)
+    return -1;
+
+  curl_easy_setopt(db->curl, CURLOPT_URL, db->url);
+
+  int status = curl_engine_submit(db->curl, cj_async_done, db);
+  if (status != 0) {
+    ERROR("curl_json plugin: Submitting request for %s failed: %s", db->url,
+          STRERROR(status));
     yajl_free(db->yajl);
-    db->yajl = yprev;
+    db->yajl = NULL;
+    db->state[0].entry = NULL;
     return -1;
   }
 
-  yajl_free(db->yajl);
-  db->yajl = yprev;
   return 0;
-} /* }}} int cj_perform */
+} /* }}} int cj_read_async */
 
 static int cj_read(user_data_t *ud) /* {{{ */
 {
@@ -948,15 +1054,26 @@ static int cj_read(user_data_t *ud) /* {{{ */
 
   db = (cj_t *)ud->data;
 
+  /* The parser state belongs to the engine until the transfer is done. */
+  if (cj_async && (db->url != NULL) && curl_engine_busy(db->curl)) {
+    WARNING("curl_json plugin: Request for %s still in progress, skipping.",
+            db->url);
+    return 0;
+  }
+
   db->depth = 0;
+  db->skip_depth = 0;
   memset(&db->state, 0, sizeof(db->state));
 
   /* This is not a compound literal because EPEL6's GCC is not cool enough to
    * handle anonymous unions within compound literals. */
-  cj_tree_entry_t root = {0};
-  root.type = TREE;
-  root.tree = db->tree;
-  db->state[0].entry = &root;
+  memset(&db->root, 0, sizeof(db->root));
+  db->root.type = TREE;
+  db->root.tree = db->tree;
+  db->state[0].entry = &db->root;
+
+  if (cj_async && (db->url != NULL))
+    return cj_read_async(db);
 
   int status = cj_perform(db);
 
@@ -970,10 +1087,24 @@ static int cj_init(void) /* {{{ */
   /* Call this while collectd is still single-threaded to avoid
    * initialization issues in libgcrypt. */
   curl_global_init(CURL_GLOBAL_SSL);
+
+  if (cj_async && (curl_engine_acquire() != 0)) {
+    ERROR("curl_json plugin: Starting the curl engine failed.");
+    cj_async = 0;
+    return -1;
+  }
   return 0;
 } /* }}} int cj_init */
 
+static int cj_shutdown(void) /* {{{ */
+{
+  if (cj_async)
+    curl_engine_release();
+  return 0;
+} /* }}} int cj_shutdown */
+
 void module_register(void) {
   plugin_register_complex_config("curl_json", cj_config);
   plugin_register_init("curl_json", cj_init);
+  plugin_register_shutdown("curl_json", cj_shutdown);
 } /* void module_register */
@@ -126,6 +126,14 @@ DEF_TEST(parse) {
       {"{\"a\":[[10,11,12,13,14]]}", "a/0/2", 12},
       {"{\"a\":[[10,11,12,13,14]]}", "a/0/3", 13},
       {"{\"a\":[[10,11,12,13,14]]}", "a/0/4", 14},
+      /* unselected subtrees are skipped */
+      {"{\"s\":{\"a\":[1,{\"b\":2}],\"c\":3},\"foo\":42}", "foo", 42},
+      {"{\"s\":[{\"x\":[1,2]},5],\"a\":[{\"x\":[1,2]},5,{\"y\":6}]}",
+       "a/1", 5},
+      {"{\"s\":[{\"x\":[1,2]},5],\"a\":[{\"x\":[1,2]},5,{\"y\":6}]}",
+       "a/2/y", 6},
+      {"{\"foo\":{\"bar\":1},\"baz\":{\"bar\":2}}", "baz/bar", 2},
+      {"{\"foo\":[[1],{\"a\":{}}],\"bar\":[7,8]}", "bar/1", 8},
   };
 
   for (size_t i = 0; i < STATIC_ARRAY_SIZE(cases); i++) {
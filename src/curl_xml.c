@@ -23,13 +23,16 @@
 
 #include "common.h"
 #include "plugin.h"
+#include "utils_curl_engine.h"
 #include "utils_curl_stats.h"
 #include "utils_llist.h"
 
 #include <libxml/parser.h>
+#include <libxml/pattern.h>
 #include <libxml/tree.h>
 #include <libxml/xpath.h>
 #include <libxml/xpathInternals.h>
+#include <libxml/xmlreader.h>
 
 #include <curl/curl.h>
 
@@ -42,6 +45,7 @@ struct cx_values_s /* {{{ */
 {
   char path[DATA_MAX_NAME_LEN];
   size_t path_len;
+  xmlXPathCompExprPtr path_comp;
 };
 typedef struct cx_values_s cx_values_t;
 /* }}} */
@@ -57,6 +61,16 @@ struct cx_xpath_s /* {{{ */
   char *plugin_instance_from;
   int is_table;
   unsigned long magic;
+
+  /* Compiled once, NULL if the expression could not be compiled. */
+  xmlXPathCompExprPtr path_comp;
+  xmlXPathCompExprPtr instance_comp;
+  xmlXPathCompExprPtr plugin_instance_comp;
+
+  /* Used with `Streaming'. */
+  xmlPatternPtr pattern;
+  const data_set_t *ds;
+  size_t matches;
 };
 typedef struct cx_xpath_s cx_xpath_t;
 /* }}} */
@@ -91,6 +105,8 @@ struct cx_s /* {{{ */
   cx_namespace_t *namespaces;
   size_t namespaces_num;
 
+  _Bool streaming;
+
   CURL *curl;
   char curl_errbuf[CURL_ERROR_SIZE];
   char *buffer;
@@ -101,6 +117,9 @@ struct cx_s /* {{{ */
 };
 typedef struct cx_s cx_t; /* }}} */
 
+/* Transfers of all URLs run on one thread through the curl engine. */
+static _Bool cx_async = 0;
+
 /*
  * Private functions
  */
@@ -140,6 +159,14 @@ static void cx_xpath_free(cx_xpath_t *xpath) /* {{{ */
   if (xpath == NULL)
     return;
 
+  xmlXPathFreeCompExpr(xpath->path_comp);
+  xmlXPathFreeCompExpr(xpath->instance_comp);
+  xmlXPathFreeCompExpr(xpath->plugin_instance_comp);
+  for (size_t i = 0; i < xpath->values_len; i++)
+    xmlXPathFreeCompExpr(xpath->values[i].path_comp);
+  if (xpath->pattern != NULL)
+    xmlFreePattern(xpath->pattern);
+
   sfree(xpath->path);
   sfree(xpath->type);
   sfree(xpath->instance_prefix);
@@ -177,8 +204,10 @@ static void cx_free(void *arg) /* {{{ */
   if (db == NULL)
     return;
 
-  if (db->curl != NULL)
+  if (db->curl != NULL) {
+    curl_engine_cancel(db->curl);
     curl_easy_cleanup(db->curl);
+  }
   db->curl = NULL;
 
   if (db->xpath_list != NULL)
@@ -250,10 +279,11 @@ static int cx_check_type(const data_set_t *ds, cx_xpath_t *xpath) /* {{{ */
 } /* }}} cx_check_type */
 
 static xmlXPathObjectPtr cx_evaluate_xpath(xmlXPathContextPtr xpath_ctx,
-                                           char *expr) /* {{{ */
-{
+                                           char *expr, /* {{{ */
+                                           xmlXPathCompExprPtr comp) {
   xmlXPathObjectPtr xpath_obj =
-      xmlXPathEvalExpression(BAD_CAST expr, xpath_ctx);
+      (comp != NULL) ? xmlXPathCompiledEval(comp, xpath_ctx)
+                     : xmlXPathEvalExpression(BAD_CAST expr, xpath_ctx);
   if (xpath_obj == NULL) {
     WARNING("curl_xml plugin: "
             "Error unable to evaluate xpath expression \"%s\". Skipping...",
@@ -280,8 +310,9 @@ static int cx_if_not_text_node(xmlNodePtr node) /* {{{ */
  * Returned value should be freed with xmlFree().
  */
 static char *cx_get_text_node_value(xmlXPathContextPtr xpath_ctx, /* {{{ */
-                                    char *expr, const char *from_option) {
-  xmlXPathObjectPtr values_node_obj = cx_evaluate_xpath(xpath_ctx, expr);
+                                    char *expr, xmlXPathCompExprPtr comp,
+                                    const char *from_option) {
+  xmlXPathObjectPtr values_node_obj = cx_evaluate_xpath(xpath_ctx, expr, comp);
   if (values_node_obj == NULL)
     return NULL; /* Error already logged. */
 
@@ -329,8 +360,9 @@ static int cx_handle_single_value_xpath(xmlXPathContextPtr xpath_ctx, /* {{{ */
                                         cx_xpath_t *xpath, const data_set_t *ds,
                                         value_list_t *vl, int index) {
 
-  char *node_value = cx_get_text_node_value(
-      xpath_ctx, xpath->values[index].path, "ValuesFrom");
+  char *node_value =
+      cx_get_text_node_value(xpath_ctx, xpath->values[index].path,
+                             xpath->values[index].path_comp, "ValuesFrom");
 
   if (node_value == NULL)
     return -1;
@@ -389,8 +421,9 @@ static int cx_handle_instance_xpath(xmlXPathContextPtr xpath_ctx, /* {{{ */
 
   /* Handle type instance */
   if (xpath->instance != NULL) {
-    char *node_value =
-        cx_get_text_node_value(xpath_ctx, xpath->instance, "InstanceFrom");
+    char *node_value = cx_get_text_node_value(xpath_ctx, xpath->instance,
+                                              xpath->instance_comp,
+                                              "InstanceFrom");
     if (node_value == NULL)
       return -1;
 
@@ -408,7 +441,8 @@ static int cx_handle_instance_xpath(xmlXPathContextPtr xpath_ctx, /* {{{ */
   /* Handle plugin instance */
   if (xpath->plugin_instance_from != NULL) {
     char *node_value = cx_get_text_node_value(
-        xpath_ctx, xpath->plugin_instance_from, "PluginInstanceFrom");
+        xpath_ctx, xpath->plugin_instance_from, xpath->plugin_instance_comp,
+        "PluginInstanceFrom");
 
     if (node_value == NULL)
       return -1;
@@ -420,6 +454,30 @@ static int cx_handle_instance_xpath(xmlXPathContextPtr xpath_ctx, /* {{{ */
   return 0;
 } /* }}} int cx_handle_instance_xpath */
 
+/* Dispatches the values of one node selected by the base xpath. */
+static int cx_handle_base_node(const cx_t *db, /* {{{ */
+                               xmlXPathContextPtr xpath_ctx, cx_xpath_t *xpath,
+                               const data_set_t *ds, xmlNodePtr node) {
+  value_list_t vl = VALUE_LIST_INIT;
+
+  /* set the values for the value_list */
+  vl.values_len = ds->ds_num;
+  sstrncpy(vl.type, xpath->type, sizeof(vl.type));
+  sstrncpy(vl.plugin, (db->plugin_name != NULL) ? db->plugin_name : "curl_xml",
+           sizeof(vl.plugin));
+  sstrncpy(vl.host, cx_host(db), sizeof(vl.host));
+
+  xpath_ctx->node = node;
+
+  if (db->instance != NULL)
+    sstrncpy(vl.plugin_instance, db->instance, sizeof(vl.plugin_instance));
+
+  if (cx_handle_instance_xpath(xpath_ctx, xpath, &vl) != 0)
+    return -1; /* An error has already been reported. */
+
+  return cx_handle_all_value_xpaths(xpath_ctx, xpath, ds, &vl);
+} /* }}} int cx_handle_base_node */
+
 static int cx_handle_xpath(const cx_t *db, /* {{{ */
                            xmlXPathContextPtr xpath_ctx, cx_xpath_t *xpath) {
 
@@ -427,7 +485,8 @@ static int cx_handle_xpath(const cx_t *db, /* {{{ */
   if (cx_check_type(ds, xpath) != 0)
     return -1;
 
-  xmlXPathObjectPtr base_node_obj = cx_evaluate_xpath(xpath_ctx, xpath->path);
+  xmlXPathObjectPtr base_node_obj =
+      cx_evaluate_xpath(xpath_ctx, xpath->path, xpath->path_comp);
   if (base_node_obj == NULL)
     return -1; /* error is logged already */
 
@@ -456,27 +515,8 @@ static int cx_handle_xpath(const cx_t *db, /* {{{ */
     return -1;
   }
 
-  value_list_t vl = VALUE_LIST_INIT;
-
-  /* set the values for the value_list */
-  vl.values_len = ds->ds_num;
-  sstrncpy(vl.type, xpath->type, sizeof(vl.type));
-  sstrncpy(vl.plugin, (db->plugin_name != NULL) ? db->plugin_name : "curl_xml",
-           sizeof(vl.plugin));
-  sstrncpy(vl.host, cx_host(db), sizeof(vl.host));
-
-  for (int i = 0; i < total_nodes; i++) {
-    xpath_ctx->node = base_nodes->nodeTab[i];
-
-    if (db->instance != NULL)
-      sstrncpy(vl.plugin_instance, db->instance, sizeof(vl.plugin_instance));
-
-    if (cx_handle_instance_xpath(xpath_ctx, xpath, &vl) != 0)
-      continue; /* An error has already been reported. */
-
-    if (cx_handle_all_value_xpaths(xpath_ctx, xpath, ds, &vl) != 0)
-      continue; /* An error has been logged. */
-  }             /* for (i = 0; i < total_nodes; i++) */
+  for (int i = 0; i < total_nodes; i++)
+    cx_handle_base_node(db, xpath_ctx, xpath, ds, base_nodes->nodeTab[i]);
 
   /* free up the allocated memory */
   xmlXPathFreeObject(base_node_obj);
@@ -501,20 +541,12 @@ static int cx_handle_parsed_xml(cx_t *db, xmlDocPtr doc, /* {{{ */
   return status;
 } /* }}} cx_handle_parsed_xml */
 
-static int cx_parse_xml(cx_t *db, char *xml) /* {{{ */
+static xmlXPathContextPtr cx_new_context(cx_t *db, xmlDocPtr doc) /* {{{ */
 {
-  /* Load the XML */
-  xmlDocPtr doc = xmlParseDoc(BAD_CAST xml);
-  if (doc == NULL) {
-    ERROR("curl_xml plugin: Failed to parse the xml document  - %s", xml);
-    return -1;
-  }
-
   xmlXPathContextPtr xpath_ctx = xmlXPathNewContext(doc);
   if (xpath_ctx == NULL) {
     ERROR("curl_xml plugin: Failed to create the xml context");
-    xmlFreeDoc(doc);
-    return -1;
+    return NULL;
   }
 
   for (size_t i = 0; i < db->namespaces_num; i++) {
@@ -526,11 +558,28 @@ static int cx_parse_xml(cx_t *db, char *xml) /* {{{ */
             "unable to register NS with prefix=\"%s\" and href=\"%s\"\n",
             ns->prefix, ns->url);
       xmlXPathFreeContext(xpath_ctx);
-      xmlFreeDoc(doc);
-      return status;
+      return NULL;
     }
   }
 
+  return xpath_ctx;
+} /* }}} xmlXPathContextPtr cx_new_context */
+
+static int cx_parse_xml(cx_t *db, char *xml) /* {{{ */
+{
+  /* Load the XML */
+  xmlDocPtr doc = xmlParseDoc(BAD_CAST xml);
+  if (doc == NULL) {
+    ERROR("curl_xml plugin: Failed to parse the xml document  - %s", xml);
+    return -1;
+  }
+
+  xmlXPathContextPtr xpath_ctx = cx_new_context(db, doc);
+  if (xpath_ctx == NULL) {
+    xmlFreeDoc(doc);
+    return -1;
+  }
+
   int status = cx_handle_parsed_xml(db, doc, xpath_ctx);
   /* Cleanup */
   xmlXPathFreeContext(xpath_ctx);
@@ -538,22 +587,106 @@ static int cx_parse_xml(cx_t *db, char *xml) /* {{{ */
   return status;
 } /* }}} cx_parse_xml */
 
-static int cx_read(user_data_t *ud) /* {{{ */
+/*
+ * Streaming mode: Instead of building the tree of the whole document, the
+ * document is read with an xmlTextReader. Only the subtrees of elements
+ * matching the base xpath of a block are expanded, so that the relative
+ * expressions can be evaluated on them. The reader frees the nodes once it has
+ * moved past them.
+ */
+static int cx_parse_xml_stream(cx_t *db, char *xml, size_t xml_len) /* {{{ */
 {
-  if ((ud == NULL) || (ud->data == NULL)) {
-    ERROR("curl_xml plugin: cx_read: Invalid user data.");
+  xmlTextReaderPtr reader =
+      xmlReaderForMemory(xml, (int)xml_len, db->url, /* encoding = */ NULL,
+                         /* options = */ 0);
+  if (reader == NULL) {
+    ERROR("curl_xml plugin: xmlReaderForMemory failed.");
     return -1;
   }
 
-  long rc;
-  char *url;
-  cx_t *db = (cx_t *)ud->data;
+  for (llentry_t *le = llist_head(db->xpath_list); le != NULL; le = le->next) {
+    cx_xpath_t *xpath = le->value;
 
-  db->buffer_fill = 0;
+    xpath->matches = 0;
+    xpath->ds = plugin_get_ds(xpath->type);
+    if (cx_check_type(xpath->ds, xpath) != 0)
+      xpath->ds = NULL;
+  }
 
-  curl_easy_setopt(db->curl, CURLOPT_URL, db->url);
+  xmlXPathContextPtr xpath_ctx = NULL;
+  int status;
+  while ((status = xmlTextReaderRead(reader)) == 1) {
+    if (xmlTextReaderNodeType(reader) != XML_READER_TYPE_ELEMENT)
+      continue;
+
+    xmlNodePtr node = xmlTextReaderCurrentNode(reader);
+    for (llentry_t *le = llist_head(db->xpath_list); le != NULL;
+         le = le->next) {
+      cx_xpath_t *xpath = le->value;
+
+      if ((xpath->ds == NULL) || (xmlPatternMatch(xpath->pattern, node) != 1))
+        continue;
+
+      xpath->matches++;
+      if ((xpath->matches > 1) && (xpath->instance == NULL) &&
+          (xpath->plugin_instance_from == NULL)) {
+        if (xpath->matches == 2)
+          ERROR("curl_xml plugin: "
+                "InstanceFrom or PluginInstanceFrom is must in xpath block "
+                "since the base xpath expression \"%s\" "
+                "returned multiple results. Skipping the further results...",
+                xpath->path);
+        continue;
+      }
+
+      /* Don't use xmlTextReaderCurrentDoc(), it stops the reader from freeing
+       * nodes. */
+      if ((xpath_ctx == NULL) &&
+          ((xpath_ctx = cx_new_context(db, node->doc)) == NULL))
+        break;
+
+      xmlNodePtr subtree = xmlTextReaderExpand(reader);
+      if (subtree == NULL) {
+        ERROR("curl_xml plugin: xmlTextReaderExpand failed.");
+        break;
+      }
+
+      cx_handle_base_node(db, xpath_ctx, xpath, xpath->ds, subtree);
+    }
+  }
+
+  if (xpath_ctx != NULL)
+    xmlXPathFreeContext(xpath_ctx);
+  xmlFreeTextReader(reader);
+
+  if (status != 0) {
+    ERROR("curl_xml plugin: Failed to parse the xml document from %s.",
+          db->url);
+    return -1;
+  }
+
+  status = -1;
+  for (llentry_t *le = llist_head(db->xpath_list); le != NULL; le = le->next) {
+    cx_xpath_t *xpath = le->value;
+
+    if (xpath->matches > 0)
+      status = 0; /* we got atleast one success */
+    else if (xpath->ds != NULL)
+      ERROR("curl_xml plugin: "
+            "xpath expression \"%s\" doesn't match any of the nodes. "
+            "Skipping the xpath block...",
+            xpath->path);
+  }
+
+  return status;
+} /* }}} cx_parse_xml_stream */
+
+/* Handles the outcome of a transfer and parses the document. */
+static int cx_read_done(cx_t *db, CURLcode status) /* {{{ */
+{
+  long rc;
+  char *url;
 
-  int status = curl_easy_perform(db->curl);
   if (status != CURLE_OK) {
     ERROR("curl_xml plugin: curl_easy_perform failed with status %i: %s (%s)",
           status, db->curl_errbuf, db->url);
@@ -574,10 +707,52 @@ static int cx_read(user_data_t *ud) /* {{{ */
     return -1;
   }
 
-  status = cx_parse_xml(db, db->buffer);
+  int ret;
+  if (db->streaming)
+    ret = cx_parse_xml_stream(db, db->buffer, db->buffer_fill);
+  else
+    ret = cx_parse_xml(db, db->buffer);
   db->buffer_fill = 0;
 
-  return status;
+  return ret;
+} /* }}} int cx_read_done */
+
+/* Called on the curl engine's thread when an asynchronous transfer is done. */
+static void cx_async_done(CURL *curl, CURLcode status, /* {{{ */
+                          void *user_data) {
+  cx_read_done(user_data, status);
+} /* }}} void cx_async_done */
+
+static int cx_read(user_data_t *ud) /* {{{ */
+{
+  if ((ud == NULL) || (ud->data == NULL)) {
+    ERROR("curl_xml plugin: cx_read: Invalid user data.");
+    return -1;
+  }
+
+  cx_t *db = (cx_t *)ud->data;
+
+  /* The buffer belongs to the engine until the transfer is done. */
+  if (cx_async && curl_engine_busy(db->curl)) {
+    WARNING("curl_xml plugin: Request for %s still in progress, skipping.",
+            db->url);
+    return 0;
+  }
+
+  db->buffer_fill = 0;
+
+  curl_easy_setopt(db->curl, CURLOPT_URL, db->url);
+
+  if (!cx_async)
+    return cx_read_done(db, curl_easy_perform(db->curl));
+
+  int status = curl_engine_submit(db->curl, cx_async_done, db);
+  if (status != 0) {
+    ERROR("curl_xml plugin: Submitting request for %s failed: %s", db->url,
+          STRERROR(status));
+    return -1;
+  }
+  return 0;
 } /* }}} int cx_read */
 
 /* Configuration handling functions {{{ */
@@ -605,6 +780,7 @@ static int cx_config_add_values(const char *name, cx_xpath_t *xpath, /* {{{ */
 
   /* populate cx_values_t structure */
   for (int i = 0; i < ci->values_num; i++) {
+    xpath->values[i].path_comp = NULL;
     xpath->values[i].path_len = sizeof(ci->values[i].value.string);
     sstrncpy(xpath->values[i].path, ci->values[i].value.string,
              sizeof(xpath->values[i].path));
@@ -675,6 +851,18 @@ static int cx_config_add_xpath(cx_t *db, oconfig_item_t *ci) /* {{{ */
     return -1;
   }
 
+  /* Compile the expressions only once. If this fails, the expressions are
+   * evaluated as strings, so the error is reported on every read. */
+  xpath->path_comp = xmlXPathCompile(BAD_CAST xpath->path);
+  if (xpath->instance != NULL)
+    xpath->instance_comp = xmlXPathCompile(BAD_CAST xpath->instance);
+  if (xpath->plugin_instance_from != NULL)
+    xpath->plugin_instance_comp =
+        xmlXPathCompile(BAD_CAST xpath->plugin_instance_from);
+  for (size_t i = 0; i < xpath->values_len; i++)
+    xpath->values[i].path_comp =
+        xmlXPathCompile(BAD_CAST xpath->values[i].path);
+
   llentry_t *le = llentry_create(xpath->path, xpath);
   if (le == NULL) {
     ERROR("curl_xml plugin: llentry_create failed.");
@@ -721,6 +909,35 @@ static int cx_config_add_namespace(cx_t *db, /* {{{ */
 } /* }}} int cx_config_add_namespace */
 
 /* Initialize db->curl */
+/* Compiles the base xpaths to patterns which can be matched while streaming.
+ * Only simple paths, such as "/a/b" or "//b", can be compiled. */
+static int cx_compile_patterns(cx_t *db) /* {{{ */
+{
+  const xmlChar *namespaces[2 * db->namespaces_num + 2];
+
+  for (size_t i = 0; i < db->namespaces_num; i++) {
+    namespaces[2 * i] = BAD_CAST db->namespaces[i].url;
+    namespaces[2 * i + 1] = BAD_CAST db->namespaces[i].prefix;
+  }
+  namespaces[2 * db->namespaces_num] = NULL;
+  namespaces[2 * db->namespaces_num + 1] = NULL;
+
+  for (llentry_t *le = llist_head(db->xpath_list); le != NULL; le = le->next) {
+    cx_xpath_t *xpath = le->value;
+
+    xpath->pattern = xmlPatterncompile(BAD_CAST xpath->path, /* dict = */ NULL,
+                                       /* flags = */ 0, namespaces);
+    if (xpath->pattern == NULL) {
+      ERROR("curl_xml plugin: The xpath \"%s\" is not a simple path and can "
+            "not be used with `Streaming'.",
+            xpath->path);
+      return -1;
+    }
+  }
+
+  return 0;
+} /* }}} int cx_compile_patterns */
+
 static int cx_init_curl(cx_t *db) /* {{{ */
 {
   db->curl = curl_easy_init();
@@ -853,6 +1070,8 @@ static int cx_config_add_url(oconfig_item_t *ci) /* {{{ */
       status = cf_util_get_string(child, &db->post_body);
     else if (strcasecmp("Namespace", child->key) == 0)
       status = cx_config_add_namespace(db, child);
+    else if (strcasecmp("Streaming", child->key) == 0)
+      status = cf_util_get_boolean(child, &db->streaming);
     else if (strcasecmp("Timeout", child->key) == 0)
       status = cf_util_get_int(child, &db->timeout);
     else if (strcasecmp("Statistics", child->key) == 0) {
@@ -880,6 +1099,11 @@ static int cx_config_add_url(oconfig_item_t *ci) /* {{{ */
     return -1;
   }
 
+  if (db->streaming && (cx_compile_patterns(db) != 0)) {
+    cx_free(db);
+    return -1;
+  }
+
   if (cx_init_curl(db) != 0) {
     cx_free(db);
     return -1;
@@ -914,6 +1138,9 @@ static int cx_config(oconfig_item_t *ci) /* {{{ */
         success++;
       else
         errors++;
+    } else if (strcasecmp("Asynchronous", child->key) == 0) {
+      if (cf_util_get_boolean(child, &cx_async) != 0)
+        errors++;
     } else {
       WARNING("curl_xml plugin: Option `%s' not allowed here.", child->key);
       errors++;
@@ -933,10 +1160,24 @@ static int cx_init(void) /* {{{ */
   /* Call this while collectd is still single-threaded to avoid
    * initialization issues in libgcrypt. */
   curl_global_init(CURL_GLOBAL_SSL);
+
+  if (cx_async && (curl_engine_acquire() != 0)) {
+    ERROR("curl_xml plugin: Starting the curl engine failed.");
+    cx_async = 0;
+    return -1;
+  }
   return 0;
 } /* }}} int cx_init */
 
+static int cx_shutdown(void) /* {{{ */
+{
+  if (cx_async)
+    curl_engine_release();
+  return 0;
+} /* }}} int cx_shutdown */
+
 void module_register(void) {
   plugin_register_complex_config("curl_xml", cx_config);
   plugin_register_init("curl_xml", cx_init);
+  plugin_register_shutdown("curl_xml", cx_shutdown);
 } /* void module_register */
@@ -0,0 +1,473 @@
+/**
+ * collectd - src/daemon/bench_dispatch.c
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+/* Benchmark of the dispatch path: plugin_dispatch_values(), the filter
+ * chains, the value cache and the write queue. Reader threads play the part
+ * of read plugins and dispatch values as fast as they can, a write callback
+ * plays the part of a write plugin and measures the time from dispatching a
+ * value to writing it. Build with "make bench_dispatch". */
+
+#include "collectd.h"
+
+#include "common.h"
+#include "configfile.h"
+#include "filter_chain.h"
+#include "meta_data.h"
+#include "plugin.h"
+#include "utils_time.h"
+
+#include <getopt.h>
+
+/* Series are spread over this many plugin instances, which the rules of the
+ * benchmark chain match on. */
+#define BENCH_INSTANCES 64
+
+/* Upper bound of latency samples kept for the percentiles. */
+#define BENCH_SAMPLES_MAX (1 << 22)
+
+static size_t series_num = 1000;
+static size_t values_num = 1000;
+static size_t readers_num = 1;
+static size_t meta_num = 0;
+static size_t rules_num = 10;
+static long write_delay_us = 0;
+
+static pthread_mutex_t written_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t written = 0;
+static cdtime_t written_last = 0;
+/* Latency of every "samples_stride"th value written. */
+static cdtime_t *samples = NULL;
+static size_t samples_num = 0;
+static uint64_t samples_stride = 1;
+
+static data_source_t bench_dsrc = {"value", DS_TYPE_GAUGE, NAN, NAN};
+static data_set_t bench_ds = {"bench", 1, &bench_dsrc};
+
+/*
+ * Fake write plugin
+ */
+static int bench_write(const data_set_t *ds, const value_list_t *vl, /* {{{ */
+                       user_data_t __attribute__((unused)) * ud) {
+  cdtime_t now;
+
+  if (strcmp("bench", vl->plugin) != 0)
+    return 0;
+
+  if (write_delay_us > 0)
+    usleep((useconds_t)write_delay_us);
+
+  now = cdtime();
+  pthread_mutex_lock(&written_lock);
+  if (((written % samples_stride) == 0) && (samples_num < BENCH_SAMPLES_MAX))
+    samples[samples_num++] = (now > vl->time) ? now - vl->time : 0;
+  written++;
+  written_last = now;
+  pthread_mutex_unlock(&written_lock);
+
+  return 0;
+} /* }}} int bench_write */
+
+/*
+ * Fake read plugin
+ */
+static void *bench_reader(void *arg) /* {{{ */
+{
+  size_t id = (size_t)(uintptr_t)arg;
+  value_list_t vl = VALUE_LIST_INIT;
+  meta_data_t *meta = NULL;
+
+  sstrncpy(vl.host, hostname_g, sizeof(vl.host));
+  sstrncpy(vl.plugin, "bench", sizeof(vl.plugin));
+  sstrncpy(vl.type, "bench", sizeof(vl.type));
+
+  if (meta_num > 0) {
+    meta = meta_data_create();
+    for (size_t i = 0; i < meta_num; i++) {
+      char key[32];
+      snprintf(key, sizeof(key), "key%" PRIsz, i);
+      meta_data_add_string(meta, key, "a meta data value of some length");
+    }
+  }
+
+  /* Each reader has got a share of the series, so that the time of each
+   * series increases strictly, as the cache requires. */
+  for (size_t n = 0; n < values_num; n++) {
+    for (size_t i = id; i < series_num; i += readers_num) {
+      vl.values = &(value_t){.gauge = (gauge_t)n};
+      vl.values_len = 1;
+      vl.time = cdtime();
+      vl.meta = meta;
+      snprintf(vl.plugin_instance, sizeof(vl.plugin_instance), "%" PRIsz,
+               i % BENCH_INSTANCES);
+      snprintf(vl.type_instance, sizeof(vl.type_instance), "%" PRIsz, i);
+
+      plugin_dispatch_values(&vl);
+    }
+  }
+
+  meta_data_destroy(meta);
+  return NULL;
+} /* }}} void *bench_reader */
+
+/*
+ * Benchmark chain: rule <i> matches the series of plugin instance <i>. In the
+ * post-cache chain, the rule writes and stops and the chain's default target
+ * writes everything else. In the pre-cache chain, the rule returns, i.e.
+ * leaves the value to the cache and the default action.
+ */
+static int bench_match_create(const oconfig_item_t *ci, /* {{{ */
+                              void **user_data) {
+  char *instance = NULL;
+
+  for (int i = 0; i < ci->children_num; i++)
+    if (strcasecmp("PluginInstance", ci->children[i].key) == 0)
+      cf_util_get_string(ci->children + i, &instance);
+
+  if (instance == NULL)
+    return -1;
+
+  *user_data = instance;
+  return 0;
+} /* }}} int bench_match_create */
+
+static int bench_match_destroy(void **user_data) /* {{{ */
+{
+  sfree(*user_data);
+  return 0;
+} /* }}} int bench_match_destroy */
+
+static int bench_match(const data_set_t __attribute__((unused)) * ds, /* {{{ */
+                       const value_list_t *vl,
+                       notification_meta_t __attribute__((unused)) * *meta,
+                       void **user_data) {
+  if (strcmp(vl->plugin_instance, *user_data) == 0)
+    return FC_MATCH_MATCHES;
+  return FC_MATCH_NO_MATCH;
+} /* }}} int bench_match */
+
+static int bench_match_constraint(fc_constraint_t *ret, /* {{{ */
+                                  void **user_data) {
+  ret->field = FC_FIELD_PLUGIN_INSTANCE;
+  ret->exact = 1;
+  sstrncpy(ret->value, *user_data, sizeof(ret->value));
+  return 0;
+} /* }}} int bench_match_constraint */
+
+static oconfig_item_t *bench_ci_add(oconfig_item_t *parent, /* {{{ */
+                                    const char *key, const char *value) {
+  oconfig_item_t *tmp;
+  oconfig_item_t *ci;
+
+  tmp = realloc(parent->children,
+                sizeof(*tmp) * (size_t)(parent->children_num + 1));
+  if (tmp == NULL) {
+    fprintf(stderr, "realloc failed.\n");
+    exit(EXIT_FAILURE);
+  }
+  parent->children = tmp;
+
+  ci = parent->children + parent->children_num;
+  parent->children_num++;
+  memset(ci, 0, sizeof(*ci));
+  ci->key = strdup(key);
+  ci->parent = parent;
+
+  if (value != NULL) {
+    ci->values = calloc(1, sizeof(*ci->values));
+    ci->values->type = OCONFIG_TYPE_STRING;
+    ci->values->value.string = strdup(value);
+    ci->values_num = 1;
+  }
+
+  return ci;
+} /* }}} oconfig_item_t *bench_ci_add */
+
+static void bench_ci_free(oconfig_item_t *ci) /* {{{ */
+{
+  for (int i = 0; i < ci->children_num; i++)
+    bench_ci_free(ci->children + i);
+  sfree(ci->children);
+  if (ci->values_num > 0)
+    sfree(ci->values->value.string);
+  sfree(ci->values);
+  sfree(ci->key);
+} /* }}} void bench_ci_free */
+
+static int bench_chain_configure(const char *where) /* {{{ */
+{
+  oconfig_item_t root = {0};
+  oconfig_item_t *chain;
+  _Bool post;
+  int status;
+
+  if (strcasecmp("pre", where) == 0)
+    post = 0;
+  else if (strcasecmp("post", where) == 0)
+    post = 1;
+  else
+    return EINVAL;
+
+  /* Rules are nested through pointers into the children array of "chain",
+   * so all of them are added before the array may be moved by realloc(). */
+  chain = bench_ci_add(&root, "Chain", "bench");
+  for (size_t i = 0; i < rules_num; i++)
+    bench_ci_add(chain, "Rule", NULL);
+  if (post)
+    bench_ci_add(chain, "Target", "write");
+
+  for (size_t i = 0; i < rules_num; i++) {
+    oconfig_item_t *rule = chain->children + i;
+    oconfig_item_t *match;
+    char instance[32];
+
+    snprintf(instance, sizeof(instance), "%" PRIsz, i);
+    match = bench_ci_add(rule, "Match", "bench");
+    bench_ci_add(match, "PluginInstance", instance);
+    if (post) {
+      bench_ci_add(rule, "Target", "write");
+      bench_ci_add(rule, "Target", "stop");
+    } else {
+      bench_ci_add(rule, "Target", "return");
+    }
+  }
+
+  fc_register_match("bench", (match_proc_t){
+                                 .create = bench_match_create,
+                                 .destroy = bench_match_destroy,
+                                 .match = bench_match,
+                                 .constraint = bench_match_constraint,
+                             });
+
+  status = fc_configure(chain);
+  bench_ci_free(&root);
+  if (status != 0)
+    return status;
+
+  return global_option_set(post ? "PostCacheChain" : "PreCacheChain", "bench",
+                           /* from_cli = */ 0);
+} /* }}} int bench_chain_configure */
+
+static int bench_init(void) { return 0; }
+
+static int cdtime_compare(const void *a, const void *b) /* {{{ */
+{
+  cdtime_t ta = *(const cdtime_t *)a;
+  cdtime_t tb = *(const cdtime_t *)b;
+
+  return (ta > tb) - (ta < tb);
+} /* }}} int cdtime_compare */
+
+static cdtime_t samples_percentile(double percent) /* {{{ */
+{
+  size_t i;
+
+  if (samples_num == 0)
+    return 0;
+
+  i = (size_t)(percent / 100.0 * (double)samples_num);
+  if (i >= samples_num)
+    i = samples_num - 1;
+  return samples[i];
+} /* }}} cdtime_t samples_percentile */
+
+__attribute__((noreturn)) static void exit_usage(int status) /* {{{ */
+{
+  printf("Usage: bench_dispatch [OPTIONS]\n\n"
+         "Available options:\n"
+         "  -s <num>      Number of series. Default: %" PRIsz "\n"
+         "  -n <num>      Number of values per series. Default: %" PRIsz "\n"
+         "  -r <num>      Number of reader (dispatching) threads. Default: "
+         "%" PRIsz "\n"
+         "  -t <num>      Number of write threads. Default: 5\n"
+         "  -m <num>      Number of meta data entries per value list. "
+         "Default: %" PRIsz "\n"
+         "  -c <where>    Filter chain: \"none\", \"pre\" (PreCacheChain) or\n"
+         "                \"post\" (PostCacheChain). Default: none\n"
+         "  -R <num>      Number of rules in the filter chain. Default: %" PRIsz
+         "\n"
+         "  -q <num>      WriteQueueLimitHigh. Default: 0 (no limit)\n"
+         "  -w <usec>     Time the write callback takes. Default: 0\n"
+         "  -h            Display this help and exit.\n",
+         series_num, values_num, readers_num, meta_num, rules_num);
+  exit(status);
+} /* }}} void exit_usage */
+
+static size_t parse_size(const char *str) /* {{{ */
+{
+  char *endptr = NULL;
+  unsigned long long tmp;
+
+  errno = 0;
+  tmp = strtoull(str, &endptr, 10);
+  if ((errno != 0) || (endptr == str) || (*endptr != 0)) {
+    fprintf(stderr, "Not a number: %s\n", str);
+    exit_usage(EXIT_FAILURE);
+  }
+
+  return (size_t)tmp;
+} /* }}} size_t parse_size */
+
+int main(int argc, char **argv) /* {{{ */
+{
+  const char *chain = "none";
+  const char *write_threads = "5";
+  const char *queue_limit = NULL;
+  pthread_t *readers;
+  uint64_t total;
+  uint64_t done = 0;
+  cdtime_t start;
+  cdtime_t dispatched;
+  cdtime_t finished;
+  int c;
+
+  while ((c = getopt(argc, argv, "s:n:r:t:m:c:R:q:w:h")) != -1) {
+    switch (c) {
+    case 's':
+      series_num = parse_size(optarg);
+      break;
+    case 'n':
+      values_num = parse_size(optarg);
+      break;
+    case 'r':
+      readers_num = parse_size(optarg);
+      break;
+    case 't':
+      write_threads = optarg;
+      break;
+    case 'm':
+      meta_num = parse_size(optarg);
+      break;
+    case 'c':
+      chain = optarg;
+      break;
+    case 'R':
+      rules_num = parse_size(optarg);
+      break;
+    case 'q':
+      queue_limit = optarg;
+      break;
+    case 'w':
+      write_delay_us = (long)parse_size(optarg);
+      break;
+    case 'h':
+      exit_usage(EXIT_SUCCESS);
+    default:
+      exit_usage(EXIT_FAILURE);
+    }
+  }
+
+  if ((series_num == 0) || (values_num == 0) || (readers_num == 0))
+    exit_usage(EXIT_FAILURE);
+  if (readers_num > series_num)
+    readers_num = series_num;
+
+  hostname_set("localhost");
+  interval_g = TIME_T_TO_CDTIME_T(10);
+  timeout_g = 2;
+  plugin_init_ctx();
+
+  global_option_set("WriteThreads", write_threads, /* from_cli = */ 0);
+  if (queue_limit != NULL)
+    global_option_set("WriteQueueLimitHigh", queue_limit,
+                      /* from_cli = */ 0);
+
+  if ((strcasecmp("none", chain) != 0) &&
+      (bench_chain_configure(chain) != 0)) {
+    fprintf(stderr, "Configuring the filter chain \"%s\" failed.\n", chain);
+    exit_usage(EXIT_FAILURE);
+  }
+
+  total = (uint64_t)series_num * (uint64_t)values_num;
+  samples_stride = (total + BENCH_SAMPLES_MAX - 1) / BENCH_SAMPLES_MAX;
+  samples = calloc((size_t)(total / samples_stride) + 1, sizeof(*samples));
+  readers = calloc(readers_num, sizeof(*readers));
+  if ((samples == NULL) || (readers == NULL)) {
+    fprintf(stderr, "Allocating memory failed.\n");
+    return EXIT_FAILURE;
+  }
+
+  plugin_register_data_set(&bench_ds);
+  plugin_register_init("bench", bench_init);
+  plugin_register_write("bench", bench_write, /* user_data = */ NULL);
+  if (plugin_init_all() != 0) {
+    fprintf(stderr, "Initializing the plugins failed.\n");
+    return EXIT_FAILURE;
+  }
+
+  start = cdtime();
+  for (size_t i = 0; i < readers_num; i++)
+    if (pthread_create(readers + i, NULL, bench_reader,
+                       (void *)(uintptr_t)i) != 0) {
+      fprintf(stderr, "pthread_create failed.\n");
+      return EXIT_FAILURE;
+    }
+  for (size_t i = 0; i < readers_num; i++)
+    pthread_join(readers[i], NULL);
+  dispatched = cdtime();
+  sfree(readers);
+
+  /* Wait for the write threads to catch up. Values dropped because of
+   * "WriteQueueLimitHigh" never arrive, so give up once no more values have
+   * been written for a second. */
+  while (42) {
+    uint64_t now_done;
+
+    pthread_mutex_lock(&written_lock);
+    now_done = written;
+    finished = written_last;
+    pthread_mutex_unlock(&written_lock);
+
+    if (now_done >= total)
+      break;
+    if ((now_done == done) && (cdtime() - dispatched > TIME_T_TO_CDTIME_T(1)))
+      break;
+
+    done = now_done;
+    usleep(10000);
+  }
+  done = written;
+  if (finished < dispatched)
+    finished = dispatched;
+
+  plugin_shutdown_all();
+
+  printf("series=%" PRIsz " values=%" PRIsz " readers=%" PRIsz
+         " write_threads=%s meta=%" PRIsz " chain=%s rules=%" PRIsz "\n",
+         series_num, values_num, readers_num, write_threads, meta_num, chain,
+         (strcasecmp("none", chain) != 0) ? rules_num : 0);
+  printf("dispatched %" PRIu64 " values in %.3f s (%.0f values/s)\n", total,
+         CDTIME_T_TO_DOUBLE(dispatched - start),
+         (double)total / CDTIME_T_TO_DOUBLE(dispatched - start));
+  printf("written    %" PRIu64 " values in %.3f s (%.0f values/s), %" PRIu64
+         " lost\n",
+         done, CDTIME_T_TO_DOUBLE(finished - start),
+         (double)done / CDTIME_T_TO_DOUBLE(finished - start), total - done);
+  qsort(samples, samples_num, sizeof(*samples), cdtime_compare);
+  printf("latency    p50 %.6f s, p99 %.6f s, max %.6f s\n",
+         CDTIME_T_TO_DOUBLE(samples_percentile(50.0)),
+         CDTIME_T_TO_DOUBLE(samples_percentile(99.0)),
+         CDTIME_T_TO_DOUBLE(samples_percentile(100.0)));
+
+  sfree(samples);
+  return EXIT_SUCCESS;
+} /* }}} int main */
@@ -0,0 +1,665 @@
+/**
+ * collectd - src/daemon/bench_micro.c
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+/* Microbenchmarks of the core data structures and formatters. Each benchmark
+ * prints one JSON object per line, e.g.
+ *
+ *   {"benchmark":"c_avl_get","size":100000,"ops":100000,"ns_per_op":123.4}
+ *
+ * "size" is the size of the data structure or the number of series, "ops"
+ * the number of operations timed. Run with "make bench". */
+
+#include "collectd.h"
+
+#include "common.h"
+#include "meta_data.h"
+#include "plugin.h"
+#include "utils_avltree.h"
+#include "utils_btree.h"
+#include "utils_cache.h"
+#include "utils_format_graphite.h"
+#include "utils_format_json.h"
+#include "utils_format_kairosdb.h"
+#include "utils_heap.h"
+#include "utils_llist.h"
+#include "utils_time.h"
+
+#include <getopt.h>
+
+static size_t repeat = 3;
+static double scale = 1.0;
+
+static cdtime_t bench_begin;
+static cdtime_t bench_elapsed;
+
+#define BENCH_START() (bench_begin = cdtime())
+#define BENCH_STOP() (bench_elapsed = cdtime() - bench_begin)
+
+/* Keeps the compiler from optimizing away results. */
+static volatile uint64_t bench_sink;
+
+static char **bench_keys(size_t size) /* {{{ */
+{
+  char **keys = calloc(size, sizeof(*keys));
+  if (keys == NULL) {
+    fprintf(stderr, "calloc failed.\n");
+    exit(EXIT_FAILURE);
+  }
+
+  /* Keys look like the identifiers used throughout the daemon and are
+   * inserted in a pseudo random order. */
+  for (size_t i = 0; i < size; i++) {
+    char buffer[128];
+    size_t n = (i * 2654435761u) % size;
+    snprintf(buffer, sizeof(buffer), "host%" PRIsz "/cpu-%" PRIsz "/cpu-user",
+             n % 1000, n / 1000);
+    keys[i] = strdup(buffer);
+  }
+
+  return keys;
+} /* }}} char **bench_keys */
+
+static void bench_keys_free(char **keys, size_t size) /* {{{ */
+{
+  for (size_t i = 0; i < size; i++)
+    sfree(keys[i]);
+  sfree(keys);
+} /* }}} void bench_keys_free */
+
+static int compare_pointer(const void *a, const void *b) /* {{{ */
+{
+  uintptr_t ia = (uintptr_t)a;
+  uintptr_t ib = (uintptr_t)b;
+
+  return (ia > ib) - (ia < ib);
+} /* }}} int compare_pointer */
+
+static void bench_vl_init(value_list_t *vl, value_t *values, /* {{{ */
+                          size_t values_num) {
+  for (size_t i = 0; i < values_num; i++)
+    values[i].gauge = 42.0 + (gauge_t)i;
+
+  vl->values = values;
+  vl->values_len = values_num;
+  vl->time = TIME_T_TO_CDTIME_T(1480063672);
+  vl->interval = TIME_T_TO_CDTIME_T(10);
+  sstrncpy(vl->host, "example.com", sizeof(vl->host));
+  sstrncpy(vl->plugin, "interface", sizeof(vl->plugin));
+  sstrncpy(vl->plugin_instance, "eth0", sizeof(vl->plugin_instance));
+  sstrncpy(vl->type, "if_octets", sizeof(vl->type));
+} /* }}} void bench_vl_init */
+
+static data_source_t bench_dsrc[] = {
+    {"rx", DS_TYPE_GAUGE, 0.0, NAN}, {"tx", DS_TYPE_GAUGE, 0.0, NAN},
+};
+static data_set_t bench_ds = {"if_octets", STATIC_ARRAY_SIZE(bench_dsrc),
+                              bench_dsrc};
+
+/*
+ * AVL tree
+ */
+static uint64_t bench_avl_insert(size_t size) /* {{{ */
+{
+  char **keys = bench_keys(size);
+  c_avl_tree_t *t = c_avl_create((int (*)(const void *, const void *))strcmp);
+
+  BENCH_START();
+  for (size_t i = 0; i < size; i++)
+    c_avl_insert(t, keys[i], NULL);
+  BENCH_STOP();
+
+  c_avl_destroy(t);
+  bench_keys_free(keys, size);
+  return size;
+} /* }}} uint64_t bench_avl_insert */
+
+static uint64_t bench_avl_get(size_t size) /* {{{ */
+{
+  char **keys = bench_keys(size);
+  c_avl_tree_t *t = c_avl_create((int (*)(const void *, const void *))strcmp);
+  for (size_t i = 0; i < size; i++)
+    c_avl_insert(t, keys[i], keys[i]);
+
+  BENCH_START();
+  for (size_t i = 0; i < size; i++) {
+    void *value = NULL;
+    c_avl_get(t, keys[(i * 7) % size], &value);
+    bench_sink += (uintptr_t)value;
+  }
+  BENCH_STOP();
+
+  c_avl_destroy(t);
+  bench_keys_free(keys, size);
+  return size;
+} /* }}} uint64_t bench_avl_get */
+
+static uint64_t bench_avl_iterate(size_t size) /* {{{ */
+{
+  char **keys = bench_keys(size);
+  c_avl_tree_t *t = c_avl_create((int (*)(const void *, const void *))strcmp);
+  for (size_t i = 0; i < size; i++)
+    c_avl_insert(t, keys[i], keys[i]);
+
+  BENCH_START();
+  c_avl_iterator_t *iter = c_avl_get_iterator(t);
+  void *key;
+  void *value;
+  while (c_avl_iterator_next(iter, &key, &value) == 0)
+    bench_sink += (uintptr_t)value;
+  c_avl_iterator_destroy(iter);
+  BENCH_STOP();
+
+  c_avl_destroy(t);
+  bench_keys_free(keys, size);
+  return size;
+} /* }}} uint64_t bench_avl_iterate */
+
+static uint64_t bench_avl_remove(size_t size) /* {{{ */
+{
+  char **keys = bench_keys(size);
+  c_avl_tree_t *t = c_avl_create((int (*)(const void *, const void *))strcmp);
+  for (size_t i = 0; i < size; i++)
+    c_avl_insert(t, keys[i], NULL);
+
+  BENCH_START();
+  for (size_t i = 0; i < size; i++)
+    c_avl_remove(t, keys[i], NULL, NULL);
+  BENCH_STOP();
+
+  c_avl_destroy(t);
+  bench_keys_free(keys, size);
+  return size;
+} /* }}} uint64_t bench_avl_remove */
+
+/*
+ * B-tree
+ */
+static uint64_t bench_btree_insert(size_t size) /* {{{ */
+{
+  char **keys = bench_keys(size);
+  c_btree_t *t = c_btree_create((int (*)(const void *, const void *))strcmp);
+
+  BENCH_START();
+  for (size_t i = 0; i < size; i++)
+    c_btree_insert(t, keys[i], NULL);
+  BENCH_STOP();
+
+  c_btree_destroy(t);
+  bench_keys_free(keys, size);
+  return size;
+} /* }}} uint64_t bench_btree_insert */
+
+static uint64_t bench_btree_get(size_t size) /* {{{ */
+{
+  char **keys = bench_keys(size);
+  c_btree_t *t = c_btree_create((int (*)(const void *, const void *))strcmp);
+  for (size_t i = 0; i < size; i++)
+    c_btree_insert(t, keys[i], keys[i]);
+
+  BENCH_START();
+  for (size_t i = 0; i < size; i++) {
+    void *value = NULL;
+    c_btree_get(t, keys[(i * 7) % size], &value);
+    bench_sink += (uintptr_t)value;
+  }
+  BENCH_STOP();
+
+  c_btree_destroy(t);
+  bench_keys_free(keys, size);
+  return size;
+} /* }}} uint64_t bench_btree_get */
+
+static uint64_t bench_btree_iterate(size_t size) /* {{{ */
+{
+  char **keys = bench_keys(size);
+  c_btree_t *t = c_btree_create((int (*)(const void *, const void *))strcmp);
+  for (size_t i = 0; i < size; i++)
+    c_btree_insert(t, keys[i], keys[i]);
+
+  BENCH_START();
+  c_btree_iterator_t *iter = c_btree_get_iterator(t);
+  void *key;
+  void *value;
+  while (c_btree_iterator_next(iter, &key, &value) == 0)
+    bench_sink += (uintptr_t)value;
+  c_btree_iterator_destroy(iter);
+  BENCH_STOP();
+
+  c_btree_destroy(t);
+  bench_keys_free(keys, size);
+  return size;
+} /* }}} uint64_t bench_btree_iterate */
+
+static uint64_t bench_btree_remove(size_t size) /* {{{ */
+{
+  char **keys = bench_keys(size);
+  c_btree_t *t = c_btree_create((int (*)(const void *, const void *))strcmp);
+  for (size_t i = 0; i < size; i++)
+    c_btree_insert(t, keys[i], NULL);
+
+  BENCH_START();
+  for (size_t i = 0; i < size; i++)
+    c_btree_remove(t, keys[i], NULL, NULL);
+  BENCH_STOP();
+
+  c_btree_destroy(t);
+  bench_keys_free(keys, size);
+  return size;
+} /* }}} uint64_t bench_btree_remove */
+
+/*
+ * Heap
+ */
+static uint64_t bench_heap_insert_get(size_t size) /* {{{ */
+{
+  c_heap_t *h = c_heap_create(compare_pointer);
+
+  BENCH_START();
+  for (size_t i = 0; i < size; i++)
+    c_heap_insert(h, (void *)(uintptr_t)(((i * 2654435761u) % size) + 1));
+  for (size_t i = 0; i < size; i++)
+    bench_sink += (uintptr_t)c_heap_get_root(h);
+  BENCH_STOP();
+
+  c_heap_destroy(h);
+  return 2 * (uint64_t)size;
+} /* }}} uint64_t bench_heap_insert_get */
+
+/*
+ * Linked list. Used for the short lists of callbacks, hence the size.
+ */
+static uint64_t bench_llist_search(size_t size) /* {{{ */
+{
+  char **keys = bench_keys(size);
+  llist_t *l = llist_create();
+  uint64_t ops = 1000000;
+  for (size_t i = 0; i < size; i++)
+    llist_append(l, llentry_create(keys[i], NULL));
+
+  BENCH_START();
+  for (uint64_t i = 0; i < ops; i++)
+    bench_sink += (uintptr_t)llist_search(l, keys[i % size]);
+  BENCH_STOP();
+
+  llist_destroy(l);
+  bench_keys_free(keys, size);
+  return ops;
+} /* }}} uint64_t bench_llist_search */
+
+/*
+ * Meta data. "size" is the number of entries of each meta data object.
+ */
+static meta_data_t *bench_meta(size_t size) /* {{{ */
+{
+  meta_data_t *md = meta_data_create();
+
+  for (size_t i = 0; i < size; i++) {
+    char key[32];
+    snprintf(key, sizeof(key), "key%" PRIsz, i);
+    meta_data_add_string(md, key, "value");
+  }
+
+  return md;
+} /* }}} meta_data_t *bench_meta */
+
+static uint64_t bench_meta_data_add(size_t size) /* {{{ */
+{
+  uint64_t ops = 0;
+
+  BENCH_START();
+  for (size_t n = 0; n < 10000; n++) {
+    meta_data_t *md = bench_meta(size);
+    meta_data_destroy(md);
+    ops += size;
+  }
+  BENCH_STOP();
+
+  return ops;
+} /* }}} uint64_t bench_meta_data_add */
+
+static uint64_t bench_meta_data_get(size_t size) /* {{{ */
+{
+  meta_data_t *md = bench_meta(size);
+  char key[32];
+  uint64_t ops = 100000;
+
+  snprintf(key, sizeof(key), "key%" PRIsz, size - 1);
+
+  BENCH_START();
+  for (uint64_t i = 0; i < ops; i++) {
+    char *value = NULL;
+    meta_data_get_string(md, key, &value);
+    bench_sink += (uintptr_t)value;
+    sfree(value);
+  }
+  BENCH_STOP();
+
+  meta_data_destroy(md);
+  return ops;
+} /* }}} uint64_t bench_meta_data_get */
+
+static uint64_t bench_meta_data_clone(size_t size) /* {{{ */
+{
+  meta_data_t *md = bench_meta(size);
+  uint64_t ops = 100000;
+
+  BENCH_START();
+  for (uint64_t i = 0; i < ops; i++)
+    meta_data_destroy(meta_data_clone(md));
+  BENCH_STOP();
+
+  meta_data_destroy(md);
+  return ops;
+} /* }}} uint64_t bench_meta_data_clone */
+
+/*
+ * Identifiers and values
+ */
+static uint64_t bench_format_name(size_t size) /* {{{ */
+{
+  char name[6 * DATA_MAX_NAME_LEN];
+
+  BENCH_START();
+  for (size_t i = 0; i < size; i++) {
+    format_name(name, sizeof(name), "example.com", "interface", "eth0",
+                "if_octets", "");
+    bench_sink += (uint64_t)name[0];
+  }
+  BENCH_STOP();
+
+  return size;
+} /* }}} uint64_t bench_format_name */
+
+static uint64_t bench_parse_values(size_t size) /* {{{ */
+{
+  value_list_t vl = VALUE_LIST_INIT;
+  value_t values[2];
+
+  bench_vl_init(&vl, values, STATIC_ARRAY_SIZE(values));
+
+  BENCH_START();
+  for (size_t i = 0; i < size; i++) {
+    char buffer[] = "1480063672.123:12345.678:-0.5";
+    parse_values(buffer, &vl, &bench_ds);
+    bench_sink += (uint64_t)vl.time;
+  }
+  BENCH_STOP();
+
+  return size;
+} /* }}} uint64_t bench_parse_values */
+
+/*
+ * Formatters. Value lists are formatted into a buffer the size write_http
+ * uses by default, which is reset when full.
+ */
+static uint64_t bench_format_json(size_t size) /* {{{ */
+{
+  value_list_t vl = VALUE_LIST_INIT;
+  value_t values[2];
+  char buffer[4096];
+  size_t fill = 0;
+  size_t free_bytes = sizeof(buffer);
+
+  bench_vl_init(&vl, values, STATIC_ARRAY_SIZE(values));
+  format_json_initialize(buffer, &fill, &free_bytes);
+
+  BENCH_START();
+  for (size_t i = 0; i < size; i++) {
+    if (format_json_value_list(buffer, &fill, &free_bytes, &bench_ds, &vl,
+                               /* store_rates = */ 0) == -ENOMEM) {
+      format_json_initialize(buffer, &fill, &free_bytes);
+      format_json_value_list(buffer, &fill, &free_bytes, &bench_ds, &vl, 0);
+    }
+  }
+  BENCH_STOP();
+
+  bench_sink += fill;
+  return size;
+} /* }}} uint64_t bench_format_json */
+
+static uint64_t bench_format_graphite(size_t size) /* {{{ */
+{
+  value_list_t vl = VALUE_LIST_INIT;
+  value_t values[2];
+  char buffer[1024];
+
+  bench_vl_init(&vl, values, STATIC_ARRAY_SIZE(values));
+
+  BENCH_START();
+  for (size_t i = 0; i < size; i++) {
+    format_graphite(buffer, sizeof(buffer), &bench_ds, &vl, "collectd.", NULL,
+                    '_', GRAPHITE_SEPARATE_INSTANCES);
+    bench_sink += (uint64_t)buffer[0];
+  }
+  BENCH_STOP();
+
+  return size;
+} /* }}} uint64_t bench_format_graphite */
+
+/* Like bench_format_graphite(), but with the identity the daemon attaches to
+ * dispatched value lists, so the metric names come from the cache. */
+static uint64_t bench_format_graphite_cached(size_t size) /* {{{ */
+{
+  value_list_t vl = VALUE_LIST_INIT;
+  value_t values[2];
+  value_list_identity_t identity;
+  char buffer[1024];
+
+  bench_vl_init(&vl, values, STATIC_ARRAY_SIZE(values));
+  FORMAT_VL(identity.name, sizeof(identity.name), &vl);
+  identity.hash = identifier_hash(identity.name);
+  vl.identity = &identity;
+  vl.identity_owner = &vl;
+
+  BENCH_START();
+  for (size_t i = 0; i < size; i++) {
+    format_graphite(buffer, sizeof(buffer), &bench_ds, &vl, "collectd.", NULL,
+                    '_', GRAPHITE_SEPARATE_INSTANCES);
+    bench_sink += (uint64_t)buffer[0];
+  }
+  BENCH_STOP();
+
+  return size;
+} /* }}} uint64_t bench_format_graphite_cached */
+
+static uint64_t bench_format_kairosdb(size_t size) /* {{{ */
+{
+  value_list_t vl = VALUE_LIST_INIT;
+  value_t values[2];
+  char buffer[4096];
+  size_t fill = 0;
+  size_t free_bytes = sizeof(buffer);
+
+  format_kairosdb_t *fk = format_kairosdb_create(NULL, 0, /* data_ttl = */ 0,
+                                                 NULL, /* expire = */ 0);
+  if (fk == NULL) {
+    fprintf(stderr, "format_kairosdb_create failed.\n");
+    exit(EXIT_FAILURE);
+  }
+
+  bench_vl_init(&vl, values, STATIC_ARRAY_SIZE(values));
+
+  BENCH_START();
+  for (size_t i = 0; i < size; i++) {
+    if (format_kairosdb_value_list(fk, &bench_ds, &vl, /* store_rates = */ 0,
+                                   sizeof(buffer)) == -ENOMEM) {
+      fill = 0;
+      free_bytes = sizeof(buffer);
+      format_kairosdb_finalize(fk, buffer, &fill, &free_bytes);
+      format_kairosdb_value_list(fk, &bench_ds, &vl, 0, sizeof(buffer));
+    }
+  }
+  BENCH_STOP();
+
+  format_kairosdb_destroy(fk);
+  bench_sink += fill;
+  return size;
+} /* }}} uint64_t bench_format_kairosdb */
+
+/*
+ * Value cache. "size" is the number of series, each of which is updated ten
+ * times.
+ */
+static uint64_t bench_uc_update(size_t size) /* {{{ */
+{
+  static _Bool initialized = 0;
+  static cdtime_t t = 0;
+  value_list_t vl = VALUE_LIST_INIT;
+  value_t values[2];
+
+  if (!initialized) {
+    uc_init();
+    initialized = 1;
+  }
+
+  bench_vl_init(&vl, values, STATIC_ARRAY_SIZE(values));
+  if (t == 0)
+    t = vl.time;
+
+  BENCH_START();
+  for (size_t n = 0; n < 10; n++) {
+    t += vl.interval;
+    vl.time = t;
+    for (size_t i = 0; i < size; i++) {
+      snprintf(vl.type_instance, sizeof(vl.type_instance), "%" PRIsz, i);
+      uc_update(&bench_ds, &vl);
+    }
+  }
+  BENCH_STOP();
+
+  return 10 * (uint64_t)size;
+} /* }}} uint64_t bench_uc_update */
+
+typedef struct {
+  const char *name;
+  size_t size;
+  uint64_t (*run)(size_t size);
+} bench_t;
+
+static bench_t benchmarks[] = {
+    {"c_avl_insert", 100000, bench_avl_insert},
+    {"c_avl_get", 100000, bench_avl_get},
+    {"c_avl_iterate", 100000, bench_avl_iterate},
+    {"c_avl_remove", 100000, bench_avl_remove},
+    {"c_btree_insert", 100000, bench_btree_insert},
+    {"c_btree_get", 100000, bench_btree_get},
+    {"c_btree_iterate", 100000, bench_btree_iterate},
+    {"c_btree_remove", 100000, bench_btree_remove},
+    {"c_heap_insert_get_root", 100000, bench_heap_insert_get},
+    {"llist_search", 20, bench_llist_search},
+    {"meta_data_add", 10, bench_meta_data_add},
+    {"meta_data_get", 10, bench_meta_data_get},
+    {"meta_data_clone", 10, bench_meta_data_clone},
+    {"format_name", 1000000, bench_format_name},
+    {"parse_values", 1000000, bench_parse_values},
+    {"format_json_value_list", 1000000, bench_format_json},
+    {"format_graphite", 1000000, bench_format_graphite},
+    {"format_graphite_cached", 1000000, bench_format_graphite_cached},
+    {"format_kairosdb_value_list", 1000000, bench_format_kairosdb},
+    {"uc_update", 100000, bench_uc_update},
+};
+
+__attribute__((noreturn)) static void exit_usage(int status) /* {{{ */
+{
+  printf("Usage: bench_micro [OPTIONS] [BENCHMARK ...]\n\n"
+         "Runs the named benchmarks, or all of them.\n\n"
+         "Available options:\n"
+         "  -r <num>      Number of runs of each benchmark; the fastest run is\n"
+         "                reported. Default: %" PRIsz "\n"
+         "  -x <factor>   Scale the sizes of the benchmarks. Default: 1.0\n"
+         "  -l            List the benchmarks and exit.\n"
+         "  -h            Display this help and exit.\n",
+         repeat);
+  exit(status);
+} /* }}} void exit_usage */
+
+static _Bool bench_selected(const char *name, int argc, char **argv) /* {{{ */
+{
+  if (optind >= argc)
+    return 1;
+
+  for (int i = optind; i < argc; i++)
+    if (strcmp(name, argv[i]) == 0)
+      return 1;
+
+  return 0;
+} /* }}} _Bool bench_selected */
+
+int main(int argc, char **argv) /* {{{ */
+{
+  int c;
+
+  while ((c = getopt(argc, argv, "r:x:lh")) != -1) {
+    switch (c) {
+    case 'r':
+      repeat = (size_t)atoi(optarg);
+      break;
+    case 'x':
+      scale = atof(optarg);
+      break;
+    case 'l':
+      for (size_t i = 0; i < STATIC_ARRAY_SIZE(benchmarks); i++)
+        printf("%s\n", benchmarks[i].name);
+      exit(EXIT_SUCCESS);
+    case 'h':
+      exit_usage(EXIT_SUCCESS);
+    default:
+      exit_usage(EXIT_FAILURE);
+    }
+  }
+
+  if ((repeat < 1) || !(scale > 0.0))
+    exit_usage(EXIT_FAILURE);
+
+  hostname_set("localhost");
+  interval_g = TIME_T_TO_CDTIME_T(10);
+  plugin_init_ctx();
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(benchmarks); i++) {
+    bench_t *b = benchmarks + i;
+    size_t size;
+    uint64_t ops = 0;
+    cdtime_t best = 0;
+
+    if (!bench_selected(b->name, argc, argv))
+      continue;
+
+    size = (size_t)((double)b->size * scale);
+    if (size < 1)
+      size = 1;
+
+    for (size_t n = 0; n < repeat; n++) {
+      ops = b->run(size);
+      if ((n == 0) || (bench_elapsed < best))
+        best = bench_elapsed;
+    }
+
+    printf("{\"benchmark\":\"%s\",\"size\":%" PRIsz ",\"ops\":%" PRIu64
+           ",\"ns_per_op\":%.1f}\n",
+           b->name, size, ops,
+           (ops > 0) ? (double)CDTIME_T_TO_NS(best) / (double)ops : 0.0);
+    fflush(stdout);
+  }
+
+  return EXIT_SUCCESS;
+} /* }}} int main */
@@ -63,6 +63,10 @@ static void sig_int_handler(int __attribute__((unused)) signal) { loop++; }
 
 static void sig_term_handler(int __attribute__((unused)) signal) { loop++; }
 
+static void sig_hup_handler(int __attribute__((unused)) signal) {
+  cf_reload_request();
+}
+
 static void sig_usr1_handler(int __attribute__((unused)) signal) {
   pthread_t thread;
   pthread_attr_t attr;
@@ -145,6 +149,16 @@ static int init_global_variables(void) {
   }
   DEBUG("timeout_g = %i;", timeout_g);
 
+  str = global_option_get("ClockSource");
+  if ((str != NULL) && (strcasecmp("Coarse", str) == 0)) {
+    if (cdtime_set_clock(CDTIME_CLOCK_COARSE) != 0)
+      WARNING("The coarse clock is not available on this system, using the "
+              "precise clock instead.");
+  } else if ((str != NULL) && (strcasecmp("Precise", str) != 0)) {
+    fprintf(stderr, "ClockSource must be \"Precise\" or \"Coarse\".\n");
+    return -1;
+  }
+
   if (init_hostname() != 0)
     return -1;
   DEBUG("hostname_g = %s;", hostname_g);
@@ -294,6 +308,9 @@ static int do_loop(void) {
   while (loop == 0) {
     cdtime_t now;
 
+    if (cf_reload_requested())
+      cf_reload();
+
 #if HAVE_LIBKSTAT
     update_kstat();
 #endif
@@ -310,14 +327,23 @@ static int do_loop(void) {
       continue;
     }
 
-    struct timespec ts_wait = CDTIME_T_TO_TIMESPEC(wait_until - now);
+    cdtime_t wake_up = wait_until;
     wait_until = wait_until + interval;
 
-    while ((loop == 0) && (nanosleep(&ts_wait, &ts_wait) != 0)) {
-      if (errno != EINTR) {
+    /* Sleep at most a second at a time, so that reload requests which did
+     * not interrupt the sleep, e.g. from the unixsock plugin, are handled
+     * quickly. */
+    while ((loop == 0) && !cf_reload_requested() && (now < wake_up)) {
+      cdtime_t step = wake_up - now;
+      if (step > TIME_T_TO_CDTIME_T(1))
+        step = TIME_T_TO_CDTIME_T(1);
+
+      struct timespec ts_wait = CDTIME_T_TO_TIMESPEC(step);
+      if ((nanosleep(&ts_wait, NULL) != 0) && (errno != EINTR)) {
         ERROR("nanosleep failed: %s", STRERRNO);
         return -1;
       }
+      now = cdtime();
     }
   } /* while (loop == 0) */
 
@@ -641,6 +667,14 @@ int main(int argc, char **argv) {
     return 1;
   }
 
+  struct sigaction sig_hup_action = {.sa_handler = sig_hup_handler};
+
+  if (0 != sigaction(SIGHUP, &sig_hup_action, NULL)) {
+    ERROR("Error: Failed to install a signal handler for signal HUP: %s",
+          STRERRNO);
+    return 1;
+  }
+
   struct sigaction sig_usr1_action = {.sa_handler = sig_usr1_handler};
 
   if (0 != sigaction(SIGUSR1, &sig_usr1_action, NULL)) {
@@ -38,6 +38,7 @@
 #include "utils_cache.h"
 
 /* for getaddrinfo */
+#include <float.h>
 #include <netdb.h>
 #include <sys/types.h>
 
@@ -60,6 +61,8 @@
 #include <sys/capability.h>
 #endif
 
+#include <sys/resource.h>
+
 #ifdef HAVE_LIBKSTAT
 extern kstat_ctl_t *kc;
 #endif
@@ -77,6 +80,29 @@ static pthread_mutex_t getpwnam_r_lock = PTHREAD_MUTEX_INITIALIZER;
 static pthread_mutex_t strerror_r_lock = PTHREAD_MUTEX_INITIALIZER;
 #endif
 
+/* Open files of read_file_cached(). Entries are reference counted, so that a
+ * file can be evicted while another thread is reading it. */
+#define READ_FILE_CACHE_BUCKETS 256
+#define READ_FILE_CACHE_MIN 16
+#define READ_FILE_CACHE_MAX 1024
+
+struct read_file_entry_s;
+typedef struct read_file_entry_s read_file_entry_t;
+struct read_file_entry_s {
+  char *path;
+  int fd;
+  unsigned int refs;
+  _Bool unlinked;
+  uint64_t last_used;
+  read_file_entry_t *next;
+};
+
+static pthread_mutex_t read_file_lock = PTHREAD_MUTEX_INITIALIZER;
+static read_file_entry_t *read_file_buckets[READ_FILE_CACHE_BUCKETS];
+static size_t read_file_entries_num;
+static size_t read_file_entries_max;
+static uint64_t read_file_clock;
+
 char *sstrncpy(char *dest, const char *src, size_t n) {
   strncpy(dest, src, n);
   dest[n - 1] = '\0';
@@ -457,6 +483,14 @@ size_t strstripnewline(char *buffer) {
 
 int escape_slashes(char *buffer, size_t buffer_size) {
   size_t buffer_len;
+  char *slash;
+
+  /* Identifiers hardly ever contain slashes: a single strchr(), which C
+   * libraries implement with vector instructions, is all it takes to find
+   * out. The buffer is only rewritten if a slash has been found. */
+  slash = strchr(buffer, '/');
+  if (slash == NULL)
+    return 0;
 
   buffer_len = strlen(buffer);
 
@@ -472,13 +506,10 @@ int escape_slashes(char *buffer, size_t buffer_size) {
   /* Move one to the left */
   if (buffer[0] == '/') {
     memmove(buffer, buffer + 1, buffer_len);
-    buffer_len--;
   }
 
-  for (size_t i = 0; i < buffer_len; i++) {
-    if (buffer[i] == '/')
-      buffer[i] = '_';
-  }
+  for (slash = strchr(buffer, '/'); slash != NULL; slash = strchr(slash, '/'))
+    *slash = '_';
 
   return 0;
 } /* int escape_slashes */
@@ -851,6 +882,33 @@ int format_name(char *ret, int ret_len, const char *hostname,
   return 0;
 } /* int format_name */
 
+int format_vl(char *ret, size_t ret_len, value_list_t const *vl) {
+  value_list_identity_t const *identity = VALUE_LIST_IDENTITY(vl);
+
+  if (identity == NULL)
+    return format_name(ret, (int)ret_len, vl->host, vl->plugin,
+                       vl->plugin_instance, vl->type, vl->type_instance);
+
+  size_t len = strlen(identity->name);
+  if (len >= ret_len)
+    return ENOBUFS;
+  memcpy(ret, identity->name, len + 1);
+  return 0;
+} /* int format_vl */
+
+/* 64 bit FNV-1a hash */
+uint64_t identifier_hash(const char *identifier) {
+  uint64_t hash = 14695981039346656037ULL;
+
+  for (const unsigned char *c = (const unsigned char *)identifier; *c != 0;
+       c++) {
+    hash ^= (uint64_t)*c;
+    hash *= 1099511628211ULL;
+  }
+
+  return hash;
+} /* uint64_t identifier_hash */
+
 int format_values(char *ret, size_t ret_len, /* {{{ */
                   const data_set_t *ds, const value_list_t *vl,
                   _Bool store_rates) {
@@ -992,58 +1050,199 @@ int parse_identifier_vl(const char *str, value_list_t *vl) /* {{{ */
   return 0;
 } /* }}} int parse_identifier_vl */
 
+/* Parses the common forms of decimal numbers, e.g. "42", "-1.5" or
+ * "2.5e-3", without calling strtod(): if the significand has at most 19
+ * digits, fits into the 53 bit mantissa and the decimal exponent is within
+ * +/-22, both the significand and the power of ten are exact doubles and a
+ * single multiplication or division rounds correctly (Clinger's fast path).
+ * Returns false for everything else, including leading white space, hex
+ * floats, "inf" and "nan", and for x87 style excess precision, so that the
+ * caller falls back to strtod() with its usual semantics. */
+static _Bool parse_double_fast(char const *str, double *ret_value, /* {{{ */
+                               char const **ret_end) {
+#if defined(FLT_EVAL_METHOD) && (FLT_EVAL_METHOD == 0)
+  static double const powers[] = {
+      1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+      1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+  };
+  char const *ptr = str;
+  _Bool negative = 0;
+  uint64_t mantissa = 0;
+  int digits = 0; /* significant digits in "mantissa" */
+  int any_digit = 0;
+  int exponent = 0;
+
+  if ((*ptr == '-') || (*ptr == '+')) {
+    negative = (*ptr == '-');
+    ptr++;
+  }
+  if ((ptr[0] == '0') && ((ptr[1] == 'x') || (ptr[1] == 'X')))
+    return 0;
+
+  for (; isdigit((unsigned char)*ptr); ptr++) {
+    any_digit = 1;
+    if ((mantissa == 0) && (*ptr == '0'))
+      continue;
+    if (++digits > 19)
+      return 0;
+    mantissa = 10 * mantissa + (uint64_t)(*ptr - '0');
+  }
+  if (*ptr == '.') {
+    for (ptr++; isdigit((unsigned char)*ptr); ptr++) {
+      any_digit = 1;
+      exponent--;
+      if ((mantissa == 0) && (*ptr == '0'))
+        continue;
+      if (++digits > 19)
+        return 0;
+      mantissa = 10 * mantissa + (uint64_t)(*ptr - '0');
+    }
+  }
+  if (!any_digit)
+    return 0;
+
+  if ((*ptr == 'e') || (*ptr == 'E')) {
+    char const *exp_ptr = ptr + 1;
+    _Bool exp_negative = 0;
+    int exp = 0;
+
+    if ((*exp_ptr == '-') || (*exp_ptr == '+')) {
+      exp_negative = (*exp_ptr == '-');
+      exp_ptr++;
+    }
+    if (!isdigit((unsigned char)*exp_ptr))
+      return 0;
+    for (; isdigit((unsigned char)*exp_ptr); exp_ptr++) {
+      if (exp > 1000)
+        return 0;
+      exp = 10 * exp + (*exp_ptr - '0');
+    }
+    exponent += exp_negative ? -exp : exp;
+    ptr = exp_ptr;
+  }
+
+  if (mantissa > (UINT64_C(1) << 53))
+    return 0;
+
+  double value = (double)mantissa;
+  if (mantissa == 0)
+    exponent = 0;
+  if ((exponent < -22) || (exponent > 22))
+    return 0;
+  if (exponent < 0)
+    value /= powers[-exponent];
+  else
+    value *= powers[exponent];
+
+  *ret_value = negative ? -value : value;
+  *ret_end = ptr;
+  return 1;
+#else
+  return 0;
+#endif
+} /* }}} _Bool parse_double_fast */
+
+/* Parses plain decimal integers, the common case of strtoull(str, end, 0).
+ * Returns false for leading white space, signs, octal and hex numbers and
+ * anything that might overflow, so that the caller falls back to
+ * strto[u]ll() with its usual semantics. */
+static _Bool parse_uint_fast(char const *str, uint64_t *ret_value, /* {{{ */
+                             char const **ret_end) {
+  char const *ptr = str;
+  uint64_t value = 0;
+
+  if (!isdigit((unsigned char)*ptr))
+    return 0;
+  /* A leading zero is an octal or hex prefix, unless it is just "0". */
+  if ((ptr[0] == '0') && (isalnum((unsigned char)ptr[1]) != 0))
+    return 0;
+
+  for (int digits = 0; isdigit((unsigned char)*ptr); ptr++, digits++) {
+    if (digits >= 18)
+      return 0;
+    value = 10 * value + (uint64_t)(*ptr - '0');
+  }
+
+  *ret_value = value;
+  *ret_end = ptr;
+  return 1;
+} /* }}} _Bool parse_uint_fast */
+
+/* Like strtod() for the numbers collectd deals with, but much faster for the
+ * common case. */
+static double parse_double(char const *str, char const **ret_end) /* {{{ */
+{
+  double value;
+
+  if (parse_double_fast(str, &value, ret_end))
+    return value;
+
+  char *end = NULL;
+  value = strtod(str, &end);
+  *ret_end = end;
+  return value;
+} /* }}} double parse_double */
+
 int parse_value(const char *value_orig, value_t *ret_value, int ds_type) {
-  char *value;
-  char *endptr = NULL;
+  char const *endptr = NULL;
+  char *tmp = NULL;
+  uint64_t u;
   size_t value_len;
 
   if (value_orig == NULL)
     return EINVAL;
 
-  value = strdup(value_orig);
-  if (value == NULL)
-    return ENOMEM;
-  value_len = strlen(value);
-
-  while ((value_len > 0) && isspace((int)value[value_len - 1])) {
-    value[value_len - 1] = 0;
+  /* Trailing white space is not garbage. */
+  value_len = strlen(value_orig);
+  while ((value_len > 0) && isspace((int)value_orig[value_len - 1]))
     value_len--;
-  }
+  char const *value_end = value_orig + value_len;
 
   switch (ds_type) {
   case DS_TYPE_COUNTER:
-    ret_value->counter = (counter_t)strtoull(value, &endptr, 0);
+    if (!parse_uint_fast(value_orig, &u, &endptr)) {
+      u = (uint64_t)strtoull(value_orig, &tmp, 0);
+      endptr = tmp;
+    }
+    ret_value->counter = (counter_t)u;
     break;
 
   case DS_TYPE_GAUGE:
-    ret_value->gauge = (gauge_t)strtod(value, &endptr);
+    ret_value->gauge = (gauge_t)parse_double(value_orig, &endptr);
     break;
 
   case DS_TYPE_DERIVE:
-    ret_value->derive = (derive_t)strtoll(value, &endptr, 0);
+    if (parse_uint_fast(value_orig + (value_orig[0] == '-'), &u, &endptr))
+      ret_value->derive = (value_orig[0] == '-') ? -(derive_t)u : (derive_t)u;
+    else {
+      ret_value->derive = (derive_t)strtoll(value_orig, &tmp, 0);
+      endptr = tmp;
+    }
     break;
 
   case DS_TYPE_ABSOLUTE:
-    ret_value->absolute = (absolute_t)strtoull(value, &endptr, 0);
+    if (!parse_uint_fast(value_orig, &u, &endptr)) {
+      u = (uint64_t)strtoull(value_orig, &tmp, 0);
+      endptr = tmp;
+    }
+    ret_value->absolute = (absolute_t)u;
     break;
 
   default:
-    sfree(value);
     ERROR("parse_value: Invalid data source type: %i.", ds_type);
     return -1;
   }
 
-  if (value == endptr) {
-    ERROR("parse_value: Failed to parse string as %s: \"%s\".",
-          DS_TYPE_TO_STRING(ds_type), value);
-    sfree(value);
+  if (value_orig == endptr) {
+    ERROR("parse_value: Failed to parse string as %s: \"%.*s\".",
+          DS_TYPE_TO_STRING(ds_type), (int)value_len, value_orig);
     return -1;
-  } else if ((NULL != endptr) && ('\0' != *endptr))
-    INFO("parse_value: Ignoring trailing garbage \"%s\" after %s value. "
+  } else if ((NULL != endptr) && (endptr < value_end))
+    INFO("parse_value: Ignoring trailing garbage \"%.*s\" after %s value. "
          "Input string was \"%s\".",
-         endptr, DS_TYPE_TO_STRING(ds_type), value_orig);
+         (int)(value_end - endptr), endptr, DS_TYPE_TO_STRING(ds_type),
+         value_orig);
 
-  sfree(value);
   return 0;
 } /* int parse_value */
 
@@ -1073,11 +1272,11 @@ int parse_values(char *buffer, value_list_t *vl, const data_set_t *ds) {
       if (strcmp("N", ptr) == 0)
         vl->time = cdtime();
       else {
-        char *endptr = NULL;
+        char const *endptr = NULL;
         double tmp;
 
         errno = 0;
-        tmp = strtod(ptr, &endptr);
+        tmp = parse_double(ptr, &endptr);
         if ((errno != 0)        /* Overflow */
             || (endptr == ptr)  /* Invalid string */
             || (endptr == NULL) /* This should not happen */
@@ -1254,6 +1453,192 @@ ssize_t read_file_contents(const char *filename, char *buf, size_t bufsize) {
   return ret;
 }
 
+static read_file_entry_t **read_file_lookup(char const *path) /* {{{ */
+{
+  size_t b = (size_t)(identifier_hash(path) % READ_FILE_CACHE_BUCKETS);
+
+  for (read_file_entry_t **e = &read_file_buckets[b]; *e != NULL;
+       e = &(*e)->next)
+    if (strcmp((*e)->path, path) == 0)
+      return e;
+
+  return NULL;
+} /* }}} read_file_entry_t **read_file_lookup */
+
+/* Removes an entry from the cache. It is freed once it is no longer in use.
+ * read_file_lock must be held. */
+static void read_file_unlink(read_file_entry_t *e) /* {{{ */
+{
+  if (e->unlinked)
+    return;
+
+  read_file_entry_t **ptr = read_file_lookup(e->path);
+  assert((ptr != NULL) && (*ptr == e));
+  *ptr = e->next;
+  e->next = NULL;
+  e->unlinked = 1;
+  read_file_entries_num--;
+
+  if (e->refs == 0) {
+    close(e->fd);
+    sfree(e->path);
+    sfree(e);
+  }
+} /* }}} void read_file_unlink */
+
+/* Evicts the least recently used entry. read_file_lock must be held. */
+static void read_file_evict(void) /* {{{ */
+{
+  read_file_entry_t *oldest = NULL;
+
+  for (size_t i = 0; i < READ_FILE_CACHE_BUCKETS; i++)
+    for (read_file_entry_t *e = read_file_buckets[i]; e != NULL; e = e->next)
+      if ((oldest == NULL) || (e->last_used < oldest->last_used))
+        oldest = e;
+
+  if (oldest != NULL)
+    read_file_unlink(oldest);
+} /* }}} void read_file_evict */
+
+static read_file_entry_t *read_file_acquire(char const *path) /* {{{ */
+{
+  pthread_mutex_lock(&read_file_lock);
+
+  if (read_file_entries_max == 0) {
+    /* Leave most descriptors to the plugins. */
+    struct rlimit rl = {0};
+    rlim_t max = READ_FILE_CACHE_MAX;
+    if ((getrlimit(RLIMIT_NOFILE, &rl) == 0) &&
+        (rl.rlim_cur != RLIM_INFINITY) && (rl.rlim_cur / 4 < max))
+      max = rl.rlim_cur / 4;
+    read_file_entries_max =
+        (max < READ_FILE_CACHE_MIN) ? READ_FILE_CACHE_MIN : (size_t)max;
+  }
+
+  read_file_entry_t **ptr = read_file_lookup(path);
+  if (ptr != NULL) {
+    read_file_entry_t *e = *ptr;
+    e->refs++;
+    e->last_used = ++read_file_clock;
+    pthread_mutex_unlock(&read_file_lock);
+    return e;
+  }
+  pthread_mutex_unlock(&read_file_lock);
+
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return NULL;
+
+  read_file_entry_t *e = calloc(1, sizeof(*e));
+  if (e != NULL)
+    e->path = strdup(path);
+  if ((e == NULL) || (e->path == NULL)) {
+    sfree(e);
+    close(fd);
+    return NULL;
+  }
+  e->fd = fd;
+  e->refs = 1;
+
+  pthread_mutex_lock(&read_file_lock);
+  /* Another thread may have opened the file in the meantime. */
+  ptr = read_file_lookup(path);
+  if (ptr != NULL) {
+    read_file_entry_t *other = *ptr;
+    other->refs++;
+    other->last_used = ++read_file_clock;
+    pthread_mutex_unlock(&read_file_lock);
+    close(fd);
+    sfree(e->path);
+    sfree(e);
+    return other;
+  }
+
+  while (read_file_entries_num >= read_file_entries_max)
+    read_file_evict();
+
+  size_t b = (size_t)(identifier_hash(path) % READ_FILE_CACHE_BUCKETS);
+  e->last_used = ++read_file_clock;
+  e->next = read_file_buckets[b];
+  read_file_buckets[b] = e;
+  read_file_entries_num++;
+  pthread_mutex_unlock(&read_file_lock);
+
+  return e;
+} /* }}} read_file_entry_t *read_file_acquire */
+
+static void read_file_release(read_file_entry_t *e, _Bool failed) /* {{{ */
+{
+  pthread_mutex_lock(&read_file_lock);
+  e->refs--;
+  if (failed)
+    read_file_unlink(e);
+  else if (e->unlinked && (e->refs == 0)) {
+    close(e->fd);
+    sfree(e->path);
+    sfree(e);
+  }
+  pthread_mutex_unlock(&read_file_lock);
+} /* }}} void read_file_release */
+
+static ssize_t read_file_pread(int fd, char *buf, size_t bufsize) /* {{{ */
+{
+  size_t len = 0;
+
+  /* Files in /proc may return less than requested before the end. */
+  while (len < bufsize) {
+    ssize_t status = pread(fd, buf + len, bufsize - len, (off_t)len);
+    if (status < 0) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    if (status == 0)
+      break;
+    len += (size_t)status;
+  }
+
+  return (ssize_t)len;
+} /* }}} ssize_t read_file_pread */
+
+ssize_t read_file_cached(char const *path, char *buf, size_t bufsize) /* {{{ */
+{
+  if ((path == NULL) || (buf == NULL))
+    return -1;
+
+  /* If reading a cached descriptor fails, e.g. because the device behind a
+   * sysfs attribute went away, the file is opened again once. */
+  for (int i = 0; i < 2; i++) {
+    read_file_entry_t *e = read_file_acquire(path);
+    if (e == NULL)
+      return -1;
+
+    ssize_t len = read_file_pread(e->fd, buf, bufsize);
+    read_file_release(e, /* failed = */ len < 0);
+    if (len >= 0)
+      return len;
+  }
+
+  return -1;
+} /* }}} ssize_t read_file_cached */
+
+int parse_value_file_cached(char const *path, value_t *ret_value, /* {{{ */
+                            int ds_type) {
+  char buffer[256];
+
+  ssize_t len = read_file_cached(path, buffer, sizeof(buffer) - 1);
+  if (len < 0)
+    return -1;
+  buffer[len] = 0;
+
+  /* Like parse_value_file(), only look at the first line. */
+  char *newline = strchr(buffer, '\n');
+  if (newline != NULL)
+    *newline = 0;
+
+  return parse_value(buffer, ret_value, ds_type);
+} /* }}} int parse_value_file_cached */
+
 counter_t counter_diff(counter_t old_value, counter_t new_value) {
   counter_t diff;
 
@@ -312,9 +312,9 @@ double htond(double d);
 int format_name(char *ret, int ret_len, const char *hostname,
                 const char *plugin, const char *plugin_instance,
                 const char *type, const char *type_instance);
-#define FORMAT_VL(ret, ret_len, vl)                                            \
-  format_name(ret, ret_len, (vl)->host, (vl)->plugin, (vl)->plugin_instance,   \
-              (vl)->type, (vl)->type_instance)
+int format_vl(char *ret, size_t ret_len, value_list_t const *vl);
+#define FORMAT_VL(ret, ret_len, vl) format_vl(ret, ret_len, vl)
+uint64_t identifier_hash(const char *identifier);
 int format_values(char *ret, size_t ret_len, const data_set_t *ds,
                   const value_list_t *vl, _Bool store_rates);
 
@@ -351,6 +351,18 @@ int walk_directory(const char *dir, dirwalk_callback_f callback,
 /* Returns the number of bytes read or negative on error. */
 ssize_t read_file_contents(char const *filename, char *buf, size_t bufsize);
 
+/* read_file_cached reads up to "bufsize" bytes of "path" like
+ * read_file_contents, but keeps the file open between calls and reads it with
+ * pread(2) from offset zero. It is meant for files in /proc and /sys, whose
+ * content is generated when they are read, and saves the path lookup for each
+ * read. A limited number of files is kept open. If reading fails, e.g.
+ * because the device behind a sysfs attribute went away, the file is opened
+ * again once. Returns the number of bytes read or negative on error. */
+ssize_t read_file_cached(char const *path, char *buf, size_t bufsize);
+
+/* parse_value_file_cached is parse_value_file using read_file_cached. */
+int parse_value_file_cached(char const *path, value_t *ret_value, int ds_type);
+
 counter_t counter_diff(counter_t old_value, counter_t new_value);
 
 /* Convert a rate back to a value_t. When converting to a derive_t, counter_t
@@ -181,6 +181,9 @@ DEF_TEST(escape_slashes) {
       {"/like/a/path", "like_a_path"},
       {"trailing/slash/", "trailing_slash_"},
       {"foo//bar", "foo__bar"},
+      {"no-slashes", "no-slashes"},
+      {"/", "root"},
+      {"", ""},
   };
 
   for (size_t i = 0; i < STATIC_ARRAY_SIZE(cases); i++) {
@@ -305,6 +308,73 @@ DEF_TEST(parse_values) {
   return 0;
 }
 
+DEF_TEST(parse_value) {
+  /* Gauges must be parsed exactly like strtod() does. */
+  char const *gauges[] = {
+      "0",        "-0",         "42",          "+42",
+      "12.3",     "-12.3",      ".5",          "1.",
+      "0.1",      "1e3",        "2.5E-3",      "123456789012345678",
+      "1e22",     "1e23",       "1e-22",       "1e-23",
+      "9007199254740993", "0.30000000000000004", "4.9e-324", "1e400",
+      "0x10",     "inf",        "-nan",        "  7.5",
+      "007.50",   "1.5abc",     "1e",          "1e+",
+      "12345678901234567890123", "3.14159 ",
+  };
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(gauges); i++) {
+    char *endptr = NULL;
+    double want = strtod(gauges[i], &endptr);
+    value_t v = {.gauge = NAN};
+
+    EXPECT_EQ_INT(0, parse_value(gauges[i], &v, DS_TYPE_GAUGE));
+    if (isnan(want))
+      OK(isnan(v.gauge));
+    else {
+      uint64_t want_bits, got_bits;
+      memcpy(&want_bits, &want, sizeof(want_bits));
+      memcpy(&got_bits, &v.gauge, sizeof(got_bits));
+      EXPECT_EQ_UINT64(want_bits, got_bits);
+    }
+  }
+
+  struct {
+    char const *str;
+    int ds_type;
+    int status;
+    uint64_t want;
+  } cases[] = {
+      {"0", DS_TYPE_COUNTER, 0, 0},
+      {"42", DS_TYPE_COUNTER, 0, 42},
+      {"0x10", DS_TYPE_COUNTER, 0, 16},
+      {"010", DS_TYPE_COUNTER, 0, 8},
+      {"18446744073709551615", DS_TYPE_COUNTER, 0, UINT64_MAX},
+      {"123456789012345678", DS_TYPE_ABSOLUTE, 0, 123456789012345678ULL},
+      {"17 ", DS_TYPE_ABSOLUTE, 0, 17},
+      {"-42", DS_TYPE_DERIVE, 0, (uint64_t)(int64_t)-42},
+      {"-0x10", DS_TYPE_DERIVE, 0, (uint64_t)(int64_t)-16},
+      {"9223372036854775807", DS_TYPE_DERIVE, 0, INT64_MAX},
+      {"", DS_TYPE_DERIVE, -1, 0},
+      {"foo", DS_TYPE_COUNTER, -1, 0},
+      {"12.5", DS_TYPE_DERIVE, 0, 12},
+  };
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(cases); i++) {
+    value_t v = {.counter = 0};
+
+    EXPECT_EQ_INT(cases[i].status,
+                  parse_value(cases[i].str, &v, cases[i].ds_type));
+    if (cases[i].status != 0)
+      continue;
+
+    if (cases[i].ds_type == DS_TYPE_DERIVE)
+      EXPECT_EQ_UINT64(cases[i].want, (uint64_t)v.derive);
+    else
+      EXPECT_EQ_UINT64(cases[i].want, v.counter);
+  }
+
+  return 0;
+}
+
 DEF_TEST(value_to_rate) {
   struct {
     time_t t0;
@@ -357,6 +427,40 @@ DEF_TEST(value_to_rate) {
   return 0;
 }
 
+static void write_file(char const *path, char const *content) {
+  FILE *fh = fopen(path, "w");
+  if (fh == NULL)
+    return;
+  fputs(content, fh);
+  fclose(fh);
+}
+
+DEF_TEST(read_file_cached) {
+  char path[] = "/tmp/collectd-test-read_file_cached.XXXXXX";
+  char buffer[64];
+  value_t v;
+
+  int fd = mkstemp(path);
+  OK(fd >= 0);
+  close(fd);
+
+  write_file(path, "42\n");
+  EXPECT_EQ_INT(3, (int)read_file_cached(path, buffer, sizeof(buffer)));
+  EXPECT_EQ_INT(0, parse_value_file_cached(path, &v, DS_TYPE_GAUGE));
+  EXPECT_EQ_DOUBLE(42.0, v.gauge);
+
+  /* The file stays open, but its current content is read. */
+  write_file(path, "1234\nsecond line\n");
+  EXPECT_EQ_INT(0, parse_value_file_cached(path, &v, DS_TYPE_DERIVE));
+  EXPECT_EQ_INT(1234, (int)v.derive);
+  EXPECT_EQ_INT(4, (int)read_file_cached(path, buffer, 4));
+
+  unlink(path);
+  OK(read_file_cached("/nonexistent/file", buffer, sizeof(buffer)) < 0);
+
+  return 0;
+}
+
 int main(void) {
   RUN_TEST(sstrncpy);
   RUN_TEST(sstrdup);
@@ -365,8 +469,10 @@ int main(void) {
   RUN_TEST(escape_slashes);
   RUN_TEST(escape_string);
   RUN_TEST(strunescape);
+  RUN_TEST(parse_value);
   RUN_TEST(parse_values);
   RUN_TEST(value_to_rate);
+  RUN_TEST(read_file_cached);
 
   END_TEST;
 }
@@ -34,6 +34,10 @@
 #include "filter_chain.h"
 #include "plugin.h"
 #include "types_list.h"
+#include "utils_avltree.h"
+#include "utils_downsample.h"
+
+#include <sys/mman.h>
 
 #if HAVE_WORDEXP_H
 #include <wordexp.h>
@@ -108,14 +112,44 @@ static cf_global_option_t cf_global_options[] = {
     {"Interval", NULL, 0, NULL},
     {"ReadThreads", NULL, 0, "5"},
     {"WriteThreads", NULL, 0, "5"},
+    {"ReadThreadsAffinity", NULL, 0, NULL},
+    {"WriteThreadsAffinity", NULL, 0, NULL},
+    {"WriteThreadsMax", NULL, 0, NULL},
+    {"WriteThreadsTargetLength", NULL, 0, "1000"},
+    {"WriteThreadsTargetAge", NULL, 0, "1"},
+    {"WriteThreadsIdleTime", NULL, 0, "60"},
     {"WriteQueueLimitHigh", NULL, 0, NULL},
     {"WriteQueueLimitLow", NULL, 0, NULL},
+    {"WriteQueueSourceRate", NULL, 0, NULL},
+    {"WriteQueueShards", NULL, 0, "1"},
+    {"WriteQueueBatchSize", NULL, 0, "1"},
+    {"NotificationThreads", NULL, 0, "0"},
+    {"PluginCPUAccounting", NULL, 0, "false"},
+    {"DispatchLatencySampling", NULL, 0, "0"},
+    {"NotificationQueueLimit", NULL, 0, "1000"},
+    {"FlushThreads", NULL, 0, "4"},
+    {"FlushDeadline", NULL, 0, "0"},
+    {"InitThreads", NULL, 0, "4"},
     {"Timeout", NULL, 0, "2"},
+    {"ClockSource", NULL, 0, "Precise"},
+    {"CacheMemoryLimit", NULL, 0, NULL},
+    {"CacheLimitAction", NULL, 0, "Reject"},
+    {"CacheMaxSeriesPerPlugin", NULL, 0, NULL},
+    {"CacheMaxSeriesPerHost", NULL, 0, NULL},
+    {"TypesDBCache", NULL, 0, NULL},
+    {"ConfigCache", NULL, 0, NULL},
+    {"CacheFile", NULL, 0, NULL},
+    {"CacheFileInterval", NULL, 0, NULL},
+    {"CacheExportFile", NULL, 0, NULL},
+    {"CacheExportSlots", NULL, 0, "65536"},
     {"AutoLoadPlugin", NULL, 0, "false"},
     {"CollectInternalStats", NULL, 0, "false"},
+    {"LogQueueLength", NULL, 0, NULL},
     {"PreCacheChain", NULL, 0, "PreCache"},
     {"PostCacheChain", NULL, 0, "PostCache"},
-    {"MaxReadInterval", NULL, 0, "86400"}};
+    {"MaxReadInterval", NULL, 0, "86400"},
+    {"ReadJitter", NULL, 0, "false"},
+    {"ReadPhase", NULL, 0, NULL}};
 static int cf_global_options_num = STATIC_ARRAY_SIZE(cf_global_options);
 
 static int cf_default_typesdb = 1;
@@ -265,6 +299,7 @@ static int dispatch_loadplugin(oconfig_item_t *ci) {
   ctx.interval = cf_get_default_interval();
   ctx.flush_interval = 0;
   ctx.flush_timeout = 0;
+  ctx.write_heartbeat = 10;
 
   for (int i = 0; i < ci->children_num; ++i) {
     oconfig_item_t *child = ci->children + i;
@@ -277,7 +312,117 @@ static int dispatch_loadplugin(oconfig_item_t *ci) {
       cf_util_get_cdtime(child, &ctx.flush_interval);
     else if (strcasecmp("FlushTimeout", child->key) == 0)
       cf_util_get_cdtime(child, &ctx.flush_timeout);
-    else {
+    else if (strcasecmp("WriteThreads", child->key) == 0) {
+      int tmp = 0;
+      if ((cf_util_get_int(child, &tmp) == 0) && (tmp >= 0))
+        ctx.write_threads = (size_t)tmp;
+      else
+        WARNING("The \"WriteThreads\" option of plugin \"%s\" requires a "
+                "non-negative integer argument.",
+                ci->values[0].value.string);
+    } else if (strcasecmp("WriteQueueLimit", child->key) == 0) {
+      int tmp = 0;
+      if ((cf_util_get_int(child, &tmp) == 0) && (tmp >= 0))
+        ctx.write_queue_limit = (long)tmp;
+      else
+        WARNING("The \"WriteQueueLimit\" option of plugin \"%s\" requires "
+                "a non-negative integer argument.",
+                ci->values[0].value.string);
+    } else if (strcasecmp("NotificationQueueLimit", child->key) == 0) {
+      int tmp = 0;
+      if ((cf_util_get_int(child, &tmp) == 0) && (tmp > 0))
+        ctx.notification_queue_limit = (long)tmp;
+      else
+        WARNING("The \"NotificationQueueLimit\" option of plugin \"%s\" "
+                "requires a positive integer argument.",
+                ci->values[0].value.string);
+    } else if (strcasecmp("WriteBatchSize", child->key) == 0) {
+      int tmp = 0;
+      if ((cf_util_get_int(child, &tmp) == 0) && (tmp > 0))
+        ctx.write_batch_size = (size_t)tmp;
+      else
+        WARNING("The \"WriteBatchSize\" option of plugin \"%s\" requires a "
+                "positive integer argument.",
+                ci->values[0].value.string);
+    } else if (strcasecmp("WriteBatchLinger", child->key) == 0)
+      cf_util_get_cdtime(child, &ctx.write_batch_linger);
+    else if (strcasecmp("WriteQueuePolicy", child->key) == 0) {
+      char *policy = NULL;
+      if (cf_util_get_string(child, &policy) != 0)
+        continue;
+      if (strcasecmp("DropNew", policy) == 0)
+        ctx.write_queue_policy = WRITE_QUEUE_POLICY_DROP_NEW;
+      else if (strcasecmp("DropOld", policy) == 0)
+        ctx.write_queue_policy = WRITE_QUEUE_POLICY_DROP_OLD;
+      else if (strcasecmp("Block", policy) == 0)
+        ctx.write_queue_policy = WRITE_QUEUE_POLICY_BLOCK;
+      else if (strcasecmp("Spill", policy) == 0)
+        ctx.write_queue_policy = WRITE_QUEUE_POLICY_SPILL;
+      else
+        WARNING("Unknown \"WriteQueuePolicy\" \"%s\" for plugin \"%s\". "
+                "Valid policies are \"DropNew\", \"DropOld\", \"Block\" "
+                "and \"Spill\".",
+                policy, ci->values[0].value.string);
+      sfree(policy);
+    } else if (strcasecmp("WriteSpillDirectory", child->key) == 0) {
+      /* Referenced by every copy of the context, so it is never freed. */
+      char *dir = NULL;
+      if (cf_util_get_string(child, &dir) == 0)
+        ctx.write_spill_directory = dir;
+    } else if (strcasecmp("WriteSpillLimit", child->key) == 0) {
+      int tmp = 0;
+      if ((cf_util_get_int(child, &tmp) == 0) && (tmp > 0))
+        ctx.write_spill_limit = ((uint64_t)tmp) * 1024 * 1024;
+      else
+        WARNING("The \"WriteSpillLimit\" option of plugin \"%s\" requires "
+                "a positive integer argument.",
+                ci->values[0].value.string);
+    } else if (strcasecmp("WriteSpillRate", child->key) == 0) {
+      int tmp = 0;
+      if ((cf_util_get_int(child, &tmp) == 0) && (tmp > 0))
+        ctx.write_spill_rate = (long)tmp;
+      else
+        WARNING("The \"WriteSpillRate\" option of plugin \"%s\" requires "
+                "a positive integer argument.",
+                ci->values[0].value.string);
+    } else if (strcasecmp("ThreadAffinity", child->key) == 0) {
+      /* Referenced by every copy of the context, so it is never freed. */
+      char *affinity = NULL;
+      if (cf_util_get_string(child, &affinity) == 0)
+        ctx.thread_affinity = affinity;
+    } else if (strcasecmp("ParallelInit", child->key) == 0)
+      cf_util_get_boolean(child, &ctx.init_parallel);
+    else if (strcasecmp("WriteChangesOnly", child->key) == 0)
+      cf_util_get_boolean(child, &ctx.write_changes_only);
+    else if (strcasecmp("WriteHeartbeat", child->key) == 0) {
+      int tmp = 0;
+      if ((cf_util_get_int(child, &tmp) == 0) && (tmp >= 0))
+        ctx.write_heartbeat = (unsigned int)tmp;
+      else
+        WARNING("The \"WriteHeartbeat\" option of plugin \"%s\" requires a "
+                "non-negative integer argument.",
+                ci->values[0].value.string);
+    } else if (strcasecmp("WriteDownsample", child->key) == 0)
+      cf_util_get_cdtime(child, &ctx.write_downsample);
+    else if (strcasecmp("WriteDownsampleFunction", child->key) == 0) {
+      char *function = NULL;
+      if (cf_util_get_string(child, &function) != 0)
+        continue;
+      if (strcasecmp("Average", function) == 0)
+        ctx.write_downsample_function = DOWNSAMPLE_AVERAGE;
+      else if (strcasecmp("Minimum", function) == 0)
+        ctx.write_downsample_function = DOWNSAMPLE_MINIMUM;
+      else if (strcasecmp("Maximum", function) == 0)
+        ctx.write_downsample_function = DOWNSAMPLE_MAXIMUM;
+      else if (strcasecmp("Last", function) == 0)
+        ctx.write_downsample_function = DOWNSAMPLE_LAST;
+      else
+        WARNING("Unknown \"WriteDownsampleFunction\" \"%s\" for plugin "
+                "\"%s\". Valid functions are \"Average\", \"Minimum\", "
+                "\"Maximum\" and \"Last\".",
+                function, ci->values[0].value.string);
+      sfree(function);
+    } else {
       WARNING("Ignoring unknown LoadPlugin option \"%s\" "
               "for plugin \"%s\"",
               child->key, ci->values[0].value.string);
@@ -416,6 +561,69 @@ static int dispatch_block_plugin(oconfig_item_t *ci) {
   return 0;
 }
 
+static int dispatch_block_read_pool(oconfig_item_t *ci) {
+  char *name = NULL;
+  int threads_num = 1;
+  char const **plugins;
+  size_t plugins_num = 0;
+  char const **groups;
+  size_t groups_num = 0;
+  int status;
+
+  if (cf_util_get_string(ci, &name) != 0)
+    return -1;
+
+  plugins = calloc(ci->children_num + 1, sizeof(*plugins));
+  groups = calloc(ci->children_num + 1, sizeof(*groups));
+  if ((plugins == NULL) || (groups == NULL)) {
+    sfree(plugins);
+    sfree(groups);
+    sfree(name);
+    return ENOMEM;
+  }
+
+  for (int i = 0; i < ci->children_num; i++) {
+    oconfig_item_t *child = ci->children + i;
+
+    if (strcasecmp("Threads", child->key) == 0) {
+      if ((cf_util_get_int(child, &threads_num) != 0) || (threads_num < 1)) {
+        WARNING("The \"Threads\" option of the \"%s\" read thread pool "
+                "requires a positive integer argument.",
+                name);
+        threads_num = 1;
+      }
+    } else if ((strcasecmp("Plugin", child->key) == 0) ||
+               (strcasecmp("Group", child->key) == 0)) {
+      if ((child->values_num != 1) ||
+          (child->values[0].type != OCONFIG_TYPE_STRING)) {
+        WARNING("The \"%s\" option of the \"%s\" read thread pool "
+                "requires exactly one string argument.",
+                child->key, name);
+        continue;
+      }
+
+      if (strcasecmp("Plugin", child->key) == 0)
+        plugins[plugins_num++] = child->values[0].value.string;
+      else
+        groups[groups_num++] = child->values[0].value.string;
+    } else
+      WARNING("Ignoring unknown option \"%s\" of the \"%s\" read thread "
+              "pool.",
+              child->key, name);
+  }
+
+  status = plugin_register_read_pool(name, (size_t)threads_num, plugins,
+                                     plugins_num, groups, groups_num);
+  if (status != 0)
+    ERROR("Registering the \"%s\" read thread pool failed with status %i.",
+          name, status);
+
+  sfree(plugins);
+  sfree(groups);
+  sfree(name);
+  return status;
+} /* int dispatch_block_read_pool */
+
 static int dispatch_block(oconfig_item_t *ci) {
   if (strcasecmp(ci->key, "LoadPlugin") == 0)
     return dispatch_loadplugin(ci);
@@ -423,6 +631,8 @@ static int dispatch_block(oconfig_item_t *ci) {
     return dispatch_block_plugin(ci);
   else if (strcasecmp(ci->key, "Chain") == 0)
     return fc_configure(ci);
+  else if (strcasecmp(ci->key, "ReadThreadPool") == 0)
+    return dispatch_block_read_pool(ci);
 
   return 0;
 }
@@ -518,6 +728,444 @@ static int cf_ci_append_children(oconfig_item_t *dst, oconfig_item_t *src) {
   return 0;
 } /* int cf_ci_append_children */
 
+/* Config cache, see "ConfigCache". The parse trees of included files are
+ * kept in one file, so that included files which have not changed need not
+ * be parsed again. The file starts with a cf_cache_header_t, followed by one
+ * record per included file: a cf_cache_record_t, the file name and the
+ * serialized tree. A file is identified by its name, modification time, size
+ * and inode number. Everything is stored in host byte order; files written
+ * by a different architecture or version are ignored. */
+#define CF_CACHE_MAGIC "collectd config"
+#define CF_CACHE_VERSION 1
+#define CF_CACHE_BYTE_ORDER 0x01020304
+
+typedef struct {
+  char magic[16];
+  uint32_t version;
+  uint32_t byte_order;
+  uint64_t records_num;
+} cf_cache_header_t;
+
+typedef struct {
+  uint32_t size; /* of the whole record */
+  uint32_t name_len;
+  int64_t mtime;
+  uint64_t file_size;
+  uint64_t inode;
+} cf_cache_record_t;
+
+typedef struct {
+  char *name;
+  cf_cache_record_t rec;
+  char *data; /* serialized tree */
+  size_t data_size;
+} cf_cache_entry_t;
+
+typedef struct {
+  char *data;
+  size_t size;
+  size_t fill;
+} cf_cache_buffer_t;
+
+static char *cf_cache_file = NULL;
+/* Entries read from the cache file, and entries used by this run. */
+static c_avl_tree_t *cf_cache_old = NULL;
+static c_avl_tree_t *cf_cache_new = NULL;
+static _Bool cf_cache_dirty = 0;
+
+static void cf_cache_entry_free(cf_cache_entry_t *e) /* {{{ */
+{
+  if (e == NULL)
+    return;
+
+  sfree(e->name);
+  sfree(e->data);
+  sfree(e);
+} /* }}} void cf_cache_entry_free */
+
+static void cf_cache_tree_free(c_avl_tree_t **tree) /* {{{ */
+{
+  void *key;
+  void *value;
+
+  if (*tree == NULL)
+    return;
+
+  while (c_avl_pick(*tree, &key, &value) == 0)
+    cf_cache_entry_free(value);
+  c_avl_destroy(*tree);
+  *tree = NULL;
+} /* }}} void cf_cache_tree_free */
+
+static int cf_cache_put(cf_cache_buffer_t *b, void const *data,
+                        size_t size) /* {{{ */
+{
+  if (b->fill + size > b->size) {
+    size_t new_size = (b->size > 0) ? 2 * b->size : 4096;
+    while (new_size < b->fill + size)
+      new_size *= 2;
+    char *tmp = realloc(b->data, new_size);
+    if (tmp == NULL)
+      return ENOMEM;
+    b->data = tmp;
+    b->size = new_size;
+  }
+
+  memcpy(b->data + b->fill, data, size);
+  b->fill += size;
+  return 0;
+} /* }}} int cf_cache_put */
+
+static int cf_cache_put_string(cf_cache_buffer_t *b, char const *str) /* {{{ */
+{
+  uint32_t len = (str != NULL) ? (uint32_t)strlen(str) : UINT32_MAX;
+  int status = cf_cache_put(b, &len, sizeof(len));
+  if ((status == 0) && (str != NULL))
+    status = cf_cache_put(b, str, (size_t)len);
+  return status;
+} /* }}} int cf_cache_put_string */
+
+static int cf_cache_serialize(cf_cache_buffer_t *b,
+                              oconfig_item_t const *ci) /* {{{ */
+{
+  int32_t num = (int32_t)ci->values_num;
+  int status = cf_cache_put_string(b, ci->key);
+  if (status == 0)
+    status = cf_cache_put(b, &num, sizeof(num));
+
+  for (int i = 0; (i < ci->values_num) && (status == 0); i++) {
+    oconfig_value_t const *v = ci->values + i;
+    int32_t type = (int32_t)v->type;
+
+    status = cf_cache_put(b, &type, sizeof(type));
+    if (status != 0)
+      break;
+    if (v->type == OCONFIG_TYPE_STRING)
+      status = cf_cache_put_string(b, v->value.string);
+    else if (v->type == OCONFIG_TYPE_NUMBER)
+      status = cf_cache_put(b, &v->value.number, sizeof(v->value.number));
+    else {
+      int32_t boolean = (int32_t)v->value.boolean;
+      status = cf_cache_put(b, &boolean, sizeof(boolean));
+    }
+  }
+
+  num = (int32_t)ci->children_num;
+  if (status == 0)
+    status = cf_cache_put(b, &num, sizeof(num));
+  for (int i = 0; (i < ci->children_num) && (status == 0); i++)
+    status = cf_cache_serialize(b, ci->children + i);
+
+  return status;
+} /* }}} int cf_cache_serialize */
+
+static int cf_cache_get(cf_cache_buffer_t *b, void *data, size_t size) /* {{{ */
+{
+  if (size > b->size - b->fill)
+    return EINVAL;
+
+  memcpy(data, b->data + b->fill, size);
+  b->fill += size;
+  return 0;
+} /* }}} int cf_cache_get */
+
+static int cf_cache_get_string(cf_cache_buffer_t *b, char **ret) /* {{{ */
+{
+  uint32_t len;
+
+  *ret = NULL;
+  if (cf_cache_get(b, &len, sizeof(len)) != 0)
+    return EINVAL;
+  if (len == UINT32_MAX)
+    return 0;
+  if (len > b->size - b->fill)
+    return EINVAL;
+
+  *ret = malloc((size_t)len + 1);
+  if (*ret == NULL)
+    return ENOMEM;
+  memcpy(*ret, b->data + b->fill, len);
+  (*ret)[len] = 0;
+  b->fill += len;
+  return 0;
+} /* }}} int cf_cache_get_string */
+
+/* Fills "ci", which must be zeroed, from the buffer. On failure, the caller
+ * must still free the partially filled tree with oconfig_free(). */
+static int cf_cache_deserialize(cf_cache_buffer_t *b,
+                                oconfig_item_t *ci) /* {{{ */
+{
+  int32_t num;
+
+  if ((cf_cache_get_string(b, &ci->key) != 0) ||
+      (cf_cache_get(b, &num, sizeof(num)) != 0) || (num < 0) ||
+      ((size_t)num > b->size - b->fill))
+    return EINVAL;
+
+  if (num > 0) {
+    ci->values = calloc((size_t)num, sizeof(*ci->values));
+    if (ci->values == NULL)
+      return ENOMEM;
+  }
+  for (; ci->values_num < num; ci->values_num++) {
+    oconfig_value_t *v = ci->values + ci->values_num;
+    int32_t type;
+    int status;
+
+    if (cf_cache_get(b, &type, sizeof(type)) != 0)
+      return EINVAL;
+    if (type == OCONFIG_TYPE_STRING)
+      status = cf_cache_get_string(b, &v->value.string);
+    else if (type == OCONFIG_TYPE_NUMBER)
+      status = cf_cache_get(b, &v->value.number, sizeof(v->value.number));
+    else if (type == OCONFIG_TYPE_BOOLEAN) {
+      int32_t boolean = 0;
+      status = cf_cache_get(b, &boolean, sizeof(boolean));
+      v->value.boolean = (int)boolean;
+    } else
+      return EINVAL;
+    if ((status != 0) ||
+        ((type == OCONFIG_TYPE_STRING) && (v->value.string == NULL)))
+      return EINVAL;
+    v->type = (int)type;
+  }
+
+  if ((cf_cache_get(b, &num, sizeof(num)) != 0) || (num < 0) ||
+      ((size_t)num > b->size - b->fill))
+    return EINVAL;
+
+  if (num > 0) {
+    ci->children = calloc((size_t)num, sizeof(*ci->children));
+    if (ci->children == NULL)
+      return ENOMEM;
+  }
+  /* Count each child before filling it, so that it is freed on failure. */
+  while (ci->children_num < num) {
+    ci->children_num++;
+    int status = cf_cache_deserialize(b, ci->children + ci->children_num - 1);
+    if (status != 0)
+      return status;
+  }
+
+  return 0;
+} /* }}} int cf_cache_deserialize */
+
+/* Reads the entries of "file" into "cf_cache_old". */
+static int cf_cache_open(char const *file) /* {{{ */
+{
+  struct stat statbuf;
+  cf_cache_header_t header;
+
+  cf_cache_file = sstrdup(file);
+  cf_cache_old = c_avl_create((int (*)(const void *, const void *))strcmp);
+  cf_cache_new = c_avl_create((int (*)(const void *, const void *))strcmp);
+  if ((cf_cache_file == NULL) || (cf_cache_old == NULL) ||
+      (cf_cache_new == NULL)) {
+    ERROR("configfile: Allocating the config cache failed.");
+    return ENOMEM;
+  }
+
+  int fd = open(file, O_RDONLY);
+  if (fd < 0)
+    return errno;
+
+  if ((fstat(fd, &statbuf) != 0) ||
+      ((size_t)statbuf.st_size < sizeof(header))) {
+    close(fd);
+    return EINVAL;
+  }
+
+  size_t size = (size_t)statbuf.st_size;
+  char *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    int status = errno;
+    WARNING("configfile: mmap (\"%s\") failed: %s", file, STRERRNO);
+    return status;
+  }
+
+  memcpy(&header, data, sizeof(header));
+  if ((memcmp(header.magic, CF_CACHE_MAGIC, sizeof(header.magic)) != 0) ||
+      (header.version != CF_CACHE_VERSION) ||
+      (header.byte_order != CF_CACHE_BYTE_ORDER)) {
+    WARNING("configfile: \"%s\" has been written by an incompatible version "
+            "or architecture and is ignored.",
+            file);
+    munmap(data, size);
+    return EINVAL;
+  }
+
+  size_t offset = sizeof(header);
+  for (uint64_t i = 0; i < header.records_num; i++) {
+    cf_cache_record_t rec;
+
+    if (offset + sizeof(rec) > size)
+      break;
+    memcpy(&rec, data + offset, sizeof(rec));
+    if ((rec.size < sizeof(rec) + rec.name_len) || (rec.size > size - offset))
+      break;
+
+    cf_cache_entry_t *e = calloc(1, sizeof(*e));
+    if (e == NULL)
+      break;
+    e->rec = rec;
+    e->name = malloc(rec.name_len + 1);
+    e->data_size = rec.size - sizeof(rec) - rec.name_len;
+    e->data = malloc((e->data_size > 0) ? e->data_size : 1);
+    if ((e->name == NULL) || (e->data == NULL)) {
+      cf_cache_entry_free(e);
+      break;
+    }
+    memcpy(e->name, data + offset + sizeof(rec), rec.name_len);
+    e->name[rec.name_len] = 0;
+    memcpy(e->data, data + offset + sizeof(rec) + rec.name_len, e->data_size);
+
+    if (c_avl_insert(cf_cache_old, e->name, e) != 0)
+      cf_cache_entry_free(e);
+
+    offset += rec.size;
+  }
+
+  munmap(data, size);
+  return 0;
+} /* }}} int cf_cache_open */
+
+/* Writes the entries used by this run to the cache file, if anything
+ * changed, and frees the cache. */
+static void cf_cache_close(void) /* {{{ */
+{
+  char tmp_file[PATH_MAX];
+  cf_cache_header_t header = {
+      .magic = CF_CACHE_MAGIC,
+      .version = CF_CACHE_VERSION,
+      .byte_order = CF_CACHE_BYTE_ORDER,
+  };
+  int status = 0;
+
+  if (cf_cache_file == NULL)
+    return;
+
+  /* Entries left in "cf_cache_old" belong to files no longer included. */
+  if (!cf_cache_dirty && (cf_cache_old != NULL) &&
+      (c_avl_size(cf_cache_old) == 0))
+    goto out;
+  if (cf_cache_new == NULL)
+    goto out;
+
+  snprintf(tmp_file, sizeof(tmp_file), "%s.tmp", cf_cache_file);
+  FILE *fh = fopen(tmp_file, "w");
+  if (fh == NULL) {
+    WARNING("configfile: fopen (\"%s\") failed: %s", tmp_file, STRERRNO);
+    goto out;
+  }
+
+  header.records_num = (uint64_t)c_avl_size(cf_cache_new);
+  if (fwrite(&header, sizeof(header), 1, fh) != 1)
+    status = errno;
+
+  c_avl_iterator_t *iter = c_avl_get_iterator(cf_cache_new);
+  char *name;
+  cf_cache_entry_t *e;
+  while ((status == 0) &&
+         (c_avl_iterator_next(iter, (void *)&name, (void *)&e) == 0)) {
+    if ((fwrite(&e->rec, sizeof(e->rec), 1, fh) != 1) ||
+        (fwrite(e->name, e->rec.name_len, 1, fh) != 1) ||
+        ((e->data_size > 0) && (fwrite(e->data, e->data_size, 1, fh) != 1)))
+      status = errno;
+  }
+  c_avl_iterator_destroy(iter);
+
+  if ((fclose(fh) != 0) && (status == 0))
+    status = errno;
+  if ((status == 0) && (rename(tmp_file, cf_cache_file) != 0))
+    status = errno;
+
+  if (status != 0) {
+    WARNING("configfile: Writing \"%s\" failed: %s", cf_cache_file,
+            STRERROR(status));
+    unlink(tmp_file);
+  } else {
+    DEBUG("configfile: Saved %" PRIu64 " parse trees to \"%s\".",
+          header.records_num, cf_cache_file);
+  }
+
+out:
+  cf_cache_tree_free(&cf_cache_old);
+  cf_cache_tree_free(&cf_cache_new);
+  sfree(cf_cache_file);
+  cf_cache_dirty = 0;
+} /* }}} void cf_cache_close */
+
+/* Parses "file" or takes its parse tree from the config cache. */
+static oconfig_item_t *cf_parse_file(const char *file) /* {{{ */
+{
+  struct stat statbuf;
+  cf_cache_entry_t *e = NULL;
+
+  if ((cf_cache_new == NULL) || (stat(file, &statbuf) != 0))
+    return oconfig_parse_file(file);
+
+  cf_cache_record_t rec = {
+      .name_len = (uint32_t)strlen(file),
+      .mtime = (int64_t)statbuf.st_mtime,
+      .file_size = (uint64_t)statbuf.st_size,
+      .inode = (uint64_t)statbuf.st_ino,
+  };
+
+  /* The same file may be included more than once. */
+  if (c_avl_get(cf_cache_new, file, (void *)&e) != 0) {
+    c_avl_remove(cf_cache_old, file, NULL, (void *)&e);
+    if ((e != NULL) && ((e->rec.mtime != rec.mtime) ||
+                        (e->rec.file_size != rec.file_size) ||
+                        (e->rec.inode != rec.inode))) {
+      cf_cache_entry_free(e);
+      e = NULL;
+    }
+    if ((e != NULL) && (c_avl_insert(cf_cache_new, e->name, e) != 0)) {
+      cf_cache_entry_free(e);
+      e = NULL;
+    }
+  }
+
+  if (e != NULL) {
+    cf_cache_buffer_t b = {.data = e->data, .size = e->data_size};
+    oconfig_item_t *root = calloc(1, sizeof(*root));
+    if (root == NULL)
+      return NULL;
+    if ((cf_cache_deserialize(&b, root) == 0) && (b.fill == b.size))
+      return root;
+
+    oconfig_free(root);
+    c_avl_remove(cf_cache_new, file, NULL, NULL);
+    cf_cache_entry_free(e);
+    e = NULL;
+  }
+
+  oconfig_item_t *root = oconfig_parse_file(file);
+  if (root == NULL)
+    return NULL;
+
+  /* Cache the tree before the includes are expanded. */
+  cf_cache_buffer_t b = {0};
+  e = calloc(1, sizeof(*e));
+  if ((e == NULL) || (cf_cache_serialize(&b, root) != 0) ||
+      ((e->name = strdup(file)) == NULL)) {
+    sfree(b.data);
+    cf_cache_entry_free(e);
+    return root;
+  }
+  e->data = b.data;
+  e->data_size = b.fill;
+  rec.size = (uint32_t)(sizeof(rec) + rec.name_len + e->data_size);
+  e->rec = rec;
+  if (c_avl_insert(cf_cache_new, e->name, e) != 0)
+    cf_cache_entry_free(e);
+  else
+    cf_cache_dirty = 1;
+
+  return root;
+} /* }}} oconfig_item_t *cf_parse_file */
+
 #define CF_MAX_DEPTH 8
 static oconfig_item_t *cf_read_generic(const char *path, const char *pattern,
                                        int depth);
@@ -602,12 +1250,25 @@ static oconfig_item_t *cf_read_file(const char *file, const char *pattern,
 #endif /* HAVE_FNMATCH_H && HAVE_LIBGEN_H */
   }
 
-  root = oconfig_parse_file(file);
+  root = cf_parse_file(file);
   if (root == NULL) {
     ERROR("configfile: Cannot read file `%s'.", file);
     return NULL;
   }
 
+  /* The cache is configured in the main file, so that it can be used for
+   * all included files. */
+  if (depth == 0) {
+    for (int i = 0; i < root->children_num; i++) {
+      oconfig_item_t *child = root->children + i;
+      if ((strcasecmp("ConfigCache", child->key) == 0) &&
+          (child->values_num == 1) &&
+          (child->values[0].type == OCONFIG_TYPE_STRING) &&
+          (cf_cache_file == NULL))
+        cf_cache_open(child->values[0].value.string);
+    }
+  }
+
   status = cf_include_all(root, depth);
   if (status != 0) {
     oconfig_free(root);
@@ -943,6 +1604,30 @@ void cf_unregister_complex(const char *type) {
     }
 } /* void cf_unregister */
 
+void cf_unregister_plugin(char const *name) /* {{{ */
+{
+  cf_callback_t **cf = &first_callback;
+  while (*cf != NULL) {
+    cf_callback_t *this = *cf;
+    if ((this->ctx.name != NULL) && (strcasecmp(this->ctx.name, name) == 0)) {
+      *cf = this->next;
+      free(this);
+    } else
+      cf = &this->next;
+  }
+
+  cf_complex_callback_t **cc = &complex_callback_head;
+  while (*cc != NULL) {
+    cf_complex_callback_t *this = *cc;
+    if ((this->ctx.name != NULL) && (strcasecmp(this->ctx.name, name) == 0)) {
+      *cc = this->next;
+      sfree(this->type);
+      sfree(this);
+    } else
+      cc = &this->next;
+  }
+} /* }}} void cf_unregister_plugin */
+
 void cf_register(const char *type, int (*callback)(const char *, const char *),
                  const char **keys, int keys_num) {
   cf_callback_t *cf_cb;
@@ -994,11 +1679,100 @@ int cf_register_complex(const char *type, int (*callback)(oconfig_item_t *)) {
   return 0;
 } /* int cf_register_complex */
 
+/* Configuration reload, see cf_reload(). The configuration of each plugin,
+ * i.e. its "LoadPlugin" and "Plugin" blocks, is serialized like for the config
+ * cache so that changed plugins can be told apart from unchanged ones. */
+typedef struct {
+  /* Plugin name -> cf_cache_buffer_t */
+  c_avl_tree_t *plugins;
+  /* Everything else */
+  cf_cache_buffer_t global;
+} cf_fingerprint_t;
+
+static char *cf_config_file = NULL;
+static cf_fingerprint_t cf_fingerprint = {NULL};
+static volatile sig_atomic_t cf_reload_pending = 0;
+
+/* Returns the name of the plugin "ci" configures or NULL for global
+ * options. */
+static char const *cf_item_plugin(oconfig_item_t const *ci) /* {{{ */
+{
+  if ((strcasecmp("LoadPlugin", ci->key) != 0) &&
+      (strcasecmp("Plugin", ci->key) != 0))
+    return NULL;
+  if ((ci->values_num < 1) || (ci->values[0].type != OCONFIG_TYPE_STRING))
+    return NULL;
+
+  if (strcmp("libvirt", ci->values[0].value.string) == 0)
+    return "virt";
+  return ci->values[0].value.string;
+} /* }}} char const *cf_item_plugin */
+
+static _Bool cf_buffer_equal(cf_cache_buffer_t const *a, /* {{{ */
+                             cf_cache_buffer_t const *b) {
+  return (a->fill == b->fill) &&
+         ((a->fill == 0) || (memcmp(a->data, b->data, a->fill) == 0));
+} /* }}} _Bool cf_buffer_equal */
+
+static void cf_fingerprint_free(cf_fingerprint_t *fp) /* {{{ */
+{
+  char *name;
+  cf_cache_buffer_t *b;
+
+  if (fp->plugins != NULL) {
+    while (c_avl_pick(fp->plugins, (void *)&name, (void *)&b) == 0) {
+      sfree(name);
+      sfree(b->data);
+      sfree(b);
+    }
+    c_avl_destroy(fp->plugins);
+    fp->plugins = NULL;
+  }
+
+  sfree(fp->global.data);
+  fp->global = (cf_cache_buffer_t){NULL};
+} /* }}} void cf_fingerprint_free */
+
+static int cf_fingerprint_create(cf_fingerprint_t *fp, /* {{{ */
+                                 oconfig_item_t const *conf) {
+  int status = 0;
+
+  *fp = (cf_fingerprint_t){NULL};
+  fp->plugins = c_avl_create((int (*)(const void *, const void *))strcasecmp);
+  if (fp->plugins == NULL)
+    return ENOMEM;
+
+  for (int i = 0; (i < conf->children_num) && (status == 0); i++) {
+    oconfig_item_t const *ci = conf->children + i;
+    char const *name = cf_item_plugin(ci);
+    cf_cache_buffer_t *b = &fp->global;
+
+    if ((name != NULL) && (c_avl_get(fp->plugins, name, (void *)&b) != 0)) {
+      char *key = strdup(name);
+      b = calloc(1, sizeof(*b));
+      if ((key == NULL) || (b == NULL) ||
+          (c_avl_insert(fp->plugins, key, b) != 0)) {
+        sfree(key);
+        sfree(b);
+        status = ENOMEM;
+        break;
+      }
+    }
+
+    status = cf_cache_serialize(b, ci);
+  }
+
+  if (status != 0)
+    cf_fingerprint_free(fp);
+  return status;
+} /* }}} int cf_fingerprint_create */
+
 int cf_read(const char *filename) {
   oconfig_item_t *conf;
   int ret = 0;
 
   conf = cf_read_generic(filename, /* pattern = */ NULL, /* depth = */ 0);
+  cf_cache_close();
   if (conf == NULL) {
     ERROR("Unable to read config file %s.", filename);
     return -1;
@@ -1018,6 +1792,13 @@ int cf_read(const char *filename) {
     }
   }
 
+  /* Remembered for cf_reload(). */
+  sfree(cf_config_file);
+  cf_config_file = (filename != NULL) ? strdup(filename) : NULL;
+  cf_fingerprint_free(&cf_fingerprint);
+  if (cf_fingerprint_create(&cf_fingerprint, conf) != 0)
+    WARNING("Remembering the configuration failed. It can't be reloaded.");
+
   oconfig_free(conf);
 
   /* Read the default types.db if no `TypesDB' option was given. */
@@ -1030,6 +1811,151 @@ int cf_read(const char *filename) {
 
 } /* int cf_read */
 
+/* Lock-free atomics are async-signal-safe and also synchronize with the
+ * unixsock plugin's threads. */
+static void cf_reload_set(int value) /* {{{ */
+{
+#if defined(__ATOMIC_SEQ_CST)
+  __atomic_store_n(&cf_reload_pending, value, __ATOMIC_SEQ_CST);
+#else
+  cf_reload_pending = value;
+#endif
+} /* }}} void cf_reload_set */
+
+void cf_reload_request(void) { cf_reload_set(1); }
+
+_Bool cf_reload_requested(void) {
+#if defined(__ATOMIC_SEQ_CST)
+  return __atomic_load_n(&cf_reload_pending, __ATOMIC_SEQ_CST) != 0;
+#else
+  return cf_reload_pending != 0;
+#endif
+}
+
+int cf_reload(void) /* {{{ */
+{
+  cf_fingerprint_t fp;
+  char *name;
+  cf_cache_buffer_t *b;
+  int ret = 0;
+
+  cf_reload_set(0);
+
+  if ((cf_config_file == NULL) || (cf_fingerprint.plugins == NULL)) {
+    ERROR("The configuration can't be reloaded.");
+    return ENOENT;
+  }
+
+  INFO("Reloading the configuration from %s.", cf_config_file);
+
+  oconfig_item_t *conf =
+      cf_read_generic(cf_config_file, /* pattern = */ NULL, /* depth = */ 0);
+  cf_cache_close();
+  if (conf == NULL) {
+    ERROR("Unable to read config file %s. Keeping the current configuration.",
+          cf_config_file);
+    return -1;
+  }
+
+  if (cf_fingerprint_create(&fp, conf) != 0) {
+    ERROR("cf_reload: Comparing the configuration failed.");
+    oconfig_free(conf);
+    return ENOMEM;
+  }
+
+  /* The new global part is dropped below, so this is reported until the
+   * daemon is restarted. */
+  if (!cf_buffer_equal(&fp.global, &cf_fingerprint.global))
+    WARNING("Global options, filter chains or read thread pools have changed. "
+            "These changes take effect after restarting the daemon.");
+
+  /* Unload plugins which have been removed or whose configuration has
+   * changed. If that fails, the plugin keeps running with its current
+   * configuration. */
+  c_avl_tree_t *reload =
+      c_avl_create((int (*)(const void *, const void *))strcasecmp);
+  if (reload == NULL) {
+    cf_fingerprint_free(&fp);
+    oconfig_free(conf);
+    return ENOMEM;
+  }
+
+  c_avl_iterator_t *iter = c_avl_get_iterator(cf_fingerprint.plugins);
+  while (c_avl_iterator_next(iter, (void *)&name, (void *)&b) == 0) {
+    cf_cache_buffer_t *new_b = NULL;
+    _Bool removed = (c_avl_get(fp.plugins, name, (void *)&new_b) != 0);
+
+    if (!removed && cf_buffer_equal(b, new_b))
+      continue;
+
+    int status = plugin_unload(name);
+    if ((status != 0) && (status != ENOENT)) {
+      ERROR("Unloading plugin \"%s\" failed with status %i. It keeps its "
+            "current configuration.",
+            name, status);
+      ret = -1;
+      /* Keep comparing with the configuration in effect. */
+      if (!removed) {
+        cf_cache_buffer_t tmp = *new_b;
+        *new_b = *b;
+        *b = tmp;
+      }
+      continue;
+    }
+
+    if (!removed)
+      c_avl_insert(reload, name, NULL);
+  }
+  c_avl_iterator_destroy(iter);
+
+  iter = c_avl_get_iterator(fp.plugins);
+  while (c_avl_iterator_next(iter, (void *)&name, (void *)&b) == 0) {
+    if (c_avl_get(cf_fingerprint.plugins, name, NULL) != 0)
+      c_avl_insert(reload, name, NULL);
+  }
+  c_avl_iterator_destroy(iter);
+
+  /* Load and configure the plugins in the order of the config file, then
+   * initialize them. */
+  for (int i = 0; i < conf->children_num; i++) {
+    oconfig_item_t *ci = conf->children + i;
+    char const *plugin = cf_item_plugin(ci);
+    if ((plugin == NULL) || (c_avl_get(reload, plugin, NULL) != 0))
+      continue;
+
+    int status =
+        (ci->children == NULL) ? dispatch_value(ci) : dispatch_block(ci);
+    if (status != 0)
+      ret = -1;
+  }
+
+  for (int i = 0; i < conf->children_num; i++) {
+    char const *plugin = cf_item_plugin(conf->children + i);
+    if ((plugin == NULL) ||
+        (c_avl_remove(reload, plugin, NULL, NULL) != 0))
+      continue;
+
+    int status = plugin_init_plugin(plugin);
+    if ((status != 0) && (status != ENOENT))
+      ret = -1;
+  }
+  c_avl_destroy(reload);
+
+  /* Only the plugins' configuration has been applied. */
+  cf_cache_buffer_t global = cf_fingerprint.global;
+  cf_fingerprint.global = fp.global;
+  fp.global = global;
+
+  cf_fingerprint_t old = cf_fingerprint;
+  cf_fingerprint = fp;
+  cf_fingerprint_free(&old);
+  oconfig_free(conf);
+
+  INFO("Reloading the configuration %s.",
+       (ret == 0) ? "succeeded" : "finished with errors");
+  return ret;
+} /* }}} int cf_reload */
+
 /* Assures the config option is a string, duplicates it and returns the copy in
  * "ret_string". If necessary "*ret_string" is freed first. Returns zero upon
  * success. */
@@ -43,6 +43,13 @@
 void cf_unregister(const char *type);
 void cf_unregister_complex(const char *type);
 
+/*
+ * DESCRIPTION
+ *  Removes all config callbacks registered by the plugin `name', see
+ *  `plugin_unload'.
+ */
+void cf_unregister_plugin(char const *name);
+
 /*
  * DESCRIPTION
  *  `cf_register' is called by plugins that wish to receive config keys. The
@@ -89,6 +96,24 @@ int cf_register_complex(const char *type, int (*callback)(oconfig_item_t *));
  */
 int cf_read(const char *filename);
 
+/*
+ * DESCRIPTION
+ *  `cf_reload' reads the config file passed to `cf_read' again and applies
+ *  the changes of the plugins' configuration: plugins whose `LoadPlugin' or
+ *  `Plugin' blocks were removed or changed are unloaded, and changed or added
+ *  plugins are loaded, configured and initialized. Other changes only take
+ *  effect after a restart. Must be called from the main thread.
+ *  `cf_reload_request' asks the main loop to call `cf_reload'. It is
+ *  async-signal-safe.
+ *
+ * RETURN VALUE
+ *  Returns zero upon success and non-zero otherwise. Plugins which could not
+ *  be unloaded keep running with their current configuration.
+ */
+int cf_reload(void);
+void cf_reload_request(void);
+_Bool cf_reload_requested(void);
+
 int global_option_set(const char *option, const char *value, _Bool from_cli);
 const char *global_option_get(const char *option);
 long global_option_get_long(const char *option, long default_value);
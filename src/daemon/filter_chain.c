@@ -30,6 +30,8 @@
 #include "configfile.h"
 #include "filter_chain.h"
 #include "plugin.h"
+#include "utils_avltree.h"
+#include "utils_cache.h"
 #include "utils_complain.h"
 
 /*
@@ -64,15 +66,75 @@ struct fc_rule_s {
   char name[DATA_MAX_NAME_LEN];
   fc_match_t *matches;
   fc_target_t *targets;
+  _Bool memoizable; /* result of `matches' depends on the identifier only */
   fc_rule_t *next;
 }; /* }}} */
 
+/* List of rule positions, used by the dispatch tables in fc_index_t. */
+struct fc_rule_list_s;
+typedef struct fc_rule_list_s fc_rule_list_t; /* {{{ */
+struct fc_rule_list_s {
+  size_t *rules;
+  size_t rules_num;
+}; /* }}} */
+
+/* Rules requiring that an identifier field starts with `prefix'. Entries are
+ * bucketed by the first character of the prefix. */
+struct fc_prefix_s;
+typedef struct fc_prefix_s fc_prefix_t; /* {{{ */
+struct fc_prefix_s {
+  char *prefix;
+  size_t prefix_len;
+  fc_rule_list_t list;
+  fc_prefix_t *next;
+}; /* }}} */
+
+/* Dispatch tables of one identifier field. */
+struct fc_field_index_s;
+typedef struct fc_field_index_s fc_field_index_t; /* {{{ */
+struct fc_field_index_s {
+  c_avl_tree_t *exact; /* Maps values to fc_rule_list_t* */
+  fc_prefix_t *prefixes[256];
+  _Bool have_prefixes;
+}; /* }}} */
+
+/* Compiled form of a chain: Each rule which contains a match with a
+ * constraint (see match_proc_t) is put into the dispatch table of the
+ * constrained field. All other rules are always candidates. */
+struct fc_index_s;
+typedef struct fc_index_s fc_index_t; /* {{{ */
+struct fc_index_s {
+  size_t rules_num;
+  fc_rule_list_t unconstrained;
+  fc_field_index_t fields[FC_FIELDS_NUM];
+}; /* }}} */
+
+/* Number of rules up to which fc_process_chain() keeps the candidate flags on
+ * the stack. */
+#define FC_CANDIDATES_STATIC 256
+
+/* Memoized match results are stored in the value cache entries, using two
+ * bits per rule: "known" and "matches". The bits of all memoizing chains are
+ * laid out one after another; "fc_memo_generation" is bumped whenever the
+ * layout changes, which invalidates everything stored before. */
+#define FC_MEMO_MAX_SIZE 128
+#define FC_MEMO_SIZE(rules_num) (((rules_num)*2 + 7) / 8)
+#define FC_MEMO_KNOWN(memo, pos) ((memo)[(pos) / 4] & (1 << (2 * ((pos) % 4))))
+#define FC_MEMO_MATCHES(memo, pos)                                             \
+  ((memo)[(pos) / 4] & (2 << (2 * ((pos) % 4))))
+#define FC_MEMO_SET(memo, pos, matches)                                        \
+  ((memo)[(pos) / 4] |= (uint8_t)((1 | ((matches) ? 2 : 0)) << (2 * ((pos) % 4))))
+
 /* List of chains, used for `chain_list_head' */
 struct fc_chain_s /* {{{ */
 {
   char name[DATA_MAX_NAME_LEN];
   fc_rule_t *rules;
   fc_target_t *targets;
+  fc_index_t *index;
+  _Bool memoize;
+  size_t memo_offset;
+  size_t memo_size; /* zero if memoization is disabled */
   fc_chain_t *next;
 }; /* }}} */
 
@@ -90,6 +152,7 @@ struct fc_writer_s {
 static fc_match_t *match_list_head;
 static fc_target_t *target_list_head;
 static fc_chain_t *chain_list_head;
+static uint64_t fc_memo_generation;
 
 /*
  * Private functions
@@ -146,11 +209,50 @@ static void fc_free_rules(fc_rule_t *r) /* {{{ */
   free(r);
 } /* }}} void fc_free_rules */
 
+static void fc_free_index(fc_index_t *idx) /* {{{ */
+{
+  if (idx == NULL)
+    return;
+
+  for (size_t i = 0; i < FC_FIELDS_NUM; i++) {
+    fc_field_index_t *f = idx->fields + i;
+
+    if (f->exact != NULL) {
+      char *key;
+      fc_rule_list_t *list;
+
+      while (c_avl_pick(f->exact, (void *)&key, (void *)&list) == 0) {
+        sfree(key);
+        sfree(list->rules);
+        sfree(list);
+      }
+      c_avl_destroy(f->exact);
+    }
+
+    for (size_t j = 0; j < STATIC_ARRAY_SIZE(f->prefixes); j++) {
+      fc_prefix_t *p = f->prefixes[j];
+
+      while (p != NULL) {
+        fc_prefix_t *next = p->next;
+
+        sfree(p->prefix);
+        sfree(p->list.rules);
+        sfree(p);
+        p = next;
+      }
+    }
+  }
+
+  sfree(idx->unconstrained.rules);
+  sfree(idx);
+} /* }}} void fc_free_index */
+
 static void fc_free_chains(fc_chain_t *c) /* {{{ */
 {
   if (c == NULL)
     return;
 
+  fc_free_index(c->index);
   fc_free_rules(c->rules);
   fc_free_targets(c->targets);
 
@@ -178,6 +280,275 @@ static char *fc_strdup(const char *orig) /* {{{ */
   return dest;
 } /* }}} char *fc_strdup */
 
+/*
+ * Chain compilation.
+ *
+ * Rules whose matches describe a constraint on one of the identifier fields
+ * are sorted into exact-match trees and prefix buckets of that field. When
+ * processing a value list, each field's tables are consulted once to find the
+ * rules which can possibly match; only those are evaluated, in their original
+ * order. Since a constraint is a necessary condition of its match, the result
+ * is the same as evaluating every rule.
+ */
+static const char *fc_field_get(const value_list_t *vl, int field) /* {{{ */
+{
+  switch (field) {
+  case FC_FIELD_HOST:
+    return vl->host;
+  case FC_FIELD_PLUGIN:
+    return vl->plugin;
+  case FC_FIELD_PLUGIN_INSTANCE:
+    return vl->plugin_instance;
+  case FC_FIELD_TYPE:
+    return vl->type;
+  case FC_FIELD_TYPE_INSTANCE:
+    return vl->type_instance;
+  }
+
+  return NULL;
+} /* }}} const char *fc_field_get */
+
+static int fc_rule_list_add(fc_rule_list_t *list, size_t pos) /* {{{ */
+{
+  size_t *tmp;
+
+  tmp = realloc(list->rules, sizeof(*tmp) * (list->rules_num + 1));
+  if (tmp == NULL)
+    return ENOMEM;
+
+  list->rules = tmp;
+  list->rules[list->rules_num] = pos;
+  list->rules_num++;
+
+  return 0;
+} /* }}} int fc_rule_list_add */
+
+/* Picks the most selective constraint of all matches of a rule: Exact matches
+ * are preferred over prefixes, longer prefixes over shorter ones. */
+static int fc_rule_constraint(fc_rule_t *rule, /* {{{ */
+                              fc_constraint_t *ret) {
+  _Bool found = 0;
+
+  for (fc_match_t *m = rule->matches; m != NULL; m = m->next) {
+    fc_constraint_t c = {0};
+
+    if (m->proc.constraint == NULL)
+      continue;
+    if ((*m->proc.constraint)(&c, &m->user_data) != 0)
+      continue;
+    if ((c.field < 0) || (c.field >= FC_FIELDS_NUM))
+      continue;
+    c.value[sizeof(c.value) - 1] = 0;
+    if (!c.exact && (c.value[0] == 0))
+      continue;
+
+    if (found) {
+      if (ret->exact && !c.exact)
+        continue;
+      if ((ret->exact == c.exact) && (strlen(c.value) <= strlen(ret->value)))
+        continue;
+    }
+
+    memcpy(ret, &c, sizeof(*ret));
+    found = 1;
+  }
+
+  return found ? 0 : -1;
+} /* }}} int fc_rule_constraint */
+
+static int fc_index_add(fc_index_t *idx, /* {{{ */
+                        const fc_constraint_t *c, size_t pos) {
+  fc_field_index_t *f = idx->fields + c->field;
+
+  if (c->exact) {
+    fc_rule_list_t *list = NULL;
+
+    if (f->exact == NULL) {
+      f->exact = c_avl_create((int (*)(const void *, const void *))strcmp);
+      if (f->exact == NULL)
+        return ENOMEM;
+    }
+
+    if (c_avl_get(f->exact, c->value, (void *)&list) != 0) {
+      char *key;
+
+      list = calloc(1, sizeof(*list));
+      key = strdup(c->value);
+      if ((list == NULL) || (key == NULL) ||
+          (c_avl_insert(f->exact, key, list) != 0)) {
+        sfree(list);
+        sfree(key);
+        return ENOMEM;
+      }
+    }
+
+    return fc_rule_list_add(list, pos);
+  }
+
+  fc_prefix_t **head = f->prefixes + (unsigned char)c->value[0];
+  fc_prefix_t *p;
+
+  for (p = *head; p != NULL; p = p->next)
+    if (strcmp(p->prefix, c->value) == 0)
+      break;
+
+  if (p == NULL) {
+    p = calloc(1, sizeof(*p));
+    if (p == NULL)
+      return ENOMEM;
+    p->prefix = strdup(c->value);
+    if (p->prefix == NULL) {
+      sfree(p);
+      return ENOMEM;
+    }
+    p->prefix_len = strlen(p->prefix);
+    p->next = *head;
+    *head = p;
+    f->have_prefixes = 1;
+  }
+
+  return fc_rule_list_add(&p->list, pos);
+} /* }}} int fc_index_add */
+
+static _Bool fc_rule_memoizable(fc_rule_t *rule) /* {{{ */
+{
+  /* Rules without matches always match. */
+  if (rule->matches == NULL)
+    return 0;
+
+  for (fc_match_t *m = rule->matches; m != NULL; m = m->next)
+    if ((m->proc.value_dependent != NULL) &&
+        ((*m->proc.value_dependent)(&m->user_data) != 0))
+      return 0;
+
+  return 1;
+} /* }}} _Bool fc_rule_memoizable */
+
+/* Assigns each memoizing chain its range of the memo. */
+static void fc_memo_layout(void) /* {{{ */
+{
+  size_t offset = 0;
+
+  for (fc_chain_t *chain = chain_list_head; chain != NULL;
+       chain = chain->next) {
+    size_t rules_num = 0;
+    _Bool any_memoizable = 0;
+
+    chain->memo_offset = 0;
+    chain->memo_size = 0;
+    if (!chain->memoize)
+      continue;
+
+    for (fc_rule_t *rule = chain->rules; rule != NULL; rule = rule->next) {
+      rule->memoizable = fc_rule_memoizable(rule);
+      if (rule->memoizable)
+        any_memoizable = 1;
+      rules_num++;
+    }
+
+    if (!any_memoizable) {
+      INFO("Filter subsystem: Chain %s: No rule depends on the identifier "
+           "only; MemoizeMatches has no effect.",
+           chain->name);
+      continue;
+    } else if (FC_MEMO_SIZE(rules_num) > FC_MEMO_MAX_SIZE) {
+      WARNING("Filter subsystem: Chain %s: Too many rules (%zu) to memoize "
+              "the match results.",
+              chain->name, rules_num);
+      continue;
+    }
+
+    chain->memo_offset = offset;
+    chain->memo_size = FC_MEMO_SIZE(rules_num);
+    offset += chain->memo_size;
+  }
+
+  fc_memo_generation++;
+} /* }}} void fc_memo_layout */
+
+/* (Re-)builds the dispatch tables of a chain. On failure, the chain is left
+ * without index and processed linearly. */
+static void fc_chain_compile(fc_chain_t *chain) /* {{{ */
+{
+  fc_index_t *idx;
+  size_t constrained_num = 0;
+  size_t pos = 0;
+
+  fc_free_index(chain->index);
+  chain->index = NULL;
+
+  fc_memo_layout();
+
+  idx = calloc(1, sizeof(*idx));
+  if (idx == NULL) {
+    ERROR("fc_chain_compile: calloc failed.");
+    return;
+  }
+
+  for (fc_rule_t *rule = chain->rules; rule != NULL; rule = rule->next) {
+    fc_constraint_t c = {0};
+    int status;
+
+    if (fc_rule_constraint(rule, &c) == 0) {
+      status = fc_index_add(idx, &c, pos);
+      constrained_num++;
+    } else
+      status = fc_rule_list_add(&idx->unconstrained, pos);
+
+    if (status != 0) {
+      ERROR("fc_chain_compile (%s): Building the dispatch tables failed.",
+            chain->name);
+      fc_free_index(idx);
+      return;
+    }
+    pos++;
+  }
+  idx->rules_num = pos;
+
+  DEBUG("fc_chain_compile (%s): %zu of %zu rules are dispatched by "
+        "identifier.",
+        chain->name, constrained_num, idx->rules_num);
+
+  /* Nothing to gain. */
+  if (constrained_num == 0) {
+    fc_free_index(idx);
+    return;
+  }
+
+  chain->index = idx;
+} /* }}} void fc_chain_compile */
+
+static void fc_candidates_mark(_Bool *candidates, /* {{{ */
+                               const fc_rule_list_t *list) {
+  for (size_t i = 0; i < list->rules_num; i++)
+    candidates[list->rules[i]] = 1;
+} /* }}} void fc_candidates_mark */
+
+/* Sets candidates[i] for every rule i which can possibly match vl. */
+static void fc_index_candidates(const fc_index_t *idx, /* {{{ */
+                                const value_list_t *vl, _Bool *candidates) {
+  memset(candidates, 0, sizeof(*candidates) * idx->rules_num);
+  fc_candidates_mark(candidates, &idx->unconstrained);
+
+  for (int i = 0; i < FC_FIELDS_NUM; i++) {
+    const fc_field_index_t *f = idx->fields + i;
+    const char *value = fc_field_get(vl, i);
+    fc_rule_list_t *list;
+
+    if ((f->exact != NULL) &&
+        (c_avl_get(f->exact, value, (void *)&list) == 0))
+      fc_candidates_mark(candidates, list);
+
+    if (!f->have_prefixes)
+      continue;
+
+    for (const fc_prefix_t *p = f->prefixes[(unsigned char)value[0]];
+         p != NULL; p = p->next)
+      if (strncmp(value, p->prefix, p->prefix_len) == 0)
+        fc_candidates_mark(candidates, &p->list);
+  }
+} /* }}} void fc_index_candidates */
+
 /*
  * Configuration.
  *
@@ -197,6 +568,8 @@ static char *fc_strdup(const char *orig) /* {{{ */
  *    <Target "write">
  *      Plugin "rrdtool"
  *    </Target>
+ *
+ *    MemoizeMatches true
  *  </Chain>
  */
 static int fc_config_add_match(fc_match_t **matches_head, /* {{{ */
@@ -429,6 +802,8 @@ static int fc_config_add_chain(const oconfig_item_t *ci) /* {{{ */
       status = fc_config_add_rule(chain, option);
     else if (strcasecmp("Target", option->key) == 0)
       status = fc_config_add_target(&chain->targets, option);
+    else if (strcasecmp("MemoizeMatches", option->key) == 0)
+      status = cf_util_get_boolean(option, &chain->memoize);
     else {
       WARNING("Filter subsystem: Chain %s: Option `%s' not allowed "
               "inside a <Chain> block.",
@@ -445,21 +820,22 @@ static int fc_config_add_chain(const oconfig_item_t *ci) /* {{{ */
     return -1;
   }
 
-  if (chain_list_head != NULL) {
-    if (!new_chain)
-      return 0;
-
-    fc_chain_t *ptr;
+  if (new_chain) {
+    if (chain_list_head != NULL) {
+      fc_chain_t *ptr;
 
-    ptr = chain_list_head;
-    while (ptr->next != NULL)
-      ptr = ptr->next;
+      ptr = chain_list_head;
+      while (ptr->next != NULL)
+        ptr = ptr->next;
 
-    ptr->next = chain;
-  } else {
-    chain_list_head = chain;
+      ptr->next = chain;
+    } else {
+      chain_list_head = chain;
+    }
   }
 
+  fc_chain_compile(chain);
+
   return 0;
 } /* }}} int fc_config_add_chain */
 
@@ -755,6 +1131,9 @@ int fc_register_match(const char *name, match_proc_t proc) /* {{{ */
     ptr->next = m;
   }
 
+  /* Chains refer to the matches until the daemon exits. */
+  plugin_mark_permanent();
+
   return 0;
 } /* }}} int fc_register_match */
 
@@ -784,9 +1163,17 @@ int fc_register_target(const char *name, target_proc_t proc) /* {{{ */
     ptr->next = t;
   }
 
+  /* Chains refer to the targets until the daemon exits. */
+  plugin_mark_permanent();
+
   return 0;
 } /* }}} int fc_register_target */
 
+int fc_match_value_dependent(void __attribute__((unused)) * *user_data) /* {{{ */
+{
+  return 1;
+} /* }}} int fc_match_value_dependent */
+
 fc_chain_t *fc_chain_get_by_name(const char *chain_name) /* {{{ */
 {
   if (chain_name == NULL)
@@ -803,37 +1190,80 @@ int fc_process_chain(const data_set_t *ds, value_list_t *vl, /* {{{ */
                      fc_chain_t *chain) {
   fc_target_t *target;
   int status = FC_TARGET_CONTINUE;
+  _Bool candidates_static[FC_CANDIDATES_STATIC];
+  _Bool *candidates = NULL;
+  size_t pos = 0;
+  value_list_identity_t const *memo_identity = NULL;
+  uint8_t memo[FC_MEMO_MAX_SIZE];
+  _Bool memo_active = 0;
+  _Bool memo_dirty = 0;
 
   if (chain == NULL)
     return -1;
 
   DEBUG("fc_process_chain (chain = %s);", chain->name);
 
-  for (fc_rule_t *rule = chain->rules; rule != NULL; rule = rule->next) {
+  /* If the allocation fails, simply evaluate all rules. */
+  if (chain->index != NULL) {
+    if (chain->index->rules_num <= STATIC_ARRAY_SIZE(candidates_static))
+      candidates = candidates_static;
+    else
+      candidates = malloc(sizeof(*candidates) * chain->index->rules_num);
+
+    if (candidates != NULL)
+      fc_index_candidates(chain->index, vl, candidates);
+  }
+
+  /* Without a cache entry (yet), there's nowhere to store the results. */
+  if (chain->memo_size > 0) {
+    memo_identity = VALUE_LIST_IDENTITY(vl);
+    if ((memo_identity != NULL) &&
+        (uc_memo_get(memo_identity, fc_memo_generation, chain->memo_offset,
+                     memo, chain->memo_size) == 0))
+      memo_active = 1;
+  }
+
+  for (fc_rule_t *rule = chain->rules; rule != NULL;
+       rule = rule->next, pos++) {
     fc_match_t *match;
     status = FC_TARGET_CONTINUE;
 
+    if ((candidates != NULL) && !candidates[pos])
+      continue;
+
     if (rule->name[0] != 0) {
       DEBUG("fc_process_chain (%s): Testing the `%s' rule.", chain->name,
             rule->name);
     }
 
-    /* N. B.: rule->matches may be NULL. */
-    for (match = rule->matches; match != NULL; match = match->next) {
-      /* FIXME: Pass the meta-data to match targets here (when implemented). */
-      status =
-          (*match->proc.match)(ds, vl, /* meta = */ NULL, &match->user_data);
-      if (status < 0) {
-        WARNING("fc_process_chain (%s): A match failed.", chain->name);
-        break;
-      } else if (status != FC_MATCH_MATCHES)
-        break;
-    }
+    if (memo_active && rule->memoizable && FC_MEMO_KNOWN(memo, pos)) {
+      if (!FC_MEMO_MATCHES(memo, pos))
+        continue;
+    } else {
+      /* N. B.: rule->matches may be NULL. */
+      for (match = rule->matches; match != NULL; match = match->next) {
+        /* FIXME: Pass the meta-data to match targets here (when implemented).
+         */
+        status =
+            (*match->proc.match)(ds, vl, /* meta = */ NULL, &match->user_data);
+        if (status < 0) {
+          WARNING("fc_process_chain (%s): A match failed.", chain->name);
+          break;
+        } else if (status != FC_MATCH_MATCHES)
+          break;
+      }
 
-    /* for-loop has been aborted: Either error or no match. */
-    if (match != NULL) {
-      status = FC_TARGET_CONTINUE;
-      continue;
+      /* Don't remember errors, they may be transient. */
+      if (memo_active && rule->memoizable && (status >= 0)) {
+        FC_MEMO_SET(memo, pos, match == NULL);
+        memo_dirty = 1;
+      }
+
+      /* for-loop has been aborted: Either error or no match. */
+      if (match != NULL) {
+        status = FC_TARGET_CONTINUE;
+        continue;
+      }
     }
 
     if (rule->name[0] != 0) {
@@ -863,6 +1293,13 @@ int fc_process_chain(const data_set_t *ds, value_list_t *vl, /* {{{ */
       }
     }
 
+    /* Targets may have changed the identifier. The memoized results only
+     * apply to the original one. */
+    if (candidates != NULL)
+      fc_index_candidates(chain->index, vl, candidates);
+    if (memo_active && (VALUE_LIST_IDENTITY(vl) != memo_identity))
+      memo_active = 0;
+
     if ((status == FC_TARGET_STOP) || (status == FC_TARGET_RETURN)) {
       if (rule->name[0] != 0) {
         DEBUG("fc_process_chain (%s): Rule `%s' signaled "
@@ -874,6 +1311,13 @@ int fc_process_chain(const data_set_t *ds, value_list_t *vl, /* {{{ */
     }
   } /* for (rule) */
 
+  if (candidates != candidates_static)
+    sfree(candidates);
+
+  if (memo_dirty)
+    uc_memo_set(memo_identity, fc_memo_generation, chain->memo_offset, memo,
+                chain->memo_size);
+
   if ((status == FC_TARGET_STOP) || (status == FC_TARGET_RETURN))
     return status;
 
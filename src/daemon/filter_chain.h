@@ -41,16 +41,46 @@
 /*
  * Match functions
  */
+#define FC_FIELD_HOST 0
+#define FC_FIELD_PLUGIN 1
+#define FC_FIELD_PLUGIN_INSTANCE 2
+#define FC_FIELD_TYPE 3
+#define FC_FIELD_TYPE_INSTANCE 4
+#define FC_FIELDS_NUM 5
+
+/* Necessary condition of a match: The identifier field `field' (one of the
+ * FC_FIELD_* constants) is equal to `value' if `exact' is true, or starts
+ * with `value' otherwise. */
+struct fc_constraint_s {
+  int field;
+  _Bool exact;
+  char value[DATA_MAX_NAME_LEN];
+};
+typedef struct fc_constraint_s fc_constraint_t;
+
 struct match_proc_s {
   int (*create)(const oconfig_item_t *ci, void **user_data);
   int (*destroy)(void **user_data);
   int (*match)(const data_set_t *ds, const value_list_t *vl,
                notification_meta_t **meta, void **user_data);
+  /* Optional. Returns zero and fills `ret' if `match' can only ever match
+   * value lists satisfying the constraint. Used to build the dispatch tables
+   * which let fc_process_chain() skip rules that cannot match. */
+  int (*constraint)(fc_constraint_t *ret, void **user_data);
+  /* Optional. Returns non-zero if the result of `match' depends on anything
+   * but the identifier of the value list, e.g. on its values, time or meta
+   * data. Matches without this callback may be memoized per identifier, see
+   * the "MemoizeMatches" chain option. */
+  int (*value_dependent)(void **user_data);
 };
 typedef struct match_proc_s match_proc_t;
 
 int fc_register_match(const char *name, match_proc_t proc);
 
+/* Convenience implementation of match_proc_t.value_dependent for matches
+ * which must never be memoized. */
+int fc_match_value_dependent(void **user_data);
+
 /*
  * Target functions
  */
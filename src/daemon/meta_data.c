@@ -29,9 +29,16 @@
 #include "common.h"
 #include "meta_data.h"
 #include "plugin.h"
+#include "utils_intern.h"
 
 #define MD_MAX_NONSTRING_CHARS 128
 
+/* Number of entries which fit into a store without a separate allocation. Most
+ * value lists carry fewer meta data entries than this. */
+#ifndef MD_INLINE_ENTRIES
+#define MD_INLINE_ENTRIES 8
+#endif
+
 /*
  * Data types
  */
@@ -47,20 +54,56 @@ typedef union meta_value_u meta_value_t;
 struct meta_entry_s;
 typedef struct meta_entry_s meta_entry_t;
 struct meta_entry_s {
-  char *key;
+  char const *key; /* interned, see md_keys() */
   meta_value_t value;
   int type;
-  meta_entry_t *next;
+};
+
+/* The entries are kept in a flat array, in the order they were added. A store
+ * is shared by all clones of a meta data object and is copied before one of
+ * them modifies it, so cloning the meta data of a value list for each write
+ * queue doesn't copy the entries. A store is never modified while it is
+ * shared. */
+struct meta_store_s;
+typedef struct meta_store_s meta_store_t;
+struct meta_store_s {
+  pthread_mutex_t lock; /* protects `refcount' */
+  size_t refcount;
+
+  meta_entry_t *entries;
+  size_t entries_num;
+  size_t entries_size;
+  meta_entry_t entries_inline[MD_INLINE_ENTRIES];
 };
 
 struct meta_data_s {
-  meta_entry_t *head;
+  meta_store_t *store; /* NULL if there are no entries yet. */
   pthread_mutex_t lock;
 };
 
+/* Keys are interned, so they don't have to be copied when entries are copied
+ * and looking up a key compares pointers. Keys are case insensitive. String
+ * values are not interned: their number isn't bounded (think of container
+ * IDs) and the intern table never shrinks. */
+static c_intern_t *md_key_table;
+static pthread_once_t md_key_table_once = PTHREAD_ONCE_INIT;
+
 /*
  * Private functions
  */
+static void md_key_table_create(void) /* {{{ */
+{
+  md_key_table = c_intern_create(/* ignore_case = */ 1);
+  if (md_key_table == NULL)
+    ERROR("meta_data: c_intern_create failed.");
+} /* }}} void md_key_table_create */
+
+static c_intern_t *md_keys(void) /* {{{ */
+{
+  pthread_once(&md_key_table_once, md_key_table_create);
+  return md_key_table;
+} /* }}} c_intern_t *md_keys */
+
 static char *md_strdup(const char *orig) /* {{{ */
 {
   size_t sz;
@@ -79,198 +122,222 @@ static char *md_strdup(const char *orig) /* {{{ */
   return dest;
 } /* }}} char *md_strdup */
 
-static meta_entry_t *md_entry_alloc(const char *key) /* {{{ */
+static void md_entry_free_contents(meta_entry_t *e) /* {{{ */
 {
-  meta_entry_t *e;
-
-  e = calloc(1, sizeof(*e));
-  if (e == NULL) {
-    ERROR("md_entry_alloc: calloc failed.");
-    return NULL;
-  }
-
-  e->key = md_strdup(key);
-  if (e->key == NULL) {
-    free(e);
-    ERROR("md_entry_alloc: md_strdup failed.");
-    return NULL;
-  }
+  e->key = NULL;
 
+  if (e->type == MD_TYPE_STRING)
+    free(e->value.mv_string);
   e->type = 0;
-  e->next = NULL;
+} /* }}} void md_entry_free_contents */
 
-  return e;
-} /* }}} meta_entry_t *md_entry_alloc */
+static int md_entry_clone_contents(meta_entry_t *copy, /* {{{ */
+                                   const meta_entry_t *orig) {
+  copy->key = orig->key;
+  copy->type = orig->type;
+  if (copy->type == MD_TYPE_STRING) {
+    copy->value.mv_string = md_strdup(orig->value.mv_string);
+    if (copy->value.mv_string == NULL)
+      return -ENOMEM;
+  } else
+    copy->value = orig->value;
 
-/* XXX: The lock on md must be held while calling this function! */
-static meta_entry_t *md_entry_clone_contents(const meta_entry_t *orig) /* {{{ */
-{
-  meta_entry_t *copy;
+  return 0;
+} /* }}} int md_entry_clone_contents */
 
-  /* WARNINGS :
-   *  - we do not check that orig != NULL here. You should have done it before.
-   *  - we do not set copy->next. DO NOT FORGET TO SET copy->next IN YOUR
-   * FUNCTION
-   */
+static meta_store_t *md_store_create(void) /* {{{ */
+{
+  meta_store_t *s;
 
-  copy = md_entry_alloc(orig->key);
-  if (copy == NULL)
+  s = calloc(1, sizeof(*s));
+  if (s == NULL) {
+    ERROR("md_store_create: calloc failed.");
     return NULL;
-  copy->type = orig->type;
-  if (copy->type == MD_TYPE_STRING)
-    copy->value.mv_string = strdup(orig->value.mv_string);
-  else
-    copy->value = orig->value;
+  }
 
-  return copy;
-} /* }}} meta_entry_t *md_entry_clone_contents */
+  pthread_mutex_init(&s->lock, /* attr = */ NULL);
+  s->refcount = 1;
+  s->entries = s->entries_inline;
+  s->entries_size = STATIC_ARRAY_SIZE(s->entries_inline);
 
-static meta_entry_t *md_entry_clone(const meta_entry_t *orig) /* {{{ */
-{
-  meta_entry_t *copy;
+  return s;
+} /* }}} meta_store_t *md_store_create */
 
-  if (orig == NULL)
+static meta_store_t *md_store_ref(meta_store_t *s) /* {{{ */
+{
+  if (s == NULL)
     return NULL;
 
-  copy = md_entry_clone_contents(orig);
+  pthread_mutex_lock(&s->lock);
+  s->refcount++;
+  pthread_mutex_unlock(&s->lock);
 
-  copy->next = md_entry_clone(orig->next);
-  return copy;
-} /* }}} meta_entry_t *md_entry_clone */
+  return s;
+} /* }}} meta_store_t *md_store_ref */
 
-static void md_entry_free(meta_entry_t *e) /* {{{ */
+static void md_store_unref(meta_store_t *s) /* {{{ */
 {
-  if (e == NULL)
-    return;
+  size_t refcount;
 
-  free(e->key);
+  if (s == NULL)
+    return;
 
-  if (e->type == MD_TYPE_STRING)
-    free(e->value.mv_string);
+  pthread_mutex_lock(&s->lock);
+  refcount = --s->refcount;
+  pthread_mutex_unlock(&s->lock);
 
-  if (e->next != NULL)
-    md_entry_free(e->next);
+  if (refcount > 0)
+    return;
 
-  free(e);
-} /* }}} void md_entry_free */
+  for (size_t i = 0; i < s->entries_num; i++)
+    md_entry_free_contents(s->entries + i);
+  if (s->entries != s->entries_inline)
+    free(s->entries);
+  pthread_mutex_destroy(&s->lock);
+  free(s);
+} /* }}} void md_store_unref */
 
-static int md_entry_insert(meta_data_t *md, meta_entry_t *e) /* {{{ */
+static int md_store_reserve(meta_store_t *s, size_t num) /* {{{ */
 {
-  meta_entry_t *this;
-  meta_entry_t *prev;
-
-  if ((md == NULL) || (e == NULL))
-    return -EINVAL;
+  meta_entry_t *tmp;
+  size_t size;
 
-  pthread_mutex_lock(&md->lock);
+  if (num <= s->entries_size)
+    return 0;
 
-  prev = NULL;
-  this = md->head;
-  while (this != NULL) {
-    if (strcasecmp(e->key, this->key) == 0)
-      break;
+  size = 2 * s->entries_size;
+  while (size < num)
+    size *= 2;
 
-    prev = this;
-    this = this->next;
+  if (s->entries == s->entries_inline) {
+    tmp = malloc(size * sizeof(*tmp));
+    if (tmp != NULL)
+      memcpy(tmp, s->entries, s->entries_num * sizeof(*tmp));
+  } else {
+    tmp = realloc(s->entries, size * sizeof(*tmp));
+  }
+  if (tmp == NULL) {
+    ERROR("md_store_reserve: Allocating %" PRIsz " entries failed.", size);
+    return -ENOMEM;
   }
 
-  if (this == NULL) {
-    /* This key does not exist yet. */
-    if (md->head == NULL)
-      md->head = e;
-    else {
-      assert(prev != NULL);
-      prev->next = e;
-    }
+  s->entries = tmp;
+  s->entries_size = size;
+  return 0;
+} /* }}} int md_store_reserve */
 
-    e->next = NULL;
-  } else /* (this != NULL) */
-  {
-    if (prev == NULL)
-      md->head = e;
-    else
-      prev->next = e;
+/* Makes sure `md' has a store of its own, copying a shared store if required.
+ * XXX: The lock on md must be held while calling this function! */
+static meta_store_t *md_store_writable(meta_data_t *md) /* {{{ */
+{
+  meta_store_t *orig = md->store;
+  meta_store_t *copy;
+  size_t refcount;
 
-    e->next = this->next;
+  if (orig == NULL) {
+    md->store = md_store_create();
+    return md->store;
   }
 
-  pthread_mutex_unlock(&md->lock);
+  /* Nobody else can take a reference to our store while we hold md->lock,
+   * so if we're the only user it stays that way. */
+  pthread_mutex_lock(&orig->lock);
+  refcount = orig->refcount;
+  pthread_mutex_unlock(&orig->lock);
+  if (refcount == 1)
+    return orig;
+
+  copy = md_store_create();
+  if (copy == NULL)
+    return NULL;
 
-  if (this != NULL) {
-    this->next = NULL;
-    md_entry_free(this);
+  if (md_store_reserve(copy, orig->entries_num) != 0) {
+    md_store_unref(copy);
+    return NULL;
   }
 
-  return 0;
-} /* }}} int md_entry_insert */
+  for (size_t i = 0; i < orig->entries_num; i++) {
+    if (md_entry_clone_contents(copy->entries + i, orig->entries + i) != 0) {
+      ERROR("md_store_writable: Copying meta data entry failed.");
+      md_store_unref(copy);
+      return NULL;
+    }
+    copy->entries_num++;
+  }
+
+  md->store = copy;
+  md_store_unref(orig);
+  return copy;
+} /* }}} meta_store_t *md_store_writable */
 
 /* XXX: The lock on md must be held while calling this function! */
-static int md_entry_insert_clone(meta_data_t *md, meta_entry_t *orig) /* {{{ */
-{
-  meta_entry_t *e;
-  meta_entry_t *this;
-  meta_entry_t *prev;
+static meta_entry_t *md_entry_lookup(meta_data_t *md, /* {{{ */
+                                     const char *key) {
+  meta_store_t *s;
 
-  /* WARNINGS :
-   *  - we do not check that md and e != NULL here. You should have done it
-   * before.
-   *  - we do not use the lock. You should have set it before.
-   */
+  if ((md == NULL) || (key == NULL) || (md->store == NULL))
+    return NULL;
 
-  e = md_entry_clone_contents(orig);
+  /* A key which hasn't been interned can't be in any meta data object. */
+  key = c_intern_find(md_keys(), key);
+  if (key == NULL)
+    return NULL;
 
-  prev = NULL;
-  this = md->head;
-  while (this != NULL) {
-    if (strcasecmp(e->key, this->key) == 0)
-      break;
+  s = md->store;
+  for (size_t i = 0; i < s->entries_num; i++)
+    if (s->entries[i].key == key)
+      return s->entries + i;
 
-    prev = this;
-    this = this->next;
-  }
+  return NULL;
+} /* }}} meta_entry_t *md_entry_lookup */
 
-  if (this == NULL) {
-    /* This key does not exist yet. */
-    if (md->head == NULL)
-      md->head = e;
-    else {
-      assert(prev != NULL);
-      prev->next = e;
-    }
+/* Adds `e' to `md', replacing an existing entry with the same key. Takes
+ * ownership of the entry's contents, even if it fails.
+ * XXX: The lock on md must be held while calling this function! */
+static int md_entry_insert_locked(meta_data_t *md, meta_entry_t *e) /* {{{ */
+{
+  meta_store_t *s;
+  meta_entry_t *this;
 
-    e->next = NULL;
-  } else /* (this != NULL) */
-  {
-    if (prev == NULL)
-      md->head = e;
-    else
-      prev->next = e;
+  s = md_store_writable(md);
+  if (s == NULL) {
+    md_entry_free_contents(e);
+    return -ENOMEM;
+  }
 
-    e->next = this->next;
+  /* `e->key' is interned already. */
+  for (size_t i = 0; i < s->entries_num; i++) {
+    this = s->entries + i;
+    if (this->key == e->key) {
+      md_entry_free_contents(this);
+      *this = *e;
+      return 0;
+    }
   }
 
-  if (this != NULL) {
-    this->next = NULL;
-    md_entry_free(this);
+  if (md_store_reserve(s, s->entries_num + 1) != 0) {
+    md_entry_free_contents(e);
+    return -ENOMEM;
   }
 
+  s->entries[s->entries_num] = *e;
+  s->entries_num++;
   return 0;
-} /* }}} int md_entry_insert_clone */
+} /* }}} int md_entry_insert_locked */
 
-/* XXX: The lock on md must be held while calling this function! */
-static meta_entry_t *md_entry_lookup(meta_data_t *md, /* {{{ */
-                                     const char *key) {
-  meta_entry_t *e;
+static int md_entry_insert(meta_data_t *md, meta_entry_t *e) /* {{{ */
+{
+  int status;
 
-  if ((md == NULL) || (key == NULL))
-    return NULL;
+  if ((md == NULL) || (e == NULL))
+    return -EINVAL;
 
-  for (e = md->head; e != NULL; e = e->next)
-    if (strcasecmp(key, e->key) == 0)
-      break;
+  pthread_mutex_lock(&md->lock);
+  status = md_entry_insert_locked(md, e);
+  pthread_mutex_unlock(&md->lock);
 
-  return e;
-} /* }}} meta_entry_t *md_entry_lookup */
+  return status;
+} /* }}} int md_entry_insert */
 
 /*
  * Each value_list_t*, as it is going through the system, is handled by exactly
@@ -312,8 +379,9 @@ meta_data_t *meta_data_clone(meta_data_t *orig) /* {{{ */
   if (copy == NULL)
     return NULL;
 
+  /* The entries are shared until either side modifies them. */
   pthread_mutex_lock(&orig->lock);
-  copy->head = md_entry_clone(orig->head);
+  copy->store = md_store_ref(orig->store);
   pthread_mutex_unlock(&orig->lock);
 
   return copy;
@@ -329,12 +397,35 @@ int meta_data_clone_merge(meta_data_t **dest, meta_data_t *orig) /* {{{ */
     return 0;
   }
 
+  if (*dest == orig)
+    return 0;
+
+  /* Holding a reference keeps the entries from being modified, so orig
+   * doesn't have to stay locked. */
   pthread_mutex_lock(&orig->lock);
-  for (meta_entry_t *e = orig->head; e != NULL; e = e->next) {
-    md_entry_insert_clone((*dest), e);
-  }
+  meta_store_t *s = md_store_ref(orig->store);
   pthread_mutex_unlock(&orig->lock);
 
+  if (s == NULL)
+    return 0;
+
+  pthread_mutex_lock(&(*dest)->lock);
+  if (((*dest)->store == NULL) || ((*dest)->store->entries_num == 0)) {
+    /* Nothing to merge with, share the entries instead. */
+    md_store_unref((*dest)->store);
+    (*dest)->store = s;
+    s = NULL;
+  } else {
+    for (size_t i = 0; i < s->entries_num; i++) {
+      meta_entry_t e;
+      if (md_entry_clone_contents(&e, s->entries + i) != 0)
+        continue;
+      md_entry_insert_locked(*dest, &e);
+    }
+  }
+  pthread_mutex_unlock(&(*dest)->lock);
+
+  md_store_unref(s);
   return 0;
 } /* }}} int meta_data_clone_merge */
 
@@ -343,58 +434,52 @@ void meta_data_destroy(meta_data_t *md) /* {{{ */
   if (md == NULL)
     return;
 
-  md_entry_free(md->head);
+  md_store_unref(md->store);
   pthread_mutex_destroy(&md->lock);
   free(md);
 } /* }}} void meta_data_destroy */
 
 int meta_data_exists(meta_data_t *md, const char *key) /* {{{ */
 {
+  int status;
+
   if ((md == NULL) || (key == NULL))
     return -EINVAL;
 
   pthread_mutex_lock(&md->lock);
-
-  for (meta_entry_t *e = md->head; e != NULL; e = e->next) {
-    if (strcasecmp(key, e->key) == 0) {
-      pthread_mutex_unlock(&md->lock);
-      return 1;
-    }
-  }
-
+  status = (md_entry_lookup(md, key) != NULL);
   pthread_mutex_unlock(&md->lock);
-  return 0;
+
+  return status;
 } /* }}} int meta_data_exists */
 
 int meta_data_type(meta_data_t *md, const char *key) /* {{{ */
 {
+  meta_entry_t *e;
+  int type;
+
   if ((md == NULL) || (key == NULL))
     return -EINVAL;
 
   pthread_mutex_lock(&md->lock);
-
-  for (meta_entry_t *e = md->head; e != NULL; e = e->next) {
-    if (strcasecmp(key, e->key) == 0) {
-      pthread_mutex_unlock(&md->lock);
-      return e->type;
-    }
-  }
-
+  e = md_entry_lookup(md, key);
+  type = (e != NULL) ? e->type : 0;
   pthread_mutex_unlock(&md->lock);
-  return 0;
+
+  return type;
 } /* }}} int meta_data_type */
 
 int meta_data_toc(meta_data_t *md, char ***toc) /* {{{ */
 {
-  int i = 0, count = 0;
+  int count = 0;
 
   if ((md == NULL) || (toc == NULL))
     return -EINVAL;
 
   pthread_mutex_lock(&md->lock);
 
-  for (meta_entry_t *e = md->head; e != NULL; e = e->next)
-    ++count;
+  if (md->store != NULL)
+    count = (int)md->store->entries_num;
 
   if (count == 0) {
     pthread_mutex_unlock(&md->lock);
@@ -402,8 +487,8 @@ int meta_data_toc(meta_data_t *md, char ***toc) /* {{{ */
   }
 
   *toc = calloc(count, sizeof(**toc));
-  for (meta_entry_t *e = md->head; e != NULL; e = e->next)
-    (*toc)[i++] = strdup(e->key);
+  for (int i = 0; i < count; i++)
+    (*toc)[i] = strdup(md->store->entries[i].key);
 
   pthread_mutex_unlock(&md->lock);
   return count;
@@ -411,38 +496,35 @@ int meta_data_toc(meta_data_t *md, char ***toc) /* {{{ */
 
 int meta_data_delete(meta_data_t *md, const char *key) /* {{{ */
 {
+  meta_store_t *s;
   meta_entry_t *this;
-  meta_entry_t *prev;
 
   if ((md == NULL) || (key == NULL))
     return -EINVAL;
 
   pthread_mutex_lock(&md->lock);
 
-  prev = NULL;
-  this = md->head;
-  while (this != NULL) {
-    if (strcasecmp(key, this->key) == 0)
-      break;
-
-    prev = this;
-    this = this->next;
+  if (md_entry_lookup(md, key) == NULL) {
+    pthread_mutex_unlock(&md->lock);
+    return -ENOENT;
   }
 
-  if (this == NULL) {
+  s = md_store_writable(md);
+  if (s == NULL) {
     pthread_mutex_unlock(&md->lock);
-    return -ENOENT;
+    return -ENOMEM;
   }
 
-  if (prev == NULL)
-    md->head = this->next;
-  else
-    prev->next = this->next;
+  /* Look up again, the store may have been copied. */
+  this = md_entry_lookup(md, key);
+  assert(this != NULL);
 
-  pthread_mutex_unlock(&md->lock);
+  md_entry_free_contents(this);
+  size_t index = (size_t)(this - s->entries);
+  memmove(this, this + 1, (s->entries_num - index - 1) * sizeof(*this));
+  s->entries_num--;
 
-  this->next = NULL;
-  md_entry_free(this);
+  pthread_mutex_unlock(&md->lock);
 
   return 0;
 } /* }}} int meta_data_delete */
@@ -452,92 +534,81 @@ int meta_data_delete(meta_data_t *md, const char *key) /* {{{ */
  */
 int meta_data_add_string(meta_data_t *md, /* {{{ */
                          const char *key, const char *value) {
-  meta_entry_t *e;
+  meta_entry_t e = {.type = MD_TYPE_STRING};
 
   if ((md == NULL) || (key == NULL) || (value == NULL))
     return -EINVAL;
 
-  e = md_entry_alloc(key);
-  if (e == NULL)
+  e.key = c_intern(md_keys(), key);
+  if (e.key == NULL)
     return -ENOMEM;
-
-  e->value.mv_string = md_strdup(value);
-  if (e->value.mv_string == NULL) {
+  e.value.mv_string = md_strdup(value);
+  if (e.value.mv_string == NULL) {
     ERROR("meta_data_add_string: md_strdup failed.");
-    md_entry_free(e);
     return -ENOMEM;
   }
-  e->type = MD_TYPE_STRING;
 
-  return md_entry_insert(md, e);
+  return md_entry_insert(md, &e);
 } /* }}} int meta_data_add_string */
 
 int meta_data_add_signed_int(meta_data_t *md, /* {{{ */
                              const char *key, int64_t value) {
-  meta_entry_t *e;
+  meta_entry_t e = {.type = MD_TYPE_SIGNED_INT};
 
   if ((md == NULL) || (key == NULL))
     return -EINVAL;
 
-  e = md_entry_alloc(key);
-  if (e == NULL)
+  e.key = c_intern(md_keys(), key);
+  if (e.key == NULL)
     return -ENOMEM;
+  e.value.mv_signed_int = value;
 
-  e->value.mv_signed_int = value;
-  e->type = MD_TYPE_SIGNED_INT;
-
-  return md_entry_insert(md, e);
+  return md_entry_insert(md, &e);
 } /* }}} int meta_data_add_signed_int */
 
 int meta_data_add_unsigned_int(meta_data_t *md, /* {{{ */
                                const char *key, uint64_t value) {
-  meta_entry_t *e;
+  meta_entry_t e = {.type = MD_TYPE_UNSIGNED_INT};
 
   if ((md == NULL) || (key == NULL))
     return -EINVAL;
 
-  e = md_entry_alloc(key);
-  if (e == NULL)
+  e.key = c_intern(md_keys(), key);
+  if (e.key == NULL)
     return -ENOMEM;
+  e.value.mv_unsigned_int = value;
 
-  e->value.mv_unsigned_int = value;
-  e->type = MD_TYPE_UNSIGNED_INT;
-
-  return md_entry_insert(md, e);
+  return md_entry_insert(md, &e);
 } /* }}} int meta_data_add_unsigned_int */
 
 int meta_data_add_double(meta_data_t *md, /* {{{ */
                          const char *key, double value) {
-  meta_entry_t *e;
+  meta_entry_t e = {.type = MD_TYPE_DOUBLE};
 
   if ((md == NULL) || (key == NULL))
     return -EINVAL;
 
-  e = md_entry_alloc(key);
-  if (e == NULL)
+  e.key = c_intern(md_keys(), key);
+  if (e.key == NULL)
     return -ENOMEM;
+  e.value.mv_double = value;
 
-  e->value.mv_double = value;
-  e->type = MD_TYPE_DOUBLE;
-
-  return md_entry_insert(md, e);
+  return md_entry_insert(md, &e);
 } /* }}} int meta_data_add_double */
 
 int meta_data_add_boolean(meta_data_t *md, /* {{{ */
                           const char *key, _Bool value) {
-  meta_entry_t *e;
+  meta_entry_t e = {.type = MD_TYPE_BOOLEAN};
 
   if ((md == NULL) || (key == NULL))
     return -EINVAL;
 
-  e = md_entry_alloc(key);
-  if (e == NULL)
+  e.key = c_intern(md_keys(), key);
+  if (e.key == NULL)
     return -ENOMEM;
+  e.value.mv_boolean = value;
 
-  e->value.mv_boolean = value;
-  e->type = MD_TYPE_BOOLEAN;
-
-  return md_entry_insert(md, e);
+  return md_entry_insert(md, &e);
 } /* }}} int meta_data_add_boolean */
 
 /*
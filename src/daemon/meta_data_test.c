@@ -109,8 +109,96 @@ DEF_TEST(base) {
   return 0;
 }
 
+DEF_TEST(clone) {
+  meta_data_t *orig;
+  meta_data_t *copy;
+  char key[32];
+  char *s;
+  int64_t si;
+  char **toc = NULL;
+
+  CHECK_NOT_NULL(orig = meta_data_create());
+
+  /* more entries than fit into a store without a separate allocation */
+  for (int i = 0; i < 20; i++) {
+    snprintf(key, sizeof(key), "key%02d", i);
+    CHECK_ZERO(meta_data_add_signed_int(orig, key, i));
+  }
+  CHECK_ZERO(meta_data_add_string(orig, "string", "foobar"));
+
+  CHECK_NOT_NULL(copy = meta_data_clone(orig));
+
+  /* modifying the copy doesn't modify the original, and vice versa */
+  CHECK_ZERO(meta_data_add_string(copy, "string", "barqux"));
+  CHECK_ZERO(meta_data_delete(copy, "key00"));
+  CHECK_ZERO(meta_data_add_signed_int(orig, "key01", 42));
+
+  CHECK_ZERO(meta_data_get_string(orig, "string", &s));
+  EXPECT_EQ_STR("foobar", s);
+  sfree(s);
+  CHECK_ZERO(meta_data_get_string(copy, "string", &s));
+  EXPECT_EQ_STR("barqux", s);
+  sfree(s);
+
+  OK(meta_data_exists(orig, "key00"));
+  OK(!meta_data_exists(copy, "key00"));
+  CHECK_ZERO(meta_data_get_signed_int(orig, "key01", &si));
+  EXPECT_EQ_INT(42, (int)si);
+  CHECK_ZERO(meta_data_get_signed_int(copy, "key01", &si));
+  EXPECT_EQ_INT(1, (int)si);
+
+  /* entries keep the order in which they were added */
+  EXPECT_EQ_INT(20, meta_data_toc(copy, &toc));
+  EXPECT_EQ_STR("key01", toc[0]);
+  EXPECT_EQ_STR("string", toc[19]);
+  strarray_free(toc, 20);
+
+  /* the copy is still valid after the original has been destroyed */
+  meta_data_destroy(orig);
+  CHECK_ZERO(meta_data_get_signed_int(copy, "key19", &si));
+  EXPECT_EQ_INT(19, (int)si);
+
+  meta_data_destroy(copy);
+  return 0;
+}
+
+DEF_TEST(clone_merge) {
+  meta_data_t *dest = NULL;
+  meta_data_t *orig;
+  char *s;
+
+  CHECK_NOT_NULL(orig = meta_data_create());
+  CHECK_ZERO(meta_data_add_string(orig, "a", "1"));
+  CHECK_ZERO(meta_data_add_string(orig, "b", "2"));
+
+  CHECK_ZERO(meta_data_clone_merge(&dest, orig));
+  CHECK_NOT_NULL(dest);
+  CHECK_ZERO(meta_data_add_string(dest, "b", "3"));
+  CHECK_ZERO(meta_data_add_string(dest, "c", "4"));
+
+  CHECK_ZERO(meta_data_add_string(orig, "a", "5"));
+  CHECK_ZERO(meta_data_clone_merge(&dest, orig));
+
+  CHECK_ZERO(meta_data_get_string(dest, "a", &s));
+  EXPECT_EQ_STR("5", s);
+  sfree(s);
+  CHECK_ZERO(meta_data_get_string(dest, "b", &s));
+  EXPECT_EQ_STR("2", s);
+  sfree(s);
+  CHECK_ZERO(meta_data_get_string(dest, "c", &s));
+  EXPECT_EQ_STR("4", s);
+  sfree(s);
+  OK(!meta_data_exists(orig, "c"));
+
+  meta_data_destroy(orig);
+  meta_data_destroy(dest);
+  return 0;
+}
+
 int main(void) {
   RUN_TEST(base);
+  RUN_TEST(clone);
+  RUN_TEST(clone_merge);
 
   END_TEST;
 }
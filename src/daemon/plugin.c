@@ -37,9 +37,15 @@
 #include "utils_avltree.h"
 #include "utils_cache.h"
 #include "utils_complain.h"
+#include "utils_downsample.h"
 #include "utils_heap.h"
+#include "utils_intern.h"
+#include "utils_latency.h"
 #include "utils_llist.h"
-#include "utils_random.h"
+#include "utils_pool.h"
+#include "utils_ring.h"
+#include "utils_shm_export.h"
+#include "utils_spill.h"
 #include "utils_time.h"
 
 #if HAVE_PTHREAD_NP_H
@@ -48,13 +54,91 @@
 
 #include <dlfcn.h>
 
+#if HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+#endif
+
+/* USDT probes at the stage boundaries of dispatching values, for use with
+ * SystemTap, bpftrace and the like. They cost a single nop when no tracer is
+ * attached. */
+#if HAVE_SYS_SDT_H
+#define DISPATCH_PROBE1(name, a) DTRACE_PROBE1(collectd, name, a)
+#define DISPATCH_PROBE2(name, a, b) DTRACE_PROBE2(collectd, name, a, b)
+#else
+#define DISPATCH_PROBE1(name, a)                                               \
+  do {                                                                         \
+  } while (0)
+#define DISPATCH_PROBE2(name, a, b)                                            \
+  do {                                                                         \
+  } while (0)
+#endif
+
 /*
  * Private structures
  */
+/* CPU time accounting, see "PluginCPUAccounting". One entry per plugin,
+ * shared by all of its callbacks. Entries live until the daemon shuts down and
+ * are updated with atomic builtins, if available. */
+#define PLUGIN_CPU_READ 0
+#define PLUGIN_CPU_WRITE 1
+#define PLUGIN_CPU_FLUSH 2
+#define PLUGIN_CPU_NOTIFICATION 3
+#define PLUGIN_CPU_KINDS 4
+struct plugin_cpu_s {
+  char *name;
+  cdtime_t time[PLUGIN_CPU_KINDS];
+  uint64_t calls[PLUGIN_CPU_KINDS];
+};
+typedef struct plugin_cpu_s plugin_cpu_t;
+
+/* Sampled latencies of a stage of dispatching values or of a write callback,
+ * see "DispatchLatencySampling". "latency" is NULL while sampling is
+ * disabled. */
+struct dispatch_latency_s {
+  pthread_mutex_t lock;
+  latency_counter_t *latency;
+};
+typedef struct dispatch_latency_s dispatch_latency_t;
+
+#define DISPATCH_STAGE_QUEUE 0
+#define DISPATCH_STAGE_PRE_CACHE 1
+#define DISPATCH_STAGE_CACHE 2
+#define DISPATCH_STAGE_POST_CACHE 3
+#define DISPATCH_STAGES_NUM 4
+
+/* A plugin loaded with plugin_load(). Entries live until the daemon shuts down,
+ * even if the plugin is unloaded in the meantime, so that callbacks can keep a
+ * pointer to theirs. The counters and flags accessed by other threads are
+ * updated with atomic builtins, if available, and under
+ * "plugins_loaded_lock" otherwise. */
+struct loaded_plugin_s {
+  char *name;
+  void *dlh;
+  _Bool loaded;
+  /* Set while the plugin is being unloaded and, after a reload, until its
+   * init callbacks have returned. Its callbacks are not called meanwhile. */
+  _Bool disabled;
+  /* Set if the plugin cannot be unloaded, see plugin_unload(). */
+  _Bool permanent;
+  /* Calls of the plugin's callbacks in progress which are not tracked by the
+   * calling thread itself, see callback_enter(). */
+  uint64_t active;
+  /* Threads started by the plugin with plugin_thread_create() which have not
+   * exited yet. */
+  uint64_t threads;
+};
+typedef struct loaded_plugin_s loaded_plugin_t;
+
 struct callback_func_s {
   void *cf_callback;
   user_data_t cf_udata;
   plugin_ctx_t cf_ctx;
+  plugin_cpu_t *cf_cpu;
+  /* NULL for the daemon's own callbacks. */
+  loaded_plugin_t *cf_plugin;
+  /* Set when the plugin is unloaded. The callback is no longer called, but
+   * is only freed at shutdown since other threads may still refer to it. */
+  _Bool cf_retired;
 };
 typedef struct callback_func_s callback_func_t;
 
@@ -71,20 +155,129 @@ struct read_func_s {
   char rf_group[DATA_MAX_NAME_LEN];
   char *rf_name;
   int rf_type;
+  size_t rf_pool; /* see read_pool_get() */
   cdtime_t rf_interval;
   cdtime_t rf_effective_interval;
   cdtime_t rf_next_read;
+  _Bool rf_phased; /* first read moved to its slot, see "ReadJitter" */
+
+  /* Statistics, protected by `rf_stats_lock'. */
+  pthread_mutex_t rf_stats_lock;
+  latency_counter_t *rf_latency;
+  uint64_t rf_reads;
+  uint64_t rf_overruns; /* reads which took longer than the interval */
+  uint64_t rf_skipped;  /* intervals in which no read happened */
 };
 typedef struct read_func_s read_func_t;
 
+struct value_list_compact_s;
+typedef struct value_list_compact_s value_list_compact_t;
+
 struct write_queue_s;
 typedef struct write_queue_s write_queue_t;
 struct write_queue_s {
+  /* Entries of the global write queue hold a compact copy, entries of a
+   * write callback's dedicated queue a reference to a shared value list. */
+  value_list_compact_t *cvl;
   value_list_t *vl;
+  /* Only set for entries of a write callback's dedicated queue. */
+  const data_set_t *ds;
   plugin_ctx_t ctx;
+  /* Time the entry was appended to the global queue, if it is sampled. */
+  cdtime_t enqueued;
+  /* Coarse time the entry was appended to the global queue, if the number of
+   * write threads is elastic. */
+  cdtime_t queued;
   write_queue_t *next;
 };
 
+struct write_func_s {
+/* `write_func_t' "inherits" from `callback_func_t'.
+ * The `wf_super' member MUST be the first one in this structure! */
+#define wf_callback wf_super.cf_callback
+#define wf_udata wf_super.cf_udata
+#define wf_ctx wf_super.cf_ctx
+  callback_func_t wf_super;
+  char *wf_name;
+
+  /* Dedicated queue, used if wf_ctx.write_threads is non-zero. */
+  pthread_mutex_t wf_lock;
+  pthread_cond_t wf_cond;
+  pthread_cond_t wf_cond_full;
+  write_queue_t *wf_head;
+  write_queue_t *wf_tail;
+  long wf_queue_length;
+  derive_t wf_dropped;
+  _Bool wf_loop;
+  pthread_t *wf_threads;
+  size_t wf_threads_num;
+
+  /* Set for callbacks registered with plugin_register_write_batch(). These
+   * always use a dedicated queue. */
+  _Bool wf_batch;
+  size_t wf_batch_size;
+  cdtime_t wf_batch_linger;
+
+  /* Set if the values are downsampled before being passed to the callback,
+   * see wf_ctx.write_downsample. */
+  downsample_t *wf_downsample;
+
+  /* Value lists not passed on because of wf_ctx.write_changes_only. Updated
+   * atomically or, without atomic builtins, under wf_lock. */
+  uint64_t wf_suppressed;
+
+  /* Journal of WRITE_QUEUE_POLICY_SPILL. Value lists which don't fit into
+   * the dedicated queue or which the callback failed to write are appended
+   * to it. They are replayed, at most wf_ctx.write_spill_rate per second,
+   * while the queue is empty and the callback succeeds. */
+  spill_t *wf_spill;
+  _Bool wf_spill_failing;
+  cdtime_t wf_spill_next;
+  derive_t wf_spilled;
+
+  /* Duration of the callback's calls. */
+  dispatch_latency_t wf_latency;
+};
+typedef struct write_func_s write_func_t;
+
+#define WRITE_SPILL_LIMIT_DEFAULT (1024 * 1024 * 1024)
+#define WRITE_SPILL_RATE_DEFAULT 1000
+/* Value lists replayed at once by callbacks which don't take batches. */
+#define WRITE_SPILL_REPLAY_NUM 100
+
+/* The write queue is split into one or more shards, each with its own lock,
+ * condition variable and linked list. Producers distribute value lists over
+ * the shards in a round-robin fashion; each write thread has a "home" shard
+ * it sleeps on and steals from other shards when its home shard is empty.
+ * With a single shard (the default) this is equivalent to one global queue. */
+struct write_queue_shard_s {
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  write_queue_t *head;
+  write_queue_t *tail;
+  long length;
+};
+typedef struct write_queue_shard_s write_queue_shard_t;
+
+/* The shards and their number are published together through a single
+ * pointer, so that a producer never combines the number of shards of one set
+ * with the array of another. */
+typedef struct {
+  write_queue_shard_t *shards;
+  size_t num;
+} write_queue_shards_t;
+
+/* Per-thread state of a write queue producer. A thread usually dispatches
+ * many value lists with the same host, plugin and type in a row, so the names
+ * interned last are remembered, see value_list_compact_intern(). */
+struct write_queue_producer_s {
+  size_t next_shard;
+  char const *host;
+  char const *plugin;
+  char const *type;
+};
+typedef struct write_queue_producer_s write_queue_producer_t;
+
 struct flush_callback_s {
   char *name;
   cdtime_t timeout;
@@ -95,8 +288,26 @@ typedef struct flush_callback_s flush_callback_t;
  * Private variables
  */
 static c_avl_tree_t *plugins_loaded = NULL;
+static pthread_mutex_t plugins_loaded_lock = PTHREAD_MUTEX_INITIALIZER;
+/* Set once plugin_init_all() has been called. Plugins loaded afterwards are
+ * held back until plugin_init_plugin() has been called for them. */
+static _Bool plugins_initialized = 0;
+
+/* Callbacks of unloaded plugins, see callback_func_t.cf_retired. "list" is
+ * the list the callback was registered with, which may be gone by the time
+ * the callback is freed. */
+typedef struct {
+  llentry_t *le;
+  llist_t *list;
+  _Bool is_write;
+  /* Set once plugin_unload() has freed the callback's user data. */
+  _Bool released;
+} retired_callback_t;
+static retired_callback_t *callbacks_retired = NULL;
+static size_t callbacks_retired_num = 0;
 
 static llist_t *list_init;
+static llist_t *list_init_parallel;
 static llist_t *list_write;
 static llist_t *list_flush;
 static llist_t *list_missing;
@@ -104,47 +315,364 @@ static llist_t *list_shutdown;
 static llist_t *list_log;
 static llist_t *list_notification;
 
+/* Immutable snapshots of the callback lists which are walked by threads other
+ * than the main thread, e.g. for every value list, log message, notification
+ * or flush. A snapshot is rebuilt whenever its list changes and published
+ * atomically, so readers neither lock nor chase list pointers. Replaced
+ * snapshots may still be in use and are only freed at shutdown; callbacks are
+ * rarely (un)registered after startup. */
+typedef struct callback_array_s callback_array_t;
+struct callback_array_s {
+  callback_array_t *retired_next;
+  size_t num;
+  struct {
+    char const *name;
+    void *value;
+  } entries[];
+};
+
+static callback_array_t *array_write = NULL;
+static callback_array_t *array_flush = NULL;
+static callback_array_t *array_log = NULL;
+static callback_array_t *array_notification = NULL;
+static pthread_mutex_t callback_array_lock = PTHREAD_MUTEX_INITIALIZER;
+static callback_array_t *callback_arrays_retired = NULL;
+
 static fc_chain_t *pre_cache_chain = NULL;
 static fc_chain_t *post_cache_chain = NULL;
 
+/* Data sets can be looked up by name, using the AVL tree, and by ID. The IDs
+ * index a table of fixed size chunks, so that entries never move. */
+struct data_set_entry_s {
+  /* `data_set_entry_t' "inherits" from `data_set_t'.
+   * The `ds' member MUST be the first one in this structure! */
+  data_set_t ds;
+  data_set_id_t id;
+};
+typedef struct data_set_entry_s data_set_entry_t;
+
+#define DATA_SET_CHUNK_SIZE 256
+#define DATA_SET_CHUNKS_NUM 256
+
 static c_avl_tree_t *data_sets;
+static data_set_entry_t **data_sets_by_id[DATA_SET_CHUNKS_NUM];
+static data_set_id_t data_sets_last_id = 0;
 
 static char *plugindir = NULL;
 
 #ifndef DEFAULT_MAX_READ_INTERVAL
 #define DEFAULT_MAX_READ_INTERVAL TIME_T_TO_CDTIME_T_STATIC(86400)
 #endif
-static c_heap_t *read_heap = NULL;
+struct read_pool_s;
+typedef struct read_pool_s read_pool_t;
+
+/* Every read thread has its own queue of read functions. A thread which has
+ * nothing to do steals read functions that are due from the other queues of
+ * its pool, so a slow read function doesn't delay the others in its queue.
+ * Before the read threads are started, all read functions are kept in the
+ * default queue. */
+struct read_queue_s {
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  /* The read function due next is kept out of the heap, so that other
+   * threads can check whether it is due without removing it. */
+  read_func_t *next;
+  c_heap_t *heap;
+  read_pool_t *pool;
+};
+typedef struct read_queue_s read_queue_t;
+
+/* Read threads are organized in pools. Read functions are only stolen within
+ * a pool, so read functions which block for a long time, e.g. because a
+ * remote end is slow, can be kept away from the others by assigning them to
+ * a pool of their own. The default pool is sized by the "ReadThreads" global
+ * option. */
+struct read_pool_s {
+  char name[DATA_MAX_NAME_LEN];
+  size_t threads_num;
+  char **plugins;
+  size_t plugins_num;
+  char **groups;
+  size_t groups_num;
+
+  /* Set while the read threads are running. */
+  read_queue_t *queues;
+  size_t queues_num;
+  size_t queue_next; /* protected by read_lock */
+};
+
+/* Upper bound for how long an idle read thread sleeps before it checks the
+ * other queues for read functions to steal. */
+#ifndef READ_STEAL_INTERVAL
+#define READ_STEAL_INTERVAL TIME_T_TO_CDTIME_T_STATIC(1)
+#endif
+
+/* Upper bound for how long a read function waits before it checks again
+ * whether its plugin's init callback has returned. */
+#ifndef INIT_PENDING_RETRY
+#define INIT_PENDING_RETRY TIME_T_TO_CDTIME_T_STATIC(1)
+#endif
+
+/* How long plugin_unload() waits for the plugin's callbacks to return and for
+ * its threads to exit. */
+#ifndef PLUGIN_UNLOAD_TIMEOUT
+#define PLUGIN_UNLOAD_TIMEOUT TIME_T_TO_CDTIME_T_STATIC(30)
+#endif
+
+static read_queue_t read_queue_default = {
+    .lock = PTHREAD_MUTEX_INITIALIZER, .cond = PTHREAD_COND_INITIALIZER,
+};
+
+static read_pool_t read_pool_default = {.name = "default"};
+/* Pools registered with plugin_register_read_pool(). `rf_pool' is an index
+ * into this array plus one, zero being the default pool. */
+static read_pool_t **read_pools = NULL;
+static size_t read_pools_num = 0;
+
 static llist_t *read_list;
 static int read_loop = 1;
 static pthread_mutex_t read_lock = PTHREAD_MUTEX_INITIALIZER;
-static pthread_cond_t read_cond = PTHREAD_COND_INITIALIZER;
 static pthread_t *read_threads = NULL;
 static size_t read_threads_num = 0;
 static cdtime_t max_read_interval = DEFAULT_MAX_READ_INTERVAL;
 
-static write_queue_t *write_queue_head;
-static write_queue_t *write_queue_tail;
-static long write_queue_length = 0;
+/* With "ReadJitter", each read callback is called at a fixed offset into its
+ * interval. The offset is made up of the host's phase, "ReadPhase" or a hash
+ * of the hostname, and a hash of the callback's name. */
+static _Bool read_jitter = 0;
+static uint64_t read_phase = 0;
+
+#ifndef WRITE_QUEUE_BATCH_MAX
+#define WRITE_QUEUE_BATCH_MAX 1024
+#endif
+/* Shard zero is statically initialized so that value lists can be enqueued
+ * before plugin_init_all() has set up the configured number of shards. */
+static write_queue_shard_t write_queue_default_shard = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+    .head = NULL,
+    .tail = NULL,
+    .length = 0,
+};
+static write_queue_shards_t write_queue_default_shards = {
+    .shards = &write_queue_default_shard,
+    .num = 1,
+};
+static write_queue_shards_t *write_queue_shards = &write_queue_default_shards;
+static size_t write_queue_batch_size = 1;
+static pthread_key_t write_queue_producer_key;
+static pthread_once_t write_queue_producer_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t write_queue_producer_lock = PTHREAD_MUTEX_INITIALIZER;
+static size_t write_queue_producer_num = 0;
 static _Bool write_loop = 1;
-static pthread_mutex_t write_lock = PTHREAD_MUTEX_INITIALIZER;
-static pthread_cond_t write_cond = PTHREAD_COND_INITIALIZER;
 static pthread_t *write_threads = NULL;
 static size_t write_threads_num = 0;
 
+/* Elastic write thread pool, enabled by "WriteThreadsMax". Once a second, the
+ * scaler thread starts another write thread if the write queue is longer than
+ * "WriteThreadsTargetLength" or its oldest entry is older than
+ * "WriteThreadsTargetAge". If the queue stays below a quarter of both targets
+ * for "WriteThreadsIdleTime", the most recently started thread is stopped.
+ * Write threads whose index is not below "write_threads_limit" exit. */
+#define WRITE_SCALER_INTERVAL TIME_T_TO_CDTIME_T(1)
+static size_t write_threads_min = 0;
+static size_t write_threads_max = 0;
+static size_t write_threads_limit = SIZE_MAX;
+static long write_scale_length = 1000;
+static cdtime_t write_scale_age = 0;
+static cdtime_t write_scale_idle = 0;
+/* Updated by the scaler thread, so that enqueueing doesn't read the clock. */
+static cdtime_t write_queue_clock = 0;
+static pthread_t write_scaler;
+static _Bool write_scaler_running = 0;
+static pthread_mutex_t write_scaler_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t write_scaler_cond = PTHREAD_COND_INITIALIZER;
+
 static pthread_key_t plugin_ctx_key;
 static _Bool plugin_ctx_key_initialized = 0;
 
 static long write_limit_high = 0;
 static long write_limit_low = 0;
 
+/* Admission control while the write queue is above its low limit. Values
+ * are attributed to a source: the sending host for values received from
+ * other hosts, the plugin otherwise. Each source may enqueue up to
+ * "WriteQueueSourceRate" values per second (token bucket with a burst size of
+ * one second). Local sources are only throttled once the high limit has been
+ * reached, sources of remote values are not admitted at all then. */
+typedef struct {
+  char *name; /* "plugin-<plugin>" or "host-<host>" */
+  double tokens;
+  cdtime_t last_refill;
+  derive_t dropped;
+} write_source_t;
+
+static double write_source_rate = 100.0;
+static c_avl_tree_t *write_sources = NULL;
+static pthread_mutex_t write_sources_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Objects shared between plugins, see plugin_shared_acquire(). */
+struct plugin_shared_s {
+  char *name;
+  void *object;
+  size_t refs;
+  struct plugin_shared_s *next;
+};
+typedef struct plugin_shared_s plugin_shared_t;
+
+static plugin_shared_t *plugin_shared_list = NULL;
+static pthread_mutex_t plugin_shared_lock = PTHREAD_MUTEX_INITIALIZER;
+
 static derive_t stats_values_dropped = 0;
 static _Bool record_statistics = 0;
 
+/* Every "dispatch_sampling"th value list (zero: none) is timed while passing
+ * a stage of plugin_dispatch_values_internal(), and likewise every so many
+ * calls of a write callback. */
+static unsigned int dispatch_sampling = 0;
+static unsigned int dispatch_sample_count = 0;
+static dispatch_latency_t dispatch_stages[DISPATCH_STAGES_NUM] = {
+    {.lock = PTHREAD_MUTEX_INITIALIZER},
+    {.lock = PTHREAD_MUTEX_INITIALIZER},
+    {.lock = PTHREAD_MUTEX_INITIALIZER},
+    {.lock = PTHREAD_MUTEX_INITIALIZER},
+};
+static char const *const dispatch_stage_names[DISPATCH_STAGES_NUM] = {
+    "queue", "pre_cache", "cache", "post_cache"};
+
+static _Bool plugin_cpu_accounting = 0;
+static c_avl_tree_t *plugin_cpu_tree = NULL;
+static pthread_mutex_t plugin_cpu_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Asynchronous notifications, see "NotificationThreads". A notification is
+ * copied once and a reference to it is appended to the queue of each
+ * notification callback. Queues with entries are kept in a list of ready
+ * queues, from which the notification threads take them. A queue is served
+ * by at most one thread at a time, so each callback sees its notifications
+ * in order, while a slow callback only holds up its own queue. */
+typedef struct {
+  notification_t n;
+  size_t refs; /* protected by "notif_lock" */
+} notification_shared_t;
+
+struct notif_entry_s;
+typedef struct notif_entry_s notif_entry_t;
+struct notif_entry_s {
+  notification_shared_t *ns;
+  notif_entry_t *next;
+};
+
+struct notif_queue_s;
+typedef struct notif_queue_s notif_queue_t;
+struct notif_queue_s {
+  char *name; /* of the notification callback */
+  notif_entry_t *head;
+  notif_entry_t *tail;
+  long length;
+  long limit;
+  derive_t dropped;
+  _Bool busy;  /* being served by a thread */
+  _Bool ready; /* linked into the ready list */
+  notif_queue_t *ready_next;
+};
+
+static pthread_mutex_t notif_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t notif_cond = PTHREAD_COND_INITIALIZER;
+static c_avl_tree_t *notif_queues = NULL;
+static notif_queue_t *notif_ready_head = NULL;
+static notif_queue_t *notif_ready_tail = NULL;
+static _Bool notif_loop = 0;
+static pthread_t *notif_threads = NULL;
+static size_t notif_threads_num = 0;
+static long notif_queue_limit = 1000;
+
+/* Concurrent flushing, see "FlushThreads". Each flush callback to be called
+ * becomes a job for the flush threads; the caller waits for the jobs of its
+ * request until they are done or the deadline has passed. A callback that is
+ * still busy with an earlier flush is not called again. */
+typedef struct {
+  plugin_flush_result_t *results;
+  _Bool *done;
+  size_t results_num;
+  size_t pending;
+  size_t refs; /* the caller plus one per queued job */
+  pthread_cond_t cond;
+} flush_request_t;
+
+struct flush_job_s;
+typedef struct flush_job_s flush_job_t;
+struct flush_job_s {
+  flush_request_t *req;
+  size_t index; /* into req->results */
+  cdtime_t timeout;
+  char *identifier;
+  flush_job_t *next;
+};
+
+static pthread_mutex_t flush_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t flush_cond = PTHREAD_COND_INITIALIZER;
+static flush_job_t *flush_queue_head = NULL;
+static flush_job_t *flush_queue_tail = NULL;
+static c_avl_tree_t *flush_busy = NULL; /* names of running callbacks */
+static _Bool flush_loop = 0;
+static pthread_t *flush_threads = NULL;
+static size_t flush_threads_num = 0;
+
+/* Parallel initialization, see plugin_register_init_parallel(). The init
+ * callbacks in "list_init_parallel" are taken in order by the init threads.
+ * "init_pending" counts, by plugin name, the callbacks which have not
+ * returned yet; the read threads hold back the read callbacks of these
+ * plugins. */
+typedef struct {
+  char const *name; /* interned, see plugin_load() */
+  size_t count;
+} init_pending_t;
+
+static pthread_mutex_t init_lock = PTHREAD_MUTEX_INITIALIZER;
+static c_avl_tree_t *init_pending = NULL;
+static size_t init_pending_num = 0; /* accessed atomically, if possible */
+static llentry_t *init_next = NULL;
+static pthread_t *init_threads = NULL;
+static size_t init_threads_num = 0;
+static _Bool init_failed = 0;
+
+/* Plugin names referenced by plugin_ctx_t.name. */
+static c_intern_t *plugin_names = NULL;
+
+static _Bool plugin_init_pending(char const *name);
+static write_queue_producer_t *write_queue_producer_get(void);
+static callback_array_t *callback_array_get(callback_array_t **array);
+
+/* Asynchronous logging, see "LogQueueLength". Messages are formatted by the
+ * calling thread and put into a ring, which a dedicated thread drains into
+ * the log callbacks. If the ring is full, messages are dropped and a summary
+ * is logged once per second. */
+#define LOG_MESSAGE_SIZE 1024
+typedef struct {
+  int level;
+  char msg[LOG_MESSAGE_SIZE];
+} log_record_t;
+
+static c_ring_t *log_ring = NULL;
+static pthread_t log_thread;
+static _Bool log_loop = 0;
+static pthread_mutex_t log_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t log_cond = PTHREAD_COND_INITIALIZER;
+/* Protected by "log_lock". */
+static uint64_t log_suppressed = 0;
+static derive_t stats_log_dropped = 0;
+
 /*
  * Static functions
  */
+/* "vl" must have been returned by plugin_value_list_clone(). */
 static int plugin_dispatch_values_internal(value_list_t *vl);
+static void start_log_thread(void);
+static void stop_log_thread(void);
+static void start_notification_threads(void);
+static void stop_notification_threads(void);
+static void start_flush_threads(void);
+static void stop_flush_threads(void);
 
 static const char *plugin_get_dir(void) {
   if (plugindir == NULL)
@@ -153,748 +681,3348 @@ static const char *plugin_get_dir(void) {
     return plugindir;
 }
 
-static int plugin_update_internal_statistics(void) { /* {{{ */
-  gauge_t copy_write_queue_length = (gauge_t)write_queue_length;
+static long write_queue_length_get(void);
 
-  /* Initialize `vl' */
-  value_list_t vl = VALUE_LIST_INIT;
-  sstrncpy(vl.plugin, "collectd", sizeof(vl.plugin));
-  vl.interval = plugin_get_interval();
+static int plugin_collect_read_stats(plugin_read_stats_t **ret_stats,
+                                     size_t *ret_stats_num,
+                                     _Bool reset) /* {{{ */
+{
+  plugin_read_stats_t *stats;
+  size_t stats_num = 0;
 
-  /* Write queue */
-  sstrncpy(vl.plugin_instance, "write_queue", sizeof(vl.plugin_instance));
+  *ret_stats = NULL;
+  *ret_stats_num = 0;
 
-  /* Write queue : queue length */
-  vl.values = &(value_t){.gauge = copy_write_queue_length};
-  vl.values_len = 1;
-  sstrncpy(vl.type, "queue_length", sizeof(vl.type));
-  vl.type_instance[0] = 0;
-  plugin_dispatch_values(&vl);
+  pthread_mutex_lock(&read_lock);
 
-  /* Write queue : Values dropped (queue length > low limit) */
-  vl.values = &(value_t){.gauge = (gauge_t)stats_values_dropped};
-  vl.values_len = 1;
-  sstrncpy(vl.type, "derive", sizeof(vl.type));
-  sstrncpy(vl.type_instance, "dropped", sizeof(vl.type_instance));
-  plugin_dispatch_values(&vl);
+  if ((read_list == NULL) || (llist_size(read_list) == 0)) {
+    pthread_mutex_unlock(&read_lock);
+    return 0;
+  }
 
-  /* Cache */
-  sstrncpy(vl.plugin_instance, "cache", sizeof(vl.plugin_instance));
+  stats = calloc((size_t)llist_size(read_list), sizeof(*stats));
+  if (stats == NULL) {
+    pthread_mutex_unlock(&read_lock);
+    return ENOMEM;
+  }
 
-  /* Cache : Nb entry in cache tree */
-  vl.values = &(value_t){.gauge = (gauge_t)uc_get_size()};
-  vl.values_len = 1;
-  sstrncpy(vl.type, "cache_size", sizeof(vl.type));
-  vl.type_instance[0] = 0;
-  plugin_dispatch_values(&vl);
+  for (llentry_t *le = llist_head(read_list); le != NULL; le = le->next) {
+    read_func_t *rf = le->value;
+    plugin_read_stats_t *st = stats + stats_num;
+
+    st->name = strdup(rf->rf_name);
+    if (st->name == NULL)
+      continue;
+
+    pthread_mutex_lock(&rf->rf_stats_lock);
+    st->interval = rf->rf_interval;
+    st->effective_interval = rf->rf_effective_interval;
+    st->reads = rf->rf_reads;
+    st->overruns = rf->rf_overruns;
+    st->skipped = rf->rf_skipped;
+    st->duration_num = latency_counter_get_num(rf->rf_latency);
+    st->duration_average = latency_counter_get_average(rf->rf_latency);
+    st->duration_max = latency_counter_get_max(rf->rf_latency);
+    st->duration_p99 = latency_counter_get_percentile(rf->rf_latency, 99.0);
+    if (reset)
+      latency_counter_reset(rf->rf_latency);
+    pthread_mutex_unlock(&rf->rf_stats_lock);
+
+    stats_num++;
+  }
+
+  pthread_mutex_unlock(&read_lock);
 
+  *ret_stats = stats;
+  *ret_stats_num = stats_num;
   return 0;
-} /* }}} int plugin_update_internal_statistics */
+} /* }}} int plugin_collect_read_stats */
 
-static void free_userdata(user_data_t const *ud) /* {{{ */
-{
-  if (ud == NULL)
+int plugin_get_read_stats(plugin_read_stats_t **ret_stats, /* {{{ */
+                          size_t *ret_stats_num) {
+  if ((ret_stats == NULL) || (ret_stats_num == NULL))
+    return EINVAL;
+
+  return plugin_collect_read_stats(ret_stats, ret_stats_num,
+                                   /* reset = */ 0);
+} /* }}} int plugin_get_read_stats */
+
+void plugin_read_stats_free(plugin_read_stats_t *stats, /* {{{ */
+                            size_t stats_num) {
+  if (stats == NULL)
     return;
 
-  if ((ud->data != NULL) && (ud->free_func != NULL)) {
-    ud->free_func(ud->data);
+  for (size_t i = 0; i < stats_num; i++)
+    sfree(stats[i].name);
+  sfree(stats);
+} /* }}} void plugin_read_stats_free */
+
+/* Returns true if the next value list or write callback call is to be
+ * timed. */
+static _Bool dispatch_latency_sample(void) /* {{{ */
+{
+  if (dispatch_sampling == 0)
+    return 0;
+
+#if defined(__ATOMIC_RELAXED)
+  unsigned int n =
+      __atomic_fetch_add(&dispatch_sample_count, 1, __ATOMIC_RELAXED);
+#else
+  /* Lost updates merely make the sampling less regular. */
+  unsigned int n = dispatch_sample_count++;
+#endif
+  return (n % dispatch_sampling) == 0;
+} /* }}} _Bool dispatch_latency_sample */
+
+/* Adds the time since "begin", as returned by cdtime_precise(), to "dl". */
+static void dispatch_latency_add(dispatch_latency_t *dl, /* {{{ */
+                                 cdtime_t begin) {
+  cdtime_t end = cdtime_precise();
+
+  pthread_mutex_lock(&dl->lock);
+  if (dl->latency != NULL)
+    latency_counter_add(dl->latency, (end > begin) ? (end - begin) : 0);
+  pthread_mutex_unlock(&dl->lock);
+} /* }}} void dispatch_latency_add */
+
+/* Copies the summary of "dl" to "st" and resets "dl" if requested. */
+static void dispatch_latency_get(dispatch_latency_t *dl, /* {{{ */
+                                 plugin_dispatch_stats_t *st, _Bool reset) {
+  pthread_mutex_lock(&dl->lock);
+  if (dl->latency != NULL) {
+    st->num = latency_counter_get_num(dl->latency);
+    st->average = latency_counter_get_average(dl->latency);
+    st->max = latency_counter_get_max(dl->latency);
+    st->p99 = latency_counter_get_percentile(dl->latency, 99.0);
+    if (reset)
+      latency_counter_reset(dl->latency);
   }
-} /* }}} void free_userdata */
+  pthread_mutex_unlock(&dl->lock);
+} /* }}} void dispatch_latency_get */
 
-static void destroy_callback(callback_func_t *cf) /* {{{ */
+static int plugin_collect_dispatch_stats(plugin_dispatch_stats_t **ret_stats,
+                                         size_t *ret_stats_num,
+                                         _Bool reset) /* {{{ */
 {
-  if (cf == NULL)
+  *ret_stats = NULL;
+  *ret_stats_num = 0;
+
+  if (dispatch_sampling == 0)
+    return ENOTSUP;
+
+  callback_array_t *array = callback_array_get(&array_write);
+  size_t num = DISPATCH_STAGES_NUM + ((array != NULL) ? array->num : 0);
+
+  plugin_dispatch_stats_t *stats = calloc(num, sizeof(*stats));
+  if (stats == NULL)
+    return ENOMEM;
+
+  size_t stats_num = 0;
+  for (size_t i = 0; i < DISPATCH_STAGES_NUM; i++) {
+    plugin_dispatch_stats_t *st = stats + stats_num;
+
+    st->name = strdup(dispatch_stage_names[i]);
+    if (st->name == NULL)
+      continue;
+    dispatch_latency_get(dispatch_stages + i, st, reset);
+    stats_num++;
+  }
+
+  for (size_t i = 0; (array != NULL) && (i < array->num); i++) {
+    write_func_t *wf = array->entries[i].value;
+    plugin_dispatch_stats_t *st = stats + stats_num;
+    char name[DATA_MAX_NAME_LEN];
+
+    snprintf(name, sizeof(name), "write-%s", array->entries[i].name);
+    st->name = strdup(name);
+    if (st->name == NULL)
+      continue;
+    dispatch_latency_get(&wf->wf_latency, st, reset);
+    stats_num++;
+  }
+
+  *ret_stats = stats;
+  *ret_stats_num = stats_num;
+  return 0;
+} /* }}} int plugin_collect_dispatch_stats */
+
+int plugin_get_dispatch_stats(plugin_dispatch_stats_t **ret_stats, /* {{{ */
+                              size_t *ret_stats_num) {
+  if ((ret_stats == NULL) || (ret_stats_num == NULL))
+    return EINVAL;
+
+  return plugin_collect_dispatch_stats(ret_stats, ret_stats_num,
+                                       /* reset = */ 0);
+} /* }}} int plugin_get_dispatch_stats */
+
+void plugin_dispatch_stats_free(plugin_dispatch_stats_t *stats, /* {{{ */
+                                size_t stats_num) {
+  if (stats == NULL)
     return;
-  free_userdata(&cf->cf_udata);
-  sfree(cf);
-} /* }}} void destroy_callback */
 
-static void destroy_all_callbacks(llist_t **list) /* {{{ */
+  for (size_t i = 0; i < stats_num; i++)
+    sfree(stats[i].name);
+  sfree(stats);
+} /* }}} void plugin_dispatch_stats_free */
+
+static void plugin_dispatch_dispatch_stats(value_list_t *vl) /* {{{ */
 {
-  llentry_t *le;
+  plugin_dispatch_stats_t *stats = NULL;
+  size_t stats_num = 0;
 
-  if (*list == NULL)
+  if (plugin_collect_dispatch_stats(&stats, &stats_num, /* reset = */ 1) != 0)
     return;
 
-  le = llist_head(*list);
-  while (le != NULL) {
-    llentry_t *le_next;
+  for (size_t i = 0; i < stats_num; i++) {
+    plugin_dispatch_stats_t *st = stats + i;
 
-    le_next = le->next;
+    if (st->num == 0)
+      continue;
 
-    sfree(le->key);
-    destroy_callback(le->value);
-    le->value = NULL;
+    snprintf(vl->plugin_instance, sizeof(vl->plugin_instance), "dispatch-%s",
+             st->name);
+    sstrncpy(vl->type, "duration", sizeof(vl->type));
 
-    le = le_next;
+    vl->values = &(value_t){.gauge = CDTIME_T_TO_DOUBLE(st->average)};
+    vl->values_len = 1;
+    sstrncpy(vl->type_instance, "average", sizeof(vl->type_instance));
+    plugin_dispatch_values(vl);
+
+    vl->values = &(value_t){.gauge = CDTIME_T_TO_DOUBLE(st->max)};
+    vl->values_len = 1;
+    sstrncpy(vl->type_instance, "max", sizeof(vl->type_instance));
+    plugin_dispatch_values(vl);
+
+    vl->values = &(value_t){.gauge = CDTIME_T_TO_DOUBLE(st->p99)};
+    vl->values_len = 1;
+    sstrncpy(vl->type_instance, "percentile-99", sizeof(vl->type_instance));
+    plugin_dispatch_values(vl);
   }
 
-  llist_destroy(*list);
-  *list = NULL;
-} /* }}} void destroy_all_callbacks */
+  plugin_dispatch_stats_free(stats, stats_num);
+} /* }}} void plugin_dispatch_dispatch_stats */
 
-static void destroy_read_heap(void) /* {{{ */
+static void plugin_dispatch_read_stats(value_list_t *vl) /* {{{ */
 {
-  if (read_heap == NULL)
+  plugin_read_stats_t *stats = NULL;
+  size_t stats_num = 0;
+
+  if (plugin_collect_read_stats(&stats, &stats_num, /* reset = */ 1) != 0)
     return;
 
-  while (42) {
-    read_func_t *rf;
+  for (size_t i = 0; i < stats_num; i++) {
+    plugin_read_stats_t *st = stats + i;
 
-    rf = c_heap_get_root(read_heap);
-    if (rf == NULL)
-      break;
-    sfree(rf->rf_name);
-    destroy_callback((callback_func_t *)rf);
-  }
+    snprintf(vl->plugin_instance, sizeof(vl->plugin_instance), "read-%s",
+             st->name);
 
-  c_heap_destroy(read_heap);
-  read_heap = NULL;
-} /* }}} void destroy_read_heap */
+    /* Read callbacks : duration of the reads */
+    if (st->duration_num > 0) {
+      sstrncpy(vl->type, "duration", sizeof(vl->type));
 
-static int register_callback(llist_t **list, /* {{{ */
-                             const char *name, callback_func_t *cf) {
-  llentry_t *le;
-  char *key;
+      vl->values = &(value_t){.gauge = CDTIME_T_TO_DOUBLE(st->duration_average)};
+      vl->values_len = 1;
+      sstrncpy(vl->type_instance, "average", sizeof(vl->type_instance));
+      plugin_dispatch_values(vl);
 
-  if (*list == NULL) {
-    *list = llist_create();
-    if (*list == NULL) {
-      ERROR("plugin: register_callback: "
-            "llist_create failed.");
-      destroy_callback(cf);
-      return -1;
+      vl->values = &(value_t){.gauge = CDTIME_T_TO_DOUBLE(st->duration_max)};
+      vl->values_len = 1;
+      sstrncpy(vl->type_instance, "max", sizeof(vl->type_instance));
+      plugin_dispatch_values(vl);
+
+      vl->values = &(value_t){.gauge = CDTIME_T_TO_DOUBLE(st->duration_p99)};
+      vl->values_len = 1;
+      sstrncpy(vl->type_instance, "percentile-99", sizeof(vl->type_instance));
+      plugin_dispatch_values(vl);
     }
+
+    /* Read callbacks : reads, overruns and skipped reads */
+    sstrncpy(vl->type, "derive", sizeof(vl->type));
+
+    vl->values = &(value_t){.derive = (derive_t)st->reads};
+    vl->values_len = 1;
+    sstrncpy(vl->type_instance, "reads", sizeof(vl->type_instance));
+    plugin_dispatch_values(vl);
+
+    vl->values = &(value_t){.derive = (derive_t)st->overruns};
+    vl->values_len = 1;
+    sstrncpy(vl->type_instance, "overruns", sizeof(vl->type_instance));
+    plugin_dispatch_values(vl);
+
+    vl->values = &(value_t){.derive = (derive_t)st->skipped};
+    vl->values_len = 1;
+    sstrncpy(vl->type_instance, "skipped", sizeof(vl->type_instance));
+    plugin_dispatch_values(vl);
   }
 
-  key = strdup(name);
-  if (key == NULL) {
-    ERROR("plugin: register_callback: strdup failed.");
-    destroy_callback(cf);
-    return -1;
+  plugin_read_stats_free(stats, stats_num);
+} /* }}} void plugin_dispatch_read_stats */
+
+/* Returns the accounting entry of the plugin the callback "name" belongs to,
+ * creating it if necessary. */
+static plugin_cpu_t *plugin_cpu_get(const char *name) /* {{{ */
+{
+  char plugin[DATA_MAX_NAME_LEN];
+  plugin_cpu_t *pc = NULL;
+
+  if (name == NULL)
+    return NULL;
+
+  sstrncpy(plugin, name, sizeof(plugin));
+  char *slash = strchr(plugin, '/');
+  if (slash != NULL)
+    *slash = 0;
+
+  pthread_mutex_lock(&plugin_cpu_lock);
+
+  if (plugin_cpu_tree == NULL)
+    plugin_cpu_tree =
+        c_avl_create((int (*)(const void *, const void *))strcmp);
+  if (plugin_cpu_tree == NULL) {
+    pthread_mutex_unlock(&plugin_cpu_lock);
+    return NULL;
   }
 
-  le = llist_search(*list, name);
-  if (le == NULL) {
-    le = llentry_create(key, cf);
-    if (le == NULL) {
-      ERROR("plugin: register_callback: "
-            "llentry_create failed.");
-      sfree(key);
-      destroy_callback(cf);
-      return -1;
-    }
+  if (c_avl_get(plugin_cpu_tree, plugin, (void *)&pc) == 0) {
+    pthread_mutex_unlock(&plugin_cpu_lock);
+    return pc;
+  }
 
-    llist_append(*list, le);
-  } else {
-    callback_func_t *old_cf;
+  pc = calloc(1, sizeof(*pc));
+  if (pc != NULL) {
+    pc->name = strdup(plugin);
+    if ((pc->name == NULL) || (c_avl_insert(plugin_cpu_tree, pc->name, pc) != 0)) {
+      sfree(pc->name);
+      sfree(pc);
+    }
+  }
 
-    old_cf = le->value;
-    le->value = cf;
+  pthread_mutex_unlock(&plugin_cpu_lock);
+  return pc;
+} /* }}} plugin_cpu_t *plugin_cpu_get */
 
-    WARNING("plugin: register_callback: "
-            "a callback named `%s' already exists - "
-            "overwriting the old entry!",
-            name);
+static void plugin_cpu_destroy(void) /* {{{ */
+{
+  char *name;
+  plugin_cpu_t *pc;
 
-    destroy_callback(old_cf);
-    sfree(key);
+  pthread_mutex_lock(&plugin_cpu_lock);
+  if (plugin_cpu_tree != NULL) {
+    while (c_avl_pick(plugin_cpu_tree, (void *)&name, (void *)&pc) == 0) {
+      sfree(pc->name);
+      sfree(pc);
+    }
+    c_avl_destroy(plugin_cpu_tree);
+    plugin_cpu_tree = NULL;
   }
+  pthread_mutex_unlock(&plugin_cpu_lock);
+} /* }}} void plugin_cpu_destroy */
 
+/* Returns the CPU time used by the calling thread, or zero if CPU time
+ * accounting is disabled. */
+static cdtime_t plugin_cpu_begin(void) /* {{{ */
+{
+#if defined(CLOCK_THREAD_CPUTIME_ID)
+  struct timespec ts;
+
+  if (!plugin_cpu_accounting)
+    return 0;
+  if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0)
+    return 0;
+  /* Zero means "not measured". */
+  return TIMESPEC_TO_CDTIME_T(&ts) + 1;
+#else
   return 0;
-} /* }}} int register_callback */
+#endif
+} /* }}} cdtime_t plugin_cpu_begin */
 
-static void log_list_callbacks(llist_t **list, /* {{{ */
-                               const char *comment) {
-  char *str;
-  int len;
-  int i;
-  llentry_t *le;
-  int n;
-  char **keys;
+/* Adds the CPU time used since "begin" to the "kind" counters of "cf". */
+static void plugin_cpu_end(callback_func_t const *cf, int kind, /* {{{ */
+                           cdtime_t begin) {
+  cdtime_t end;
 
-  n = llist_size(*list);
-  if (n == 0) {
-    INFO("%s [none]", comment);
+  if ((begin == 0) || (cf->cf_cpu == NULL))
     return;
-  }
 
-  keys = calloc(n, sizeof(char *));
+  end = plugin_cpu_begin();
+  if (end < begin)
+    return;
 
-  if (keys == NULL) {
-    ERROR("%s: failed to allocate memory for list of callbacks", comment);
+#if defined(__ATOMIC_RELAXED)
+  __atomic_add_fetch(&cf->cf_cpu->time[kind], end - begin, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&cf->cf_cpu->calls[kind], 1, __ATOMIC_RELAXED);
+#else
+  pthread_mutex_lock(&plugin_cpu_lock);
+  cf->cf_cpu->time[kind] += end - begin;
+  cf->cf_cpu->calls[kind]++;
+  pthread_mutex_unlock(&plugin_cpu_lock);
+#endif
+} /* }}} void plugin_cpu_end */
 
-    return;
+int plugin_get_cpu_stats(plugin_cpu_stats_t **ret_stats, /* {{{ */
+                         size_t *ret_stats_num) {
+  plugin_cpu_stats_t *stats;
+  size_t stats_num = 0;
+
+  if ((ret_stats == NULL) || (ret_stats_num == NULL))
+    return EINVAL;
+  if (!plugin_cpu_accounting)
+    return ENOTSUP;
+
+  *ret_stats = NULL;
+  *ret_stats_num = 0;
+
+  pthread_mutex_lock(&plugin_cpu_lock);
+  if ((plugin_cpu_tree == NULL) || (c_avl_size(plugin_cpu_tree) == 0)) {
+    pthread_mutex_unlock(&plugin_cpu_lock);
+    return 0;
   }
 
-  for (le = llist_head(*list), i = 0, len = 0; le != NULL; le = le->next, i++) {
-    keys[i] = le->key;
-    len += strlen(le->key) + 6;
-  }
-  str = malloc(len + 10);
-  if (str == NULL) {
-    ERROR("%s: failed to allocate memory for list of callbacks", comment);
-  } else {
-    *str = '\0';
-    strjoin(str, len, keys, n, "', '");
-    INFO("%s ['%s']", comment, str);
-    sfree(str);
+  stats = calloc((size_t)c_avl_size(plugin_cpu_tree), sizeof(*stats));
+  if (stats == NULL) {
+    pthread_mutex_unlock(&plugin_cpu_lock);
+    return ENOMEM;
   }
-  sfree(keys);
-} /* }}} void log_list_callbacks */
 
-static int create_register_callback(llist_t **list, /* {{{ */
-                                    const char *name, void *callback,
-                                    user_data_t const *ud) {
-  callback_func_t *cf;
+  c_avl_iterator_t *iter = c_avl_get_iterator(plugin_cpu_tree);
+  char *name;
+  plugin_cpu_t *pc;
+  while (c_avl_iterator_next(iter, (void *)&name, (void *)&pc) == 0) {
+    plugin_cpu_stats_t *st = stats + stats_num;
+    cdtime_t time[PLUGIN_CPU_KINDS];
+    uint64_t calls[PLUGIN_CPU_KINDS];
+
+    st->name = strdup(pc->name);
+    if (st->name == NULL)
+      continue;
 
-  cf = calloc(1, sizeof(*cf));
-  if (cf == NULL) {
-    free_userdata(ud);
-    ERROR("plugin: create_register_callback: calloc failed.");
-    return -1;
-  }
+    for (size_t i = 0; i < PLUGIN_CPU_KINDS; i++) {
+#if defined(__ATOMIC_RELAXED)
+      time[i] = __atomic_load_n(&pc->time[i], __ATOMIC_RELAXED);
+      calls[i] = __atomic_load_n(&pc->calls[i], __ATOMIC_RELAXED);
+#else
+      time[i] = pc->time[i];
+      calls[i] = pc->calls[i];
+#endif
+    }
 
-  cf->cf_callback = callback;
-  if (ud == NULL) {
-    cf->cf_udata.data = NULL;
-    cf->cf_udata.free_func = NULL;
-  } else {
-    cf->cf_udata = *ud;
+    st->read_time = time[PLUGIN_CPU_READ];
+    st->reads = calls[PLUGIN_CPU_READ];
+    st->write_time = time[PLUGIN_CPU_WRITE];
+    st->writes = calls[PLUGIN_CPU_WRITE];
+    st->flush_time = time[PLUGIN_CPU_FLUSH];
+    st->flushes = calls[PLUGIN_CPU_FLUSH];
+    st->notification_time = time[PLUGIN_CPU_NOTIFICATION];
+    st->notifications = calls[PLUGIN_CPU_NOTIFICATION];
+
+    stats_num++;
   }
+  c_avl_iterator_destroy(iter);
 
-  cf->cf_ctx = plugin_get_ctx();
+  pthread_mutex_unlock(&plugin_cpu_lock);
 
-  return register_callback(list, name, cf);
-} /* }}} int create_register_callback */
+  *ret_stats = stats;
+  *ret_stats_num = stats_num;
+  return 0;
+} /* }}} int plugin_get_cpu_stats */
 
-static int plugin_unregister(llist_t *list, const char *name) /* {{{ */
+void plugin_cpu_stats_free(plugin_cpu_stats_t *stats, /* {{{ */
+                           size_t stats_num) {
+  if (stats == NULL)
+    return;
+
+  for (size_t i = 0; i < stats_num; i++)
+    sfree(stats[i].name);
+  sfree(stats);
+} /* }}} void plugin_cpu_stats_free */
+
+static void plugin_dispatch_cpu_stats(value_list_t *vl) /* {{{ */
 {
-  llentry_t *e;
+  plugin_cpu_stats_t *stats = NULL;
+  size_t stats_num = 0;
 
-  if (list == NULL)
-    return -1;
+  if (plugin_get_cpu_stats(&stats, &stats_num) != 0)
+    return;
 
-  e = llist_search(list, name);
-  if (e == NULL)
-    return -1;
+  for (size_t i = 0; i < stats_num; i++) {
+    plugin_cpu_stats_t *st = stats + i;
+    struct {
+      const char *kind;
+      cdtime_t time;
+      uint64_t calls;
+    } counters[] = {
+        {"read", st->read_time, st->reads},
+        {"write", st->write_time, st->writes},
+        {"flush", st->flush_time, st->flushes},
+        {"notification", st->notification_time, st->notifications},
+    };
+
+    snprintf(vl->plugin_instance, sizeof(vl->plugin_instance), "plugin-%s",
+             st->name);
+
+    for (size_t j = 0; j < STATIC_ARRAY_SIZE(counters); j++) {
+      if (counters[j].calls == 0)
+        continue;
+
+      vl->values = &(value_t){.derive = (derive_t)CDTIME_T_TO_MS(
+                                  counters[j].time)};
+      vl->values_len = 1;
+      sstrncpy(vl->type, "total_time_in_ms", sizeof(vl->type));
+      sstrncpy(vl->type_instance, counters[j].kind, sizeof(vl->type_instance));
+      plugin_dispatch_values(vl);
+
+      vl->values = &(value_t){.derive = (derive_t)counters[j].calls};
+      vl->values_len = 1;
+      sstrncpy(vl->type, "derive", sizeof(vl->type));
+      snprintf(vl->type_instance, sizeof(vl->type_instance), "calls-%s",
+               counters[j].kind);
+      plugin_dispatch_values(vl);
+    }
+  }
 
-  llist_remove(list, e);
+  plugin_cpu_stats_free(stats, stats_num);
+} /* }}} void plugin_dispatch_cpu_stats */
 
-  sfree(e->key);
-  destroy_callback(e->value);
+static int plugin_update_internal_statistics(void) { /* {{{ */
+  gauge_t copy_write_queue_length = (gauge_t)write_queue_length_get();
 
-  llentry_destroy(e);
+  /* Initialize `vl' */
+  value_list_t vl = VALUE_LIST_INIT;
+  sstrncpy(vl.plugin, "collectd", sizeof(vl.plugin));
+  vl.interval = plugin_get_interval();
 
-  return 0;
-} /* }}} int plugin_unregister */
+  /* Write queue */
+  sstrncpy(vl.plugin_instance, "write_queue", sizeof(vl.plugin_instance));
 
-/* plugin_load_file loads the shared object "file" and calls its
- * "module_register" function. Returns zero on success, non-zero otherwise. */
-static int plugin_load_file(char const *file, _Bool global) {
-  int flags = RTLD_NOW;
-  if (global)
-    flags |= RTLD_GLOBAL;
+  /* Write queue : queue length */
+  vl.values = &(value_t){.gauge = copy_write_queue_length};
+  vl.values_len = 1;
+  sstrncpy(vl.type, "queue_length", sizeof(vl.type));
+  vl.type_instance[0] = 0;
+  plugin_dispatch_values(&vl);
 
-  void *dlh = dlopen(file, flags);
-  if (dlh == NULL) {
-    char errbuf[1024] = "";
+  /* Write queue : Values dropped (queue length > low limit) */
+  vl.values = &(value_t){.gauge = (gauge_t)stats_values_dropped};
+  vl.values_len = 1;
+  sstrncpy(vl.type, "derive", sizeof(vl.type));
+  sstrncpy(vl.type_instance, "dropped", sizeof(vl.type_instance));
+  plugin_dispatch_values(&vl);
 
-    snprintf(errbuf, sizeof(errbuf),
-             "dlopen(\"%s\") failed: %s. "
-             "The most common cause for this problem is missing dependencies. "
-             "Use ldd(1) to check the dependencies of the plugin / shared "
-             "object.",
-             file, dlerror());
+  /* Write queue : Number of write threads */
+  pthread_mutex_lock(&write_scaler_lock);
+  vl.values = &(value_t){.gauge = (gauge_t)write_threads_num};
+  pthread_mutex_unlock(&write_scaler_lock);
+  vl.values_len = 1;
+  sstrncpy(vl.type, "threads", sizeof(vl.type));
+  vl.type_instance[0] = 0;
+  plugin_dispatch_values(&vl);
 
-    /* This error is printed to STDERR unconditionally. If list_log is NULL,
-     * plugin_log() will also print to STDERR. We avoid duplicate output by
-     * checking that the list of log handlers, list_log, is not NULL. */
-    fprintf(stderr, "ERROR: %s\n", errbuf);
-    if (list_log != NULL) {
-      ERROR("%s", errbuf);
+  /* Write queue : Values dropped per source */
+  write_source_t *sources = NULL;
+  size_t sources_num = 0;
+
+  pthread_mutex_lock(&write_sources_lock);
+  if (write_sources != NULL)
+    sources = calloc((size_t)c_avl_size(write_sources) + 1, sizeof(*sources));
+  if (sources != NULL) {
+    c_avl_iterator_t *iter = c_avl_get_iterator(write_sources);
+    char *key;
+    write_source_t *src;
+
+    while ((iter != NULL) &&
+           (c_avl_iterator_next(iter, (void *)&key, (void *)&src) == 0)) {
+      if (src->dropped == 0)
+        continue;
+      sources[sources_num] = *src;
+      sources[sources_num].name = strdup(src->name);
+      if (sources[sources_num].name != NULL)
+        sources_num++;
     }
+    c_avl_iterator_destroy(iter);
+  }
+  pthread_mutex_unlock(&write_sources_lock);
+
+  /* Dispatch outside of the lock: check_drop_value() may need it. */
+  for (size_t i = 0; i < sources_num; i++) {
+    vl.values = &(value_t){.derive = sources[i].dropped};
+    vl.values_len = 1;
+    sstrncpy(vl.type, "derive", sizeof(vl.type));
+    snprintf(vl.type_instance, sizeof(vl.type_instance), "dropped-%s",
+             sources[i].name);
+    sstrncpy(vl.plugin_instance, "write_queue-source",
+             sizeof(vl.plugin_instance));
+    plugin_dispatch_values(&vl);
+    sfree(sources[i].name);
+  }
+  sfree(sources);
+  sstrncpy(vl.plugin_instance, "write_queue", sizeof(vl.plugin_instance));
 
-    return ENOENT;
+  /* Write queue : dedicated queues of write callbacks */
+  callback_array_t *array = callback_array_get(&array_write);
+  for (size_t i = 0; (array != NULL) && (i < array->num); i++) {
+    char const *name = array->entries[i].name;
+    write_func_t *wf = array->entries[i].value;
+    long length;
+    derive_t dropped;
+
+    if (wf->wf_ctx.write_changes_only) {
+#if defined(__ATOMIC_RELAXED)
+      uint64_t suppressed =
+          __atomic_load_n(&wf->wf_suppressed, __ATOMIC_RELAXED);
+#else
+      pthread_mutex_lock(&wf->wf_lock);
+      uint64_t suppressed = wf->wf_suppressed;
+      pthread_mutex_unlock(&wf->wf_lock);
+#endif
+      vl.values = &(value_t){.derive = (derive_t)suppressed};
+      vl.values_len = 1;
+      sstrncpy(vl.type, "derive", sizeof(vl.type));
+      snprintf(vl.type_instance, sizeof(vl.type_instance), "suppressed-%s",
+               name);
+      plugin_dispatch_values(&vl);
+    }
+
+    if (wf->wf_threads == NULL)
+      continue;
+
+    pthread_mutex_lock(&wf->wf_lock);
+    length = wf->wf_queue_length;
+    dropped = wf->wf_dropped;
+    derive_t spilled = wf->wf_spilled;
+    pthread_mutex_unlock(&wf->wf_lock);
+
+    vl.values = &(value_t){.gauge = (gauge_t)length};
+    vl.values_len = 1;
+    sstrncpy(vl.type, "queue_length", sizeof(vl.type));
+    sstrncpy(vl.type_instance, name, sizeof(vl.type_instance));
+    plugin_dispatch_values(&vl);
+
+    vl.values = &(value_t){.derive = dropped};
+    vl.values_len = 1;
+    sstrncpy(vl.type, "derive", sizeof(vl.type));
+    snprintf(vl.type_instance, sizeof(vl.type_instance), "dropped-%s",
+             name);
+    plugin_dispatch_values(&vl);
+
+    if (wf->wf_spill != NULL) {
+      vl.values = &(value_t){.derive = spilled};
+      snprintf(vl.type_instance, sizeof(vl.type_instance), "spilled-%s",
+               name);
+      plugin_dispatch_values(&vl);
+    }
   }
 
-  void (*reg_handle)(void) = dlsym(dlh, "module_register");
-  if (reg_handle == NULL) {
-    ERROR("Couldn't find symbol \"module_register\" in \"%s\": %s\n", file,
-          dlerror());
-    dlclose(dlh);
-    return ENOENT;
+  /* Notification queues */
+  if (notif_threads_num > 0) {
+    sstrncpy(vl.plugin_instance, "notification_queue",
+             sizeof(vl.plugin_instance));
+
+    /* Copy the numbers first: dispatching may raise notifications. */
+    pthread_mutex_lock(&notif_lock);
+    size_t queues_num = (size_t)c_avl_size(notif_queues);
+    notif_queue_t *queues = calloc(queues_num + 1, sizeof(*queues));
+    size_t n = 0;
+    if (queues != NULL) {
+      c_avl_iterator_t *iter = c_avl_get_iterator(notif_queues);
+      char *key;
+      notif_queue_t *q;
+      while ((iter != NULL) && (n < queues_num) &&
+             (c_avl_iterator_next(iter, (void *)&key, (void *)&q) == 0)) {
+        queues[n] = *q;
+        queues[n].name = strdup(q->name);
+        if (queues[n].name != NULL)
+          n++;
+      }
+      c_avl_iterator_destroy(iter);
+    }
+    pthread_mutex_unlock(&notif_lock);
+
+    for (size_t i = 0; i < n; i++) {
+      vl.values = &(value_t){.gauge = (gauge_t)queues[i].length};
+      vl.values_len = 1;
+      sstrncpy(vl.type, "queue_length", sizeof(vl.type));
+      sstrncpy(vl.type_instance, queues[i].name, sizeof(vl.type_instance));
+      plugin_dispatch_values(&vl);
+
+      vl.values = &(value_t){.derive = queues[i].dropped};
+      vl.values_len = 1;
+      sstrncpy(vl.type, "derive", sizeof(vl.type));
+      snprintf(vl.type_instance, sizeof(vl.type_instance), "dropped-%s",
+               queues[i].name);
+      plugin_dispatch_values(&vl);
+
+      sfree(queues[i].name);
+    }
+    sfree(queues);
   }
 
-  (*reg_handle)();
+  /* Log : Messages dropped because the log queue was full */
+  if (log_ring != NULL) {
+    pthread_mutex_lock(&log_lock);
+    derive_t log_dropped = stats_log_dropped;
+    pthread_mutex_unlock(&log_lock);
+
+    sstrncpy(vl.plugin_instance, "log", sizeof(vl.plugin_instance));
+    vl.values = &(value_t){.derive = log_dropped};
+    vl.values_len = 1;
+    sstrncpy(vl.type, "derive", sizeof(vl.type));
+    sstrncpy(vl.type_instance, "dropped", sizeof(vl.type_instance));
+    plugin_dispatch_values(&vl);
+  }
+
+  /* Cache */
+  sstrncpy(vl.plugin_instance, "cache", sizeof(vl.plugin_instance));
+
+  /* Cache : Nb entry in cache tree */
+  vl.values = &(value_t){.gauge = (gauge_t)uc_get_size()};
+  vl.values_len = 1;
+  sstrncpy(vl.type, "cache_size", sizeof(vl.type));
+  vl.type_instance[0] = 0;
+  plugin_dispatch_values(&vl);
+
+  /* Cache : Memory used and series evicted or rejected because of the
+   * limits */
+  uc_stats_t cache_stats;
+  uc_get_stats(&cache_stats);
+
+  vl.values = &(value_t){.gauge = (gauge_t)cache_stats.memory};
+  vl.values_len = 1;
+  sstrncpy(vl.type, "memory", sizeof(vl.type));
+  sstrncpy(vl.type_instance, "used", sizeof(vl.type_instance));
+  plugin_dispatch_values(&vl);
+
+  vl.values = &(value_t){.derive = (derive_t)cache_stats.evicted};
+  vl.values_len = 1;
+  sstrncpy(vl.type, "cache_eviction", sizeof(vl.type));
+  vl.type_instance[0] = 0;
+  plugin_dispatch_values(&vl);
+
+  struct {
+    const char *name;
+    uint64_t value;
+  } rejected[] = {
+      {"rejected-memory", cache_stats.rejected_memory},
+      {"rejected-plugin", cache_stats.rejected_plugin},
+      {"rejected-host", cache_stats.rejected_host},
+  };
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(rejected); i++) {
+    vl.values = &(value_t){.derive = (derive_t)rejected[i].value};
+    vl.values_len = 1;
+    sstrncpy(vl.type, "derive", sizeof(vl.type));
+    sstrncpy(vl.type_instance, rejected[i].name, sizeof(vl.type_instance));
+    plugin_dispatch_values(&vl);
+  }
+
+  /* Read callbacks */
+  plugin_dispatch_read_stats(&vl);
+
+  /* CPU time per plugin */
+  plugin_dispatch_cpu_stats(&vl);
+
+  /* Latency of the dispatch stages and write callbacks */
+  plugin_dispatch_dispatch_stats(&vl);
+
   return 0;
-}
+} /* }}} int plugin_update_internal_statistics */
 
-static void *plugin_read_thread(void __attribute__((unused)) * args) {
-  while (read_loop != 0) {
-    read_func_t *rf;
-    plugin_ctx_t old_ctx;
-    cdtime_t start;
-    cdtime_t now;
-    cdtime_t elapsed;
-    int status;
-    int rf_type;
-    int rc;
+/* Returns the entry of the plugin "name" in "plugins_loaded". If there is none
+ * and "create" is true, a new entry is added. */
+static loaded_plugin_t *plugin_loaded_get(char const *name, /* {{{ */
+                                          _Bool create) {
+  loaded_plugin_t *lp = NULL;
 
-    /* Get the read function that needs to be read next.
-     * We don't need to hold "read_lock" for the heap, but we need
-     * to call c_heap_get_root() and pthread_cond_wait() in the
-     * same protected block. */
-    pthread_mutex_lock(&read_lock);
-    rf = c_heap_get_root(read_heap);
-    if (rf == NULL) {
-      pthread_cond_wait(&read_cond, &read_lock);
-      pthread_mutex_unlock(&read_lock);
-      continue;
+  if (name == NULL)
+    return NULL;
+
+  pthread_mutex_lock(&plugins_loaded_lock);
+  if (plugins_loaded == NULL)
+    plugins_loaded =
+        c_avl_create((int (*)(const void *, const void *))strcasecmp);
+  if ((plugins_loaded != NULL) &&
+      (c_avl_get(plugins_loaded, name, (void *)&lp) != 0) && create) {
+    lp = calloc(1, sizeof(*lp));
+    if (lp != NULL) {
+      lp->name = strdup(name);
+      if ((lp->name == NULL) ||
+          (c_avl_insert(plugins_loaded, lp->name, lp) != 0)) {
+        sfree(lp->name);
+        sfree(lp);
+      }
     }
-    pthread_mutex_unlock(&read_lock);
+  }
+  pthread_mutex_unlock(&plugins_loaded_lock);
 
-    if (rf->rf_interval == 0) {
-      /* this should not happen, because the interval is set
-       * for each plugin when loading it
-       * XXX: issue a warning? */
-      rf->rf_interval = plugin_get_interval();
-      rf->rf_effective_interval = rf->rf_interval;
+  return lp;
+} /* }}} loaded_plugin_t *plugin_loaded_get */
 
-      rf->rf_next_read = cdtime();
-    }
+static void plugin_loaded_set(_Bool *flag, _Bool value) /* {{{ */
+{
+#if defined(__ATOMIC_SEQ_CST)
+  __atomic_store_n(flag, value, __ATOMIC_SEQ_CST);
+#else
+  pthread_mutex_lock(&plugins_loaded_lock);
+  *flag = value;
+  pthread_mutex_unlock(&plugins_loaded_lock);
+#endif
+} /* }}} void plugin_loaded_set */
 
-    /* sleep until this entry is due,
-     * using pthread_cond_timedwait */
-    pthread_mutex_lock(&read_lock);
-    /* In pthread_cond_timedwait, spurious wakeups are possible
-     * (and really happen, at least on NetBSD with > 1 CPU), thus
-     * we need to re-evaluate the condition every time
-     * pthread_cond_timedwait returns. */
-    rc = 0;
-    while ((read_loop != 0) && (cdtime() < rf->rf_next_read) && rc == 0) {
-      rc = pthread_cond_timedwait(&read_cond, &read_lock,
-                                  &CDTIME_T_TO_TIMESPEC(rf->rf_next_read));
-    }
+static _Bool plugin_loaded_is(_Bool *flag) /* {{{ */
+{
+#if defined(__ATOMIC_SEQ_CST)
+  return __atomic_load_n(flag, __ATOMIC_SEQ_CST);
+#else
+  pthread_mutex_lock(&plugins_loaded_lock);
+  _Bool ret = *flag;
+  pthread_mutex_unlock(&plugins_loaded_lock);
+  return ret;
+#endif
+} /* }}} _Bool plugin_loaded_is */
 
-    /* Must hold `read_lock' when accessing `rf->rf_type'. */
-    rf_type = rf->rf_type;
-    pthread_mutex_unlock(&read_lock);
+static uint64_t plugin_loaded_add(uint64_t *counter, int64_t n) /* {{{ */
+{
+#if defined(__ATOMIC_SEQ_CST)
+  return __atomic_add_fetch(counter, (uint64_t)n, __ATOMIC_SEQ_CST);
+#else
+  pthread_mutex_lock(&plugins_loaded_lock);
+  *counter += (uint64_t)n;
+  uint64_t ret = *counter;
+  pthread_mutex_unlock(&plugins_loaded_lock);
+  return ret;
+#endif
+} /* }}} uint64_t plugin_loaded_add */
+
+/* Waits until "*counter" drops to zero. Returns false if it did not do so
+ * before "deadline". */
+static _Bool plugin_loaded_wait(uint64_t *counter, /* {{{ */
+                                cdtime_t deadline) {
+  while (plugin_loaded_add(counter, 0) != 0) {
+    if (cdtime() >= deadline)
+      return 0;
 
-    /* Check if we're supposed to stop.. This may have interrupted
-     * the sleep, too. */
-    if (read_loop == 0) {
-      /* Insert `rf' again, so it can be free'd correctly */
-      c_heap_insert(read_heap, rf);
+    struct timespec ts = {.tv_sec = 0, .tv_nsec = 10000000};
+    nanosleep(&ts, NULL);
+  }
+
+  return 1;
+} /* }}} _Bool plugin_loaded_wait */
+
+#if defined(__ATOMIC_SEQ_CST)
+/* The plugins whose callbacks a thread is currently in, innermost last.
+ * Callbacks nest, e.g. a read callback which logs a message. Each thread only
+ * writes its own slots, so entering a callback doesn't write to memory shared
+ * with other threads; plugin_unload() looks at the slots of all threads
+ * instead. Calls nested deeper are counted in loaded_plugin_t.active. */
+#ifndef CALLBACK_DEPTH_MAX
+#define CALLBACK_DEPTH_MAX 8
+#endif
+typedef struct callback_thread_s callback_thread_t;
+struct callback_thread_s {
+  loaded_plugin_t *active[CALLBACK_DEPTH_MAX];
+  size_t depth;
+  callback_thread_t *next;
+};
+
+static pthread_mutex_t callback_threads_lock = PTHREAD_MUTEX_INITIALIZER;
+static callback_thread_t *callback_threads = NULL;
+static pthread_key_t callback_thread_key;
+static pthread_once_t callback_thread_once = PTHREAD_ONCE_INIT;
+
+static void callback_thread_destroy(void *arg) /* {{{ */
+{
+  callback_thread_t *ct = arg;
+
+  pthread_mutex_lock(&callback_threads_lock);
+  for (callback_thread_t **ptr = &callback_threads; *ptr != NULL;
+       ptr = &(*ptr)->next) {
+    if (*ptr == ct) {
+      *ptr = ct->next;
       break;
     }
+  }
+  pthread_mutex_unlock(&callback_threads_lock);
 
-    /* The entry has been marked for deletion. The linked list
-     * entry has already been removed by `plugin_unregister_read'.
-     * All we have to do here is free the `read_func_t' and
-     * continue. */
-    if (rf_type == RF_REMOVE) {
-      DEBUG("plugin_read_thread: Destroying the `%s' "
-            "callback.",
-            rf->rf_name);
-      sfree(rf->rf_name);
-      destroy_callback((callback_func_t *)rf);
-      rf = NULL;
-      continue;
+  sfree(ct);
+} /* }}} void callback_thread_destroy */
+
+static void callback_thread_key_create(void) /* {{{ */
+{
+  pthread_key_create(&callback_thread_key, callback_thread_destroy);
+} /* }}} void callback_thread_key_create */
+
+/* Returns the state of the calling thread, creating it if "create" is true.
+ * Returns NULL if it doesn't exist and could not be created. */
+static callback_thread_t *callback_thread_get(_Bool create) /* {{{ */
+{
+  pthread_once(&callback_thread_once, callback_thread_key_create);
+
+  callback_thread_t *ct = pthread_getspecific(callback_thread_key);
+  if ((ct != NULL) || !create)
+    return ct;
+
+  ct = calloc(1, sizeof(*ct));
+  if (ct == NULL)
+    return NULL;
+  if (pthread_setspecific(callback_thread_key, ct) != 0) {
+    sfree(ct);
+    return NULL;
+  }
+
+  pthread_mutex_lock(&callback_threads_lock);
+  ct->next = callback_threads;
+  callback_threads = ct;
+  pthread_mutex_unlock(&callback_threads_lock);
+
+  return ct;
+} /* }}} callback_thread_t *callback_thread_get */
+
+/* Returns true if any thread is in a callback of "lp". */
+static _Bool callback_threads_busy(loaded_plugin_t *lp) /* {{{ */
+{
+  _Bool busy = 0;
+
+  pthread_mutex_lock(&callback_threads_lock);
+  for (callback_thread_t *ct = callback_threads; (ct != NULL) && !busy;
+       ct = ct->next)
+    for (size_t i = 0; (i < CALLBACK_DEPTH_MAX) && !busy; i++)
+      busy = (__atomic_load_n(&ct->active[i], __ATOMIC_SEQ_CST) == lp);
+  pthread_mutex_unlock(&callback_threads_lock);
+
+  return busy;
+} /* }}} _Bool callback_threads_busy */
+#endif /* __ATOMIC_SEQ_CST */
+
+/* Waits until no callback of "lp" is in progress any longer. Returns false if
+ * that did not happen before "deadline". */
+static _Bool callback_wait(loaded_plugin_t *lp, cdtime_t deadline) /* {{{ */
+{
+  if (!plugin_loaded_wait(&lp->active, deadline))
+    return 0;
+
+#if defined(__ATOMIC_SEQ_CST)
+  while (callback_threads_busy(lp)) {
+    if (cdtime() >= deadline)
+      return 0;
+
+    struct timespec ts = {.tv_sec = 0, .tv_nsec = 10000000};
+    nanosleep(&ts, NULL);
+  }
+#endif
+
+  return 1;
+} /* }}} _Bool callback_wait */
+
+/* Ends a call of "cf" started with callback_enter(). */
+static void callback_leave(callback_func_t *cf) /* {{{ */
+{
+  if (cf->cf_plugin == NULL)
+    return;
+
+#if defined(__ATOMIC_SEQ_CST)
+  callback_thread_t *ct = callback_thread_get(/* create = */ 0);
+  if ((ct != NULL) && (ct->depth > 0)) {
+    ct->depth--;
+    if (ct->depth < CALLBACK_DEPTH_MAX) {
+      __atomic_store_n(ct->active + ct->depth, NULL, __ATOMIC_RELEASE);
+      return;
     }
+  }
+#endif
+
+  plugin_loaded_add(&cf->cf_plugin->active, -1);
+} /* }}} void callback_leave */
+
+/* Marks a call of "cf" as in progress. Returns false if the callback must not
+ * be called because it has been retired or its plugin is disabled. Every
+ * successful call has to be matched by callback_leave(). */
+static _Bool callback_enter(callback_func_t *cf) /* {{{ */
+{
+  loaded_plugin_t *lp = cf->cf_plugin;
+
+  if (lp == NULL)
+    return 1;
+
+#if defined(__ATOMIC_SEQ_CST)
+  /* plugin_unload() sets the flags before waiting for the call to be gone,
+   * so either it sees this call or this call sees the flags. */
+  callback_thread_t *ct = callback_thread_get(/* create = */ 1);
+  loaded_plugin_t **slot = NULL;
+  if (ct != NULL) {
+    if (ct->depth < CALLBACK_DEPTH_MAX)
+      slot = ct->active + ct->depth;
+    ct->depth++;
+  }
+
+  if (slot != NULL)
+    __atomic_store_n(slot, lp, __ATOMIC_SEQ_CST);
+  else
+    __atomic_add_fetch(&lp->active, 1, __ATOMIC_SEQ_CST);
+
+  if (!__atomic_load_n(&cf->cf_retired, __ATOMIC_SEQ_CST) &&
+      !__atomic_load_n(&lp->disabled, __ATOMIC_SEQ_CST))
+    return 1;
+
+  callback_leave(cf);
+  return 0;
+#else
+  pthread_mutex_lock(&plugins_loaded_lock);
+  _Bool ok = !cf->cf_retired && !lp->disabled;
+  if (ok)
+    lp->active++;
+  pthread_mutex_unlock(&plugins_loaded_lock);
+  return ok;
+#endif
+} /* }}} _Bool callback_enter */
+
+static void free_userdata(user_data_t const *ud) /* {{{ */
+{
+  if (ud == NULL)
+    return;
+
+  if ((ud->data != NULL) && (ud->free_func != NULL)) {
+    ud->free_func(ud->data);
+  }
+} /* }}} void free_userdata */
+
+static void destroy_callback(callback_func_t *cf) /* {{{ */
+{
+  if (cf == NULL)
+    return;
+  free_userdata(&cf->cf_udata);
+  sfree(cf);
+} /* }}} void destroy_callback */
+
+static void destroy_all_callbacks(llist_t **list) /* {{{ */
+{
+  llentry_t *le;
+
+  if (*list == NULL)
+    return;
+
+  le = llist_head(*list);
+  while (le != NULL) {
+    llentry_t *le_next;
+
+    le_next = le->next;
+
+    sfree(le->key);
+    destroy_callback(le->value);
+    le->value = NULL;
+
+    le = le_next;
+  }
+
+  llist_destroy(*list);
+  *list = NULL;
+} /* }}} void destroy_all_callbacks */
+
+static void read_func_destroy(read_func_t *rf) /* {{{ */
+{
+  if (rf == NULL)
+    return;
+
+  latency_counter_destroy(rf->rf_latency);
+  pthread_mutex_destroy(&rf->rf_stats_lock);
+  sfree(rf->rf_name);
+  destroy_callback((callback_func_t *)rf);
+} /* }}} void read_func_destroy */
+
+static int plugin_compare_read_func(const void *arg0, const void *arg1);
+
+/* `q->lock' must be held by the caller. */
+static int read_queue_insert(read_queue_t *q, read_func_t *rf) /* {{{ */
+{
+  if (q->heap == NULL) {
+    q->heap = c_heap_create(plugin_compare_read_func);
+    if (q->heap == NULL)
+      return ENOMEM;
+  }
+
+  if (q->next == NULL) {
+    q->next = rf;
+    return 0;
+  }
+
+  if (rf->rf_next_read < q->next->rf_next_read) {
+    read_func_t *tmp = q->next;
+    q->next = rf;
+    rf = tmp;
+  }
+
+  return c_heap_insert(q->heap, rf);
+} /* }}} int read_queue_insert */
+
+/* `q->lock' must be held by the caller. */
+static read_func_t *read_queue_take(read_queue_t *q) /* {{{ */
+{
+  read_func_t *rf = q->next;
+
+  if (rf != NULL)
+    q->next = (q->heap != NULL) ? c_heap_get_root(q->heap) : NULL;
+
+  return rf;
+} /* }}} read_func_t *read_queue_take */
+
+static _Bool read_queue_is_due(read_queue_t const *q, cdtime_t now) /* {{{ */
+{
+  return (q->next != NULL) && (q->next->rf_next_read <= now);
+} /* }}} _Bool read_queue_is_due */
+
+static void destroy_read_queue(read_queue_t *q) /* {{{ */
+{
+  read_func_t *rf;
+
+  while ((rf = read_queue_take(q)) != NULL) {
+    read_func_destroy(rf);
+  }
+
+  c_heap_destroy(q->heap);
+  q->heap = NULL;
+} /* }}} void destroy_read_queue */
+
+static int register_callback(llist_t **list, /* {{{ */
+                             const char *name, callback_func_t *cf) {
+  llentry_t *le;
+  char *key;
+
+  if (*list == NULL) {
+    *list = llist_create();
+    if (*list == NULL) {
+      ERROR("plugin: register_callback: "
+            "llist_create failed.");
+      destroy_callback(cf);
+      return -1;
+    }
+  }
+
+  key = strdup(name);
+  if (key == NULL) {
+    ERROR("plugin: register_callback: strdup failed.");
+    destroy_callback(cf);
+    return -1;
+  }
+
+  le = llist_search(*list, name);
+  if (le == NULL) {
+    le = llentry_create(key, cf);
+    if (le == NULL) {
+      ERROR("plugin: register_callback: "
+            "llentry_create failed.");
+      sfree(key);
+      destroy_callback(cf);
+      return -1;
+    }
+
+    llist_append(*list, le);
+  } else {
+    callback_func_t *old_cf;
+
+    old_cf = le->value;
+    le->value = cf;
+
+    WARNING("plugin: register_callback: "
+            "a callback named `%s' already exists - "
+            "overwriting the old entry!",
+            name);
+
+    destroy_callback(old_cf);
+    sfree(key);
+  }
+
+  return 0;
+} /* }}} int register_callback */
+
+static void log_list_callbacks(llist_t **list, /* {{{ */
+                               const char *comment) {
+  char *str;
+  int len;
+  int i;
+  llentry_t *le;
+  int n;
+  char **keys;
+
+  n = llist_size(*list);
+  if (n == 0) {
+    INFO("%s [none]", comment);
+    return;
+  }
+
+  keys = calloc(n, sizeof(char *));
+
+  if (keys == NULL) {
+    ERROR("%s: failed to allocate memory for list of callbacks", comment);
+
+    return;
+  }
+
+  for (le = llist_head(*list), i = 0, len = 0; le != NULL; le = le->next, i++) {
+    keys[i] = le->key;
+    len += strlen(le->key) + 6;
+  }
+  str = malloc(len + 10);
+  if (str == NULL) {
+    ERROR("%s: failed to allocate memory for list of callbacks", comment);
+  } else {
+    *str = '\0';
+    strjoin(str, len, keys, n, "', '");
+    INFO("%s ['%s']", comment, str);
+    sfree(str);
+  }
+  sfree(keys);
+} /* }}} void log_list_callbacks */
+
+static int create_register_callback(llist_t **list, /* {{{ */
+                                    const char *name, void *callback,
+                                    user_data_t const *ud) {
+  callback_func_t *cf;
+
+  cf = calloc(1, sizeof(*cf));
+  if (cf == NULL) {
+    free_userdata(ud);
+    ERROR("plugin: create_register_callback: calloc failed.");
+    return -1;
+  }
+
+  cf->cf_callback = callback;
+  if (ud == NULL) {
+    cf->cf_udata.data = NULL;
+    cf->cf_udata.free_func = NULL;
+  } else {
+    cf->cf_udata = *ud;
+  }
+
+  cf->cf_ctx = plugin_get_ctx();
+  cf->cf_cpu = plugin_cpu_get(name);
+  cf->cf_plugin = plugin_loaded_get(cf->cf_ctx.name, /* create = */ 0);
+
+  return register_callback(list, name, cf);
+} /* }}} int create_register_callback */
+
+/* Publishes a new snapshot of "list" in "array". */
+static void callback_array_update(callback_array_t **array, /* {{{ */
+                                  llist_t *list) {
+  callback_array_t *new = NULL;
+  int num = (list != NULL) ? llist_size(list) : 0;
+
+  if (num > 0) {
+    new = calloc(1, sizeof(*new) + (size_t)num * sizeof(new->entries[0]));
+    if (new == NULL) {
+      /* Keeping the old snapshot would keep calling removed callbacks. */
+      ERROR("plugin: callback_array_update: calloc failed.");
+      return;
+    }
+    for (llentry_t *le = llist_head(list); le != NULL; le = le->next) {
+      new->entries[new->num].name = le->key;
+      new->entries[new->num].value = le->value;
+      new->num++;
+    }
+  }
+
+  pthread_mutex_lock(&callback_array_lock);
+#if defined(__ATOMIC_ACQ_REL)
+  callback_array_t *old = __atomic_exchange_n(array, new, __ATOMIC_ACQ_REL);
+#else
+  callback_array_t *old = *array;
+  *array = new;
+#endif
+  if (old != NULL) {
+    old->retired_next = callback_arrays_retired;
+    callback_arrays_retired = old;
+  }
+  pthread_mutex_unlock(&callback_array_lock);
+} /* }}} void callback_array_update */
+
+/* Returns the current snapshot in "array", or NULL if the list is empty. */
+static callback_array_t *callback_array_get(callback_array_t **array) /* {{{ */
+{
+#if defined(__ATOMIC_ACQUIRE)
+  return __atomic_load_n(array, __ATOMIC_ACQUIRE);
+#else
+  pthread_mutex_lock(&callback_array_lock);
+  callback_array_t *ret = *array;
+  pthread_mutex_unlock(&callback_array_lock);
+  return ret;
+#endif
+} /* }}} callback_array_t *callback_array_get */
+
+static void callback_arrays_free(void) /* {{{ */
+{
+  callback_array_update(&array_write, NULL);
+  callback_array_update(&array_flush, NULL);
+  callback_array_update(&array_log, NULL);
+  callback_array_update(&array_notification, NULL);
+
+  pthread_mutex_lock(&callback_array_lock);
+  while (callback_arrays_retired != NULL) {
+    callback_array_t *next = callback_arrays_retired->retired_next;
+    sfree(callback_arrays_retired);
+    callback_arrays_retired = next;
+  }
+  pthread_mutex_unlock(&callback_array_lock);
+} /* }}} void callback_arrays_free */
+
+static int plugin_unregister(llist_t *list, const char *name) /* {{{ */
+{
+  llentry_t *e;
+
+  if (list == NULL)
+    return -1;
+
+  e = llist_search(list, name);
+  if (e == NULL)
+    return -1;
+
+  llist_remove(list, e);
+
+  sfree(e->key);
+  destroy_callback(e->value);
+
+  llentry_destroy(e);
+
+  return 0;
+} /* }}} int plugin_unregister */
+
+/* plugin_load_file loads the shared object "file" and calls its
+ * "module_register" function. Returns zero on success, non-zero otherwise.
+ * The handle of the shared object is stored in "ret_dlh". */
+static int plugin_load_file(char const *file, _Bool global, void **ret_dlh) {
+  int flags = RTLD_NOW;
+  if (global)
+    flags |= RTLD_GLOBAL;
+
+  void *dlh = dlopen(file, flags);
+  if (dlh == NULL) {
+    char errbuf[1024] = "";
+
+    snprintf(errbuf, sizeof(errbuf),
+             "dlopen(\"%s\") failed: %s. "
+             "The most common cause for this problem is missing dependencies. "
+             "Use ldd(1) to check the dependencies of the plugin / shared "
+             "object.",
+             file, dlerror());
+
+    /* This error is printed to STDERR unconditionally. If list_log is NULL,
+     * plugin_log() will also print to STDERR. We avoid duplicate output by
+     * checking that the list of log handlers, list_log, is not NULL. */
+    fprintf(stderr, "ERROR: %s\n", errbuf);
+    if (list_log != NULL) {
+      ERROR("%s", errbuf);
+    }
+
+    return ENOENT;
+  }
+
+  void (*reg_handle)(void) = dlsym(dlh, "module_register");
+  if (reg_handle == NULL) {
+    ERROR("Couldn't find symbol \"module_register\" in \"%s\": %s\n", file,
+          dlerror());
+    dlclose(dlh);
+    return ENOENT;
+  }
+
+  *ret_dlh = dlh;
+  (*reg_handle)();
+  return 0;
+}
+
+/* Takes a read function which is due from another queue of the pool. */
+static read_func_t *plugin_read_steal(read_pool_t *pool, size_t self, /* {{{ */
+                                      cdtime_t now) {
+  for (size_t i = 1; i < pool->queues_num; i++) {
+    read_queue_t *q = pool->queues + ((self + i) % pool->queues_num);
+    read_func_t *rf = NULL;
+
+    /* Don't wait for busy queues, try the next one instead. */
+    if (pthread_mutex_trylock(&q->lock) != 0)
+      continue;
+    if (read_queue_is_due(q, now))
+      rf = read_queue_take(q);
+    _Bool more = read_queue_is_due(q, now);
+    pthread_mutex_unlock(&q->lock);
+
+    if (rf == NULL)
+      continue;
+
+    /* Ask the next thread for help, too, if there is still work left. */
+    if (more)
+      pthread_cond_signal(&pool->queues[(self + 1) % pool->queues_num].cond);
+    return rf;
+  }
+
+  return NULL;
+} /* }}} read_func_t *plugin_read_steal */
+
+/* Returns the first time not before "now" at which "rf" is in its slot, i.e.
+ * at its offset into the interval, counted from the epoch. */
+static cdtime_t plugin_read_slot(read_func_t const *rf, cdtime_t now) {
+  cdtime_t interval = rf->rf_effective_interval;
+  if (interval == 0)
+    return now;
+
+  cdtime_t offset =
+      (read_phase % interval + identifier_hash(rf->rf_name) % interval) %
+      interval;
+  cdtime_t next = now - (now % interval) + offset;
+  if (next < now)
+    next += interval;
+  return next;
+} /* cdtime_t plugin_read_slot */
+
+static void *plugin_read_thread(void *args) {
+  read_queue_t *queue = args;
+  read_pool_t *pool = queue->pool;
+  size_t self = (size_t)(queue - pool->queues);
+
+  while (read_loop != 0) {
+    read_func_t *rf = NULL;
+    plugin_ctx_t old_ctx;
+    cdtime_t start;
+    cdtime_t now;
+    cdtime_t elapsed;
+    int status;
+    int rf_type;
+
+    /* Take the read function that needs to be read next from our own queue
+     * if it is due. If more read functions are due, another thread will have
+     * to help out. */
+    now = cdtime();
+    pthread_mutex_lock(&queue->lock);
+    if (read_queue_is_due(queue, now)) {
+      rf = read_queue_take(queue);
+      if ((pool->queues_num > 1) && read_queue_is_due(queue, now))
+        pthread_cond_signal(&pool->queues[(self + 1) % pool->queues_num].cond);
+    }
+    pthread_mutex_unlock(&queue->lock);
+
+    if (rf == NULL)
+      rf = plugin_read_steal(pool, self, now);
+
+    if (rf == NULL) {
+      /* Sleep until our next read function is due or another thread asks for
+       * help. In pthread_cond_timedwait, spurious wakeups are possible (and
+       * really happen, at least on NetBSD with > 1 CPU), but the loop
+       * re-evaluates everything anyway. */
+      pthread_mutex_lock(&queue->lock);
+      cdtime_t wait_until = now + READ_STEAL_INTERVAL;
+      if ((queue->next != NULL) && (queue->next->rf_next_read < wait_until))
+        wait_until = queue->next->rf_next_read;
+      if ((read_loop != 0) && (cdtime() < wait_until))
+        pthread_cond_timedwait(&queue->cond, &queue->lock,
+                               &CDTIME_T_TO_TIMESPEC(wait_until));
+      pthread_mutex_unlock(&queue->lock);
+      continue;
+    }
+
+    /* Check if we're supposed to stop.. This may have interrupted
+     * the sleep, too. */
+    if (read_loop == 0) {
+      /* Insert `rf' again, so it can be free'd correctly */
+      pthread_mutex_lock(&queue->lock);
+      read_queue_insert(queue, rf);
+      pthread_mutex_unlock(&queue->lock);
+      break;
+    }
+
+    if (rf->rf_interval == 0) {
+      /* this should not happen, because the interval is set
+       * for each plugin when loading it
+       * XXX: issue a warning? */
+      rf->rf_interval = plugin_get_interval();
+      rf->rf_effective_interval = rf->rf_interval;
+
+      rf->rf_next_read = cdtime();
+    }
+
+    /* Must hold `read_lock' when accessing `rf->rf_type'. */
+    pthread_mutex_lock(&read_lock);
+    rf_type = rf->rf_type;
+    pthread_mutex_unlock(&read_lock);
+
+    /* The entry has been marked for deletion. The linked list
+     * entry has already been removed by `plugin_unregister_read'.
+     * All we have to do here is free the `read_func_t' and
+     * continue. */
+    if (rf_type == RF_REMOVE) {
+      DEBUG("plugin_read_thread: Destroying the `%s' "
+            "callback.",
+            rf->rf_name);
+      read_func_destroy(rf);
+      rf = NULL;
+      continue;
+    }
+
+    /* Hosts started at the same time would otherwise read, and send, in
+     * lockstep. Delay the first read until the callback's slot. */
+    if (read_jitter && !rf->rf_phased) {
+      rf->rf_phased = 1;
+      rf->rf_next_read = plugin_read_slot(rf, cdtime());
+      pthread_mutex_lock(&queue->lock);
+      status = read_queue_insert(queue, rf);
+      pthread_mutex_unlock(&queue->lock);
+      if (status != 0) {
+        ERROR("plugin_read_thread: Re-inserting the `%s' callback failed. "
+              "It will no longer be called.",
+              rf->rf_name);
+        read_func_destroy(rf);
+      }
+      continue;
+    }
+
+    /* The plugin's init callback has not returned yet or the plugin is being
+     * reloaded. Try again soon. */
+    if (plugin_init_pending(rf->rf_ctx.name) ||
+        !callback_enter(&rf->rf_super)) {
+      rf->rf_next_read =
+          cdtime() + ((rf->rf_interval < INIT_PENDING_RETRY) ? rf->rf_interval
+                                                              : INIT_PENDING_RETRY);
+      pthread_mutex_lock(&queue->lock);
+      status = read_queue_insert(queue, rf);
+      pthread_mutex_unlock(&queue->lock);
+      if (status != 0) {
+        ERROR("plugin_read_thread: Re-inserting the `%s' callback failed. "
+              "It will no longer be called.",
+              rf->rf_name);
+        read_func_destroy(rf);
+      }
+      continue;
+    }
+
+    DEBUG("plugin_read_thread: Handling `%s'.", rf->rf_name);
+
+    start = cdtime_precise();
+
+    old_ctx = plugin_set_ctx(rf->rf_ctx);
+    cdtime_t cpu_begin = plugin_cpu_begin();
+
+    if (rf_type == RF_SIMPLE) {
+      int (*callback)(void);
+
+      callback = rf->rf_callback;
+      status = (*callback)();
+    } else {
+      plugin_read_cb callback;
+
+      assert(rf_type == RF_COMPLEX);
+
+      callback = rf->rf_callback;
+      status = (*callback)(&rf->rf_udata);
+    }
+
+    plugin_cpu_end(&rf->rf_super, PLUGIN_CPU_READ, cpu_begin);
+    plugin_set_ctx(old_ctx);
+    callback_leave(&rf->rf_super);
+
+    /* If the function signals failure, we will increase the
+     * intervals in which it will be called. */
+    if (status != 0) {
+      rf->rf_effective_interval *= 2;
+      if (rf->rf_effective_interval > max_read_interval)
+        rf->rf_effective_interval = max_read_interval;
+
+      NOTICE("read-function of plugin `%s' failed. "
+             "Will suspend it for %.3f seconds.",
+             rf->rf_name, CDTIME_T_TO_DOUBLE(rf->rf_effective_interval));
+    } else {
+      /* Success: Restore the interval, if it was changed. */
+      rf->rf_effective_interval = rf->rf_interval;
+    }
+
+    /* update the ``next read due'' field */
+    now = cdtime_precise();
+
+    /* calculate the time spent in the read function */
+    elapsed = (now - start);
+
+    _Bool overrun = (elapsed > rf->rf_effective_interval);
+    if (overrun)
+      WARNING(
+          "plugin_read_thread: read-function of the `%s' plugin took %.3f "
+          "seconds, which is above its read interval (%.3f seconds). You might "
+          "want to adjust the `Interval' or `ReadThreads' settings.",
+          rf->rf_name, CDTIME_T_TO_DOUBLE(elapsed),
+          CDTIME_T_TO_DOUBLE(rf->rf_effective_interval));
+
+    DEBUG("plugin_read_thread: read-function of the `%s' plugin took "
+          "%.6f seconds.",
+          rf->rf_name, CDTIME_T_TO_DOUBLE(elapsed));
+
+    DEBUG("plugin_read_thread: Effective interval of the "
+          "`%s' plugin is %.3f seconds.",
+          rf->rf_name, CDTIME_T_TO_DOUBLE(rf->rf_effective_interval));
+
+    /* Calculate the next (absolute) time at which this function
+     * should be called. */
+    rf->rf_next_read += rf->rf_effective_interval;
+
+    /* Check, if `rf_next_read' is in the past. */
+    uint64_t skipped = 0;
+    if (rf->rf_next_read < now) {
+      /* Every complete interval that passed is one read we skipped. */
+      if (rf->rf_effective_interval > 0)
+        skipped = (uint64_t)((now - rf->rf_next_read) /
+                             rf->rf_effective_interval);
+
+      /* `rf_next_read' is in the past. Insert `now'
+       * so this value doesn't trail off into the
+       * past too much. */
+      rf->rf_next_read = read_jitter ? plugin_read_slot(rf, now) : now;
+    }
+
+    pthread_mutex_lock(&rf->rf_stats_lock);
+    latency_counter_add(rf->rf_latency, elapsed);
+    rf->rf_reads++;
+    if (overrun)
+      rf->rf_overruns++;
+    rf->rf_skipped += skipped;
+    pthread_mutex_unlock(&rf->rf_stats_lock);
+
+    DEBUG("plugin_read_thread: Next read of the `%s' plugin at %.3f.",
+          rf->rf_name, CDTIME_T_TO_DOUBLE(rf->rf_next_read));
+
+    /* Re-insert this read function into our own queue. Read functions stolen
+     * from other threads thereby move to the thread with spare capacity. */
+    pthread_mutex_lock(&queue->lock);
+    status = read_queue_insert(queue, rf);
+    pthread_mutex_unlock(&queue->lock);
+    if (status != 0) {
+      ERROR("plugin_read_thread: Re-inserting the `%s' callback failed. "
+            "It will no longer be called.",
+            rf->rf_name);
+      read_func_destroy(rf);
+    }
+  } /* while (read_loop) */
+
+  pthread_exit(NULL);
+  return (void *)0;
+} /* void *plugin_read_thread */
+
+#ifdef PTHREAD_MAX_NAMELEN_NP
+#define THREAD_NAME_MAX PTHREAD_MAX_NAMELEN_NP
+#else
+#define THREAD_NAME_MAX 16
+#endif
+
+static void set_thread_name(pthread_t tid, char const *name) {
+#if defined(HAVE_PTHREAD_SETNAME_NP) || defined(HAVE_PTHREAD_SET_NAME_NP)
+
+  /* glibc limits the length of the name and fails if the passed string
+   * is too long, so we truncate it here. */
+  char n[THREAD_NAME_MAX];
+  if (strlen(name) >= THREAD_NAME_MAX)
+    WARNING("set_thread_name(\"%s\"): name too long", name);
+  sstrncpy(n, name, sizeof(n));
+
+#if defined(HAVE_PTHREAD_SETNAME_NP)
+  int status = pthread_setname_np(tid, n);
+  if (status != 0) {
+    ERROR("set_thread_name(\"%s\"): %s", n, STRERROR(status));
+  }
+#else /* if defined(HAVE_PTHREAD_SET_NAME_NP) */
+  pthread_set_name_np(tid, n);
+#endif
+
+#endif
+}
+
+/* Restricts the thread "tid" to the CPUs in "cpus", a list of CPU numbers
+ * and ranges such as "0-3,8". Does nothing if "cpus" is NULL. */
+static int set_thread_affinity(pthread_t tid, char const *cpus) /* {{{ */
+{
+  if ((cpus == NULL) || (cpus[0] == 0))
+    return 0;
+
+#if HAVE_PTHREAD_SETAFFINITY_NP
+  cpu_set_t set;
+  CPU_ZERO(&set);
+
+  char const *ptr = cpus;
+  while (*ptr != 0) {
+    char *end = NULL;
+
+    errno = 0;
+    unsigned long first = strtoul(ptr, &end, 10);
+    unsigned long last = first;
+    if ((errno == 0) && (end != ptr) && (*end == '-')) {
+      ptr = end + 1;
+      last = strtoul(ptr, &end, 10);
+    }
+    if ((errno != 0) || (end == ptr) || ((*end != ',') && (*end != 0)) ||
+        (last < first) || (last >= CPU_SETSIZE)) {
+      ERROR("set_thread_affinity(\"%s\"): Invalid CPU list.", cpus);
+      return EINVAL;
+    }
+
+    for (unsigned long cpu = first; cpu <= last; cpu++)
+      CPU_SET((int)cpu, &set);
+
+    ptr = (*end == ',') ? end + 1 : end;
+  }
+
+  int status = pthread_setaffinity_np(tid, sizeof(set), &set);
+  if (status != 0) {
+    ERROR("set_thread_affinity(\"%s\"): %s", cpus, STRERROR(status));
+    return status;
+  }
+  return 0;
+#else
+  WARNING("set_thread_affinity(\"%s\"): Setting the CPU affinity of threads "
+          "is not supported on this system.",
+          cpus);
+  return ENOTSUP;
+#endif
+} /* }}} int set_thread_affinity */
+
+static read_pool_t *read_pool_get(size_t index) /* {{{ */
+{
+  if ((index == 0) || (index > read_pools_num))
+    return &read_pool_default;
+  return read_pools[index - 1];
+} /* }}} read_pool_t *read_pool_get */
+
+/* Returns the pool of `plugin', or zero for the default pool. */
+static size_t read_pool_find_plugin(char const *plugin) /* {{{ */
+{
+  for (size_t i = 0; i < read_pools_num; i++)
+    for (size_t j = 0; j < read_pools[i]->plugins_num; j++)
+      if (strcasecmp(plugin, read_pools[i]->plugins[j]) == 0)
+        return i + 1;
+  return 0;
+} /* }}} size_t read_pool_find_plugin */
+
+/* Returns the pool of the read functions in `group', or zero if the group
+ * hasn't been assigned to a pool. */
+static size_t read_pool_find_group(char const *group) /* {{{ */
+{
+  if ((group == NULL) || (group[0] == 0))
+    return 0;
+
+  for (size_t i = 0; i < read_pools_num; i++)
+    for (size_t j = 0; j < read_pools[i]->groups_num; j++)
+      if (strcmp(group, read_pools[i]->groups[j]) == 0)
+        return i + 1;
+  return 0;
+} /* }}} size_t read_pool_find_group */
+
+/* Picks the queue a read function is added to. `read_lock' must be held by
+ * the caller. */
+static read_queue_t *read_pool_next_queue(read_pool_t *pool) /* {{{ */
+{
+  if (pool->queues_num == 0)
+    return &read_queue_default;
+
+  read_queue_t *q = pool->queues + (pool->queue_next % pool->queues_num);
+  pool->queue_next++;
+  return q;
+} /* }}} read_queue_t *read_pool_next_queue */
+
+static int read_pool_create_queues(read_pool_t *pool) /* {{{ */
+{
+  pool->queues = calloc(pool->threads_num, sizeof(*pool->queues));
+  if (pool->queues == NULL)
+    return ENOMEM;
+
+  for (size_t i = 0; i < pool->threads_num; i++) {
+    pthread_mutex_init(&pool->queues[i].lock, /* attr = */ NULL);
+    pthread_cond_init(&pool->queues[i].cond, /* attr = */ NULL);
+    pool->queues[i].pool = pool;
+  }
+  pool->queues_num = pool->threads_num;
+  pool->queue_next = 0;
+
+  return 0;
+} /* }}} int read_pool_create_queues */
+
+/* Moves all read functions of `pool' back to the default queue, so they can
+ * be free'd correctly. `read_lock' and the default queue's lock must be held
+ * by the caller. */
+static void read_pool_destroy_queues(read_pool_t *pool) /* {{{ */
+{
+  for (size_t i = 0; i < pool->queues_num; i++) {
+    read_func_t *rf;
+    while ((rf = read_queue_take(&pool->queues[i])) != NULL) {
+      if (read_queue_insert(&read_queue_default, rf) != 0) {
+        read_func_destroy(rf);
+      }
+    }
+    c_heap_destroy(pool->queues[i].heap);
+    pthread_cond_destroy(&pool->queues[i].cond);
+    pthread_mutex_destroy(&pool->queues[i].lock);
+  }
+
+  sfree(pool->queues);
+  pool->queues_num = 0;
+} /* }}} void read_pool_destroy_queues */
+
+static void start_read_threads(size_t num) /* {{{ */
+{
+  size_t threads_num = 0;
+
+  if (read_threads != NULL)
+    return;
+
+  read_pool_default.threads_num = num;
+  for (size_t i = 0; i <= read_pools_num; i++)
+    threads_num += read_pool_get(i)->threads_num;
+
+  read_threads = (pthread_t *)calloc(threads_num, sizeof(pthread_t));
+  if (read_threads == NULL) {
+    ERROR("plugin: start_read_threads: calloc failed.");
+    return;
+  }
+
+  /* Distribute the read functions registered so far among the threads of
+   * their pools. */
+  pthread_mutex_lock(&read_lock);
+  pthread_mutex_lock(&read_queue_default.lock);
+  for (size_t i = 0; i <= read_pools_num; i++) {
+    if (read_pool_create_queues(read_pool_get(i)) != 0) {
+      ERROR("plugin: start_read_threads: calloc failed.");
+      for (size_t j = 0; j < i; j++)
+        read_pool_destroy_queues(read_pool_get(j));
+      pthread_mutex_unlock(&read_queue_default.lock);
+      pthread_mutex_unlock(&read_lock);
+      sfree(read_threads);
+      return;
+    }
+  }
+
+  read_func_t *rf;
+  while ((rf = read_queue_take(&read_queue_default)) != NULL) {
+    read_queue_t *q = read_pool_next_queue(read_pool_get(rf->rf_pool));
+    if (read_queue_insert(q, rf) != 0) {
+      ERROR("plugin: start_read_threads: Scheduling the `%s' callback "
+            "failed.",
+            rf->rf_name);
+      read_func_destroy(rf);
+    }
+  }
+  pthread_mutex_unlock(&read_queue_default.lock);
+  pthread_mutex_unlock(&read_lock);
+
+  char const *affinity = global_option_get("ReadThreadsAffinity");
+  read_threads_num = 0;
+  for (size_t i = 0; i <= read_pools_num; i++) {
+    read_pool_t *pool = read_pool_get(i);
+
+    for (size_t j = 0; j < pool->queues_num; j++) {
+      int status = pthread_create(read_threads + read_threads_num,
+                                  /* attr = */ NULL, plugin_read_thread,
+                                  /* arg = */ pool->queues + j);
+      if (status != 0) {
+        /* The read functions in the queues of threads that couldn't be
+         * started are stolen by the other threads of the pool. */
+        ERROR("plugin: start_read_threads: pthread_create failed with status "
+              "%i (%s).",
+              status, STRERROR(status));
+        break;
+      }
+
+      char name[THREAD_NAME_MAX];
+      snprintf(name, sizeof(name), "reader#%" PRIsz, read_threads_num);
+      set_thread_name(read_threads[read_threads_num], name);
+      set_thread_affinity(read_threads[read_threads_num], affinity);
+
+      read_threads_num++;
+    } /* for (j) */
+
+    if (pool != &read_pool_default)
+      INFO("collectd: Started %" PRIsz " threads for the \"%s\" read thread "
+           "pool.",
+           pool->queues_num, pool->name);
+  } /* for (i) */
+} /* }}} void start_read_threads */
+
+static void stop_read_threads(void) {
+  if (read_threads == NULL)
+    return;
+
+  INFO("collectd: Stopping %" PRIsz " read threads.", read_threads_num);
+
+  read_loop = 0;
+  DEBUG("plugin: stop_read_threads: Signalling the read threads");
+  for (size_t i = 0; i <= read_pools_num; i++) {
+    read_pool_t *pool = read_pool_get(i);
+    for (size_t j = 0; j < pool->queues_num; j++) {
+      pthread_mutex_lock(&pool->queues[j].lock);
+      pthread_cond_broadcast(&pool->queues[j].cond);
+      pthread_mutex_unlock(&pool->queues[j].lock);
+    }
+  }
+
+  for (size_t i = 0; i < read_threads_num; i++) {
+    if (pthread_join(read_threads[i], NULL) != 0) {
+      ERROR("plugin: stop_read_threads: pthread_join failed.");
+    }
+    read_threads[i] = (pthread_t)0;
+  }
+  sfree(read_threads);
+  read_threads_num = 0;
+
+  pthread_mutex_lock(&read_lock);
+  pthread_mutex_lock(&read_queue_default.lock);
+  for (size_t i = 0; i <= read_pools_num; i++)
+    read_pool_destroy_queues(read_pool_get(i));
+  pthread_mutex_unlock(&read_queue_default.lock);
+  pthread_mutex_unlock(&read_lock);
+} /* void stop_read_threads */
+
+/* Value lists cloned by plugin_value_list_clone() are allocated from a pool.
+ * Up to VALUE_LIST_INLINE_VALUES values are stored in the same object, which
+ * covers the vast majority of types. */
+#ifndef VALUE_LIST_INLINE_VALUES
+#define VALUE_LIST_INLINE_VALUES 4
+#endif
+struct value_list_pooled_s {
+  value_list_t vl; /* must be the first member */
+  value_t values[VALUE_LIST_INLINE_VALUES];
+
+  /* Once shared, "vl" is immutable and its identity is kept here, since the
+   * references may outlive the dispatching function. */
+  size_t refs;
+  value_list_identity_t identity;
+};
+typedef struct value_list_pooled_s value_list_pooled_t;
+
+/* Value lists waiting in the global write queue are stored in a compact
+ * form instead of a value_list_t with its five fixed size name buffers. The
+ * host, plugin and type are interned, since there are only few distinct ones.
+ * The values and the plugin and type instance, which may be short-lived, are
+ * stored back to back in the same allocation. The write threads turn them
+ * back into a value_list_t, see value_list_compact_expand(). */
+struct value_list_compact_s {
+  char const *host;
+  char const *plugin;
+  char const *type;
+  char const *plugin_instance;
+  char const *type_instance;
+  cdtime_t time;
+  cdtime_t interval;
+  meta_data_t *meta;
+  data_set_id_t type_id;
+  _Bool pooled; /* allocated from "value_list_compact_pool" */
+  size_t values_len;
+  value_t values[];
+};
+
+/* Size of the objects in "value_list_compact_pool". Value lists with few
+ * values and short instance names fit; larger ones are allocated with
+ * malloc(). */
+#ifndef VALUE_LIST_COMPACT_POOLED_SIZE
+#define VALUE_LIST_COMPACT_POOLED_SIZE 256
+#endif
+
+static c_pool_t *value_list_pool = NULL;
+static c_pool_t *value_list_compact_pool = NULL;
+static c_pool_t *write_queue_pool = NULL;
+static c_intern_t *value_list_names = NULL;
+static pthread_once_t plugin_pools_once = PTHREAD_ONCE_INIT;
+
+static void plugin_pools_create(void) /* {{{ */
+{
+  value_list_pool = c_pool_create(sizeof(value_list_pooled_t),
+                                  /* batch_size = */ 0);
+  value_list_compact_pool =
+      c_pool_create(VALUE_LIST_COMPACT_POOLED_SIZE, /* batch_size = */ 0);
+  write_queue_pool = c_pool_create(sizeof(write_queue_t), /* batch_size = */ 0);
+  value_list_names = c_intern_create(/* ignore_case = */ 0);
+  if ((value_list_pool == NULL) || (value_list_compact_pool == NULL) ||
+      (write_queue_pool == NULL) || (value_list_names == NULL))
+    ERROR("plugin: Creating the value list pools failed.");
+} /* }}} void plugin_pools_create */
+
+static write_queue_t *write_queue_alloc(void) /* {{{ */
+{
+  pthread_once(&plugin_pools_once, plugin_pools_create);
+  return c_pool_alloc(write_queue_pool);
+} /* }}} write_queue_t *write_queue_alloc */
+
+static void write_queue_free(write_queue_t *q) /* {{{ */
+{
+  c_pool_free(write_queue_pool, q);
+} /* }}} void write_queue_free */
+
+/* Reference counts are updated with atomic builtins if available. */
+#if defined(__ATOMIC_ACQ_REL)
+#define VALUE_LIST_REF(pvl) __atomic_add_fetch(&(pvl)->refs, 1, __ATOMIC_RELAXED)
+#define VALUE_LIST_UNREF(pvl)                                                  \
+  __atomic_sub_fetch(&(pvl)->refs, 1, __ATOMIC_ACQ_REL)
+#else
+static pthread_mutex_t value_list_refs_lock = PTHREAD_MUTEX_INITIALIZER;
+static size_t value_list_ref_locked(size_t *refs, int delta) /* {{{ */
+{
+  pthread_mutex_lock(&value_list_refs_lock);
+  size_t ret = (*refs += delta);
+  pthread_mutex_unlock(&value_list_refs_lock);
+  return ret;
+} /* }}} size_t value_list_ref_locked */
+#define VALUE_LIST_REF(pvl) value_list_ref_locked(&(pvl)->refs, 1)
+#define VALUE_LIST_UNREF(pvl) value_list_ref_locked(&(pvl)->refs, -1)
+#endif
+
+static void plugin_value_list_free(value_list_t *vl) /* {{{ */
+{
+  value_list_pooled_t *pvl = (value_list_pooled_t *)vl;
+
+  if (vl == NULL)
+    return;
+
+  meta_data_destroy(vl->meta);
+  if (vl->values != pvl->values)
+    sfree(vl->values);
+  c_pool_free(value_list_pool, pvl);
+} /* }}} void plugin_value_list_free */
+
+/* Returns the interval for a value list which doesn't specify one, taken from
+ * the thread context. */
+static cdtime_t plugin_value_list_interval(value_list_t const *vl) /* {{{ */
+{
+  plugin_ctx_t ctx = plugin_get_ctx();
+  char name[6 * DATA_MAX_NAME_LEN];
+
+  if (ctx.interval != 0)
+    return ctx.interval;
+
+  FORMAT_VL(name, sizeof(name), vl);
+  ERROR("plugin_value_list_clone: Unable to determine "
+        "interval from context for "
+        "value list \"%s\". "
+        "This indicates a broken plugin. "
+        "Please report this problem to the "
+        "collectd mailing list or at "
+        "<http://collectd.org/bugs/>.",
+        name);
+  return cf_get_default_interval();
+} /* }}} cdtime_t plugin_value_list_interval */
+
+static value_list_t *
+plugin_value_list_clone(value_list_t const *vl_orig) /* {{{ */
+{
+  value_list_pooled_t *pvl;
+  value_list_t *vl;
+
+  if (vl_orig == NULL)
+    return NULL;
+
+  pthread_once(&plugin_pools_once, plugin_pools_create);
+  pvl = c_pool_alloc(value_list_pool);
+  if (pvl == NULL)
+    return NULL;
+  vl = &pvl->vl;
+  memcpy(vl, vl_orig, sizeof(*vl));
+  vl->meta = NULL;
+  vl->shared_owner = NULL;
+  pvl->refs = 1;
+
+  if (vl->host[0] == 0)
+    sstrncpy(vl->host, hostname_g, sizeof(vl->host));
+
+  if (vl_orig->values_len <= VALUE_LIST_INLINE_VALUES)
+    vl->values = pvl->values;
+  else
+    vl->values = calloc(vl_orig->values_len, sizeof(*vl->values));
+  if (vl->values == NULL) {
+    plugin_value_list_free(vl);
+    return NULL;
+  }
+  memcpy(vl->values, vl_orig->values,
+         vl_orig->values_len * sizeof(*vl->values));
+
+  vl->meta = meta_data_clone(vl_orig->meta);
+  if ((vl_orig->meta != NULL) && (vl->meta == NULL)) {
+    plugin_value_list_free(vl);
+    return NULL;
+  }
+
+  if (vl->time == 0)
+    vl->time = cdtime();
+  if (vl->interval == 0)
+    vl->interval = plugin_value_list_interval(vl);
+
+  return vl;
+} /* }}} value_list_t *plugin_value_list_clone */
+
+static void value_list_compact_free(value_list_compact_t *cvl) /* {{{ */
+{
+  if (cvl == NULL)
+    return;
+
+  meta_data_destroy(cvl->meta);
+  if (cvl->pooled)
+    c_pool_free(value_list_compact_pool, cvl);
+  else
+    free(cvl);
+} /* }}} void value_list_compact_free */
+
+/* Returns the interned copy of "name". "cached" is the string the calling
+ * thread interned last for the same field; it is reused if it is still
+ * equal, which avoids hashing the name for every value list. */
+static char const *value_list_compact_intern(char const **cached, /* {{{ */
+                                             char const *name) {
+  if ((*cached != NULL) && (strcmp(*cached, name) == 0))
+    return *cached;
+
+  char const *ret = c_intern(value_list_names, name);
+  if (ret != NULL)
+    *cached = ret;
+  return ret;
+} /* }}} char const *value_list_compact_intern */
+
+/* Returns a compact copy of "vl", filling in the host, time and interval like
+ * plugin_value_list_clone(). */
+static value_list_compact_t *
+value_list_compact_create(value_list_t const *vl) /* {{{ */
+{
+  value_list_compact_t *cvl;
+  size_t plugin_instance_size;
+  size_t type_instance_size;
+  size_t size;
+  char *ptr;
+
+  pthread_once(&plugin_pools_once, plugin_pools_create);
+  if ((value_list_names == NULL) || (value_list_compact_pool == NULL))
+    return NULL;
+
+  plugin_instance_size =
+      strnlen(vl->plugin_instance, sizeof(vl->plugin_instance) - 1) + 1;
+  type_instance_size =
+      strnlen(vl->type_instance, sizeof(vl->type_instance) - 1) + 1;
+
+  size = sizeof(*cvl) + vl->values_len * sizeof(*cvl->values) +
+         plugin_instance_size + type_instance_size;
+  if (size <= VALUE_LIST_COMPACT_POOLED_SIZE)
+    cvl = c_pool_alloc(value_list_compact_pool);
+  else
+    cvl = malloc(size);
+  if (cvl == NULL)
+    return NULL;
+  cvl->pooled = (size <= VALUE_LIST_COMPACT_POOLED_SIZE);
+  cvl->meta = NULL;
+
+  /* Without per-thread state, every name is looked up in the table. */
+  write_queue_producer_t fallback = {0};
+  write_queue_producer_t *p = write_queue_producer_get();
+  if (p == NULL)
+    p = &fallback;
+
+  cvl->host = value_list_compact_intern(
+      &p->host, (vl->host[0] != 0) ? vl->host : hostname_g);
+  cvl->plugin = value_list_compact_intern(&p->plugin, vl->plugin);
+  cvl->type = value_list_compact_intern(&p->type, vl->type);
+  if ((cvl->host == NULL) || (cvl->plugin == NULL) || (cvl->type == NULL)) {
+    value_list_compact_free(cvl);
+    return NULL;
+  }
+
+  cvl->values_len = vl->values_len;
+  memcpy(cvl->values, vl->values, vl->values_len * sizeof(*cvl->values));
+
+  ptr = (char *)(cvl->values + vl->values_len);
+  sstrncpy(ptr, vl->plugin_instance, plugin_instance_size);
+  cvl->plugin_instance = ptr;
+  ptr += plugin_instance_size;
+  sstrncpy(ptr, vl->type_instance, type_instance_size);
+  cvl->type_instance = ptr;
+
+  cvl->meta = meta_data_clone(vl->meta);
+  if ((vl->meta != NULL) && (cvl->meta == NULL)) {
+    value_list_compact_free(cvl);
+    return NULL;
+  }
+
+  cvl->type_id = vl->type_id;
+  cvl->time = (vl->time != 0) ? vl->time : cdtime();
+  cvl->interval =
+      (vl->interval != 0) ? vl->interval : plugin_value_list_interval(vl);
+
+  return cvl;
+} /* }}} value_list_compact_t *value_list_compact_create */
+
+/* Returns a value list like plugin_value_list_clone() with the content of
+ * "cvl" and frees "cvl". */
+static value_list_t *
+value_list_compact_expand(value_list_compact_t *cvl) /* {{{ */
+{
+  value_list_pooled_t *pvl;
+  value_list_t *vl;
+
+  pvl = c_pool_alloc(value_list_pool);
+  if (pvl == NULL) {
+    value_list_compact_free(cvl);
+    return NULL;
+  }
+  vl = &pvl->vl;
+  *vl = (value_list_t){
+      .values_len = cvl->values_len,
+      .time = cvl->time,
+      .interval = cvl->interval,
+      .meta = cvl->meta,
+      .type_id = cvl->type_id,
+  };
+  pvl->refs = 1;
+  cvl->meta = NULL;
+
+  sstrncpy(vl->host, cvl->host, sizeof(vl->host));
+  sstrncpy(vl->plugin, cvl->plugin, sizeof(vl->plugin));
+  sstrncpy(vl->plugin_instance, cvl->plugin_instance,
+           sizeof(vl->plugin_instance));
+  sstrncpy(vl->type, cvl->type, sizeof(vl->type));
+  sstrncpy(vl->type_instance, cvl->type_instance, sizeof(vl->type_instance));
+
+  if (cvl->values_len <= VALUE_LIST_INLINE_VALUES)
+    vl->values = pvl->values;
+  else
+    vl->values = calloc(cvl->values_len, sizeof(*vl->values));
+  if (vl->values == NULL) {
+    value_list_compact_free(cvl);
+    plugin_value_list_free(vl);
+    return NULL;
+  }
+  memcpy(vl->values, cvl->values, cvl->values_len * sizeof(*vl->values));
+
+  value_list_compact_free(cvl);
+  return vl;
+} /* }}} value_list_t *value_list_compact_expand */
+
+/* Makes a value list returned by plugin_value_list_clone() immutable, so that
+ * references to it can be handed out. "identity" is its identity, if known. */
+static void plugin_value_list_share(value_list_t *vl, /* {{{ */
+                                    value_list_identity_t const *identity) {
+  value_list_pooled_t *pvl = (value_list_pooled_t *)vl;
+
+  if (vl->shared_owner == vl)
+    return;
+
+  if (identity != NULL) {
+    pvl->identity = *identity;
+    vl->identity = &pvl->identity;
+    vl->identity_owner = vl;
+  } else
+    VALUE_LIST_IDENTITY_INVALIDATE(vl);
+
+  vl->shared_owner = vl;
+} /* }}} void plugin_value_list_share */
+
+value_list_t *plugin_value_list_retain(value_list_t const *vl) /* {{{ */
+{
+  if (vl == NULL)
+    return NULL;
+
+  if (vl->shared_owner == vl) {
+    VALUE_LIST_REF((value_list_pooled_t *)vl);
+    return (value_list_t *)vl;
+  }
+
+  value_list_t *copy = plugin_value_list_clone(vl);
+  if (copy != NULL)
+    plugin_value_list_share(copy, VALUE_LIST_IDENTITY(vl));
+  return copy;
+} /* }}} value_list_t *plugin_value_list_retain */
+
+void plugin_value_list_release(value_list_t *vl) /* {{{ */
+{
+  if (vl == NULL)
+    return;
+
+  if (VALUE_LIST_UNREF((value_list_pooled_t *)vl) == 0)
+    plugin_value_list_free(vl);
+} /* }}} void plugin_value_list_release */
+
+static void write_queue_producer_key_create(void) /* {{{ */
+{
+  pthread_key_create(&write_queue_producer_key, free);
+} /* }}} void write_queue_producer_key_create */
+
+static write_queue_shards_t *write_queue_shards_get(void) /* {{{ */
+{
+#if defined(__ATOMIC_ACQUIRE)
+  return __atomic_load_n(&write_queue_shards, __ATOMIC_ACQUIRE);
+#else
+  return write_queue_shards;
+#endif
+} /* }}} write_queue_shards_t *write_queue_shards_get */
+
+static void write_queue_shards_set(write_queue_shards_t *ws) /* {{{ */
+{
+#if defined(__ATOMIC_RELEASE)
+  __atomic_store_n(&write_queue_shards, ws, __ATOMIC_RELEASE);
+#else
+  write_queue_shards = ws;
+#endif
+} /* }}} void write_queue_shards_set */
+
+/* Returns the producer state of the calling thread, creating it if necessary,
+ * or NULL if memory could not be allocated. */
+static write_queue_producer_t *write_queue_producer_get(void) /* {{{ */
+{
+  write_queue_producer_t *p;
+
+  pthread_once(&write_queue_producer_once, write_queue_producer_key_create);
+
+  p = pthread_getspecific(write_queue_producer_key);
+  if (p != NULL)
+    return p;
+
+  p = calloc(1, sizeof(*p));
+  if (p == NULL)
+    return NULL;
+
+  pthread_mutex_lock(&write_queue_producer_lock);
+  p->next_shard = write_queue_producer_num++;
+  pthread_mutex_unlock(&write_queue_producer_lock);
+
+  pthread_setspecific(write_queue_producer_key, p);
+  return p;
+} /* }}} write_queue_producer_t *write_queue_producer_get */
+
+/* Returns the shard the calling thread will enqueue its next value list to.
+ * Each producer thread starts at a different offset, so that multiple
+ * producers rarely hit the same shard at the same time. */
+static write_queue_shard_t *write_queue_next_shard(_Bool advance) /* {{{ */
+{
+  write_queue_shards_t *ws = write_queue_shards_get();
+  write_queue_producer_t *p;
+
+  if (ws->num == 1)
+    return ws->shards;
+
+  p = write_queue_producer_get();
+  if (p == NULL)
+    return ws->shards;
+
+  size_t idx = p->next_shard % ws->num;
+  if (advance)
+    p->next_shard = idx + 1;
+
+  return ws->shards + idx;
+} /* }}} write_queue_shard_t *write_queue_next_shard */
+
+static long write_queue_length_get(void) /* {{{ */
+{
+  write_queue_shards_t *ws = write_queue_shards_get();
+  long length = 0;
+
+  for (size_t i = 0; i < ws->num; i++) {
+    write_queue_shard_t *shard = ws->shards + i;
+
+    pthread_mutex_lock(&shard->lock);
+    length += shard->length;
+    pthread_mutex_unlock(&shard->lock);
+  }
+
+  return length;
+} /* }}} long write_queue_length_get */
+
+/* Allocates "num" shards and moves everything queued so far into the first
+ * one. Must be called before the write threads are started; producers may
+ * already be running. */
+static int write_queue_shards_create(size_t num) /* {{{ */
+{
+  write_queue_shards_t *ws;
+  write_queue_shard_t *shards;
+
+  if ((num <= 1) || (write_queue_shards_get() != &write_queue_default_shards))
+    return 0;
+
+  ws = calloc(1, sizeof(*ws));
+  shards = calloc(num, sizeof(*shards));
+  if ((ws == NULL) || (shards == NULL)) {
+    ERROR("plugin: write_queue_shards_create: calloc failed.");
+    sfree(ws);
+    sfree(shards);
+    return ENOMEM;
+  }
+  ws->shards = shards;
+  ws->num = num;
+
+  for (size_t i = 0; i < num; i++) {
+    pthread_mutex_init(&shards[i].lock, /* attr = */ NULL);
+    pthread_cond_init(&shards[i].cond, /* attr = */ NULL);
+  }
+
+  pthread_mutex_lock(&write_queue_default_shard.lock);
+  shards[0].head = write_queue_default_shard.head;
+  shards[0].tail = write_queue_default_shard.tail;
+  shards[0].length = write_queue_default_shard.length;
+  write_queue_default_shard.head = NULL;
+  write_queue_default_shard.tail = NULL;
+  write_queue_default_shard.length = 0;
+
+  /* Published with the default shard locked, see write_queue_append(). */
+  write_queue_shards_set(ws);
+  pthread_mutex_unlock(&write_queue_default_shard.lock);
+
+  return 0;
+} /* }}} int write_queue_shards_create */
+
+static void write_queue_shards_destroy(void) /* {{{ */
+{
+  write_queue_shards_t *ws = write_queue_shards_get();
+
+  if (ws == &write_queue_default_shards)
+    return;
+
+  write_queue_shards_set(&write_queue_default_shards);
+
+  for (size_t i = 0; i < ws->num; i++) {
+    pthread_mutex_destroy(&ws->shards[i].lock);
+    pthread_cond_destroy(&ws->shards[i].cond);
+  }
+  sfree(ws->shards);
+  sfree(ws);
+} /* }}} void write_queue_shards_destroy */
+
+static write_queue_t *write_queue_entry_create(value_list_t const *vl) /* {{{ */
+{
+  write_queue_t *q;
+
+  q = write_queue_alloc();
+  if (q == NULL)
+    return NULL;
+  q->next = NULL;
+  q->ds = NULL;
+  q->vl = NULL;
+
+  q->cvl = value_list_compact_create(vl);
+  if (q->cvl == NULL) {
+    write_queue_free(q);
+    return NULL;
+  }
+  q->enqueued = dispatch_latency_sample() ? cdtime_precise() : 0;
+#if defined(__ATOMIC_RELAXED)
+  q->queued = __atomic_load_n(&write_queue_clock, __ATOMIC_RELAXED);
+#else
+  q->queued = write_queue_clock;
+#endif
+
+  /* Store context of caller (read plugin); otherwise, it would not be
+   * available to the write plugins when actually dispatching the
+   * value-list later on. */
+  q->ctx = plugin_get_ctx();
+
+  return q;
+} /* }}} write_queue_t *write_queue_entry_create */
+
+/* Appends the "num" entries from "head" to "tail" to the next shard. */
+static void write_queue_append(write_queue_t *head, /* {{{ */
+                               write_queue_t *tail, long num) {
+  write_queue_shard_t *shard;
+
+  while (1) {
+    shard = write_queue_next_shard(/* advance = */ 1);
+    pthread_mutex_lock(&shard->lock);
+
+    /* The default shard is retired once the configured shards have been
+     * published. Entries appended to it afterwards would never be taken. */
+    if ((shard != &write_queue_default_shard) ||
+        (write_queue_shards_get() == &write_queue_default_shards))
+      break;
+    pthread_mutex_unlock(&shard->lock);
+  }
+
+  if (shard->tail == NULL) {
+    shard->head = head;
+    shard->tail = tail;
+    shard->length = num;
+  } else {
+    shard->tail->next = head;
+    shard->tail = tail;
+    shard->length += num;
+  }
+
+  if (num == 1)
+    pthread_cond_signal(&shard->cond);
+  else
+    pthread_cond_broadcast(&shard->cond);
+  pthread_mutex_unlock(&shard->lock);
+} /* }}} void write_queue_append */
+
+static int plugin_write_enqueue(value_list_t const *vl) /* {{{ */
+{
+  write_queue_t *q;
+
+  q = write_queue_entry_create(vl);
+  if (q == NULL)
+    return ENOMEM;
+
+  write_queue_append(q, q, 1);
+  return 0;
+} /* }}} int plugin_write_enqueue */
+
+/* Detaches up to "write_queue_batch_size" entries from "shard". The caller
+ * must hold the shard's lock. */
+static write_queue_t *write_queue_shard_take(write_queue_shard_t *shard) /* {{{ */
+{
+  write_queue_t *first = shard->head;
+  write_queue_t *last = first;
+  long num = 1;
+
+  if (first == NULL)
+    return NULL;
+
+  while ((last->next != NULL) && (num < (long)write_queue_batch_size)) {
+    last = last->next;
+    num++;
+  }
+
+  shard->head = last->next;
+  shard->length -= num;
+  if (shard->head == NULL) {
+    shard->tail = NULL;
+    assert(0 == shard->length);
+  }
+
+  last->next = NULL;
+  return first;
+} /* }}} write_queue_t *write_queue_shard_take */
+
+/* Returns a list of one or more queue entries. Blocks on the home shard of
+ * the calling write thread until entries become available or the write
+ * thread "idx" is being stopped. Other shards are checked, without blocking,
+ * before going to sleep. */
+static write_queue_t *plugin_write_dequeue(size_t idx) /* {{{ */
+{
+  write_queue_shards_t *ws = write_queue_shards_get();
+  size_t home = idx % ws->num;
+  write_queue_shard_t *shard = ws->shards + home;
+  write_queue_t *q;
+
+  pthread_mutex_lock(&shard->lock);
+  q = write_queue_shard_take(shard);
+  pthread_mutex_unlock(&shard->lock);
+  if (q != NULL)
+    return q;
+
+  for (size_t i = 1; i < ws->num; i++) {
+    write_queue_shard_t *other = ws->shards + ((home + i) % ws->num);
+
+    if (pthread_mutex_trylock(&other->lock) != 0)
+      continue;
+    q = write_queue_shard_take(other);
+    pthread_mutex_unlock(&other->lock);
+    if (q != NULL)
+      return q;
+  }
+
+  pthread_mutex_lock(&shard->lock);
 
-    DEBUG("plugin_read_thread: Handling `%s'.", rf->rf_name);
+  while (write_loop && (idx < write_threads_limit) && (shard->head == NULL))
+    pthread_cond_wait(&shard->cond, &shard->lock);
 
-    start = cdtime();
+  q = write_queue_shard_take(shard);
 
-    old_ctx = plugin_set_ctx(rf->rf_ctx);
+  pthread_mutex_unlock(&shard->lock);
+  return q;
+} /* }}} write_queue_t *plugin_write_dequeue */
 
-    if (rf_type == RF_SIMPLE) {
-      int (*callback)(void);
+static void *plugin_write_thread(void *args) /* {{{ */
+{
+  size_t idx = (size_t)(uintptr_t)args;
 
-      callback = rf->rf_callback;
-      status = (*callback)();
-    } else {
-      plugin_read_cb callback;
+  while (write_loop && (idx < write_threads_limit)) {
+    write_queue_t *q = plugin_write_dequeue(idx);
 
-      assert(rf_type == RF_COMPLEX);
+    while (q != NULL) {
+      write_queue_t *next = q->next;
 
-      callback = rf->rf_callback;
-      status = (*callback)(&rf->rf_udata);
+      if (q->enqueued != 0)
+        dispatch_latency_add(&dispatch_stages[DISPATCH_STAGE_QUEUE],
+                             q->enqueued);
+
+      (void)plugin_set_ctx(q->ctx);
+      value_list_t *vl = value_list_compact_expand(q->cvl);
+      if (vl != NULL)
+        plugin_dispatch_values_internal(vl);
+      else
+        ERROR("plugin_write_thread: value_list_compact_expand failed.");
+
+      plugin_value_list_release(vl);
+      write_queue_free(q);
+      q = next;
     }
+  }
 
-    plugin_set_ctx(old_ctx);
+  pthread_exit(NULL);
+  return (void *)0;
+} /* }}} void *plugin_write_thread */
 
-    /* If the function signals failure, we will increase the
-     * intervals in which it will be called. */
-    if (status != 0) {
-      rf->rf_effective_interval *= 2;
-      if (rf->rf_effective_interval > max_read_interval)
-        rf->rf_effective_interval = max_read_interval;
+/* Starts the write thread with index "write_threads_num". */
+static int start_write_thread(void) /* {{{ */
+{
+  size_t idx = write_threads_num;
 
-      NOTICE("read-function of plugin `%s' failed. "
-             "Will suspend it for %.3f seconds.",
-             rf->rf_name, CDTIME_T_TO_DOUBLE(rf->rf_effective_interval));
-    } else {
-      /* Success: Restore the interval, if it was changed. */
-      rf->rf_effective_interval = rf->rf_interval;
-    }
+  int status = pthread_create(write_threads + idx, /* attr = */ NULL,
+                              plugin_write_thread,
+                              /* arg = */ (void *)(uintptr_t)idx);
+  if (status != 0) {
+    ERROR("plugin: start_write_thread: pthread_create failed with status %i "
+          "(%s).",
+          status, STRERROR(status));
+    return status;
+  }
 
-    /* update the ``next read due'' field */
-    now = cdtime();
+  char name[THREAD_NAME_MAX];
+  snprintf(name, sizeof(name), "writer#%" PRIsz, idx);
+  set_thread_name(write_threads[idx], name);
+  set_thread_affinity(write_threads[idx],
+                      global_option_get("WriteThreadsAffinity"));
 
-    /* calculate the time spent in the read function */
-    elapsed = (now - start);
+  write_threads_num++;
+  return 0;
+} /* }}} int start_write_thread */
 
-    if (elapsed > rf->rf_effective_interval)
-      WARNING(
-          "plugin_read_thread: read-function of the `%s' plugin took %.3f "
-          "seconds, which is above its read interval (%.3f seconds). You might "
-          "want to adjust the `Interval' or `ReadThreads' settings.",
-          rf->rf_name, CDTIME_T_TO_DOUBLE(elapsed),
-          CDTIME_T_TO_DOUBLE(rf->rf_effective_interval));
+/* Returns the length of the write queue and, in "age", the age of its oldest
+ * entry. */
+static long write_queue_pressure(cdtime_t now, cdtime_t *age) /* {{{ */
+{
+  write_queue_shards_t *ws = write_queue_shards_get();
+  long length = 0;
+
+  *age = 0;
+  for (size_t i = 0; i < ws->num; i++) {
+    write_queue_shard_t *shard = ws->shards + i;
+
+    pthread_mutex_lock(&shard->lock);
+    length += shard->length;
+    if ((shard->head != NULL) && (shard->head->queued != 0) &&
+        (now > shard->head->queued) && (now - shard->head->queued > *age))
+      *age = now - shard->head->queued;
+    pthread_mutex_unlock(&shard->lock);
+  }
 
-    DEBUG("plugin_read_thread: read-function of the `%s' plugin took "
-          "%.6f seconds.",
-          rf->rf_name, CDTIME_T_TO_DOUBLE(elapsed));
+  return length;
+} /* }}} long write_queue_pressure */
 
-    DEBUG("plugin_read_thread: Effective interval of the "
-          "`%s' plugin is %.3f seconds.",
-          rf->rf_name, CDTIME_T_TO_DOUBLE(rf->rf_effective_interval));
+/* Stops the most recently started write thread. Blocks until the thread has
+ * finished the entries it is currently handling. */
+static void write_threads_shrink(void) /* {{{ */
+{
+  write_queue_shards_t *ws = write_queue_shards_get();
+  size_t idx = write_threads_num - 1;
+  write_queue_shard_t *shard = ws->shards + (idx % ws->num);
 
-    /* Calculate the next (absolute) time at which this function
-     * should be called. */
-    rf->rf_next_read += rf->rf_effective_interval;
+  pthread_mutex_lock(&shard->lock);
+  write_threads_limit = idx;
+  pthread_cond_broadcast(&shard->cond);
+  pthread_mutex_unlock(&shard->lock);
 
-    /* Check, if `rf_next_read' is in the past. */
-    if (rf->rf_next_read < now) {
-      /* `rf_next_read' is in the past. Insert `now'
-       * so this value doesn't trail off into the
-       * past too much. */
-      rf->rf_next_read = now;
-    }
+  if (pthread_join(write_threads[idx], NULL) != 0)
+    ERROR("plugin: write_threads_shrink: pthread_join failed.");
+  write_threads[idx] = (pthread_t)0;
 
-    DEBUG("plugin_read_thread: Next read of the `%s' plugin at %.3f.",
-          rf->rf_name, CDTIME_T_TO_DOUBLE(rf->rf_next_read));
+  pthread_mutex_lock(&write_scaler_lock);
+  write_threads_num--;
+  pthread_mutex_unlock(&write_scaler_lock);
+} /* }}} void write_threads_shrink */
 
-    /* Re-insert this read function into the heap again. */
-    c_heap_insert(read_heap, rf);
-  } /* while (read_loop) */
+static void write_threads_grow(void) /* {{{ */
+{
+  write_threads_limit = write_threads_num + 1;
 
-  pthread_exit(NULL);
-  return (void *)0;
-} /* void *plugin_read_thread */
+  pthread_mutex_lock(&write_scaler_lock);
+  if (start_write_thread() != 0)
+    write_threads_limit = write_threads_num;
+  pthread_mutex_unlock(&write_scaler_lock);
+} /* }}} void write_threads_grow */
 
-#ifdef PTHREAD_MAX_NAMELEN_NP
-#define THREAD_NAME_MAX PTHREAD_MAX_NAMELEN_NP
+static void *plugin_write_scaler(void *args) /* {{{ */
+{
+  cdtime_t idle_since = 0;
+
+  pthread_mutex_lock(&write_scaler_lock);
+  while (write_loop) {
+    cdtime_t now = cdtime();
+#if defined(__ATOMIC_RELAXED)
+    __atomic_store_n(&write_queue_clock, now, __ATOMIC_RELAXED);
 #else
-#define THREAD_NAME_MAX 16
+    write_queue_clock = now;
 #endif
+    pthread_mutex_unlock(&write_scaler_lock);
+
+    cdtime_t age;
+    long length = write_queue_pressure(now, &age);
+
+    if ((length > write_scale_length) || (age > write_scale_age)) {
+      idle_since = 0;
+      if (write_threads_num < write_threads_max) {
+        write_threads_grow();
+        DEBUG("plugin: Write queue length %ld, age %.3f: now using %" PRIsz
+              " write threads.",
+              length, CDTIME_T_TO_DOUBLE(age), write_threads_num);
+      }
+    } else if ((length > write_scale_length / 4) ||
+               (age > write_scale_age / 4)) {
+      idle_since = 0;
+    } else if (idle_since == 0) {
+      idle_since = now;
+    } else if ((now - idle_since >= write_scale_idle) &&
+               (write_threads_num > write_threads_min)) {
+      write_threads_shrink();
+      idle_since = now;
+      DEBUG("plugin: Write queue idle: now using %" PRIsz " write threads.",
+            write_threads_num);
+    }
 
-static void set_thread_name(pthread_t tid, char const *name) {
-#if defined(HAVE_PTHREAD_SETNAME_NP) || defined(HAVE_PTHREAD_SET_NAME_NP)
-
-  /* glibc limits the length of the name and fails if the passed string
-   * is too long, so we truncate it here. */
-  char n[THREAD_NAME_MAX];
-  if (strlen(name) >= THREAD_NAME_MAX)
-    WARNING("set_thread_name(\"%s\"): name too long", name);
-  sstrncpy(n, name, sizeof(n));
-
-#if defined(HAVE_PTHREAD_SETNAME_NP)
-  int status = pthread_setname_np(tid, n);
-  if (status != 0) {
-    ERROR("set_thread_name(\"%s\"): %s", n, STRERROR(status));
+    pthread_mutex_lock(&write_scaler_lock);
+    if (write_loop)
+      pthread_cond_timedwait(
+          &write_scaler_cond, &write_scaler_lock,
+          &CDTIME_T_TO_TIMESPEC(now + WRITE_SCALER_INTERVAL));
   }
-#else /* if defined(HAVE_PTHREAD_SET_NAME_NP) */
-  pthread_set_name_np(tid, n);
-#endif
+  pthread_mutex_unlock(&write_scaler_lock);
 
-#endif
-}
+  return (void *)0;
+} /* }}} void *plugin_write_scaler */
 
-static void start_read_threads(size_t num) /* {{{ */
+static void start_write_threads(size_t num) /* {{{ */
 {
-  if (read_threads != NULL)
+  if (write_threads != NULL)
     return;
 
-  read_threads = (pthread_t *)calloc(num, sizeof(pthread_t));
-  if (read_threads == NULL) {
-    ERROR("plugin: start_read_threads: calloc failed.");
+  write_threads = calloc((write_threads_max > num) ? write_threads_max : num,
+                         sizeof(pthread_t));
+  if (write_threads == NULL) {
+    ERROR("plugin: start_write_threads: calloc failed.");
     return;
   }
 
-  read_threads_num = 0;
+  write_threads_num = 0;
   for (size_t i = 0; i < num; i++) {
-    int status = pthread_create(read_threads + read_threads_num,
-                                /* attr = */ NULL, plugin_read_thread,
-                                /* arg = */ NULL);
-    if (status != 0) {
-      ERROR("plugin: start_read_threads: pthread_create failed with status %i "
-            "(%s).",
-            status, STRERROR(status));
+    if (start_write_thread() != 0)
       return;
-    }
+  }
 
-    char name[THREAD_NAME_MAX];
-    snprintf(name, sizeof(name), "reader#%" PRIsz, read_threads_num);
-    set_thread_name(read_threads[read_threads_num], name);
+  if (write_threads_max <= write_threads_num)
+    return;
 
-    read_threads_num++;
-  } /* for (i) */
-} /* }}} void start_read_threads */
+  write_threads_min = write_threads_num;
+  write_threads_limit = write_threads_num;
+  write_queue_clock = cdtime();
 
-static void stop_read_threads(void) {
-  if (read_threads == NULL)
+  int status = pthread_create(&write_scaler, /* attr = */ NULL,
+                              plugin_write_scaler, /* arg = */ NULL);
+  if (status != 0) {
+    ERROR("plugin: start_write_threads: pthread_create failed with status %i "
+          "(%s).",
+          status, STRERROR(status));
     return;
+  }
+  set_thread_name(write_scaler, "writer scaler");
+  write_scaler_running = 1;
+  INFO("plugin: Using %" PRIsz " to %" PRIsz " write threads.",
+       write_threads_min, write_threads_max);
+} /* }}} void start_write_threads */
 
-  INFO("collectd: Stopping %" PRIsz " read threads.", read_threads_num);
+static void stop_write_threads(void) /* {{{ */
+{
+  write_queue_shards_t *ws = write_queue_shards_get();
+  write_queue_t *q;
+  size_t i;
 
-  pthread_mutex_lock(&read_lock);
-  read_loop = 0;
-  DEBUG("plugin: stop_read_threads: Signalling `read_cond'");
-  pthread_cond_broadcast(&read_cond);
-  pthread_mutex_unlock(&read_lock);
+  if (write_threads == NULL)
+    return;
 
-  for (size_t i = 0; i < read_threads_num; i++) {
-    if (pthread_join(read_threads[i], NULL) != 0) {
-      ERROR("plugin: stop_read_threads: pthread_join failed.");
+  INFO("collectd: Stopping %" PRIsz " write threads.", write_threads_num);
+
+  pthread_mutex_lock(&write_scaler_lock);
+  write_loop = 0;
+  pthread_cond_signal(&write_scaler_cond);
+  pthread_mutex_unlock(&write_scaler_lock);
+
+  if (write_scaler_running) {
+    pthread_join(write_scaler, NULL);
+    write_scaler_running = 0;
+  }
+
+  for (size_t j = 0; j < ws->num; j++) {
+    write_queue_shard_t *shard = ws->shards + j;
+
+    pthread_mutex_lock(&shard->lock);
+    DEBUG("plugin: stop_write_threads: Signalling `cond' of shard %" PRIsz, j);
+    pthread_cond_broadcast(&shard->cond);
+    pthread_mutex_unlock(&shard->lock);
+  }
+
+  for (i = 0; i < write_threads_num; i++) {
+    if (pthread_join(write_threads[i], NULL) != 0) {
+      ERROR("plugin: stop_write_threads: pthread_join failed.");
     }
-    read_threads[i] = (pthread_t)0;
+    write_threads[i] = (pthread_t)0;
   }
-  sfree(read_threads);
-  read_threads_num = 0;
-} /* void stop_read_threads */
+  sfree(write_threads);
+  write_threads_num = 0;
 
-static void plugin_value_list_free(value_list_t *vl) /* {{{ */
-{
-  if (vl == NULL)
-    return;
+  i = 0;
+  for (size_t j = 0; j < ws->num; j++) {
+    write_queue_shard_t *shard = ws->shards + j;
+
+    pthread_mutex_lock(&shard->lock);
+    for (q = shard->head; q != NULL;) {
+      write_queue_t *q1 = q;
+      value_list_compact_free(q->cvl);
+      q = q->next;
+      write_queue_free(q1);
+      i++;
+    }
+    shard->head = NULL;
+    shard->tail = NULL;
+    shard->length = 0;
+    pthread_mutex_unlock(&shard->lock);
+  }
 
-  meta_data_destroy(vl->meta);
-  sfree(vl->values);
-  sfree(vl);
-} /* }}} void plugin_value_list_free */
+  write_queue_shards_destroy();
 
-static value_list_t *
-plugin_value_list_clone(value_list_t const *vl_orig) /* {{{ */
+  if (i > 0) {
+    WARNING("plugin: %" PRIsz " value list%s left after shutting down "
+            "the write threads.",
+            i, (i == 1) ? " was" : "s were");
+  }
+} /* }}} void stop_write_threads */
+
+static void write_func_drop(write_func_t *wf, write_queue_t *q) /* {{{ */
 {
-  value_list_t *vl;
+  /* `wf_lock' is held by the caller. */
+  wf->wf_dropped++;
+  plugin_value_list_release(q->vl);
+  write_queue_free(q);
+} /* }}} void write_func_drop */
+
+/* Appends "vl" to the journal of "wf". Value lists which can't be written are
+ * counted as dropped. `wf_lock' must not be held by the caller. */
+static void write_func_spill(write_func_t *wf, /* {{{ */
+                             value_list_t const *vl) {
+  int status = spill_write(wf->wf_spill, vl);
+
+  pthread_mutex_lock(&wf->wf_lock);
+  if (status == 0)
+    wf->wf_spilled++;
+  else
+    wf->wf_dropped++;
+  pthread_mutex_unlock(&wf->wf_lock);
+} /* }}} void write_func_spill */
+
+/* Appends a reference to "vl" to the dedicated queue of "wf", applying the
+ * configured policy when the queue is full. */
+static int write_func_enqueue(write_func_t *wf, /* {{{ */
+                              const data_set_t *ds, const value_list_t *vl) {
+  write_queue_t *q;
+  long limit = wf->wf_ctx.write_queue_limit;
 
-  if (vl_orig == NULL)
-    return NULL;
+  q = write_queue_alloc();
+  if (q == NULL)
+    return ENOMEM;
+  q->next = NULL;
+  q->ds = ds;
+  q->ctx = plugin_get_ctx();
+  q->cvl = NULL;
+  q->enqueued = 0;
+  q->queued = 0;
 
-  vl = malloc(sizeof(*vl));
-  if (vl == NULL)
-    return NULL;
-  memcpy(vl, vl_orig, sizeof(*vl));
+  q->vl = plugin_value_list_retain(vl);
+  if (q->vl == NULL) {
+    write_queue_free(q);
+    return ENOMEM;
+  }
 
-  if (vl->host[0] == 0)
-    sstrncpy(vl->host, hostname_g, sizeof(vl->host));
+  pthread_mutex_lock(&wf->wf_lock);
 
-  vl->values = calloc(vl_orig->values_len, sizeof(*vl->values));
-  if (vl->values == NULL) {
-    plugin_value_list_free(vl);
-    return NULL;
+  if ((limit > 0) && (wf->wf_queue_length >= limit) &&
+      (wf->wf_spill != NULL)) {
+    pthread_mutex_unlock(&wf->wf_lock);
+    write_func_spill(wf, q->vl);
+    plugin_value_list_release(q->vl);
+    write_queue_free(q);
+    return 0;
   }
-  memcpy(vl->values, vl_orig->values,
-         vl_orig->values_len * sizeof(*vl->values));
 
-  vl->meta = meta_data_clone(vl->meta);
-  if ((vl_orig->meta != NULL) && (vl->meta == NULL)) {
-    plugin_value_list_free(vl);
+  if ((limit > 0) && (wf->wf_queue_length >= limit)) {
+    switch (wf->wf_ctx.write_queue_policy) {
+    case WRITE_QUEUE_POLICY_DROP_OLD: {
+      write_queue_t *old = wf->wf_head;
+      wf->wf_head = old->next;
+      wf->wf_queue_length--;
+      if (wf->wf_head == NULL)
+        wf->wf_tail = NULL;
+      write_func_drop(wf, old);
+      break;
+    }
+    case WRITE_QUEUE_POLICY_BLOCK:
+      while (wf->wf_loop && (wf->wf_queue_length >= limit))
+        pthread_cond_wait(&wf->wf_cond_full, &wf->wf_lock);
+      if (wf->wf_loop)
+        break;
+    /* fall through */
+    default: /* WRITE_QUEUE_POLICY_DROP_NEW, or SPILL without a journal */
+      write_func_drop(wf, q);
+      pthread_mutex_unlock(&wf->wf_lock);
+      return ENOBUFS;
+    }
+  }
+
+  if (wf->wf_tail == NULL)
+    wf->wf_head = q;
+  else
+    wf->wf_tail->next = q;
+  wf->wf_tail = q;
+  wf->wf_queue_length++;
+
+  pthread_cond_signal(&wf->wf_cond);
+  pthread_mutex_unlock(&wf->wf_lock);
+
+  return 0;
+} /* }}} int write_func_enqueue */
+
+/* Detaches up to "max" entries from the dedicated queue of "wf". The caller
+ * must hold `wf_lock'. */
+static write_queue_t *write_func_take(write_func_t *wf, /* {{{ */
+                                      size_t max, size_t *ret_num) {
+  write_queue_t *first = wf->wf_head;
+  write_queue_t *last = first;
+  size_t num = 1;
+
+  *ret_num = 0;
+  if (first == NULL)
     return NULL;
+
+  while ((last->next != NULL) && (num < max)) {
+    last = last->next;
+    num++;
   }
 
-  if (vl->time == 0)
-    vl->time = cdtime();
+  wf->wf_head = last->next;
+  wf->wf_queue_length -= (long)num;
+  if (wf->wf_head == NULL)
+    wf->wf_tail = NULL;
+  last->next = NULL;
+
+  pthread_cond_broadcast(&wf->wf_cond_full);
+
+  *ret_num = num;
+  return first;
+} /* }}} write_queue_t *write_func_take */
+
+/* Hands a list of queue entries to the write callback of "wf" and frees the
+ * entries. "batch" must have room for "num" entries if "wf" is a batch
+ * callback. */
+static void write_func_deliver(write_func_t *wf, write_queue_t *q, /* {{{ */
+                               size_t num, write_batch_entry_t *batch) {
+  int status = 0;
+
+  /* Keep the context of the plugin that dispatched the values, just like
+   * plugin_write() does. */
+  if (q != NULL)
+    (void)plugin_set_ctx(q->ctx);
+
+  cdtime_t cpu_begin = plugin_cpu_begin();
+  if (wf->wf_batch) {
+    size_t i = 0;
+    for (write_queue_t *e = q; (e != NULL) && (i < num); e = e->next, i++)
+      batch[i] = (write_batch_entry_t){.ds = e->ds, .vl = e->vl};
+
+    cdtime_t begin = dispatch_latency_sample() ? cdtime_precise() : 0;
+    DISPATCH_PROBE1(write__start, wf->wf_name);
+    plugin_write_batch_cb callback = wf->wf_callback;
+    status = (*callback)(batch, i, &wf->wf_udata);
+    DISPATCH_PROBE2(write__done, wf->wf_name, status);
+    if (begin != 0)
+      dispatch_latency_add(&wf->wf_latency, begin);
+    if ((status != 0) && (wf->wf_spill != NULL))
+      for (write_queue_t *e = q; e != NULL; e = e->next)
+        write_func_spill(wf, e->vl);
+  } else {
+    plugin_write_cb callback = wf->wf_callback;
+    for (write_queue_t *e = q; e != NULL; e = e->next) {
+      cdtime_t begin = dispatch_latency_sample() ? cdtime_precise() : 0;
+      DISPATCH_PROBE1(write__start, wf->wf_name);
+      int tmp = (*callback)(e->ds, e->vl, &wf->wf_udata);
+      DISPATCH_PROBE2(write__done, wf->wf_name, tmp);
+      if (begin != 0)
+        dispatch_latency_add(&wf->wf_latency, begin);
+      if (tmp != 0) {
+        status = tmp;
+        if (wf->wf_spill != NULL)
+          write_func_spill(wf, e->vl);
+      }
+    }
+  }
+  plugin_cpu_end(&wf->wf_super, PLUGIN_CPU_WRITE, cpu_begin);
 
-  /* Fill in the interval from the thread context, if it is zero. */
-  if (vl->interval == 0) {
-    plugin_ctx_t ctx = plugin_get_ctx();
+  /* Replaying the journal is paused while the callback fails. */
+  if (wf->wf_spill != NULL) {
+    pthread_mutex_lock(&wf->wf_lock);
+    wf->wf_spill_failing = (status != 0);
+    pthread_mutex_unlock(&wf->wf_lock);
+  }
 
-    if (ctx.interval != 0)
-      vl->interval = ctx.interval;
-    else {
-      char name[6 * DATA_MAX_NAME_LEN];
-      FORMAT_VL(name, sizeof(name), vl);
-      ERROR("plugin_value_list_clone: Unable to determine "
-            "interval from context for "
-            "value list \"%s\". "
-            "This indicates a broken plugin. "
-            "Please report this problem to the "
-            "collectd mailing list or at "
-            "<http://collectd.org/bugs/>.",
-            name);
-      vl->interval = cf_get_default_interval();
+  if (status != 0)
+    DEBUG("plugin: write_func_deliver: Write callback \"%s\" failed with "
+          "status %i.",
+          wf->wf_name, status);
+
+  while (q != NULL) {
+    write_queue_t *next = q->next;
+    plugin_value_list_release(q->vl);
+    write_queue_free(q);
+    q = next;
+  }
+} /* }}} void write_func_deliver */
+
+/* Passes value lists from the journal of "wf" to the callback, limited to
+ * wf_ctx.write_spill_rate per second. `wf_lock' must be held by the caller;
+ * it is released while replaying. Returns false if there is nothing to
+ * replay. */
+static _Bool write_func_replay(write_func_t *wf, size_t max, /* {{{ */
+                               write_batch_entry_t *batch) {
+  if ((wf->wf_spill == NULL) || wf->wf_spill_failing ||
+      (spill_pending(wf->wf_spill) == 0))
+    return 0;
+
+  cdtime_t now = cdtime();
+  if (now < wf->wf_spill_next) {
+    pthread_cond_timedwait(&wf->wf_cond, &wf->wf_lock,
+                           &CDTIME_T_TO_TIMESPEC(wf->wf_spill_next));
+    return 1;
+  }
+
+  long rate = (wf->wf_ctx.write_spill_rate > 0) ? wf->wf_ctx.write_spill_rate
+                                                : WRITE_SPILL_RATE_DEFAULT;
+  size_t num = wf->wf_batch ? max : WRITE_SPILL_REPLAY_NUM;
+  if (num > (size_t)rate)
+    num = (size_t)rate;
+  wf->wf_spill_next = now + DOUBLE_TO_CDTIME_T(((double)num) / rate);
+  pthread_mutex_unlock(&wf->wf_lock);
+
+  write_queue_t *head = NULL;
+  write_queue_t *tail = NULL;
+  size_t n = 0;
+  while (n < num) {
+    value_list_t vl;
+    if (spill_read(wf->wf_spill, &vl) != 0)
+      break;
+
+    /* The data set may have changed since the value list was written. */
+    data_set_t const *ds = plugin_get_ds(vl.type);
+    write_queue_t *q = NULL;
+    if ((ds != NULL) && (ds->ds_num == vl.values_len))
+      q = write_queue_alloc();
+    if (q != NULL)
+      q->vl = plugin_value_list_retain(&vl);
+    sfree(vl.values);
+
+    if ((q == NULL) || (q->vl == NULL)) {
+      write_queue_free(q);
+      pthread_mutex_lock(&wf->wf_lock);
+      wf->wf_dropped++;
+      pthread_mutex_unlock(&wf->wf_lock);
+      continue;
     }
+    q->cvl = NULL;
+    q->ds = ds;
+    q->ctx = wf->wf_ctx;
+    q->next = NULL;
+
+    if (tail == NULL)
+      head = q;
+    else
+      tail->next = q;
+    tail = q;
+    n++;
   }
 
-  return vl;
-} /* }}} value_list_t *plugin_value_list_clone */
+  if (head != NULL)
+    write_func_deliver(wf, head, n, batch);
+
+  pthread_mutex_lock(&wf->wf_lock);
+  return 1;
+} /* }}} _Bool write_func_replay */
+
+static void *write_func_thread(void *arg) /* {{{ */
+{
+  write_func_t *wf = arg;
+  size_t max = wf->wf_batch ? wf->wf_batch_size : 1;
+  write_batch_entry_t *batch = NULL;
+
+  if (wf->wf_batch) {
+    batch = calloc(max, sizeof(*batch));
+    if (batch == NULL) {
+      ERROR("plugin: write_func_thread: calloc failed.");
+      return (void *)1;
+    }
+  }
+
+  pthread_mutex_lock(&wf->wf_lock);
+  while (wf->wf_loop) {
+    if (wf->wf_head == NULL) {
+      if (!write_func_replay(wf, max, batch))
+        pthread_cond_wait(&wf->wf_cond, &wf->wf_lock);
+      continue;
+    }
+
+    /* Give a batch the chance to fill up, but don't hold on to values for
+     * longer than the linger time. */
+    if ((max > 1) && (wf->wf_batch_linger > 0) &&
+        ((size_t)wf->wf_queue_length < max)) {
+      cdtime_t deadline = cdtime() + wf->wf_batch_linger;
+      int rc = 0;
+
+      while (wf->wf_loop && ((size_t)wf->wf_queue_length < max) && (rc == 0))
+        rc = pthread_cond_timedwait(&wf->wf_cond, &wf->wf_lock,
+                                    &CDTIME_T_TO_TIMESPEC(deadline));
+      if (!wf->wf_loop)
+        break;
+    }
+
+    size_t num = 0;
+    write_queue_t *q = write_func_take(wf, max, &num);
+    pthread_mutex_unlock(&wf->wf_lock);
+
+    write_func_deliver(wf, q, num, batch);
+
+    pthread_mutex_lock(&wf->wf_lock);
+  }
+  pthread_mutex_unlock(&wf->wf_lock);
+
+  sfree(batch);
+  return (void *)0;
+} /* }}} void *write_func_thread */
 
-static int plugin_write_enqueue(value_list_t const *vl) /* {{{ */
+static int write_func_start(write_func_t *wf) /* {{{ */
 {
-  write_queue_t *q;
+  size_t num = wf->wf_ctx.write_threads;
 
-  q = malloc(sizeof(*q));
-  if (q == NULL)
-    return ENOMEM;
-  q->next = NULL;
+  if (wf->wf_batch && (num == 0))
+    num = 1;
 
-  q->vl = plugin_value_list_clone(vl);
-  if (q->vl == NULL) {
-    sfree(q);
+  if ((num == 0) || (wf->wf_threads != NULL))
+    return 0;
+
+  wf->wf_threads = calloc(num, sizeof(*wf->wf_threads));
+  if (wf->wf_threads == NULL) {
+    ERROR("plugin: write_func_start: calloc failed.");
     return ENOMEM;
   }
 
-  /* Store context of caller (read plugin); otherwise, it would not be
-   * available to the write plugins when actually dispatching the
-   * value-list later on. */
-  q->ctx = plugin_get_ctx();
-
-  pthread_mutex_lock(&write_lock);
+  wf->wf_loop = 1;
+  wf->wf_threads_num = 0;
+  for (size_t i = 0; i < num; i++) {
+    int status = pthread_create(wf->wf_threads + wf->wf_threads_num,
+                                /* attr = */ NULL, write_func_thread, wf);
+    if (status != 0) {
+      ERROR("plugin: write_func_start: pthread_create failed with status %i "
+            "(%s).",
+            status, STRERROR(status));
+      break;
+    }
 
-  if (write_queue_tail == NULL) {
-    write_queue_head = q;
-    write_queue_tail = q;
-    write_queue_length = 1;
-  } else {
-    write_queue_tail->next = q;
-    write_queue_tail = q;
-    write_queue_length += 1;
+    char name[THREAD_NAME_MAX];
+    snprintf(name, sizeof(name), "w:%s", wf->wf_name);
+    set_thread_name(wf->wf_threads[wf->wf_threads_num], name);
+    set_thread_affinity(wf->wf_threads[wf->wf_threads_num],
+                        (wf->wf_ctx.thread_affinity != NULL)
+                            ? wf->wf_ctx.thread_affinity
+                            : global_option_get("WriteThreadsAffinity"));
+
+    wf->wf_threads_num++;
   }
 
-  pthread_cond_signal(&write_cond);
-  pthread_mutex_unlock(&write_lock);
-
+  INFO("plugin: Started %" PRIsz " write thread%s for \"%s\".",
+       wf->wf_threads_num, (wf->wf_threads_num == 1) ? "" : "s", wf->wf_name);
   return 0;
-} /* }}} int plugin_write_enqueue */
+} /* }}} int write_func_start */
 
-static value_list_t *plugin_write_dequeue(void) /* {{{ */
-{
-  write_queue_t *q;
-  value_list_t *vl;
+static int write_func_pass(write_func_t *wf, const data_set_t *ds,
+                           const value_list_t *vl);
 
-  pthread_mutex_lock(&write_lock);
+static int write_func_emit(const data_set_t *ds, /* {{{ */
+                           const value_list_t *vl, void *user_data) {
+  return write_func_pass(user_data, ds, vl);
+} /* }}} int write_func_emit */
 
-  while (write_loop && (write_queue_head == NULL))
-    pthread_cond_wait(&write_cond, &write_lock);
+static void write_func_stop(write_func_t *wf) /* {{{ */
+{
+  size_t left = 0;
+  size_t spilled = 0;
 
-  if (write_queue_head == NULL) {
-    pthread_mutex_unlock(&write_lock);
-    return NULL;
-  }
+  /* Pass the incomplete windows on while the queue is still served. */
+  if (wf->wf_downsample != NULL)
+    downsample_expire(wf->wf_downsample, /* now = */ 0, write_func_emit, wf);
 
-  q = write_queue_head;
-  write_queue_head = q->next;
-  write_queue_length -= 1;
-  if (write_queue_head == NULL) {
-    write_queue_tail = NULL;
-    assert(0 == write_queue_length);
-  }
+  if (wf->wf_threads == NULL)
+    return;
 
-  pthread_mutex_unlock(&write_lock);
+  pthread_mutex_lock(&wf->wf_lock);
+  wf->wf_loop = 0;
+  pthread_cond_broadcast(&wf->wf_cond);
+  pthread_cond_broadcast(&wf->wf_cond_full);
+  pthread_mutex_unlock(&wf->wf_lock);
 
-  (void)plugin_set_ctx(q->ctx);
+  for (size_t i = 0; i < wf->wf_threads_num; i++) {
+    if (pthread_join(wf->wf_threads[i], NULL) != 0) {
+      ERROR("plugin: write_func_stop: pthread_join failed.");
+    }
+  }
+  sfree(wf->wf_threads);
+  wf->wf_threads_num = 0;
 
-  vl = q->vl;
-  sfree(q);
-  return vl;
-} /* }}} value_list_t *plugin_write_dequeue */
+  /* Batch callbacks hold on to values deliberately (see
+   * wf_batch_linger), so hand whatever is left to the callback. */
+  if (wf->wf_batch) {
+    write_batch_entry_t *batch = calloc(wf->wf_batch_size, sizeof(*batch));
 
-static void *plugin_write_thread(void __attribute__((unused)) * args) /* {{{ */
-{
-  while (write_loop) {
-    value_list_t *vl = plugin_write_dequeue();
-    if (vl == NULL)
-      continue;
+    pthread_mutex_lock(&wf->wf_lock);
+    while ((batch != NULL) && (wf->wf_head != NULL)) {
+      size_t num = 0;
+      write_queue_t *q = write_func_take(wf, wf->wf_batch_size, &num);
+      pthread_mutex_unlock(&wf->wf_lock);
 
-    plugin_dispatch_values_internal(vl);
+      write_func_deliver(wf, q, num, batch);
 
-    plugin_value_list_free(vl);
+      pthread_mutex_lock(&wf->wf_lock);
+    }
+    pthread_mutex_unlock(&wf->wf_lock);
+    sfree(batch);
   }
 
-  pthread_exit(NULL);
-  return (void *)0;
-} /* }}} void *plugin_write_thread */
+  /* With a journal, the rest of the queue is replayed after the restart. */
+  pthread_mutex_lock(&wf->wf_lock);
+  while (wf->wf_head != NULL) {
+    write_queue_t *q = wf->wf_head;
+    wf->wf_head = q->next;
+    if ((wf->wf_spill != NULL) && (spill_write(wf->wf_spill, q->vl) == 0))
+      spilled++;
+    else
+      left++;
+    plugin_value_list_release(q->vl);
+    write_queue_free(q);
+  }
+  wf->wf_tail = NULL;
+  wf->wf_queue_length = 0;
+  pthread_mutex_unlock(&wf->wf_lock);
+
+  if (spilled > 0)
+    INFO("plugin: Saved %" PRIsz " value list%s of \"%s\" in its journal.",
+         spilled, (spilled == 1) ? "" : "s", wf->wf_name);
+  if (left > 0) {
+    WARNING("plugin: %" PRIsz " value list%s left in the queue of \"%s\" "
+            "after shutting down its write threads.",
+            left, (left == 1) ? " was" : "s were", wf->wf_name);
+  }
+} /* }}} void write_func_stop */
 
-static void start_write_threads(size_t num) /* {{{ */
+static void write_func_destroy(write_func_t *wf) /* {{{ */
 {
-  if (write_threads != NULL)
+  if (wf == NULL)
     return;
 
-  write_threads = (pthread_t *)calloc(num, sizeof(pthread_t));
-  if (write_threads == NULL) {
-    ERROR("plugin: start_write_threads: calloc failed.");
-    return;
+  write_func_stop(wf);
+  downsample_destroy(wf->wf_downsample);
+  spill_destroy(wf->wf_spill);
+
+  pthread_mutex_destroy(&wf->wf_lock);
+  pthread_cond_destroy(&wf->wf_cond);
+  pthread_cond_destroy(&wf->wf_cond_full);
+  latency_counter_destroy(wf->wf_latency.latency);
+  pthread_mutex_destroy(&wf->wf_latency.lock);
+  sfree(wf->wf_name);
+  destroy_callback((callback_func_t *)wf);
+} /* }}} void write_func_destroy */
+
+/* Calls the write callback "wf" directly or, if it has a dedicated queue,
+ * appends the value list to that queue. */
+static int write_func_pass(write_func_t *wf, /* {{{ */
+                           const data_set_t *ds, const value_list_t *vl) {
+  if (wf->wf_threads != NULL)
+    return write_func_enqueue(wf, ds, vl);
+
+  cdtime_t cpu_begin = plugin_cpu_begin();
+  cdtime_t begin = dispatch_latency_sample() ? cdtime_precise() : 0;
+  int status;
+  DISPATCH_PROBE1(write__start, wf->wf_name);
+  if (wf->wf_batch) {
+    plugin_write_batch_cb callback = wf->wf_callback;
+    status = (*callback)(&(write_batch_entry_t){.ds = ds, .vl = vl}, 1,
+                         &wf->wf_udata);
+  } else {
+    plugin_write_cb callback = wf->wf_callback;
+    status = (*callback)(ds, vl, &wf->wf_udata);
   }
+  DISPATCH_PROBE2(write__done, wf->wf_name, status);
+  if (begin != 0)
+    dispatch_latency_add(&wf->wf_latency, begin);
+  plugin_cpu_end(&wf->wf_super, PLUGIN_CPU_WRITE, cpu_begin);
 
-  write_threads_num = 0;
-  for (size_t i = 0; i < num; i++) {
-    int status = pthread_create(write_threads + write_threads_num,
-                                /* attr = */ NULL, plugin_write_thread,
-                                /* arg = */ NULL);
-    if (status != 0) {
-      ERROR("plugin: start_write_threads: pthread_create failed with status %i "
-            "(%s).",
-            status, STRERROR(status));
-      return;
+  return status;
+} /* }}} int write_func_pass */
+
+/* Like write_func_pass(), but downsamples the values first if configured.
+ * Values which are already at a coarser resolution than the window are
+ * passed on unchanged, unless they are suppressed because they did not
+ * change. */
+static int write_func_write(write_func_t *wf, /* {{{ */
+                            const data_set_t *ds, const value_list_t *vl) {
+  if ((wf->wf_downsample == NULL) ||
+      (vl->interval >= wf->wf_ctx.write_downsample)) {
+    unsigned int heartbeat = wf->wf_ctx.write_heartbeat;
+    if (wf->wf_ctx.write_changes_only && (vl->unchanged > 0) &&
+        ((heartbeat == 0) || ((vl->unchanged % heartbeat) != 0))) {
+#if defined(__ATOMIC_RELAXED)
+      __atomic_add_fetch(&wf->wf_suppressed, 1, __ATOMIC_RELAXED);
+#else
+      pthread_mutex_lock(&wf->wf_lock);
+      wf->wf_suppressed++;
+      pthread_mutex_unlock(&wf->wf_lock);
+#endif
+      return 0;
     }
+    return write_func_pass(wf, ds, vl);
+  }
 
-    char name[THREAD_NAME_MAX];
-    snprintf(name, sizeof(name), "writer#%" PRIsz, write_threads_num);
-    set_thread_name(write_threads[write_threads_num], name);
+  value_list_t *window = NULL;
+  int status = downsample_update(wf->wf_downsample, ds, vl, &window);
+  if (window != NULL) {
+    status = write_func_pass(wf, ds, window);
+    downsample_value_list_free(window);
+  }
 
-    write_threads_num++;
-  } /* for (i) */
-} /* }}} void start_write_threads */
+  /* Series which stopped being updated are passed on and forgotten. */
+  downsample_expire(wf->wf_downsample, vl->time, write_func_emit, wf);
 
-static void stop_write_threads(void) /* {{{ */
+  return status;
+} /* }}} int write_func_write */
+
+static void write_funcs_start(void) /* {{{ */
 {
-  write_queue_t *q;
-  size_t i;
+  for (llentry_t *le = llist_head(list_write); le != NULL; le = le->next)
+    write_func_start(le->value);
+} /* }}} void write_funcs_start */
 
-  if (write_threads == NULL)
-    return;
+static void write_funcs_stop(void) /* {{{ */
+{
+  for (llentry_t *le = llist_head(list_write); le != NULL; le = le->next)
+    write_func_stop(le->value);
+} /* }}} void write_funcs_stop */
 
-  INFO("collectd: Stopping %" PRIsz " write threads.", write_threads_num);
+static void write_funcs_destroy(void) /* {{{ */
+{
+  llentry_t *le;
 
-  pthread_mutex_lock(&write_lock);
-  write_loop = 0;
-  DEBUG("plugin: stop_write_threads: Signalling `write_cond'");
-  pthread_cond_broadcast(&write_cond);
-  pthread_mutex_unlock(&write_lock);
+  if (list_write == NULL)
+    return;
 
-  for (i = 0; i < write_threads_num; i++) {
-    if (pthread_join(write_threads[i], NULL) != 0) {
-      ERROR("plugin: stop_write_threads: pthread_join failed.");
-    }
-    write_threads[i] = (pthread_t)0;
-  }
-  sfree(write_threads);
-  write_threads_num = 0;
+  callback_array_update(&array_write, NULL);
 
-  pthread_mutex_lock(&write_lock);
-  i = 0;
-  for (q = write_queue_head; q != NULL;) {
-    write_queue_t *q1 = q;
-    plugin_value_list_free(q->vl);
-    q = q->next;
-    sfree(q1);
-    i++;
-  }
-  write_queue_head = NULL;
-  write_queue_tail = NULL;
-  write_queue_length = 0;
-  pthread_mutex_unlock(&write_lock);
+  le = llist_head(list_write);
+  while (le != NULL) {
+    llentry_t *le_next = le->next;
 
-  if (i > 0) {
-    WARNING("plugin: %" PRIsz " value list%s left after shutting down "
-            "the write threads.",
-            i, (i == 1) ? " was" : "s were");
+    sfree(le->key);
+    write_func_destroy(le->value);
+    le->value = NULL;
+
+    le = le_next;
   }
-} /* }}} void stop_write_threads */
+
+  llist_destroy(list_write);
+  list_write = NULL;
+} /* }}} void write_funcs_destroy */
 
 /*
  * Public functions
@@ -912,31 +4040,6 @@ void plugin_set_dir(const char *dir) {
     ERROR("plugin_set_dir: strdup(\"%s\") failed", dir);
 }
 
-static _Bool plugin_is_loaded(char const *name) {
-  int status;
-
-  if (plugins_loaded == NULL)
-    plugins_loaded =
-        c_avl_create((int (*)(const void *, const void *))strcasecmp);
-  assert(plugins_loaded != NULL);
-
-  status = c_avl_get(plugins_loaded, name, /* ret_value = */ NULL);
-  return status == 0;
-}
-
-static int plugin_mark_loaded(char const *name) {
-  char *name_copy;
-  int status;
-
-  name_copy = strdup(name);
-  if (name_copy == NULL)
-    return ENOMEM;
-
-  status = c_avl_insert(plugins_loaded,
-                        /* key = */ name_copy, /* value = */ NULL);
-  return status;
-}
-
 static void plugin_free_loaded(void) {
   void *key;
   void *value;
@@ -945,8 +4048,14 @@ static void plugin_free_loaded(void) {
     return;
 
   while (c_avl_pick(plugins_loaded, &key, &value) == 0) {
-    sfree(key);
-    assert(value == NULL);
+    loaded_plugin_t *lp = value;
+
+    /* Detached threads may still exit and update the entry. */
+    if (plugin_loaded_add(&lp->threads, 0) != 0)
+      continue;
+
+    sfree(lp->name);
+    sfree(lp);
   }
 
   c_avl_destroy(plugins_loaded);
@@ -954,6 +4063,20 @@ static void plugin_free_loaded(void) {
 }
 
 #define BUFSIZE 512
+/* Returns a copy of "name" which is valid until the daemon exits. */
+static char const *plugin_name_intern(char const *name) /* {{{ */
+{
+  char const *ret;
+
+  pthread_mutex_lock(&init_lock);
+  if (plugin_names == NULL)
+    plugin_names = c_intern_create(/* ignore_case = */ 0);
+  ret = (plugin_names != NULL) ? c_intern(plugin_names, name) : NULL;
+  pthread_mutex_unlock(&init_lock);
+
+  return ret;
+} /* }}} char const *plugin_name_intern */
+
 int plugin_load(char const *plugin_name, _Bool global) {
   DIR *dh;
   const char *dir;
@@ -967,9 +4090,13 @@ int plugin_load(char const *plugin_name, _Bool global) {
   if (plugin_name == NULL)
     return EINVAL;
 
+  loaded_plugin_t *lp = plugin_loaded_get(plugin_name, /* create = */ 1);
+  if (lp == NULL)
+    return ENOMEM;
+
   /* Check if plugin is already loaded and don't do anything in this
    * case. */
-  if (plugin_is_loaded(plugin_name))
+  if (lp->loaded)
     return 0;
 
   dir = plugin_get_dir();
@@ -990,6 +4117,16 @@ int plugin_load(char const *plugin_name, _Bool global) {
       (strcasecmp("python", plugin_name) == 0))
     global = 1;
 
+  /* The interpreters embedded by these plugins can't be started a second time
+   * within the same process. */
+  if ((strcasecmp("java", plugin_name) == 0) ||
+      (strcasecmp("perl", plugin_name) == 0) ||
+      (strcasecmp("python", plugin_name) == 0))
+    plugin_loaded_set(&lp->permanent, 1);
+
+  /* Plugins loaded by a reload are held back until plugin_init_plugin(). */
+  plugin_loaded_set(&lp->disabled, plugins_initialized);
+
   /* `cpu' should not match `cpufreq'. To solve this we add `.so' to the
    * type when matching the filename */
   status = snprintf(typename, sizeof(typename), "%s.so", plugin_name);
@@ -1022,10 +4159,19 @@ int plugin_load(char const *plugin_name, _Bool global) {
       continue;
     }
 
-    status = plugin_load_file(filename, global);
+    /* Read functions of plugins assigned to a read thread pool are
+     * registered with that pool. */
+    plugin_ctx_t ctx = plugin_get_ctx();
+    ctx.read_pool = read_pool_find_plugin(plugin_name);
+    ctx.name = plugin_name_intern(plugin_name);
+    plugin_ctx_t old_ctx = plugin_set_ctx(ctx);
+    void *dlh = NULL;
+    status = plugin_load_file(filename, global, &dlh);
+    plugin_set_ctx(old_ctx);
     if (status == 0) {
       /* success */
-      plugin_mark_loaded(plugin_name);
+      lp->dlh = dlh;
+      lp->loaded = 1;
       ret = 0;
       INFO("plugin_load: plugin \"%s\" successfully loaded.", plugin_name);
       break;
@@ -1060,9 +4206,25 @@ int plugin_register_complex_config(const char *type,
 } /* int plugin_register_complex_config */
 
 int plugin_register_init(const char *name, int (*callback)(void)) {
+  plugin_ctx_t ctx = plugin_get_ctx();
+
+  if (ctx.init_parallel)
+    return plugin_register_init_parallel(name, callback);
+
   return create_register_callback(&list_init, name, (void *)callback, NULL);
 } /* plugin_register_init */
 
+int plugin_register_init_parallel(const char *name, int (*callback)(void)) {
+  plugin_ctx_t ctx = plugin_get_ctx();
+
+  /* Without a plugin name the read callbacks cannot be held back. */
+  if (ctx.name == NULL)
+    return create_register_callback(&list_init, name, (void *)callback, NULL);
+
+  return create_register_callback(&list_init_parallel, name, (void *)callback,
+                                  NULL);
+} /* plugin_register_init_parallel */
+
 static int plugin_compare_read_func(const void *arg0, const void *arg1) {
   const read_func_t *rf0;
   const read_func_t *rf1;
@@ -1078,10 +4240,10 @@ static int plugin_compare_read_func(const void *arg0, const void *arg1) {
     return 0;
 } /* int plugin_compare_read_func */
 
-/* Add a read function to both, the heap and a linked list. The linked list if
- * used to look-up read functions, especially for the remove function. The heap
- * is used to determine which plugin to read next. */
-static int plugin_insert_read(read_func_t *rf) {
+/* Add a read function to both, a read queue and a linked list. The linked
+ * list if used to look-up read functions, especially for the remove function.
+ * The queues are used to determine which plugin to read next. */
+static int plugin_schedule_read(read_func_t *rf) {
   int status;
   llentry_t *le;
 
@@ -1099,15 +4261,6 @@ static int plugin_insert_read(read_func_t *rf) {
     }
   }
 
-  if (read_heap == NULL) {
-    read_heap = c_heap_create(plugin_compare_read_func);
-    if (read_heap == NULL) {
-      pthread_mutex_unlock(&read_lock);
-      ERROR("plugin_insert_read: c_heap_create failed.");
-      return -1;
-    }
-  }
-
   le = llist_search(read_list, rf->rf_name);
   if (le != NULL) {
     pthread_mutex_unlock(&read_lock);
@@ -1124,21 +4277,48 @@ static int plugin_insert_read(read_func_t *rf) {
     return -1;
   }
 
-  status = c_heap_insert(read_heap, rf);
+  /* Spread new read functions over the queues of their pool. */
+  read_queue_t *q = read_pool_next_queue(read_pool_get(rf->rf_pool));
+
+  pthread_mutex_lock(&q->lock);
+  status = read_queue_insert(q, rf);
   if (status != 0) {
+    pthread_mutex_unlock(&q->lock);
     pthread_mutex_unlock(&read_lock);
-    ERROR("plugin_insert_read: c_heap_insert failed.");
+    ERROR("plugin_insert_read: read_queue_insert failed.");
     llentry_destroy(le);
     return -1;
   }
 
+  /* Wake up the queue's read thread. */
+  pthread_cond_signal(&q->cond);
+  pthread_mutex_unlock(&q->lock);
+
   /* This does not fail. */
   llist_append(read_list, le);
 
-  /* Wake up all the read threads. */
-  pthread_cond_broadcast(&read_cond);
   pthread_mutex_unlock(&read_lock);
   return 0;
+} /* int plugin_schedule_read */
+
+static int plugin_insert_read(read_func_t *rf) {
+  int status;
+
+  rf->rf_latency = latency_counter_create();
+  if (rf->rf_latency == NULL) {
+    ERROR("plugin_insert_read: latency_counter_create failed.");
+    return ENOMEM;
+  }
+  pthread_mutex_init(&rf->rf_stats_lock, /* attr = */ NULL);
+
+  status = plugin_schedule_read(rf);
+  if (status != 0) {
+    latency_counter_destroy(rf->rf_latency);
+    rf->rf_latency = NULL;
+    pthread_mutex_destroy(&rf->rf_stats_lock);
+  }
+
+  return status;
 } /* int plugin_insert_read */
 
 int plugin_register_read(const char *name, int (*callback)(void)) {
@@ -1155,6 +4335,9 @@ int plugin_register_read(const char *name, int (*callback)(void)) {
   rf->rf_udata.data = NULL;
   rf->rf_udata.free_func = NULL;
   rf->rf_ctx = plugin_get_ctx();
+  rf->rf_super.cf_cpu = plugin_cpu_get(name);
+  rf->rf_super.cf_plugin = plugin_loaded_get(rf->rf_ctx.name, 0);
+  rf->rf_pool = rf->rf_ctx.read_pool;
   rf->rf_group[0] = '\0';
   rf->rf_name = strdup(name);
   rf->rf_type = RF_SIMPLE;
@@ -1200,6 +4383,11 @@ int plugin_register_complex_read(const char *group, const char *name,
   }
 
   rf->rf_ctx = plugin_get_ctx();
+  rf->rf_super.cf_cpu = plugin_cpu_get(name);
+  rf->rf_super.cf_plugin = plugin_loaded_get(rf->rf_ctx.name, 0);
+  rf->rf_pool = read_pool_find_group(rf->rf_group);
+  if (rf->rf_pool == 0)
+    rf->rf_pool = rf->rf_ctx.read_pool;
 
   status = plugin_insert_read(rf);
   if (status != 0) {
@@ -1211,15 +4399,211 @@ int plugin_register_complex_read(const char *group, const char *name,
   return status;
 } /* int plugin_register_complex_read */
 
+static char **read_pool_strarray_dup(char const *const *strings,
+                                     size_t strings_num) /* {{{ */
+{
+  char **ret = calloc(strings_num + 1, sizeof(*ret));
+  if (ret == NULL)
+    return NULL;
+
+  for (size_t i = 0; i < strings_num; i++) {
+    ret[i] = strdup(strings[i]);
+    if (ret[i] == NULL) {
+      strarray_free(ret, i);
+      return NULL;
+    }
+  }
+
+  return ret;
+} /* }}} char **read_pool_strarray_dup */
+
+static void read_pool_destroy(read_pool_t *pool) /* {{{ */
+{
+  if (pool == NULL)
+    return;
+
+  strarray_free(pool->plugins, pool->plugins_num);
+  strarray_free(pool->groups, pool->groups_num);
+  sfree(pool);
+} /* }}} void read_pool_destroy */
+
+int plugin_register_read_pool(const char *name, size_t threads_num, /* {{{ */
+                              char const *const *plugins, size_t plugins_num,
+                              char const *const *groups, size_t groups_num) {
+  read_pool_t *pool;
+  read_pool_t **tmp;
+
+  if ((name == NULL) || (threads_num == 0))
+    return EINVAL;
+
+  if (read_threads != NULL) {
+    ERROR("plugin_register_read_pool: Read thread pools have to be "
+          "registered before the read threads are started.");
+    return EBUSY;
+  }
+
+  for (size_t i = 0; i <= read_pools_num; i++) {
+    if (strcasecmp(name, read_pool_get(i)->name) == 0) {
+      ERROR("plugin_register_read_pool: A read thread pool named \"%s\" "
+            "already exists.",
+            name);
+      return EEXIST;
+    }
+  }
+
+  pool = calloc(1, sizeof(*pool));
+  if (pool == NULL)
+    return ENOMEM;
+
+  sstrncpy(pool->name, name, sizeof(pool->name));
+  pool->threads_num = threads_num;
+  pool->plugins = read_pool_strarray_dup(plugins, plugins_num);
+  pool->plugins_num = plugins_num;
+  pool->groups = read_pool_strarray_dup(groups, groups_num);
+  pool->groups_num = groups_num;
+  if ((pool->plugins == NULL) || (pool->groups == NULL)) {
+    read_pool_destroy(pool);
+    return ENOMEM;
+  }
+
+  tmp = realloc(read_pools, (read_pools_num + 1) * sizeof(*read_pools));
+  if (tmp == NULL) {
+    read_pool_destroy(pool);
+    return ENOMEM;
+  }
+  read_pools = tmp;
+  read_pools[read_pools_num] = pool;
+  read_pools_num++;
+
+  return 0;
+} /* }}} int plugin_register_read_pool */
+
+static int plugin_insert_write(write_func_t *wf, const char *name, /* {{{ */
+                               void *callback, user_data_t const *ud) {
+  int status;
+
+  wf->wf_callback = callback;
+  if (ud == NULL) {
+    wf->wf_udata.data = NULL;
+    wf->wf_udata.free_func = NULL;
+  } else {
+    wf->wf_udata = *ud;
+  }
+  wf->wf_ctx = plugin_get_ctx();
+  wf->wf_super.cf_cpu = plugin_cpu_get(name);
+  wf->wf_super.cf_plugin = plugin_loaded_get(wf->wf_ctx.name, 0);
+
+  wf->wf_name = strdup(name);
+  if (wf->wf_name == NULL) {
+    ERROR("plugin_register_write: strdup failed.");
+    destroy_callback((callback_func_t *)wf);
+    return ENOMEM;
+  }
+
+  pthread_mutex_init(&wf->wf_lock, /* attr = */ NULL);
+  pthread_cond_init(&wf->wf_cond, /* attr = */ NULL);
+  pthread_cond_init(&wf->wf_cond_full, /* attr = */ NULL);
+  pthread_mutex_init(&wf->wf_latency.lock, /* attr = */ NULL);
+  if (dispatch_sampling != 0)
+    wf->wf_latency.latency = latency_counter_create();
+
+  if (wf->wf_ctx.write_downsample > 0) {
+    wf->wf_downsample = downsample_create(wf->wf_ctx.write_downsample,
+                                          wf->wf_ctx.write_downsample_function);
+    if (wf->wf_downsample == NULL) {
+      ERROR("plugin_register_write: downsample_create failed.");
+      write_func_destroy(wf);
+      return ENOMEM;
+    }
+  }
+
+  if (wf->wf_ctx.write_queue_policy == WRITE_QUEUE_POLICY_SPILL) {
+    char dir[PATH_MAX];
+    uint64_t limit = (wf->wf_ctx.write_spill_limit > 0)
+                         ? wf->wf_ctx.write_spill_limit
+                         : WRITE_SPILL_LIMIT_DEFAULT;
+
+    if (wf->wf_ctx.write_spill_directory != NULL)
+      sstrncpy(dir, wf->wf_ctx.write_spill_directory, sizeof(dir));
+    else
+      snprintf(dir, sizeof(dir), "%s/spill", global_option_get("BaseDir"));
+
+    wf->wf_spill = spill_create(dir, name, limit);
+    if (wf->wf_spill == NULL)
+      WARNING("plugin_register_write: Creating the journal of \"%s\" in "
+              "\"%s\" failed. Values which don't fit into the queue are "
+              "dropped.",
+              name, dir);
+  }
+
+  /* register_callback() cannot stop the threads of a callback it replaces. */
+  if ((list_write != NULL) && (llist_search(list_write, name) != NULL)) {
+    WARNING("plugin_register_write: a write callback named `%s' already "
+            "exists - overwriting the old entry!",
+            name);
+    plugin_unregister_write(name);
+  }
+
+  status = register_callback(&list_write, name, (callback_func_t *)wf);
+  if (status != 0)
+    return status;
+  callback_array_update(&array_write, list_write);
+
+  /* Write callbacks registered after the write threads have been started
+   * (e.g. from an init callback) start their queue right away. */
+  if (write_threads != NULL)
+    write_func_start(wf);
+
+  return 0;
+} /* }}} int plugin_insert_write */
+
 int plugin_register_write(const char *name, plugin_write_cb callback,
                           user_data_t const *ud) {
-  return create_register_callback(&list_write, name, (void *)callback, ud);
+  write_func_t *wf;
+
+  wf = calloc(1, sizeof(*wf));
+  if (wf == NULL) {
+    free_userdata(ud);
+    ERROR("plugin_register_write: calloc failed.");
+    return ENOMEM;
+  }
+
+  return plugin_insert_write(wf, name, (void *)callback, ud);
 } /* int plugin_register_write */
 
+int plugin_register_write_batch(const char *name,
+                                plugin_write_batch_cb callback,
+                                size_t batch_size, cdtime_t linger,
+                                user_data_t const *ud) {
+  write_func_t *wf;
+  plugin_ctx_t ctx = plugin_get_ctx();
+
+  wf = calloc(1, sizeof(*wf));
+  if (wf == NULL) {
+    free_userdata(ud);
+    ERROR("plugin_register_write_batch: calloc failed.");
+    return ENOMEM;
+  }
+
+  /* Settings in the LoadPlugin block take precedence over the defaults
+   * provided by the plugin. */
+  wf->wf_batch = 1;
+  wf->wf_batch_size = (ctx.write_batch_size != 0) ? ctx.write_batch_size
+                                                   : batch_size;
+  if (wf->wf_batch_size == 0)
+    wf->wf_batch_size = 1;
+  wf->wf_batch_linger =
+      (ctx.write_batch_linger != 0) ? ctx.write_batch_linger : linger;
+
+  return plugin_insert_write(wf, name, (void *)callback, ud);
+} /* int plugin_register_write_batch */
+
 static int plugin_flush_timeout_callback(user_data_t *ud) {
   flush_callback_t *cb = ud->data;
 
-  return plugin_flush(cb->name, cb->timeout, NULL);
+  /* A failing flush callback is not a failing read callback. */
+  plugin_flush(cb->name, cb->timeout, NULL);
+  return 0;
 } /* static int plugin_flush_callback */
 
 static void plugin_flush_timeout_callback_free(void *data) {
@@ -1259,6 +4643,7 @@ int plugin_register_flush(const char *name, plugin_flush_cb callback,
   plugin_ctx_t ctx = plugin_get_ctx();
 
   status = create_register_callback(&list_flush, name, (void *)callback, ud);
+  callback_array_update(&array_flush, list_flush);
   if (status != 0)
     return status;
 
@@ -1295,21 +4680,64 @@ int plugin_register_flush(const char *name, plugin_flush_cb callback,
             .data = cb, .free_func = plugin_flush_timeout_callback_free,
         });
 
-    sfree(flush_name);
-    return status;
+    sfree(flush_name);
+    return status;
+  }
+
+  return 0;
+} /* int plugin_register_flush */
+
+int plugin_register_missing(const char *name, plugin_missing_cb callback,
+                            user_data_t const *ud) {
+  return create_register_callback(&list_missing, name, (void *)callback, ud);
+} /* int plugin_register_missing */
+
+int plugin_register_shutdown(const char *name, int (*callback)(void)) {
+  return create_register_callback(&list_shutdown, name, (void *)callback, NULL);
+} /* int plugin_register_shutdown */
+
+static data_set_entry_t **data_set_slot(data_set_id_t id) /* {{{ */
+{
+  if ((id == 0) || (id > data_sets_last_id))
+    return NULL;
+
+  data_set_entry_t **chunk = data_sets_by_id[(id - 1) / DATA_SET_CHUNK_SIZE];
+  if (chunk == NULL)
+    return NULL;
+
+  return chunk + ((id - 1) % DATA_SET_CHUNK_SIZE);
+} /* }}} data_set_entry_t **data_set_slot */
+
+static data_set_id_t data_set_new_id(void) /* {{{ */
+{
+  data_set_id_t id = data_sets_last_id + 1;
+  size_t chunk = (id - 1) / DATA_SET_CHUNK_SIZE;
+
+  if (chunk >= DATA_SET_CHUNKS_NUM) {
+    ERROR("plugin: Too many data sets registered (%d).",
+          DATA_SET_CHUNKS_NUM * DATA_SET_CHUNK_SIZE);
+    return 0;
+  }
+
+  if (data_sets_by_id[chunk] == NULL) {
+    data_sets_by_id[chunk] =
+        calloc(DATA_SET_CHUNK_SIZE, sizeof(*data_sets_by_id[chunk]));
+    if (data_sets_by_id[chunk] == NULL)
+      return 0;
   }
 
-  return 0;
-} /* int plugin_register_flush */
+  data_sets_last_id = id;
+  return id;
+} /* }}} data_set_id_t data_set_new_id */
 
-int plugin_register_missing(const char *name, plugin_missing_cb callback,
-                            user_data_t const *ud) {
-  return create_register_callback(&list_missing, name, (void *)callback, ud);
-} /* int plugin_register_missing */
+static void data_set_entry_destroy(data_set_entry_t *e) /* {{{ */
+{
+  if (e == NULL)
+    return;
 
-int plugin_register_shutdown(const char *name, int (*callback)(void)) {
-  return create_register_callback(&list_shutdown, name, (void *)callback, NULL);
-} /* int plugin_register_shutdown */
+  sfree(e->ds.ds);
+  sfree(e);
+} /* }}} void data_set_entry_destroy */
 
 static void plugin_free_data_sets(void) {
   void *key;
@@ -1319,56 +4747,73 @@ static void plugin_free_data_sets(void) {
     return;
 
   while (c_avl_pick(data_sets, &key, &value) == 0) {
-    data_set_t *ds = value;
     /* key is a pointer to ds->type */
-
-    sfree(ds->ds);
-    sfree(ds);
+    data_set_entry_destroy(value);
   }
 
   c_avl_destroy(data_sets);
   data_sets = NULL;
+
+  for (size_t i = 0; i < DATA_SET_CHUNKS_NUM; i++)
+    sfree(data_sets_by_id[i]);
+  data_sets_last_id = 0;
 } /* void plugin_free_data_sets */
 
 int plugin_register_data_set(const data_set_t *ds) {
-  data_set_t *ds_copy;
+  data_set_entry_t *old = NULL;
+  data_set_entry_t *e;
 
-  if ((data_sets != NULL) && (c_avl_get(data_sets, ds->type, NULL) == 0)) {
-    NOTICE("Replacing DS `%s' with another version.", ds->type);
-    plugin_unregister_data_set(ds->type);
-  } else if (data_sets == NULL) {
+  if (data_sets == NULL) {
     data_sets = c_avl_create((int (*)(const void *, const void *))strcmp);
     if (data_sets == NULL)
       return -1;
   }
 
-  ds_copy = malloc(sizeof(*ds_copy));
-  if (ds_copy == NULL)
+  e = calloc(1, sizeof(*e));
+  if (e == NULL)
     return -1;
-  memcpy(ds_copy, ds, sizeof(data_set_t));
+  memcpy(&e->ds, ds, sizeof(data_set_t));
 
-  ds_copy->ds = malloc(sizeof(*ds_copy->ds) * ds->ds_num);
-  if (ds_copy->ds == NULL) {
-    sfree(ds_copy);
+  e->ds.ds = malloc(sizeof(*e->ds.ds) * ds->ds_num);
+  if (e->ds.ds == NULL) {
+    sfree(e);
     return -1;
   }
 
   for (size_t i = 0; i < ds->ds_num; i++)
-    memcpy(ds_copy->ds + i, ds->ds + i, sizeof(data_source_t));
+    memcpy(e->ds.ds + i, ds->ds + i, sizeof(data_source_t));
+
+  /* A data set which is replaced keeps its ID. */
+  if (c_avl_remove(data_sets, ds->type, NULL, (void *)&old) == 0) {
+    NOTICE("Replacing DS `%s' with another version.", ds->type);
+    e->id = old->id;
+    data_set_entry_destroy(old);
+  } else {
+    e->id = data_set_new_id();
+    if (e->id == 0) {
+      data_set_entry_destroy(e);
+      return -1;
+    }
+  }
 
-  return c_avl_insert(data_sets, (void *)ds_copy->type, (void *)ds_copy);
+  *data_set_slot(e->id) = e;
+  return c_avl_insert(data_sets, (void *)e->ds.type, (void *)e);
 } /* int plugin_register_data_set */
 
 int plugin_register_log(const char *name, plugin_log_cb callback,
                         user_data_t const *ud) {
-  return create_register_callback(&list_log, name, (void *)callback, ud);
+  int status = create_register_callback(&list_log, name, (void *)callback, ud);
+  callback_array_update(&array_log, list_log);
+  return status;
 } /* int plugin_register_log */
 
 int plugin_register_notification(const char *name,
                                  plugin_notification_cb callback,
                                  user_data_t const *ud) {
-  return create_register_callback(&list_notification, name, (void *)callback,
-                                  ud);
+  int status = create_register_callback(&list_notification, name,
+                                        (void *)callback, ud);
+  callback_array_update(&array_notification, list_notification);
+  return status;
 } /* int plugin_register_log */
 
 int plugin_unregister_config(const char *name) {
@@ -1382,7 +4827,9 @@ int plugin_unregister_complex_config(const char *name) {
 } /* int plugin_unregister_complex_config */
 
 int plugin_unregister_init(const char *name) {
-  return plugin_unregister(list_init, name);
+  if (plugin_unregister(list_init, name) == 0)
+    return 0;
+  return plugin_unregister(list_init_parallel, name);
 }
 
 int plugin_unregister_read(const char *name) /* {{{ */
@@ -1485,7 +4932,24 @@ int plugin_unregister_read_group(const char *group) /* {{{ */
 } /* }}} int plugin_unregister_read_group */
 
 int plugin_unregister_write(const char *name) {
-  return plugin_unregister(list_write, name);
+  llentry_t *e;
+
+  if (list_write == NULL)
+    return -1;
+
+  e = llist_search(list_write, name);
+  if (e == NULL)
+    return -1;
+
+  llist_remove(list_write, e);
+  callback_array_update(&array_write, list_write);
+
+  sfree(e->key);
+  write_func_destroy(e->value);
+
+  llentry_destroy(e);
+
+  return 0;
 }
 
 int plugin_unregister_flush(const char *name) {
@@ -1501,137 +4965,692 @@ int plugin_unregister_flush(const char *name) {
     }
   }
 
-  return plugin_unregister(list_flush, name);
-}
+  int status = plugin_unregister(list_flush, name);
+  callback_array_update(&array_flush, list_flush);
+  return status;
+}
+
+int plugin_unregister_missing(const char *name) {
+  return plugin_unregister(list_missing, name);
+}
+
+int plugin_unregister_shutdown(const char *name) {
+  return plugin_unregister(list_shutdown, name);
+}
+
+int plugin_unregister_data_set(const char *name) {
+  data_set_entry_t *e;
+
+  if (data_sets == NULL)
+    return -1;
+
+  if (c_avl_remove(data_sets, name, NULL, (void *)&e) != 0)
+    return -1;
+
+  *data_set_slot(e->id) = NULL;
+  data_set_entry_destroy(e);
+
+  return 0;
+} /* int plugin_unregister_data_set */
+
+int plugin_unregister_log(const char *name) {
+  int status = plugin_unregister(list_log, name);
+  callback_array_update(&array_log, list_log);
+  return status;
+}
+
+int plugin_unregister_notification(const char *name) {
+  int status = plugin_unregister(list_notification, name);
+  callback_array_update(&array_notification, list_notification);
+  return status;
+}
+
+/* Calls the init callback "le". Returns non-zero if it failed. */
+static int plugin_init_one(llentry_t *le) /* {{{ */
+{
+  callback_func_t *cf = le->value;
+  plugin_ctx_t old_ctx = plugin_set_ctx(cf->cf_ctx);
+  plugin_init_cb callback = cf->cf_callback;
+  int status = (*callback)();
+  plugin_set_ctx(old_ctx);
+
+  if (status != 0) {
+    ERROR("Initialization of plugin `%s' "
+          "failed with status %i. "
+          "Plugin will be unloaded.",
+          le->key, status);
+    /* Plugins that register read callbacks from the init
+     * callback should take care of appropriate error
+     * handling themselves. */
+    /* FIXME: Unload _all_ functions */
+    plugin_unregister_read(le->key);
+  }
+
+  return status;
+} /* }}} int plugin_init_one */
+
+/* Returns true if an init callback of the plugin "name" is still running or
+ * waiting to be run. */
+static _Bool plugin_init_pending(char const *name) /* {{{ */
+{
+  if (name == NULL)
+    return 0;
+
+#if defined(__ATOMIC_ACQUIRE)
+  if (__atomic_load_n(&init_pending_num, __ATOMIC_ACQUIRE) == 0)
+    return 0;
+#endif
+
+  pthread_mutex_lock(&init_lock);
+  _Bool pending =
+      (init_pending != NULL) && (c_avl_get(init_pending, name, NULL) == 0);
+  pthread_mutex_unlock(&init_lock);
+
+  return pending;
+} /* }}} _Bool plugin_init_pending */
+
+/* Must be called with "init_lock" held. */
+static void init_pending_update(char const *name, _Bool add) /* {{{ */
+{
+  init_pending_t *ip = NULL;
+
+  if (c_avl_get(init_pending, name, (void *)&ip) != 0) {
+    if (!add || ((ip = calloc(1, sizeof(*ip))) == NULL))
+      return;
+    ip->name = name;
+    if (c_avl_insert(init_pending, (void *)ip->name, ip) != 0) {
+      sfree(ip);
+      return;
+    }
+  }
+
+  if (add) {
+    ip->count++;
+  } else if (--ip->count == 0) {
+    c_avl_remove(init_pending, name, NULL, NULL);
+    sfree(ip);
+  }
+
+#if defined(__ATOMIC_RELEASE)
+  __atomic_store_n(&init_pending_num, (size_t)c_avl_size(init_pending),
+                   __ATOMIC_RELEASE);
+#else
+  init_pending_num = (size_t)c_avl_size(init_pending);
+#endif
+} /* }}} void init_pending_update */
+
+static void *plugin_init_thread(void __attribute__((unused)) * args) /* {{{ */
+{
+  pthread_mutex_lock(&init_lock);
+  while (init_next != NULL) {
+    llentry_t *le = init_next;
+    init_next = le->next;
+    pthread_mutex_unlock(&init_lock);
+
+    callback_func_t *cf = le->value;
+    int status = plugin_init_one(le);
+
+    pthread_mutex_lock(&init_lock);
+    if (status != 0)
+      init_failed = 1;
+    init_pending_update(cf->cf_ctx.name, /* add = */ 0);
+  }
+  pthread_mutex_unlock(&init_lock);
+
+  return NULL;
+} /* }}} void *plugin_init_thread */
+
+static int wait_init_threads(void);
+
+static void start_init_threads(void) /* {{{ */
+{
+  if (list_init_parallel == NULL)
+    return;
+
+  /* plugin_init_all() may be called again, e.g. on Solaris. */
+  wait_init_threads();
+
+  long num = global_option_get_long("InitThreads", /* default = */ 4);
+  if (num < 0) {
+    ERROR("InitThreads must be positive or zero.");
+    num = 4;
+  }
+  if ((size_t)num > (size_t)llist_size(list_init_parallel))
+    num = (long)llist_size(list_init_parallel);
+
+  pthread_mutex_lock(&init_lock);
+  if (init_pending == NULL)
+    init_pending = c_avl_create((int (*)(const void *, const void *))strcmp);
+  init_threads = calloc((size_t)num + 1, sizeof(*init_threads));
+  if ((init_pending == NULL) || (init_threads == NULL)) {
+    ERROR("plugin: start_init_threads: Allocating memory failed.");
+    sfree(init_threads);
+    num = 0;
+  }
+
+  init_failed = 0;
+  init_next = llist_head(list_init_parallel);
+  for (llentry_t *le = init_next; (le != NULL) && (init_pending != NULL);
+       le = le->next) {
+    callback_func_t *cf = le->value;
+    init_pending_update(cf->cf_ctx.name, /* add = */ 1);
+  }
+  pthread_mutex_unlock(&init_lock);
+
+  for (size_t i = 0; i < (size_t)num; i++) {
+    int status = pthread_create(init_threads + init_threads_num,
+                                /* attr = */ NULL, plugin_init_thread,
+                                /* arg = */ NULL);
+    if (status != 0) {
+      ERROR("plugin: start_init_threads: pthread_create failed with status "
+            "%i (%s).",
+            status, STRERROR(status));
+      break;
+    }
+
+    char name[THREAD_NAME_MAX];
+    snprintf(name, sizeof(name), "init#%" PRIsz, init_threads_num);
+    set_thread_name(init_threads[init_threads_num], name);
+
+    init_threads_num++;
+  }
+
+  /* With "InitThreads 0" or if no thread could be started, the callbacks
+   * are called right here. */
+  if (init_threads_num == 0)
+    plugin_init_thread(NULL);
+} /* }}} void start_init_threads */
+
+/* Blocks until all independent init callbacks have returned. Returns
+ * non-zero if any of them failed. */
+static int wait_init_threads(void) /* {{{ */
+{
+  for (size_t i = 0; i < init_threads_num; i++)
+    if (pthread_join(init_threads[i], NULL) != 0)
+      ERROR("plugin: wait_init_threads: pthread_join failed.");
+  sfree(init_threads);
+  init_threads_num = 0;
+
+  pthread_mutex_lock(&init_lock);
+  int ret = init_failed ? -1 : 0;
+  pthread_mutex_unlock(&init_lock);
+
+  return ret;
+} /* }}} int wait_init_threads */
+
+int plugin_init_all(void) {
+  char const *chain_name;
+  llentry_t *le;
+  int ret = 0;
+
+  /* Plugins loaded from now on wait for plugin_init_plugin(). */
+  plugins_initialized = 1;
+
+  /* Init the value cache */
+  uc_init();
+
+  if (IS_TRUE(global_option_get("CollectInternalStats"))) {
+    record_statistics = 1;
+    plugin_register_read("collectd", plugin_update_internal_statistics);
+  }
+
+  plugin_cpu_accounting = IS_TRUE(global_option_get("PluginCPUAccounting"));
+#if !defined(CLOCK_THREAD_CPUTIME_ID)
+  if (plugin_cpu_accounting) {
+    WARNING("plugin_init_all: \"PluginCPUAccounting\" is not supported on "
+            "this system.");
+    plugin_cpu_accounting = 0;
+  }
+#endif
+
+  long sampling = global_option_get_long("DispatchLatencySampling",
+                                        /* default = */ 0);
+  if ((sampling > 0) && (sampling <= UINT_MAX)) {
+    for (size_t i = 0; i < DISPATCH_STAGES_NUM; i++)
+      dispatch_stages[i].latency = latency_counter_create();
+    for (llentry_t *le = llist_head(list_write); le != NULL; le = le->next) {
+      write_func_t *wf = le->value;
+      wf->wf_latency.latency = latency_counter_create();
+    }
+    dispatch_sampling = (unsigned int)sampling;
+  } else if (sampling != 0) {
+    WARNING("plugin_init_all: DispatchLatencySampling %ld is out of range. "
+            "Not sampling the dispatch latency.",
+            sampling);
+  }
+
+  chain_name = global_option_get("PreCacheChain");
+  pre_cache_chain = fc_chain_get_by_name(chain_name);
+
+  chain_name = global_option_get("PostCacheChain");
+  post_cache_chain = fc_chain_get_by_name(chain_name);
+
+  write_limit_high = global_option_get_long("WriteQueueLimitHigh",
+                                            /* default = */ 0);
+  if (write_limit_high < 0) {
+    ERROR("WriteQueueLimitHigh must be positive or zero.");
+    write_limit_high = 0;
+  }
+
+  write_limit_low =
+      global_option_get_long("WriteQueueLimitLow",
+                             /* default = */ write_limit_high / 2);
+  if (write_limit_low < 0) {
+    ERROR("WriteQueueLimitLow must be positive or zero.");
+    write_limit_low = write_limit_high / 2;
+  } else if (write_limit_low > write_limit_high) {
+    ERROR("WriteQueueLimitLow must not be larger than "
+          "WriteQueueLimitHigh.");
+    write_limit_low = write_limit_high;
+  }
+
+  const char *source_rate = global_option_get("WriteQueueSourceRate");
+  if (source_rate != NULL) {
+    double rate = atof(source_rate);
+    if (!isfinite(rate) || (rate < 0.0))
+      ERROR("WriteQueueSourceRate must be positive or zero.");
+    else
+      write_source_rate = rate;
+  }
+
+  write_threads_num = global_option_get_long("WriteThreads",
+                                             /* default = */ 5);
+  if (write_threads_num < 1) {
+    ERROR("WriteThreads must be positive.");
+    write_threads_num = 5;
+  }
+
+  long threads_max = global_option_get_long("WriteThreadsMax",
+                                            /* default = */ 0);
+  if ((threads_max != 0) && ((size_t)threads_max < write_threads_num)) {
+    ERROR("WriteThreadsMax must not be smaller than WriteThreads.");
+  } else if (threads_max > 0) {
+    write_threads_max = (size_t)threads_max;
+    write_scale_length = global_option_get_long("WriteThreadsTargetLength",
+                                                /* default = */ 1000);
+    if (write_scale_length < 1) {
+      ERROR("WriteThreadsTargetLength must be positive.");
+      write_scale_length = 1000;
+    }
+    write_scale_age = global_option_get_time("WriteThreadsTargetAge",
+                                             TIME_T_TO_CDTIME_T(1));
+    if (write_scale_age == 0) {
+      ERROR("WriteThreadsTargetAge must be positive.");
+      write_scale_age = TIME_T_TO_CDTIME_T(1);
+    }
+    write_scale_idle = global_option_get_time("WriteThreadsIdleTime",
+                                              TIME_T_TO_CDTIME_T(60));
+  }
+
+  long shards_num = global_option_get_long("WriteQueueShards",
+                                           /* default = */ 1);
+  if (shards_num < 1) {
+    ERROR("WriteQueueShards must be positive.");
+    shards_num = 1;
+  } else if ((size_t)shards_num > write_threads_num) {
+    WARNING("WriteQueueShards (%ld) is larger than WriteThreads (%" PRIsz
+            "). Using %" PRIsz " shards.",
+            shards_num, write_threads_num, write_threads_num);
+    shards_num = (long)write_threads_num;
+  }
+  write_queue_shards_create((size_t)shards_num);
+
+  long batch_size = global_option_get_long("WriteQueueBatchSize",
+                                           /* default = */ 1);
+  if ((batch_size < 1) || (batch_size > WRITE_QUEUE_BATCH_MAX)) {
+    ERROR("WriteQueueBatchSize must be in the range [1-%d].",
+          WRITE_QUEUE_BATCH_MAX);
+    batch_size = 1;
+  }
+  write_queue_batch_size = (size_t)batch_size;
+
+  if ((list_init == NULL) && (list_init_parallel == NULL) &&
+      (read_list == NULL))
+    return ret;
+
+  start_log_thread();
+
+  /* The independent init callbacks run in the background while the others
+   * are called here. */
+  start_init_threads();
+
+  /* Calling all init callbacks before checking if read callbacks
+   * are available allows the init callbacks to register the read
+   * callback. */
+  le = llist_head(list_init);
+  while (le != NULL) {
+    if (plugin_init_one(le) != 0)
+      ret = -1;
+
+    le = le->next;
+  }
+
+  /* Without read threads (see the `-T' command line option), there is
+   * nothing to get a head start on. */
+  const char *rt = global_option_get("ReadThreads");
+  if ((rt != NULL) && (atoi(rt) == -1))
+    wait_init_threads();
+
+  /* Write threads raise notifications, e.g. the threshold checks, so the
+   * notification threads are started first. */
+  start_notification_threads();
+  start_flush_threads();
+  write_funcs_start();
+  start_write_threads((size_t)write_threads_num);
+
+  max_read_interval =
+      global_option_get_time("MaxReadInterval", DEFAULT_MAX_READ_INTERVAL);
+
+  read_jitter = IS_TRUE(global_option_get("ReadJitter"));
+  if (global_option_get("ReadPhase") != NULL)
+    read_phase = (uint64_t)global_option_get_time("ReadPhase", 0);
+  else
+    read_phase = identifier_hash(hostname_g);
+
+  /* Start read-threads */
+  if (read_list != NULL) {
+    int num;
+
+    num = atoi(rt);
+    if (num != -1)
+      start_read_threads((num > 0) ? ((size_t)num) : 5);
+  }
+
+  /* The read threads are already busy with the plugins which are ready, so
+   * waiting for the remaining init callbacks here only delays the main
+   * loop. */
+  if (wait_init_threads() != 0)
+    ret = -1;
+
+  return ret;
+} /* void plugin_init_all */
+
+int plugin_init_plugin(char const *name) /* {{{ */
+{
+  loaded_plugin_t *lp = plugin_loaded_get(name, /* create = */ 0);
+  int ret = 0;
+
+  if ((lp == NULL) || !lp->loaded)
+    return ENOENT;
+
+  llist_t *lists[] = {list_init, list_init_parallel};
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(lists); i++) {
+    if (lists[i] == NULL)
+      continue;
+
+    for (llentry_t *le = llist_head(lists[i]); le != NULL; le = le->next) {
+      callback_func_t *cf = le->value;
+      if ((cf->cf_plugin == lp) && (plugin_init_one(le) != 0))
+        ret = -1;
+    }
+  }
+
+  plugin_loaded_set(&lp->disabled, 0);
+  return ret;
+} /* }}} int plugin_init_plugin */
+
+void plugin_mark_permanent(void) /* {{{ */
+{
+  loaded_plugin_t *lp = plugin_loaded_get(plugin_get_ctx().name, 0);
+
+  if (lp != NULL)
+    plugin_loaded_set(&lp->permanent, 1);
+} /* }}} void plugin_mark_permanent */
+
+void *plugin_shared_acquire(char const *name, /* {{{ */
+                            void *(*create)(void)) {
+  if ((name == NULL) || (create == NULL))
+    return NULL;
+
+  pthread_mutex_lock(&plugin_shared_lock);
+
+  plugin_shared_t *ps = plugin_shared_list;
+  while ((ps != NULL) && (strcmp(ps->name, name) != 0))
+    ps = ps->next;
+
+  if (ps == NULL) {
+    ps = calloc(1, sizeof(*ps));
+    if (ps == NULL) {
+      pthread_mutex_unlock(&plugin_shared_lock);
+      ERROR("plugin_shared_acquire: calloc failed.");
+      return NULL;
+    }
+    ps->name = strdup(name);
+    ps->object = (ps->name != NULL) ? create() : NULL;
+    if (ps->object == NULL) {
+      pthread_mutex_unlock(&plugin_shared_lock);
+      sfree(ps->name);
+      sfree(ps);
+      return NULL;
+    }
+    ps->next = plugin_shared_list;
+    plugin_shared_list = ps;
+  }
+
+  ps->refs++;
+  void *object = ps->object;
+  pthread_mutex_unlock(&plugin_shared_lock);
+  return object;
+} /* }}} void *plugin_shared_acquire */
 
-int plugin_unregister_missing(const char *name) {
-  return plugin_unregister(list_missing, name);
-}
+void *plugin_shared_release(char const *name) /* {{{ */
+{
+  if (name == NULL)
+    return NULL;
 
-int plugin_unregister_shutdown(const char *name) {
-  return plugin_unregister(list_shutdown, name);
-}
+  pthread_mutex_lock(&plugin_shared_lock);
 
-int plugin_unregister_data_set(const char *name) {
-  data_set_t *ds;
+  plugin_shared_t **ptr = &plugin_shared_list;
+  while ((*ptr != NULL) && (strcmp((*ptr)->name, name) != 0))
+    ptr = &(*ptr)->next;
 
-  if (data_sets == NULL)
-    return -1;
+  plugin_shared_t *ps = *ptr;
+  if (ps == NULL) {
+    pthread_mutex_unlock(&plugin_shared_lock);
+    WARNING("plugin_shared_release: \"%s\" is not registered.", name);
+    return NULL;
+  }
 
-  if (c_avl_remove(data_sets, name, NULL, (void *)&ds) != 0)
-    return -1;
+  ps->refs--;
+  if (ps->refs > 0) {
+    pthread_mutex_unlock(&plugin_shared_lock);
+    return NULL;
+  }
 
-  sfree(ds->ds);
-  sfree(ds);
+  *ptr = ps->next;
+  pthread_mutex_unlock(&plugin_shared_lock);
+
+  void *object = ps->object;
+  sfree(ps->name);
+  sfree(ps);
+  return object;
+} /* }}} void *plugin_shared_release */
+
+/* Moves the callbacks of "lp" from "list" to "callbacks_retired". Only the
+ * main thread walks the lists themselves; other threads use the callback
+ * arrays, which have to be updated afterwards. The entries are kept until
+ * shutdown, since older snapshots may still refer to them. */
+static void plugin_retire_callbacks(llist_t *list, /* {{{ */
+                                    loaded_plugin_t *lp) {
+  if (list == NULL)
+    return;
 
-  return 0;
-} /* int plugin_unregister_data_set */
+  llentry_t *le = llist_head(list);
+  while (le != NULL) {
+    llentry_t *next = le->next;
+    callback_func_t *cf = le->value;
 
-int plugin_unregister_log(const char *name) {
-  return plugin_unregister(list_log, name);
-}
+    if (cf->cf_plugin == lp) {
+      llist_remove(list, le);
+      plugin_loaded_set(&cf->cf_retired, 1);
 
-int plugin_unregister_notification(const char *name) {
-  return plugin_unregister(list_notification, name);
-}
+      /* Without the entry, the callback is simply never freed. */
+      retired_callback_t *tmp =
+          realloc(callbacks_retired,
+                  (callbacks_retired_num + 1) * sizeof(*callbacks_retired));
+      if (tmp == NULL) {
+        ERROR("plugin_unload: realloc failed.");
+      } else {
+        callbacks_retired = tmp;
+        callbacks_retired[callbacks_retired_num] =
+            (retired_callback_t){
+                .le = le, .list = list, .is_write = (list == list_write)};
+        callbacks_retired_num++;
+      }
+    }
 
-int plugin_init_all(void) {
-  char const *chain_name;
-  llentry_t *le;
-  int status;
-  int ret = 0;
+    le = next;
+  }
+} /* }}} void plugin_retire_callbacks */
 
-  /* Init the value cache */
-  uc_init();
+/* Returns true if the retired callback "i" belongs to "lp" and has not been
+ * released yet, e.g. because an earlier plugin_unload() timed out. */
+static _Bool plugin_retired_pending(size_t i, loaded_plugin_t *lp) /* {{{ */
+{
+  callback_func_t *cf = callbacks_retired[i].le->value;
 
-  if (IS_TRUE(global_option_get("CollectInternalStats"))) {
-    record_statistics = 1;
-    plugin_register_read("collectd", plugin_update_internal_statistics);
+  return !callbacks_retired[i].released && (cf->cf_plugin == lp);
+} /* }}} _Bool plugin_retired_pending */
+
+int plugin_unload(char const *name) /* {{{ */
+{
+  loaded_plugin_t *lp = plugin_loaded_get(name, /* create = */ 0);
+  if ((lp == NULL) || !lp->loaded)
+    return ENOENT;
+
+  if (plugin_loaded_is(&lp->permanent)) {
+    NOTICE("plugin_unload: Plugin \"%s\" can't be unloaded.", lp->name);
+    return EBUSY;
   }
 
-  chain_name = global_option_get("PreCacheChain");
-  pre_cache_chain = fc_chain_get_by_name(chain_name);
+  cdtime_t deadline = cdtime() + PLUGIN_UNLOAD_TIMEOUT;
+
+  /* From here on, none of the plugin's callbacks are entered. */
+  plugin_loaded_set(&lp->disabled, 1);
+
+  plugin_retire_callbacks(list_init, lp);
+  plugin_retire_callbacks(list_init_parallel, lp);
+  plugin_retire_callbacks(list_write, lp);
+  callback_array_update(&array_write, list_write);
+  plugin_retire_callbacks(list_flush, lp);
+  callback_array_update(&array_flush, list_flush);
+  plugin_retire_callbacks(list_missing, lp);
+  plugin_retire_callbacks(list_notification, lp);
+  callback_array_update(&array_notification, list_notification);
+  plugin_retire_callbacks(list_log, lp);
+  callback_array_update(&array_log, list_log);
+  plugin_retire_callbacks(list_shutdown, lp);
+
+  /* Read functions are destroyed by the read threads, like with
+   * plugin_unregister_read(). Their user data is freed here, while the
+   * plugin's free functions are still around. */
+  user_data_t *read_udata = NULL;
+  size_t read_udata_num = 0;
 
-  chain_name = global_option_get("PostCacheChain");
-  post_cache_chain = fc_chain_get_by_name(chain_name);
+  pthread_mutex_lock(&read_lock);
+  llentry_t *le = (read_list != NULL) ? llist_head(read_list) : NULL;
+  while (le != NULL) {
+    llentry_t *next = le->next;
+    read_func_t *rf = le->value;
+
+    if (rf->rf_super.cf_plugin == lp) {
+      user_data_t *tmp =
+          realloc(read_udata, (read_udata_num + 1) * sizeof(*read_udata));
+      if (tmp != NULL) {
+        read_udata = tmp;
+        read_udata[read_udata_num++] = rf->rf_udata;
+        rf->rf_udata.free_func = NULL;
+      }
 
-  write_limit_high = global_option_get_long("WriteQueueLimitHigh",
-                                            /* default = */ 0);
-  if (write_limit_high < 0) {
-    ERROR("WriteQueueLimitHigh must be positive or zero.");
-    write_limit_high = 0;
-  }
+      llist_remove(read_list, le);
+      llentry_destroy(le);
+      rf->rf_type = RF_REMOVE;
+    }
 
-  write_limit_low =
-      global_option_get_long("WriteQueueLimitLow",
-                             /* default = */ write_limit_high / 2);
-  if (write_limit_low < 0) {
-    ERROR("WriteQueueLimitLow must be positive or zero.");
-    write_limit_low = write_limit_high / 2;
-  } else if (write_limit_low > write_limit_high) {
-    ERROR("WriteQueueLimitLow must not be larger than "
-          "WriteQueueLimitHigh.");
-    write_limit_low = write_limit_high;
+    le = next;
   }
+  pthread_mutex_unlock(&read_lock);
 
-  write_threads_num = global_option_get_long("WriteThreads",
-                                             /* default = */ 5);
-  if (write_threads_num < 1) {
-    ERROR("WriteThreads must be positive.");
-    write_threads_num = 5;
+  if (!callback_wait(lp, deadline)) {
+    ERROR("plugin_unload: Callbacks of plugin \"%s\" did not return within "
+          "%.0f seconds. The plugin stays loaded, but disabled.",
+          lp->name, CDTIME_T_TO_DOUBLE(PLUGIN_UNLOAD_TIMEOUT));
+    sfree(read_udata);
+    return ETIMEDOUT;
   }
 
-  if ((list_init == NULL) && (read_heap == NULL))
-    return ret;
+  /* Drain the write queues and let the plugin write out its state, like
+   * plugin_shutdown_all() does. */
+  for (size_t i = 0; i < callbacks_retired_num; i++) {
+    if (!plugin_retired_pending(i, lp) ||
+        (callbacks_retired[i].list != list_write))
+      continue;
 
-  /* Calling all init callbacks before checking if read callbacks
-   * are available allows the init callbacks to register the read
-   * callback. */
-  le = llist_head(list_init);
-  while (le != NULL) {
-    callback_func_t *cf;
-    plugin_init_cb callback;
-    plugin_ctx_t old_ctx;
+    write_func_t *wf = callbacks_retired[i].le->value;
+    write_func_stop(wf);
+    downsample_destroy(wf->wf_downsample);
+    wf->wf_downsample = NULL;
+    /* The journal is opened again when the plugin is loaded again. */
+    spill_destroy(wf->wf_spill);
+    wf->wf_spill = NULL;
+  }
 
-    cf = le->value;
-    old_ctx = plugin_set_ctx(cf->cf_ctx);
-    callback = cf->cf_callback;
-    status = (*callback)();
+  for (size_t i = 0; i < callbacks_retired_num; i++) {
+    if (!plugin_retired_pending(i, lp) ||
+        (callbacks_retired[i].list != list_flush))
+      continue;
+
+    callback_func_t *cf = callbacks_retired[i].le->value;
+    plugin_flush_cb callback = cf->cf_callback;
+    plugin_ctx_t old_ctx = plugin_set_ctx(cf->cf_ctx);
+    (*callback)(/* timeout = */ 0, /* identifier = */ NULL, &cf->cf_udata);
     plugin_set_ctx(old_ctx);
+  }
 
-    if (status != 0) {
-      ERROR("Initialization of plugin `%s' "
-            "failed with status %i. "
-            "Plugin will be unloaded.",
-            le->key, status);
-      /* Plugins that register read callbacks from the init
-       * callback should take care of appropriate error
-       * handling themselves. */
-      /* FIXME: Unload _all_ functions */
-      plugin_unregister_read(le->key);
-      ret = -1;
-    }
+  for (size_t i = 0; i < callbacks_retired_num; i++) {
+    if (!plugin_retired_pending(i, lp) ||
+        (callbacks_retired[i].list != list_shutdown))
+      continue;
 
-    le = le->next;
+    llentry_t *le = callbacks_retired[i].le;
+    callback_func_t *cf = le->value;
+    plugin_shutdown_cb callback = cf->cf_callback;
+    plugin_ctx_t old_ctx = plugin_set_ctx(cf->cf_ctx);
+    if ((*callback)() != 0)
+      WARNING("plugin_unload: Shutdown callback \"%s\" failed.", le->key);
+    plugin_set_ctx(old_ctx);
   }
 
-  start_write_threads((size_t)write_threads_num);
+  /* See plugin_shutdown_all() for why this frees all user data. */
+  for (size_t i = 0; i < callbacks_retired_num; i++) {
+    if (!plugin_retired_pending(i, lp))
+      continue;
 
-  max_read_interval =
-      global_option_get_time("MaxReadInterval", DEFAULT_MAX_READ_INTERVAL);
+    callback_func_t *cf = callbacks_retired[i].le->value;
+    free_userdata(&cf->cf_udata);
+    cf->cf_udata = (user_data_t){0};
+    callbacks_retired[i].released = 1;
+  }
+  for (size_t i = 0; i < read_udata_num; i++)
+    free_userdata(read_udata + i);
+  sfree(read_udata);
 
-  /* Start read-threads */
-  if (read_heap != NULL) {
-    const char *rt;
-    int num;
+  cf_unregister_plugin(lp->name);
 
-    rt = global_option_get("ReadThreads");
-    num = atoi(rt);
-    if (num != -1)
-      start_read_threads((num > 0) ? ((size_t)num) : 5);
+  if (!plugin_loaded_wait(&lp->threads, deadline)) {
+    ERROR("plugin_unload: Threads of plugin \"%s\" did not exit within "
+          "%.0f seconds. The plugin stays loaded, but disabled.",
+          lp->name, CDTIME_T_TO_DOUBLE(PLUGIN_UNLOAD_TIMEOUT));
+    return EBUSY;
   }
-  return ret;
-} /* void plugin_init_all */
+
+  dlclose(lp->dlh);
+  lp->dlh = NULL;
+  lp->loaded = 0;
+
+  INFO("plugin_unload: Plugin \"%s\" has been unloaded.", lp->name);
+  return 0;
+} /* }}} int plugin_unload */
 
 /* TODO: Rename this function. */
 void plugin_read_all(void) {
@@ -1645,7 +5664,7 @@ int plugin_read_all_once(void) {
   int status;
   int return_status = 0;
 
-  if (read_heap == NULL) {
+  if (read_list == NULL) {
     NOTICE("No read-functions are registered.");
     return 0;
   }
@@ -1654,7 +5673,9 @@ int plugin_read_all_once(void) {
     read_func_t *rf;
     plugin_ctx_t old_ctx;
 
-    rf = c_heap_get_root(read_heap);
+    pthread_mutex_lock(&read_queue_default.lock);
+    rf = read_queue_take(&read_queue_default);
+    pthread_mutex_unlock(&read_queue_default.lock);
     if (rf == NULL)
       break;
 
@@ -1679,8 +5700,7 @@ int plugin_read_all_once(void) {
       return_status = -1;
     }
 
-    sfree(rf->rf_name);
-    destroy_callback((void *)rf);
+    read_func_destroy(rf);
   }
 
   return return_status;
@@ -1688,13 +5708,14 @@ int plugin_read_all_once(void) {
 
 int plugin_write(const char *plugin, /* {{{ */
                  const data_set_t *ds, const value_list_t *vl) {
-  llentry_t *le;
+  callback_array_t *array;
   int status;
 
   if (vl == NULL)
     return EINVAL;
 
-  if (list_write == NULL)
+  array = callback_array_get(&array_write);
+  if (array == NULL)
     return ENOENT;
 
   if (ds == NULL) {
@@ -1709,23 +5730,24 @@ int plugin_write(const char *plugin, /* {{{ */
     int success = 0;
     int failure = 0;
 
-    le = llist_head(list_write);
-    while (le != NULL) {
-      callback_func_t *cf = le->value;
-      plugin_write_cb callback;
+    for (size_t i = 0; i < array->num; i++) {
+      write_func_t *wf = array->entries[i].value;
 
       /* do not switch plugin context; rather keep the context (interval)
        * information of the calling read plugin */
 
-      DEBUG("plugin: plugin_write: Writing values via %s.", le->key);
-      callback = cf->cf_callback;
-      status = (*callback)(ds, vl, &cf->cf_udata);
+      /* The plugin is being unloaded. */
+      if (!callback_enter(&wf->wf_super))
+        continue;
+
+      DEBUG("plugin: plugin_write: Writing values via %s.",
+            array->entries[i].name);
+      status = write_func_write(wf, ds, vl);
+      callback_leave(&wf->wf_super);
       if (status != 0)
         failure++;
       else
         success++;
-
-      le = le->next;
     }
 
     if ((success == 0) && (failure != 0))
@@ -1734,68 +5756,408 @@ int plugin_write(const char *plugin, /* {{{ */
       status = 0;
   } else /* plugin != NULL */
   {
-    callback_func_t *cf;
-    plugin_write_cb callback;
-
-    le = llist_head(list_write);
-    while (le != NULL) {
-      if (strcasecmp(plugin, le->key) == 0)
+    size_t i;
+    for (i = 0; i < array->num; i++)
+      if (strcasecmp(plugin, array->entries[i].name) == 0)
         break;
 
-      le = le->next;
-    }
-
-    if (le == NULL)
+    if (i >= array->num)
       return ENOENT;
 
-    cf = le->value;
-
     /* do not switch plugin context; rather keep the context (interval)
      * information of the calling read plugin */
 
-    DEBUG("plugin: plugin_write: Writing values via %s.", le->key);
-    callback = cf->cf_callback;
-    status = (*callback)(ds, vl, &cf->cf_udata);
+    write_func_t *wf = array->entries[i].value;
+    if (!callback_enter(&wf->wf_super))
+      return ENOENT;
+
+    DEBUG("plugin: plugin_write: Writing values via %s.",
+          array->entries[i].name);
+    status = write_func_write(wf, ds, vl);
+    callback_leave(&wf->wf_super);
   }
 
   return status;
 } /* }}} int plugin_write */
 
-int plugin_flush(const char *plugin, cdtime_t timeout, const char *identifier) {
-  llentry_t *le;
+/* Calls the flush callback "name". Returns ENOENT if it has been
+ * unregistered in the meantime. */
+static int plugin_flush_one(const char *name, cdtime_t timeout, /* {{{ */
+                            const char *identifier) {
+  callback_array_t *array = callback_array_get(&array_flush);
+  callback_func_t *cf = NULL;
+
+  for (size_t i = 0; (array != NULL) && (i < array->num); i++) {
+    if (strcmp(name, array->entries[i].name) == 0) {
+      cf = array->entries[i].value;
+      break;
+    }
+  }
+  if ((cf == NULL) || !callback_enter(cf))
+    return ENOENT;
+
+  plugin_ctx_t old_ctx = plugin_set_ctx(cf->cf_ctx);
+  plugin_flush_cb callback = cf->cf_callback;
+
+  cdtime_t cpu_begin = plugin_cpu_begin();
+  int status = (*callback)(timeout, identifier, &cf->cf_udata);
+  plugin_cpu_end(cf, PLUGIN_CPU_FLUSH, cpu_begin);
+
+  plugin_set_ctx(old_ctx);
+  callback_leave(cf);
+  return status;
+} /* }}} int plugin_flush_one */
+
+/* Must be called with "flush_lock" held. */
+static void flush_request_release(flush_request_t *req) /* {{{ */
+{
+  assert(req->refs > 0);
+  req->refs--;
+  if (req->refs > 0)
+    return;
+
+  for (size_t i = 0; i < req->results_num; i++)
+    sfree(req->results[i].name);
+  sfree(req->results);
+  sfree(req->done);
+  pthread_cond_destroy(&req->cond);
+  sfree(req);
+} /* }}} void flush_request_release */
+
+static void *plugin_flush_thread(void __attribute__((unused)) * args) /* {{{ */
+{
+  pthread_mutex_lock(&flush_lock);
+  while (42) {
+    flush_job_t *job = flush_queue_head;
+    if (job == NULL) {
+      if (!flush_loop)
+        break;
+      pthread_cond_wait(&flush_cond, &flush_lock);
+      continue;
+    }
+    flush_queue_head = job->next;
+    if (flush_queue_head == NULL)
+      flush_queue_tail = NULL;
+
+    flush_request_t *req = job->req;
+    /* The name is owned by the request, which we hold a reference to. */
+    char *name = req->results[job->index].name;
+    pthread_mutex_unlock(&flush_lock);
+
+    cdtime_t start = cdtime_precise();
+    int status = plugin_flush_one(name, job->timeout, job->identifier);
+    cdtime_t duration = cdtime_precise() - start;
+
+    pthread_mutex_lock(&flush_lock);
+    char *key = NULL;
+    if (c_avl_remove(flush_busy, name, (void *)&key, NULL) == 0)
+      sfree(key);
+
+    req->results[job->index].status = status;
+    req->results[job->index].duration = duration;
+    req->done[job->index] = 1;
+    req->pending--;
+    pthread_cond_broadcast(&req->cond);
+    flush_request_release(req);
+
+    sfree(job->identifier);
+    sfree(job);
+  }
+  pthread_mutex_unlock(&flush_lock);
+  return NULL;
+} /* }}} void *plugin_flush_thread */
+
+static void start_flush_threads(void) /* {{{ */
+{
+  long num = global_option_get_long("FlushThreads", /* default = */ 4);
+  if (num < 0) {
+    ERROR("FlushThreads must be positive or zero.");
+    num = 0;
+  }
+  if ((num == 0) || (flush_threads != NULL))
+    return;
+
+  pthread_mutex_lock(&flush_lock);
+  flush_busy = c_avl_create((int (*)(const void *, const void *))strcmp);
+  flush_threads = calloc((size_t)num, sizeof(*flush_threads));
+  if ((flush_busy == NULL) || (flush_threads == NULL)) {
+    ERROR("plugin: start_flush_threads: Allocating memory failed.");
+    if (flush_busy != NULL)
+      c_avl_destroy(flush_busy);
+    flush_busy = NULL;
+    sfree(flush_threads);
+    pthread_mutex_unlock(&flush_lock);
+    return;
+  }
+
+  flush_loop = 1;
+  for (size_t i = 0; i < (size_t)num; i++) {
+    int status = pthread_create(flush_threads + flush_threads_num,
+                                /* attr = */ NULL, plugin_flush_thread,
+                                /* arg = */ NULL);
+    if (status != 0) {
+      ERROR("plugin: start_flush_threads: pthread_create failed with "
+            "status %i (%s).",
+            status, STRERROR(status));
+      break;
+    }
+
+    char name[THREAD_NAME_MAX];
+    snprintf(name, sizeof(name), "flush#%" PRIsz, flush_threads_num);
+    set_thread_name(flush_threads[flush_threads_num], name);
+
+    flush_threads_num++;
+  }
+  pthread_mutex_unlock(&flush_lock);
+} /* }}} void start_flush_threads */
+
+/* Blocks until all running flush callbacks have returned. */
+static void stop_flush_threads(void) /* {{{ */
+{
+  if (flush_threads == NULL)
+    return;
+
+  pthread_mutex_lock(&flush_lock);
+  flush_loop = 0;
+  pthread_cond_broadcast(&flush_cond);
+  size_t num = flush_threads_num;
+  /* Callers flush synchronously from now on. */
+  flush_threads_num = 0;
+  pthread_mutex_unlock(&flush_lock);
+
+  for (size_t i = 0; i < num; i++)
+    if (pthread_join(flush_threads[i], NULL) != 0)
+      ERROR("plugin: stop_flush_threads: pthread_join failed.");
+  sfree(flush_threads);
+
+  pthread_mutex_lock(&flush_lock);
+  char *key;
+  while (c_avl_pick(flush_busy, (void *)&key, NULL) == 0)
+    sfree(key);
+  c_avl_destroy(flush_busy);
+  flush_busy = NULL;
+  pthread_mutex_unlock(&flush_lock);
+} /* }}} void stop_flush_threads */
+
+/* Calls the matching callbacks one after the other in the calling thread. */
+static int plugin_flush_sync(const char *plugin, cdtime_t timeout, /* {{{ */
+                             const char *identifier,
+                             plugin_flush_result_t **ret_results,
+                             size_t *ret_results_num) {
+  callback_array_t *array = callback_array_get(&array_flush);
+  plugin_flush_result_t *results = NULL;
+  size_t results_num = 0;
+
+  for (size_t i = 0; (array != NULL) && (i < array->num); i++) {
+    char const *key = array->entries[i].name;
+    if ((plugin != NULL) && (strcmp(plugin, key) != 0))
+      continue;
+
+    plugin_flush_result_t *tmp =
+        realloc(results, (results_num + 1) * sizeof(*results));
+    char *name = strdup(key);
+    if ((tmp == NULL) || (name == NULL)) {
+      ERROR("plugin_flush: Allocating memory failed.");
+      if (tmp != NULL)
+        results = tmp;
+      sfree(name);
+      plugin_flush_results_free(results, results_num);
+      return ENOMEM;
+    }
+    results = tmp;
+
+    cdtime_t start = cdtime_precise();
+    int status = plugin_flush_one(name, timeout, identifier);
+    results[results_num] = (plugin_flush_result_t){
+        .name = name, .status = status, .duration = cdtime_precise() - start,
+    };
+    results_num++;
+  }
 
-  if (list_flush == NULL)
+  *ret_results = results;
+  *ret_results_num = results_num;
+  return 0;
+} /* }}} int plugin_flush_sync */
+
+/* Like plugin_flush_results(), but a "deadline" of zero waits for all
+ * callbacks to return. */
+static int plugin_flush_collect(const char *plugin, cdtime_t timeout, /* {{{ */
+                                const char *identifier, cdtime_t deadline,
+                                plugin_flush_result_t **ret_results,
+                                size_t *ret_results_num) {
+  *ret_results = NULL;
+  *ret_results_num = 0;
+
+  callback_array_t *array = callback_array_get(&array_flush);
+  if (array == NULL)
     return 0;
 
-  le = llist_head(list_flush);
-  while (le != NULL) {
-    callback_func_t *cf;
-    plugin_flush_cb callback;
-    plugin_ctx_t old_ctx;
+  pthread_mutex_lock(&flush_lock);
+  if (flush_threads_num == 0) {
+    pthread_mutex_unlock(&flush_lock);
+    return plugin_flush_sync(plugin, timeout, identifier, ret_results,
+                             ret_results_num);
+  }
 
-    if ((plugin != NULL) && (strcmp(plugin, le->key) != 0)) {
-      le = le->next;
+  size_t num = 0;
+  for (size_t i = 0; i < array->num; i++)
+    if ((plugin == NULL) || (strcmp(plugin, array->entries[i].name) == 0))
+      num++;
+  if (num == 0) {
+    pthread_mutex_unlock(&flush_lock);
+    return 0;
+  }
+
+  flush_request_t *req = calloc(1, sizeof(*req));
+  plugin_flush_result_t *results = calloc(num, sizeof(*results));
+  if ((req == NULL) || (results == NULL) ||
+      ((req->results = calloc(num, sizeof(*req->results))) == NULL) ||
+      ((req->done = calloc(num, sizeof(*req->done))) == NULL)) {
+    pthread_mutex_unlock(&flush_lock);
+    ERROR("plugin_flush: Allocating memory failed.");
+    if (req != NULL) {
+      sfree(req->results);
+      sfree(req->done);
+    }
+    sfree(req);
+    sfree(results);
+    return ENOMEM;
+  }
+  pthread_cond_init(&req->cond, /* attr = */ NULL);
+  req->refs = 1;
+
+  cdtime_t start = cdtime_precise();
+  for (size_t i = 0; (i < array->num) && (req->results_num < num); i++) {
+    char const *cb_name = array->entries[i].name;
+    if ((plugin != NULL) && (strcmp(plugin, cb_name) != 0))
+      continue;
+
+    size_t index = req->results_num;
+    plugin_flush_result_t *r = req->results + index;
+    if ((r->name = strdup(cb_name)) == NULL)
+      break;
+    req->results_num++;
+
+    if (c_avl_get(flush_busy, r->name, NULL) == 0) {
+      r->status = EBUSY;
+      req->done[index] = 1;
       continue;
     }
 
-    cf = le->value;
-    old_ctx = plugin_set_ctx(cf->cf_ctx);
-    callback = cf->cf_callback;
+    flush_job_t *job = calloc(1, sizeof(*job));
+    char *key = strdup(r->name);
+    if ((job == NULL) || (key == NULL) ||
+        ((identifier != NULL) &&
+         ((job->identifier = strdup(identifier)) == NULL)) ||
+        (c_avl_insert(flush_busy, key, NULL) != 0)) {
+      ERROR("plugin_flush: Queueing the flush of %s failed.", r->name);
+      if (job != NULL)
+        sfree(job->identifier);
+      sfree(job);
+      sfree(key);
+      r->status = ENOMEM;
+      req->done[index] = 1;
+      continue;
+    }
+    job->req = req;
+    job->index = index;
+    job->timeout = timeout;
 
-    (*callback)(timeout, identifier, &cf->cf_udata);
+    if (flush_queue_tail == NULL)
+      flush_queue_head = job;
+    else
+      flush_queue_tail->next = job;
+    flush_queue_tail = job;
 
-    plugin_set_ctx(old_ctx);
+    req->refs++;
+    req->pending++;
+  }
+  pthread_cond_broadcast(&flush_cond);
 
-    le = le->next;
+  cdtime_t end = (deadline > 0) ? start + deadline : 0;
+  while (req->pending > 0) {
+    if (end == 0) {
+      pthread_cond_wait(&req->cond, &flush_lock);
+      continue;
+    }
+    if (pthread_cond_timedwait(&req->cond, &flush_lock,
+                               &CDTIME_T_TO_TIMESPEC(end)) == ETIMEDOUT)
+      break;
+  }
+
+  /* Callbacks that missed the deadline keep running; their outcome is
+   * discarded when they return. */
+  cdtime_t now = cdtime_precise();
+  size_t results_num = 0;
+  for (size_t i = 0; i < req->results_num; i++) {
+    char *name = strdup(req->results[i].name);
+    if (name == NULL)
+      continue;
+    results[results_num] = req->results[i];
+    results[results_num].name = name;
+    if (!req->done[i]) {
+      results[results_num].status = ETIMEDOUT;
+      results[results_num].duration = now - start;
+    }
+    results_num++;
   }
+  flush_request_release(req);
+  pthread_mutex_unlock(&flush_lock);
+
+  *ret_results = results;
+  *ret_results_num = results_num;
   return 0;
+} /* }}} int plugin_flush_collect */
+
+int plugin_flush_results(const char *plugin, cdtime_t timeout, /* {{{ */
+                         const char *identifier, cdtime_t deadline,
+                         plugin_flush_result_t **ret_results,
+                         size_t *ret_results_num) {
+  if ((ret_results == NULL) || (ret_results_num == NULL))
+    return EINVAL;
+
+  if (deadline == 0)
+    deadline = global_option_get_time("FlushDeadline", /* default = */ 0);
+
+  return plugin_flush_collect(plugin, timeout, identifier, deadline,
+                              ret_results, ret_results_num);
+} /* }}} int plugin_flush_results */
+
+void plugin_flush_results_free(plugin_flush_result_t *results, /* {{{ */
+                               size_t results_num) {
+  if (results == NULL)
+    return;
+
+  for (size_t i = 0; i < results_num; i++)
+    sfree(results[i].name);
+  sfree(results);
+} /* }}} void plugin_flush_results_free */
+
+int plugin_flush(const char *plugin, cdtime_t timeout, const char *identifier) {
+  plugin_flush_result_t *results = NULL;
+  size_t results_num = 0;
+
+  int status = plugin_flush_results(plugin, timeout, identifier,
+                                    /* deadline = */ 0, &results, &results_num);
+  if (status != 0)
+    return status;
+
+  for (size_t i = 0; i < results_num; i++)
+    if (results[i].status != 0)
+      status = -1;
+
+  plugin_flush_results_free(results, results_num);
+  return status;
 } /* int plugin_flush */
 
 int plugin_shutdown_all(void) {
   llentry_t *le;
   int ret = 0; // Assume success.
 
+  /* Init callbacks still running may register further callbacks. */
+  wait_init_threads();
   destroy_all_callbacks(&list_init);
+  destroy_all_callbacks(&list_init_parallel);
 
   stop_read_threads();
 
@@ -1804,15 +6166,31 @@ int plugin_shutdown_all(void) {
   read_list = NULL;
   pthread_mutex_unlock(&read_lock);
 
-  destroy_read_heap();
+  pthread_mutex_lock(&read_queue_default.lock);
+  destroy_read_queue(&read_queue_default);
+  pthread_mutex_unlock(&read_queue_default.lock);
+
+  for (size_t i = 0; i < read_pools_num; i++)
+    read_pool_destroy(read_pools[i]);
+  sfree(read_pools);
+  read_pools_num = 0;
 
   /* blocks until all write threads have shut down. */
   stop_write_threads();
+  write_funcs_stop();
 
-  /* ask all plugins to write out the state they kept. */
-  plugin_flush(/* plugin = */ NULL,
-               /* timeout = */ 0,
-               /* identifier = */ NULL);
+  /* Deliver the queued notifications before the plugins shut down. */
+  stop_notification_threads();
+
+  /* ask all plugins to write out the state they kept. Unlike other flushes,
+   * this one waits for all callbacks to return. */
+  plugin_flush_result_t *flush_results = NULL;
+  size_t flush_results_num = 0;
+  if (plugin_flush_collect(/* plugin = */ NULL, /* timeout = */ 0,
+                           /* identifier = */ NULL, /* deadline = */ 0,
+                           &flush_results, &flush_results_num) == 0)
+    plugin_flush_results_free(flush_results, flush_results_num);
+  stop_flush_threads();
 
   le = NULL;
   if (list_shutdown != NULL)
@@ -1839,20 +6217,69 @@ int plugin_shutdown_all(void) {
     plugin_set_ctx(old_ctx);
   }
 
+  /* All plugins have stopped dispatching values by now. */
+  uc_save();
+  shm_export_destroy();
+
   /* Write plugins which use the `user_data' pointer usually need the
    * same data available to the flush callback. If this is the case, set
    * the free_function to NULL when registering the flush callback and to
    * the real free function when registering the write callback. This way
    * the data isn't freed twice. */
+  callback_array_update(&array_flush, NULL);
   destroy_all_callbacks(&list_flush);
   destroy_all_callbacks(&list_missing);
-  destroy_all_callbacks(&list_write);
+  write_funcs_destroy();
+
+  callback_array_update(&array_notification, NULL);
+  destroy_all_callbacks(&list_notification);
+  destroy_all_callbacks(&list_shutdown);
+
+  /* Deliver the remaining messages, log synchronously from now on. */
+  stop_log_thread();
+  callback_array_update(&array_log, NULL);
+  destroy_all_callbacks(&list_log);
+
+  /* No thread refers to the callbacks of unloaded plugins any longer. */
+  for (size_t i = 0; i < callbacks_retired_num; i++) {
+    llentry_t *le = callbacks_retired[i].le;
+
+    if (callbacks_retired[i].is_write)
+      write_func_destroy(le->value);
+    else
+      destroy_callback(le->value);
+    sfree(le->key);
+    llentry_destroy(le);
+  }
+  sfree(callbacks_retired);
+  callbacks_retired_num = 0;
+
+  pthread_mutex_lock(&write_sources_lock);
+  if (write_sources != NULL) {
+    char *key;
+    write_source_t *src;
+    while (c_avl_pick(write_sources, (void *)&key, (void *)&src) == 0) {
+      sfree(src->name);
+      sfree(src);
+    }
+    c_avl_destroy(write_sources);
+    write_sources = NULL;
+  }
+  pthread_mutex_unlock(&write_sources_lock);
 
-  destroy_all_callbacks(&list_notification);
-  destroy_all_callbacks(&list_shutdown);
-  destroy_all_callbacks(&list_log);
+  plugin_cpu_accounting = 0;
+  plugin_cpu_destroy();
+
+  dispatch_sampling = 0;
+  for (size_t i = 0; i < DISPATCH_STAGES_NUM; i++) {
+    pthread_mutex_lock(&dispatch_stages[i].lock);
+    latency_counter_destroy(dispatch_stages[i].latency);
+    dispatch_stages[i].latency = NULL;
+    pthread_mutex_unlock(&dispatch_stages[i].lock);
+  }
 
   plugin_free_loaded();
+  callback_arrays_free();
   plugin_free_data_sets();
   return ret;
 } /* void plugin_shutdown_all */
@@ -1865,11 +6292,17 @@ int plugin_dispatch_missing(const value_list_t *vl) /* {{{ */
   llentry_t *le = llist_head(list_missing);
   while (le != NULL) {
     callback_func_t *cf = le->value;
+    if (!callback_enter(cf)) {
+      le = le->next;
+      continue;
+    }
+
     plugin_ctx_t old_ctx = plugin_set_ctx(cf->cf_ctx);
     plugin_missing_cb callback = cf->cf_callback;
 
     int status = (*callback)(vl, &cf->cf_udata);
     plugin_set_ctx(old_ctx);
+    callback_leave(cf);
     if (status != 0) {
       if (status < 0) {
         ERROR("plugin_dispatch_missing: Callback function \"%s\" "
@@ -1899,7 +6332,8 @@ static int plugin_dispatch_values_internal(value_list_t *vl) {
   assert(vl->time != 0); /* The time is determined at _enqueue_ time. */
   assert(vl->interval != 0);
 
-  if (vl->type[0] == 0 || vl->values == NULL || vl->values_len < 1) {
+  if (((vl->type[0] == 0) && (vl->type_id == 0)) || vl->values == NULL ||
+      vl->values_len < 1) {
     ERROR("plugin_dispatch_values: Invalid value list "
           "from plugin %s.",
           vl->plugin);
@@ -1925,8 +6359,18 @@ static int plugin_dispatch_values_internal(value_list_t *vl) {
     return -1;
   }
 
-  data_set_t *ds = NULL;
-  if (c_avl_get(data_sets, vl->type, (void *)&ds) != 0) {
+  /* Prefer the handle resolved by the plugin. The type is still checked,
+   * because copies of a value list may have been given a different type. */
+  data_set_t const *ds = NULL;
+  if (vl->type_id != 0) {
+    ds = plugin_get_ds_by_id(vl->type_id);
+    if ((ds != NULL) && (vl->type[0] == 0))
+      sstrncpy(vl->type, ds->type, sizeof(vl->type));
+    else if ((ds != NULL) && (strcmp(ds->type, vl->type) != 0))
+      ds = NULL;
+  }
+
+  if ((ds == NULL) && (c_avl_get(data_sets, vl->type, (void *)&ds) != 0)) {
     char ident[6 * DATA_MAX_NAME_LEN];
 
     FORMAT_VL(ident, sizeof(ident), vl);
@@ -1945,10 +6389,6 @@ static int plugin_dispatch_values_internal(value_list_t *vl) {
 
 #if COLLECT_DEBUG
   assert(0 == strcmp(ds->type, vl->type));
-#else
-  if (0 != strcmp(ds->type, vl->type))
-    WARNING("plugin_dispatch_values: (ds->type = %s) != (vl->type = %s)",
-            ds->type, vl->type);
 #endif
 
 #if COLLECT_DEBUG
@@ -1969,6 +6409,21 @@ static int plugin_dispatch_values_internal(value_list_t *vl) {
   escape_slashes(vl->type, sizeof(vl->type));
   escape_slashes(vl->type_instance, sizeof(vl->type_instance));
 
+  /* Determine the identity once, so the cache, matches, targets and write
+   * callbacks don't have to format the identifier again. Targets which modify
+   * the value list invalidate it. */
+  value_list_identity_t identity;
+  VALUE_LIST_IDENTITY_INVALIDATE(vl);
+  if (FORMAT_VL(identity.name, sizeof(identity.name), vl) == 0) {
+    identity.hash = identifier_hash(identity.name);
+    vl->identity = &identity;
+    vl->identity_owner = vl;
+  }
+
+  /* "stage_begin" is zero unless this value list is timed. */
+  cdtime_t stage_begin = dispatch_latency_sample() ? cdtime_precise() : 0;
+  DISPATCH_PROBE2(dispatch__start, vl->plugin, vl->type);
+
   if (pre_cache_chain != NULL) {
     status = fc_process_chain(ds, vl, pre_cache_chain);
     if (status < 0) {
@@ -1976,12 +6431,31 @@ static int plugin_dispatch_values_internal(value_list_t *vl) {
               "pre-cache chain failed with "
               "status %i (%#x).",
               status, status);
-    } else if (status == FC_TARGET_STOP)
+    } else if (status == FC_TARGET_STOP) {
+      VALUE_LIST_IDENTITY_INVALIDATE(vl);
       return 0;
+    }
+
+    if (stage_begin != 0) {
+      dispatch_latency_add(&dispatch_stages[DISPATCH_STAGE_PRE_CACHE],
+                           stage_begin);
+      stage_begin = cdtime_precise();
+    }
+  }
+  DISPATCH_PROBE2(dispatch__pre_cache, vl->plugin, vl->type);
+
+  /* Update the value cache. New series beyond the cache limits are dropped
+   * altogether. */
+  if (uc_update_unchanged(ds, vl, &vl->unchanged) == ENOSPC) {
+    VALUE_LIST_IDENTITY_INVALIDATE(vl);
+    return 0;
   }
+  DISPATCH_PROBE2(dispatch__cache, vl->plugin, vl->type);
 
-  /* Update the value cache */
-  uc_update(ds, vl);
+  if (stage_begin != 0) {
+    dispatch_latency_add(&dispatch_stages[DISPATCH_STAGE_CACHE], stage_begin);
+    stage_begin = cdtime_precise();
+  }
 
   if (post_cache_chain != NULL) {
     status = fc_process_chain(ds, vl, post_cache_chain);
@@ -1991,8 +6465,27 @@ static int plugin_dispatch_values_internal(value_list_t *vl) {
               "status %i (%#x).",
               status, status);
     }
-  } else
+  } else {
+    /* Nothing modifies the value list after this point, so the write
+     * callbacks' dedicated queues can share it instead of copying it. Targets
+     * of the post-cache chain may still modify it after writing, so values
+     * are copied for the dedicated queues in that case. */
+    plugin_value_list_share(vl, VALUE_LIST_IDENTITY(vl));
     fc_default_action(ds, vl);
+  }
+  DISPATCH_PROBE2(dispatch__post_cache, vl->plugin, vl->type);
+
+  if (stage_begin != 0)
+    dispatch_latency_add(&dispatch_stages[DISPATCH_STAGE_POST_CACHE],
+                         stage_begin);
+
+  /* Shared value lists keep their meta data and identity until they are
+   * released. */
+  if (vl->shared_owner == vl)
+    return 0;
+
+  /* "identity" goes out of scope. */
+  VALUE_LIST_IDENTITY_INVALIDATE(vl);
 
   if ((free_meta_data != 0) && (vl->meta != NULL)) {
     meta_data_destroy(vl->meta);
@@ -2002,72 +6495,137 @@ static int plugin_dispatch_values_internal(value_list_t *vl) {
   return 0;
 } /* int plugin_dispatch_values_internal */
 
-static double get_drop_probability(void) /* {{{ */
+static long write_queue_length_estimate(void) /* {{{ */
 {
-  long pos;
-  long size;
   long wql;
 
-  pthread_mutex_lock(&write_lock);
-  wql = write_queue_length;
-  pthread_mutex_unlock(&write_lock);
+  /* Shards are filled round-robin, so the length of the shard the next value
+   * will be appended to, multiplied by the number of shards, is a good
+   * estimate of the total queue length and avoids locking every shard. */
+  write_queue_shard_t *shard = write_queue_next_shard(/* advance = */ 0);
+  pthread_mutex_lock(&shard->lock);
+  wql = shard->length * (long)write_queue_shards_get()->num;
+  pthread_mutex_unlock(&shard->lock);
+
+  return wql;
+} /* }}} long write_queue_length_estimate */
+
+/* Returns the source "name", creating it with a full bucket if necessary.
+ * "write_sources_lock" must be held. */
+static write_source_t *write_source_get(const char *name, /* {{{ */
+                                        cdtime_t now) {
+  write_source_t *src = NULL;
+
+  if (write_sources == NULL) {
+    write_sources =
+        c_avl_create((int (*)(const void *, const void *))strcmp);
+    if (write_sources == NULL)
+      return NULL;
+  }
 
-  if (wql < write_limit_low)
-    return 0.0;
-  if (wql >= write_limit_high)
-    return 1.0;
+  if (c_avl_get(write_sources, name, (void *)&src) == 0)
+    return src;
+
+  src = calloc(1, sizeof(*src));
+  if (src == NULL)
+    return NULL;
+  src->name = strdup(name);
+  if ((src->name == NULL) ||
+      (c_avl_insert(write_sources, src->name, src) != 0)) {
+    sfree(src->name);
+    sfree(src);
+    return NULL;
+  }
+  src->tokens = write_source_rate;
+  src->last_refill = now;
+
+  return src;
+} /* }}} write_source_t *write_source_get */
+
+/* Takes one token from the bucket of "name". Returns false, and counts the
+ * value as dropped, if the bucket is empty or "admit" is false. */
+static _Bool write_source_admit(const char *name, _Bool admit) /* {{{ */
+{
+  cdtime_t now = cdtime();
+
+  pthread_mutex_lock(&write_sources_lock);
+
+  write_source_t *src = write_source_get(name, now);
+  if (src == NULL) {
+    pthread_mutex_unlock(&write_sources_lock);
+    return admit;
+  }
+
+  if (now > src->last_refill) {
+    src->tokens += write_source_rate * CDTIME_T_TO_DOUBLE(now - src->last_refill);
+    if (src->tokens > write_source_rate)
+      src->tokens = write_source_rate;
+    src->last_refill = now;
+  }
 
-  pos = 1 + wql - write_limit_low;
-  size = 1 + write_limit_high - write_limit_low;
+  if (admit && (src->tokens >= 1.0))
+    src->tokens -= 1.0;
+  else {
+    admit = 0;
+    src->dropped++;
+  }
 
-  return (double)pos / (double)size;
-} /* }}} double get_drop_probability */
+  pthread_mutex_unlock(&write_sources_lock);
+  return admit;
+} /* }}} _Bool write_source_admit */
 
-static _Bool check_drop_value(void) /* {{{ */
+static _Bool check_drop_value(value_list_t const *vl) /* {{{ */
 {
   static cdtime_t last_message_time = 0;
   static pthread_mutex_t last_message_lock = PTHREAD_MUTEX_INITIALIZER;
 
-  double p;
-  double q;
-  int status;
+  char name[DATA_MAX_NAME_LEN + 8];
+  long wql;
+  _Bool remote;
+  _Bool admit;
 
   if (write_limit_high == 0)
     return 0;
 
-  p = get_drop_probability();
-  if (p == 0.0)
+  wql = write_queue_length_estimate();
+  if (wql < write_limit_low)
     return 0;
 
-  status = pthread_mutex_trylock(&last_message_lock);
-  if (status == 0) {
-    cdtime_t now;
+  /* Values without a host are local, see plugin_value_list_clone(). */
+  remote = (vl->host[0] != 0) && (strcmp(vl->host, hostname_g) != 0);
+  if (!remote && (wql < write_limit_high))
+    return 0;
 
-    now = cdtime();
+  if (remote)
+    snprintf(name, sizeof(name), "host-%s", vl->host);
+  else
+    snprintf(name, sizeof(name), "plugin-%s", vl->plugin);
+
+  admit = write_source_admit(name, /* admit = */ !remote ||
+                                       (wql < write_limit_high));
+  if (admit)
+    return 0;
+
+  if (pthread_mutex_trylock(&last_message_lock) == 0) {
+    cdtime_t now = cdtime();
     if ((now - last_message_time) > TIME_T_TO_CDTIME_T(1)) {
       last_message_time = now;
-      ERROR("plugin_dispatch_values: Low water mark "
-            "reached. Dropping %.0f%% of metrics.",
-            100.0 * p);
+      ERROR("plugin_dispatch_values: %s water mark reached. Dropping "
+            "values of source \"%s\".",
+            (wql < write_limit_high) ? "Low" : "High", name);
     }
     pthread_mutex_unlock(&last_message_lock);
   }
 
-  if (p == 1.0)
-    return 1;
-
-  q = cdrand_d();
-  if (q > p)
-    return 1;
-  else
-    return 0;
+  return 1;
 } /* }}} _Bool check_drop_value */
 
+static pthread_mutex_t statistics_lock = PTHREAD_MUTEX_INITIALIZER;
+
 int plugin_dispatch_values(value_list_t const *vl) {
   int status;
-  static pthread_mutex_t statistics_lock = PTHREAD_MUTEX_INITIALIZER;
 
-  if (check_drop_value()) {
+  if (check_drop_value(vl)) {
     if (record_statistics) {
       pthread_mutex_lock(&statistics_lock);
       stats_values_dropped++;
@@ -2087,6 +6645,53 @@ int plugin_dispatch_values(value_list_t const *vl) {
   return 0;
 }
 
+int plugin_dispatch_values_batch(value_list_t const *vl, /* {{{ */
+                                 size_t vl_num) {
+  write_queue_t *head = NULL;
+  write_queue_t *tail = NULL;
+  long num = 0;
+  derive_t dropped = 0;
+  int status = 0;
+
+  for (size_t i = 0; i < vl_num; i++) {
+    write_queue_t *q;
+
+    if (check_drop_value(vl + i)) {
+      dropped++;
+      continue;
+    }
+
+    q = write_queue_entry_create(vl + i);
+    if (q == NULL) {
+      status = ENOMEM;
+      continue;
+    }
+
+    if (tail == NULL)
+      head = q;
+    else
+      tail->next = q;
+    tail = q;
+    num++;
+  }
+
+  if (num > 0)
+    write_queue_append(head, tail, num);
+
+  if ((dropped > 0) && record_statistics) {
+    pthread_mutex_lock(&statistics_lock);
+    stats_values_dropped += dropped;
+    pthread_mutex_unlock(&statistics_lock);
+  }
+
+  if (status != 0)
+    ERROR("plugin_dispatch_values_batch: Enqueueing %" PRIsz " of %" PRIsz
+          " value lists failed: %s",
+          vl_num - (size_t)num - (size_t)dropped, vl_num, STRERROR(status));
+
+  return status;
+} /* }}} int plugin_dispatch_values_batch */
+
 __attribute__((sentinel)) int
 plugin_dispatch_multivalue(value_list_t const *template, /* {{{ */
                            _Bool store_percentage, int store_type, ...) {
@@ -2162,8 +6767,272 @@ plugin_dispatch_multivalue(value_list_t const *template, /* {{{ */
   return failed;
 } /* }}} int plugin_dispatch_multivalue */
 
+static void notification_shared_release(notification_shared_t *ns) /* {{{ */
+{
+  /* `notif_lock' is held by the caller. */
+  if (--ns->refs > 0)
+    return;
+
+  if (ns->n.meta != NULL)
+    plugin_notification_meta_free(ns->n.meta);
+  sfree(ns);
+} /* }}} void notification_shared_release */
+
+/* Returns the queue of the callback "name", creating it if necessary.
+ * `notif_lock' is held by the caller. */
+static notif_queue_t *notif_queue_get(const char *name, /* {{{ */
+                                      callback_func_t const *cf) {
+  notif_queue_t *q = NULL;
+
+  if (c_avl_get(notif_queues, name, (void *)&q) == 0)
+    return q;
+
+  q = calloc(1, sizeof(*q));
+  if (q == NULL)
+    return NULL;
+  q->name = strdup(name);
+  if ((q->name == NULL) || (c_avl_insert(notif_queues, q->name, q) != 0)) {
+    sfree(q->name);
+    sfree(q);
+    return NULL;
+  }
+  q->limit = (cf->cf_ctx.notification_queue_limit > 0)
+                 ? cf->cf_ctx.notification_queue_limit
+                 : notif_queue_limit;
+
+  return q;
+} /* }}} notif_queue_t *notif_queue_get */
+
+/* Links "q" into the ready list unless it is there already or being served.
+ * `notif_lock' is held by the caller. */
+static void notif_queue_make_ready(notif_queue_t *q) /* {{{ */
+{
+  if (q->busy || q->ready || (q->head == NULL))
+    return;
+
+  q->ready = 1;
+  q->ready_next = NULL;
+  if (notif_ready_tail == NULL)
+    notif_ready_head = q;
+  else
+    notif_ready_tail->ready_next = q;
+  notif_ready_tail = q;
+
+  pthread_cond_signal(&notif_cond);
+} /* }}} void notif_queue_make_ready */
+
+/* Copies "notif" and appends a reference to the queue of every notification
+ * callback. The callbacks' queue limits are applied per callback. */
+static int notification_enqueue(const notification_t *notif) /* {{{ */
+{
+  notification_shared_t *ns = calloc(1, sizeof(*ns));
+  if (ns == NULL)
+    return ENOMEM;
+
+  ns->n = *notif;
+  ns->n.meta = NULL;
+  if (notif->meta != NULL)
+    plugin_notification_meta_copy(&ns->n, notif);
+  ns->refs = 1;
+
+  callback_array_t *array = callback_array_get(&array_notification);
+
+  pthread_mutex_lock(&notif_lock);
+
+  for (size_t i = 0; (array != NULL) && (i < array->num); i++) {
+    notif_queue_t *q =
+        notif_queue_get(array->entries[i].name, array->entries[i].value);
+    notif_entry_t *e;
+
+    if (q == NULL)
+      continue;
+
+    if (q->length >= q->limit) {
+      q->dropped++;
+      continue;
+    }
+
+    e = malloc(sizeof(*e));
+    if (e == NULL) {
+      q->dropped++;
+      continue;
+    }
+    e->ns = ns;
+    e->next = NULL;
+    ns->refs++;
+
+    if (q->tail == NULL)
+      q->head = e;
+    else
+      q->tail->next = e;
+    q->tail = e;
+    q->length++;
+
+    notif_queue_make_ready(q);
+  }
+
+  /* Drop the reference of this function. */
+  notification_shared_release(ns);
+
+  pthread_mutex_unlock(&notif_lock);
+  return 0;
+} /* }}} int notification_enqueue */
+
+static void *plugin_notification_thread(void __attribute__((unused)) * args) {
+  pthread_mutex_lock(&notif_lock);
+
+  while (42) {
+    notif_queue_t *q = notif_ready_head;
+
+    if (q == NULL) {
+      if (!notif_loop)
+        break;
+      pthread_cond_wait(&notif_cond, &notif_lock);
+      continue;
+    }
+
+    notif_ready_head = q->ready_next;
+    if (notif_ready_head == NULL)
+      notif_ready_tail = NULL;
+    q->ready = 0;
+    q->busy = 1;
+
+    notif_entry_t *e = q->head;
+    q->head = e->next;
+    if (q->head == NULL)
+      q->tail = NULL;
+    q->length--;
+
+    pthread_mutex_unlock(&notif_lock);
+
+    /* The callback may have been unregistered in the meantime. */
+    callback_array_t *array = callback_array_get(&array_notification);
+    callback_func_t *cf = NULL;
+    for (size_t i = 0; (array != NULL) && (i < array->num); i++) {
+      if (strcmp(q->name, array->entries[i].name) == 0) {
+        cf = array->entries[i].value;
+        break;
+      }
+    }
+    if ((cf != NULL) && callback_enter(cf)) {
+      plugin_notification_cb callback = cf->cf_callback;
+      plugin_ctx_t old_ctx = plugin_set_ctx(cf->cf_ctx);
+
+      cdtime_t cpu_begin = plugin_cpu_begin();
+      int status = (*callback)(&e->ns->n, &cf->cf_udata);
+      plugin_cpu_end(cf, PLUGIN_CPU_NOTIFICATION, cpu_begin);
+      if (status != 0)
+        WARNING("plugin_dispatch_notification: Notification "
+                "callback %s returned %i.",
+                q->name, status);
+
+      plugin_set_ctx(old_ctx);
+      callback_leave(cf);
+    }
+
+    pthread_mutex_lock(&notif_lock);
+    notification_shared_release(e->ns);
+    sfree(e);
+    q->busy = 0;
+    notif_queue_make_ready(q);
+  }
+
+  pthread_mutex_unlock(&notif_lock);
+  return NULL;
+} /* void *plugin_notification_thread */
+
+static void start_notification_threads(void) /* {{{ */
+{
+  long num = global_option_get_long("NotificationThreads", /* default = */ 0);
+  if (num < 0) {
+    ERROR("NotificationThreads must be positive or zero.");
+    num = 0;
+  }
+  if ((num == 0) || (notif_threads != NULL))
+    return;
+
+  long limit =
+      global_option_get_long("NotificationQueueLimit", /* default = */ 1000);
+  if (limit <= 0) {
+    ERROR("NotificationQueueLimit must be positive.");
+    limit = 1000;
+  }
+  notif_queue_limit = limit;
+
+  notif_queues = c_avl_create((int (*)(const void *, const void *))strcmp);
+  notif_threads = calloc((size_t)num, sizeof(*notif_threads));
+  if ((notif_queues == NULL) || (notif_threads == NULL)) {
+    ERROR("plugin: start_notification_threads: Allocating memory failed.");
+    if (notif_queues != NULL)
+      c_avl_destroy(notif_queues);
+    notif_queues = NULL;
+    sfree(notif_threads);
+    return;
+  }
+
+  notif_loop = 1;
+  for (size_t i = 0; i < (size_t)num; i++) {
+    int status = pthread_create(notif_threads + notif_threads_num,
+                                /* attr = */ NULL, plugin_notification_thread,
+                                /* arg = */ NULL);
+    if (status != 0) {
+      ERROR("plugin: start_notification_threads: pthread_create failed with "
+            "status %i (%s).",
+            status, STRERROR(status));
+      break;
+    }
+
+    char name[THREAD_NAME_MAX];
+    snprintf(name, sizeof(name), "notify#%" PRIsz, notif_threads_num);
+    set_thread_name(notif_threads[notif_threads_num], name);
+
+    notif_threads_num++;
+  }
+} /* }}} void start_notification_threads */
+
+/* Blocks until all queued notifications have been delivered. */
+static void stop_notification_threads(void) /* {{{ */
+{
+  if (notif_threads == NULL)
+    return;
+
+  pthread_mutex_lock(&notif_lock);
+  notif_loop = 0;
+  pthread_cond_broadcast(&notif_cond);
+  pthread_mutex_unlock(&notif_lock);
+
+  for (size_t i = 0; i < notif_threads_num; i++)
+    if (pthread_join(notif_threads[i], NULL) != 0)
+      ERROR("plugin: stop_notification_threads: pthread_join failed.");
+  sfree(notif_threads);
+
+  pthread_mutex_lock(&notif_lock);
+  /* Only left if no thread could be started. */
+  while (notif_ready_head != NULL) {
+    notif_queue_t *q = notif_ready_head;
+    notif_ready_head = q->ready_next;
+    while (q->head != NULL) {
+      notif_entry_t *e = q->head;
+      q->head = e->next;
+      notification_shared_release(e->ns);
+      sfree(e);
+    }
+  }
+  notif_ready_tail = NULL;
+
+  char *key;
+  notif_queue_t *q;
+  while (c_avl_pick(notif_queues, (void *)&key, (void *)&q) == 0) {
+    sfree(q->name);
+    sfree(q);
+  }
+  c_avl_destroy(notif_queues);
+  notif_queues = NULL;
+  notif_threads_num = 0;
+  pthread_mutex_unlock(&notif_lock);
+} /* }}} void stop_notification_threads */
+
 int plugin_dispatch_notification(const notification_t *notif) {
-  llentry_t *le;
   /* Possible TODO: Add flap detection here */
 
   DEBUG("plugin_dispatch_notification: severity = %i; message = %s; "
@@ -2175,8 +7044,12 @@ int plugin_dispatch_notification(const notification_t *notif) {
   if (list_notification == NULL)
     return -1;
 
-  le = llist_head(list_notification);
-  while (le != NULL) {
+  /* notif_threads_num only changes while no other threads run. */
+  if (notif_threads_num > 0)
+    return notification_enqueue(notif);
+
+  callback_array_t *array = callback_array_get(&array_notification);
+  for (size_t i = 0; (array != NULL) && (i < array->num); i++) {
     callback_func_t *cf;
     plugin_notification_cb callback;
     int status;
@@ -2184,25 +7057,139 @@ int plugin_dispatch_notification(const notification_t *notif) {
     /* do not switch plugin context; rather keep the context
      * (interval) information of the calling plugin */
 
-    cf = le->value;
+    cf = array->entries[i].value;
+    if (!callback_enter(cf))
+      continue;
+
     callback = cf->cf_callback;
+    cdtime_t cpu_begin = plugin_cpu_begin();
     status = (*callback)(notif, &cf->cf_udata);
+    plugin_cpu_end(cf, PLUGIN_CPU_NOTIFICATION, cpu_begin);
+    callback_leave(cf);
     if (status != 0) {
       WARNING("plugin_dispatch_notification: Notification "
               "callback %s returned %i.",
-              le->key, status);
+              array->entries[i].name, status);
     }
-
-    le = le->next;
   }
 
   return 0;
 } /* int plugin_dispatch_notification */
 
+static void plugin_log_deliver(int level, const char *msg) /* {{{ */
+{
+  callback_array_t *array = callback_array_get(&array_log);
+
+  for (size_t i = 0; (array != NULL) && (i < array->num); i++) {
+    callback_func_t *cf = array->entries[i].value;
+    plugin_log_cb callback = cf->cf_callback;
+
+    if (!callback_enter(cf))
+      continue;
+
+    /* do not switch plugin context; rather keep the context
+     * (interval) information of the calling plugin */
+
+    (*callback)(level, msg, &cf->cf_udata);
+    callback_leave(cf);
+  }
+} /* }}} void plugin_log_deliver */
+
+static void *plugin_log_thread(void __attribute__((unused)) * arg) /* {{{ */
+{
+  log_record_t rec;
+  cdtime_t last_summary = 0;
+
+  while (42) {
+    while (c_ring_pop(log_ring, &rec) == 0)
+      plugin_log_deliver(rec.level, rec.msg);
+
+    pthread_mutex_lock(&log_lock);
+
+    cdtime_t now = cdtime();
+    if ((log_suppressed > 0) &&
+        (!log_loop || (now - last_summary >= TIME_T_TO_CDTIME_T(1)))) {
+      uint64_t suppressed = log_suppressed;
+      log_suppressed = 0;
+      last_summary = now;
+      pthread_mutex_unlock(&log_lock);
+
+      char msg[LOG_MESSAGE_SIZE];
+      snprintf(msg, sizeof(msg),
+               "plugin_log: The log queue is full, %" PRIu64 " messages "
+               "have been suppressed.",
+               suppressed);
+      plugin_log_deliver(LOG_WARNING, msg);
+      continue;
+    }
+
+    if (!log_loop && c_ring_empty(log_ring)) {
+      pthread_mutex_unlock(&log_lock);
+      break;
+    }
+
+    /* Producers signal without holding the lock, so a wakeup may be missed
+     * occasionally. The timeout bounds the delay in that case. */
+    if (c_ring_empty(log_ring))
+      pthread_cond_timedwait(
+          &log_cond, &log_lock,
+          &CDTIME_T_TO_TIMESPEC(now + MS_TO_CDTIME_T(100)));
+    pthread_mutex_unlock(&log_lock);
+  }
+
+  return NULL;
+} /* }}} void *plugin_log_thread */
+
+static void start_log_thread(void) /* {{{ */
+{
+  long length = global_option_get_long("LogQueueLength", /* default = */ 0);
+  if (length <= 0)
+    return;
+
+  if (log_ring != NULL)
+    return;
+
+  log_ring = c_ring_create((size_t)length, sizeof(log_record_t));
+  if (log_ring == NULL) {
+    ERROR("plugin: start_log_thread: c_ring_create failed.");
+    return;
+  }
+
+  log_loop = 1;
+  int status = pthread_create(&log_thread, /* attr = */ NULL,
+                              plugin_log_thread, /* arg = */ NULL);
+  if (status != 0) {
+    c_ring_t *r = log_ring;
+    log_ring = NULL;
+    c_ring_destroy(r);
+    ERROR("plugin: start_log_thread: pthread_create failed with status %i "
+          "(%s).",
+          status, STRERROR(status));
+    return;
+  }
+  set_thread_name(log_thread, "log");
+} /* }}} void start_log_thread */
+
+static void stop_log_thread(void) /* {{{ */
+{
+  if (log_ring == NULL)
+    return;
+
+  pthread_mutex_lock(&log_lock);
+  log_loop = 0;
+  pthread_cond_broadcast(&log_cond);
+  pthread_mutex_unlock(&log_lock);
+
+  pthread_join(log_thread, NULL);
+
+  c_ring_t *r = log_ring;
+  log_ring = NULL;
+  c_ring_destroy(r);
+} /* }}} void stop_log_thread */
+
 void plugin_log(int level, const char *format, ...) {
-  char msg[1024];
+  log_record_t rec;
   va_list ap;
-  llentry_t *le;
 
 #if !COLLECT_DEBUG
   if (level >= LOG_DEBUG)
@@ -2210,30 +7197,33 @@ void plugin_log(int level, const char *format, ...) {
 #endif
 
   va_start(ap, format);
-  vsnprintf(msg, sizeof(msg), format, ap);
-  msg[sizeof(msg) - 1] = '\0';
+  vsnprintf(rec.msg, sizeof(rec.msg), format, ap);
+  rec.msg[sizeof(rec.msg) - 1] = '\0';
   va_end(ap);
 
   if (list_log == NULL) {
-    fprintf(stderr, "%s\n", msg);
+    fprintf(stderr, "%s\n", rec.msg);
     return;
   }
 
-  le = llist_head(list_log);
-  while (le != NULL) {
-    callback_func_t *cf;
-    plugin_log_cb callback;
-
-    cf = le->value;
-    callback = cf->cf_callback;
-
-    /* do not switch plugin context; rather keep the context
-     * (interval) information of the calling plugin */
-
-    (*callback)(level, msg, &cf->cf_udata);
+  /* Messages of the log thread itself, e.g. of a failing log callback, are
+   * delivered directly. */
+  c_ring_t *r = log_ring;
+  if ((r == NULL) || pthread_equal(pthread_self(), log_thread)) {
+    plugin_log_deliver(level, rec.msg);
+    return;
+  }
 
-    le = le->next;
+  rec.level = level;
+  if (c_ring_push(r, &rec) == 0) {
+    pthread_cond_signal(&log_cond);
+    return;
   }
+
+  pthread_mutex_lock(&log_lock);
+  log_suppressed++;
+  stats_log_dropped++;
+  pthread_mutex_unlock(&log_lock);
 } /* void plugin_log */
 
 int parse_log_severity(const char *severity) {
@@ -2287,6 +7277,29 @@ const data_set_t *plugin_get_ds(const char *name) {
   return ds;
 } /* data_set_t *plugin_get_ds */
 
+data_set_id_t plugin_get_ds_id(const char *name) /* {{{ */
+{
+  data_set_entry_t *e;
+
+  if ((data_sets == NULL) || (name == NULL))
+    return 0;
+
+  if (c_avl_get(data_sets, name, (void *)&e) != 0)
+    return 0;
+
+  return e->id;
+} /* }}} data_set_id_t plugin_get_ds_id */
+
+const data_set_t *plugin_get_ds_by_id(data_set_id_t id) /* {{{ */
+{
+  data_set_entry_t **slot = data_set_slot(id);
+
+  if ((slot == NULL) || (*slot == NULL))
+    return NULL;
+
+  return &(*slot)->ds;
+} /* }}} data_set_t *plugin_get_ds_by_id */
+
 static int plugin_notification_meta_add(notification_t *n, const char *name,
                                         enum notification_meta_type_e type,
                                         const void *value) {
@@ -2511,44 +7524,69 @@ cdtime_t plugin_get_interval(void) {
 
 typedef struct {
   plugin_ctx_t ctx;
+  loaded_plugin_t *plugin;
   void *(*start_routine)(void *);
   void *arg;
 } plugin_thread_t;
 
+static void plugin_thread_exit(void *arg) {
+  loaded_plugin_t *lp = arg;
+
+  if (lp != NULL)
+    plugin_loaded_add(&lp->threads, -1);
+} /* void plugin_thread_exit */
+
 static void *plugin_thread_start(void *arg) {
   plugin_thread_t *plugin_thread = arg;
 
   void *(*start_routine)(void *) = plugin_thread->start_routine;
   void *plugin_arg = plugin_thread->arg;
+  loaded_plugin_t *lp = plugin_thread->plugin;
+  void *ret;
 
   plugin_set_ctx(plugin_thread->ctx);
 
   sfree(plugin_thread);
 
-  return start_routine(plugin_arg);
+  /* Also counts threads which call pthread_exit() as exited. */
+  pthread_cleanup_push(plugin_thread_exit, lp);
+  ret = start_routine(plugin_arg);
+  pthread_cleanup_pop(1);
+
+  return ret;
 } /* void *plugin_thread_start */
 
 int plugin_thread_create(pthread_t *thread, const pthread_attr_t *attr,
                          void *(*start_routine)(void *), void *arg,
                          char const *name) {
   plugin_thread_t *plugin_thread;
+  plugin_ctx_t ctx = plugin_get_ctx();
 
   plugin_thread = malloc(sizeof(*plugin_thread));
   if (plugin_thread == NULL)
     return ENOMEM;
 
-  plugin_thread->ctx = plugin_get_ctx();
+  plugin_thread->ctx = ctx;
+  plugin_thread->plugin = plugin_loaded_get(ctx.name, /* create = */ 0);
   plugin_thread->start_routine = start_routine;
   plugin_thread->arg = arg;
 
+  /* plugin_unload() waits for the plugin's threads to exit. */
+  loaded_plugin_t *lp = plugin_thread->plugin;
+  if (lp != NULL)
+    plugin_loaded_add(&lp->threads, 1);
+
   int ret = pthread_create(thread, attr, plugin_thread_start, plugin_thread);
   if (ret != 0) {
+    plugin_thread_exit(lp);
     sfree(plugin_thread);
     return ret;
   }
 
   if (name != NULL)
     set_thread_name(*thread, name);
+  /* plugin_thread may already have been freed by the new thread. */
+  set_thread_affinity(*thread, ctx.thread_affinity);
 
   return 0;
 } /* int plugin_thread_create */
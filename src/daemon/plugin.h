@@ -99,6 +99,19 @@ union value_u {
 };
 typedef union value_u value_t;
 
+/* The identity of a value list, i.e. its identifier as returned by
+ * FORMAT_VL() and the identifier_hash() of it. It is computed once per value
+ * list by the daemon when dispatching it. */
+struct value_list_identity_s {
+  uint64_t hash;
+  char name[6 * DATA_MAX_NAME_LEN];
+};
+typedef struct value_list_identity_s value_list_identity_t;
+
+/* Stable handle of a registered data set, see plugin_get_ds_id(). Zero is
+ * never a valid handle. */
+typedef size_t data_set_id_t;
+
 struct value_list_s {
   value_t *values;
   size_t values_len;
@@ -110,9 +123,39 @@ struct value_list_s {
   char type[DATA_MAX_NAME_LEN];
   char type_instance[DATA_MAX_NAME_LEN];
   meta_data_t *meta;
+
+  /* Optional: if set, the data set is looked up by this handle instead of by
+   * "type". "type" must then either be empty or match the data set. */
+  data_set_id_t type_id;
+
+  /* Set by the daemon when dispatching: the number of consecutive updates of
+   * the series, up to this one, which did not change its values. */
+  uint64_t unchanged;
+
+  /* Use VALUE_LIST_IDENTITY() to access these. */
+  value_list_identity_t const *identity;
+  struct value_list_s const *identity_owner;
+
+  /* Points to the value list itself if it is an immutable, reference counted
+   * value list owned by the daemon, see plugin_value_list_retain(). */
+  struct value_list_s const *shared_owner;
 };
 typedef struct value_list_s value_list_t;
 
+/* Returns the cached identity of "vl" or NULL if there is none. Copies of a
+ * value list don't inherit the identity, because "identity_owner" then points
+ * to the original. */
+#define VALUE_LIST_IDENTITY(vl)                                                \
+  (((vl)->identity_owner == (vl)) ? (vl)->identity : NULL)
+
+/* Must be used by code which changes the host, plugin, plugin instance, type
+ * or type instance of a value list in place, e.g. targets. */
+#define VALUE_LIST_IDENTITY_INVALIDATE(vl)                                     \
+  do {                                                                         \
+    (vl)->identity = NULL;                                                     \
+    (vl)->identity_owner = NULL;                                               \
+  } while (0)
+
 #define VALUE_LIST_INIT                                                        \
   { .values = NULL, .meta = NULL }
 
@@ -170,10 +213,54 @@ struct user_data_s {
 };
 typedef struct user_data_s user_data_t;
 
+#define WRITE_QUEUE_POLICY_DROP_NEW 0
+#define WRITE_QUEUE_POLICY_DROP_OLD 1
+#define WRITE_QUEUE_POLICY_BLOCK 2
+#define WRITE_QUEUE_POLICY_SPILL 3
+
 struct plugin_ctx_s {
+  /* Name of the plugin the callbacks belong to, set by plugin_load(). NULL
+   * for the daemon's own callbacks. The string is never freed. */
+  char const *name;
   cdtime_t interval;
   cdtime_t flush_interval;
   cdtime_t flush_timeout;
+  /* If non-zero, write callbacks get a dedicated queue served by this many
+   * threads. */
+  size_t write_threads;
+  long write_queue_limit;
+  int write_queue_policy;
+  /* Journal of WRITE_QUEUE_POLICY_SPILL, see utils_spill.h. The directory is
+   * never freed. */
+  char const *write_spill_directory;
+  uint64_t write_spill_limit;
+  long write_spill_rate;
+  /* Overrides the defaults passed to plugin_register_write_batch(). */
+  size_t write_batch_size;
+  cdtime_t write_batch_linger;
+  /* If non-zero, values are consolidated over windows of this length before
+   * being passed to the write callbacks, using one of the DOWNSAMPLE_*
+   * functions from utils_downsample.h. */
+  cdtime_t write_downsample;
+  int write_downsample_function;
+  /* If set, value lists which did not change since the last update are
+   * only passed to the write callbacks every "write_heartbeat" updates, or
+   * not at all if that is zero. */
+  _Bool write_changes_only;
+  unsigned int write_heartbeat;
+  /* Read thread pool of the plugin's read callbacks, see
+   * plugin_register_read_pool(). Zero is the default pool. */
+  size_t read_pool;
+  /* Overrides "NotificationQueueLimit" for the plugin's notification
+   * callbacks if non-zero. */
+  long notification_queue_limit;
+  /* Registers the plugin's init callbacks as with
+   * plugin_register_init_parallel(). */
+  _Bool init_parallel;
+  /* CPUs the threads of the plugin are restricted to, e.g. "0-3,8", or NULL.
+   * Applies to plugin_thread_create() and to the plugin's own write threads.
+   * The string is never freed. */
+  char const *thread_affinity;
 };
 typedef struct plugin_ctx_s plugin_ctx_t;
 
@@ -184,8 +271,70 @@ typedef int (*plugin_init_cb)(void);
 typedef int (*plugin_read_cb)(user_data_t *);
 typedef int (*plugin_write_cb)(const data_set_t *, const value_list_t *,
                                user_data_t *);
+typedef struct write_batch_entry_s {
+  const data_set_t *ds;
+  const value_list_t *vl;
+} write_batch_entry_t;
+typedef int (*plugin_write_batch_cb)(const write_batch_entry_t *entries,
+                                     size_t entries_num, user_data_t *);
 typedef int (*plugin_flush_cb)(cdtime_t timeout, const char *identifier,
                                user_data_t *);
+
+/* Statistics of one read callback, see plugin_get_read_stats(). */
+struct plugin_read_stats_s {
+  char *name;
+  cdtime_t interval;
+  cdtime_t effective_interval;
+  uint64_t reads;
+  uint64_t overruns;
+  uint64_t skipped;
+  /* Durations of the reads since the internal statistics were last
+   * collected. */
+  size_t duration_num;
+  cdtime_t duration_average;
+  cdtime_t duration_max;
+  cdtime_t duration_p99;
+};
+typedef struct plugin_read_stats_s plugin_read_stats_t;
+
+/* CPU time used by the callbacks of one plugin, see plugin_get_cpu_stats().
+ * Plugins are told apart by the part of the callback names before the first
+ * slash, e.g. "write_graphite" for "write_graphite/carbon". */
+struct plugin_cpu_stats_s {
+  char *name;
+  cdtime_t read_time;
+  uint64_t reads;
+  cdtime_t write_time;
+  uint64_t writes;
+  cdtime_t flush_time;
+  uint64_t flushes;
+  cdtime_t notification_time;
+  uint64_t notifications;
+};
+typedef struct plugin_cpu_stats_s plugin_cpu_stats_t;
+
+/* Sampled latency of one stage of dispatching values, or of the calls of one
+ * write callback, see plugin_get_dispatch_stats(). */
+struct plugin_dispatch_stats_s {
+  char *name;
+  /* Samples since the internal statistics were last collected. */
+  size_t num;
+  cdtime_t average;
+  cdtime_t max;
+  cdtime_t p99;
+};
+typedef struct plugin_dispatch_stats_s plugin_dispatch_stats_t;
+
+/* Outcome of one flush callback, see plugin_flush_results(). */
+struct plugin_flush_result_s {
+  char *name;
+  /* Return value of the callback, EBUSY if the callback was still busy with an
+   * earlier flush and ETIMEDOUT if it had not returned by the deadline. */
+  int status;
+  cdtime_t duration;
+};
+typedef struct plugin_flush_result_s plugin_flush_result_t;
+
 /* "missing" callback. Returns less than zero on failure, zero if other
  * callbacks should be called, greater than zero if no more callbacks should be
  * called. */
@@ -233,6 +382,84 @@ void plugin_set_dir(const char *dir);
 int plugin_load(const char *name, _Bool global);
 
 int plugin_init_all(void);
+
+/*
+ * NAME
+ *  plugin_unload
+ *
+ * DESCRIPTION
+ *  Unloads the plugin `name' so that it can be loaded again with a new
+ *  configuration. Its callbacks are no longer called from the moment this
+ *  function is entered. Once the calls in progress have returned, the
+ *  plugin's write queues are drained, its flush and shutdown callbacks are
+ *  called, and its user data, config callbacks and shared object are
+ *  released. Plugins which are loaded afterwards are held back until
+ *  `plugin_init_plugin' has been called for them.
+ *
+ * RETURN VALUE
+ *  Returns zero upon success, ENOENT if the plugin is not loaded, EBUSY if
+ *  it can't be unloaded (see `plugin_mark_permanent') or its threads did not
+ *  exit, and ETIMEDOUT if its callbacks did not return. In the last two
+ *  cases the plugin stays loaded, but its callbacks are not called again.
+ */
+int plugin_unload(char const *name);
+
+/*
+ * NAME
+ *  plugin_init_plugin
+ *
+ * DESCRIPTION
+ *  Calls the init callbacks of the plugin `name', which has been loaded after
+ *  `plugin_init_all', and enables its other callbacks.
+ *
+ * RETURN VALUE
+ *  Returns zero upon success, ENOENT if the plugin is not loaded and -1 if
+ *  an init callback failed.
+ */
+int plugin_init_plugin(char const *name);
+
+/*
+ * NAME
+ *  plugin_mark_permanent
+ *
+ * DESCRIPTION
+ *  Marks the calling plugin as one which can't be unloaded, e.g. because
+ *  other parts of the daemon hold on to its functions or it embeds an
+ *  interpreter which can't be started twice.
+ */
+void plugin_mark_permanent(void);
+
+/*
+ * NAME
+ *  plugin_shared_acquire
+ *
+ * DESCRIPTION
+ *  Returns the object registered as `name', creating it with `create' if
+ *  there is none yet, and takes a reference to it. This lets helpers which
+ *  are compiled into several plugins, such as utils_curl_engine, share a
+ *  single instance per process. `create' is called with a lock held and must
+ *  not call `plugin_shared_acquire' or `plugin_shared_release'.
+ *
+ * RETURN VALUE
+ *  Returns the object, or NULL if `create' failed or memory is exhausted.
+ */
+void *plugin_shared_acquire(char const *name, void *(*create)(void));
+
+/*
+ * NAME
+ *  plugin_shared_release
+ *
+ * DESCRIPTION
+ *  Drops a reference taken with `plugin_shared_acquire'.
+ *
+ * RETURN VALUE
+ *  Returns the object if this was the last reference, in which case it has
+ *  been unregistered and the caller has to free it. Returns NULL otherwise.
+ *  The object is handed back rather than freed by a callback so that the
+ *  plugin which created it may have been unloaded meanwhile.
+ */
+void *plugin_shared_release(char const *name);
+
 void plugin_read_all(void);
 int plugin_read_all_once(void);
 int plugin_shutdown_all(void);
@@ -267,8 +494,105 @@ int plugin_shutdown_all(void);
 int plugin_write(const char *plugin, const data_set_t *ds,
                  const value_list_t *vl);
 
+/*
+ * NAME
+ *  plugin_value_list_retain
+ *
+ * DESCRIPTION
+ *  Returns a reference to `vl' which stays valid after the write callback
+ *  returns, e.g. for processing the value list asynchronously. The daemon
+ *  hands immutable, reference counted value lists to write callbacks
+ *  whenever possible, in which case only the reference count is increased.
+ *  Otherwise, an immutable copy is made.
+ *
+ * RETURN VALUE
+ *  The reference, which must be passed to `plugin_value_list_release' and
+ *  must not be modified, or NULL if copying failed.
+ */
+value_list_t *plugin_value_list_retain(value_list_t const *vl);
+void plugin_value_list_release(value_list_t *vl);
+
 int plugin_flush(const char *plugin, cdtime_t timeout, const char *identifier);
 
+/*
+ * NAME
+ *  plugin_flush_results
+ *
+ * DESCRIPTION
+ *  Calls the flush callback `plugin', or all flush callbacks if `plugin' is
+ *  NULL, and reports the outcome of each. With "FlushThreads" greater than
+ *  zero the callbacks run concurrently and the function returns once all of
+ *  them have returned or `deadline' has passed, whichever comes first. A
+ *  `deadline' of zero uses the "FlushDeadline" option. plugin_flush() only
+ *  reports whether all callbacks succeeded.
+ *  The returned array has to be freed with plugin_flush_results_free().
+ *
+ * RETURN VALUE
+ *  Returns zero upon success, even if some callbacks failed, and non-zero if
+ *  an error occurred.
+ */
+int plugin_flush_results(const char *plugin, cdtime_t timeout,
+                         const char *identifier, cdtime_t deadline,
+                         plugin_flush_result_t **ret_results,
+                         size_t *ret_results_num);
+void plugin_flush_results_free(plugin_flush_result_t *results,
+                               size_t results_num);
+
+/*
+ * NAME
+ *  plugin_get_read_stats
+ *
+ * DESCRIPTION
+ *  Returns an array with the statistics of all registered read callbacks.
+ *  Counters are totals since the callback was registered. The returned array
+ *  has to be freed with plugin_read_stats_free().
+ *
+ * RETURN VALUE
+ *  Returns zero upon success or non-zero if an error occurred.
+ */
+int plugin_get_read_stats(plugin_read_stats_t **ret_stats,
+                          size_t *ret_stats_num);
+void plugin_read_stats_free(plugin_read_stats_t *stats, size_t stats_num);
+
+/*
+ * NAME
+ *  plugin_get_cpu_stats
+ *
+ * DESCRIPTION
+ *  Returns an array with the CPU time used by the read, write, flush and
+ *  notification callbacks of each plugin, and the number of calls. Counters
+ *  are totals since the daemon was started. The returned array has to be
+ *  freed with plugin_cpu_stats_free().
+ *
+ * RETURN VALUE
+ *  Returns zero upon success, ENOTSUP if "PluginCPUAccounting" is disabled
+ *  and another non-zero value if an error occurred.
+ */
+int plugin_get_cpu_stats(plugin_cpu_stats_t **ret_stats,
+                         size_t *ret_stats_num);
+void plugin_cpu_stats_free(plugin_cpu_stats_t *stats, size_t stats_num);
+
+/*
+ * NAME
+ *  plugin_get_dispatch_stats
+ *
+ * DESCRIPTION
+ *  Returns an array with the sampled latency of the stages of dispatching
+ *  values: "queue" (waiting in the write queue), "pre_cache" (the pre-cache
+ *  chain), "cache" (updating the value cache) and "post_cache" (the
+ *  post-cache chain, including write callbacks called directly), followed by
+ *  one entry "write-<name>" per write callback. The returned array has to be
+ *  freed with plugin_dispatch_stats_free().
+ *
+ * RETURN VALUE
+ *  Returns zero upon success, ENOTSUP if "DispatchLatencySampling" is disabled
+ *  and another non-zero value if an error occurred.
+ */
+int plugin_get_dispatch_stats(plugin_dispatch_stats_t **ret_stats,
+                              size_t *ret_stats_num);
+void plugin_dispatch_stats_free(plugin_dispatch_stats_t *stats,
+                                size_t stats_num);
+
 /*
  * The `plugin_register_*' functions are used to make `config', `init',
  * `read', `write' and `shutdown' functions known to the plugin
@@ -280,7 +604,37 @@ int plugin_register_config(const char *name,
 int plugin_register_complex_config(const char *type,
                                    int (*callback)(oconfig_item_t *));
 int plugin_register_init(const char *name, plugin_init_cb callback);
+/* Registers an init callback which does not depend on other plugins being
+ * initialized. Such callbacks run concurrently with each other and with the
+ * other init callbacks, see "InitThreads", and may still be running when the
+ * read threads start. The read callbacks of the plugin are held back until
+ * its init callback has returned; its other callbacks are not, so they must
+ * cope with being called before. */
+int plugin_register_init_parallel(const char *name, plugin_init_cb callback);
 int plugin_register_read(const char *name, int (*callback)(void));
+/*
+ * NAME
+ *  plugin_register_read_pool
+ *
+ * DESCRIPTION
+ *  Creates a pool of `threads_num' read threads which serves the read
+ *  callbacks of the given plugins and groups only, so that slow read callbacks
+ *  can't delay the others. Plugins have to be added before they are loaded,
+ *  groups before their read callbacks are registered.
+ *
+ * ARGUMENTS
+ *  `name'        Name of the pool.
+ *  `threads_num' Number of threads serving the pool.
+ *  `plugins'     Names of the plugins whose read callbacks go to the pool.
+ *  `groups'      Groups (see plugin_register_complex_read()) whose read
+ *                callbacks go to the pool. Takes precedence over `plugins'.
+ *
+ * RETURN VALUE
+ *  Zero upon success, an errno otherwise.
+ */
+int plugin_register_read_pool(const char *name, size_t threads_num,
+                              char const *const *plugins, size_t plugins_num,
+                              char const *const *groups, size_t groups_num);
 /* "user_data" will be freed automatically, unless
  * "plugin_register_complex_read" returns an error (non-zero). */
 int plugin_register_complex_read(const char *group, const char *name,
@@ -288,6 +642,25 @@ int plugin_register_complex_read(const char *group, const char *name,
                                  user_data_t const *user_data);
 int plugin_register_write(const char *name, plugin_write_cb callback,
                           user_data_t const *user_data);
+/*
+ * NAME
+ *  plugin_register_write_batch
+ *
+ * DESCRIPTION
+ *  Registers a write callback that receives value lists in batches. Value
+ *  lists are put into a dedicated queue and handed to the callback once
+ *  `batch_size' value lists have accumulated or `linger' has passed since the
+ *  first value list of the batch became available, whichever happens first.
+ *  The `WriteBatchSize' and `WriteBatchLinger' options of the plugin's
+ *  LoadPlugin block override these defaults.
+ *
+ *  The value lists are only valid during the callback; plugins which need to
+ *  keep them around have to copy them.
+ */
+int plugin_register_write_batch(const char *name,
+                                plugin_write_batch_cb callback,
+                                size_t batch_size, cdtime_t linger,
+                                user_data_t const *user_data);
 int plugin_register_flush(const char *name, plugin_flush_cb callback,
                           user_data_t const *user_data);
 int plugin_register_missing(const char *name, plugin_missing_cb callback,
@@ -341,6 +714,22 @@ void plugin_log_available_writers(void);
  */
 int plugin_dispatch_values(value_list_t const *vl);
 
+/*
+ * NAME
+ *  plugin_dispatch_values_batch
+ *
+ * DESCRIPTION
+ *  Dispatches `vl_num' value lists at once. This is equivalent to calling
+ *  `plugin_dispatch_values' for each of them, but the write queue is locked
+ *  only once. Meant for plugins that dispatch many value lists per read,
+ *  e.g. one per network interface.
+ *
+ * RETURNS
+ *  Zero upon success or an errno value if some value lists could not be
+ *  enqueued. The other value lists are dispatched nonetheless.
+ */
+int plugin_dispatch_values_batch(value_list_t const *vl, size_t vl_num);
+
 /*
  * NAME
  *  plugin_dispatch_multivalue
@@ -400,6 +789,25 @@ int parse_notif_severity(const char *severity);
 
 const data_set_t *plugin_get_ds(const char *name);
 
+/*
+ * NAME
+ *  plugin_get_ds_id
+ *
+ * DESCRIPTION
+ *  Returns the handle of the data set `name', which stays the same while the
+ *  data set is registered, even if it is replaced. Plugins can resolve their
+ *  types once, for example in their init callback, and set
+ *  `value_list_t.type_id' so that dispatching doesn't search the data sets by
+ *  name.
+ *
+ * RETURN VALUE
+ *  The handle or zero if no such data set is registered.
+ */
+data_set_id_t plugin_get_ds_id(const char *name);
+
+/* Returns the data set with the handle `id' or NULL if there is none. */
+const data_set_t *plugin_get_ds_by_id(data_set_id_t id);
+
 int plugin_notification_meta_add_string(notification_t *n, const char *name,
                                         const char *value);
 int plugin_notification_meta_add_signed_int(notification_t *n, const char *name,
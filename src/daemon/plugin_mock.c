@@ -37,6 +37,13 @@ void plugin_set_dir(const char *dir) { /* nop */
 
 int plugin_load(const char *name, _Bool global) { return ENOTSUP; }
 
+int plugin_unload(char const *name) { return ENOTSUP; }
+
+int plugin_init_plugin(char const *name) { return ENOTSUP; }
+
+void plugin_mark_permanent(void) { /* nop */
+}
+
 int plugin_register_config(const char *name,
                            int (*callback)(const char *key, const char *val),
                            const char **keys, int keys_num) {
@@ -52,6 +59,10 @@ int plugin_register_init(const char *name, plugin_init_cb callback) {
   return ENOTSUP;
 }
 
+int plugin_register_init_parallel(const char *name, plugin_init_cb callback) {
+  return ENOTSUP;
+}
+
 int plugin_register_read(const char *name, int (*callback)(void)) {
   return ENOTSUP;
 }
@@ -71,10 +82,24 @@ int plugin_register_data_set(const data_set_t *ds) { return ENOTSUP; }
 
 int plugin_dispatch_values(value_list_t const *vl) { return ENOTSUP; }
 
+int plugin_dispatch_values_batch(value_list_t const *vl, size_t vl_num) {
+  return ENOTSUP;
+}
+
 int plugin_flush(const char *plugin, cdtime_t timeout, const char *identifier) {
   return ENOTSUP;
 }
 
+int plugin_flush_results(const char *plugin, cdtime_t timeout,
+                         const char *identifier, cdtime_t deadline,
+                         plugin_flush_result_t **ret_results,
+                         size_t *ret_results_num) {
+  return ENOTSUP;
+}
+
+void plugin_flush_results_free(plugin_flush_result_t *results,
+                               size_t results_num) {}
+
 static data_source_t magic_ds[] = {{"value", DS_TYPE_DERIVE, 0.0, NAN}};
 static data_set_t magic = {"MAGIC", 1, magic_ds};
 const data_set_t *plugin_get_ds(const char *name) {
@@ -84,6 +109,10 @@ const data_set_t *plugin_get_ds(const char *name) {
   return &magic;
 }
 
+data_set_id_t plugin_get_ds_id(const char *name) {
+  return (strcmp(name, "MAGIC") == 0) ? 1 : 0;
+}
+
 void plugin_log(int level, char const *format, ...) {
   char buffer[1024];
   va_list ap;
@@ -112,6 +141,33 @@ plugin_ctx_t plugin_set_ctx(plugin_ctx_t ctx) {
 
 cdtime_t plugin_get_interval(void) { return mock_context.interval; }
 
+int plugin_thread_create(pthread_t *thread, const pthread_attr_t *attr,
+                         void *(*start_routine)(void *), void *arg,
+                         char const *name) {
+  return pthread_create(thread, attr, start_routine, arg);
+}
+
+/* The tests use at most one shared object. */
+static void *mock_shared = NULL;
+static size_t mock_shared_refs = 0;
+
+void *plugin_shared_acquire(char const *name, void *(*create)(void)) {
+  if (mock_shared == NULL)
+    mock_shared = create();
+  if (mock_shared != NULL)
+    mock_shared_refs++;
+  return mock_shared;
+}
+
+void *plugin_shared_release(char const *name) {
+  if ((mock_shared_refs == 0) || (--mock_shared_refs > 0))
+    return NULL;
+
+  void *object = mock_shared;
+  mock_shared = NULL;
+  return object;
+}
+
 /* TODO(octo): this function is actually from filter_chain.h, but in order not
  * to tumble down that rabbit hole, we're declaring it here. A better solution
  * would be to hard-code the top-level config keys in daemon/collectd.c to avoid
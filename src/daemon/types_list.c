@@ -32,6 +32,45 @@
 #include "plugin.h"
 #include "types_list.h"
 
+#include <sys/mman.h>
+
+/* Compiled types databases, see "TypesDBCache". The file starts with a
+ * types_cache_header_t, followed by one types_cache_set_t per data set and
+ * then by the data sources of all sets, stored as data_source_t so they can
+ * be used right from the mapping. The header identifies the source file by
+ * its modification time, size and inode number. Everything is stored in host
+ * byte order; files written by a different architecture or version, or
+ * whose checksum does not match, are ignored and rewritten. */
+#define TYPES_CACHE_MAGIC "collectd types\n"
+#define TYPES_CACHE_VERSION 1
+#define TYPES_CACHE_BYTE_ORDER 0x01020304
+
+typedef struct {
+  char magic[16];
+  uint32_t version;
+  uint32_t byte_order;
+  uint32_t name_len;    /* DATA_MAX_NAME_LEN */
+  uint32_t source_size; /* sizeof(data_source_t) */
+  int64_t source_mtime;
+  uint64_t source_file_size;
+  uint64_t source_inode;
+  uint64_t sets_num;
+  uint64_t sources_num;
+  uint64_t checksum; /* FNV-1a of everything after the header */
+} types_cache_header_t;
+
+typedef struct {
+  char type[DATA_MAX_NAME_LEN];
+  uint64_t ds_num;
+} types_cache_set_t;
+
+/* Data sets read from one file, in the order of the file. */
+typedef struct {
+  data_set_t *sets;
+  size_t sets_num;
+  size_t sources_num;
+} types_list_t;
+
 static int parse_ds(data_source_t *dsrc, char *buf, size_t buf_len) {
   char *dummy;
   char *saveptr;
@@ -93,7 +132,7 @@ static int parse_ds(data_source_t *dsrc, char *buf, size_t buf_len) {
   return 0;
 } /* int parse_ds */
 
-static void parse_line(char *buf) {
+static void parse_line(types_list_t *tl, char *buf) {
   char *fields[64];
   size_t fields_num;
   data_set_t *ds;
@@ -131,11 +170,23 @@ static void parse_line(char *buf) {
 
   plugin_register_data_set(ds);
 
-  sfree(ds->ds);
+  /* Keep the data set for the cache, if any. */
+  data_set_t *tmp = NULL;
+  if (tl != NULL)
+    tmp = realloc(tl->sets, (tl->sets_num + 1) * sizeof(*tl->sets));
+  if (tmp == NULL) {
+    sfree(ds->ds);
+    sfree(ds);
+    return;
+  }
+  tl->sets = tmp;
+  tl->sets[tl->sets_num] = *ds;
+  tl->sets_num++;
+  tl->sources_num += ds->ds_num;
   sfree(ds);
 } /* void parse_line */
 
-static void parse_file(FILE *fh) {
+static void parse_file(types_list_t *tl, FILE *fh) {
   char buf[4096];
   size_t buf_len;
 
@@ -162,11 +213,222 @@ static void parse_file(FILE *fh) {
     if (buf_len == 0)
       continue;
 
-    parse_line(buf);
+    parse_line(tl, buf);
   } /* while (fgets) */
 } /* void parse_file */
 
+static void types_list_free(types_list_t *tl) /* {{{ */
+{
+  for (size_t i = 0; i < tl->sets_num; i++)
+    sfree(tl->sets[i].ds);
+  sfree(tl->sets);
+  tl->sets_num = 0;
+  tl->sources_num = 0;
+} /* }}} void types_list_free */
+
+static uint64_t types_cache_checksum(uint64_t hash, void const *buf,
+                                     size_t size) /* {{{ */
+{
+  for (unsigned char const *c = buf; size > 0; c++, size--) {
+    hash ^= (uint64_t)*c;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+} /* }}} uint64_t types_cache_checksum */
+
+/* Returns the name of the cache of "file" in "ret_path" or an error if no
+ * cache is configured. */
+static int types_cache_path(char *ret_path, size_t ret_path_size,
+                            char const *file) /* {{{ */
+{
+  char const *dir = global_option_get("TypesDBCache");
+  if ((dir == NULL) || (dir[0] == 0))
+    return ENOENT;
+
+  char const *base = strrchr(file, '/');
+  base = (base != NULL) ? base + 1 : file;
+
+  int status =
+      snprintf(ret_path, ret_path_size, "%s/%s-%016" PRIx64 ".cache", dir,
+               base, identifier_hash(file));
+  if ((status < 0) || ((size_t)status >= ret_path_size))
+    return ENAMETOOLONG;
+  return 0;
+} /* }}} int types_cache_path */
+
+static void types_cache_header_init(types_cache_header_t *h,
+                                    struct stat const *source) /* {{{ */
+{
+  memset(h, 0, sizeof(*h));
+  memcpy(h->magic, TYPES_CACHE_MAGIC, sizeof(TYPES_CACHE_MAGIC));
+  h->version = TYPES_CACHE_VERSION;
+  h->byte_order = TYPES_CACHE_BYTE_ORDER;
+  h->name_len = DATA_MAX_NAME_LEN;
+  h->source_size = (uint32_t)sizeof(data_source_t);
+  h->source_mtime = (int64_t)source->st_mtime;
+  h->source_file_size = (uint64_t)source->st_size;
+  h->source_inode = (uint64_t)source->st_ino;
+} /* }}} void types_cache_header_init */
+
+/* Registers the data sets from the cache "path", if it is valid for the
+ * source file described by "source". The data sets are registered in the
+ * order of the source file, so they get the same IDs as when parsing it. */
+static int types_cache_load(char const *path,
+                            struct stat const *source) /* {{{ */
+{
+  struct stat statbuf;
+  types_cache_header_t expected;
+  types_cache_header_t header;
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return errno;
+
+  if ((fstat(fd, &statbuf) != 0) ||
+      ((size_t)statbuf.st_size < sizeof(header))) {
+    close(fd);
+    return EINVAL;
+  }
+
+  size_t size = (size_t)statbuf.st_size;
+  char *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    int status = errno;
+    WARNING("types_list: mmap (\"%s\") failed: %s", path, STRERRNO);
+    return status;
+  }
+
+  memcpy(&header, data, sizeof(header));
+  types_cache_header_init(&expected, source);
+  expected.sets_num = header.sets_num;
+  expected.sources_num = header.sources_num;
+  expected.checksum = header.checksum;
+
+  size_t sets_size = (size_t)header.sets_num * sizeof(types_cache_set_t);
+  size_t sources_size = (size_t)header.sources_num * sizeof(data_source_t);
+  if ((memcmp(&header, &expected, sizeof(header)) != 0) ||
+      (header.sets_num > size / sizeof(types_cache_set_t)) ||
+      (header.sources_num > size / sizeof(data_source_t)) ||
+      (sizeof(header) + sets_size + sources_size != size) ||
+      (types_cache_checksum(14695981039346656037ULL, data + sizeof(header),
+                            size - sizeof(header)) != header.checksum)) {
+    DEBUG("types_list: \"%s\" is outdated or invalid.", path);
+    munmap(data, size);
+    return EINVAL;
+  }
+
+  types_cache_set_t const *sets =
+      (types_cache_set_t const *)(data + sizeof(header));
+  data_source_t *sources = (data_source_t *)(data + sizeof(header) + sets_size);
+
+  /* Check everything before registering anything. */
+  uint64_t sources_num = 0;
+  for (uint64_t i = 0; i < header.sets_num; i++) {
+    if ((memchr(sets[i].type, 0, sizeof(sets[i].type)) == NULL) ||
+        (sets[i].ds_num == 0) ||
+        (sets[i].ds_num > header.sources_num - sources_num)) {
+      munmap(data, size);
+      return EINVAL;
+    }
+    sources_num += sets[i].ds_num;
+  }
+
+  sources_num = 0;
+  for (uint64_t i = 0; i < header.sets_num; i++) {
+    data_set_t ds = {
+        .ds_num = (size_t)sets[i].ds_num, .ds = sources + sources_num,
+    };
+    sstrncpy(ds.type, sets[i].type, sizeof(ds.type));
+    plugin_register_data_set(&ds);
+    sources_num += sets[i].ds_num;
+  }
+
+  munmap(data, size);
+
+  DEBUG("types_list: Loaded %" PRIu64 " data sets from \"%s\".",
+        header.sets_num, path);
+  return 0;
+} /* }}} int types_cache_load */
+
+static int types_cache_save(char const *path, struct stat const *source,
+                            types_list_t const *tl) /* {{{ */
+{
+  char tmp_path[PATH_MAX];
+  types_cache_header_t header;
+  uint64_t checksum = 14695981039346656037ULL;
+  int status = 0;
+
+  types_cache_header_init(&header, source);
+  header.sets_num = (uint64_t)tl->sets_num;
+  header.sources_num = (uint64_t)tl->sources_num;
+
+  status = snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+  if ((status < 0) || ((size_t)status >= sizeof(tmp_path))) {
+    WARNING("types_list: Cache file name \"%s.tmp\" is too long.", path);
+    return ENAMETOOLONG;
+  }
+  status = 0;
+
+  FILE *fh = fopen(tmp_path, "w");
+  if (fh == NULL) {
+    WARNING("types_list: fopen (\"%s\") failed: %s", tmp_path, STRERRNO);
+    return errno;
+  }
+
+  if (fwrite(&header, sizeof(header), 1, fh) != 1)
+    status = errno;
+
+  for (size_t i = 0; (i < tl->sets_num) && (status == 0); i++) {
+    types_cache_set_t set = {.ds_num = (uint64_t)tl->sets[i].ds_num};
+    sstrncpy(set.type, tl->sets[i].type, sizeof(set.type));
+    checksum = types_cache_checksum(checksum, &set, sizeof(set));
+    if (fwrite(&set, sizeof(set), 1, fh) != 1)
+      status = errno;
+  }
+
+  for (size_t i = 0; (i < tl->sets_num) && (status == 0); i++) {
+    /* Zero the padding, so the checksum is reproducible. */
+    for (size_t j = 0; (j < tl->sets[i].ds_num) && (status == 0); j++) {
+      data_source_t dsrc;
+      memset(&dsrc, 0, sizeof(dsrc));
+      sstrncpy(dsrc.name, tl->sets[i].ds[j].name, sizeof(dsrc.name));
+      dsrc.type = tl->sets[i].ds[j].type;
+      dsrc.min = tl->sets[i].ds[j].min;
+      dsrc.max = tl->sets[i].ds[j].max;
+      checksum = types_cache_checksum(checksum, &dsrc, sizeof(dsrc));
+      if (fwrite(&dsrc, sizeof(dsrc), 1, fh) != 1)
+        status = errno;
+    }
+  }
+
+  header.checksum = checksum;
+  if ((status == 0) && ((fseek(fh, 0, SEEK_SET) != 0) ||
+                        (fwrite(&header, sizeof(header), 1, fh) != 1)))
+    status = errno;
+  if ((fclose(fh) != 0) && (status == 0))
+    status = errno;
+
+  if ((status == 0) && (rename(tmp_path, path) != 0))
+    status = errno;
+
+  if (status != 0) {
+    WARNING("types_list: Writing \"%s\" failed: %s", path,
+            STRERROR(status));
+    unlink(tmp_path);
+    return status;
+  }
+
+  DEBUG("types_list: Saved %" PRIsz " data sets to \"%s\".", tl->sets_num,
+        path);
+  return 0;
+} /* }}} int types_cache_save */
+
 int read_types_list(const char *file) {
+  types_list_t tl = {0};
+  struct stat statbuf;
+  char cache_path[PATH_MAX];
+  _Bool use_cache;
   FILE *fh;
 
   if (file == NULL)
@@ -180,12 +442,23 @@ int read_types_list(const char *file) {
     return -1;
   }
 
-  parse_file(fh);
+  use_cache = (fstat(fileno(fh), &statbuf) == 0) &&
+              (types_cache_path(cache_path, sizeof(cache_path), file) == 0);
+  if (use_cache && (types_cache_load(cache_path, &statbuf) == 0)) {
+    fclose(fh);
+    return 0;
+  }
+
+  parse_file(use_cache ? &tl : NULL, fh);
 
   fclose(fh);
   fh = NULL;
 
   DEBUG("Done parsing `%s'", file);
 
+  if (use_cache)
+    types_cache_save(cache_path, &statbuf, &tl);
+  types_list_free(&tl);
+
   return 0;
 } /* int read_types_list */
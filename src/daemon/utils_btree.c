@@ -0,0 +1,593 @@
+/**
+ * collectd - src/daemon/utils_btree.c
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils_btree.h"
+
+/* Minimum degree of the tree: nodes other than the root hold between
+ * BTREE_T - 1 and BTREE_MAX entries, inner nodes one child more. */
+#define BTREE_T 16
+#define BTREE_MAX (2 * BTREE_T - 1)
+
+/* With at least BTREE_T children per inner node, INT_MAX entries fit into a
+ * tree of height eight. */
+#define BTREE_MAX_DEPTH 16
+
+/* Number of nodes allocated at once. */
+#define BTREE_SLAB_NODES 64
+
+/*
+ * private data types
+ */
+struct c_btree_node_s {
+  int num;
+  _Bool leaf;
+  void *key[BTREE_MAX];
+  void *value[BTREE_MAX];
+  /* Only allocated for inner nodes. */
+  struct c_btree_node_s *child[];
+};
+typedef struct c_btree_node_s c_btree_node_t;
+
+/* Leaves and inner nodes are allocated from separate slabs, because they
+ * differ in size. Freed nodes are kept on a free list and the memory is only
+ * returned when the tree is destroyed. */
+typedef struct {
+  size_t node_size;
+  void *free;
+  void *chunks;
+} c_btree_slab_t;
+
+struct c_btree_s {
+  c_btree_node_t *root;
+  int (*compare)(const void *, const void *);
+  int size;
+
+  c_btree_slab_t leaves;
+  c_btree_slab_t inner;
+};
+
+/* `path' holds the nodes from the root down to the node of the current
+ * entry. For the last node `index' is the position of the current entry, for
+ * all others it is the position of the child the path continues with. */
+struct c_btree_iterator_s {
+  c_btree_t *tree;
+  int depth;
+  struct {
+    c_btree_node_t *node;
+    int index;
+  } path[BTREE_MAX_DEPTH];
+};
+
+/*
+ * private functions
+ */
+static void *slab_alloc(c_btree_slab_t *s) /* {{{ */
+{
+  if (s->free == NULL) {
+    /* The first slot of each chunk links the chunks of the slab. */
+    char *chunk = malloc(s->node_size * (BTREE_SLAB_NODES + 1));
+    if (chunk == NULL)
+      return NULL;
+
+    *(void **)chunk = s->chunks;
+    s->chunks = chunk;
+
+    for (size_t i = BTREE_SLAB_NODES; i > 0; i--) {
+      void *n = chunk + i * s->node_size;
+      *(void **)n = s->free;
+      s->free = n;
+    }
+  }
+
+  void *n = s->free;
+  s->free = *(void **)n;
+  return n;
+} /* }}} void *slab_alloc */
+
+static void slab_free(c_btree_slab_t *s, void *n) /* {{{ */
+{
+  *(void **)n = s->free;
+  s->free = n;
+} /* }}} void slab_free */
+
+static void slab_destroy(c_btree_slab_t *s) /* {{{ */
+{
+  while (s->chunks != NULL) {
+    void *next = *(void **)s->chunks;
+    free(s->chunks);
+    s->chunks = next;
+  }
+  s->free = NULL;
+} /* }}} void slab_destroy */
+
+static c_btree_node_t *node_alloc(c_btree_t *t, _Bool leaf) /* {{{ */
+{
+  c_btree_node_t *n = slab_alloc(leaf ? &t->leaves : &t->inner);
+  if (n == NULL)
+    return NULL;
+
+  n->num = 0;
+  n->leaf = leaf;
+  return n;
+} /* }}} c_btree_node_t *node_alloc */
+
+static void node_free(c_btree_t *t, c_btree_node_t *n) /* {{{ */
+{
+  slab_free(n->leaf ? &t->leaves : &t->inner, n);
+} /* }}} void node_free */
+
+/* Moves `num' entries of `src', starting at `src_pos', to `dst_pos' of
+ * `dst'. The ranges may overlap. */
+static void entries_move(c_btree_node_t *dst, int dst_pos, /* {{{ */
+                         c_btree_node_t *src, int src_pos, int num) {
+  if (num <= 0)
+    return;
+  memmove(dst->key + dst_pos, src->key + src_pos, num * sizeof(void *));
+  memmove(dst->value + dst_pos, src->value + src_pos, num * sizeof(void *));
+} /* }}} void entries_move */
+
+static void children_move(c_btree_node_t *dst, int dst_pos, /* {{{ */
+                          c_btree_node_t *src, int src_pos, int num) {
+  if (num <= 0)
+    return;
+  memmove(dst->child + dst_pos, src->child + src_pos,
+          num * sizeof(c_btree_node_t *));
+} /* }}} void children_move */
+
+/* Returns the position of the first key in `n' which is not less than `key'
+ * and sets `found' if that key is equal to `key'. */
+static int node_find(c_btree_t *t, c_btree_node_t *n, /* {{{ */
+                     const void *key, _Bool *found) {
+  int lo = 0;
+  int hi = n->num;
+
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    int cmp = t->compare(key, n->key[mid]);
+
+    if (cmp == 0) {
+      *found = 1;
+      return mid;
+    } else if (cmp < 0) {
+      hi = mid;
+    } else {
+      lo = mid + 1;
+    }
+  }
+
+  *found = 0;
+  return lo;
+} /* }}} int node_find */
+
+/* Splits the full child `i' of `p' in two, moving its median entry to `p'. */
+static int split_child(c_btree_t *t, c_btree_node_t *p, int i) /* {{{ */
+{
+  c_btree_node_t *y = p->child[i];
+  c_btree_node_t *z = node_alloc(t, y->leaf);
+  if (z == NULL)
+    return -1;
+
+  entries_move(z, 0, y, BTREE_T, BTREE_T - 1);
+  if (!y->leaf)
+    children_move(z, 0, y, BTREE_T, BTREE_T);
+  z->num = BTREE_T - 1;
+  y->num = BTREE_T - 1;
+
+  entries_move(p, i + 1, p, i, p->num - i);
+  children_move(p, i + 2, p, i + 1, p->num - i);
+  p->key[i] = y->key[BTREE_T - 1];
+  p->value[i] = y->value[BTREE_T - 1];
+  p->child[i + 1] = z;
+  p->num++;
+
+  return 0;
+} /* }}} int split_child */
+
+/* Merges child `i + 1' of `p' and the entry separating it from child `i' into
+ * child `i'. Both children must hold BTREE_T - 1 entries. */
+static void merge_children(c_btree_t *t, c_btree_node_t *p, int i) /* {{{ */
+{
+  c_btree_node_t *y = p->child[i];
+  c_btree_node_t *z = p->child[i + 1];
+
+  y->key[y->num] = p->key[i];
+  y->value[y->num] = p->value[i];
+  entries_move(y, y->num + 1, z, 0, z->num);
+  if (!y->leaf)
+    children_move(y, y->num + 1, z, 0, z->num + 1);
+  y->num += z->num + 1;
+
+  entries_move(p, i, p, i + 1, p->num - i - 1);
+  children_move(p, i + 1, p, i + 2, p->num - i - 1);
+  p->num--;
+
+  node_free(t, z);
+} /* }}} void merge_children */
+
+/* Makes sure child `i' of `p' holds at least BTREE_T entries before descending
+ * into it, by moving an entry over from a sibling or merging it with one.
+ * Returns the position of the child which now holds the range of child `i'. */
+static int fill_child(c_btree_t *t, c_btree_node_t *p, int i) /* {{{ */
+{
+  c_btree_node_t *c = p->child[i];
+
+  if ((i > 0) && (p->child[i - 1]->num >= BTREE_T)) {
+    c_btree_node_t *l = p->child[i - 1];
+
+    entries_move(c, 1, c, 0, c->num);
+    if (!c->leaf)
+      children_move(c, 1, c, 0, c->num + 1);
+    c->key[0] = p->key[i - 1];
+    c->value[0] = p->value[i - 1];
+    if (!c->leaf)
+      c->child[0] = l->child[l->num];
+    c->num++;
+
+    p->key[i - 1] = l->key[l->num - 1];
+    p->value[i - 1] = l->value[l->num - 1];
+    l->num--;
+    return i;
+  }
+
+  if ((i < p->num) && (p->child[i + 1]->num >= BTREE_T)) {
+    c_btree_node_t *r = p->child[i + 1];
+
+    c->key[c->num] = p->key[i];
+    c->value[c->num] = p->value[i];
+    if (!c->leaf)
+      c->child[c->num + 1] = r->child[0];
+    c->num++;
+
+    p->key[i] = r->key[0];
+    p->value[i] = r->value[0];
+    entries_move(r, 0, r, 1, r->num - 1);
+    if (!r->leaf)
+      children_move(r, 0, r, 1, r->num);
+    r->num--;
+    return i;
+  }
+
+  if (i < p->num) {
+    merge_children(t, p, i);
+    return i;
+  }
+
+  merge_children(t, p, i - 1);
+  return i - 1;
+} /* }}} int fill_child */
+
+static void iter_descend(c_btree_iterator_t *iter, /* {{{ */
+                         c_btree_node_t *n, _Bool last) {
+  while (42) {
+    iter->depth++;
+    assert(iter->depth < BTREE_MAX_DEPTH);
+    iter->path[iter->depth].node = n;
+
+    if (n->leaf) {
+      iter->path[iter->depth].index = last ? n->num - 1 : 0;
+      return;
+    }
+
+    iter->path[iter->depth].index = last ? n->num : 0;
+    n = n->child[last ? n->num : 0];
+  }
+} /* }}} void iter_descend */
+
+/*
+ * public functions
+ */
+c_btree_t *c_btree_create(int (*compare)(const void *, const void *)) /* {{{ */
+{
+  c_btree_t *t;
+
+  if (compare == NULL)
+    return NULL;
+
+  if ((t = calloc(1, sizeof(*t))) == NULL)
+    return NULL;
+
+  t->compare = compare;
+  t->leaves.node_size = sizeof(c_btree_node_t);
+  t->inner.node_size =
+      sizeof(c_btree_node_t) + (BTREE_MAX + 1) * sizeof(c_btree_node_t *);
+
+  return t;
+} /* }}} c_btree_t *c_btree_create */
+
+void c_btree_destroy(c_btree_t *t) /* {{{ */
+{
+  if (t == NULL)
+    return;
+
+  slab_destroy(&t->leaves);
+  slab_destroy(&t->inner);
+  free(t);
+} /* }}} void c_btree_destroy */
+
+int c_btree_insert(c_btree_t *t, void *key, void *value) /* {{{ */
+{
+  c_btree_node_t *n;
+
+  /* Full nodes are split on the way down, so that there is always room for
+   * the entry moved up by a split. */
+  if (t->root == NULL) {
+    if ((t->root = node_alloc(t, /* leaf = */ 1)) == NULL)
+      return -1;
+  } else if (t->root->num == BTREE_MAX) {
+    if ((n = node_alloc(t, /* leaf = */ 0)) == NULL)
+      return -1;
+    n->child[0] = t->root;
+    if (split_child(t, n, 0) != 0) {
+      node_free(t, n);
+      return -1;
+    }
+    t->root = n;
+  }
+
+  n = t->root;
+  while (42) {
+    _Bool found;
+    int i = node_find(t, n, key, &found);
+
+    if (found)
+      return 1;
+
+    if (n->leaf) {
+      entries_move(n, i + 1, n, i, n->num - i);
+      n->key[i] = key;
+      n->value[i] = value;
+      n->num++;
+      break;
+    }
+
+    if (n->child[i]->num == BTREE_MAX) {
+      if (split_child(t, n, i) != 0)
+        return -1;
+
+      int cmp = t->compare(key, n->key[i]);
+      if (cmp == 0)
+        return 1;
+      else if (cmp > 0)
+        i++;
+    }
+    n = n->child[i];
+  } /* while (42) */
+
+  ++t->size;
+  return 0;
+} /* }}} int c_btree_insert */
+
+int c_btree_remove(c_btree_t *t, const void *key, void **rkey, /* {{{ */
+                   void **rvalue) {
+  c_btree_node_t *n;
+  int status = -1;
+
+  assert(t != NULL);
+
+  /* Every node descended into holds at least BTREE_T entries, so that the
+   * entry can be removed from the leaf without walking back up. */
+  n = t->root;
+  while (n != NULL) {
+    _Bool found;
+    int i = node_find(t, n, key, &found);
+
+    if (found && (status != 0)) {
+      if (rkey != NULL)
+        *rkey = n->key[i];
+      if (rvalue != NULL)
+        *rvalue = n->value[i];
+      status = 0;
+    }
+
+    if (found && n->leaf) {
+      entries_move(n, i, n, i + 1, n->num - i - 1);
+      n->num--;
+      break;
+    } else if (found) {
+      /* Replace the entry with its predecessor or successor and remove that
+       * one from the leaf instead. */
+      c_btree_node_t *y = n->child[i];
+      c_btree_node_t *z = n->child[i + 1];
+      c_btree_node_t *m;
+
+      if (y->num >= BTREE_T) {
+        for (m = y; !m->leaf; m = m->child[m->num])
+          /* nop */;
+        n->key[i] = m->key[m->num - 1];
+        n->value[i] = m->value[m->num - 1];
+        key = n->key[i];
+        n = y;
+      } else if (z->num >= BTREE_T) {
+        for (m = z; !m->leaf; m = m->child[0])
+          /* nop */;
+        n->key[i] = m->key[0];
+        n->value[i] = m->value[0];
+        key = n->key[i];
+        n = z;
+      } else {
+        merge_children(t, n, i);
+        n = y;
+      }
+      continue;
+    }
+
+    if (n->leaf)
+      break;
+
+    if (n->child[i]->num < BTREE_T)
+      i = fill_child(t, n, i);
+    n = n->child[i];
+  } /* while (n != NULL) */
+
+  /* Merging the last two children of the root leaves it empty. */
+  if ((t->root != NULL) && (t->root->num == 0)) {
+    n = t->root;
+    t->root = n->leaf ? NULL : n->child[0];
+    node_free(t, n);
+  }
+
+  if (status == 0)
+    --t->size;
+  return status;
+} /* }}} int c_btree_remove */
+
+int c_btree_get(c_btree_t *t, const void *key, void **value) /* {{{ */
+{
+  c_btree_node_t *n;
+
+  assert(t != NULL);
+
+  n = t->root;
+  while (n != NULL) {
+    _Bool found;
+    int i = node_find(t, n, key, &found);
+
+    if (found) {
+      if (value != NULL)
+        *value = n->value[i];
+      return 0;
+    }
+
+    n = n->leaf ? NULL : n->child[i];
+  }
+
+  return -1;
+} /* }}} int c_btree_get */
+
+int c_btree_pick(c_btree_t *t, void **key, void **value) /* {{{ */
+{
+  c_btree_node_t *n;
+
+  assert(t != NULL);
+
+  if ((key == NULL) || (value == NULL))
+    return -1;
+  if (t->root == NULL)
+    return -1;
+
+  for (n = t->root; !n->leaf; n = n->child[n->num])
+    /* nop */;
+
+  return c_btree_remove(t, n->key[n->num - 1], key, value);
+} /* }}} int c_btree_pick */
+
+c_btree_iterator_t *c_btree_get_iterator(c_btree_t *t) /* {{{ */
+{
+  c_btree_iterator_t *iter;
+
+  if (t == NULL)
+    return NULL;
+
+  iter = calloc(1, sizeof(*iter));
+  if (iter == NULL)
+    return NULL;
+  iter->tree = t;
+  iter->depth = -1;
+
+  return iter;
+} /* }}} c_btree_iterator_t *c_btree_get_iterator */
+
+int c_btree_iterator_next(c_btree_iterator_t *iter, void **key, /* {{{ */
+                          void **value) {
+  if ((iter == NULL) || (key == NULL) || (value == NULL))
+    return -1;
+
+  if (iter->depth < 0) {
+    if (iter->tree->root == NULL)
+      return -1;
+    iter_descend(iter, iter->tree->root, /* last = */ 0);
+  } else {
+    c_btree_node_t *n = iter->path[iter->depth].node;
+    int i = iter->path[iter->depth].index;
+
+    if (!n->leaf) {
+      iter->path[iter->depth].index = i + 1;
+      iter_descend(iter, n->child[i + 1], /* last = */ 0);
+    } else if (i + 1 < n->num) {
+      iter->path[iter->depth].index = i + 1;
+    } else {
+      /* Go up to the first node that has entries right of the path. */
+      int depth = iter->depth - 1;
+      while ((depth >= 0) &&
+             (iter->path[depth].index >= iter->path[depth].node->num))
+        depth--;
+      if (depth < 0)
+        return -1;
+      iter->depth = depth;
+    }
+  }
+
+  *key = iter->path[iter->depth].node->key[iter->path[iter->depth].index];
+  *value = iter->path[iter->depth].node->value[iter->path[iter->depth].index];
+  return 0;
+} /* }}} int c_btree_iterator_next */
+
+int c_btree_iterator_prev(c_btree_iterator_t *iter, void **key, /* {{{ */
+                          void **value) {
+  if ((iter == NULL) || (key == NULL) || (value == NULL))
+    return -1;
+
+  if (iter->depth < 0) {
+    if (iter->tree->root == NULL)
+      return -1;
+    iter_descend(iter, iter->tree->root, /* last = */ 1);
+  } else {
+    c_btree_node_t *n = iter->path[iter->depth].node;
+    int i = iter->path[iter->depth].index;
+
+    if (!n->leaf) {
+      iter_descend(iter, n->child[i], /* last = */ 1);
+    } else if (i > 0) {
+      iter->path[iter->depth].index = i - 1;
+    } else {
+      /* Go up to the first node that has entries left of the path. */
+      int depth = iter->depth - 1;
+      while ((depth >= 0) && (iter->path[depth].index == 0))
+        depth--;
+      if (depth < 0)
+        return -1;
+      iter->path[depth].index--;
+      iter->depth = depth;
+    }
+  }
+
+  *key = iter->path[iter->depth].node->key[iter->path[iter->depth].index];
+  *value = iter->path[iter->depth].node->value[iter->path[iter->depth].index];
+  return 0;
+} /* }}} int c_btree_iterator_prev */
+
+void c_btree_iterator_destroy(c_btree_iterator_t *iter) /* {{{ */
+{
+  free(iter);
+} /* }}} void c_btree_iterator_destroy */
+
+int c_btree_size(c_btree_t *t) /* {{{ */
+{
+  if (t == NULL)
+    return 0;
+  return t->size;
+} /* }}} int c_btree_size */
@@ -0,0 +1,131 @@
+/**
+ * collectd - src/daemon/utils_btree.h
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef UTILS_BTREE_H
+#define UTILS_BTREE_H 1
+
+/* An ordered map with the same interface and semantics as the AVL-tree in
+ * "utils_avltree.h". Up to 31 entries are stored per node, so a lookup visits
+ * far fewer nodes, and the keys compared during a lookup are adjacent in
+ * memory. Nodes are carved from slabs owned by the tree instead of being
+ * allocated one by one. The differences to the AVL-tree are:
+ *
+ *   - Inserting or removing entries invalidates all iterators of the tree.
+ *   - c_btree_pick always returns the largest key.
+ */
+
+struct c_btree_s;
+typedef struct c_btree_s c_btree_t;
+
+struct c_btree_iterator_s;
+typedef struct c_btree_iterator_s c_btree_iterator_t;
+
+/*
+ * NAME
+ *   c_btree_create
+ *
+ * DESCRIPTION
+ *   Allocates a new B-tree. `compare' is used like with c_avl_create.
+ *
+ * RETURN VALUE
+ *   A c_btree_t-pointer upon success or NULL upon failure.
+ */
+c_btree_t *c_btree_create(int (*compare)(const void *, const void *));
+
+/*
+ * NAME
+ *   c_btree_destroy
+ *
+ * DESCRIPTION
+ *   Deallocates a B-tree. Stored value- and key-pointers are lost, but not
+ *   freed.
+ */
+void c_btree_destroy(c_btree_t *t);
+
+/*
+ * NAME
+ *   c_btree_insert
+ *
+ * DESCRIPTION
+ *   Stores the key-value-pair in the tree. The key is _not_ copied.
+ *
+ * RETURN VALUE
+ *   Zero upon success, non-zero otherwise. It's less than zero if an error
+ *   occurred or greater than zero if the key is already stored in the tree.
+ */
+int c_btree_insert(c_btree_t *t, void *key, void *value);
+
+/*
+ * NAME
+ *   c_btree_remove
+ *
+ * DESCRIPTION
+ *   Removes a key-value-pair from the tree. The stored key and value are
+ *   returned in `rkey' and `rvalue' unless they are NULL.
+ *
+ * RETURN VALUE
+ *   Zero upon success or non-zero if the key isn't found in the tree.
+ */
+int c_btree_remove(c_btree_t *t, const void *key, void **rkey, void **rvalue);
+
+/*
+ * NAME
+ *   c_btree_get
+ *
+ * DESCRIPTION
+ *   Retrieves the `value' belonging to `key'. `value' may be NULL.
+ *
+ * RETURN VALUE
+ *   Zero upon success or non-zero if the key isn't found in the tree.
+ */
+int c_btree_get(c_btree_t *t, const void *key, void **value);
+
+/*
+ * NAME
+ *   c_btree_pick
+ *
+ * DESCRIPTION
+ *   Removes the entry with the largest key from the tree and returns its
+ *   `key' and `value'.
+ *
+ * RETURN VALUE
+ *   Zero upon success or non-zero if the tree is empty or key or value is
+ *   NULL.
+ */
+int c_btree_pick(c_btree_t *t, void **key, void **value);
+
+c_btree_iterator_t *c_btree_get_iterator(c_btree_t *t);
+int c_btree_iterator_next(c_btree_iterator_t *iter, void **key, void **value);
+int c_btree_iterator_prev(c_btree_iterator_t *iter, void **key, void **value);
+void c_btree_iterator_destroy(c_btree_iterator_t *iter);
+
+/*
+ * NAME
+ *   c_btree_size
+ *
+ * DESCRIPTION
+ *   Returns the number of entries in the tree.
+ */
+int c_btree_size(c_btree_t *t);
+
+#endif /* UTILS_BTREE_H */
@@ -0,0 +1,214 @@
+/**
+ * collectd - src/daemon/utils_btree_test.c
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "common.h"
+#include "testing.h"
+#include "utils_avltree.h"
+#include "utils_btree.h"
+
+#define NUM_KEYS 5000
+
+static int compare_int(void const *a, void const *b) {
+  int x = *(int const *)a;
+  int y = *(int const *)b;
+  return (x > y) - (x < y);
+}
+
+static int keys[NUM_KEYS];
+static void *order[NUM_KEYS];
+
+/* Checks that iterating forward returns the same sequence as the AVL tree
+ * and iterating backward returns it in reverse. */
+static int check_order(c_btree_t *b, c_avl_tree_t *a) {
+  c_btree_iterator_t *bi;
+  c_avl_iterator_t *ai;
+  void *bk, *bv, *ak, *av;
+  int n = 0;
+
+  EXPECT_EQ_INT(c_avl_size(a), c_btree_size(b));
+
+  CHECK_NOT_NULL(bi = c_btree_get_iterator(b));
+  CHECK_NOT_NULL(ai = c_avl_get_iterator(a));
+  while (c_avl_iterator_next(ai, &ak, &av) == 0) {
+    CHECK_ZERO(c_btree_iterator_next(bi, &bk, &bv));
+    OK(ak == bk);
+    OK(av == bv);
+    order[n++] = ak;
+  }
+  OK(c_btree_iterator_next(bi, &bk, &bv) != 0);
+  EXPECT_EQ_INT(c_avl_size(a), n);
+  c_btree_iterator_destroy(bi);
+  c_avl_iterator_destroy(ai);
+
+  CHECK_NOT_NULL(bi = c_btree_get_iterator(b));
+  while (n > 0) {
+    CHECK_ZERO(c_btree_iterator_prev(bi, &bk, &bv));
+    OK(order[--n] == bk);
+  }
+  OK(c_btree_iterator_prev(bi, &bk, &bv) != 0);
+  c_btree_iterator_destroy(bi);
+
+  return 0;
+}
+
+DEF_TEST(success) {
+  c_btree_t *t;
+  char *key;
+  char *value;
+
+  CHECK_NOT_NULL(t = c_btree_create((void *)strcmp));
+  EXPECT_EQ_INT(-1, c_btree_get(t, "foo", NULL));
+  EXPECT_EQ_INT(-1, c_btree_pick(t, (void *)&key, (void *)&value));
+
+  CHECK_ZERO(c_btree_insert(t, "foo", "1"));
+  CHECK_ZERO(c_btree_insert(t, "bar", "2"));
+  EXPECT_EQ_INT(1, c_btree_insert(t, "foo", "3"));
+  EXPECT_EQ_INT(2, c_btree_size(t));
+
+  CHECK_ZERO(c_btree_get(t, "foo", (void *)&value));
+  EXPECT_EQ_STR("1", value);
+
+  CHECK_ZERO(c_btree_remove(t, "bar", (void *)&key, (void *)&value));
+  EXPECT_EQ_STR("bar", key);
+  EXPECT_EQ_STR("2", value);
+  EXPECT_EQ_INT(-1, c_btree_remove(t, "bar", NULL, NULL));
+
+  CHECK_ZERO(c_btree_pick(t, (void *)&key, (void *)&value));
+  EXPECT_EQ_STR("foo", key);
+  EXPECT_EQ_INT(0, c_btree_size(t));
+
+  c_btree_destroy(t);
+  return 0;
+}
+
+DEF_TEST(random) {
+  c_btree_t *b;
+  c_avl_tree_t *a;
+
+  CHECK_NOT_NULL(b = c_btree_create(compare_int));
+  CHECK_NOT_NULL(a = c_avl_create(compare_int));
+
+  srand(42);
+  for (int i = 0; i < NUM_KEYS; i++)
+    keys[i] = rand() % (2 * NUM_KEYS);
+
+  /* Insert with duplicates, so that the trees are split into several levels
+   * and some inserts fail. */
+  for (int i = 0; i < NUM_KEYS; i++)
+    EXPECT_EQ_INT(c_avl_insert(a, &keys[i], &keys[i]),
+                  c_btree_insert(b, &keys[i], &keys[i]));
+  CHECK_ZERO(check_order(b, a));
+
+  for (int i = 0; i < 2 * NUM_KEYS; i++) {
+    void *av = NULL;
+    void *bv = NULL;
+    EXPECT_EQ_INT(c_avl_get(a, &i, &av), c_btree_get(b, &i, &bv));
+    OK(av == bv);
+  }
+
+  /* Remove every other key, including ones not in the trees. This merges
+   * nodes and moves entries between them. */
+  for (int i = 0; i < 2 * NUM_KEYS; i += 2) {
+    void *ak = NULL, *av = NULL, *bk = NULL, *bv = NULL;
+    EXPECT_EQ_INT(c_avl_remove(a, &i, &ak, &av) == 0,
+                  c_btree_remove(b, &i, &bk, &bv) == 0);
+    OK(ak == bk);
+    OK(av == bv);
+  }
+  CHECK_ZERO(check_order(b, a));
+
+  /* Pick returns the largest key. */
+  while (c_btree_size(b) > NUM_KEYS / 4) {
+    void *k, *v;
+    int max = -1;
+
+    for (int i = 0; i < NUM_KEYS; i++)
+      if ((keys[i] > max) && (c_avl_get(a, &keys[i], NULL) == 0))
+        max = keys[i];
+
+    CHECK_ZERO(c_btree_pick(b, &k, &v));
+    EXPECT_EQ_INT(max, *(int *)k);
+    CHECK_ZERO(c_avl_remove(a, k, NULL, NULL));
+  }
+  CHECK_ZERO(check_order(b, a));
+
+  /* Refill, then empty the trees completely. */
+  for (int i = 0; i < NUM_KEYS; i++)
+    EXPECT_EQ_INT(c_avl_insert(a, &keys[i], &keys[i]),
+                  c_btree_insert(b, &keys[i], &keys[i]));
+  CHECK_ZERO(check_order(b, a));
+
+  for (int i = NUM_KEYS - 1; i >= 0; i--)
+    EXPECT_EQ_INT(c_avl_remove(a, &keys[i], NULL, NULL),
+                  c_btree_remove(b, &keys[i], NULL, NULL));
+  EXPECT_EQ_INT(0, c_btree_size(b));
+  CHECK_ZERO(check_order(b, a));
+
+  c_btree_destroy(b);
+  c_avl_destroy(a);
+  return 0;
+}
+
+DEF_TEST(iterator) {
+  c_btree_t *t;
+  c_btree_iterator_t *iter;
+  void *k, *v;
+
+  CHECK_NOT_NULL(t = c_btree_create(compare_int));
+  for (int i = 0; i < NUM_KEYS; i++) {
+    keys[i] = i;
+    CHECK_ZERO(c_btree_insert(t, &keys[i], NULL));
+  }
+
+  /* Changing direction returns the previous entry again. */
+  CHECK_NOT_NULL(iter = c_btree_get_iterator(t));
+  for (int i = 0; i < NUM_KEYS; i++) {
+    CHECK_ZERO(c_btree_iterator_next(iter, &k, &v));
+    EXPECT_EQ_INT(i, *(int *)k);
+    if (i == 0)
+      continue;
+    CHECK_ZERO(c_btree_iterator_prev(iter, &k, &v));
+    EXPECT_EQ_INT(i - 1, *(int *)k);
+    CHECK_ZERO(c_btree_iterator_next(iter, &k, &v));
+    EXPECT_EQ_INT(i, *(int *)k);
+  }
+
+  /* The iterator stays on the last entry. */
+  OK(c_btree_iterator_next(iter, &k, &v) != 0);
+  CHECK_ZERO(c_btree_iterator_prev(iter, &k, &v));
+  EXPECT_EQ_INT(NUM_KEYS - 2, *(int *)k);
+  c_btree_iterator_destroy(iter);
+
+  c_btree_destroy(t);
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(success);
+  RUN_TEST(random);
+  RUN_TEST(iterator);
+
+  END_TEST;
+}
@@ -29,21 +29,106 @@
 #include "collectd.h"
 
 #include "common.h"
+#include "configfile.h"
 #include "meta_data.h"
 #include "plugin.h"
 #include "utils_avltree.h"
 #include "utils_cache.h"
+#include "utils_shm_export.h"
 
 #include <assert.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* Number of independently locked parts of the cache. Must be a power of
+ * two. */
+#ifndef UC_SHARDS_NUM
+#define UC_SHARDS_NUM 64
+#endif
+
+/* Initial number of slots per shard. Must be a power of two. */
+#define UC_SHARD_INITIAL_SIZE 16
 
+/* Each shard keeps its entries in a timing wheel, sorted by the time they
+ * will time out. A bucket covers UC_WHEEL_RESOLUTION; deadlines further away
+ * than UC_WHEEL_BUCKETS buckets wrap around and are moved when their bucket
+ * is visited. */
+#ifndef UC_WHEEL_BUCKETS
+#define UC_WHEEL_BUCKETS 256
+#endif
+#define UC_WHEEL_RESOLUTION TIME_T_TO_CDTIME_T(1)
+
+/* Values, rates and states are read without locking the shard if the
+ * compiler provides atomic builtins, see uc_read_lockless(). Readers which
+ * raced with writers this many times lock the shard instead. */
+#if defined(__ATOMIC_ACQUIRE)
+#define UC_LOCKLESS_READS 1
+#else
+#define UC_LOCKLESS_READS 0
+#endif
+#define UC_READ_ATTEMPTS 8
+
+/* Number of series per plugin or host, see "CacheMaxSeriesPerPlugin" and
+ * "CacheMaxSeriesPerHost". */
+typedef struct {
+  char *name;
+  size_t num;
+} cache_count_t;
+
+/* The identity index maps each host and each plugin to a list of its
+ * entries, see uc_query_create(). */
+#define UC_INDEX_HOST 0
+#define UC_INDEX_PLUGIN 1
+#define UC_INDEX_NUM 2
+
+struct cache_entry_s;
+
+/* Entries and slot arrays which lock-free readers may still be using, see
+ * cache_shard_defer(). Entries embed their own node, "entry" is NULL for
+ * slot arrays. */
+typedef struct cache_garbage_s {
+  struct cache_garbage_s *next;
+  struct cache_entry_s *entry;
+  struct cache_slot_s *slots;
+} cache_garbage_t;
+
+typedef struct {
+  char *name;
+  struct cache_entry_s *entries;
+  size_t num;
+} cache_index_node_t;
+
+typedef struct {
+  cache_index_node_t *node;
+  struct cache_entry_s *next;
+  struct cache_entry_s *prev;
+} cache_index_link_t;
+
+/* Entries are allocated as a single block by cache_alloc(): the entry is
+ * followed by the current and previous raw values, the gauge values and the
+ * name, which is only as long as it needs to be. The shard's slot and the
+ * identity index refer to this one copy of the name. */
 typedef struct cache_entry_s {
-  char name[6 * DATA_MAX_NAME_LEN];
+  char *name;
+  uint64_t hash;
   size_t values_num;
+  /* Odd while the values, times, rates or state are being changed, see
+   * cache_seq_begin(). */
+  uint64_t seq;
   gauge_t *values_gauge;
   value_t *values_raw;
   /* Time contained in the package
    * (for calculating rates) */
   cdtime_t last_time;
+  /* Rates are only calculated when they are read, see cache_entry_rates(),
+   * from the raw values and time of the previous update kept here. Entries
+   * with a history calculate them on every update. */
+  value_t *values_prev;
+  cdtime_t prev_time;
+  _Bool rates_valid;
+  data_set_id_t ds_id;
   /* Time according to the local clock
    * (for purging old entries) */
   cdtime_t last_update;
@@ -52,6 +137,8 @@ typedef struct cache_entry_s {
   cdtime_t interval;
   int state;
   int hits;
+  /* Number of consecutive updates which didn't change the raw values. */
+  uint64_t unchanged;
 
   /*
    * +-----+-----+-----+-----+-----+-----+-----+-----+-----+----
@@ -67,48 +154,749 @@ typedef struct cache_entry_s {
   size_t history_length;
 
   meta_data_t *meta;
+
+  /* Memoized filter chain results, see uc_memo_get(). */
+  uint8_t *memo;
+  size_t memo_size;
+  uint64_t memo_generation;
+
+  /* Resolved threshold, see uc_threshold_get(). */
+  void *threshold;
+  uint64_t threshold_generation;
+
+  /* Timing wheel linkage. "wheel_tick" is the tick of the bucket the entry is
+   * linked into. */
+  struct cache_entry_s *wheel_next;
+  struct cache_entry_s **wheel_pprev;
+  uint64_t wheel_tick;
+
+  /* Snapshot support, see uc_snapshot_create(). Entries are linked into
+   * their shard's "entries" list, newest first. Removed entries stay linked
+   * (and in the shard's "retired" list) while an active snapshot may still
+   * return them. */
+  uint64_t epoch_added;
+  uint64_t epoch_removed; /* zero while the entry is in the cache */
+  struct cache_entry_s *list_next;
+  struct cache_entry_s *list_prev;
+  struct cache_entry_s *retired_next;
+
+  /* Accounting, see cache_entry_size(). The counts are NULL unless the
+   * respective limit is configured. */
+  size_t size;
+  cache_count_t *count_plugin;
+  cache_count_t *count_host;
+
+  /* Identity index linkage, protected by "index_lock". */
+  cache_index_link_t index[UC_INDEX_NUM];
+
+  /* Slot in the shared memory export or -1, see "CacheExportFile". */
+  int64_t export_slot;
+
+  cache_garbage_t garbage;
 } cache_entry_t;
 
+/* Each shard is an open addressing hash table using linear probing. The
+ * entry's hash is stored in the slot so that probing only compares names when
+ * the hashes match. */
+typedef struct cache_slot_s {
+  uint64_t hash;
+  cache_entry_t *entry; /* NULL if the slot is unused */
+} cache_slot_t;
+
+typedef struct {
+  pthread_mutex_t lock;
+  cache_slot_t *slots;
+  size_t size; /* number of slots, a power of two */
+  size_t num;  /* number of entries */
+
+  cache_entry_t *wheel[UC_WHEEL_BUCKETS];
+  uint64_t wheel_tick; /* first tick not yet completely processed */
+
+  cache_entry_t *entries;
+  cache_entry_t *retired;
+
+  size_t memory; /* bytes used by the slots and entries */
+
+  /* Lock-free readers, see uc_read_lockless(). "table_seq" is odd while the
+   * slots are being changed. Readers register in "readers[read_epoch & 1]".
+   * Removed entries and replaced slot arrays are collected in "garbage" and
+   * moved to "garbage_prev" when the epoch is advanced. They are freed once
+   * the readers of the previous epoch are gone. */
+  uint64_t table_seq;
+  uint64_t read_epoch;
+  uint64_t readers[2];
+  cache_garbage_t *garbage;
+  cache_garbage_t *garbage_prev;
+} cache_shard_t;
+
 struct uc_iter_s {
-  c_avl_iterator_t *iter;
+  /* All entries, sorted by name. */
+  cache_entry_t **entries;
+  size_t entries_num;
+  size_t index;
 
   char *name;
   cache_entry_t *entry;
 };
 
-static c_avl_tree_t *cache_tree = NULL;
-static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+/* Number of entries uc_snapshot_next() fetches per shard lock. */
+#define UC_SNAPSHOT_BATCH 128
 
-static int cache_compare(const cache_entry_t *a, const cache_entry_t *b) {
-#if COLLECT_DEBUG
-  assert((a != NULL) && (b != NULL));
+struct uc_snapshot_s {
+  uint64_t epoch;
+  size_t size;
+
+  /* Position: the next entry to visit is "cursor" in shard "shard", or the
+   * shard's first entry if "cursor" is NULL. The cursor always points to an
+   * entry visible to the snapshot, so it isn't freed meanwhile. */
+  size_t shard;
+  cache_entry_t *cursor;
+
+  struct {
+    const char *name;
+    cdtime_t time;
+    int state;
+  } batch[UC_SNAPSHOT_BATCH];
+  size_t batch_num;
+  size_t batch_index;
+};
+
+static cache_shard_t cache_shards[UC_SHARDS_NUM];
+static _Bool cache_initialized = 0;
+
+/* Snapshot epochs. Both are only changed while all shards are locked, so
+ * holding any shard's lock is enough to read them. An entry is visible to the
+ * snapshot with epoch S if epoch_added <= S and it hasn't been removed before
+ * the snapshot was created, i.e. epoch_removed is zero or greater than S.
+ * "snapshot_epochs" holds the epochs of all active snapshots in ascending
+ * order. */
+static uint64_t cache_epoch = 1;
+static uint64_t *snapshot_epochs;
+static size_t snapshot_epochs_num;
+
+/* Limits. The memory limit is enforced for each shard separately, using an
+ * equal share of "CacheMemoryLimit". The per-plugin and per-host counts and
+ * all statistics are protected by "limits_lock", which may be locked while
+ * holding a shard's lock, but not the other way around. */
+static size_t shard_memory_limit; /* zero: unlimited */
+static _Bool limit_evict;
+static size_t max_series_per_plugin;
+static size_t max_series_per_host;
+
+static pthread_mutex_t limits_lock = PTHREAD_MUTEX_INITIALIZER;
+static c_avl_tree_t *counts_plugin;
+static c_avl_tree_t *counts_host;
+static uc_stats_t cache_stats;
+
+/* The identity index holds exactly the entries in the shards' hash tables.
+ * "index_lock" may be locked while holding a shard's lock, but not the other
+ * way around. */
+static pthread_mutex_t index_lock = PTHREAD_MUTEX_INITIALIZER;
+static c_avl_tree_t *index_trees[UC_INDEX_NUM];
+
+struct uc_query_s {
+  value_list_t match;
+
+  /* Queries with a literal host or plugin return the entries found in the
+   * index, all others iterate over a snapshot of the whole cache. */
+  uc_snapshot_t *snapshot;
+  struct {
+    char *name;
+    uint64_t hash;
+  } * matches;
+  size_t matches_num;
+  size_t matches_index;
+};
+
+/* Persistence, see "CacheFile". The file starts with a uc_file_header_t,
+ * followed by one record per entry: a uc_file_record_t, the name, the raw
+ * values, the gauge values and the history. Records are padded to multiples
+ * of eight bytes. Everything is stored in host byte order; files written by
+ * a different architecture or version are ignored. */
+#define UC_FILE_MAGIC "collectd cache\n"
+#define UC_FILE_VERSION 1
+#define UC_FILE_BYTE_ORDER 0x01020304
+#define UC_FILE_ALIGN(n) (((n) + 7) & ~((size_t)7))
+
+typedef struct {
+  char magic[16];
+  uint32_t version;
+  uint32_t byte_order;
+  uint64_t records_num;
+} uc_file_header_t;
+
+typedef struct {
+  uint32_t size; /* of the whole record */
+  uint16_t name_len;
+  uint16_t values_num;
+  uint32_t history_length;
+  uint32_t history_index;
+  int32_t state;
+  uint32_t reserved;
+  uint64_t last_time;
+  uint64_t interval;
+} uc_file_record_t;
+
+static char *cache_file;
+static cdtime_t cache_file_interval;
+static cdtime_t cache_file_next;
+
+/* The lower bits of the hash select the slot, the upper bits the shard. */
+static cache_shard_t *cache_shard(uint64_t hash) /* {{{ */
+{
+  return &cache_shards[(hash >> 32) & (UC_SHARDS_NUM - 1)];
+} /* }}} cache_shard_t *cache_shard */
+
+/* Writers, which hold the shard's lock, call cache_seq_begin() before and
+ * cache_seq_end() after changing data read by lock-free readers. Readers
+ * copy the data between cache_seq_read_begin() and cache_seq_read_retry()
+ * and try again if the latter returns true. */
+static void cache_seq_begin(uint64_t *seq) /* {{{ */
+{
+#if UC_LOCKLESS_READS
+  __atomic_store_n(seq, *seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+#endif
+} /* }}} void cache_seq_begin */
+
+static void cache_seq_end(uint64_t *seq) /* {{{ */
+{
+#if UC_LOCKLESS_READS
+  __atomic_store_n(seq, *seq + 1, __ATOMIC_RELEASE);
 #endif
-  return strcmp(a->name, b->name);
-} /* int cache_compare */
+} /* }}} void cache_seq_end */
+
+#if UC_LOCKLESS_READS
+static uint64_t cache_seq_read_begin(uint64_t const *seq) /* {{{ */
+{
+  return __atomic_load_n(seq, __ATOMIC_ACQUIRE);
+} /* }}} uint64_t cache_seq_read_begin */
+
+static _Bool cache_seq_read_retry(uint64_t const *seq, /* {{{ */
+                                  uint64_t begin) {
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  return ((begin & 1) != 0) ||
+         (__atomic_load_n(seq, __ATOMIC_RELAXED) != begin);
+} /* }}} _Bool cache_seq_read_retry */
+#endif
+
+static void cache_free(cache_entry_t *ce);
+
+static void cache_garbage_free(cache_garbage_t *g) /* {{{ */
+{
+  while (g != NULL) {
+    cache_garbage_t *next = g->next;
+
+    if (g->entry != NULL) {
+      cache_free(g->entry);
+    } else {
+      sfree(g->slots);
+      sfree(g);
+    }
+    g = next;
+  }
+} /* }}} void cache_garbage_free */
+
+/* Frees the garbage of the previous epoch and advances the epoch, unless
+ * readers of the previous epoch are still active. Those are counted in the
+ * same counter as readers of the next epoch. The shard must be locked. */
+static void cache_shard_collect(cache_shard_t *shard) /* {{{ */
+{
+#if UC_LOCKLESS_READS
+  uint64_t epoch = shard->read_epoch;
+
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&shard->readers[(epoch + 1) & 1], __ATOMIC_SEQ_CST) != 0)
+    return;
+
+  cache_garbage_free(shard->garbage_prev);
+  shard->garbage_prev = shard->garbage;
+  shard->garbage = NULL;
+  if (shard->garbage_prev != NULL)
+    __atomic_store_n(&shard->read_epoch, epoch + 1, __ATOMIC_SEQ_CST);
+#else
+  cache_garbage_free(shard->garbage);
+  shard->garbage = NULL;
+#endif
+} /* }}} void cache_shard_collect */
+
+/* Frees "g", which has been removed from the shard's slots, once no
+ * lock-free reader can use it anymore. The shard must be locked. */
+static void cache_shard_defer(cache_shard_t *shard, /* {{{ */
+                              cache_garbage_t *g) {
+  g->next = shard->garbage;
+  shard->garbage = g;
+  cache_shard_collect(shard);
+} /* }}} void cache_shard_defer */
+
+static cdtime_t cache_entry_deadline(cache_entry_t const *ce) /* {{{ */
+{
+  return ce->last_update + ce->interval * (cdtime_t)timeout_g;
+} /* }}} cdtime_t cache_entry_deadline */
+
+static void cache_wheel_unlink(cache_entry_t *ce) /* {{{ */
+{
+  if (ce->wheel_pprev == NULL)
+    return;
+
+  *ce->wheel_pprev = ce->wheel_next;
+  if (ce->wheel_next != NULL)
+    ce->wheel_next->wheel_pprev = ce->wheel_pprev;
+  ce->wheel_next = NULL;
+  ce->wheel_pprev = NULL;
+} /* }}} void cache_wheel_unlink */
+
+/* (Re-)links "ce" into the bucket matching its deadline. Deadlines which have
+ * already passed go into the bucket processed next. */
+static void cache_wheel_link(cache_shard_t *shard,
+                             cache_entry_t *ce) /* {{{ */
+{
+  uint64_t tick = (uint64_t)(cache_entry_deadline(ce) / UC_WHEEL_RESOLUTION);
+  if (tick < shard->wheel_tick)
+    tick = shard->wheel_tick;
+
+  if ((ce->wheel_pprev != NULL) && (ce->wheel_tick == tick))
+    return;
+  cache_wheel_unlink(ce);
+
+  cache_entry_t **head = &shard->wheel[tick % UC_WHEEL_BUCKETS];
+  ce->wheel_next = *head;
+  if (*head != NULL)
+    (*head)->wheel_pprev = &ce->wheel_next;
+  ce->wheel_pprev = head;
+  *head = ce;
+  ce->wheel_tick = tick;
+} /* }}} void cache_wheel_link */
+
+/* Returns the index of the slot holding "name" or, if there is no such entry,
+ * the index of the free slot where it would be inserted. The shard must have
+ * at least one free slot. */
+static size_t cache_shard_find(cache_shard_t *shard, const char *name,
+                               uint64_t hash) /* {{{ */
+{
+  size_t mask = shard->size - 1;
+  size_t i = (size_t)hash & mask;
+
+  while (shard->slots[i].entry != NULL) {
+    if ((shard->slots[i].hash == hash) &&
+        (strcmp(shard->slots[i].entry->name, name) == 0))
+      break;
+    i = (i + 1) & mask;
+  }
+
+  return i;
+} /* }}} size_t cache_shard_find */
+
+static cache_entry_t *cache_shard_get(cache_shard_t *shard, const char *name,
+                                      uint64_t hash) /* {{{ */
+{
+  if (shard->num == 0)
+    return NULL;
+
+  return shard->slots[cache_shard_find(shard, name, hash)].entry;
+} /* }}} cache_entry_t *cache_shard_get */
+
+static int cache_shard_resize(cache_shard_t *shard, size_t size) /* {{{ */
+{
+  cache_slot_t *slots = calloc(size, sizeof(*slots));
+  if (slots == NULL)
+    return ENOMEM;
+
+  cache_slot_t *old_slots = shard->slots;
+  size_t old_size = shard->size;
+
+  /* Lock-free readers may still be probing the old slots. */
+  cache_garbage_t *g = NULL;
+  if (old_slots != NULL) {
+    g = calloc(1, sizeof(*g));
+    if (g == NULL) {
+      sfree(slots);
+      return ENOMEM;
+    }
+    g->slots = old_slots;
+  }
+
+  for (size_t i = 0; i < old_size; i++) {
+    if (old_slots[i].entry == NULL)
+      continue;
+
+    size_t mask = size - 1;
+    size_t j = (size_t)old_slots[i].hash & mask;
+    while (slots[j].entry != NULL)
+      j = (j + 1) & mask;
+    slots[j] = old_slots[i];
+  }
+
+  cache_seq_begin(&shard->table_seq);
+  shard->slots = slots;
+  shard->size = size;
+  cache_seq_end(&shard->table_seq);
+
+  if (g != NULL)
+    cache_shard_defer(shard, g);
+  shard->memory += (size - old_size) * sizeof(*slots);
+  return 0;
+} /* }}} int cache_shard_resize */
+
+/* Copies the index key of "name" into "key": the host or the plugin name
+ * without its instance. */
+static void cache_index_key(int index, const char *name, /* {{{ */
+                            char *key, size_t key_size) {
+  const char *begin = name;
+  if (index == UC_INDEX_PLUGIN) {
+    begin = strchr(name, '/');
+    begin = (begin != NULL) ? begin + 1 : "";
+  }
+
+  size_t len = strcspn(begin, (index == UC_INDEX_PLUGIN) ? "-/" : "/");
+  if (len >= key_size)
+    len = key_size - 1;
+  memcpy(key, begin, len);
+  key[len] = 0;
+} /* }}} void cache_index_key */
+
+/* Adds "ce" to all indexes. "index_lock" must be held. */
+static int cache_index_link(cache_entry_t *ce) /* {{{ */
+{
+  for (int i = 0; i < UC_INDEX_NUM; i++) {
+    char key[DATA_MAX_NAME_LEN];
+    cache_index_node_t *node = NULL;
+
+    cache_index_key(i, ce->name, key, sizeof(key));
+    if (c_avl_get(index_trees[i], key, (void *)&node) != 0) {
+      node = calloc(1, sizeof(*node));
+      if (node == NULL)
+        return ENOMEM;
+      node->name = strdup(key);
+      if ((node->name == NULL) ||
+          (c_avl_insert(index_trees[i], node->name, node) != 0)) {
+        sfree(node->name);
+        sfree(node);
+        return ENOMEM;
+      }
+    }
+
+    cache_index_link_t *link = &ce->index[i];
+    link->node = node;
+    link->prev = NULL;
+    link->next = node->entries;
+    if (node->entries != NULL)
+      node->entries->index[i].prev = ce;
+    node->entries = ce;
+    node->num++;
+  }
+
+  return 0;
+} /* }}} int cache_index_link */
+
+/* Removes "ce" from all indexes it has been added to. "index_lock" must be
+ * held. */
+static void cache_index_unlink(cache_entry_t *ce) /* {{{ */
+{
+  for (int i = 0; i < UC_INDEX_NUM; i++) {
+    cache_index_link_t *link = &ce->index[i];
+    cache_index_node_t *node = link->node;
+    if (node == NULL)
+      continue;
+
+    if (link->prev != NULL)
+      link->prev->index[i].next = link->next;
+    else
+      node->entries = link->next;
+    if (link->next != NULL)
+      link->next->index[i].prev = link->prev;
+    memset(link, 0, sizeof(*link));
+
+    node->num--;
+    if (node->num == 0) {
+      c_avl_remove(index_trees[i], node->name, NULL, NULL);
+      sfree(node->name);
+      sfree(node);
+    }
+  }
+} /* }}} void cache_index_unlink */
+
+static void cache_entry_export(cache_entry_t *ce, data_set_t const *ds);
+
+static int cache_shard_insert(cache_shard_t *shard,
+                              cache_entry_t *ce) /* {{{ */
+{
+  /* Keep the load factor below 3/4. */
+  if (4 * (shard->num + 1) > 3 * shard->size) {
+    size_t size = (shard->size != 0) ? 2 * shard->size : UC_SHARD_INITIAL_SIZE;
+    int status = cache_shard_resize(shard, size);
+    if (status != 0)
+      return status;
+  }
+
+  size_t i = cache_shard_find(shard, ce->name, ce->hash);
+  if (shard->slots[i].entry != NULL)
+    return EEXIST;
+
+  pthread_mutex_lock(&index_lock);
+  int status = cache_index_link(ce);
+  if (status != 0)
+    cache_index_unlink(ce);
+  pthread_mutex_unlock(&index_lock);
+  if (status != 0)
+    return status;
+
+  cache_seq_begin(&shard->table_seq);
+  shard->slots[i].hash = ce->hash;
+  shard->slots[i].entry = ce;
+  cache_seq_end(&shard->table_seq);
+  shard->num++;
+
+  ce->epoch_added = cache_epoch;
+  ce->epoch_removed = 0;
+  ce->list_prev = NULL;
+  ce->list_next = shard->entries;
+  if (shard->entries != NULL)
+    shard->entries->list_prev = ce;
+  shard->entries = ce;
+
+  ce->export_slot = shm_export_alloc(ce->name, ce->values_num);
+  cache_entry_export(ce, /* ds = */ NULL);
+  return 0;
+} /* }}} int cache_shard_insert */
+
+static _Bool cache_entry_visible(cache_entry_t const *ce, /* {{{ */
+                                 uint64_t epoch) {
+  return (ce->epoch_added <= epoch) &&
+         ((ce->epoch_removed == 0) || (ce->epoch_removed > epoch));
+} /* }}} _Bool cache_entry_visible */
+
+/* Returns true if an active snapshot may still return the removed entry. */
+static _Bool cache_entry_needed(cache_entry_t const *ce) /* {{{ */
+{
+  for (size_t i = 0; i < snapshot_epochs_num; i++)
+    if (cache_entry_visible(ce, snapshot_epochs[i]))
+      return 1;
+  return 0;
+} /* }}} _Bool cache_entry_needed */
+
+static void cache_shard_unlink(cache_shard_t *shard, /* {{{ */
+                               cache_entry_t *ce) {
+  if (ce->list_prev != NULL)
+    ce->list_prev->list_next = ce->list_next;
+  else
+    shard->entries = ce->list_next;
+  if (ce->list_next != NULL)
+    ce->list_next->list_prev = ce->list_prev;
+  ce->list_next = NULL;
+  ce->list_prev = NULL;
+} /* }}} void cache_shard_unlink */
+
+/* Called for entries returned by cache_shard_remove(). Returns true if the
+ * caller has to free the entry using cache_shard_defer() and false if freeing
+ * is deferred until no snapshot needs it anymore. */
+static _Bool cache_shard_retire(cache_shard_t *shard, /* {{{ */
+                                cache_entry_t *ce) {
+  ce->epoch_removed = cache_epoch;
+
+  if (cache_entry_needed(ce)) {
+    ce->retired_next = shard->retired;
+    shard->retired = ce;
+    return 0;
+  }
+
+  cache_shard_unlink(shard, ce);
+  return 1;
+} /* }}} _Bool cache_shard_retire */
+
+/* Unlinks all retired entries which are no longer needed and returns them as
+ * a list linked by "retired_next". */
+static cache_entry_t *cache_shard_sweep(cache_shard_t *shard) /* {{{ */
+{
+  cache_entry_t *unneeded = NULL;
+  cache_entry_t **pprev = &shard->retired;
+
+  while (*pprev != NULL) {
+    cache_entry_t *ce = *pprev;
+
+    if (cache_entry_needed(ce)) {
+      pprev = &ce->retired_next;
+      continue;
+    }
+
+    *pprev = ce->retired_next;
+    cache_shard_unlink(shard, ce);
+    ce->retired_next = unneeded;
+    unneeded = ce;
+  }
+
+  return unneeded;
+} /* }}} cache_entry_t *cache_shard_sweep */
+
+/* Removes the entry "name" from the shard and returns it. Uses backward shift
+ * deletion, so no tombstones are needed. */
+static cache_entry_t *cache_shard_remove(cache_shard_t *shard,
+                                         const char *name,
+                                         uint64_t hash) /* {{{ */
+{
+  if (shard->num == 0)
+    return NULL;
+
+  size_t mask = shard->size - 1;
+  size_t i = cache_shard_find(shard, name, hash);
+  cache_entry_t *ce = shard->slots[i].entry;
+  if (ce == NULL)
+    return NULL;
+
+  cache_seq_begin(&shard->table_seq);
+  size_t j = i;
+  while (42) {
+    j = (j + 1) & mask;
+    if (shard->slots[j].entry == NULL)
+      break;
+
+    /* Leave the entry where it is if its home slot lies cyclically in
+     * (i, j]. */
+    size_t k = (size_t)shard->slots[j].hash & mask;
+    if ((i <= j) ? ((i < k) && (k <= j)) : ((i < k) || (k <= j)))
+      continue;
+
+    shard->slots[i] = shard->slots[j];
+    i = j;
+  }
+  shard->slots[i].entry = NULL;
+  cache_seq_end(&shard->table_seq);
+  shard->num--;
+
+  pthread_mutex_lock(&index_lock);
+  cache_index_unlink(ce);
+  pthread_mutex_unlock(&index_lock);
+
+  cache_wheel_unlink(ce);
+
+  shm_export_release(ce->export_slot);
+  ce->export_slot = -1;
+  return ce;
+} /* }}} cache_entry_t *cache_shard_remove */
+
+/* Looks up "name", whose identifier_hash() is "hash", and returns the
+ * matching entry or NULL. In both cases the lock of the shard returned in
+ * "ret_shard" is held when this function returns and must be released by the
+ * caller. */
+static cache_entry_t *uc_lookup(const char *name, uint64_t hash,
+                                cache_shard_t **ret_shard) /* {{{ */
+{
+  cache_shard_t *shard = cache_shard(hash);
+
+  pthread_mutex_lock(&shard->lock);
+
+  *ret_shard = shard;
+  return cache_shard_get(shard, name, hash);
+} /* }}} cache_entry_t *uc_lookup */
+
+/* Formats the identifier of "vl" into "name" and returns its hash in
+ * "ret_hash". Uses the identity cached in the value list, if any. */
+static int uc_format_vl(const value_list_t *vl, char *name, size_t name_size,
+                        uint64_t *ret_hash) /* {{{ */
+{
+  value_list_identity_t const *identity = VALUE_LIST_IDENTITY(vl);
+
+  if (identity != NULL) {
+    sstrncpy(name, identity->name, name_size);
+    *ret_hash = identity->hash;
+    return 0;
+  }
+
+  if (FORMAT_VL(name, name_size, vl) != 0)
+    return -1;
+
+  *ret_hash = identifier_hash(name);
+  return 0;
+} /* }}} int uc_format_vl */
+
+static void uc_lock_all(void) /* {{{ */
+{
+  for (size_t i = 0; i < UC_SHARDS_NUM; i++)
+    pthread_mutex_lock(&cache_shards[i].lock);
+} /* }}} void uc_lock_all */
+
+static void uc_unlock_all(void) /* {{{ */
+{
+  for (size_t i = UC_SHARDS_NUM; i > 0; i--)
+    pthread_mutex_unlock(&cache_shards[i - 1].lock);
+} /* }}} void uc_unlock_all */
+
+static int cache_entry_compare(const void *a, const void *b) /* {{{ */
+{
+  cache_entry_t const *const *ce_a = a;
+  cache_entry_t const *const *ce_b = b;
+
+  return strcmp((*ce_a)->name, (*ce_b)->name);
+} /* }}} int cache_entry_compare */
+
+/* Returns all entries of the cache, sorted by name. All shards must be locked
+ * by the caller. */
+static int uc_get_sorted_entries(cache_entry_t ***ret_entries,
+                                 size_t *ret_entries_num) /* {{{ */
+{
+  cache_entry_t **entries;
+  size_t entries_num = 0;
+
+  for (size_t i = 0; i < UC_SHARDS_NUM; i++)
+    entries_num += cache_shards[i].num;
+
+  *ret_entries = NULL;
+  *ret_entries_num = 0;
+  if (entries_num == 0)
+    return 0;
+
+  entries = calloc(entries_num, sizeof(*entries));
+  if (entries == NULL)
+    return ENOMEM;
+
+  size_t n = 0;
+  for (size_t i = 0; i < UC_SHARDS_NUM; i++) {
+    cache_shard_t *shard = &cache_shards[i];
+    for (size_t j = 0; j < shard->size; j++)
+      if (shard->slots[j].entry != NULL)
+        entries[n++] = shard->slots[j].entry;
+  }
+  assert(n == entries_num);
+
+  qsort(entries, entries_num, sizeof(*entries), cache_entry_compare);
+
+  *ret_entries = entries;
+  *ret_entries_num = entries_num;
+  return 0;
+} /* }}} int uc_get_sorted_entries */
+
+/* Size of the block holding an entry with "values_num" values and a name of
+ * "name_len" bytes, see cache_alloc(). */
+static size_t cache_alloc_size(size_t values_num, /* {{{ */
+                               size_t name_len) {
+  return sizeof(cache_entry_t) +
+         values_num * (2 * sizeof(value_t) + sizeof(gauge_t)) + name_len + 1;
+} /* }}} size_t cache_alloc_size */
 
-static cache_entry_t *cache_alloc(size_t values_num) {
+static cache_entry_t *cache_alloc(size_t values_num, const char *name) {
   cache_entry_t *ce;
+  size_t name_len = strlen(name);
 
-  ce = calloc(1, sizeof(*ce));
+  ce = calloc(1, cache_alloc_size(values_num, name_len));
   if (ce == NULL) {
     ERROR("utils_cache: cache_alloc: calloc failed.");
     return NULL;
   }
   ce->values_num = values_num;
 
-  ce->values_gauge = calloc(values_num, sizeof(*ce->values_gauge));
-  ce->values_raw = calloc(values_num, sizeof(*ce->values_raw));
-  if ((ce->values_gauge == NULL) || (ce->values_raw == NULL)) {
-    sfree(ce->values_gauge);
-    sfree(ce->values_raw);
-    sfree(ce);
-    ERROR("utils_cache: cache_alloc: calloc failed.");
-    return NULL;
-  }
+  /* value_t and gauge_t are both eight bytes wide, so neither array needs
+   * padding. */
+  ce->values_raw = (value_t *)(ce + 1);
+  ce->values_prev = ce->values_raw + values_num;
+  ce->values_gauge = (gauge_t *)(ce->values_prev + values_num);
+  ce->name = (char *)(ce->values_gauge + values_num);
+  memcpy(ce->name, name, name_len + 1);
 
   ce->history = NULL;
   ce->history_length = 0;
   ce->meta = NULL;
+  ce->export_slot = -1;
+  ce->garbage.entry = ce;
 
   return ce;
 } /* cache_entry_t *cache_alloc */
@@ -117,9 +905,8 @@ static void cache_free(cache_entry_t *ce) {
   if (ce == NULL)
     return;
 
-  sfree(ce->values_gauge);
-  sfree(ce->values_raw);
   sfree(ce->history);
+  sfree(ce->memo);
   if (ce->meta != NULL) {
     meta_data_destroy(ce->meta);
     ce->meta = NULL;
@@ -127,38 +914,304 @@ static void cache_free(cache_entry_t *ce) {
   sfree(ce);
 } /* void cache_free */
 
-static void uc_check_range(const data_set_t *ds, cache_entry_t *ce) {
+/* Bytes used by an entry, not counting its meta data. */
+static size_t cache_entry_size(cache_entry_t const *ce) /* {{{ */
+{
+  return cache_alloc_size(ce->values_num, strlen(ce->name)) +
+         ce->history_length * ce->values_num * sizeof(*ce->history) +
+         ce->memo_size;
+} /* }}} size_t cache_entry_size */
+
+/* Updates the shard's memory usage after the size of "ce" changed. */
+static void cache_entry_account(cache_shard_t *shard, /* {{{ */
+                                cache_entry_t *ce) {
+  size_t size = cache_entry_size(ce);
+
+  shard->memory = shard->memory - ce->size + size;
+  ce->size = size;
+} /* }}} void cache_entry_account */
+
+/* Returns the count of "name", creating it if necessary. "limits_lock" must
+ * be held. */
+static cache_count_t *cache_count_get(c_avl_tree_t *tree, /* {{{ */
+                                      const char *name) {
+  cache_count_t *c = NULL;
+
+  if (c_avl_get(tree, name, (void *)&c) == 0)
+    return c;
+
+  c = calloc(1, sizeof(*c));
+  if (c == NULL)
+    return NULL;
+  c->name = strdup(name);
+  if ((c->name == NULL) || (c_avl_insert(tree, c->name, c) != 0)) {
+    sfree(c->name);
+    sfree(c);
+    return NULL;
+  }
+
+  return c;
+} /* }}} cache_count_t *cache_count_get */
+
+/* Removes unused counts. "limits_lock" must be held. */
+static void cache_count_trim(c_avl_tree_t *tree, /* {{{ */
+                             cache_count_t *c) {
+  if ((c == NULL) || (c->num > 0))
+    return;
+
+  c_avl_remove(tree, c->name, NULL, NULL);
+  sfree(c->name);
+  sfree(c);
+} /* }}} void cache_count_trim */
+
+static void cache_count_release(cache_count_t *count_plugin, /* {{{ */
+                                cache_count_t *count_host) {
+  if ((count_plugin == NULL) && (count_host == NULL))
+    return;
+
+  pthread_mutex_lock(&limits_lock);
+  if (count_plugin != NULL) {
+    count_plugin->num--;
+    cache_count_trim(counts_plugin, count_plugin);
+  }
+  if (count_host != NULL) {
+    count_host->num--;
+    cache_count_trim(counts_host, count_host);
+  }
+  pthread_mutex_unlock(&limits_lock);
+} /* }}} void cache_count_release */
+
+/* Takes an entry removed from the shard out of the accounting. */
+static void cache_entry_unaccount(cache_shard_t *shard, /* {{{ */
+                                  cache_entry_t *ce) {
+  shard->memory -= ce->size;
+  ce->size = 0;
+
+  cache_count_release(ce->count_plugin, ce->count_host);
+  ce->count_plugin = NULL;
+  ce->count_host = NULL;
+} /* }}} void cache_entry_unaccount */
+
+/* Removes the entry closest to timing out, i.e. the one which hasn't been
+ * updated for the longest time relative to its interval, from the shard.
+ * Returns NULL if the shard is empty. */
+static cache_entry_t *cache_shard_evict(cache_shard_t *shard) /* {{{ */
+{
+  cache_entry_t *ce = NULL;
+
+  for (uint64_t i = 0; (i < UC_WHEEL_BUCKETS) && (ce == NULL); i++)
+    ce = shard->wheel[(shard->wheel_tick + i) % UC_WHEEL_BUCKETS];
+  if (ce == NULL)
+    return NULL;
+
+  ce = cache_shard_remove(shard, ce->name, ce->hash);
+  if (ce == NULL)
+    return NULL;
+  cache_entry_unaccount(shard, ce);
+
+  pthread_mutex_lock(&limits_lock);
+  cache_stats.evicted++;
+  pthread_mutex_unlock(&limits_lock);
+
+  DEBUG("uc_insert: Evicted %s from the cache.", ce->name);
+  return ce;
+} /* }}} cache_entry_t *cache_shard_evict */
+
+/* Checks the limits before a new entry of "size" bytes is inserted into the
+ * shard, evicting other entries if configured. On success, the entry's
+ * counts are returned in "ret_plugin" and "ret_host" (NULL if the respective
+ * limit is disabled). Returns ENOSPC if the entry must be rejected. */
+static int uc_reserve(cache_shard_t *shard, const value_list_t *vl, /* {{{ */
+                      size_t size, cache_count_t **ret_plugin,
+                      cache_count_t **ret_host) {
+  cache_count_t *count_plugin = NULL;
+  cache_count_t *count_host = NULL;
+  int status = 0;
+
+  *ret_plugin = NULL;
+  *ret_host = NULL;
+
+  if ((max_series_per_plugin > 0) || (max_series_per_host > 0)) {
+    pthread_mutex_lock(&limits_lock);
+
+    if (max_series_per_plugin > 0) {
+      count_plugin = cache_count_get(counts_plugin, vl->plugin);
+      if (count_plugin == NULL)
+        status = ENOMEM;
+      else if (count_plugin->num >= max_series_per_plugin) {
+        cache_stats.rejected_plugin++;
+        status = ENOSPC;
+      }
+    }
+
+    if ((status == 0) && (max_series_per_host > 0)) {
+      count_host = cache_count_get(counts_host, vl->host);
+      if (count_host == NULL)
+        status = ENOMEM;
+      else if (count_host->num >= max_series_per_host) {
+        cache_stats.rejected_host++;
+        status = ENOSPC;
+      }
+    }
+
+    if (status == 0) {
+      if (count_plugin != NULL)
+        count_plugin->num++;
+      if (count_host != NULL)
+        count_host->num++;
+    } else {
+      cache_count_trim(counts_plugin, count_plugin);
+      cache_count_trim(counts_host, count_host);
+    }
+
+    pthread_mutex_unlock(&limits_lock);
+
+    if (status != 0)
+      return status;
+  }
+
+  while ((shard_memory_limit > 0) &&
+         (shard->memory + size > shard_memory_limit)) {
+    cache_entry_t *victim = limit_evict ? cache_shard_evict(shard) : NULL;
+
+    if (victim == NULL) {
+      cache_count_release(count_plugin, count_host);
+
+      pthread_mutex_lock(&limits_lock);
+      cache_stats.rejected_memory++;
+      pthread_mutex_unlock(&limits_lock);
+      return ENOSPC;
+    }
+
+    if (cache_shard_retire(shard, victim))
+      cache_shard_defer(shard, &victim->garbage);
+  }
+
+  *ret_plugin = count_plugin;
+  *ret_host = count_host;
+  return 0;
+} /* }}} int uc_reserve */
+
+static void uc_check_range(const data_set_t *ds, gauge_t *rates) {
   for (size_t i = 0; i < ds->ds_num; i++) {
-    if (isnan(ce->values_gauge[i]))
+    if (isnan(rates[i]))
       continue;
-    else if (ce->values_gauge[i] < ds->ds[i].min)
-      ce->values_gauge[i] = NAN;
-    else if (ce->values_gauge[i] > ds->ds[i].max)
-      ce->values_gauge[i] = NAN;
+    else if (rates[i] < ds->ds[i].min)
+      rates[i] = NAN;
+    else if (rates[i] > ds->ds[i].max)
+      rates[i] = NAN;
   }
 } /* void uc_check_range */
 
-static int uc_insert(const data_set_t *ds, const value_list_t *vl,
-                     const char *key) {
-  char *key_copy;
+/* Calculates "rates" from the current and previous raw values of a series.
+ * "ds" may be NULL, in which case the data set "ds_id" is looked up. */
+static void cache_rates_calculate(data_set_id_t ds_id, /* {{{ */
+                                  data_set_t const *ds, size_t values_num,
+                                  value_t const *raw, value_t const *prev,
+                                  cdtime_t last_time, cdtime_t prev_time,
+                                  gauge_t *rates) {
+  if (ds == NULL)
+    ds = plugin_get_ds_by_id(ds_id);
+  if ((ds == NULL) || (ds->ds_num != values_num)) {
+    for (size_t i = 0; i < values_num; i++)
+      rates[i] = NAN;
+    return;
+  }
+
+  double interval = CDTIME_T_TO_DOUBLE(last_time - prev_time);
+
+  for (size_t i = 0; i < ds->ds_num; i++) {
+    switch (ds->ds[i].type) {
+    case DS_TYPE_COUNTER:
+      rates[i] =
+          ((double)counter_diff(prev[i].counter, raw[i].counter)) / interval;
+      break;
+
+    case DS_TYPE_GAUGE:
+      rates[i] = raw[i].gauge;
+      break;
+
+    case DS_TYPE_DERIVE:
+      rates[i] = ((double)(raw[i].derive - prev[i].derive)) / interval;
+      break;
+
+    case DS_TYPE_ABSOLUTE:
+      rates[i] = ((double)raw[i].absolute) / interval;
+      break;
+
+    default:
+      rates[i] = NAN;
+    } /* switch (ds->ds[i].type) */
+  }
+
+  /* Prune invalid gauge data */
+  uc_check_range(ds, rates);
+} /* }}} void cache_rates_calculate */
+
+/* Calculates the rates of "ce" from its current and previous raw values, if
+ * this hasn't been done since the last update. "ds" may be NULL, in which case
+ * the entry's data set is looked up. The entry's shard must be locked. */
+static void cache_entry_rates(cache_entry_t *ce, /* {{{ */
+                              data_set_t const *ds) {
+  if (ce->rates_valid)
+    return;
+
+  cache_seq_begin(&ce->seq);
+  cache_rates_calculate(ce->ds_id, ds, ce->values_num, ce->values_raw,
+                        ce->values_prev, ce->last_time, ce->prev_time,
+                        ce->values_gauge);
+  ce->rates_valid = 1;
+  cache_seq_end(&ce->seq);
+} /* }}} void cache_entry_rates */
+
+/* Publishes the entry to the shared memory export if it has a slot there.
+ * Rates are calculated on every update in that case. "ds" may be NULL. The
+ * entry's shard must be locked. */
+static void cache_entry_export(cache_entry_t *ce, /* {{{ */
+                               data_set_t const *ds) {
+  if (ce->export_slot < 0)
+    return;
+
+  if (ds == NULL)
+    ds = plugin_get_ds_by_id(ce->ds_id);
+  if ((ds == NULL) || (ds->ds_num != ce->values_num))
+    return;
+
+  cache_entry_rates(ce, ds);
+  shm_export_publish(ce->export_slot, ce->name, ds, ce->values_raw,
+                     ce->values_gauge, ce->last_time, ce->interval);
+} /* }}} void cache_entry_export */
+
+static int uc_insert(cache_shard_t *shard, const data_set_t *ds,
+                     const value_list_t *vl, const char *key, uint64_t hash) {
   cache_entry_t *ce;
+  cache_count_t *count_plugin;
+  cache_count_t *count_host;
+  int status;
 
-  /* `cache_lock' has been locked by `uc_update' */
+  /* The shard's lock has been locked by `uc_update' */
 
-  key_copy = strdup(key);
-  if (key_copy == NULL) {
-    ERROR("uc_insert: strdup failed.");
+  status = uc_reserve(shard, vl, cache_alloc_size(ds->ds_num, strlen(key)),
+                      &count_plugin, &count_host);
+  if (status == ENOSPC) {
+    DEBUG("uc_insert: Rejected %s: cache limit reached.", key);
+    return ENOSPC;
+  } else if (status != 0) {
+    ERROR("uc_insert: uc_reserve failed with status %i.", status);
     return -1;
   }
 
-  ce = cache_alloc(ds->ds_num);
+  ce = cache_alloc(ds->ds_num, key);
   if (ce == NULL) {
-    sfree(key_copy);
     ERROR("uc_insert: cache_alloc (%" PRIsz ") failed.", ds->ds_num);
+    cache_count_release(count_plugin, count_host);
     return -1;
   }
 
-  sstrncpy(ce->name, key, sizeof(ce->name));
+  ce->hash = hash;
+  ce->count_plugin = count_plugin;
+  ce->count_host = count_host;
+  ce->ds_id = (vl->type_id != 0) ? vl->type_id : plugin_get_ds_id(ds->type);
 
   for (size_t i = 0; i < ds->ds_num; i++) {
     switch (ds->ds[i].type) {
@@ -189,34 +1242,413 @@ static int uc_insert(const data_set_t *ds, const value_list_t *vl,
       /* This shouldn't happen. */
       ERROR("uc_insert: Don't know how to handle data source type %i.",
             ds->ds[i].type);
-      sfree(key_copy);
+      cache_entry_unaccount(shard, ce);
       cache_free(ce);
       return -1;
     } /* switch (ds->ds[i].type) */
   }   /* for (i) */
 
   /* Prune invalid gauge data */
-  uc_check_range(ds, ce);
+  uc_check_range(ds, ce->values_gauge);
+
+  memcpy(ce->values_prev, ce->values_raw,
+         ds->ds_num * sizeof(*ce->values_prev));
+  ce->rates_valid = 1;
 
   ce->last_time = vl->time;
+  ce->prev_time = vl->time;
   ce->last_update = cdtime();
   ce->interval = vl->interval;
   ce->state = STATE_OKAY;
 
-  if (c_avl_insert(cache_tree, key_copy, ce) != 0) {
-    sfree(key_copy);
-    ERROR("uc_insert: c_avl_insert failed.");
+  if (cache_shard_insert(shard, ce) != 0) {
+    cache_entry_unaccount(shard, ce);
+    cache_free(ce);
+    ERROR("uc_insert: cache_shard_insert failed.");
     return -1;
   }
+  cache_wheel_link(shard, ce);
+  cache_entry_account(shard, ce);
 
   DEBUG("uc_insert: Added %s to the cache.", key);
   return 0;
 } /* int uc_insert */
 
+static size_t uc_file_record_size(size_t name_len, /* {{{ */
+                                  size_t values_num, size_t history_length) {
+  return sizeof(uc_file_record_t) + UC_FILE_ALIGN(name_len) +
+         values_num * (sizeof(value_t) + sizeof(gauge_t)) +
+         history_length * values_num * sizeof(gauge_t);
+} /* }}} size_t uc_file_record_size */
+
+/* Appends the record of "ce" to "buffer". The entry's shard must be locked. */
+static int uc_file_record_append(cache_entry_t *ce, /* {{{ */
+                                 char **buffer, size_t *buffer_size,
+                                 size_t *buffer_fill) {
+  size_t name_len = strlen(ce->name);
+  size_t size =
+      uc_file_record_size(name_len, ce->values_num, ce->history_length);
+
+  if ((ce->values_num > UINT16_MAX) || (size > UINT32_MAX))
+    return EINVAL;
+
+  if (*buffer_fill + size > *buffer_size) {
+    size_t new_size = 2 * (*buffer_fill + size);
+    char *tmp = realloc(*buffer, new_size);
+    if (tmp == NULL)
+      return ENOMEM;
+    *buffer = tmp;
+    *buffer_size = new_size;
+  }
+
+  char *ptr = *buffer + *buffer_fill;
+  memset(ptr, 0, size);
+
+  cache_entry_rates(ce, /* ds = */ NULL);
+
+  uc_file_record_t rec = {
+      .size = (uint32_t)size,
+      .name_len = (uint16_t)name_len,
+      .values_num = (uint16_t)ce->values_num,
+      .history_length = (uint32_t)ce->history_length,
+      .history_index = (uint32_t)ce->history_index,
+      .state = (int32_t)ce->state,
+      .last_time = (uint64_t)ce->last_time,
+      .interval = (uint64_t)ce->interval,
+  };
+  memcpy(ptr, &rec, sizeof(rec));
+  ptr += sizeof(rec);
+
+  memcpy(ptr, ce->name, name_len);
+  ptr += UC_FILE_ALIGN(name_len);
+
+  memcpy(ptr, ce->values_raw, ce->values_num * sizeof(value_t));
+  ptr += ce->values_num * sizeof(value_t);
+  memcpy(ptr, ce->values_gauge, ce->values_num * sizeof(gauge_t));
+  ptr += ce->values_num * sizeof(gauge_t);
+  if (ce->history != NULL)
+    memcpy(ptr, ce->history,
+           ce->history_length * ce->values_num * sizeof(gauge_t));
+
+  *buffer_fill += size;
+  return 0;
+} /* }}} int uc_file_record_append */
+
+/* Creates an entry from a record and inserts it, subject to the limits.
+ * Records of unknown types or whose number of values doesn't match the type
+ * (any more) are skipped. */
+static int uc_file_record_restore(char const *ptr, /* {{{ */
+                                  uc_file_record_t const *rec) {
+  char name[6 * DATA_MAX_NAME_LEN];
+  value_list_t vl = VALUE_LIST_INIT;
+  const data_set_t *ds;
+  cache_shard_t *shard;
+  cache_entry_t *ce;
+  cache_count_t *count_plugin;
+  cache_count_t *count_host;
+  uint64_t hash;
+
+  if ((rec->name_len == 0) || (rec->name_len >= sizeof(name)))
+    return EINVAL;
+  memcpy(name, ptr, rec->name_len);
+  name[rec->name_len] = 0;
+  ptr += UC_FILE_ALIGN(rec->name_len);
+
+  if (parse_identifier_vl(name, &vl) != 0)
+    return EINVAL;
+  ds = plugin_get_ds(vl.type);
+  if ((ds == NULL) || (ds->ds_num != rec->values_num))
+    return ENOENT;
+
+  hash = identifier_hash(name);
+  shard = cache_shard(hash);
+  pthread_mutex_lock(&shard->lock);
+
+  if (cache_shard_get(shard, name, hash) != NULL) {
+    pthread_mutex_unlock(&shard->lock);
+    return EEXIST;
+  }
+
+  int status =
+      uc_reserve(shard, &vl, cache_alloc_size(rec->values_num, rec->name_len),
+                 &count_plugin, &count_host);
+  if (status != 0) {
+    pthread_mutex_unlock(&shard->lock);
+    return status;
+  }
+
+  ce = cache_alloc(rec->values_num, name);
+  if ((ce != NULL) && (rec->history_length > 0)) {
+    ce->history =
+        malloc(rec->history_length * rec->values_num * sizeof(*ce->history));
+    if (ce->history == NULL) {
+      cache_free(ce);
+      ce = NULL;
+    }
+  }
+  if (ce == NULL) {
+    cache_count_release(count_plugin, count_host);
+    pthread_mutex_unlock(&shard->lock);
+    return ENOMEM;
+  }
+
+  ce->hash = hash;
+  ce->count_plugin = count_plugin;
+  ce->count_host = count_host;
+  ce->ds_id = plugin_get_ds_id(ds->type);
+
+  memcpy(ce->values_raw, ptr, rec->values_num * sizeof(value_t));
+  memcpy(ce->values_prev, ptr, rec->values_num * sizeof(value_t));
+  ce->rates_valid = 1;
+  ptr += rec->values_num * sizeof(value_t);
+  memcpy(ce->values_gauge, ptr, rec->values_num * sizeof(gauge_t));
+  ptr += rec->values_num * sizeof(gauge_t);
+  if (ce->history != NULL) {
+    memcpy(ce->history, ptr,
+           rec->history_length * rec->values_num * sizeof(gauge_t));
+    ce->history_length = rec->history_length;
+    ce->history_index = rec->history_index % rec->history_length;
+  }
+
+  ce->last_time = (cdtime_t)rec->last_time;
+  ce->prev_time = ce->last_time;
+  /* Give the entry a full timeout to receive its next update. */
+  ce->last_update = cdtime();
+  ce->interval = (cdtime_t)rec->interval;
+  ce->state = (int)rec->state;
+
+  if (cache_shard_insert(shard, ce) != 0) {
+    cache_entry_unaccount(shard, ce);
+    cache_free(ce);
+    pthread_mutex_unlock(&shard->lock);
+    return ENOMEM;
+  }
+  cache_wheel_link(shard, ce);
+  cache_entry_account(shard, ce);
+
+  pthread_mutex_unlock(&shard->lock);
+  return 0;
+} /* }}} int uc_file_record_restore */
+
+/* Restores the entries saved by uc_save(). */
+static int uc_load(const char *file) /* {{{ */
+{
+  struct stat statbuf;
+  uc_file_header_t header;
+  size_t restored = 0;
+  size_t skipped = 0;
+  int fd;
+
+  fd = open(file, O_RDONLY);
+  if (fd < 0) {
+    int status = errno;
+    if (status != ENOENT)
+      WARNING("uc_load: Opening \"%s\" failed: %s", file, STRERRNO);
+    return status;
+  }
+
+  if ((fstat(fd, &statbuf) != 0) ||
+      ((size_t)statbuf.st_size < sizeof(header))) {
+    WARNING("uc_load: \"%s\" is not a cache file.", file);
+    close(fd);
+    return EINVAL;
+  }
+
+  size_t size = (size_t)statbuf.st_size;
+  char *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    int status = errno;
+    WARNING("uc_load: mmap (\"%s\") failed: %s", file, STRERRNO);
+    return status;
+  }
+
+  memcpy(&header, data, sizeof(header));
+  if ((memcmp(header.magic, UC_FILE_MAGIC, sizeof(header.magic)) != 0) ||
+      (header.version != UC_FILE_VERSION) ||
+      (header.byte_order != UC_FILE_BYTE_ORDER)) {
+    WARNING("uc_load: \"%s\" has been written by an incompatible version "
+            "or architecture and is ignored.",
+            file);
+    munmap(data, size);
+    return EINVAL;
+  }
+
+  size_t offset = sizeof(header);
+  for (uint64_t i = 0; i < header.records_num; i++) {
+    uc_file_record_t rec;
+
+    if (offset + sizeof(rec) > size)
+      break;
+    memcpy(&rec, data + offset, sizeof(rec));
+    if ((rec.size < uc_file_record_size(rec.name_len, rec.values_num,
+                                        rec.history_length)) ||
+        (rec.size > size - offset))
+      break;
+
+    if (uc_file_record_restore(data + offset + sizeof(rec), &rec) == 0)
+      restored++;
+    else
+      skipped++;
+
+    offset += rec.size;
+  }
+
+  munmap(data, size);
+
+  INFO("uc_load: Restored %" PRIsz " entries from \"%s\", skipped %" PRIsz
+       ".",
+       restored, file, skipped);
+  return 0;
+} /* }}} int uc_load */
+
+int uc_save(void) /* {{{ */
+{
+  char tmp_file[PATH_MAX];
+  uc_file_header_t header = {
+      .magic = UC_FILE_MAGIC,
+      .version = UC_FILE_VERSION,
+      .byte_order = UC_FILE_BYTE_ORDER,
+  };
+  char *buffer = NULL;
+  size_t buffer_size = 0;
+  int status = 0;
+
+  if (cache_file == NULL)
+    return 0;
+
+  snprintf(tmp_file, sizeof(tmp_file), "%s.tmp", cache_file);
+  FILE *fh = fopen(tmp_file, "w");
+  if (fh == NULL) {
+    ERROR("uc_save: fopen (\"%s\") failed: %s", tmp_file, STRERRNO);
+    return -1;
+  }
+
+  if (fwrite(&header, sizeof(header), 1, fh) != 1)
+    status = errno;
+
+  /* Serialize one shard at a time into memory, so no I/O happens while a
+   * shard is locked. */
+  for (size_t i = 0; (i < UC_SHARDS_NUM) && (status == 0); i++) {
+    cache_shard_t *shard = &cache_shards[i];
+    size_t buffer_fill = 0;
+
+    pthread_mutex_lock(&shard->lock);
+    for (cache_entry_t *ce = shard->entries; ce != NULL; ce = ce->list_next) {
+      if (ce->epoch_removed != 0)
+        continue;
+      status = uc_file_record_append(ce, &buffer, &buffer_size, &buffer_fill);
+      if (status == EINVAL) {
+        status = 0;
+        continue;
+      } else if (status != 0)
+        break;
+      header.records_num++;
+    }
+    pthread_mutex_unlock(&shard->lock);
+
+    if ((status == 0) && (buffer_fill > 0) &&
+        (fwrite(buffer, buffer_fill, 1, fh) != 1))
+      status = errno;
+  }
+  sfree(buffer);
+
+  if ((status == 0) && ((fseek(fh, 0, SEEK_SET) != 0) ||
+                        (fwrite(&header, sizeof(header), 1, fh) != 1)))
+    status = errno;
+  if ((fclose(fh) != 0) && (status == 0))
+    status = errno;
+
+  if ((status == 0) && (rename(tmp_file, cache_file) != 0))
+    status = errno;
+
+  if (status != 0) {
+    ERROR("uc_save: Writing \"%s\" failed: %s", cache_file,
+          STRERROR(status));
+    unlink(tmp_file);
+    return -1;
+  }
+
+  DEBUG("uc_save: Saved %" PRIu64 " entries to \"%s\".", header.records_num,
+        cache_file);
+  return 0;
+} /* }}} int uc_save */
+
 int uc_init(void) {
-  if (cache_tree == NULL)
-    cache_tree =
-        c_avl_create((int (*)(const void *, const void *))cache_compare);
+  if (cache_initialized)
+    return 0;
+
+  for (size_t i = 0; i < UC_SHARDS_NUM; i++) {
+    pthread_mutex_init(&cache_shards[i].lock, /* attr = */ NULL);
+    cache_shards[i].slots = NULL;
+    cache_shards[i].size = 0;
+    cache_shards[i].num = 0;
+    memset(cache_shards[i].wheel, 0, sizeof(cache_shards[i].wheel));
+    cache_shards[i].wheel_tick =
+        (uint64_t)(cdtime() / UC_WHEEL_RESOLUTION);
+  }
+
+  long memory_limit = global_option_get_long("CacheMemoryLimit", 0);
+  if (memory_limit > 0)
+    shard_memory_limit =
+        ((size_t)memory_limit * 1024 * 1024 + UC_SHARDS_NUM - 1) /
+        UC_SHARDS_NUM;
+
+  const char *action = global_option_get("CacheLimitAction");
+  if ((action != NULL) && (strcasecmp("Evict", action) == 0))
+    limit_evict = 1;
+  else if ((action != NULL) && (strcasecmp("Reject", action) != 0))
+    WARNING("uc_init: Unknown CacheLimitAction \"%s\", rejecting new "
+            "series instead.",
+            action);
+
+  long max_plugin = global_option_get_long("CacheMaxSeriesPerPlugin", 0);
+  long max_host = global_option_get_long("CacheMaxSeriesPerHost", 0);
+  max_series_per_plugin = (max_plugin > 0) ? (size_t)max_plugin : 0;
+  max_series_per_host = (max_host > 0) ? (size_t)max_host : 0;
+
+  if (max_series_per_plugin > 0)
+    counts_plugin = c_avl_create((int (*)(const void *, const void *))strcmp);
+  if (max_series_per_host > 0)
+    counts_host = c_avl_create((int (*)(const void *, const void *))strcmp);
+  if (((max_series_per_plugin > 0) && (counts_plugin == NULL)) ||
+      ((max_series_per_host > 0) && (counts_host == NULL))) {
+    ERROR("uc_init: c_avl_create failed.");
+    return ENOMEM;
+  }
+
+  for (size_t i = 0; i < UC_INDEX_NUM; i++) {
+    index_trees[i] = c_avl_create((int (*)(const void *, const void *))strcmp);
+    if (index_trees[i] == NULL) {
+      ERROR("uc_init: c_avl_create failed.");
+      return ENOMEM;
+    }
+  }
+
+  cache_initialized = 1;
+
+  const char *export_file = global_option_get("CacheExportFile");
+  if ((export_file != NULL) && (export_file[0] != 0)) {
+    long slots = global_option_get_long("CacheExportSlots", 65536);
+    if (slots < 1)
+      ERROR("uc_init: CacheExportSlots must be positive.");
+    else
+      shm_export_create(export_file, (size_t)slots);
+  }
+
+  const char *file = global_option_get("CacheFile");
+  if ((file != NULL) && (file[0] != 0)) {
+    cache_file = strdup(file);
+    if (cache_file == NULL) {
+      ERROR("uc_init: strdup failed.");
+      return ENOMEM;
+    }
+    cache_file_interval = global_option_get_time("CacheFileInterval", 0);
+    if (cache_file_interval > 0)
+      cache_file_next = cdtime() + cache_file_interval;
+
+    uc_load(cache_file);
+  }
 
   return 0;
 } /* int uc_init */
@@ -229,39 +1661,73 @@ int uc_check_timeout(void) {
   } *expired = NULL;
   size_t expired_num = 0;
 
-  pthread_mutex_lock(&cache_lock);
   cdtime_t now = cdtime();
 
-  /* Build a list of entries to be flushed */
-  c_avl_iterator_t *iter = c_avl_get_iterator(cache_tree);
-  char *key = NULL;
-  cache_entry_t *ce = NULL;
-  while (c_avl_iterator_next(iter, (void *)&key, (void *)&ce) == 0) {
-    /* If the entry is fresh enough, continue. */
-    if ((now - ce->last_update) < (ce->interval * timeout_g))
-      continue;
-
-    void *tmp = realloc(expired, (expired_num + 1) * sizeof(*expired));
-    if (tmp == NULL) {
-      ERROR("uc_check_timeout: realloc failed.");
-      continue;
-    }
-    expired = tmp;
+  uint64_t now_tick = (uint64_t)(now / UC_WHEEL_RESOLUTION);
 
-    expired[expired_num].key = strdup(key);
-    expired[expired_num].time = ce->last_time;
-    expired[expired_num].interval = ce->interval;
-
-    if (expired[expired_num].key == NULL) {
-      ERROR("uc_check_timeout: strdup failed.");
-      continue;
-    }
-
-    expired_num++;
-  } /* while (c_avl_iterator_next) */
+  if ((cache_file_interval > 0) && (now >= cache_file_next)) {
+    cache_file_next = now + cache_file_interval;
+    uc_save();
+  }
 
-  c_avl_iterator_destroy(iter);
-  pthread_mutex_unlock(&cache_lock);
+  /* Build a list of entries to be flushed. Only the wheel's buckets which
+   * became due since the last run are visited, and only one shard is locked
+   * at a time, so updates of other shards may continue meanwhile. */
+  for (size_t i = 0; i < UC_SHARDS_NUM; i++) {
+    cache_shard_t *shard = &cache_shards[i];
+
+    pthread_mutex_lock(&shard->lock);
+
+    uint64_t first_tick = shard->wheel_tick;
+    if ((now_tick - first_tick) >= UC_WHEEL_BUCKETS)
+      first_tick = now_tick - (UC_WHEEL_BUCKETS - 1);
+
+    /* The current tick's bucket is visited again on the next run, because
+     * entries may still be added to it. */
+    shard->wheel_tick = now_tick;
+
+    for (uint64_t tick = first_tick; tick <= now_tick; tick++) {
+      cache_entry_t *ce = shard->wheel[tick % UC_WHEEL_BUCKETS];
+
+      while (ce != NULL) {
+        cache_entry_t *next = ce->wheel_next;
+
+        /* If the entry is fresh enough, move it to the bucket of its
+         * deadline. This happens for deadlines which wrapped around the
+         * wheel. */
+        if ((now - ce->last_update) < (ce->interval * timeout_g)) {
+          cache_wheel_link(shard, ce);
+          ce = next;
+          continue;
+        }
+
+        void *tmp = realloc(expired, (expired_num + 1) * sizeof(*expired));
+        if (tmp == NULL) {
+          ERROR("uc_check_timeout: realloc failed.");
+          ce = next;
+          continue;
+        }
+        expired = tmp;
+
+        expired[expired_num].key = strdup(ce->name);
+        expired[expired_num].time = ce->last_time;
+        expired[expired_num].interval = ce->interval;
+
+        if (expired[expired_num].key == NULL) {
+          ERROR("uc_check_timeout: strdup failed.");
+          ce = next;
+          continue;
+        }
+
+        expired_num++;
+        ce = next;
+      } /* while (ce != NULL) */
+    }   /* for (tick = first_tick; tick <= now_tick; tick++) */
+
+    /* Free garbage left behind because readers were active. */
+    cache_shard_collect(shard);
+    pthread_mutex_unlock(&shard->lock);
+  } /* for (i = 0; i < UC_SHARDS_NUM; i++) */
 
   if (expired_num == 0) {
     sfree(expired);
@@ -290,45 +1756,72 @@ int uc_check_timeout(void) {
   /* Now actually remove all the values from the cache. We don't re-evaluate
    * the timestamp again, so in theory it is possible we remove a value after
    * it is updated here. */
-  pthread_mutex_lock(&cache_lock);
   for (size_t i = 0; i < expired_num; i++) {
-    char *key = NULL;
-    cache_entry_t *value = NULL;
-
-    if (c_avl_remove(cache_tree, expired[i].key, (void *)&key,
-                     (void *)&value) != 0) {
-      ERROR("uc_check_timeout: c_avl_remove (\"%s\") failed.", expired[i].key);
+    uint64_t hash = identifier_hash(expired[i].key);
+    cache_shard_t *shard = cache_shard(hash);
+
+    pthread_mutex_lock(&shard->lock);
+    cache_entry_t *value = cache_shard_remove(shard, expired[i].key, hash);
+    if (value != NULL)
+      cache_entry_unaccount(shard, value);
+    if ((value != NULL) && cache_shard_retire(shard, value))
+      cache_shard_defer(shard, &value->garbage);
+    pthread_mutex_unlock(&shard->lock);
+
+    if (value == NULL) {
+      ERROR("uc_check_timeout: cache_shard_remove (\"%s\") failed.",
+            expired[i].key);
       sfree(expired[i].key);
       continue;
     }
-    sfree(key);
-    cache_free(value);
 
     sfree(expired[i].key);
   } /* for (i = 0; i < expired_num; i++) */
-  pthread_mutex_unlock(&cache_lock);
 
   sfree(expired);
   return 0;
 } /* int uc_check_timeout */
 
+static _Bool uc_value_equal(int ds_type, value_t a, value_t b) /* {{{ */
+{
+  switch (ds_type) {
+  case DS_TYPE_COUNTER:
+    return a.counter == b.counter;
+  case DS_TYPE_GAUGE:
+    return (a.gauge == b.gauge) || (isnan(a.gauge) && isnan(b.gauge));
+  case DS_TYPE_DERIVE:
+    return a.derive == b.derive;
+  case DS_TYPE_ABSOLUTE:
+    return a.absolute == b.absolute;
+  }
+  return 0;
+} /* }}} _Bool uc_value_equal */
+
 int uc_update(const data_set_t *ds, const value_list_t *vl) {
+  return uc_update_unchanged(ds, vl, /* ret_unchanged = */ NULL);
+} /* int uc_update */
+
+int uc_update_unchanged(const data_set_t *ds, const value_list_t *vl,
+                        uint64_t *ret_unchanged) {
   char name[6 * DATA_MAX_NAME_LEN];
+  cache_shard_t *shard;
   cache_entry_t *ce = NULL;
+  uint64_t hash;
   int status;
 
-  if (FORMAT_VL(name, sizeof(name), vl) != 0) {
-    ERROR("uc_update: FORMAT_VL failed.");
+  if (ret_unchanged != NULL)
+    *ret_unchanged = 0;
+
+  if (uc_format_vl(vl, name, sizeof(name), &hash) != 0) {
+    ERROR("uc_update: uc_format_vl failed.");
     return -1;
   }
 
-  pthread_mutex_lock(&cache_lock);
-
-  status = c_avl_get(cache_tree, name, (void *)&ce);
-  if (status != 0) /* entry does not yet exist */
+  ce = uc_lookup(name, hash, &shard);
+  if (ce == NULL) /* entry does not yet exist */
   {
-    status = uc_insert(ds, vl, name);
-    pthread_mutex_unlock(&cache_lock);
+    status = uc_insert(shard, ds, vl, name, hash);
+    pthread_mutex_unlock(&shard->lock);
     return status;
   }
 
@@ -336,7 +1829,7 @@ int uc_update(const data_set_t *ds, const value_list_t *vl) {
   assert(ce->values_num == ds->ds_num);
 
   if (ce->last_time >= vl->time) {
-    pthread_mutex_unlock(&cache_lock);
+    pthread_mutex_unlock(&shard->lock);
     NOTICE("uc_update: Value too old: name = %s; value time = %.3f; "
            "last cache update = %.3f;",
            name, CDTIME_T_TO_DOUBLE(vl->time),
@@ -344,125 +1837,329 @@ int uc_update(const data_set_t *ds, const value_list_t *vl) {
     return -1;
   }
 
-  for (size_t i = 0; i < ds->ds_num; i++) {
-    switch (ds->ds[i].type) {
-    case DS_TYPE_COUNTER: {
-      counter_t diff =
-          counter_diff(ce->values_raw[i].counter, vl->values[i].counter);
-      ce->values_gauge[i] =
-          ((double)diff) / (CDTIME_T_TO_DOUBLE(vl->time - ce->last_time));
-      ce->values_raw[i].counter = vl->values[i].counter;
-    } break;
+  _Bool unchanged = 1;
+  for (size_t i = 0; (i < ds->ds_num) && unchanged; i++)
+    unchanged = uc_value_equal(ds->ds[i].type, ce->values_raw[i],
+                               vl->values[i]);
+  ce->unchanged = unchanged ? ce->unchanged + 1 : 0;
+  if (ret_unchanged != NULL)
+    *ret_unchanged = ce->unchanged;
+
+  /* Only keep the raw values here, rates are calculated when they are read. */
+  cache_seq_begin(&ce->seq);
+  memcpy(ce->values_prev, ce->values_raw,
+         ds->ds_num * sizeof(*ce->values_prev));
+  memcpy(ce->values_raw, vl->values, ds->ds_num * sizeof(*ce->values_raw));
+  ce->prev_time = ce->last_time;
+  ce->last_time = vl->time;
+  ce->rates_valid = 0;
+  cache_seq_end(&ce->seq);
 
-    case DS_TYPE_GAUGE:
-      ce->values_raw[i].gauge = vl->values[i].gauge;
-      ce->values_gauge[i] = vl->values[i].gauge;
-      break;
+  /* Update the history if it exists. */
+  if (ce->history != NULL) {
+    cache_entry_rates(ce, ds);
 
-    case DS_TYPE_DERIVE: {
-      derive_t diff = vl->values[i].derive - ce->values_raw[i].derive;
+    assert(ce->history_index < ce->history_length);
+    for (size_t i = 0; i < ce->values_num; i++) {
+      size_t hist_idx = (ce->values_num * ce->history_index) + i;
+      ce->history[hist_idx] = ce->values_gauge[i];
+    }
 
-      ce->values_gauge[i] =
-          ((double)diff) / (CDTIME_T_TO_DOUBLE(vl->time - ce->last_time));
-      ce->values_raw[i].derive = vl->values[i].derive;
-    } break;
+    assert(ce->history_length > 0);
+    ce->history_index = (ce->history_index + 1) % ce->history_length;
+  }
 
-    case DS_TYPE_ABSOLUTE:
-      ce->values_gauge[i] = ((double)vl->values[i].absolute) /
-                            (CDTIME_T_TO_DOUBLE(vl->time - ce->last_time));
-      ce->values_raw[i].absolute = vl->values[i].absolute;
-      break;
+  ce->last_update = cdtime();
+  ce->interval = vl->interval;
+  cache_wheel_link(shard, ce);
+  cache_entry_export(ce, ds);
 
-    default:
-      /* This shouldn't happen. */
-      pthread_mutex_unlock(&cache_lock);
-      ERROR("uc_update: Don't know how to handle data source type %i.",
-            ds->ds[i].type);
-      return -1;
-    } /* switch (ds->ds[i].type) */
+  pthread_mutex_unlock(&shard->lock);
+
+  return 0;
+} /* int uc_update_unchanged */
+
+/* Allocates the buffers requested by uc_read(). */
+static int uc_read_alloc(size_t values_num, value_t **ret_values, /* {{{ */
+                         gauge_t **ret_rates) {
+  if (ret_values != NULL) {
+    *ret_values = calloc(values_num, sizeof(**ret_values));
+    if (*ret_values == NULL)
+      return ENOMEM;
+  }
+
+  if (ret_rates != NULL) {
+    *ret_rates = calloc(values_num, sizeof(**ret_rates));
+    if (*ret_rates == NULL) {
+      if (ret_values != NULL)
+        sfree(*ret_values);
+      return ENOMEM;
+    }
+  }
+
+  return 0;
+} /* }}} int uc_read_alloc */
 
-    DEBUG("uc_update: %s: ds[%" PRIsz "] = %lf", name, i, ce->values_gauge[i]);
-  } /* for (i) */
+#if UC_LOCKLESS_READS
+/* Registers a lock-free reader of "shard". Entries and slot arrays removed
+ * after this call are not freed before uc_read_end() has been called with the
+ * returned value. */
+static unsigned int uc_read_begin(cache_shard_t *shard) /* {{{ */
+{
+  while (42) {
+    uint64_t epoch = __atomic_load_n(&shard->read_epoch, __ATOMIC_SEQ_CST);
+
+    __atomic_add_fetch(&shard->readers[epoch & 1], 1, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&shard->read_epoch, __ATOMIC_SEQ_CST) == epoch)
+      return (unsigned int)(epoch & 1);
+
+    /* The epoch has been advanced meanwhile, so the counter may already
+     * have been checked. */
+    __atomic_sub_fetch(&shard->readers[epoch & 1], 1, __ATOMIC_SEQ_CST);
+  }
+} /* }}} unsigned int uc_read_begin */
+
+static void uc_read_end(cache_shard_t *shard, unsigned int index) /* {{{ */
+{
+  __atomic_sub_fetch(&shard->readers[index], 1, __ATOMIC_SEQ_CST);
+} /* }}} void uc_read_end */
+
+/* Looks up "name" without locking the shard. Returns EAGAIN if the slots were
+ * changed during every attempt. */
+static int cache_shard_get_lockless(cache_shard_t *shard, /* {{{ */
+                                    const char *name, uint64_t hash,
+                                    cache_entry_t **ret_entry) {
+  for (int attempt = 0; attempt < UC_READ_ATTEMPTS; attempt++) {
+    uint64_t seq = cache_seq_read_begin(&shard->table_seq);
+    cache_slot_t *slots = __atomic_load_n(&shard->slots, __ATOMIC_RELAXED);
+    size_t size = __atomic_load_n(&shard->size, __ATOMIC_RELAXED);
+    cache_entry_t *ce = NULL;
+
+    /* The slots may be changed while they are probed, so the number of
+     * probes is limited even though there is always a free slot. */
+    size_t mask = size - 1;
+    size_t i = (size_t)hash & mask;
+    for (size_t n = 0; n < size; n++) {
+      cache_entry_t *e = __atomic_load_n(&slots[i].entry, __ATOMIC_RELAXED);
+      if (e == NULL)
+        break;
+      if ((__atomic_load_n(&slots[i].hash, __ATOMIC_RELAXED) == hash) &&
+          (strcmp(e->name, name) == 0)) {
+        ce = e;
+        break;
+      }
+      i = (i + 1) & mask;
+    }
+
+    if (!cache_seq_read_retry(&shard->table_seq, seq)) {
+      *ret_entry = ce;
+      return 0;
+    }
+  }
+
+  return EAGAIN;
+} /* }}} int cache_shard_get_lockless */
+
+/* Implements uc_read() without locking the entry's shard. The entry is
+ * copied while no writer changes it, as indicated by its "seq". If the rates
+ * haven't been calculated since the last update, they are calculated from the
+ * copied raw values, but not stored in the entry. Returns EAGAIN if readers
+ * raced with writers too often; the caller has to lock the shard then. */
+static int uc_read_lockless(const char *name, uint64_t hash, /* {{{ */
+                            int *ret_state, value_t **ret_values,
+                            gauge_t **ret_rates, size_t *ret_values_num) {
+  cache_shard_t *shard = cache_shard(hash);
+  unsigned int reader = uc_read_begin(shard);
+
+  cache_entry_t *ce = NULL;
+  int status = cache_shard_get_lockless(shard, name, hash, &ce);
+  if ((status == 0) && (ce == NULL))
+    status = ENOENT;
+  if (status != 0) {
+    uc_read_end(shard, reader);
+    return status;
+  }
+
+  size_t values_num = ce->values_num;
+  value_t *values = NULL;
+  gauge_t *rates = NULL;
+  status = uc_read_alloc(values_num, (ret_values != NULL) ? &values : NULL,
+                         (ret_rates != NULL) ? &rates : NULL);
+
+  /* Raw values for calculating the rates: current and previous. */
+  value_t *raw = NULL;
+  if ((status == 0) && (ret_rates != NULL)) {
+    raw = calloc(2 * values_num, sizeof(*raw));
+    if (raw == NULL)
+      status = ENOMEM;
+  }
+  if (status != 0) {
+    uc_read_end(shard, reader);
+    sfree(values);
+    sfree(rates);
+    return status;
+  }
+
+  int state = STATE_ERROR;
+  _Bool rates_valid = 0;
+  data_set_id_t ds_id = 0;
+  cdtime_t last_time = 0;
+  cdtime_t prev_time = 0;
+
+  status = EAGAIN;
+  for (int attempt = 0; attempt < UC_READ_ATTEMPTS; attempt++) {
+    uint64_t seq = cache_seq_read_begin(&ce->seq);
+
+    state = __atomic_load_n(&ce->state, __ATOMIC_RELAXED);
+    if (values != NULL)
+      memcpy(values, ce->values_raw, values_num * sizeof(*values));
+    if (rates != NULL) {
+      rates_valid = __atomic_load_n(&ce->rates_valid, __ATOMIC_RELAXED);
+      if (rates_valid) {
+        memcpy(rates, ce->values_gauge, values_num * sizeof(*rates));
+      } else {
+        memcpy(raw, ce->values_raw, values_num * sizeof(*raw));
+        memcpy(raw + values_num, ce->values_prev, values_num * sizeof(*raw));
+        ds_id = __atomic_load_n(&ce->ds_id, __ATOMIC_RELAXED);
+        last_time = __atomic_load_n(&ce->last_time, __ATOMIC_RELAXED);
+        prev_time = __atomic_load_n(&ce->prev_time, __ATOMIC_RELAXED);
+      }
+    }
 
-  /* Update the history if it exists. */
-  if (ce->history != NULL) {
-    assert(ce->history_index < ce->history_length);
-    for (size_t i = 0; i < ce->values_num; i++) {
-      size_t hist_idx = (ce->values_num * ce->history_index) + i;
-      ce->history[hist_idx] = ce->values_gauge[i];
+    if (!cache_seq_read_retry(&ce->seq, seq)) {
+      status = 0;
+      break;
     }
+  }
+  uc_read_end(shard, reader);
 
-    assert(ce->history_length > 0);
-    ce->history_index = (ce->history_index + 1) % ce->history_length;
+  if (status != 0) {
+    sfree(values);
+    sfree(rates);
+    sfree(raw);
+    return status;
   }
 
-  /* Prune invalid gauge data */
-  uc_check_range(ds, ce);
+  if ((rates != NULL) && !rates_valid)
+    cache_rates_calculate(ds_id, /* ds = */ NULL, values_num, raw,
+                          raw + values_num, last_time, prev_time, rates);
+  sfree(raw);
+
+  *ret_state = state;
+  if (ret_values != NULL)
+    *ret_values = values;
+  if (ret_rates != NULL)
+    *ret_rates = rates;
+  if (ret_values_num != NULL)
+    *ret_values_num = values_num;
+  return 0;
+} /* }}} int uc_read_lockless */
+#else
+static int uc_read_lockless(const char *name, uint64_t hash, /* {{{ */
+                            int *ret_state, value_t **ret_values,
+                            gauge_t **ret_rates, size_t *ret_values_num) {
+  return EAGAIN;
+} /* }}} int uc_read_lockless */
+#endif
 
-  ce->last_time = vl->time;
-  ce->last_update = cdtime();
-  ce->interval = vl->interval;
+/* Implements uc_read() while holding the lock of the entry's shard. */
+static int uc_read_locked(const char *name, uint64_t hash, /* {{{ */
+                          int *ret_state, value_t **ret_values,
+                          gauge_t **ret_rates, size_t *ret_values_num) {
+  cache_shard_t *shard;
+  cache_entry_t *ce = uc_lookup(name, hash, &shard);
+  if (ce == NULL) {
+    pthread_mutex_unlock(&shard->lock);
+    return ENOENT;
+  }
+
+  int status = uc_read_alloc(ce->values_num, ret_values, ret_rates);
+  if (status != 0) {
+    pthread_mutex_unlock(&shard->lock);
+    return status;
+  }
 
-  pthread_mutex_unlock(&cache_lock);
+  *ret_state = ce->state;
+  if (ret_values != NULL)
+    memcpy(*ret_values, ce->values_raw, ce->values_num * sizeof(value_t));
+  if (ret_rates != NULL) {
+    cache_entry_rates(ce, /* ds = */ NULL);
+    memcpy(*ret_rates, ce->values_gauge, ce->values_num * sizeof(gauge_t));
+  }
+  if (ret_values_num != NULL)
+    *ret_values_num = ce->values_num;
 
+  pthread_mutex_unlock(&shard->lock);
   return 0;
-} /* int uc_update */
+} /* }}} int uc_read_locked */
+
+/* Copies the state and, unless the respective pointer is NULL, the raw values
+ * and rates of "name", whose identifier_hash() is "hash". Values and rates are
+ * allocated using calloc(3) and must be freed by the caller. Returns zero on
+ * success, ENOENT if there is no such entry or another errno value. */
+static int uc_read(const char *name, uint64_t hash, int *ret_state, /* {{{ */
+                   value_t **ret_values, gauge_t **ret_rates,
+                   size_t *ret_values_num) {
+  int status = uc_read_lockless(name, hash, ret_state, ret_values, ret_rates,
+                                ret_values_num);
+  if (status != EAGAIN)
+    return status;
 
-int uc_get_rate_by_name(const char *name, gauge_t **ret_values,
-                        size_t *ret_values_num) {
+  return uc_read_locked(name, hash, ret_state, ret_values, ret_rates,
+                        ret_values_num);
+} /* }}} int uc_read */
+
+static int uc_get_rate_by_hash(const char *name, uint64_t hash,
+                               gauge_t **ret_values, size_t *ret_values_num) {
   gauge_t *ret = NULL;
   size_t ret_num = 0;
-  cache_entry_t *ce = NULL;
-  int status = 0;
-
-  pthread_mutex_lock(&cache_lock);
-
-  if (c_avl_get(cache_tree, name, (void *)&ce) == 0) {
-    assert(ce != NULL);
+  int state = STATE_ERROR;
 
-    /* remove missing values from getval */
-    if (ce->state == STATE_MISSING) {
-      DEBUG("utils_cache: uc_get_rate_by_name: requested metric \"%s\" is in "
-            "state \"missing\".",
-            name);
-      status = -1;
-    } else {
-      ret_num = ce->values_num;
-      ret = malloc(ret_num * sizeof(*ret));
-      if (ret == NULL) {
-        ERROR("utils_cache: uc_get_rate_by_name: malloc failed.");
-        status = -1;
-      } else {
-        memcpy(ret, ce->values_gauge, ret_num * sizeof(gauge_t));
-      }
-    }
-  } else {
+  int status = uc_read(name, hash, &state, /* ret_values = */ NULL, &ret,
+                       &ret_num);
+  if (status == ENOENT) {
     DEBUG("utils_cache: uc_get_rate_by_name: No such value: %s", name);
-    status = -1;
+    return -1;
+  } else if (status != 0) {
+    ERROR("utils_cache: uc_get_rate_by_name: Reading \"%s\" failed: %s", name,
+          STRERROR(status));
+    return -1;
   }
 
-  pthread_mutex_unlock(&cache_lock);
-
-  if (status == 0) {
-    *ret_values = ret;
-    *ret_values_num = ret_num;
+  /* remove missing values from getval */
+  if (state == STATE_MISSING) {
+    DEBUG("utils_cache: uc_get_rate_by_name: requested metric \"%s\" is in "
+          "state \"missing\".",
+          name);
+    sfree(ret);
+    return -1;
   }
 
-  return status;
-} /* gauge_t *uc_get_rate_by_name */
+  *ret_values = ret;
+  *ret_values_num = ret_num;
+  return 0;
+} /* int uc_get_rate_by_hash */
+
+int uc_get_rate_by_name(const char *name, gauge_t **ret_values,
+                        size_t *ret_values_num) {
+  return uc_get_rate_by_hash(name, identifier_hash(name), ret_values,
+                             ret_values_num);
+} /* int uc_get_rate_by_name */
 
 gauge_t *uc_get_rate(const data_set_t *ds, const value_list_t *vl) {
   char name[6 * DATA_MAX_NAME_LEN];
+  uint64_t hash;
   gauge_t *ret = NULL;
   size_t ret_num = 0;
   int status;
 
-  if (FORMAT_VL(name, sizeof(name), vl) != 0) {
-    ERROR("utils_cache: uc_get_rate: FORMAT_VL failed.");
+  if (uc_format_vl(vl, name, sizeof(name), &hash) != 0) {
+    ERROR("utils_cache: uc_get_rate: uc_format_vl failed.");
     return NULL;
   }
 
-  status = uc_get_rate_by_name(name, &ret, &ret_num);
+  status = uc_get_rate_by_hash(name, hash, &ret, &ret_num);
   if (status != 0)
     return NULL;
 
@@ -479,58 +2176,53 @@ gauge_t *uc_get_rate(const data_set_t *ds, const value_list_t *vl) {
   return ret;
 } /* gauge_t *uc_get_rate */
 
-int uc_get_value_by_name(const char *name, value_t **ret_values,
-                         size_t *ret_values_num) {
+static int uc_get_value_by_hash(const char *name, uint64_t hash,
+                                value_t **ret_values, size_t *ret_values_num) {
   value_t *ret = NULL;
   size_t ret_num = 0;
-  cache_entry_t *ce = NULL;
-  int status = 0;
-
-  pthread_mutex_lock(&cache_lock);
+  int state = STATE_ERROR;
 
-  if (c_avl_get(cache_tree, name, (void *)&ce) == 0) {
-    assert(ce != NULL);
-
-    /* remove missing values from getval */
-    if (ce->state == STATE_MISSING) {
-      status = -1;
-    } else {
-      ret_num = ce->values_num;
-      ret = malloc(ret_num * sizeof(*ret));
-      if (ret == NULL) {
-        ERROR("utils_cache: uc_get_value_by_name: malloc failed.");
-        status = -1;
-      } else {
-        memcpy(ret, ce->values_raw, ret_num * sizeof(value_t));
-      }
-    }
-  } else {
+  int status = uc_read(name, hash, &state, &ret, /* ret_rates = */ NULL,
+                       &ret_num);
+  if (status == ENOENT) {
     DEBUG("utils_cache: uc_get_value_by_name: No such value: %s", name);
-    status = -1;
+    return -1;
+  } else if (status != 0) {
+    ERROR("utils_cache: uc_get_value_by_name: Reading \"%s\" failed: %s",
+          name, STRERROR(status));
+    return -1;
   }
 
-  pthread_mutex_unlock(&cache_lock);
-
-  if (status == 0) {
-    *ret_values = ret;
-    *ret_values_num = ret_num;
+  /* remove missing values from getval */
+  if (state == STATE_MISSING) {
+    sfree(ret);
+    return -1;
   }
 
-  return (status);
+  *ret_values = ret;
+  *ret_values_num = ret_num;
+  return 0;
+} /* int uc_get_value_by_hash */
+
+int uc_get_value_by_name(const char *name, value_t **ret_values,
+                         size_t *ret_values_num) {
+  return uc_get_value_by_hash(name, identifier_hash(name), ret_values,
+                              ret_values_num);
 } /* int uc_get_value_by_name */
 
 value_t *uc_get_value(const data_set_t *ds, const value_list_t *vl) {
   char name[6 * DATA_MAX_NAME_LEN];
+  uint64_t hash;
   value_t *ret = NULL;
   size_t ret_num = 0;
   int status;
 
-  if (FORMAT_VL(name, sizeof(name), vl) != 0) {
-    ERROR("utils_cache: uc_get_value: FORMAT_VL failed.");
+  if (uc_format_vl(vl, name, sizeof(name), &hash) != 0) {
+    ERROR("utils_cache: uc_get_value: uc_format_vl failed.");
     return (NULL);
   }
 
-  status = uc_get_value_by_name(name, &ret, &ret_num);
+  status = uc_get_value_by_hash(name, hash, &ret, &ret_num);
   if (status != 0)
     return (NULL);
 
@@ -550,82 +2242,103 @@ value_t *uc_get_value(const data_set_t *ds, const value_list_t *vl) {
 size_t uc_get_size(void) {
   size_t size_arrays = 0;
 
-  pthread_mutex_lock(&cache_lock);
-  size_arrays = (size_t)c_avl_size(cache_tree);
-  pthread_mutex_unlock(&cache_lock);
+  for (size_t i = 0; i < UC_SHARDS_NUM; i++) {
+    pthread_mutex_lock(&cache_shards[i].lock);
+    size_arrays += cache_shards[i].num;
+    pthread_mutex_unlock(&cache_shards[i].lock);
+  }
 
   return size_arrays;
 }
 
+typedef struct {
+  char *name;
+  cdtime_t time;
+} uc_name_t;
+
+static int uc_name_compare(const void *a, const void *b) /* {{{ */
+{
+  return strcmp(((uc_name_t const *)a)->name, ((uc_name_t const *)b)->name);
+} /* }}} int uc_name_compare */
+
 int uc_get_names(char ***ret_names, cdtime_t **ret_times, size_t *ret_number) {
-  c_avl_iterator_t *iter;
-  char *key;
-  cache_entry_t *value;
+  uc_snapshot_t *snapshot;
+  uc_name_t *sorted = NULL;
+  size_t number = 0;
 
   char **names = NULL;
   cdtime_t *times = NULL;
-  size_t number = 0;
-  size_t size_arrays = 0;
 
+  const char *name;
+  cdtime_t time;
+  int state;
   int status = 0;
 
   if ((ret_names == NULL) || (ret_number == NULL))
     return -1;
 
-  pthread_mutex_lock(&cache_lock);
-
-  size_arrays = (size_t)c_avl_size(cache_tree);
-  if (size_arrays < 1) {
+  /* Copy the names without blocking updates of the cache. */
+  snapshot = uc_snapshot_create();
+  if (snapshot == NULL) {
+    ERROR("uc_get_names: uc_snapshot_create failed.");
+    return ENOMEM;
+  }
+  if (uc_snapshot_size(snapshot) < 1) {
     /* Handle the "no values" case here, to avoid the error message when
      * calloc() returns NULL. */
-    pthread_mutex_unlock(&cache_lock);
+    uc_snapshot_destroy(snapshot);
     return 0;
   }
 
-  names = calloc(size_arrays, sizeof(*names));
-  times = calloc(size_arrays, sizeof(*times));
-  if ((names == NULL) || (times == NULL)) {
+  sorted = calloc(uc_snapshot_size(snapshot), sizeof(*sorted));
+  if (sorted == NULL) {
     ERROR("uc_get_names: calloc failed.");
-    sfree(names);
-    sfree(times);
-    pthread_mutex_unlock(&cache_lock);
+    uc_snapshot_destroy(snapshot);
     return ENOMEM;
   }
 
-  iter = c_avl_get_iterator(cache_tree);
-  while (c_avl_iterator_next(iter, (void *)&key, (void *)&value) == 0) {
+  while (uc_snapshot_next(snapshot, &name, &time, &state) == 0) {
     /* remove missing values when list values */
-    if (value->state == STATE_MISSING)
+    if (state == STATE_MISSING)
       continue;
 
-    /* c_avl_size does not return a number smaller than the number of elements
-     * returned by c_avl_iterator_next. */
-    assert(number < size_arrays);
-
-    if (ret_times != NULL)
-      times[number] = value->last_time;
-
-    names[number] = strdup(key);
-    if (names[number] == NULL) {
+    sorted[number].name = strdup(name);
+    sorted[number].time = time;
+    if (sorted[number].name == NULL) {
       status = -1;
       break;
     }
 
     number++;
-  } /* while (c_avl_iterator_next) */
-
-  c_avl_iterator_destroy(iter);
-  pthread_mutex_unlock(&cache_lock);
+  }
+  uc_snapshot_destroy(snapshot);
+
+  if ((status == 0) && (number > 0)) {
+    names = calloc(number, sizeof(*names));
+    times = calloc(number, sizeof(*times));
+    if ((names == NULL) || (times == NULL)) {
+      ERROR("uc_get_names: calloc failed.");
+      status = ENOMEM;
+    }
+  }
 
   if (status != 0) {
     for (size_t i = 0; i < number; i++) {
-      sfree(names[i]);
+      sfree(sorted[i].name);
     }
+    sfree(sorted);
     sfree(names);
     sfree(times);
 
-    return -1;
+    return status;
+  }
+
+  qsort(sorted, number, sizeof(*sorted), uc_name_compare);
+  for (size_t i = 0; i < number; i++) {
+    names[i] = sorted[i].name;
+    times[i] = sorted[i].time;
   }
+  sfree(sorted);
 
   *ret_names = names;
   if (ret_times != NULL)
@@ -637,66 +2350,384 @@ int uc_get_names(char ***ret_names, cdtime_t **ret_times, size_t *ret_number) {
   return 0;
 } /* int uc_get_names */
 
+void uc_get_stats(uc_stats_t *ret_stats) /* {{{ */
+{
+  pthread_mutex_lock(&limits_lock);
+  memcpy(ret_stats, &cache_stats, sizeof(*ret_stats));
+  pthread_mutex_unlock(&limits_lock);
+
+  ret_stats->memory = 0;
+  for (size_t i = 0; i < UC_SHARDS_NUM; i++) {
+    pthread_mutex_lock(&cache_shards[i].lock);
+    ret_stats->memory += cache_shards[i].memory;
+    pthread_mutex_unlock(&cache_shards[i].lock);
+  }
+} /* }}} void uc_get_stats */
+
+uc_snapshot_t *uc_snapshot_create(void) /* {{{ */
+{
+  uc_snapshot_t *snapshot;
+  uint64_t *tmp;
+
+  snapshot = calloc(1, sizeof(*snapshot));
+  if (snapshot == NULL)
+    return NULL;
+
+  uc_lock_all();
+
+  tmp = realloc(snapshot_epochs,
+                (snapshot_epochs_num + 1) * sizeof(*snapshot_epochs));
+  if (tmp == NULL) {
+    uc_unlock_all();
+    sfree(snapshot);
+    return NULL;
+  }
+  snapshot_epochs = tmp;
+
+  /* Entries inserted or removed from now on get a later epoch. */
+  snapshot->epoch = cache_epoch;
+  cache_epoch++;
+  snapshot_epochs[snapshot_epochs_num] = snapshot->epoch;
+  snapshot_epochs_num++;
+
+  for (size_t i = 0; i < UC_SHARDS_NUM; i++)
+    snapshot->size += cache_shards[i].num;
+
+  uc_unlock_all();
+
+  return snapshot;
+} /* }}} uc_snapshot_t *uc_snapshot_create */
+
+size_t uc_snapshot_size(uc_snapshot_t const *snapshot) /* {{{ */
+{
+  return (snapshot != NULL) ? snapshot->size : 0;
+} /* }}} size_t uc_snapshot_size */
+
+/* Fetches the next batch of visible entries, locking one shard at a time. */
+static int uc_snapshot_fetch(uc_snapshot_t *snapshot) /* {{{ */
+{
+  snapshot->batch_num = 0;
+  snapshot->batch_index = 0;
+
+  while (snapshot->shard < UC_SHARDS_NUM) {
+    cache_shard_t *shard = &cache_shards[snapshot->shard];
+
+    pthread_mutex_lock(&shard->lock);
+
+    cache_entry_t *ce =
+        (snapshot->cursor != NULL) ? snapshot->cursor : shard->entries;
+    for (; ce != NULL; ce = ce->list_next) {
+      if (!cache_entry_visible(ce, snapshot->epoch))
+        continue;
+      if (snapshot->batch_num >= STATIC_ARRAY_SIZE(snapshot->batch))
+        break;
+
+      snapshot->batch[snapshot->batch_num].name = ce->name;
+      snapshot->batch[snapshot->batch_num].time = ce->last_time;
+      snapshot->batch[snapshot->batch_num].state = ce->state;
+      snapshot->batch_num++;
+    }
+
+    pthread_mutex_unlock(&shard->lock);
+
+    snapshot->cursor = ce;
+    if (ce == NULL)
+      snapshot->shard++;
+
+    if (snapshot->batch_num > 0)
+      return 0;
+  }
+
+  return ENOENT;
+} /* }}} int uc_snapshot_fetch */
+
+int uc_snapshot_next(uc_snapshot_t *snapshot, const char **ret_name, /* {{{ */
+                     cdtime_t *ret_time, int *ret_state) {
+  if (snapshot == NULL)
+    return EINVAL;
+
+  if (snapshot->batch_index >= snapshot->batch_num) {
+    int status = uc_snapshot_fetch(snapshot);
+    if (status != 0)
+      return status;
+  }
+
+  size_t i = snapshot->batch_index;
+  if (ret_name != NULL)
+    *ret_name = snapshot->batch[i].name;
+  if (ret_time != NULL)
+    *ret_time = snapshot->batch[i].time;
+  if (ret_state != NULL)
+    *ret_state = snapshot->batch[i].state;
+  snapshot->batch_index++;
+
+  return 0;
+} /* }}} int uc_snapshot_next */
+
+void uc_snapshot_rewind(uc_snapshot_t *snapshot) /* {{{ */
+{
+  if (snapshot == NULL)
+    return;
+
+  snapshot->shard = 0;
+  snapshot->cursor = NULL;
+  snapshot->batch_num = 0;
+  snapshot->batch_index = 0;
+} /* }}} void uc_snapshot_rewind */
+
+void uc_snapshot_destroy(uc_snapshot_t *snapshot) /* {{{ */
+{
+  if (snapshot == NULL)
+    return;
+
+  uc_lock_all();
+  for (size_t i = 0; i < snapshot_epochs_num; i++) {
+    if (snapshot_epochs[i] != snapshot->epoch)
+      continue;
+
+    memmove(snapshot_epochs + i, snapshot_epochs + i + 1,
+            (snapshot_epochs_num - i - 1) * sizeof(*snapshot_epochs));
+    snapshot_epochs_num--;
+    break;
+  }
+  uc_unlock_all();
+
+  /* Free the entries removed while the snapshot was active. */
+  for (size_t i = 0; i < UC_SHARDS_NUM; i++) {
+    cache_shard_t *shard = &cache_shards[i];
+
+    pthread_mutex_lock(&shard->lock);
+    cache_entry_t *unneeded = cache_shard_sweep(shard);
+    while (unneeded != NULL) {
+      cache_entry_t *next = unneeded->retired_next;
+      cache_shard_defer(shard, &unneeded->garbage);
+      unneeded = next;
+    }
+    pthread_mutex_unlock(&shard->lock);
+  }
+
+  sfree(snapshot);
+} /* }}} void uc_snapshot_destroy */
+
+static _Bool uc_pattern_is_literal(const char *pattern) /* {{{ */
+{
+  return (pattern[0] != 0) && (strpbrk(pattern, "*?[\\") == NULL);
+} /* }}} _Bool uc_pattern_is_literal */
+
+/* Copies the names and hashes of the entries of "node" into the query.
+ * "index_lock" must be held. */
+static int uc_query_copy_matches(uc_query_t *q, /* {{{ */
+                                 cache_index_node_t const *node, int index) {
+  q->matches = calloc(node->num, sizeof(*q->matches));
+  if (q->matches == NULL)
+    return ENOMEM;
+
+  for (cache_entry_t *ce = node->entries; ce != NULL;
+       ce = ce->index[index].next) {
+    q->matches[q->matches_num].name = strdup(ce->name);
+    if (q->matches[q->matches_num].name == NULL)
+      return ENOMEM;
+    q->matches[q->matches_num].hash = ce->hash;
+    q->matches_num++;
+  }
+
+  return 0;
+} /* }}} int uc_query_copy_matches */
+
+uc_query_t *uc_query_create(value_list_t const *match) /* {{{ */
+{
+  uc_query_t *q = calloc(1, sizeof(*q));
+  if (q == NULL)
+    return NULL;
+
+  q->match = *match;
+  q->match.values = NULL;
+  q->match.values_len = 0;
+  q->match.meta = NULL;
+
+  _Bool host_literal = uc_pattern_is_literal(match->host);
+  _Bool plugin_literal = uc_pattern_is_literal(match->plugin);
+  if (!host_literal && !plugin_literal) {
+    q->snapshot = uc_snapshot_create();
+    if (q->snapshot == NULL) {
+      sfree(q);
+      return NULL;
+    }
+    return q;
+  }
+
+  int status = 0;
+  pthread_mutex_lock(&index_lock);
+  if (index_trees[UC_INDEX_HOST] != NULL) {
+    cache_index_node_t *host = NULL;
+    cache_index_node_t *plugin = NULL;
+
+    if (host_literal)
+      c_avl_get(index_trees[UC_INDEX_HOST], match->host, (void *)&host);
+    if (plugin_literal)
+      c_avl_get(index_trees[UC_INDEX_PLUGIN], match->plugin, (void *)&plugin);
+
+    /* An unknown literal means that nothing matches. Otherwise use the
+     * smaller list of candidates. */
+    if ((host_literal && (host == NULL)) || (plugin_literal && (plugin == NULL)))
+      status = 0;
+    else if ((plugin == NULL) || ((host != NULL) && (host->num <= plugin->num)))
+      status = uc_query_copy_matches(q, host, UC_INDEX_HOST);
+    else
+      status = uc_query_copy_matches(q, plugin, UC_INDEX_PLUGIN);
+  }
+  pthread_mutex_unlock(&index_lock);
+
+  if (status != 0) {
+    uc_query_destroy(q);
+    return NULL;
+  }
+  return q;
+} /* }}} uc_query_t *uc_query_create */
+
+/* Returns the name of the next candidate and its hash. */
+static int uc_query_next_name(uc_query_t *q, const char **ret_name, /* {{{ */
+                              uint64_t *ret_hash) {
+  if (q->snapshot != NULL) {
+    const char *name;
+    int state;
+
+    do {
+      int status = uc_snapshot_next(q->snapshot, &name, NULL, &state);
+      if (status != 0)
+        return status;
+    } while (state == STATE_MISSING);
+
+    *ret_name = name;
+    *ret_hash = 0;
+    return 0;
+  }
+
+  if (q->matches_index >= q->matches_num)
+    return ENOENT;
+
+  *ret_name = q->matches[q->matches_index].name;
+  *ret_hash = q->matches[q->matches_index].hash;
+  q->matches_index++;
+  return 0;
+} /* }}} int uc_query_next_name */
+
+int uc_query_next(uc_query_t *q, value_list_t *vl) /* {{{ */
+{
+  const char *name;
+  uint64_t hash;
+  value_list_t const *m = &q->match;
+
+  while (uc_query_next_name(q, &name, &hash) == 0) {
+    value_list_t tmp = VALUE_LIST_INIT;
+    if (parse_identifier_vl(name, &tmp) != 0)
+      continue;
+
+    if ((fnmatch(m->host, tmp.host, 0) != 0) ||
+        (fnmatch(m->plugin, tmp.plugin, 0) != 0) ||
+        (fnmatch(m->plugin_instance, tmp.plugin_instance, 0) != 0) ||
+        (fnmatch(m->type, tmp.type, 0) != 0) ||
+        (fnmatch(m->type_instance, tmp.type_instance, 0) != 0))
+      continue;
+
+    /* Only the entries which match are hashed and looked up. */
+    if (hash == 0)
+      hash = identifier_hash(name);
+
+    cache_shard_t *shard;
+    cache_entry_t *ce = uc_lookup(name, hash, &shard);
+    if ((ce == NULL) || (ce->state == STATE_MISSING)) {
+      pthread_mutex_unlock(&shard->lock);
+      continue;
+    }
+
+    tmp.values = calloc(ce->values_num, sizeof(*tmp.values));
+    if (tmp.values == NULL) {
+      pthread_mutex_unlock(&shard->lock);
+      return ENOMEM;
+    }
+    memcpy(tmp.values, ce->values_raw, ce->values_num * sizeof(*tmp.values));
+    tmp.values_len = ce->values_num;
+    tmp.time = ce->last_time;
+    tmp.interval = ce->interval;
+    tmp.meta = meta_data_clone(ce->meta);
+    pthread_mutex_unlock(&shard->lock);
+
+    *vl = tmp;
+    return 0;
+  }
+
+  return ENOENT;
+} /* }}} int uc_query_next */
+
+void uc_query_destroy(uc_query_t *q) /* {{{ */
+{
+  if (q == NULL)
+    return;
+
+  uc_snapshot_destroy(q->snapshot);
+  for (size_t i = 0; i < q->matches_num; i++)
+    sfree(q->matches[i].name);
+  sfree(q->matches);
+  sfree(q);
+} /* }}} void uc_query_destroy */
+
 int uc_get_state(const data_set_t *ds, const value_list_t *vl) {
   char name[6 * DATA_MAX_NAME_LEN];
-  cache_entry_t *ce = NULL;
+  uint64_t hash;
   int ret = STATE_ERROR;
 
-  if (FORMAT_VL(name, sizeof(name), vl) != 0) {
-    ERROR("uc_get_state: FORMAT_VL failed.");
+  if (uc_format_vl(vl, name, sizeof(name), &hash) != 0) {
+    ERROR("uc_get_state: uc_format_vl failed.");
     return STATE_ERROR;
   }
 
-  pthread_mutex_lock(&cache_lock);
-
-  if (c_avl_get(cache_tree, name, (void *)&ce) == 0) {
-    assert(ce != NULL);
-    ret = ce->state;
-  }
-
-  pthread_mutex_unlock(&cache_lock);
+  if (uc_read(name, hash, &ret, /* ret_values = */ NULL,
+              /* ret_rates = */ NULL, /* ret_values_num = */ NULL) != 0)
+    return STATE_ERROR;
 
   return ret;
 } /* int uc_get_state */
 
 int uc_set_state(const data_set_t *ds, const value_list_t *vl, int state) {
   char name[6 * DATA_MAX_NAME_LEN];
+  uint64_t hash;
+  cache_shard_t *shard;
   cache_entry_t *ce = NULL;
   int ret = -1;
 
-  if (FORMAT_VL(name, sizeof(name), vl) != 0) {
-    ERROR("uc_set_state: FORMAT_VL failed.");
+  if (uc_format_vl(vl, name, sizeof(name), &hash) != 0) {
+    ERROR("uc_set_state: uc_format_vl failed.");
     return STATE_ERROR;
   }
 
-  pthread_mutex_lock(&cache_lock);
-
-  if (c_avl_get(cache_tree, name, (void *)&ce) == 0) {
+  ce = uc_lookup(name, hash, &shard);
+  if (ce != NULL) {
     assert(ce != NULL);
     ret = ce->state;
+    cache_seq_begin(&ce->seq);
     ce->state = state;
+    cache_seq_end(&ce->seq);
   }
 
-  pthread_mutex_unlock(&cache_lock);
+  pthread_mutex_unlock(&shard->lock);
 
   return ret;
 } /* int uc_set_state */
 
 int uc_get_history_by_name(const char *name, gauge_t *ret_history,
                            size_t num_steps, size_t num_ds) {
+  cache_shard_t *shard;
   cache_entry_t *ce = NULL;
-  int status = 0;
-
-  pthread_mutex_lock(&cache_lock);
 
-  status = c_avl_get(cache_tree, name, (void *)&ce);
-  if (status != 0) {
-    pthread_mutex_unlock(&cache_lock);
+  ce = uc_lookup(name, identifier_hash(name), &shard);
+  if (ce == NULL) {
+    pthread_mutex_unlock(&shard->lock);
     return -ENOENT;
   }
 
   if (((size_t)ce->values_num) != num_ds) {
-    pthread_mutex_unlock(&cache_lock);
+    pthread_mutex_unlock(&shard->lock);
     return -EINVAL;
   }
 
@@ -708,7 +2739,7 @@ int uc_get_history_by_name(const char *name, gauge_t *ret_history,
     tmp =
         realloc(ce->history, sizeof(*ce->history) * num_steps * ce->values_num);
     if (tmp == NULL) {
-      pthread_mutex_unlock(&cache_lock);
+      pthread_mutex_unlock(&shard->lock);
       return -ENOMEM;
     }
 
@@ -718,6 +2749,7 @@ int uc_get_history_by_name(const char *name, gauge_t *ret_history,
 
     ce->history = tmp;
     ce->history_length = num_steps;
+    cache_entry_account(shard, ce);
   } /* if (ce->history_length < num_steps) */
 
   /* Copy the values to the output buffer. */
@@ -737,7 +2769,7 @@ int uc_get_history_by_name(const char *name, gauge_t *ret_history,
            sizeof(*ret_history) * num_ds);
   }
 
-  pthread_mutex_unlock(&cache_lock);
+  pthread_mutex_unlock(&shard->lock);
 
   return 0;
 } /* int uc_get_history_by_name */
@@ -745,9 +2777,10 @@ int uc_get_history_by_name(const char *name, gauge_t *ret_history,
 int uc_get_history(const data_set_t *ds, const value_list_t *vl,
                    gauge_t *ret_history, size_t num_steps, size_t num_ds) {
   char name[6 * DATA_MAX_NAME_LEN];
+  uint64_t hash;
 
-  if (FORMAT_VL(name, sizeof(name), vl) != 0) {
-    ERROR("utils_cache: uc_get_history: FORMAT_VL failed.");
+  if (uc_format_vl(vl, name, sizeof(name), &hash) != 0) {
+    ERROR("utils_cache: uc_get_history: uc_format_vl failed.");
     return -1;
   }
 
@@ -756,68 +2789,71 @@ int uc_get_history(const data_set_t *ds, const value_list_t *vl,
 
 int uc_get_hits(const data_set_t *ds, const value_list_t *vl) {
   char name[6 * DATA_MAX_NAME_LEN];
+  uint64_t hash;
+  cache_shard_t *shard;
   cache_entry_t *ce = NULL;
   int ret = STATE_ERROR;
 
-  if (FORMAT_VL(name, sizeof(name), vl) != 0) {
-    ERROR("uc_get_hits: FORMAT_VL failed.");
+  if (uc_format_vl(vl, name, sizeof(name), &hash) != 0) {
+    ERROR("uc_get_hits: uc_format_vl failed.");
     return STATE_ERROR;
   }
 
-  pthread_mutex_lock(&cache_lock);
-
-  if (c_avl_get(cache_tree, name, (void *)&ce) == 0) {
+  ce = uc_lookup(name, hash, &shard);
+  if (ce != NULL) {
     assert(ce != NULL);
     ret = ce->hits;
   }
 
-  pthread_mutex_unlock(&cache_lock);
+  pthread_mutex_unlock(&shard->lock);
 
   return ret;
 } /* int uc_get_hits */
 
 int uc_set_hits(const data_set_t *ds, const value_list_t *vl, int hits) {
   char name[6 * DATA_MAX_NAME_LEN];
+  uint64_t hash;
+  cache_shard_t *shard;
   cache_entry_t *ce = NULL;
   int ret = -1;
 
-  if (FORMAT_VL(name, sizeof(name), vl) != 0) {
-    ERROR("uc_set_hits: FORMAT_VL failed.");
+  if (uc_format_vl(vl, name, sizeof(name), &hash) != 0) {
+    ERROR("uc_set_hits: uc_format_vl failed.");
     return STATE_ERROR;
   }
 
-  pthread_mutex_lock(&cache_lock);
-
-  if (c_avl_get(cache_tree, name, (void *)&ce) == 0) {
+  ce = uc_lookup(name, hash, &shard);
+  if (ce != NULL) {
     assert(ce != NULL);
     ret = ce->hits;
     ce->hits = hits;
   }
 
-  pthread_mutex_unlock(&cache_lock);
+  pthread_mutex_unlock(&shard->lock);
 
   return ret;
 } /* int uc_set_hits */
 
 int uc_inc_hits(const data_set_t *ds, const value_list_t *vl, int step) {
   char name[6 * DATA_MAX_NAME_LEN];
+  uint64_t hash;
+  cache_shard_t *shard;
   cache_entry_t *ce = NULL;
   int ret = -1;
 
-  if (FORMAT_VL(name, sizeof(name), vl) != 0) {
-    ERROR("uc_inc_hits: FORMAT_VL failed.");
+  if (uc_format_vl(vl, name, sizeof(name), &hash) != 0) {
+    ERROR("uc_inc_hits: uc_format_vl failed.");
     return STATE_ERROR;
   }
 
-  pthread_mutex_lock(&cache_lock);
-
-  if (c_avl_get(cache_tree, name, (void *)&ce) == 0) {
+  ce = uc_lookup(name, hash, &shard);
+  if (ce != NULL) {
     assert(ce != NULL);
     ret = ce->hits;
     ce->hits = ret + step;
   }
 
-  pthread_mutex_unlock(&cache_lock);
+  pthread_mutex_unlock(&shard->lock);
 
   return ret;
 } /* int uc_inc_hits */
@@ -832,10 +2868,11 @@ uc_iter_t *uc_get_iterator(void) {
   if (iter == NULL)
     return NULL;
 
-  pthread_mutex_lock(&cache_lock);
+  /* All shards stay locked until the iterator is destroyed. */
+  uc_lock_all();
 
-  iter->iter = c_avl_get_iterator(cache_tree);
-  if (iter->iter == NULL) {
+  if (uc_get_sorted_entries(&iter->entries, &iter->entries_num) != 0) {
+    uc_unlock_all();
     free(iter);
     return NULL;
   }
@@ -844,36 +2881,34 @@ uc_iter_t *uc_get_iterator(void) {
 } /* uc_iter_t *uc_get_iterator */
 
 int uc_iterator_next(uc_iter_t *iter, char **ret_name) {
-  int status;
-
   if (iter == NULL)
     return -1;
 
-  while ((status = c_avl_iterator_next(iter->iter, (void *)&iter->name,
-                                       (void *)&iter->entry)) == 0) {
+  while (iter->index < iter->entries_num) {
+    iter->entry = iter->entries[iter->index];
+    iter->index++;
+
     if (iter->entry->state == STATE_MISSING)
       continue;
 
-    break;
-  }
-  if (status != 0) {
-    iter->name = NULL;
-    iter->entry = NULL;
-    return -1;
-  }
+    iter->name = iter->entry->name;
+    if (ret_name != NULL)
+      *ret_name = iter->name;
 
-  if (ret_name != NULL)
-    *ret_name = iter->name;
+    return 0;
+  }
 
-  return 0;
+  iter->name = NULL;
+  iter->entry = NULL;
+  return -1;
 } /* int uc_iterator_next */
 
 void uc_iterator_destroy(uc_iter_t *iter) {
   if (iter == NULL)
     return;
 
-  c_avl_iterator_destroy(iter->iter);
-  pthread_mutex_unlock(&cache_lock);
+  sfree(iter->entries);
+  uc_unlock_all();
 
   free(iter);
 } /* void uc_iterator_destroy */
@@ -924,24 +2959,120 @@ int uc_iterator_get_meta(uc_iter_t *iter, meta_data_t **ret_meta) {
 /*
  * Meta data interface
  */
-/* XXX: This function will acquire `cache_lock' but will not free it! */
-static meta_data_t *uc_get_meta(const value_list_t *vl) /* {{{ */
+/* XXX: This function will acquire the lock of the shard returned in
+ * "ret_shard" but will not free it! */
+int uc_memo_get(value_list_identity_t const *identity, /* {{{ */
+                uint64_t generation, size_t offset, uint8_t *buffer,
+                size_t buffer_size) {
+  cache_shard_t *shard;
+  cache_entry_t *ce;
+  int status = 0;
+
+  memset(buffer, 0, buffer_size);
+
+  ce = uc_lookup(identity->name, identity->hash, &shard);
+  if (ce == NULL)
+    status = ENOENT;
+  else if ((ce->memo_generation == generation) && (offset < ce->memo_size)) {
+    size_t n = ce->memo_size - offset;
+    memcpy(buffer, ce->memo + offset, (n < buffer_size) ? n : buffer_size);
+  }
+  pthread_mutex_unlock(&shard->lock);
+
+  return status;
+} /* }}} int uc_memo_get */
+
+int uc_memo_set(value_list_identity_t const *identity, /* {{{ */
+                uint64_t generation, size_t offset, uint8_t const *buffer,
+                size_t buffer_size) {
+  cache_shard_t *shard;
+  cache_entry_t *ce;
+  int status = 0;
+
+  ce = uc_lookup(identity->name, identity->hash, &shard);
+  if (ce == NULL) {
+    pthread_mutex_unlock(&shard->lock);
+    return ENOENT;
+  }
+
+  /* Results of an older configuration are of no use. */
+  if (ce->memo_generation != generation) {
+    if (ce->memo != NULL)
+      memset(ce->memo, 0, ce->memo_size);
+    ce->memo_generation = generation;
+  }
+
+  if (ce->memo_size < offset + buffer_size) {
+    uint8_t *tmp = realloc(ce->memo, offset + buffer_size);
+    if (tmp == NULL)
+      status = ENOMEM;
+    else {
+      memset(tmp + ce->memo_size, 0, offset + buffer_size - ce->memo_size);
+      ce->memo = tmp;
+      ce->memo_size = offset + buffer_size;
+      cache_entry_account(shard, ce);
+    }
+  }
+
+  if (status == 0)
+    memcpy(ce->memo + offset, buffer, buffer_size);
+  pthread_mutex_unlock(&shard->lock);
+
+  return status;
+} /* }}} int uc_memo_set */
+
+int uc_threshold_get(value_list_identity_t const *identity, /* {{{ */
+                     uint64_t generation, void **ret_threshold) {
+  cache_shard_t *shard;
+  cache_entry_t *ce;
+  int status = 0;
+
+  ce = uc_lookup(identity->name, identity->hash, &shard);
+  if ((ce == NULL) || (ce->threshold_generation != generation))
+    status = ENOENT;
+  else
+    *ret_threshold = ce->threshold;
+  pthread_mutex_unlock(&shard->lock);
+
+  return status;
+} /* }}} int uc_threshold_get */
+
+int uc_threshold_set(value_list_identity_t const *identity, /* {{{ */
+                     uint64_t generation, void *threshold) {
+  cache_shard_t *shard;
+  cache_entry_t *ce;
+
+  ce = uc_lookup(identity->name, identity->hash, &shard);
+  if (ce == NULL) {
+    pthread_mutex_unlock(&shard->lock);
+    return ENOENT;
+  }
+
+  ce->threshold = threshold;
+  ce->threshold_generation = generation;
+  pthread_mutex_unlock(&shard->lock);
+
+  return 0;
+} /* }}} int uc_threshold_set */
+
+static meta_data_t *uc_get_meta(const value_list_t *vl,
+                                cache_shard_t **ret_shard) /* {{{ */
 {
   char name[6 * DATA_MAX_NAME_LEN];
+  uint64_t hash;
+  cache_shard_t *shard;
   cache_entry_t *ce = NULL;
   int status;
 
-  status = FORMAT_VL(name, sizeof(name), vl);
+  status = uc_format_vl(vl, name, sizeof(name), &hash);
   if (status != 0) {
-    ERROR("utils_cache: uc_get_meta: FORMAT_VL failed.");
+    ERROR("utils_cache: uc_get_meta: uc_format_vl failed.");
     return NULL;
   }
 
-  pthread_mutex_lock(&cache_lock);
-
-  status = c_avl_get(cache_tree, name, (void *)&ce);
-  if (status != 0) {
-    pthread_mutex_unlock(&cache_lock);
+  ce = uc_lookup(name, hash, &shard);
+  if (ce == NULL) {
+    pthread_mutex_unlock(&shard->lock);
     return NULL;
   }
   assert(ce != NULL);
@@ -950,8 +3081,9 @@ static meta_data_t *uc_get_meta(const value_list_t *vl) /* {{{ */
     ce->meta = meta_data_create();
 
   if (ce->meta == NULL)
-    pthread_mutex_unlock(&cache_lock);
+    pthread_mutex_unlock(&shard->lock);
 
+  *ret_shard = shard;
   return ce->meta;
 } /* }}} meta_data_t *uc_get_meta */
 
@@ -959,13 +3091,14 @@ static meta_data_t *uc_get_meta(const value_list_t *vl) /* {{{ */
  * shorter.. */
 #define UC_WRAP(wrap_function)                                                 \
   {                                                                            \
+    cache_shard_t *shard;                                                      \
     meta_data_t *meta;                                                         \
     int status;                                                                \
-    meta = uc_get_meta(vl);                                                    \
+    meta = uc_get_meta(vl, &shard);                                            \
     if (meta == NULL)                                                          \
       return -1;                                                               \
     status = wrap_function(meta, key);                                         \
-    pthread_mutex_unlock(&cache_lock);                                         \
+    pthread_mutex_unlock(&shard->lock);                                        \
     return status;                                                             \
   }
 int uc_meta_data_exists(const value_list_t *vl,
@@ -979,13 +3112,14 @@ int uc_meta_data_exists(const value_list_t *vl,
  * two argumetns. */
 #define UC_WRAP(wrap_function)                                                 \
   {                                                                            \
+    cache_shard_t *shard;                                                      \
     meta_data_t *meta;                                                         \
     int status;                                                                \
-    meta = uc_get_meta(vl);                                                    \
+    meta = uc_get_meta(vl, &shard);                                            \
     if (meta == NULL)                                                          \
       return -1;                                                               \
     status = wrap_function(meta, key, value);                                  \
-    pthread_mutex_unlock(&cache_lock);                                         \
+    pthread_mutex_unlock(&shard->lock);                                        \
     return status;                                                             \
   }
         int uc_meta_data_add_string(const value_list_t *vl, const char *key,
@@ -36,9 +36,30 @@
 #define STATE_ERROR 2
 #define STATE_MISSING 15
 
+/* Statistics of the limits configured with the "CacheMemoryLimit",
+ * "CacheMaxSeriesPerPlugin" and "CacheMaxSeriesPerHost" options. */
+typedef struct {
+  size_t memory; /* bytes used by the cache, not counting meta data */
+  uint64_t evicted;
+  uint64_t rejected_memory;
+  uint64_t rejected_plugin;
+  uint64_t rejected_host;
+} uc_stats_t;
+
 int uc_init(void);
 int uc_check_timeout(void);
+/* Writes the cache to the file set with the "CacheFile" option, if any.
+ * uc_init() restores it. */
+int uc_save(void);
+/* Returns ENOSPC if the value list is a new series which has been rejected
+ * because of the cache limits. */
 int uc_update(const data_set_t *ds, const value_list_t *vl);
+/* Like uc_update(). Additionally returns the number of consecutive updates,
+ * including this one, which did not change the values of the series. */
+int uc_update_unchanged(const data_set_t *ds, const value_list_t *vl,
+                        uint64_t *ret_unchanged);
+/* The following functions, as well as uc_get_state(), don't lock the cache
+ * unless they repeatedly race with updates of the same shard. */
 int uc_get_rate_by_name(const char *name, gauge_t **ret_values,
                         size_t *ret_values_num);
 gauge_t *uc_get_rate(const data_set_t *ds, const value_list_t *vl);
@@ -46,6 +67,7 @@ int uc_get_value_by_name(const char *name, value_t **ret_values, size_t *ret_val
 value_t *uc_get_value(const data_set_t *ds, const value_list_t *vl);
 
 size_t uc_get_size(void);
+void uc_get_stats(uc_stats_t *ret_stats);
 int uc_get_names(char ***ret_names, cdtime_t **ret_times, size_t *ret_number);
 
 int uc_get_state(const data_set_t *ds, const value_list_t *vl);
@@ -59,6 +81,47 @@ int uc_get_history(const data_set_t *ds, const value_list_t *vl,
 int uc_get_history_by_name(const char *name, gauge_t *ret_history,
                            size_t num_steps, size_t num_ds);
 
+/*
+ * Snapshot interface
+ *
+ * A snapshot is a consistent view of the cache at the time it was created.
+ * Iterating over it neither copies the cache nor blocks updates: only one
+ * shard is locked at a time, entries added later are skipped and entries
+ * removed later are kept until the snapshot is destroyed. Entries are returned
+ * in no particular order, including those in the STATE_MISSING state.
+ */
+struct uc_snapshot_s;
+typedef struct uc_snapshot_s uc_snapshot_t;
+
+uc_snapshot_t *uc_snapshot_create(void);
+/* Returns the number of entries in the snapshot. */
+size_t uc_snapshot_size(uc_snapshot_t const *snapshot);
+/* Returns the next entry. "ret_name" stays valid until the snapshot is
+ * destroyed. All return pointers are optional. Returns ENOENT at the end. */
+int uc_snapshot_next(uc_snapshot_t *snapshot, const char **ret_name,
+                     cdtime_t *ret_time, int *ret_state);
+/* Restarts the iteration. The entries are returned in the same order again. */
+void uc_snapshot_rewind(uc_snapshot_t *snapshot);
+void uc_snapshot_destroy(uc_snapshot_t *snapshot);
+
+/*
+ * Query interface
+ *
+ * A query returns the entries whose identifier fields match the shell wildcard
+ * patterns (see fnmatch(3)) in the fields of "match". If the host or plugin is
+ * a literal, only the entries of that host or plugin are visited, using an
+ * index maintained by the cache. Otherwise the query iterates over a snapshot
+ * of the cache. No more than one shard is locked at a time.
+ */
+struct uc_query_s;
+typedef struct uc_query_s uc_query_t;
+
+uc_query_t *uc_query_create(value_list_t const *match);
+/* Returns the next matching entry in "vl". The values and meta data are
+ * copies owned by the caller. Returns ENOENT at the end. */
+int uc_query_next(uc_query_t *q, value_list_t *vl);
+void uc_query_destroy(uc_query_t *q);
+
 /*
  * Iterator interface
  */
@@ -109,6 +172,34 @@ int uc_iterator_get_interval(uc_iter_t *iter, cdtime_t *ret_interval);
 /* Return the metadata for the value at the current position. */
 int uc_iterator_get_meta(uc_iter_t *iter, meta_data_t **ret_meta);
 
+/*
+ * Memoization interface
+ *
+ * Opaque per-entry storage used by the filter chains to remember match
+ * results. Data stored with a different `generation' reads as zero bytes, so
+ * bumping the generation invalidates all entries at once.
+ */
+/* Copies `buffer_size' bytes at `offset' into `buffer'; bytes never set are
+ * zero. Returns ENOENT if there's no entry for `identity'. */
+int uc_memo_get(value_list_identity_t const *identity, uint64_t generation,
+                size_t offset, uint8_t *buffer, size_t buffer_size);
+int uc_memo_set(value_list_identity_t const *identity, uint64_t generation,
+                size_t offset, uint8_t const *buffer, size_t buffer_size);
+
+/*
+ * Threshold interface
+ *
+ * Remembers the result of threshold_search() per entry, including "no
+ * threshold", i.e. NULL. A result stored with a different `generation' is not
+ * returned.
+ */
+/* Returns ENOENT if there's no entry for `identity' or no result of
+ * `generation'. */
+int uc_threshold_get(value_list_identity_t const *identity, uint64_t generation,
+                     void **ret_threshold);
+int uc_threshold_set(value_list_identity_t const *identity, uint64_t generation,
+                     void *threshold);
+
 /*
  * Meta data interface
  */
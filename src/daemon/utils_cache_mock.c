@@ -41,3 +41,33 @@ int uc_get_rate_by_name(const char *name, gauge_t **ret_values,
 int uc_get_names(char ***ret_names, cdtime_t **ret_times, size_t *ret_number) {
   return ENOTSUP;
 }
+
+uc_snapshot_t *uc_snapshot_create(void) {
+  errno = ENOTSUP;
+  return NULL;
+}
+
+size_t uc_snapshot_size(__attribute__((unused)) uc_snapshot_t const *snapshot) {
+  return 0;
+}
+
+int uc_snapshot_next(uc_snapshot_t *snapshot, const char **ret_name,
+                     cdtime_t *ret_time, int *ret_state) {
+  return ENOENT;
+}
+
+void uc_snapshot_rewind(__attribute__((unused)) uc_snapshot_t *snapshot) {}
+
+void uc_snapshot_destroy(__attribute__((unused)) uc_snapshot_t *snapshot) {}
+
+uc_query_t *uc_query_create(__attribute__((unused)) value_list_t const *match) {
+  errno = ENOTSUP;
+  return NULL;
+}
+
+int uc_query_next(__attribute__((unused)) uc_query_t *q,
+                  __attribute__((unused)) value_list_t *vl) {
+  return ENOENT;
+}
+
+void uc_query_destroy(__attribute__((unused)) uc_query_t *q) {}
@@ -0,0 +1,324 @@
+/**
+ * collectd - src/daemon/utils_downsample.c
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "common.h"
+#include "utils_avltree.h"
+#include "utils_downsample.h"
+
+/* One series. "vl" holds the identifier, the metadata of the first value of
+ * the current window, and the last values, which are used for counters and
+ * derives. "acc" holds the consolidated gauges and the sums of absolute
+ * values; "num" counts the gauges that were not NaN. */
+typedef struct {
+  char *name;
+  const data_set_t *ds;
+  value_list_t vl;
+  value_t *acc;
+  size_t *num;
+  cdtime_t window_end;
+} downsample_entry_t;
+
+struct downsample_s {
+  pthread_mutex_t lock;
+  c_avl_tree_t *entries;
+  cdtime_t window;
+  int function;
+  cdtime_t next_expire;
+};
+
+static void downsample_entry_free(downsample_entry_t *e) /* {{{ */
+{
+  if (e == NULL)
+    return;
+
+  meta_data_destroy(e->vl.meta);
+  sfree(e->vl.values);
+  sfree(e->acc);
+  sfree(e->num);
+  sfree(e->name);
+  sfree(e);
+} /* }}} void downsample_entry_free */
+
+/* Starts a new window with "vl". */
+static int downsample_entry_start(downsample_t *d, /* {{{ */
+                                  downsample_entry_t *e, const data_set_t *ds,
+                                  const value_list_t *vl) {
+  if ((e->vl.values == NULL) || (e->vl.values_len != vl->values_len)) {
+    sfree(e->vl.values);
+    sfree(e->acc);
+    sfree(e->num);
+    e->vl.values = calloc(vl->values_len, sizeof(*e->vl.values));
+    e->acc = calloc(vl->values_len, sizeof(*e->acc));
+    e->num = calloc(vl->values_len, sizeof(*e->num));
+    if ((e->vl.values == NULL) || (e->acc == NULL) || (e->num == NULL))
+      return ENOMEM;
+  }
+
+  meta_data_destroy(e->vl.meta);
+  value_t *values = e->vl.values;
+  e->vl = *vl;
+  e->vl.values = values;
+  e->vl.meta = meta_data_clone(vl->meta);
+  VALUE_LIST_IDENTITY_INVALIDATE(&e->vl);
+  e->vl.shared_owner = NULL;
+  e->ds = ds;
+  e->window_end = vl->time - (vl->time % d->window) + d->window;
+
+  memcpy(e->vl.values, vl->values, vl->values_len * sizeof(*vl->values));
+  for (size_t i = 0; i < vl->values_len; i++) {
+    e->acc[i] = vl->values[i];
+    e->num[i] = 1;
+    if ((ds->ds[i].type == DS_TYPE_GAUGE) && isnan(vl->values[i].gauge))
+      e->num[i] = 0;
+  }
+
+  return 0;
+} /* }}} int downsample_entry_start */
+
+static void downsample_entry_add(downsample_t *d, /* {{{ */
+                                 downsample_entry_t *e,
+                                 const value_list_t *vl) {
+  for (size_t i = 0; i < vl->values_len; i++) {
+    value_t v = vl->values[i];
+
+    e->vl.values[i] = v;
+    if (e->ds->ds[i].type == DS_TYPE_ABSOLUTE) {
+      e->acc[i].absolute += v.absolute;
+      continue;
+    } else if ((e->ds->ds[i].type != DS_TYPE_GAUGE) || isnan(v.gauge)) {
+      continue;
+    }
+
+    if (e->num[i] == 0) {
+      e->acc[i] = v;
+    } else {
+      switch (d->function) {
+      case DOWNSAMPLE_AVERAGE:
+        e->acc[i].gauge += v.gauge;
+        break;
+      case DOWNSAMPLE_MINIMUM:
+        if (v.gauge < e->acc[i].gauge)
+          e->acc[i] = v;
+        break;
+      case DOWNSAMPLE_MAXIMUM:
+        if (v.gauge > e->acc[i].gauge)
+          e->acc[i] = v;
+        break;
+      default: /* DOWNSAMPLE_LAST */
+        e->acc[i] = v;
+      }
+    }
+    e->num[i]++;
+  }
+  e->vl.time = vl->time;
+} /* }}} void downsample_entry_add */
+
+/* Returns the consolidated value list of the current window. */
+static value_list_t *downsample_entry_emit(downsample_t *d, /* {{{ */
+                                           downsample_entry_t *e) {
+  value_list_t *vl = calloc(1, sizeof(*vl));
+  if (vl == NULL)
+    return NULL;
+
+  *vl = e->vl;
+  vl->values = calloc(e->vl.values_len, sizeof(*vl->values));
+  if (vl->values == NULL) {
+    sfree(vl);
+    return NULL;
+  }
+  /* The metadata is handed over, the next window gets its own copy. */
+  e->vl.meta = NULL;
+  vl->interval = d->window;
+
+  for (size_t i = 0; i < vl->values_len; i++) {
+    switch (e->ds->ds[i].type) {
+    case DS_TYPE_GAUGE:
+      if (e->num[i] == 0)
+        vl->values[i].gauge = NAN;
+      else if (d->function == DOWNSAMPLE_AVERAGE)
+        vl->values[i].gauge = e->acc[i].gauge / (gauge_t)e->num[i];
+      else
+        vl->values[i] = e->acc[i];
+      break;
+    case DS_TYPE_ABSOLUTE:
+      vl->values[i] = e->acc[i];
+      break;
+    default:
+      vl->values[i] = e->vl.values[i];
+    }
+  }
+
+  return vl;
+} /* }}} value_list_t *downsample_entry_emit */
+
+downsample_t *downsample_create(cdtime_t window, int function) /* {{{ */
+{
+  if ((window == 0) || (function < DOWNSAMPLE_AVERAGE) ||
+      (function > DOWNSAMPLE_LAST))
+    return NULL;
+
+  downsample_t *d = calloc(1, sizeof(*d));
+  if (d == NULL)
+    return NULL;
+
+  d->entries = c_avl_create((int (*)(const void *, const void *))strcmp);
+  if (d->entries == NULL) {
+    sfree(d);
+    return NULL;
+  }
+  pthread_mutex_init(&d->lock, /* attr = */ NULL);
+  d->window = window;
+  d->function = function;
+
+  return d;
+} /* }}} downsample_t *downsample_create */
+
+void downsample_destroy(downsample_t *d) /* {{{ */
+{
+  if (d == NULL)
+    return;
+
+  char *name;
+  downsample_entry_t *e;
+  while (c_avl_pick(d->entries, (void *)&name, (void *)&e) == 0)
+    downsample_entry_free(e);
+  c_avl_destroy(d->entries);
+  pthread_mutex_destroy(&d->lock);
+  sfree(d);
+} /* }}} void downsample_destroy */
+
+int downsample_update(downsample_t *d, const data_set_t *ds, /* {{{ */
+                      const value_list_t *vl, value_list_t **ret_vl) {
+  if ((d == NULL) || (ds == NULL) || (vl == NULL) || (ret_vl == NULL) ||
+      (ds->ds_num != vl->values_len))
+    return EINVAL;
+
+  *ret_vl = NULL;
+
+  char buffer[6 * DATA_MAX_NAME_LEN];
+  char const *name;
+  value_list_identity_t const *identity = VALUE_LIST_IDENTITY(vl);
+  if (identity != NULL) {
+    name = identity->name;
+  } else {
+    if (FORMAT_VL(buffer, sizeof(buffer), vl) != 0)
+      return EINVAL;
+    name = buffer;
+  }
+
+  pthread_mutex_lock(&d->lock);
+
+  downsample_entry_t *e = NULL;
+  if (c_avl_get(d->entries, name, (void *)&e) != 0) {
+    e = calloc(1, sizeof(*e));
+    if ((e == NULL) || ((e->name = strdup(name)) == NULL) ||
+        (downsample_entry_start(d, e, ds, vl) != 0) ||
+        (c_avl_insert(d->entries, e->name, e) != 0)) {
+      pthread_mutex_unlock(&d->lock);
+      downsample_entry_free(e);
+      return ENOMEM;
+    }
+    pthread_mutex_unlock(&d->lock);
+    return 0;
+  }
+
+  int status = 0;
+  if ((vl->time >= e->window_end) || (e->ds != ds) ||
+      (e->vl.values_len != vl->values_len)) {
+    *ret_vl = downsample_entry_emit(d, e);
+    status = downsample_entry_start(d, e, ds, vl);
+    if (status != 0) {
+      /* Leave no half-initialized entry behind. */
+      c_avl_remove(d->entries, name, NULL, NULL);
+      downsample_entry_free(e);
+    }
+  } else {
+    downsample_entry_add(d, e, vl);
+  }
+
+  pthread_mutex_unlock(&d->lock);
+  return status;
+} /* }}} int downsample_update */
+
+int downsample_expire(downsample_t *d, cdtime_t now, /* {{{ */
+                      downsample_emit_cb emit, void *user_data) {
+  if ((d == NULL) || (emit == NULL))
+    return 0;
+
+  pthread_mutex_lock(&d->lock);
+  if ((now != 0) && (now < d->next_expire)) {
+    pthread_mutex_unlock(&d->lock);
+    return 0;
+  }
+  d->next_expire = now + d->window;
+
+  downsample_entry_t **expired = NULL;
+  size_t expired_num = 0;
+
+  c_avl_iterator_t *iter = c_avl_get_iterator(d->entries);
+  char *name;
+  downsample_entry_t *e;
+  while (c_avl_iterator_next(iter, (void *)&name, (void *)&e) == 0) {
+    if ((now != 0) && (e->vl.time + 2 * d->window >= now))
+      continue;
+
+    downsample_entry_t **tmp =
+        realloc(expired, (expired_num + 1) * sizeof(*expired));
+    if (tmp == NULL)
+      break;
+    expired = tmp;
+    expired[expired_num] = e;
+    expired_num++;
+  }
+  c_avl_iterator_destroy(iter);
+
+  for (size_t i = 0; i < expired_num; i++)
+    c_avl_remove(d->entries, expired[i]->name, NULL, NULL);
+  pthread_mutex_unlock(&d->lock);
+
+  int emitted = 0;
+  for (size_t i = 0; i < expired_num; i++) {
+    value_list_t *vl = downsample_entry_emit(d, expired[i]);
+    if (vl != NULL) {
+      (*emit)(expired[i]->ds, vl, user_data);
+      downsample_value_list_free(vl);
+      emitted++;
+    }
+    downsample_entry_free(expired[i]);
+  }
+  sfree(expired);
+
+  return emitted;
+} /* }}} int downsample_expire */
+
+void downsample_value_list_free(value_list_t *vl) /* {{{ */
+{
+  if (vl == NULL)
+    return;
+
+  meta_data_destroy(vl->meta);
+  sfree(vl->values);
+  sfree(vl);
+} /* }}} void downsample_value_list_free */
@@ -0,0 +1,102 @@
+/**
+ * collectd - src/daemon/utils_downsample.h
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef UTILS_DOWNSAMPLE_H
+#define UTILS_DOWNSAMPLE_H 1
+
+#include "plugin.h"
+
+#define DOWNSAMPLE_AVERAGE 0
+#define DOWNSAMPLE_MINIMUM 1
+#define DOWNSAMPLE_MAXIMUM 2
+#define DOWNSAMPLE_LAST 3
+
+struct downsample_s;
+typedef struct downsample_s downsample_t;
+
+typedef int (*downsample_emit_cb)(const data_set_t *ds, const value_list_t *vl,
+                                  void *user_data);
+
+/*
+ * NAME
+ *   downsample_create
+ *
+ * DESCRIPTION
+ *   Allocates the state needed to consolidate the values of each series over
+ *   windows of `window' length. Windows are aligned to multiples of `window'.
+ *   Gauges are consolidated with `function', one of the DOWNSAMPLE_*
+ *   constants. Counters and derives always keep the last value, so that
+ *   rates stay correct, and absolute values are summed up.
+ *
+ * RETURN VALUE
+ *   A downsample_t-pointer upon success or NULL upon failure.
+ */
+downsample_t *downsample_create(cdtime_t window, int function);
+
+/*
+ * NAME
+ *   downsample_destroy
+ *
+ * DESCRIPTION
+ *   Frees the state. Windows which have not been emitted are lost; use
+ *   downsample_expire() with `now' set to zero first to emit them.
+ */
+void downsample_destroy(downsample_t *d);
+
+/*
+ * NAME
+ *   downsample_update
+ *
+ * DESCRIPTION
+ *   Adds `vl' to the current window of its series. If `vl' belongs to a later
+ *   window, the current window is complete: its consolidated value list is
+ *   returned in `ret_vl' and `vl' starts the next window. Otherwise `ret_vl'
+ *   is set to NULL. A returned value list has to be freed with
+ *   downsample_value_list_free(). Thread-safe.
+ *
+ * RETURN VALUE
+ *   Zero upon success or an errno value upon failure.
+ */
+int downsample_update(downsample_t *d, const data_set_t *ds,
+                      const value_list_t *vl, value_list_t **ret_vl);
+
+/*
+ * NAME
+ *   downsample_expire
+ *
+ * DESCRIPTION
+ *   Emits the pending windows of series which have not been updated for two
+ *   windows and forgets about these series. The check is done at most once
+ *   per window, so this is cheap enough to be called for every value. If
+ *   `now' is zero, all pending windows are emitted. `emit' is called without
+ *   any lock held.
+ *
+ * RETURN VALUE
+ *   The number of emitted value lists.
+ */
+int downsample_expire(downsample_t *d, cdtime_t now, downsample_emit_cb emit,
+                      void *user_data);
+
+void downsample_value_list_free(value_list_t *vl);
+
+#endif /* UTILS_DOWNSAMPLE_H */
@@ -0,0 +1,147 @@
+/**
+ * collectd - src/daemon/utils_downsample_test.c
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "common.h"
+#include "testing.h"
+#include "utils_downsample.h"
+
+static data_source_t test_dsrc[] = {
+    {"gauge", DS_TYPE_GAUGE, NAN, NAN},
+    {"derive", DS_TYPE_DERIVE, 0, NAN},
+    {"absolute", DS_TYPE_ABSOLUTE, 0, NAN},
+};
+static data_set_t test_ds = {"test", STATIC_ARRAY_SIZE(test_dsrc), test_dsrc};
+
+static int test_update(downsample_t *d, char const *host, double t,
+                       gauge_t g, derive_t der, absolute_t abs,
+                       value_list_t **ret_vl) {
+  value_t values[] = {{.gauge = g}, {.derive = der}, {.absolute = abs}};
+  value_list_t vl = {
+      .values = values,
+      .values_len = STATIC_ARRAY_SIZE(values),
+      .time = DOUBLE_TO_CDTIME_T(t),
+      .interval = TIME_T_TO_CDTIME_T(1),
+  };
+  sstrncpy(vl.host, host, sizeof(vl.host));
+  sstrncpy(vl.plugin, "test", sizeof(vl.plugin));
+  sstrncpy(vl.type, "test", sizeof(vl.type));
+
+  return downsample_update(d, &test_ds, &vl, ret_vl);
+}
+
+DEF_TEST(functions) {
+  struct {
+    int function;
+    gauge_t want;
+  } cases[] = {
+      {DOWNSAMPLE_AVERAGE, 3.0},
+      {DOWNSAMPLE_MINIMUM, 1.0},
+      {DOWNSAMPLE_MAXIMUM, 6.0},
+      {DOWNSAMPLE_LAST, 2.0},
+  };
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(cases); i++) {
+    downsample_t *d;
+    value_list_t *vl = NULL;
+    gauge_t gauges[] = {1.0, 6.0, NAN, 2.0};
+
+    CHECK_NOT_NULL(d = downsample_create(TIME_T_TO_CDTIME_T(10),
+                                         cases[i].function));
+
+    /* One window, [10, 20). NaNs are skipped. */
+    for (size_t j = 0; j < STATIC_ARRAY_SIZE(gauges); j++) {
+      CHECK_ZERO(test_update(d, "host", 11.0 + (double)j, gauges[j],
+                             (derive_t)(100 * j), 5, &vl));
+      OK(vl == NULL);
+    }
+
+    /* The first value of the next window completes it. */
+    CHECK_ZERO(test_update(d, "host", 21.0, 7.0, 400, 5, &vl));
+    CHECK_NOT_NULL(vl);
+    EXPECT_EQ_DOUBLE(cases[i].want, vl->values[0].gauge);
+    EXPECT_EQ_INT(300, (int)vl->values[1].derive);
+    EXPECT_EQ_INT(20, (int)vl->values[2].absolute);
+    EXPECT_EQ_DOUBLE(14.0, CDTIME_T_TO_DOUBLE(vl->time));
+    EXPECT_EQ_DOUBLE(10.0, CDTIME_T_TO_DOUBLE(vl->interval));
+    EXPECT_EQ_STR("host", vl->host);
+    downsample_value_list_free(vl);
+
+    downsample_destroy(d);
+  }
+
+  return 0;
+}
+
+static int test_emit(const data_set_t *ds, const value_list_t *vl,
+                     void *user_data) {
+  int *count = user_data;
+
+  EXPECT_EQ_DOUBLE(4.0, vl->values[0].gauge);
+  (*count)++;
+  return 0;
+}
+
+DEF_TEST(expire) {
+  downsample_t *d;
+  value_list_t *vl = NULL;
+  int count = 0;
+
+  CHECK_NOT_NULL(d = downsample_create(TIME_T_TO_CDTIME_T(10),
+                                       DOWNSAMPLE_AVERAGE));
+
+  CHECK_ZERO(test_update(d, "idle", 11.0, 4.0, 0, 0, &vl));
+  CHECK_ZERO(test_update(d, "busy", 11.0, 4.0, 0, 0, &vl));
+  CHECK_ZERO(test_update(d, "busy", 45.0, 4.0, 0, 0, &vl));
+  CHECK_NOT_NULL(vl);
+  downsample_value_list_free(vl);
+
+  /* "idle" has not been updated for more than two windows. */
+  EXPECT_EQ_INT(1, downsample_expire(d, TIME_T_TO_CDTIME_T(45), test_emit,
+                                     &count));
+  EXPECT_EQ_INT(1, count);
+
+  /* "idle" starts over. Expiry is checked at most once per window. */
+  CHECK_ZERO(test_update(d, "idle", 46.0, 4.0, 0, 0, &vl));
+  OK(vl == NULL);
+  EXPECT_EQ_INT(0, downsample_expire(d, TIME_T_TO_CDTIME_T(54), test_emit,
+                                     &count));
+  EXPECT_EQ_INT(0, downsample_expire(d, TIME_T_TO_CDTIME_T(55), test_emit,
+                                     &count));
+
+  /* Zero emits all pending windows. */
+  EXPECT_EQ_INT(2, downsample_expire(d, 0, test_emit, &count));
+  EXPECT_EQ_INT(3, count);
+  EXPECT_EQ_INT(0, downsample_expire(d, 0, test_emit, &count));
+
+  downsample_destroy(d);
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(functions);
+  RUN_TEST(expire);
+
+  END_TEST;
+}
@@ -0,0 +1,223 @@
+/**
+ * collectd - src/daemon/utils_fdstore.c
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "common.h"
+#include "plugin.h"
+#include "utils_fdstore.h"
+
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/* Replies from collectdmon are expected immediately; the timeout only
+ * protects against a monitor that went away. */
+#define FDSTORE_TIMEOUT_SEC 5
+
+static pthread_mutex_t fdstore_lock = PTHREAD_MUTEX_INITIALIZER;
+static int fdstore_fd = -2; /* -2: not yet looked up, -1: not available */
+
+static int fdstore_ctl(void) /* {{{ */
+{
+  if (fdstore_fd != -2)
+    return fdstore_fd;
+
+  fdstore_fd = -1;
+
+  char const *env = getenv(FDSTORE_ENV);
+  if ((env == NULL) || (env[0] == 0))
+    return -1;
+
+  char *endptr = NULL;
+  errno = 0;
+  long fd = strtol(env, &endptr, 10);
+  if ((errno != 0) || (endptr == env) || (*endptr != 0) || (fd < 0) ||
+      (fd > INT_MAX)) {
+    WARNING("fdstore: Ignoring invalid %s=\"%s\".", FDSTORE_ENV, env);
+    return -1;
+  }
+
+  int type = 0;
+  socklen_t type_len = sizeof(type);
+  if ((getsockopt((int)fd, SOL_SOCKET, SO_TYPE, &type, &type_len) != 0) ||
+      (type != SOCK_SEQPACKET)) {
+    WARNING("fdstore: %s=%ld is not a control socket.", FDSTORE_ENV, fd);
+    return -1;
+  }
+
+  /* Don't leak the control socket into processes started by plugins. */
+  fcntl((int)fd, F_SETFD, fcntl((int)fd, F_GETFD) | FD_CLOEXEC);
+
+  struct timeval tv = {.tv_sec = FDSTORE_TIMEOUT_SEC};
+  setsockopt((int)fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  setsockopt((int)fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+  fdstore_fd = (int)fd;
+  INFO("fdstore: Listening sockets are kept open across restarts.");
+  return fdstore_fd;
+} /* }}} int fdstore_ctl */
+
+/* Sends a command, with `fd' attached unless it is negative. */
+static int fdstore_send(int ctl, char cmd, char const *name, /* {{{ */
+                        int fd) {
+  char buffer[FDSTORE_NAME_MAX + 1];
+  size_t name_len = strlen(name);
+
+  if ((name_len == 0) || (name_len >= FDSTORE_NAME_MAX))
+    return EINVAL;
+
+  buffer[0] = cmd;
+  memcpy(buffer + 1, name, name_len);
+
+  struct iovec iov = {.iov_base = buffer, .iov_len = name_len + 1};
+  union {
+    struct cmsghdr hdr;
+    char buf[CMSG_SPACE(sizeof(int))];
+  } control = {{0}};
+  struct msghdr msg = {.msg_iov = &iov, .msg_iovlen = 1};
+
+  if (fd >= 0) {
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+  }
+
+  if (sendmsg(ctl, &msg, 0) < 0)
+    return errno;
+  return 0;
+} /* }}} int fdstore_send */
+
+_Bool fdstore_enabled(void) /* {{{ */
+{
+  pthread_mutex_lock(&fdstore_lock);
+  int ctl = fdstore_ctl();
+  pthread_mutex_unlock(&fdstore_lock);
+
+  return ctl >= 0;
+} /* }}} _Bool fdstore_enabled */
+
+int fdstore_get(char const *name) /* {{{ */
+{
+  if (name == NULL)
+    return -1;
+
+  pthread_mutex_lock(&fdstore_lock);
+
+  int ctl = fdstore_ctl();
+  if (ctl < 0) {
+    pthread_mutex_unlock(&fdstore_lock);
+    return -1;
+  }
+
+  int status = fdstore_send(ctl, FDSTORE_CMD_GET, name, -1);
+  if (status != 0) {
+    pthread_mutex_unlock(&fdstore_lock);
+    ERROR("fdstore: Requesting \"%s\" failed: %s", name, STRERROR(status));
+    return -1;
+  }
+
+  char reply;
+  struct iovec iov = {.iov_base = &reply, .iov_len = sizeof(reply)};
+  union {
+    struct cmsghdr hdr;
+    char buf[CMSG_SPACE(sizeof(int))];
+  } control = {{0}};
+  struct msghdr msg = {.msg_iov = &iov,
+                       .msg_iovlen = 1,
+                       .msg_control = control.buf,
+                       .msg_controllen = sizeof(control.buf)};
+
+  ssize_t len = recvmsg(ctl, &msg, 0);
+  if (len <= 0) {
+    status = (len < 0) ? errno : ECONNRESET;
+    pthread_mutex_unlock(&fdstore_lock);
+    ERROR("fdstore: Receiving \"%s\" failed: %s", name, STRERROR(status));
+    return -1;
+  }
+  pthread_mutex_unlock(&fdstore_lock);
+
+  int fd = -1;
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  if ((cmsg != NULL) && (cmsg->cmsg_level == SOL_SOCKET) &&
+      (cmsg->cmsg_type == SCM_RIGHTS) &&
+      (cmsg->cmsg_len == CMSG_LEN(sizeof(int))))
+    memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+
+  if ((reply != '1') || (fd < 0)) {
+    if (fd >= 0)
+      close(fd);
+    return -1;
+  }
+
+  fcntl(fd, F_SETFD, fcntl(fd, F_GETFD) | FD_CLOEXEC);
+  DEBUG("fdstore: Received \"%s\" as fd %d.", name, fd);
+  return fd;
+} /* }}} int fdstore_get */
+
+int fdstore_put(char const *name, int fd) /* {{{ */
+{
+  if ((name == NULL) || (fd < 0))
+    return EINVAL;
+
+  pthread_mutex_lock(&fdstore_lock);
+
+  int ctl = fdstore_ctl();
+  if (ctl < 0) {
+    pthread_mutex_unlock(&fdstore_lock);
+    return ENOTSUP;
+  }
+
+  int status = fdstore_send(ctl, FDSTORE_CMD_PUT, name, fd);
+  pthread_mutex_unlock(&fdstore_lock);
+
+  if (status != 0)
+    ERROR("fdstore: Storing \"%s\" failed: %s", name, STRERROR(status));
+  return status;
+} /* }}} int fdstore_put */
+
+int fdstore_socket_name(char *buffer, size_t buffer_size, /* {{{ */
+                        char const *prefix, struct addrinfo const *ai,
+                        size_t index) {
+  char host[NI_MAXHOST];
+  char service[NI_MAXSERV];
+
+  int status = getnameinfo(ai->ai_addr, ai->ai_addrlen, host, sizeof(host),
+                           service, sizeof(service),
+                           NI_NUMERICHOST | NI_NUMERICSERV);
+  if (status != 0)
+    return EINVAL;
+
+  status = snprintf(buffer, buffer_size, "%s/[%s]:%s/%s/%zu", prefix, host,
+                    service, (ai->ai_socktype == SOCK_STREAM) ? "tcp" : "udp",
+                    index);
+  if ((status < 0) || ((size_t)status >= buffer_size) ||
+      ((size_t)status >= FDSTORE_NAME_MAX))
+    return ENOMEM;
+  return 0;
+} /* }}} int fdstore_socket_name */
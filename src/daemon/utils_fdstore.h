@@ -0,0 +1,104 @@
+/**
+ * collectd - src/daemon/utils_fdstore.h
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef UTILS_FDSTORE_H
+#define UTILS_FDSTORE_H 1
+
+#include <stddef.h>
+
+struct addrinfo;
+
+/* Name of the environment variable through which collectdmon(1) passes the
+ * file descriptor of the store's control socket to the daemon. */
+#define FDSTORE_ENV "COLLECTD_FDSTORE"
+
+/* The control socket is a SOCK_SEQPACKET socket. Each request is a single
+ * message: a command character followed by the name of the descriptor.
+ *
+ *   'G' <name>         Get a descriptor. The reply is "1" with the
+ *                      descriptor attached or "0" if none is stored.
+ *   'P' <name> + fd    Put a descriptor. There is no reply.
+ */
+#define FDSTORE_CMD_GET 'G'
+#define FDSTORE_CMD_PUT 'P'
+#define FDSTORE_NAME_MAX 256
+
+/*
+ * NAME
+ *   fdstore_enabled
+ *
+ * DESCRIPTION
+ *   Returns true if the daemon runs under collectdmon(1) with socket
+ *   handoff enabled, i.e. if descriptors can be stored at all.
+ */
+_Bool fdstore_enabled(void);
+
+/*
+ * NAME
+ *   fdstore_get
+ *
+ * DESCRIPTION
+ *   Returns a new descriptor referring to the socket previously stored under
+ *   `name', typically by an earlier instance of the daemon. The socket is
+ *   still bound and datagrams received while no daemon was running are
+ *   waiting in its receive buffer. The caller owns the returned descriptor;
+ *   closing it does not close the stored copy.
+ *
+ * RETURN VALUE
+ *   A file descriptor or -1 if no descriptor is stored under this name or
+ *   the store is not available.
+ */
+int fdstore_get(char const *name);
+
+/*
+ * NAME
+ *   fdstore_put
+ *
+ * DESCRIPTION
+ *   Hands a copy of `fd' to the store, so that it is kept open while the
+ *   daemon is being restarted. Descriptors that were not requested or put
+ *   by a daemon instance are closed by the store once that instance exits.
+ *   It is not an error to put a descriptor that has been received with
+ *   `fdstore_get'.
+ *
+ * RETURN VALUE
+ *   Zero on success, an errno value otherwise.
+ */
+int fdstore_put(char const *name, int fd);
+
+/*
+ * NAME
+ *   fdstore_socket_name
+ *
+ * DESCRIPTION
+ *   Formats a name identifying a listening socket, made up of `prefix', the
+ *   numeric address and port of `ai', the socket type and `index'. The index
+ *   distinguishes several sockets bound to the same address.
+ *
+ * RETURN VALUE
+ *   Zero on success, an errno value otherwise.
+ */
+int fdstore_socket_name(char *buffer, size_t buffer_size, char const *prefix,
+                        struct addrinfo const *ai, size_t index);
+
+#endif /* UTILS_FDSTORE_H */
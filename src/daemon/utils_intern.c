@@ -0,0 +1,290 @@
+/**
+ * collectd - src/daemon/utils_intern.c
+ * Copyright (C) 2026       collectd contributors
+ *
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "utils_intern.h"
+
+#include <pthread.h>
+
+#ifndef C_INTERN_INITIAL_SIZE
+#define C_INTERN_INITIAL_SIZE 64
+#endif
+
+/* Readers traverse the table without a lock. Nodes are only ever added at the
+ * head of a chain, and the bucket array is replaced as a whole when it grows,
+ * so a reader sees either the old or the new state. Publishing a pointer
+ * needs release semantics, reading it acquire semantics. If the compiler
+ * doesn't provide the atomic builtins, readers take the lock, too. */
+#if defined(__ATOMIC_ACQUIRE) && defined(__ATOMIC_RELEASE)
+#define C_INTERN_LOAD(ptr) __atomic_load_n(&(ptr), __ATOMIC_ACQUIRE)
+#define C_INTERN_STORE(ptr, val)                                               \
+  __atomic_store_n(&(ptr), (val), __ATOMIC_RELEASE)
+#define C_INTERN_LOCK_FREE 1
+#else
+#define C_INTERN_LOAD(ptr) (ptr)
+#define C_INTERN_STORE(ptr, val) ((ptr) = (val))
+#define C_INTERN_LOCK_FREE 0
+#endif
+
+struct c_intern_node_s;
+typedef struct c_intern_node_s c_intern_node_t;
+struct c_intern_node_s {
+  c_intern_node_t *next;
+  uint64_t hash;
+  char *str; /* shared by the nodes of old bucket arrays */
+};
+
+struct c_intern_buckets_s;
+typedef struct c_intern_buckets_s c_intern_buckets_t;
+struct c_intern_buckets_s {
+  c_intern_node_t **heads;
+  size_t size; /* power of two */
+  /* Bucket arrays which have been replaced may still be in use by readers.
+   * They are kept until the table is destroyed. */
+  c_intern_buckets_t *retired;
+};
+
+struct c_intern_s {
+  pthread_mutex_t lock; /* serializes writers */
+  _Bool ignore_case;
+  c_intern_buckets_t *buckets;
+  size_t num;
+};
+
+/* FNV-1a */
+static uint64_t c_intern_hash(c_intern_t const *t, char const *str) /* {{{ */
+{
+  uint64_t hash = 14695981039346656037ULL;
+
+  for (unsigned char const *ptr = (unsigned char const *)str; *ptr != 0;
+       ptr++) {
+    hash ^= t->ignore_case ? (uint64_t)tolower(*ptr) : (uint64_t)*ptr;
+    hash *= 1099511628211ULL;
+  }
+
+  return hash;
+} /* }}} uint64_t c_intern_hash */
+
+static c_intern_buckets_t *c_intern_buckets_create(size_t size) /* {{{ */
+{
+  c_intern_buckets_t *b = calloc(1, sizeof(*b));
+  if (b == NULL)
+    return NULL;
+
+  b->heads = calloc(size, sizeof(*b->heads));
+  if (b->heads == NULL) {
+    free(b);
+    return NULL;
+  }
+  b->size = size;
+
+  return b;
+} /* }}} c_intern_buckets_t *c_intern_buckets_create */
+
+static char const *c_intern_search(c_intern_t *t, /* {{{ */
+                                   char const *str, uint64_t hash) {
+  c_intern_buckets_t *b = C_INTERN_LOAD(t->buckets);
+
+  for (c_intern_node_t *n = C_INTERN_LOAD(b->heads[hash & (b->size - 1)]);
+       n != NULL; n = C_INTERN_LOAD(n->next)) {
+    if (n->hash != hash)
+      continue;
+    if ((t->ignore_case ? strcasecmp(str, n->str) : strcmp(str, n->str)) == 0)
+      return n->str;
+  }
+
+  return NULL;
+} /* }}} char const *c_intern_search */
+
+/* Replaces the bucket array with one twice the size. The nodes are copied, so
+ * readers of the old array are not disturbed. `t->lock' must be held. */
+static int c_intern_grow(c_intern_t *t) /* {{{ */
+{
+  c_intern_buckets_t *old = t->buckets;
+  c_intern_buckets_t *new = c_intern_buckets_create(2 * old->size);
+  if (new == NULL)
+    return ENOMEM;
+
+  for (size_t i = 0; i < old->size; i++) {
+    for (c_intern_node_t *n = old->heads[i]; n != NULL; n = n->next) {
+      c_intern_node_t *copy = malloc(sizeof(*copy));
+      if (copy == NULL) {
+        /* Keep using the old array. */
+        for (size_t j = 0; j < new->size; j++) {
+          while (new->heads[j] != NULL) {
+            c_intern_node_t *next = new->heads[j]->next;
+            free(new->heads[j]);
+            new->heads[j] = next;
+          }
+        }
+        free(new->heads);
+        free(new);
+        return ENOMEM;
+      }
+
+      *copy = *n;
+      copy->next = new->heads[n->hash & (new->size - 1)];
+      new->heads[n->hash & (new->size - 1)] = copy;
+    }
+  }
+
+  new->retired = old;
+  C_INTERN_STORE(t->buckets, new);
+  return 0;
+} /* }}} int c_intern_grow */
+
+c_intern_t *c_intern_create(_Bool ignore_case) /* {{{ */
+{
+  c_intern_t *t = calloc(1, sizeof(*t));
+  if (t == NULL)
+    return NULL;
+
+  t->buckets = c_intern_buckets_create(C_INTERN_INITIAL_SIZE);
+  if (t->buckets == NULL) {
+    free(t);
+    return NULL;
+  }
+
+  pthread_mutex_init(&t->lock, /* attr = */ NULL);
+  t->ignore_case = ignore_case;
+
+  return t;
+} /* }}} c_intern_t *c_intern_create */
+
+void c_intern_destroy(c_intern_t *t) /* {{{ */
+{
+  if (t == NULL)
+    return;
+
+  /* Only the current bucket array owns the strings. */
+  _Bool owner = 1;
+  c_intern_buckets_t *b = t->buckets;
+  while (b != NULL) {
+    c_intern_buckets_t *retired = b->retired;
+
+    for (size_t i = 0; i < b->size; i++) {
+      c_intern_node_t *n = b->heads[i];
+      while (n != NULL) {
+        c_intern_node_t *next = n->next;
+        if (owner)
+          free(n->str);
+        free(n);
+        n = next;
+      }
+    }
+    free(b->heads);
+    free(b);
+
+    b = retired;
+    owner = 0;
+  }
+
+  pthread_mutex_destroy(&t->lock);
+  free(t);
+} /* }}} void c_intern_destroy */
+
+char const *c_intern_find(c_intern_t *t, char const *str) /* {{{ */
+{
+  char const *ret;
+
+  if ((t == NULL) || (str == NULL))
+    return NULL;
+
+  uint64_t hash = c_intern_hash(t, str);
+
+#if C_INTERN_LOCK_FREE
+  ret = c_intern_search(t, str, hash);
+#else
+  pthread_mutex_lock(&t->lock);
+  ret = c_intern_search(t, str, hash);
+  pthread_mutex_unlock(&t->lock);
+#endif
+
+  return ret;
+} /* }}} char const *c_intern_find */
+
+char const *c_intern(c_intern_t *t, char const *str) /* {{{ */
+{
+  char const *ret;
+
+  if ((t == NULL) || (str == NULL))
+    return NULL;
+
+  uint64_t hash = c_intern_hash(t, str);
+
+#if C_INTERN_LOCK_FREE
+  ret = c_intern_search(t, str, hash);
+  if (ret != NULL)
+    return ret;
+#endif
+
+  pthread_mutex_lock(&t->lock);
+
+  /* Another thread may have added the string in the meantime. */
+  ret = c_intern_search(t, str, hash);
+  if (ret != NULL) {
+    pthread_mutex_unlock(&t->lock);
+    return ret;
+  }
+
+  if (t->num >= t->buckets->size)
+    c_intern_grow(t); /* on failure, the chains just get longer */
+
+  c_intern_node_t *n = malloc(sizeof(*n));
+  if (n == NULL) {
+    pthread_mutex_unlock(&t->lock);
+    return NULL;
+  }
+
+  n->hash = hash;
+  n->str = strdup(str);
+  if (n->str == NULL) {
+    free(n);
+    pthread_mutex_unlock(&t->lock);
+    return NULL;
+  }
+
+  c_intern_buckets_t *b = t->buckets;
+  n->next = b->heads[hash & (b->size - 1)];
+  C_INTERN_STORE(b->heads[hash & (b->size - 1)], n);
+  t->num++;
+
+  pthread_mutex_unlock(&t->lock);
+  return n->str;
+} /* }}} char const *c_intern */
+
+size_t c_intern_size(c_intern_t *t) /* {{{ */
+{
+  size_t num;
+
+  if (t == NULL)
+    return 0;
+
+  pthread_mutex_lock(&t->lock);
+  num = t->num;
+  pthread_mutex_unlock(&t->lock);
+
+  return num;
+} /* }}} size_t c_intern_size */
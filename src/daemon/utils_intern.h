@@ -0,0 +1,94 @@
+/**
+ * collectd - src/daemon/utils_intern.h
+ * Copyright (C) 2026       collectd contributors
+ *
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef UTILS_INTERN_H
+#define UTILS_INTERN_H 1
+
+#include <stddef.h>
+
+struct c_intern_s;
+typedef struct c_intern_s c_intern_t;
+
+/*
+ * NAME
+ *   c_intern_create
+ *
+ * DESCRIPTION
+ *   Allocates a new string interning table. Interning a string returns a
+ *   pointer to a copy owned by the table, and equal strings always return the
+ *   same pointer, so interned strings can be compared by comparing pointers.
+ *   Looking up strings doesn't take a lock, only adding new strings does.
+ *   Strings are never removed from the table, so it is meant for sets of
+ *   strings which don't grow without bounds, such as meta data keys.
+ *
+ * PARAMETERS
+ *   `ignore_case'  If true, strings which only differ in case are considered
+ *                  equal. Interning such a string returns the spelling that
+ *                  was interned first.
+ *
+ * RETURN VALUE
+ *   A c_intern_t-pointer upon success or NULL upon failure.
+ */
+c_intern_t *c_intern_create(_Bool ignore_case);
+
+/*
+ * NAME
+ *   c_intern_destroy
+ *
+ * DESCRIPTION
+ *   Frees the table and all interned strings. This must only be called when
+ *   no other thread uses the table or any of its strings any more.
+ */
+void c_intern_destroy(c_intern_t *t);
+
+/*
+ * NAME
+ *   c_intern
+ *
+ * DESCRIPTION
+ *   Returns the interned copy of `str', adding it to the table if required.
+ *   Returns NULL if `str' is NULL or memory could not be allocated.
+ */
+char const *c_intern(c_intern_t *t, char const *str);
+
+/*
+ * NAME
+ *   c_intern_find
+ *
+ * DESCRIPTION
+ *   Returns the interned copy of `str' or NULL if `str' hasn't been interned.
+ *   Never takes a lock or allocates memory.
+ */
+char const *c_intern_find(c_intern_t *t, char const *str);
+
+/*
+ * NAME
+ *   c_intern_size
+ *
+ * DESCRIPTION
+ *   Returns the number of strings in the table.
+ */
+size_t c_intern_size(c_intern_t *t);
+
+#endif /* UTILS_INTERN_H */
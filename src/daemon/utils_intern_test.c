@@ -0,0 +1,142 @@
+/**
+ * collectd - src/daemon/utils_intern_test.c
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "common.h"
+#include "testing.h"
+#include "utils_intern.h"
+
+#define TEST_THREADS 4
+#define TEST_STRINGS 1000
+
+DEF_TEST(simple) {
+  c_intern_t *t;
+  char buffer[32];
+  char const *foo;
+
+  CHECK_NOT_NULL(t = c_intern_create(/* ignore_case = */ 0));
+
+  OK(c_intern_find(t, "foo") == NULL);
+  OK((foo = c_intern(t, "foo")) != NULL);
+  EXPECT_EQ_STR("foo", foo);
+
+  snprintf(buffer, sizeof(buffer), "%s", "foo");
+  OK(c_intern(t, buffer) == foo);
+  OK(c_intern_find(t, buffer) == foo);
+  OK(c_intern_find(t, "FOO") == NULL);
+  OK(c_intern(t, "FOO") != foo);
+  EXPECT_EQ_UINT64(2, (uint64_t)c_intern_size(t));
+
+  OK(c_intern(t, NULL) == NULL);
+  OK(c_intern_find(t, NULL) == NULL);
+
+  c_intern_destroy(t);
+  return 0;
+}
+
+DEF_TEST(ignore_case) {
+  c_intern_t *t;
+  char const *foo;
+
+  CHECK_NOT_NULL(t = c_intern_create(/* ignore_case = */ 1));
+
+  OK((foo = c_intern(t, "Foo")) != NULL);
+  OK(c_intern(t, "foo") == foo);
+  OK(c_intern_find(t, "FOO") == foo);
+  EXPECT_EQ_STR("Foo", foo);
+  EXPECT_EQ_UINT64(1, (uint64_t)c_intern_size(t));
+
+  c_intern_destroy(t);
+  return 0;
+}
+
+DEF_TEST(grow) {
+  c_intern_t *t;
+  char const *strings[TEST_STRINGS];
+  char buffer[32];
+
+  CHECK_NOT_NULL(t = c_intern_create(/* ignore_case = */ 0));
+
+  for (size_t i = 0; i < TEST_STRINGS; i++) {
+    snprintf(buffer, sizeof(buffer), "string%" PRIsz, i);
+    OK((strings[i] = c_intern(t, buffer)) != NULL);
+  }
+  EXPECT_EQ_UINT64(TEST_STRINGS, (uint64_t)c_intern_size(t));
+
+  /* Pointers stay valid when the table grows. */
+  for (size_t i = 0; i < TEST_STRINGS; i++) {
+    snprintf(buffer, sizeof(buffer), "string%" PRIsz, i);
+    OK(c_intern_find(t, buffer) == strings[i]);
+    EXPECT_EQ_STR(buffer, strings[i]);
+  }
+
+  c_intern_destroy(t);
+  return 0;
+}
+
+static c_intern_t *threads_table;
+
+static void *intern_thread(void *arg) {
+  char const **strings = arg;
+  char buffer[32];
+
+  for (size_t i = 0; i < TEST_STRINGS; i++) {
+    snprintf(buffer, sizeof(buffer), "string%" PRIsz, i);
+    strings[i] = c_intern(threads_table, buffer);
+  }
+
+  return NULL;
+}
+
+DEF_TEST(threads) {
+  pthread_t threads[TEST_THREADS];
+  char const *strings[TEST_THREADS][TEST_STRINGS];
+
+  CHECK_NOT_NULL(threads_table = c_intern_create(/* ignore_case = */ 0));
+
+  for (size_t i = 0; i < TEST_THREADS; i++)
+    CHECK_ZERO(pthread_create(threads + i, NULL, intern_thread, strings[i]));
+  for (size_t i = 0; i < TEST_THREADS; i++)
+    CHECK_ZERO(pthread_join(threads[i], NULL));
+
+  /* All threads got the same pointers. */
+  EXPECT_EQ_UINT64(TEST_STRINGS, (uint64_t)c_intern_size(threads_table));
+  for (size_t i = 0; i < TEST_STRINGS; i++) {
+    OK(strings[0][i] != NULL);
+    for (size_t j = 1; j < TEST_THREADS; j++)
+      OK(strings[j][i] == strings[0][i]);
+  }
+
+  c_intern_destroy(threads_table);
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(simple);
+  RUN_TEST(ignore_case);
+  RUN_TEST(grow);
+  RUN_TEST(threads);
+
+  END_TEST;
+}
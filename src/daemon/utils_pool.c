@@ -0,0 +1,256 @@
+/**
+ * collectd - src/daemon/utils_pool.c
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "utils_pool.h"
+
+#include <pthread.h>
+
+#ifndef C_POOL_DEFAULT_BATCH
+#define C_POOL_DEFAULT_BATCH 64
+#endif
+
+/* Alignment suitable for any object handed out by the pool. */
+typedef union {
+  long double ld;
+  void *ptr;
+  uint64_t u64;
+} c_pool_align_t;
+#define C_POOL_ALIGN(size)                                                     \
+  ((((size) + sizeof(c_pool_align_t) - 1) / sizeof(c_pool_align_t)) *          \
+   sizeof(c_pool_align_t))
+
+/* Free objects are linked through their first bytes. */
+struct c_pool_object_s;
+typedef struct c_pool_object_s c_pool_object_t;
+struct c_pool_object_s {
+  c_pool_object_t *next;
+};
+
+struct c_pool_chunk_s;
+typedef struct c_pool_chunk_s c_pool_chunk_t;
+struct c_pool_chunk_s {
+  c_pool_chunk_t *next;
+  /* objects follow */
+};
+
+/* Per-thread cache of free objects. */
+typedef struct {
+  c_pool_t *pool;
+  c_pool_object_t *head;
+  size_t num;
+} c_pool_cache_t;
+
+struct c_pool_s {
+  size_t object_size;
+  size_t batch_size;
+
+  pthread_key_t cache_key;
+
+  /* Protects the following members. */
+  pthread_mutex_t lock;
+  c_pool_object_t *free_head;
+  size_t free_num;
+  c_pool_chunk_t *chunks;
+};
+
+/* Moves "num" objects from "cache" to the shared free list. */
+static void pool_release(c_pool_t *p, c_pool_cache_t *cache, size_t num) {
+  c_pool_object_t *first = cache->head;
+  c_pool_object_t *last = first;
+
+  if ((first == NULL) || (num == 0))
+    return;
+
+  for (size_t i = 1; (i < num) && (last->next != NULL); i++)
+    last = last->next;
+
+  cache->head = last->next;
+  cache->num -= num;
+
+  pthread_mutex_lock(&p->lock);
+  last->next = p->free_head;
+  p->free_head = first;
+  p->free_num += num;
+  pthread_mutex_unlock(&p->lock);
+} /* void pool_release */
+
+static void pool_cache_destroy(void *arg) {
+  c_pool_cache_t *cache = arg;
+
+  if (cache == NULL)
+    return;
+
+  pool_release(cache->pool, cache, cache->num);
+  free(cache);
+} /* void pool_cache_destroy */
+
+static c_pool_cache_t *pool_get_cache(c_pool_t *p) {
+  c_pool_cache_t *cache = pthread_getspecific(p->cache_key);
+
+  if (cache == NULL) {
+    cache = calloc(1, sizeof(*cache));
+    if (cache == NULL)
+      return NULL;
+    cache->pool = p;
+    pthread_setspecific(p->cache_key, cache);
+  }
+
+  return cache;
+} /* c_pool_cache_t *pool_get_cache */
+
+/* Fills "cache" with up to one batch of objects, either from the shared free
+ * list or from a newly allocated chunk. Returns zero on success. */
+static int pool_refill(c_pool_t *p, c_pool_cache_t *cache) {
+  pthread_mutex_lock(&p->lock);
+
+  if (p->free_head != NULL) {
+    while ((p->free_head != NULL) && (cache->num < p->batch_size)) {
+      c_pool_object_t *obj = p->free_head;
+      p->free_head = obj->next;
+      p->free_num--;
+
+      obj->next = cache->head;
+      cache->head = obj;
+      cache->num++;
+    }
+    pthread_mutex_unlock(&p->lock);
+    return 0;
+  }
+
+  /* Round the chunk header up so objects stay suitably aligned. */
+  size_t header_size = C_POOL_ALIGN(sizeof(c_pool_chunk_t));
+  c_pool_chunk_t *chunk = malloc(header_size + p->batch_size * p->object_size);
+  if (chunk == NULL) {
+    pthread_mutex_unlock(&p->lock);
+    return ENOMEM;
+  }
+  chunk->next = p->chunks;
+  p->chunks = chunk;
+  pthread_mutex_unlock(&p->lock);
+
+  char *base = ((char *)chunk) + header_size;
+  for (size_t i = 0; i < p->batch_size; i++) {
+    c_pool_object_t *obj = (void *)(base + i * p->object_size);
+    obj->next = cache->head;
+    cache->head = obj;
+    cache->num++;
+  }
+
+  return 0;
+} /* int pool_refill */
+
+c_pool_t *c_pool_create(size_t object_size, size_t batch_size) {
+  c_pool_t *p;
+
+  if (object_size == 0)
+    return NULL;
+
+  p = calloc(1, sizeof(*p));
+  if (p == NULL)
+    return NULL;
+
+  /* Objects need to be able to hold the free list pointer and must keep
+   * every object in a chunk aligned. */
+  if (object_size < sizeof(c_pool_object_t))
+    object_size = sizeof(c_pool_object_t);
+  p->object_size = C_POOL_ALIGN(object_size);
+  p->batch_size = (batch_size != 0) ? batch_size : C_POOL_DEFAULT_BATCH;
+
+  if (pthread_key_create(&p->cache_key, pool_cache_destroy) != 0) {
+    free(p);
+    return NULL;
+  }
+  pthread_mutex_init(&p->lock, /* attr = */ NULL);
+
+  return p;
+} /* c_pool_t *c_pool_create */
+
+void c_pool_destroy(c_pool_t *p) {
+  if (p == NULL)
+    return;
+
+  /* The calling thread's cache is the only one we can reach. Caches of
+   * other threads point into chunks which are freed below. */
+  c_pool_cache_t *cache = pthread_getspecific(p->cache_key);
+  if (cache != NULL) {
+    pthread_setspecific(p->cache_key, NULL);
+    free(cache);
+  }
+  pthread_key_delete(p->cache_key);
+
+  while (p->chunks != NULL) {
+    c_pool_chunk_t *next = p->chunks->next;
+    free(p->chunks);
+    p->chunks = next;
+  }
+
+  pthread_mutex_destroy(&p->lock);
+  free(p);
+} /* void c_pool_destroy */
+
+void *c_pool_alloc(c_pool_t *p) {
+  if (p == NULL)
+    return NULL;
+
+  c_pool_cache_t *cache = pool_get_cache(p);
+  if (cache == NULL)
+    return NULL;
+
+  if ((cache->head == NULL) && (pool_refill(p, cache) != 0))
+    return NULL;
+
+  c_pool_object_t *obj = cache->head;
+  cache->head = obj->next;
+  cache->num--;
+
+  return obj;
+} /* void *c_pool_alloc */
+
+void c_pool_free(c_pool_t *p, void *ptr) {
+  if ((p == NULL) || (ptr == NULL))
+    return;
+
+  c_pool_cache_t *cache = pool_get_cache(p);
+  if (cache == NULL) {
+    /* Can't cache it locally; hand it to the shared list directly. */
+    c_pool_object_t *obj = ptr;
+    pthread_mutex_lock(&p->lock);
+    obj->next = p->free_head;
+    p->free_head = obj;
+    p->free_num++;
+    pthread_mutex_unlock(&p->lock);
+    return;
+  }
+
+  c_pool_object_t *obj = ptr;
+  obj->next = cache->head;
+  cache->head = obj;
+  cache->num++;
+
+  /* Threads which mostly free objects (e.g. the write threads) would
+   * otherwise accumulate all objects in their cache. */
+  if (cache->num >= 2 * p->batch_size)
+    pool_release(p, cache, p->batch_size);
+} /* void c_pool_free */
@@ -0,0 +1,86 @@
+/**
+ * collectd - src/daemon/utils_pool.h
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef UTILS_POOL_H
+#define UTILS_POOL_H 1
+
+#include <stddef.h>
+
+struct c_pool_s;
+typedef struct c_pool_s c_pool_t;
+
+/*
+ * NAME
+ *   c_pool_create
+ *
+ * DESCRIPTION
+ *   Allocates a new pool of fixed-size objects. Objects are carved out of
+ *   larger chunks ("slabs") and recycled instead of being returned to the
+ *   system. Each thread keeps a small cache of free objects; only when this
+ *   cache runs empty or overflows a batch of objects is moved from or to a
+ *   list shared by all threads. This makes the pool suitable for objects
+ *   which are allocated by one thread and freed by another.
+ *
+ * PARAMETERS
+ *   `object_size'  Size of the objects handed out by the pool.
+ *   `batch_size'   Number of objects moved between a thread's cache and the
+ *                  shared list at once. This is also the number of objects
+ *                  allocated per chunk. If zero, a default is used.
+ *
+ * RETURN VALUE
+ *   A c_pool_t-pointer upon success or NULL upon failure.
+ */
+c_pool_t *c_pool_create(size_t object_size, size_t batch_size);
+
+/*
+ * NAME
+ *   c_pool_destroy
+ *
+ * DESCRIPTION
+ *   Frees all memory allocated by the pool. Objects that have not been
+ *   returned with `c_pool_free' become invalid, too. This must only be called
+ *   when no other thread uses the pool any more.
+ */
+void c_pool_destroy(c_pool_t *p);
+
+/*
+ * NAME
+ *   c_pool_alloc
+ *
+ * DESCRIPTION
+ *   Returns an uninitialized object of the pool's object size or NULL if
+ *   memory could not be allocated.
+ */
+void *c_pool_alloc(c_pool_t *p);
+
+/*
+ * NAME
+ *   c_pool_free
+ *
+ * DESCRIPTION
+ *   Returns `ptr', which must have been allocated with `c_pool_alloc' from the
+ *   same pool, to the pool. Passing NULL is a no-op.
+ */
+void c_pool_free(c_pool_t *p, void *ptr);
+
+#endif /* UTILS_POOL_H */
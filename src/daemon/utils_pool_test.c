@@ -0,0 +1,111 @@
+/**
+ * collectd - src/daemon/utils_pool_test.c
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+#include "collectd.h"
+
+#include "common.h"
+#include "testing.h"
+#include "utils_pool.h"
+
+#define TEST_BATCH 8
+#define TEST_THREADS 4
+#define TEST_OBJECTS 64
+
+DEF_TEST(simple) {
+  c_pool_t *p;
+  void *objs[3 * TEST_BATCH];
+
+  CHECK_NOT_NULL(p = c_pool_create(sizeof(uint64_t), TEST_BATCH));
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(objs); i++) {
+    CHECK_NOT_NULL(objs[i] = c_pool_alloc(p));
+    *((uint64_t *)objs[i]) = (uint64_t)i;
+  }
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(objs); i++) {
+    EXPECT_EQ_UINT64((uint64_t)i, *((uint64_t *)objs[i]));
+    for (size_t j = 0; j < i; j++)
+      OK(objs[i] != objs[j]);
+  }
+
+  /* Freed objects are handed out again before new chunks are allocated. */
+  void *last = objs[STATIC_ARRAY_SIZE(objs) - 1];
+  c_pool_free(p, last);
+  OK(c_pool_alloc(p) == last);
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(objs); i++)
+    c_pool_free(p, objs[i]);
+  c_pool_free(p, NULL);
+
+  c_pool_destroy(p);
+  return 0;
+}
+
+static void *alloc_thread(void *arg) {
+  c_pool_t *p = arg;
+  void *objs[TEST_OBJECTS];
+
+  for (int round = 0; round < 100; round++) {
+    for (size_t i = 0; i < TEST_OBJECTS; i++) {
+      objs[i] = c_pool_alloc(p);
+      if (objs[i] == NULL)
+        return (void *)1;
+      memset(objs[i], (int)round, 32);
+    }
+    for (size_t i = 0; i < TEST_OBJECTS; i++)
+      c_pool_free(p, objs[i]);
+  }
+
+  return NULL;
+}
+
+DEF_TEST(threads) {
+  c_pool_t *p;
+  pthread_t threads[TEST_THREADS];
+
+  CHECK_NOT_NULL(p = c_pool_create(32, TEST_BATCH));
+
+  for (size_t i = 0; i < TEST_THREADS; i++)
+    CHECK_ZERO(pthread_create(&threads[i], NULL, alloc_thread, p));
+  for (size_t i = 0; i < TEST_THREADS; i++) {
+    void *ret = (void *)1;
+    CHECK_ZERO(pthread_join(threads[i], &ret));
+    OK(ret == NULL);
+  }
+
+  /* Objects allocated in one thread may be freed in another. */
+  void *obj;
+  CHECK_NOT_NULL(obj = c_pool_alloc(p));
+  c_pool_free(p, obj);
+
+  c_pool_destroy(p);
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(simple);
+  RUN_TEST(threads);
+
+  END_TEST;
+}
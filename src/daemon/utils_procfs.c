@@ -0,0 +1,294 @@
+/**
+ * collectd - src/daemon/utils_procfs.c
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "common.h"
+#include "plugin.h"
+#include "utils_procfs.h"
+
+/* Upper bound of the age of a snapshot which is handed out again. Read
+ * callbacks with the same interval run within a few milliseconds of each
+ * other, so this only has to cover one read cycle. */
+#define PROCFS_MAX_AGE TIME_T_TO_CDTIME_T_STATIC(1)
+#define PROCFS_DEFAULT_SIZE 4096
+
+struct procfs_file_s;
+typedef struct procfs_file_s procfs_file_t;
+
+struct procfs_snapshot_s {
+  procfs_file_t *file;
+  unsigned int refs; /* protected by file->lock */
+  cdtime_t time;
+
+  char *data;
+  procfs_entry_t *entries;
+  size_t entries_num;
+  procfs_entry_t const **sorted; /* sorted by key */
+};
+
+struct procfs_file_s {
+  char *path;
+  pthread_mutex_t lock;
+  procfs_snapshot_t *current;
+  size_t size; /* buffer size needed to read the file the last time */
+  procfs_file_t *next;
+};
+
+/* Files are never removed from the list. Only a handful of distinct files is
+ * read. */
+static pthread_mutex_t procfs_lock = PTHREAD_MUTEX_INITIALIZER;
+static procfs_file_t *procfs_files;
+
+static procfs_file_t *procfs_file_get(char const *path) /* {{{ */
+{
+  pthread_mutex_lock(&procfs_lock);
+
+  procfs_file_t *f;
+  for (f = procfs_files; f != NULL; f = f->next)
+    if (strcmp(path, f->path) == 0)
+      break;
+
+  if (f == NULL) {
+    f = calloc(1, sizeof(*f));
+    if ((f == NULL) || ((f->path = strdup(path)) == NULL)) {
+      sfree(f);
+      pthread_mutex_unlock(&procfs_lock);
+      errno = ENOMEM;
+      return NULL;
+    }
+    pthread_mutex_init(&f->lock, /* attr = */ NULL);
+    f->size = PROCFS_DEFAULT_SIZE;
+    f->next = procfs_files;
+    procfs_files = f;
+  }
+
+  pthread_mutex_unlock(&procfs_lock);
+  return f;
+} /* }}} procfs_file_t *procfs_file_get */
+
+static void procfs_snapshot_free(procfs_snapshot_t *s) /* {{{ */
+{
+  if (s == NULL)
+    return;
+
+  sfree(s->data);
+  sfree(s->entries);
+  sfree(s->sorted);
+  sfree(s);
+} /* }}} void procfs_snapshot_free */
+
+static int procfs_entry_compare(void const *a, void const *b) /* {{{ */
+{
+  procfs_entry_t const *const *ea = a;
+  procfs_entry_t const *const *eb = b;
+  return strcmp((*ea)->key, (*eb)->key);
+} /* }}} int procfs_entry_compare */
+
+/* Splits "s->data" into lines of "<key>[:] <value> [...]" and fills the
+ * entry table. */
+static int procfs_snapshot_parse(procfs_snapshot_t *s) /* {{{ */
+{
+  size_t lines_num = 1;
+  for (char const *ptr = s->data; *ptr != 0; ptr++)
+    if (*ptr == '\n')
+      lines_num++;
+
+  s->entries = calloc(lines_num, sizeof(*s->entries));
+  s->sorted = calloc(lines_num, sizeof(*s->sorted));
+  if ((s->entries == NULL) || (s->sorted == NULL))
+    return ENOMEM;
+
+  char *saveptr = NULL;
+  for (char *line = strtok_r(s->data, "\n", &saveptr); line != NULL;
+       line = strtok_r(NULL, "\n", &saveptr)) {
+    char *fields[3];
+    if (strsplit(line, fields, STATIC_ARRAY_SIZE(fields)) < 2)
+      continue;
+
+    size_t key_len = strlen(fields[0]);
+    if ((key_len > 0) && (fields[0][key_len - 1] == ':'))
+      fields[0][key_len - 1] = 0;
+
+    char *endptr = NULL;
+    errno = 0;
+    long long value = strtoll(fields[1], &endptr, 10);
+    if ((endptr == fields[1]) || (*endptr != 0) || (errno != 0))
+      continue;
+
+    procfs_entry_t *e = s->entries + s->entries_num;
+    e->key = fields[0];
+    e->value = (int64_t)value;
+    s->sorted[s->entries_num] = e;
+    s->entries_num++;
+  }
+
+  qsort(s->sorted, s->entries_num, sizeof(*s->sorted), procfs_entry_compare);
+  return 0;
+} /* }}} int procfs_snapshot_parse */
+
+/* Must hold f->lock. */
+static procfs_snapshot_t *procfs_snapshot_read(procfs_file_t *f, /* {{{ */
+                                               cdtime_t now) {
+  procfs_snapshot_t *s = calloc(1, sizeof(*s));
+  if (s == NULL) {
+    errno = ENOMEM;
+    return NULL;
+  }
+  s->file = f;
+  s->time = now;
+
+  /* Files in /proc don't have a size, so the buffer is grown until the
+   * whole file fits. */
+  size_t size = f->size;
+  while (42) {
+    char *tmp = realloc(s->data, size + 1);
+    if (tmp == NULL) {
+      procfs_snapshot_free(s);
+      errno = ENOMEM;
+      return NULL;
+    }
+    s->data = tmp;
+
+    ssize_t len = read_file_cached(f->path, s->data, size);
+    if (len < 0) {
+      int status = errno;
+      procfs_snapshot_free(s);
+      errno = status;
+      return NULL;
+    }
+    if ((size_t)len < size) {
+      s->data[len] = 0;
+      break;
+    }
+    size *= 2;
+  }
+  f->size = size;
+
+  int status = procfs_snapshot_parse(s);
+  if (status != 0) {
+    procfs_snapshot_free(s);
+    errno = status;
+    return NULL;
+  }
+
+  return s;
+} /* }}} procfs_snapshot_t *procfs_snapshot_read */
+
+/* Returns the age up to which a snapshot is handed out again: half the
+ * interval of the calling read callback, but at most PROCFS_MAX_AGE. */
+static cdtime_t procfs_max_age(void) /* {{{ */
+{
+  cdtime_t max_age = plugin_get_interval() / 2;
+  if ((max_age == 0) || (max_age > PROCFS_MAX_AGE))
+    max_age = PROCFS_MAX_AGE;
+  return max_age;
+} /* }}} cdtime_t procfs_max_age */
+
+procfs_snapshot_t *procfs_snapshot_acquire(char const *path) /* {{{ */
+{
+  if (path == NULL) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  procfs_file_t *f = procfs_file_get(path);
+  if (f == NULL)
+    return NULL;
+
+  /* Holding the lock while reading makes concurrent readers of the same file
+   * wait for the snapshot instead of reading the file as well. */
+  pthread_mutex_lock(&f->lock);
+
+  cdtime_t now = cdtime();
+  procfs_snapshot_t *s = f->current;
+  if ((s != NULL) && (now >= s->time) &&
+      ((now - s->time) < procfs_max_age())) {
+    s->refs++;
+    pthread_mutex_unlock(&f->lock);
+    return s;
+  }
+
+  s = procfs_snapshot_read(f, now);
+  if (s == NULL) {
+    int status = errno;
+    pthread_mutex_unlock(&f->lock);
+    errno = status;
+    return NULL;
+  }
+
+  if (f->current != NULL) {
+    f->current->refs--;
+    if (f->current->refs == 0)
+      procfs_snapshot_free(f->current);
+  }
+  f->current = s;
+  s->refs = 2; /* one for the file, one for the caller */
+
+  pthread_mutex_unlock(&f->lock);
+  return s;
+} /* }}} procfs_snapshot_t *procfs_snapshot_acquire */
+
+void procfs_snapshot_release(procfs_snapshot_t *s) /* {{{ */
+{
+  if (s == NULL)
+    return;
+
+  procfs_file_t *f = s->file;
+  pthread_mutex_lock(&f->lock);
+  assert(s->refs > 0);
+  s->refs--;
+  if (s->refs == 0)
+    procfs_snapshot_free(s);
+  pthread_mutex_unlock(&f->lock);
+} /* }}} void procfs_snapshot_release */
+
+cdtime_t procfs_snapshot_time(procfs_snapshot_t const *s) /* {{{ */
+{
+  return s->time;
+} /* }}} cdtime_t procfs_snapshot_time */
+
+procfs_entry_t const * /* {{{ */
+procfs_snapshot_entries(procfs_snapshot_t const *s, size_t *ret_entries_num) {
+  *ret_entries_num = s->entries_num;
+  return s->entries;
+} /* }}} procfs_entry_t const *procfs_snapshot_entries */
+
+procfs_entry_t const * /* {{{ */
+procfs_snapshot_lookup(procfs_snapshot_t const *s, char const *key) {
+  size_t lo = 0;
+  size_t hi = s->entries_num;
+
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    int cmp = strcmp(key, s->sorted[mid]->key);
+    if (cmp == 0)
+      return s->sorted[mid];
+    if (cmp < 0)
+      hi = mid;
+    else
+      lo = mid + 1;
+  }
+
+  return NULL;
+} /* }}} procfs_entry_t const *procfs_snapshot_lookup */
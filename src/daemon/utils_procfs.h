@@ -0,0 +1,94 @@
+/**
+ * collectd - src/daemon/utils_procfs.h
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef UTILS_PROCFS_H
+#define UTILS_PROCFS_H 1
+
+#include "collectd.h"
+
+struct procfs_snapshot_s;
+typedef struct procfs_snapshot_s procfs_snapshot_t;
+
+typedef struct {
+  char const *key;
+  int64_t value;
+} procfs_entry_t;
+
+/*
+ * NAME
+ *   procfs_snapshot_acquire
+ *
+ * DESCRIPTION
+ *   Returns a snapshot of `path', a file holding one "<key> <value>" pair per
+ *   line, such as /proc/meminfo, /proc/vmstat or the "numastat" files of
+ *   NUMA nodes. A colon at the end of a key and anything following the value,
+ *   e.g. a "kB" unit, are ignored, as are lines without an integer value.
+ *
+ *   The file is read at most once per read cycle: if a snapshot of the file
+ *   has been taken less than half an interval ago, but at most one second
+ *   ago, that snapshot is returned. Plugins reading the same file therefore
+ *   get the same values for the same time. A snapshot doesn't change while it
+ *   is being held and must be released with procfs_snapshot_release().
+ *
+ * RETURN VALUE
+ *   A snapshot upon success or NULL upon failure, in which case errno is set.
+ */
+procfs_snapshot_t *procfs_snapshot_acquire(char const *path);
+
+void procfs_snapshot_release(procfs_snapshot_t *s);
+
+/*
+ * NAME
+ *   procfs_snapshot_time
+ *
+ * DESCRIPTION
+ *   Returns the time at which the file was read. Plugins should use it as
+ *   the time of the values they derive from the snapshot.
+ */
+cdtime_t procfs_snapshot_time(procfs_snapshot_t const *s);
+
+/*
+ * NAME
+ *   procfs_snapshot_entries
+ *
+ * DESCRIPTION
+ *   Returns the entries of the snapshot in the order in which they appear in
+ *   the file and stores their number in `ret_entries_num'.
+ */
+procfs_entry_t const *procfs_snapshot_entries(procfs_snapshot_t const *s,
+                                              size_t *ret_entries_num);
+
+/*
+ * NAME
+ *   procfs_snapshot_lookup
+ *
+ * DESCRIPTION
+ *   Looks up `key', without a trailing colon, in the snapshot.
+ *
+ * RETURN VALUE
+ *   The entry or NULL if the key doesn't exist.
+ */
+procfs_entry_t const *procfs_snapshot_lookup(procfs_snapshot_t const *s,
+                                             char const *key);
+
+#endif /* UTILS_PROCFS_H */
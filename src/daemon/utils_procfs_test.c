@@ -0,0 +1,157 @@
+/**
+ * collectd - src/daemon/utils_procfs_test.c
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "common.h"
+#include "testing.h"
+#include "utils_procfs.h"
+
+/* Declared by "utils_time.h" only if "testing.h" is included first. */
+extern cdtime_t cdtime_mock;
+
+static char test_file[] = "/tmp/collectd-procfs-test.XXXXXX";
+
+static int write_file(char const *content) /* {{{ */
+{
+  FILE *fh = fopen(test_file, "w");
+  if (fh == NULL)
+    return errno;
+  fputs(content, fh);
+  fclose(fh);
+  return 0;
+} /* }}} int write_file */
+
+DEF_TEST(parse) {
+  procfs_snapshot_t *s;
+  procfs_entry_t const *e;
+  size_t entries_num = 0;
+
+  CHECK_ZERO(write_file("MemTotal:       16314044 kB\n"
+                        "MemFree:         1234567 kB\n"
+                        "nr_dirty 42\n"
+                        "no value\n"
+                        "\n"
+                        "negative -3\n"
+                        "Buffers:          204800 kB"));
+
+  CHECK_NOT_NULL(s = procfs_snapshot_acquire(test_file));
+  EXPECT_EQ_UINT64(cdtime(), procfs_snapshot_time(s));
+
+  /* Entries are in file order. */
+  CHECK_NOT_NULL(e = procfs_snapshot_entries(s, &entries_num));
+  EXPECT_EQ_INT(5, (int)entries_num);
+  EXPECT_EQ_STR("MemTotal", e[0].key);
+  EXPECT_EQ_STR("MemFree", e[1].key);
+  EXPECT_EQ_STR("nr_dirty", e[2].key);
+  EXPECT_EQ_STR("negative", e[3].key);
+  EXPECT_EQ_STR("Buffers", e[4].key);
+
+  CHECK_NOT_NULL(e = procfs_snapshot_lookup(s, "MemTotal"));
+  EXPECT_EQ_UINT64(16314044, (uint64_t)e->value);
+  CHECK_NOT_NULL(e = procfs_snapshot_lookup(s, "Buffers"));
+  EXPECT_EQ_UINT64(204800, (uint64_t)e->value);
+  CHECK_NOT_NULL(e = procfs_snapshot_lookup(s, "nr_dirty"));
+  EXPECT_EQ_UINT64(42, (uint64_t)e->value);
+  CHECK_NOT_NULL(e = procfs_snapshot_lookup(s, "negative"));
+  EXPECT_EQ_INT(-3, (int)e->value);
+  OK(procfs_snapshot_lookup(s, "no") == NULL);
+  OK(procfs_snapshot_lookup(s, "MemTotal:") == NULL);
+  OK(procfs_snapshot_lookup(s, "SwapTotal") == NULL);
+
+  procfs_snapshot_release(s);
+  cdtime_mock += TIME_T_TO_CDTIME_T(10);
+  return 0;
+}
+
+DEF_TEST(sharing) {
+  procfs_snapshot_t *s1;
+  procfs_snapshot_t *s2;
+  procfs_snapshot_t *s3;
+
+  CHECK_ZERO(write_file("pgfault 1\n"));
+  CHECK_NOT_NULL(s1 = procfs_snapshot_acquire(test_file));
+
+  /* Within the same read cycle the file isn't read again. */
+  CHECK_ZERO(write_file("pgfault 2\n"));
+  cdtime_mock += MS_TO_CDTIME_T(100);
+  CHECK_NOT_NULL(s2 = procfs_snapshot_acquire(test_file));
+  OK(s1 == s2);
+  EXPECT_EQ_UINT64(1, (uint64_t)procfs_snapshot_lookup(s2, "pgfault")->value);
+  procfs_snapshot_release(s2);
+
+  /* Later it is, and snapshots still being held don't change. */
+  cdtime_mock += TIME_T_TO_CDTIME_T(10);
+  CHECK_NOT_NULL(s3 = procfs_snapshot_acquire(test_file));
+  OK(s1 != s3);
+  EXPECT_EQ_UINT64(2, (uint64_t)procfs_snapshot_lookup(s3, "pgfault")->value);
+  EXPECT_EQ_UINT64(1, (uint64_t)procfs_snapshot_lookup(s1, "pgfault")->value);
+  OK(procfs_snapshot_time(s1) < procfs_snapshot_time(s3));
+
+  procfs_snapshot_release(s1);
+  procfs_snapshot_release(s3);
+  return 0;
+}
+
+DEF_TEST(large_file) {
+  procfs_snapshot_t *s;
+  procfs_entry_t const *e;
+  size_t entries_num = 0;
+  char *content;
+  size_t content_size = 100000 * 20;
+
+  /* Larger than the initial buffer. */
+  CHECK_NOT_NULL(content = calloc(1, content_size));
+  for (size_t i = 0, len = 0; i < 100000; i++)
+    len += (size_t)snprintf(content + len, content_size - len,
+                            "key%06" PRIsz " %" PRIsz "\n", i, i);
+  CHECK_ZERO(write_file(content));
+  sfree(content);
+
+  cdtime_mock += TIME_T_TO_CDTIME_T(10);
+  CHECK_NOT_NULL(s = procfs_snapshot_acquire(test_file));
+  CHECK_NOT_NULL(e = procfs_snapshot_entries(s, &entries_num));
+  EXPECT_EQ_INT(100000, (int)entries_num);
+  CHECK_NOT_NULL(e = procfs_snapshot_lookup(s, "key099999"));
+  EXPECT_EQ_INT(99999, (int)e->value);
+  procfs_snapshot_release(s);
+
+  OK(procfs_snapshot_acquire("/nonexistent/file") == NULL);
+  return 0;
+}
+
+int main(void) {
+  int fd = mkstemp(test_file);
+  if (fd < 0) {
+    printf("mkstemp failed: %s\n", STRERRNO);
+    return 1;
+  }
+  close(fd);
+
+  RUN_TEST(parse);
+  RUN_TEST(sharing);
+  RUN_TEST(large_file);
+
+  unlink(test_file);
+  END_TEST;
+}
@@ -0,0 +1,217 @@
+/**
+ * collectd - src/daemon/utils_ring.c
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "utils_ring.h"
+
+#include <pthread.h>
+
+/* This is the bounded queue described by Dmitry Vyukov: every cell carries a
+ * sequence number telling producers and consumers whether it is free or holds
+ * a record of the current round, so the head and tail positions are the only
+ * shared state that needs to be updated with compare-and-swap. If the
+ * compiler doesn't provide the atomic builtins, a lock is used instead. */
+#if defined(__ATOMIC_ACQUIRE) && defined(__ATOMIC_RELEASE)
+#define C_RING_LOCK_FREE 1
+#else
+#define C_RING_LOCK_FREE 0
+#endif
+
+typedef struct {
+  size_t seq;
+  /* record follows */
+} c_ring_cell_t;
+
+struct c_ring_s {
+  size_t mask;
+  size_t record_size;
+  size_t cell_size;
+  char *cells;
+
+  /* Producers and consumers are kept on different cache lines. */
+  char pad0[64];
+  size_t tail; /* next position to push to */
+  char pad1[64];
+  size_t head; /* next position to pop from */
+  char pad2[64];
+
+#if !C_RING_LOCK_FREE
+  pthread_mutex_t lock;
+#endif
+};
+
+static c_ring_cell_t *c_ring_cell(c_ring_t *r, size_t pos) /* {{{ */
+{
+  return (c_ring_cell_t *)(r->cells + (pos & r->mask) * r->cell_size);
+} /* }}} c_ring_cell_t *c_ring_cell */
+
+c_ring_t *c_ring_create(size_t capacity, size_t record_size) /* {{{ */
+{
+  c_ring_t *r;
+  size_t size = 2;
+
+  if ((capacity == 0) || (record_size == 0))
+    return NULL;
+
+  while (size < capacity)
+    size *= 2;
+
+  r = calloc(1, sizeof(*r));
+  if (r == NULL)
+    return NULL;
+
+  r->mask = size - 1;
+  r->record_size = record_size;
+  /* Keep the cells aligned for any record type. */
+  r->cell_size = sizeof(c_ring_cell_t) +
+                 ((record_size + sizeof(void *) - 1) & ~(sizeof(void *) - 1));
+  r->cells = calloc(size, r->cell_size);
+  if (r->cells == NULL) {
+    free(r);
+    return NULL;
+  }
+
+  for (size_t i = 0; i < size; i++)
+    c_ring_cell(r, i)->seq = i;
+
+#if !C_RING_LOCK_FREE
+  pthread_mutex_init(&r->lock, NULL);
+#endif
+
+  return r;
+} /* }}} c_ring_t *c_ring_create */
+
+void c_ring_destroy(c_ring_t *r) /* {{{ */
+{
+  if (r == NULL)
+    return;
+
+#if !C_RING_LOCK_FREE
+  pthread_mutex_destroy(&r->lock);
+#endif
+  free(r->cells);
+  free(r);
+} /* }}} void c_ring_destroy */
+
+#if C_RING_LOCK_FREE
+int c_ring_push(c_ring_t *r, void const *record) /* {{{ */
+{
+  size_t pos = __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+  c_ring_cell_t *cell;
+
+  while (42) {
+    cell = c_ring_cell(r, pos);
+    size_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+    intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+    if (diff == 0) {
+      if (__atomic_compare_exchange_n(&r->tail, &pos, pos + 1,
+                                      /* weak = */ 1, __ATOMIC_RELAXED,
+                                      __ATOMIC_RELAXED))
+        break;
+    } else if (diff < 0) {
+      return ENOBUFS;
+    } else {
+      pos = __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+    }
+  }
+
+  memcpy(cell + 1, record, r->record_size);
+  __atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+  return 0;
+} /* }}} int c_ring_push */
+
+int c_ring_pop(c_ring_t *r, void *record) /* {{{ */
+{
+  size_t pos = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+  c_ring_cell_t *cell;
+
+  while (42) {
+    cell = c_ring_cell(r, pos);
+    size_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+    intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+
+    if (diff == 0) {
+      if (__atomic_compare_exchange_n(&r->head, &pos, pos + 1,
+                                      /* weak = */ 1, __ATOMIC_RELAXED,
+                                      __ATOMIC_RELAXED))
+        break;
+    } else if (diff < 0) {
+      return ENOENT;
+    } else {
+      pos = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+    }
+  }
+
+  memcpy(record, cell + 1, r->record_size);
+  __atomic_store_n(&cell->seq, pos + r->mask + 1, __ATOMIC_RELEASE);
+  return 0;
+} /* }}} int c_ring_pop */
+
+_Bool c_ring_empty(c_ring_t *r) /* {{{ */
+{
+  size_t pos = __atomic_load_n(&r->head, __ATOMIC_SEQ_CST);
+  c_ring_cell_t *cell = c_ring_cell(r, pos);
+
+  return __atomic_load_n(&cell->seq, __ATOMIC_SEQ_CST) != pos + 1;
+} /* }}} _Bool c_ring_empty */
+#else  /* !C_RING_LOCK_FREE */
+int c_ring_push(c_ring_t *r, void const *record) /* {{{ */
+{
+  pthread_mutex_lock(&r->lock);
+  c_ring_cell_t *cell = c_ring_cell(r, r->tail);
+  if (cell->seq != r->tail) {
+    pthread_mutex_unlock(&r->lock);
+    return ENOBUFS;
+  }
+  memcpy(cell + 1, record, r->record_size);
+  cell->seq = r->tail + 1;
+  r->tail++;
+  pthread_mutex_unlock(&r->lock);
+  return 0;
+} /* }}} int c_ring_push */
+
+int c_ring_pop(c_ring_t *r, void *record) /* {{{ */
+{
+  pthread_mutex_lock(&r->lock);
+  c_ring_cell_t *cell = c_ring_cell(r, r->head);
+  if (cell->seq != r->head + 1) {
+    pthread_mutex_unlock(&r->lock);
+    return ENOENT;
+  }
+  memcpy(record, cell + 1, r->record_size);
+  cell->seq = r->head + r->mask + 1;
+  r->head++;
+  pthread_mutex_unlock(&r->lock);
+  return 0;
+} /* }}} int c_ring_pop */
+
+_Bool c_ring_empty(c_ring_t *r) /* {{{ */
+{
+  pthread_mutex_lock(&r->lock);
+  _Bool empty = (c_ring_cell(r, r->head)->seq != r->head + 1);
+  pthread_mutex_unlock(&r->lock);
+  return empty;
+} /* }}} _Bool c_ring_empty */
+#endif /* C_RING_LOCK_FREE */
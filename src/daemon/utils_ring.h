@@ -0,0 +1,96 @@
+/**
+ * collectd - src/daemon/utils_ring.h
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef UTILS_RING_H
+#define UTILS_RING_H 1
+
+#include <stddef.h>
+
+struct c_ring_s;
+typedef struct c_ring_s c_ring_t;
+
+/*
+ * NAME
+ *   c_ring_create
+ *
+ * DESCRIPTION
+ *   Allocates a bounded first-in, first-out queue of fixed-size records.
+ *   Records are copied into and out of the ring. Any number of threads may
+ *   push and pop concurrently without taking a lock: a full ring makes
+ *   `c_ring_push' fail instead of blocking. The order of records pushed by
+ *   one thread is preserved.
+ *
+ * PARAMETERS
+ *   `capacity'     Maximum number of records. Rounded up to a power of two.
+ *   `record_size'  Size of each record in bytes.
+ *
+ * RETURN VALUE
+ *   A c_ring_t-pointer upon success or NULL upon failure.
+ */
+c_ring_t *c_ring_create(size_t capacity, size_t record_size);
+
+/*
+ * NAME
+ *   c_ring_destroy
+ *
+ * DESCRIPTION
+ *   Frees the ring and all records in it. This must only be called when no
+ *   other thread uses the ring any more.
+ */
+void c_ring_destroy(c_ring_t *r);
+
+/*
+ * NAME
+ *   c_ring_push
+ *
+ * DESCRIPTION
+ *   Copies the record pointed to by `record' into the ring.
+ *
+ * RETURN VALUE
+ *   Zero upon success or ENOBUFS if the ring is full.
+ */
+int c_ring_push(c_ring_t *r, void const *record);
+
+/*
+ * NAME
+ *   c_ring_pop
+ *
+ * DESCRIPTION
+ *   Copies the oldest record into the buffer pointed to by `record', which
+ *   must be at least as large as the ring's record size, and removes it.
+ *
+ * RETURN VALUE
+ *   Zero upon success or ENOENT if the ring is empty.
+ */
+int c_ring_pop(c_ring_t *r, void *record);
+
+/*
+ * NAME
+ *   c_ring_empty
+ *
+ * DESCRIPTION
+ *   Returns true if there was no record in the ring at the time of the call.
+ */
+_Bool c_ring_empty(c_ring_t *r);
+
+#endif /* UTILS_RING_H */
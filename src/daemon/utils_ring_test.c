@@ -0,0 +1,138 @@
+/**
+ * collectd - src/daemon/utils_ring_test.c
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "common.h"
+#include "testing.h"
+#include "utils_ring.h"
+
+#include <sched.h>
+
+#define TEST_THREADS 4
+#define TEST_RECORDS 10000
+
+typedef struct {
+  uint64_t producer;
+  uint64_t seq;
+  char text[20];
+} test_record_t;
+
+DEF_TEST(simple) {
+  c_ring_t *r;
+  test_record_t rec;
+
+  CHECK_NOT_NULL(r = c_ring_create(3, sizeof(rec)));
+  OK(c_ring_empty(r));
+  EXPECT_EQ_INT(ENOENT, c_ring_pop(r, &rec));
+
+  /* The capacity is rounded up to four. */
+  for (uint64_t i = 0; i < 4; i++) {
+    rec = (test_record_t){.seq = i};
+    snprintf(rec.text, sizeof(rec.text), "record %" PRIu64, i);
+    EXPECT_EQ_INT(0, c_ring_push(r, &rec));
+  }
+  EXPECT_EQ_INT(ENOBUFS, c_ring_push(r, &rec));
+  OK(!c_ring_empty(r));
+
+  /* Wrap around a few times. */
+  for (uint64_t i = 0; i < 20; i++) {
+    EXPECT_EQ_INT(0, c_ring_pop(r, &rec));
+    EXPECT_EQ_UINT64(i, rec.seq);
+    char want[20];
+    snprintf(want, sizeof(want), "record %" PRIu64, i);
+    EXPECT_EQ_STR(want, rec.text);
+
+    rec = (test_record_t){.seq = i + 4};
+    snprintf(rec.text, sizeof(rec.text), "record %" PRIu64, i + 4);
+    EXPECT_EQ_INT(0, c_ring_push(r, &rec));
+  }
+
+  for (uint64_t i = 20; i < 24; i++) {
+    EXPECT_EQ_INT(0, c_ring_pop(r, &rec));
+    EXPECT_EQ_UINT64(i, rec.seq);
+  }
+  OK(c_ring_empty(r));
+
+  c_ring_destroy(r);
+  return 0;
+}
+
+typedef struct {
+  c_ring_t *ring;
+  uint64_t producer;
+} test_producer_t;
+
+static void *push_thread(void *arg) {
+  test_producer_t *p = arg;
+
+  for (uint64_t i = 0; i < TEST_RECORDS; i++) {
+    test_record_t rec = {.producer = p->producer, .seq = i};
+    while (c_ring_push(p->ring, &rec) != 0)
+      sched_yield();
+  }
+
+  return NULL;
+}
+
+DEF_TEST(threads) {
+  c_ring_t *r;
+  pthread_t threads[TEST_THREADS];
+  test_producer_t producers[TEST_THREADS];
+  uint64_t next[TEST_THREADS] = {0};
+  size_t received = 0;
+
+  CHECK_NOT_NULL(r = c_ring_create(64, sizeof(test_record_t)));
+
+  for (size_t i = 0; i < TEST_THREADS; i++) {
+    producers[i] = (test_producer_t){.ring = r, .producer = i};
+    CHECK_ZERO(pthread_create(&threads[i], NULL, push_thread, &producers[i]));
+  }
+
+  /* Records of each producer arrive complete and in order. */
+  while (received < TEST_THREADS * TEST_RECORDS) {
+    test_record_t rec;
+    if (c_ring_pop(r, &rec) != 0) {
+      sched_yield();
+      continue;
+    }
+    OK(rec.producer < TEST_THREADS);
+    EXPECT_EQ_UINT64(next[rec.producer], rec.seq);
+    next[rec.producer]++;
+    received++;
+  }
+
+  for (size_t i = 0; i < TEST_THREADS; i++)
+    CHECK_ZERO(pthread_join(threads[i], NULL));
+  OK(c_ring_empty(r));
+
+  c_ring_destroy(r);
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(simple);
+  RUN_TEST(threads);
+
+  END_TEST;
+}
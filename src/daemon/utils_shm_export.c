@@ -0,0 +1,248 @@
+/**
+ * collectd - src/daemon/utils_shm_export.c
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "common.h"
+#include "libcollectdclient/collectd/shm_format.h"
+#include "utils_shm_export.h"
+
+#include <sys/mman.h>
+
+/* The sequence locks need the atomic builtins. */
+#if defined(__ATOMIC_ACQUIRE) && defined(__ATOMIC_RELEASE)
+#define SHM_EXPORT_SUPPORTED 1
+#else
+#define SHM_EXPORT_SUPPORTED 0
+#endif
+
+static pthread_mutex_t export_lock = PTHREAD_MUTEX_INITIALIZER;
+static void *export_map = NULL;
+static size_t export_map_size = 0;
+static lcc_shm_header_t *export_header = NULL;
+static size_t export_slots_num = 0;
+
+/* Released slots, reused before new slots are taken. Protected by
+ * "export_lock", like the header's "slots_used". */
+static uint64_t *export_free = NULL;
+static size_t export_free_num = 0;
+static _Bool export_full_reported = 0;
+
+static lcc_shm_slot_t *shm_export_slot(int64_t slot) /* {{{ */
+{
+  return (lcc_shm_slot_t *)((char *)export_map + sizeof(lcc_shm_header_t) +
+                            (size_t)slot * sizeof(lcc_shm_slot_t));
+} /* }}} lcc_shm_slot_t *shm_export_slot */
+
+#if SHM_EXPORT_SUPPORTED
+static void shm_export_write_begin(lcc_shm_slot_t *s) /* {{{ */
+{
+  __atomic_store_n(&s->seq, s->seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+} /* }}} void shm_export_write_begin */
+
+static void shm_export_write_end(lcc_shm_slot_t *s) /* {{{ */
+{
+  __atomic_store_n(&s->seq, s->seq + 1, __ATOMIC_RELEASE);
+} /* }}} void shm_export_write_end */
+#endif
+
+int shm_export_create(char const *path, size_t slots_num) /* {{{ */
+{
+#if !SHM_EXPORT_SUPPORTED
+  ERROR("shm_export_create: Not supported by the compiler.");
+  return ENOTSUP;
+#else
+  if ((path == NULL) || (slots_num == 0))
+    return EINVAL;
+  if (export_map != NULL)
+    return EEXIST;
+
+  size_t size = sizeof(lcc_shm_header_t) + slots_num * sizeof(lcc_shm_slot_t);
+
+  char tmp[PATH_MAX];
+  int status = snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path);
+  if ((status < 0) || ((size_t)status >= sizeof(tmp)))
+    return ENAMETOOLONG;
+
+  int fd = mkstemp(tmp);
+  if (fd < 0) {
+    status = errno;
+    ERROR("shm_export_create: mkstemp(\"%s\") failed: %s", tmp, STRERRNO);
+    return status;
+  }
+
+  /* The file is sparse: pages are only allocated once slots are used. */
+  if ((fchmod(fd, 0644) != 0) || (ftruncate(fd, (off_t)size) != 0)) {
+    status = errno;
+    ERROR("shm_export_create: Sizing \"%s\" failed: %s", tmp, STRERRNO);
+    close(fd);
+    unlink(tmp);
+    return status;
+  }
+
+  void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    status = errno;
+    ERROR("shm_export_create: mmap failed: %s", STRERRNO);
+    unlink(tmp);
+    return status;
+  }
+
+  lcc_shm_header_t *header = map;
+  header->magic = LCC_SHM_MAGIC;
+  header->version = LCC_SHM_VERSION;
+  header->slot_size = (uint32_t)sizeof(lcc_shm_slot_t);
+  header->slots_num = (uint64_t)slots_num;
+  header->slots_used = 0;
+  header->created = (uint64_t)cdtime();
+  __atomic_store_n(&header->active, 1, __ATOMIC_RELEASE);
+
+  if (rename(tmp, path) != 0) {
+    status = errno;
+    ERROR("shm_export_create: Renaming \"%s\" to \"%s\" failed: %s", tmp,
+          path, STRERRNO);
+    munmap(map, size);
+    unlink(tmp);
+    return status;
+  }
+
+  pthread_mutex_lock(&export_lock);
+  export_map = map;
+  export_map_size = size;
+  export_header = header;
+  export_slots_num = slots_num;
+  pthread_mutex_unlock(&export_lock);
+
+  INFO("shm_export_create: Exporting up to %" PRIsz " series to \"%s\".",
+       slots_num, path);
+  return 0;
+#endif
+} /* }}} int shm_export_create */
+
+void shm_export_destroy(void) /* {{{ */
+{
+  pthread_mutex_lock(&export_lock);
+  if (export_map == NULL) {
+    pthread_mutex_unlock(&export_lock);
+    return;
+  }
+
+#if SHM_EXPORT_SUPPORTED
+  __atomic_store_n(&export_header->active, 0, __ATOMIC_RELEASE);
+#endif
+  munmap(export_map, export_map_size);
+  export_map = NULL;
+  export_map_size = 0;
+  export_header = NULL;
+  export_slots_num = 0;
+
+  sfree(export_free);
+  export_free_num = 0;
+  export_full_reported = 0;
+  pthread_mutex_unlock(&export_lock);
+} /* }}} void shm_export_destroy */
+
+int64_t shm_export_alloc(char const *name, size_t values_num) /* {{{ */
+{
+  if ((export_map == NULL) || (name == NULL) ||
+      (strlen(name) >= LCC_SHM_NAME_LEN) || (values_num == 0) ||
+      (values_num > LCC_SHM_VALUES_MAX))
+    return -1;
+
+  int64_t slot = -1;
+
+  pthread_mutex_lock(&export_lock);
+  if (export_free_num > 0) {
+    export_free_num--;
+    slot = (int64_t)export_free[export_free_num];
+  } else if (export_header->slots_used < export_slots_num) {
+    slot = (int64_t)export_header->slots_used;
+#if SHM_EXPORT_SUPPORTED
+    __atomic_store_n(&export_header->slots_used, (uint64_t)slot + 1,
+                     __ATOMIC_RELEASE);
+#endif
+  } else if (!export_full_reported) {
+    export_full_reported = 1;
+    WARNING("shm_export_alloc: All %" PRIsz " slots are used, further "
+            "series are not exported. Consider increasing "
+            "\"CacheExportSlots\".",
+            export_slots_num);
+  }
+  pthread_mutex_unlock(&export_lock);
+
+  return slot;
+} /* }}} int64_t shm_export_alloc */
+
+void shm_export_release(int64_t slot) /* {{{ */
+{
+  if ((slot < 0) || (export_map == NULL))
+    return;
+
+#if SHM_EXPORT_SUPPORTED
+  lcc_shm_slot_t *s = shm_export_slot(slot);
+  shm_export_write_begin(s);
+  s->values_num = 0;
+  s->name[0] = 0;
+  shm_export_write_end(s);
+#endif
+
+  pthread_mutex_lock(&export_lock);
+  uint64_t *tmp =
+      realloc(export_free, (export_free_num + 1) * sizeof(*export_free));
+  if (tmp != NULL) {
+    export_free = tmp;
+    export_free[export_free_num] = (uint64_t)slot;
+    export_free_num++;
+  } else {
+    ERROR("shm_export_release: realloc failed, losing slot %" PRIi64 ".",
+          slot);
+  }
+  pthread_mutex_unlock(&export_lock);
+} /* }}} void shm_export_release */
+
+void shm_export_publish(int64_t slot, char const *name, /* {{{ */
+                        data_set_t const *ds, value_t const *values,
+                        gauge_t const *rates, cdtime_t time,
+                        cdtime_t interval) {
+  if ((slot < 0) || (export_map == NULL) || (ds == NULL) ||
+      (ds->ds_num > LCC_SHM_VALUES_MAX))
+    return;
+
+#if SHM_EXPORT_SUPPORTED
+  lcc_shm_slot_t *s = shm_export_slot(slot);
+  shm_export_write_begin(s);
+  s->time = (uint64_t)time;
+  s->interval = (uint64_t)interval;
+  s->values_num = (uint32_t)ds->ds_num;
+  for (size_t i = 0; i < ds->ds_num; i++) {
+    s->types[i] = (uint8_t)ds->ds[i].type;
+    memcpy(&s->values[i], &values[i], sizeof(s->values[i]));
+    s->rates[i] = rates[i];
+  }
+  if (strcmp(s->name, name) != 0)
+    sstrncpy(s->name, name, sizeof(s->name));
+  shm_export_write_end(s);
+#endif
+} /* }}} void shm_export_publish */
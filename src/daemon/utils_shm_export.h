@@ -0,0 +1,93 @@
+/**
+ * collectd - src/daemon/utils_shm_export.h
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef UTILS_SHM_EXPORT_H
+#define UTILS_SHM_EXPORT_H 1
+
+#include "plugin.h"
+
+/*
+ * NAME
+ *   shm_export_create
+ *
+ * DESCRIPTION
+ *   Creates the shared memory segment to which the value cache is exported,
+ *   see "libcollectdclient/collectd/shm_format.h" for its layout. The segment
+ *   is a file of `slots_num' slots at `path', typically below /dev/shm. It is
+ *   created under a temporary name and renamed to `path', so a segment of an
+ *   earlier instance of the daemon stays valid for readers which still have
+ *   it mapped.
+ *
+ * RETURN VALUE
+ *   Zero on success, an errno value otherwise.
+ */
+int shm_export_create(char const *path, size_t slots_num);
+
+/*
+ * NAME
+ *   shm_export_destroy
+ *
+ * DESCRIPTION
+ *   Marks the segment as inactive and unmaps it. The file is kept, so readers
+ *   can tell that the daemon has been stopped.
+ */
+void shm_export_destroy(void);
+
+/*
+ * NAME
+ *   shm_export_alloc
+ *
+ * DESCRIPTION
+ *   Reserves a slot for the series `name' with `values_num' values.
+ *
+ * RETURN VALUE
+ *   The slot index or -1 if the export is disabled, all slots are used or
+ *   the series doesn't fit into a slot.
+ */
+int64_t shm_export_alloc(char const *name, size_t values_num);
+
+/*
+ * NAME
+ *   shm_export_release
+ *
+ * DESCRIPTION
+ *   Clears the slot `slot' and makes it available to shm_export_alloc().
+ *   Negative slot indexes are ignored.
+ */
+void shm_export_release(int64_t slot);
+
+/*
+ * NAME
+ *   shm_export_publish
+ *
+ * DESCRIPTION
+ *   Writes the values of a series to its slot. Readers never see a partially
+ *   written slot. Only one thread may write to a given slot at a time; the
+ *   value cache guarantees this by holding the lock of the series' shard.
+ *   Negative slot indexes are ignored.
+ */
+void shm_export_publish(int64_t slot, char const *name, data_set_t const *ds,
+                        value_t const *values, gauge_t const *rates,
+                        cdtime_t time, cdtime_t interval);
+
+#endif /* UTILS_SHM_EXPORT_H */
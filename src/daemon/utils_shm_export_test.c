@@ -0,0 +1,150 @@
+/**
+ * collectd - src/daemon/utils_shm_export_test.c
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "common.h"
+#include "libcollectdclient/collectd/shm_format.h"
+#include "testing.h"
+#include "utils_shm_export.h"
+
+#include <sys/mman.h>
+
+static char test_dir[] = "/tmp/collectd-shm-export-test.XXXXXX";
+static char test_file[PATH_MAX];
+
+static data_source_t dsrc[] = {
+    {"rx", DS_TYPE_DERIVE, 0.0, NAN}, {"tx", DS_TYPE_GAUGE, 0.0, NAN},
+};
+static data_set_t ds = {"if_octets", STATIC_ARRAY_SIZE(dsrc), dsrc};
+
+/* Maps the segment like a reader would. */
+static lcc_shm_header_t *map_segment(size_t *ret_size) /* {{{ */
+{
+  int fd = open(test_file, O_RDONLY);
+  if (fd < 0)
+    return NULL;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return NULL;
+  }
+
+  void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return NULL;
+
+  *ret_size = (size_t)st.st_size;
+  return map;
+} /* }}} lcc_shm_header_t *map_segment */
+
+static lcc_shm_slot_t const *get_slot(lcc_shm_header_t const *h, /* {{{ */
+                                      int64_t i) {
+  return (lcc_shm_slot_t const *)((char const *)(h + 1) + i * h->slot_size);
+} /* }}} lcc_shm_slot_t *get_slot */
+
+DEF_TEST(publish) {
+  size_t size;
+  lcc_shm_header_t *h;
+
+  CHECK_ZERO(shm_export_create(test_file, 4));
+  CHECK_NOT_NULL(h = map_segment(&size));
+  EXPECT_EQ_UINT64(LCC_SHM_MAGIC, h->magic);
+  EXPECT_EQ_INT(LCC_SHM_VERSION, (int)h->version);
+  EXPECT_EQ_UINT64(4, h->slots_num);
+  EXPECT_EQ_UINT64(0, h->slots_used);
+  EXPECT_EQ_INT(1, (int)h->active);
+
+  int64_t slot = shm_export_alloc("example.com/interface-eth0/if_octets", 2);
+  EXPECT_EQ_INT(0, (int)slot);
+  EXPECT_EQ_UINT64(1, h->slots_used);
+
+  value_t values[] = {{.derive = 4200}, {.gauge = 42.5}};
+  gauge_t rates[] = {100.0, 42.5};
+  shm_export_publish(slot, "example.com/interface-eth0/if_octets", &ds, values,
+                     rates, TIME_T_TO_CDTIME_T(1000), TIME_T_TO_CDTIME_T(10));
+
+  lcc_shm_slot_t const *s = get_slot(h, slot);
+  EXPECT_EQ_UINT64(2, s->seq);
+  EXPECT_EQ_INT(2, (int)s->values_num);
+  EXPECT_EQ_STR("example.com/interface-eth0/if_octets", s->name);
+  EXPECT_EQ_UINT64(TIME_T_TO_CDTIME_T(1000), s->time);
+  EXPECT_EQ_UINT64(TIME_T_TO_CDTIME_T(10), s->interval);
+  EXPECT_EQ_INT(DS_TYPE_DERIVE, s->types[0]);
+  EXPECT_EQ_INT(DS_TYPE_GAUGE, s->types[1]);
+  EXPECT_EQ_UINT64(4200, s->values[0]);
+  EXPECT_EQ_DOUBLE(100.0, s->rates[0]);
+  EXPECT_EQ_DOUBLE(42.5, s->rates[1]);
+
+  /* Released slots are cleared and reused. */
+  shm_export_release(slot);
+  EXPECT_EQ_UINT64(4, s->seq);
+  EXPECT_EQ_INT(0, (int)s->values_num);
+  EXPECT_EQ_INT(0, (int)shm_export_alloc("example.com/load/load", 3));
+  EXPECT_EQ_UINT64(1, h->slots_used);
+
+  shm_export_destroy();
+  EXPECT_EQ_INT(0, (int)h->active);
+  munmap(h, size);
+  unlink(test_file);
+  return 0;
+}
+
+DEF_TEST(limits) {
+  char name[LCC_SHM_NAME_LEN + 1];
+
+  /* Nothing is exported without a segment. */
+  EXPECT_EQ_INT(-1, (int)shm_export_alloc("example.com/load/load", 3));
+
+  CHECK_ZERO(shm_export_create(test_file, 2));
+
+  memset(name, 'x', sizeof(name) - 1);
+  name[sizeof(name) - 1] = 0;
+  EXPECT_EQ_INT(-1, (int)shm_export_alloc(name, 1));
+  EXPECT_EQ_INT(-1, (int)shm_export_alloc("example.com/load/load",
+                                          LCC_SHM_VALUES_MAX + 1));
+
+  EXPECT_EQ_INT(0, (int)shm_export_alloc("example.com/load/load", 3));
+  EXPECT_EQ_INT(1, (int)shm_export_alloc("example.com/memory/memory-free", 1));
+  EXPECT_EQ_INT(-1, (int)shm_export_alloc("example.com/memory/memory-used", 1));
+
+  shm_export_destroy();
+  unlink(test_file);
+  return 0;
+}
+
+int main(void) {
+  if (mkdtemp(test_dir) == NULL) {
+    printf("mkdtemp failed: %s\n", STRERRNO);
+    return 1;
+  }
+  snprintf(test_file, sizeof(test_file), "%s/cache", test_dir);
+
+  RUN_TEST(publish);
+  RUN_TEST(limits);
+
+  rmdir(test_dir);
+  END_TEST;
+}
@@ -0,0 +1,515 @@
+/**
+ * collectd - src/daemon/utils_spill.c
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "common.h"
+#include "plugin.h"
+#include "utils_crc32.h"
+#include "utils_spill.h"
+
+#include <dirent.h>
+
+/* A segment is completed and a new one is started once it reaches this size,
+ * so that disk space is released while the journal is being read. Smaller
+ * segments are used if the size limit is less than four segments. */
+#ifndef SPILL_SEGMENT_SIZE
+#define SPILL_SEGMENT_SIZE (4 * 1024 * 1024)
+#endif
+#define SPILL_SEGMENT_MIN (64 * 1024)
+
+#define SPILL_SUFFIX ".spill"
+
+/* Each record is a spill_header_t followed by "size" bytes of payload: the
+ * time, the interval and the number of values, the host, plugin, plugin
+ * instance, type and type instance, each as a length byte followed by the
+ * characters, and the values. Numbers are stored in host byte order, since
+ * the journal is only read on the same host. */
+typedef struct {
+  uint32_t size;
+  uint32_t crc;
+} spill_header_t;
+
+#define SPILL_FIELDS_NUM 5
+#define SPILL_PAYLOAD_MIN                                                      \
+  (2 * sizeof(uint64_t) + sizeof(uint16_t) + SPILL_FIELDS_NUM)
+#define SPILL_PAYLOAD_MAX                                                      \
+  (SPILL_PAYLOAD_MIN + SPILL_FIELDS_NUM * DATA_MAX_NAME_LEN +                  \
+   UINT16_MAX * sizeof(value_t))
+
+typedef struct {
+  uint64_t seq;
+  uint64_t size;
+} spill_segment_t;
+
+struct spill_s {
+  pthread_mutex_t lock;
+  char *dir;
+  char *name;
+  uint64_t max_size;
+  uint64_t segment_size;
+
+  /* Segments, oldest first. Records are appended to the last segment and
+   * read from the first one. */
+  spill_segment_t *segments;
+  size_t segments_num;
+  uint64_t next_seq;
+  uint64_t size; /* of all segments */
+  uint64_t lost;
+
+  FILE *wfh; /* NULL if the last segment is complete */
+  FILE *rfh; /* NULL if the first segment hasn't been opened yet */
+  uint64_t read_offset;
+
+  unsigned char *buffer;
+  size_t buffer_size;
+};
+
+static void spill_segment_path(spill_t *s, uint64_t seq, /* {{{ */
+                               char *buffer, size_t buffer_size) {
+  snprintf(buffer, buffer_size, "%s/%s-%08" PRIu64 SPILL_SUFFIX, s->dir,
+           s->name, seq);
+} /* }}} void spill_segment_path */
+
+static int spill_segment_compare(void const *a, void const *b) /* {{{ */
+{
+  spill_segment_t const *sa = a;
+  spill_segment_t const *sb = b;
+
+  if (sa->seq == sb->seq)
+    return 0;
+  return (sa->seq < sb->seq) ? -1 : 1;
+} /* }}} int spill_segment_compare */
+
+static int spill_segment_append(spill_t *s, uint64_t seq, /* {{{ */
+                                uint64_t size) {
+  spill_segment_t *tmp =
+      realloc(s->segments, (s->segments_num + 1) * sizeof(*s->segments));
+  if (tmp == NULL)
+    return ENOMEM;
+  s->segments = tmp;
+
+  s->segments[s->segments_num] = (spill_segment_t){.seq = seq, .size = size};
+  s->segments_num++;
+  s->size += size;
+  return 0;
+} /* }}} int spill_segment_append */
+
+/* Removes the first segment from disk. */
+static void spill_segment_remove_first(spill_t *s) /* {{{ */
+{
+  char path[PATH_MAX];
+
+  if (s->segments_num == 0)
+    return;
+
+  if (s->rfh != NULL) {
+    fclose(s->rfh);
+    s->rfh = NULL;
+  }
+  if ((s->segments_num == 1) && (s->wfh != NULL)) {
+    fclose(s->wfh);
+    s->wfh = NULL;
+  }
+
+  spill_segment_path(s, s->segments[0].seq, path, sizeof(path));
+  if ((unlink(path) != 0) && (errno != ENOENT))
+    WARNING("spill: Removing \"%s\" failed: %s", path, STRERRNO);
+
+  s->size -= s->segments[0].size;
+  s->read_offset = 0;
+  s->segments_num--;
+  memmove(s->segments, s->segments + 1,
+          s->segments_num * sizeof(*s->segments));
+} /* }}} void spill_segment_remove_first */
+
+/* Drops the rest of the first segment, e.g. because it is corrupted. */
+static void spill_segment_drop_first(spill_t *s) /* {{{ */
+{
+  if (s->segments_num == 0)
+    return;
+
+  s->lost += s->segments[0].size - s->read_offset;
+  spill_segment_remove_first(s);
+} /* }}} void spill_segment_drop_first */
+
+/* Finds the segments left by an earlier instance. */
+static int spill_scan(spill_t *s) /* {{{ */
+{
+  size_t name_len = strlen(s->name);
+  struct dirent *de;
+  DIR *dh;
+
+  dh = opendir(s->dir);
+  if (dh == NULL) {
+    int status = errno;
+    ERROR("spill: Opening directory \"%s\" failed: %s", s->dir, STRERRNO);
+    return status;
+  }
+
+  while ((de = readdir(dh)) != NULL) {
+    char const *num = de->d_name + name_len + 1;
+    char path[PATH_MAX];
+    struct stat st;
+    char *end = NULL;
+
+    if ((strncmp(de->d_name, s->name, name_len) != 0) ||
+        (de->d_name[name_len] != '-') || !isdigit((int)num[0]))
+      continue;
+
+    errno = 0;
+    uint64_t seq = (uint64_t)strtoull(num, &end, 10);
+    if ((errno != 0) || (strcmp(end, SPILL_SUFFIX) != 0))
+      continue;
+
+    spill_segment_path(s, seq, path, sizeof(path));
+    if ((stat(path, &st) != 0) || !S_ISREG(st.st_mode))
+      continue;
+
+    if (spill_segment_append(s, seq, (uint64_t)st.st_size) != 0) {
+      closedir(dh);
+      return ENOMEM;
+    }
+    if (seq >= s->next_seq)
+      s->next_seq = seq + 1;
+  }
+  closedir(dh);
+
+  qsort(s->segments, s->segments_num, sizeof(*s->segments),
+        spill_segment_compare);
+
+  if (s->size > 0)
+    INFO("spill: Found %" PRIu64 " bytes in %" PRIsz " segment%s of \"%s\".",
+         s->size, s->segments_num, (s->segments_num == 1) ? "" : "s",
+         s->name);
+  return 0;
+} /* }}} int spill_scan */
+
+spill_t *spill_create(char const *dir, char const *name, /* {{{ */
+                      uint64_t max_size) {
+  char path[PATH_MAX];
+  spill_t *s;
+
+  if ((dir == NULL) || (name == NULL) || (name[0] == 0) || (max_size == 0))
+    return NULL;
+
+  snprintf(path, sizeof(path), "%s/", dir);
+  if (check_create_dir(path) != 0) {
+    ERROR("spill: Creating directory \"%s\" failed.", dir);
+    return NULL;
+  }
+
+  s = calloc(1, sizeof(*s));
+  if (s == NULL)
+    return NULL;
+  pthread_mutex_init(&s->lock, /* attr = */ NULL);
+
+  s->dir = strdup(dir);
+  s->name = strdup(name);
+  if ((s->dir == NULL) || (s->name == NULL)) {
+    spill_destroy(s);
+    return NULL;
+  }
+  for (char *c = s->name; *c != 0; c++)
+    if (!isalnum((int)*c) && (*c != '-') && (*c != '_') && (*c != '.'))
+      *c = '_';
+
+  s->max_size = max_size;
+  s->segment_size = max_size / 4;
+  if (s->segment_size > SPILL_SEGMENT_SIZE)
+    s->segment_size = SPILL_SEGMENT_SIZE;
+  if (s->segment_size < SPILL_SEGMENT_MIN)
+    s->segment_size = SPILL_SEGMENT_MIN;
+  s->next_seq = 1;
+
+  if (spill_scan(s) != 0) {
+    spill_destroy(s);
+    return NULL;
+  }
+
+  return s;
+} /* }}} spill_t *spill_create */
+
+void spill_destroy(spill_t *s) /* {{{ */
+{
+  if (s == NULL)
+    return;
+
+  if (s->wfh != NULL)
+    fclose(s->wfh);
+  if (s->rfh != NULL)
+    fclose(s->rfh);
+
+  /* A partly read segment is read again from the start by the next instance,
+   * i.e. its records may be delivered twice. */
+  pthread_mutex_destroy(&s->lock);
+  sfree(s->segments);
+  sfree(s->buffer);
+  sfree(s->dir);
+  sfree(s->name);
+  sfree(s);
+} /* }}} void spill_destroy */
+
+static int spill_reserve(spill_t *s, size_t size) /* {{{ */
+{
+  if (size <= s->buffer_size)
+    return 0;
+
+  unsigned char *tmp = realloc(s->buffer, size);
+  if (tmp == NULL)
+    return ENOMEM;
+  s->buffer = tmp;
+  s->buffer_size = size;
+  return 0;
+} /* }}} int spill_reserve */
+
+/* Encodes "vl" into the buffer and returns the size of the record, or zero
+ * upon failure. */
+static size_t spill_encode(spill_t *s, value_list_t const *vl) /* {{{ */
+{
+  char const *fields[SPILL_FIELDS_NUM] = {vl->host, vl->plugin,
+                                          vl->plugin_instance, vl->type,
+                                          vl->type_instance};
+
+  if (spill_reserve(s, sizeof(spill_header_t) + SPILL_PAYLOAD_MIN +
+                           SPILL_FIELDS_NUM * DATA_MAX_NAME_LEN +
+                           vl->values_len * sizeof(value_t)) != 0)
+    return 0;
+
+  unsigned char *payload = s->buffer + sizeof(spill_header_t);
+  unsigned char *ptr = payload;
+
+  uint64_t time = (uint64_t)vl->time;
+  uint64_t interval = (uint64_t)vl->interval;
+  uint16_t values_len = (uint16_t)vl->values_len;
+  memcpy(ptr, &time, sizeof(time));
+  ptr += sizeof(time);
+  memcpy(ptr, &interval, sizeof(interval));
+  ptr += sizeof(interval);
+  memcpy(ptr, &values_len, sizeof(values_len));
+  ptr += sizeof(values_len);
+
+  for (size_t i = 0; i < SPILL_FIELDS_NUM; i++) {
+    size_t len = strnlen(fields[i], DATA_MAX_NAME_LEN - 1);
+    *ptr++ = (unsigned char)len;
+    memcpy(ptr, fields[i], len);
+    ptr += len;
+  }
+
+  memcpy(ptr, vl->values, vl->values_len * sizeof(value_t));
+  ptr += vl->values_len * sizeof(value_t);
+
+  spill_header_t hdr = {
+      .size = (uint32_t)(ptr - payload),
+      .crc = crc32_buffer(payload, (size_t)(ptr - payload)),
+  };
+  memcpy(s->buffer, &hdr, sizeof(hdr));
+
+  return sizeof(hdr) + hdr.size;
+} /* }}} size_t spill_encode */
+
+int spill_write(spill_t *s, value_list_t const *vl) /* {{{ */
+{
+  if ((s == NULL) || (vl == NULL) || (vl->values_len > UINT16_MAX))
+    return EINVAL;
+
+  pthread_mutex_lock(&s->lock);
+
+  size_t size = spill_encode(s, vl);
+  if (size == 0) {
+    pthread_mutex_unlock(&s->lock);
+    return ENOMEM;
+  }
+
+  if (s->wfh == NULL) {
+    char path[PATH_MAX];
+    uint64_t seq = s->next_seq;
+
+    spill_segment_path(s, seq, path, sizeof(path));
+    s->wfh = fopen(path, "w");
+    if (s->wfh == NULL) {
+      int status = errno;
+      pthread_mutex_unlock(&s->lock);
+      ERROR("spill: Opening \"%s\" failed: %s", path, STRERROR(status));
+      return status;
+    }
+    if (spill_segment_append(s, seq, 0) != 0) {
+      fclose(s->wfh);
+      s->wfh = NULL;
+      unlink(path);
+      pthread_mutex_unlock(&s->lock);
+      return ENOMEM;
+    }
+    s->next_seq++;
+  }
+
+  /* A partly written record is skipped when reading. */
+  int status = 0;
+  if (fwrite(s->buffer, 1, size, s->wfh) != size)
+    status = (errno != 0) ? errno : EIO;
+
+  spill_segment_t *seg = s->segments + (s->segments_num - 1);
+  seg->size += size;
+  s->size += size;
+  if ((status != 0) || (seg->size >= s->segment_size)) {
+    fclose(s->wfh);
+    s->wfh = NULL;
+  }
+
+  while ((s->size > s->max_size) && (s->segments_num > 1))
+    spill_segment_drop_first(s);
+
+  pthread_mutex_unlock(&s->lock);
+
+  if (status != 0)
+    ERROR("spill: Writing to \"%s\" failed: %s", s->name, STRERROR(status));
+  return status;
+} /* }}} int spill_write */
+
+static int spill_decode(unsigned char const *ptr, size_t size, /* {{{ */
+                        value_list_t *vl) {
+  unsigned char const *end = ptr + size;
+  char *fields[SPILL_FIELDS_NUM] = {vl->host, vl->plugin, vl->plugin_instance,
+                                    vl->type, vl->type_instance};
+  uint64_t time;
+  uint64_t interval;
+  uint16_t values_len;
+
+  memcpy(&time, ptr, sizeof(time));
+  ptr += sizeof(time);
+  memcpy(&interval, ptr, sizeof(interval));
+  ptr += sizeof(interval);
+  memcpy(&values_len, ptr, sizeof(values_len));
+  ptr += sizeof(values_len);
+
+  for (size_t i = 0; i < SPILL_FIELDS_NUM; i++) {
+    size_t len = (size_t)*ptr++;
+    if ((len >= DATA_MAX_NAME_LEN) || (len > (size_t)(end - ptr)))
+      return EBADMSG;
+    memcpy(fields[i], ptr, len);
+    fields[i][len] = 0;
+    ptr += len;
+  }
+
+  if ((values_len == 0) ||
+      ((size_t)(end - ptr) != values_len * sizeof(value_t)))
+    return EBADMSG;
+
+  vl->values = malloc(values_len * sizeof(*vl->values));
+  if (vl->values == NULL)
+    return ENOMEM;
+  memcpy(vl->values, ptr, values_len * sizeof(*vl->values));
+  vl->values_len = values_len;
+  vl->time = (cdtime_t)time;
+  vl->interval = (cdtime_t)interval;
+
+  return 0;
+} /* }}} int spill_decode */
+
+int spill_read(spill_t *s, value_list_t *vl) /* {{{ */
+{
+  if ((s == NULL) || (vl == NULL))
+    return EINVAL;
+
+  pthread_mutex_lock(&s->lock);
+
+  while (s->segments_num > 0) {
+    if (s->rfh == NULL) {
+      char path[PATH_MAX];
+
+      /* Complete the segment being written before reading it. */
+      if ((s->segments_num == 1) && (s->wfh != NULL)) {
+        fclose(s->wfh);
+        s->wfh = NULL;
+      }
+
+      spill_segment_path(s, s->segments[0].seq, path, sizeof(path));
+      s->rfh = fopen(path, "r");
+      s->read_offset = 0;
+      if (s->rfh == NULL) {
+        ERROR("spill: Opening \"%s\" failed: %s", path, STRERRNO);
+        spill_segment_drop_first(s);
+        continue;
+      }
+    }
+
+    spill_header_t hdr;
+    size_t n = fread(&hdr, 1, sizeof(hdr), s->rfh);
+    if (n == 0) { /* end of the segment */
+      spill_segment_remove_first(s);
+      continue;
+    } else if ((n != sizeof(hdr)) || (hdr.size < SPILL_PAYLOAD_MIN) ||
+               (hdr.size > SPILL_PAYLOAD_MAX) ||
+               (spill_reserve(s, hdr.size) != 0) ||
+               (fread(s->buffer, 1, hdr.size, s->rfh) != hdr.size)) {
+      spill_segment_drop_first(s);
+      continue;
+    }
+    s->read_offset += sizeof(hdr) + hdr.size;
+
+    if (crc32_buffer(s->buffer, hdr.size) != hdr.crc) {
+      s->lost += sizeof(hdr) + hdr.size;
+      continue;
+    }
+
+    *vl = (value_list_t)VALUE_LIST_INIT;
+    int status = spill_decode(s->buffer, hdr.size, vl);
+    if (status == ENOMEM) {
+      pthread_mutex_unlock(&s->lock);
+      return status;
+    } else if (status != 0) {
+      s->lost += sizeof(hdr) + hdr.size;
+      continue;
+    }
+
+    pthread_mutex_unlock(&s->lock);
+    return 0;
+  }
+
+  pthread_mutex_unlock(&s->lock);
+  return ENOENT;
+} /* }}} int spill_read */
+
+uint64_t spill_pending(spill_t *s) /* {{{ */
+{
+  if (s == NULL)
+    return 0;
+
+  pthread_mutex_lock(&s->lock);
+  uint64_t pending = s->size - s->read_offset;
+  pthread_mutex_unlock(&s->lock);
+
+  return pending;
+} /* }}} uint64_t spill_pending */
+
+uint64_t spill_lost(spill_t *s) /* {{{ */
+{
+  if (s == NULL)
+    return 0;
+
+  pthread_mutex_lock(&s->lock);
+  uint64_t lost = s->lost;
+  pthread_mutex_unlock(&s->lock);
+
+  return lost;
+} /* }}} uint64_t spill_lost */
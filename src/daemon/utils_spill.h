@@ -0,0 +1,116 @@
+/**
+ * collectd - src/daemon/utils_spill.h
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef UTILS_SPILL_H
+#define UTILS_SPILL_H 1
+
+#include "plugin.h"
+
+struct spill_s;
+typedef struct spill_s spill_t;
+
+/*
+ * NAME
+ *   spill_create
+ *
+ * DESCRIPTION
+ *   Opens the spill journal `name' in the directory `dir', creating the
+ *   directory if required. The journal is a first-in, first-out queue of
+ *   value lists stored in a sequence of append-only segment files named
+ *   "<name>-<sequence>.spill". Each record carries a checksum; records which
+ *   fail the check, e.g. because the daemon crashed while writing them, are
+ *   skipped when reading. Segments left by an earlier instance of the daemon
+ *   are read before any new records. All functions may be called from
+ *   several threads at once.
+ *
+ * PARAMETERS
+ *   `dir'       Directory holding the segment files.
+ *   `name'      Name of the journal. Characters other than letters, digits,
+ *               '-', '_' and '.' are replaced with '_' in file names.
+ *   `max_size'  Maximum size of all segments in bytes. When it is exceeded,
+ *               the oldest segment is removed and its records are lost.
+ *
+ * RETURN VALUE
+ *   A spill_t-pointer upon success or NULL upon failure.
+ */
+spill_t *spill_create(char const *dir, char const *name, uint64_t max_size);
+
+/*
+ * NAME
+ *   spill_destroy
+ *
+ * DESCRIPTION
+ *   Closes the journal. Segments which have not been read completely are
+ *   kept, so that they are read by the next spill_create() of the same name.
+ */
+void spill_destroy(spill_t *s);
+
+/*
+ * NAME
+ *   spill_write
+ *
+ * DESCRIPTION
+ *   Appends the identifier, time, interval and values of `vl' to the
+ *   journal. Meta data is not stored.
+ *
+ * RETURN VALUE
+ *   Zero on success, an errno value otherwise.
+ */
+int spill_write(spill_t *s, value_list_t const *vl);
+
+/*
+ * NAME
+ *   spill_read
+ *
+ * DESCRIPTION
+ *   Removes the oldest value list from the journal and stores it in `vl'.
+ *   `vl->values' is allocated with malloc(3) and must be freed by the
+ *   caller.
+ *
+ * RETURN VALUE
+ *   Zero on success, ENOENT if the journal is empty or another errno value
+ *   upon failure.
+ */
+int spill_read(spill_t *s, value_list_t *vl);
+
+/*
+ * NAME
+ *   spill_pending
+ *
+ * DESCRIPTION
+ *   Returns the number of bytes which have been written to the journal but
+ *   not read yet. Zero means that the journal is empty.
+ */
+uint64_t spill_pending(spill_t *s);
+
+/*
+ * NAME
+ *   spill_lost
+ *
+ * DESCRIPTION
+ *   Returns the number of bytes of records which have been lost, because the
+ *   size limit was exceeded or because they were corrupted.
+ */
+uint64_t spill_lost(spill_t *s);
+
+#endif /* UTILS_SPILL_H */
@@ -0,0 +1,243 @@
+/**
+ * collectd - src/daemon/utils_spill_test.c
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "common.h"
+#include "testing.h"
+#include "utils_spill.h"
+
+#include <dirent.h>
+
+static char test_dir[] = "/tmp/collectd-spill-test.XXXXXX";
+
+static void make_vl(value_list_t *vl, value_t *values, uint64_t i) /* {{{ */
+{
+  *vl = (value_list_t)VALUE_LIST_INIT;
+  values[0].derive = (derive_t)i;
+  values[1].gauge = (gauge_t)i / 2.0;
+  vl->values = values;
+  vl->values_len = 2;
+  vl->time = TIME_T_TO_CDTIME_T(1000 + i);
+  vl->interval = TIME_T_TO_CDTIME_T(10);
+  sstrncpy(vl->host, "example.com", sizeof(vl->host));
+  sstrncpy(vl->plugin, "test", sizeof(vl->plugin));
+  snprintf(vl->plugin_instance, sizeof(vl->plugin_instance), "%" PRIu64, i);
+  sstrncpy(vl->type, "if_octets", sizeof(vl->type));
+} /* }}} void make_vl */
+
+static int check_vl(value_list_t *vl, uint64_t i) /* {{{ */
+{
+  char want[DATA_MAX_NAME_LEN];
+
+  snprintf(want, sizeof(want), "%" PRIu64, i);
+  EXPECT_EQ_STR("example.com", vl->host);
+  EXPECT_EQ_STR("test", vl->plugin);
+  EXPECT_EQ_STR(want, vl->plugin_instance);
+  EXPECT_EQ_STR("if_octets", vl->type);
+  EXPECT_EQ_STR("", vl->type_instance);
+  EXPECT_EQ_UINT64(TIME_T_TO_CDTIME_T(1000 + i), vl->time);
+  EXPECT_EQ_UINT64(TIME_T_TO_CDTIME_T(10), vl->interval);
+  EXPECT_EQ_INT(2, (int)vl->values_len);
+  EXPECT_EQ_INT((int)i, (int)vl->values[0].derive);
+  EXPECT_EQ_DOUBLE((gauge_t)i / 2.0, vl->values[1].gauge);
+  return 0;
+} /* }}} int check_vl */
+
+static void remove_files(void) /* {{{ */
+{
+  DIR *dh = opendir(test_dir);
+  struct dirent *de;
+
+  while ((dh != NULL) && ((de = readdir(dh)) != NULL)) {
+    char path[PATH_MAX];
+    if (de->d_name[0] == '.')
+      continue;
+    snprintf(path, sizeof(path), "%s/%s", test_dir, de->d_name);
+    unlink(path);
+  }
+  if (dh != NULL)
+    closedir(dh);
+} /* }}} void remove_files */
+
+DEF_TEST(fifo) {
+  spill_t *s;
+  value_list_t vl;
+  value_t values[2];
+
+  CHECK_NOT_NULL(s = spill_create(test_dir, "write_test/a", 1 << 20));
+  EXPECT_EQ_UINT64(0, spill_pending(s));
+  EXPECT_EQ_INT(ENOENT, spill_read(s, &vl));
+
+  for (uint64_t i = 0; i < 100; i++) {
+    make_vl(&vl, values, i);
+    EXPECT_EQ_INT(0, spill_write(s, &vl));
+  }
+  OK(spill_pending(s) > 0);
+
+  /* Reading and writing can be interleaved. */
+  for (uint64_t i = 0; i < 200; i++) {
+    if (i < 100) {
+      make_vl(&vl, values, 100 + i);
+      EXPECT_EQ_INT(0, spill_write(s, &vl));
+    }
+
+    EXPECT_EQ_INT(0, spill_read(s, &vl));
+    CHECK_ZERO(check_vl(&vl, i));
+    sfree(vl.values);
+  }
+
+  EXPECT_EQ_INT(ENOENT, spill_read(s, &vl));
+  EXPECT_EQ_UINT64(0, spill_pending(s));
+  EXPECT_EQ_UINT64(0, spill_lost(s));
+
+  spill_destroy(s);
+  remove_files();
+  return 0;
+}
+
+DEF_TEST(reopen) {
+  spill_t *s;
+  value_list_t vl;
+  value_t values[2];
+
+  CHECK_NOT_NULL(s = spill_create(test_dir, "reopen", 1 << 20));
+  for (uint64_t i = 0; i < 10; i++) {
+    make_vl(&vl, values, i);
+    EXPECT_EQ_INT(0, spill_write(s, &vl));
+  }
+  spill_destroy(s);
+
+  /* Another journal in the same directory doesn't see the records. */
+  CHECK_NOT_NULL(s = spill_create(test_dir, "other", 1 << 20));
+  EXPECT_EQ_INT(ENOENT, spill_read(s, &vl));
+  spill_destroy(s);
+
+  CHECK_NOT_NULL(s = spill_create(test_dir, "reopen", 1 << 20));
+  OK(spill_pending(s) > 0);
+
+  /* New records are read after the old ones. */
+  make_vl(&vl, values, 10);
+  EXPECT_EQ_INT(0, spill_write(s, &vl));
+
+  for (uint64_t i = 0; i <= 10; i++) {
+    EXPECT_EQ_INT(0, spill_read(s, &vl));
+    CHECK_ZERO(check_vl(&vl, i));
+    sfree(vl.values);
+  }
+  EXPECT_EQ_INT(ENOENT, spill_read(s, &vl));
+
+  spill_destroy(s);
+  remove_files();
+  return 0;
+}
+
+DEF_TEST(corrupted) {
+  spill_t *s;
+  value_list_t vl;
+  value_t values[2];
+  char path[PATH_MAX];
+  size_t record_size;
+  struct stat st;
+
+  CHECK_NOT_NULL(s = spill_create(test_dir, "corrupted", 1 << 20));
+  for (uint64_t i = 0; i < 3; i++) {
+    make_vl(&vl, values, i);
+    EXPECT_EQ_INT(0, spill_write(s, &vl));
+  }
+  spill_destroy(s);
+
+  /* All records have the same size. Flip a bit in the second record and
+   * cut the third one short. */
+  snprintf(path, sizeof(path), "%s/corrupted-00000001.spill", test_dir);
+  CHECK_ZERO(stat(path, &st));
+  record_size = (size_t)st.st_size / 3;
+
+  FILE *fh = fopen(path, "r+");
+  CHECK_NOT_NULL(fh);
+  fseek(fh, (long)(record_size + record_size / 2), SEEK_SET);
+  int c = fgetc(fh);
+  fseek(fh, (long)(record_size + record_size / 2), SEEK_SET);
+  fputc(c ^ 0x01, fh);
+  fclose(fh);
+  CHECK_ZERO(truncate(path, (off_t)(3 * record_size - 1)));
+
+  CHECK_NOT_NULL(s = spill_create(test_dir, "corrupted", 1 << 20));
+  EXPECT_EQ_INT(0, spill_read(s, &vl));
+  CHECK_ZERO(check_vl(&vl, 0));
+  sfree(vl.values);
+  EXPECT_EQ_INT(ENOENT, spill_read(s, &vl));
+  EXPECT_EQ_UINT64(2 * record_size - 1, spill_lost(s));
+
+  spill_destroy(s);
+  remove_files();
+  return 0;
+}
+
+DEF_TEST(limit) {
+  spill_t *s;
+  value_list_t vl;
+  value_t values[2];
+  uint64_t written = 0;
+
+  /* Segments are 64 KiB, so four segments fit. */
+  CHECK_NOT_NULL(s = spill_create(test_dir, "limit", 256 * 1024));
+  while (spill_lost(s) == 0) {
+    make_vl(&vl, values, written);
+    EXPECT_EQ_INT(0, spill_write(s, &vl));
+    written++;
+  }
+  OK(spill_pending(s) <= 256 * 1024);
+
+  /* The oldest records have been lost, the remaining ones are in order. */
+  EXPECT_EQ_INT(0, spill_read(s, &vl));
+  uint64_t first = (uint64_t)vl.values[0].derive;
+  OK(first > 0);
+  sfree(vl.values);
+
+  for (uint64_t i = first + 1; i < written; i++) {
+    EXPECT_EQ_INT(0, spill_read(s, &vl));
+    CHECK_ZERO(check_vl(&vl, i));
+    sfree(vl.values);
+  }
+  EXPECT_EQ_INT(ENOENT, spill_read(s, &vl));
+
+  spill_destroy(s);
+  remove_files();
+  return 0;
+}
+
+int main(void) {
+  if (mkdtemp(test_dir) == NULL) {
+    printf("mkdtemp failed: %s\n", STRERRNO);
+    return 1;
+  }
+
+  RUN_TEST(fifo);
+  RUN_TEST(reopen);
+  RUN_TEST(corrupted);
+  RUN_TEST(limit);
+
+  rmdir(test_dir);
+  END_TEST;
+}
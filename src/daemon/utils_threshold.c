@@ -28,6 +28,7 @@
 
 #include "common.h"
 #include "utils_avltree.h"
+#include "utils_cache.h"
 #include "utils_threshold.h"
 
 #include <pthread.h>
@@ -63,52 +64,201 @@ threshold_t *threshold_get(const char *hostname, const char *plugin,
     return NULL;
 } /* }}} threshold_t *threshold_get */
 
+/*
+ * Threshold index
+ *
+ * A threshold applies to the value lists whose fields equal its non-empty
+ * fields. threshold_search() tries the variations below, most specific first,
+ * and returns the first threshold found. All thresholds are kept in one hash
+ * table keyed by their fields, so each variation costs one hash probe. Only
+ * variations some threshold actually uses are tried, and variations that are
+ * the same for a given value list, because it has no plugin or type instance,
+ * only once. The index is rebuilt whenever a threshold is added to
+ * "threshold_tree"; thresholds appended to an existing threshold's "next" list
+ * don't change it.
+ * {{{ */
+#define TH_HOST 0x01
+#define TH_PLUGIN 0x02
+#define TH_PLUGIN_INSTANCE 0x04
+#define TH_TYPE_INSTANCE 0x08
+
+static unsigned int const threshold_variations[] = {
+    TH_HOST | TH_PLUGIN | TH_PLUGIN_INSTANCE | TH_TYPE_INSTANCE,
+    TH_HOST | TH_PLUGIN | TH_PLUGIN_INSTANCE,
+    TH_HOST | TH_PLUGIN | TH_TYPE_INSTANCE,
+    TH_HOST | TH_PLUGIN,
+    TH_HOST | TH_TYPE_INSTANCE,
+    TH_HOST,
+    TH_PLUGIN | TH_PLUGIN_INSTANCE | TH_TYPE_INSTANCE,
+    TH_PLUGIN | TH_PLUGIN_INSTANCE,
+    TH_PLUGIN | TH_TYPE_INSTANCE,
+    TH_PLUGIN,
+    TH_TYPE_INSTANCE,
+    0,
+};
+
+typedef struct {
+  uint64_t hash;
+  threshold_t *th; /* NULL if the slot is empty */
+} threshold_slot_t;
+
+static threshold_slot_t *threshold_slots;
+static size_t threshold_slots_num; /* power of two */
+/* Bit (1 << fields) is set if a threshold with these fields exists. */
+static uint32_t threshold_fields_used;
+/* c_avl_size() of "threshold_tree" when the index was built. */
+static int threshold_indexed_num;
+/* Bumped whenever the index is rebuilt, see uc_threshold_get(). */
+static uint64_t threshold_generation;
+
+static uint64_t threshold_hash(const char *host, const char *plugin,
+                               const char *plugin_instance, const char *type,
+                               const char *type_instance) { /* {{{ */
+  char const *fields[] = {host, plugin, plugin_instance, type, type_instance};
+  uint64_t hash = 14695981039346656037ULL; /* FNV-1a */
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(fields); i++) {
+    /* Hash the terminating null byte, too, so fields can't run into each
+     * other. */
+    for (char const *c = fields[i];; c++) {
+      hash = (hash ^ (uint8_t)*c) * 1099511628211ULL;
+      if (*c == 0)
+        break;
+    }
+  }
+
+  return hash;
+} /* }}} uint64_t threshold_hash */
+
+static unsigned int threshold_fields(const char *host, const char *plugin,
+                                     const char *plugin_instance,
+                                     const char *type_instance) { /* {{{ */
+  return ((host[0] != 0) ? TH_HOST : 0) | ((plugin[0] != 0) ? TH_PLUGIN : 0) |
+         ((plugin_instance[0] != 0) ? TH_PLUGIN_INSTANCE : 0) |
+         ((type_instance[0] != 0) ? TH_TYPE_INSTANCE : 0);
+} /* }}} unsigned int threshold_fields */
+
+static int threshold_index_build(void) /* {{{ */
+{
+  int num = c_avl_size(threshold_tree);
+  size_t slots_num = 16;
+  while (slots_num < 2 * (size_t)num)
+    slots_num *= 2;
+
+  threshold_slot_t *slots = calloc(slots_num, sizeof(*slots));
+  if (slots == NULL)
+    return ENOMEM;
+
+  uint32_t fields_used = 0;
+  c_avl_iterator_t *iter = c_avl_get_iterator(threshold_tree);
+  char *name;
+  threshold_t *th;
+  while (c_avl_iterator_next(iter, (void *)&name, (void *)&th) == 0) {
+    uint64_t hash = threshold_hash(th->host, th->plugin, th->plugin_instance,
+                                   th->type, th->type_instance);
+    size_t i = (size_t)hash & (slots_num - 1);
+    while (slots[i].th != NULL)
+      i = (i + 1) & (slots_num - 1);
+
+    slots[i] = (threshold_slot_t){.hash = hash, .th = th};
+    fields_used |= 1 << threshold_fields(th->host, th->plugin,
+                                         th->plugin_instance,
+                                         th->type_instance);
+  }
+  c_avl_iterator_destroy(iter);
+
+  sfree(threshold_slots);
+  threshold_slots = slots;
+  threshold_slots_num = slots_num;
+  threshold_fields_used = fields_used;
+  threshold_indexed_num = num;
+  threshold_generation++;
+
+  return 0;
+} /* }}} int threshold_index_build */
+
+static threshold_t *threshold_index_get(const char *host, const char *plugin,
+                                        const char *plugin_instance,
+                                        const char *type,
+                                        const char *type_instance) { /* {{{ */
+  uint64_t hash =
+      threshold_hash(host, plugin, plugin_instance, type, type_instance);
+
+  for (size_t i = (size_t)hash & (threshold_slots_num - 1);
+       threshold_slots[i].th != NULL; i = (i + 1) & (threshold_slots_num - 1)) {
+    threshold_t *th = threshold_slots[i].th;
+
+    if ((threshold_slots[i].hash == hash) && (strcmp(th->type, type) == 0) &&
+        (strcmp(th->type_instance, type_instance) == 0) &&
+        (strcmp(th->plugin, plugin) == 0) &&
+        (strcmp(th->plugin_instance, plugin_instance) == 0) &&
+        (strcmp(th->host, host) == 0))
+      return th;
+  }
+
+  return NULL;
+} /* }}} threshold_t *threshold_index_get */
+
+static threshold_t *threshold_index_search(const value_list_t *vl) /* {{{ */
+{
+  unsigned int vl_fields = threshold_fields(vl->host, vl->plugin,
+                                            vl->plugin_instance,
+                                            vl->type_instance);
+  uint32_t tried = 0;
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(threshold_variations); i++) {
+    unsigned int fields = threshold_variations[i] & vl_fields;
+    if (((threshold_fields_used & (1 << fields)) == 0) ||
+        ((tried & (1 << fields)) != 0))
+      continue;
+    tried |= 1 << fields;
+
+    threshold_t *th =
+        threshold_index_get((fields & TH_HOST) ? vl->host : "",
+                            (fields & TH_PLUGIN) ? vl->plugin : "",
+                            (fields & TH_PLUGIN_INSTANCE) ? vl->plugin_instance
+                                                          : "",
+                            vl->type,
+                            (fields & TH_TYPE_INSTANCE) ? vl->type_instance
+                                                        : "");
+    if (th != NULL)
+      return th;
+  }
+
+  return NULL;
+} /* }}} threshold_t *threshold_index_search */
+/* }}} */
+
 /*
  * threshold_t *threshold_search
  *
  * Searches for a threshold configuration using all the possible variations of
  * "Host", "Plugin" and "Type" blocks. Returns NULL if no threshold could be
- * found.
- * XXX: This is likely the least efficient function in collectd.
+ * found. The result is remembered in the value cache, so for series known to
+ * the cache the search is done only once. Must be called with
+ * "threshold_lock" held.
  */
 threshold_t *threshold_search(const value_list_t *vl) { /* {{{ */
-  threshold_t *th;
+  value_list_identity_t const *identity = VALUE_LIST_IDENTITY(vl);
+  threshold_t *th = NULL;
 
-  if ((th = threshold_get(vl->host, vl->plugin, vl->plugin_instance, vl->type,
-                          vl->type_instance)) != NULL)
-    return th;
-  else if ((th = threshold_get(vl->host, vl->plugin, vl->plugin_instance,
-                               vl->type, NULL)) != NULL)
-    return th;
-  else if ((th = threshold_get(vl->host, vl->plugin, NULL, vl->type,
-                               vl->type_instance)) != NULL)
-    return th;
-  else if ((th = threshold_get(vl->host, vl->plugin, NULL, vl->type, NULL)) !=
-           NULL)
-    return th;
-  else if ((th = threshold_get(vl->host, "", NULL, vl->type,
-                               vl->type_instance)) != NULL)
-    return th;
-  else if ((th = threshold_get(vl->host, "", NULL, vl->type, NULL)) != NULL)
-    return th;
-  else if ((th = threshold_get("", vl->plugin, vl->plugin_instance, vl->type,
-                               vl->type_instance)) != NULL)
-    return th;
-  else if ((th = threshold_get("", vl->plugin, vl->plugin_instance, vl->type,
-                               NULL)) != NULL)
-    return th;
-  else if ((th = threshold_get("", vl->plugin, NULL, vl->type,
-                               vl->type_instance)) != NULL)
-    return th;
-  else if ((th = threshold_get("", vl->plugin, NULL, vl->type, NULL)) != NULL)
-    return th;
-  else if ((th = threshold_get("", "", NULL, vl->type, vl->type_instance)) !=
-           NULL)
-    return th;
-  else if ((th = threshold_get("", "", NULL, vl->type, NULL)) != NULL)
+  if (threshold_indexed_num != c_avl_size(threshold_tree)) {
+    if (threshold_index_build() != 0) {
+      ERROR("threshold_search: Building the threshold index failed.");
+      return NULL;
+    }
+  }
+
+  if ((identity != NULL) &&
+      (uc_threshold_get(identity, threshold_generation, (void *)&th) == 0))
     return th;
 
-  return NULL;
+  th = threshold_index_search(vl);
+
+  if (identity != NULL)
+    uc_threshold_set(identity, threshold_generation, th);
+
+  return th;
 } /* }}} threshold_t *threshold_search */
 
 int ut_search_threshold(const value_list_t *vl, /* {{{ */
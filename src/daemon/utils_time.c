@@ -38,21 +38,48 @@
 cdtime_t cdtime_mock = (cdtime_t)MOCK_TIME;
 
 cdtime_t cdtime(void) { return cdtime_mock; }
+cdtime_t cdtime_precise(void) { return cdtime_mock; }
+int cdtime_set_clock(int clock) { return 0; }
 #else /* !MOCK_TIME */
 #if HAVE_CLOCK_GETTIME
-cdtime_t cdtime(void) /* {{{ */
+/* Set once at startup, before any threads are started. */
+static clockid_t cdtime_clock = CLOCK_REALTIME;
+
+static cdtime_t cdtime_clock_get(clockid_t clock) /* {{{ */
 {
   int status;
   struct timespec ts = {0, 0};
 
-  status = clock_gettime(CLOCK_REALTIME, &ts);
+  status = clock_gettime(clock, &ts);
   if (status != 0) {
     ERROR("cdtime: clock_gettime failed: %s", STRERRNO);
     return 0;
   }
 
   return TIMESPEC_TO_CDTIME_T(&ts);
-} /* }}} cdtime_t cdtime */
+} /* }}} cdtime_t cdtime_clock_get */
+
+cdtime_t cdtime(void) { return cdtime_clock_get(cdtime_clock); }
+
+cdtime_t cdtime_precise(void) { return cdtime_clock_get(CLOCK_REALTIME); }
+
+int cdtime_set_clock(int clock) /* {{{ */
+{
+  if (clock == CDTIME_CLOCK_PRECISE) {
+    cdtime_clock = CLOCK_REALTIME;
+    return 0;
+  } else if (clock != CDTIME_CLOCK_COARSE)
+    return EINVAL;
+
+#ifdef CLOCK_REALTIME_COARSE
+  struct timespec ts;
+  if (clock_gettime(CLOCK_REALTIME_COARSE, &ts) == 0) {
+    cdtime_clock = CLOCK_REALTIME_COARSE;
+    return 0;
+  }
+#endif
+  return ENOTSUP;
+} /* }}} int cdtime_set_clock */
 #else /* !HAVE_CLOCK_GETTIME */
 /* Work around for Mac OS X which doesn't have clock_gettime(2). *sigh* */
 cdtime_t cdtime(void) /* {{{ */
@@ -68,6 +95,15 @@ cdtime_t cdtime(void) /* {{{ */
 
   return TIMEVAL_TO_CDTIME_T(&tv);
 } /* }}} cdtime_t cdtime */
+
+cdtime_t cdtime_precise(void) { return cdtime(); }
+
+int cdtime_set_clock(int clock) /* {{{ */
+{
+  if (clock == CDTIME_CLOCK_PRECISE)
+    return 0;
+  return (clock == CDTIME_CLOCK_COARSE) ? ENOTSUP : EINVAL;
+} /* }}} int cdtime_set_clock */
 #endif
 #endif
 
@@ -108,8 +108,24 @@ extern cdtime_t cdtime_mock;
 #define TIMESPEC_TO_CDTIME_T(ts)                                               \
   NS_TO_CDTIME_T(1000000000ULL * (ts)->tv_sec + (ts)->tv_nsec)
 
+/* cdtime returns the current time. Depending on cdtime_set_clock(), it may
+ * only be accurate to a few milliseconds, which is good enough for time
+ * stamps. Use cdtime_precise to measure durations. */
 cdtime_t cdtime(void);
 
+/* cdtime_precise returns the current time with the full resolution of the
+ * system clock. */
+cdtime_t cdtime_precise(void);
+
+#define CDTIME_CLOCK_PRECISE 0
+#define CDTIME_CLOCK_COARSE 1
+
+/* cdtime_set_clock selects the clock used by cdtime. CDTIME_CLOCK_COARSE uses
+ * CLOCK_REALTIME_COARSE where available, which is much cheaper to read.
+ * Returns ENOTSUP if the clock is not available on this system. Must be
+ * called before any threads are started. */
+int cdtime_set_clock(int clock);
+
 #define RFC3339_SIZE 26     /* 2006-01-02T15:04:05+00:00 */
 #define RFC3339NANO_SIZE 36 /* 2006-01-02T15:04:05.999999999+00:00 */
 
@@ -58,6 +58,22 @@ struct cdbi_driver_option_s /* {{{ */
 };
 typedef struct cdbi_driver_option_s cdbi_driver_option_t; /* }}} */
 
+struct cdbi_database_s;
+typedef struct cdbi_database_s cdbi_database_t;
+
+/* One connection of a database's pool. Every connection has its own read
+ * callback and executes every `connections_num'th query, starting at
+ * `index', so that a slow query does not hold up the queries assigned to the
+ * other connections. */
+struct cdbi_connection_s /* {{{ */
+{
+  cdbi_database_t *db;
+  size_t index;
+
+  dbi_conn connection;
+};
+typedef struct cdbi_connection_s cdbi_connection_t; /* }}} */
+
 struct cdbi_database_s /* {{{ */
 {
   char *name;
@@ -75,9 +91,9 @@ struct cdbi_database_s /* {{{ */
   udb_query_t **queries;
   size_t queries_num;
 
-  dbi_conn connection;
-};
-typedef struct cdbi_database_s cdbi_database_t; /* }}} */
+  cdbi_connection_t *connections;
+  size_t connections_num;
+}; /* }}} */
 
 /*
  * Global variables
@@ -193,6 +209,12 @@ static void cdbi_database_free(cdbi_database_t *db) /* {{{ */
    * variable. Free the array here, but not the content. */
   sfree(db->queries);
 
+  for (size_t i = 0; i < db->connections_num; i++) {
+    if (db->connections[i].connection != NULL)
+      dbi_conn_close(db->connections[i].connection);
+  }
+  sfree(db->connections);
+
   sfree(db);
 } /* }}} void cdbi_database_free */
 
@@ -215,6 +237,7 @@ static void cdbi_database_free(cdbi_database_t *db) /* {{{ */
  *     DriverOption "hostname" "localhost"
  *     ...
  *     Query "plugin_instance0"
+ *     Connections 2
  *   </Database>
  * </Plugin>
  */
@@ -268,6 +291,7 @@ static int cdbi_config_add_database_driver_option(cdbi_database_t *db, /* {{{ */
 static int cdbi_config_add_database(oconfig_item_t *ci) /* {{{ */
 {
   cdbi_database_t *db;
+  int connections_num = 1;
   int status;
 
   if ((ci->values_num != 1) || (ci->values[0].type != OCONFIG_TYPE_STRING)) {
@@ -307,7 +331,13 @@ static int cdbi_config_add_database(oconfig_item_t *ci) /* {{{ */
       status = cf_util_get_cdtime(child, &db->interval);
     else if (strcasecmp("Plugin", child->key) == 0)
       status = cf_util_get_string(child, &db->plugin_name);
-    else {
+    else if (strcasecmp("Connections", child->key) == 0) {
+      status = cf_util_get_int(child, &connections_num);
+      if ((status == 0) && (connections_num < 1)) {
+        WARNING("dbi plugin: `Connections' must be at least 1.");
+        status = -1;
+      }
+    } else {
       WARNING("dbi plugin: Option `%s' not allowed here.", child->key);
       status = -1;
     }
@@ -352,6 +382,25 @@ static int cdbi_config_add_database(oconfig_item_t *ci) /* {{{ */
     break;
   }
 
+  /* There is no point in opening more connections than there are queries. */
+  if ((status == 0) && (db->queries_num > 0) &&
+      ((size_t)connections_num > db->queries_num))
+    connections_num = (int)db->queries_num;
+
+  if (status == 0) {
+    db->connections = calloc(connections_num, sizeof(*db->connections));
+    if (db->connections == NULL) {
+      ERROR("dbi plugin: calloc failed.");
+      status = -1;
+    } else {
+      db->connections_num = (size_t)connections_num;
+      for (size_t i = 0; i < db->connections_num; i++) {
+        db->connections[i].db = db;
+        db->connections[i].index = i;
+      }
+    }
+  }
+
   /* If all went well, add this database to the global list of databases. */
   if (status == 0) {
     cdbi_database_t **temp;
@@ -365,16 +414,19 @@ static int cdbi_config_add_database(oconfig_item_t *ci) /* {{{ */
       databases[databases_num] = db;
       databases_num++;
 
-      char *name = ssnprintf_alloc("dbi:%s", db->name);
-      plugin_register_complex_read(
-          /* group = */ NULL,
-          /* name = */ name ? name : db->name,
-          /* callback = */ cdbi_read_database,
-          /* interval = */ (db->interval > 0) ? db->interval : 0,
-          &(user_data_t){
-              .data = db,
-          });
-      sfree(name);
+      for (size_t i = 0; i < db->connections_num; i++) {
+        char *name = (i == 0) ? ssnprintf_alloc("dbi:%s", db->name)
+                              : ssnprintf_alloc("dbi:%s:%" PRIsz, db->name, i);
+        plugin_register_complex_read(
+            /* group = */ NULL,
+            /* name = */ name ? name : db->name,
+            /* callback = */ cdbi_read_database,
+            /* interval = */ (db->interval > 0) ? db->interval : 0,
+            &(user_data_t){
+                .data = db->connections + i,
+            });
+        sfree(name);
+      }
     }
   }
 
@@ -442,7 +494,7 @@ static int cdbi_init(void) /* {{{ */
 } /* }}} int cdbi_init */
 
 static int cdbi_read_database_query(cdbi_database_t *db, /* {{{ */
-                                    udb_query_t *q,
+                                    dbi_conn connection, udb_query_t *q,
                                     udb_query_preparation_area_t *prep_area) {
   const char *statement;
   dbi_result res;
@@ -474,13 +526,13 @@ static int cdbi_read_database_query(cdbi_database_t *db, /* {{{ */
   statement = udb_query_get_statement(q);
   assert(statement != NULL);
 
-  res = dbi_conn_query(db->connection, statement);
+  res = dbi_conn_query(connection, statement);
   if (res == NULL) {
     char errbuf[1024];
     ERROR("dbi plugin: cdbi_read_database_query (%s, %s): "
           "dbi_conn_query failed: %s",
           db->name, udb_query_get_name(q),
-          cdbi_strerror(db->connection, errbuf, sizeof(errbuf)));
+          cdbi_strerror(connection, errbuf, sizeof(errbuf)));
     BAIL_OUT(-1);
   } else /* Get the number of columns */
   {
@@ -492,7 +544,7 @@ static int cdbi_read_database_query(cdbi_database_t *db, /* {{{ */
       ERROR("dbi plugin: cdbi_read_database_query (%s, %s): "
             "dbi_result_get_numfields failed: %s",
             db->name, udb_query_get_name(q),
-            cdbi_strerror(db->connection, errbuf, sizeof(errbuf)));
+            cdbi_strerror(connection, errbuf, sizeof(errbuf)));
       BAIL_OUT(-1);
     }
 
@@ -561,7 +613,7 @@ static int cdbi_read_database_query(cdbi_database_t *db, /* {{{ */
           "dbi_result_first_row failed: %s. Maybe the statement didn't "
           "return any rows?",
           db->name, udb_query_get_name(q),
-          cdbi_strerror(db->connection, errbuf, sizeof(errbuf)));
+          cdbi_strerror(connection, errbuf, sizeof(errbuf)));
     udb_query_finish_result(q, prep_area);
     BAIL_OUT(-1);
   } /* }}} */
@@ -601,12 +653,12 @@ static int cdbi_read_database_query(cdbi_database_t *db, /* {{{ */
     /* Get the next row from the database. */
     status = dbi_result_next_row(res); /* {{{ */
     if (status != 1) {
-      if (dbi_conn_error(db->connection, NULL) != 0) {
+      if (dbi_conn_error(connection, NULL) != 0) {
         char errbuf[1024];
         WARNING("dbi plugin: cdbi_read_database_query (%s, %s): "
                 "dbi_result_next_row failed: %s.",
                 db->name, udb_query_get_name(q),
-                cdbi_strerror(db->connection, errbuf, sizeof(errbuf)));
+                cdbi_strerror(connection, errbuf, sizeof(errbuf)));
       }
       break;
     } /* }}} */
@@ -620,19 +672,20 @@ static int cdbi_read_database_query(cdbi_database_t *db, /* {{{ */
 #undef BAIL_OUT
 } /* }}} int cdbi_read_database_query */
 
-static int cdbi_connect_database(cdbi_database_t *db) /* {{{ */
+static int cdbi_connect_database(cdbi_connection_t *c) /* {{{ */
 {
+  cdbi_database_t *db = c->db;
   dbi_driver driver;
   dbi_conn connection;
   int status;
 
-  if (db->connection != NULL) {
-    status = dbi_conn_ping(db->connection);
+  if (c->connection != NULL) {
+    status = dbi_conn_ping(c->connection);
     if (status != 0) /* connection is alive */
       return 0;
 
-    dbi_conn_close(db->connection);
-    db->connection = NULL;
+    dbi_conn_close(c->connection);
+    c->connection = NULL;
   }
 
   driver = dbi_driver_open_r(db->driver, dbi_instance);
@@ -724,35 +777,37 @@ static int cdbi_connect_database(cdbi_database_t *db) /* {{{ */
     }
   }
 
-  db->connection = connection;
+  c->connection = connection;
   return 0;
 } /* }}} int cdbi_connect_database */
 
 static int cdbi_read_database(user_data_t *ud) /* {{{ */
 {
-  cdbi_database_t *db = (cdbi_database_t *)ud->data;
+  cdbi_connection_t *c = (cdbi_connection_t *)ud->data;
+  cdbi_database_t *db = c->db;
   int success;
   int status;
 
   unsigned int db_version;
 
-  status = cdbi_connect_database(db);
+  status = cdbi_connect_database(c);
   if (status != 0)
     return status;
-  assert(db->connection != NULL);
+  assert(c->connection != NULL);
 
-  db_version = dbi_conn_get_engine_version(db->connection);
+  db_version = dbi_conn_get_engine_version(c->connection);
   /* TODO: Complain if `db_version == 0' */
 
   success = 0;
-  for (size_t i = 0; i < db->queries_num; i++) {
+  for (size_t i = c->index; i < db->queries_num; i += db->connections_num) {
     /* Check if we know the database's version and if so, if this query applies
      * to that version. */
     if ((db_version != 0) &&
         (udb_query_check_version(db->queries[i], db_version) == 0))
       continue;
 
-    status = cdbi_read_database_query(db, db->queries[i], db->q_prep_areas[i]);
+    status = cdbi_read_database_query(db, c->connection, db->queries[i],
+                                      db->q_prep_areas[i]);
     if (status == 0)
       success++;
   }
@@ -767,13 +822,8 @@ static int cdbi_read_database(user_data_t *ud) /* {{{ */
 
 static int cdbi_shutdown(void) /* {{{ */
 {
-  for (size_t i = 0; i < databases_num; i++) {
-    if (databases[i]->connection != NULL) {
-      dbi_conn_close(databases[i]->connection);
-      databases[i]->connection = NULL;
-    }
+  for (size_t i = 0; i < databases_num; i++)
     cdbi_database_free(databases[i]);
-  }
   sfree(databases);
   databases_num = 0;
 
@@ -787,6 +837,6 @@ static int cdbi_shutdown(void) /* {{{ */
 void module_register(void) /* {{{ */
 {
   plugin_register_complex_config("dbi", cdbi_config);
-  plugin_register_init("dbi", cdbi_init);
+  plugin_register_init_parallel("dbi", cdbi_init);
   plugin_register_shutdown("dbi", cdbi_shutdown);
 } /* }}} void module_register */
@@ -25,6 +25,7 @@
 
 #include "common.h"
 #include "plugin.h"
+#include "utils_avltree.h"
 #include "utils_ignorelist.h"
 #include "utils_mount.h"
 
@@ -60,6 +61,17 @@ static _Bool report_inodes = 0;
 static _Bool values_absolute = 1;
 static _Bool values_percentage = 0;
 
+/* A mount point that passed the ignorelists and is not a duplicate. The
+ * selection is only updated when the mount table changes. */
+typedef struct {
+  cu_mount_t *mnt;
+  char disk_name[256];
+} df_mount_t;
+
+static cu_mount_cache_t *mount_cache = NULL;
+static df_mount_t *selected = NULL;
+static size_t selected_num = 0;
+
 static int df_init(void) {
   if (il_device == NULL)
     il_device = ignorelist_create(1);
@@ -146,34 +158,56 @@ __attribute__((nonnull(2))) static void df_submit_one(char *plugin_instance,
   plugin_dispatch_values(&vl);
 } /* void df_submit_one */
 
-static int df_read(void) {
-#if HAVE_STATVFS
-  struct statvfs statbuf;
-#elif HAVE_STATFS
-  struct statfs statbuf;
-#endif
-  int retval = 0;
-  /* struct STATANYFS statbuf; */
-  cu_mount_t *mnt_list;
+/* Returns true if "key" has been seen before, i.e. if the mount point is a
+ * duplicate of an earlier one. */
+static _Bool df_is_duplicate(c_avl_tree_t *seen, char *key) {
+  if (key == NULL)
+    return 0;
 
-  mnt_list = NULL;
-  if (cu_mount_getlist(&mnt_list) == NULL) {
-    ERROR("df plugin: cu_mount_getlist failed.");
+  if (c_avl_get(seen, key, /* value = */ NULL) == 0)
+    return 1;
+
+  c_avl_insert(seen, key, /* value = */ NULL);
+  return 0;
+} /* _Bool df_is_duplicate */
+
+static int df_select(cu_mount_t *mnt_list) {
+  c_avl_tree_t *seen;
+  size_t num = 0;
+  df_mount_t *tmp;
+
+  for (cu_mount_t *mnt_ptr = mnt_list; mnt_ptr != NULL;
+       mnt_ptr = mnt_ptr->next)
+    num++;
+
+  tmp = realloc(selected, (num > 0 ? num : 1) * sizeof(*selected));
+  if (tmp == NULL) {
+    ERROR("df plugin: realloc failed.");
+    return -1;
+  }
+  selected = tmp;
+  selected_num = 0;
+
+  seen = c_avl_create((int (*)(const void *, const void *))strcmp);
+  if (seen == NULL) {
+    ERROR("df plugin: c_avl_create failed.");
     return -1;
   }
 
   for (cu_mount_t *mnt_ptr = mnt_list; mnt_ptr != NULL;
        mnt_ptr = mnt_ptr->next) {
-    unsigned long long blocksize;
-    char disk_name[256];
-    cu_mount_t *dup_ptr;
-    uint64_t blk_free;
-    uint64_t blk_reserved;
-    uint64_t blk_used;
+    char *disk_name = selected[selected_num].disk_name;
+    size_t disk_name_size = sizeof(selected[selected_num].disk_name);
+    _Bool duplicate;
 
     char const *dev =
         (mnt_ptr->spec_device != NULL) ? mnt_ptr->spec_device : mnt_ptr->device;
 
+    /* Duplicates are searched among all earlier mount points, including the
+     * ignored ones. */
+    duplicate = df_is_duplicate(seen, by_device ? mnt_ptr->spec_device
+                                                : mnt_ptr->dir);
+
     if (ignorelist_match(il_device, dev))
       continue;
     if (ignorelist_match(il_mountpoint, mnt_ptr->dir))
@@ -181,41 +215,16 @@ static int df_read(void) {
     if (ignorelist_match(il_fstype, mnt_ptr->type))
       continue;
 
-    /* search for duplicates *in front of* the current mnt_ptr. */
-    for (dup_ptr = mnt_list; dup_ptr != NULL; dup_ptr = dup_ptr->next) {
-      /* No duplicate found: mnt_ptr is the first of its kind. */
-      if (dup_ptr == mnt_ptr) {
-        dup_ptr = NULL;
-        break;
-      }
-
-      /* Duplicate found: leave non-NULL dup_ptr. */
-      if (by_device && (mnt_ptr->spec_device != NULL) &&
-          (dup_ptr->spec_device != NULL) &&
-          (strcmp(mnt_ptr->spec_device, dup_ptr->spec_device) == 0))
-        break;
-      else if (!by_device && (strcmp(mnt_ptr->dir, dup_ptr->dir) == 0))
-        break;
-    }
-
     /* ignore duplicates */
-    if (dup_ptr != NULL)
-      continue;
-
-    if (STATANYFS(mnt_ptr->dir, &statbuf) < 0) {
-      ERROR(STATANYFS_STR "(%s) failed: %s", mnt_ptr->dir, STRERRNO);
-      continue;
-    }
-
-    if (!statbuf.f_blocks)
+    if (duplicate)
       continue;
 
     if (by_device) {
       /* eg, /dev/hda1  -- strip off the "/dev/" */
       if (strncmp(dev, "/dev/", strlen("/dev/")) == 0)
-        sstrncpy(disk_name, dev + strlen("/dev/"), sizeof(disk_name));
+        sstrncpy(disk_name, dev + strlen("/dev/"), disk_name_size);
       else
-        sstrncpy(disk_name, dev, sizeof(disk_name));
+        sstrncpy(disk_name, dev, disk_name_size);
 
       if (strlen(disk_name) < 1) {
         DEBUG("df: no device name for mountpoint %s, skipping", mnt_ptr->dir);
@@ -223,11 +232,11 @@ static int df_read(void) {
       }
     } else {
       if (strcmp(mnt_ptr->dir, "/") == 0)
-        sstrncpy(disk_name, "root", sizeof(disk_name));
+        sstrncpy(disk_name, "root", disk_name_size);
       else {
         int len;
 
-        sstrncpy(disk_name, mnt_ptr->dir + 1, sizeof(disk_name));
+        sstrncpy(disk_name, mnt_ptr->dir + 1, disk_name_size);
         len = strlen(disk_name);
 
         for (int i = 0; i < len; i++)
@@ -236,6 +245,62 @@ static int df_read(void) {
       }
     }
 
+    selected[selected_num].mnt = mnt_ptr;
+    selected_num++;
+  }
+
+  c_avl_destroy(seen);
+  return 0;
+} /* int df_select */
+
+static int df_read(void) {
+#if HAVE_STATVFS
+  struct statvfs statbuf;
+#elif HAVE_STATFS
+  struct statfs statbuf;
+#endif
+  int retval = 0;
+  /* struct STATANYFS statbuf; */
+  cu_mount_t *mnt_list;
+  _Bool changed = 0;
+
+  if (mount_cache == NULL) {
+    mount_cache = cu_mount_cache_create();
+    if (mount_cache == NULL) {
+      ERROR("df plugin: cu_mount_cache_create failed.");
+      return -1;
+    }
+  }
+
+  mnt_list = cu_mount_cache_get(mount_cache, &changed);
+  if (mnt_list == NULL) {
+    ERROR("df plugin: cu_mount_getlist failed.");
+    return -1;
+  }
+
+  if (changed && (df_select(mnt_list) != 0)) {
+    /* Force a new selection during the next read. */
+    cu_mount_cache_destroy(mount_cache);
+    mount_cache = NULL;
+    return -1;
+  }
+
+  for (size_t i = 0; i < selected_num; i++) {
+    cu_mount_t *mnt_ptr = selected[i].mnt;
+    char *disk_name = selected[i].disk_name;
+    unsigned long long blocksize;
+    uint64_t blk_free;
+    uint64_t blk_reserved;
+    uint64_t blk_used;
+
+    if (STATANYFS(mnt_ptr->dir, &statbuf) < 0) {
+      ERROR(STATANYFS_STR "(%s) failed: %s", mnt_ptr->dir, STRERRNO);
+      continue;
+    }
+
+    if (!statbuf.f_blocks)
+      continue;
+
     blocksize = BLOCKSIZE(statbuf);
 
 /*
@@ -330,13 +395,22 @@ static int df_read(void) {
     }
   }
 
-  cu_mount_freelist(mnt_list);
-
   return retval;
 } /* int df_read */
 
+static int df_shutdown(void) {
+  cu_mount_cache_destroy(mount_cache);
+  mount_cache = NULL;
+
+  sfree(selected);
+  selected_num = 0;
+
+  return 0;
+} /* int df_shutdown */
+
 void module_register(void) {
   plugin_register_config("df", df_config, config_keys, config_keys_num);
   plugin_register_init("df", df_init);
   plugin_register_read("df", df_read);
+  plugin_register_shutdown("df", df_shutdown);
 } /* void module_register */
@@ -110,10 +110,24 @@ typedef struct diskstats {
   _Bool has_in_progress;
   _Bool has_io_time;
 
+  /* The device number identifies the device behind the name. */
+  unsigned int major;
+  unsigned int minor;
+#if HAVE_UDEV_H
+  /* Name from the udev attribute, NULL if the device doesn't have it. Valid
+   * while "alt_name_cached" is set, i.e. until udev reports a change. */
+  char *alt_name;
+  _Bool alt_name_cached;
+#endif
+
   struct diskstats *next;
 } diskstats_t;
 
 static diskstats_t *disklist;
+
+/* /proc/diskstats is read into this buffer, which grows as needed. */
+static char *diskstats_buffer;
+static size_t diskstats_buffer_size;
 /* #endif KERNEL_LINUX */
 #elif KERNEL_FREEBSD
 static struct gmesh geom_tree;
@@ -141,9 +155,14 @@ static int pnumdisk;
 
 #if HAVE_UDEV_H
 #include <libudev.h>
+#include <poll.h>
+#include <sys/sysmacros.h>
 
 static char *conf_udev_name_attr = NULL;
 static struct udev *handle_udev;
+/* Reports changes to block devices, which invalidate the cached names. If it
+ * isn't available, names are looked up on every read. */
+static struct udev_monitor *handle_udev_monitor;
 #endif
 
 static const char *config_keys[] = {"Disk", "UseBSDName", "IgnoreSelected",
@@ -216,6 +235,18 @@ static int disk_init(void) {
       ERROR("disk plugin: udev_new() failed!");
       return -1;
     }
+
+    handle_udev_monitor = udev_monitor_new_from_netlink(handle_udev, "udev");
+    if ((handle_udev_monitor == NULL) ||
+        (udev_monitor_filter_add_match_subsystem_devtype(
+             handle_udev_monitor, "block", NULL) < 0) ||
+        (udev_monitor_enable_receiving(handle_udev_monitor) < 0)) {
+      WARNING("disk plugin: Creating the udev monitor failed. Device names "
+              "will be looked up on every read.");
+      if (handle_udev_monitor != NULL)
+        udev_monitor_unref(handle_udev_monitor);
+      handle_udev_monitor = NULL;
+    }
   }
 #endif /* HAVE_UDEV_H */
 /* #endif KERNEL_LINUX */
@@ -261,9 +292,14 @@ static int disk_init(void) {
 static int disk_shutdown(void) {
 #if KERNEL_LINUX
 #if HAVE_UDEV_H
+  if (handle_udev_monitor != NULL)
+    udev_monitor_unref(handle_udev_monitor);
+  handle_udev_monitor = NULL;
   if (handle_udev != NULL)
     udev_unref(handle_udev);
 #endif /* HAVE_UDEV_H */
+  sfree(diskstats_buffer);
+  diskstats_buffer_size = 0;
 #endif /* KERNEL_LINUX */
   return 0;
 } /* int disk_shutdown */
@@ -350,6 +386,85 @@ static char *disk_udev_attr_name(struct udev *udev, char *disk_name,
   }
   return output;
 }
+
+static void disk_udev_invalidate(diskstats_t *ds) /* {{{ */
+{
+  sfree(ds->alt_name);
+  ds->alt_name_cached = 0;
+} /* }}} void disk_udev_invalidate */
+
+/* Invalidates the cached names of the devices udev reported events for,
+ * i.e. devices which have been added, removed or changed since the last
+ * read. Doesn't block. */
+static void disk_udev_monitor_drain(void) /* {{{ */
+{
+  if (handle_udev_monitor == NULL)
+    return;
+
+  struct pollfd pfd = {.fd = udev_monitor_get_fd(handle_udev_monitor),
+                       .events = POLLIN};
+  while (poll(&pfd, 1, /* timeout = */ 0) > 0) {
+    struct udev_device *dev = udev_monitor_receive_device(handle_udev_monitor);
+    if (dev == NULL)
+      break;
+
+    dev_t devnum = udev_device_get_devnum(dev);
+    char const *sysname = udev_device_get_sysname(dev);
+    for (diskstats_t *ds = disklist; ds != NULL; ds = ds->next) {
+      if (((devnum != 0) && (ds->major == major(devnum)) &&
+           (ds->minor == minor(devnum))) ||
+          ((sysname != NULL) && (strcmp(sysname, ds->name) == 0)))
+        disk_udev_invalidate(ds);
+    }
+
+    DEBUG("disk plugin: udev reported \"%s\" for %s.",
+          udev_device_get_action(dev), (sysname != NULL) ? sysname : "?");
+    udev_device_unref(dev);
+  }
+} /* }}} void disk_udev_monitor_drain */
+
+/* Returns the name of "ds" according to the udev attribute or NULL. */
+static char const *disk_udev_name(diskstats_t *ds) /* {{{ */
+{
+  if (!ds->alt_name_cached) {
+    sfree(ds->alt_name);
+    ds->alt_name =
+        disk_udev_attr_name(handle_udev, ds->name, conf_udev_name_attr);
+    ds->alt_name_cached = (handle_udev_monitor != NULL);
+  }
+  return ds->alt_name;
+} /* }}} char const *disk_udev_name */
+#endif
+
+#if KERNEL_LINUX
+/* Reads "path" into diskstats_buffer, growing the buffer until the whole file
+ * fits. Returns the number of bytes read or negative on error. */
+static ssize_t disk_read_file(char const *path) /* {{{ */
+{
+  while (1) {
+    if (diskstats_buffer_size == 0) {
+      diskstats_buffer = malloc(4096);
+      if (diskstats_buffer == NULL)
+        return -1;
+      diskstats_buffer_size = 4096;
+    }
+
+    ssize_t len =
+        read_file_cached(path, diskstats_buffer, diskstats_buffer_size - 1);
+    if (len < 0)
+      return len;
+    if ((size_t)len < diskstats_buffer_size - 1) {
+      diskstats_buffer[len] = 0;
+      return len;
+    }
+
+    char *tmp = realloc(diskstats_buffer, 2 * diskstats_buffer_size);
+    if (tmp == NULL)
+      return -1;
+    diskstats_buffer = tmp;
+    diskstats_buffer_size *= 2;
+  }
+} /* }}} ssize_t disk_read_file */
 #endif
 
 #if HAVE_IOKIT_IOKITLIB_H
@@ -652,14 +767,15 @@ static int disk_read(void) {
   geom_stats_snapshot_free(snap);
 
 #elif KERNEL_LINUX
-  FILE *fh;
-  char buffer[1024];
+  char *buffer;
+  char *saveptr = NULL;
 
   char *fields[32];
   int numfields;
   int fieldshift = 0;
 
-  int minor = 0;
+  unsigned int major = 0;
+  unsigned int minor = 0;
 
   derive_t read_sectors = 0;
   derive_t write_sectors = 0;
@@ -677,10 +793,9 @@ static int disk_read(void) {
 
   diskstats_t *ds, *pre_ds;
 
-  if ((fh = fopen("/proc/diskstats", "r")) == NULL) {
-    fh = fopen("/proc/partitions", "r");
-    if (fh == NULL) {
-      ERROR("disk plugin: fopen (/proc/{diskstats,partitions}) failed.");
+  if (disk_read_file("/proc/diskstats") < 0) {
+    if (disk_read_file("/proc/partitions") < 0) {
+      ERROR("disk plugin: reading /proc/{diskstats,partitions} failed.");
       return -1;
     }
 
@@ -688,16 +803,22 @@ static int disk_read(void) {
     fieldshift = 1;
   }
 
-  while (fgets(buffer, sizeof(buffer), fh) != NULL) {
+#if HAVE_UDEV_H
+  disk_udev_monitor_drain();
+#endif
+
+  for (buffer = strtok_r(diskstats_buffer, "\n", &saveptr); buffer != NULL;
+       buffer = strtok_r(NULL, "\n", &saveptr)) {
     char *disk_name;
-    char *output_name;
+    char const *output_name;
 
     numfields = strsplit(buffer, fields, 32);
 
     if ((numfields != (14 + fieldshift)) && (numfields != 7))
       continue;
 
-    minor = atoll(fields[1]);
+    major = (unsigned int)atoll(fields[0]);
+    minor = (unsigned int)atoll(fields[1]);
 
     disk_name = fields[2 + fieldshift];
 
@@ -721,6 +842,15 @@ static int disk_read(void) {
         pre_ds->next = ds;
     }
 
+    /* The name now refers to another device. */
+    if ((ds->major != major) || (ds->minor != minor)) {
+      ds->major = major;
+      ds->minor = minor;
+#if HAVE_UDEV_H
+      disk_udev_invalidate(ds);
+#endif
+    }
+
     is_disk = 0;
     if (numfields == 7) {
       /* Kernel 2.6, Partition */
@@ -842,22 +972,15 @@ static int disk_read(void) {
     output_name = disk_name;
 
 #if HAVE_UDEV_H
-    char *alt_name = NULL;
     if (conf_udev_name_attr != NULL) {
-      alt_name =
-          disk_udev_attr_name(handle_udev, disk_name, conf_udev_name_attr);
+      char const *alt_name = disk_udev_name(ds);
       if (alt_name != NULL)
         output_name = alt_name;
     }
 #endif
 
-    if (ignorelist_match(ignorelist, output_name) != 0) {
-#if HAVE_UDEV_H
-      /* release udev-based alternate name, if allocated */
-      sfree(alt_name);
-#endif
+    if (ignorelist_match(ignorelist, output_name) != 0)
       continue;
-    }
 
     if ((ds->read_bytes != 0) || (ds->write_bytes != 0))
       disk_submit(output_name, "disk_octets", ds->read_bytes, ds->write_bytes);
@@ -877,14 +1000,7 @@ static int disk_read(void) {
       if (ds->has_io_time)
         submit_io_time(output_name, io_time, weighted_time);
     } /* if (is_disk) */
-
-#if HAVE_UDEV_H
-    /* release udev-based alternate name, if allocated */
-    sfree(alt_name);
-#endif
-  } /* while (fgets (buffer, sizeof (buffer), fh) != NULL) */
-
-  fclose(fh);
+  } /* for (buffer = strtok_r (diskstats_buffer, ...)) */
 /* #endif defined(KERNEL_LINUX) */
 
 #elif HAVE_LIBKSTAT
@@ -38,93 +38,60 @@
 #include <sys/capability.h>
 #endif
 
+#if KERNEL_LINUX
+#include <linux/if_packet.h>
+#endif
+
 /*
  * Private data types
  */
-struct counter_list_s {
-  unsigned int key;
-  unsigned int value;
-  struct counter_list_s *next;
+/* Counters of one capture thread. Each thread only updates its own counters,
+ * so no locking is needed; dns_read() sums them up. */
+struct dns_counters_s {
+  derive_t queries;
+  derive_t responses;
+  derive_t qtype[T_MAX];
+  derive_t opcode[16];
+  derive_t rcode[16];
+};
+typedef struct dns_counters_s dns_counters_t;
+
+struct dns_capture_s {
+  pthread_t thread;
+  dns_counters_t *counters;
 };
-typedef struct counter_list_s counter_list_t;
+typedef struct dns_capture_s dns_capture_t;
 
 /*
  * Private variables
  */
 static const char *config_keys[] = {"Interface", "IgnoreSource",
-                                    "SelectNumericQueryTypes"};
+                                    "SelectNumericQueryTypes", "Threads",
+                                    "BufferSize"};
 static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 static int select_numeric_qtype = 1;
 
 #define PCAP_SNAPLEN 1460
 static char *pcap_device = NULL;
+/* Size of the kernel's capture ring. On Linux, libpcap maps it into memory
+ * and hands packets to the callback without copying them. */
+static int pcap_buffer_size = 32 * 1024 * 1024;
 
-static derive_t tr_queries;
-static derive_t tr_responses;
-static counter_list_t *qtype_list;
-static counter_list_t *opcode_list;
-static counter_list_t *rcode_list;
+static size_t capture_num = 1;
+static dns_capture_t *captures = NULL;
+static pthread_key_t counters_key;
 
-static pthread_t listen_thread;
+/* Number of running capture threads. */
 static int listen_thread_init = 0;
-/* The `traffic' mutex if for `tr_queries' and `tr_responses' */
-static pthread_mutex_t traffic_mutex = PTHREAD_MUTEX_INITIALIZER;
-static pthread_mutex_t qtype_mutex = PTHREAD_MUTEX_INITIALIZER;
-static pthread_mutex_t opcode_mutex = PTHREAD_MUTEX_INITIALIZER;
-static pthread_mutex_t rcode_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 /*
  * Private functions
  */
-static counter_list_t *counter_list_search(counter_list_t **list,
-                                           unsigned int key) {
-  counter_list_t *entry;
-
-  for (entry = *list; entry != NULL; entry = entry->next)
-    if (entry->key == key)
-      break;
-
-  return entry;
-}
-
-static counter_list_t *counter_list_create(counter_list_t **list,
-                                           unsigned int key,
-                                           unsigned int value) {
-  counter_list_t *entry;
-
-  entry = calloc(1, sizeof(*entry));
-  if (entry == NULL)
-    return NULL;
-
-  entry->key = key;
-  entry->value = value;
-
-  if (*list == NULL) {
-    *list = entry;
-  } else {
-    counter_list_t *last;
-
-    last = *list;
-    while (last->next != NULL)
-      last = last->next;
-
-    last->next = entry;
-  }
-
-  return entry;
-}
-
-static void counter_list_add(counter_list_t **list, unsigned int key,
-                             unsigned int increment) {
-  counter_list_t *entry;
-
-  entry = counter_list_search(list, key);
-
-  if (entry != NULL) {
-    entry->value += increment;
-  } else {
-    counter_list_create(list, key, increment);
-  }
+/* Counters are written by one thread and read by dns_read(). */
+static inline void dns_counter_add(derive_t *counter, derive_t increment) {
+  __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) +
+                                increment,
+                   __ATOMIC_RELAXED);
 }
 
 static int dns_config(const char *key, const char *value) {
@@ -141,6 +108,27 @@ static int dns_config(const char *key, const char *value) {
       select_numeric_qtype = 0;
     else
       select_numeric_qtype = 1;
+  } else if (strcasecmp(key, "Threads") == 0) {
+    int tmp = atoi(value);
+    if (tmp < 1) {
+      WARNING("dns plugin: Ignoring invalid number of threads: %s", value);
+      return 1;
+    }
+#if !defined(PACKET_FANOUT)
+    if (tmp > 1) {
+      WARNING("dns plugin: Distributing packets to several threads is not "
+              "supported on this system. Using one thread.");
+      tmp = 1;
+    }
+#endif
+    capture_num = (size_t)tmp;
+  } else if (strcasecmp(key, "BufferSize") == 0) {
+    int tmp = atoi(value);
+    if (tmp <= 0) {
+      WARNING("dns plugin: Ignoring invalid buffer size: %s", value);
+      return 1;
+    }
+    pcap_buffer_size = tmp;
   } else {
     return -1;
   }
@@ -149,6 +137,10 @@ static int dns_config(const char *key, const char *value) {
 }
 
 static void dns_child_callback(const rfc1035_header_t *dns) {
+  dns_counters_t *c = pthread_getspecific(counters_key);
+  if (c == NULL)
+    return;
+
   if (dns->qr == 0) {
     /* This is a query */
     int skip = 0;
@@ -158,36 +150,25 @@ static void dns_child_callback(const rfc1035_header_t *dns) {
         skip = 1;
     }
 
-    pthread_mutex_lock(&traffic_mutex);
-    tr_queries += dns->length;
-    pthread_mutex_unlock(&traffic_mutex);
+    dns_counter_add(&c->queries, dns->length);
 
-    if (skip == 0) {
-      pthread_mutex_lock(&qtype_mutex);
-      counter_list_add(&qtype_list, dns->qtype, 1);
-      pthread_mutex_unlock(&qtype_mutex);
-    }
+    if (skip == 0)
+      dns_counter_add(&c->qtype[dns->qtype], 1);
   } else {
     /* This is a reply */
-    pthread_mutex_lock(&traffic_mutex);
-    tr_responses += dns->length;
-    pthread_mutex_unlock(&traffic_mutex);
-
-    pthread_mutex_lock(&rcode_mutex);
-    counter_list_add(&rcode_list, dns->rcode, 1);
-    pthread_mutex_unlock(&rcode_mutex);
+    dns_counter_add(&c->responses, dns->length);
+    dns_counter_add(&c->rcode[dns->rcode], 1);
   }
 
   /* FIXME: Are queries, replies or both interesting? */
-  pthread_mutex_lock(&opcode_mutex);
-  counter_list_add(&opcode_list, dns->opcode, 1);
-  pthread_mutex_unlock(&opcode_mutex);
+  dns_counter_add(&c->opcode[dns->opcode], 1);
 }
 
 static int dns_run_pcap_loop(void) {
   pcap_t *pcap_obj;
   char pcap_error[PCAP_ERRBUF_SIZE];
   struct bpf_program fp = {0};
+  const char *device = (pcap_device != NULL) ? pcap_device : "any";
 
   int status;
 
@@ -200,36 +181,63 @@ static int dns_run_pcap_loop(void) {
 
   /* Passing `pcap_device == NULL' is okay and the same as passign "any" */
   DEBUG("dns plugin: Creating PCAP object..");
-  pcap_obj = pcap_open_live((pcap_device != NULL) ? pcap_device : "any",
-                            PCAP_SNAPLEN, 0 /* Not promiscuous */,
-                            (int)CDTIME_T_TO_MS(plugin_get_interval() / 2),
-                            pcap_error);
+  pcap_obj = pcap_create(device, pcap_error);
   if (pcap_obj == NULL) {
     ERROR("dns plugin: Opening interface `%s' "
           "failed: %s",
-          (pcap_device != NULL) ? pcap_device : "any", pcap_error);
+          device, pcap_error);
     return PCAP_ERROR;
   }
 
+  pcap_set_snaplen(pcap_obj, PCAP_SNAPLEN);
+  pcap_set_promisc(pcap_obj, 0 /* Not promiscuous */);
+  pcap_set_timeout(pcap_obj, (int)CDTIME_T_TO_MS(plugin_get_interval() / 2));
+  pcap_set_buffer_size(pcap_obj, pcap_buffer_size);
+
+  status = pcap_activate(pcap_obj);
+  if (status < 0) {
+    ERROR("dns plugin: Opening interface `%s' failed: %s", device,
+          pcap_geterr(pcap_obj));
+    pcap_close(pcap_obj);
+    return status;
+  }
+
+  /* The filter runs in the kernel, so only DNS packets reach the ring. */
   status = pcap_compile(pcap_obj, &fp, "udp port 53", 1, 0);
   if (status < 0) {
     ERROR("dns plugin: pcap_compile failed: %s", pcap_statustostr(status));
+    pcap_close(pcap_obj);
     return status;
   }
 
   status = pcap_setfilter(pcap_obj, &fp);
+  pcap_freecode(&fp);
   if (status < 0) {
     ERROR("dns plugin: pcap_setfilter failed: %s", pcap_statustostr(status));
+    pcap_close(pcap_obj);
     return status;
   }
 
+#if defined(PACKET_FANOUT)
+  /* Let the kernel distribute the packets to the capture threads. Hashing
+   * keeps the packets of one flow in one thread. */
+  if (capture_num > 1) {
+    int fanout = (int)(getpid() & 0xffff) | (PACKET_FANOUT_HASH << 16);
+    if (setsockopt(pcap_fileno(pcap_obj), SOL_PACKET, PACKET_FANOUT, &fanout,
+                   sizeof(fanout)) != 0) {
+      ERROR("dns plugin: Joining the fanout group failed: %s", STRERRNO);
+      pcap_close(pcap_obj);
+      return PCAP_ERROR;
+    }
+  }
+#endif
+
   DEBUG("dns plugin: PCAP object created.");
 
-  dnstop_set_pcap_obj(pcap_obj);
   dnstop_set_callback(dns_child_callback);
 
   status = pcap_loop(pcap_obj, -1 /* loop forever */,
-                     handle_pcap /* callback */, NULL /* user data */);
+                     handle_pcap /* callback */, (u_char *)pcap_obj);
   INFO("dns plugin: pcap_loop exited with status %i.", status);
   /* We need to handle "PCAP_ERROR" specially because libpcap currently
    * doesn't return PCAP_ERROR_IFACE_NOT_UP for compatibility reasons. */
@@ -253,10 +261,13 @@ static int dns_sleep_one_interval(void) /* {{{ */
   return 0;
 } /* }}} int dns_sleep_one_interval */
 
-static void *dns_child_loop(__attribute__((unused)) void *dummy) /* {{{ */
+static void *dns_child_loop(void *arg) /* {{{ */
 {
+  dns_capture_t *capture = arg;
   int status;
 
+  pthread_setspecific(counters_key, capture->counters);
+
   while (42) {
     status = dns_run_pcap_loop();
     if (status != PCAP_ERROR_IFACE_NOT_UP)
@@ -268,7 +279,7 @@ static void *dns_child_loop(__attribute__((unused)) void *dummy) /* {{{ */
   if (status != PCAP_ERROR_BREAK)
     ERROR("dns plugin: PCAP returned error %s.", pcap_statustostr(status));
 
-  listen_thread_init = 0;
+  __atomic_sub_fetch(&listen_thread_init, 1, __ATOMIC_RELAXED);
   return NULL;
 } /* }}} void *dns_child_loop */
 
@@ -276,22 +287,42 @@ static int dns_init(void) {
   /* clean up an old thread */
   int status;
 
-  pthread_mutex_lock(&traffic_mutex);
-  tr_queries = 0;
-  tr_responses = 0;
-  pthread_mutex_unlock(&traffic_mutex);
-
-  if (listen_thread_init != 0)
+  if (__atomic_load_n(&listen_thread_init, __ATOMIC_RELAXED) != 0)
     return -1;
 
-  status = plugin_thread_create(&listen_thread, NULL, dns_child_loop, (void *)0,
-                                "dns listen");
-  if (status != 0) {
-    ERROR("dns plugin: pthread_create failed: %s", STRERRNO);
-    return -1;
+  if (captures == NULL) {
+    pthread_key_create(&counters_key, NULL);
+
+    captures = calloc(capture_num, sizeof(*captures));
+    if (captures == NULL) {
+      ERROR("dns plugin: calloc failed.");
+      return -1;
+    }
+  }
+
+  for (size_t i = 0; i < capture_num; i++) {
+    if (captures[i].counters == NULL) {
+      captures[i].counters = calloc(1, sizeof(*captures[i].counters));
+      if (captures[i].counters == NULL) {
+        ERROR("dns plugin: calloc failed.");
+        return -1;
+      }
+    }
+
+    __atomic_store_n(&captures[i].counters->queries, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&captures[i].counters->responses, 0, __ATOMIC_RELAXED);
   }
 
-  listen_thread_init = 1;
+  for (size_t i = 0; i < capture_num; i++) {
+    __atomic_add_fetch(&listen_thread_init, 1, __ATOMIC_RELAXED);
+    status = plugin_thread_create(&captures[i].thread, NULL, dns_child_loop,
+                                  captures + i, "dns listen");
+    if (status != 0) {
+      __atomic_sub_fetch(&listen_thread_init, 1, __ATOMIC_RELAXED);
+      ERROR("dns plugin: pthread_create failed: %s", STRERRNO);
+      return -1;
+    }
+  }
 
 #if defined(HAVE_SYS_CAPABILITY_H) && defined(CAP_NET_RAW)
   if (check_capability(CAP_NET_RAW) != 0) {
@@ -336,58 +367,54 @@ static void submit_octets(derive_t queries, derive_t responses) {
   plugin_dispatch_values(&vl);
 } /* void submit_octets */
 
-static int dns_read(void) {
-  unsigned int keys[T_MAX];
-  unsigned int values[T_MAX];
-  int len;
-
-  counter_list_t *ptr;
+/* Sum up the counter at offset `off' of all capture threads. */
+static derive_t dns_counters_sum(size_t off) {
+  derive_t sum = 0;
 
-  pthread_mutex_lock(&traffic_mutex);
-  values[0] = tr_queries;
-  values[1] = tr_responses;
-  pthread_mutex_unlock(&traffic_mutex);
+  for (size_t i = 0; i < capture_num; i++) {
+    derive_t *c = (derive_t *)(((char *)captures[i].counters) + off);
+    sum += __atomic_load_n(c, __ATOMIC_RELAXED);
+  }
 
-  if ((values[0] != 0) || (values[1] != 0))
-    submit_octets(values[0], values[1]);
+  return sum;
+}
 
-  pthread_mutex_lock(&qtype_mutex);
-  for (ptr = qtype_list, len = 0; (ptr != NULL) && (len < T_MAX);
-       ptr = ptr->next, len++) {
-    keys[len] = ptr->key;
-    values[len] = ptr->value;
-  }
-  pthread_mutex_unlock(&qtype_mutex);
+static int dns_read(void) {
+  derive_t value;
 
-  for (int i = 0; i < len; i++) {
-    DEBUG("dns plugin: qtype = %u; counter = %u;", keys[i], values[i]);
-    submit_derive("dns_qtype", qtype_str(keys[i]), values[i]);
-  }
+  if (captures == NULL)
+    return -1;
 
-  pthread_mutex_lock(&opcode_mutex);
-  for (ptr = opcode_list, len = 0; (ptr != NULL) && (len < T_MAX);
-       ptr = ptr->next, len++) {
-    keys[len] = ptr->key;
-    values[len] = ptr->value;
-  }
-  pthread_mutex_unlock(&opcode_mutex);
+  derive_t queries = dns_counters_sum(offsetof(dns_counters_t, queries));
+  derive_t responses = dns_counters_sum(offsetof(dns_counters_t, responses));
+  if ((queries != 0) || (responses != 0))
+    submit_octets(queries, responses);
 
-  for (int i = 0; i < len; i++) {
-    DEBUG("dns plugin: opcode = %u; counter = %u;", keys[i], values[i]);
-    submit_derive("dns_opcode", opcode_str(keys[i]), values[i]);
+  for (unsigned int i = 0; i < T_MAX; i++) {
+    value = dns_counters_sum(offsetof(dns_counters_t, qtype) +
+                             i * sizeof(derive_t));
+    if (value == 0)
+      continue;
+    DEBUG("dns plugin: qtype = %u; counter = %" PRIi64 ";", i, value);
+    submit_derive("dns_qtype", qtype_str(i), value);
   }
 
-  pthread_mutex_lock(&rcode_mutex);
-  for (ptr = rcode_list, len = 0; (ptr != NULL) && (len < T_MAX);
-       ptr = ptr->next, len++) {
-    keys[len] = ptr->key;
-    values[len] = ptr->value;
+  for (unsigned int i = 0; i < 16; i++) {
+    value = dns_counters_sum(offsetof(dns_counters_t, opcode) +
+                             i * sizeof(derive_t));
+    if (value == 0)
+      continue;
+    DEBUG("dns plugin: opcode = %u; counter = %" PRIi64 ";", i, value);
+    submit_derive("dns_opcode", opcode_str(i), value);
   }
-  pthread_mutex_unlock(&rcode_mutex);
 
-  for (int i = 0; i < len; i++) {
-    DEBUG("dns plugin: rcode = %u; counter = %u;", keys[i], values[i]);
-    submit_derive("dns_rcode", rcode_str(keys[i]), values[i]);
+  for (unsigned int i = 0; i < 16; i++) {
+    value = dns_counters_sum(offsetof(dns_counters_t, rcode) +
+                             i * sizeof(derive_t));
+    if (value == 0)
+      continue;
+    DEBUG("dns plugin: rcode = %u; counter = %" PRIi64 ";", i, value);
+    submit_derive("dns_rcode", rcode_str(i), value);
   }
 
   return 0;
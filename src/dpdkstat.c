@@ -79,6 +79,9 @@ struct dpdk_stats_ctx_s {
   dpdk_stats_config_t config;
   uint32_t stats_count;
   uint32_t ports_count;
+  /* Set by the helper once stats_count, port_stats_count and the xstats
+   * names have been fetched; cleared whenever the layout changes. */
+  _Bool layout_valid;
   cdtime_t port_read_time[RTE_MAX_ETHPORTS];
   uint32_t port_stats_count[RTE_MAX_ETHPORTS];
 #if RTE_VERSION < RTE_VERSION_16_07
@@ -220,16 +223,25 @@ static int dpdk_helper_stats_get(dpdk_helper_ctx_t *phc) {
                      ": Error reading stats (port=%d; len=%d, ret=%d)\n",
                      i, len, ret);
       ctx->port_stats_count[i] = 0;
+      ctx->layout_valid = 0;
       return -1;
     }
 #if RTE_VERSION >= RTE_VERSION_16_07
-    ret = rte_eth_xstats_get_names(i, &ctx->xnames[stats], len);
-    if (ret < 0 || ret > len) {
-      DPDK_CHILD_LOG(DPDK_STATS_PLUGIN
-                     ": Error reading stat names (port=%d; len=%d ret=%d)\n",
-                     i, len, ret);
-      ctx->port_stats_count[i] = 0;
-      return -1;
+    /* The names only change along with the number of stats, so they are
+     * fetched once and reused from the shared memory afterwards. */
+    if (ctx->layout_valid && ret != len) {
+      ctx->layout_valid = 0;
+      return -EAGAIN;
+    }
+    if (!ctx->layout_valid) {
+      ret = rte_eth_xstats_get_names(i, &ctx->xnames[stats], len);
+      if (ret < 0 || ret > len) {
+        DPDK_CHILD_LOG(DPDK_STATS_PLUGIN
+                       ": Error reading stat names (port=%d; len=%d ret=%d)\n",
+                       i, len, ret);
+        ctx->port_stats_count[i] = 0;
+        return -1;
+      }
     }
 #endif
     ctx->port_stats_count[i] = ret;
@@ -237,6 +249,7 @@ static int dpdk_helper_stats_get(dpdk_helper_ctx_t *phc) {
   }
 
   assert(stats <= ctx->stats_count);
+  ctx->layout_valid = 1;
   return 0;
 }
 
@@ -289,12 +302,24 @@ int dpdk_helper_command_handler(dpdk_helper_ctx_t *phc, enum DPDK_CMD cmd) {
     return -EINVAL;
   }
 
+  dpdk_stats_ctx_t *ctx = DPDK_STATS_CTX_GET(phc);
+
+  /* Ports may come and go while the primary process is running. */
+  if (ctx->layout_valid && ctx->ports_count != dpdk_helper_eth_dev_count())
+    ctx->layout_valid = 0;
+
+  if (ctx->layout_valid) {
+    int ret = dpdk_helper_stats_get(phc);
+    if (ret != -EAGAIN)
+      return ret;
+  }
+
   int stats_count = dpdk_helper_stats_count_get(phc);
   if (stats_count < 0) {
     return stats_count;
   }
 
-  DPDK_STATS_CTX_GET(phc)->stats_count = stats_count;
+  ctx->stats_count = stats_count;
   int stats_size = stats_count * DPDK_STATS_CTX_GET_XSTAT_SIZE;
 
   if (dpdk_stats_get_size(phc) < stats_size) {
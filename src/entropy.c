@@ -48,7 +48,7 @@ static void entropy_submit(value_t value) {
 
 static int entropy_read(void) {
   value_t v;
-  if (parse_value_file(ENTROPY_FILE, &v, DS_TYPE_GAUGE) != 0) {
+  if (parse_value_file_cached(ENTROPY_FILE, &v, DS_TYPE_GAUGE) != 0) {
     ERROR("entropy plugin: Reading \"" ENTROPY_FILE "\" failed.");
     return -1;
   }
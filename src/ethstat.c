@@ -48,31 +48,52 @@ struct value_map_s {
 };
 typedef struct value_map_s value_map_t;
 
-static char **interfaces = NULL;
+/* A statistic name with its mapping resolved. */
+struct ethstat_stat_s {
+  char name[ETH_GSTRING_LEN + 1];
+  const value_map_t *map;
+};
+typedef struct ethstat_stat_s ethstat_stat_t;
+
+struct ethstat_interface_s {
+  char *name;
+
+  /* The string table is only fetched again when the driver information,
+   * including the number of statistics, changes. */
+  struct ethtool_drvinfo drvinfo;
+  ethstat_stat_t *stats_info;
+  struct ethtool_stats *stats;
+  size_t stats_num;
+};
+typedef struct ethstat_interface_s ethstat_interface_t;
+
+static ethstat_interface_t *interfaces = NULL;
 static size_t interfaces_num = 0;
 
+static int control_fd = -1;
+
 static c_avl_tree_t *value_map = NULL;
 
 static _Bool collect_mapped_only = 0;
 
 static int ethstat_add_interface(const oconfig_item_t *ci) /* {{{ */
 {
-  char **tmp;
+  ethstat_interface_t *tmp;
   int status;
 
   tmp = realloc(interfaces, sizeof(*interfaces) * (interfaces_num + 1));
   if (tmp == NULL)
     return -1;
   interfaces = tmp;
-  interfaces[interfaces_num] = NULL;
+  memset(interfaces + interfaces_num, 0, sizeof(*interfaces));
 
-  status = cf_util_get_string(ci, interfaces + interfaces_num);
+  status = cf_util_get_string(ci, &interfaces[interfaces_num].name);
   if (status != 0)
     return status;
 
   interfaces_num++;
   INFO("ethstat plugin: Registered interface %s",
-       interfaces[interfaces_num - 1]);
+       interfaces[interfaces_num - 1].name);
 
   return 0;
 } /* }}} int ethstat_add_interface */
@@ -157,15 +178,12 @@ static int ethstat_config(oconfig_item_t *ci) /* {{{ */
   return 0;
 } /* }}} */
 
-static void ethstat_submit_value(const char *device, const char *type_instance,
-                                 derive_t value) {
+static void ethstat_submit_value(const char *device, /* {{{ */
+                                 const ethstat_stat_t *stat, derive_t value) {
   static c_complain_t complain_no_map = C_COMPLAIN_INIT_STATIC;
 
   value_list_t vl = VALUE_LIST_INIT;
-  value_map_t *map = NULL;
-
-  if (value_map != NULL)
-    c_avl_get(value_map, type_instance, (void *)&map);
+  const value_map_t *map = stat->map;
 
   /* If the "MappedOnly" option is specified, ignore unmapped values. */
   if (collect_mapped_only && (map == NULL)) {
@@ -187,58 +205,42 @@ static void ethstat_submit_value(const char *device, const char *type_instance,
     sstrncpy(vl.type_instance, map->type_instance, sizeof(vl.type_instance));
   } else {
     sstrncpy(vl.type, "derive", sizeof(vl.type));
-    sstrncpy(vl.type_instance, type_instance, sizeof(vl.type_instance));
+    sstrncpy(vl.type_instance, stat->name, sizeof(vl.type_instance));
   }
 
   plugin_dispatch_values(&vl);
-}
+} /* }}} void ethstat_submit_value */
 
-static int ethstat_read_interface(char *device) {
-  int fd;
+static void ethstat_interface_reset(ethstat_interface_t *iface) /* {{{ */
+{
+  sfree(iface->stats_info);
+  sfree(iface->stats);
+  iface->stats_num = 0;
+  memset(&iface->drvinfo, 0, sizeof(iface->drvinfo));
+} /* }}} void ethstat_interface_reset */
+
+/* Fetches the names of the statistics and resolves their mappings once, so
+ * that reads only need to fetch the values. */
+static int ethstat_load_strings(ethstat_interface_t *iface, /* {{{ */
+                                const struct ethtool_drvinfo *drvinfo) {
   struct ethtool_gstrings *strings;
-  struct ethtool_stats *stats;
-  size_t n_stats;
+  size_t n_stats = (size_t)drvinfo->n_stats;
   size_t strings_size;
   size_t stats_size;
   int status;
 
-  fd = socket(AF_INET, SOCK_DGRAM, /* protocol = */ 0);
-  if (fd < 0) {
-    ERROR("ethstat plugin: Failed to open control socket: %s", STRERRNO);
-    return 1;
-  }
-
-  struct ethtool_drvinfo drvinfo = {.cmd = ETHTOOL_GDRVINFO};
-
-  struct ifreq req = {.ifr_data = (void *)&drvinfo};
-
-  sstrncpy(req.ifr_name, device, sizeof(req.ifr_name));
-
-  status = ioctl(fd, SIOCETHTOOL, &req);
-  if (status < 0) {
-    close(fd);
-    ERROR("ethstat plugin: Failed to get driver information "
-          "from %s: %s",
-          device, STRERRNO);
-    return -1;
-  }
-
-  n_stats = (size_t)drvinfo.n_stats;
-  if (n_stats < 1) {
-    close(fd);
-    ERROR("ethstat plugin: No stats available for %s", device);
-    return -1;
-  }
+  ethstat_interface_reset(iface);
 
   strings_size = sizeof(struct ethtool_gstrings) + (n_stats * ETH_GSTRING_LEN);
   stats_size = sizeof(struct ethtool_stats) + (n_stats * sizeof(uint64_t));
 
   strings = malloc(strings_size);
-  stats = malloc(stats_size);
-  if ((strings == NULL) || (stats == NULL)) {
-    close(fd);
+  iface->stats = malloc(stats_size);
+  iface->stats_info = calloc(n_stats, sizeof(*iface->stats_info));
+  if ((strings == NULL) || (iface->stats == NULL) ||
+      (iface->stats_info == NULL)) {
     sfree(strings);
-    sfree(stats);
+    ethstat_interface_reset(iface);
     ERROR("ethstat plugin: malloc failed.");
     return -1;
   }
@@ -246,52 +248,123 @@ static int ethstat_read_interface(char *device) {
   strings->cmd = ETHTOOL_GSTRINGS;
   strings->string_set = ETH_SS_STATS;
   strings->len = n_stats;
-  req.ifr_data = (void *)strings;
-  status = ioctl(fd, SIOCETHTOOL, &req);
-  if (status < 0) {
-    close(fd);
-    free(strings);
-    free(stats);
-    ERROR("ethstat plugin: Cannot get strings from %s: %s", device, STRERRNO);
-    return -1;
-  }
 
-  stats->cmd = ETHTOOL_GSTATS;
-  stats->n_stats = n_stats;
-  req.ifr_data = (void *)stats;
-  status = ioctl(fd, SIOCETHTOOL, &req);
+  struct ifreq req = {.ifr_data = (void *)strings};
+  sstrncpy(req.ifr_name, iface->name, sizeof(req.ifr_name));
+
+  status = ioctl(control_fd, SIOCETHTOOL, &req);
   if (status < 0) {
-    close(fd);
-    free(strings);
-    free(stats);
-    ERROR("ethstat plugin: Reading statistics from %s failed: %s", device,
+    ERROR("ethstat plugin: Cannot get strings from %s: %s", iface->name,
           STRERRNO);
+    sfree(strings);
+    ethstat_interface_reset(iface);
     return -1;
   }
 
   for (size_t i = 0; i < n_stats; i++) {
-    char *stat_name;
+    ethstat_stat_t *stat = iface->stats_info + i;
+    const char *stat_name = (void *)&strings->data[i * ETH_GSTRING_LEN];
+    size_t len = strnlen(stat_name, ETH_GSTRING_LEN);
 
-    stat_name = (void *)&strings->data[i * ETH_GSTRING_LEN];
     /* Remove leading spaces in key name */
-    while (isspace((int)*stat_name))
+    while ((len > 0) && isspace((int)*stat_name)) {
       stat_name++;
+      len--;
+    }
+    memcpy(stat->name, stat_name, len);
+    stat->name[len] = 0;
 
-    DEBUG("ethstat plugin: device = \"%s\": %s = %" PRIu64, device, stat_name,
-          (uint64_t)stats->data[i]);
-    ethstat_submit_value(device, stat_name, (derive_t)stats->data[i]);
+    stat->map = NULL;
+    if (value_map != NULL)
+      c_avl_get(value_map, stat->name, (void *)&stat->map);
   }
 
-  close(fd);
   sfree(strings);
-  sfree(stats);
+  iface->stats_num = n_stats;
+  memcpy(&iface->drvinfo, drvinfo, sizeof(iface->drvinfo));
+
+  DEBUG("ethstat plugin: Loaded %" PRIsz " statistics names of %s (%s).",
+        n_stats, iface->name, drvinfo->driver);
+  return 0;
+} /* }}} int ethstat_load_strings */
+
+static _Bool ethstat_drvinfo_changed(const ethstat_interface_t *iface, /* {{{ */
+                                     const struct ethtool_drvinfo *drvinfo) {
+  return (iface->stats_info == NULL) ||
+         (iface->drvinfo.n_stats != drvinfo->n_stats) ||
+         (strncmp(iface->drvinfo.driver, drvinfo->driver,
+                  sizeof(drvinfo->driver)) != 0) ||
+         (strncmp(iface->drvinfo.version, drvinfo->version,
+                  sizeof(drvinfo->version)) != 0) ||
+         (strncmp(iface->drvinfo.fw_version, drvinfo->fw_version,
+                  sizeof(drvinfo->fw_version)) != 0) ||
+         (strncmp(iface->drvinfo.bus_info, drvinfo->bus_info,
+                  sizeof(drvinfo->bus_info)) != 0);
+} /* }}} _Bool ethstat_drvinfo_changed */
+
+static int ethstat_read_interface(ethstat_interface_t *iface) /* {{{ */
+{
+  int status;
+
+  if (control_fd < 0) {
+    control_fd = socket(AF_INET, SOCK_DGRAM, /* protocol = */ 0);
+    if (control_fd < 0) {
+      ERROR("ethstat plugin: Failed to open control socket: %s", STRERRNO);
+      return 1;
+    }
+  }
+
+  struct ethtool_drvinfo drvinfo = {.cmd = ETHTOOL_GDRVINFO};
+
+  struct ifreq req = {.ifr_data = (void *)&drvinfo};
+
+  sstrncpy(req.ifr_name, iface->name, sizeof(req.ifr_name));
+
+  status = ioctl(control_fd, SIOCETHTOOL, &req);
+  if (status < 0) {
+    ERROR("ethstat plugin: Failed to get driver information "
+          "from %s: %s",
+          iface->name, STRERRNO);
+    ethstat_interface_reset(iface);
+    return -1;
+  }
+
+  if (drvinfo.n_stats < 1) {
+    ERROR("ethstat plugin: No stats available for %s", iface->name);
+    ethstat_interface_reset(iface);
+    return -1;
+  }
+
+  if (ethstat_drvinfo_changed(iface, &drvinfo)) {
+    status = ethstat_load_strings(iface, &drvinfo);
+    if (status != 0)
+      return status;
+  }
+
+  iface->stats->cmd = ETHTOOL_GSTATS;
+  iface->stats->n_stats = iface->stats_num;
+  req.ifr_data = (void *)iface->stats;
+  status = ioctl(control_fd, SIOCETHTOOL, &req);
+  if (status < 0) {
+    ERROR("ethstat plugin: Reading statistics from %s failed: %s",
+          iface->name, STRERRNO);
+    ethstat_interface_reset(iface);
+    return -1;
+  }
+
+  for (size_t i = 0; i < iface->stats_num; i++) {
+    DEBUG("ethstat plugin: device = \"%s\": %s = %" PRIu64, iface->name,
+          iface->stats_info[i].name, (uint64_t)iface->stats->data[i]);
+    ethstat_submit_value(iface->name, iface->stats_info + i,
+                         (derive_t)iface->stats->data[i]);
+  }
 
   return 0;
 } /* }}} ethstat_read_interface */
 
 static int ethstat_read(void) {
   for (size_t i = 0; i < interfaces_num; i++)
-    ethstat_read_interface(interfaces[i]);
+    ethstat_read_interface(interfaces + i);
 
   return 0;
 }
@@ -300,6 +373,18 @@ static int ethstat_shutdown(void) {
   void *key = NULL;
   void *value = NULL;
 
+  for (size_t i = 0; i < interfaces_num; i++) {
+    ethstat_interface_reset(interfaces + i);
+    sfree(interfaces[i].name);
+  }
+  sfree(interfaces);
+  interfaces_num = 0;
+
+  if (control_fd >= 0) {
+    close(control_fd);
+    control_fd = -1;
+  }
+
   if (value_map == NULL)
     return 0;
 
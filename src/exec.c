@@ -33,11 +33,18 @@
 
 #include "utils_cmd_putnotif.h"
 #include "utils_cmd_putval.h"
+#include "utils_complain.h"
 
 #include <grp.h>
+#include <poll.h>
 #include <pwd.h>
 #include <signal.h>
+#include <sys/socket.h>
 #include <sys/types.h>
+#if HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#endif
 
 #ifdef HAVE_SYS_CAPABILITY_H
 #include <sys/capability.h>
@@ -57,7 +64,10 @@
  * all functions used to handle notifications MUST NOT write to this structure.
  * The `pid' and `status' fields are thus unused if the `PL_NOTIF_ACTION' flag
  * is set.
- * The `PL_RUNNING' flag is set in `exec_read' and unset in `exec_read_one'.
+ * The `PL_RUNNING' flag is set in `exec_read' and unset in `exec_read_one' or,
+ * with the event loop, in `exec_child_check'.
+ * With `PersistentNotificationExec', `pid' and `notif_fd' of notification
+ * programs refer to the running worker and are protected by `notif_lock'.
  */
 struct program_list_s;
 typedef struct program_list_s program_list_t;
@@ -69,6 +79,10 @@ struct program_list_s {
   int pid;
   int status;
   int flags;
+  /* position in the list, used to refer to the program in fork requests */
+  int index;
+  int notif_fd;
+  c_complain_t notif_complaint;
   program_list_t *next;
 };
 
@@ -81,8 +95,25 @@ typedef struct program_list_and_notification_s {
  * Private variables
  */
 static program_list_t *pl_head = NULL;
+static int pl_num = 0;
 static pthread_mutex_t pl_lock = PTHREAD_MUTEX_INITIALIZER;
 
+/* The fork server is a small process forked from the daemon before it has
+ * grown. It forks the programs on behalf of the daemon, because forking a
+ * large, multi-threaded process is expensive. */
+static _Bool use_fork_server = 1;
+static int fork_server_fd = -1;
+static pid_t fork_server_pid = 0;
+static pthread_mutex_t fork_server_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static _Bool persistent_notifications = 0;
+static pthread_mutex_t notif_lock = PTHREAD_MUTEX_INITIALIZER;
+
+#if HAVE_SYS_EPOLL_H
+/* Read the output of all programs in a single thread, see exec_loop_main. */
+static _Bool event_loop = 1;
+#endif
+
 /*
  * Functions
  */
@@ -219,6 +250,10 @@ static int exec_config_exec(oconfig_item_t *ci) /* {{{ */
     DEBUG("exec plugin: argv[%i] = %s", i, pl->argv[i]);
   }
 
+  pl->index = pl_num++;
+  pl->notif_fd = -1;
+  C_COMPLAIN_INIT(&pl->notif_complaint);
+
   pl->next = pl_head;
   pl_head = pl;
 
@@ -232,6 +267,18 @@ static int exec_config(oconfig_item_t *ci) /* {{{ */
     if ((strcasecmp("Exec", child->key) == 0) ||
         (strcasecmp("NotificationExec", child->key) == 0))
       exec_config_exec(child);
+    else if (strcasecmp("ForkServer", child->key) == 0)
+      cf_util_get_boolean(child, &use_fork_server);
+    else if (strcasecmp("PersistentNotificationExec", child->key) == 0)
+      cf_util_get_boolean(child, &persistent_notifications);
+    else if (strcasecmp("EventLoop", child->key) == 0) {
+#if HAVE_SYS_EPOLL_H
+      cf_util_get_boolean(child, &event_loop);
+#else
+      WARNING("exec plugin: EventLoop is not supported on this system; "
+              "using one thread per program.");
+#endif
+    }
     else {
       WARNING("exec plugin: Unknown config option `%s'.", child->key);
     }
@@ -345,8 +392,8 @@ static void close_pipe(int fd_pipe[2]) /* {{{ */
  * the child and fd_out is connected to STDOUT and fd_err is connected to STDERR
  * of the child. Then is calls `exec_child'.
  */
-static int fork_child(program_list_t *pl, int *fd_in, int *fd_out,
-                      int *fd_err) /* {{{ */
+static int fork_child_direct(program_list_t *pl, int *fd_in, int *fd_out,
+                             int *fd_err) /* {{{ */
 {
   int fd_pipe_in[2] = {-1, -1};
   int fd_pipe_out[2] = {-1, -1};
@@ -498,6 +545,201 @@ failed:
   close_pipe(fd_pipe_err);
 
   return -1;
+} /* int fork_child_direct }}} */
+
+static program_list_t *pl_by_index(int index) /* {{{ */
+{
+  for (program_list_t *pl = pl_head; pl != NULL; pl = pl->next)
+    if (pl->index == index)
+      return pl;
+  return NULL;
+} /* }}} program_list_t *pl_by_index */
+
+/*
+ * Main loop of the fork server: Reads the index of a program from `fd',
+ * forks the program and sends back its PID and the STDIN, STDOUT and STDERR
+ * pipes. The server's children are reaped here, the daemon only sees the
+ * pipes being closed. Exits when the daemon closes its end of the socket.
+ */
+__attribute__((noreturn)) static void fork_server_main(int fd) /* {{{ */
+{
+  struct sigaction sa = {.sa_handler = SIG_DFL};
+  sigaction(SIGCHLD, &sa, NULL);
+
+  while (1) {
+    struct pollfd pfd = {.fd = fd, .events = POLLIN};
+    int status = poll(&pfd, 1, /* timeout = */ 1000);
+
+    while (waitpid(-1, NULL, WNOHANG) > 0)
+      /* reap */;
+
+    if ((status < 0) && (errno != EINTR))
+      break;
+    if (status <= 0)
+      continue;
+
+    int index;
+    if (read(fd, &index, sizeof(index)) != (ssize_t)sizeof(index))
+      break;
+
+    int fds[3] = {-1, -1, -1};
+    int pid = -1;
+    program_list_t *pl = pl_by_index(index);
+    if (pl != NULL)
+      pid = fork_child_direct(pl, &fds[0], &fds[1], &fds[2]);
+
+    char control[CMSG_SPACE(sizeof(fds))];
+    struct iovec iov = {.iov_base = &pid, .iov_len = sizeof(pid)};
+    struct msghdr msg = {.msg_iov = &iov, .msg_iovlen = 1};
+
+    if (pid > 0) {
+      memset(control, 0, sizeof(control));
+      msg.msg_control = control;
+      msg.msg_controllen = sizeof(control);
+
+      struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+      cmsg->cmsg_level = SOL_SOCKET;
+      cmsg->cmsg_type = SCM_RIGHTS;
+      cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+      memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+    }
+
+    status = (int)sendmsg(fd, &msg, 0);
+
+    for (size_t i = 0; i < STATIC_ARRAY_SIZE(fds); i++)
+      if (fds[i] >= 0)
+        close(fds[i]);
+
+    if (status < 0)
+      break;
+  }
+
+  _exit(0);
+} /* }}} void fork_server_main */
+
+static int fork_server_start(void) /* {{{ */
+{
+  int sv[2];
+
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) {
+    ERROR("exec plugin: socketpair failed: %s", STRERRNO);
+    return -1;
+  }
+
+  pid_t pid = fork();
+  if (pid < 0) {
+    ERROR("exec plugin: Forking the fork server failed: %s", STRERRNO);
+    close(sv[0]);
+    close(sv[1]);
+    return -1;
+  } else if (pid == 0) {
+    close(sv[0]);
+    fork_server_main(sv[1]);
+    /* does not return */
+  }
+
+  close(sv[1]);
+  fcntl(sv[0], F_SETFD, FD_CLOEXEC);
+
+  fork_server_fd = sv[0];
+  fork_server_pid = pid;
+  return 0;
+} /* }}} int fork_server_start */
+
+static void fork_server_stop(void) /* {{{ */
+{
+  if (fork_server_fd < 0)
+    return;
+
+  /* The server exits when reading from the socket fails. */
+  close(fork_server_fd);
+  fork_server_fd = -1;
+
+  waitpid(fork_server_pid, NULL, 0);
+  fork_server_pid = 0;
+} /* }}} void fork_server_stop */
+
+/* fork_server_lock must be held when calling this function. */
+static int fork_child_server(program_list_t *pl, int fds[3]) /* {{{ */
+{
+  int pid = -1;
+  char control[CMSG_SPACE(3 * sizeof(int))];
+  struct iovec iov = {.iov_base = &pid, .iov_len = sizeof(pid)};
+  struct msghdr msg = {
+      .msg_iov = &iov,
+      .msg_iovlen = 1,
+      .msg_control = control,
+      .msg_controllen = sizeof(control),
+  };
+
+  if (write(fork_server_fd, &pl->index, sizeof(pl->index)) !=
+      (ssize_t)sizeof(pl->index))
+    return -2;
+
+  ssize_t status;
+  do {
+    status = recvmsg(fork_server_fd, &msg, 0);
+  } while ((status < 0) && (errno == EINTR));
+
+  if (status != (ssize_t)sizeof(pid))
+    return -2;
+
+  if (pid <= 0)
+    return -1;
+
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  if ((cmsg == NULL) || (cmsg->cmsg_level != SOL_SOCKET) ||
+      (cmsg->cmsg_type != SCM_RIGHTS) ||
+      (cmsg->cmsg_len != CMSG_LEN(3 * sizeof(int)))) {
+    ERROR("exec plugin: The fork server did not send the pipes of `%s'.",
+          pl->exec);
+    kill(pid, SIGTERM);
+    return -1;
+  }
+
+  memcpy(fds, CMSG_DATA(cmsg), 3 * sizeof(int));
+  return pid;
+} /* }}} int fork_child_server */
+
+/*
+ * Starts the program of `pl' and connects its STDIN, STDOUT and STDERR as
+ * `fork_child_direct' does. The program is forked by the fork server if it
+ * is running, else by the daemon itself.
+ */
+static int fork_child(program_list_t *pl, int *fd_in, int *fd_out,
+                      int *fd_err) /* {{{ */
+{
+  int fds[3] = {-1, -1, -1};
+  int pid = -2;
+
+  if (pl->pid != 0)
+    return -1;
+
+  pthread_mutex_lock(&fork_server_lock);
+  if (fork_server_fd >= 0) {
+    pid = fork_child_server(pl, fds);
+    if (pid == -2) {
+      ERROR("exec plugin: Lost connection to the fork server; "
+            "forking programs from the daemon from now on.");
+      fork_server_stop();
+    }
+  }
+  pthread_mutex_unlock(&fork_server_lock);
+
+  if (pid == -2)
+    return fork_child_direct(pl, fd_in, fd_out, fd_err);
+  if (pid < 0)
+    return -1;
+
+  int *ret[3] = {fd_in, fd_out, fd_err};
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(fds); i++) {
+    if (ret[i] != NULL)
+      *ret[i] = fds[i];
+    else
+      close(fds[i]);
+  }
+
+  return pid;
 } /* int fork_child }}} */
 
 static int parse_line(char *buffer) /* {{{ */
@@ -661,31 +903,10 @@ static void *exec_read_one(void *arg) /* {{{ */
   return NULL;
 } /* void *exec_read_one }}} */
 
-static void *exec_notification_one(void *arg) /* {{{ */
-{
-  program_list_t *pl = ((program_list_and_notification_t *)arg)->pl;
-  notification_t *n = &((program_list_and_notification_t *)arg)->n;
-  int fd;
-  FILE *fh;
-  int pid;
-  int status;
+static void exec_print_notification(FILE *fh, /* {{{ */
+                                    const notification_t *n) {
   const char *severity;
 
-  pid = fork_child(pl, &fd, NULL, NULL);
-  if (pid < 0) {
-    sfree(arg);
-    pthread_exit((void *)1);
-  }
-
-  fh = fdopen(fd, "w");
-  if (fh == NULL) {
-    ERROR("exec plugin: fdopen (%i) failed: %s", fd, STRERRNO);
-    kill(pid, SIGTERM);
-    close(fd);
-    sfree(arg);
-    pthread_exit((void *)1);
-  }
-
   severity = "FAILURE";
   if (n->severity == NOTIF_WARNING)
     severity = "WARNING";
@@ -725,6 +946,33 @@ static void *exec_notification_one(void *arg) /* {{{ */
   }
 
   fprintf(fh, "\n%s\n", n->message);
+} /* }}} void exec_print_notification */
+
+static void *exec_notification_one(void *arg) /* {{{ */
+{
+  program_list_t *pl = ((program_list_and_notification_t *)arg)->pl;
+  notification_t *n = &((program_list_and_notification_t *)arg)->n;
+  int fd;
+  FILE *fh;
+  int pid;
+  int status;
+
+  pid = fork_child(pl, &fd, NULL, NULL);
+  if (pid < 0) {
+    sfree(arg);
+    pthread_exit((void *)1);
+  }
+
+  fh = fdopen(fd, "w");
+  if (fh == NULL) {
+    ERROR("exec plugin: fdopen (%i) failed: %s", fd, STRERRNO);
+    kill(pid, SIGTERM);
+    close(fd);
+    sfree(arg);
+    pthread_exit((void *)1);
+  }
+
+  exec_print_notification(fh, n);
 
   fflush(fh);
   fclose(fh);
@@ -741,12 +989,633 @@ static void *exec_notification_one(void *arg) /* {{{ */
   return NULL;
 } /* void *exec_notification_one }}} */
 
+/*
+ * Passes a notification to the persistent worker of `pl', starting the
+ * worker if it is not running. Notifications are written in one piece of at
+ * most PIPE_BUF bytes to the non-blocking pipe, so they are either passed
+ * completely or, if the worker does not keep up, dropped.
+ */
+static int exec_notification_persistent(program_list_t *pl, /* {{{ */
+                                        const notification_t *n) {
+  char buffer[PIPE_BUF];
+  notification_t copy = *n;
+
+  /* The message must be a single line, because it ends the notification. */
+  for (char *c = copy.message; *c != 0; c++)
+    if ((*c == '\n') || (*c == '\r'))
+      *c = ' ';
+
+  FILE *fh = fmemopen(buffer, sizeof(buffer), "w");
+  if (fh == NULL) {
+    ERROR("exec plugin: fmemopen failed: %s", STRERRNO);
+    return -1;
+  }
+  exec_print_notification(fh, &copy);
+  fflush(fh);
+  long len = ftell(fh);
+  _Bool truncated = ferror(fh) || (len < 0) || ((size_t)len >= sizeof(buffer));
+  fclose(fh);
+
+  if (truncated) {
+    WARNING("exec plugin: Notification is too large for `%s', dropping it.",
+            pl->exec);
+    return -1;
+  }
+
+  int status = -1;
+  pthread_mutex_lock(&notif_lock);
+  for (int attempt = 0; attempt < 2; attempt++) {
+    if (pl->notif_fd < 0) {
+      int pid = fork_child(pl, &pl->notif_fd, NULL, NULL);
+      if (pid < 0)
+        break;
+      pl->pid = pid;
+      fcntl(pl->notif_fd, F_SETFL, fcntl(pl->notif_fd, F_GETFL) | O_NONBLOCK);
+    }
+
+    ssize_t written = write(pl->notif_fd, buffer, (size_t)len);
+    if (written == (ssize_t)len) {
+      c_release(LOG_INFO, &pl->notif_complaint,
+                "exec plugin: `%s' is accepting notifications again.",
+                pl->exec);
+      status = 0;
+      break;
+    } else if ((written < 0) && (errno == EAGAIN)) {
+      c_complain(LOG_WARNING, &pl->notif_complaint,
+                 "exec plugin: `%s' does not keep up with the notifications, "
+                 "dropping notifications.",
+                 pl->exec);
+      break;
+    }
+
+    /* The worker has exited. Start it again. */
+    NOTICE("exec plugin: Notification worker `%s' (pid %i) has exited.",
+           pl->exec, pl->pid);
+    close(pl->notif_fd);
+    pl->notif_fd = -1;
+    pl->pid = 0;
+  }
+  pthread_mutex_unlock(&notif_lock);
+
+  return status;
+} /* }}} int exec_notification_persistent */
+
+#if HAVE_SYS_EPOLL_H
+/*
+ * Event loop: Instead of starting a thread for each program, a single thread
+ * reads the output of all running programs and writes the notifications to
+ * the notification programs. The loop thread owns all exec_child_t
+ * structures. Other threads hand new children over using `loop_new' and wake
+ * the loop thread up by writing to `loop_wake'.
+ */
+#define EXEC_FD_IN 0
+#define EXEC_FD_OUT 1
+#define EXEC_FD_ERR 2
+#define EXEC_FD_PID 3
+#define EXEC_FD_NUM 4
+
+/* Maximum number of PUTVAL lines dispatched at once. */
+#define EXEC_BATCH_SIZE 64
+
+struct exec_child_s;
+typedef struct exec_child_s exec_child_t;
+
+typedef struct {
+  exec_child_t *child;
+  int index;
+} exec_watch_t;
+
+struct exec_child_s {
+  program_list_t *pl;
+  pid_t pid;
+  plugin_ctx_t ctx;
+  _Bool exited;
+
+  /* STDIN, STDOUT and STDERR of the program and a pidfd, or -1. */
+  int fds[EXEC_FD_NUM];
+  exec_watch_t watch[EXEC_FD_NUM];
+
+  char out[1200];
+  size_t out_len;
+  char err[1024];
+  size_t err_len;
+
+  /* The notification written to STDIN. */
+  char *in;
+  size_t in_len;
+  size_t in_off;
+
+  exec_child_t *prev;
+  exec_child_t *next;
+};
+
+typedef struct {
+  cmd_t cmds[EXEC_BATCH_SIZE];
+  size_t cmds_num;
+  value_list_t *vl;
+  size_t vl_size;
+} exec_batch_t;
+
+static int loop_efd = -1;
+static int loop_wake[2] = {-1, -1};
+static pthread_t loop_thread;
+
+static pthread_mutex_t loop_lock = PTHREAD_MUTEX_INITIALIZER;
+static exec_child_t *loop_new = NULL;
+static _Bool loop_quit = 0;
+
+/* Only accessed by the loop thread. */
+static exec_child_t *loop_children = NULL;
+static exec_batch_t loop_batch;
+
+static int exec_pidfd_open(pid_t pid) /* {{{ */
+{
+#ifdef SYS_pidfd_open
+  return (int)syscall(SYS_pidfd_open, pid, 0);
+#else
+  errno = ENOSYS;
+  return -1;
+#endif
+} /* }}} int exec_pidfd_open */
+
+static void exec_batch_flush(exec_batch_t *b) /* {{{ */
+{
+  size_t vl_num = 0;
+
+  if (b->cmds_num == 0)
+    return;
+
+  for (size_t i = 0; i < b->cmds_num; i++)
+    vl_num += b->cmds[i].cmd.putval.vl_num;
+
+  if (vl_num > b->vl_size) {
+    value_list_t *tmp = realloc(b->vl, vl_num * sizeof(*tmp));
+    if (tmp != NULL) {
+      b->vl = tmp;
+      b->vl_size = vl_num;
+    }
+  }
+
+  if (vl_num <= b->vl_size) {
+    size_t n = 0;
+    for (size_t i = 0; i < b->cmds_num; i++)
+      for (size_t j = 0; j < b->cmds[i].cmd.putval.vl_num; j++)
+        b->vl[n++] = b->cmds[i].cmd.putval.vl[j];
+    plugin_dispatch_values_batch(b->vl, n);
+  } else {
+    for (size_t i = 0; i < b->cmds_num; i++)
+      for (size_t j = 0; j < b->cmds[i].cmd.putval.vl_num; j++)
+        plugin_dispatch_values(&b->cmds[i].cmd.putval.vl[j]);
+  }
+
+  for (size_t i = 0; i < b->cmds_num; i++)
+    cmd_destroy(&b->cmds[i]);
+  b->cmds_num = 0;
+} /* }}} void exec_batch_flush */
+
+/* Like parse_line, but PUTVAL lines are collected and dispatched in batches
+ * by exec_batch_flush. */
+static void exec_batch_line(exec_batch_t *b, char *line) /* {{{ */
+{
+  if (strncasecmp("PUTVAL", line, strlen("PUTVAL")) != 0) {
+    /* Keep the order of values and notifications. */
+    exec_batch_flush(b);
+    parse_line(line);
+    return;
+  }
+
+  cmd_error_handler_t err = {cmd_error_fh, stdout};
+  cmd_t *cmd = b->cmds + b->cmds_num;
+
+  if (cmd_parse(line, cmd, NULL, &err) != CMD_OK)
+    return;
+  if (cmd->type != CMD_PUTVAL) {
+    cmd_error(CMD_UNKNOWN_COMMAND, &err, "Unexpected command: `%s'.",
+              CMD_TO_STRING(cmd->type));
+    cmd_destroy(cmd);
+    return;
+  }
+
+  b->cmds_num++;
+  if (b->cmds_num >= EXEC_BATCH_SIZE)
+    exec_batch_flush(b);
+} /* }}} void exec_batch_line */
+
+static void exec_child_close(exec_child_t *c, int index) /* {{{ */
+{
+  if (c->fds[index] < 0)
+    return;
+
+  epoll_ctl(loop_efd, EPOLL_CTL_DEL, c->fds[index], NULL);
+  close(c->fds[index]);
+  c->fds[index] = -1;
+} /* }}} void exec_child_close */
+
+static void exec_child_free(exec_child_t *c) /* {{{ */
+{
+  for (int i = 0; i < EXEC_FD_NUM; i++)
+    exec_child_close(c, i);
+
+  if (c->prev != NULL)
+    c->prev->next = c->next;
+  else if (loop_children == c)
+    loop_children = c->next;
+  if (c->next != NULL)
+    c->next->prev = c->prev;
+
+  sfree(c->in);
+  sfree(c);
+} /* }}} void exec_child_free */
+
+/* Collects the exit status without blocking. Returns zero if the program is
+ * still running. Programs started by the fork server and programs already
+ * reaped by sigchld_handler are not our children any more; waitpid fails
+ * for those. */
+static int exec_child_wait(exec_child_t *c) /* {{{ */
+{
+  int status;
+  pid_t pid = waitpid(c->pid, &status, WNOHANG);
+
+  if (pid == 0)
+    return 0;
+  if ((pid > 0) && (c->pl->flags & PL_NORMAL))
+    c->pl->status = status;
+  return 1;
+} /* }}} int exec_child_wait */
+
+/* Frees the child once it has closed its pipes and exited. Without a pidfd,
+ * the exit is only noticed by polling, like exec_read_one does. */
+static void exec_child_check(exec_child_t *c) /* {{{ */
+{
+  if ((c->fds[EXEC_FD_IN] >= 0) || (c->fds[EXEC_FD_OUT] >= 0) ||
+      (c->fds[EXEC_FD_ERR] >= 0))
+    return;
+
+  if (!c->exited && (c->fds[EXEC_FD_PID] < 0) && (exec_child_wait(c) != 0))
+    c->exited = 1;
+  if (!c->exited)
+    return;
+
+  DEBUG("exec plugin: Child %i exited with status %i.", (int)c->pid,
+        c->pl->status);
+
+  if (c->pl->flags & PL_NORMAL) {
+    c->pl->pid = 0;
+
+    pthread_mutex_lock(&pl_lock);
+    c->pl->flags &= ~PL_RUNNING;
+    pthread_mutex_unlock(&pl_lock);
+  }
+
+  exec_child_free(c);
+} /* }}} void exec_child_check */
+
+static void exec_child_read(exec_child_t *c, int index) /* {{{ */
+{
+  char *buffer = (index == EXEC_FD_OUT) ? c->out : c->err;
+  size_t size = (index == EXEC_FD_OUT) ? sizeof(c->out) : sizeof(c->err);
+  size_t *len = (index == EXEC_FD_OUT) ? &c->out_len : &c->err_len;
+
+  ssize_t status = read(c->fds[index], buffer + *len, size - 1 - *len);
+  if (status < 0) {
+    if ((errno == EINTR) || (errno == EAGAIN) || (errno == EWOULDBLOCK))
+      return;
+    exec_child_close(c, index);
+    return;
+  } else if (status == 0) {
+    /* We've reached EOF */
+    if (index == EXEC_FD_ERR)
+      NOTICE("exec plugin: Program `%s' has closed STDERR.", c->pl->exec);
+    exec_child_close(c, index);
+    return;
+  }
+  *len += (size_t)status;
+
+  plugin_set_ctx(c->ctx);
+
+  while (*len > 0) {
+    size_t line_len;
+    size_t consumed;
+    char *newline = memchr(buffer, '\n', *len);
+
+    if (newline != NULL) {
+      line_len = (size_t)(newline - buffer);
+      consumed = line_len + 1;
+    } else if (*len >= size - 1) { /* split long lines */
+      line_len = consumed = *len;
+    } else {
+      break;
+    }
+
+    buffer[line_len] = 0;
+    if ((line_len > 0) && (buffer[line_len - 1] == '\r'))
+      buffer[line_len - 1] = 0;
+
+    if (index == EXEC_FD_OUT)
+      exec_batch_line(&loop_batch, buffer);
+    else
+      ERROR("exec plugin: exec_read_one: error = %s", buffer);
+
+    *len -= consumed;
+    memmove(buffer, buffer + consumed, *len);
+  }
+
+  exec_batch_flush(&loop_batch);
+} /* }}} void exec_child_read */
+
+static void exec_child_write(exec_child_t *c) /* {{{ */
+{
+  while (c->in_off < c->in_len) {
+    ssize_t status =
+        write(c->fds[EXEC_FD_IN], c->in + c->in_off, c->in_len - c->in_off);
+    if (status < 0) {
+      if (errno == EINTR)
+        continue;
+      if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+        return;
+      break;
+    }
+    c->in_off += (size_t)status;
+  }
+
+  /* Closing STDIN ends the notification. */
+  exec_child_close(c, EXEC_FD_IN);
+  sfree(c->in);
+} /* }}} void exec_child_write */
+
+static void exec_loop_handle(exec_watch_t *w, uint32_t events) /* {{{ */
+{
+  exec_child_t *c = w->child;
+
+  if (w->index == EXEC_FD_PID) {
+    exec_child_wait(c);
+    c->exited = 1;
+    exec_child_close(c, EXEC_FD_PID);
+  } else if (w->index == EXEC_FD_IN) {
+    if (events & EPOLLERR)
+      exec_child_close(c, EXEC_FD_IN);
+    else
+      exec_child_write(c);
+  } else {
+    exec_child_read(c, w->index);
+  }
+
+  exec_child_check(c);
+} /* }}} void exec_loop_handle */
+
+static void exec_loop_register(exec_child_t *c) /* {{{ */
+{
+  c->next = loop_children;
+  if (loop_children != NULL)
+    loop_children->prev = c;
+  loop_children = c;
+
+  for (int i = 0; i < EXEC_FD_NUM; i++) {
+    if (c->fds[i] < 0)
+      continue;
+
+    struct epoll_event ev = {.events = (i == EXEC_FD_IN) ? EPOLLOUT : EPOLLIN,
+                             .data.ptr = c->watch + i};
+    if (epoll_ctl(loop_efd, EPOLL_CTL_ADD, c->fds[i], &ev) != 0) {
+      ERROR("exec plugin: epoll_ctl failed: %s", STRERRNO);
+      close(c->fds[i]);
+      c->fds[i] = -1;
+    }
+  }
+
+  exec_child_check(c);
+} /* }}} void exec_loop_register */
+
+/* Returns true if the loop should quit. */
+static _Bool exec_loop_wakeup(void) /* {{{ */
+{
+  char buffer[64];
+  while (read(loop_wake[0], buffer, sizeof(buffer)) > 0)
+    ;
+
+  pthread_mutex_lock(&loop_lock);
+  exec_child_t *new = loop_new;
+  loop_new = NULL;
+  _Bool quit = loop_quit;
+  pthread_mutex_unlock(&loop_lock);
+
+  while (new != NULL) {
+    exec_child_t *next = new->next;
+    exec_loop_register(new);
+    new = next;
+  }
+
+  return quit;
+} /* }}} _Bool exec_loop_wakeup */
+
+static void *exec_loop_main(void __attribute__((unused)) * arg) /* {{{ */
+{
+  struct epoll_event events[64];
+  _Bool quit = 0;
+
+  while (!quit) {
+    int num = epoll_wait(loop_efd, events, STATIC_ARRAY_SIZE(events),
+                         /* timeout = */ 1000);
+    if (num < 0) {
+      if (errno == EINTR)
+        continue;
+      ERROR("exec plugin: epoll_wait failed: %s", STRERRNO);
+      break;
+    }
+
+    for (int i = 0; i < num; i++) {
+      if (events[i].data.ptr == NULL)
+        quit = exec_loop_wakeup();
+      else
+        exec_loop_handle(events[i].data.ptr, events[i].events);
+    }
+
+    /* Poll the exit of programs which have closed their pipes but have no
+     * pidfd. */
+    for (exec_child_t *c = loop_children, *next; c != NULL; c = next) {
+      next = c->next;
+      exec_child_check(c);
+    }
+  }
+
+  /* Running programs are killed by exec_shutdown. */
+  pthread_mutex_lock(&loop_lock);
+  exec_child_t *new = loop_new;
+  loop_new = NULL;
+  pthread_mutex_unlock(&loop_lock);
+  while (new != NULL) {
+    exec_child_t *next = new->next;
+    exec_child_free(new);
+    new = next;
+  }
+  while (loop_children != NULL)
+    exec_child_free(loop_children);
+  sfree(loop_batch.vl);
+  loop_batch.vl_size = 0;
+
+  return (void *)0;
+} /* }}} void *exec_loop_main */
+
+/*
+ * Hands the pipes of a newly started program over to the loop thread, which
+ * takes care of reading its output, writing `in' to its STDIN and reaping it.
+ * `in' is freed by the loop thread. On failure, the pipes are closed and the
+ * program is killed.
+ */
+static int exec_loop_add(program_list_t *pl, pid_t pid, /* {{{ */
+                         int fd_in, int fd_out, int fd_err, char *in,
+                         size_t in_len) {
+  int fds[EXEC_FD_NUM] = {fd_in, fd_out, fd_err, exec_pidfd_open(pid)};
+  exec_child_t *c = calloc(1, sizeof(*c));
+
+  if (c == NULL) {
+    ERROR("exec plugin: calloc failed.");
+    kill(pid, SIGTERM);
+    for (int i = 0; i < EXEC_FD_NUM; i++)
+      if (fds[i] >= 0)
+        close(fds[i]);
+    sfree(in);
+    return ENOMEM;
+  }
+
+  c->pl = pl;
+  c->pid = pid;
+  c->ctx = plugin_get_ctx();
+  c->in = in;
+  c->in_len = in_len;
+  for (int i = 0; i < EXEC_FD_NUM; i++) {
+    c->fds[i] = fds[i];
+    c->watch[i] = (exec_watch_t){.child = c, .index = i};
+    if ((i != EXEC_FD_PID) && (fds[i] >= 0))
+      fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+  }
+
+  pthread_mutex_lock(&loop_lock);
+  c->next = loop_new;
+  loop_new = c;
+  pthread_mutex_unlock(&loop_lock);
+
+  /* If the pipe is full, the loop thread has yet to look at `loop_new'. */
+  if (write(loop_wake[1], "", 1) < 0)
+    DEBUG("exec plugin: Waking up the loop thread failed: %s", STRERRNO);
+
+  return 0;
+} /* }}} int exec_loop_add */
+
+static void exec_loop_read(program_list_t *pl) /* {{{ */
+{
+  int fd, fd_err;
+  int pid = fork_child(pl, NULL, &fd, &fd_err);
+
+  if (pid > 0) {
+    pl->pid = pid;
+    if (exec_loop_add(pl, pid, -1, fd, fd_err, NULL, 0) == 0)
+      return;
+    pl->pid = 0;
+  }
+
+  /* Reset the "running" flag */
+  pthread_mutex_lock(&pl_lock);
+  pl->flags &= ~PL_RUNNING;
+  pthread_mutex_unlock(&pl_lock);
+} /* }}} void exec_loop_read */
+
+static void exec_loop_notification(program_list_t *pl, /* {{{ */
+                                   const notification_t *n) {
+  char *buffer = NULL;
+  size_t buffer_size = 0;
+
+  FILE *fh = open_memstream(&buffer, &buffer_size);
+  if (fh == NULL) {
+    ERROR("exec plugin: open_memstream failed: %s", STRERRNO);
+    return;
+  }
+  exec_print_notification(fh, n);
+  fclose(fh);
+
+  int fd;
+  int pid = fork_child(pl, &fd, NULL, NULL);
+  if (pid < 0) {
+    sfree(buffer);
+    return;
+  }
+
+  exec_loop_add(pl, pid, fd, -1, -1, buffer, buffer_size);
+} /* }}} void exec_loop_notification */
+
+static int exec_loop_start(void) /* {{{ */
+{
+  loop_efd = epoll_create1(EPOLL_CLOEXEC);
+  if (loop_efd < 0) {
+    ERROR("exec plugin: epoll_create1 failed: %s", STRERRNO);
+    return -1;
+  }
+
+  if (pipe(loop_wake) != 0) {
+    ERROR("exec plugin: pipe failed: %s", STRERRNO);
+    close(loop_efd);
+    loop_efd = -1;
+    return -1;
+  }
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(loop_wake); i++) {
+    fcntl(loop_wake[i], F_SETFL, fcntl(loop_wake[i], F_GETFL) | O_NONBLOCK);
+    fcntl(loop_wake[i], F_SETFD, fcntl(loop_wake[i], F_GETFD) | FD_CLOEXEC);
+  }
+
+  struct epoll_event ev = {.events = EPOLLIN, .data.ptr = NULL};
+  int status = epoll_ctl(loop_efd, EPOLL_CTL_ADD, loop_wake[0], &ev);
+  if (status != 0)
+    ERROR("exec plugin: epoll_ctl failed: %s", STRERRNO);
+  else if ((status = plugin_thread_create(&loop_thread, NULL, exec_loop_main,
+                                          NULL, "exec loop")) != 0)
+    ERROR("exec plugin: plugin_thread_create failed.");
+
+  if (status != 0) {
+    close_pipe(loop_wake);
+    loop_wake[0] = loop_wake[1] = -1;
+    close(loop_efd);
+    loop_efd = -1;
+    return -1;
+  }
+
+  return 0;
+} /* }}} int exec_loop_start */
+
+static void exec_loop_stop(void) /* {{{ */
+{
+  if (loop_efd < 0)
+    return;
+
+  pthread_mutex_lock(&loop_lock);
+  loop_quit = 1;
+  pthread_mutex_unlock(&loop_lock);
+
+  if (write(loop_wake[1], "", 1) < 0)
+    DEBUG("exec plugin: Waking up the loop thread failed: %s", STRERRNO);
+  pthread_join(loop_thread, NULL);
+
+  close_pipe(loop_wake);
+  loop_wake[0] = loop_wake[1] = -1;
+  close(loop_efd);
+  loop_efd = -1;
+} /* }}} void exec_loop_stop */
+#endif /* HAVE_SYS_EPOLL_H */
+
 static int exec_init(void) /* {{{ */
 {
   struct sigaction sa = {.sa_handler = sigchld_handler};
 
   sigaction(SIGCHLD, &sa, NULL);
 
+  if (use_fork_server && (pl_head != NULL))
+    fork_server_start();
+
+#if HAVE_SYS_EPOLL_H
+  if (event_loop && (pl_head != NULL) && (exec_loop_start() != 0))
+    WARNING("exec plugin: Starting the event loop failed; "
+            "using one thread per program.");
+#endif
+
 #if defined(HAVE_SYS_CAPABILITY_H) && defined(CAP_SETUID) && defined(CAP_SETGID)
   if ((check_capability(CAP_SETUID) != 0) ||
       (check_capability(CAP_SETGID) != 0)) {
@@ -786,6 +1655,13 @@ static int exec_read(void) /* {{{ */
     pl->flags |= PL_RUNNING;
     pthread_mutex_unlock(&pl_lock);
 
+#if HAVE_SYS_EPOLL_H
+    if (loop_efd >= 0) {
+      exec_loop_read(pl);
+      continue;
+    }
+#endif
+
     pthread_attr_init(&attr);
     pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
     int status =
@@ -811,10 +1687,22 @@ static int exec_notification(const notification_t *n, /* {{{ */
     if ((pl->flags & PL_NOTIF_ACTION) == 0)
       continue;
 
+    if (persistent_notifications) {
+      exec_notification_persistent(pl, n);
+      continue;
+    }
+
     /* Skip if a child is already running. */
     if (pl->pid != 0)
       continue;
 
+#if HAVE_SYS_EPOLL_H
+    if (loop_efd >= 0) {
+      exec_loop_notification(pl, n);
+      continue;
+    }
+#endif
+
     pln = malloc(sizeof(*pln));
     if (pln == NULL) {
       ERROR("exec plugin: malloc failed.");
@@ -847,10 +1735,17 @@ static int exec_shutdown(void) /* {{{ */
   program_list_t *pl;
   program_list_t *next;
 
+#if HAVE_SYS_EPOLL_H
+  exec_loop_stop();
+#endif
+
   pl = pl_head;
   while (pl != NULL) {
     next = pl->next;
 
+    if (pl->notif_fd >= 0)
+      close(pl->notif_fd);
+
     if (pl->pid > 0) {
       kill(pl->pid, SIGTERM);
       INFO("exec plugin: Sent SIGTERM to %hu", (unsigned short int)pl->pid);
@@ -863,6 +1758,8 @@ static int exec_shutdown(void) /* {{{ */
   } /* while (pl) */
   pl_head = NULL;
 
+  fork_server_stop();
+
   return 0;
 } /* int exec_shutdown }}} */
 
@@ -75,20 +75,15 @@ static int fhcount_read(void) {
   int prc_used, prc_unused;
   char *fields[3];
   char buffer[buffer_len];
-  FILE *fp;
+  ssize_t len;
 
-  // Open file
-  fp = fopen("/proc/sys/fs/file-nr", "r");
-  if (fp == NULL) {
-    ERROR("fhcount: fopen: %s", STRERRNO);
+  // Read file
+  len = read_file_cached("/proc/sys/fs/file-nr", buffer, buffer_len - 1);
+  if (len < 0) {
+    ERROR("fhcount: Reading /proc/sys/fs/file-nr failed: %s", STRERRNO);
     return EXIT_FAILURE;
   }
-  if (fgets(buffer, buffer_len, fp) == NULL) {
-    ERROR("fhcount: fgets: %s", STRERRNO);
-    fclose(fp);
-    return EXIT_FAILURE;
-  }
-  fclose(fp);
+  buffer[len] = '\0';
 
   // Tokenize string
   numfields = strsplit(buffer, fields, STATIC_ARRAY_SIZE(fields));
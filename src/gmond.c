@@ -24,11 +24,14 @@
  *   Florian octo Forster <octo at collectd.org>
  **/
 
+#define _GNU_SOURCE /* For recvmmsg(2) */
+
 #include "collectd.h"
 
 #include "common.h"
 #include "plugin.h"
 #include "utils_avltree.h"
+#include "utils_rcvbuf.h"
 
 #if HAVE_NETDB_H
 #include <netdb.h>
@@ -59,6 +62,14 @@
 #define BUFF_SIZE 1400
 #endif
 
+/* Number of datagrams received with one recvmmsg(2) call. */
+#define MC_RECEIVE_BATCH 32
+
+/* AIX doesn't have MSG_DONTWAIT */
+#ifndef MSG_DONTWAIT
+#define MSG_DONTWAIT MSG_NONBLOCK
+#endif
+
 struct socket_entry_s {
   int fd;
   struct sockaddr_storage addr;
@@ -95,6 +106,14 @@ static socket_entry_t *mc_send_sockets = NULL;
 static size_t mc_send_sockets_num = 0;
 static pthread_mutex_t mc_send_sockets_lock = PTHREAD_MUTEX_INITIALIZER;
 
+static int mc_receive_buffer = 0;
+static _Bool mc_receive_buffer_auto = 1;
+
+/* Datagrams dropped by the kernel. Only reported if drops can be counted for
+ * at least one socket. */
+static uint64_t mc_receive_drops = 0;
+static _Bool mc_receive_drops_enabled = 0;
+
 static int mc_receive_thread_loop = 0;
 static int mc_receive_thread_running = 0;
 static pthread_t mc_receive_thread_id;
@@ -125,75 +144,106 @@ static size_t metric_map_len_default = STATIC_ARRAY_SIZE(metric_map_default);
 static metric_map_t *metric_map = NULL;
 static size_t metric_map_len = 0;
 
+/* Open addressing hash table of the user-supplied and the built-in metrics,
+ * built by gmond_init(). The user-supplied entries take precedence. */
+static metric_map_t **metric_hash = NULL;
+static size_t metric_hash_mask = 0;
+
 static c_avl_tree_t *staging_tree;
 static pthread_mutex_t staging_lock = PTHREAD_MUTEX_INITIALIZER;
 
+static void metric_hash_insert(metric_map_t *map) /* {{{ */
+{
+  size_t i = (size_t)identifier_hash(map->ganglia_name) & metric_hash_mask;
+
+  while (metric_hash[i] != NULL) {
+    if (strcmp(metric_hash[i]->ganglia_name, map->ganglia_name) == 0)
+      return;
+    i = (i + 1) & metric_hash_mask;
+  }
+
+  metric_hash[i] = map;
+} /* }}} void metric_hash_insert */
+
+static int metric_hash_create(void) /* {{{ */
+{
+  size_t size = 16;
+
+  /* Keep the table at most half full so that probe sequences are short. */
+  while (size < 2 * (metric_map_len + metric_map_len_default))
+    size *= 2;
+
+  metric_hash = calloc(size, sizeof(*metric_hash));
+  if (metric_hash == NULL)
+    return ENOMEM;
+  metric_hash_mask = size - 1;
+
+  for (size_t i = 0; i < metric_map_len; i++)
+    metric_hash_insert(metric_map + i);
+  for (size_t i = 0; i < metric_map_len_default; i++)
+    metric_hash_insert(metric_map_default + i);
+
+  return 0;
+} /* }}} int metric_hash_create */
+
 static metric_map_t *metric_lookup(const char *key) /* {{{ */
 {
-  metric_map_t *map;
-  size_t map_len;
-  size_t i;
-
-  /* Search the user-supplied table first.. */
-  map = metric_map;
-  map_len = metric_map_len;
-  for (i = 0; i < map_len; i++)
-    if (strcmp(map[i].ganglia_name, key) == 0)
-      break;
+  metric_map_t *map = NULL;
 
-  /* .. and fall back to the built-in table if nothing is found. */
-  if (i >= map_len) {
-    map = metric_map_default;
-    map_len = metric_map_len_default;
+  if (metric_hash == NULL)
+    return NULL;
 
-    for (i = 0; i < map_len; i++)
-      if (strcmp(map[i].ganglia_name, key) == 0)
-        break;
+  for (size_t i = (size_t)identifier_hash(key) & metric_hash_mask;
+       metric_hash[i] != NULL; i = (i + 1) & metric_hash_mask) {
+    if (strcmp(metric_hash[i]->ganglia_name, key) == 0) {
+      map = metric_hash[i];
+      break;
+    }
   }
 
-  if (i >= map_len)
+  if (map == NULL)
     return NULL;
 
   /* Look up the DS type and ds_index. */
-  if (map[i].ds_type < 0) /* {{{ */
+  if (map->ds_type < 0) /* {{{ */
   {
     const data_set_t *ds;
 
-    ds = plugin_get_ds(map[i].type);
+    ds = plugin_get_ds(map->type);
     if (ds == NULL) {
-      WARNING("gmond plugin: Type not defined: %s", map[i].type);
+      WARNING("gmond plugin: Type not defined: %s", map->type);
       return NULL;
     }
 
-    if ((map[i].ds_name == NULL) && (ds->ds_num != 1)) {
+    if ((map->ds_name == NULL) && (ds->ds_num != 1)) {
       WARNING("gmond plugin: No data source name defined for metric %s, "
               "but type %s has more than one data source.",
-              map[i].ganglia_name, map[i].type);
+              map->ganglia_name, map->type);
       return NULL;
     }
 
-    if (map[i].ds_name == NULL) {
-      map[i].ds_index = 0;
+    if (map->ds_name == NULL) {
+      map->ds_index = 0;
     } else {
       size_t j;
 
       for (j = 0; j < ds->ds_num; j++)
-        if (strcasecmp(ds->ds[j].name, map[i].ds_name) == 0)
+        if (strcasecmp(ds->ds[j].name, map->ds_name) == 0)
           break;
 
       if (j >= ds->ds_num) {
         WARNING("gmond plugin: There is no data source "
                 "named `%s' in type `%s'.",
-                map[i].ds_name, ds->type);
+                map->ds_name, ds->type);
         return NULL;
       }
-      map[i].ds_index = j;
+      map->ds_index = j;
     }
 
-    map[i].ds_type = ds->ds[map[i].ds_index].type;
-  } /* }}} if ((map[i].ds_type < 0) || (map[i].ds_index < 0)) */
+    map->ds_type = ds->ds[map->ds_index].type;
+  } /* }}} if ((map->ds_type < 0) || (map->ds_index < 0)) */
 
-  return map + i;
+  return map;
 } /* }}} metric_map_t *metric_lookup */
 
 static int create_sockets(socket_entry_t **ret_sockets, /* {{{ */
@@ -689,6 +739,8 @@ static int mc_handle_metric(void *buffer, size_t buffer_size) /* {{{ */
 
     if (xdr_Ganglia_value_msg(&xdr, &msg))
       mc_handle_value_msg(&msg);
+    /* Free the strings allocated while decoding. */
+    xdr_free((xdrproc_t)xdr_Ganglia_value_msg, (char *)&msg);
     break;
   }
 
@@ -697,6 +749,7 @@ static int mc_handle_metric(void *buffer, size_t buffer_size) /* {{{ */
     Ganglia_metadata_msg msg = {0};
     if (xdr_Ganglia_metadata_msg(&xdr, &msg))
       mc_handle_metadata_msg(&msg);
+    xdr_free((xdrproc_t)xdr_Ganglia_metadata_msg, (char *)&msg);
     break;
   }
 
@@ -708,32 +761,94 @@ static int mc_handle_metric(void *buffer, size_t buffer_size) /* {{{ */
   return 0;
 } /* }}} int mc_handle_metric */
 
-static int mc_handle_socket(struct pollfd *p) /* {{{ */
-{
-  char buffer[BUFF_SIZE];
-  ssize_t buffer_size;
-
+/* Receives and handles datagrams until the socket has no more data.
+ * "buffers" holds MC_RECEIVE_BATCH buffers of BUFF_SIZE bytes. */
+static int mc_handle_socket(struct pollfd *p, rcvbuf_t *rb, /* {{{ */
+                            char *buffers) {
   if ((p->revents & (POLLIN | POLLPRI)) == 0) {
     p->revents = 0;
     return -1;
   }
+  p->revents = 0;
+
+  uint64_t drops = rb->drops;
+  int ret = 0;
+
+#if HAVE_RECVMMSG
+  struct mmsghdr msgs[MC_RECEIVE_BATCH];
+  struct iovec iovs[MC_RECEIVE_BATCH];
+  char control[MC_RECEIVE_BATCH][RCVBUF_CONTROL_SIZE];
+  int status;
 
-  buffer_size = recv(p->fd, buffer, sizeof(buffer), /* flags = */ 0);
+  do {
+    memset(msgs, 0, sizeof(msgs));
+    for (size_t i = 0; i < MC_RECEIVE_BATCH; i++) {
+      iovs[i].iov_base = buffers + i * BUFF_SIZE;
+      iovs[i].iov_len = BUFF_SIZE;
+      msgs[i].msg_hdr.msg_iov = iovs + i;
+      msgs[i].msg_hdr.msg_iovlen = 1;
+      msgs[i].msg_hdr.msg_control = control[i];
+      msgs[i].msg_hdr.msg_controllen = sizeof(control[i]);
+    }
+
+    status = recvmmsg(p->fd, msgs, MC_RECEIVE_BATCH, MSG_DONTWAIT,
+                      /* timeout = */ NULL);
+    if (status < 0) {
+      if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR)) {
+        ERROR("gmond plugin: recvmmsg failed: %s", STRERRNO);
+        ret = -1;
+      }
+      break;
+    }
+
+    for (int i = 0; i < status; i++)
+      mc_handle_metric(buffers + i * BUFF_SIZE, (size_t)msgs[i].msg_len);
+
+    /* The drop counter is cumulative, the last datagram has the latest. */
+    if (status > 0)
+      rcvbuf_update(rb, &msgs[status - 1].msg_hdr);
+    /* A full batch suggests that more datagrams are waiting. */
+  } while (status == MC_RECEIVE_BATCH);
+#else
+  char control[RCVBUF_CONTROL_SIZE];
+  struct iovec iov = {.iov_base = buffers, .iov_len = BUFF_SIZE};
+  struct msghdr msg = {.msg_iov = &iov,
+                       .msg_iovlen = 1,
+                       .msg_control = control,
+                       .msg_controllen = sizeof(control)};
+
+  ssize_t buffer_size = recvmsg(p->fd, &msg, /* flags = */ 0);
   if (buffer_size <= 0) {
-    ERROR("gmond plugin: recv failed: %s", STRERRNO);
-    p->revents = 0;
+    ERROR("gmond plugin: recvmsg failed: %s", STRERRNO);
     return -1;
   }
 
-  mc_handle_metric(buffer, (size_t)buffer_size);
-  return 0;
+  mc_handle_metric(buffers, (size_t)buffer_size);
+  rcvbuf_update(rb, &msg);
+#endif
+
+  if (rb->drops != drops) {
+    __atomic_fetch_add(&mc_receive_drops, rb->drops - drops,
+                       __ATOMIC_RELAXED);
+    rcvbuf_tune(rb);
+  }
+
+  return ret;
 } /* }}} int mc_handle_socket */
 
 static void *mc_receive_thread(void *arg) /* {{{ */
 {
   socket_entry_t *mc_receive_socket_entries;
+  rcvbuf_t *rbs;
+  char *buffers;
   int status;
 
+  buffers = malloc(MC_RECEIVE_BATCH * BUFF_SIZE);
+  if (buffers == NULL) {
+    ERROR("gmond plugin: malloc failed.");
+    return (void *)-1;
+  }
+
   mc_receive_socket_entries = NULL;
   status = create_sockets(
       &mc_receive_socket_entries, &mc_receive_sockets_num,
@@ -742,18 +857,23 @@ static void *mc_receive_thread(void *arg) /* {{{ */
       /* listen = */ 1);
   if (status != 0) {
     ERROR("gmond plugin: create_sockets failed.");
+    sfree(buffers);
     return (void *)-1;
   }
 
   mc_receive_sockets = (struct pollfd *)calloc(mc_receive_sockets_num,
                                                sizeof(*mc_receive_sockets));
-  if (mc_receive_sockets == NULL) {
+  rbs = calloc(mc_receive_sockets_num, sizeof(*rbs));
+  if ((mc_receive_sockets == NULL) || (rbs == NULL)) {
     ERROR("gmond plugin: calloc failed.");
+    sfree(mc_receive_sockets);
+    sfree(rbs);
     for (size_t i = 0; i < mc_receive_sockets_num; i++)
       close(mc_receive_socket_entries[i].fd);
     free(mc_receive_socket_entries);
     mc_receive_socket_entries = NULL;
     mc_receive_sockets_num = 0;
+    sfree(buffers);
     return (void *)-1;
   }
 
@@ -761,6 +881,10 @@ static void *mc_receive_thread(void *arg) /* {{{ */
     mc_receive_sockets[i].fd = mc_receive_socket_entries[i].fd;
     mc_receive_sockets[i].events = POLLIN | POLLPRI;
     mc_receive_sockets[i].revents = 0;
+
+    if (rcvbuf_init(rbs + i, mc_receive_sockets[i].fd, mc_receive_buffer,
+                    mc_receive_buffer_auto, "gmond") == 0)
+      mc_receive_drops_enabled = 1;
   }
 
   while (mc_receive_thread_loop != 0) {
@@ -774,11 +898,13 @@ static void *mc_receive_thread(void *arg) /* {{{ */
 
     for (size_t i = 0; i < mc_receive_sockets_num; i++) {
       if (mc_receive_sockets[i].revents != 0)
-        mc_handle_socket(mc_receive_sockets + i);
+        mc_handle_socket(mc_receive_sockets + i, rbs + i, buffers);
     }
   } /* while (mc_receive_thread_loop != 0) */
 
   free(mc_receive_socket_entries);
+  sfree(rbs);
+  sfree(buffers);
   return (void *)0;
 } /* }}} void *mc_receive_thread */
 
@@ -826,6 +952,8 @@ static int mc_receive_thread_stop(void) /* {{{ */
  *
  * <Plugin gmond>
  *   MCReceiveFrom "239.2.11.71" "8649"
+ *   ReceiveBufferSize 0
+ *   ReceiveBufferAutoTune true
  *   <Metric "load_one">
  *     Type "load"
  *     [TypeInstance "foo"]
@@ -960,6 +1088,10 @@ static int gmond_config(oconfig_item_t *ci) /* {{{ */
       gmond_config_set_address(child, &mc_receive_group, &mc_receive_port);
     else if (strcasecmp("Metric", child->key) == 0)
       gmond_config_add_metric(child);
+    else if (strcasecmp("ReceiveBufferSize", child->key) == 0)
+      cf_util_get_int(child, &mc_receive_buffer);
+    else if (strcasecmp("ReceiveBufferAutoTune", child->key) == 0)
+      cf_util_get_boolean(child, &mc_receive_buffer_auto);
     else {
       WARNING("gmond plugin: Unknown configuration option `%s' ignored.",
               child->key);
@@ -983,11 +1115,34 @@ static int gmond_init(void) /* {{{ */
     return -1;
   }
 
+  if (metric_hash_create() != 0) {
+    ERROR("gmond plugin: metric_hash_create failed.");
+    return -1;
+  }
+
   mc_receive_thread_start();
 
   return 0;
 } /* }}} int gmond_init */
 
+static int gmond_read(void) /* {{{ */
+{
+  if (!mc_receive_drops_enabled)
+    return 0;
+
+  value_list_t vl = VALUE_LIST_INIT;
+  value_t v = {
+      .derive = (derive_t)__atomic_load_n(&mc_receive_drops, __ATOMIC_RELAXED)};
+
+  vl.values = &v;
+  vl.values_len = 1;
+  sstrncpy(vl.plugin, "gmond", sizeof(vl.plugin));
+  sstrncpy(vl.type, "if_rx_dropped", sizeof(vl.type));
+  plugin_dispatch_values(&vl);
+
+  return 0;
+} /* }}} int gmond_read */
+
 static int gmond_shutdown(void) /* {{{ */
 {
   mc_receive_thread_stop();
@@ -1001,11 +1156,15 @@ static int gmond_shutdown(void) /* {{{ */
   mc_send_sockets_num = 0;
   pthread_mutex_unlock(&mc_send_sockets_lock);
 
+  sfree(metric_hash);
+  metric_hash_mask = 0;
+
   return 0;
 } /* }}} int gmond_shutdown */
 
 void module_register(void) {
   plugin_register_complex_config("gmond", gmond_config);
   plugin_register_init("gmond", gmond_init);
+  plugin_register_read("gmond", gmond_read);
   plugin_register_shutdown("gmond", gmond_shutdown);
 }
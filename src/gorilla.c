@@ -0,0 +1,557 @@
+/**
+ * collectd - src/gorilla.c
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "common.h"
+#include "plugin.h"
+#include "utils_avltree.h"
+#include "utils_gorilla.h"
+
+#include <dirent.h>
+
+/*
+ * Every series is assigned to a shard by the hash of its identifier. A shard
+ * keeps the open chunk of each of its series in memory. Full chunks are
+ * appended to the shard's segment file of the chunk's time partition, e.g.
+ * "gorilla/shard-03/1500000000.seg" for the partition starting at that Unix
+ * time. See utils_gorilla.h for the file format.
+ */
+
+#define GORILLA_DATADIR_DEFAULT "gorilla"
+#define GORILLA_SHARDS_DEFAULT 4
+#define GORILLA_CHUNK_SAMPLES_DEFAULT 120
+#define GORILLA_PARTITION_DEFAULT TIME_T_TO_CDTIME_T(7200)
+#define GORILLA_SYNC_INTERVAL_DEFAULT TIME_T_TO_CDTIME_T(10)
+/* Records are collected in memory up to this size before they are written. */
+#define GORILLA_WRITE_BUFFER_SIZE 65536
+/* Segments open per shard: the current partition and the previous one, while
+ * the series move on to the new partition. */
+#define GORILLA_OPEN_SEGMENTS 2
+
+typedef struct {
+  char *name;
+  int *ds_types;
+  gorilla_chunk_t chunk;
+  uint64_t partition;
+} gorilla_series_t;
+
+typedef struct {
+  uint64_t partition;
+  int fd;
+  uint8_t *buffer;
+  size_t buffer_fill;
+  size_t buffer_size;
+  _Bool dirty; /* written since the last sync */
+} gorilla_segment_writer_t;
+
+typedef struct {
+  size_t index;
+  pthread_mutex_t lock;
+  c_avl_tree_t *series;
+  gorilla_segment_writer_t segments[GORILLA_OPEN_SEGMENTS];
+  uint64_t newest_partition;
+  cdtime_t next_sync;
+} gorilla_shard_t;
+
+static char *datadir = NULL;
+static int shards_num = GORILLA_SHARDS_DEFAULT;
+static int chunk_samples = GORILLA_CHUNK_SAMPLES_DEFAULT;
+static cdtime_t partition_interval = GORILLA_PARTITION_DEFAULT;
+static cdtime_t sync_interval = GORILLA_SYNC_INTERVAL_DEFAULT;
+static cdtime_t retention = 0;
+
+static gorilla_shard_t *shards = NULL;
+static uint64_t partition_ms;
+
+static int gorilla_segment_path(char *buffer, size_t buffer_size, /* {{{ */
+                                gorilla_shard_t const *shard,
+                                uint64_t partition) {
+  int status = snprintf(buffer, buffer_size, "%s/shard-%02zu/%" PRIu64 ".seg",
+                        datadir, shard->index, partition * partition_ms / 1000);
+  if ((status < 0) || ((size_t)status >= buffer_size))
+    return ENAMETOOLONG;
+  return 0;
+} /* }}} int gorilla_segment_path */
+
+/* Writes the buffered records to the file. */
+static int gorilla_writer_write(gorilla_segment_writer_t *w) /* {{{ */
+{
+  if ((w->fd < 0) || (w->buffer_fill == 0))
+    return 0;
+
+  int status = swrite(w->fd, w->buffer, w->buffer_fill);
+  if (status != 0)
+    ERROR("gorilla plugin: Writing %" PRIsz " bytes failed: %s",
+          w->buffer_fill, STRERRNO);
+
+  w->buffer_fill = 0;
+  w->dirty = 1;
+  return status;
+} /* }}} int gorilla_writer_write */
+
+static int gorilla_writer_sync(gorilla_segment_writer_t *w) /* {{{ */
+{
+  int status = gorilla_writer_write(w);
+
+  if ((w->fd >= 0) && w->dirty) {
+    if (fsync(w->fd) != 0) {
+      ERROR("gorilla plugin: fsync failed: %s", STRERRNO);
+      status = -1;
+    }
+    w->dirty = 0;
+  }
+
+  return status;
+} /* }}} int gorilla_writer_sync */
+
+static void gorilla_writer_close(gorilla_segment_writer_t *w) /* {{{ */
+{
+  if (w->fd < 0)
+    return;
+
+  gorilla_writer_sync(w);
+  close(w->fd);
+  w->fd = -1;
+} /* }}} void gorilla_writer_close */
+
+/* Removes the segments which are older than the retention time, counted back
+ * from the end of the newest partition. */
+static void gorilla_shard_expire(gorilla_shard_t *shard) /* {{{ */
+{
+  char path[PATH_MAX];
+  DIR *dh;
+  struct dirent *de;
+
+  uint64_t end_ms = (shard->newest_partition + 1) * partition_ms;
+  uint64_t retention_ms = CDTIME_T_TO_MS(retention);
+  if ((retention == 0) || (end_ms <= retention_ms))
+    return;
+
+  snprintf(path, sizeof(path), "%s/shard-%02zu", datadir, shard->index);
+  if ((dh = opendir(path)) == NULL)
+    return;
+
+  while ((de = readdir(dh)) != NULL) {
+    char *endptr = NULL;
+    uint64_t start = (uint64_t)strtoull(de->d_name, &endptr, 10);
+
+    if ((endptr == de->d_name) || (strcmp(endptr, ".seg") != 0))
+      continue;
+    if ((1000 * start + partition_ms) > (end_ms - retention_ms))
+      continue;
+
+    char file[PATH_MAX];
+    if (snprintf(file, sizeof(file), "%s/%s", path, de->d_name) >=
+        (int)sizeof(file))
+      continue;
+    if (unlink(file) != 0)
+      WARNING("gorilla plugin: unlink (%s) failed: %s", file, STRERRNO);
+    else {
+      DEBUG("gorilla plugin: Removed expired segment %s.", file);
+    }
+  }
+
+  closedir(dh);
+} /* }}} void gorilla_shard_expire */
+
+/* shard->lock must be held when calling this function. Returns the writer of
+ * the segment for `partition', opening the file if necessary. */
+static gorilla_segment_writer_t *
+gorilla_shard_segment(gorilla_shard_t *shard, uint64_t partition) /* {{{ */
+{
+  gorilla_segment_writer_t *w = NULL;
+  char path[PATH_MAX];
+  struct stat statbuf;
+
+  for (size_t i = 0; i < GORILLA_OPEN_SEGMENTS; i++) {
+    if ((shard->segments[i].fd >= 0) &&
+        (shard->segments[i].partition == partition))
+      return shard->segments + i;
+
+    /* Prefer a closed slot, then the one with the oldest partition. */
+    if ((w == NULL) || ((w->fd >= 0) && ((shard->segments[i].fd < 0) ||
+                                         (shard->segments[i].partition <
+                                          w->partition))))
+      w = shard->segments + i;
+  }
+
+  gorilla_writer_close(w);
+
+  if (gorilla_segment_path(path, sizeof(path), shard, partition) != 0)
+    return NULL;
+  if (check_create_dir(path) != 0)
+    return NULL;
+
+  w->fd = open(path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+  if (w->fd < 0) {
+    ERROR("gorilla plugin: open (%s) failed: %s", path, STRERRNO);
+    return NULL;
+  }
+  w->partition = partition;
+
+  if (fstat(w->fd, &statbuf) != 0) {
+    ERROR("gorilla plugin: fstat (%s) failed: %s", path, STRERRNO);
+    close(w->fd);
+    w->fd = -1;
+    return NULL;
+  }
+
+  /* A new file, or one whose header was not written completely. */
+  if (statbuf.st_size < GORILLA_SEGMENT_HEADER_SIZE) {
+    uint8_t header[GORILLA_SEGMENT_HEADER_SIZE];
+
+    gorilla_segment_header(header, partition * partition_ms, partition_ms);
+    if ((ftruncate(w->fd, 0) != 0) ||
+        (swrite(w->fd, header, sizeof(header)) != 0)) {
+      ERROR("gorilla plugin: Writing the header of %s failed: %s", path,
+            STRERRNO);
+      close(w->fd);
+      w->fd = -1;
+      return NULL;
+    }
+    w->dirty = 1;
+  }
+
+  if (partition > shard->newest_partition) {
+    shard->newest_partition = partition;
+    gorilla_shard_expire(shard);
+  }
+
+  return w;
+} /* }}} gorilla_segment_writer_t *gorilla_shard_segment */
+
+/* shard->lock must be held when calling this function. Moves the series'
+ * chunk to the write buffer of its segment. */
+static int gorilla_series_seal(gorilla_shard_t *shard, /* {{{ */
+                               gorilla_series_t *s) {
+  if (s->chunk.samples_num == 0)
+    return 0;
+
+  gorilla_segment_writer_t *w = gorilla_shard_segment(shard, s->partition);
+  if (w == NULL) {
+    gorilla_chunk_reset(&s->chunk);
+    return -1;
+  }
+
+  size_t name_len = strlen(s->name);
+  size_t size = gorilla_record_size(name_len, &s->chunk);
+  if ((w->buffer_fill + size) > w->buffer_size) {
+    size_t buffer_size =
+        (w->buffer_size > 0) ? w->buffer_size : GORILLA_WRITE_BUFFER_SIZE;
+    while (buffer_size < (w->buffer_fill + size))
+      buffer_size *= 2;
+
+    uint8_t *tmp = realloc(w->buffer, buffer_size);
+    if (tmp == NULL) {
+      ERROR("gorilla plugin: realloc failed.");
+      gorilla_chunk_reset(&s->chunk);
+      return ENOMEM;
+    }
+    w->buffer = tmp;
+    w->buffer_size = buffer_size;
+  }
+
+  w->buffer_fill += gorilla_record_write(w->buffer + w->buffer_fill, s->name,
+                                         name_len, s->ds_types, &s->chunk);
+  gorilla_chunk_reset(&s->chunk);
+
+  if (w->buffer_fill >= GORILLA_WRITE_BUFFER_SIZE)
+    return gorilla_writer_write(w);
+  return 0;
+} /* }}} int gorilla_series_seal */
+
+static void gorilla_series_free(gorilla_series_t *s) /* {{{ */
+{
+  if (s == NULL)
+    return;
+
+  gorilla_chunk_destroy(&s->chunk);
+  sfree(s->ds_types);
+  sfree(s->name);
+  sfree(s);
+} /* }}} void gorilla_series_free */
+
+/* shard->lock must be held when calling this function. */
+static gorilla_series_t *gorilla_series_get(gorilla_shard_t *shard, /* {{{ */
+                                            char const *name,
+                                            data_set_t const *ds) {
+  gorilla_series_t *s = NULL;
+
+  if (c_avl_get(shard->series, name, (void *)&s) == 0) {
+    _Bool changed = (s->chunk.ds_num != ds->ds_num);
+    for (size_t i = 0; !changed && (i < ds->ds_num); i++)
+      changed = (s->ds_types[i] != ds->ds[i].type);
+    if (!changed)
+      return s;
+
+    /* The data set has been changed, e.g. by reloading types.db. */
+    gorilla_series_seal(shard, s);
+    int *ds_types = realloc(s->ds_types, ds->ds_num * sizeof(*ds_types));
+    if (ds_types == NULL)
+      return NULL;
+    s->ds_types = ds_types;
+    gorilla_chunk_destroy(&s->chunk);
+    if (gorilla_chunk_init(&s->chunk, ds->ds_num) != 0)
+      return NULL;
+  } else {
+    s = calloc(1, sizeof(*s));
+    if (s == NULL)
+      return NULL;
+    s->name = strdup(name);
+    s->ds_types = calloc(ds->ds_num, sizeof(*s->ds_types));
+    if ((s->name == NULL) || (s->ds_types == NULL) ||
+        (gorilla_chunk_init(&s->chunk, ds->ds_num) != 0) ||
+        (c_avl_insert(shard->series, s->name, s) != 0)) {
+      gorilla_series_free(s);
+      return NULL;
+    }
+  }
+
+  for (size_t i = 0; i < ds->ds_num; i++)
+    s->ds_types[i] = ds->ds[i].type;
+  return s;
+} /* }}} gorilla_series_t *gorilla_series_get */
+
+/* shard->lock must be held when calling this function. */
+static void gorilla_shard_sync(gorilla_shard_t *shard) /* {{{ */
+{
+  for (size_t i = 0; i < GORILLA_OPEN_SEGMENTS; i++)
+    gorilla_writer_sync(shard->segments + i);
+} /* }}} void gorilla_shard_sync */
+
+static int gorilla_write(data_set_t const *ds, value_list_t const *vl, /* {{{ */
+                         user_data_t __attribute__((unused)) * ud) {
+  value_list_identity_t const *identity = VALUE_LIST_IDENTITY(vl);
+  char buffer[6 * DATA_MAX_NAME_LEN];
+  char const *name;
+  uint64_t hash;
+  uint64_t values[ds->ds_num];
+  int status;
+
+  if (shards == NULL)
+    return -1;
+
+  if (identity != NULL) {
+    name = identity->name;
+    hash = identity->hash;
+  } else {
+    if (FORMAT_VL(buffer, sizeof(buffer), vl) != 0)
+      return -1;
+    name = buffer;
+    hash = identifier_hash(buffer);
+  }
+
+  for (size_t i = 0; i < ds->ds_num; i++)
+    values[i] = gorilla_value_to_raw(vl->values[i], ds->ds[i].type);
+
+  uint64_t time = CDTIME_T_TO_MS(vl->time);
+  uint64_t partition = time / partition_ms;
+  gorilla_shard_t *shard = shards + (hash % (uint64_t)shards_num);
+
+  pthread_mutex_lock(&shard->lock);
+
+  gorilla_series_t *s = gorilla_series_get(shard, name, ds);
+  if (s == NULL) {
+    pthread_mutex_unlock(&shard->lock);
+    ERROR("gorilla plugin: Creating series %s failed.", name);
+    return -1;
+  }
+
+  /* Chunks don't span partitions. */
+  if ((s->chunk.samples_num > 0) && (s->partition != partition))
+    gorilla_series_seal(shard, s);
+  if (s->chunk.samples_num == 0)
+    s->partition = partition;
+
+  status = gorilla_chunk_append(&s->chunk, time, values);
+  if ((status == 0) && (s->chunk.samples_num >= (size_t)chunk_samples))
+    status = gorilla_series_seal(shard, s);
+
+  /* Grouped syncs: one fsync per segment and interval rather than per write. */
+  cdtime_t now = cdtime();
+  if (now >= shard->next_sync) {
+    gorilla_shard_sync(shard);
+    shard->next_sync = now + sync_interval;
+  }
+
+  pthread_mutex_unlock(&shard->lock);
+  return status;
+} /* }}} int gorilla_write */
+
+/* Writes the chunks which hold samples older than `timeout' to disk, all of
+ * them if `timeout' is zero. */
+static int gorilla_flush(cdtime_t timeout, /* {{{ */
+                         char const __attribute__((unused)) * identifier,
+                         user_data_t __attribute__((unused)) * ud) {
+  uint64_t now = CDTIME_T_TO_MS(cdtime());
+  uint64_t timeout_ms = CDTIME_T_TO_MS(timeout);
+
+  if (shards == NULL)
+    return 0;
+
+  for (int i = 0; i < shards_num; i++) {
+    gorilla_shard_t *shard = shards + i;
+    c_avl_iterator_t *iter;
+    char *key;
+    gorilla_series_t *s;
+
+    pthread_mutex_lock(&shard->lock);
+    iter = c_avl_get_iterator(shard->series);
+    while (c_avl_iterator_next(iter, (void *)&key, (void *)&s) == 0) {
+      if ((s->chunk.samples_num > 0) &&
+          ((timeout == 0) || ((s->chunk.first_time + timeout_ms) <= now)))
+        gorilla_series_seal(shard, s);
+    }
+    c_avl_iterator_destroy(iter);
+    gorilla_shard_sync(shard);
+    pthread_mutex_unlock(&shard->lock);
+  }
+
+  return 0;
+} /* }}} int gorilla_flush */
+
+static int gorilla_shutdown(void) /* {{{ */
+{
+  if (shards == NULL)
+    return 0;
+
+  gorilla_flush(/* timeout = */ 0, /* identifier = */ NULL, /* ud = */ NULL);
+
+  for (int i = 0; i < shards_num; i++) {
+    gorilla_shard_t *shard = shards + i;
+    void *key;
+    gorilla_series_t *s;
+
+    while (c_avl_pick(shard->series, &key, (void *)&s) == 0)
+      gorilla_series_free(s);
+    c_avl_destroy(shard->series);
+
+    for (size_t j = 0; j < GORILLA_OPEN_SEGMENTS; j++) {
+      gorilla_writer_close(shard->segments + j);
+      sfree(shard->segments[j].buffer);
+    }
+    pthread_mutex_destroy(&shard->lock);
+  }
+
+  sfree(shards);
+  sfree(datadir);
+  return 0;
+} /* }}} int gorilla_shutdown */
+
+static int gorilla_init(void) /* {{{ */
+{
+  if (shards != NULL)
+    return 0;
+
+  if (datadir == NULL) {
+    datadir = strdup(GORILLA_DATADIR_DEFAULT);
+    if (datadir == NULL)
+      return ENOMEM;
+  }
+
+  partition_ms = CDTIME_T_TO_MS(partition_interval);
+  if (partition_ms == 0)
+    partition_ms = 1;
+
+  shards = calloc((size_t)shards_num, sizeof(*shards));
+  if (shards == NULL)
+    return ENOMEM;
+
+  for (int i = 0; i < shards_num; i++) {
+    gorilla_shard_t *shard = shards + i;
+
+    shard->index = (size_t)i;
+    pthread_mutex_init(&shard->lock, NULL);
+    for (size_t j = 0; j < GORILLA_OPEN_SEGMENTS; j++)
+      shard->segments[j].fd = -1;
+    shard->series =
+        c_avl_create((int (*)(const void *, const void *))strcmp);
+    if (shard->series == NULL) {
+      ERROR("gorilla plugin: c_avl_create failed.");
+      shards_num = i;
+      pthread_mutex_destroy(&shard->lock);
+      gorilla_shutdown();
+      return ENOMEM;
+    }
+  }
+
+  return 0;
+} /* }}} int gorilla_init */
+
+static int gorilla_config(oconfig_item_t *ci) /* {{{ */
+{
+  int status = 0;
+
+  for (int i = 0; i < ci->children_num; i++) {
+    oconfig_item_t *child = ci->children + i;
+
+    if (strcasecmp("DataDir", child->key) == 0) {
+      status = cf_util_get_string(child, &datadir);
+      if (status == 0) {
+        size_t len = strlen(datadir);
+        while ((len > 1) && (datadir[len - 1] == '/'))
+          datadir[--len] = 0;
+      }
+    } else if (strcasecmp("Shards", child->key) == 0) {
+      status = cf_util_get_int(child, &shards_num);
+      if ((status == 0) && (shards_num < 1)) {
+        ERROR("gorilla plugin: Shards must be at least 1.");
+        status = -1;
+      }
+    } else if (strcasecmp("ChunkSamples", child->key) == 0) {
+      status = cf_util_get_int(child, &chunk_samples);
+      if ((status == 0) && (chunk_samples < 1)) {
+        ERROR("gorilla plugin: ChunkSamples must be at least 1.");
+        status = -1;
+      }
+    } else if (strcasecmp("PartitionInterval", child->key) == 0) {
+      status = cf_util_get_cdtime(child, &partition_interval);
+      if ((status == 0) && (CDTIME_T_TO_MS(partition_interval) < 1000)) {
+        ERROR("gorilla plugin: PartitionInterval must be at least one "
+              "second.");
+        status = -1;
+      }
+    } else if (strcasecmp("SyncInterval", child->key) == 0)
+      status = cf_util_get_cdtime(child, &sync_interval);
+    else if (strcasecmp("Retention", child->key) == 0)
+      status = cf_util_get_cdtime(child, &retention);
+    else {
+      WARNING("gorilla plugin: Ignoring unknown config option \"%s\".",
+              child->key);
+    }
+
+    if (status != 0)
+      return status;
+  }
+
+  return 0;
+} /* }}} int gorilla_config */
+
+void module_register(void) {
+  plugin_register_complex_config("gorilla", gorilla_config);
+  plugin_register_init("gorilla", gorilla_init);
+  plugin_register_write("gorilla", gorilla_write, /* user_data = */ NULL);
+  plugin_register_flush("gorilla", gorilla_flush, /* user_data = */ NULL);
+  plugin_register_shutdown("gorilla", gorilla_shutdown);
+} /* void module_register */
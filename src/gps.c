@@ -285,7 +285,7 @@ static int cgps_init(void) {
   status =
       plugin_thread_create(&cgps_thread_id, NULL, cgps_thread, NULL, "gps");
   if (status != 0) {
-    ERROR("gps plugin: pthread_create() failed.");
+    ERROR("gps plugin: plugin_thread_create() failed.");
     return -1;
   }
 
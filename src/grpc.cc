@@ -29,15 +29,14 @@
 #include <google/protobuf/util/time_util.h>
 #include <grpc++/grpc++.h>
 
+#include <chrono>
 #include <fstream>
 #include <iostream>
-#include <queue>
 #include <vector>
 
 #include "collectd.grpc.pb.h"
 
 extern "C" {
-#include <fnmatch.h>
 #include <stdbool.h>
 
 #include "collectd.h"
@@ -72,27 +71,13 @@ struct Listener {
 static std::vector<Listener> listeners;
 static grpc::string default_addr("0.0.0.0:50051");
 
+/* Number of threads polling the completion queues of PutValues calls. */
+static int worker_threads_num = 2;
+
 /*
  * helper functions
  */
 
-static bool ident_matches(const value_list_t *vl, const value_list_t *matcher) {
-  if (fnmatch(matcher->host, vl->host, 0))
-    return false;
-
-  if (fnmatch(matcher->plugin, vl->plugin, 0))
-    return false;
-  if (fnmatch(matcher->plugin_instance, vl->plugin_instance, 0))
-    return false;
-
-  if (fnmatch(matcher->type, vl->type, 0))
-    return false;
-  if (fnmatch(matcher->type_instance, vl->type_instance, 0))
-    return false;
-
-  return true;
-} /* ident_matches */
-
 static grpc::string read_file(const char *filename) {
   std::ifstream f;
   grpc::string s, content;
@@ -393,6 +378,39 @@ static grpc::Status unmarshal_value_list(const collectd::types::ValueList &msg,
   return status;
 } /* unmarshal_value_list() */
 
+static grpc::Status dispatch_value_list(const collectd::types::ValueList &msg) {
+  value_list_t vl = {0};
+  auto status = unmarshal_value_list(msg, &vl);
+  if (!status.ok())
+    return status;
+
+  /* plugin_dispatch_values() copies the values and the meta data. */
+  int err = plugin_dispatch_values(&vl);
+  sfree(vl.values);
+  meta_data_destroy(vl.meta);
+
+  if (err)
+    return grpc::Status(grpc::StatusCode::INTERNAL,
+                        grpc::string("failed to enqueue values for writing"));
+  return grpc::Status::OK;
+} /* dispatch_value_list() */
+
+static grpc::Status dispatch_put_values(const PutValuesRequest &req) {
+  if (req.has_value_list()) {
+    auto status = dispatch_value_list(req.value_list());
+    if (!status.ok())
+      return status;
+  }
+
+  for (auto const &msg : req.value_lists()) {
+    auto status = dispatch_value_list(msg);
+    if (!status.ok())
+      return status;
+  }
+
+  return grpc::Status::OK;
+} /* dispatch_put_values() */
+
 /*
  * Collectd service
  */
@@ -401,132 +419,122 @@ public:
   grpc::Status
   QueryValues(grpc::ServerContext *ctx, QueryValuesRequest const *req,
               grpc::ServerWriter<QueryValuesResponse> *writer) override {
-    value_list_t match;
+    value_list_t match = {0};
     auto status = unmarshal_ident(req->identifier(), &match, false);
     if (!status.ok()) {
       return status;
     }
 
-    std::queue<value_list_t> value_lists;
-    status = this->queryValuesRead(&match, &value_lists);
-    if (status.ok()) {
-      status = this->queryValuesWrite(ctx, writer, &value_lists);
+    /* Matches are streamed as they are found rather than collected first, so
+     * neither the cache nor memory is tied up by large results. */
+    uc_query_t *query = uc_query_create(&match);
+    if (query == NULL) {
+      return grpc::Status(
+          grpc::StatusCode::INTERNAL,
+          grpc::string("failed to query values: cannot create query"));
     }
 
-    while (!value_lists.empty()) {
-      auto vl = value_lists.front();
-      value_lists.pop();
+    value_list_t vl = {0};
+    while (status.ok() && (uc_query_next(query, &vl) == 0)) {
+      QueryValuesResponse res;
+      status = marshal_value_list(&vl, res.mutable_value_list());
+      if (status.ok() && !writer->Write(res))
+        status = grpc::Status::CANCELLED;
+
       sfree(vl.values);
       meta_data_destroy(vl.meta);
     }
 
+    uc_query_destroy(query);
     return status;
   }
+};
 
-  grpc::Status PutValues(grpc::ServerContext *ctx,
-                         grpc::ServerReader<PutValuesRequest> *reader,
-                         PutValuesResponse *res) override {
-    PutValuesRequest req;
-
-    while (reader->Read(&req)) {
-      value_list_t vl = {0};
-      auto status = unmarshal_value_list(req.value_list(), &vl);
-      if (!status.ok())
-        return status;
+/* PutValues is served asynchronously: streams don't occupy a thread each but
+ * are driven by a fixed number of threads polling completion queues.
+ * QueryValues remains synchronous. */
+typedef collectd::Collectd::WithAsyncMethod_PutValues<CollectdImpl>
+    CollectdService;
 
-      if (plugin_dispatch_values(&vl))
-        return grpc::Status(
-            grpc::StatusCode::INTERNAL,
-            grpc::string("failed to enqueue values for writing"));
-    }
-
-    res->Clear();
-    return grpc::Status::OK;
+/* The state of one PutValues stream. The object is the tag of all of the
+ * stream's operations and deletes itself once the stream is finished. */
+class PutValuesCall final {
+public:
+  PutValuesCall(CollectdService *service, grpc::ServerCompletionQueue *cq)
+      : service_(service), cq_(cq), reader_(&ctx_), state_(CREATE) {
+    service_->RequestPutValues(&ctx_, &reader_, cq_, cq_, this);
   }
 
-private:
-  grpc::Status queryValuesRead(value_list_t const *match,
-                               std::queue<value_list_t> *value_lists) {
-    uc_iter_t *iter;
-    if ((iter = uc_get_iterator()) == NULL) {
-      return grpc::Status(
-          grpc::StatusCode::INTERNAL,
-          grpc::string("failed to query values: cannot create iterator"));
-    }
-
-    grpc::Status status = grpc::Status::OK;
-    char *name = NULL;
-    while (uc_iterator_next(iter, &name) == 0) {
-      value_list_t vl;
-      if (parse_identifier_vl(name, &vl) != 0) {
-        status = grpc::Status(grpc::StatusCode::INTERNAL,
-                              grpc::string("failed to parse identifier"));
-        break;
+  void Proceed(bool ok) {
+    switch (state_) {
+    case CREATE:
+      if (!ok) {
+        /* The server is shutting down. */
+        delete this;
+        return;
       }
+      /* Accept the next stream while this one is read. */
+      new PutValuesCall(service_, cq_);
+      state_ = READ;
+      reader_.Read(&req_, this);
+      break;
 
-      if (!ident_matches(&vl, match))
-        continue;
-      if (uc_iterator_get_time(iter, &vl.time) < 0) {
-        status =
-            grpc::Status(grpc::StatusCode::INTERNAL,
-                         grpc::string("failed to retrieve value timestamp"));
+    case READ: {
+      if (!ok) {
+        /* The client has finished writing. */
+        res_.Clear();
+        state_ = FINISH;
+        reader_.Finish(res_, grpc::Status::OK, this);
         break;
       }
-      if (uc_iterator_get_interval(iter, &vl.interval) < 0) {
-        status =
-            grpc::Status(grpc::StatusCode::INTERNAL,
-                         grpc::string("failed to retrieve value interval"));
-        break;
-      }
-      if (uc_iterator_get_values(iter, &vl.values, &vl.values_len) < 0) {
-        status = grpc::Status(grpc::StatusCode::INTERNAL,
-                              grpc::string("failed to retrieve values"));
+
+      auto status = dispatch_put_values(req_);
+      if (!status.ok()) {
+        state_ = FINISH;
+        reader_.FinishWithError(status, this);
         break;
       }
-      if (uc_iterator_get_meta(iter, &vl.meta) < 0) {
-        status =
-            grpc::Status(grpc::StatusCode::INTERNAL,
-                         grpc::string("failed to retrieve value metadata"));
-      }
-
-      value_lists->push(vl);
-    } // while (uc_iterator_next(iter, &name) == 0)
+      reader_.Read(&req_, this);
+      break;
+    }
 
-    uc_iterator_destroy(iter);
-    return status;
-  }
+    case FINISH:
+      delete this;
+      break;
+    }
+  } /* void Proceed */
 
-  grpc::Status queryValuesWrite(grpc::ServerContext *ctx,
-                                grpc::ServerWriter<QueryValuesResponse> *writer,
-                                std::queue<value_list_t> *value_lists) {
-    while (!value_lists->empty()) {
-      auto vl = value_lists->front();
-      QueryValuesResponse res;
-      res.Clear();
+private:
+  enum State { CREATE, READ, FINISH };
 
-      auto status = marshal_value_list(&vl, res.mutable_value_list());
-      if (!status.ok()) {
-        return status;
-      }
+  CollectdService *service_;
+  grpc::ServerCompletionQueue *cq_;
+  grpc::ServerContext ctx_;
+  grpc::ServerAsyncReader<PutValuesResponse, PutValuesRequest> reader_;
+  PutValuesRequest req_;
+  PutValuesResponse res_;
+  State state_;
+}; /* class PutValuesCall */
 
-      if (!writer->Write(res)) {
-        return grpc::Status::CANCELLED;
-      }
+extern "C" {
+static void *put_values_worker(void *arg) {
+  grpc::ServerCompletionQueue *cq = (grpc::ServerCompletionQueue *)arg;
+  void *tag;
+  bool ok;
 
-      value_lists->pop();
-      sfree(vl.values);
-    }
+  while (cq->Next(&tag, &ok))
+    ((PutValuesCall *)tag)->Proceed(ok);
 
-    return grpc::Status::OK;
-  }
-};
+  return NULL;
+} /* void *put_values_worker */
+}
 
 /*
  * gRPC server implementation
  */
 class CollectdServer final {
 public:
-  void Start() {
+  bool Start() {
     auto auth = grpc::InsecureServerCredentials();
 
     grpc::ServerBuilder builder;
@@ -552,15 +560,66 @@ public:
 
     builder.RegisterService(&collectd_service_);
 
+    /* One completion queue per thread avoids contention between them. */
+    for (int i = 0; i < worker_threads_num; i++)
+      cqs_.push_back(builder.AddCompletionQueue());
+
     server_ = builder.BuildAndStart();
+    if (!server_) {
+      ERROR("grpc: Failed to start server");
+      Shutdown();
+      return false;
+    }
+
+    for (auto &cq : cqs_) {
+      new PutValuesCall(&collectd_service_, cq.get());
+
+      pthread_t thread;
+      int status = plugin_thread_create(&thread, /* attr = */ NULL,
+                                        put_values_worker, cq.get(),
+                                        "grpc worker");
+      if (status != 0) {
+        char errbuf[256];
+        ERROR("grpc: Starting a worker thread failed: %s",
+              sstrerror(status, errbuf, sizeof(errbuf)));
+        break;
+      }
+      threads_.push_back(thread);
+    }
+
+    if (threads_.empty()) {
+      Shutdown();
+      return false;
+    }
+    return true;
   } /* Start() */
 
-  void Shutdown() { server_->Shutdown(); } /* Shutdown() */
+  void Shutdown() {
+    if (server_) {
+      /* Streams may be open forever, so they are cancelled after a while. */
+      server_->Shutdown(std::chrono::system_clock::now() +
+                        std::chrono::seconds(1));
+    }
+
+    /* Shutting down the queues makes the threads return once the remaining
+     * events have been handled. Queues without a thread are drained here. */
+    for (auto &cq : cqs_)
+      cq->Shutdown();
+    for (auto thread : threads_)
+      pthread_join(thread, NULL);
+    for (size_t i = threads_.size(); i < cqs_.size(); i++)
+      put_values_worker(cqs_[i].get());
+
+    threads_.clear();
+    cqs_.clear();
+  } /* Shutdown() */
 
 private:
-  CollectdImpl collectd_service_;
+  CollectdService collectd_service_;
 
   std::unique_ptr<grpc::Server> server_;
+  std::vector<std::unique_ptr<grpc::ServerCompletionQueue>> cqs_;
+  std::vector<pthread_t> threads_;
 }; /* class CollectdServer */
 
 class CollectdClient final {
@@ -766,6 +825,13 @@ static int c_grpc_config(oconfig_item_t *ci) {
     } else if (!strcasecmp("Server", child->key)) {
       if (c_grpc_config_server(child))
         return -1;
+    } else if (!strcasecmp("WorkerThreads", child->key)) {
+      int tmp = 0;
+      if (cf_util_get_int(child, &tmp) || (tmp < 1)) {
+        ERROR("grpc: Option `%s` expects a positive integer", child->key);
+        return -1;
+      }
+      worker_threads_num = tmp;
     }
 
     else {
@@ -783,7 +849,11 @@ static int c_grpc_init(void) {
     return -1;
   }
 
-  server->Start();
+  if (!server->Start()) {
+    delete server;
+    server = nullptr;
+    return -1;
+  }
   return 0;
 } /* c_grpc_init() */
 
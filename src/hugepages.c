@@ -123,22 +123,16 @@ static int read_hugepage_entry(const char *path, const char *entry,
                                void *e_info) {
   char path2[PATH_MAX];
   struct entry_info *info = e_info;
+  value_t v;
   double value;
 
   snprintf(path2, sizeof(path2), "%s/%s", path, entry);
 
-  FILE *fh = fopen(path2, "rt");
-  if (fh == NULL) {
-    ERROR("%s: cannot open %s", g_plugin_name, path2);
+  if (parse_value_file_cached(path2, &v, DS_TYPE_GAUGE) != 0) {
+    ERROR("%s: cannot read %s", g_plugin_name, path2);
     return -1;
   }
-
-  if (fscanf(fh, "%lf", &value) != 1) {
-    ERROR("%s: cannot parse file %s", g_plugin_name, path2);
-    fclose(fh);
-    return -1;
-  }
-  fclose(fh);
+  value = v.gauge;
 
   if (strcmp(entry, "nr_hugepages") == 0) {
     info->nr = value;
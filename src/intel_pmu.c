@@ -33,6 +33,9 @@
 
 #define PMU_PLUGIN "intel_pmu"
 
+/* Number of CPUs a read thread takes at once. */
+#define PMU_READ_CHUNK 8
+
 #define HW_CACHE_READ_ACCESS                                                   \
   (((PERF_COUNT_HW_CACHE_OP_READ) << 8) |                                      \
    ((PERF_COUNT_HW_CACHE_RESULT_ACCESS) << 16))
@@ -71,6 +74,12 @@ struct intel_pmu_ctx_s {
   char **hw_events;
   size_t hw_events_count;
   struct eventlist *event_list;
+  /* Largest number of events in one group. */
+  size_t group_size_max;
+
+  size_t read_threads;
+  pthread_t *read_workers;
+  size_t read_workers_num;
 };
 typedef struct intel_pmu_ctx_s intel_pmu_ctx_t;
 
@@ -165,7 +174,18 @@ event_info_t g_sw_events[] = {
     {.name = "emulation-faults", .config = PERF_COUNT_SW_EMULATION_FAULTS},
 };
 
-static intel_pmu_ctx_t g_ctx;
+static intel_pmu_ctx_t g_ctx = {.read_threads = 1};
+
+/* The read callback and the read workers take CPUs from `g_read_next' until
+ * all have been read. */
+static int g_read_next;
+static int g_read_status;
+static pthread_mutex_t g_read_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_read_start_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t g_read_done_cond = PTHREAD_COND_INITIALIZER;
+static unsigned long g_read_generation;
+static size_t g_read_busy;
+static _Bool g_read_shutdown;
 
 #if COLLECT_DEBUG
 static void pmu_dump_events() {
@@ -190,6 +210,7 @@ static void pmu_dump_config(void) {
   DEBUG(PMU_PLUGIN ":   hw_cache_events   : %d", g_ctx.hw_cache_events);
   DEBUG(PMU_PLUGIN ":   kernel_pmu_events : %d", g_ctx.kernel_pmu_events);
   DEBUG(PMU_PLUGIN ":   software_events   : %d", g_ctx.sw_events);
+  DEBUG(PMU_PLUGIN ":   read_threads      : %" PRIsz, g_ctx.read_threads);
 
   for (size_t i = 0; i < g_ctx.hw_events_count; i++) {
     DEBUG(PMU_PLUGIN ":   hardware_events[%" PRIsz "]: %s", i,
@@ -248,6 +269,15 @@ static int pmu_config(oconfig_item_t *ci) {
       ret = pmu_config_hw_events(child);
     } else if (strcasecmp("ReportSoftwareEvents", child->key) == 0) {
       ret = cf_util_get_boolean(child, &g_ctx.sw_events);
+    } else if (strcasecmp("ReadThreads", child->key) == 0) {
+      int tmp = 0;
+      ret = cf_util_get_int(child, &tmp);
+      if ((ret == 0) && (tmp < 1)) {
+        ERROR(PMU_PLUGIN ": ReadThreads must be at least 1.");
+        ret = -EINVAL;
+      }
+      if (ret == 0)
+        g_ctx.read_threads = (size_t)tmp;
     } else {
       ERROR(PMU_PLUGIN ": Unknown configuration parameter \"%s\".", child->key);
       ret = -1;
@@ -346,15 +376,167 @@ static void pmu_dispatch_data(void) {
   }
 }
 
-static int pmu_read(__attribute__((unused)) user_data_t *ud) {
-  int ret;
+/* Reads the counters of a group with one read(2). The kernel returns the
+ * number of events, the times enabled and running, which are the same for all
+ * members, and one value per member in the order they were added. */
+static int pmu_read_group(struct event *leader, int cpu) {
+  uint64_t buf[3 + g_ctx.group_size_max];
+
+  ssize_t len = read(leader->efd[cpu].fd, buf, sizeof(buf));
+  if (len < (ssize_t)(3 * sizeof(uint64_t)))
+    return -1;
+
+  size_t values_num = (size_t)len / sizeof(uint64_t) - 3;
+  if (buf[0] < values_num)
+    values_num = (size_t)buf[0];
+
+  size_t i = 0;
+  for (struct event *e = leader; e != NULL; e = e->next) {
+    if (e->efd[cpu].fd >= 0) {
+      if (i >= values_num)
+        return -1;
+
+      e->efd[cpu].val[0] = buf[3 + i];
+      e->efd[cpu].val[1] = buf[1];
+      e->efd[cpu].val[2] = buf[2];
+      i++;
+    }
+
+    if (e->end_group)
+      break;
+  }
+
+  return 0;
+}
+
+static int pmu_read_cpu(int cpu) {
+  struct event *leader = NULL;
+
+  for (struct event *e = g_ctx.event_list->eventlist; e; e = e->next) {
+    if (e->group_leader) {
+      leader = e;
+      if (e->efd[cpu].fd >= 0) {
+        if (pmu_read_group(e, cpu) != 0)
+          return -1;
+      }
+    } else if ((leader == NULL) || (leader->efd[cpu].fd < 0)) {
+      /* Events outside of a group or without a group on this CPU. */
+      if ((e->efd[cpu].fd >= 0) && (read_event(e, cpu) != 0))
+        return -1;
+    }
+
+    if (e->end_group)
+      leader = NULL;
+  }
+
+  return 0;
+}
+
+static void pmu_read_run(void) {
+  int num_cpus = g_ctx.event_list->num_cpus;
+
+  while (42) {
+    int first =
+        __atomic_fetch_add(&g_read_next, PMU_READ_CHUNK, __ATOMIC_RELAXED);
+    int last = first + PMU_READ_CHUNK;
+
+    if (first >= num_cpus)
+      break;
+    if (last > num_cpus)
+      last = num_cpus;
+
+    for (int cpu = first; cpu < last; cpu++) {
+      if (pmu_read_cpu(cpu) != 0)
+        __atomic_store_n(&g_read_status, -1, __ATOMIC_RELAXED);
+    }
+  }
+}
+
+static void *pmu_read_worker(__attribute__((unused)) void *arg) {
+  unsigned long generation = 0;
 
+  pthread_mutex_lock(&g_read_lock);
+  while (!g_read_shutdown) {
+    if (generation == g_read_generation) {
+      pthread_cond_wait(&g_read_start_cond, &g_read_lock);
+      continue;
+    }
+    generation = g_read_generation;
+    pthread_mutex_unlock(&g_read_lock);
+
+    pmu_read_run();
+
+    pthread_mutex_lock(&g_read_lock);
+    g_read_busy--;
+    if (g_read_busy == 0)
+      pthread_cond_signal(&g_read_done_cond);
+  }
+  pthread_mutex_unlock(&g_read_lock);
+
+  return NULL;
+}
+
+static void pmu_read_workers_start(void) {
+  if (g_ctx.read_threads < 2)
+    return;
+
+  g_ctx.read_workers =
+      calloc(g_ctx.read_threads - 1, sizeof(*g_ctx.read_workers));
+  if (g_ctx.read_workers == NULL) {
+    ERROR(PMU_PLUGIN ": Failed to allocate read threads.");
+    return;
+  }
+
+  g_read_shutdown = 0;
+
+  /* The read callback takes part in reading, too. */
+  for (size_t i = 1; i < g_ctx.read_threads; i++) {
+    int status = plugin_thread_create(
+        &g_ctx.read_workers[g_ctx.read_workers_num], /* attr = */ NULL,
+        pmu_read_worker, /* arg = */ NULL, "intel_pmu read");
+    if (status != 0) {
+      WARNING(PMU_PLUGIN ": Starting read thread #%" PRIsz " failed: %s", i,
+              STRERROR(status));
+      break;
+    }
+    g_ctx.read_workers_num++;
+  }
+}
+
+static void pmu_read_workers_stop(void) {
+  pthread_mutex_lock(&g_read_lock);
+  g_read_shutdown = 1;
+  pthread_cond_broadcast(&g_read_start_cond);
+  pthread_mutex_unlock(&g_read_lock);
+
+  for (size_t i = 0; i < g_ctx.read_workers_num; i++)
+    pthread_join(g_ctx.read_workers[i], /* retval = */ NULL);
+  sfree(g_ctx.read_workers);
+  g_ctx.read_workers_num = 0;
+}
+
+static int pmu_read(__attribute__((unused)) user_data_t *ud) {
   DEBUG(PMU_PLUGIN ": %s:%d", __FUNCTION__, __LINE__);
 
-  ret = read_all_events(g_ctx.event_list);
-  if (ret != 0) {
+  __atomic_store_n(&g_read_next, 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&g_read_status, 0, __ATOMIC_RELAXED);
+
+  pthread_mutex_lock(&g_read_lock);
+  g_read_busy = g_ctx.read_workers_num;
+  g_read_generation++;
+  pthread_cond_broadcast(&g_read_start_cond);
+  pthread_mutex_unlock(&g_read_lock);
+
+  pmu_read_run();
+
+  pthread_mutex_lock(&g_read_lock);
+  while (g_read_busy > 0)
+    pthread_cond_wait(&g_read_done_cond, &g_read_lock);
+  pthread_mutex_unlock(&g_read_lock);
+
+  if (__atomic_load_n(&g_read_status, __ATOMIC_RELAXED) != 0) {
     ERROR(PMU_PLUGIN ": Failed to read values of all events.");
-    return ret;
+    return -1;
   }
 
   pmu_dispatch_data();
@@ -363,7 +545,7 @@ static int pmu_read(__attribute__((unused)) user_data_t *ud) {
 }
 
 static int pmu_add_events(struct eventlist *el, uint32_t type,
-                          event_info_t *events, size_t count) {
+                          event_info_t *events, size_t count, _Bool group) {
 
   for (size_t i = 0; i < count; i++) {
     /* Allocate memory for event struct that contains array of efd structs
@@ -384,6 +566,11 @@ static int pmu_add_events(struct eventlist *el, uint32_t type,
       el->eventlist_last->next = e;
     el->eventlist_last = e;
     e->event = strdup(events[i].name);
+
+    if (group && (count > 1)) {
+      e->group_leader = (i == 0);
+      e->end_group = (i == count - 1);
+    }
   }
 
   return 0;
@@ -464,9 +651,13 @@ static void pmu_free_events(struct eventlist *el) {
 static int pmu_setup_events(struct eventlist *el, bool measure_all,
                             int measure_pid) {
   struct event *e, *leader = NULL;
+  size_t group_size = 0;
   int ret = -1;
 
   for (e = el->eventlist; e; e = e->next) {
+    /* Read all counters of a group at once, see pmu_read_group(). */
+    if (e->group_leader)
+      e->attr.read_format |= PERF_FORMAT_GROUP;
 
     for (int i = 0; i < el->num_cpus; i++) {
       if (setup_event(e, i, leader, measure_all, measure_pid) < 0) {
@@ -478,8 +669,15 @@ static int pmu_setup_events(struct eventlist *el, bool measure_all,
       }
     }
 
-    if (e->group_leader)
+    if (e->group_leader) {
       leader = e;
+      group_size = 0;
+    }
+    if (leader != NULL) {
+      group_size++;
+      if (group_size > g_ctx.group_size_max)
+        g_ctx.group_size_max = group_size;
+    }
     if (e->end_group)
       leader = NULL;
   }
@@ -501,7 +699,7 @@ static int pmu_init(void) {
   if (g_ctx.hw_cache_events) {
     ret =
         pmu_add_events(g_ctx.event_list, PERF_TYPE_HW_CACHE, g_hw_cache_events,
-                       STATIC_ARRAY_SIZE(g_hw_cache_events));
+                       STATIC_ARRAY_SIZE(g_hw_cache_events), /* group = */ 0);
     if (ret != 0) {
       ERROR(PMU_PLUGIN ": Failed to add hw cache events.");
       goto init_error;
@@ -511,7 +709,8 @@ static int pmu_init(void) {
   if (g_ctx.kernel_pmu_events) {
     ret = pmu_add_events(g_ctx.event_list, PERF_TYPE_HARDWARE,
                          g_kernel_pmu_events,
-                         STATIC_ARRAY_SIZE(g_kernel_pmu_events));
+                         STATIC_ARRAY_SIZE(g_kernel_pmu_events),
+                         /* group = */ 0);
     if (ret != 0) {
       ERROR(PMU_PLUGIN ": Failed to add kernel PMU events.");
       goto init_error;
@@ -537,8 +736,10 @@ static int pmu_init(void) {
   }
 
   if (g_ctx.sw_events) {
+    /* Software events are not limited by the number of hardware counters,
+     * so they can always be read as one group. */
     ret = pmu_add_events(g_ctx.event_list, PERF_TYPE_SOFTWARE, g_sw_events,
-                         STATIC_ARRAY_SIZE(g_sw_events));
+                         STATIC_ARRAY_SIZE(g_sw_events), /* group = */ 1);
     if (ret != 0) {
       ERROR(PMU_PLUGIN ": Failed to add software events.");
       goto init_error;
@@ -561,6 +762,8 @@ static int pmu_init(void) {
             ": Events list is empty. No events were setup for monitoring.");
   }
 
+  pmu_read_workers_start();
+
   return 0;
 
 init_error:
@@ -580,6 +783,8 @@ static int pmu_shutdown(void) {
 
   DEBUG(PMU_PLUGIN ": %s:%d", __FUNCTION__, __LINE__);
 
+  pmu_read_workers_stop();
+
   pmu_free_events(g_ctx.event_list);
   sfree(g_ctx.event_list);
   for (size_t i = 0; i < g_ctx.hw_events_count; i++) {
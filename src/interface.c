@@ -67,6 +67,11 @@
 #endif /* !COLLECT_GETIFADDRS */
 #endif /* KERNEL_LINUX */
 
+#if KERNEL_LINUX && !HAVE_GETIFADDRS && HAVE_LIBRTNLSTATS
+#define IF_USE_RTNL_STATS 1
+#include "utils_rtnl_stats.h"
+#endif
+
 #if HAVE_PERFSTAT
 static perfstat_netinterface_t *ifstat;
 static int nif;
@@ -98,6 +103,18 @@ static int numif = 0;
 static _Bool unique_name = 0;
 #endif /* HAVE_LIBKSTAT */
 
+#if IF_USE_RTNL_STATS
+static rtnl_stats_t *rtnl_stats = NULL;
+
+/* Value lists are collected and dispatched in batches, so that the write
+ * queue is not locked once per value list on hosts with thousands of
+ * interfaces. */
+#define IF_BATCH_SIZE 256
+static value_list_t if_batch[IF_BATCH_SIZE];
+static value_t if_batch_values[2 * IF_BATCH_SIZE];
+static size_t if_batch_num = 0;
+#endif /* IF_USE_RTNL_STATS */
+
 static int interface_config(const char *key, const char *value) {
   if (ignorelist == NULL)
     ignorelist = ignorelist_create(/* invert = */ 1);
@@ -153,6 +170,69 @@ static int interface_init(void) {
 } /* int interface_init */
 #endif /* HAVE_LIBKSTAT */
 
+#if IF_USE_RTNL_STATS
+static int interface_init(void) {
+  rtnl_stats = rtnl_stats_create();
+  if (rtnl_stats == NULL)
+    WARNING("interface plugin: Reading statistics via netlink is not "
+            "possible; reading /proc/net/dev instead.");
+
+  return 0;
+} /* int interface_init */
+
+static int interface_shutdown(void) {
+  rtnl_stats_destroy(rtnl_stats);
+  rtnl_stats = NULL;
+
+  return 0;
+} /* int interface_shutdown */
+
+static void if_batch_flush(void) {
+  if (if_batch_num == 0)
+    return;
+
+  plugin_dispatch_values_batch(if_batch, if_batch_num);
+  if_batch_num = 0;
+} /* void if_batch_flush */
+
+static void if_batch_add(const char *dev, const char *type, derive_t rx,
+                         derive_t tx) {
+  value_list_t *vl;
+
+  if (if_batch_num >= IF_BATCH_SIZE)
+    if_batch_flush();
+
+  vl = if_batch + if_batch_num;
+  *vl = (value_list_t)VALUE_LIST_INIT;
+  vl->values = if_batch_values + 2 * if_batch_num;
+  vl->values[0].derive = rx;
+  vl->values[1].derive = tx;
+  vl->values_len = 2;
+  sstrncpy(vl->plugin, "interface", sizeof(vl->plugin));
+  sstrncpy(vl->plugin_instance, dev, sizeof(vl->plugin_instance));
+  sstrncpy(vl->type, type, sizeof(vl->type));
+
+  if_batch_num++;
+} /* void if_batch_add */
+
+static void if_rtnl_stats_cb(int __attribute__((unused)) ifindex,
+                             char const *dev, rtnl_stats_link_t const *stats,
+                             void __attribute__((unused)) * user_data) {
+  if (ignorelist_match(ignorelist, dev) != 0)
+    return;
+
+  if (!report_inactive && (stats->rx_packets == 0) && (stats->tx_packets == 0))
+    return;
+
+  if_batch_add(dev, "if_packets", stats->rx_packets, stats->tx_packets);
+  if_batch_add(dev, "if_octets", stats->rx_bytes, stats->tx_bytes);
+  if_batch_add(dev, "if_errors", stats->rx_errors, stats->tx_errors);
+  /* Same as the "drop" column of /proc/net/dev. */
+  if_batch_add(dev, "if_dropped", stats->rx_dropped + stats->rx_missed_errors,
+               stats->tx_dropped);
+} /* void if_rtnl_stats_cb */
+#endif /* IF_USE_RTNL_STATS */
+
 static void if_submit(const char *dev, const char *type, derive_t rx,
                       derive_t tx) {
   value_list_t vl = VALUE_LIST_INIT;
@@ -235,6 +315,19 @@ static int interface_read(void) {
   char *fields[16];
   int numfields;
 
+#if IF_USE_RTNL_STATS
+  if (rtnl_stats != NULL) {
+    int status = rtnl_stats_read(rtnl_stats, if_rtnl_stats_cb, NULL);
+    if_batch_flush();
+    if (status != 0) {
+      ERROR("interface plugin: Reading statistics via netlink failed: %s",
+            STRERROR(status));
+      return -1;
+    }
+    return 0;
+  }
+#endif
+
   if ((fh = fopen("/proc/net/dev", "r")) == NULL) {
     WARNING("interface plugin: fopen: %s", STRERRNO);
     return -1;
@@ -388,6 +481,9 @@ void module_register(void) {
                          config_keys_num);
 #if HAVE_LIBKSTAT
   plugin_register_init("interface", interface_init);
+#elif IF_USE_RTNL_STATS
+  plugin_register_init("interface", interface_init);
+  plugin_register_shutdown("interface", interface_shutdown);
 #endif
   plugin_register_read("interface", interface_read);
 } /* void module_register */
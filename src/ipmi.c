@@ -55,6 +55,8 @@ struct c_ipmi_instance_s {
   _Bool notify_conn;
   _Bool sel_enabled;
   _Bool sel_clear_event;
+  _Bool sdr_cache;
+  int read_concurrency;
 
   char *host;
   char *connaddr;
@@ -66,6 +68,9 @@ struct c_ipmi_instance_s {
   ipmi_con_t *connection;
   pthread_mutex_t sensor_list_lock;
   c_ipmi_sensor_list_t *sensor_list;
+  /* Readings started in the current cycle and still outstanding */
+  unsigned int read_cycle;
+  int reads_pending;
 
   _Bool active;
   pthread_t thread_id;
@@ -84,6 +89,7 @@ struct c_ipmi_sensor_list_s {
   c_ipmi_sensor_list_t *next;
   c_ipmi_instance_t *instance;
   unsigned int use;
+  unsigned int read_cycle;
 };
 
 struct c_ipmi_db_type_map_s {
@@ -172,11 +178,10 @@ static notification_t c_ipmi_notification_init(c_ipmi_instance_t const *st,
 /* Prototype for sensor_list_remove, so sensor_read_handler can call it. */
 static int sensor_list_remove(c_ipmi_instance_t *st, ipmi_sensor_t *sensor);
 
-static void sensor_read_handler(ipmi_sensor_t *sensor, int err,
-                                enum ipmi_value_present_e value_present,
-                                unsigned int __attribute__((unused)) raw_value,
-                                double value, ipmi_states_t *states,
-                                void *user_data) {
+static void sensor_read_submit(ipmi_sensor_t *sensor, int err,
+                               enum ipmi_value_present_e value_present,
+                               double value, ipmi_states_t *states,
+                               void *user_data) {
   value_list_t vl = VALUE_LIST_INIT;
 
   c_ipmi_sensor_list_t *list_item = user_data;
@@ -296,6 +301,30 @@ static void sensor_read_handler(ipmi_sensor_t *sensor, int err,
            sizeof(vl.type_instance));
 
   plugin_dispatch_values(&vl);
+} /* void sensor_read_submit */
+
+static void sensor_list_read_next(c_ipmi_instance_t *st);
+
+static void sensor_read_handler(ipmi_sensor_t *sensor, int err,
+                                enum ipmi_value_present_e value_present,
+                                unsigned int __attribute__((unused)) raw_value,
+                                double value, ipmi_states_t *states,
+                                void *user_data) {
+  c_ipmi_sensor_list_t *list_item = user_data;
+  c_ipmi_instance_t *st = list_item->instance;
+
+  /* May remove and free list_item. */
+  sensor_read_submit(sensor, err, value_present, value, states, user_data);
+
+  /* Without a limit, all readings were started by sensor_list_read_all(). */
+  if (st->read_concurrency == 0)
+    return;
+
+  pthread_mutex_lock(&st->sensor_list_lock);
+  if (st->reads_pending > 0)
+    st->reads_pending--;
+  sensor_list_read_next(st);
+  pthread_mutex_unlock(&st->sensor_list_lock);
 } /* void sensor_read_handler */
 
 static void sensor_get_name(ipmi_sensor_t *sensor, char *buffer, int buf_len) {
@@ -570,22 +599,49 @@ static int sensor_list_remove(c_ipmi_instance_t *st, ipmi_sensor_t *sensor) {
   return 0;
 } /* int sensor_list_remove */
 
-static int sensor_list_read_all(c_ipmi_instance_t *st) {
-  pthread_mutex_lock(&st->sensor_list_lock);
-
+/* Starts readings of sensors not read in the current cycle yet, keeping at most
+ * "ReadConcurrency" of them outstanding. Must be called with sensor_list_lock
+ * held. */
+static void sensor_list_read_next(c_ipmi_instance_t *st) {
   for (c_ipmi_sensor_list_t *list_item = st->sensor_list; list_item != NULL;
        list_item = list_item->next) {
-    DEBUG("ipmi plugin: try read sensor `%s` of `%s`, use: %d",
-          list_item->sensor_name, st->name, list_item->use);
+    if ((st->read_concurrency > 0) &&
+        (st->reads_pending >= st->read_concurrency))
+      break;
 
-    /* Reading already initiated */
-    if (list_item->use)
+    /* Reading already initiated or done in this cycle */
+    if (list_item->use || (list_item->read_cycle == st->read_cycle))
       continue;
 
+    DEBUG("ipmi plugin: try read sensor `%s` of `%s`, use: %d",
+          list_item->sensor_name, st->name, list_item->use);
+
+    list_item->read_cycle = st->read_cycle;
     list_item->use++;
-    ipmi_sensor_id_get_reading(list_item->sensor_id, sensor_read_handler,
-                               /* user data = */ (void *)list_item);
+    int status =
+        ipmi_sensor_id_get_reading(list_item->sensor_id, sensor_read_handler,
+                                   /* user data = */ (void *)list_item);
+    if (status != 0) {
+      list_item->use--;
+      continue;
+    }
+    st->reads_pending++;
   } /* for (list_item) */
+} /* void sensor_list_read_next */
+
+static int sensor_list_read_all(c_ipmi_instance_t *st) {
+  pthread_mutex_lock(&st->sensor_list_lock);
+
+  /* Readings of removed sensors never complete, so count the outstanding ones
+   * again at the start of each cycle. */
+  st->reads_pending = 0;
+  for (c_ipmi_sensor_list_t *list_item = st->sensor_list; list_item != NULL;
+       list_item = list_item->next)
+    if (list_item->use)
+      st->reads_pending++;
+
+  st->read_cycle++;
+  sensor_list_read_next(st);
 
   pthread_mutex_unlock(&st->sensor_list_lock);
 
@@ -939,8 +995,9 @@ static int c_ipmi_thread_init(c_ipmi_instance_t *st) {
   ipmi_open_option_t opts[] = {
       {.option = IPMI_OPEN_OPTION_ALL, {.ival = 1}},
 #ifdef IPMI_OPEN_OPTION_USE_CACHE
-      /* OpenIPMI-2.0.17 and later: Disable SDR cache in local file */
-      {.option = IPMI_OPEN_OPTION_USE_CACHE, {.ival = 0}},
+      /* OpenIPMI-2.0.17 and later: Keep the SDRs in a local file, so they
+       * need not be fetched from the BMC again after a restart. */
+      {.option = IPMI_OPEN_OPTION_USE_CACHE, {.ival = st->sdr_cache}},
 #endif
   };
 
@@ -1084,6 +1141,19 @@ static int c_ipmi_config_add_instance(oconfig_item_t *ci) {
       status = cf_util_get_boolean(child, &st->sel_enabled);
     } else if (strcasecmp("SELClearEvent", child->key) == 0) {
       status = cf_util_get_boolean(child, &st->sel_clear_event);
+    } else if (strcasecmp("SDRCache", child->key) == 0) {
+      status = cf_util_get_boolean(child, &st->sdr_cache);
+#ifndef IPMI_OPEN_OPTION_USE_CACHE
+      if ((status == 0) && st->sdr_cache)
+        WARNING("ipmi plugin: SDRCache is not supported by this version "
+                "of OpenIPMI.");
+#endif
+    } else if (strcasecmp("ReadConcurrency", child->key) == 0) {
+      status = cf_util_get_int(child, &st->read_concurrency);
+      if ((status == 0) && (st->read_concurrency < 0)) {
+        WARNING("ipmi plugin: ReadConcurrency must not be negative.");
+        status = -1;
+      }
     } else if (strcasecmp("Host", child->key) == 0)
       status = cf_util_get_string(child, &st->host);
     else if (strcasecmp("Address", child->key) == 0)
@@ -1200,6 +1270,29 @@ static int c_ipmi_init(void) {
     return -1;
   };
 
+#ifdef IPMI_OPEN_OPTION_USE_CACHE
+  /* The SDR cache is shared by all domains, the keys include the domain
+   * name. */
+  for (st = instances; st != NULL; st = st->next) {
+    if (!st->sdr_cache)
+      continue;
+
+    const char *base_dir = global_option_get("BaseDir");
+    char cache_file[PATH_MAX];
+    snprintf(cache_file, sizeof(cache_file), "%s/ipmi_sdr.cache",
+             (base_dir != NULL) ? base_dir : ".");
+
+    int status = -1;
+    if (os_handler->database_set_filename != NULL)
+      status = os_handler->database_set_filename(os_handler, cache_file);
+    if (status != 0)
+      WARNING("ipmi plugin: Setting the SDR cache file to \"%s\" failed. "
+              "OpenIPMI will use its default location.",
+              cache_file);
+    break;
+  }
+#endif
+
   if (instances == NULL) {
     /* No instances were configured, let's start a default instance. */
     st = c_ipmi_init_instance();
@@ -89,6 +89,106 @@ typedef struct {
 static ip_chain_t **chain_list = NULL;
 static int chain_num = 0;
 
+/*
+ * The same chains grouped by table and chain name, so that each table is
+ * fetched from the kernel once and each chain is walked once per read.
+ */
+typedef struct {
+  char chain[XT_TABLE_MAXNAMELEN];
+  ip_chain_t **numbered; /* sorted by rule number */
+  size_t numbered_num;
+  ip_chain_t **commented;
+  size_t commented_num;
+} ip_chain_group_t;
+
+typedef struct {
+  protocol_version_t ip_version;
+  char table[XT_TABLE_MAXNAMELEN];
+  ip_chain_group_t *groups;
+  size_t groups_num;
+} ip_table_t;
+
+static ip_table_t *table_list = NULL;
+static size_t table_num = 0;
+
+static ip_table_t *iptables_get_table(const ip_chain_t *chain) /* {{{ */
+{
+  for (size_t i = 0; i < table_num; i++)
+    if ((table_list[i].ip_version == chain->ip_version) &&
+        (strcmp(table_list[i].table, chain->table) == 0))
+      return table_list + i;
+
+  ip_table_t *tmp = realloc(table_list, (table_num + 1) * sizeof(*tmp));
+  if (tmp == NULL)
+    return NULL;
+  table_list = tmp;
+
+  ip_table_t *table = table_list + table_num;
+  table_num++;
+
+  memset(table, 0, sizeof(*table));
+  table->ip_version = chain->ip_version;
+  sstrncpy(table->table, chain->table, sizeof(table->table));
+  return table;
+} /* }}} ip_table_t *iptables_get_table */
+
+static ip_chain_group_t *iptables_get_group(ip_table_t *table, /* {{{ */
+                                            const ip_chain_t *chain) {
+  for (size_t i = 0; i < table->groups_num; i++)
+    if (strcmp(table->groups[i].chain, chain->chain) == 0)
+      return table->groups + i;
+
+  ip_chain_group_t *tmp =
+      realloc(table->groups, (table->groups_num + 1) * sizeof(*tmp));
+  if (tmp == NULL)
+    return NULL;
+  table->groups = tmp;
+
+  ip_chain_group_t *group = table->groups + table->groups_num;
+  table->groups_num++;
+
+  memset(group, 0, sizeof(*group));
+  sstrncpy(group->chain, chain->chain, sizeof(group->chain));
+  return group;
+} /* }}} ip_chain_group_t *iptables_get_group */
+
+static int iptables_group_chain(ip_chain_t *chain) /* {{{ */
+{
+  ip_table_t *table = iptables_get_table(chain);
+  if (table == NULL)
+    return ENOMEM;
+
+  ip_chain_group_t *group = iptables_get_group(table, chain);
+  if (group == NULL)
+    return ENOMEM;
+
+  if (chain->rule_type != RTYPE_NUM) {
+    ip_chain_t **tmp = realloc(group->commented,
+                               (group->commented_num + 1) * sizeof(*tmp));
+    if (tmp == NULL)
+      return ENOMEM;
+    group->commented = tmp;
+    group->commented[group->commented_num] = chain;
+    group->commented_num++;
+    return 0;
+  }
+
+  ip_chain_t **tmp =
+      realloc(group->numbered, (group->numbered_num + 1) * sizeof(*tmp));
+  if (tmp == NULL)
+    return ENOMEM;
+  group->numbered = tmp;
+
+  size_t pos = group->numbered_num;
+  while ((pos > 0) && (group->numbered[pos - 1]->rule.num > chain->rule.num))
+    pos--;
+  memmove(group->numbered + pos + 1, group->numbered + pos,
+          (group->numbered_num - pos) * sizeof(*tmp));
+  group->numbered[pos] = chain;
+  group->numbered_num++;
+  return 0;
+} /* }}} int iptables_group_chain */
+
 static int iptables_config(const char *key, const char *value) {
   /* int ip_value; */
   protocol_version_t ip_version = 0;
@@ -197,6 +297,11 @@ static int iptables_config(const char *key, const char *value) {
   chain_list[chain_num] = final;
   chain_num++;
 
+  if (iptables_group_chain(final) != 0) {
+    ERROR("iptables plugin: Grouping chain `%s' failed.", final->chain);
+    return 1;
+  }
+
   DEBUG("Chain #%i: table = %s; chain = %s;", chain_num, final->table,
         final->chain);
 
@@ -298,13 +403,39 @@ static int submit_match(const struct ipt_entry_match *match,
   return 0;
 } /* int submit_match */
 
+/* Submits all rules selected by comment. */
+static int submit6_comments(const struct ip6t_entry_match *match,
+                            const struct ip6t_entry *entry,
+                            const ip_chain_group_t *group, int rule_num) {
+  if (strcmp(match->u.user.name, "comment") != 0)
+    return 0;
+
+  for (size_t i = 0; i < group->commented_num; i++)
+    submit6_match(match, entry, group->commented[i], rule_num);
+
+  return 0;
+} /* int submit6_comments */
+
+static int submit_comments(const struct ipt_entry_match *match,
+                           const struct ipt_entry *entry,
+                           const ip_chain_group_t *group, int rule_num) {
+  if (strcmp(match->u.user.name, "comment") != 0)
+    return 0;
+
+  for (size_t i = 0; i < group->commented_num; i++)
+    submit_match(match, entry, group->commented[i], rule_num);
+
+  return 0;
+} /* int submit_comments */
+
 /* ipv6 submit_chain */
-static void submit6_chain(ip6tc_handle_t *handle, ip_chain_t *chain) {
+static void submit6_chain(ip6tc_handle_t *handle, ip_chain_group_t *group) {
   const struct ip6t_entry *entry;
   int rule_num;
+  size_t next = 0;
 
   /* Find first rule for chain and use the iterate macro */
-  entry = ip6tc_first_rule(chain->chain, handle);
+  entry = ip6tc_first_rule(group->chain, handle);
   if (entry == NULL) {
     DEBUG("ip6tc_first_rule failed: %s", ip6tc_strerror(errno));
     return;
@@ -312,24 +443,31 @@ static void submit6_chain(ip6tc_handle_t *handle, ip_chain_t *chain) {
 
   rule_num = 1;
   while (entry) {
-    if (chain->rule_type == RTYPE_NUM) {
-      submit6_match(NULL, entry, chain, rule_num);
-    } else {
-      IP6T_MATCH_ITERATE(entry, submit6_match, entry, chain, rule_num);
+    /* The numbered rules are sorted, so only the next ones can match. */
+    while ((next < group->numbered_num) &&
+           (group->numbered[next]->rule.num <= rule_num)) {
+      submit6_match(NULL, entry, group->numbered[next], rule_num);
+      next++;
     }
 
+    if (group->commented_num > 0)
+      IP6T_MATCH_ITERATE(entry, submit6_comments, entry, group, rule_num);
+    else if (next >= group->numbered_num)
+      break;
+
     entry = ip6tc_next_rule(entry, handle);
     rule_num++;
   } /* while (entry) */
 }
 
 /* ipv4 submit_chain */
-static void submit_chain(iptc_handle_t *handle, ip_chain_t *chain) {
+static void submit_chain(iptc_handle_t *handle, ip_chain_group_t *group) {
   const struct ipt_entry *entry;
   int rule_num;
+  size_t next = 0;
 
   /* Find first rule for chain and use the iterate macro */
-  entry = iptc_first_rule(chain->chain, handle);
+  entry = iptc_first_rule(group->chain, handle);
   if (entry == NULL) {
     DEBUG("iptc_first_rule failed: %s", iptc_strerror(errno));
     return;
@@ -337,77 +475,90 @@ static void submit_chain(iptc_handle_t *handle, ip_chain_t *chain) {
 
   rule_num = 1;
   while (entry) {
-    if (chain->rule_type == RTYPE_NUM) {
-      submit_match(NULL, entry, chain, rule_num);
-    } else {
-      IPT_MATCH_ITERATE(entry, submit_match, entry, chain, rule_num);
+    /* The numbered rules are sorted, so only the next ones can match. */
+    while ((next < group->numbered_num) &&
+           (group->numbered[next]->rule.num <= rule_num)) {
+      submit_match(NULL, entry, group->numbered[next], rule_num);
+      next++;
     }
 
+    if (group->commented_num > 0)
+      IPT_MATCH_ITERATE(entry, submit_comments, entry, group, rule_num);
+    else if (next >= group->numbered_num)
+      break;
+
     entry = iptc_next_rule(entry, handle);
     rule_num++;
   } /* while (entry) */
 }
 
 static int iptables_read(void) {
-  int num_failures = 0;
-  ip_chain_t *chain;
+  size_t num_failures = 0;
 
-  /* Init the iptc handle structure and query the correct table */
-  for (int i = 0; i < chain_num; i++) {
-    chain = chain_list[i];
+  /* Init the iptc handle structure once per table and query all its chains
+   * from the same snapshot. */
+  for (size_t i = 0; i < table_num; i++) {
+    ip_table_t *table = table_list + i;
 
-    if (!chain) {
-      DEBUG("iptables plugin: chain == NULL");
-      continue;
-    }
-
-    if (chain->ip_version == IPV4) {
+    if (table->ip_version == IPV4) {
 #ifdef HAVE_IPTC_HANDLE_T
       iptc_handle_t _handle;
       iptc_handle_t *handle = &_handle;
 
-      *handle = iptc_init(chain->table);
+      *handle = iptc_init(table->table);
 #else
       iptc_handle_t *handle;
-      handle = iptc_init(chain->table);
+      handle = iptc_init(table->table);
 #endif
 
       if (!handle) {
-        ERROR("iptables plugin: iptc_init (%s) failed: %s", chain->table,
+        ERROR("iptables plugin: iptc_init (%s) failed: %s", table->table,
               iptc_strerror(errno));
         num_failures++;
         continue;
       }
 
-      submit_chain(handle, chain);
+      for (size_t j = 0; j < table->groups_num; j++)
+        submit_chain(handle, table->groups + j);
       iptc_free(handle);
-    } else if (chain->ip_version == IPV6) {
+    } else if (table->ip_version == IPV6) {
 #ifdef HAVE_IP6TC_HANDLE_T
       ip6tc_handle_t _handle;
       ip6tc_handle_t *handle = &_handle;
 
-      *handle = ip6tc_init(chain->table);
+      *handle = ip6tc_init(table->table);
 #else
       ip6tc_handle_t *handle;
-      handle = ip6tc_init(chain->table);
+      handle = ip6tc_init(table->table);
 #endif
       if (!handle) {
-        ERROR("iptables plugin: ip6tc_init (%s) failed: %s", chain->table,
+        ERROR("iptables plugin: ip6tc_init (%s) failed: %s", table->table,
               ip6tc_strerror(errno));
         num_failures++;
         continue;
       }
 
-      submit6_chain(handle, chain);
+      for (size_t j = 0; j < table->groups_num; j++)
+        submit6_chain(handle, table->groups + j);
       ip6tc_free(handle);
     } else
       num_failures++;
-  } /* for (i = 0 .. chain_num) */
+  } /* for (i = 0 .. table_num) */
 
-  return (num_failures < chain_num) ? 0 : -1;
+  return (num_failures < table_num) ? 0 : -1;
 } /* int iptables_read */
 
 static int iptables_shutdown(void) {
+  for (size_t i = 0; i < table_num; i++) {
+    for (size_t j = 0; j < table_list[i].groups_num; j++) {
+      sfree(table_list[i].groups[j].numbered);
+      sfree(table_list[i].groups[j].commented);
+    }
+    sfree(table_list[i].groups);
+  }
+  sfree(table_list);
+  table_num = 0;
+
   for (int i = 0; i < chain_num; i++) {
     if ((chain_list[i] != NULL) && (chain_list[i]->rule_type == RTYPE_COMMENT))
       sfree(chain_list[i]->rule.comment);
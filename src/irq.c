@@ -34,11 +34,37 @@
 /*
  * (Module-)Global variables
  */
-static const char *config_keys[] = {"Irq", "IgnoreSelected"};
+static const char *config_keys[] = {"Irq", "IgnoreSelected", "CpuGroupSize"};
 static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 
 static ignorelist_t *ignorelist = NULL;
 
+/* If non-zero, the per-CPU counters of all selected IRQs are summed up in
+ * groups of this many CPUs and dispatched instead of the per-IRQ totals. */
+static size_t cpu_group_size = 0;
+
+/* /proc/interrupts is well beyond a megabyte on hosts with hundreds of CPUs.
+ * The file is kept open and read in large blocks into a buffer which is
+ * reused across intervals. */
+#define IRQ_READ_SIZE 65536
+static int proc_interrupts_fd = -1;
+static char *irq_buffer = NULL;
+static size_t irq_buffer_size = 0;
+
+/* CPU number of each counter column, as named in the header line, and the
+ * counters of the current line in CpuGroupSize mode. */
+static size_t *irq_cpu_ids = NULL;
+static derive_t *irq_row_values = NULL;
+static size_t irq_cpu_ids_size = 0;
+
+static derive_t *irq_group_sums = NULL;
+static size_t irq_group_sums_size = 0;
+
+#define IRQ_BATCH_SIZE 256
+static value_list_t irq_batch[IRQ_BATCH_SIZE];
+static value_t irq_batch_values[IRQ_BATCH_SIZE];
+static size_t irq_batch_num = 0;
+
 /*
  * Private functions
  */
@@ -53,6 +79,13 @@ static int irq_config(const char *key, const char *value) {
     if (IS_TRUE(value))
       invert = 0;
     ignorelist_set_invert(ignorelist, invert);
+  } else if (strcasecmp(key, "CpuGroupSize") == 0) {
+    int tmp = atoi(value);
+    if (tmp < 0) {
+      WARNING("irq plugin: CpuGroupSize must not be negative.");
+      return 1;
+    }
+    cpu_group_size = (size_t)tmp;
   } else {
     return -1;
   }
@@ -60,26 +93,246 @@ static int irq_config(const char *key, const char *value) {
   return 0;
 }
 
-static void irq_submit(const char *irq_name, derive_t value) {
-  value_list_t vl = VALUE_LIST_INIT;
-
-  if (ignorelist_match(ignorelist, irq_name) != 0)
+static void irq_batch_flush(void) /* {{{ */
+{
+  if (irq_batch_num == 0)
     return;
 
-  vl.values = &(value_t){.derive = value};
-  vl.values_len = 1;
-  sstrncpy(vl.plugin, "irq", sizeof(vl.plugin));
-  sstrncpy(vl.type, "irq", sizeof(vl.type));
-  sstrncpy(vl.type_instance, irq_name, sizeof(vl.type_instance));
+  plugin_dispatch_values_batch(irq_batch, irq_batch_num);
+  irq_batch_num = 0;
+} /* }}} void irq_batch_flush */
+
+static void irq_submit(const char *type_instance, derive_t value) {
+  value_list_t *vl;
+
+  if (irq_batch_num >= IRQ_BATCH_SIZE)
+    irq_batch_flush();
 
-  plugin_dispatch_values(&vl);
+  vl = irq_batch + irq_batch_num;
+  *vl = (value_list_t)VALUE_LIST_INIT;
+  vl->values = irq_batch_values + irq_batch_num;
+  vl->values[0].derive = value;
+  vl->values_len = 1;
+  sstrncpy(vl->plugin, "irq", sizeof(vl->plugin));
+  sstrncpy(vl->type, "irq", sizeof(vl->type));
+  sstrncpy(vl->type_instance, type_instance, sizeof(vl->type_instance));
+
+  irq_batch_num++;
 } /* void irq_submit */
 
+/* Reads all of /proc/interrupts into irq_buffer and returns its length, or a
+ * negative value on error. The buffer is null-terminated. */
+static ssize_t irq_read_file(void) /* {{{ */
+{
+  size_t len = 0;
+
+  if (proc_interrupts_fd < 0) {
+    proc_interrupts_fd = open("/proc/interrupts", O_RDONLY | O_CLOEXEC);
+    if (proc_interrupts_fd < 0) {
+      ERROR("irq plugin: open (/proc/interrupts): %s", STRERRNO);
+      return -1;
+    }
+  }
+
+  while (42) {
+    ssize_t status;
+
+    if (irq_buffer_size - len < IRQ_READ_SIZE + 1) {
+      size_t new_size = irq_buffer_size * 2;
+      if (new_size < len + IRQ_READ_SIZE + 1)
+        new_size = len + IRQ_READ_SIZE + 1;
+
+      char *tmp = realloc(irq_buffer, new_size);
+      if (tmp == NULL) {
+        ERROR("irq plugin: realloc failed.");
+        return -1;
+      }
+      irq_buffer = tmp;
+      irq_buffer_size = new_size;
+    }
+
+    status = pread(proc_interrupts_fd, irq_buffer + len,
+                   irq_buffer_size - len - 1, (off_t)len);
+    if (status < 0) {
+      if (errno == EINTR)
+        continue;
+      ERROR("irq plugin: reading /proc/interrupts failed: %s", STRERRNO);
+      close(proc_interrupts_fd);
+      proc_interrupts_fd = -1;
+      return -1;
+    } else if (status == 0) {
+      break;
+    }
+
+    len += (size_t)status;
+  }
+
+  irq_buffer[len] = 0;
+  return (ssize_t)len;
+} /* }}} ssize_t irq_read_file */
+
+/* Parses the header line, e.g. "    CPU0  CPU1  CPU4", into irq_cpu_ids and
+ * returns the number of counter columns, or -1 on error. */
+static int irq_parse_header(char const *ptr, char const *end) /* {{{ */
+{
+  size_t cpu_count = 0;
+
+  while (ptr < end) {
+    char const *token;
+
+    while ((ptr < end) && isspace((unsigned char)*ptr))
+      ptr++;
+    if (ptr >= end)
+      break;
+
+    token = ptr;
+    while ((ptr < end) && !isspace((unsigned char)*ptr))
+      ptr++;
+
+    if (cpu_count >= irq_cpu_ids_size) {
+      size_t new_size = (irq_cpu_ids_size == 0) ? 64 : 2 * irq_cpu_ids_size;
+      size_t *ids = realloc(irq_cpu_ids, new_size * sizeof(*ids));
+      if (ids == NULL) {
+        ERROR("irq plugin: realloc failed.");
+        return -1;
+      }
+      irq_cpu_ids = ids;
+
+      derive_t *values = realloc(irq_row_values, new_size * sizeof(*values));
+      if (values == NULL) {
+        ERROR("irq plugin: realloc failed.");
+        return -1;
+      }
+      irq_row_values = values;
+      irq_cpu_ids_size = new_size;
+    }
+
+    /* Offline CPUs have no column, so the column index is not necessarily
+     * the CPU number. */
+    irq_cpu_ids[cpu_count] = cpu_count;
+    if ((ptr - token > 3) && (strncmp(token, "CPU", 3) == 0)) {
+      size_t id = 0;
+      char const *digit;
+
+      for (digit = token + 3; digit < ptr; digit++) {
+        if (!isdigit((unsigned char)*digit))
+          break;
+        id = 10 * id + (size_t)(*digit - '0');
+      }
+      if (digit == ptr)
+        irq_cpu_ids[cpu_count] = id;
+    }
+
+    cpu_count++;
+  }
+
+  if (cpu_count > INT_MAX)
+    return -1;
+  return (int)cpu_count;
+} /* }}} int irq_parse_header */
+
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+/* Checks whether all eight bytes of the little-endian word `v' are ASCII
+ * digits. */
+static _Bool irq_eight_digits(uint64_t v) {
+  return ((v & 0xF0F0F0F0F0F0F0F0ULL) |
+          (((v + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4)) ==
+         0x3333333333333333ULL;
+} /* _Bool irq_eight_digits */
+
+/* Converts eight ASCII digits at once by combining adjacent pairs of digits,
+ * then pairs of two-digit numbers and so on. */
+static uint64_t irq_parse_eight_digits(uint64_t v) {
+  v -= 0x3030303030303030ULL;
+  v = (v * 10) + (v >> 8);
+  v = (((v & 0x000000FF000000FFULL) * 0x000F424000000064ULL) +
+       (((v >> 16) & 0x000000FF000000FFULL) * 0x0000271000000001ULL)) >>
+      32;
+  return v;
+} /* uint64_t irq_parse_eight_digits */
+#endif
+
+/* Parses the unsigned decimal number at `*ptr' and advances `*ptr' past it.
+ * The caller guarantees that `*ptr' points to a digit. */
+static uint64_t irq_parse_number(char const **ptr, char const *end) /* {{{ */
+{
+  char const *p = *ptr;
+  uint64_t value = 0;
+
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+  /* Counters of busy IRQs quickly exceed eight digits. */
+  if (end - p >= 8) {
+    uint64_t word;
+    memcpy(&word, p, sizeof(word));
+    if (irq_eight_digits(word)) {
+      value = irq_parse_eight_digits(word);
+      p += 8;
+    }
+  }
+#endif
+
+  while ((p < end) && (*p >= '0') && (*p <= '9')) {
+    value = 10 * value + (uint64_t)(*p - '0');
+    p++;
+  }
+
+  *ptr = p;
+  return value;
+} /* }}} uint64_t irq_parse_number */
+
+static int irq_group_sums_reset(int cpu_count) /* {{{ */
+{
+  size_t groups_num = 0;
+
+  for (int i = 0; i < cpu_count; i++)
+    if (groups_num <= irq_cpu_ids[i] / cpu_group_size)
+      groups_num = irq_cpu_ids[i] / cpu_group_size + 1;
+
+  if (groups_num > irq_group_sums_size) {
+    derive_t *tmp = realloc(irq_group_sums, groups_num * sizeof(*tmp));
+    if (tmp == NULL) {
+      ERROR("irq plugin: realloc failed.");
+      return -1;
+    }
+    irq_group_sums = tmp;
+    irq_group_sums_size = groups_num;
+  }
+
+  /* Groups without any online CPU are marked with -1 and not dispatched. */
+  for (size_t i = 0; i < groups_num; i++)
+    irq_group_sums[i] = -1;
+  for (int i = 0; i < cpu_count; i++)
+    irq_group_sums[irq_cpu_ids[i] / cpu_group_size] = 0;
+
+  return (int)groups_num;
+} /* }}} int irq_group_sums_reset */
+
+static void irq_group_sums_submit(int groups_num) /* {{{ */
+{
+  for (int i = 0; i < groups_num; i++) {
+    size_t first = (size_t)i * cpu_group_size;
+    char name[DATA_MAX_NAME_LEN];
+
+    if (irq_group_sums[i] < 0)
+      continue;
+
+    if (cpu_group_size == 1)
+      snprintf(name, sizeof(name), "cpu%zu", first);
+    else
+      snprintf(name, sizeof(name), "cpu%zu-%zu", first,
+               first + cpu_group_size - 1);
+
+    irq_submit(name, irq_group_sums[i]);
+  }
+} /* }}} void irq_group_sums_submit */
+
 static int irq_read(void) {
-  FILE *fh;
-  char buffer[1024];
+  ssize_t len;
+  char *ptr;
+  char *end;
+  char *eol;
   int cpu_count;
-  char *fields[256];
+  int groups_num = 0;
 
   /*
    * Example content:
@@ -88,44 +341,49 @@ static int irq_read(void) {
    * 1:     102553     158669     218062      70587   IO-APIC-edge      i8042
    * 8:          0          0          0          1   IO-APIC-edge      rtc0
    */
-  fh = fopen("/proc/interrupts", "r");
-  if (fh == NULL) {
-    ERROR("irq plugin: fopen (/proc/interrupts): %s", STRERRNO);
+  len = irq_read_file();
+  if (len < 0)
     return -1;
-  }
+
+  ptr = irq_buffer;
+  end = irq_buffer + len;
 
   /* Get CPU count from the first line */
-  if (fgets(buffer, sizeof(buffer), fh) != NULL) {
-    cpu_count = strsplit(buffer, fields, STATIC_ARRAY_SIZE(fields));
-  } else {
+  eol = memchr(ptr, '\n', (size_t)len);
+  if (eol == NULL) {
     ERROR("irq plugin: unable to get CPU count from first line "
           "of /proc/interrupts");
-    fclose(fh);
     return -1;
   }
+  cpu_count = irq_parse_header(ptr, eol);
+  if (cpu_count < 0)
+    return -1;
+
+  if (cpu_group_size > 0) {
+    groups_num = irq_group_sums_reset(cpu_count);
+    if (groups_num < 0)
+      return -1;
+  }
 
-  while (fgets(buffer, sizeof(buffer), fh) != NULL) {
+  /* The counters are summed up in place, without splitting the lines into
+   * fields first. */
+  for (ptr = eol + 1; ptr < end; ptr = eol + 1) {
     char *irq_name;
     size_t irq_name_len;
     derive_t irq_value;
     int i;
-    int fields_num;
-    int irq_values_to_parse;
 
-    fields_num = strsplit(buffer, fields, STATIC_ARRAY_SIZE(fields));
-    if (fields_num < 2)
-      continue;
-
-    /* Parse this many numeric fields, skip the rest
-     * (+1 because first there is a name of irq in each line) */
-    if (fields_num >= cpu_count + 1)
-      irq_values_to_parse = cpu_count;
-    else
-      irq_values_to_parse = fields_num - 1;
+    eol = memchr(ptr, '\n', (size_t)(end - ptr));
+    if (eol == NULL)
+      eol = end;
 
     /* First field is irq name and colon */
-    irq_name = fields[0];
-    irq_name_len = strlen(irq_name);
+    while ((ptr < eol) && isspace((unsigned char)*ptr))
+      ptr++;
+    irq_name = ptr;
+    while ((ptr < eol) && !isspace((unsigned char)*ptr))
+      ptr++;
+    irq_name_len = (size_t)(ptr - irq_name);
     if (irq_name_len < 2)
       continue;
 
@@ -141,32 +399,75 @@ static int irq_read(void) {
     irq_name[irq_name_len - 1] = 0;
     irq_name_len--;
 
+    if (ignorelist_match(ignorelist, irq_name) != 0)
+      continue;
+
     irq_value = 0;
-    for (i = 1; i <= irq_values_to_parse; i++) {
+    for (i = 0; i < cpu_count; i++) {
       /* Per-CPU value */
-      value_t v;
-      int status;
+      derive_t v;
 
-      status = parse_value(fields[i], &v, DS_TYPE_DERIVE);
-      if (status != 0)
+      while ((ptr < eol) && ((*ptr == ' ') || (*ptr == '\t')))
+        ptr++;
+      if ((ptr >= eol) || (*ptr < '0') || (*ptr > '9'))
         break;
 
-      irq_value += v.derive;
+      v = (derive_t)irq_parse_number((char const **)&ptr, eol);
+      /* A number directly followed by text is not a counter. */
+      if ((ptr < eol) && !isspace((unsigned char)*ptr))
+        break;
+
+      irq_value += v;
+      irq_row_values[i] = v;
     } /* for (i) */
 
     /* No valid fields -> do not submit anything. */
-    if (i <= 1)
+    if (i == 0)
       continue;
 
-    irq_submit(irq_name, irq_value);
+    if (groups_num == 0) {
+      irq_submit(irq_name, irq_value);
+      continue;
+    }
+
+    /* Lines such as "ERR:" and "MIS:" hold a single system-wide counter,
+     * which cannot be attributed to a group of CPUs. */
+    if (i < cpu_count)
+      continue;
+    for (i = 0; i < cpu_count; i++)
+      irq_group_sums[irq_cpu_ids[i] / cpu_group_size] += irq_row_values[i];
   }
 
-  fclose(fh);
+  if (groups_num > 0)
+    irq_group_sums_submit(groups_num);
+
+  irq_batch_flush();
 
   return 0;
 } /* int irq_read */
 
+static int irq_shutdown(void) {
+  if (proc_interrupts_fd >= 0) {
+    close(proc_interrupts_fd);
+    proc_interrupts_fd = -1;
+  }
+
+  sfree(irq_buffer);
+  irq_buffer_size = 0;
+  sfree(irq_cpu_ids);
+  sfree(irq_row_values);
+  irq_cpu_ids_size = 0;
+  sfree(irq_group_sums);
+  irq_group_sums_size = 0;
+
+  ignorelist_free(ignorelist);
+  ignorelist = NULL;
+
+  return 0;
+} /* int irq_shutdown */
+
 void module_register(void) {
   plugin_register_config("irq", irq_config, config_keys, config_keys_num);
   plugin_register_read("irq", irq_read);
+  plugin_register_shutdown("irq", irq_shutdown);
 } /* void module_register */
@@ -63,6 +63,7 @@ typedef struct java_plugin_class_s java_plugin_class_t;
 #define CB_TYPE_NOTIFICATION 8
 #define CB_TYPE_MATCH 9
 #define CB_TYPE_TARGET 10
+#define CB_TYPE_WRITE_BATCH 11
 struct cjni_callback_info_s /* {{{ */
 {
   char *name;
@@ -74,6 +75,49 @@ struct cjni_callback_info_s /* {{{ */
 typedef struct cjni_callback_info_s cjni_callback_info_t;
 /* }}} */
 
+/* Classes and methods needed to convert value lists. They are looked up once by
+ * `cjni_cache_init' instead of once per value list. The classes are held by
+ * global references, which keeps the method IDs valid. */
+struct cjni_cache_s /* {{{ */
+{
+  jclass c_valuelist;
+  jmethodID m_valuelist_constructor;
+  jmethodID m_valuelist_set_data_set;
+  jmethodID m_valuelist_set_host;
+  jmethodID m_valuelist_set_plugin;
+  jmethodID m_valuelist_set_plugin_instance;
+  jmethodID m_valuelist_set_type;
+  jmethodID m_valuelist_set_type_instance;
+  jmethodID m_valuelist_set_time;
+  jmethodID m_valuelist_set_interval;
+  jmethodID m_valuelist_add_value;
+  jmethodID m_valuelist_get_host;
+  jmethodID m_valuelist_get_plugin;
+  jmethodID m_valuelist_get_plugin_instance;
+  jmethodID m_valuelist_get_type;
+  jmethodID m_valuelist_get_type_instance;
+  jmethodID m_valuelist_get_time;
+  jmethodID m_valuelist_get_interval;
+  jmethodID m_valuelist_get_values;
+
+  jclass c_long;
+  jmethodID m_long_constructor;
+  jclass c_double;
+  jmethodID m_double_constructor;
+  jclass c_number;
+  jmethodID m_number_long_value;
+  jmethodID m_number_double_value;
+
+  jclass c_list;
+  jmethodID m_list_size;
+  jmethodID m_list_get;
+  jclass c_arraylist;
+  jmethodID m_arraylist_constructor;
+  jmethodID m_arraylist_add;
+};
+typedef struct cjni_cache_s cjni_cache_t;
+/* }}} */
+
 /*
  * Global variables
  */
@@ -93,6 +137,9 @@ static cjni_callback_info_t *java_callbacks = NULL;
 static size_t java_callbacks_num = 0;
 static pthread_mutex_t java_callbacks_lock = PTHREAD_MUTEX_INITIALIZER;
 
+/* Filled in by `cjni_init_native' when the JVM is created. */
+static cjni_cache_t cjni_cache;
+
 static oconfig_item_t *config_block = NULL;
 
 /*
@@ -111,6 +158,8 @@ static int cjni_callback_register(JNIEnv *jvm_env, jobject o_name,
 static int cjni_read(user_data_t *user_data);
 static int cjni_write(const data_set_t *ds, const value_list_t *vl,
                       user_data_t *ud);
+static int cjni_write_batch(const write_batch_entry_t *entries,
+                            size_t entries_num, user_data_t *ud);
 static int cjni_flush(cdtime_t timeout, const char *identifier,
                       user_data_t *ud);
 static void cjni_log(int severity, const char *message, user_data_t *ud);
@@ -127,10 +176,10 @@ static int cjni_match_target_invoke(const data_set_t *ds, value_list_t *vl,
 /*
  * C to Java conversion functions
  */
-static int ctoj_string(JNIEnv *jvm_env, /* {{{ */
-                       const char *string, jclass class_ptr, jobject object_ptr,
-                       const char *method_name) {
-  jmethodID m_set;
+/* Call a `void setFoo (String s)' method whose ID is already known. */
+static int ctoj_string_method(JNIEnv *jvm_env, /* {{{ */
+                              const char *string, jobject object_ptr,
+                              jmethodID m_set) {
   jstring o_string;
 
   /* Create a java.lang.String */
@@ -140,23 +189,30 @@ static int ctoj_string(JNIEnv *jvm_env, /* {{{ */
     return -1;
   }
 
+  /* Call the method. */
+  (*jvm_env)->CallVoidMethod(jvm_env, object_ptr, m_set, o_string);
+
+  /* Decrease reference counter on the java.lang.String object. */
+  (*jvm_env)->DeleteLocalRef(jvm_env, o_string);
+
+  return 0;
+} /* }}} int ctoj_string_method */
+
+static int ctoj_string(JNIEnv *jvm_env, /* {{{ */
+                       const char *string, jclass class_ptr, jobject object_ptr,
+                       const char *method_name) {
+  jmethodID m_set;
+
   /* Search for the `void setFoo (String s)' method. */
   m_set = (*jvm_env)->GetMethodID(jvm_env, class_ptr, method_name,
                                   "(Ljava/lang/String;)V");
   if (m_set == NULL) {
     ERROR("java plugin: ctoj_string: Cannot find method `void %s (String)'.",
           method_name);
-    (*jvm_env)->DeleteLocalRef(jvm_env, o_string);
     return -1;
   }
 
-  /* Call the method. */
-  (*jvm_env)->CallVoidMethod(jvm_env, object_ptr, m_set, o_string);
-
-  /* Decrease reference counter on the java.lang.String object. */
-  (*jvm_env)->DeleteLocalRef(jvm_env, o_string);
-
-  return 0;
+  return ctoj_string_method(jvm_env, string, object_ptr, m_set);
 } /* }}} int ctoj_string */
 
 static jstring ctoj_output_string(JNIEnv *jvm_env, /* {{{ */
@@ -230,51 +286,15 @@ static int ctoj_double(JNIEnv *jvm_env, /* {{{ */
 /* Convert a jlong to a java.lang.Number */
 static jobject ctoj_jlong_to_number(JNIEnv *jvm_env, jlong value) /* {{{ */
 {
-  jclass c_long;
-  jmethodID m_long_constructor;
-
-  /* Look up the java.lang.Long class */
-  c_long = (*jvm_env)->FindClass(jvm_env, "java/lang/Long");
-  if (c_long == NULL) {
-    ERROR("java plugin: ctoj_jlong_to_number: Looking up the "
-          "java.lang.Long class failed.");
-    return NULL;
-  }
-
-  m_long_constructor =
-      (*jvm_env)->GetMethodID(jvm_env, c_long, "<init>", "(J)V");
-  if (m_long_constructor == NULL) {
-    ERROR("java plugin: ctoj_jlong_to_number: Looking up the "
-          "`Long (long)' constructor failed.");
-    return NULL;
-  }
-
-  return (*jvm_env)->NewObject(jvm_env, c_long, m_long_constructor, value);
+  return (*jvm_env)->NewObject(jvm_env, cjni_cache.c_long,
+                               cjni_cache.m_long_constructor, value);
 } /* }}} jobject ctoj_jlong_to_number */
 
 /* Convert a jdouble to a java.lang.Number */
 static jobject ctoj_jdouble_to_number(JNIEnv *jvm_env, jdouble value) /* {{{ */
 {
-  jclass c_double;
-  jmethodID m_double_constructor;
-
-  /* Look up the java.lang.Long class */
-  c_double = (*jvm_env)->FindClass(jvm_env, "java/lang/Double");
-  if (c_double == NULL) {
-    ERROR("java plugin: ctoj_jdouble_to_number: Looking up the "
-          "java.lang.Double class failed.");
-    return NULL;
-  }
-
-  m_double_constructor =
-      (*jvm_env)->GetMethodID(jvm_env, c_double, "<init>", "(D)V");
-  if (m_double_constructor == NULL) {
-    ERROR("java plugin: ctoj_jdouble_to_number: Looking up the "
-          "`Double (double)' constructor failed.");
-    return NULL;
-  }
-
-  return (*jvm_env)->NewObject(jvm_env, c_double, m_double_constructor, value);
+  return (*jvm_env)->NewObject(jvm_env, cjni_cache.c_double,
+                               cjni_cache.m_double_constructor, value);
 } /* }}} jobject ctoj_jdouble_to_number */
 
 /* Convert a value_t to a java.lang.Number */
@@ -627,18 +647,9 @@ static jobject ctoj_data_set(JNIEnv *jvm_env, const data_set_t *ds) /* {{{ */
 
 static int ctoj_value_list_add_value(JNIEnv *jvm_env, /* {{{ */
                                      value_t value, int ds_type,
-                                     jclass class_ptr, jobject object_ptr) {
-  jmethodID m_addvalue;
+                                     jobject object_ptr) {
   jobject o_number;
 
-  m_addvalue = (*jvm_env)->GetMethodID(jvm_env, class_ptr, "addValue",
-                                       "(Ljava/lang/Number;)V");
-  if (m_addvalue == NULL) {
-    ERROR("java plugin: ctoj_value_list_add_value: "
-          "Cannot find method `void addValue (Number)'.");
-    return -1;
-  }
-
   o_number = ctoj_value_to_number(jvm_env, value, ds_type);
   if (o_number == NULL) {
     ERROR("java plugin: ctoj_value_list_add_value: "
@@ -646,130 +657,82 @@ static int ctoj_value_list_add_value(JNIEnv *jvm_env, /* {{{ */
     return -1;
   }
 
-  (*jvm_env)->CallVoidMethod(jvm_env, object_ptr, m_addvalue, o_number);
+  (*jvm_env)->CallVoidMethod(jvm_env, object_ptr,
+                             cjni_cache.m_valuelist_add_value, o_number);
 
   (*jvm_env)->DeleteLocalRef(jvm_env, o_number);
 
   return 0;
 } /* }}} int ctoj_value_list_add_value */
 
-static int ctoj_value_list_add_data_set(JNIEnv *jvm_env, /* {{{ */
-                                        jclass c_valuelist, jobject o_valuelist,
-                                        const data_set_t *ds) {
-  jmethodID m_setdataset;
-  jobject o_dataset;
-
-  /* Look for the `void setDataSource (List<DataSource> ds)' method. */
-  m_setdataset = (*jvm_env)->GetMethodID(jvm_env, c_valuelist, "setDataSet",
-                                         "(Lorg/collectd/api/DataSet;)V");
-  if (m_setdataset == NULL) {
-    ERROR("java plugin: ctoj_value_list_add_data_set: "
-          "Cannot find the `void setDataSet (DataSet)' method.");
-    return -1;
-  }
-
-  /* Create a DataSet object. */
-  o_dataset = ctoj_data_set(jvm_env, ds);
-  if (o_dataset == NULL) {
-    ERROR("java plugin: ctoj_value_list_add_data_set: "
-          "ctoj_data_set (%s) failed.",
-          ds->type);
-    return -1;
-  }
-
-  /* Actually call the method. */
-  (*jvm_env)->CallVoidMethod(jvm_env, o_valuelist, m_setdataset, o_dataset);
-
-  /* Decrease reference counter on the List<DataSource> object. */
-  (*jvm_env)->DeleteLocalRef(jvm_env, o_dataset);
-
-  return 0;
-} /* }}} int ctoj_value_list_add_data_set */
-
-/* Convert a value_list_t (and data_set_t) to a org/collectd/api/ValueList */
+/* Convert a value_list_t (and data_set_t) to a org/collectd/api/ValueList. If
+ * `o_dataset' is not NULL, it is used instead of converting `ds' again. This
+ * lets value lists of the same type share one DataSet object. */
 static jobject ctoj_value_list(JNIEnv *jvm_env, /* {{{ */
-                               const data_set_t *ds, const value_list_t *vl) {
-  jclass c_valuelist;
-  jmethodID m_valuelist_constructor;
+                               const data_set_t *ds, jobject o_dataset,
+                               const value_list_t *vl) {
   jobject o_valuelist;
   int status;
 
-  /* First, create a new ValueList instance..
-   * Look up the class.. */
-  c_valuelist = (*jvm_env)->FindClass(jvm_env, "org/collectd/api/ValueList");
-  if (c_valuelist == NULL) {
-    ERROR("java plugin: ctoj_value_list: "
-          "FindClass (org/collectd/api/ValueList) failed.");
-    return NULL;
-  }
-
-  /* Lookup the `ValueList ()' constructor. */
-  m_valuelist_constructor =
-      (*jvm_env)->GetMethodID(jvm_env, c_valuelist, "<init>", "()V");
-  if (m_valuelist_constructor == NULL) {
-    ERROR("java plugin: ctoj_value_list: Cannot find the "
-          "`ValueList ()' constructor.");
-    return NULL;
-  }
-
-  /* Create a new instance. */
-  o_valuelist =
-      (*jvm_env)->NewObject(jvm_env, c_valuelist, m_valuelist_constructor);
+  /* Create a new ValueList instance. */
+  o_valuelist = (*jvm_env)->NewObject(jvm_env, cjni_cache.c_valuelist,
+                                      cjni_cache.m_valuelist_constructor);
   if (o_valuelist == NULL) {
     ERROR("java plugin: ctoj_value_list: Creating a new ValueList instance "
           "failed.");
     return NULL;
   }
 
-  status = ctoj_value_list_add_data_set(jvm_env, c_valuelist, o_valuelist, ds);
-  if (status != 0) {
-    ERROR("java plugin: ctoj_value_list: "
-          "ctoj_value_list_add_data_set failed.");
-    (*jvm_env)->DeleteLocalRef(jvm_env, o_valuelist);
-    return NULL;
+  if (o_dataset != NULL) {
+    (*jvm_env)->CallVoidMethod(jvm_env, o_valuelist,
+                               cjni_cache.m_valuelist_set_data_set, o_dataset);
+  } else {
+    o_dataset = ctoj_data_set(jvm_env, ds);
+    if (o_dataset == NULL) {
+      ERROR("java plugin: ctoj_value_list: ctoj_data_set (%s) failed.",
+            ds->type);
+      (*jvm_env)->DeleteLocalRef(jvm_env, o_valuelist);
+      return NULL;
+    }
+
+    (*jvm_env)->CallVoidMethod(jvm_env, o_valuelist,
+                               cjni_cache.m_valuelist_set_data_set, o_dataset);
+    (*jvm_env)->DeleteLocalRef(jvm_env, o_dataset);
   }
 
 /* Set the strings.. */
-#define SET_STRING(str, method_name)                                           \
+#define SET_STRING(str, method)                                                \
   do {                                                                         \
-    status = ctoj_string(jvm_env, str, c_valuelist, o_valuelist, method_name); \
+    status = ctoj_string_method(jvm_env, str, o_valuelist,                     \
+                                cjni_cache.m_valuelist_##method);              \
     if (status != 0) {                                                         \
       ERROR("java plugin: ctoj_value_list: ctoj_string (%s) failed.",          \
-            method_name);                                                      \
+            #method);                                                          \
       (*jvm_env)->DeleteLocalRef(jvm_env, o_valuelist);                        \
       return NULL;                                                             \
     }                                                                          \
   } while (0)
 
-  SET_STRING(vl->host, "setHost");
-  SET_STRING(vl->plugin, "setPlugin");
-  SET_STRING(vl->plugin_instance, "setPluginInstance");
-  SET_STRING(vl->type, "setType");
-  SET_STRING(vl->type_instance, "setTypeInstance");
+  SET_STRING(vl->host, set_host);
+  SET_STRING(vl->plugin, set_plugin);
+  SET_STRING(vl->plugin_instance, set_plugin_instance);
+  SET_STRING(vl->type, set_type);
+  SET_STRING(vl->type_instance, set_type_instance);
 
 #undef SET_STRING
 
-  /* Set the `time' member. Java stores time in milliseconds. */
-  status = ctoj_long(jvm_env, (jlong)CDTIME_T_TO_MS(vl->time), c_valuelist,
-                     o_valuelist, "setTime");
-  if (status != 0) {
-    ERROR("java plugin: ctoj_value_list: ctoj_long (setTime) failed.");
-    (*jvm_env)->DeleteLocalRef(jvm_env, o_valuelist);
-    return NULL;
-  }
-
-  /* Set the `interval' member.. */
-  status = ctoj_long(jvm_env, (jlong)CDTIME_T_TO_MS(vl->interval), c_valuelist,
-                     o_valuelist, "setInterval");
-  if (status != 0) {
-    ERROR("java plugin: ctoj_value_list: ctoj_long (setInterval) failed.");
-    (*jvm_env)->DeleteLocalRef(jvm_env, o_valuelist);
-    return NULL;
-  }
+  /* Set the `time' and `interval' members. Java stores time in
+   * milliseconds. */
+  (*jvm_env)->CallVoidMethod(jvm_env, o_valuelist,
+                             cjni_cache.m_valuelist_set_time,
+                             (jlong)CDTIME_T_TO_MS(vl->time));
+  (*jvm_env)->CallVoidMethod(jvm_env, o_valuelist,
+                             cjni_cache.m_valuelist_set_interval,
+                             (jlong)CDTIME_T_TO_MS(vl->interval));
 
   for (size_t i = 0; i < vl->values_len; i++) {
     status = ctoj_value_list_add_value(jvm_env, vl->values[i], ds->ds[i].type,
-                                       c_valuelist, o_valuelist);
+                                       o_valuelist);
     if (status != 0) {
       ERROR("java plugin: ctoj_value_list: "
             "ctoj_value_list_add_value failed.");
@@ -863,23 +826,14 @@ static jobject ctoj_notification(JNIEnv *jvm_env, /* {{{ */
 /*
  * Java to C conversion functions
  */
-/* Call a `String <method> ()' method. */
-static int jtoc_string(JNIEnv *jvm_env, /* {{{ */
-                       char *buffer, size_t buffer_size, int empty_okay,
-                       jclass class_ptr, jobject object_ptr,
-                       const char *method_name) {
-  jmethodID method_id;
+/* Call a `String <method> ()' method whose ID is already known. */
+static int jtoc_string_method(JNIEnv *jvm_env, /* {{{ */
+                              char *buffer, size_t buffer_size, int empty_okay,
+                              jobject object_ptr, jmethodID method_id,
+                              const char *method_name) {
   jobject string_obj;
   const char *c_str;
 
-  method_id = (*jvm_env)->GetMethodID(jvm_env, class_ptr, method_name,
-                                      "()Ljava/lang/String;");
-  if (method_id == NULL) {
-    ERROR("java plugin: jtoc_string: Cannot find method `String %s ()'.",
-          method_name);
-    return -1;
-  }
-
   string_obj = (*jvm_env)->CallObjectMethod(jvm_env, object_ptr, method_id);
   if ((string_obj == NULL) && (empty_okay == 0)) {
     ERROR("java plugin: jtoc_string: CallObjectMethod (%s) failed.",
@@ -903,6 +857,25 @@ static int jtoc_string(JNIEnv *jvm_env, /* {{{ */
   (*jvm_env)->DeleteLocalRef(jvm_env, string_obj);
 
   return 0;
+} /* }}} int jtoc_string_method */
+
+/* Call a `String <method> ()' method. */
+static int jtoc_string(JNIEnv *jvm_env, /* {{{ */
+                       char *buffer, size_t buffer_size, int empty_okay,
+                       jclass class_ptr, jobject object_ptr,
+                       const char *method_name) {
+  jmethodID method_id;
+
+  method_id = (*jvm_env)->GetMethodID(jvm_env, class_ptr, method_name,
+                                      "()Ljava/lang/String;");
+  if (method_id == NULL) {
+    ERROR("java plugin: jtoc_string: Cannot find method `String %s ()'.",
+          method_name);
+    return -1;
+  }
+
+  return jtoc_string_method(jvm_env, buffer, buffer_size, empty_okay,
+                            object_ptr, method_id, method_name);
 } /* }}} int jtoc_string */
 
 /* Call an `int <method> ()' method. */
@@ -941,51 +914,19 @@ static int jtoc_long(JNIEnv *jvm_env, /* {{{ */
   return 0;
 } /* }}} int jtoc_long */
 
-/* Call a `double <method> ()' method. */
-static int jtoc_double(JNIEnv *jvm_env, /* {{{ */
-                       jdouble *ret_value, jclass class_ptr, jobject object_ptr,
-                       const char *method_name) {
-  jmethodID method_id;
-
-  method_id = (*jvm_env)->GetMethodID(jvm_env, class_ptr, method_name, "()D");
-  if (method_id == NULL) {
-    ERROR("java plugin: jtoc_double: Cannot find method `double %s ()'.",
-          method_name);
-    return -1;
-  }
-
-  *ret_value = (*jvm_env)->CallDoubleMethod(jvm_env, object_ptr, method_id);
-
-  return 0;
-} /* }}} int jtoc_double */
-
 static int jtoc_value(JNIEnv *jvm_env, /* {{{ */
                       value_t *ret_value, int ds_type, jobject object_ptr) {
-  jclass class_ptr;
-  int status;
-
-  class_ptr = (*jvm_env)->GetObjectClass(jvm_env, object_ptr);
-
   if (ds_type == DS_TYPE_GAUGE) {
     jdouble tmp_double;
 
-    status =
-        jtoc_double(jvm_env, &tmp_double, class_ptr, object_ptr, "doubleValue");
-    if (status != 0) {
-      ERROR("java plugin: jtoc_value: "
-            "jtoc_double failed.");
-      return -1;
-    }
+    tmp_double = (*jvm_env)->CallDoubleMethod(
+        jvm_env, object_ptr, cjni_cache.m_number_double_value);
     (*ret_value).gauge = (gauge_t)tmp_double;
   } else {
     jlong tmp_long;
 
-    status = jtoc_long(jvm_env, &tmp_long, class_ptr, object_ptr, "longValue");
-    if (status != 0) {
-      ERROR("java plugin: jtoc_value: "
-            "jtoc_long failed.");
-      return -1;
-    }
+    tmp_long = (*jvm_env)->CallLongMethod(jvm_env, object_ptr,
+                                          cjni_cache.m_number_long_value);
 
     if (ds_type == DS_TYPE_DERIVE)
       (*ret_value).derive = (derive_t)tmp_long;
@@ -1002,11 +943,9 @@ static int jtoc_value(JNIEnv *jvm_env, /* {{{ */
  * `value_list_t'. */
 static int jtoc_values_array(JNIEnv *jvm_env, /* {{{ */
                              const data_set_t *ds, value_list_t *vl,
-                             jclass class_ptr, jobject object_ptr) {
-  jmethodID m_getvalues;
-  jmethodID m_toarray;
+                             jobject object_ptr) {
   jobject o_list;
-  jobjectArray o_number_array;
+  jint list_size;
 
   value_t *values;
   int values_num;
@@ -1014,47 +953,31 @@ static int jtoc_values_array(JNIEnv *jvm_env, /* {{{ */
   values_num = ds->ds_num;
 
   values = NULL;
-  o_number_array = NULL;
   o_list = NULL;
 
 #define BAIL_OUT(status)                                                       \
   free(values);                                                                \
-  if (o_number_array != NULL)                                                  \
-    (*jvm_env)->DeleteLocalRef(jvm_env, o_number_array);                       \
   if (o_list != NULL)                                                          \
     (*jvm_env)->DeleteLocalRef(jvm_env, o_list);                               \
   return status;
 
   /* Call: List<Number> ValueList.getValues () */
-  m_getvalues = (*jvm_env)->GetMethodID(jvm_env, class_ptr, "getValues",
-                                        "()Ljava/util/List;");
-  if (m_getvalues == NULL) {
-    ERROR("java plugin: jtoc_values_array: "
-          "Cannot find method `List getValues ()'.");
-    BAIL_OUT(-1);
-  }
-
-  o_list = (*jvm_env)->CallObjectMethod(jvm_env, object_ptr, m_getvalues);
+  o_list = (*jvm_env)->CallObjectMethod(jvm_env, object_ptr,
+                                        cjni_cache.m_valuelist_get_values);
   if (o_list == NULL) {
     ERROR("java plugin: jtoc_values_array: "
           "CallObjectMethod (getValues) failed.");
     BAIL_OUT(-1);
   }
 
-  /* Call: Number[] List.toArray () */
-  m_toarray = (*jvm_env)->GetMethodID(
-      jvm_env, (*jvm_env)->GetObjectClass(jvm_env, o_list), "toArray",
-      "()[Ljava/lang/Object;");
-  if (m_toarray == NULL) {
-    ERROR("java plugin: jtoc_values_array: "
-          "Cannot find method `Object[] toArray ()'.");
-    BAIL_OUT(-1);
-  }
-
-  o_number_array = (*jvm_env)->CallObjectMethod(jvm_env, o_list, m_toarray);
-  if (o_number_array == NULL) {
-    ERROR("java plugin: jtoc_values_array: "
-          "CallObjectMethod (toArray) failed.");
+  /* The elements are read with List.get () directly, rather than copying them
+   * into an array with List.toArray () first. */
+  list_size =
+      (*jvm_env)->CallIntMethod(jvm_env, o_list, cjni_cache.m_list_size);
+  if (list_size < values_num) {
+    ERROR("java plugin: jtoc_values_array: The value list has %i values, "
+          "but the data set `%s' requires %i.",
+          (int)list_size, ds->type, values_num);
     BAIL_OUT(-1);
   }
 
@@ -1068,16 +991,17 @@ static int jtoc_values_array(JNIEnv *jvm_env, /* {{{ */
     jobject o_number;
     int status;
 
-    o_number =
-        (*jvm_env)->GetObjectArrayElement(jvm_env, o_number_array, (jsize)i);
+    o_number = (*jvm_env)->CallObjectMethod(jvm_env, o_list,
+                                            cjni_cache.m_list_get, (jint)i);
     if (o_number == NULL) {
       ERROR("java plugin: jtoc_values_array: "
-            "GetObjectArrayElement (%i) failed.",
+            "List.get (%i) failed.",
             i);
       BAIL_OUT(-1);
     }
 
     status = jtoc_value(jvm_env, values + i, ds->ds[i].type, o_number);
+    (*jvm_env)->DeleteLocalRef(jvm_env, o_number);
     if (status != 0) {
       ERROR("java plugin: jtoc_values_array: "
             "jtoc_value (%i) failed.",
@@ -1090,7 +1014,6 @@ static int jtoc_values_array(JNIEnv *jvm_env, /* {{{ */
   vl->values_len = values_num;
 
 #undef BAIL_OUT
-  (*jvm_env)->DeleteLocalRef(jvm_env, o_number_array);
   (*jvm_env)->DeleteLocalRef(jvm_env, o_list);
   return 0;
 } /* }}} int jtoc_values_array */
@@ -1098,29 +1021,23 @@ static int jtoc_values_array(JNIEnv *jvm_env, /* {{{ */
 /* Convert a org/collectd/api/ValueList to a value_list_t. */
 static int jtoc_value_list(JNIEnv *jvm_env, value_list_t *vl, /* {{{ */
                            jobject object_ptr) {
-  jclass class_ptr;
   int status;
-  jlong tmp_long;
   const data_set_t *ds;
 
-  class_ptr = (*jvm_env)->GetObjectClass(jvm_env, object_ptr);
-  if (class_ptr == NULL) {
-    ERROR("java plugin: jtoc_value_list: GetObjectClass failed.");
-    return -1;
-  }
-
 /* eo == empty okay */
 #define SET_STRING(buffer, method, eo)                                         \
   do {                                                                         \
-    status = jtoc_string(jvm_env, buffer, sizeof(buffer), eo, class_ptr,       \
-                         object_ptr, method);                                  \
+    status = jtoc_string_method(jvm_env, buffer, sizeof(buffer), eo,           \
+                                object_ptr, cjni_cache.m_valuelist_##method,   \
+                                #method);                                      \
     if (status != 0) {                                                         \
-      ERROR("java plugin: jtoc_value_list: jtoc_string (%s) failed.", method); \
+      ERROR("java plugin: jtoc_value_list: jtoc_string (%s) failed.",          \
+            #method);                                                          \
       return -1;                                                               \
     }                                                                          \
   } while (0)
 
-  SET_STRING(vl->type, "getType", /* empty = */ 0);
+  SET_STRING(vl->type, get_type, /* empty = */ 0);
 
   ds = plugin_get_ds(vl->type);
   if (ds == NULL) {
@@ -1130,29 +1047,20 @@ static int jtoc_value_list(JNIEnv *jvm_env, value_list_t *vl, /* {{{ */
     return -1;
   }
 
-  SET_STRING(vl->host, "getHost", /* empty = */ 0);
-  SET_STRING(vl->plugin, "getPlugin", /* empty = */ 0);
-  SET_STRING(vl->plugin_instance, "getPluginInstance", /* empty = */ 1);
-  SET_STRING(vl->type_instance, "getTypeInstance", /* empty = */ 1);
+  SET_STRING(vl->host, get_host, /* empty = */ 0);
+  SET_STRING(vl->plugin, get_plugin, /* empty = */ 0);
+  SET_STRING(vl->plugin_instance, get_plugin_instance, /* empty = */ 1);
+  SET_STRING(vl->type_instance, get_type_instance, /* empty = */ 1);
 
 #undef SET_STRING
 
-  status = jtoc_long(jvm_env, &tmp_long, class_ptr, object_ptr, "getTime");
-  if (status != 0) {
-    ERROR("java plugin: jtoc_value_list: jtoc_long (getTime) failed.");
-    return -1;
-  }
   /* Java measures time in milliseconds. */
-  vl->time = MS_TO_CDTIME_T(tmp_long);
-
-  status = jtoc_long(jvm_env, &tmp_long, class_ptr, object_ptr, "getInterval");
-  if (status != 0) {
-    ERROR("java plugin: jtoc_value_list: jtoc_long (getInterval) failed.");
-    return -1;
-  }
-  vl->interval = MS_TO_CDTIME_T(tmp_long);
+  vl->time = MS_TO_CDTIME_T((*jvm_env)->CallLongMethod(
+      jvm_env, object_ptr, cjni_cache.m_valuelist_get_time));
+  vl->interval = MS_TO_CDTIME_T((*jvm_env)->CallLongMethod(
+      jvm_env, object_ptr, cjni_cache.m_valuelist_get_interval));
 
-  status = jtoc_values_array(jvm_env, ds, vl, class_ptr, object_ptr);
+  status = jtoc_values_array(jvm_env, ds, vl, object_ptr);
   if (status != 0) {
     ERROR("java plugin: jtoc_value_list: jtoc_values_array failed.");
     return -1;
@@ -1236,6 +1144,65 @@ static jint JNICALL cjni_api_dispatch_values(JNIEnv *jvm_env, /* {{{ */
   return status;
 } /* }}} jint cjni_api_dispatch_values */
 
+/* Dispatches a List<ValueList> with a single call into the daemon. Either all
+ * value lists are dispatched or, if one of them cannot be converted, none. */
+static jint JNICALL cjni_api_dispatch_values_list(JNIEnv *jvm_env, /* {{{ */
+                                                  jobject this,
+                                                  jobject o_list) {
+  value_list_t *vl;
+  jint vl_num;
+  int status;
+
+  if (o_list == NULL) {
+    ERROR("java plugin: cjni_api_dispatch_values_list: "
+          "The list of value lists is null.");
+    return -1;
+  }
+
+  vl_num = (*jvm_env)->CallIntMethod(jvm_env, o_list, cjni_cache.m_list_size);
+  if (vl_num <= 0)
+    return 0;
+
+  vl = calloc((size_t)vl_num, sizeof(*vl));
+  if (vl == NULL) {
+    ERROR("java plugin: cjni_api_dispatch_values_list: calloc failed.");
+    return -1;
+  }
+
+  status = 0;
+  for (jint i = 0; i < vl_num; i++) {
+    jobject o_vl;
+
+    o_vl = (*jvm_env)->CallObjectMethod(jvm_env, o_list, cjni_cache.m_list_get,
+                                        i);
+    if (o_vl == NULL) {
+      ERROR("java plugin: cjni_api_dispatch_values_list: "
+            "Element %i of the list is null.",
+            (int)i);
+      status = -1;
+      break;
+    }
+
+    status = jtoc_value_list(jvm_env, vl + i, o_vl);
+    (*jvm_env)->DeleteLocalRef(jvm_env, o_vl);
+    if (status != 0) {
+      ERROR("java plugin: cjni_api_dispatch_values_list: "
+            "jtoc_value_list (%i) failed.",
+            (int)i);
+      break;
+    }
+  }
+
+  if (status == 0)
+    status = plugin_dispatch_values_batch(vl, (size_t)vl_num);
+
+  for (jint i = 0; i < vl_num; i++)
+    sfree(vl[i].values);
+  sfree(vl);
+
+  return status;
+} /* }}} jint cjni_api_dispatch_values_list */
+
 static jint JNICALL cjni_api_dispatch_notification(JNIEnv *jvm_env, /* {{{ */
                                                    jobject this,
                                                    jobject o_notification) {
@@ -1337,6 +1304,39 @@ static jint JNICALL cjni_api_register_write(JNIEnv *jvm_env, /* {{{ */
   return 0;
 } /* }}} jint cjni_api_register_write */
 
+static jint JNICALL cjni_api_register_write_batch(JNIEnv *jvm_env, /* {{{ */
+                                                  jobject this, jobject o_name,
+                                                  jobject o_write,
+                                                  jint batch_size,
+                                                  jlong linger_ms) {
+  cjni_callback_info_t *cbi;
+
+  if ((batch_size <= 0) || (linger_ms < 0)) {
+    ERROR("java plugin: cjni_api_register_write_batch: Invalid batch size "
+          "(%i) or linger time (%lli ms).",
+          (int)batch_size, (long long)linger_ms);
+    return -1;
+  }
+
+  cbi =
+      cjni_callback_info_create(jvm_env, o_name, o_write, CB_TYPE_WRITE_BATCH);
+  if (cbi == NULL)
+    return -1;
+
+  DEBUG("java plugin: Registering new batch write callback: %s", cbi->name);
+
+  plugin_register_write_batch(
+      cbi->name, cjni_write_batch, (size_t)batch_size,
+      MS_TO_CDTIME_T(linger_ms),
+      &(user_data_t){
+          .data = cbi, .free_func = cjni_callback_info_destroy,
+      });
+
+  (*jvm_env)->DeleteLocalRef(jvm_env, o_write);
+
+  return 0;
+} /* }}} jint cjni_api_register_write_batch */
+
 static jint JNICALL cjni_api_register_flush(JNIEnv *jvm_env, /* {{{ */
                                             jobject this, jobject o_name,
                                             jobject o_flush) {
@@ -1434,6 +1434,7 @@ static jint JNICALL cjni_api_register_match_target(JNIEnv *jvm_env, /* {{{ */
     m_proc.create = cjni_match_target_create;
     m_proc.destroy = cjni_match_target_destroy;
     m_proc.match = (void *)cjni_match_target_invoke;
+    m_proc.value_dependent = fc_match_value_dependent;
 
     status = fc_register_match(c_name, m_proc);
   } else if (type == CB_TYPE_TARGET) {
@@ -1510,6 +1511,9 @@ static JNINativeMethod jni_api_functions[] = /* {{{ */
         {"dispatchValues", "(Lorg/collectd/api/ValueList;)I",
          cjni_api_dispatch_values},
 
+        {"dispatchValues", "(Ljava/util/List;)I",
+         cjni_api_dispatch_values_list},
+
         {"dispatchNotification", "(Lorg/collectd/api/Notification;)I",
          cjni_api_dispatch_notification},
 
@@ -1532,6 +1536,10 @@ static JNINativeMethod jni_api_functions[] = /* {{{ */
          "(Ljava/lang/String;Lorg/collectd/api/CollectdWriteInterface;)I",
          cjni_api_register_write},
 
+        {"registerWriteBatch", "(Ljava/lang/String;Lorg/collectd/api/"
+                               "CollectdWriteBatchInterface;IJ)I",
+         cjni_api_register_write_batch},
+
         {"registerFlush",
          "(Ljava/lang/String;Lorg/collectd/api/CollectdFlushInterface;)I",
          cjni_api_register_flush},
@@ -1599,6 +1607,11 @@ cjni_callback_info_create(JNIEnv *jvm_env, /* {{{ */
     method_signature = "(Lorg/collectd/api/ValueList;)I";
     break;
 
+  case CB_TYPE_WRITE_BATCH:
+    method_name = "write";
+    method_signature = "(Ljava/util/List;)I";
+    break;
+
   case CB_TYPE_FLUSH:
     method_name = "flush";
     method_signature = "(Ljava/lang/Number;Ljava/lang/String;)I";
@@ -1787,6 +1800,101 @@ static void cjni_jvm_env_destroy(void *args) /* {{{ */
   free(cjni_env);
 } /* }}} void cjni_jvm_env_destroy */
 
+/* Look up a class and store a global reference to it in `ret_class'. */
+static int cjni_cache_class(JNIEnv *jvm_env, jclass *ret_class, /* {{{ */
+                            const char *name) {
+  jclass class_ptr;
+
+  class_ptr = (*jvm_env)->FindClass(jvm_env, name);
+  if (class_ptr == NULL) {
+    ERROR("java plugin: cjni_cache_init: FindClass (%s) failed.", name);
+    return -1;
+  }
+
+  *ret_class = (*jvm_env)->NewGlobalRef(jvm_env, class_ptr);
+  (*jvm_env)->DeleteLocalRef(jvm_env, class_ptr);
+  if (*ret_class == NULL) {
+    ERROR("java plugin: cjni_cache_init: NewGlobalRef (%s) failed.", name);
+    return -1;
+  }
+
+  return 0;
+} /* }}} int cjni_cache_class */
+
+/* Fill the global `cjni_cache' variable. */
+static int cjni_cache_init(JNIEnv *jvm_env) /* {{{ */
+{
+#define CACHE_CLASS(member, name)                                              \
+  do {                                                                         \
+    if (cjni_cache_class(jvm_env, &cjni_cache.member, name) != 0)              \
+      return -1;                                                               \
+  } while (0)
+
+#define CACHE_METHOD(member, class_member, name, signature)                    \
+  do {                                                                         \
+    cjni_cache.member = (*jvm_env)->GetMethodID(                               \
+        jvm_env, cjni_cache.class_member, name, signature);                    \
+    if (cjni_cache.member == NULL) {                                           \
+      ERROR("java plugin: cjni_cache_init: Cannot find method `%s%s'.", name,  \
+            signature);                                                        \
+      return -1;                                                               \
+    }                                                                          \
+  } while (0)
+
+  CACHE_CLASS(c_valuelist, "org/collectd/api/ValueList");
+  CACHE_METHOD(m_valuelist_constructor, c_valuelist, "<init>", "()V");
+  CACHE_METHOD(m_valuelist_set_data_set, c_valuelist, "setDataSet",
+               "(Lorg/collectd/api/DataSet;)V");
+  CACHE_METHOD(m_valuelist_set_host, c_valuelist, "setHost",
+               "(Ljava/lang/String;)V");
+  CACHE_METHOD(m_valuelist_set_plugin, c_valuelist, "setPlugin",
+               "(Ljava/lang/String;)V");
+  CACHE_METHOD(m_valuelist_set_plugin_instance, c_valuelist,
+               "setPluginInstance", "(Ljava/lang/String;)V");
+  CACHE_METHOD(m_valuelist_set_type, c_valuelist, "setType",
+               "(Ljava/lang/String;)V");
+  CACHE_METHOD(m_valuelist_set_type_instance, c_valuelist, "setTypeInstance",
+               "(Ljava/lang/String;)V");
+  CACHE_METHOD(m_valuelist_set_time, c_valuelist, "setTime", "(J)V");
+  CACHE_METHOD(m_valuelist_set_interval, c_valuelist, "setInterval", "(J)V");
+  CACHE_METHOD(m_valuelist_add_value, c_valuelist, "addValue",
+               "(Ljava/lang/Number;)V");
+  CACHE_METHOD(m_valuelist_get_host, c_valuelist, "getHost",
+               "()Ljava/lang/String;");
+  CACHE_METHOD(m_valuelist_get_plugin, c_valuelist, "getPlugin",
+               "()Ljava/lang/String;");
+  CACHE_METHOD(m_valuelist_get_plugin_instance, c_valuelist,
+               "getPluginInstance", "()Ljava/lang/String;");
+  CACHE_METHOD(m_valuelist_get_type, c_valuelist, "getType",
+               "()Ljava/lang/String;");
+  CACHE_METHOD(m_valuelist_get_type_instance, c_valuelist, "getTypeInstance",
+               "()Ljava/lang/String;");
+  CACHE_METHOD(m_valuelist_get_time, c_valuelist, "getTime", "()J");
+  CACHE_METHOD(m_valuelist_get_interval, c_valuelist, "getInterval", "()J");
+  CACHE_METHOD(m_valuelist_get_values, c_valuelist, "getValues",
+               "()Ljava/util/List;");
+
+  CACHE_CLASS(c_long, "java/lang/Long");
+  CACHE_METHOD(m_long_constructor, c_long, "<init>", "(J)V");
+  CACHE_CLASS(c_double, "java/lang/Double");
+  CACHE_METHOD(m_double_constructor, c_double, "<init>", "(D)V");
+  CACHE_CLASS(c_number, "java/lang/Number");
+  CACHE_METHOD(m_number_long_value, c_number, "longValue", "()J");
+  CACHE_METHOD(m_number_double_value, c_number, "doubleValue", "()D");
+
+  CACHE_CLASS(c_list, "java/util/List");
+  CACHE_METHOD(m_list_size, c_list, "size", "()I");
+  CACHE_METHOD(m_list_get, c_list, "get", "(I)Ljava/lang/Object;");
+  CACHE_CLASS(c_arraylist, "java/util/ArrayList");
+  CACHE_METHOD(m_arraylist_constructor, c_arraylist, "<init>", "(I)V");
+  CACHE_METHOD(m_arraylist_add, c_arraylist, "add", "(Ljava/lang/Object;)Z");
+
+#undef CACHE_METHOD
+#undef CACHE_CLASS
+
+  return 0;
+} /* }}} int cjni_cache_init */
+
 /* Register ``native'' functions with the JVM. Native functions are C-functions
  * that can be called by Java code. */
 static int cjni_init_native(JNIEnv *jvm_env) /* {{{ */
@@ -1809,6 +1917,12 @@ static int cjni_init_native(JNIEnv *jvm_env) /* {{{ */
     return -1;
   }
 
+  status = cjni_cache_init(jvm_env);
+  if (status != 0) {
+    ERROR("cjni_init_native: cjni_cache_init failed.");
+    return -1;
+  }
+
   return 0;
 } /* }}} int cjni_init_native */
 
@@ -2333,7 +2447,7 @@ static int cjni_write(const data_set_t *ds, const value_list_t *vl, /* {{{ */
 
   cbi = (cjni_callback_info_t *)ud->data;
 
-  vl_java = ctoj_value_list(jvm_env, ds, vl);
+  vl_java = ctoj_value_list(jvm_env, ds, /* o_dataset = */ NULL, vl);
   if (vl_java == NULL) {
     ERROR("java plugin: cjni_write: ctoj_value_list failed.");
     cjni_thread_detach();
@@ -2349,6 +2463,114 @@ static int cjni_write(const data_set_t *ds, const value_list_t *vl, /* {{{ */
   return ret_status;
 } /* }}} int cjni_write */
 
+/* Call the CB_TYPE_WRITE_BATCH callback pointed to by the `user_data_t'
+ * pointer. The value lists are passed as one List<ValueList>; value lists of
+ * the same type share one DataSet object. */
+static int cjni_write_batch(const write_batch_entry_t *entries, /* {{{ */
+                            size_t entries_num, user_data_t *ud) {
+  JNIEnv *jvm_env;
+  cjni_callback_info_t *cbi;
+  const data_set_t **ds_list;
+  jobject *o_ds_list;
+  size_t ds_num;
+  jobject o_list;
+  int ret_status;
+
+  if (jvm == NULL) {
+    ERROR("java plugin: cjni_write_batch: jvm == NULL");
+    return -1;
+  }
+
+  if ((ud == NULL) || (ud->data == NULL)) {
+    ERROR("java plugin: cjni_write_batch: Invalid user data.");
+    return -1;
+  }
+
+  ds_list = calloc(entries_num, sizeof(*ds_list));
+  o_ds_list = calloc(entries_num, sizeof(*o_ds_list));
+  if ((ds_list == NULL) || (o_ds_list == NULL)) {
+    ERROR("java plugin: cjni_write_batch: calloc failed.");
+    sfree(ds_list);
+    sfree(o_ds_list);
+    return -1;
+  }
+  ds_num = 0;
+
+  jvm_env = cjni_thread_attach();
+  if (jvm_env == NULL) {
+    sfree(ds_list);
+    sfree(o_ds_list);
+    return -1;
+  }
+
+  cbi = (cjni_callback_info_t *)ud->data;
+
+  /* All local references created below are released by `PopLocalFrame'. */
+  if ((*jvm_env)->PushLocalFrame(jvm_env, 16) != 0) {
+    ERROR("java plugin: cjni_write_batch: PushLocalFrame failed.");
+    cjni_thread_detach();
+    sfree(ds_list);
+    sfree(o_ds_list);
+    return -1;
+  }
+
+  ret_status = 0;
+  o_list = (*jvm_env)->NewObject(jvm_env, cjni_cache.c_arraylist,
+                                 cjni_cache.m_arraylist_constructor,
+                                 (jint)entries_num);
+  if (o_list == NULL) {
+    ERROR("java plugin: cjni_write_batch: Creating an ArrayList failed.");
+    ret_status = -1;
+  }
+
+  for (size_t i = 0; (ret_status == 0) && (i < entries_num); i++) {
+    jobject o_dataset = NULL;
+    jobject o_vl;
+
+    for (size_t j = 0; j < ds_num; j++) {
+      if (ds_list[j] == entries[i].ds) {
+        o_dataset = o_ds_list[j];
+        break;
+      }
+    }
+
+    if (o_dataset == NULL) {
+      o_dataset = ctoj_data_set(jvm_env, entries[i].ds);
+      if (o_dataset == NULL) {
+        ERROR("java plugin: cjni_write_batch: ctoj_data_set (%s) failed.",
+              entries[i].ds->type);
+        ret_status = -1;
+        break;
+      }
+      ds_list[ds_num] = entries[i].ds;
+      o_ds_list[ds_num] = o_dataset;
+      ds_num++;
+    }
+
+    o_vl = ctoj_value_list(jvm_env, entries[i].ds, o_dataset, entries[i].vl);
+    if (o_vl == NULL) {
+      ERROR("java plugin: cjni_write_batch: ctoj_value_list failed.");
+      ret_status = -1;
+      break;
+    }
+
+    (*jvm_env)->CallBooleanMethod(jvm_env, o_list, cjni_cache.m_arraylist_add,
+                                  o_vl);
+    (*jvm_env)->DeleteLocalRef(jvm_env, o_vl);
+  }
+
+  if (ret_status == 0)
+    ret_status =
+        (*jvm_env)->CallIntMethod(jvm_env, cbi->object, cbi->method, o_list);
+
+  (*jvm_env)->PopLocalFrame(jvm_env, NULL);
+
+  cjni_thread_detach();
+  sfree(ds_list);
+  sfree(o_ds_list);
+  return ret_status;
+} /* }}} int cjni_write_batch */
+
 /* Call the CB_TYPE_FLUSH callback pointed to by the `user_data_t' pointer. */
 static int cjni_flush(cdtime_t timeout, const char *identifier, /* {{{ */
                       user_data_t *ud) {
@@ -2651,16 +2873,17 @@ static int cjni_match_target_invoke(const data_set_t *ds, /* {{{ */
 
   cbi = (cjni_callback_info_t *)*user_data;
 
-  o_vl = ctoj_value_list(jvm_env, ds, vl);
-  if (o_vl == NULL) {
-    ERROR("java plugin: cjni_match_target_invoke: ctoj_value_list failed.");
+  o_ds = ctoj_data_set(jvm_env, ds);
+  if (o_ds == NULL) {
+    ERROR("java plugin: cjni_match_target_invoke: ctoj_data_set failed.");
     cjni_thread_detach();
     return -1;
   }
 
-  o_ds = ctoj_data_set(jvm_env, ds);
-  if (o_ds == NULL) {
+  o_vl = ctoj_value_list(jvm_env, ds, o_ds, vl);
+  if (o_vl == NULL) {
     ERROR("java plugin: cjni_match_target_invoke: ctoj_value_list failed.");
+    (*jvm_env)->DeleteLocalRef(jvm_env, o_ds);
     cjni_thread_detach();
     return -1;
   }
@@ -2787,6 +3010,18 @@ static int cjni_shutdown(void) /* {{{ */
   java_classes_list_len = 0;
   sfree(java_classes_list);
 
+  /* Release the global references to the cached classes. */
+  {
+    jclass cached_classes[] = {cjni_cache.c_valuelist, cjni_cache.c_long,
+                               cjni_cache.c_double,    cjni_cache.c_number,
+                               cjni_cache.c_list,      cjni_cache.c_arraylist};
+
+    for (size_t i = 0; i < STATIC_ARRAY_SIZE(cached_classes); i++)
+      if (cached_classes[i] != NULL)
+        (*jvm_env)->DeleteGlobalRef(jvm_env, cached_classes[i]);
+    memset(&cjni_cache, 0, sizeof(cjni_cache));
+  }
+
   /* Destroy the JVM */
   DEBUG("java plugin: Destroying the JVM.");
   (*jvm)->DestroyJavaVM(jvm);
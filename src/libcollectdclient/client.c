@@ -95,10 +95,31 @@
 /*
  * Types
  */
+struct lcc_pipeline_entry_s {
+  lcc_pipeline_callback_t callback;
+  void *user_data;
+};
+typedef struct lcc_pipeline_entry_s lcc_pipeline_entry_t;
+
 struct lcc_connection_s {
   FILE *fh;
   char errbuf[2048];
+
+  /* Commands sent with lcc_pipeline_send() whose responses have not been read
+   * yet, in the order they were sent. */
+  lcc_pipeline_entry_t *pipeline;
+  size_t pipeline_size;
+  size_t pipeline_head;
+  size_t pipeline_num;
+  size_t pipeline_window;
+
+  /* Pipelined commands not written yet. They bypass the stdio buffer of "fh",
+   * because glibc can't switch a socket stream from reading to writing
+   * while it holds buffered input (fseek fails with ESPIPE). */
+  char *wbuf;
+  size_t wbuf_len;
 };
+#define LCC_PIPELINE_BUFFER_SIZE 65536
 
 struct lcc_response_s {
   int status;
@@ -264,14 +285,13 @@ static int lcc_send(lcc_connection_t *c, const char *command) /* {{{ */
   return 0;
 } /* }}} int lcc_send */
 
-static int lcc_receive(lcc_connection_t *c, /* {{{ */
-                       lcc_response_t *ret_res) {
-  lcc_response_t res = {0};
+/* Reads the first line of a response, containing the status and a message.
+ * For successful commands, the status is the number of lines that follow. */
+static int lcc_receive_status(lcc_connection_t *c, /* {{{ */
+                              lcc_response_t *res) {
   char *ptr;
   char buffer[4096];
-  size_t i;
 
-  /* Read the first line, containing the status and a message */
   ptr = fgets(buffer, sizeof(buffer), c->fh);
   if (ptr == NULL) {
     lcc_set_errno(c, errno);
@@ -284,7 +304,7 @@ static int lcc_receive(lcc_connection_t *c, /* {{{ */
    * beginning of the message. */
   ptr = NULL;
   errno = 0;
-  res.status = (int)strtol(buffer, &ptr, 0);
+  res->status = (int)strtol(buffer, &ptr, 0);
   if ((errno != 0) || (ptr == &buffer[0])) {
     lcc_set_errno(c, errno);
     return -1;
@@ -295,8 +315,21 @@ static int lcc_receive(lcc_connection_t *c, /* {{{ */
     ptr++;
 
   /* Now copy the message. */
-  strncpy(res.message, ptr, sizeof(res.message));
-  res.message[sizeof(res.message) - 1] = 0;
+  strncpy(res->message, ptr, sizeof(res->message));
+  res->message[sizeof(res->message) - 1] = 0;
+
+  return 0;
+} /* }}} int lcc_receive_status */
+
+static int lcc_receive(lcc_connection_t *c, /* {{{ */
+                       lcc_response_t *ret_res) {
+  lcc_response_t res = {0};
+  char *ptr;
+  char buffer[4096];
+  size_t i;
+
+  if (lcc_receive_status(c, &res) != 0)
+    return -1;
 
   /* Error or no lines follow: We're done. */
   if (res.status <= 0) {
@@ -344,6 +377,73 @@ static int lcc_receive(lcc_connection_t *c, /* {{{ */
   return 0;
 } /* }}} int lcc_receive */
 
+/* Writes the buffered pipelined commands to the socket. */
+static int lcc_pipeline_write(lcc_connection_t *c) /* {{{ */
+{
+  size_t off = 0;
+
+  while (off < c->wbuf_len) {
+    ssize_t status = write(fileno(c->fh), c->wbuf + off, c->wbuf_len - off);
+    if (status < 0) {
+      if (errno == EINTR)
+        continue;
+      lcc_set_errno(c, errno);
+      c->wbuf_len = 0;
+      return -1;
+    }
+    off += (size_t)status;
+  }
+
+  c->wbuf_len = 0;
+  return 0;
+} /* }}} int lcc_pipeline_write */
+
+/* Reads the responses of the "num" oldest pipelined commands and invokes their
+ * callbacks. If reading fails, the callbacks of all pending commands are
+ * invoked with a status of -1, because the responses can no longer be matched
+ * to the commands. */
+static int lcc_pipeline_receive(lcc_connection_t *c, size_t num) /* {{{ */
+{
+  int failed = 0;
+
+  if ((num > 0) && (lcc_pipeline_write(c) != 0))
+    failed = 1;
+
+  /* Callbacks may send further commands, so check the queue every time. */
+  while (!failed && (num > 0) && (c->pipeline_num > 0)) {
+    lcc_pipeline_entry_t e = c->pipeline[c->pipeline_head];
+    lcc_response_t res = {0};
+
+    if (lcc_receive(c, &res) != 0) {
+      failed = 1;
+      break;
+    }
+
+    c->pipeline_head = (c->pipeline_head + 1) % c->pipeline_size;
+    c->pipeline_num--;
+    num--;
+
+    if (e.callback != NULL)
+      e.callback(c, res.status, res.message, res.lines, res.lines_num,
+                 e.user_data);
+    lcc_response_free(&res);
+  }
+
+  if (!failed)
+    return 0;
+
+  while (c->pipeline_num > 0) {
+    lcc_pipeline_entry_t e = c->pipeline[c->pipeline_head];
+
+    c->pipeline_head = (c->pipeline_head + 1) % c->pipeline_size;
+    c->pipeline_num--;
+
+    if (e.callback != NULL)
+      e.callback(c, -1, c->errbuf, NULL, 0, e.user_data);
+  }
+  return -1;
+} /* }}} int lcc_pipeline_receive */
+
 static int lcc_sendreceive(lcc_connection_t *c, /* {{{ */
                            const char *command, lcc_response_t *ret_res) {
   lcc_response_t res = {0};
@@ -354,6 +454,13 @@ static int lcc_sendreceive(lcc_connection_t *c, /* {{{ */
     return -1;
   }
 
+  /* Responses to pipelined commands come first. */
+  if (c->pipeline_num > 0) {
+    status = lcc_pipeline_receive(c, c->pipeline_num);
+    if (status != 0)
+      return status;
+  }
+
   status = lcc_send(c, command);
   if (status != 0)
     return status;
@@ -573,6 +680,8 @@ int lcc_disconnect(lcc_connection_t *c) /* {{{ */
     c->fh = NULL;
   }
 
+  free(c->pipeline);
+  free(c->wbuf);
   free(c);
   return 0;
 } /* }}} int lcc_disconnect */
@@ -698,16 +807,18 @@ int lcc_getval(lcc_connection_t *c, lcc_identifier_t *ident, /* {{{ */
   return 0;
 } /* }}} int lcc_getval */
 
-int lcc_putval(lcc_connection_t *c, const lcc_value_list_t *vl) /* {{{ */
-{
+/* Formats the arguments of a PUTVAL command, i.e. the escaped identifier,
+ * options and values, without the command itself. */
+static int lcc_format_putval_args(lcc_connection_t *c, /* {{{ */
+                                  char *ret, size_t ret_size,
+                                  const lcc_value_list_t *vl) {
   char ident_str[6 * LCC_NAME_LEN];
   char ident_esc[12 * LCC_NAME_LEN];
-  char command[1024] = "";
-  lcc_response_t res;
+  char args[1024] = "";
   int status;
 
-  if ((c == NULL) || (vl == NULL) || (vl->values_len < 1) ||
-      (vl->values == NULL) || (vl->values_types == NULL)) {
+  if ((vl == NULL) || (vl->values_len < 1) || (vl->values == NULL) ||
+      (vl->values_types == NULL)) {
     lcc_set_errno(c, EINVAL);
     return -1;
   }
@@ -717,32 +828,51 @@ int lcc_putval(lcc_connection_t *c, const lcc_value_list_t *vl) /* {{{ */
   if (status != 0)
     return status;
 
-  SSTRCATF(command, "PUTVAL %s",
-           lcc_strescape(ident_esc, ident_str, sizeof(ident_esc)));
+  SSTRCAT(args, lcc_strescape(ident_esc, ident_str, sizeof(ident_esc)));
 
   if (vl->interval > 0.0)
-    SSTRCATF(command, " interval=%.3f", vl->interval);
+    SSTRCATF(args, " interval=%.3f", vl->interval);
 
   if (vl->time > 0.0)
-    SSTRCATF(command, " %.3f", vl->time);
+    SSTRCATF(args, " %.3f", vl->time);
   else
-    SSTRCAT(command, " N");
+    SSTRCAT(args, " N");
 
   for (size_t i = 0; i < vl->values_len; i++) {
     if (vl->values_types[i] == LCC_TYPE_COUNTER)
-      SSTRCATF(command, ":%" PRIu64, vl->values[i].counter);
+      SSTRCATF(args, ":%" PRIu64, vl->values[i].counter);
     else if (vl->values_types[i] == LCC_TYPE_GAUGE) {
       if (isnan(vl->values[i].gauge))
-        SSTRCATF(command, ":U");
+        SSTRCATF(args, ":U");
       else
-        SSTRCATF(command, ":%g", vl->values[i].gauge);
+        SSTRCATF(args, ":%g", vl->values[i].gauge);
     } else if (vl->values_types[i] == LCC_TYPE_DERIVE)
-      SSTRCATF(command, ":%" PRIu64, vl->values[i].derive);
+      SSTRCATF(args, ":%" PRIu64, vl->values[i].derive);
     else if (vl->values_types[i] == LCC_TYPE_ABSOLUTE)
-      SSTRCATF(command, ":%" PRIu64, vl->values[i].absolute);
+      SSTRCATF(args, ":%" PRIu64, vl->values[i].absolute);
 
   } /* for (i = 0; i < vl->values_len; i++) */
 
+  snprintf(ret, ret_size, "%s", args);
+  return 0;
+} /* }}} int lcc_format_putval_args */
+
+int lcc_putval(lcc_connection_t *c, const lcc_value_list_t *vl) /* {{{ */
+{
+  char args[1024];
+  char command[1024 + 8];
+  lcc_response_t res;
+  int status;
+
+  if (c == NULL)
+    return -1;
+
+  status = lcc_format_putval_args(c, args, sizeof(args), vl);
+  if (status != 0)
+    return status;
+
+  snprintf(command, sizeof(command), "PUTVAL %s", args);
+
   status = lcc_sendreceive(c, command, &res);
   if (status != 0)
     return status;
@@ -757,6 +887,398 @@ int lcc_putval(lcc_connection_t *c, const lcc_value_list_t *vl) /* {{{ */
   return 0;
 } /* }}} int lcc_putval */
 
+/* Sends a PUTVALS or GETVALS command: a header with the number of lines and
+ * the lines themselves, flushed once. */
+static int lcc_send_bulk(lcc_connection_t *c, const char *command, /* {{{ */
+                         char **lines, size_t lines_num) {
+  if (c->fh == NULL) {
+    lcc_set_errno(c, EBADF);
+    return -1;
+  }
+
+  if ((c->pipeline_num > 0) &&
+      (lcc_pipeline_receive(c, c->pipeline_num) != 0))
+    return -1;
+
+  lcc_tracef("send:    --> %s %zu\n", command, lines_num);
+  if (fprintf(c->fh, "%s %zu\r\n", command, lines_num) < 0) {
+    lcc_set_errno(c, errno);
+    return -1;
+  }
+
+  for (size_t i = 0; i < lines_num; i++) {
+    lcc_tracef("send:    --> %s\n", lines[i]);
+    if (fprintf(c->fh, "%s\r\n", lines[i]) < 0) {
+      lcc_set_errno(c, errno);
+      return -1;
+    }
+  }
+  fflush(c->fh);
+
+  return 0;
+} /* }}} int lcc_send_bulk */
+
+static void lcc_free_lines(char **lines, size_t lines_num) /* {{{ */
+{
+  if (lines == NULL)
+    return;
+
+  for (size_t i = 0; i < lines_num; i++)
+    free(lines[i]);
+  free(lines);
+} /* }}} void lcc_free_lines */
+
+int lcc_putval_multi(lcc_connection_t *c, /* {{{ */
+                     const lcc_value_list_t *vls, size_t vls_num,
+                     int *ret_status) {
+  lcc_response_t res;
+  char **lines;
+  size_t failed = 0;
+  int status;
+
+  if (c == NULL)
+    return -1;
+
+  if ((vls == NULL) || (vls_num < 1)) {
+    lcc_set_errno(c, EINVAL);
+    return -1;
+  }
+
+  /* Format all lines first, so nothing is sent if one of them is invalid. */
+  lines = calloc(vls_num, sizeof(*lines));
+  if (lines == NULL) {
+    lcc_set_errno(c, ENOMEM);
+    return -1;
+  }
+
+  for (size_t i = 0; i < vls_num; i++) {
+    char args[1024];
+
+    status = lcc_format_putval_args(c, args, sizeof(args), vls + i);
+    if (status == 0) {
+      lines[i] = strdup(args);
+      if (lines[i] == NULL) {
+        lcc_set_errno(c, ENOMEM);
+        status = -1;
+      }
+    }
+    if (status != 0) {
+      lcc_free_lines(lines, vls_num);
+      return status;
+    }
+  }
+
+  status = lcc_send_bulk(c, "PUTVALS", lines, vls_num);
+  lcc_free_lines(lines, vls_num);
+  if (status != 0)
+    return status;
+
+  status = lcc_receive(c, &res);
+  if (status != 0)
+    return status;
+
+  if (res.status != 0) {
+    LCC_SET_ERRSTR(c, "Server error: %s", res.message);
+    lcc_response_free(&res);
+    return -1;
+  }
+
+  /* The status vector has one character per value list. */
+  if ((res.lines_num != 1) || (strlen(res.lines[0]) != vls_num)) {
+    LCC_SET_ERRSTR(c, "Invalid response: %s", res.message);
+    lcc_response_free(&res);
+    return -1;
+  }
+
+  for (size_t i = 0; i < vls_num; i++) {
+    int ok = (res.lines[0][i] == '0');
+    if (!ok)
+      failed++;
+    if (ret_status != NULL)
+      ret_status[i] = ok ? 0 : -1;
+  }
+
+  lcc_response_free(&res);
+
+  if (failed > 0) {
+    LCC_SET_ERRSTR(c, "%zu of %zu value lists were rejected.", failed,
+                   vls_num);
+    return -1;
+  }
+  return 0;
+} /* }}} int lcc_putval_multi */
+
+/* Parses one line of a GETVALS response: the number of values followed by
+ * name=value pairs, or a negative status and an error message. */
+static int lcc_parse_getvals_line(char *line, /* {{{ */
+                                  size_t *ret_values_num,
+                                  gauge_t **ret_values) {
+  char *ptr = NULL;
+  long num;
+  gauge_t *values;
+
+  errno = 0;
+  num = strtol(line, &ptr, 10);
+  if ((errno != 0) || (ptr == line))
+    return EILSEQ;
+  if (num < 0)
+    return ENOENT;
+
+  values = calloc((num > 0) ? (size_t)num : 1, sizeof(*values));
+  if (values == NULL)
+    return ENOMEM;
+
+  for (long i = 0; i < num; i++) {
+    char *value = strchr(ptr, '=');
+    char *endptr = NULL;
+
+    if (value == NULL) {
+      free(values);
+      return EILSEQ;
+    }
+    value++;
+
+    errno = 0;
+    values[i] = strtod(value, &endptr);
+    if ((endptr == value) || (errno != 0)) {
+      free(values);
+      return EILSEQ;
+    }
+    ptr = endptr;
+  }
+
+  *ret_values_num = (size_t)num;
+  *ret_values = values;
+  return 0;
+} /* }}} int lcc_parse_getvals_line */
+
+int lcc_getval_multi(lcc_connection_t *c, /* {{{ */
+                     lcc_identifier_t *idents, size_t idents_num,
+                     size_t *ret_values_num, gauge_t **ret_values,
+                     int *ret_status) {
+  lcc_response_t res;
+  char **lines;
+  size_t failed = 0;
+  int status;
+
+  if (c == NULL)
+    return -1;
+
+  if ((idents == NULL) || (idents_num < 1) || (ret_values_num == NULL) ||
+      (ret_values == NULL)) {
+    lcc_set_errno(c, EINVAL);
+    return -1;
+  }
+
+  lines = calloc(idents_num, sizeof(*lines));
+  if (lines == NULL) {
+    lcc_set_errno(c, ENOMEM);
+    return -1;
+  }
+
+  for (size_t i = 0; i < idents_num; i++) {
+    char ident_str[6 * LCC_NAME_LEN];
+    char ident_esc[12 * LCC_NAME_LEN];
+
+    status = lcc_identifier_to_string(c, ident_str, sizeof(ident_str),
+                                      idents + i);
+    if (status == 0) {
+      lines[i] = strdup(lcc_strescape(ident_esc, ident_str, sizeof(ident_esc)));
+      if (lines[i] == NULL) {
+        lcc_set_errno(c, ENOMEM);
+        status = -1;
+      }
+    }
+    if (status != 0) {
+      lcc_free_lines(lines, idents_num);
+      return status;
+    }
+  }
+
+  status = lcc_send_bulk(c, "GETVALS", lines, idents_num);
+  lcc_free_lines(lines, idents_num);
+  if (status != 0)
+    return status;
+
+  status = lcc_receive(c, &res);
+  if (status != 0)
+    return status;
+
+  if (res.status != 0) {
+    LCC_SET_ERRSTR(c, "Server error: %s", res.message);
+    lcc_response_free(&res);
+    return -1;
+  }
+
+  if (res.lines_num != idents_num) {
+    LCC_SET_ERRSTR(c, "Invalid response: %s", res.message);
+    lcc_response_free(&res);
+    return -1;
+  }
+
+  for (size_t i = 0; i < idents_num; i++) {
+    ret_values_num[i] = 0;
+    ret_values[i] = NULL;
+
+    status = lcc_parse_getvals_line(res.lines[i], ret_values_num + i,
+                                    ret_values + i);
+    if (status == EILSEQ || status == ENOMEM) {
+      for (size_t j = 0; j < i; j++) {
+        free(ret_values[j]);
+        ret_values[j] = NULL;
+      }
+      lcc_set_errno(c, status);
+      lcc_response_free(&res);
+      return -1;
+    }
+
+    if (status != 0)
+      failed++;
+    if (ret_status != NULL)
+      ret_status[i] = (status == 0) ? 0 : -1;
+  }
+
+  lcc_response_free(&res);
+
+  if (failed > 0) {
+    LCC_SET_ERRSTR(c, "%zu of %zu identifiers were not found.", failed,
+                   idents_num);
+    return -1;
+  }
+  return 0;
+} /* }}} int lcc_getval_multi */
+
+int lcc_pipeline_send(lcc_connection_t *c, const char *command, /* {{{ */
+                      lcc_pipeline_callback_t callback, void *user_data) {
+  size_t window;
+
+  if (c == NULL)
+    return -1;
+
+  if (command == NULL) {
+    lcc_set_errno(c, EINVAL);
+    return -1;
+  }
+
+  if (c->fh == NULL) {
+    lcc_set_errno(c, EBADF);
+    return -1;
+  }
+
+  /* Read the older half of the responses once the window is full. Otherwise
+   * the daemon blocks writing responses nobody reads, stops reading commands,
+   * and both sides block. */
+  window = (c->pipeline_window > 0) ? c->pipeline_window
+                                    : LCC_PIPELINE_WINDOW_DEFAULT;
+  if ((c->pipeline_num >= window) &&
+      (lcc_pipeline_receive(c, c->pipeline_num - window / 2) != 0))
+    return -1;
+
+  if (c->pipeline_num == c->pipeline_size) {
+    size_t size = (c->pipeline_size > 0) ? 2 * c->pipeline_size : 64;
+    lcc_pipeline_entry_t *tmp = malloc(size * sizeof(*tmp));
+    if (tmp == NULL) {
+      lcc_set_errno(c, ENOMEM);
+      return -1;
+    }
+
+    /* Unwrap the ring into the new array. */
+    for (size_t i = 0; i < c->pipeline_num; i++)
+      tmp[i] = c->pipeline[(c->pipeline_head + i) % c->pipeline_size];
+    free(c->pipeline);
+    c->pipeline = tmp;
+    c->pipeline_size = size;
+    c->pipeline_head = 0;
+  }
+
+  /* Written when the buffer is full or on lcc_pipeline_flush() and
+   * lcc_pipeline_wait(). */
+  size_t command_len = strlen(command);
+  if (command_len + 2 > LCC_PIPELINE_BUFFER_SIZE) {
+    lcc_set_errno(c, EINVAL);
+    return -1;
+  }
+  if (c->wbuf == NULL) {
+    c->wbuf = malloc(LCC_PIPELINE_BUFFER_SIZE);
+    if (c->wbuf == NULL) {
+      lcc_set_errno(c, ENOMEM);
+      return -1;
+    }
+  }
+  if ((c->wbuf_len + command_len + 2 > LCC_PIPELINE_BUFFER_SIZE) &&
+      (lcc_pipeline_write(c) != 0))
+    return -1;
+
+  lcc_tracef("send:    --> %s\n", command);
+  memcpy(c->wbuf + c->wbuf_len, command, command_len);
+  memcpy(c->wbuf + c->wbuf_len + command_len, "\r\n", 2);
+  c->wbuf_len += command_len + 2;
+
+  c->pipeline[(c->pipeline_head + c->pipeline_num) % c->pipeline_size] =
+      (lcc_pipeline_entry_t){.callback = callback, .user_data = user_data};
+  c->pipeline_num++;
+
+  return 0;
+} /* }}} int lcc_pipeline_send */
+
+int lcc_pipeline_putval(lcc_connection_t *c, /* {{{ */
+                        const lcc_value_list_t *vl,
+                        lcc_pipeline_callback_t callback, void *user_data) {
+  char args[1024];
+  char command[1024 + 8];
+  int status;
+
+  if (c == NULL)
+    return -1;
+
+  status = lcc_format_putval_args(c, args, sizeof(args), vl);
+  if (status != 0)
+    return status;
+
+  snprintf(command, sizeof(command), "PUTVAL %s", args);
+  return lcc_pipeline_send(c, command, callback, user_data);
+} /* }}} int lcc_pipeline_putval */
+
+int lcc_pipeline_flush(lcc_connection_t *c) /* {{{ */
+{
+  if (c == NULL)
+    return -1;
+
+  if (c->fh == NULL) {
+    lcc_set_errno(c, EBADF);
+    return -1;
+  }
+
+  return lcc_pipeline_write(c);
+} /* }}} int lcc_pipeline_flush */
+
+int lcc_pipeline_wait(lcc_connection_t *c) /* {{{ */
+{
+  if (c == NULL)
+    return -1;
+
+  if (c->fh == NULL) {
+    lcc_set_errno(c, EBADF);
+    return -1;
+  }
+
+  return lcc_pipeline_receive(c, c->pipeline_num);
+} /* }}} int lcc_pipeline_wait */
+
+size_t lcc_pipeline_pending(lcc_connection_t *c) /* {{{ */
+{
+  return (c != NULL) ? c->pipeline_num : 0;
+} /* }}} size_t lcc_pipeline_pending */
+
+int lcc_pipeline_set_window(lcc_connection_t *c, size_t window) /* {{{ */
+{
+  if (c == NULL)
+    return -1;
+
+  c->pipeline_window = window;
+  return 0;
+} /* }}} int lcc_pipeline_set_window */
+
 int lcc_flush(lcc_connection_t *c, const char *plugin, /* {{{ */
               lcc_identifier_t *ident, int timeout) {
   char command[1024] = "";
@@ -881,6 +1403,82 @@ int lcc_listval(lcc_connection_t *c, /* {{{ */
   return 0;
 } /* }}} int lcc_listval */
 
+int lcc_listval_stream(lcc_connection_t *c, const char *pattern, /* {{{ */
+                       lcc_listval_callback_t callback, void *user_data) {
+  char command[1024] = "LISTVAL";
+  lcc_response_t res = {0};
+  int cb_status = 0;
+  int status;
+
+  if (c == NULL)
+    return -1;
+
+  if (callback == NULL) {
+    lcc_set_errno(c, EINVAL);
+    return -1;
+  }
+
+  if (pattern != NULL) {
+    char pattern_esc[sizeof(command) - sizeof("LISTVAL ")];
+    SSTRCATF(command, " %s",
+             lcc_strescape(pattern_esc, pattern, sizeof(pattern_esc)));
+  }
+
+  /* Responses to pipelined commands come first. */
+  if (c->pipeline_num > 0) {
+    status = lcc_pipeline_receive(c, c->pipeline_num);
+    if (status != 0)
+      return status;
+  }
+
+  status = lcc_send(c, command);
+  if (status != 0)
+    return status;
+
+  status = lcc_receive_status(c, &res);
+  if (status != 0)
+    return status;
+
+  if (res.status < 0) {
+    LCC_SET_ERRSTR(c, "Server error: %s", res.message);
+    return -1;
+  }
+
+  /* All lines are read even if the callback fails, so that the connection
+   * can still be used afterwards. */
+  for (int i = 0; i < res.status; i++) {
+    char buffer[4096];
+    char *ident_str;
+    double time;
+
+    if (fgets(buffer, sizeof(buffer), c->fh) == NULL) {
+      lcc_set_errno(c, errno);
+      return -1;
+    }
+    lcc_chomp(buffer);
+    lcc_tracef("receive: <-- %s\n", buffer);
+
+    if (cb_status != 0)
+      continue;
+
+    /* First field is the time, the second one the identifier. */
+    errno = 0;
+    time = strtod(buffer, &ident_str);
+    if ((errno != 0) || (ident_str == buffer) ||
+        ((*ident_str != ' ') && (*ident_str != '\t'))) {
+      lcc_set_errno(c, EILSEQ);
+      cb_status = -1;
+      continue;
+    }
+    while ((*ident_str == ' ') || (*ident_str == '\t'))
+      ident_str++;
+
+    cb_status = callback(c, time, ident_str, user_data);
+  }
+
+  return (cb_status != 0) ? -1 : 0;
+} /* }}} int lcc_listval_stream */
+
 const char *lcc_strerror(lcc_connection_t *c) /* {{{ */
 {
   if (c == NULL)
@@ -66,9 +66,71 @@ int lcc_getval(lcc_connection_t *c, lcc_identifier_t *ident,
 
 int lcc_putval(lcc_connection_t *c, const lcc_value_list_t *vl);
 
+/* Submits "vls_num" value lists with a single PUTVALS command, i.e. one round
+ * trip. If "ret_status" is not NULL, it must have room for "vls_num" entries
+ * and is set to zero for each value list the daemon accepted and -1 for each
+ * one it rejected. Returns zero if all value lists were accepted. */
+int lcc_putval_multi(lcc_connection_t *c, const lcc_value_list_t *vls,
+                     size_t vls_num, int *ret_status);
+
+/* Queries the values of "idents_num" identifiers with a single GETVALS
+ * command. For each identifier, "ret_values_num[i]" and "ret_values[i]" are
+ * set to the number of values and a newly allocated array of them, which the
+ * caller has to free, or zero and NULL if there is no such value. If
+ * "ret_status" is not NULL, it is set to zero or -1 for each identifier.
+ * Returns zero if all identifiers were found. */
+int lcc_getval_multi(lcc_connection_t *c, lcc_identifier_t *idents,
+                     size_t idents_num, size_t *ret_values_num,
+                     gauge_t **ret_values, int *ret_status);
+
+/*
+ * Pipelining
+ *
+ * Commands sent with lcc_pipeline_send() don't wait for their response. They
+ * are buffered and written together when the buffer is full or on
+ * lcc_pipeline_flush(). The responses are read in order by
+ * lcc_pipeline_wait(), which invokes each command's callback. "status" is
+ * negative if the command failed and zero otherwise; "lines" holds the lines
+ * following the status line, e.g. the values of a GETVAL command, and is only
+ * valid during the callback. A status of -1 with no lines is also reported if
+ * the connection failed, for this and all other pending commands.
+ *
+ * At most "window" commands are outstanding (LCC_PIPELINE_WINDOW_DEFAULT if
+ * zero). When it is reached, responses are read before the next command is
+ * sent, so that the daemon is not blocked writing responses. The daemon
+ * writes every response on its own, and each takes far more socket buffer
+ * space than its length, so large windows can deadlock. The non-pipelined
+ * functions read all pending responses first.
+ */
+#define LCC_PIPELINE_WINDOW_DEFAULT 128
+
+typedef void (*lcc_pipeline_callback_t)(lcc_connection_t *c, int status,
+                                        const char *message, char **lines,
+                                        size_t lines_num, void *user_data);
+
+int lcc_pipeline_send(lcc_connection_t *c, const char *command,
+                      lcc_pipeline_callback_t callback, void *user_data);
+int lcc_pipeline_putval(lcc_connection_t *c, const lcc_value_list_t *vl,
+                        lcc_pipeline_callback_t callback, void *user_data);
+int lcc_pipeline_flush(lcc_connection_t *c);
+int lcc_pipeline_wait(lcc_connection_t *c);
+size_t lcc_pipeline_pending(lcc_connection_t *c);
+int lcc_pipeline_set_window(lcc_connection_t *c, size_t window);
+
 int lcc_flush(lcc_connection_t *c, const char *plugin, lcc_identifier_t *ident,
               int timeout);
 
+/* Lists the identifiers in the daemon's cache which match the shell glob
+ * "pattern", or all identifiers if it is NULL. "callback" is invoked for each
+ * identifier as it is read, so the list is never held in memory; "ident" is
+ * only valid during the callback. If the callback returns non-zero, it is not
+ * invoked again, the rest of the list is discarded and -1 is returned. */
+typedef int (*lcc_listval_callback_t)(lcc_connection_t *c, double time,
+                                      const char *ident, void *user_data);
+
+int lcc_listval_stream(lcc_connection_t *c, const char *pattern,
+                       lcc_listval_callback_t callback, void *user_data);
+
 int lcc_listval(lcc_connection_t *c, lcc_identifier_t **ret_ident,
                 size_t *ret_ident_num);
 
@@ -68,6 +68,11 @@ int lcc_server_set_security_level(lcc_server_t *srv, lcc_security_level_t level,
  * Send data
  */
 int lcc_network_values_send(lcc_network_t *net, const lcc_value_list_t *vl);
+/* Sends "vls_num" value lists, together with those queued by
+ * lcc_network_values_send(), before returning. The value lists are encoded into
+ * preallocated buffers which are sent with as few system calls as possible. */
+int lcc_network_values_send_batch(lcc_network_t *net,
+                                  const lcc_value_list_t *vls, size_t vls_num);
 #if 0
 int lcc_network_notification_send (lcc_network_t *net,
     const lcc_notification_t *notif);
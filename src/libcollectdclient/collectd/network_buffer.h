@@ -53,4 +53,9 @@ int lcc_network_buffer_add_value(lcc_network_buffer_t *nb,
 int lcc_network_buffer_get(lcc_network_buffer_t *nb, void *buffer,
                            size_t *buffer_size);
 
+/* Like lcc_network_buffer_get(), but returns a pointer to the internal buffer
+ * instead of copying it. The pointer is valid until the buffer is modified. */
+int lcc_network_buffer_peek(lcc_network_buffer_t *nb, void const **ret_buffer,
+                            size_t *ret_buffer_size);
+
 #endif /* LIBCOLLECTDCLIENT_NETWORK_BUFFER_H */
@@ -0,0 +1,79 @@
+/**
+ * collectd - src/libcollectdclient/collectd/shm.h
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef LIBCOLLECTD_SHM_H
+#define LIBCOLLECTD_SHM_H 1
+
+#include "collectd/lcc_features.h"
+
+#include "collectd/shm_format.h"
+#include "collectd/types.h"
+
+LCC_BEGIN_DECLS
+
+/* lcc_shm_t is a read-only mapping of the value cache exported by the daemon,
+ * see the "CacheExportFile" option in collectd.conf(5). Reading doesn't
+ * involve the daemon at all: no socket round trip and no lock of the daemon
+ * is taken, so series can be read at memory speed. */
+struct lcc_shm_s;
+typedef struct lcc_shm_s lcc_shm_t;
+
+/* lcc_shm_series_t is a consistent copy of one series. */
+typedef struct {
+  lcc_identifier_t identifier;
+  double time;
+  double interval;
+  size_t values_len;
+  int values_types[LCC_SHM_VALUES_MAX];
+  value_t values[LCC_SHM_VALUES_MAX];
+  double rates[LCC_SHM_VALUES_MAX];
+} lcc_shm_series_t;
+
+/* lcc_shm_series_callback_t is called by lcc_shm_foreach() for each series.
+ * Returning non-zero stops the iteration. */
+typedef int (*lcc_shm_series_callback_t)(lcc_shm_series_t const *series,
+                                         void *user_data);
+
+/* lcc_shm_open maps the segment at "path" read-only. Returns zero on success
+ * and an errno value otherwise, EPROTO if the file isn't a segment of a
+ * compatible version. */
+int lcc_shm_open(lcc_shm_t **ret_shm, char const *path);
+
+/* lcc_shm_close unmaps the segment. */
+void lcc_shm_close(lcc_shm_t *shm);
+
+/* lcc_shm_active returns non-zero while the daemon which created the segment
+ * is running. When a daemon restarts, it creates a new segment at the same
+ * path, so readers should open it again once this returns zero. */
+int lcc_shm_active(lcc_shm_t *shm);
+
+/* lcc_shm_foreach calls "callback" for each series in the segment. Series
+ * which are being updated concurrently are read again, so each copy is
+ * consistent, but series updated after they have been visited are not.
+ * Returns zero on success or the callback's non-zero return value. */
+int lcc_shm_foreach(lcc_shm_t *shm, lcc_shm_series_callback_t callback,
+                    void *user_data);
+
+LCC_END_DECLS
+
+#endif /* LIBCOLLECTD_SHM_H */
@@ -0,0 +1,78 @@
+/**
+ * collectd - src/libcollectdclient/collectd/shm_format.h
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef LIBCOLLECTD_SHM_FORMAT_H
+#define LIBCOLLECTD_SHM_FORMAT_H 1
+
+#include <stdint.h>
+
+/* Layout of the shared memory segment to which the daemon exports its value
+ * cache, see the "CacheExportFile" option. This header is shared by the
+ * daemon and libcollectdclient and must not depend on either.
+ *
+ * The segment starts with an lcc_shm_header_t, followed by "slots_num" slots
+ * of "slot_size" bytes each. Every series in the cache occupies one slot.
+ * Each slot is protected by a sequence lock: the writer increments "seq" to
+ * an odd number before and to an even number after changing the slot, so a
+ * reader knows its copy is consistent if it read the same even "seq" before
+ * and after copying the slot. All fields are in host byte order. */
+#define LCC_SHM_MAGIC UINT64_C(0x31464d4853444343) /* "CCDSHMF1" */
+#define LCC_SHM_VERSION 1
+
+#define LCC_SHM_NAME_LEN 256
+#define LCC_SHM_VALUES_MAX 8
+
+typedef struct {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t slot_size;
+  uint64_t slots_num;
+  /* One more than the highest slot index used so far. Readers don't need to
+   * look at slots beyond it. */
+  uint64_t slots_used;
+  /* Time the daemon created the segment, in cdtime_t units (2^-30 s). */
+  uint64_t created;
+  /* Set to zero when the daemon shuts down. */
+  uint32_t active;
+  uint32_t reserved[5];
+} lcc_shm_header_t;
+
+typedef struct {
+  uint64_t seq;
+  /* Time and interval of the last value, in cdtime_t units. */
+  uint64_t time;
+  uint64_t interval;
+  /* Zero if the slot is unused. */
+  uint32_t values_num;
+  uint32_t reserved;
+  /* Data source types: 0 counter, 1 gauge, 2 derive, 3 absolute. */
+  uint8_t types[LCC_SHM_VALUES_MAX];
+  /* The raw values, i.e. the bits of the daemon's value_t. */
+  uint64_t values[LCC_SHM_VALUES_MAX];
+  /* Rates as returned by the daemon's uc_get_rate(). */
+  double rates[LCC_SHM_VALUES_MAX];
+  /* Identifier "host/plugin[-instance]/type[-instance]", null terminated. */
+  char name[LCC_SHM_NAME_LEN];
+} lcc_shm_slot_t;
+
+#endif /* LIBCOLLECTD_SHM_FORMAT_H */
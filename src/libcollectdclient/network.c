@@ -26,6 +26,8 @@
  *   Max Henkel <henkel at gmx.at>
  **/
 
+#define _GNU_SOURCE /* For sendmmsg(2) */
+
 #include "collectd.h"
 
 #include <assert.h>
@@ -50,6 +52,10 @@
 #include "collectd/network.h"
 #include "collectd/network_buffer.h"
 
+/* Number of buffers filled by lcc_network_values_send_batch() before they are
+ * sent with a single system call. */
+#define SERVER_BATCH_SIZE 64
+
 /*
  * Private data types
  */
@@ -72,6 +78,11 @@ struct lcc_server_s {
 
   lcc_network_buffer_t *buffer;
 
+  /* Allocated by the first call of lcc_network_values_send_batch(). The first
+   * element is "buffer", so that values queued by lcc_network_values_send()
+   * are sent first. */
+  lcc_network_buffer_t **batch;
+
   lcc_server_t *next;
 };
 
@@ -106,6 +117,13 @@ static void int_server_destroy(lcc_server_t *srv) /* {{{ */
 
   next = srv->next;
 
+  if (srv->batch != NULL) {
+    for (size_t i = 1; i < SERVER_BATCH_SIZE; i++)
+      lcc_network_buffer_destroy(srv->batch[i]);
+    free(srv->batch);
+  }
+  lcc_network_buffer_destroy(srv->buffer);
+
   free(srv->node);
   free(srv->service);
   free(srv->username);
@@ -142,7 +160,11 @@ static int server_open_socket(lcc_server_t *srv) /* {{{ */
     if (srv->fd < 0)
       continue;
 
-    if (ai_ptr->ai_family == AF_INET) {
+    /* Keep the system's default unless a TTL has been set. */
+    status = 0;
+    if (srv->ttl < 1) {
+      /* nothing to do */
+    } else if (ai_ptr->ai_family == AF_INET) {
       struct sockaddr_in *addr = (struct sockaddr_in *)ai_ptr->ai_addr;
       int optname;
 
@@ -193,49 +215,92 @@ static int server_open_socket(lcc_server_t *srv) /* {{{ */
   return 0;
 } /* }}} int server_open_socket */
 
-static int server_send_buffer(lcc_server_t *srv) /* {{{ */
-{
-  char buffer[LCC_NETWORK_BUFFER_SIZE_DEFAULT] = {0};
-  size_t buffer_size;
+/* Finalizes and sends the buffers "nbs" and initializes them again. The
+ * datagrams are sent directly from the buffers. */
+static int server_send_buffers(lcc_server_t *srv, /* {{{ */
+                               lcc_network_buffer_t **nbs, size_t nbs_num) {
+  void const *buffers[SERVER_BATCH_SIZE];
+  size_t buffers_len[SERVER_BATCH_SIZE];
+  size_t num = 0;
   int status;
 
+  assert(nbs_num <= SERVER_BATCH_SIZE);
+
   if (srv->fd < 0) {
     status = server_open_socket(srv);
-    if (status != 0)
+    if (status != 0) {
+      for (size_t i = 0; i < nbs_num; i++)
+        lcc_network_buffer_initialize(nbs[i]);
       return status;
+    }
   }
 
-  buffer_size = sizeof(buffer);
-
-  status = lcc_network_buffer_finalize(srv->buffer);
-  if (status != 0) {
-    lcc_network_buffer_initialize(srv->buffer);
-    return status;
+  for (size_t i = 0; i < nbs_num; i++) {
+    status = lcc_network_buffer_finalize(nbs[i]);
+    if (status == 0)
+      status = lcc_network_buffer_peek(nbs[i], buffers + num, buffers_len + num);
+    if (status != 0) {
+      lcc_network_buffer_initialize(nbs[i]);
+      continue;
+    }
+    num++;
   }
 
-  status = lcc_network_buffer_get(srv->buffer, buffer, &buffer_size);
-  lcc_network_buffer_initialize(srv->buffer);
-
-  if (status != 0)
-    return status;
-
-  if (buffer_size > sizeof(buffer))
-    buffer_size = sizeof(buffer);
+  assert(srv->fd >= 0);
+  assert(srv->sa != NULL);
+  status = 0;
+#if HAVE_SENDMMSG
+  struct mmsghdr msgs[SERVER_BATCH_SIZE];
+  struct iovec iovs[SERVER_BATCH_SIZE];
+  size_t sent = 0;
+
+  memset(msgs, 0, sizeof(msgs[0]) * num);
+  for (size_t i = 0; i < num; i++) {
+    iovs[i].iov_base = (void *)buffers[i];
+    iovs[i].iov_len = buffers_len[i];
+    msgs[i].msg_hdr.msg_iov = iovs + i;
+    msgs[i].msg_hdr.msg_iovlen = 1;
+    msgs[i].msg_hdr.msg_name = srv->sa;
+    msgs[i].msg_hdr.msg_namelen = srv->sa_len;
+  }
 
-  while (42) {
-    assert(srv->fd >= 0);
-    assert(srv->sa != NULL);
-    status = (int)sendto(srv->fd, buffer, buffer_size, /* flags = */ 0, srv->sa,
-                         srv->sa_len);
-    if ((status < 0) && ((errno == EINTR) || (errno == EAGAIN)))
+  while (sent < num) {
+    int n = sendmmsg(srv->fd, msgs + sent, (unsigned int)(num - sent),
+                     /* flags = */ 0);
+    if ((n < 0) && ((errno == EINTR) || (errno == EAGAIN)))
       continue;
-
-    break;
+    if (n < 0) {
+      status = n;
+      break;
+    }
+    sent += (size_t)n;
   }
+#else
+  for (size_t i = 0; i < num; i++) {
+    while (42) {
+      status = (int)sendto(srv->fd, buffers[i], buffers_len[i],
+                           /* flags = */ 0, srv->sa, srv->sa_len);
+      if ((status < 0) && ((errno == EINTR) || (errno == EAGAIN)))
+        continue;
+
+      break;
+    }
+    if (status < 0)
+      break;
+  }
+#endif
+
+  for (size_t i = 0; i < nbs_num; i++)
+    lcc_network_buffer_initialize(nbs[i]);
 
   if (status < 0)
     return status;
   return 0;
+} /* }}} int server_send_buffers */
+
+static int server_send_buffer(lcc_server_t *srv) /* {{{ */
+{
+  return server_send_buffers(srv, &srv->buffer, 1);
 } /* }}} int server_send_buffer */
 
 static int server_value_add(lcc_server_t *srv, /* {{{ */
@@ -250,6 +315,58 @@ static int server_value_add(lcc_server_t *srv, /* {{{ */
   return lcc_network_buffer_add_value(srv->buffer, vl);
 } /* }}} int server_value_add */
 
+static int server_batch_create(lcc_server_t *srv) /* {{{ */
+{
+  srv->batch = calloc(SERVER_BATCH_SIZE, sizeof(*srv->batch));
+  if (srv->batch == NULL)
+    return ENOMEM;
+
+  srv->batch[0] = srv->buffer;
+  for (size_t i = 1; i < SERVER_BATCH_SIZE; i++) {
+    int status = ENOMEM;
+
+    srv->batch[i] = lcc_network_buffer_create(/* size = */ 0);
+    if (srv->batch[i] != NULL)
+      status = lcc_network_buffer_set_security_level(
+          srv->batch[i], srv->security_level, srv->username, srv->password);
+
+    if (status != 0) {
+      for (size_t j = 1; j <= i; j++)
+        lcc_network_buffer_destroy(srv->batch[j]);
+      free(srv->batch);
+      srv->batch = NULL;
+      return status;
+    }
+  }
+
+  return 0;
+} /* }}} int server_batch_create */
+
+static int server_values_add_batch(lcc_server_t *srv, /* {{{ */
+                                   const lcc_value_list_t *vls,
+                                   size_t vls_num) {
+  size_t cur = 0;
+
+  if ((srv->batch == NULL) && (server_batch_create(srv) != 0))
+    return ENOMEM;
+
+  for (size_t i = 0; i < vls_num; i++) {
+    if (lcc_network_buffer_add_value(srv->batch[cur], vls + i) == 0)
+      continue;
+
+    cur++;
+    if (cur == SERVER_BATCH_SIZE) {
+      server_send_buffers(srv, srv->batch, cur);
+      cur = 0;
+    }
+
+    /* Fails only if the value list does not fit into an empty buffer. */
+    lcc_network_buffer_add_value(srv->batch[cur], vls + i);
+  }
+
+  return server_send_buffers(srv, srv->batch, cur + 1);
+} /* }}} int server_values_add_batch */
+
 /*
  * Public functions
  */
@@ -432,8 +549,41 @@ int lcc_server_set_interface(lcc_server_t *srv, char const *interface) /* {{{ */
 int lcc_server_set_security_level(lcc_server_t *srv, /* {{{ */
                                   lcc_security_level_t level,
                                   const char *username, const char *password) {
-  return lcc_network_buffer_set_security_level(srv->buffer, level, username,
-                                               password);
+  int status;
+
+  status = lcc_network_buffer_set_security_level(srv->buffer, level, username,
+                                                 password);
+  if (status != 0)
+    return status;
+
+  char *username_copy = NULL;
+  char *password_copy = NULL;
+  if (level != NONE) {
+    username_copy = strdup(username);
+    password_copy = strdup(password);
+    if ((username_copy == NULL) || (password_copy == NULL)) {
+      free(username_copy);
+      free(password_copy);
+      return ENOMEM;
+    }
+  }
+
+  free(srv->username);
+  free(srv->password);
+  srv->security_level = level;
+  srv->username = username_copy;
+  srv->password = password_copy;
+
+  if (srv->batch != NULL) {
+    for (size_t i = 1; i < SERVER_BATCH_SIZE; i++) {
+      status = lcc_network_buffer_set_security_level(srv->batch[i], level,
+                                                     username, password);
+      if (status != 0)
+        return status;
+    }
+  }
+
+  return 0;
 } /* }}} int lcc_server_set_security_level */
 
 int lcc_network_values_send(lcc_network_t *net, /* {{{ */
@@ -446,3 +596,14 @@ int lcc_network_values_send(lcc_network_t *net, /* {{{ */
 
   return 0;
 } /* }}} int lcc_network_values_send */
+
+int lcc_network_values_send_batch(lcc_network_t *net, /* {{{ */
+                                  const lcc_value_list_t *vls, size_t vls_num) {
+  if ((net == NULL) || ((vls == NULL) && (vls_num > 0)))
+    return EINVAL;
+
+  for (lcc_server_t *srv = net->servers; srv != NULL; srv = srv->next)
+    server_values_add_batch(srv, vls, vls_num);
+
+  return 0;
+} /* }}} int lcc_network_values_send_batch */
@@ -107,6 +107,7 @@ struct lcc_network_buffer_s {
   char *password;
 
 #if HAVE_GCRYPT_H
+  gcry_md_hd_t sign_md;
   gcry_cipher_hd_t encr_cypher;
   size_t encr_header_len;
   char encr_iv[16];
@@ -140,7 +141,7 @@ static _Bool have_gcrypt(void) /* {{{ */
   if (!gcry_check_version(GCRYPT_VERSION))
     return 0;
 
-  if (!gcry_control(GCRYCTL_INIT_SECMEM, 32768, 0))
+  if (gcry_control(GCRYCTL_INIT_SECMEM, 32768, 0))
     return 0;
 
   gcry_control(GCRYCTL_INITIALIZATION_FINISHED, 0);
@@ -420,60 +421,69 @@ static int nb_add_value_list(lcc_network_buffer_t *nb, /* {{{ */
   ident_src = &vl->identifier;
   ident_dst = &nb->state.identifier;
 
-  if (strcmp(ident_dst->host, ident_src->host) != 0) {
-    if (nb_add_string(&buffer, &buffer_size, TYPE_HOST, ident_src->host,
-                      strlen(ident_src->host)) != 0)
-      return -1;
-    SSTRNCPY(ident_dst->host, ident_src->host, sizeof(ident_dst->host));
-  }
+  /* The state is only updated once the value list has been added completely,
+   * so that it still describes the buffer's content if this fails. */
+  _Bool host_changed = (strcmp(ident_dst->host, ident_src->host) != 0);
+  _Bool plugin_changed = (strcmp(ident_dst->plugin, ident_src->plugin) != 0);
+  _Bool plugin_instance_changed =
+      (strcmp(ident_dst->plugin_instance, ident_src->plugin_instance) != 0);
+  _Bool type_changed = (strcmp(ident_dst->type, ident_src->type) != 0);
+  _Bool type_instance_changed =
+      (strcmp(ident_dst->type_instance, ident_src->type_instance) != 0);
+
+  if (host_changed && (nb_add_string(&buffer, &buffer_size, TYPE_HOST,
+                                     ident_src->host,
+                                     strlen(ident_src->host)) != 0))
+    return -1;
 
-  if (strcmp(ident_dst->plugin, ident_src->plugin) != 0) {
-    if (nb_add_string(&buffer, &buffer_size, TYPE_PLUGIN, ident_src->plugin,
-                      strlen(ident_src->plugin)) != 0)
-      return -1;
-    SSTRNCPY(ident_dst->plugin, ident_src->plugin, sizeof(ident_dst->plugin));
-  }
+  if (plugin_changed && (nb_add_string(&buffer, &buffer_size, TYPE_PLUGIN,
+                                       ident_src->plugin,
+                                       strlen(ident_src->plugin)) != 0))
+    return -1;
 
-  if (strcmp(ident_dst->plugin_instance, ident_src->plugin_instance) != 0) {
-    if (nb_add_string(&buffer, &buffer_size, TYPE_PLUGIN_INSTANCE,
-                      ident_src->plugin_instance,
-                      strlen(ident_src->plugin_instance)) != 0)
-      return -1;
-    SSTRNCPY(ident_dst->plugin_instance, ident_src->plugin_instance,
-             sizeof(ident_dst->plugin_instance));
-  }
+  if (plugin_instance_changed &&
+      (nb_add_string(&buffer, &buffer_size, TYPE_PLUGIN_INSTANCE,
+                     ident_src->plugin_instance,
+                     strlen(ident_src->plugin_instance)) != 0))
+    return -1;
 
-  if (strcmp(ident_dst->type, ident_src->type) != 0) {
-    if (nb_add_string(&buffer, &buffer_size, TYPE_TYPE, ident_src->type,
-                      strlen(ident_src->type)) != 0)
-      return -1;
-    SSTRNCPY(ident_dst->type, ident_src->type, sizeof(ident_dst->type));
-  }
+  if (type_changed &&
+      (nb_add_string(&buffer, &buffer_size, TYPE_TYPE, ident_src->type,
+                     strlen(ident_src->type)) != 0))
+    return -1;
 
-  if (strcmp(ident_dst->type_instance, ident_src->type_instance) != 0) {
-    if (nb_add_string(&buffer, &buffer_size, TYPE_TYPE_INSTANCE,
-                      ident_src->type_instance,
-                      strlen(ident_src->type_instance)) != 0)
-      return -1;
-    SSTRNCPY(ident_dst->type_instance, ident_src->type_instance,
-             sizeof(ident_dst->type_instance));
-  }
+  if (type_instance_changed &&
+      (nb_add_string(&buffer, &buffer_size, TYPE_TYPE_INSTANCE,
+                     ident_src->type_instance,
+                     strlen(ident_src->type_instance)) != 0))
+    return -1;
 
-  if (nb->state.time != vl->time) {
-    if (nb_add_time(&buffer, &buffer_size, TYPE_TIME_HR, vl->time))
-      return -1;
-    nb->state.time = vl->time;
-  }
+  if ((nb->state.time != vl->time) &&
+      nb_add_time(&buffer, &buffer_size, TYPE_TIME_HR, vl->time))
+    return -1;
 
-  if (nb->state.interval != vl->interval) {
-    if (nb_add_time(&buffer, &buffer_size, TYPE_INTERVAL_HR, vl->interval))
-      return -1;
-    nb->state.interval = vl->interval;
-  }
+  if ((nb->state.interval != vl->interval) &&
+      nb_add_time(&buffer, &buffer_size, TYPE_INTERVAL_HR, vl->interval))
+    return -1;
 
   if (nb_add_values(&buffer, &buffer_size, vl) != 0)
     return -1;
 
+  if (host_changed)
+    SSTRNCPY(ident_dst->host, ident_src->host, sizeof(ident_dst->host));
+  if (plugin_changed)
+    SSTRNCPY(ident_dst->plugin, ident_src->plugin, sizeof(ident_dst->plugin));
+  if (plugin_instance_changed)
+    SSTRNCPY(ident_dst->plugin_instance, ident_src->plugin_instance,
+             sizeof(ident_dst->plugin_instance));
+  if (type_changed)
+    SSTRNCPY(ident_dst->type, ident_src->type, sizeof(ident_dst->type));
+  if (type_instance_changed)
+    SSTRNCPY(ident_dst->type_instance, ident_src->type_instance,
+             sizeof(ident_dst->type_instance));
+  nb->state.time = vl->time;
+  nb->state.interval = vl->interval;
+
   nb->ptr = buffer;
   nb->free = buffer_size;
   return 0;
@@ -498,29 +508,38 @@ static int nb_add_signature(lcc_network_buffer_t *nb) /* {{{ */
   assert(nb->size >= (nb->free + PART_SIGNATURE_SHA256_SIZE));
   buffer_size = nb->size - (nb->free + PART_SIGNATURE_SHA256_SIZE);
 
-  hd = NULL;
-  err = gcry_md_open(&hd, GCRY_MD_SHA256, GCRY_MD_FLAG_HMAC);
-  if (err != 0)
-    return -1;
+  /* The keyed handle is kept with the buffer. Resetting it restores the state
+   * after gcry_md_setkey(), so the key is only set once. */
+  if (nb->sign_md == NULL) {
+    err = gcry_md_open(&nb->sign_md, GCRY_MD_SHA256, GCRY_MD_FLAG_HMAC);
+    if (err != 0) {
+      nb->sign_md = NULL;
+      return -1;
+    }
 
-  assert(nb->password != NULL);
-  err = gcry_md_setkey(hd, nb->password, strlen(nb->password));
-  if (err != 0) {
-    gcry_md_close(hd);
-    return -1;
+    assert(nb->password != NULL);
+    err = gcry_md_setkey(nb->sign_md, nb->password, strlen(nb->password));
+    if (err != 0) {
+      gcry_md_close(nb->sign_md);
+      nb->sign_md = NULL;
+      return -1;
+    }
+  } else {
+    gcry_md_reset(nb->sign_md);
   }
+  hd = nb->sign_md;
 
   gcry_md_write(hd, buffer, buffer_size);
   hash = gcry_md_read(hd, GCRY_MD_SHA256);
   if (hash == NULL) {
-    gcry_md_close(hd);
+    gcry_md_close(nb->sign_md);
+    nb->sign_md = NULL;
     return -1;
   }
 
   assert(((2 * sizeof(uint16_t)) + hash_length) == PART_SIGNATURE_SHA256_SIZE);
   memcpy(nb->buffer + (2 * sizeof(uint16_t)), hash, hash_length);
 
-  gcry_md_close(hd);
   return 0;
 } /* }}} int nb_add_signature */
 
@@ -542,8 +561,8 @@ static int nb_add_encryption(lcc_network_buffer_t *nb) /* {{{ */
   pkg_length = htons((uint16_t)package_length);
   memcpy(nb->buffer + 2, &pkg_length, sizeof(pkg_length));
 
-  /* Calculate what to hash */
-  hash_ptr = nb->buffer + PART_ENCRYPTION_AES256_SIZE;
+  /* Calculate what to hash. The header includes the username. */
+  hash_ptr = nb->buffer + nb->encr_header_len;
   hash_size = package_length - nb->encr_header_len;
 
   /* Calculate what to encrypt */
@@ -599,6 +618,21 @@ static int nb_add_encryption(lcc_network_buffer_t *nb) /* {{{ */
 } /* }}} int nb_add_encryption */
 #endif
 
+/* Closes the handles derived from the password. */
+static void nb_close_handles(lcc_network_buffer_t *nb) /* {{{ */
+{
+#if HAVE_GCRYPT_H
+  if (nb->sign_md != NULL)
+    gcry_md_close(nb->sign_md);
+  nb->sign_md = NULL;
+  if (nb->encr_cypher != NULL)
+    gcry_cipher_close(nb->encr_cypher);
+  nb->encr_cypher = NULL;
+#else
+  (void)nb;
+#endif
+} /* }}} void nb_close_handles */
+
 /*
  * Public functions
  */
@@ -640,6 +674,9 @@ void lcc_network_buffer_destroy(lcc_network_buffer_t *nb) /* {{{ */
   if (nb == NULL)
     return;
 
+  nb_close_handles(nb);
+  free(nb->username);
+  free(nb->password);
   free(nb->buffer);
   free(nb);
 } /* }}} void lcc_network_buffer_destroy */
@@ -651,6 +688,8 @@ int lcc_network_buffer_set_security_level(lcc_network_buffer_t *nb, /* {{{ */
   char *username_copy;
   char *password_copy;
 
+  nb_close_handles(nb);
+
   if (level == NONE) {
     free(nb->username);
     free(nb->password);
@@ -687,7 +726,8 @@ int lcc_network_buffer_initialize(lcc_network_buffer_t *nb) /* {{{ */
   if (nb == NULL)
     return EINVAL;
 
-  memset(nb->buffer, 0, nb->size);
+  /* Only the part written since the last initialization needs clearing. */
+  memset(nb->buffer, 0, nb->size - nb->free);
   memset(&nb->state, 0, sizeof(nb->state));
   nb->ptr = nb->buffer;
   nb->free = nb->size;
@@ -783,3 +823,15 @@ int lcc_network_buffer_get(lcc_network_buffer_t *nb, /* {{{ */
 
   return 0;
 } /* }}} int lcc_network_buffer_get */
+
+int lcc_network_buffer_peek(lcc_network_buffer_t *nb, /* {{{ */
+                            void const **ret_buffer, size_t *ret_buffer_size) {
+  if ((nb == NULL) || (ret_buffer == NULL) || (ret_buffer_size == NULL))
+    return EINVAL;
+
+  assert(nb->size >= nb->free);
+  *ret_buffer = nb->buffer;
+  *ret_buffer_size = nb->size - nb->free;
+
+  return 0;
+} /* }}} int lcc_network_buffer_peek */
@@ -68,6 +68,10 @@ __attribute__((const)) static uint64_t be64toh(uint64_t n) {
 #include <gcrypt.h>
 #endif
 
+#if HAVE_LZ4_H
+#include <lz4.h>
+#endif
+
 #include <stdio.h>
 #define DEBUG(...) printf(__VA_ARGS__)
 
@@ -80,7 +84,8 @@ GCRY_THREAD_OPTION_PTHREAD_IMPL;
 /* forward declaration because parse_sign_sha256()/parse_encrypt_aes256() and
  * network_parse() need to call each other. */
 static int network_parse(void *data, size_t data_size, lcc_security_level_t sl,
-                         lcc_network_parse_options_t const *opts);
+                         lcc_network_parse_options_t const *opts,
+                         _Bool compressed);
 
 #if HAVE_GCRYPT_H
 static int init_gcrypt() {
@@ -150,8 +155,37 @@ static int buffer_uint16(buffer_t *b, uint16_t *out) {
 #define TYPE_VALUES 0x0006
 #define TYPE_INTERVAL 0x0007
 #define TYPE_INTERVAL_HR 0x0009
+#define TYPE_VALUES_VARINT 0x000a
+#define TYPE_VALUES_DELTA 0x000b
+#define TYPE_TIME_DELTA 0x000c
 #define TYPE_SIGN_SHA256 0x0200
 #define TYPE_ENCR_AES256 0x0210
+#define TYPE_ENCR_AES256_GCM 0x0220
+#define TYPE_COMPRESS_LZ4 0x0300
+
+/* Reads a variable length integer: seven bits per byte, least significant
+ * group first, the high bit set on all but the last byte. */
+static int buffer_varint(buffer_t *b, uint64_t *out) {
+  uint64_t v = 0;
+
+  for (unsigned int shift = 0; shift < 64; shift += 7) {
+    uint8_t byte;
+    if (buffer_next(b, &byte, sizeof(byte)))
+      return -1;
+
+    v |= ((uint64_t)(byte & 0x7f)) << shift;
+    if ((byte & 0x80) == 0) {
+      *out = v;
+      return 0;
+    }
+  }
+
+  return -1;
+}
+
+static int64_t zigzag_decode(uint64_t u) {
+  return (int64_t)((u >> 1) ^ (0 - (u & 1)));
+}
 
 static int parse_int(void *payload, size_t payload_size, uint64_t *out) {
   uint64_t tmp;
@@ -209,6 +243,20 @@ static int parse_identifier(uint16_t type, void *payload, size_t payload_size,
 static int parse_time(uint16_t type, void *payload, size_t payload_size,
                       lcc_value_list_t *state) {
   uint64_t tmp = 0;
+
+  if (type == TYPE_TIME_DELTA) {
+    buffer_t *b = &(buffer_t){
+        .data = payload, .len = payload_size,
+    };
+
+    /* Relative to the previous time of the packet. */
+    if ((state->time == 0) || buffer_varint(b, &tmp) || (b->len != 0))
+      return EINVAL;
+
+    state->time += ((double)zigzag_decode(tmp)) / 1073741824.0;
+    return 0;
+  }
+
   if (parse_int(payload, payload_size, &tmp))
     return EINVAL;
 
@@ -363,6 +411,88 @@ static int parse_values(void *payload, size_t payload_size,
   return 0;
 }
 
+/* Parses a TYPE_VALUES_VARINT or TYPE_VALUES_DELTA part. Integer values are
+ * variable length integers; derives, and all values of a delta part, are
+ * zigzag encoded. Delta parts are relative to "base", the values of the
+ * previous values part of the packet. */
+static int parse_values_varint(uint16_t type, void *payload,
+                               size_t payload_size, lcc_value_list_t *state,
+                               lcc_value_list_t const *base) {
+  buffer_t *b = &(buffer_t){
+      .data = payload, .len = payload_size,
+  };
+
+  uint16_t n;
+  if (buffer_uint16(b, &n) || ((size_t)n > b->len))
+    return EINVAL;
+
+  _Bool delta = (type == TYPE_VALUES_DELTA);
+  if (delta && ((base->values == NULL) || (base->values_len != (size_t)n)))
+    return EINVAL;
+
+  state->values_len = (size_t)n;
+  state->values = calloc(sizeof(*state->values), state->values_len);
+  state->values_types = calloc(sizeof(*state->values_types), state->values_len);
+  if ((state->values == NULL) || (state->values_types == NULL)) {
+    return ENOMEM;
+  }
+
+  for (uint16_t i = 0; i < n; i++) {
+    uint8_t tmp;
+    if (buffer_next(b, &tmp, sizeof(tmp)))
+      return EINVAL;
+    state->values_types[i] = (int)tmp;
+    if (delta && (base->values_types[i] != state->values_types[i]))
+      return EINVAL;
+  }
+
+  for (uint16_t i = 0; i < n; i++) {
+    uint64_t tmp;
+
+    if (state->values_types[i] == LCC_TYPE_GAUGE) {
+      union {
+        uint64_t i;
+        double d;
+      } conv;
+      if (buffer_next(b, &conv.i, sizeof(conv.i)))
+        return EINVAL;
+      state->values[i].gauge = ntohd(conv.d);
+      continue;
+    }
+
+    if (buffer_varint(b, &tmp))
+      return EINVAL;
+
+    switch (state->values_types[i]) {
+    case LCC_TYPE_COUNTER:
+      if (delta)
+        tmp = (uint64_t)base->values[i].counter + (uint64_t)zigzag_decode(tmp);
+      state->values[i].counter = (counter_t)tmp;
+      break;
+    case LCC_TYPE_DERIVE:
+      if (delta)
+        tmp = (uint64_t)base->values[i].derive + (uint64_t)zigzag_decode(tmp);
+      else
+        tmp = (uint64_t)zigzag_decode(tmp);
+      state->values[i].derive = (derive_t)tmp;
+      break;
+    case LCC_TYPE_ABSOLUTE:
+      if (delta)
+        tmp =
+            (uint64_t)base->values[i].absolute + (uint64_t)zigzag_decode(tmp);
+      state->values[i].absolute = (absolute_t)tmp;
+      break;
+    default:
+      return EINVAL;
+    }
+  }
+
+  if (b->len != 0)
+    return EINVAL;
+
+  return 0;
+}
+
 #if HAVE_GCRYPT_H
 static int verify_sha256(void *payload, size_t payload_size,
                          char const *username, char const *password,
@@ -410,7 +540,7 @@ static int parse_sign_sha256(void *signature, size_t signature_len,
   if (opts->password_lookup == NULL) {
     /* The sender signed the packet but we can't verify it. Handle it as if it
      * were unsigned, i.e. security level NONE. */
-    return network_parse(payload, payload_size, NONE, opts);
+    return network_parse(payload, payload_size, NONE, opts, 0);
   }
 
   buffer_t *b = &(buffer_t){
@@ -429,13 +559,13 @@ static int parse_sign_sha256(void *signature, size_t signature_len,
 
   char const *password = opts->password_lookup(username);
   if (!password)
-    return network_parse(payload, payload_size, NONE, opts);
+    return network_parse(payload, payload_size, NONE, opts, 0);
 
   int status = verify_sha256(payload, payload_size, username, password, hash);
   if (status != 0)
     return status;
 
-  return network_parse(payload, payload_size, SIGN, opts);
+  return network_parse(payload, payload_size, SIGN, opts, 0);
 }
 
 #if HAVE_GCRYPT_H
@@ -509,7 +639,7 @@ static int parse_encrypt_aes256(void *data, size_t data_size,
     return -1;
   }
 
-  return network_parse(b->data, b->len, ENCRYPT, opts);
+  return network_parse(b->data, b->len, ENCRYPT, opts, 0);
 }
 #else /* !HAVE_GCRYPT_H */
 static int parse_encrypt_aes256(void *data, size_t data_size,
@@ -518,8 +648,115 @@ static int parse_encrypt_aes256(void *data, size_t data_size,
 }
 #endif
 
-static int network_parse(void *data, size_t data_size, lcc_security_level_t sl,
-                         lcc_network_parse_options_t const *opts) {
+#if HAVE_GCRYPT_H && GCRYPT_VERSION_NUMBER >= 0x010600
+/* The part header and username are authenticated additional data. Since
+ * "data" no longer includes the part header, it is reconstructed here. */
+static int parse_encrypt_aes256_gcm(void *data, size_t data_size,
+                                    lcc_network_parse_options_t const *opts) {
+  if (opts->password_lookup == NULL)
+    return ENOENT;
+
+  buffer_t *b = &(buffer_t){
+      .data = data, .len = data_size,
+  };
+
+  uint16_t username_len;
+  if (buffer_uint16(b, &username_len))
+    return EINVAL;
+  if ((username_len == 0) || ((size_t)username_len > b->len))
+    return EINVAL;
+  char username[((size_t)username_len) + 1];
+  memset(username, 0, sizeof(username));
+  if (buffer_next(b, username, (size_t)username_len))
+    return EINVAL;
+
+  char const *password = opts->password_lookup(username);
+  if (!password)
+    return ENOENT;
+
+  uint8_t iv[12];
+  uint8_t tag[16];
+  if (buffer_next(b, iv, sizeof(iv)) || buffer_next(b, tag, sizeof(tag)) ||
+      (b->len == 0))
+    return EINVAL;
+
+  size_t part_size = 4 + data_size;
+  uint8_t aad[6 + (size_t)username_len];
+  aad[0] = (uint8_t)(TYPE_ENCR_AES256_GCM >> 8);
+  aad[1] = (uint8_t)(TYPE_ENCR_AES256_GCM & 0xff);
+  aad[2] = (uint8_t)(part_size >> 8);
+  aad[3] = (uint8_t)(part_size & 0xff);
+  memcpy(aad + 4, data, 2 + (size_t)username_len);
+
+  uint8_t pwhash[32] = {0};
+  gcry_md_hash_buffer(GCRY_MD_SHA256, pwhash, password, strlen(password));
+
+  gcry_cipher_hd_t cipher = NULL;
+  if (gcry_cipher_open(&cipher, GCRY_CIPHER_AES256, GCRY_CIPHER_MODE_GCM,
+                       /* flags = */ 0))
+    return -1;
+
+  if (gcry_cipher_setkey(cipher, pwhash, sizeof(pwhash)) ||
+      gcry_cipher_setiv(cipher, iv, sizeof(iv)) ||
+      gcry_cipher_authenticate(cipher, aad, sizeof(aad)) ||
+      gcry_cipher_decrypt(cipher, b->data, b->len, /* in = */ NULL,
+                          /* in_size = */ 0) ||
+      gcry_cipher_checktag(cipher, tag, sizeof(tag))) {
+    gcry_cipher_close(cipher);
+    return -1;
+  }
+  gcry_cipher_close(cipher);
+
+  return network_parse(b->data, b->len, ENCRYPT, opts, 0);
+}
+#else /* !HAVE_GCRYPT_H || GCRYPT_VERSION_NUMBER < 0x010600 */
+static int parse_encrypt_aes256_gcm(void *data, size_t data_size,
+                                    lcc_network_parse_options_t const *opts) {
+  return ENOTSUP;
+}
+#endif
+
+#if HAVE_LZ4_H
+static int parse_compress_lz4(void *data, size_t data_size,
+                              lcc_security_level_t sl,
+                              lcc_network_parse_options_t const *opts) {
+  buffer_t *b = &(buffer_t){
+      .data = data, .len = data_size,
+  };
+
+  uint16_t uncompressed_size;
+  if (buffer_uint16(b, &uncompressed_size) || (b->len == 0))
+    return EINVAL;
+
+  char *uncompressed = malloc(uncompressed_size);
+  if (uncompressed == NULL)
+    return ENOMEM;
+
+  int status = LZ4_decompress_safe((char *)b->data, uncompressed, (int)b->len,
+                                   (int)uncompressed_size);
+  if (status != (int)uncompressed_size) {
+    free(uncompressed);
+    return EINVAL;
+  }
+
+  status = network_parse(uncompressed, uncompressed_size, sl, opts, 1);
+  free(uncompressed);
+  return status;
+}
+#else /* !HAVE_LZ4_H */
+static int parse_compress_lz4(void *data, size_t data_size,
+                              lcc_security_level_t sl,
+                              lcc_network_parse_options_t const *opts) {
+  return ENOTSUP;
+}
+#endif
+
+/* Parses the parts of a packet. "base" holds the values of the previous
+ * values part for TYPE_VALUES_DELTA parts. */
+static int network_parse_parts(void *data, size_t data_size,
+                               lcc_security_level_t sl,
+                               lcc_network_parse_options_t const *opts,
+                               _Bool compressed, lcc_value_list_t *base) {
   buffer_t *b = &(buffer_t){
       .data = data, .len = data_size,
   };
@@ -541,6 +778,17 @@ static int network_parse(void *data, size_t data_size, lcc_security_level_t sl,
     }
     sz -= 4;
 
+    /* Compressed parts only contain data, never security or other compressed
+     * parts. */
+    if (compressed &&
+        ((type == TYPE_SIGN_SHA256) || (type == TYPE_ENCR_AES256) ||
+         (type == TYPE_ENCR_AES256_GCM) || (type == TYPE_COMPRESS_LZ4))) {
+      DEBUG("lcc_network_parse(): type %" PRIu16
+            " is not allowed inside of a compressed part\n",
+            type);
+      return EINVAL;
+    }
+
     uint8_t payload[sz];
     if (buffer_next(b, payload, sizeof(payload)))
       return EINVAL;
@@ -561,7 +809,8 @@ static int network_parse(void *data, size_t data_size, lcc_security_level_t sl,
     case TYPE_INTERVAL:
     case TYPE_INTERVAL_HR:
     case TYPE_TIME:
-    case TYPE_TIME_HR: {
+    case TYPE_TIME_HR:
+    case TYPE_TIME_DELTA: {
       if (parse_time(type, payload, sizeof(payload), &state)) {
         DEBUG("lcc_network_parse(): parse_time failed.\n");
         return EINVAL;
@@ -569,23 +818,31 @@ static int network_parse(void *data, size_t data_size, lcc_security_level_t sl,
       break;
     }
 
-    case TYPE_VALUES: {
+    case TYPE_VALUES:
+    case TYPE_VALUES_VARINT:
+    case TYPE_VALUES_DELTA: {
       lcc_value_list_t vl = state;
-      if (parse_values(payload, sizeof(payload), &vl)) {
+      int status = (type == TYPE_VALUES)
+                       ? parse_values(payload, sizeof(payload), &vl)
+                       : parse_values_varint(type, payload, sizeof(payload),
+                                             &vl, base);
+      if (status != 0) {
         free(vl.values);
         free(vl.values_types);
         DEBUG("lcc_network_parse(): parse_values failed.\n");
         return EINVAL;
       }
 
-      int status = 0;
-
       /* Write metrics if they have the required security level. */
       if (sl >= opts->security_level)
         status = opts->writer(&vl);
 
-      free(vl.values);
-      free(vl.values_types);
+      /* Keep the values as the base of the next part. */
+      free(base->values);
+      free(base->values_types);
+      base->values = vl.values;
+      base->values_types = vl.values_types;
+      base->values_len = vl.values_len;
 
       if (status != 0)
         return status;
@@ -614,6 +871,25 @@ static int network_parse(void *data, size_t data_size, lcc_security_level_t sl,
       break;
     }
 
+    case TYPE_ENCR_AES256_GCM: {
+      int status = parse_encrypt_aes256_gcm(payload, sizeof(payload), opts);
+      if (status != 0) {
+        DEBUG("lcc_network_parse(): parse_encrypt_aes256_gcm() = %d\n",
+              status);
+        return -1;
+      }
+      break;
+    }
+
+    case TYPE_COMPRESS_LZ4: {
+      int status = parse_compress_lz4(payload, sizeof(payload), sl, opts);
+      if (status != 0) {
+        DEBUG("lcc_network_parse(): parse_compress_lz4() = %d\n", status);
+        return status;
+      }
+      break;
+    }
+
     default: {
       DEBUG("lcc_network_parse(): ignoring unknown type %" PRIu16 "\n", type);
       return EINVAL;
@@ -624,6 +900,19 @@ static int network_parse(void *data, size_t data_size, lcc_security_level_t sl,
   return 0;
 }
 
+static int network_parse(void *data, size_t data_size, lcc_security_level_t sl,
+                         lcc_network_parse_options_t const *opts,
+                         _Bool compressed) {
+  lcc_value_list_t base = {0};
+
+  int status =
+      network_parse_parts(data, data_size, sl, opts, compressed, &base);
+
+  free(base.values);
+  free(base.values_types);
+  return status;
+}
+
 int lcc_network_parse(void *data, size_t data_size,
                       lcc_network_parse_options_t opts) {
   if (opts.password_lookup) {
@@ -637,5 +926,5 @@ int lcc_network_parse(void *data, size_t data_size,
 #endif
   }
 
-  return network_parse(data, data_size, NONE, &opts);
+  return network_parse(data, data_size, NONE, &opts, 0);
 }
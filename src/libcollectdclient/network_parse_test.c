@@ -486,6 +486,246 @@ static int test_decrypt_aes256() {
 }
 #endif
 
+static lcc_value_list_t compact_got[2];
+static int compact_got_num;
+
+static int compact_writer(lcc_value_list_t const *vl) {
+  if ((compact_got_num >= 2) || (vl->values_len != 2))
+    return EINVAL;
+
+  lcc_value_list_t *dst = compact_got + compact_got_num;
+  *dst = *vl;
+  dst->values = calloc(vl->values_len, sizeof(*dst->values));
+  memmove(dst->values, vl->values, vl->values_len * sizeof(*dst->values));
+  dst->values_types = NULL;
+  compact_got_num++;
+  return 0;
+}
+
+static int test_parse_compact() {
+  char const *packet_str =
+      "0000000668000002000670000004000674000008000c000000fa00000000" /* id */
+      "000a000b00020202d80403"   /* values_varint: 300, -2 */
+      "000c00098080808004"       /* time_delta: +0.5s */
+      "000b000a000202020201";    /* values_delta: +1, -1 */
+  uint8_t packet[128];
+  size_t packet_size = sizeof(packet);
+  if (decode_string(packet_str, packet, &packet_size)) {
+    fprintf(stderr, "test_parse_compact: decode_string failed.\n");
+    return -1;
+  }
+
+  compact_got_num = 0;
+  int status = lcc_network_parse(packet, packet_size,
+                                 (lcc_network_parse_options_t){
+                                     .writer = compact_writer,
+                                 });
+
+  int ret = 0;
+  if ((status != 0) || (compact_got_num != 2)) {
+    fprintf(stderr, "lcc_network_parse(compact) = %d with %d value lists, "
+                    "want 0 with 2 value lists\n",
+            status, compact_got_num);
+    ret = -1;
+  } else if ((compact_got[0].time != 1000.0) ||
+             (compact_got[0].values[0].derive != 300) ||
+             (compact_got[0].values[1].derive != (derive_t)-2) ||
+             (compact_got[1].time != 1000.5) ||
+             (compact_got[1].values[0].derive != 301) ||
+             (compact_got[1].values[1].derive != (derive_t)-3)) {
+    fprintf(stderr, "lcc_network_parse(compact) decoded wrong values\n");
+    ret = -1;
+  } else {
+    printf("ok - lcc_network_parse(compact)\n");
+  }
+
+  for (int i = 0; i < compact_got_num; i++)
+    free(compact_got[i].values);
+
+  /* A delta part needs a previous values part. */
+  char const *orphan_str = "0000000668000002000670000004000674000008000c000000"
+                           "fa00000000000b000a000202020201";
+  packet_size = sizeof(packet);
+  if (decode_string(orphan_str, packet, &packet_size))
+    return -1;
+
+  compact_got_num = 0;
+  status = lcc_network_parse(packet, packet_size,
+                             (lcc_network_parse_options_t){
+                                 .writer = compact_writer,
+                             });
+  if ((status == 0) || (compact_got_num != 0)) {
+    fprintf(stderr, "lcc_network_parse(orphan delta) = %d, want non-zero\n",
+            status);
+    ret = -1;
+  }
+
+  return ret;
+}
+
+#if HAVE_GCRYPT_H && GCRYPT_VERSION_NUMBER >= 0x010600
+static char const *gcm_password_lookup(char const *username) {
+  return (strcmp(username, "alice") == 0) ? "s3cret" : NULL;
+}
+
+static int test_parse_encrypt_aes256_gcm() {
+  char const *plain_str =
+      "0000000668000002000670000004000674000008000c000000fa00000000"
+      "000a000b00020202d80403000c00098080808004000b000a000202020201";
+  uint8_t plain[128];
+  size_t plain_size = sizeof(plain);
+  if (decode_string(plain_str, plain, &plain_size))
+    return -1;
+
+  /* type, length, username length, "alice", IV, tag, ciphertext */
+  size_t header_size = 6 + 5 + 12 + 16;
+  size_t packet_size = header_size + plain_size;
+  uint8_t packet[header_size + plain_size];
+  packet[0] = 0x02;
+  packet[1] = 0x20;
+  packet[2] = (uint8_t)(packet_size >> 8);
+  packet[3] = (uint8_t)(packet_size & 0xff);
+  packet[4] = 0x00;
+  packet[5] = 0x05;
+  memmove(packet + 6, "alice", 5);
+  memset(packet + 11, 0x42, 12);
+
+  uint8_t pwhash[32];
+  gcry_md_hash_buffer(GCRY_MD_SHA256, pwhash, "s3cret", strlen("s3cret"));
+
+  gcry_cipher_hd_t cipher = NULL;
+  if (gcry_cipher_open(&cipher, GCRY_CIPHER_AES256, GCRY_CIPHER_MODE_GCM, 0) ||
+      gcry_cipher_setkey(cipher, pwhash, sizeof(pwhash)) ||
+      gcry_cipher_setiv(cipher, packet + 11, 12) ||
+      gcry_cipher_authenticate(cipher, packet, 11) ||
+      gcry_cipher_encrypt(cipher, packet + header_size, plain_size, plain,
+                          plain_size) ||
+      gcry_cipher_gettag(cipher, packet + 23, 16)) {
+    fprintf(stderr, "test_parse_encrypt_aes256_gcm: encryption failed.\n");
+    gcry_cipher_close(cipher);
+    return -1;
+  }
+  gcry_cipher_close(cipher);
+
+  lcc_network_parse_options_t opts = {
+      .writer = compact_writer,
+      .password_lookup = gcm_password_lookup,
+      .security_level = ENCRYPT,
+  };
+
+  int ret = 0;
+  compact_got_num = 0;
+  int status = lcc_network_parse(packet, packet_size, opts);
+  if ((status != 0) || (compact_got_num != 2) ||
+      (compact_got[1].values[0].derive != 301)) {
+    fprintf(stderr, "lcc_network_parse(AES-256-GCM) = %d with %d value "
+                    "lists, want 0 with 2 value lists\n",
+            status, compact_got_num);
+    ret = -1;
+  } else {
+    printf("ok - lcc_network_parse(AES-256-GCM)\n");
+  }
+  for (int i = 0; i < compact_got_num; i++)
+    free(compact_got[i].values);
+
+  /* Tampering with the packet length (authenticated, but not encrypted)
+   * must be detected. */
+  packet[3] ^= 0x01;
+  packet_size ^= 0x01;
+  compact_got_num = 0;
+  if (lcc_network_parse(packet, packet_size, opts) == 0) {
+    fprintf(stderr, "lcc_network_parse(tampered) = 0, want non-zero\n");
+    ret = -1;
+  }
+
+  return ret;
+}
+#endif
+
+#if HAVE_LZ4_H
+static int count_writer_num;
+
+static int count_writer(lcc_value_list_t const *vl) {
+  count_writer_num++;
+  return nop_writer(vl);
+}
+
+static int test_parse_compress_lz4() {
+  uint8_t raw[LCC_NETWORK_BUFFER_SIZE_DEFAULT];
+  size_t raw_size = sizeof(raw);
+  if (decode_string(raw_packet_data[0], raw, &raw_size)) {
+    fprintf(stderr, "test_parse_compress_lz4: decode_string failed.\n");
+    return -1;
+  }
+
+  lcc_network_parse_options_t opts = {
+      .writer = count_writer,
+  };
+
+  count_writer_num = 0;
+  if (lcc_network_parse(raw, raw_size, opts) != 0)
+    return -1;
+  int want = count_writer_num;
+
+  char packet[6 + LZ4_COMPRESSBOUND(LCC_NETWORK_BUFFER_SIZE_DEFAULT)];
+  int compressed_size =
+      LZ4_compress_default((char *)raw, packet + 6, (int)raw_size,
+                           (int)(sizeof(packet) - 6));
+  if (compressed_size <= 0) {
+    fprintf(stderr, "LZ4_compress_default() = %d\n", compressed_size);
+    return -1;
+  }
+  size_t packet_size = 6 + (size_t)compressed_size;
+
+  uint16_t tmp16 = htobe16(TYPE_COMPRESS_LZ4);
+  memmove(packet, &tmp16, sizeof(tmp16));
+  tmp16 = htobe16((uint16_t)packet_size);
+  memmove(packet + 2, &tmp16, sizeof(tmp16));
+  tmp16 = htobe16((uint16_t)raw_size);
+  memmove(packet + 4, &tmp16, sizeof(tmp16));
+
+  count_writer_num = 0;
+  int status = lcc_network_parse(packet, packet_size, opts);
+  if ((status != 0) || (count_writer_num != want)) {
+    fprintf(stderr,
+            "lcc_network_parse(compressed) = %d with %d value lists, "
+            "want 0 with %d value lists\n",
+            status, count_writer_num, want);
+    return -1;
+  }
+  printf("ok - lcc_network_parse(compressed raw_packet_data[0])\n");
+
+  /* A corrupt size must be rejected. */
+  tmp16 = htobe16((uint16_t)(raw_size + 1));
+  memmove(packet + 4, &tmp16, sizeof(tmp16));
+  if (lcc_network_parse(packet, packet_size, opts) == 0) {
+    fprintf(stderr, "lcc_network_parse(corrupt) = 0, want non-zero\n");
+    return -1;
+  }
+
+  /* Compressed parts cannot be nested. */
+  char nested[6 + LZ4_COMPRESSBOUND(sizeof(packet))];
+  tmp16 = htobe16((uint16_t)raw_size);
+  memmove(packet + 4, &tmp16, sizeof(tmp16));
+  compressed_size = LZ4_compress_default(
+      packet, nested + 6, (int)packet_size, (int)(sizeof(nested) - 6));
+  if (compressed_size <= 0)
+    return -1;
+  tmp16 = htobe16(TYPE_COMPRESS_LZ4);
+  memmove(nested, &tmp16, sizeof(tmp16));
+  tmp16 = htobe16((uint16_t)(6 + compressed_size));
+  memmove(nested + 2, &tmp16, sizeof(tmp16));
+  tmp16 = htobe16((uint16_t)packet_size);
+  memmove(nested + 4, &tmp16, sizeof(tmp16));
+  if (lcc_network_parse(nested, 6 + (size_t)compressed_size, opts) == 0) {
+    fprintf(stderr, "lcc_network_parse(nested) = 0, want non-zero\n");
+    return -1;
+  }
+
+  return 0;
+}
+#endif
+
 int main(void) {
   int ret = 0;
 
@@ -510,6 +750,21 @@ int main(void) {
   if ((status = test_decrypt_aes256())) {
     ret = status;
   }
+#if GCRYPT_VERSION_NUMBER >= 0x010600
+  if ((status = test_parse_encrypt_aes256_gcm())) {
+    ret = status;
+  }
+#endif
+#endif
+
+  if ((status = test_parse_compact())) {
+    ret = status;
+  }
+
+#if HAVE_LZ4_H
+  if ((status = test_parse_compress_lz4())) {
+    ret = status;
+  }
 #endif
 
   return ret;
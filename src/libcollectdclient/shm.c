@@ -0,0 +1,219 @@
+/**
+ * collectd - src/libcollectdclient/shm.c
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "config.h"
+
+#include "collectd/lcc_features.h"
+#include "collectd/shm.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Copies of slots which are being written are retried this many times before
+ * the series is skipped. */
+#define LCC_SHM_RETRIES 1000
+
+struct lcc_shm_s {
+  void *map;
+  size_t map_size;
+  lcc_shm_header_t const *header;
+};
+
+static lcc_shm_slot_t const *lcc_shm_slot(lcc_shm_t *shm, /* {{{ */
+                                          uint64_t index) {
+  char const *base = (char const *)shm->map + sizeof(lcc_shm_header_t);
+  return (lcc_shm_slot_t const *)(base + index * shm->header->slot_size);
+} /* }}} lcc_shm_slot_t *lcc_shm_slot */
+
+/* Copies "slot" to "copy". Returns zero if the copy is consistent, EAGAIN if
+ * the slot was changed meanwhile. */
+static int lcc_shm_copy(lcc_shm_slot_t const *slot, /* {{{ */
+                        lcc_shm_slot_t *copy) {
+  uint64_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+  if (seq & 1)
+    return EAGAIN;
+
+  /* The copy may be torn if the slot is changed meanwhile. This is detected
+   * by checking the sequence number again. */
+  memcpy(copy, slot, sizeof(*copy));
+
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != seq)
+    return EAGAIN;
+  return 0;
+} /* }}} int lcc_shm_copy */
+
+/* Copies "src", which may be NULL, to "dst", truncating it if necessary. */
+static void lcc_shm_strcpy(char *dst, char const *src, /* {{{ */
+                           size_t dst_size) {
+  size_t len = (src == NULL) ? 0 : strlen(src);
+  if (len >= dst_size)
+    len = dst_size - 1;
+  memcpy(dst, src, len);
+  dst[len] = 0;
+} /* }}} void lcc_shm_strcpy */
+
+/* Splits "host/plugin[-instance]/type[-instance]" into "ident". */
+static int lcc_shm_parse_name(char *name, /* {{{ */
+                              lcc_identifier_t *ident) {
+  char *plugin = strchr(name, '/');
+  if (plugin == NULL)
+    return EINVAL;
+  *(plugin++) = 0;
+
+  char *type = strchr(plugin, '/');
+  if (type == NULL)
+    return EINVAL;
+  *(type++) = 0;
+
+  char *plugin_instance = strchr(plugin, '-');
+  if (plugin_instance != NULL)
+    *(plugin_instance++) = 0;
+  char *type_instance = strchr(type, '-');
+  if (type_instance != NULL)
+    *(type_instance++) = 0;
+
+  memset(ident, 0, sizeof(*ident));
+  lcc_shm_strcpy(ident->host, name, sizeof(ident->host));
+  lcc_shm_strcpy(ident->plugin, plugin, sizeof(ident->plugin));
+  lcc_shm_strcpy(ident->plugin_instance, plugin_instance,
+                 sizeof(ident->plugin_instance));
+  lcc_shm_strcpy(ident->type, type, sizeof(ident->type));
+  lcc_shm_strcpy(ident->type_instance, type_instance,
+                 sizeof(ident->type_instance));
+  return 0;
+} /* }}} int lcc_shm_parse_name */
+
+int lcc_shm_open(lcc_shm_t **ret_shm, char const *path) /* {{{ */
+{
+  if ((ret_shm == NULL) || (path == NULL))
+    return EINVAL;
+
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return errno;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    int status = errno;
+    close(fd);
+    return status;
+  }
+  if ((size_t)st.st_size < sizeof(lcc_shm_header_t)) {
+    close(fd);
+    return EPROTO;
+  }
+
+  void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return errno;
+
+  lcc_shm_header_t const *header = map;
+  if ((header->magic != LCC_SHM_MAGIC) ||
+      (header->version != LCC_SHM_VERSION) ||
+      (header->slot_size < sizeof(lcc_shm_slot_t)) ||
+      (header->slots_num >
+       ((size_t)st.st_size - sizeof(*header)) / header->slot_size)) {
+    munmap(map, (size_t)st.st_size);
+    return EPROTO;
+  }
+
+  lcc_shm_t *shm = calloc(1, sizeof(*shm));
+  if (shm == NULL) {
+    munmap(map, (size_t)st.st_size);
+    return ENOMEM;
+  }
+  shm->map = map;
+  shm->map_size = (size_t)st.st_size;
+  shm->header = header;
+
+  *ret_shm = shm;
+  return 0;
+} /* }}} int lcc_shm_open */
+
+void lcc_shm_close(lcc_shm_t *shm) /* {{{ */
+{
+  if (shm == NULL)
+    return;
+
+  munmap(shm->map, shm->map_size);
+  free(shm);
+} /* }}} void lcc_shm_close */
+
+int lcc_shm_active(lcc_shm_t *shm) /* {{{ */
+{
+  if (shm == NULL)
+    return 0;
+  return __atomic_load_n(&shm->header->active, __ATOMIC_ACQUIRE) != 0;
+} /* }}} int lcc_shm_active */
+
+int lcc_shm_foreach(lcc_shm_t *shm, /* {{{ */
+                    lcc_shm_series_callback_t callback, void *user_data) {
+  if ((shm == NULL) || (callback == NULL))
+    return EINVAL;
+
+  uint64_t slots_used =
+      __atomic_load_n(&shm->header->slots_used, __ATOMIC_ACQUIRE);
+  if (slots_used > shm->header->slots_num)
+    slots_used = shm->header->slots_num;
+
+  for (uint64_t i = 0; i < slots_used; i++) {
+    lcc_shm_slot_t copy;
+    int status = EAGAIN;
+
+    for (int retry = 0; (retry < LCC_SHM_RETRIES) && (status == EAGAIN);
+         retry++)
+      status = lcc_shm_copy(lcc_shm_slot(shm, i), &copy);
+    if ((status != 0) || (copy.values_num == 0) ||
+        (copy.values_num > LCC_SHM_VALUES_MAX))
+      continue;
+
+    lcc_shm_series_t series = {
+        .time = ((double)copy.time) / 1073741824.0,
+        .interval = ((double)copy.interval) / 1073741824.0,
+        .values_len = copy.values_num,
+    };
+
+    copy.name[sizeof(copy.name) - 1] = 0;
+    if (lcc_shm_parse_name(copy.name, &series.identifier) != 0)
+      continue;
+
+    for (size_t j = 0; j < copy.values_num; j++) {
+      series.values_types[j] = (int)copy.types[j];
+      memcpy(&series.values[j], &copy.values[j], sizeof(series.values[j]));
+      series.rates[j] = copy.rates[j];
+    }
+
+    status = (*callback)(&series, user_data);
+    if (status != 0)
+      return status;
+  }
+
+  return 0;
+} /* }}} int lcc_shm_foreach */
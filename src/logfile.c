@@ -43,8 +43,30 @@ static char *log_file = NULL;
 static int print_timestamp = 1;
 static int print_severity = 0;
 
-static const char *config_keys[] = {"LogLevel", "File", "Timestamp",
-                                    "PrintSeverity"};
+/* Buffered mode, see "BufferSize". Lines are appended to `buffer' and
+ * written by a background thread, so that logging threads never wait for the
+ * disk. The thread swaps `buffer' and `buffer_spare' and writes the latter
+ * without holding `buffer_lock'. */
+static size_t buffer_size = 0;
+static cdtime_t flush_interval = 0;
+
+static pthread_mutex_t buffer_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t buffer_cond = PTHREAD_COND_INITIALIZER;
+static char *buffer = NULL;
+static char *buffer_spare = NULL;
+static size_t buffer_fill = 0;
+static uint64_t buffer_dropped = 0;
+static _Bool buffer_reopen = 0;
+static _Bool buffer_quit = 0;
+static _Bool flush_thread_running = 0;
+static pthread_t flush_thread;
+
+/* Only used by the flush thread. */
+static int log_fd = -1;
+
+static const char *config_keys[] = {"LogLevel",      "File",
+                                    "Timestamp",     "PrintSeverity",
+                                    "BufferSize",    "FlushInterval"};
 static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 
 static int logfile_config(const char *key, const char *value) {
@@ -68,17 +90,33 @@ static int logfile_config(const char *key, const char *value) {
       print_severity = 0;
     else
       print_severity = 1;
+  } else if (0 == strcasecmp(key, "BufferSize")) {
+    char *endptr = NULL;
+    errno = 0;
+    unsigned long long size = strtoull(value, &endptr, 0);
+    if ((errno != 0) || (endptr == value) || (*endptr != 0) ||
+        ((size > 0) && (size < 4096))) {
+      ERROR("logfile: invalid BufferSize [%s]", value);
+      return 1;
+    }
+    buffer_size = (size_t)size;
+  } else if (0 == strcasecmp(key, "FlushInterval")) {
+    double interval = atof(value);
+    if (!(interval > 0.0)) {
+      ERROR("logfile: invalid FlushInterval [%s]", value);
+      return 1;
+    }
+    flush_interval = DOUBLE_TO_CDTIME_T(interval);
   } else {
     return -1;
   }
   return 0;
 } /* int logfile_config (const char *, const char *) */
 
-static void logfile_print(const char *msg, int severity,
-                          cdtime_t timestamp_time) {
-  FILE *fh;
-  _Bool do_close = 0;
-  char timestamp_str[64];
+/* Formats the timestamp and severity which precede each message. */
+static void logfile_prefix(char *prefix, size_t prefix_size, /* {{{ */
+                           int severity, cdtime_t timestamp_time) {
+  char timestamp_str[64] = "";
   char level_str[16] = "";
 
   if (print_severity) {
@@ -110,8 +148,148 @@ static void logfile_print(const char *msg, int severity,
     strftime(timestamp_str, sizeof(timestamp_str), "%Y-%m-%d %H:%M:%S",
              &timestamp_tm);
     timestamp_str[sizeof(timestamp_str) - 1] = '\0';
+
+    snprintf(prefix, prefix_size, "[%s] %s", timestamp_str, level_str);
+  } else {
+    snprintf(prefix, prefix_size, "%s", level_str);
+  }
+} /* }}} void logfile_prefix */
+
+/* Returns the descriptor of the log file, opening it if necessary. The file
+ * is reopened if it has been moved or removed, e.g. by logrotate(8). */
+static int logfile_fd(_Bool reopen) /* {{{ */
+{
+  if ((log_file == NULL) || (strcasecmp(log_file, "stderr") == 0))
+    return STDERR_FILENO;
+  else if (strcasecmp(log_file, "stdout") == 0)
+    return STDOUT_FILENO;
+
+  if ((log_fd >= 0) && !reopen) {
+    struct stat st_path;
+    struct stat st_fd;
+
+    if ((stat(log_file, &st_path) == 0) && (fstat(log_fd, &st_fd) == 0) &&
+        (st_path.st_dev == st_fd.st_dev) && (st_path.st_ino == st_fd.st_ino))
+      return log_fd;
+  }
+
+  if (log_fd >= 0) {
+    close(log_fd);
+    log_fd = -1;
+  }
+
+  log_fd = open(log_file, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0666);
+  if (log_fd < 0)
+    fprintf(stderr, "logfile plugin: open (%s) failed: %s\n", log_file,
+            STRERRNO);
+  return log_fd;
+} /* }}} int logfile_fd */
+
+static void logfile_write(const char *data, size_t len, /* {{{ */
+                          uint64_t dropped, _Bool reopen) {
+  char dropped_msg[256];
+
+  if ((len == 0) && (dropped == 0))
+    return;
+
+  int fd = logfile_fd(reopen);
+  if (fd < 0)
+    return;
+
+  while (len > 0) {
+    ssize_t status = write(fd, data, len);
+    if (status < 0) {
+      if (errno == EINTR)
+        continue;
+      fprintf(stderr, "logfile plugin: write (%s) failed: %s\n",
+              (log_file != NULL) ? log_file : "stderr", STRERRNO);
+      break;
+    }
+    data += status;
+    len -= (size_t)status;
+  }
+
+  if (dropped > 0) {
+    char prefix[128];
+    logfile_prefix(prefix, sizeof(prefix), LOG_WARNING, cdtime());
+    int status = snprintf(dropped_msg, sizeof(dropped_msg),
+                          "%slogfile plugin: The buffer was full, %" PRIu64
+                          " message%s have been dropped.\n",
+                          prefix, dropped, (dropped == 1) ? "" : "s");
+    if ((status > 0) && ((size_t)status < sizeof(dropped_msg)) &&
+        (write(fd, dropped_msg, (size_t)status) < 0))
+      fprintf(stderr, "logfile plugin: write failed: %s\n", STRERRNO);
+  }
+} /* }}} void logfile_write */
+
+static void *logfile_flush_thread(void __attribute__((unused)) * arg) /* {{{ */
+{
+  pthread_mutex_lock(&buffer_lock);
+  while (42) {
+    if (!buffer_quit && !buffer_reopen && (buffer_fill < buffer_size / 2)) {
+      struct timespec ts = CDTIME_T_TO_TIMESPEC(cdtime() + flush_interval);
+      pthread_cond_timedwait(&buffer_cond, &buffer_lock, &ts);
+    }
+
+    char *data = buffer;
+    size_t len = buffer_fill;
+    uint64_t dropped = buffer_dropped;
+    _Bool reopen = buffer_reopen;
+    _Bool quit = buffer_quit;
+
+    buffer = buffer_spare;
+    buffer_spare = data;
+    buffer_fill = 0;
+    buffer_dropped = 0;
+    buffer_reopen = 0;
+    pthread_mutex_unlock(&buffer_lock);
+
+    logfile_write(data, len, dropped, reopen);
+
+    pthread_mutex_lock(&buffer_lock);
+    if (quit)
+      break;
+  }
+  pthread_mutex_unlock(&buffer_lock);
+
+  return NULL;
+} /* }}} void *logfile_flush_thread */
+
+/* Appends a line to the buffer. Returns non-zero if buffered mode is not
+ * active. */
+static int logfile_buffer_print(const char *prefix, const char *msg) /* {{{ */
+{
+  pthread_mutex_lock(&buffer_lock);
+  if (!flush_thread_running) {
+    pthread_mutex_unlock(&buffer_lock);
+    return -1;
   }
 
+  size_t avail = buffer_size - buffer_fill;
+  int status = snprintf(buffer + buffer_fill, avail, "%s%s\n", prefix, msg);
+  if ((status < 0) || ((size_t)status >= avail))
+    buffer_dropped++;
+  else
+    buffer_fill += (size_t)status;
+
+  if ((buffer_fill >= buffer_size / 2) || (buffer_dropped > 0))
+    pthread_cond_signal(&buffer_cond);
+  pthread_mutex_unlock(&buffer_lock);
+
+  return 0;
+} /* }}} int logfile_buffer_print */
+
+static void logfile_print(const char *msg, int severity,
+                          cdtime_t timestamp_time) {
+  FILE *fh;
+  _Bool do_close = 0;
+  char prefix[128];
+
+  logfile_prefix(prefix, sizeof(prefix), severity, timestamp_time);
+
+  if (logfile_buffer_print(prefix, msg) == 0)
+    return;
+
   pthread_mutex_lock(&file_lock);
 
   if (log_file == NULL) {
@@ -129,10 +307,7 @@ static void logfile_print(const char *msg, int severity,
     fprintf(stderr, "logfile plugin: fopen (%s) failed: %s\n", log_file,
             STRERRNO);
   } else {
-    if (print_timestamp)
-      fprintf(fh, "[%s] %s%s\n", timestamp_str, level_str, msg);
-    else
-      fprintf(fh, "%s%s\n", level_str, msg);
+    fprintf(fh, "%s%s\n", prefix, msg);
 
     if (do_close) {
       fclose(fh);
@@ -196,10 +371,94 @@ static int logfile_notification(const notification_t *n,
   return 0;
 } /* int logfile_notification */
 
+static int logfile_flush(cdtime_t __attribute__((unused)) timeout, /* {{{ */
+                         const char __attribute__((unused)) * identifier,
+                         user_data_t __attribute__((unused)) * user_data) {
+  /* Also reopens the file, so sending SIGUSR1 after rotating the logs takes
+   * effect immediately. */
+  pthread_mutex_lock(&buffer_lock);
+  buffer_reopen = 1;
+  pthread_cond_signal(&buffer_cond);
+  pthread_mutex_unlock(&buffer_lock);
+
+  return 0;
+} /* }}} int logfile_flush */
+
+static int logfile_init(void) /* {{{ */
+{
+  if ((buffer_size == 0) || flush_thread_running)
+    return 0;
+
+  if (flush_interval == 0)
+    flush_interval = TIME_T_TO_CDTIME_T(1);
+
+  buffer = malloc(buffer_size);
+  buffer_spare = malloc(buffer_size);
+  if ((buffer == NULL) || (buffer_spare == NULL)) {
+    ERROR("logfile plugin: malloc failed.");
+    sfree(buffer);
+    sfree(buffer_spare);
+    return -1;
+  }
+
+  pthread_mutex_lock(&buffer_lock);
+  buffer_fill = 0;
+  buffer_quit = 0;
+  int status = plugin_thread_create(&flush_thread, /* attr = */ NULL,
+                                    logfile_flush_thread, /* arg = */ NULL,
+                                    "logfile flush");
+  if (status == 0)
+    flush_thread_running = 1;
+  pthread_mutex_unlock(&buffer_lock);
+
+  if (status != 0) {
+    ERROR("logfile plugin: Starting the flush thread failed.");
+    sfree(buffer);
+    sfree(buffer_spare);
+    return -1;
+  }
+
+  return 0;
+} /* }}} int logfile_init */
+
+static int logfile_shutdown(void) /* {{{ */
+{
+  pthread_mutex_lock(&buffer_lock);
+  if (!flush_thread_running) {
+    pthread_mutex_unlock(&buffer_lock);
+    return 0;
+  }
+  buffer_quit = 1;
+  pthread_cond_signal(&buffer_cond);
+  pthread_mutex_unlock(&buffer_lock);
+
+  pthread_join(flush_thread, NULL);
+
+  /* Messages logged from now on are written directly. */
+  pthread_mutex_lock(&buffer_lock);
+  flush_thread_running = 0;
+  logfile_write(buffer, buffer_fill, buffer_dropped, /* reopen = */ 0);
+  buffer_fill = 0;
+  buffer_dropped = 0;
+  sfree(buffer);
+  sfree(buffer_spare);
+  pthread_mutex_unlock(&buffer_lock);
+
+  if (log_fd >= 0) {
+    close(log_fd);
+    log_fd = -1;
+  }
+
+  return 0;
+} /* }}} int logfile_shutdown */
+
 void module_register(void) {
   plugin_register_config("logfile", logfile_config, config_keys,
                          config_keys_num);
+  plugin_register_init("logfile", logfile_init);
   plugin_register_log("logfile", logfile_log, /* user_data = */ NULL);
   plugin_register_notification("logfile", logfile_notification,
                                /* user_data = */ NULL);
+  plugin_register_flush("logfile", logfile_flush, /* user_data = */ NULL);
+  plugin_register_shutdown("logfile", logfile_shutdown);
 } /* void module_register (void) */
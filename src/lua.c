@@ -52,19 +52,44 @@
 typedef struct lua_script_s {
   char *script_path;
   lua_State *lua_state;
+  /* Serializes all callbacks running in `lua_state'. */
+  pthread_mutex_t lock;
   struct lua_script_s *next;
 } lua_script_t;
 
+#define CLUA_CB_READ 1
+#define CLUA_CB_WRITE 2
+#define CLUA_CB_WRITE_BATCH 3
+
+/* A callback function in one instance of a script. */
 typedef struct {
   lua_State *lua_state;
-  const char *lua_function_name;
-  pthread_mutex_t lock;
   int callback_id;
+  pthread_mutex_t *lock;
+} clua_instance_t;
+
+typedef struct {
+  char *lua_function_name;
+  int type;
+  clua_instance_t *instances;
+  size_t instances_num;
+  /* Where the search for an idle instance starts. */
+  size_t next_instance;
 } clua_callback_data_t;
 
 static char base_path[PATH_MAX];
+static size_t script_instances = 1;
 static lua_script_t *scripts;
 
+/* While the instances of a script are being loaded, the callbacks registered
+ * by the first instance, in order. The n-th callback registered by a later
+ * instance is added to the n-th callback of the first. */
+static _Bool script_loading;
+static clua_callback_data_t **load_callbacks;
+static size_t load_callbacks_num;
+static size_t load_instance;
+static size_t load_registered;
+
 static int clua_store_callback(lua_State *L, int idx) /* {{{ */
 {
   /* Copy the function pointer */
@@ -104,65 +129,87 @@ static int clua_store_thread(lua_State *L, int idx) /* {{{ */
   return 0;
 } /* }}} int clua_store_thread */
 
-static int clua_read(user_data_t *ud) /* {{{ */
+/* Lock an instance of the callback. An idle instance is preferred, so that
+ * callbacks of a script which has been loaded several times run in parallel. */
+static clua_instance_t *clua_acquire(clua_callback_data_t *cb) /* {{{ */
 {
-  clua_callback_data_t *cb = ud->data;
-
-  pthread_mutex_lock(&cb->lock);
-
-  lua_State *L = cb->lua_state;
-
-  int status = clua_load_callback(L, cb->callback_id);
-  if (status != 0) {
-    ERROR("Lua plugin: Unable to load callback \"%s\" (id %i).",
-          cb->lua_function_name, cb->callback_id);
-    pthread_mutex_unlock(&cb->lock);
-    return -1;
+  size_t start =
+      __atomic_fetch_add(&cb->next_instance, 1, __ATOMIC_RELAXED) %
+      cb->instances_num;
+
+  for (size_t i = 0; i < cb->instances_num; i++) {
+    clua_instance_t *inst = cb->instances + (start + i) % cb->instances_num;
+    if (pthread_mutex_trylock(inst->lock) == 0)
+      return inst;
   }
-  /* +1 = 1 */
 
-  status = lua_pcall(L, 0, 1, 0);
+  pthread_mutex_lock(cb->instances[start].lock);
+  return cb->instances + start;
+} /* }}} clua_instance_t *clua_acquire */
+
+/* Call the function pushed below its `nargs' arguments and return the status
+ * it returned. The stack is empty afterwards. */
+static int clua_call(clua_callback_data_t *cb, lua_State *L, /* {{{ */
+                     int nargs) {
+  int status = lua_pcall(L, nargs, 1, 0);
   if (status != 0) {
     const char *errmsg = lua_tostring(L, -1);
     if (errmsg == NULL)
-      ERROR("Lua plugin: Calling a read callback failed. "
-            "In addition, retrieving the error message failed.");
+      ERROR("Lua plugin: Calling callback \"%s\" failed. "
+            "In addition, retrieving the error message failed.",
+            cb->lua_function_name);
     else
-      ERROR("Lua plugin: Calling a read callback failed: %s", errmsg);
+      ERROR("Lua plugin: Calling callback \"%s\" failed:\n%s",
+            cb->lua_function_name, errmsg);
     lua_pop(L, 1);
-    pthread_mutex_unlock(&cb->lock);
     return -1;
   }
 
   if (!lua_isnumber(L, -1)) {
-    ERROR("Lua plugin: Read function \"%s\" (id %i) did not return a numeric "
-          "status.",
-          cb->lua_function_name, cb->callback_id);
+    ERROR("Lua plugin: Callback \"%s\" did not return a numeric status.",
+          cb->lua_function_name);
     status = -1;
   } else {
     status = (int)lua_tointeger(L, -1);
   }
 
-  /* pop return value and function */
-  lua_pop(L, 1); /* -1 = 0 */
+  /* pop return value */
+  lua_pop(L, 1);
+  return status;
+} /* }}} int clua_call */
+
+static int clua_read(user_data_t *ud) /* {{{ */
+{
+  clua_callback_data_t *cb = ud->data;
+  clua_instance_t *inst = clua_acquire(cb);
+  lua_State *L = inst->lua_state;
 
-  pthread_mutex_unlock(&cb->lock);
+  int status = clua_load_callback(L, inst->callback_id);
+  if (status != 0) {
+    ERROR("Lua plugin: Unable to load callback \"%s\" (id %i).",
+          cb->lua_function_name, inst->callback_id);
+    pthread_mutex_unlock(inst->lock);
+    return -1;
+  }
+  /* +1 = 1 */
+
+  status = clua_call(cb, L, 0);
+
+  pthread_mutex_unlock(inst->lock);
   return status;
 } /* }}} int clua_read */
 
 static int clua_write(const data_set_t *ds, const value_list_t *vl, /* {{{ */
                       user_data_t *ud) {
   clua_callback_data_t *cb = ud->data;
+  clua_instance_t *inst = clua_acquire(cb);
+  lua_State *L = inst->lua_state;
 
-  pthread_mutex_lock(&cb->lock);
-
-  lua_State *L = cb->lua_state;
-
-  int status = clua_load_callback(L, cb->callback_id);
+  int status = clua_load_callback(L, inst->callback_id);
   if (status != 0) {
     ERROR("Lua plugin: Unable to load callback \"%s\" (id %i).",
-          cb->lua_function_name, cb->callback_id);
-    pthread_mutex_unlock(&cb->lock);
+          cb->lua_function_name, inst->callback_id);
+    pthread_mutex_unlock(inst->lock);
     return -1;
   }
   /* +1 = 1 */
@@ -170,38 +217,63 @@ static int clua_write(const data_set_t *ds, const value_list_t *vl, /* {{{ */
   status = luaC_pushvaluelist(L, ds, vl);
   if (status != 0) {
     lua_pop(L, 1); /* -1 = 0 */
-    pthread_mutex_unlock(&cb->lock);
+    pthread_mutex_unlock(inst->lock);
     ERROR("Lua plugin: luaC_pushvaluelist failed.");
     return -1;
   }
   /* +1 = 2 */
 
-  status = lua_pcall(L, 1, 1, 0); /* -2+1 = 1 */
+  status = clua_call(cb, L, 1); /* -2 = 0 */
+
+  pthread_mutex_unlock(inst->lock);
+  return status;
+} /* }}} int clua_write */
+
+/* Calls the callback with one argument, an array of value lists. */
+static int clua_write_batch(const write_batch_entry_t *entries, /* {{{ */
+                            size_t entries_num, user_data_t *ud) {
+  clua_callback_data_t *cb = ud->data;
+  clua_instance_t *inst = clua_acquire(cb);
+  lua_State *L = inst->lua_state;
+
+  int status = clua_load_callback(L, inst->callback_id);
   if (status != 0) {
-    const char *errmsg = lua_tostring(L, -1);
-    if (errmsg == NULL)
-      ERROR("Lua plugin: Calling the write callback failed. "
-            "In addition, retrieving the error message failed.");
-    else
-      ERROR("Lua plugin: Calling the write callback failed:\n%s", errmsg);
-    lua_pop(L, 1); /* -1 = 0 */
-    pthread_mutex_unlock(&cb->lock);
+    ERROR("Lua plugin: Unable to load callback \"%s\" (id %i).",
+          cb->lua_function_name, inst->callback_id);
+    pthread_mutex_unlock(inst->lock);
     return -1;
   }
+  /* +1 = 1 */
 
-  if (!lua_isnumber(L, -1)) {
-    ERROR("Lua plugin: Write function \"%s\" (id %i) did not return a numeric "
-          "value.",
-          cb->lua_function_name, cb->callback_id);
-    status = -1;
-  } else {
-    status = (int)lua_tointeger(L, -1);
+  lua_createtable(L, (int)entries_num, 0); /* +1 = 2 */
+  for (size_t i = 0; i < entries_num; i++) {
+    status = luaC_pushvaluelist(L, entries[i].ds, entries[i].vl);
+    if (status != 0) {
+      lua_pop(L, 2); /* -2 = 0 */
+      pthread_mutex_unlock(inst->lock);
+      ERROR("Lua plugin: luaC_pushvaluelist failed.");
+      return -1;
+    }
+    lua_rawseti(L, -2, (int)(i + 1)); /* -1 = 2 */
   }
 
-  lua_pop(L, 1); /* -1 = 0 */
-  pthread_mutex_unlock(&cb->lock);
+  status = clua_call(cb, L, 1); /* -2 = 0 */
+
+  pthread_mutex_unlock(inst->lock);
   return status;
-} /* }}} int clua_write */
+} /* }}} int clua_write_batch */
+
+static void clua_callback_data_free(void *arg) /* {{{ */
+{
+  clua_callback_data_t *cb = arg;
+
+  if (cb == NULL)
+    return;
+
+  sfree(cb->lua_function_name);
+  sfree(cb->instances);
+  sfree(cb);
+} /* }}} void clua_callback_data_free */
 
 /*
  * Exported functions
@@ -272,17 +344,43 @@ static int lua_cb_dispatch_values(lua_State *L) /* {{{ */
   return 0;
 } /* }}} lua_cb_dispatch_values */
 
-static int lua_cb_register_read(lua_State *L) /* {{{ */
+static lua_script_t *clua_get_script(lua_State *L) /* {{{ */
 {
-  int nargs = lua_gettop(L);
-
-  if (nargs != 1)
-    return luaL_error(L, "Invalid number of arguments (%d != 1)", nargs);
-
-  luaL_checktype(L, 1, LUA_TFUNCTION);
+  lua_getfield(L, LUA_REGISTRYINDEX, "collectd_script");
+  lua_script_t *script = lua_touserdata(L, -1);
+  lua_pop(L, 1);
+  return script;
+} /* }}} lua_script_t *clua_get_script */
+
+static int clua_add_instance(clua_callback_data_t *cb, /* {{{ */
+                             lua_State *thread, int callback_id,
+                             lua_script_t *script) {
+  clua_instance_t *tmp =
+      realloc(cb->instances, (cb->instances_num + 1) * sizeof(*tmp));
+  if (tmp == NULL)
+    return ENOMEM;
+  cb->instances = tmp;
+
+  cb->instances[cb->instances_num] = (clua_instance_t){
+      .lua_state = thread, .callback_id = callback_id, .lock = &script->lock,
+  };
+  cb->instances_num++;
+  return 0;
+} /* }}} int clua_add_instance */
+
+/* Registers the function at index 1 as a callback of type `type'. Later
+ * instances of a script only add their copy of the function to the callback
+ * registered by the first instance. */
+static int clua_register_callback(lua_State *L, int type, /* {{{ */
+                                  size_t batch_size, cdtime_t linger) {
+  /* lua_tostring() returns NULL for functions, so the address of the function
+   * is used to tell callbacks apart. */
+  char function_name[DATA_MAX_NAME_LEN] = "";
+  snprintf(function_name, sizeof(function_name), "lua/%p", lua_topointer(L, 1));
 
-  char function_name[DATA_MAX_NAME_LEN];
-  snprintf(function_name, sizeof(function_name), "lua/%s", lua_tostring(L, 1));
+  lua_script_t *script = clua_get_script(L);
+  if (script == NULL)
+    return luaL_error(L, "%s", "Unable to determine the calling script");
 
   int callback_id = clua_store_callback(L, 1);
   if (callback_id < 0)
@@ -294,26 +392,76 @@ static int lua_cb_register_read(lua_State *L) /* {{{ */
   clua_store_thread(L, -1);
   lua_pop(L, 1);
 
+  if (script_loading && (load_instance > 0)) {
+    if ((load_registered >= load_callbacks_num) ||
+        (load_callbacks[load_registered]->type != type))
+      return luaL_error(L, "Instance %d of script \"%s\" registered other "
+                           "callbacks than the first instance",
+                        (int)load_instance + 1, script->script_path);
+
+    if (clua_add_instance(load_callbacks[load_registered], thread,
+                          callback_id, script) != 0)
+      return luaL_error(L, "%s", "realloc failed");
+    load_registered++;
+    return 0;
+  }
+
   clua_callback_data_t *cb = calloc(1, sizeof(*cb));
   if (cb == NULL)
     return luaL_error(L, "%s", "calloc failed");
 
-  cb->lua_state = thread;
-  cb->callback_id = callback_id;
+  cb->type = type;
   cb->lua_function_name = strdup(function_name);
-  pthread_mutex_init(&cb->lock, NULL);
-
-  int status = plugin_register_complex_read(/* group = */ "lua",
-                                            /* name      = */ function_name,
-                                            /* callback  = */ clua_read,
-                                            /* interval  = */ 0,
-                                            &(user_data_t){
-                                                .data = cb,
-                                            });
+  if ((cb->lua_function_name == NULL) ||
+      (clua_add_instance(cb, thread, callback_id, script) != 0)) {
+    clua_callback_data_free(cb);
+    return luaL_error(L, "%s", "Allocating memory failed");
+  }
 
+  user_data_t ud = {
+      .data = cb, .free_func = clua_callback_data_free,
+  };
+  int status;
+  if (type == CLUA_CB_READ)
+    status = plugin_register_complex_read(/* group = */ "lua",
+                                          /* name      = */ function_name,
+                                          /* callback  = */ clua_read,
+                                          /* interval  = */ 0, &ud);
+  else if (type == CLUA_CB_WRITE)
+    status = plugin_register_write(/* name = */ function_name,
+                                   /* callback  = */ clua_write, &ud);
+  else
+    status = plugin_register_write_batch(/* name = */ function_name,
+                                         /* callback  = */ clua_write_batch,
+                                         batch_size, linger, &ud);
   if (status != 0)
-    return luaL_error(L, "%s", "plugin_register_complex_read failed");
+    return luaL_error(L, "Registering callback \"%s\" failed", function_name);
+
+  /* Remember the callback so that later instances of the script can add their
+   * copies of the function to it. */
+  if (script_loading) {
+    clua_callback_data_t **tmp = realloc(
+        load_callbacks, (load_callbacks_num + 1) * sizeof(*load_callbacks));
+    if (tmp == NULL)
+      return luaL_error(L, "%s", "realloc failed");
+    load_callbacks = tmp;
+    load_callbacks[load_callbacks_num] = cb;
+    load_callbacks_num++;
+  }
+
   return 0;
+} /* }}} int clua_register_callback */
+
+static int lua_cb_register_read(lua_State *L) /* {{{ */
+{
+  int nargs = lua_gettop(L);
+
+  if (nargs != 1)
+    return luaL_error(L, "Invalid number of arguments (%d != 1)", nargs);
+
+  luaL_checktype(L, 1, LUA_TFUNCTION);
+
+  return clua_register_callback(L, CLUA_CB_READ, 0, 0);
 } /* }}} int lua_cb_register_read */
 
 static int lua_cb_register_write(lua_State *L) /* {{{ */
@@ -325,38 +473,36 @@ static int lua_cb_register_write(lua_State *L) /* {{{ */
 
   luaL_checktype(L, 1, LUA_TFUNCTION);
 
-  char function_name[DATA_MAX_NAME_LEN] = "";
-  snprintf(function_name, sizeof(function_name), "lua/%s", lua_tostring(L, 1));
+  return clua_register_callback(L, CLUA_CB_WRITE, 0, 0);
+} /* }}} int lua_cb_register_write */
 
-  int callback_id = clua_store_callback(L, 1);
-  if (callback_id < 0)
-    return luaL_error(L, "%s", "Storing callback function failed");
+/* collectd.register_write_batch(callback[, batch_size[, linger]]) */
+static int lua_cb_register_write_batch(lua_State *L) /* {{{ */
+{
+  int nargs = lua_gettop(L);
 
-  lua_State *thread = lua_newthread(L);
-  if (thread == NULL)
-    return luaL_error(L, "%s", "lua_newthread failed");
-  clua_store_thread(L, -1);
-  lua_pop(L, 1);
+  if ((nargs < 1) || (nargs > 3))
+    return luaL_error(L, "Invalid number of arguments (%d, expected 1-3)",
+                      nargs);
 
-  clua_callback_data_t *cb = calloc(1, sizeof(*cb));
-  if (cb == NULL)
-    return luaL_error(L, "%s", "calloc failed");
+  luaL_checktype(L, 1, LUA_TFUNCTION);
 
-  cb->lua_state = thread;
-  cb->callback_id = callback_id;
-  cb->lua_function_name = strdup(function_name);
-  pthread_mutex_init(&cb->lock, NULL);
+  lua_Integer batch_size = 1000;
+  if (nargs >= 2)
+    batch_size = luaL_checkinteger(L, 2);
+  if (batch_size < 1)
+    return luaL_error(L, "Invalid batch size (%d)", (int)batch_size);
 
-  int status = plugin_register_write(/* name = */ function_name,
-                                     /* callback  = */ clua_write,
-                                     &(user_data_t){
-                                         .data = cb,
-                                     });
+  lua_Number linger = 1.0;
+  if (nargs >= 3)
+    linger = luaL_checknumber(L, 3);
+  if (linger < 0.0)
+    return luaL_error(L, "%s", "The linger time must not be negative");
 
-  if (status != 0)
-    return luaL_error(L, "%s", "plugin_register_write failed");
-  return 0;
-} /* }}} int lua_cb_register_write */
+  lua_settop(L, 1);
+  return clua_register_callback(L, CLUA_CB_WRITE_BATCH, (size_t)batch_size,
+                                DOUBLE_TO_CDTIME_T(linger));
+} /* }}} int lua_cb_register_write_batch */
 
 static const luaL_Reg collectdlib[] = {
     {"log_debug", lua_cb_log_debug},
@@ -367,6 +513,7 @@ static const luaL_Reg collectdlib[] = {
     {"dispatch_values", lua_cb_dispatch_values},
     {"register_read", lua_cb_register_read},
     {"register_write", lua_cb_register_write},
+    {"register_write_batch", lua_cb_register_write_batch},
     {NULL, NULL}};
 
 static int open_collectd(lua_State *L) /* {{{ */
@@ -390,6 +537,7 @@ static void lua_script_free(lua_script_t *script) /* {{{ */
     lua_close(script->lua_state);
     script->lua_state = NULL;
   }
+  pthread_mutex_destroy(&script->lock);
 
   sfree(script->script_path);
   sfree(script);
@@ -400,6 +548,7 @@ static void lua_script_free(lua_script_t *script) /* {{{ */
 static int lua_script_init(lua_script_t *script) /* {{{ */
 {
   memset(script, 0, sizeof(*script));
+  pthread_mutex_init(&script->lock, NULL);
 
   /* initialize the lua context */
   script->lua_state = luaL_newstate();
@@ -411,6 +560,10 @@ static int lua_script_init(lua_script_t *script) /* {{{ */
   /* Open up all the standard Lua libraries. */
   luaL_openlibs(script->lua_state);
 
+  /* Let the registration functions find the script they are called from. */
+  lua_pushlightuserdata(script->lua_state, script);
+  lua_setfield(script->lua_state, LUA_REGISTRYINDEX, "collectd_script");
+
 /* Load the 'collectd' library */
 #if LUA_VERSION_NUM < 502
   lua_pushcfunction(script->lua_state, open_collectd);
@@ -538,7 +691,31 @@ static int lua_config_script(const oconfig_item_t *ci) /* {{{ */
 
   DEBUG("Lua plugin: abs_path = \"%s\";", abs_path);
 
-  status = lua_script_load(abs_path);
+  script_loading = 1;
+  load_callbacks_num = 0;
+  for (load_instance = 0; load_instance < script_instances; load_instance++) {
+    load_registered = 0;
+
+    status = lua_script_load(abs_path);
+    if (status != 0) {
+      /* The failed instance has been freed, so forget its callbacks. */
+      for (size_t i = 0; (load_instance > 0) && (i < load_registered); i++)
+        load_callbacks[i]->instances_num--;
+      break;
+    }
+
+    if ((load_instance > 0) && (load_registered != load_callbacks_num)) {
+      ERROR("Lua plugin: Instance %zu of script \"%s\" registered %zu "
+            "callbacks, but the first instance registered %zu.",
+            load_instance + 1, abs_path, load_registered, load_callbacks_num);
+      status = -1;
+      break;
+    }
+  }
+  script_loading = 0;
+  sfree(load_callbacks);
+  load_callbacks_num = 0;
+  load_instance = 0;
   if (status != 0)
     return status;
 
@@ -547,9 +724,27 @@ static int lua_config_script(const oconfig_item_t *ci) /* {{{ */
   return 0;
 } /* }}} int lua_config_script */
 
+static int lua_config_instances(const oconfig_item_t *ci) /* {{{ */
+{
+  int tmp = 0;
+
+  int status = cf_util_get_int(ci, &tmp);
+  if (status != 0)
+    return status;
+
+  if (tmp < 1) {
+    ERROR("Lua plugin: The \"Instances\" option requires a positive number.");
+    return -1;
+  }
+
+  script_instances = (size_t)tmp;
+  return 0;
+} /* }}} int lua_config_instances */
+
 /*
  * <Plugin lua>
  *   BasePath "/"
+ *   Instances 4
  *   Script "script1.lua"
  *   Script "script2.lua"
  * </Plugin>
@@ -562,6 +757,8 @@ static int lua_config(oconfig_item_t *ci) /* {{{ */
 
     if (strcasecmp("BasePath", child->key) == 0) {
       status = lua_config_base_path(child);
+    } else if (strcasecmp("Instances", child->key) == 0) {
+      status = lua_config_instances(child);
     } else if (strcasecmp("Script", child->key) == 0) {
       status = lua_config_script(child);
     } else {
@@ -76,6 +76,9 @@ void module_register(void) {
   fc_register_match(
       "empty_counter",
       (match_proc_t){
-          .create = mec_create, .destroy = mec_destroy, .match = mec_match,
+          .create = mec_create,
+          .destroy = mec_destroy,
+          .match = mec_match,
+          .value_dependent = fc_match_value_dependent,
       });
 } /* module_register */
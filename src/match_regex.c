@@ -128,6 +128,39 @@ static int mr_match_regexen(mr_regex_t *re_head, /* {{{ */
   return FC_MATCH_MATCHES;
 } /* }}} int mr_match_regexen */
 
+/* Extracts the literal prefix of an anchored regular expression, e.g. "cpu"
+ * from "^cpu[0-9]". If the expression is only a literal, e.g. "^cpu$", the
+ * string must be equal to it and `exact' is set. */
+static int mr_regex_literal(const char *re_str, /* {{{ */
+                            fc_constraint_t *ret) {
+  const char *special = ".[]()*+?{}|\\^$";
+  size_t len = 0;
+
+  /* An alternation may apply to the anchor, too. */
+  if ((re_str[0] != '^') || (strchr(re_str, '|') != NULL))
+    return -1;
+
+  const char *ptr = re_str + 1;
+  while ((*ptr != 0) && (strchr(special, *ptr) == NULL)) {
+    if (len >= sizeof(ret->value) - 1)
+      break;
+    ret->value[len] = *ptr;
+    len++;
+    ptr++;
+  }
+
+  /* The last character is optional, e.g. "^cpus?". */
+  if ((len > 0) && ((*ptr == '*') || (*ptr == '?') || (*ptr == '{')))
+    len--;
+  ret->value[len] = 0;
+
+  ret->exact = (strcmp("$", ptr) == 0);
+  if (!ret->exact && (len == 0))
+    return -1;
+
+  return 0;
+} /* }}} int mr_regex_literal */
+
 static int mr_add_regex(mr_regex_t **re_head, const char *re_str, /* {{{ */
                         const char *option) {
   mr_regex_t *re;
@@ -306,6 +339,63 @@ static int mr_destroy(void **user_data) /* {{{ */
   return 0;
 } /* }}} int mr_destroy */
 
+static int mr_constraint(fc_constraint_t *ret, void **user_data) /* {{{ */
+{
+  mr_match_t *m;
+  mr_regex_t *fields[FC_FIELDS_NUM];
+  _Bool found = 0;
+
+  if ((user_data == NULL) || (*user_data == NULL))
+    return -1;
+
+  m = *user_data;
+  if (m->invert)
+    return -1;
+
+  fields[FC_FIELD_HOST] = m->host;
+  fields[FC_FIELD_PLUGIN] = m->plugin;
+  fields[FC_FIELD_PLUGIN_INSTANCE] = m->plugin_instance;
+  fields[FC_FIELD_TYPE] = m->type;
+  fields[FC_FIELD_TYPE_INSTANCE] = m->type_instance;
+
+  /* All regular expressions have to match, so any of them will do. Pick the
+   * most selective one. */
+  for (int i = 0; i < FC_FIELDS_NUM; i++) {
+    for (mr_regex_t *re = fields[i]; re != NULL; re = re->next) {
+      fc_constraint_t c = {0};
+
+      if (mr_regex_literal(re->re_str, &c) != 0)
+        continue;
+      c.field = i;
+
+      if (found) {
+        if (ret->exact && !c.exact)
+          continue;
+        if ((ret->exact == c.exact) &&
+            (strlen(c.value) <= strlen(ret->value)))
+          continue;
+      }
+
+      memcpy(ret, &c, sizeof(*ret));
+      found = 1;
+    }
+  }
+
+  return found ? 0 : -1;
+} /* }}} int mr_constraint */
+
+/* Meta data is not part of the identifier. */
+static int mr_value_dependent(void **user_data) /* {{{ */
+{
+  mr_match_t *m;
+
+  if ((user_data == NULL) || (*user_data == NULL))
+    return 1;
+
+  m = *user_data;
+  return m->meta != NULL;
+} /* }}} int mr_value_dependent */
+
 static int mr_match(const data_set_t __attribute__((unused)) * ds, /* {{{ */
                     const value_list_t *vl,
                     notification_meta_t __attribute__((unused)) * *meta,
@@ -362,5 +452,7 @@ void module_register(void) {
   mproc.create = mr_create;
   mproc.destroy = mr_destroy;
   mproc.match = mr_match;
+  mproc.constraint = mr_constraint;
+  mproc.value_dependent = mr_value_dependent;
   fc_register_match("regex", mproc);
 } /* module_register */
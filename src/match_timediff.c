@@ -139,5 +139,6 @@ void module_register(void) {
   mproc.create = mt_create;
   mproc.destroy = mt_destroy;
   mproc.match = mt_match;
+  mproc.value_dependent = fc_match_value_dependent;
   fc_register_match("timediff", mproc);
 } /* module_register */
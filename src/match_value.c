@@ -34,6 +34,7 @@
 #include "common.h"
 #include "filter_chain.h"
 #include "utils_cache.h"
+#include "utils_ds_select.h"
 
 #define SATISFY_ALL 0
 #define SATISFY_ANY 1
@@ -51,6 +52,12 @@ struct mv_match_s {
 
   char **data_sources;
   size_t data_sources_num;
+
+  /* Resolved when the configuration is read: the bounds with NAN replaced by
+   * -INFINITY and INFINITY, and the selection of data sources. */
+  gauge_t lower;
+  gauge_t upper;
+  ds_select_t *select;
 };
 
 /*
@@ -66,6 +73,7 @@ static void mv_free_match(mv_match_t *m) /* {{{ */
       free(m->data_sources[i]);
     free(m->data_sources);
   }
+  ds_select_destroy(m->select);
 
   free(m);
 } /* }}} void mv_free_match */
@@ -224,11 +232,22 @@ static int mv_create(const oconfig_item_t *ci, void **user_data) /* {{{ */
     break;
   }
 
+  if ((status == 0) && (m->data_sources_num > 0)) {
+    m->select = ds_select_create(m->data_sources, m->data_sources_num);
+    if (m->select == NULL) {
+      ERROR("`value' match: ds_select_create failed.");
+      status = -1;
+    }
+  }
+
   if (status != 0) {
     mv_free_match(m);
     return status;
   }
 
+  m->lower = isnan(m->min) ? -INFINITY : m->min;
+  m->upper = isnan(m->max) ? INFINITY : m->max;
+
   *user_data = m;
   return 0;
 } /* }}} int mv_create */
@@ -259,50 +278,29 @@ static int mv_match(const data_set_t *ds, const value_list_t *vl, /* {{{ */
     return -1;
   }
 
-  status = FC_MATCH_NO_MATCH;
+  uint64_t mask = ds_select_mask(m->select, ds);
+  size_t selected = 0;
+  size_t matching = 0;
 
+  /* Count the selected and the matching data sources without branching on
+   * the values. NaN compares as within the bounds, as it always did. */
   for (size_t i = 0; i < ds->ds_num; i++) {
-    int value_matches = 0;
-
-    /* Check if this data source is relevant. */
-    if (m->data_sources != NULL) {
-      size_t j;
-
-      for (j = 0; j < m->data_sources_num; j++)
-        if (strcasecmp(ds->ds[i].name, m->data_sources[j]) == 0)
-          break;
-
-      /* No match, ignore this data source. */
-      if (j >= m->data_sources_num)
-        continue;
-    }
+    size_t is_selected = ds_select_index(m->select, ds, mask, i);
+    size_t in_range =
+        (size_t)(!(values[i] < m->lower) & !(values[i] > m->upper));
 
     DEBUG("`value' match: current = %g; min = %g; max = %g; invert = %s;",
           values[i], m->min, m->max, m->invert ? "true" : "false");
 
-    if ((!isnan(m->min) && (values[i] < m->min)) ||
-        (!isnan(m->max) && (values[i] > m->max)))
-      value_matches = 0;
-    else
-      value_matches = 1;
-
-    if (m->invert) {
-      if (value_matches)
-        value_matches = 0;
-      else
-        value_matches = 1;
-    }
+    selected += is_selected;
+    matching += is_selected & (in_range ^ (size_t)(m->invert != 0));
+  }
 
-    if (value_matches != 0) {
-      status = FC_MATCH_MATCHES;
-      if (m->satisfy == SATISFY_ANY)
-        break;
-    } else {
-      status = FC_MATCH_NO_MATCH;
-      if (m->satisfy == SATISFY_ALL)
-        break;
-    }
-  } /* for (i = 0; i < ds->ds_num; i++) */
+  if (m->satisfy == SATISFY_ANY)
+    status = (matching > 0) ? FC_MATCH_MATCHES : FC_MATCH_NO_MATCH;
+  else
+    status = ((selected > 0) && (matching == selected)) ? FC_MATCH_MATCHES
+                                                        : FC_MATCH_NO_MATCH;
 
   free(values);
   return status;
@@ -314,5 +312,6 @@ void module_register(void) {
   mproc.create = mv_create;
   mproc.destroy = mv_destroy;
   mproc.match = mv_match;
+  mproc.value_dependent = fc_match_value_dependent;
   fc_register_match("value", mproc);
 } /* module_register */
@@ -28,6 +28,10 @@
 #include "common.h"
 #include "plugin.h"
 
+#if KERNEL_LINUX
+#include "utils_procfs.h"
+#endif
+
 #ifdef HAVE_SYS_SYSCTL_H
 #include <sys/sysctl.h>
 #endif
@@ -262,11 +266,8 @@ static int memory_read_internal(value_list_t *vl) {
 /* #endif HAVE_SYSCTLBYNAME */
 
 #elif KERNEL_LINUX
-  FILE *fh;
-  char buffer[1024];
-
-  char *fields[8];
-  int numfields;
+  procfs_snapshot_t *s;
+  procfs_entry_t const *e;
 
   _Bool detailed_slab_info = 0;
 
@@ -279,43 +280,33 @@ static int memory_read_internal(value_list_t *vl) {
   gauge_t mem_slab_reclaimable = 0;
   gauge_t mem_slab_unreclaimable = 0;
 
-  if ((fh = fopen("/proc/meminfo", "r")) == NULL) {
-    WARNING("memory: fopen: %s", STRERRNO);
+  if ((s = procfs_snapshot_acquire("/proc/meminfo")) == NULL) {
+    WARNING("memory: Reading /proc/meminfo failed: %s", STRERRNO);
     return -1;
   }
 
-  while (fgets(buffer, sizeof(buffer), fh) != NULL) {
-    gauge_t *val = NULL;
-
-    if (strncasecmp(buffer, "MemTotal:", 9) == 0)
-      val = &mem_total;
-    else if (strncasecmp(buffer, "MemFree:", 8) == 0)
-      val = &mem_free;
-    else if (strncasecmp(buffer, "Buffers:", 8) == 0)
-      val = &mem_buffered;
-    else if (strncasecmp(buffer, "Cached:", 7) == 0)
-      val = &mem_cached;
-    else if (strncasecmp(buffer, "Slab:", 5) == 0)
-      val = &mem_slab_total;
-    else if (strncasecmp(buffer, "SReclaimable:", 13) == 0) {
-      val = &mem_slab_reclaimable;
-      detailed_slab_info = 1;
-    } else if (strncasecmp(buffer, "SUnreclaim:", 11) == 0) {
-      val = &mem_slab_unreclaimable;
-      detailed_slab_info = 1;
-    } else
-      continue;
-
-    numfields = strsplit(buffer, fields, STATIC_ARRAY_SIZE(fields));
-    if (numfields < 2)
-      continue;
-
-    *val = 1024.0 * atof(fields[1]);
-  }
+#define MEMINFO_GET(key, val)                                                  \
+  do {                                                                         \
+    if ((e = procfs_snapshot_lookup(s, (key))) != NULL)                        \
+      (val) = 1024.0 * (gauge_t)e->value;                                      \
+  } while (0)
 
-  if (fclose(fh)) {
-    WARNING("memory: fclose: %s", STRERRNO);
-  }
+  MEMINFO_GET("MemTotal", mem_total);
+  MEMINFO_GET("MemFree", mem_free);
+  MEMINFO_GET("Buffers", mem_buffered);
+  MEMINFO_GET("Cached", mem_cached);
+  MEMINFO_GET("Slab", mem_slab_total);
+  if ((procfs_snapshot_lookup(s, "SReclaimable") != NULL) ||
+      (procfs_snapshot_lookup(s, "SUnreclaim") != NULL))
+    detailed_slab_info = 1;
+  MEMINFO_GET("SReclaimable", mem_slab_reclaimable);
+  MEMINFO_GET("SUnreclaim", mem_slab_unreclaimable);
+
+#undef MEMINFO_GET
+
+  /* Values derived from the same snapshot share its time. */
+  vl->time = procfs_snapshot_time(s);
+  procfs_snapshot_release(s);
 
   if (mem_total < (mem_free + mem_buffered + mem_cached + mem_slab_total))
     return -1;
@@ -45,6 +45,11 @@
 #endif
 #endif
 
+/* Maximum number of registers a single read request may return. */
+#ifndef MODBUS_MAX_READ_REGISTERS
+#define MODBUS_MAX_READ_REGISTERS 125
+#endif
+
 /*
  * <Data "data_name">
  *   RegisterBase 1234
@@ -109,11 +114,15 @@ struct mb_data_s /* {{{ */
   mb_data_t *next;
 }; /* }}} */
 
+struct mb_data_group_s;
+typedef struct mb_data_group_s mb_data_group_t;
+
 struct mb_slave_s /* {{{ */
 {
   int id;
   char instance[DATA_MAX_NAME_LEN];
   mb_data_t *collect;
+  mb_data_group_t *groups;
 }; /* }}} */
 typedef struct mb_slave_s mb_slave_t;
 
@@ -129,6 +138,8 @@ struct mb_host_s /* {{{ */
 
   mb_slave_t *slaves;
   size_t slaves_num;
+  /* Number of unused registers a read may span to combine two data blocks */
+  int max_register_gap;
 
 #if LEGACY_LIBMODBUS
   modbus_param_t connection;
@@ -139,12 +150,15 @@ struct mb_host_s /* {{{ */
 }; /* }}} */
 typedef struct mb_host_s mb_host_t;
 
-struct mb_data_group_s;
-typedef struct mb_data_group_s mb_data_group_t;
+/* Data blocks of one slave which are read with a single request. */
 struct mb_data_group_s /* {{{ */
 {
-  mb_data_t *registers;
-  size_t registers_num;
+  mb_mreg_type_t modbus_register_type;
+  int register_base;
+  int registers_num;
+
+  mb_data_t **data;
+  size_t data_num;
 
   mb_data_group_t *next;
 }; /* }}} */
@@ -404,15 +418,24 @@ static int mb_init_connection(mb_host_t *host) /* {{{ */
       (vt).absolute = (absolute_t)(raw);                                       \
   } while (0)
 
-static int mb_read_data(mb_host_t *host, mb_slave_t *slave, /* {{{ */
-                        mb_data_t *data) {
-  uint16_t values[2] = {0};
-  int values_num;
-  const data_set_t *ds;
-  int status = 0;
+/* Returns the number of registers used by a data block. */
+static int mb_data_registers_num(const mb_data_t *data) /* {{{ */
+{
+  if ((data->register_type == REG_TYPE_INT32) ||
+      (data->register_type == REG_TYPE_INT32_CDAB) ||
+      (data->register_type == REG_TYPE_UINT32) ||
+      (data->register_type == REG_TYPE_UINT32_CDAB) ||
+      (data->register_type == REG_TYPE_FLOAT) ||
+      (data->register_type == REG_TYPE_FLOAT_CDAB))
+    return 2;
+  else
+    return 1;
+} /* }}} int mb_data_registers_num */
 
-  if ((host == NULL) || (slave == NULL) || (data == NULL))
-    return EINVAL;
+/* Converts the registers of one data block and dispatches the value. */
+static int mb_decode_data(mb_host_t *host, mb_slave_t *slave, /* {{{ */
+                          mb_data_t *data, const uint16_t *values) {
+  const data_set_t *ds;
 
   ds = plugin_get_ds(data->type);
   if (ds == NULL) {
@@ -439,94 +462,12 @@ static int mb_read_data(mb_host_t *host, mb_slave_t *slave, /* {{{ */
         data->type, DS_TYPE_TO_STRING(ds->ds[0].type));
   }
 
-  if ((data->register_type == REG_TYPE_INT32) ||
-      (data->register_type == REG_TYPE_INT32_CDAB) ||
-      (data->register_type == REG_TYPE_UINT32) ||
-      (data->register_type == REG_TYPE_UINT32_CDAB) ||
-      (data->register_type == REG_TYPE_FLOAT) ||
-      (data->register_type == REG_TYPE_FLOAT_CDAB))
-    values_num = 2;
-  else
-    values_num = 1;
-
-  if (host->connection == NULL) {
-    status = EBADF;
-  } else if (host->conntype == MBCONN_TCP) {
-    /* getpeername() is used only to determine if the socket is connected, not
-     * because we're really interested in the peer's IP address. */
-    if (getpeername(modbus_get_socket(host->connection),
-                    (void *)&(struct sockaddr_storage){0},
-                    &(socklen_t){sizeof(struct sockaddr_storage)}) != 0)
-      status = errno;
-  }
-
-  if ((status == EBADF) || (status == ENOTSOCK) || (status == ENOTCONN)) {
-    status = mb_init_connection(host);
-    if (status != 0) {
-      ERROR("Modbus plugin: mb_init_connection (%s/%s) failed. ", host->host,
-            host->node);
-      host->is_connected = 0;
-      host->connection = NULL;
-      return -1;
-    }
-  } else if (status != 0) {
-#if LEGACY_LIBMODBUS
-    modbus_close(&host->connection);
-#else
-    modbus_close(host->connection);
-    modbus_free(host->connection);
-#endif
-  }
-
-#if LEGACY_LIBMODBUS
-/* Version 2.0.3: Pass the connection struct as a pointer and pass the slave
- * id to each call of "read_holding_registers". */
-#define modbus_read_registers(ctx, addr, nb, dest)                             \
-  read_holding_registers(&(ctx), slave->id, (addr), (nb), (dest))
-#else /* if !LEGACY_LIBMODBUS */
-  /* Version 2.9.2: Set the slave id once before querying the registers. */
-  status = modbus_set_slave(host->connection, slave->id);
-  if (status != 0) {
-    ERROR("Modbus plugin: modbus_set_slave (%i) failed with status %i.",
-          slave->id, status);
-    return -1;
-  }
-#endif
-  if (data->modbus_register_type == MREG_INPUT) {
-    status = modbus_read_input_registers(host->connection,
-                                         /* start_addr = */ data->register_base,
-                                         /* num_registers = */ values_num,
-                                         /* buffer = */ values);
-  } else {
-    status = modbus_read_registers(host->connection,
-                                   /* start_addr = */ data->register_base,
-                                   /* num_registers = */ values_num,
-                                   /* buffer = */ values);
-  }
-  if (status != values_num) {
-    ERROR("Modbus plugin: modbus read function (%s/%s) failed. "
-          " status = %i, start_addr = %i, values_num = %i. Giving up.",
-          host->host, host->node, status, data->register_base, values_num);
-#if LEGACY_LIBMODBUS
-    modbus_close(&host->connection);
-#else
-    modbus_close(host->connection);
-    modbus_free(host->connection);
-#endif
-    host->connection = NULL;
-    return -1;
-  }
-
-  DEBUG("Modbus plugin: mb_read_data: Success! "
-        "modbus_read_registers returned with status %i.",
-        status);
-
   if (data->register_type == REG_TYPE_FLOAT) {
     float float_value;
     value_t vt;
 
     float_value = mb_register_to_float(values[0], values[1]);
-    DEBUG("Modbus plugin: mb_read_data: "
+    DEBUG("Modbus plugin: mb_decode_data: "
           "Returned float value is %g",
           (double)float_value);
 
@@ -537,7 +478,7 @@ static int mb_read_data(mb_host_t *host, mb_slave_t *slave, /* {{{ */
     value_t vt;
 
     float_value = mb_register_to_float(values[1], values[0]);
-    DEBUG("Modbus plugin: mb_read_data: "
+    DEBUG("Modbus plugin: mb_decode_data: "
           "Returned float value is %g",
           (double)float_value);
 
@@ -551,7 +492,7 @@ static int mb_read_data(mb_host_t *host, mb_slave_t *slave, /* {{{ */
     value_t vt;
 
     v.u32 = (((uint32_t)values[0]) << 16) | ((uint32_t)values[1]);
-    DEBUG("Modbus plugin: mb_read_data: "
+    DEBUG("Modbus plugin: mb_decode_data: "
           "Returned int32 value is %" PRIi32,
           v.i32);
 
@@ -565,7 +506,7 @@ static int mb_read_data(mb_host_t *host, mb_slave_t *slave, /* {{{ */
     value_t vt;
 
     v.u32 = (((uint32_t)values[1]) << 16) | ((uint32_t)values[0]);
-    DEBUG("Modbus plugin: mb_read_data: "
+    DEBUG("Modbus plugin: mb_decode_data: "
           "Returned int32 value is %" PRIi32,
           v.i32);
 
@@ -580,7 +521,7 @@ static int mb_read_data(mb_host_t *host, mb_slave_t *slave, /* {{{ */
 
     v.u16 = values[0];
 
-    DEBUG("Modbus plugin: mb_read_data: "
+    DEBUG("Modbus plugin: mb_decode_data: "
           "Returned int16 value is %" PRIi16,
           v.i16);
 
@@ -591,7 +532,7 @@ static int mb_read_data(mb_host_t *host, mb_slave_t *slave, /* {{{ */
     value_t vt;
 
     v32 = (((uint32_t)values[0]) << 16) | ((uint32_t)values[1]);
-    DEBUG("Modbus plugin: mb_read_data: "
+    DEBUG("Modbus plugin: mb_decode_data: "
           "Returned uint32 value is %" PRIu32,
           v32);
 
@@ -602,7 +543,7 @@ static int mb_read_data(mb_host_t *host, mb_slave_t *slave, /* {{{ */
     value_t vt;
 
     v32 = (((uint32_t)values[1]) << 16) | ((uint32_t)values[0]);
-    DEBUG("Modbus plugin: mb_read_data: "
+    DEBUG("Modbus plugin: mb_decode_data: "
           "Returned uint32 value is %" PRIu32,
           v32);
 
@@ -612,7 +553,7 @@ static int mb_read_data(mb_host_t *host, mb_slave_t *slave, /* {{{ */
   {
     value_t vt;
 
-    DEBUG("Modbus plugin: mb_read_data: "
+    DEBUG("Modbus plugin: mb_decode_data: "
           "Returned uint16 value is %" PRIu16,
           values[0]);
 
@@ -621,23 +562,139 @@ static int mb_read_data(mb_host_t *host, mb_slave_t *slave, /* {{{ */
   }
 
   return 0;
-} /* }}} int mb_read_data */
+} /* }}} int mb_decode_data */
 
-static int mb_read_slave(mb_host_t *host, mb_slave_t *slave) /* {{{ */
+/* Makes sure the host is connected and addresses the slave. */
+static int mb_connect_slave(mb_host_t *host, mb_slave_t *slave) /* {{{ */
 {
+  int status = 0;
+
+  if (host->connection == NULL) {
+    status = EBADF;
+  } else if (host->conntype == MBCONN_TCP) {
+    /* getpeername() is used only to determine if the socket is connected, not
+     * because we're really interested in the peer's IP address. */
+    if (getpeername(modbus_get_socket(host->connection),
+                    (void *)&(struct sockaddr_storage){0},
+                    &(socklen_t){sizeof(struct sockaddr_storage)}) != 0)
+      status = errno;
+  }
+
+  if ((status == EBADF) || (status == ENOTSOCK) || (status == ENOTCONN)) {
+    status = mb_init_connection(host);
+    if (status != 0) {
+      ERROR("Modbus plugin: mb_init_connection (%s/%s) failed. ", host->host,
+            host->node);
+      host->is_connected = 0;
+      host->connection = NULL;
+      return -1;
+    }
+  } else if (status != 0) {
+#if LEGACY_LIBMODBUS
+    modbus_close(&host->connection);
+#else
+    modbus_close(host->connection);
+    modbus_free(host->connection);
+#endif
+    host->connection = NULL;
+    return -1;
+  }
+
+#if !LEGACY_LIBMODBUS
+  /* Version 2.9.2: Set the slave id once before querying the registers. */
+  status = modbus_set_slave(host->connection, slave->id);
+  if (status != 0) {
+    ERROR("Modbus plugin: modbus_set_slave (%i) failed with status %i.",
+          slave->id, status);
+    return -1;
+  }
+#endif
+  return 0;
+} /* }}} int mb_connect_slave */
+
+/* Reads the registers of a group with one request and decodes all of its data
+ * blocks. Returns the number of data blocks dispatched or -1 on error. */
+static int mb_read_group(mb_host_t *host, mb_slave_t *slave, /* {{{ */
+                         mb_data_group_t *group) {
+  uint16_t values[MODBUS_MAX_READ_REGISTERS] = {0};
   int success;
   int status;
 
-  if ((host == NULL) || (slave == NULL))
+  if ((host == NULL) || (slave == NULL) || (group == NULL))
     return EINVAL;
 
+#if LEGACY_LIBMODBUS
+/* Version 2.0.3: Pass the connection struct as a pointer and pass the slave
+ * id to each call of "read_holding_registers". */
+#define modbus_read_registers(ctx, addr, nb, dest)                             \
+  read_holding_registers(&(ctx), slave->id, (addr), (nb), (dest))
+#endif
+
+  status = mb_connect_slave(host, slave);
+  if (status != 0)
+    return -1;
+
+  if (group->modbus_register_type == MREG_INPUT) {
+    status = modbus_read_input_registers(
+        host->connection,
+        /* start_addr = */ group->register_base,
+        /* num_registers = */ group->registers_num,
+        /* buffer = */ values);
+  } else {
+    status = modbus_read_registers(host->connection,
+                                   /* start_addr = */ group->register_base,
+                                   /* num_registers = */ group->registers_num,
+                                   /* buffer = */ values);
+  }
+  if (status != group->registers_num) {
+    ERROR("Modbus plugin: modbus read function (%s/%s) failed. "
+          " status = %i, start_addr = %i, values_num = %i. Giving up.",
+          host->host, host->node, status, group->register_base,
+          group->registers_num);
+#if LEGACY_LIBMODBUS
+    modbus_close(&host->connection);
+#else
+    modbus_close(host->connection);
+    modbus_free(host->connection);
+#endif
+    host->connection = NULL;
+    return -1;
+  }
+
+  DEBUG("Modbus plugin: mb_read_group: Success! "
+        "modbus_read_registers returned with status %i.",
+        status);
+
   success = 0;
-  for (mb_data_t *data = slave->collect; data != NULL; data = data->next) {
-    status = mb_read_data(host, slave, data);
+  for (size_t i = 0; i < group->data_num; i++) {
+    mb_data_t *data = group->data[i];
+
+    status = mb_decode_data(host, slave, data,
+                            values + (data->register_base -
+                                      group->register_base));
     if (status == 0)
       success++;
   }
 
+  return success;
+} /* }}} int mb_read_group */
+
+static int mb_read_slave(mb_host_t *host, mb_slave_t *slave) /* {{{ */
+{
+  int success;
+  int status;
+
+  if ((host == NULL) || (slave == NULL))
+    return EINVAL;
+
+  success = 0;
+  for (mb_data_group_t *group = slave->groups; group != NULL;
+       group = group->next) {
+    status = mb_read_group(host, slave, group);
+    if (status > 0)
+      success += status;
+  }
+
   if (success == 0)
     return -1;
   else
@@ -692,13 +749,26 @@ static void data_free_all(mb_data_t *data) /* {{{ */
   data_free_all(next);
 } /* }}} void data_free_all */
 
+static void groups_free_all(mb_data_group_t *group) /* {{{ */
+{
+  while (group != NULL) {
+    mb_data_group_t *next = group->next;
+
+    sfree(group->data);
+    sfree(group);
+    group = next;
+  }
+} /* }}} void groups_free_all */
+
 static void slaves_free_all(mb_slave_t *slaves, size_t slaves_num) /* {{{ */
 {
   if (slaves == NULL)
     return;
 
-  for (size_t i = 0; i < slaves_num; i++)
+  for (size_t i = 0; i < slaves_num; i++) {
+    groups_free_all(slaves[i].groups);
     data_free_all(slaves[i].collect);
+  }
   sfree(slaves);
 } /* }}} void slaves_free_all */
 
@@ -715,6 +785,82 @@ static void host_free(void *void_host) /* {{{ */
 
 /* Config functions */
 
+static int mb_data_compare(const void *a, const void *b) /* {{{ */
+{
+  const mb_data_t *d0 = *(mb_data_t *const *)a;
+  const mb_data_t *d1 = *(mb_data_t *const *)b;
+
+  if (d0->modbus_register_type != d1->modbus_register_type)
+    return (d0->modbus_register_type < d1->modbus_register_type) ? -1 : 1;
+  if (d0->register_base != d1->register_base)
+    return (d0->register_base < d1->register_base) ? -1 : 1;
+  return 0;
+} /* }}} int mb_data_compare */
+
+/* Combines the data blocks of a slave into as few read requests as possible.
+ * Blocks of the same register type are merged when they overlap or are at
+ * most "max_gap" registers apart and the request stays within
+ * MODBUS_MAX_READ_REGISTERS. */
+static int mb_plan_groups(mb_slave_t *slave, int max_gap) /* {{{ */
+{
+  mb_data_group_t **tail = &slave->groups;
+  mb_data_group_t *group = NULL;
+  mb_data_t **sorted;
+  size_t data_num = 0;
+  size_t i;
+
+  for (mb_data_t *data = slave->collect; data != NULL; data = data->next)
+    data_num++;
+
+  sorted = calloc(data_num, sizeof(*sorted));
+  if (sorted == NULL)
+    return ENOMEM;
+
+  i = 0;
+  for (mb_data_t *data = slave->collect; data != NULL; data = data->next)
+    sorted[i++] = data;
+  qsort(sorted, data_num, sizeof(*sorted), mb_data_compare);
+
+  for (i = 0; i < data_num; i++) {
+    mb_data_t *data = sorted[i];
+    int end = data->register_base + mb_data_registers_num(data);
+
+    if ((group != NULL) &&
+        (group->modbus_register_type == data->modbus_register_type) &&
+        (data->register_base - (group->register_base + group->registers_num) <=
+         max_gap) &&
+        (end - group->register_base <= MODBUS_MAX_READ_REGISTERS)) {
+      if (end - group->register_base > group->registers_num)
+        group->registers_num = end - group->register_base;
+    } else {
+      group = calloc(1, sizeof(*group));
+      if (group == NULL) {
+        sfree(sorted);
+        return ENOMEM;
+      }
+      group->modbus_register_type = data->modbus_register_type;
+      group->register_base = data->register_base;
+      group->registers_num = end - data->register_base;
+
+      *tail = group;
+      tail = &group->next;
+    }
+
+    mb_data_t **tmp =
+        realloc(group->data, sizeof(*group->data) * (group->data_num + 1));
+    if (tmp == NULL) {
+      sfree(sorted);
+      return ENOMEM;
+    }
+    group->data = tmp;
+    group->data[group->data_num] = data;
+    group->data_num++;
+  }
+
+  sfree(sorted);
+  return 0;
+} /* }}} int mb_plan_groups */
+
 static int mb_config_add_data(oconfig_item_t *ci) /* {{{ */
 {
   mb_data_t data = {0};
@@ -947,7 +1093,16 @@ static int mb_config_add_host(oconfig_item_t *ci) /* {{{ */
       status = cf_util_get_int(child, &host->baudrate);
     else if (strcasecmp("Interval", child->key) == 0)
       status = cf_util_get_cdtime(child, &host->interval);
-    else if (strcasecmp("Slave", child->key) == 0)
+    else if (strcasecmp("MaxRegisterGap", child->key) == 0) {
+      status = cf_util_get_int(child, &host->max_register_gap);
+      if ((status == 0) && ((host->max_register_gap < 0) ||
+                            (host->max_register_gap >=
+                             MODBUS_MAX_READ_REGISTERS))) {
+        ERROR("Modbus plugin: MaxRegisterGap must be between 0 and %d.",
+              MODBUS_MAX_READ_REGISTERS - 1);
+        status = -1;
+      }
+    } else if (strcasecmp("Slave", child->key) == 0)
       /* Don't set status: Gracefully continue if a slave fails. */
       mb_config_add_slave(host, child);
     else {
@@ -980,6 +1135,14 @@ static int mb_config_add_host(oconfig_item_t *ci) /* {{{ */
     status = -1;
   }
 
+  /* Slaves may precede "MaxRegisterGap", so plan the reads only now. */
+  for (size_t i = 0; (status == 0) && (i < host->slaves_num); i++) {
+    status = mb_plan_groups(host->slaves + i, host->max_register_gap);
+    if (status != 0)
+      ERROR("Modbus plugin: Planning the reads of slave %i failed.",
+            host->slaves[i].id);
+  }
+
   if (status == 0) {
     char name[1024];
 
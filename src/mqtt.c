@@ -34,6 +34,7 @@
 #include "common.h"
 #include "plugin.h"
 #include "utils_complain.h"
+#include "utils_name_cache.h"
 
 #include <mosquitto.h>
 
@@ -43,6 +44,12 @@
 #define MQTT_DEFAULT_PORT 1883
 #define MQTT_DEFAULT_TOPIC_PREFIX "collectd"
 #define MQTT_DEFAULT_TOPIC "collectd/#"
+#define MQTT_DEFAULT_BATCH_TIMEOUT TIME_T_TO_CDTIME_T(1)
+/* Number of topics cached per Publish block. */
+#define MQTT_TOPIC_CACHE_SIZE 65536
+/* How long a write waits for an acknowledgement when the in-flight window is
+ * full. */
+#define MQTT_INFLIGHT_TIMEOUT TIME_T_TO_CDTIME_T(1)
 #ifndef MQTT_KEEPALIVE
 #define MQTT_KEEPALIVE 60
 #endif
@@ -53,6 +60,17 @@
 /*
  * Data types
  */
+/* Value lists of one host waiting to be published in one message. */
+struct mqtt_batch_s {
+  char host[DATA_MAX_NAME_LEN];
+  char *payload;
+  size_t size;
+  size_t fill;
+  cdtime_t time;
+  struct mqtt_batch_s *next;
+};
+typedef struct mqtt_batch_s mqtt_batch_t;
+
 struct mqtt_client_conf {
   _Bool publish;
   char *name;
@@ -76,6 +94,20 @@ struct mqtt_client_conf {
   char *topic_prefix;
   _Bool store_rates;
   _Bool retain;
+  name_cache_t *topic_cache;
+  /* Batched mode: the value lists of a host are published together once
+   * they exceed batch_size bytes or are older than batch_timeout. */
+  size_t batch_size;
+  cdtime_t batch_timeout;
+  mqtt_batch_t *batches;
+  cdtime_t batches_next_check;
+  /* QoS 1 and 2: at most max_inflight messages are unacknowledged. Only
+   * enforced while the network loop runs in its own thread, see
+   * mqtt_connect(). */
+  int max_inflight;
+  int inflight;
+  _Bool loop_started;
+  pthread_cond_t inflight_cond;
 
   /* For subscribing */
   pthread_t thread;
@@ -135,15 +167,38 @@ static char const *mosquitto_strerror(int code) {
 /* provided by libmosquitto */
 #endif
 
-static void mqtt_free(mqtt_client_conf_t *conf) {
+static int mqtt_batches_publish(mqtt_client_conf_t *conf, cdtime_t timeout);
+
+static void mqtt_free(void *arg) {
+  mqtt_client_conf_t *conf = arg;
+
   if (conf == NULL)
     return;
 
+  if (conf->publish) {
+    pthread_mutex_lock(&conf->lock);
+    mqtt_batches_publish(conf, /* timeout = */ 0);
+    pthread_mutex_unlock(&conf->lock);
+  }
+
   if (conf->connected)
     (void)mosquitto_disconnect(conf->mosq);
   conf->connected = 0;
+#if LIBMOSQUITTO_MAJOR != 0
+  if (conf->loop_started)
+    (void)mosquitto_loop_stop(conf->mosq, /* force = */ false);
+  conf->loop_started = 0;
+#endif
   (void)mosquitto_destroy(conf->mosq);
 
+  while (conf->batches != NULL) {
+    mqtt_batch_t *next = conf->batches->next;
+    sfree(conf->batches->payload);
+    sfree(conf->batches);
+    conf->batches = next;
+  }
+  name_cache_destroy(conf->topic_cache);
+
   sfree(conf->host);
   sfree(conf->username);
   sfree(conf->password);
@@ -173,71 +228,144 @@ static char *strip_prefix(char *topic) {
   return topic;
 }
 
-static void on_message(
-#if LIBMOSQUITTO_MAJOR == 0
-#else
-    __attribute__((unused)) struct mosquitto *m,
-#endif
-    __attribute__((unused)) void *arg, const struct mosquitto_message *msg) {
+/* Dispatches the values of the series "name", which is an identifier as
+ * returned by FORMAT_VL(). */
+static int mqtt_dispatch(char const *name, char *values) {
   value_list_t vl = VALUE_LIST_INIT;
   data_set_t const *ds;
-  char *topic;
-  char *name;
-  char *payload;
   int status;
 
-  if (msg->payloadlen <= 0) {
-    DEBUG("mqtt plugin: message has empty payload");
-    return;
-  }
-
-  topic = strdup(msg->topic);
-  name = strip_prefix(topic);
-
   status = parse_identifier_vl(name, &vl);
   if (status != 0) {
-    ERROR("mqtt plugin: Unable to parse topic \"%s\".", topic);
-    sfree(topic);
-    return;
+    ERROR("mqtt plugin: Unable to parse identifier \"%s\".", name);
+    return status;
   }
-  sfree(topic);
 
   ds = plugin_get_ds(vl.type);
   if (ds == NULL) {
     ERROR("mqtt plugin: Unknown type: \"%s\".", vl.type);
-    return;
+    return -1;
   }
 
   vl.values = calloc(ds->ds_num, sizeof(*vl.values));
   if (vl.values == NULL) {
     ERROR("mqtt plugin: calloc failed.");
-    return;
+    return -1;
   }
   vl.values_len = ds->ds_num;
 
+  DEBUG("mqtt plugin: values = \"%s\"", values);
+  status = parse_values(values, &vl, ds);
+  if (status != 0) {
+    ERROR("mqtt plugin: Unable to parse payload \"%s\".", values);
+    sfree(vl.values);
+    return status;
+  }
+
+  plugin_dispatch_values(&vl);
+  sfree(vl.values);
+  return 0;
+} /* int mqtt_dispatch */
+
+static void on_message(
+#if LIBMOSQUITTO_MAJOR == 0
+#else
+    __attribute__((unused)) struct mosquitto *m,
+#endif
+    __attribute__((unused)) void *arg, const struct mosquitto_message *msg) {
+  char *payload;
+
+  if (msg->payloadlen <= 0) {
+    DEBUG("mqtt plugin: message has empty payload");
+    return;
+  }
+
   payload = malloc(msg->payloadlen + 1);
   if (payload == NULL) {
     ERROR("mqtt plugin: malloc for payload buffer failed.");
-    sfree(vl.values);
     return;
   }
   memmove(payload, msg->payload, msg->payloadlen);
   payload[msg->payloadlen] = 0;
 
-  DEBUG("mqtt plugin: payload = \"%s\"", payload);
-  status = parse_values(payload, &vl, ds);
-  if (status != 0) {
-    ERROR("mqtt plugin: Unable to parse payload \"%s\".", payload);
+  /* Batches hold one "<identifier> <values>" line per value list. The topic
+   * only names the host then. Values never contain spaces. */
+  if (strchr(payload, ' ') != NULL) {
+    char *saveptr = NULL;
+    for (char *line = strtok_r(payload, "\n", &saveptr); line != NULL;
+         line = strtok_r(NULL, "\n", &saveptr)) {
+      char *values = strrchr(line, ' ');
+      if (values == NULL) {
+        ERROR("mqtt plugin: Unable to parse line \"%s\".", line);
+        continue;
+      }
+      *values = 0;
+      mqtt_dispatch(line, values + 1);
+    }
     sfree(payload);
-    sfree(vl.values);
     return;
   }
-  sfree(payload);
 
-  plugin_dispatch_values(&vl);
-  sfree(vl.values);
+  char *topic = strdup(msg->topic);
+  if (topic == NULL) {
+    ERROR("mqtt plugin: strdup failed.");
+    sfree(payload);
+    return;
+  }
+
+  char *name = strip_prefix(topic);
+  if (name == NULL)
+    ERROR("mqtt plugin: Unable to parse topic \"%s\".", topic);
+  else
+    mqtt_dispatch(name, payload);
+
+  sfree(topic);
+  sfree(payload);
 } /* void on_message */
 
+#if LIBMOSQUITTO_MAJOR != 0
+/* The following callbacks are called by the network loop thread of
+ * publishers. */
+static void on_publish(__attribute__((unused)) struct mosquitto *m, void *arg,
+                       __attribute__((unused)) int mid) {
+  mqtt_client_conf_t *conf = arg;
+
+  if (conf->qos == 0)
+    return;
+
+  pthread_mutex_lock(&conf->lock);
+  if (conf->inflight > 0)
+    conf->inflight--;
+  pthread_cond_signal(&conf->inflight_cond);
+  pthread_mutex_unlock(&conf->lock);
+} /* void on_publish */
+
+static void on_connect(__attribute__((unused)) struct mosquitto *m, void *arg,
+                       int rc) {
+  mqtt_client_conf_t *conf = arg;
+
+  if (rc != 0)
+    return;
+
+  pthread_mutex_lock(&conf->lock);
+  conf->connected = 1;
+  c_release(LOG_INFO, &conf->complaint_cantpublish,
+            "mqtt plugin: successfully reconnected to broker \"%s:%d\"",
+            conf->host, conf->port);
+  pthread_mutex_unlock(&conf->lock);
+} /* void on_connect */
+
+static void on_disconnect(__attribute__((unused)) struct mosquitto *m,
+                          void *arg, __attribute__((unused)) int rc) {
+  mqtt_client_conf_t *conf = arg;
+
+  pthread_mutex_lock(&conf->lock);
+  conf->connected = 0;
+  pthread_cond_broadcast(&conf->inflight_cond);
+  pthread_mutex_unlock(&conf->lock);
+} /* void on_disconnect */
+#endif
+
 /* must hold conf->lock when calling. */
 static int mqtt_reconnect(mqtt_client_conf_t *conf) {
   int status;
@@ -337,6 +465,10 @@ static int mqtt_connect(mqtt_client_conf_t *conf) {
                              /* keepalive = */ MQTT_KEEPALIVE,
                              /* clean session = */ conf->clean_session);
 #else
+  if (conf->publish && (conf->max_inflight > 0))
+    mosquitto_max_inflight_messages_set(conf->mosq,
+                                        (unsigned int)conf->max_inflight);
+
   status =
       mosquitto_connect(conf->mosq, conf->host, conf->port, MQTT_KEEPALIVE);
 #endif
@@ -366,6 +498,24 @@ static int mqtt_connect(mqtt_client_conf_t *conf) {
     }
   }
 
+#if LIBMOSQUITTO_MAJOR != 0
+  /* Publishers run the network loop in a thread of the library, so that
+   * acknowledgements are processed and the library reconnects by itself. */
+  if (conf->publish) {
+    mosquitto_publish_callback_set(conf->mosq, on_publish);
+    mosquitto_connect_callback_set(conf->mosq, on_connect);
+    mosquitto_disconnect_callback_set(conf->mosq, on_disconnect);
+
+    status = mosquitto_loop_start(conf->mosq);
+    if (status == MOSQ_ERR_SUCCESS)
+      conf->loop_started = 1;
+    else
+      WARNING("mqtt plugin: mosquitto_loop_start failed: %s. Messages with "
+              "QoS 1 or 2 will not be acknowledged.",
+              mosquitto_strerror(status));
+  }
+#endif
+
   conf->connected = 1;
   return 0;
 } /* mqtt_connect */
@@ -410,17 +560,35 @@ static void *subscribers_thread(void *arg) {
   pthread_exit(0);
 } /* void *subscribers_thread */
 
-static int publish(mqtt_client_conf_t *conf, char const *topic,
-                   void const *payload, size_t payload_len) {
+/* must hold conf->lock when calling. */
+static int publish_locked(mqtt_client_conf_t *conf, char const *topic,
+                          void const *payload, size_t payload_len) {
   int status;
 
-  pthread_mutex_lock(&conf->lock);
+  if (!conf->loop_started) {
+    status = mqtt_connect(conf);
+    if (status != 0) {
+      ERROR("mqtt plugin: unable to reconnect to broker");
+      return status;
+    }
+  }
 
-  status = mqtt_connect(conf);
-  if (status != 0) {
-    pthread_mutex_unlock(&conf->lock);
-    ERROR("mqtt plugin: unable to reconnect to broker");
-    return status;
+  /* Wait for acknowledgements while the in-flight window is full, so that
+   * the broker isn't sent more than it allows. */
+  if (conf->loop_started && (conf->qos > 0) && (conf->max_inflight > 0)) {
+    cdtime_t deadline = cdtime() + MQTT_INFLIGHT_TIMEOUT;
+    while (conf->connected && (conf->inflight >= conf->max_inflight) &&
+           (cdtime() < deadline))
+      pthread_cond_timedwait(&conf->inflight_cond, &conf->lock,
+                             &CDTIME_T_TO_TIMESPEC(deadline));
+
+    if (conf->inflight >= conf->max_inflight) {
+      c_complain(LOG_ERR, &conf->complaint_cantpublish,
+                 "mqtt plugin: %d messages are waiting for acknowledgement, "
+                 "dropping messages.",
+                 conf->inflight);
+      return -1;
+    }
   }
 
   status = mosquitto_publish(conf->mosq, /* message_id */ NULL, topic,
@@ -430,6 +598,10 @@ static int publish(mqtt_client_conf_t *conf, char const *topic,
                              (int)payload_len, payload,
 #endif
                              conf->qos, conf->retain);
+  /* The library keeps messages with QoS 1 and 2 while disconnected and sends
+   * them once the network loop has reconnected. */
+  if (conf->loop_started && (conf->qos > 0) && (status == MOSQ_ERR_NO_CONN))
+    status = MOSQ_ERR_SUCCESS;
   if (status != MOSQ_ERR_SUCCESS) {
     c_complain(LOG_ERR, &conf->complaint_cantpublish,
                "mqtt plugin: mosquitto_publish failed: %s",
@@ -437,16 +609,28 @@ static int publish(mqtt_client_conf_t *conf, char const *topic,
                                           : mosquitto_strerror(status));
     /* Mark our connection "down" regardless of the error as a safety
      * measure; we will try to reconnect the next time we have to publish a
-     * message */
-    conf->connected = 0;
-    mosquitto_disconnect(conf->mosq);
-
-    pthread_mutex_unlock(&conf->lock);
+     * message. The network loop thread reconnects by itself. */
+    if (!conf->loop_started) {
+      conf->connected = 0;
+      mosquitto_disconnect(conf->mosq);
+    }
     return -1;
   }
 
-  pthread_mutex_unlock(&conf->lock);
+  if (conf->loop_started && (conf->qos > 0))
+    conf->inflight++;
   return 0;
+} /* int publish_locked */
+
+static int publish(mqtt_client_conf_t *conf, char const *topic,
+                   void const *payload, size_t payload_len) {
+  int status;
+
+  pthread_mutex_lock(&conf->lock);
+  status = publish_locked(conf, topic, payload, payload_len);
+  pthread_mutex_unlock(&conf->lock);
+
+  return status;
 } /* int publish */
 
 static int format_topic(char *buf, size_t buf_len, data_set_t const *ds,
@@ -455,23 +639,172 @@ static int format_topic(char *buf, size_t buf_len, data_set_t const *ds,
   int status;
   char *c;
 
+  /* Topics only depend on the identifier, so they are cached per series. */
+  value_list_identity_t const *identity = VALUE_LIST_IDENTITY(vl);
+  if ((identity != NULL) && (conf->topic_cache != NULL) &&
+      (name_cache_get(conf->topic_cache, identity, NAME_CACHE_KEY_INIT, buf,
+                      buf_len) == 0))
+    return 0;
+
+  if ((conf->topic_prefix == NULL) || (conf->topic_prefix[0] == 0)) {
+    status = FORMAT_VL(buf, buf_len, vl);
+    if (status != 0)
+      return status;
+  } else {
+    status = FORMAT_VL(name, sizeof(name), vl);
+    if (status != 0)
+      return status;
+
+    status = snprintf(buf, buf_len, "%s/%s", conf->topic_prefix, name);
+    if ((status < 0) || (((size_t)status) >= buf_len))
+      return ENOMEM;
+
+    while ((c = strchr(buf, '#')) || (c = strchr(buf, '+'))) {
+      *c = '_';
+    }
+  }
+
+  if ((identity != NULL) && (conf->topic_cache != NULL))
+    name_cache_set(conf->topic_cache, identity, NAME_CACHE_KEY_INIT, buf);
+  return 0;
+} /* int format_topic */
+
+/* Publishes the batch of one host. must hold conf->lock when calling. */
+static int mqtt_batch_publish(mqtt_client_conf_t *conf, /* {{{ */
+                              mqtt_batch_t *b) {
+  char topic[MQTT_MAX_TOPIC_SIZE];
+  char *c;
+  int status;
+
   if ((conf->topic_prefix == NULL) || (conf->topic_prefix[0] == 0))
-    return FORMAT_VL(buf, buf_len, vl);
+    sstrncpy(topic, b->host, sizeof(topic));
+  else
+    snprintf(topic, sizeof(topic), "%s/%s", conf->topic_prefix, b->host);
+  while ((c = strchr(topic, '#')) || (c = strchr(topic, '+')))
+    *c = '_';
+
+  /* The lock may be released while waiting for the in-flight window, so the
+   * payload is taken out of the batch. */
+  char *payload = b->payload;
+  size_t payload_size = b->size;
+  size_t payload_len = b->fill + 1;
+  b->payload = NULL;
+  b->size = 0;
+  b->fill = 0;
+
+  status = publish_locked(conf, topic, payload, payload_len);
+
+  if (b->payload == NULL) {
+    b->payload = payload;
+    b->size = payload_size;
+    b->payload[0] = 0;
+  } else {
+    sfree(payload);
+  }
+
+  return status;
+} /* }}} int mqtt_batch_publish */
 
-  status = FORMAT_VL(name, sizeof(name), vl);
-  if (status != 0)
+/* Publishes the batches which are older than "timeout", all of them if
+ * "timeout" is zero. must hold conf->lock when calling. */
+static int mqtt_batches_publish(mqtt_client_conf_t *conf, /* {{{ */
+                                cdtime_t timeout) {
+  cdtime_t now = cdtime();
+  int status = 0;
+
+  for (mqtt_batch_t *b = conf->batches; b != NULL; b = b->next) {
+    if ((b->fill == 0) || ((timeout != 0) && ((b->time + timeout) > now)))
+      continue;
+    if (mqtt_batch_publish(conf, b) != 0)
+      status = -1;
+  }
+
+  return status;
+} /* }}} int mqtt_batches_publish */
+
+static int mqtt_write_batch(mqtt_client_conf_t *conf, /* {{{ */
+                            data_set_t const *ds, value_list_t const *vl) {
+  char name[MQTT_MAX_TOPIC_SIZE];
+  char values[MQTT_MAX_MESSAGE_SIZE];
+  int status;
+
+  value_list_identity_t const *identity = VALUE_LIST_IDENTITY(vl);
+  if (identity != NULL)
+    sstrncpy(name, identity->name, sizeof(name));
+  else if ((status = FORMAT_VL(name, sizeof(name), vl)) != 0) {
+    ERROR("mqtt plugin: FORMAT_VL failed with status %d.", status);
     return status;
+  }
 
-  status = snprintf(buf, buf_len, "%s/%s", conf->topic_prefix, name);
-  if ((status < 0) || (((size_t)status) >= buf_len))
-    return ENOMEM;
+  status = format_values(values, sizeof(values), ds, vl, conf->store_rates);
+  if (status != 0) {
+    ERROR("mqtt plugin: format_values failed with status %d.", status);
+    return status;
+  }
 
-  while ((c = strchr(buf, '#')) || (c = strchr(buf, '+'))) {
-    *c = '_';
+  size_t name_len = strlen(name);
+  size_t values_len = strlen(values);
+
+  pthread_mutex_lock(&conf->lock);
+
+  mqtt_batch_t *b = conf->batches;
+  while ((b != NULL) && (strcmp(b->host, vl->host) != 0))
+    b = b->next;
+  if (b == NULL) {
+    b = calloc(1, sizeof(*b));
+    if (b == NULL) {
+      pthread_mutex_unlock(&conf->lock);
+      ERROR("mqtt plugin: calloc failed.");
+      return ENOMEM;
+    }
+    sstrncpy(b->host, vl->host, sizeof(b->host));
+    b->next = conf->batches;
+    conf->batches = b;
   }
 
-  return 0;
-} /* int format_topic */
+  /* "<name> <values>\n" and the terminating null byte. */
+  size_t needed = b->fill + name_len + values_len + 3;
+  if (needed > b->size) {
+    size_t size = (b->size > 0) ? b->size : 1024;
+    while (size < needed)
+      size *= 2;
+
+    char *tmp = realloc(b->payload, size);
+    if (tmp == NULL) {
+      pthread_mutex_unlock(&conf->lock);
+      ERROR("mqtt plugin: realloc failed.");
+      return ENOMEM;
+    }
+    b->payload = tmp;
+    b->size = size;
+  }
+
+  if (b->fill == 0)
+    b->time = cdtime();
+  memcpy(b->payload + b->fill, name, name_len);
+  b->fill += name_len;
+  b->payload[b->fill++] = ' ';
+  memcpy(b->payload + b->fill, values, values_len);
+  b->fill += values_len;
+  b->payload[b->fill++] = '\n';
+  b->payload[b->fill] = 0;
+
+  status = 0;
+  if (b->fill >= conf->batch_size)
+    status = mqtt_batch_publish(conf, b);
+
+  /* Batches of hosts which don't send enough values are published here
+   * rather than by a thread of their own. */
+  cdtime_t now = cdtime();
+  if (now >= conf->batches_next_check) {
+    if (mqtt_batches_publish(conf, conf->batch_timeout) != 0)
+      status = -1;
+    conf->batches_next_check = now + conf->batch_timeout / 2;
+  }
+
+  pthread_mutex_unlock(&conf->lock);
+  return status;
+} /* }}} int mqtt_write_batch */
 
 static int mqtt_write(const data_set_t *ds, const value_list_t *vl,
                       user_data_t *user_data) {
@@ -484,6 +817,9 @@ static int mqtt_write(const data_set_t *ds, const value_list_t *vl,
     return EINVAL;
   conf = user_data->data;
 
+  if (conf->batch_size > 0)
+    return mqtt_write_batch(conf, ds, vl);
+
   status = format_topic(topic, sizeof(topic), ds, vl, conf);
   if (status != 0) {
     ERROR("mqtt plugin: format_topic failed with status %d.", status);
@@ -505,6 +841,19 @@ static int mqtt_write(const data_set_t *ds, const value_list_t *vl,
   return status;
 } /* mqtt_write */
 
+static int mqtt_flush(cdtime_t timeout,
+                      __attribute__((unused)) char const *identifier,
+                      user_data_t *user_data) {
+  mqtt_client_conf_t *conf = user_data->data;
+  int status;
+
+  pthread_mutex_lock(&conf->lock);
+  status = mqtt_batches_publish(conf, timeout);
+  pthread_mutex_unlock(&conf->lock);
+
+  return status;
+} /* int mqtt_flush */
+
 /*
  * <Publish "name">
  *   Host "example.com"
@@ -516,6 +865,9 @@ static int mqtt_write(const data_set_t *ds, const value_list_t *vl,
  *   StoreRates true
  *   Retain false
  *   QoS 0
+ *   MaxInflight 0
+ *   BatchSize 0                          Publishes per host if set
+ *   BatchTimeout 1
  *   CACert "ca.pem"                      Enables TLS if set
  *   CertificateFile "client-cert.pem"	  optional
  *   CertificateKeyFile "client-key.pem"  optional
@@ -547,12 +899,18 @@ static int mqtt_config_publisher(oconfig_item_t *ci) {
   conf->qos = 0;
   conf->topic_prefix = strdup(MQTT_DEFAULT_TOPIC_PREFIX);
   conf->store_rates = 1;
+  conf->batch_timeout = MQTT_DEFAULT_BATCH_TIMEOUT;
 
   status = pthread_mutex_init(&conf->lock, NULL);
   if (status != 0) {
     mqtt_free(conf);
     return status;
   }
+  pthread_cond_init(&conf->inflight_cond, /* attr = */ NULL);
+
+  conf->topic_cache = name_cache_create(MQTT_TOPIC_CACHE_SIZE);
+  if (conf->topic_cache == NULL)
+    WARNING("mqtt plugin: Creating the topic cache failed.");
 
   C_COMPLAIN_INIT(&conf->complaint_cantpublish);
 
@@ -579,6 +937,32 @@ static int mqtt_config_publisher(oconfig_item_t *ci) {
         ERROR("mqtt plugin: Not a valid QoS setting.");
       else
         conf->qos = tmp;
+    } else if (strcasecmp("MaxInflight", child->key) == 0) {
+      int tmp = -1;
+      status = cf_util_get_int(child, &tmp);
+      if ((status != 0) || (tmp < 0))
+        ERROR("mqtt plugin: Not a valid MaxInflight setting.");
+      else
+        conf->max_inflight = tmp;
+#if LIBMOSQUITTO_MAJOR == 0
+      if (conf->max_inflight > 0)
+        WARNING("mqtt plugin: MaxInflight requires libmosquitto 1.0 or "
+                "later and will be ignored.");
+#endif
+    } else if (strcasecmp("BatchSize", child->key) == 0) {
+      int tmp = -1;
+      status = cf_util_get_int(child, &tmp);
+      if ((status != 0) || (tmp < 0))
+        ERROR("mqtt plugin: Not a valid BatchSize setting.");
+      else
+        conf->batch_size = (size_t)tmp;
+    } else if (strcasecmp("BatchTimeout", child->key) == 0) {
+      cdtime_t tmp = 0;
+      status = cf_util_get_cdtime(child, &tmp);
+      if ((status != 0) || (tmp == 0))
+        ERROR("mqtt plugin: Not a valid BatchTimeout setting.");
+      else
+        conf->batch_timeout = tmp;
     } else if (strcasecmp("Prefix", child->key) == 0)
       cf_util_get_string(child, &conf->topic_prefix);
     else if (strcasecmp("StoreRates", child->key) == 0)
@@ -601,6 +985,10 @@ static int mqtt_config_publisher(oconfig_item_t *ci) {
 
   snprintf(cb_name, sizeof(cb_name), "mqtt/%s", conf->name);
   plugin_register_write(cb_name, mqtt_write,
+                        &(user_data_t){
+                            .data = conf, .free_func = mqtt_free,
+                        });
+  plugin_register_flush(cb_name, mqtt_flush,
                         &(user_data_t){
                             .data = conf,
                         });
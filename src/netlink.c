@@ -29,6 +29,7 @@
 
 #include "common.h"
 #include "plugin.h"
+#include "utils_rtnl_stats.h"
 
 #include <asm/types.h>
 
@@ -43,41 +44,6 @@
 
 #include <libmnl/libmnl.h>
 
-struct ir_link_stats_storage_s {
-
-  uint64_t rx_packets;
-  uint64_t tx_packets;
-  uint64_t rx_bytes;
-  uint64_t tx_bytes;
-  uint64_t rx_errors;
-  uint64_t tx_errors;
-
-  uint64_t rx_dropped;
-  uint64_t tx_dropped;
-  uint64_t multicast;
-  uint64_t collisions;
-
-  uint64_t rx_length_errors;
-  uint64_t rx_over_errors;
-  uint64_t rx_crc_errors;
-  uint64_t rx_frame_errors;
-  uint64_t rx_fifo_errors;
-  uint64_t rx_missed_errors;
-
-  uint64_t tx_aborted_errors;
-  uint64_t tx_carrier_errors;
-  uint64_t tx_fifo_errors;
-  uint64_t tx_heartbeat_errors;
-  uint64_t tx_window_errors;
-};
-
-union ir_link_stats_u {
-  struct rtnl_link_stats *stats32;
-#ifdef HAVE_RTNL_LINK_STATS64
-  struct rtnl_link_stats64 *stats64;
-#endif
-};
-
 typedef struct ir_ignorelist_s {
   char *device;
   char *type;
@@ -94,6 +60,15 @@ static int ir_ignorelist_invert = 1;
 static ir_ignorelist_t *ir_ignorelist_head = NULL;
 
 static struct mnl_socket *nl;
+static rtnl_stats_t *rtnl_stats;
+
+/* Value lists are collected and dispatched in batches, so that the write
+ * queue is not locked once per value list on hosts with thousands of
+ * interfaces. */
+#define IR_BATCH_SIZE 256
+static value_list_t ir_batch[IR_BATCH_SIZE];
+static value_t ir_batch_values[2 * IR_BATCH_SIZE];
+static size_t ir_batch_num;
 
 static char **iflist = NULL;
 static size_t iflist_len = 0;
@@ -177,69 +152,85 @@ static int check_ignorelist(const char *dev, const char *type,
   return ir_ignorelist_invert;
 } /* int check_ignorelist */
 
-static void submit_one(const char *dev, const char *type,
-                       const char *type_instance, derive_t value) {
-  value_list_t vl = VALUE_LIST_INIT;
+static void ir_batch_flush(void) {
+  if (ir_batch_num == 0)
+    return;
+
+  plugin_dispatch_values_batch(ir_batch, ir_batch_num);
+  ir_batch_num = 0;
+} /* void ir_batch_flush */
+
+static void ir_batch_add(const char *dev, const char *type,
+                         const char *type_instance, value_t const *values,
+                         size_t values_num) {
+  value_list_t *vl;
 
-  vl.values = &(value_t){.derive = value};
-  vl.values_len = 1;
-  sstrncpy(vl.plugin, "netlink", sizeof(vl.plugin));
-  sstrncpy(vl.plugin_instance, dev, sizeof(vl.plugin_instance));
-  sstrncpy(vl.type, type, sizeof(vl.type));
+  assert(values_num <= 2);
+
+  if (ir_batch_num >= IR_BATCH_SIZE)
+    ir_batch_flush();
+
+  vl = ir_batch + ir_batch_num;
+  *vl = (value_list_t)VALUE_LIST_INIT;
+  vl->values = ir_batch_values + 2 * ir_batch_num;
+  memcpy(vl->values, values, values_num * sizeof(*values));
+  vl->values_len = values_num;
+  sstrncpy(vl->plugin, "netlink", sizeof(vl->plugin));
+  sstrncpy(vl->plugin_instance, dev, sizeof(vl->plugin_instance));
+  sstrncpy(vl->type, type, sizeof(vl->type));
 
   if (type_instance != NULL)
-    sstrncpy(vl.type_instance, type_instance, sizeof(vl.type_instance));
+    sstrncpy(vl->type_instance, type_instance, sizeof(vl->type_instance));
+
+  ir_batch_num++;
+} /* void ir_batch_add */
+
+static void submit_one(const char *dev, const char *type,
+                       const char *type_instance, derive_t value) {
+  value_t values[] = {
+      {.derive = value},
+  };
 
-  plugin_dispatch_values(&vl);
+  ir_batch_add(dev, type, type_instance, values, STATIC_ARRAY_SIZE(values));
 } /* void submit_one */
 
 static void submit_two(const char *dev, const char *type,
                        const char *type_instance, derive_t rx, derive_t tx) {
-  value_list_t vl = VALUE_LIST_INIT;
   value_t values[] = {
       {.derive = rx}, {.derive = tx},
   };
 
-  vl.values = values;
-  vl.values_len = STATIC_ARRAY_SIZE(values);
-  sstrncpy(vl.plugin, "netlink", sizeof(vl.plugin));
-  sstrncpy(vl.plugin_instance, dev, sizeof(vl.plugin_instance));
-  sstrncpy(vl.type, type, sizeof(vl.type));
-
-  if (type_instance != NULL)
-    sstrncpy(vl.type_instance, type_instance, sizeof(vl.type_instance));
-
-  plugin_dispatch_values(&vl);
+  ir_batch_add(dev, type, type_instance, values, STATIC_ARRAY_SIZE(values));
 } /* void submit_two */
 
-static int update_iflist(struct ifinfomsg *msg, const char *dev) {
+static int update_iflist(int ifindex, const char *dev) {
   /* Update the `iflist'. It's used to know which interfaces exist and query
    * them later for qdiscs and classes. */
-  if ((msg->ifi_index >= 0) && ((size_t)msg->ifi_index >= iflist_len)) {
+  if ((ifindex >= 0) && ((size_t)ifindex >= iflist_len)) {
     char **temp;
 
-    temp = realloc(iflist, (msg->ifi_index + 1) * sizeof(char *));
+    temp = realloc(iflist, (ifindex + 1) * sizeof(char *));
     if (temp == NULL) {
       ERROR("netlink plugin: update_iflist: realloc failed.");
       return -1;
     }
 
     memset(temp + iflist_len, '\0',
-           (msg->ifi_index + 1 - iflist_len) * sizeof(char *));
+           (ifindex + 1 - iflist_len) * sizeof(char *));
     iflist = temp;
-    iflist_len = msg->ifi_index + 1;
+    iflist_len = ifindex + 1;
   }
-  if ((iflist[msg->ifi_index] == NULL) ||
-      (strcmp(iflist[msg->ifi_index], dev) != 0)) {
-    sfree(iflist[msg->ifi_index]);
-    iflist[msg->ifi_index] = strdup(dev);
+  if ((iflist[ifindex] == NULL) ||
+      (strcmp(iflist[ifindex], dev) != 0)) {
+    sfree(iflist[ifindex]);
+    iflist[ifindex] = strdup(dev);
   }
 
   return 0;
 } /* int update_iflist */
 
 static void check_ignorelist_and_submit(const char *dev,
-                                        struct ir_link_stats_storage_s *stats) {
+                                        rtnl_stats_link_t const *stats) {
 
   if (check_ignorelist(dev, "interface", NULL) == 0) {
     submit_two(dev, "if_octets", NULL, stats->rx_bytes, stats->tx_bytes);
@@ -272,127 +263,14 @@ static void check_ignorelist_and_submit(const char *dev,
 
 } /* void check_ignorelist_and_submit */
 
-#define COPY_RTNL_LINK_VALUE(dst_stats, src_stats, value_name)                 \
-  (dst_stats)->value_name = (src_stats)->value_name
-
-#define COPY_RTNL_LINK_STATS(dst_stats, src_stats)                             \
-  COPY_RTNL_LINK_VALUE(dst_stats, src_stats, rx_packets);                      \
-  COPY_RTNL_LINK_VALUE(dst_stats, src_stats, tx_packets);                      \
-  COPY_RTNL_LINK_VALUE(dst_stats, src_stats, rx_bytes);                        \
-  COPY_RTNL_LINK_VALUE(dst_stats, src_stats, tx_bytes);                        \
-  COPY_RTNL_LINK_VALUE(dst_stats, src_stats, rx_errors);                       \
-  COPY_RTNL_LINK_VALUE(dst_stats, src_stats, tx_errors);                       \
-  COPY_RTNL_LINK_VALUE(dst_stats, src_stats, rx_dropped);                      \
-  COPY_RTNL_LINK_VALUE(dst_stats, src_stats, tx_dropped);                      \
-  COPY_RTNL_LINK_VALUE(dst_stats, src_stats, multicast);                       \
-  COPY_RTNL_LINK_VALUE(dst_stats, src_stats, collisions);                      \
-  COPY_RTNL_LINK_VALUE(dst_stats, src_stats, rx_length_errors);                \
-  COPY_RTNL_LINK_VALUE(dst_stats, src_stats, rx_over_errors);                  \
-  COPY_RTNL_LINK_VALUE(dst_stats, src_stats, rx_crc_errors);                   \
-  COPY_RTNL_LINK_VALUE(dst_stats, src_stats, rx_frame_errors);                 \
-  COPY_RTNL_LINK_VALUE(dst_stats, src_stats, rx_fifo_errors);                  \
-  COPY_RTNL_LINK_VALUE(dst_stats, src_stats, rx_missed_errors);                \
-  COPY_RTNL_LINK_VALUE(dst_stats, src_stats, tx_aborted_errors);               \
-  COPY_RTNL_LINK_VALUE(dst_stats, src_stats, tx_carrier_errors);               \
-  COPY_RTNL_LINK_VALUE(dst_stats, src_stats, tx_fifo_errors);                  \
-  COPY_RTNL_LINK_VALUE(dst_stats, src_stats, tx_heartbeat_errors);             \
-  COPY_RTNL_LINK_VALUE(dst_stats, src_stats, tx_window_errors)
-
-#ifdef HAVE_RTNL_LINK_STATS64
-static void check_ignorelist_and_submit64(const char *dev,
-                                          struct rtnl_link_stats64 *stats) {
-  struct ir_link_stats_storage_s s;
-
-  COPY_RTNL_LINK_STATS(&s, stats);
-
-  check_ignorelist_and_submit(dev, &s);
-}
-#endif
-
-static void check_ignorelist_and_submit32(const char *dev,
-                                          struct rtnl_link_stats *stats) {
-  struct ir_link_stats_storage_s s;
-
-  COPY_RTNL_LINK_STATS(&s, stats);
-
-  check_ignorelist_and_submit(dev, &s);
-}
-
-static int link_filter_cb(const struct nlmsghdr *nlh,
-                          void *args __attribute__((unused))) {
-  struct ifinfomsg *ifm = mnl_nlmsg_get_payload(nlh);
-  struct nlattr *attr;
-  const char *dev = NULL;
-  union ir_link_stats_u stats;
-
-  if (nlh->nlmsg_type != RTM_NEWLINK) {
-    ERROR("netlink plugin: link_filter_cb: Don't know how to handle type %i.",
-          nlh->nlmsg_type);
-    return MNL_CB_ERROR;
-  }
-
-  /* Scan attribute list for device name. */
-  mnl_attr_for_each(attr, nlh, sizeof(*ifm)) {
-    if (mnl_attr_get_type(attr) != IFLA_IFNAME)
-      continue;
-
-    if (mnl_attr_validate(attr, MNL_TYPE_STRING) < 0) {
-      ERROR("netlink plugin: link_filter_cb: IFLA_IFNAME mnl_attr_validate "
-            "failed.");
-      return MNL_CB_ERROR;
-    }
-
-    dev = mnl_attr_get_str(attr);
-    if (update_iflist(ifm, dev) < 0)
-      return MNL_CB_ERROR;
-    break;
-  }
-
-  if (dev == NULL) {
-    ERROR("netlink plugin: link_filter_cb: dev == NULL");
-    return MNL_CB_ERROR;
-  }
-#ifdef HAVE_RTNL_LINK_STATS64
-  mnl_attr_for_each(attr, nlh, sizeof(*ifm)) {
-    if (mnl_attr_get_type(attr) != IFLA_STATS64)
-      continue;
-
-    if (mnl_attr_validate2(attr, MNL_TYPE_UNSPEC, sizeof(*stats.stats64)) < 0) {
-      char errbuf[1024];
-      ERROR("netlink plugin: link_filter_cb: IFLA_STATS64 mnl_attr_validate2 "
-            "failed: %s",
-            sstrerror(errno, errbuf, sizeof(errbuf)));
-      return MNL_CB_ERROR;
-    }
-    stats.stats64 = mnl_attr_get_payload(attr);
-
-    check_ignorelist_and_submit64(dev, stats.stats64);
-
-    return MNL_CB_OK;
-  }
-#endif
-  mnl_attr_for_each(attr, nlh, sizeof(*ifm)) {
-    if (mnl_attr_get_type(attr) != IFLA_STATS)
-      continue;
-
-    if (mnl_attr_validate2(attr, MNL_TYPE_UNSPEC, sizeof(*stats.stats32)) < 0) {
-      char errbuf[1024];
-      ERROR("netlink plugin: link_filter_cb: IFLA_STATS mnl_attr_validate2 "
-            "failed: %s",
-            sstrerror(errno, errbuf, sizeof(errbuf)));
-      return MNL_CB_ERROR;
-    }
-    stats.stats32 = mnl_attr_get_payload(attr);
-
-    check_ignorelist_and_submit32(dev, stats.stats32);
-
-    return MNL_CB_OK;
-  }
-
-  DEBUG("netlink plugin: link_filter: No statistics for interface %s.", dev);
-  return MNL_CB_OK;
+static void link_stats_cb(int ifindex, char const *dev,
+                          rtnl_stats_link_t const *stats,
+                          void __attribute__((unused)) * user_data) {
+  if (update_iflist(ifindex, dev) < 0)
+    return;
 
-} /* int link_filter_cb */
+  check_ignorelist_and_submit(dev, stats);
+} /* void link_stats_cb */
 
 #if HAVE_TCA_STATS2
 static int qos_attr_cb(const struct nlattr *attr, void *data) {
@@ -659,13 +537,18 @@ static int ir_init(void) {
     return -1;
   }
 
+  rtnl_stats = rtnl_stats_create();
+  if (rtnl_stats == NULL) {
+    ERROR("netlink plugin: ir_init: rtnl_stats_create failed.");
+    return -1;
+  }
+
   return 0;
 } /* int ir_init */
 
 static int ir_read(void) {
   char buf[MNL_SOCKET_BUFFER_SIZE];
   struct nlmsghdr *nlh;
-  struct rtgenmsg *rt;
   int ret;
   unsigned int seq, portid;
 
@@ -674,33 +557,15 @@ static int ir_read(void) {
 
   portid = mnl_socket_get_portid(nl);
 
-  nlh = mnl_nlmsg_put_header(buf);
-  nlh->nlmsg_type = RTM_GETLINK;
-  nlh->nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
-  nlh->nlmsg_seq = seq = time(NULL);
-  rt = mnl_nlmsg_put_extra_header(nlh, sizeof(*rt));
-  rt->rtgen_family = AF_PACKET;
-
-  if (mnl_socket_sendto(nl, nlh, nlh->nlmsg_len) < 0) {
-    ERROR("netlink plugin: ir_read: rtnl_wilddump_request failed.");
+  ret = rtnl_stats_read(rtnl_stats, link_stats_cb, /* user_data = */ NULL);
+  if (ret != 0) {
+    ERROR("netlink plugin: ir_read: Reading link statistics failed: %s",
+          STRERROR(ret));
+    ir_batch_flush();
     return -1;
   }
 
-  ret = mnl_socket_recvfrom(nl, buf, sizeof(buf));
-  while (ret > 0) {
-    ret = mnl_cb_run(buf, ret, seq, portid, link_filter_cb, NULL);
-    if (ret <= MNL_CB_STOP)
-      break;
-    ret = mnl_socket_recvfrom(nl, buf, sizeof(buf));
-  }
-  if (ret < 0) {
-    char errbuf[1024];
-    ERROR("netlink plugin: ir_read: mnl_socket_recvfrom failed: %s",
-          sstrerror(errno, errbuf, sizeof(errbuf)));
-    return (-1);
-  }
-
-  /* `link_filter_cb' will update `iflist' which is used here to iterate
+  /* `link_stats_cb' will update `iflist' which is used here to iterate
    * over all interfaces. */
   for (size_t ifindex = 1; ifindex < iflist_len; ifindex++) {
     struct tcmsg *tm;
@@ -749,6 +614,8 @@ static int ir_read(void) {
     } /* for (type_index) */
   }   /* for (if_index) */
 
+  ir_batch_flush();
+
   return 0;
 } /* int ir_read */
 
@@ -758,6 +625,9 @@ static int ir_shutdown(void) {
     nl = NULL;
   }
 
+  rtnl_stats_destroy(rtnl_stats);
+  rtnl_stats = NULL;
+
   return 0;
 } /* int ir_shutdown */
 
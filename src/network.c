@@ -22,6 +22,7 @@
  *   Aman Gupta <aman at tmm1.net>
  **/
 
+#define _GNU_SOURCE /* For recvmmsg(2) and sendmmsg(2) */
 #define _DEFAULT_SOURCE
 #define _BSD_SOURCE /* For struct ip_mreq */
 
@@ -29,9 +30,13 @@
 
 #include "common.h"
 #include "plugin.h"
+#include "utils_avltree.h"
 #include "utils_cache.h"
 #include "utils_complain.h"
 #include "utils_fbhash.h"
+#include "utils_fdstore.h"
+#include "utils_rcvbuf.h"
+#include "utils_topk.h"
 
 #include "network.h"
 
@@ -41,6 +46,9 @@
 #if HAVE_NETINET_IN_H
 #include <netinet/in.h>
 #endif
+#if HAVE_NETINET_TCP_H
+#include <netinet/tcp.h>
+#endif
 #if HAVE_ARPA_INET_H
 #include <arpa/inet.h>
 #endif
@@ -71,9 +79,15 @@
 #endif
 #if GCRYPT_VERSION_NUMBER < 0x010600
 GCRY_THREAD_OPTION_PTHREAD_IMPL;
+#else
+#define HAVE_GCRYPT_GCM 1
 #endif
 #endif
 
+#if HAVE_LZ4_H
+#include <lz4.h>
+#endif
+
 #ifndef IPV6_ADD_MEMBERSHIP
 #ifdef IPV6_JOIN_GROUP
 #define IPV6_ADD_MEMBERSHIP IPV6_JOIN_GROUP
@@ -92,6 +106,18 @@ GCRY_THREAD_OPTION_PTHREAD_IMPL;
  */
 #define BUFF_SIG_SIZE 106
 
+/*
+ * With `Protocol TCP', every datagram is sent over the connection prefixed
+ * with its length as a 16 bit integer in network byte order.
+ */
+#define NETWORK_STREAM_HEADER_SIZE 2
+#define NETWORK_STREAM_BUFFER_SIZE (NETWORK_STREAM_HEADER_SIZE + UINT16_MAX)
+/* A send blocking for longer than this closes the connection. */
+#define NETWORK_STREAM_SEND_TIMEOUT 2
+/* Failed connection attempts are retried after 1, 2, 4, ... seconds. */
+#define NETWORK_STREAM_BACKOFF_MIN TIME_T_TO_CDTIME_T(1)
+#define NETWORK_STREAM_BACKOFF_MAX TIME_T_TO_CDTIME_T(64)
+
 /*
  * Private data types
  */
@@ -99,6 +125,9 @@ GCRY_THREAD_OPTION_PTHREAD_IMPL;
 #if HAVE_GCRYPT_H
 #define SECURITY_LEVEL_SIGN 1
 #define SECURITY_LEVEL_ENCRYPT 2
+
+#define CIPHER_AES256_OFB 0
+#define CIPHER_AES256_GCM 1
 #endif
 struct sockent_client {
   int fd;
@@ -106,23 +135,36 @@ struct sockent_client {
   socklen_t addrlen;
 #if HAVE_GCRYPT_H
   int security_level;
+  int cipher;
   char *username;
   char *password;
   gcry_cipher_hd_t cypher;
+  gcry_cipher_hd_t gcm_cypher;
+  gcry_md_hd_t hmac;
   unsigned char password_hash[32];
+  /* The GCM nonce is a random prefix followed by a counter. */
+  unsigned char nonce_prefix[8];
+  uint32_t nonce_counter;
+  /* Signed or encrypted datagrams of the batch being sent. */
+  char *batch_buffer;
+  size_t *batch_len;
 #endif
   cdtime_t next_resolve_reconnect;
   cdtime_t resolve_interval;
+  /* Reconnect backoff of stream sockets */
+  cdtime_t next_connect;
+  cdtime_t connect_backoff;
 };
 
 struct sockent_server {
   int *fd;
+  /* Receive buffer and drops of each datagram socket in "fd". */
+  rcvbuf_t *rcvbuf;
   size_t fd_num;
 #if HAVE_GCRYPT_H
   int security_level;
   char *auth_file;
   fbhash_t *userdb;
-  gcry_cipher_hd_t cypher;
 #endif
 };
 
@@ -134,6 +176,8 @@ typedef struct sockent {
   char *node;
   char *service;
   int interface;
+  /* SOCK_DGRAM or SOCK_STREAM */
+  int socktype;
 
   union {
     struct sockent_client client;
@@ -250,14 +294,79 @@ struct part_encryption_aes256_s {
 };
 typedef struct part_encryption_aes256_s part_encryption_aes256_t;
 
+/*                      1 1 1 1 1 1 1 1 1 1 2 2 2 2 2 2 2 2 2 2 3 3
+ *  0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+ * +-------------------------------+-------------------------------+
+ * ! Type                          ! Length                        !
+ * +-------------------------------+-------------------------------+
+ * ! Username length               ! Username                      :
+ * +-------------------------------+-------------------------------+
+ * : Username (cont.)              ! IV (96 bits)                  :
+ * +-------------------------------+-------------------------------+
+ * : Authentication tag (128 bits)                                 :
+ * +---------------------------------------------------------------+
+ * : Encrypted payload                                             :
+ * +---------------------------------------------------------------+
+ *
+ * The type, length, username length and username are authenticated but not
+ * encrypted.
+ */
+/* Minimum size */
+#define PART_ENCRYPTION_AES256_GCM_SIZE 34
+#define PART_ENCRYPTION_AES256_GCM_IV_SIZE 12
+#define PART_ENCRYPTION_AES256_GCM_TAG_SIZE 16
+
 struct receive_list_entry_s {
   char *data;
   int data_len;
-  int fd;
+  sockent_t *se;
+  struct sockaddr_storage addr;
   struct receive_list_entry_s *next;
 };
 typedef struct receive_list_entry_s receive_list_entry_t;
 
+struct receive_list_s {
+  receive_list_entry_t *head;
+  receive_list_entry_t *tail;
+  uint64_t length;
+};
+typedef struct receive_list_s receive_list_t;
+
+/* All packets received on one socket are queued for the same dispatch thread,
+ * so that packets from one sender are parsed in order. */
+struct receive_queue_s {
+  receive_list_t list;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  pthread_t thread;
+  _Bool thread_running;
+};
+typedef struct receive_queue_s receive_queue_t;
+
+/* Receive state of an accepted stream connection. */
+struct receive_stream_s {
+  char buffer[NETWORK_STREAM_BUFFER_SIZE];
+  size_t fill;
+  struct sockaddr_storage addr;
+};
+typedef struct receive_stream_s receive_stream_t;
+
+struct receive_thread_s {
+  struct pollfd *pollfd;
+  /* Socket entry and index of the receive queue for each entry in "pollfd".
+   * "stream" is NULL for datagram and listening sockets. Accepted connections
+   * are appended to these arrays by the receive thread. */
+  sockent_t **sockent;
+  size_t *queue;
+  receive_stream_t **stream;
+  rcvbuf_t **rcvbuf;
+  size_t pollfd_num;
+  size_t pollfd_size;
+  pthread_t thread;
+  _Bool thread_running;
+};
+typedef struct receive_thread_s receive_thread_t;
+
 /*
  * Private variables
  */
@@ -265,42 +374,86 @@ static int network_config_ttl = 0;
 /* Ethernet - (IPv6 + UDP) = 1500 - (40 + 8) = 1452 */
 static size_t network_config_packet_size = 1452;
 static _Bool network_config_forward = 0;
+static _Bool network_config_forward_passthrough = 0;
+static _Bool network_config_forward_rebatch = 1;
 static _Bool network_config_stats = 0;
+static size_t network_config_receive_threads = 1;
+static size_t network_config_dispatch_threads = 1;
+static size_t network_config_send_batch = 1;
+static int network_config_receive_buffer = 0;
+static _Bool network_config_receive_buffer_auto = 1;
+static _Bool network_config_compact = 0;
 
 static sockent_t *sending_sockets = NULL;
 
-static receive_list_entry_t *receive_list_head = NULL;
-static receive_list_entry_t *receive_list_tail = NULL;
-static pthread_mutex_t receive_list_lock = PTHREAD_MUTEX_INITIALIZER;
-static pthread_cond_t receive_list_cond = PTHREAD_COND_INITIALIZER;
-static uint64_t receive_list_length = 0;
+static receive_queue_t *receive_queues = NULL;
+static size_t receive_queues_num = 0;
+
+/* Number of datagrams read from a socket with one system call. */
+#define NETWORK_RECEIVE_BATCH 64
+/* Upper bound for the memory held by idle entries in the receive pool. */
+#define NETWORK_RECEIVE_POOL_SIZE (16 * 1024 * 1024)
+
+/* Entries (and their packet buffers) are recycled through this free list
+ * instead of being allocated for every received packet. */
+static receive_list_entry_t *receive_pool_head = NULL;
+static size_t receive_pool_length = 0;
+static pthread_mutex_t receive_pool_lock = PTHREAD_MUTEX_INITIALIZER;
 
 static sockent_t *listen_sockets = NULL;
 static struct pollfd *listen_sockets_pollfd = NULL;
 static size_t listen_sockets_num = 0;
 
+static receive_thread_t *receive_threads = NULL;
+static size_t receive_threads_num = 0;
+
 /* The receive and dispatch threads will run as long as `listen_loop' is set to
  * zero. */
 static int listen_loop = 0;
-static int receive_thread_running = 0;
-static pthread_t receive_thread_id;
-static int dispatch_thread_running = 0;
-static pthread_t dispatch_thread_id;
 
-/* Buffer in which to-be-sent network packets are constructed. */
+/* Buffer in which to-be-sent network packets are constructed. It is one of
+ * the "SendBatchSize" slots of "send_batch"; finished packets stay in their
+ * slot until the batch is sent. All of this is protected by send_buffer_lock.
+ */
+static char *send_batch;
+static size_t *send_batch_len;
+static size_t send_batch_num;
 static char *send_buffer;
 static char *send_buffer_ptr;
 static int send_buffer_fill;
 static cdtime_t send_buffer_last_update;
+static size_t send_buffer_size;
 static value_list_t send_buffer_vl = VALUE_LIST_INIT;
+/* Values of the previous TYPE_VALUES_VARINT / TYPE_VALUES_DELTA part in
+ * "send_buffer", which TYPE_VALUES_DELTA parts are relative to. */
+static value_t *send_buffer_base;
+static uint8_t *send_buffer_base_types;
+static size_t send_buffer_base_num;
+static size_t send_buffer_base_size;
 static pthread_mutex_t send_buffer_lock = PTHREAD_MUTEX_INITIALIZER;
 
-/* XXX: These counters are incremented from one place only. The spot in which
- * the values are incremented is either only reachable by one thread (the
- * dispatch thread, for example) or locked by some lock (send_buffer_lock for
- * example). Only if neither is true, the stats_lock is acquired. The counters
- * are always read without holding a lock in the hope that writing 8 bytes to
- * memory is an atomic operation. */
+#if HAVE_LZ4_H
+/* With "Compress" enabled, values are written into segments of
+ * "send_buffer_size" bytes, each of which can be parsed on its own. Finished
+ * segments are queued in "compress_pending", followed by the segment that is
+ * currently being filled, and as many of them as fit are compressed into one
+ * datagram. "compress_ratio" is the running estimate used to decide how many
+ * segments that is. Also protected by send_buffer_lock. */
+#define NETWORK_COMPRESS_SEGMENT_SIZE 512
+static _Bool network_config_compress = 0;
+static char *compress_pending;
+static size_t compress_pending_len;
+static size_t *compress_segment_end;
+static size_t compress_segments_num;
+static size_t compress_segments_max;
+static double compress_ratio = 2.0;
+#endif
+
+/* XXX: The send counters are incremented from one place only, which is
+ * locked by send_buffer_lock. The receive and dispatch counters are updated by
+ * several threads and thus use NETWORK_STATS_ADD. The counters are always read
+ * without holding a lock in the hope that writing 8 bytes to memory is an
+ * atomic operation. */
 static derive_t stats_octets_rx = 0;
 static derive_t stats_octets_tx = 0;
 static derive_t stats_packets_rx = 0;
@@ -311,6 +464,83 @@ static derive_t stats_values_sent = 0;
 static derive_t stats_values_not_sent = 0;
 static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
 
+/* Heaviest senders by source address (weighted by packets) and by host field
+ * (weighted by value lists). The sums are indexed by TOP_SENDERS_*. Enabled
+ * with "ReportTopSenders". */
+#define TOP_SENDERS_PACKETS 0
+#define TOP_SENDERS_OCTETS 1
+#define TOP_SENDERS_VALUES 2
+static size_t network_config_top_senders = 0;
+static topk_t *top_senders_addr = NULL;
+static topk_t *top_senders_host = NULL;
+static pthread_mutex_t top_senders_lock = PTHREAD_MUTEX_INITIALIZER;
+
+#if HAVE_GCRYPT_H
+/* Key material of one user of the AuthFile, cached per dispatch thread. */
+#define NETWORK_KEY_CACHE_TTL TIME_T_TO_CDTIME_T(10)
+struct network_key_s {
+  fbhash_t *userdb;
+  char *secret;
+  unsigned char password_hash[32];
+  cdtime_t expires;
+  gcry_cipher_hd_t ofb;
+  gcry_cipher_hd_t gcm;
+  gcry_md_hd_t hmac;
+};
+typedef struct network_key_s network_key_t;
+#endif
+
+/* Scratch space for the values of a TYPE_VALUES part, one per thread. The
+ * values are copied by plugin_dispatch_values(), so the space is reused for
+ * the next part instead of allocating it every time. The values and types of
+ * the previous part of a packet are kept for TYPE_VALUES_DELTA parts. */
+struct parse_scratch_s {
+  value_t *values;
+  uint8_t *types;
+  size_t values_num;
+  size_t values_size;
+  /* Value lists dispatched from the current packet, and from the current
+   * host field, for "ReportTopSenders". */
+  uint64_t sender_values;
+  char sender_host[DATA_MAX_NAME_LEN];
+  uint64_t sender_host_values;
+#if HAVE_GCRYPT_H
+  /* network_key_t per username */
+  c_avl_tree_t *keys;
+#endif
+#if HAVE_LZ4_H
+  /* Holds the decompressed payload of a TYPE_COMPRESS_LZ4 part. */
+  char *uncompressed;
+#endif
+  /* With "ForwardPassthrough", received values parts are copied into
+   * "forward" until it is added to the send buffer. "forward_vl" is the
+   * receiver's state after the copied parts and "forward_base" is set when
+   * the last values part in "forward" is the base of a TYPE_VALUES_DELTA
+   * part that follows. */
+  char *forward;
+  size_t forward_len;
+  size_t forward_size;
+  value_list_t forward_vl;
+  _Bool forward_base;
+  uint64_t forward_values;
+};
+typedef struct parse_scratch_s parse_scratch_t;
+
+static pthread_key_t parse_scratch_key;
+static pthread_once_t parse_scratch_once = PTHREAD_ONCE_INIT;
+
+#if defined(__ATOMIC_RELAXED)
+#define NETWORK_STATS_ADD(counter, n)                                          \
+  __atomic_add_fetch(&(counter), (n), __ATOMIC_RELAXED)
+#else
+#define NETWORK_STATS_ADD(counter, n)                                          \
+  do {                                                                         \
+    pthread_mutex_lock(&stats_lock);                                           \
+    (counter) += (n);                                                          \
+    pthread_mutex_unlock(&stats_lock);                                         \
+  } while (0)
+#endif
+
 /*
  * Private functions
  */
@@ -390,6 +620,76 @@ static _Bool check_send_notify_okay(const notification_t *n) /* {{{ */
   return !received;
 } /* }}} _Bool check_send_notify_okay */
 
+static parse_scratch_t *parse_scratch_lookup(void);
+
+/* Adds the value lists counted for the current host field to the
+ * "top_senders_host" summary. The caller must hold "top_senders_lock". */
+static void top_senders_flush_host(parse_scratch_t *ps) /* {{{ */
+{
+  if (ps->sender_host_values == 0)
+    return;
+
+  uint64_t sums[TOPK_SUMS_NUM] = {
+      [TOP_SENDERS_VALUES] = ps->sender_host_values,
+  };
+  topk_add(top_senders_host, ps->sender_host, ps->sender_host_values, sums);
+  ps->sender_host_values = 0;
+} /* }}} void top_senders_flush_host */
+
+/* Counts a dispatched value list for the sender's address and for its host
+ * field. Packets usually contain a single host, so the lock is only taken
+ * when the host changes. */
+static void top_senders_count_host(char const *host) /* {{{ */
+{
+  parse_scratch_t *ps = parse_scratch_lookup();
+  if (ps == NULL)
+    return;
+
+  ps->sender_values++;
+  if ((ps->sender_host_values > 0) && (strcmp(ps->sender_host, host) != 0)) {
+    pthread_mutex_lock(&top_senders_lock);
+    top_senders_flush_host(ps);
+    pthread_mutex_unlock(&top_senders_lock);
+  }
+  if (ps->sender_host_values == 0)
+    sstrncpy(ps->sender_host, host, sizeof(ps->sender_host));
+  ps->sender_host_values++;
+} /* }}} void top_senders_count_host */
+
+/* Adds a received packet to the "top_senders_addr" summary. */
+static void top_senders_count_packet(receive_list_entry_t *ent) /* {{{ */
+{
+  char addr[NI_MAXHOST];
+  parse_scratch_t *ps = parse_scratch_lookup();
+  if (ps == NULL)
+    return;
+
+  socklen_t addrlen = 0;
+  if (ent->addr.ss_family == AF_INET)
+    addrlen = sizeof(struct sockaddr_in);
+  else if (ent->addr.ss_family == AF_INET6)
+    addrlen = sizeof(struct sockaddr_in6);
+
+  if ((addrlen == 0) ||
+      (getnameinfo((struct sockaddr *)&ent->addr, addrlen, addr, sizeof(addr),
+                   /* serv = */ NULL, /* serv_len = */ 0,
+                   NI_NUMERICHOST) != 0))
+    sstrncpy(addr, "unknown", sizeof(addr));
+
+  uint64_t sums[TOPK_SUMS_NUM] = {
+      [TOP_SENDERS_PACKETS] = 1,
+      [TOP_SENDERS_OCTETS] = (uint64_t)ent->data_len,
+      [TOP_SENDERS_VALUES] = ps->sender_values,
+  };
+
+  pthread_mutex_lock(&top_senders_lock);
+  topk_add(top_senders_addr, addr, /* weight = */ 1, sums);
+  top_senders_flush_host(ps);
+  pthread_mutex_unlock(&top_senders_lock);
+
+  ps->sender_values = 0;
+} /* }}} void top_senders_count_packet */
+
 static int network_dispatch_values(value_list_t *vl, /* {{{ */
                                    const char *username) {
   int status;
@@ -407,7 +707,7 @@ static int network_dispatch_values(value_list_t *vl, /* {{{ */
           "NOT dispatching %s.",
           name);
 #endif
-    stats_values_not_dispatched++;
+    NETWORK_STATS_ADD(stats_values_not_dispatched, 1);
     return 0;
   }
 
@@ -438,7 +738,10 @@ static int network_dispatch_values(value_list_t *vl, /* {{{ */
   }
 
   plugin_dispatch_values(vl);
-  stats_values_dispatched++;
+  NETWORK_STATS_ADD(stats_values_dispatched, 1);
+
+  if (top_senders_addr != NULL)
+    top_senders_count_host(vl->host);
 
   meta_data_destroy(vl->meta);
   vl->meta = NULL;
@@ -508,70 +811,313 @@ static int network_init_gcrypt(void) /* {{{ */
   return 0;
 } /* }}} int network_init_gcrypt */
 
-static gcry_cipher_hd_t network_get_aes256_cypher(sockent_t *se, /* {{{ */
+/* Returns the cipher "*hd" with "iv" set. The cipher is opened and keyed
+ * with "key" on first use; afterwards only the IV is changed, so the key
+ * schedule is computed once. */
+static gcry_cipher_hd_t network_get_aes256_cypher(gcry_cipher_hd_t *hd, /* {{{ */
+                                                  int mode,
+                                                  const unsigned char *key,
                                                   const void *iv,
-                                                  size_t iv_size,
-                                                  const char *username) {
+                                                  size_t iv_size) {
   gcry_error_t err;
-  gcry_cipher_hd_t *cyper_ptr;
-  unsigned char password_hash[32];
-
-  if (se->type == SOCKENT_TYPE_CLIENT) {
-    cyper_ptr = &se->data.client.cypher;
-    memcpy(password_hash, se->data.client.password_hash, sizeof(password_hash));
-  } else {
-    char *secret;
-
-    cyper_ptr = &se->data.server.cypher;
-
-    if (username == NULL)
-      return NULL;
 
-    secret = fbh_get(se->data.server.userdb, username);
-    if (secret == NULL)
+  if (*hd == NULL) {
+    err = gcry_cipher_open(hd, GCRY_CIPHER_AES256, mode, /* flags = */ 0);
+    if (err != 0) {
+      ERROR("network plugin: gcry_cipher_open returned: %s",
+            gcry_strerror(err));
+      *hd = NULL;
       return NULL;
+    }
 
-    gcry_md_hash_buffer(GCRY_MD_SHA256, password_hash, secret, strlen(secret));
-
-    sfree(secret);
-  }
-
-  if (*cyper_ptr == NULL) {
-    err = gcry_cipher_open(cyper_ptr, GCRY_CIPHER_AES256, GCRY_CIPHER_MODE_OFB,
-                           /* flags = */ 0);
+    err = gcry_cipher_setkey(*hd, key, 32);
     if (err != 0) {
-      ERROR("network plugin: gcry_cipher_open returned: %s",
+      ERROR("network plugin: gcry_cipher_setkey returned: %s",
             gcry_strerror(err));
-      *cyper_ptr = NULL;
+      gcry_cipher_close(*hd);
+      *hd = NULL;
       return NULL;
     }
   } else {
-    gcry_cipher_reset(*cyper_ptr);
+    gcry_cipher_reset(*hd);
   }
-  assert(*cyper_ptr != NULL);
 
-  err = gcry_cipher_setkey(*cyper_ptr, password_hash, sizeof(password_hash));
+  err = gcry_cipher_setiv(*hd, iv, iv_size);
   if (err != 0) {
-    ERROR("network plugin: gcry_cipher_setkey returned: %s",
+    ERROR("network plugin: gcry_cipher_setiv returned: %s",
           gcry_strerror(err));
-    gcry_cipher_close(*cyper_ptr);
-    *cyper_ptr = NULL;
+    gcry_cipher_close(*hd);
+    *hd = NULL;
     return NULL;
   }
 
-  err = gcry_cipher_setiv(*cyper_ptr, iv, iv_size);
+  return *hd;
+} /* }}} gcry_cipher_hd_t network_get_aes256_cypher */
+
+/* Returns the HMAC-SHA-256 object "*hd", opened and keyed with "secret" on
+ * first use and reset otherwise. */
+static gcry_md_hd_t network_get_hmac(gcry_md_hd_t *hd, /* {{{ */
+                                     const char *secret) {
+  gcry_error_t err;
+
+  if (*hd != NULL) {
+    gcry_md_reset(*hd);
+    return *hd;
+  }
+
+  err = gcry_md_open(hd, GCRY_MD_SHA256, GCRY_MD_FLAG_HMAC);
   if (err != 0) {
-    ERROR("network plugin: gcry_cipher_setkey returned: %s",
+    ERROR("network plugin: Creating HMAC-SHA-256 object failed: %s",
           gcry_strerror(err));
-    gcry_cipher_close(*cyper_ptr);
-    *cyper_ptr = NULL;
+    *hd = NULL;
     return NULL;
   }
 
-  return *cyper_ptr;
-} /* }}} int network_get_aes256_cypher */
+  err = gcry_md_setkey(*hd, secret, strlen(secret));
+  if (err != 0) {
+    ERROR("network plugin: gcry_md_setkey failed: %s", gcry_strerror(err));
+    gcry_md_close(*hd);
+    *hd = NULL;
+    return NULL;
+  }
+
+  return *hd;
+} /* }}} gcry_md_hd_t network_get_hmac */
 #endif /* HAVE_GCRYPT_H */
 
+/* Variable length integers store seven bits per byte, least significant
+ * group first, and set the high bit on all but the last byte. Signed numbers
+ * are zigzag encoded first, so that small negative numbers stay short. */
+static uint64_t zigzag_encode(int64_t n) /* {{{ */
+{
+  return ((uint64_t)n << 1) ^ (uint64_t)(n >> 63);
+} /* }}} uint64_t zigzag_encode */
+
+static int64_t zigzag_decode(uint64_t u) /* {{{ */
+{
+  return (int64_t)((u >> 1) ^ (0 - (u & 1)));
+} /* }}} int64_t zigzag_decode */
+
+static size_t varint_size(uint64_t u) /* {{{ */
+{
+  size_t size = 1;
+  while (u >= 0x80) {
+    u >>= 7;
+    size++;
+  }
+  return size;
+} /* }}} size_t varint_size */
+
+static uint8_t *varint_write(uint8_t *buffer, uint64_t u) /* {{{ */
+{
+  while (u >= 0x80) {
+    *buffer++ = (uint8_t)(u | 0x80);
+    u >>= 7;
+  }
+  *buffer++ = (uint8_t)u;
+  return buffer;
+} /* }}} uint8_t *varint_write */
+
+static int varint_read(uint8_t const **ret_buffer, /* {{{ */
+                       uint8_t const *end, uint64_t *ret_value) {
+  uint8_t const *buffer = *ret_buffer;
+  uint64_t u = 0;
+
+  for (unsigned int shift = 0; shift < 64; shift += 7) {
+    if (buffer >= end)
+      return -1;
+
+    uint8_t byte = *buffer++;
+    u |= ((uint64_t)(byte & 0x7f)) << shift;
+    if ((byte & 0x80) == 0) {
+      *ret_buffer = buffer;
+      *ret_value = u;
+      return 0;
+    }
+  }
+
+  return -1;
+} /* }}} int varint_read */
+
+/* Encoded integer of a value, either absolute or relative to "base". */
+static uint64_t varint_value(int ds_type, value_t v, /* {{{ */
+                             value_t const *base) {
+  switch (ds_type) {
+  case DS_TYPE_COUNTER:
+    if (base != NULL)
+      return zigzag_encode((int64_t)(v.counter - base->counter));
+    return (uint64_t)v.counter;
+  case DS_TYPE_DERIVE:
+    if (base != NULL)
+      return zigzag_encode(
+          (int64_t)((uint64_t)v.derive - (uint64_t)base->derive));
+    return zigzag_encode((int64_t)v.derive);
+  case DS_TYPE_ABSOLUTE:
+    if (base != NULL)
+      return zigzag_encode((int64_t)(v.absolute - base->absolute));
+    return (uint64_t)v.absolute;
+  }
+  return 0;
+} /* }}} uint64_t varint_value */
+
+/* Writes a TYPE_VALUES_VARINT or TYPE_VALUES_DELTA part. Both have the layout
+ * of a TYPE_VALUES part, but integer values are variable length integers:
+ * counters and absolutes as is, derives zigzag encoded. In a
+ * TYPE_VALUES_DELTA part they are the zigzag encoded differences to the
+ * previous values part of the packet, which must have the same data source
+ * types. Gauges are always sent in full. */
+static int write_part_values_varint(char **ret_buffer, /* {{{ */
+                                    size_t *ret_buffer_len,
+                                    const data_set_t *ds,
+                                    const value_list_t *vl) {
+  size_t num_values = vl->values_len;
+  size_t absolute_size = 0;
+  size_t delta_size = 0;
+  _Bool delta = (send_buffer_base_num == num_values);
+
+  for (size_t i = 0; i < num_values; i++) {
+    int type = ds->ds[i].type;
+
+    if ((type != DS_TYPE_COUNTER) && (type != DS_TYPE_GAUGE) &&
+        (type != DS_TYPE_DERIVE) && (type != DS_TYPE_ABSOLUTE)) {
+      ERROR("network plugin: write_part_values_varint: "
+            "Unknown data source type: %i",
+            type);
+      return -1;
+    }
+
+    if (delta && (send_buffer_base_types[i] != (uint8_t)type))
+      delta = 0;
+
+    if (type == DS_TYPE_GAUGE) {
+      absolute_size += sizeof(gauge_t);
+      delta_size += sizeof(gauge_t);
+      continue;
+    }
+
+    absolute_size += varint_size(varint_value(type, vl->values[i], NULL));
+    if (delta)
+      delta_size += varint_size(
+          varint_value(type, vl->values[i], send_buffer_base + i));
+  }
+
+  if (delta && (delta_size >= absolute_size))
+    delta = 0;
+
+  size_t packet_len = sizeof(part_header_t) + sizeof(uint16_t) + num_values +
+                      (delta ? delta_size : absolute_size);
+  if ((*ret_buffer_len < packet_len) || (packet_len > UINT16_MAX))
+    return -1;
+
+  if (send_buffer_base_size < num_values) {
+    value_t *tmp = realloc(send_buffer_base, num_values * sizeof(*tmp));
+    if (tmp == NULL)
+      return -1;
+    send_buffer_base = tmp;
+
+    uint8_t *tmp_types =
+        realloc(send_buffer_base_types, num_values * sizeof(*tmp_types));
+    if (tmp_types == NULL)
+      return -1;
+    send_buffer_base_types = tmp_types;
+
+    send_buffer_base_size = num_values;
+  }
+
+  uint8_t *buffer = (uint8_t *)*ret_buffer;
+  uint16_t tmp16;
+
+  tmp16 = htons(delta ? TYPE_VALUES_DELTA : TYPE_VALUES_VARINT);
+  memcpy(buffer, &tmp16, sizeof(tmp16));
+  buffer += sizeof(tmp16);
+  tmp16 = htons((uint16_t)packet_len);
+  memcpy(buffer, &tmp16, sizeof(tmp16));
+  buffer += sizeof(tmp16);
+  tmp16 = htons((uint16_t)num_values);
+  memcpy(buffer, &tmp16, sizeof(tmp16));
+  buffer += sizeof(tmp16);
+
+  for (size_t i = 0; i < num_values; i++)
+    *buffer++ = (uint8_t)ds->ds[i].type;
+
+  for (size_t i = 0; i < num_values; i++) {
+    int type = ds->ds[i].type;
+
+    if (type == DS_TYPE_GAUGE) {
+      gauge_t tmp = htond(vl->values[i].gauge);
+      memcpy(buffer, &tmp, sizeof(tmp));
+      buffer += sizeof(tmp);
+    } else {
+      buffer = varint_write(buffer, varint_value(type, vl->values[i],
+                                                 delta ? send_buffer_base + i
+                                                       : NULL));
+    }
+
+    send_buffer_base[i] = vl->values[i];
+    send_buffer_base_types[i] = (uint8_t)type;
+  }
+  send_buffer_base_num = num_values;
+
+  assert((char *)buffer == *ret_buffer + packet_len);
+
+  *ret_buffer += packet_len;
+  *ret_buffer_len -= packet_len;
+
+  return 0;
+} /* }}} int write_part_values_varint */
+
+/* Writes values that have been decoded from a received packet as a
+ * TYPE_VALUES_VARINT part, i.e. without referring to a previous part. */
+static int write_part_values_absolute(char **ret_buffer, /* {{{ */
+                                      size_t *ret_buffer_len,
+                                      value_t const *values,
+                                      uint8_t const *types, size_t num) {
+  size_t packet_len = sizeof(part_header_t) + sizeof(uint16_t) + num;
+
+  for (size_t i = 0; i < num; i++) {
+    if (types[i] == DS_TYPE_GAUGE)
+      packet_len += sizeof(gauge_t);
+    else
+      packet_len += varint_size(varint_value(types[i], values[i], NULL));
+  }
+
+  if ((*ret_buffer_len < packet_len) || (packet_len > UINT16_MAX))
+    return -1;
+
+  uint8_t *buffer = (uint8_t *)*ret_buffer;
+  uint16_t tmp16;
+
+  tmp16 = htons(TYPE_VALUES_VARINT);
+  memcpy(buffer, &tmp16, sizeof(tmp16));
+  buffer += sizeof(tmp16);
+  tmp16 = htons((uint16_t)packet_len);
+  memcpy(buffer, &tmp16, sizeof(tmp16));
+  buffer += sizeof(tmp16);
+  tmp16 = htons((uint16_t)num);
+  memcpy(buffer, &tmp16, sizeof(tmp16));
+  buffer += sizeof(tmp16);
+
+  memcpy(buffer, types, num);
+  buffer += num;
+
+  for (size_t i = 0; i < num; i++) {
+    if (types[i] == DS_TYPE_GAUGE) {
+      gauge_t tmp = htond(values[i].gauge);
+      memcpy(buffer, &tmp, sizeof(tmp));
+      buffer += sizeof(tmp);
+    } else {
+      buffer = varint_write(buffer, varint_value(types[i], values[i], NULL));
+    }
+  }
+
+  assert((char *)buffer == *ret_buffer + packet_len);
+
+  *ret_buffer += packet_len;
+  *ret_buffer_len -= packet_len;
+
+  return 0;
+} /* }}} int write_part_values_absolute */
+
 static int write_part_values(char **ret_buffer, size_t *ret_buffer_len,
                              const data_set_t *ds, const value_list_t *vl) {
   char *packet_ptr;
@@ -700,6 +1246,35 @@ static int write_part_number(char **ret_buffer, size_t *ret_buffer_len,
   return 0;
 } /* int write_part_number */
 
+/* Writes the time "t" as a TYPE_TIME_DELTA part relative to "prev", if that
+ * is shorter than a TYPE_TIME_HR part. */
+static int write_part_time(char **ret_buffer, size_t *ret_buffer_len, /* {{{ */
+                           cdtime_t prev, cdtime_t t) {
+  uint64_t delta = zigzag_encode((int64_t)((uint64_t)t - (uint64_t)prev));
+  size_t packet_len = sizeof(part_header_t) + varint_size(delta);
+
+  if ((prev == 0) || (packet_len >= sizeof(part_header_t) + sizeof(uint64_t)))
+    return write_part_number(ret_buffer, ret_buffer_len, TYPE_TIME_HR,
+                             (uint64_t)t);
+
+  if (*ret_buffer_len < packet_len)
+    return -1;
+
+  uint8_t *buffer = (uint8_t *)*ret_buffer;
+  uint16_t tmp16;
+
+  tmp16 = htons(TYPE_TIME_DELTA);
+  memcpy(buffer, &tmp16, sizeof(tmp16));
+  tmp16 = htons((uint16_t)packet_len);
+  memcpy(buffer + sizeof(tmp16), &tmp16, sizeof(tmp16));
+  varint_write(buffer + sizeof(part_header_t), delta);
+
+  *ret_buffer += packet_len;
+  *ret_buffer_len -= packet_len;
+
+  return 0;
+} /* }}} int write_part_time */
+
 static int write_part_string(char **ret_buffer, size_t *ret_buffer_len,
                              int type, const char *str, size_t str_len) {
   char *buffer;
@@ -736,6 +1311,186 @@ static int write_part_string(char **ret_buffer, size_t *ret_buffer_len,
   return 0;
 } /* int write_part_string */
 
+#if HAVE_GCRYPT_H
+static void network_key_free(network_key_t *key) /* {{{ */
+{
+  if (key == NULL)
+    return;
+
+  if (key->ofb != NULL)
+    gcry_cipher_close(key->ofb);
+  if (key->gcm != NULL)
+    gcry_cipher_close(key->gcm);
+  if (key->hmac != NULL)
+    gcry_md_close(key->hmac);
+  sfree(key->secret);
+  sfree(key);
+} /* }}} void network_key_free */
+
+static void network_keys_destroy(c_avl_tree_t *keys) /* {{{ */
+{
+  char *username;
+  network_key_t *key;
+
+  if (keys == NULL)
+    return;
+
+  while (c_avl_pick(keys, (void *)&username, (void *)&key) == 0) {
+    sfree(username);
+    network_key_free(key);
+  }
+  c_avl_destroy(keys);
+} /* }}} void network_keys_destroy */
+#endif /* HAVE_GCRYPT_H */
+
+static void parse_scratch_free(void *arg) /* {{{ */
+{
+  parse_scratch_t *ps = arg;
+
+  if (ps == NULL)
+    return;
+
+  sfree(ps->values);
+  sfree(ps->types);
+#if HAVE_GCRYPT_H
+  network_keys_destroy(ps->keys);
+#endif
+#if HAVE_LZ4_H
+  sfree(ps->uncompressed);
+#endif
+  sfree(ps->forward);
+  sfree(ps);
+} /* }}} void parse_scratch_free */
+
+static void parse_scratch_init(void) /* {{{ */
+{
+  pthread_key_create(&parse_scratch_key, parse_scratch_free);
+} /* }}} void parse_scratch_init */
+
+static parse_scratch_t *parse_scratch_lookup(void) /* {{{ */
+{
+  parse_scratch_t *ps;
+
+  pthread_once(&parse_scratch_once, parse_scratch_init);
+
+  ps = pthread_getspecific(parse_scratch_key);
+  if (ps == NULL) {
+    ps = calloc(1, sizeof(*ps));
+    if (ps == NULL)
+      return NULL;
+    if (pthread_setspecific(parse_scratch_key, ps) != 0) {
+      sfree(ps);
+      return NULL;
+    }
+  }
+
+  return ps;
+} /* }}} parse_scratch_t *parse_scratch_lookup */
+
+/* Returns this thread's scratch space, grown to hold at least "num" values.
+ */
+static parse_scratch_t *parse_scratch_get(size_t num) /* {{{ */
+{
+  parse_scratch_t *ps = parse_scratch_lookup();
+  if (ps == NULL)
+    return NULL;
+
+  if (num == 0)
+    num = 1;
+
+  if (ps->values_size < num) {
+    value_t *tmp = realloc(ps->values, num * sizeof(*tmp));
+    if (tmp == NULL)
+      return NULL;
+    ps->values = tmp;
+
+    uint8_t *tmp_types = realloc(ps->types, num * sizeof(*tmp_types));
+    if (tmp_types == NULL)
+      return NULL;
+    ps->types = tmp_types;
+
+    ps->values_size = num;
+  }
+
+  return ps;
+} /* }}} parse_scratch_t *parse_scratch_get */
+
+#if HAVE_GCRYPT_H
+/* Returns the calling thread's cached key of "username", looking up the
+ * secret in the AuthFile at most every NETWORK_KEY_CACHE_TTL. The ciphers of
+ * a key are created and keyed once and then reused for every packet. */
+static network_key_t *network_key_get(sockent_t *se, /* {{{ */
+                                      const char *username) {
+  parse_scratch_t *ps = parse_scratch_lookup();
+  network_key_t *key = NULL;
+  cdtime_t now = cdtime();
+  char *secret;
+
+  if ((ps == NULL) || (username == NULL))
+    return NULL;
+
+  if (ps->keys == NULL) {
+    ps->keys = c_avl_create((int (*)(const void *, const void *))strcmp);
+    if (ps->keys == NULL)
+      return NULL;
+  }
+
+  if ((c_avl_get(ps->keys, username, (void *)&key) == 0) &&
+      (key->userdb == se->data.server.userdb) && (key->expires > now))
+    return key;
+
+  secret = fbh_get(se->data.server.userdb, username);
+  if (secret == NULL) {
+    char *key_username = NULL;
+    if (c_avl_remove(ps->keys, username, (void *)&key_username,
+                     (void *)&key) == 0) {
+      sfree(key_username);
+      network_key_free(key);
+    }
+    return NULL;
+  }
+
+  if (key == NULL) {
+    char *key_username = strdup(username);
+    key = calloc(1, sizeof(*key));
+    if ((key_username == NULL) || (key == NULL) ||
+        (c_avl_insert(ps->keys, key_username, key) != 0)) {
+      sfree(key_username);
+      sfree(key);
+      sfree(secret);
+      return NULL;
+    }
+  }
+
+  if ((key->secret == NULL) || (key->userdb != se->data.server.userdb) ||
+      (strcmp(key->secret, secret) != 0)) {
+    if (key->ofb != NULL)
+      gcry_cipher_close(key->ofb);
+    if (key->gcm != NULL)
+      gcry_cipher_close(key->gcm);
+    if (key->hmac != NULL)
+      gcry_md_close(key->hmac);
+    key->ofb = NULL;
+    key->gcm = NULL;
+    key->hmac = NULL;
+
+    sfree(key->secret);
+    key->secret = secret;
+    key->userdb = se->data.server.userdb;
+    gcry_md_hash_buffer(GCRY_MD_SHA256, key->password_hash, secret,
+                        strlen(secret));
+  } else {
+    sfree(secret);
+  }
+
+  key->expires = now + NETWORK_KEY_CACHE_TTL;
+  return key;
+} /* }}} network_key_t *network_key_get */
+#endif /* HAVE_GCRYPT_H */
+
+/* Decodes a TYPE_VALUES part. The types are read from the packet in place and
+ * the values are decoded into the calling thread's scratch array, which is
+ * only valid until the next call. */
 static int parse_part_values(void **ret_buffer, size_t *ret_buffer_len,
                              value_t **ret_values, size_t *ret_num_values) {
   char *buffer = *ret_buffer;
@@ -748,8 +1503,9 @@ static int parse_part_values(void **ret_buffer, size_t *ret_buffer_len,
   uint16_t pkg_type;
   size_t pkg_numval;
 
-  uint8_t *pkg_types;
+  uint8_t const *pkg_types;
   value_t *pkg_values;
+  parse_scratch_t *ps;
 
   if (buffer_len < 15) {
     NOTICE("network plugin: packet is too short: "
@@ -791,16 +1547,15 @@ static int parse_part_values(void **ret_buffer, size_t *ret_buffer_len,
     return -1;
   }
 
-  pkg_types = calloc(pkg_numval, sizeof(*pkg_types));
-  pkg_values = calloc(pkg_numval, sizeof(*pkg_values));
-  if ((pkg_types == NULL) || (pkg_values == NULL)) {
-    sfree(pkg_types);
-    sfree(pkg_values);
-    ERROR("network plugin: parse_part_values: calloc failed.");
+  ps = parse_scratch_get(pkg_numval);
+  if (ps == NULL) {
+    ERROR("network plugin: parse_part_values: realloc failed.");
     return -1;
   }
+  pkg_values = ps->values;
+  ps->values_num = 0;
 
-  memcpy(pkg_types, buffer, pkg_numval * sizeof(*pkg_types));
+  pkg_types = (uint8_t const *)buffer;
   buffer += pkg_numval * sizeof(*pkg_types);
   memcpy(pkg_values, buffer, pkg_numval * sizeof(*pkg_values));
   buffer += pkg_numval * sizeof(*pkg_values);
@@ -827,22 +1582,189 @@ static int parse_part_values(void **ret_buffer, size_t *ret_buffer_len,
       NOTICE("network plugin: parse_part_values: "
              "Don't know how to handle data source type %" PRIu8,
              pkg_types[i]);
-      sfree(pkg_types);
-      sfree(pkg_values);
       return -1;
     } /* switch (pkg_types[i]) */
   }
 
+  memcpy(ps->types, pkg_types, pkg_numval * sizeof(*pkg_types));
+  ps->values_num = pkg_numval;
+
   *ret_buffer = buffer;
   *ret_buffer_len = buffer_len - pkg_length;
   *ret_num_values = pkg_numval;
   *ret_values = pkg_values;
 
-  sfree(pkg_types);
-
   return 0;
 } /* int parse_part_values */
 
+/* Decodes a TYPE_VALUES_VARINT or TYPE_VALUES_DELTA part. See
+ * write_part_values_varint() for the format. */
+static int parse_part_values_varint(void **ret_buffer, /* {{{ */
+                                    size_t *ret_buffer_len,
+                                    value_t **ret_values,
+                                    size_t *ret_num_values) {
+  uint8_t const *buffer = *ret_buffer;
+  size_t buffer_len = *ret_buffer_len;
+
+  uint16_t tmp16;
+  uint16_t pkg_type;
+  uint16_t pkg_length;
+  size_t pkg_numval;
+  size_t header_size = 3 * sizeof(uint16_t);
+
+  uint8_t const *pkg_types;
+  uint8_t const *end;
+  parse_scratch_t *ps;
+  _Bool delta;
+
+  if (buffer_len < header_size) {
+    NOTICE("network plugin: packet is too short: "
+           "buffer_len = %" PRIsz,
+           buffer_len);
+    return -1;
+  }
+
+  memcpy(&tmp16, buffer, sizeof(tmp16));
+  pkg_type = ntohs(tmp16);
+  memcpy(&tmp16, buffer + sizeof(tmp16), sizeof(tmp16));
+  pkg_length = ntohs(tmp16);
+  memcpy(&tmp16, buffer + 2 * sizeof(tmp16), sizeof(tmp16));
+  pkg_numval = (size_t)ntohs(tmp16);
+
+  if ((pkg_length > buffer_len) || (pkg_length < header_size + pkg_numval)) {
+    WARNING("network plugin: parse_part_values_varint: "
+            "Length and number of values "
+            "in the packet don't match.");
+    return -1;
+  }
+
+  ps = parse_scratch_get(pkg_numval);
+  if (ps == NULL) {
+    ERROR("network plugin: parse_part_values_varint: realloc failed.");
+    return -1;
+  }
+
+  pkg_types = buffer + header_size;
+  end = buffer + pkg_length;
+  buffer = pkg_types + pkg_numval;
+
+  delta = (pkg_type == TYPE_VALUES_DELTA);
+  if (delta && ((ps->values_num != pkg_numval) ||
+                (memcmp(ps->types, pkg_types, pkg_numval) != 0))) {
+    NOTICE("network plugin: parse_part_values_varint: "
+           "Delta encoded values don't match the previous values.");
+    ps->values_num = 0;
+    return -1;
+  }
+  /* Deltas are applied in place, so the base is gone from here on. */
+  ps->values_num = 0;
+
+  for (size_t i = 0; i < pkg_numval; i++) {
+    value_t *v = ps->values + i;
+    uint64_t tmp = 0;
+
+    if (pkg_types[i] == DS_TYPE_GAUGE) {
+      if ((size_t)(end - buffer) < sizeof(v->gauge)) {
+        NOTICE("network plugin: parse_part_values_varint: "
+               "Truncated gauge value.");
+        return -1;
+      }
+      memcpy(&v->gauge, buffer, sizeof(v->gauge));
+      v->gauge = (gauge_t)ntohd(v->gauge);
+      buffer += sizeof(v->gauge);
+      continue;
+    }
+
+    if (varint_read(&buffer, end, &tmp) != 0) {
+      NOTICE("network plugin: parse_part_values_varint: "
+             "Truncated variable length integer.");
+      return -1;
+    }
+
+    switch (pkg_types[i]) {
+    case DS_TYPE_COUNTER:
+      if (delta)
+        v->counter += (counter_t)zigzag_decode(tmp);
+      else
+        v->counter = (counter_t)tmp;
+      break;
+
+    case DS_TYPE_DERIVE:
+      if (delta)
+        v->derive =
+            (derive_t)((uint64_t)v->derive + (uint64_t)zigzag_decode(tmp));
+      else
+        v->derive = (derive_t)zigzag_decode(tmp);
+      break;
+
+    case DS_TYPE_ABSOLUTE:
+      if (delta)
+        v->absolute += (absolute_t)zigzag_decode(tmp);
+      else
+        v->absolute = (absolute_t)tmp;
+      break;
+
+    default:
+      NOTICE("network plugin: parse_part_values_varint: "
+             "Don't know how to handle data source type %" PRIu8,
+             pkg_types[i]);
+      return -1;
+    } /* switch (pkg_types[i]) */
+  }
+
+  if (buffer != end) {
+    WARNING("network plugin: parse_part_values_varint: "
+            "Length and values in the packet don't match.");
+    return -1;
+  }
+
+  memcpy(ps->types, pkg_types, pkg_numval * sizeof(*pkg_types));
+  ps->values_num = pkg_numval;
+
+  *ret_buffer = (void *)end;
+  *ret_buffer_len = buffer_len - pkg_length;
+  *ret_num_values = pkg_numval;
+  *ret_values = ps->values;
+
+  return 0;
+} /* }}} int parse_part_values_varint */
+
+/* Decodes a TYPE_TIME_DELTA part, which is relative to "*ret_time". */
+static int parse_part_time_delta(void **ret_buffer, /* {{{ */
+                                 size_t *ret_buffer_len, cdtime_t *ret_time) {
+  uint8_t const *buffer = *ret_buffer;
+  size_t buffer_len = *ret_buffer_len;
+  part_header_t ph;
+  uint64_t tmp = 0;
+
+  if (buffer_len < sizeof(ph) + 1)
+    return -1;
+
+  memcpy(&ph, buffer, sizeof(ph));
+  ph.length = ntohs(ph.length);
+  if ((ph.length > buffer_len) || (ph.length < sizeof(ph) + 1))
+    return -1;
+
+  uint8_t const *end = buffer + ph.length;
+  buffer += sizeof(ph);
+  if ((varint_read(&buffer, end, &tmp) != 0) || (buffer != end)) {
+    NOTICE("network plugin: parse_part_time_delta: Invalid part.");
+    return -1;
+  }
+
+  if (*ret_time == 0) {
+    NOTICE("network plugin: parse_part_time_delta: "
+           "Relative time without a previous time.");
+    return -1;
+  }
+
+  *ret_time = (cdtime_t)((uint64_t)*ret_time + (uint64_t)zigzag_decode(tmp));
+
+  *ret_buffer = (void *)end;
+  *ret_buffer_len = buffer_len - ph.length;
+  return 0;
+} /* }}} int parse_part_time_delta */
+
 static int parse_part_number(void **ret_buffer, size_t *ret_buffer_len,
                              uint64_t *value) {
   char *buffer = *ret_buffer;
@@ -946,19 +1868,19 @@ static int parse_part_string(void **ret_buffer, size_t *ret_buffer_len,
     return -1;
   }
 
-  /* All sanity checks successfull, let's copy the data over */
-  memcpy((void *)output, (void *)buffer, payload_size);
-  buffer += payload_size;
-
   /* For some very weird reason '\0' doesn't do the trick on SPARC in
    * this statement. */
-  if (output[payload_size - 1] != 0) {
+  if (buffer[payload_size - 1] != 0) {
     WARNING("network plugin: parse_part_string: "
             "Received string does not end "
             "with a NULL-byte.");
     return -1;
   }
 
+  /* All sanity checks successfull, let's copy the data over */
+  memcpy((void *)output, (void *)buffer, payload_size);
+  buffer += payload_size;
+
   *ret_buffer = buffer;
   *ret_buffer_len = buffer_len - pkg_length;
 
@@ -969,8 +1891,14 @@ static int parse_part_string(void **ret_buffer, size_t *ret_buffer_len,
  * parse_packet and vice versa. */
 #define PP_SIGNED 0x01
 #define PP_ENCRYPTED 0x02
+#define PP_COMPRESSED 0x04
+#define PP_FORWARD 0x08
 static int parse_packet(sockent_t *se, void *buffer, size_t buffer_size,
                         int flags, const char *username);
+static void network_forward_values(sockent_t *se, value_list_t *vl,
+                                   void const *part, size_t part_len,
+                                   int part_type, const char *username);
+static void network_forward_flush(parse_scratch_t *ps);
 
 #define BUFFER_READ(p, s)                                                      \
   do {                                                                         \
@@ -989,14 +1917,13 @@ static int parse_part_sign_sha256(sockent_t *se, /* {{{ */
   size_t buffer_offset;
 
   size_t username_len;
-  char *secret;
+  network_key_t *key;
 
   part_signature_sha256_t pss;
   uint16_t pss_head_length;
   char hash[sizeof(pss.hash)];
 
   gcry_md_hd_t hd;
-  gcry_error_t err;
   unsigned char *hash_ptr;
 
   buffer = *ret_buffer;
@@ -1047,29 +1974,16 @@ static int parse_part_sign_sha256(sockent_t *se, /* {{{ */
   assert(buffer_offset == pss_head_length);
 
   /* Query the password */
-  secret = fbh_get(se->data.server.userdb, pss.username);
-  if (secret == NULL) {
+  key = network_key_get(se, pss.username);
+  if (key == NULL) {
     ERROR("network plugin: Unknown user: %s", pss.username);
     sfree(pss.username);
     return -ENOENT;
   }
 
-  /* Create a hash device and check the HMAC */
-  hd = NULL;
-  err = gcry_md_open(&hd, GCRY_MD_SHA256, GCRY_MD_FLAG_HMAC);
-  if (err != 0) {
-    ERROR("network plugin: Creating HMAC-SHA-256 object failed: %s",
-          gcry_strerror(err));
-    sfree(secret);
-    sfree(pss.username);
-    return -1;
-  }
-
-  err = gcry_md_setkey(hd, secret, strlen(secret));
-  if (err != 0) {
-    ERROR("network plugin: gcry_md_setkey failed: %s", gcry_strerror(err));
-    gcry_md_close(hd);
-    sfree(secret);
+  /* Check the HMAC with the user's cached hash device */
+  hd = network_get_hmac(&key->hmac, key->secret);
+  if (hd == NULL) {
     sfree(pss.username);
     return -1;
   }
@@ -1079,17 +1993,11 @@ static int parse_part_sign_sha256(sockent_t *se, /* {{{ */
   hash_ptr = gcry_md_read(hd, GCRY_MD_SHA256);
   if (hash_ptr == NULL) {
     ERROR("network plugin: gcry_md_read failed.");
-    gcry_md_close(hd);
-    sfree(secret);
     sfree(pss.username);
     return -1;
   }
   memcpy(hash, hash_ptr, sizeof(hash));
 
-  /* Clean up */
-  gcry_md_close(hd);
-  hd = NULL;
-
   if (memcmp(pss.hash, hash, sizeof(pss.hash)) != 0) {
     WARNING("network plugin: Verifying HMAC-SHA-256 signature failed: "
             "Hash mismatch. Username: %s",
@@ -1099,7 +2007,6 @@ static int parse_part_sign_sha256(sockent_t *se, /* {{{ */
                  flags | PP_SIGNED, pss.username);
   }
 
-  sfree(secret);
   sfree(pss.username);
 
   *ret_buffer = buffer + buffer_len;
@@ -1166,6 +2073,7 @@ static int parse_part_encr_aes256(sockent_t *se, /* {{{ */
   part_encryption_aes256_t pea;
   unsigned char hash[sizeof(pea.hash)] = {0};
 
+  network_key_t *key;
   gcry_cipher_hd_t cypher;
   gcry_error_t err;
 
@@ -1215,7 +2123,11 @@ static int parse_part_encr_aes256(sockent_t *se, /* {{{ */
   assert(buffer_offset ==
          (username_len + PART_ENCRYPTION_AES256_SIZE - sizeof(pea.hash)));
 
-  cypher = network_get_aes256_cypher(se, pea.iv, sizeof(pea.iv), pea.username);
+  key = network_key_get(se, pea.username);
+  cypher = (key == NULL) ? NULL
+                         : network_get_aes256_cypher(
+                               &key->ofb, GCRY_CIPHER_MODE_OFB,
+                               key->password_hash, pea.iv, sizeof(pea.iv));
   if (cypher == NULL) {
     ERROR("network plugin: Failed to get cypher. Username: %s", pea.username);
     sfree(pea.username);
@@ -1262,6 +2174,98 @@ static int parse_part_encr_aes256(sockent_t *se, /* {{{ */
 
   return 0;
 } /* }}} int parse_part_encr_aes256 */
+
+#if HAVE_GCRYPT_GCM
+static int parse_part_encr_aes256_gcm(sockent_t *se, /* {{{ */
+                                      void **ret_buffer,
+                                      size_t *ret_buffer_len, int flags) {
+  char *buffer = *ret_buffer;
+  size_t buffer_len = *ret_buffer_len;
+  size_t part_size;
+  size_t header_size;
+  uint16_t tmp;
+  size_t username_len;
+  char *username;
+  const unsigned char *iv;
+  const unsigned char *tag;
+
+  network_key_t *key;
+  gcry_cipher_hd_t cypher;
+  gcry_error_t err;
+
+  if (buffer_len <= PART_ENCRYPTION_AES256_GCM_SIZE) {
+    NOTICE("network plugin: parse_part_encr_aes256_gcm: "
+           "Discarding short packet.");
+    return -1;
+  }
+
+  memcpy(&tmp, buffer + 2, sizeof(tmp));
+  part_size = ntohs(tmp);
+  if ((part_size <= PART_ENCRYPTION_AES256_GCM_SIZE) ||
+      (part_size > buffer_len)) {
+    NOTICE("network plugin: parse_part_encr_aes256_gcm: "
+           "Discarding part with invalid size.");
+    return -1;
+  }
+
+  memcpy(&tmp, buffer + 4, sizeof(tmp));
+  username_len = ntohs(tmp);
+  if ((username_len == 0) ||
+      (username_len > (part_size - (PART_ENCRYPTION_AES256_GCM_SIZE + 1)))) {
+    NOTICE("network plugin: parse_part_encr_aes256_gcm: "
+           "Discarding part with invalid username length.");
+    return -1;
+  }
+
+  username = malloc(username_len + 1);
+  if (username == NULL)
+    return -ENOMEM;
+  memcpy(username, buffer + 6, username_len);
+  username[username_len] = 0;
+
+  iv = (unsigned char *)buffer + 6 + username_len;
+  tag = iv + PART_ENCRYPTION_AES256_GCM_IV_SIZE;
+  header_size = PART_ENCRYPTION_AES256_GCM_SIZE + username_len;
+
+  key = network_key_get(se, username);
+  cypher = (key == NULL)
+               ? NULL
+               : network_get_aes256_cypher(&key->gcm, GCRY_CIPHER_MODE_GCM,
+                                           key->password_hash, iv,
+                                           PART_ENCRYPTION_AES256_GCM_IV_SIZE);
+  if (cypher == NULL) {
+    ERROR("network plugin: Failed to get cypher. Username: %s", username);
+    sfree(username);
+    return -1;
+  }
+
+  err = gcry_cipher_authenticate(cypher, buffer, 6 + username_len);
+  if (err == 0)
+    err = gcry_cipher_decrypt(cypher, buffer + header_size,
+                              part_size - header_size,
+                              /* in = */ NULL, /* in len = */ 0);
+  if (err == 0)
+    err = gcry_cipher_checktag(cypher, tag,
+                               PART_ENCRYPTION_AES256_GCM_TAG_SIZE);
+  if (err != 0) {
+    ERROR("network plugin: Decrypting AES-256-GCM part failed: %s. "
+          "Username: %s",
+          gcry_strerror(err), username);
+    sfree(username);
+    return -1;
+  }
+
+  parse_packet(se, buffer + header_size, part_size - header_size,
+               flags | PP_ENCRYPTED, username);
+
+  *ret_buffer = buffer + part_size;
+  *ret_buffer_len = buffer_len - part_size;
+
+  sfree(username);
+
+  return 0;
+} /* }}} int parse_part_encr_aes256_gcm */
+#endif /* HAVE_GCRYPT_GCM */
 /* #endif HAVE_GCRYPT_H */
 
 #else  /* if !HAVE_GCRYPT_H */
@@ -1308,6 +2312,74 @@ static int parse_part_encr_aes256(sockent_t *se, /* {{{ */
 } /* }}} int parse_part_encr_aes256 */
 #endif /* !HAVE_GCRYPT_H */
 
+#if HAVE_LZ4_H
+/* Decompresses a TYPE_COMPRESS_LZ4 part and parses the parts inside of it.
+ * The part starts with the uncompressed size (uint16_t) which is followed by
+ * the LZ4 block. */
+static int parse_part_compress_lz4(sockent_t *se, /* {{{ */
+                                   void **ret_buffer, size_t *ret_buffer_len,
+                                   int flags, const char *username) {
+  char *buffer = *ret_buffer;
+  size_t buffer_len = *ret_buffer_len;
+  size_t header_size = sizeof(part_header_t) + sizeof(uint16_t);
+
+  part_header_t ph;
+  uint16_t uncompressed_size;
+
+  if (buffer_len <= header_size) {
+    NOTICE("network plugin: parse_part_compress_lz4: "
+           "Discarding short packet.");
+    return -1;
+  }
+
+  memcpy(&ph, buffer, sizeof(ph));
+  memcpy(&uncompressed_size, buffer + sizeof(ph), sizeof(uncompressed_size));
+  ph.length = ntohs(ph.length);
+  uncompressed_size = ntohs(uncompressed_size);
+
+  if ((ph.length <= header_size) || (ph.length > buffer_len)) {
+    NOTICE("network plugin: parse_part_compress_lz4: "
+           "Discarding part with invalid length %" PRIu16 ".",
+           ph.length);
+    return -1;
+  }
+
+  /* Compressed containers cannot be nested. */
+  if (flags & PP_COMPRESSED) {
+    NOTICE("network plugin: parse_part_compress_lz4: "
+           "Discarding nested compressed part.");
+    return -1;
+  }
+
+  parse_scratch_t *ps = parse_scratch_lookup();
+  if (ps == NULL)
+    return -1;
+  if (ps->uncompressed == NULL) {
+    ps->uncompressed = malloc(UINT16_MAX);
+    if (ps->uncompressed == NULL)
+      return -1;
+  }
+
+  int status = LZ4_decompress_safe(buffer + header_size, ps->uncompressed,
+                                   (int)(ph.length - header_size),
+                                   (int)uncompressed_size);
+  if (status != (int)uncompressed_size) {
+    NOTICE("network plugin: parse_part_compress_lz4: "
+           "Decompressing the payload failed with status %i.",
+           status);
+    return -1;
+  }
+
+  parse_packet(se, ps->uncompressed, uncompressed_size, flags | PP_COMPRESSED,
+               username);
+
+  *ret_buffer = buffer + ph.length;
+  *ret_buffer_len = buffer_len - ph.length;
+
+  return 0;
+} /* }}} int parse_part_compress_lz4 */
+#endif /* HAVE_LZ4_H */
+
 #undef BUFFER_READ
 
 static int parse_packet(sockent_t *se, /* {{{ */
@@ -1318,6 +2390,11 @@ static int parse_packet(sockent_t *se, /* {{{ */
   value_list_t vl = VALUE_LIST_INIT;
   notification_t n = {0};
 
+  /* TYPE_VALUES_DELTA parts are relative to a previous part of this packet. */
+  parse_scratch_t *ps = parse_scratch_lookup();
+  if (ps != NULL)
+    ps->values_num = 0;
+
 #if HAVE_GCRYPT_H
   int packet_was_signed = (flags & PP_SIGNED);
   int packet_was_encrypted = (flags & PP_ENCRYPTED);
@@ -1355,6 +2432,17 @@ static int parse_packet(sockent_t *se, /* {{{ */
         break;
       }
     }
+#if HAVE_GCRYPT_GCM
+    else if (pkg_type == TYPE_ENCR_AES256_GCM) {
+      status = parse_part_encr_aes256_gcm(se, &buffer, &buffer_size, flags);
+      if (status != 0) {
+        ERROR("network plugin: Decrypting AES-256-GCM part failed "
+              "with status %i.",
+              status);
+        break;
+      }
+    }
+#endif /* HAVE_GCRYPT_GCM */
 #if HAVE_GCRYPT_H
     else if ((se->data.server.security_level == SECURITY_LEVEL_ENCRYPT) &&
              (packet_was_encrypted == 0)) {
@@ -1391,15 +2479,45 @@ static int parse_packet(sockent_t *se, /* {{{ */
       continue;
     }
 #endif /* HAVE_GCRYPT_H */
+#if HAVE_LZ4_H
+    else if (pkg_type == TYPE_COMPRESS_LZ4) {
+      status = parse_part_compress_lz4(se, &buffer, &buffer_size, flags,
+                                       username);
+      if (status != 0)
+        break;
+    }
+#endif /* HAVE_LZ4_H */
     else if (pkg_type == TYPE_VALUES) {
+      void *part = buffer;
       status =
           parse_part_values(&buffer, &buffer_size, &vl.values, &vl.values_len);
       if (status != 0)
         break;
 
-      network_dispatch_values(&vl, username);
+      if (flags & PP_FORWARD)
+        network_forward_values(se, &vl, part, pkg_length, pkg_type, username);
+      else
+        network_dispatch_values(&vl, username);
+      vl.values = NULL;
+      vl.values_len = 0;
+    } else if ((pkg_type == TYPE_VALUES_VARINT) ||
+               (pkg_type == TYPE_VALUES_DELTA)) {
+      void *part = buffer;
+      status = parse_part_values_varint(&buffer, &buffer_size, &vl.values,
+                                        &vl.values_len);
+      if (status != 0)
+        break;
 
-      sfree(vl.values);
+      if (flags & PP_FORWARD)
+        network_forward_values(se, &vl, part, pkg_length, pkg_type, username);
+      else
+        network_dispatch_values(&vl, username);
+      vl.values = NULL;
+      vl.values_len = 0;
+    } else if (pkg_type == TYPE_TIME_DELTA) {
+      status = parse_part_time_delta(&buffer, &buffer_size, &vl.time);
+      if (status == 0)
+        n.time = vl.time;
     } else if (pkg_type == TYPE_TIME) {
       uint64_t tmp = 0;
       status = parse_part_number(&buffer, &buffer_size, &tmp);
@@ -1427,29 +2545,18 @@ static int parse_packet(sockent_t *se, /* {{{ */
     } else if (pkg_type == TYPE_HOST) {
       status =
           parse_part_string(&buffer, &buffer_size, vl.host, sizeof(vl.host));
-      if (status == 0)
-        sstrncpy(n.host, vl.host, sizeof(n.host));
     } else if (pkg_type == TYPE_PLUGIN) {
       status = parse_part_string(&buffer, &buffer_size, vl.plugin,
                                  sizeof(vl.plugin));
-      if (status == 0)
-        sstrncpy(n.plugin, vl.plugin, sizeof(n.plugin));
     } else if (pkg_type == TYPE_PLUGIN_INSTANCE) {
       status = parse_part_string(&buffer, &buffer_size, vl.plugin_instance,
                                  sizeof(vl.plugin_instance));
-      if (status == 0)
-        sstrncpy(n.plugin_instance, vl.plugin_instance,
-                 sizeof(n.plugin_instance));
     } else if (pkg_type == TYPE_TYPE) {
       status =
           parse_part_string(&buffer, &buffer_size, vl.type, sizeof(vl.type));
-      if (status == 0)
-        sstrncpy(n.type, vl.type, sizeof(n.type));
     } else if (pkg_type == TYPE_TYPE_INSTANCE) {
       status = parse_part_string(&buffer, &buffer_size, vl.type_instance,
                                  sizeof(vl.type_instance));
-      if (status == 0)
-        sstrncpy(n.type_instance, vl.type_instance, sizeof(n.type_instance));
     } else if (pkg_type == TYPE_MESSAGE) {
       status = parse_part_string(&buffer, &buffer_size, n.message,
                                  sizeof(n.message));
@@ -1471,6 +2578,14 @@ static int parse_packet(sockent_t *se, /* {{{ */
              "Ignoring notification with "
              "an empty message.");
       } else {
+        /* The identifier parts are shared with value lists and only copied
+         * when a notification is actually dispatched. */
+        sstrncpy(n.host, vl.host, sizeof(n.host));
+        sstrncpy(n.plugin, vl.plugin, sizeof(n.plugin));
+        sstrncpy(n.plugin_instance, vl.plugin_instance,
+                 sizeof(n.plugin_instance));
+        sstrncpy(n.type, vl.type, sizeof(n.type));
+        sstrncpy(n.type_instance, vl.type_instance, sizeof(n.type_instance));
         network_dispatch_notification(&n);
       }
     } else if (pkg_type == TYPE_SEVERITY) {
@@ -1506,6 +2621,12 @@ static void free_sockent_client(struct sockent_client *sec) /* {{{ */
   sfree(sec->password);
   if (sec->cypher != NULL)
     gcry_cipher_close(sec->cypher);
+  if (sec->gcm_cypher != NULL)
+    gcry_cipher_close(sec->gcm_cypher);
+  if (sec->hmac != NULL)
+    gcry_md_close(sec->hmac);
+  sfree(sec->batch_buffer);
+  sfree(sec->batch_len);
 #endif
 } /* }}} void free_sockent_client */
 
@@ -1519,11 +2640,10 @@ static void free_sockent_server(struct sockent_server *ses) /* {{{ */
   }
 
   sfree(ses->fd);
+  sfree(ses->rcvbuf);
 #if HAVE_GCRYPT_H
   sfree(ses->auth_file);
   fbh_destroy(ses->userdb);
-  if (ses->cypher != NULL)
-    gcry_cipher_close(ses->cypher);
 #endif
 } /* }}} void free_sockent_server */
 
@@ -1684,7 +2804,7 @@ static int network_set_interface(const sockent_t *se,
 } /* }}} network_set_interface */
 
 static int network_bind_socket(int fd, const struct addrinfo *ai,
-                               const int interface_idx) {
+                               const int interface_idx, _Bool reuse_port) {
 #if KERNEL_SOLARIS
   char loop = 0;
 #else
@@ -1698,6 +2818,17 @@ static int network_bind_socket(int fd, const struct addrinfo *ai,
     return -1;
   }
 
+#ifdef SO_REUSEPORT
+  /* let the kernel distribute datagrams across several sockets */
+  if (reuse_port &&
+      (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(yes)) == -1)) {
+    ERROR("network plugin: setsockopt (reuseport): %s", STRERRNO);
+    return -1;
+  }
+#else
+  assert(!reuse_port);
+#endif
+
   DEBUG("fd = %i; calling `bind'", fd);
 
   if (bind(fd, ai->ai_addr, ai->ai_addrlen) == -1) {
@@ -1820,6 +2951,7 @@ static sockent_t *sockent_create(int type) /* {{{ */
   se->node = NULL;
   se->service = NULL;
   se->interface = 0;
+  se->socktype = SOCK_DGRAM;
   se->next = NULL;
 
   if (type == SOCKENT_TYPE_SERVER) {
@@ -1829,18 +2961,24 @@ static sockent_t *sockent_create(int type) /* {{{ */
     se->data.server.security_level = SECURITY_LEVEL_NONE;
     se->data.server.auth_file = NULL;
     se->data.server.userdb = NULL;
-    se->data.server.cypher = NULL;
 #endif
   } else {
     se->data.client.fd = -1;
     se->data.client.addr = NULL;
     se->data.client.resolve_interval = 0;
     se->data.client.next_resolve_reconnect = 0;
+    se->data.client.next_connect = 0;
+    se->data.client.connect_backoff = 0;
 #if HAVE_GCRYPT_H
     se->data.client.security_level = SECURITY_LEVEL_NONE;
+    se->data.client.cipher = CIPHER_AES256_OFB;
     se->data.client.username = NULL;
     se->data.client.password = NULL;
     se->data.client.cypher = NULL;
+    se->data.client.gcm_cypher = NULL;
+    se->data.client.hmac = NULL;
+    se->data.client.batch_buffer = NULL;
+    se->data.client.batch_len = NULL;
 #endif
   }
 
@@ -1917,9 +3055,36 @@ static int sockent_client_disconnect(sockent_t *se) /* {{{ */
   return 0;
 } /* }}} int sockent_client_disconnect */
 
+/* Connects the stream socket of "se" to "ai". The send timeout bounds how
+ * long a slow receiver can block the sending thread. */
+static int sockent_client_connect_stream(sockent_t *se, /* {{{ */
+                                         const struct addrinfo *ai) {
+  struct sockent_client *client = &se->data.client;
+  struct timeval tv = {.tv_sec = NETWORK_STREAM_SEND_TIMEOUT};
+
+  if (setsockopt(client->fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv)) != 0)
+    WARNING("network plugin: setsockopt (SO_SNDTIMEO) failed: %s", STRERRNO);
+
+#ifdef TCP_NODELAY
+  /* Datagrams are written in batches; don't delay the last one. */
+  int yes = 1;
+  if (setsockopt(client->fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes)) !=
+      0)
+    WARNING("network plugin: setsockopt (TCP_NODELAY) failed: %s", STRERRNO);
+#endif
+
+  if (connect(client->fd, ai->ai_addr, ai->ai_addrlen) != 0) {
+    DEBUG("network plugin: connect (%s) failed: %s", se->node, STRERRNO);
+    return -1;
+  }
+
+  return 0;
+} /* }}} int sockent_client_connect_stream */
+
 static int sockent_client_connect(sockent_t *se) /* {{{ */
 {
   static c_complain_t complaint = C_COMPLAIN_INIT_STATIC;
+  static c_complain_t stream_complaint = C_COMPLAIN_INIT_STATIC;
 
   struct sockent_client *client;
   struct addrinfo *ai_list;
@@ -1944,10 +3109,16 @@ static int sockent_client_connect(sockent_t *se) /* {{{ */
   if (client->fd >= 0 && !reconnect) /* already connected and not stale*/
     return 0;
 
-  struct addrinfo ai_hints = {.ai_family = AF_UNSPEC,
-                              .ai_flags = AI_ADDRCONFIG,
-                              .ai_protocol = IPPROTO_UDP,
-                              .ai_socktype = SOCK_DGRAM};
+  /* Don't retry a failed stream connection before the backoff has passed. */
+  if ((se->socktype == SOCK_STREAM) && (client->fd < 0) &&
+      (client->next_connect > now))
+    return -1;
+
+  struct addrinfo ai_hints = {
+      .ai_family = AF_UNSPEC,
+      .ai_flags = AI_ADDRCONFIG,
+      .ai_protocol = (se->socktype == SOCK_STREAM) ? IPPROTO_TCP : IPPROTO_UDP,
+      .ai_socktype = se->socktype};
 
   status = getaddrinfo(se->node,
                        (se->service != NULL) ? se->service : NET_DEFAULT_PORT,
@@ -1990,12 +3161,37 @@ static int sockent_client_connect(sockent_t *se) /* {{{ */
     network_set_ttl(se, ai_ptr);
     network_set_interface(se, ai_ptr);
 
+    if ((se->socktype == SOCK_STREAM) &&
+        (sockent_client_connect_stream(se, ai_ptr) != 0)) {
+      sockent_client_disconnect(se);
+      continue;
+    }
+
     /* We don't open more than one write-socket per
      * node/service pair.. */
     break;
   }
 
   freeaddrinfo(ai_list);
+
+  if (se->socktype == SOCK_STREAM) {
+    if (client->fd < 0) {
+      if (client->connect_backoff < NETWORK_STREAM_BACKOFF_MIN)
+        client->connect_backoff = NETWORK_STREAM_BACKOFF_MIN;
+      else if (client->connect_backoff < NETWORK_STREAM_BACKOFF_MAX)
+        client->connect_backoff *= 2;
+      client->next_connect = now + client->connect_backoff;
+      c_complain(LOG_ERR, &stream_complaint,
+                 "network plugin: Connecting to \"%s\" failed. Retrying in "
+                 "%.0f seconds.",
+                 se->node, CDTIME_T_TO_DOUBLE(client->connect_backoff));
+    } else {
+      client->connect_backoff = 0;
+      c_release(LOG_NOTICE, &stream_complaint,
+                "network plugin: Successfully connected to \"%s\".", se->node);
+    }
+  }
+
   if (client->fd < 0)
     return -1;
 
@@ -2028,10 +3224,11 @@ static int sockent_server_listen(sockent_t *se) /* {{{ */
   DEBUG("network plugin: sockent_server_listen: node = %s; service = %s;", node,
         service);
 
-  struct addrinfo ai_hints = {.ai_family = AF_UNSPEC,
-                              .ai_flags = AI_ADDRCONFIG | AI_PASSIVE,
-                              .ai_protocol = IPPROTO_UDP,
-                              .ai_socktype = SOCK_DGRAM};
+  struct addrinfo ai_hints = {
+      .ai_family = AF_UNSPEC,
+      .ai_flags = AI_ADDRCONFIG | AI_PASSIVE,
+      .ai_protocol = (se->socktype == SOCK_STREAM) ? IPPROTO_TCP : IPPROTO_UDP,
+      .ai_socktype = se->socktype};
 
   status = getaddrinfo(node, service, &ai_hints, &ai_list);
   if (status != 0) {
@@ -2041,34 +3238,87 @@ static int sockent_server_listen(sockent_t *se) /* {{{ */
     return -1;
   }
 
+  /* With more than one receive thread, open one socket per thread for each
+   * address and let the kernel shard the incoming traffic. */
+  size_t sockets_per_addr = network_config_receive_threads;
+#ifndef SO_REUSEPORT
+  if (sockets_per_addr > 1) {
+    WARNING("network plugin: SO_REUSEPORT is not available on this system. "
+            "Opening only one socket per address.");
+    sockets_per_addr = 1;
+  }
+#endif
+
   for (struct addrinfo *ai_ptr = ai_list; ai_ptr != NULL;
        ai_ptr = ai_ptr->ai_next) {
-    int *tmp;
+    for (size_t i = 0; i < sockets_per_addr; i++) {
+      int *tmp;
 
-    tmp = realloc(se->data.server.fd,
-                  sizeof(*tmp) * (se->data.server.fd_num + 1));
-    if (tmp == NULL) {
-      ERROR("network plugin: realloc failed.");
-      continue;
-    }
-    se->data.server.fd = tmp;
-    tmp = se->data.server.fd + se->data.server.fd_num;
-
-    *tmp = socket(ai_ptr->ai_family, ai_ptr->ai_socktype, ai_ptr->ai_protocol);
-    if (*tmp < 0) {
-      ERROR("network plugin: socket(2) failed: %s", STRERRNO);
-      continue;
-    }
+      tmp = realloc(se->data.server.fd,
+                    sizeof(*tmp) * (se->data.server.fd_num + 1));
+      if (tmp == NULL) {
+        ERROR("network plugin: realloc failed.");
+        continue;
+      }
+      se->data.server.fd = tmp;
+      tmp = se->data.server.fd + se->data.server.fd_num;
 
-    status = network_bind_socket(*tmp, ai_ptr, se->interface);
-    if (status != 0) {
-      close(*tmp);
-      *tmp = -1;
-      continue;
-    }
+      rcvbuf_t *rb = realloc(se->data.server.rcvbuf,
+                             sizeof(*rb) * (se->data.server.fd_num + 1));
+      if (rb == NULL) {
+        ERROR("network plugin: realloc failed.");
+        continue;
+      }
+      se->data.server.rcvbuf = rb;
+      rb = se->data.server.rcvbuf + se->data.server.fd_num;
+      memset(rb, 0, sizeof(*rb));
+
+      /* Under collectdmon(1) the socket may have been kept open while the
+       * daemon restarted. In that case it is bound already. */
+      char fd_name[FDSTORE_NAME_MAX] = "";
+      if (fdstore_enabled() &&
+          (fdstore_socket_name(fd_name, sizeof(fd_name), "network", ai_ptr,
+                               i) != 0))
+        fd_name[0] = 0;
+
+      *tmp = (fd_name[0] != 0) ? fdstore_get(fd_name) : -1;
+      if (*tmp < 0) {
+        *tmp = socket(ai_ptr->ai_family, ai_ptr->ai_socktype,
+                      ai_ptr->ai_protocol);
+        if (*tmp < 0) {
+          ERROR("network plugin: socket(2) failed: %s", STRERRNO);
+          continue;
+        }
+
+        status = network_bind_socket(*tmp, ai_ptr, se->interface,
+                                     /* reuse_port = */ sockets_per_addr > 1);
+        if (status != 0) {
+          close(*tmp);
+          *tmp = -1;
+          continue;
+        }
+      }
 
-    se->data.server.fd_num++;
-    continue;
+      /* The listening socket is non-blocking so that accept(2) can't block
+       * the receive thread if a connection is reset after poll(2). */
+      if ((se->socktype == SOCK_STREAM) &&
+          ((fcntl(*tmp, F_SETFL, fcntl(*tmp, F_GETFL) | O_NONBLOCK) != 0) ||
+           (listen(*tmp, SOMAXCONN) != 0))) {
+        ERROR("network plugin: listen(2) failed: %s", STRERRNO);
+        close(*tmp);
+        *tmp = -1;
+        continue;
+      }
+
+      if (fd_name[0] != 0)
+        fdstore_put(fd_name, *tmp);
+
+      if (se->socktype == SOCK_DGRAM)
+        rcvbuf_init(rb, *tmp, network_config_receive_buffer,
+                    network_config_receive_buffer_auto, "network");
+
+      se->data.server.fd_num++;
+    }
   } /* for (ai_list) */
 
   freeaddrinfo(ai_list);
@@ -2128,221 +3378,732 @@ static int sockent_add(sockent_t *se) /* {{{ */
   return 0;
 } /* }}} int sockent_add */
 
-static void *dispatch_thread(void __attribute__((unused)) * arg) /* {{{ */
+static void receive_entry_free(receive_list_entry_t *ent) /* {{{ */
+{
+  if (ent == NULL)
+    return;
+
+  sfree(ent->data);
+  sfree(ent);
+} /* }}} void receive_entry_free */
+
+static receive_list_entry_t *receive_entry_alloc(void) /* {{{ */
 {
+  receive_list_entry_t *ent = calloc(1, sizeof(*ent));
+  if (ent == NULL)
+    return NULL;
+
+  ent->data = malloc(network_config_packet_size);
+  if (ent->data == NULL) {
+    sfree(ent);
+    return NULL;
+  }
+
+  return ent;
+} /* }}} receive_list_entry_t *receive_entry_alloc */
+
+/* Fills "ret" with up to "num" entries, taking them from the pool first and
+ * allocating new ones if the pool runs dry. Returns the number of entries
+ * stored in "ret". */
+static size_t receive_pool_get(receive_list_entry_t **ret, /* {{{ */
+                               size_t num) {
+  size_t have = 0;
+
+  pthread_mutex_lock(&receive_pool_lock);
+  while ((have < num) && (receive_pool_head != NULL)) {
+    ret[have] = receive_pool_head;
+    receive_pool_head = receive_pool_head->next;
+    receive_pool_length--;
+    have++;
+  }
+  pthread_mutex_unlock(&receive_pool_lock);
+
+  while (have < num) {
+    receive_list_entry_t *ent = receive_entry_alloc();
+    if (ent == NULL)
+      break;
+    ret[have] = ent;
+    have++;
+  }
+
+  for (size_t i = 0; i < have; i++)
+    ret[i]->next = NULL;
+
+  return have;
+} /* }}} size_t receive_pool_get */
+
+/* Returns a list of entries to the pool. Entries exceeding the pool's size
+ * limit are freed. */
+static void receive_pool_put(receive_list_entry_t *head) /* {{{ */
+{
+  size_t pool_max = NETWORK_RECEIVE_POOL_SIZE / network_config_packet_size;
+  if (pool_max < NETWORK_RECEIVE_BATCH)
+    pool_max = NETWORK_RECEIVE_BATCH;
+
+  pthread_mutex_lock(&receive_pool_lock);
+  while ((head != NULL) && (receive_pool_length < pool_max)) {
+    receive_list_entry_t *next = head->next;
+
+    head->next = receive_pool_head;
+    receive_pool_head = head;
+    receive_pool_length++;
+
+    head = next;
+  }
+  pthread_mutex_unlock(&receive_pool_lock);
+
+  while (head != NULL) {
+    receive_list_entry_t *next = head->next;
+    receive_entry_free(head);
+    head = next;
+  }
+} /* }}} void receive_pool_put */
+
+static void receive_pool_destroy(void) /* {{{ */
+{
+  pthread_mutex_lock(&receive_pool_lock);
+  receive_list_entry_t *head = receive_pool_head;
+  receive_pool_head = NULL;
+  receive_pool_length = 0;
+  pthread_mutex_unlock(&receive_pool_lock);
+
+  while (head != NULL) {
+    receive_list_entry_t *next = head->next;
+    receive_entry_free(head);
+    head = next;
+  }
+} /* }}} void receive_pool_destroy */
+
+/* Moves all entries of "src" to the end of "dst". */
+static void receive_list_append(receive_list_t *dst, /* {{{ */
+                                receive_list_t *src) {
+  if (src->head == NULL)
+    return;
+
+  assert(((dst->head == NULL) && (dst->length == 0)) ||
+         ((dst->head != NULL) && (dst->length != 0)));
+
+  if (dst->head == NULL)
+    dst->head = src->head;
+  else
+    dst->tail->next = src->head;
+  dst->tail = src->tail;
+  dst->length += src->length;
+
+  src->head = NULL;
+  src->tail = NULL;
+  src->length = 0;
+} /* }}} void receive_list_append */
+
+static void *dispatch_thread(void *arg) /* {{{ */
+{
+  receive_queue_t *q = arg;
+
   while (42) {
-    receive_list_entry_t *ent;
-    sockent_t *se;
+    receive_list_entry_t *head;
 
     /* Lock and wait for more data to come in */
-    pthread_mutex_lock(&receive_list_lock);
-    while ((listen_loop == 0) && (receive_list_head == NULL))
-      pthread_cond_wait(&receive_list_cond, &receive_list_lock);
+    pthread_mutex_lock(&q->lock);
+    while ((listen_loop == 0) && (q->list.head == NULL))
+      pthread_cond_wait(&q->cond, &q->lock);
 
-    /* Remove the head entry and unlock */
-    ent = receive_list_head;
-    if (ent != NULL)
-      receive_list_head = ent->next;
-    receive_list_length--;
-    pthread_mutex_unlock(&receive_list_lock);
+    /* Take the entire list and unlock */
+    head = q->list.head;
+    q->list.head = NULL;
+    q->list.tail = NULL;
+    q->list.length = 0;
+    pthread_mutex_unlock(&q->lock);
 
     /* Check whether we are supposed to exit. We do NOT check `listen_loop'
      * because we dispatch all missing packets before shutting down. */
-    if (ent == NULL)
+    if (head == NULL)
       break;
 
-    /* Look for the correct `sockent_t' */
-    se = listen_sockets;
-    while (se != NULL) {
-      size_t i;
+    for (receive_list_entry_t *ent = head; ent != NULL; ent = ent->next) {
+      parse_packet(ent->se, ent->data, ent->data_len,
+                   network_config_forward_passthrough ? PP_FORWARD : 0,
+                   /* username = */ NULL);
+      if (network_config_forward_passthrough &&
+          !network_config_forward_rebatch)
+        network_forward_flush(parse_scratch_lookup());
+      if (top_senders_addr != NULL)
+        top_senders_count_packet(ent);
+    }
 
-      for (i = 0; i < se->data.server.fd_num; i++)
-        if (se->data.server.fd[i] == ent->fd)
-          break;
+    /* Add the parts forwarded from this batch to the send buffer before
+     * waiting for more packets. */
+    if (network_config_forward_passthrough)
+      network_forward_flush(parse_scratch_lookup());
 
-      if (i < se->data.server.fd_num)
-        break;
+    receive_pool_put(head);
+  } /* while (42) */
 
-      se = se->next;
-    }
+  return NULL;
+} /* }}} void *dispatch_thread */
+
+/* Reads one or more datagrams from "fd" into the entries of "ents". Returns
+ * the number of datagrams received, zero if no data was available, or a
+ * negative value on error. */
+static int network_receive_batch(int fd, rcvbuf_t *rb, /* {{{ */
+                                 receive_list_entry_t **ents,
+                                 size_t ents_num) {
+#if HAVE_RECVMMSG
+  struct mmsghdr msgs[NETWORK_RECEIVE_BATCH];
+  struct iovec iovs[NETWORK_RECEIVE_BATCH];
+  char control[NETWORK_RECEIVE_BATCH][RCVBUF_CONTROL_SIZE];
+
+  if (ents_num > NETWORK_RECEIVE_BATCH)
+    ents_num = NETWORK_RECEIVE_BATCH;
+
+  memset(msgs, 0, sizeof(msgs[0]) * ents_num);
+  for (size_t i = 0; i < ents_num; i++) {
+    iovs[i].iov_base = ents[i]->data;
+    iovs[i].iov_len = network_config_packet_size;
+    msgs[i].msg_hdr.msg_iov = iovs + i;
+    msgs[i].msg_hdr.msg_iovlen = 1;
+    msgs[i].msg_hdr.msg_name = &ents[i]->addr;
+    msgs[i].msg_hdr.msg_namelen = sizeof(ents[i]->addr);
+    msgs[i].msg_hdr.msg_control = control[i];
+    msgs[i].msg_hdr.msg_controllen = sizeof(control[i]);
+  }
+
+  /* poll(2) reported the socket as readable, so at least one datagram is
+   * available. Don't block waiting for the rest of the batch. */
+  int status = recvmmsg(fd, msgs, (unsigned int)ents_num, MSG_DONTWAIT,
+                        /* timeout = */ NULL);
+  if (status < 0) {
+    if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR))
+      return 0;
+    ERROR("network plugin: recvmmsg(2) failed: %s", STRERRNO);
+    return -1;
+  }
+
+  for (int i = 0; i < status; i++) {
+    ents[i]->data_len = (int)msgs[i].msg_len;
+    if (msgs[i].msg_hdr.msg_namelen == 0)
+      ents[i]->addr.ss_family = AF_UNSPEC;
+  }
+
+  /* The drop counter is cumulative, the last datagram has the latest. */
+  if ((rb != NULL) && (status > 0)) {
+    rcvbuf_update(rb, &msgs[status - 1].msg_hdr);
+    rcvbuf_tune(rb);
+  }
+
+  return status;
+#else
+  (void)ents_num;
+
+  char control[RCVBUF_CONTROL_SIZE];
+  struct iovec iov = {.iov_base = ents[0]->data,
+                      .iov_len = network_config_packet_size};
+  struct msghdr msg = {.msg_name = &ents[0]->addr,
+                       .msg_namelen = sizeof(ents[0]->addr),
+                       .msg_iov = &iov,
+                       .msg_iovlen = 1,
+                       .msg_control = control,
+                       .msg_controllen = sizeof(control)};
+  ssize_t buffer_len = recvmsg(fd, &msg, 0 /* no flags */);
+  if (buffer_len < 0) {
+    if (errno == EINTR)
+      return 0;
+    ERROR("network plugin: recvmsg(2) failed: %s", STRERRNO);
+    return -1;
+  }
+
+  ents[0]->data_len = (int)buffer_len;
+  if (msg.msg_namelen == 0)
+    ents[0]->addr.ss_family = AF_UNSPEC;
+
+  if (rb != NULL) {
+    rcvbuf_update(rb, &msg);
+    rcvbuf_tune(rb);
+  }
+  return 1;
+#endif
+} /* }}} int network_receive_batch */
+
+/* Hands the private lists of a receive thread over to the receive queues. If
+ * "wait" is false, queues that are currently locked are skipped. Blocking
+ * here has led to insufficient performance in the past. */
+static void network_receive_flush(receive_list_t *private, /* {{{ */
+                                  _Bool wait) {
+  for (size_t i = 0; i < receive_queues_num; i++) {
+    receive_queue_t *q = receive_queues + i;
+
+    if (private[i].head == NULL)
+      continue;
 
-    if (se == NULL) {
-      ERROR("network plugin: Got packet from FD %i, but can't "
-            "find an appropriate socket entry.",
-            ent->fd);
-      sfree(ent->data);
-      sfree(ent);
+    if (wait)
+      pthread_mutex_lock(&q->lock);
+    else if (pthread_mutex_trylock(&q->lock) != 0)
       continue;
+
+    receive_list_append(&q->list, private + i);
+
+    pthread_cond_signal(&q->cond);
+    pthread_mutex_unlock(&q->lock);
+  }
+} /* }}} void network_receive_flush */
+
+/* Appends a socket to the poll set of the receive thread. */
+static int receive_thread_add(receive_thread_t *rt, int fd, /* {{{ */
+                              sockent_t *se, size_t queue,
+                              receive_stream_t *stream) {
+  if (rt->pollfd_num >= rt->pollfd_size) {
+    size_t size = 2 * rt->pollfd_size + 4;
+    struct pollfd *pollfd = realloc(rt->pollfd, size * sizeof(*pollfd));
+    if (pollfd != NULL)
+      rt->pollfd = pollfd;
+    sockent_t **sockent = realloc(rt->sockent, size * sizeof(*sockent));
+    if (sockent != NULL)
+      rt->sockent = sockent;
+    size_t *q = realloc(rt->queue, size * sizeof(*q));
+    if (q != NULL)
+      rt->queue = q;
+    receive_stream_t **st = realloc(rt->stream, size * sizeof(*st));
+    if (st != NULL)
+      rt->stream = st;
+    rcvbuf_t **rb = realloc(rt->rcvbuf, size * sizeof(*rb));
+    if (rb != NULL)
+      rt->rcvbuf = rb;
+    if ((pollfd == NULL) || (sockent == NULL) || (q == NULL) || (st == NULL) ||
+        (rb == NULL))
+      return ENOMEM;
+    rt->pollfd_size = size;
+  }
+
+  rt->pollfd[rt->pollfd_num] = (struct pollfd){
+      .fd = fd, .events = POLLIN | POLLPRI, .revents = 0,
+  };
+  rt->sockent[rt->pollfd_num] = se;
+  rt->queue[rt->pollfd_num] = queue;
+  rt->stream[rt->pollfd_num] = stream;
+  rt->rcvbuf[rt->pollfd_num] = NULL;
+  rt->pollfd_num++;
+
+  return 0;
+} /* }}} int receive_thread_add */
+
+/* Accepts a connection on the listening stream socket "fd". All datagrams
+ * received on the connection are queued for the same dispatch thread. */
+static int network_accept_stream(receive_thread_t *rt, int fd, /* {{{ */
+                                 sockent_t *se) {
+  struct sockaddr_storage addr = {0};
+  socklen_t addrlen = sizeof(addr);
+  int conn = accept(fd, (struct sockaddr *)&addr, &addrlen);
+  if (conn < 0) {
+    if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR) ||
+        (errno == ECONNABORTED))
+      return 0;
+    ERROR("network plugin: accept(2) failed: %s", STRERRNO);
+    return -1;
+  }
+
+  receive_stream_t *stream = malloc(sizeof(*stream));
+  if ((stream == NULL) ||
+      (receive_thread_add(rt, conn, se, (size_t)conn % receive_queues_num,
+                          stream) != 0)) {
+    ERROR("network plugin: Allocating a stream connection failed.");
+    sfree(stream);
+    close(conn);
+    return 0;
+  }
+  stream->fill = 0;
+  stream->addr = addr;
+
+  DEBUG("network plugin: Accepted connection on %s, fd = %i.", se->node, conn);
+  return 0;
+} /* }}} int network_accept_stream */
+
+/* Reads from the stream connection "fd" and splits the data into datagrams,
+ * which are appended to "list". Returns the number of datagrams received or
+ * a negative value if the connection was closed or is broken. */
+static int network_receive_stream(int fd, receive_stream_t *stream, /* {{{ */
+                                  sockent_t *se, receive_list_entry_t **spare,
+                                  size_t *spare_num, receive_list_t *list,
+                                  uint64_t *ret_octets) {
+  ssize_t status = recv(fd, stream->buffer + stream->fill,
+                        sizeof(stream->buffer) - stream->fill, MSG_DONTWAIT);
+  if (status < 0) {
+    if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR))
+      return 0;
+    NOTICE("network plugin: recv(2) on stream connection failed: %s",
+           STRERRNO);
+    return -1;
+  } else if (status == 0) {
+    DEBUG("network plugin: Stream connection fd = %i closed by peer.", fd);
+    return -1;
+  }
+  stream->fill += (size_t)status;
+  *ret_octets = (uint64_t)status;
+
+  int received = 0;
+  size_t offset = 0;
+  while ((stream->fill - offset) >= NETWORK_STREAM_HEADER_SIZE) {
+    uint16_t tmp;
+    memcpy(&tmp, stream->buffer + offset, sizeof(tmp));
+    size_t len = ntohs(tmp);
+
+    if ((len == 0) || (len > network_config_packet_size)) {
+      NOTICE("network plugin: Closing stream connection which sent a "
+             "datagram of %" PRIsz " bytes; the MaxPacketSize is %" PRIsz ".",
+             len, network_config_packet_size);
+      return -1;
     }
+    if ((stream->fill - offset) < (NETWORK_STREAM_HEADER_SIZE + len))
+      break;
 
-    parse_packet(se, ent->data, ent->data_len, /* flags = */ 0,
-                 /* username = */ NULL);
-    sfree(ent->data);
-    sfree(ent);
-  } /* while (42) */
+    if (*spare_num == 0)
+      *spare_num = receive_pool_get(spare, NETWORK_RECEIVE_BATCH);
+    if (*spare_num == 0) {
+      ERROR("network plugin: Allocating receive buffers failed.");
+      return -1;
+    }
+    (*spare_num)--;
+    receive_list_entry_t *ent = spare[*spare_num];
+    memcpy(ent->data, stream->buffer + offset + NETWORK_STREAM_HEADER_SIZE,
+           len);
+    ent->data_len = (int)len;
+    ent->se = se;
+    ent->addr = stream->addr;
+
+    if (list->head == NULL)
+      list->head = ent;
+    else
+      list->tail->next = ent;
+    list->tail = ent;
+    list->length++;
+    received++;
 
-  return NULL;
-} /* }}} void *dispatch_thread */
+    offset += NETWORK_STREAM_HEADER_SIZE + len;
+  }
+
+  /* Keep the incomplete datagram at the beginning of the buffer. */
+  if (offset > 0) {
+    memmove(stream->buffer, stream->buffer + offset, stream->fill - offset);
+    stream->fill -= offset;
+  }
+
+  return received;
+} /* }}} int network_receive_stream */
 
-static int network_receive(void) /* {{{ */
+/* Removes the closed stream connections (fd < 0) from the poll set. */
+static void receive_thread_compact(receive_thread_t *rt) /* {{{ */
 {
-  char buffer[network_config_packet_size];
-  int buffer_len;
+  size_t j = 0;
 
-  int status = 0;
+  for (size_t i = 0; i < rt->pollfd_num; i++) {
+    if (rt->pollfd[i].fd < 0) {
+      sfree(rt->stream[i]);
+      continue;
+    }
 
-  receive_list_entry_t *private_list_head;
-  receive_list_entry_t *private_list_tail;
-  uint64_t private_list_length;
+    rt->pollfd[j] = rt->pollfd[i];
+    rt->sockent[j] = rt->sockent[i];
+    rt->queue[j] = rt->queue[i];
+    rt->stream[j] = rt->stream[i];
+    rt->rcvbuf[j] = rt->rcvbuf[i];
+    j++;
+  }
+
+  rt->pollfd_num = j;
+} /* }}} void receive_thread_compact */
 
-  assert(listen_sockets_num > 0);
+static int network_receive(receive_thread_t *rt) /* {{{ */
+{
+  /* Entries with preallocated packet buffers, ready to be received into. */
+  receive_list_entry_t *spare[NETWORK_RECEIVE_BATCH];
+  size_t spare_num = 0;
 
-  private_list_head = NULL;
-  private_list_tail = NULL;
-  private_list_length = 0;
+  /* One private list per receive queue. */
+  receive_list_t private[receive_queues_num];
+  memset(private, 0, sizeof(private));
+
+  int status = 0;
+
+  assert(rt->pollfd_num > 0);
 
   while (listen_loop == 0) {
-    status = poll(listen_sockets_pollfd, listen_sockets_num, -1);
-    if (status <= 0) {
+    int ready = poll(rt->pollfd, rt->pollfd_num, -1);
+    if (ready <= 0) {
       if (errno == EINTR)
         continue;
       ERROR("network plugin: poll(2) failed: %s", STRERRNO);
+      status = -1;
       break;
     }
 
-    for (size_t i = 0; (i < listen_sockets_num) && (status > 0); i++) {
-      receive_list_entry_t *ent;
+    _Bool closed = 0;
+    size_t pollfd_num = rt->pollfd_num;
+    for (size_t i = 0; (i < pollfd_num) && (ready > 0); i++) {
+      receive_list_t *list = private + rt->queue[i];
+      uint64_t octets = 0;
+      int received;
 
-      if ((listen_sockets_pollfd[i].revents & (POLLIN | POLLPRI)) == 0)
+      if (rt->pollfd[i].revents == 0)
+        continue;
+      ready--;
+
+      if (rt->sockent[i]->socktype == SOCK_STREAM) {
+        if (rt->stream[i] == NULL) {
+          if (network_accept_stream(rt, rt->pollfd[i].fd, rt->sockent[i]) !=
+              0) {
+            status = -1;
+            break;
+          }
+          continue;
+        }
+
+        received =
+            network_receive_stream(rt->pollfd[i].fd, rt->stream[i],
+                                   rt->sockent[i], spare, &spare_num, list,
+                                   &octets);
+        if (received < 0) {
+          close(rt->pollfd[i].fd);
+          rt->pollfd[i].fd = -1;
+          closed = 1;
+          continue;
+        }
+
+        NETWORK_STATS_ADD(stats_octets_rx, octets);
+        if (received > 0) {
+          NETWORK_STATS_ADD(stats_packets_rx, received);
+          network_receive_flush(private, /* wait = */ 0);
+        }
         continue;
-      status--;
-
-      buffer_len = recv(listen_sockets_pollfd[i].fd, buffer, sizeof(buffer),
-                        0 /* no flags */);
-      if (buffer_len < 0) {
-        status = (errno != 0) ? errno : -1;
-        ERROR("network plugin: recv(2) failed: %s", STRERRNO);
-        break;
       }
 
-      stats_octets_rx += ((uint64_t)buffer_len);
-      stats_packets_rx++;
+      if ((rt->pollfd[i].revents & (POLLIN | POLLPRI)) == 0)
+        continue;
 
-      /* TODO: Possible performance enhancement: Do not free
-       * these entries in the dispatch thread but put them in
-       * another list, so we don't have to allocate more and
-       * more of these structures. */
-      ent = calloc(1, sizeof(*ent));
-      if (ent == NULL) {
-        ERROR("network plugin: calloc failed.");
+      spare_num += receive_pool_get(spare + spare_num,
+                                    NETWORK_RECEIVE_BATCH - spare_num);
+      if (spare_num == 0) {
+        ERROR("network plugin: Allocating receive buffers failed.");
         status = ENOMEM;
         break;
       }
 
-      ent->data = malloc(network_config_packet_size);
-      if (ent->data == NULL) {
-        sfree(ent);
-        ERROR("network plugin: malloc failed.");
-        status = ENOMEM;
+      received = network_receive_batch(rt->pollfd[i].fd, rt->rcvbuf[i], spare,
+                                       spare_num);
+      if (received < 0) {
+        status = (errno != 0) ? errno : -1;
         break;
       }
-      ent->fd = listen_sockets_pollfd[i].fd;
-      ent->next = NULL;
 
-      memcpy(ent->data, buffer, buffer_len);
-      ent->data_len = buffer_len;
+      for (int j = 0; j < received; j++) {
+        receive_list_entry_t *ent = spare[j];
 
-      if (private_list_head == NULL)
-        private_list_head = ent;
-      else
-        private_list_tail->next = ent;
-      private_list_tail = ent;
-      private_list_length++;
-
-      /* Do not block here. Blocking here has led to
-       * insufficient performance in the past. */
-      if (pthread_mutex_trylock(&receive_list_lock) == 0) {
-        assert(((receive_list_head == NULL) && (receive_list_length == 0)) ||
-               ((receive_list_head != NULL) && (receive_list_length != 0)));
-
-        if (receive_list_head == NULL)
-          receive_list_head = private_list_head;
+        ent->se = rt->sockent[i];
+        octets += (uint64_t)ent->data_len;
+
+        if (list->head == NULL)
+          list->head = ent;
         else
-          receive_list_tail->next = private_list_head;
-        receive_list_tail = private_list_tail;
-        receive_list_length += private_list_length;
+          list->tail->next = ent;
+        list->tail = ent;
+        list->length++;
+      }
 
-        pthread_cond_signal(&receive_list_cond);
-        pthread_mutex_unlock(&receive_list_lock);
+      spare_num -= (size_t)received;
+      memmove(spare, spare + received, sizeof(spare[0]) * spare_num);
 
-        private_list_head = NULL;
-        private_list_tail = NULL;
-        private_list_length = 0;
+      if (received > 0) {
+        NETWORK_STATS_ADD(stats_octets_rx, octets);
+        NETWORK_STATS_ADD(stats_packets_rx, received);
       }
 
-      status = 0;
-    } /* for (listen_sockets_pollfd) */
+      network_receive_flush(private, /* wait = */ 0);
+    } /* for (rt->pollfd) */
+
+    if (closed)
+      receive_thread_compact(rt);
 
     if (status != 0)
       break;
   } /* while (listen_loop == 0) */
 
   /* Make sure everything is dispatched before exiting. */
-  if (private_list_head != NULL) {
-    pthread_mutex_lock(&receive_list_lock);
-
-    if (receive_list_head == NULL)
-      receive_list_head = private_list_head;
-    else
-      receive_list_tail->next = private_list_head;
-    receive_list_tail = private_list_tail;
-    receive_list_length += private_list_length;
+  network_receive_flush(private, /* wait = */ 1);
 
-    pthread_cond_signal(&receive_list_cond);
-    pthread_mutex_unlock(&receive_list_lock);
+  for (size_t i = 0; i < rt->pollfd_num; i++) {
+    if (rt->stream[i] == NULL)
+      continue;
+    close(rt->pollfd[i].fd);
+    rt->pollfd[i].fd = -1;
   }
+  receive_thread_compact(rt);
+
+  for (size_t i = 0; i < spare_num; i++)
+    receive_entry_free(spare[i]);
 
   return status;
 } /* }}} int network_receive */
 
-static void *receive_thread(void __attribute__((unused)) * arg) {
-  return network_receive() ? (void *)1 : (void *)0;
+static void *receive_thread(void *arg) {
+  return network_receive(arg) ? (void *)1 : (void *)0;
 } /* void *receive_thread */
 
 static void network_init_buffer(void) {
-  memset(send_buffer, 0, network_config_packet_size);
+  memset(send_buffer, 0, send_buffer_size);
   send_buffer_ptr = send_buffer;
   send_buffer_fill = 0;
   send_buffer_last_update = 0;
 
   memset(&send_buffer_vl, 0, sizeof(send_buffer_vl));
+  send_buffer_base_num = 0;
 } /* int network_init_buffer */
 
-static void network_send_buffer_plain(sockent_t *se, /* {{{ */
-                                      const char *buffer, size_t buffer_size) {
-  int status;
+/* Writes "num" datagrams to the stream connection of "se", each prefixed
+ * with its length, using as few system calls as possible. If the connection
+ * fails or the receiver does not keep up for NETWORK_STREAM_SEND_TIMEOUT
+ * seconds, it is closed; the rest of the batch is lost. */
+static void network_send_stream(sockent_t *se, /* {{{ */
+                                char *const *buffers,
+                                size_t const *buffers_len, size_t num) {
+  uint16_t headers[num];
+  struct iovec iovs[2 * num];
+  size_t iovs_num = 0;
+#ifdef MSG_NOSIGNAL
+  int flags = MSG_NOSIGNAL;
+#else
+  int flags = 0;
+#endif
 
-  while (42) {
-    status = sockent_client_connect(se);
+  for (size_t i = 0; i < num; i++) {
+    if (buffers_len[i] == 0)
+      continue;
+
+    assert(buffers_len[i] <= UINT16_MAX);
+    headers[i] = htons((uint16_t)buffers_len[i]);
+    iovs[iovs_num].iov_base = headers + i;
+    iovs[iovs_num].iov_len = sizeof(headers[i]);
+    iovs_num++;
+    iovs[iovs_num].iov_base = buffers[i];
+    iovs[iovs_num].iov_len = buffers_len[i];
+    iovs_num++;
+  }
+
+  if ((iovs_num == 0) || (sockent_client_connect(se) != 0))
+    return;
+
+  struct iovec *iov = iovs;
+  while (iovs_num > 0) {
+    struct msghdr msg = {.msg_iov = iov, .msg_iovlen = iovs_num};
+#ifdef IOV_MAX
+    if (msg.msg_iovlen > IOV_MAX)
+      msg.msg_iovlen = IOV_MAX;
+#endif
+
+    ssize_t status = sendmsg(se->data.client.fd, &msg, flags);
+    if (status < 0) {
+      if (errno == EINTR)
+        continue;
+
+      ERROR("network plugin: Sending to \"%s\" failed: %s. Closing the "
+            "connection.",
+            se->node, STRERRNO);
+      sockent_client_disconnect(se);
+      return;
+    }
+
+    /* Skip what has been written, which may end in the middle of an
+     * iovec. */
+    size_t written = (size_t)status;
+    while ((iovs_num > 0) && (written >= iov->iov_len)) {
+      written -= iov->iov_len;
+      iov++;
+      iovs_num--;
+    }
+    if (iovs_num > 0) {
+      iov->iov_base = (char *)iov->iov_base + written;
+      iov->iov_len -= written;
+    }
+  }
+} /* }}} void network_send_stream */
+
+/* Sends "num" datagrams to the server "se". Datagrams with a length of zero
+ * are skipped. */
+static void network_send_datagrams(sockent_t *se, /* {{{ */
+                                   char *const *buffers,
+                                   size_t const *buffers_len, size_t num) {
+  if (se->socktype == SOCK_STREAM) {
+    network_send_stream(se, buffers, buffers_len, num);
+    return;
+  }
+
+#if HAVE_SENDMMSG
+  struct mmsghdr msgs[num];
+  struct iovec iovs[num];
+  size_t msgs_num = 0;
+  size_t sent = 0;
+
+  for (size_t i = 0; i < num; i++) {
+    if (buffers_len[i] == 0)
+      continue;
+
+    iovs[msgs_num].iov_base = buffers[i];
+    iovs[msgs_num].iov_len = buffers_len[i];
+    memset(msgs + msgs_num, 0, sizeof(msgs[msgs_num]));
+    msgs[msgs_num].msg_hdr.msg_iov = iovs + msgs_num;
+    msgs[msgs_num].msg_hdr.msg_iovlen = 1;
+    msgs_num++;
+  }
+
+  while (sent < msgs_num) {
+    int status = sockent_client_connect(se);
     if (status != 0)
       return;
 
-    status = sendto(se->data.client.fd, buffer, buffer_size,
-                    /* flags = */ 0, (struct sockaddr *)se->data.client.addr,
-                    se->data.client.addrlen);
+    /* The address may change when the socket is reconnected. */
+    for (size_t i = sent; i < msgs_num; i++) {
+      msgs[i].msg_hdr.msg_name = se->data.client.addr;
+      msgs[i].msg_hdr.msg_namelen = se->data.client.addrlen;
+    }
+
+    status = sendmmsg(se->data.client.fd, msgs + sent,
+                      (unsigned int)(msgs_num - sent), /* flags = */ 0);
     if (status < 0) {
       if ((errno == EINTR) || (errno == EAGAIN))
         continue;
 
-      ERROR("network plugin: sendto failed: %s. Closing sending socket.",
+      ERROR("network plugin: sendmmsg failed: %s. Closing sending socket.",
             STRERRNO);
       sockent_client_disconnect(se);
       return;
     }
 
-    break;
-  } /* while (42) */
-} /* }}} void network_send_buffer_plain */
+    sent += (size_t)status;
+  } /* while (sent < msgs_num) */
+#else  /* !HAVE_SENDMMSG */
+  for (size_t i = 0; i < num; i++) {
+    if (buffers_len[i] == 0)
+      continue;
+
+    while (42) {
+      int status = sockent_client_connect(se);
+      if (status != 0)
+        return;
+
+      status = sendto(se->data.client.fd, buffers[i], buffers_len[i],
+                      /* flags = */ 0, (struct sockaddr *)se->data.client.addr,
+                      se->data.client.addrlen);
+      if (status < 0) {
+        if ((errno == EINTR) || (errno == EAGAIN))
+          continue;
+
+        ERROR("network plugin: sendto failed: %s. Closing sending socket.",
+              STRERRNO);
+        sockent_client_disconnect(se);
+        return;
+      }
+
+      break;
+    } /* while (42) */
+  }
+#endif /* !HAVE_SENDMMSG */
+} /* }}} void network_send_datagrams */
 
 #if HAVE_GCRYPT_H
 #define BUFFER_ADD(p, s)                                                       \
@@ -2351,37 +4112,26 @@ static void network_send_buffer_plain(sockent_t *se, /* {{{ */
     buffer_offset += (s);                                                      \
   } while (0)
 
-static void network_send_buffer_signed(sockent_t *se, /* {{{ */
-                                       const char *in_buffer,
-                                       size_t in_buffer_size) {
-  char buffer[BUFF_SIG_SIZE + in_buffer_size];
+/* Writes the signed version of "in_buffer" to "buffer", which must be able to
+ * hold BUFF_SIG_SIZE + in_buffer_size bytes. Returns the size of the signed
+ * datagram or zero on error. */
+static size_t network_sign_buffer(sockent_t *se, /* {{{ */
+                                  const char *in_buffer, size_t in_buffer_size,
+                                  char *buffer) {
   size_t buffer_offset;
   size_t username_len;
 
   gcry_md_hd_t hd;
-  gcry_error_t err;
   unsigned char *hash;
 
-  hd = NULL;
-  err = gcry_md_open(&hd, GCRY_MD_SHA256, GCRY_MD_FLAG_HMAC);
-  if (err != 0) {
-    ERROR("network plugin: Creating HMAC object failed: %s",
-          gcry_strerror(err));
-    return;
-  }
-
-  err = gcry_md_setkey(hd, se->data.client.password,
-                       strlen(se->data.client.password));
-  if (err != 0) {
-    ERROR("network plugin: gcry_md_setkey failed: %s", gcry_strerror(err));
-    gcry_md_close(hd);
-    return;
-  }
+  hd = network_get_hmac(&se->data.client.hmac, se->data.client.password);
+  if (hd == NULL)
+    return 0;
 
   username_len = strlen(se->data.client.username);
   if (username_len > (BUFF_SIG_SIZE - PART_SIGNATURE_SHA256_SIZE)) {
     ERROR("network plugin: Username too long: %s", se->data.client.username);
-    return;
+    return 0;
   }
 
   memcpy(buffer + PART_SIGNATURE_SHA256_SIZE, se->data.client.username,
@@ -2400,8 +4150,7 @@ static void network_send_buffer_signed(sockent_t *se, /* {{{ */
   hash = gcry_md_read(hd, GCRY_MD_SHA256);
   if (hash == NULL) {
     ERROR("network plugin: gcry_md_read failed.");
-    gcry_md_close(hd);
-    return;
+    return 0;
   }
   memcpy(ps.hash, hash, sizeof(ps.hash));
 
@@ -2414,17 +4163,15 @@ static void network_send_buffer_signed(sockent_t *se, /* {{{ */
 
   assert(buffer_offset == PART_SIGNATURE_SHA256_SIZE);
 
-  gcry_md_close(hd);
-  hd = NULL;
-
-  buffer_offset = PART_SIGNATURE_SHA256_SIZE + username_len + in_buffer_size;
-  network_send_buffer_plain(se, buffer, buffer_offset);
-} /* }}} void network_send_buffer_signed */
+  return PART_SIGNATURE_SHA256_SIZE + username_len + in_buffer_size;
+} /* }}} size_t network_sign_buffer */
 
-static void network_send_buffer_encrypted(sockent_t *se, /* {{{ */
-                                          const char *in_buffer,
-                                          size_t in_buffer_size) {
-  char buffer[BUFF_SIG_SIZE + in_buffer_size];
+/* Writes the encrypted version of "in_buffer" to "buffer", which must be able
+ * to hold BUFF_SIG_SIZE + in_buffer_size bytes. Returns the size of the
+ * encrypted datagram or zero on error. */
+static size_t network_encrypt_buffer(sockent_t *se, /* {{{ */
+                                     const char *in_buffer,
+                                     size_t in_buffer_size, char *buffer) {
   size_t buffer_size;
   size_t buffer_offset;
   size_t header_size;
@@ -2439,14 +4186,14 @@ static void network_send_buffer_encrypted(sockent_t *se, /* {{{ */
   username_len = strlen(pea.username);
   if ((PART_ENCRYPTION_AES256_SIZE + username_len) > BUFF_SIG_SIZE) {
     ERROR("network plugin: Username too long: %s", pea.username);
-    return;
+    return 0;
   }
 
   buffer_size = PART_ENCRYPTION_AES256_SIZE + username_len + in_buffer_size;
   header_size = PART_ENCRYPTION_AES256_SIZE + username_len - sizeof(pea.hash);
 
-  assert(buffer_size <= sizeof(buffer));
-  DEBUG("network plugin: network_send_buffer_encrypted: "
+  assert(buffer_size <= BUFF_SIG_SIZE + in_buffer_size);
+  DEBUG("network plugin: network_encrypt_buffer: "
         "buffer_size = %" PRIsz ";",
         buffer_size);
 
@@ -2462,7 +4209,7 @@ static void network_send_buffer_encrypted(sockent_t *se, /* {{{ */
 
   /* Initialize the buffer */
   buffer_offset = 0;
-  memset(buffer, 0, sizeof(buffer));
+  memset(buffer, 0, buffer_size);
 
   BUFFER_ADD(&pea.head.type, sizeof(pea.head.type));
   BUFFER_ADD(&pea.head.length, sizeof(pea.head.length));
@@ -2475,10 +4222,11 @@ static void network_send_buffer_encrypted(sockent_t *se, /* {{{ */
 
   assert(buffer_offset == buffer_size);
 
-  cypher = network_get_aes256_cypher(se, pea.iv, sizeof(pea.iv),
-                                     se->data.client.password);
+  cypher = network_get_aes256_cypher(
+      &se->data.client.cypher, GCRY_CIPHER_MODE_OFB,
+      se->data.client.password_hash, pea.iv, sizeof(pea.iv));
   if (cypher == NULL)
-    return;
+    return 0;
 
   /* Encrypt the buffer in-place */
   err = gcry_cipher_encrypt(cypher, buffer + header_size,
@@ -2487,67 +4235,339 @@ static void network_send_buffer_encrypted(sockent_t *se, /* {{{ */
   if (err != 0) {
     ERROR("network plugin: gcry_cipher_encrypt returned: %s",
           gcry_strerror(err));
-    return;
+    return 0;
+  }
+
+  return buffer_size;
+} /* }}} size_t network_encrypt_buffer */
+
+#if HAVE_GCRYPT_GCM
+/* Like network_encrypt_buffer() but uses AES-256 in Galois/Counter mode. The
+ * 96 bit IV is a random prefix followed by a 32 bit counter, so an IV is never
+ * reused with the same key. */
+static size_t network_encrypt_buffer_gcm(sockent_t *se, /* {{{ */
+                                         const char *in_buffer,
+                                         size_t in_buffer_size, char *buffer) {
+  struct sockent_client *sec = &se->data.client;
+  size_t buffer_offset;
+  size_t header_size;
+  size_t username_len;
+  uint16_t tmp;
+  uint32_t counter;
+  unsigned char iv[PART_ENCRYPTION_AES256_GCM_IV_SIZE];
+  gcry_cipher_hd_t cypher;
+  gcry_error_t err;
+
+  username_len = strlen(sec->username);
+  if ((PART_ENCRYPTION_AES256_GCM_SIZE + username_len) > BUFF_SIG_SIZE) {
+    ERROR("network plugin: Username too long: %s", sec->username);
+    return 0;
+  }
+  header_size = PART_ENCRYPTION_AES256_GCM_SIZE + username_len;
+
+  if (sec->nonce_counter == 0)
+    gcry_create_nonce(sec->nonce_prefix, sizeof(sec->nonce_prefix));
+  counter = htonl(sec->nonce_counter);
+  sec->nonce_counter++;
+  memcpy(iv, sec->nonce_prefix, sizeof(sec->nonce_prefix));
+  memcpy(iv + sizeof(sec->nonce_prefix), &counter, sizeof(counter));
+
+  buffer_offset = 0;
+  tmp = htons(TYPE_ENCR_AES256_GCM);
+  BUFFER_ADD(&tmp, sizeof(tmp));
+  tmp = htons((uint16_t)(header_size + in_buffer_size));
+  BUFFER_ADD(&tmp, sizeof(tmp));
+  tmp = htons((uint16_t)username_len);
+  BUFFER_ADD(&tmp, sizeof(tmp));
+  BUFFER_ADD(sec->username, username_len);
+  BUFFER_ADD(iv, sizeof(iv));
+  /* The tag is filled in after encryption. */
+  buffer_offset += PART_ENCRYPTION_AES256_GCM_TAG_SIZE;
+  assert(buffer_offset == header_size);
+
+  cypher = network_get_aes256_cypher(&sec->gcm_cypher, GCRY_CIPHER_MODE_GCM,
+                                     sec->password_hash, iv, sizeof(iv));
+  if (cypher == NULL)
+    return 0;
+
+  err = gcry_cipher_authenticate(cypher, buffer, 6 + username_len);
+  if (err == 0)
+    err = gcry_cipher_encrypt(cypher, buffer + header_size, in_buffer_size,
+                              in_buffer, in_buffer_size);
+  if (err == 0)
+    err = gcry_cipher_gettag(cypher, buffer + header_size -
+                                         PART_ENCRYPTION_AES256_GCM_TAG_SIZE,
+                             PART_ENCRYPTION_AES256_GCM_TAG_SIZE);
+  if (err != 0) {
+    ERROR("network plugin: Encrypting with AES-256-GCM failed: %s",
+          gcry_strerror(err));
+    return 0;
   }
 
-  /* Send it out without further modifications */
-  network_send_buffer_plain(se, buffer, buffer_size);
-} /* }}} void network_send_buffer_encrypted */
+  return header_size + in_buffer_size;
+} /* }}} size_t network_encrypt_buffer_gcm */
+#endif /* HAVE_GCRYPT_GCM */
 #undef BUFFER_ADD
-#endif /* HAVE_GCRYPT_H */
 
-static void network_send_buffer(char *buffer, size_t buffer_len) /* {{{ */
+/* Returns a server preceding "se" in "sending_sockets" which uses the same
+ * security level and credentials, or NULL if there is none. */
+static sockent_t *network_find_same_credentials(sockent_t *se) /* {{{ */
 {
-  DEBUG("network plugin: network_send_buffer: buffer_len = %" PRIsz,
-        buffer_len);
+  struct sockent_client *a = &se->data.client;
+
+  for (sockent_t *prev = sending_sockets; prev != se; prev = prev->next) {
+    struct sockent_client *b = &prev->data.client;
+
+    if ((a->security_level == b->security_level) &&
+        (a->cipher == b->cipher) && (strcmp(a->username, b->username) == 0) &&
+        (strcmp(a->password, b->password) == 0))
+      return prev;
+  }
+
+  return NULL;
+} /* }}} sockent_t *network_find_same_credentials */
+
+/* Signs or encrypts the batch for "se". If a preceding server uses the same
+ * credentials, the datagrams it produced are reused. Returns zero on
+ * success. */
+static int network_secure_batch(sockent_t *se, /* {{{ */
+                                char *const *in_buffers,
+                                size_t const *in_buffers_len, size_t num,
+                                char **buffers, size_t *buffers_len) {
+  size_t stride = BUFF_SIG_SIZE + network_config_packet_size;
+  sockent_t *prev = network_find_same_credentials(se);
+  struct sockent_client *sec =
+      (prev != NULL) ? &prev->data.client : &se->data.client;
+
+  assert(num <= network_config_send_batch);
+
+  if (prev == NULL) {
+    if (sec->batch_buffer == NULL) {
+      sec->batch_buffer = malloc(network_config_send_batch * stride);
+      sec->batch_len =
+          calloc(network_config_send_batch, sizeof(*sec->batch_len));
+      if ((sec->batch_buffer == NULL) || (sec->batch_len == NULL)) {
+        ERROR("network plugin: malloc failed.");
+        sfree(sec->batch_buffer);
+        sfree(sec->batch_len);
+        return ENOMEM;
+      }
+    }
+
+    for (size_t i = 0; i < num; i++) {
+      char *buffer = sec->batch_buffer + i * stride;
+
+      if (sec->security_level == SECURITY_LEVEL_SIGN)
+        sec->batch_len[i] =
+            network_sign_buffer(se, in_buffers[i], in_buffers_len[i], buffer);
+#if HAVE_GCRYPT_GCM
+      else if (sec->cipher == CIPHER_AES256_GCM)
+        sec->batch_len[i] = network_encrypt_buffer_gcm(
+            se, in_buffers[i], in_buffers_len[i], buffer);
+#endif
+      else /* if (sec->security_level == SECURITY_LEVEL_ENCRYPT) */
+        sec->batch_len[i] = network_encrypt_buffer(se, in_buffers[i],
+                                                   in_buffers_len[i], buffer);
+    }
+  } else if (sec->batch_buffer == NULL) {
+    /* The preceding server failed to allocate its buffers. */
+    return ENOMEM;
+  }
+
+  for (size_t i = 0; i < num; i++) {
+    buffers[i] = sec->batch_buffer + i * stride;
+    buffers_len[i] = sec->batch_len[i];
+  }
+
+  return 0;
+} /* }}} int network_secure_batch */
+#endif /* HAVE_GCRYPT_H */
+
+/* Sends "num" (unsecured) datagrams to all servers. Must be called with
+ * send_buffer_lock held. */
+static void network_send_buffers(char *const *buffers, /* {{{ */
+                                 size_t const *buffers_len, size_t num) {
+  DEBUG("network plugin: network_send_buffers: num = %" PRIsz, num);
 
   for (sockent_t *se = sending_sockets; se != NULL; se = se->next) {
 #if HAVE_GCRYPT_H
-    if (se->data.client.security_level == SECURITY_LEVEL_ENCRYPT)
-      network_send_buffer_encrypted(se, buffer, buffer_len);
-    else if (se->data.client.security_level == SECURITY_LEVEL_SIGN)
-      network_send_buffer_signed(se, buffer, buffer_len);
-    else /* if (se->data.client.security_level == SECURITY_LEVEL_NONE) */
-#endif   /* HAVE_GCRYPT_H */
-      network_send_buffer_plain(se, buffer, buffer_len);
+    if (se->data.client.security_level > SECURITY_LEVEL_NONE) {
+      char *secured[num];
+      size_t secured_len[num];
+
+      if (network_secure_batch(se, buffers, buffers_len, num, secured,
+                               secured_len) == 0)
+        network_send_datagrams(se, secured, secured_len, num);
+    } else /* if (se->data.client.security_level == SECURITY_LEVEL_NONE) */
+#endif     /* HAVE_GCRYPT_H */
+      network_send_datagrams(se, buffers, buffers_len, num);
   } /* for (sending_sockets) */
-} /* }}} void network_send_buffer */
+} /* }}} void network_send_buffers */
 
-static int add_to_buffer(char *buffer, size_t buffer_size, /* {{{ */
-                         value_list_t *vl_def, const data_set_t *ds,
-                         const value_list_t *vl) {
-  char *buffer_orig = buffer;
+/* Sends all finished packets of the current batch. Must be called with
+ * send_buffer_lock held. */
+static void network_send_batch(void) /* {{{ */
+{
+  char *buffers[network_config_send_batch];
+
+  if (send_batch_num == 0)
+    return;
+
+  for (size_t i = 0; i < send_batch_num; i++)
+    buffers[i] = send_batch + i * network_config_packet_size;
+
+  network_send_buffers(buffers, send_batch_len, send_batch_num);
+  send_batch_num = 0;
+
+#if HAVE_LZ4_H
+  /* Segments are queued in "compress_pending" instead. */
+  if (network_config_compress)
+    return;
+#endif
+
+  /* Move a partially filled packet to the first slot. */
+  if (send_buffer != send_batch) {
+    memcpy(send_batch, send_buffer, (size_t)send_buffer_fill);
+    send_buffer = send_batch;
+    send_buffer_ptr = send_buffer + send_buffer_fill;
+  }
+} /* }}} void network_send_batch */
+
+#if HAVE_LZ4_H
+/* Compresses queued segments into datagrams and adds those to the batch.
+ * Unless "force" is set, this waits until enough segments are queued to fill
+ * a datagram. A segment that does not compress is sent as is. Must be called
+ * with send_buffer_lock held. */
+static void network_compress_pending(_Bool force) /* {{{ */
+{
+  size_t header_size = sizeof(part_header_t) + sizeof(uint16_t);
+  size_t target = network_config_packet_size - (BUFF_SIG_SIZE + header_size);
+
+  while (compress_segments_num > 0) {
+    char *datagram = send_batch + send_batch_num * network_config_packet_size;
+    size_t limit = (size_t)(0.95 * compress_ratio * (double)target);
+    size_t raw_len;
+    size_t datagram_len;
+    size_t n = 0;
+    int compressed_len = 0;
+
+    if (!force && (compress_segments_num < compress_segments_max) &&
+        (compress_pending_len < limit))
+      break;
+
+    while ((n < compress_segments_num) && (compress_segment_end[n] <= limit))
+      n++;
+    if (n == 0)
+      n = 1;
+
+    /* LZ4_compress_default() returns zero if the result exceeds "target". */
+    while (n > 0) {
+      compressed_len = LZ4_compress_default(
+          compress_pending, datagram + header_size,
+          (int)compress_segment_end[n - 1], (int)target);
+      if (compressed_len > 0)
+        break;
+      n--;
+    }
 
+    if ((n > 0) &&
+        ((size_t)compressed_len + header_size < compress_segment_end[n - 1])) {
+      uint16_t tmp16;
+
+      raw_len = compress_segment_end[n - 1];
+      datagram_len = (size_t)compressed_len + header_size;
+
+      tmp16 = htons(TYPE_COMPRESS_LZ4);
+      memcpy(datagram, &tmp16, sizeof(tmp16));
+      tmp16 = htons((uint16_t)datagram_len);
+      memcpy(datagram + sizeof(tmp16), &tmp16, sizeof(tmp16));
+      tmp16 = htons((uint16_t)raw_len);
+      memcpy(datagram + sizeof(part_header_t), &tmp16, sizeof(tmp16));
+
+      compress_ratio = 0.75 * compress_ratio +
+                       0.25 * ((double)raw_len) / ((double)compressed_len);
+    } else {
+      n = 1;
+      raw_len = compress_segment_end[0];
+      datagram_len = raw_len;
+      memcpy(datagram, compress_pending, raw_len);
+
+      compress_ratio = 0.75 * compress_ratio + 0.25;
+    }
+
+    send_batch_len[send_batch_num] = datagram_len;
+    send_batch_num++;
+
+    stats_octets_tx += ((uint64_t)datagram_len);
+    stats_packets_tx++;
+
+    /* Remove the segments, keeping the one that is being filled. */
+    memmove(compress_pending, compress_pending + raw_len,
+            compress_pending_len - raw_len + (size_t)send_buffer_fill);
+    for (size_t i = n; i < compress_segments_num; i++)
+      compress_segment_end[i - n] = compress_segment_end[i] - raw_len;
+    compress_segments_num -= n;
+    compress_pending_len -= raw_len;
+
+    send_buffer = compress_pending + compress_pending_len;
+    send_buffer_ptr = send_buffer + send_buffer_fill;
+
+    if (send_batch_num >= network_config_send_batch)
+      network_send_batch();
+  }
+} /* }}} void network_compress_pending */
+#endif /* HAVE_LZ4_H */
+
+/* Sends all finished packets, including segments that are still waiting to be
+ * compressed. Must be called with send_buffer_lock held. */
+static void network_send_pending(void) /* {{{ */
+{
+#if HAVE_LZ4_H
+  if (network_config_compress)
+    network_compress_pending(/* force = */ 1);
+#endif
+  network_send_batch();
+} /* }}} void network_send_pending */
+
+/* Writes the identifier, time and interval parts of "vl" which differ from
+ * "vl_def", the state of the receiver, and updates "vl_def" accordingly. */
+static int write_parts_identifier(char **ret_buffer, /* {{{ */
+                                  size_t *ret_buffer_len,
+                                  value_list_t *vl_def,
+                                  const value_list_t *vl) {
   if (strcmp(vl_def->host, vl->host) != 0) {
-    if (write_part_string(&buffer, &buffer_size, TYPE_HOST, vl->host,
+    if (write_part_string(ret_buffer, ret_buffer_len, TYPE_HOST, vl->host,
                           strlen(vl->host)) != 0)
       return -1;
     sstrncpy(vl_def->host, vl->host, sizeof(vl_def->host));
   }
 
   if (vl_def->time != vl->time) {
-    if (write_part_number(&buffer, &buffer_size, TYPE_TIME_HR,
-                          (uint64_t)vl->time))
+    if (network_config_compact) {
+      if (write_part_time(ret_buffer, ret_buffer_len, vl_def->time, vl->time))
+        return -1;
+    } else if (write_part_number(ret_buffer, ret_buffer_len, TYPE_TIME_HR,
+                                 (uint64_t)vl->time))
       return -1;
     vl_def->time = vl->time;
   }
 
   if (vl_def->interval != vl->interval) {
-    if (write_part_number(&buffer, &buffer_size, TYPE_INTERVAL_HR,
+    if (write_part_number(ret_buffer, ret_buffer_len, TYPE_INTERVAL_HR,
                           (uint64_t)vl->interval))
       return -1;
     vl_def->interval = vl->interval;
   }
 
   if (strcmp(vl_def->plugin, vl->plugin) != 0) {
-    if (write_part_string(&buffer, &buffer_size, TYPE_PLUGIN, vl->plugin,
+    if (write_part_string(ret_buffer, ret_buffer_len, TYPE_PLUGIN, vl->plugin,
                           strlen(vl->plugin)) != 0)
       return -1;
     sstrncpy(vl_def->plugin, vl->plugin, sizeof(vl_def->plugin));
   }
 
   if (strcmp(vl_def->plugin_instance, vl->plugin_instance) != 0) {
-    if (write_part_string(&buffer, &buffer_size, TYPE_PLUGIN_INSTANCE,
+    if (write_part_string(ret_buffer, ret_buffer_len, TYPE_PLUGIN_INSTANCE,
                           vl->plugin_instance,
                           strlen(vl->plugin_instance)) != 0)
       return -1;
@@ -2556,21 +4576,35 @@ static int add_to_buffer(char *buffer, size_t buffer_size, /* {{{ */
   }
 
   if (strcmp(vl_def->type, vl->type) != 0) {
-    if (write_part_string(&buffer, &buffer_size, TYPE_TYPE, vl->type,
+    if (write_part_string(ret_buffer, ret_buffer_len, TYPE_TYPE, vl->type,
                           strlen(vl->type)) != 0)
       return -1;
-    sstrncpy(vl_def->type, ds->type, sizeof(vl_def->type));
+    sstrncpy(vl_def->type, vl->type, sizeof(vl_def->type));
   }
 
   if (strcmp(vl_def->type_instance, vl->type_instance) != 0) {
-    if (write_part_string(&buffer, &buffer_size, TYPE_TYPE_INSTANCE,
+    if (write_part_string(ret_buffer, ret_buffer_len, TYPE_TYPE_INSTANCE,
                           vl->type_instance, strlen(vl->type_instance)) != 0)
       return -1;
     sstrncpy(vl_def->type_instance, vl->type_instance,
              sizeof(vl_def->type_instance));
   }
 
-  if (write_part_values(&buffer, &buffer_size, ds, vl) != 0)
+  return 0;
+} /* }}} int write_parts_identifier */
+
+static int add_to_buffer(char *buffer, size_t buffer_size, /* {{{ */
+                         value_list_t *vl_def, const data_set_t *ds,
+                         const value_list_t *vl) {
+  char *buffer_orig = buffer;
+
+  if (write_parts_identifier(&buffer, &buffer_size, vl_def, vl) != 0)
+    return -1;
+
+  if (network_config_compact) {
+    if (write_part_values_varint(&buffer, &buffer_size, ds, vl) != 0)
+      return -1;
+  } else if (write_part_values(&buffer, &buffer_size, ds, vl) != 0)
     return -1;
 
   return buffer - buffer_orig;
@@ -2580,14 +4614,160 @@ static void flush_buffer(void) {
   DEBUG("network plugin: flush_buffer: send_buffer_fill = %i",
         send_buffer_fill);
 
-  network_send_buffer(send_buffer, (size_t)send_buffer_fill);
+#if HAVE_LZ4_H
+  if (network_config_compress) {
+    if (send_buffer_fill > 0) {
+      compress_pending_len += (size_t)send_buffer_fill;
+      compress_segment_end[compress_segments_num] = compress_pending_len;
+      compress_segments_num++;
+    }
+    send_buffer_fill = 0;
+    network_compress_pending(/* force = */ 0);
+
+    send_buffer = compress_pending + compress_pending_len;
+    network_init_buffer();
+    return;
+  }
+#endif
+
+  send_batch_len[send_batch_num] = (size_t)send_buffer_fill;
+  send_batch_num++;
 
   stats_octets_tx += ((uint64_t)send_buffer_fill);
   stats_packets_tx++;
 
+  send_buffer_fill = 0;
+  if (send_batch_num >= network_config_send_batch)
+    network_send_batch();
+  else
+    send_buffer = send_batch + send_batch_num * network_config_packet_size;
+
   network_init_buffer();
 }
 
+/* Adds the parts collected by network_forward_values() to the send buffer.
+ * The receiver's state is reset first, because the parts were written for a
+ * receiver that starts with an empty state. */
+static void network_forward_flush(parse_scratch_t *ps) /* {{{ */
+{
+  if (ps->forward_len > 0) {
+    value_list_t empty = VALUE_LIST_INIT;
+
+    pthread_mutex_lock(&send_buffer_lock);
+
+    if (!network_config_forward_rebatch && (send_buffer_fill > 0))
+      flush_buffer();
+
+    char *buffer = send_buffer_ptr;
+    size_t buffer_size =
+        send_buffer_size - (send_buffer_fill + BUFF_SIG_SIZE);
+    if ((write_parts_identifier(&buffer, &buffer_size, &send_buffer_vl,
+                                &empty) != 0) ||
+        (buffer_size < ps->forward_len)) {
+      if (send_buffer_fill > 0)
+        flush_buffer();
+      buffer = send_buffer_ptr;
+      buffer_size = send_buffer_size - BUFF_SIG_SIZE;
+    }
+    /* "forward_size" is chosen so that this always fits. */
+    assert(buffer_size >= ps->forward_len);
+
+    memcpy(buffer, ps->forward, ps->forward_len);
+    buffer += ps->forward_len;
+    send_buffer_fill += (int)(buffer - send_buffer_ptr);
+    send_buffer_ptr = buffer;
+    send_buffer_last_update = cdtime();
+
+    /* Local values must not be delta encoded relative to forwarded ones. */
+    memcpy(&send_buffer_vl, &ps->forward_vl, sizeof(send_buffer_vl));
+    send_buffer_base_num = 0;
+
+    stats_values_sent += (derive_t)ps->forward_values;
+
+    /* Send the buffer if another chunk of this size would not fit. */
+    if (!network_config_forward_rebatch ||
+        ((send_buffer_size - (send_buffer_fill + BUFF_SIG_SIZE)) <
+         ps->forward_len))
+      flush_buffer();
+
+    pthread_mutex_unlock(&send_buffer_lock);
+  }
+
+  ps->forward_len = 0;
+  memset(&ps->forward_vl, 0, sizeof(ps->forward_vl));
+  ps->forward_base = 0;
+  ps->forward_values = 0;
+} /* }}} void network_forward_flush */
+
+/* Appends a values part to "ps->forward", preceded by the identifier parts
+ * that changed. A TYPE_VALUES_DELTA part whose base is not in "forward" is
+ * encoded as TYPE_VALUES_VARINT instead. Returns non-zero if it doesn't fit.
+ */
+static int network_forward_append(parse_scratch_t *ps, /* {{{ */
+                                  value_list_t const *vl, void const *part,
+                                  size_t part_len, int part_type) {
+  char *buffer = ps->forward + ps->forward_len;
+  size_t buffer_size = ps->forward_size - ps->forward_len;
+
+  if (write_parts_identifier(&buffer, &buffer_size, &ps->forward_vl, vl) != 0)
+    return -1;
+
+  if ((part_type != TYPE_VALUES_DELTA) || ps->forward_base) {
+    if (buffer_size < part_len)
+      return -1;
+    memcpy(buffer, part, part_len);
+    buffer += part_len;
+  } else if (write_part_values_absolute(&buffer, &buffer_size, vl->values,
+                                        ps->types, vl->values_len) != 0)
+    return -1;
+
+  ps->forward_len = (size_t)(buffer - ps->forward);
+  ps->forward_base = 1;
+  ps->forward_values++;
+  return 0;
+} /* }}} int network_forward_append */
+
+/* Forwards a received values part as it is, without dispatching the value
+ * list. "vl" holds the decoded identifier and values of the part, which are
+ * only used to write the identifier parts and to re-encode delta encoded
+ * values. */
+static void network_forward_values(sockent_t *se, /* {{{ */
+                                   value_list_t *vl, void const *part,
+                                   size_t part_len, int part_type,
+                                   const char *username) {
+  parse_scratch_t *ps = parse_scratch_lookup();
+
+  /* Same checks as in network_dispatch_values(). */
+  if ((vl->time == 0) || (vl->host[0] == 0) || (vl->plugin[0] == 0) ||
+      (vl->type[0] == 0))
+    return;
+
+  if ((ps != NULL) && (ps->forward == NULL)) {
+    ps->forward_size = send_buffer_size - BUFF_SIG_SIZE;
+    ps->forward = malloc(ps->forward_size);
+    if (ps->forward == NULL)
+      ps->forward_size = 0;
+  }
+
+  if ((ps == NULL) || (ps->forward == NULL)) {
+    network_dispatch_values(vl, username);
+    return;
+  }
+
+  if (network_forward_append(ps, vl, part, part_len, part_type) != 0) {
+    network_forward_flush(ps);
+    /* A part that is larger than a packet goes the long way. */
+    if (network_forward_append(ps, vl, part, part_len, part_type) != 0) {
+      network_forward_flush(ps);
+      network_dispatch_values(vl, username);
+      return;
+    }
+  }
+
+  if (top_senders_addr != NULL)
+    top_senders_count_host(vl->host);
+} /* }}} void network_forward_values */
+
 static int network_write(const data_set_t *ds, const value_list_t *vl,
                          user_data_t __attribute__((unused)) * user_data) {
   int status;
@@ -2619,8 +4799,7 @@ static int network_write(const data_set_t *ds, const value_list_t *vl,
   pthread_mutex_lock(&send_buffer_lock);
 
   status = add_to_buffer(send_buffer_ptr,
-                         network_config_packet_size -
-                             (send_buffer_fill + BUFF_SIG_SIZE),
+                         send_buffer_size - (send_buffer_fill + BUFF_SIG_SIZE),
                          &send_buffer_vl, ds, vl);
   if (status >= 0) {
     /* status == bytes added to the buffer */
@@ -2633,7 +4812,7 @@ static int network_write(const data_set_t *ds, const value_list_t *vl,
     flush_buffer();
 
     status = add_to_buffer(send_buffer_ptr,
-                           network_config_packet_size -
+                           send_buffer_size -
                                (send_buffer_fill + BUFF_SIG_SIZE),
                            &send_buffer_vl, ds, vl);
 
@@ -2648,7 +4827,7 @@ static int network_write(const data_set_t *ds, const value_list_t *vl,
   if (status < 0) {
     ERROR("network plugin: Unable to append to the "
           "buffer for some weird reason");
-  } else if ((network_config_packet_size - send_buffer_fill) < 15) {
+  } else if ((send_buffer_size - send_buffer_fill) < 15) {
     flush_buffer();
   }
 
@@ -2673,6 +4852,56 @@ static int network_config_set_ttl(const oconfig_item_t *ci) /* {{{ */
   return 0;
 } /* }}} int network_config_set_ttl */
 
+static int network_config_set_threads(const oconfig_item_t *ci, /* {{{ */
+                                      size_t *ret_threads) {
+  int tmp = 0;
+
+  if (cf_util_get_int(ci, &tmp) != 0)
+    return -1;
+
+  if ((tmp < 1) || (tmp > 256)) {
+    WARNING("network plugin: The `%s' option must be between 1 and 256.",
+            ci->key);
+    return -1;
+  }
+
+  *ret_threads = (size_t)tmp;
+  return 0;
+} /* }}} int network_config_set_threads */
+
+static int network_config_set_send_batch(const oconfig_item_t *ci) /* {{{ */
+{
+  int tmp = 0;
+
+  if (cf_util_get_int(ci, &tmp) != 0)
+    return -1;
+  else if ((tmp >= 1) && (tmp <= 1024))
+    network_config_send_batch = (size_t)tmp;
+  else {
+    WARNING("network plugin: The `SendBatchSize' must be between 1 and 1024.");
+    return -1;
+  }
+
+  return 0;
+} /* }}} int network_config_set_send_batch */
+
+static int network_config_set_top_senders(const oconfig_item_t *ci) /* {{{ */
+{
+  int tmp = 0;
+
+  if (cf_util_get_int(ci, &tmp) != 0)
+    return -1;
+  else if ((tmp >= 0) && (tmp <= 1024))
+    network_config_top_senders = (size_t)tmp;
+  else {
+    WARNING("network plugin: The `ReportTopSenders' option must be between "
+            "0 and 1024.");
+    return -1;
+  }
+
+  return 0;
+} /* }}} int network_config_set_top_senders */
+
 static int network_config_set_interface(const oconfig_item_t *ci, /* {{{ */
                                         int *interface) {
   char if_name[256];
@@ -2725,8 +4954,58 @@ static int network_config_set_security_level(oconfig_item_t *ci, /* {{{ */
 
   return 0;
 } /* }}} int network_config_set_security_level */
+
+static int network_config_set_cipher(oconfig_item_t *ci, /* {{{ */
+                                     int *retval) {
+  char *str;
+  if ((ci->values_num != 1) || (ci->values[0].type != OCONFIG_TYPE_STRING)) {
+    WARNING("network plugin: The `Cipher' config option needs exactly "
+            "one string argument.");
+    return -1;
+  }
+
+  str = ci->values[0].value.string;
+  if (strcasecmp("AES-256-OFB", str) == 0)
+    *retval = CIPHER_AES256_OFB;
+  else if (strcasecmp("AES-256-GCM", str) == 0) {
+#if HAVE_GCRYPT_GCM
+    *retval = CIPHER_AES256_GCM;
+#else
+    WARNING("network plugin: AES-256-GCM requires libgcrypt 1.6 or later. "
+            "Using AES-256-OFB instead.");
+    *retval = CIPHER_AES256_OFB;
+#endif
+  } else {
+    WARNING("network plugin: Unknown cipher: %s.", str);
+    return -1;
+  }
+
+  return 0;
+} /* }}} int network_config_set_cipher */
 #endif /* HAVE_GCRYPT_H */
 
+static int network_config_set_protocol(const oconfig_item_t *ci, /* {{{ */
+                                       int *retval) {
+  char *str;
+  if ((ci->values_num != 1) || (ci->values[0].type != OCONFIG_TYPE_STRING)) {
+    WARNING("network plugin: The `Protocol' config option needs exactly "
+            "one string argument.");
+    return -1;
+  }
+
+  str = ci->values[0].value.string;
+  if (strcasecmp("UDP", str) == 0)
+    *retval = SOCK_DGRAM;
+  else if (strcasecmp("TCP", str) == 0)
+    *retval = SOCK_STREAM;
+  else {
+    WARNING("network plugin: Unknown protocol: %s.", str);
+    return -1;
+  }
+
+  return 0;
+} /* }}} int network_config_set_protocol */
+
 static int network_config_add_listen(const oconfig_item_t *ci) /* {{{ */
 {
   sockent_t *se;
@@ -2763,6 +5042,8 @@ static int network_config_add_listen(const oconfig_item_t *ci) /* {{{ */
 #endif /* HAVE_GCRYPT_H */
         if (strcasecmp("Interface", child->key) == 0)
       network_config_set_interface(child, &se->interface);
+    else if (strcasecmp("Protocol", child->key) == 0)
+      network_config_set_protocol(child, &se->socktype);
     else {
       WARNING("network plugin: Option `%s' is not allowed here.", child->key);
     }
@@ -2839,12 +5120,16 @@ static int network_config_add_server(const oconfig_item_t *ci) /* {{{ */
       cf_util_get_string(child, &se->data.client.password);
     else if (strcasecmp("SecurityLevel", child->key) == 0)
       network_config_set_security_level(child, &se->data.client.security_level);
+    else if (strcasecmp("Cipher", child->key) == 0)
+      network_config_set_cipher(child, &se->data.client.cipher);
     else
 #endif /* HAVE_GCRYPT_H */
         if (strcasecmp("Interface", child->key) == 0)
       network_config_set_interface(child, &se->interface);
     else if (strcasecmp("ResolveInterval", child->key) == 0)
       cf_util_get_cdtime(child, &se->data.client.resolve_interval);
+    else if (strcasecmp("Protocol", child->key) == 0)
+      network_config_set_protocol(child, &se->socktype);
     else {
       WARNING("network plugin: Option `%s' is not allowed here.", child->key);
     }
@@ -2890,6 +5175,12 @@ static int network_config(oconfig_item_t *ci) /* {{{ */
     oconfig_item_t *child = ci->children + i;
     if (strcasecmp("TimeToLive", child->key) == 0)
       network_config_set_ttl(child);
+    else if (strcasecmp("ReceiveThreads", child->key) == 0)
+      network_config_set_threads(child, &network_config_receive_threads);
+    else if (strcasecmp("ReceiveBufferSize", child->key) == 0)
+      cf_util_get_int(child, &network_config_receive_buffer);
+    else if (strcasecmp("ReceiveBufferAutoTune", child->key) == 0)
+      cf_util_get_boolean(child, &network_config_receive_buffer_auto);
   }
 
   for (int i = 0; i < ci->children_num; i++) {
@@ -2899,14 +5190,36 @@ static int network_config(oconfig_item_t *ci) /* {{{ */
       network_config_add_listen(child);
     else if (strcasecmp("Server", child->key) == 0)
       network_config_add_server(child);
-    else if (strcasecmp("TimeToLive", child->key) == 0) {
+    else if ((strcasecmp("TimeToLive", child->key) == 0) ||
+             (strcasecmp("ReceiveThreads", child->key) == 0) ||
+             (strcasecmp("ReceiveBufferSize", child->key) == 0) ||
+             (strcasecmp("ReceiveBufferAutoTune", child->key) == 0)) {
       /* Handled earlier */
-    } else if (strcasecmp("MaxPacketSize", child->key) == 0)
+    } else if (strcasecmp("DispatchThreads", child->key) == 0)
+      network_config_set_threads(child, &network_config_dispatch_threads);
+    else if (strcasecmp("SendBatchSize", child->key) == 0)
+      network_config_set_send_batch(child);
+    else if (strcasecmp("Compress", child->key) == 0) {
+#if HAVE_LZ4_H
+      cf_util_get_boolean(child, &network_config_compress);
+#else
+      WARNING("network plugin: The `Compress' option is not supported "
+              "because the plugin was built without liblz4.");
+#endif
+    } else if (strcasecmp("CompactEncoding", child->key) == 0)
+      cf_util_get_boolean(child, &network_config_compact);
+    else if (strcasecmp("MaxPacketSize", child->key) == 0)
       network_config_set_buffer_size(child);
     else if (strcasecmp("Forward", child->key) == 0)
       cf_util_get_boolean(child, &network_config_forward);
+    else if (strcasecmp("ForwardPassthrough", child->key) == 0)
+      cf_util_get_boolean(child, &network_config_forward_passthrough);
+    else if (strcasecmp("ForwardRebatch", child->key) == 0)
+      cf_util_get_boolean(child, &network_config_forward_rebatch);
     else if (strcasecmp("ReportStats", child->key) == 0)
       cf_util_get_boolean(child, &network_config_stats);
+    else if (strcasecmp("ReportTopSenders", child->key) == 0)
+      network_config_set_top_senders(child);
     else {
       WARNING("network plugin: Option `%s' is not allowed here.", child->key);
     }
@@ -2978,39 +5291,182 @@ static int network_notification(const notification_t *n,
   if (status != 0)
     return -1;
 
-  network_send_buffer(buffer, sizeof(buffer) - buffer_free);
+  char *buffers[1] = {buffer};
+  size_t buffers_len[1] = {sizeof(buffer) - buffer_free};
+
+  /* Send finished packets first to preserve the order. */
+  pthread_mutex_lock(&send_buffer_lock);
+  network_send_pending();
+  network_send_buffers(buffers, buffers_len, 1);
+  pthread_mutex_unlock(&send_buffer_lock);
 
   return 0;
 } /* int network_notification */
 
-static int network_shutdown(void) {
-  listen_loop++;
+/* Starts the dispatch and receive threads. Listening socket "i" is served by
+ * receive thread (i % ReceiveThreads) and its packets are parsed by dispatch
+ * thread (i % DispatchThreads). */
+static int network_start_threads(void) /* {{{ */
+{
+  receive_queues_num = network_config_dispatch_threads;
+  if (receive_queues_num > listen_sockets_num)
+    receive_queues_num = listen_sockets_num;
+  receive_threads_num = network_config_receive_threads;
+  if (receive_threads_num > listen_sockets_num)
+    receive_threads_num = listen_sockets_num;
+
+  receive_queues = calloc(receive_queues_num, sizeof(*receive_queues));
+  receive_threads = calloc(receive_threads_num, sizeof(*receive_threads));
+  if ((receive_queues == NULL) || (receive_threads == NULL)) {
+    ERROR("network plugin: calloc failed.");
+    sfree(receive_queues);
+    sfree(receive_threads);
+    receive_queues_num = 0;
+    receive_threads_num = 0;
+    return -1;
+  }
 
-  /* Kill the listening thread */
-  if (receive_thread_running != 0) {
-    INFO("network plugin: Stopping receive thread.");
-    pthread_kill(receive_thread_id, SIGTERM);
-    pthread_join(receive_thread_id, NULL /* no return value */);
-    memset(&receive_thread_id, 0, sizeof(receive_thread_id));
-    receive_thread_running = 0;
+  for (size_t i = 0; i < receive_queues_num; i++) {
+    pthread_mutex_init(&receive_queues[i].lock, /* attr = */ NULL);
+    pthread_cond_init(&receive_queues[i].cond, /* attr = */ NULL);
   }
 
-  /* Shutdown the dispatching thread */
-  if (dispatch_thread_running != 0) {
-    INFO("network plugin: Stopping dispatch thread.");
-    pthread_mutex_lock(&receive_list_lock);
-    pthread_cond_broadcast(&receive_list_cond);
-    pthread_mutex_unlock(&receive_list_lock);
-    pthread_join(dispatch_thread_id, /* ret = */ NULL);
-    dispatch_thread_running = 0;
+  for (size_t i = 0; i < receive_threads_num; i++) {
+    receive_thread_t *rt = receive_threads + i;
+    size_t num = (listen_sockets_num - i + receive_threads_num - 1) /
+                 receive_threads_num;
+
+    rt->pollfd = calloc(num, sizeof(*rt->pollfd));
+    rt->sockent = calloc(num, sizeof(*rt->sockent));
+    rt->queue = calloc(num, sizeof(*rt->queue));
+    rt->stream = calloc(num, sizeof(*rt->stream));
+    rt->rcvbuf = calloc(num, sizeof(*rt->rcvbuf));
+    if ((rt->pollfd == NULL) || (rt->sockent == NULL) || (rt->queue == NULL) ||
+        (rt->stream == NULL) || (rt->rcvbuf == NULL)) {
+      ERROR("network plugin: calloc failed.");
+      return -1;
+    }
+    rt->pollfd_size = num;
+  }
+
+  /* "listen_sockets_pollfd" holds the file descriptors in the same order as
+   * the "listen_sockets" list. */
+  size_t fd_index = 0;
+  for (sockent_t *se = listen_sockets; se != NULL; se = se->next) {
+    for (size_t i = 0; i < se->data.server.fd_num; i++) {
+      receive_thread_t *rt =
+          receive_threads + (fd_index % receive_threads_num);
+
+      assert(listen_sockets_pollfd[fd_index].fd == se->data.server.fd[i]);
+      rt->pollfd[rt->pollfd_num] = listen_sockets_pollfd[fd_index];
+      rt->sockent[rt->pollfd_num] = se;
+      rt->queue[rt->pollfd_num] = fd_index % receive_queues_num;
+      if (se->socktype == SOCK_DGRAM)
+        rt->rcvbuf[rt->pollfd_num] = se->data.server.rcvbuf + i;
+      rt->pollfd_num++;
+      fd_index++;
+    }
+  }
+
+  for (size_t i = 0; i < receive_queues_num; i++) {
+    receive_queue_t *q = receive_queues + i;
+
+    int status = plugin_thread_create(&q->thread, NULL /* no attributes */,
+                                      dispatch_thread, q, "network disp");
+    if (status != 0) {
+      ERROR("network: pthread_create failed: %s", STRERRNO);
+      return -1;
+    }
+    q->thread_running = 1;
+  }
+
+  for (size_t i = 0; i < receive_threads_num; i++) {
+    receive_thread_t *rt = receive_threads + i;
+
+    int status = plugin_thread_create(&rt->thread, NULL /* no attributes */,
+                                      receive_thread, rt, "network recv");
+    if (status != 0) {
+      ERROR("network: pthread_create failed: %s", STRERRNO);
+      return -1;
+    }
+    rt->thread_running = 1;
   }
 
+  return 0;
+} /* }}} int network_start_threads */
+
+static void network_stop_threads(void) /* {{{ */
+{
+  /* Kill the listening threads */
+  for (size_t i = 0; i < receive_threads_num; i++) {
+    receive_thread_t *rt = receive_threads + i;
+
+    if (rt->thread_running) {
+      INFO("network plugin: Stopping receive thread.");
+      pthread_kill(rt->thread, SIGTERM);
+      pthread_join(rt->thread, NULL /* no return value */);
+      rt->thread_running = 0;
+    }
+
+    sfree(rt->pollfd);
+    sfree(rt->sockent);
+    sfree(rt->queue);
+    sfree(rt->stream);
+    sfree(rt->rcvbuf);
+  }
+  sfree(receive_threads);
+  receive_threads_num = 0;
+
+  /* Shutdown the dispatching threads. Each one drains its queue before
+   * exiting. */
+  for (size_t i = 0; i < receive_queues_num; i++) {
+    receive_queue_t *q = receive_queues + i;
+
+    if (q->thread_running) {
+      INFO("network plugin: Stopping dispatch thread.");
+      pthread_mutex_lock(&q->lock);
+      pthread_cond_broadcast(&q->cond);
+      pthread_mutex_unlock(&q->lock);
+      pthread_join(q->thread, /* ret = */ NULL);
+      q->thread_running = 0;
+    }
+
+    /* Only left over if the dispatch thread could not be started. */
+    receive_pool_put(q->list.head);
+    pthread_mutex_destroy(&q->lock);
+    pthread_cond_destroy(&q->cond);
+  }
+  sfree(receive_queues);
+  receive_queues_num = 0;
+} /* }}} void network_stop_threads */
+
+static int network_shutdown(void) {
+  listen_loop++;
+
+  network_stop_threads();
+  receive_pool_destroy();
+
+  topk_destroy(top_senders_addr);
+  top_senders_addr = NULL;
+  topk_destroy(top_senders_host);
+  top_senders_host = NULL;
+
   sockent_destroy(listen_sockets);
 
   if (send_buffer_fill > 0)
     flush_buffer();
-
-  sfree(send_buffer);
+  network_send_pending();
+
+  sfree(send_batch);
+  sfree(send_batch_len);
+  sfree(send_buffer_base);
+  sfree(send_buffer_base_types);
+  send_buffer_base_size = 0;
+#if HAVE_LZ4_H
+  sfree(compress_pending);
+  sfree(compress_segment_end);
+#endif
+  send_buffer = NULL;
 
   for (sockent_t *se = sending_sockets; se != NULL; se = se->next)
     sockent_client_disconnect(se);
@@ -3024,6 +5480,68 @@ static int network_shutdown(void) {
   return 0;
 } /* int network_shutdown */
 
+/* Dispatches the sums of the heaviest senders and decays the summaries, so
+ * that senders which stop sending are eventually replaced. */
+static void network_stats_read_top_senders(void) /* {{{ */
+{
+  size_t num = network_config_top_senders;
+  topk_item_t *addr_items = calloc(num, sizeof(*addr_items));
+  topk_item_t *host_items = calloc(num, sizeof(*host_items));
+  if ((addr_items == NULL) || (host_items == NULL)) {
+    ERROR("network plugin: calloc failed.");
+    sfree(addr_items);
+    sfree(host_items);
+    return;
+  }
+
+  pthread_mutex_lock(&top_senders_lock);
+  size_t addr_num = topk_get(top_senders_addr, addr_items, num);
+  size_t host_num = topk_get(top_senders_host, host_items, num);
+  topk_decay(top_senders_addr);
+  topk_decay(top_senders_host);
+  pthread_mutex_unlock(&top_senders_lock);
+
+  value_list_t vl = VALUE_LIST_INIT;
+  value_t values[1];
+
+  vl.values = values;
+  vl.values_len = 1;
+  sstrncpy(vl.plugin, "network", sizeof(vl.plugin));
+
+  for (size_t i = 0; i < addr_num; i++) {
+    topk_item_t *item = addr_items + i;
+
+    snprintf(vl.plugin_instance, sizeof(vl.plugin_instance), "sender-%s",
+             item->name);
+
+    vl.values[0].derive = (derive_t)item->sums[TOP_SENDERS_PACKETS];
+    sstrncpy(vl.type, "if_rx_packets", sizeof(vl.type));
+    vl.type_instance[0] = 0;
+    plugin_dispatch_values(&vl);
+
+    vl.values[0].derive = (derive_t)item->sums[TOP_SENDERS_OCTETS];
+    sstrncpy(vl.type, "if_rx_octets", sizeof(vl.type));
+    plugin_dispatch_values(&vl);
+
+    vl.values[0].derive = (derive_t)item->sums[TOP_SENDERS_VALUES];
+    sstrncpy(vl.type, "total_values", sizeof(vl.type));
+    sstrncpy(vl.type_instance, "dispatch-accepted", sizeof(vl.type_instance));
+    plugin_dispatch_values(&vl);
+  }
+
+  sstrncpy(vl.type, "total_values", sizeof(vl.type));
+  sstrncpy(vl.type_instance, "dispatch-accepted", sizeof(vl.type_instance));
+  for (size_t i = 0; i < host_num; i++) {
+    snprintf(vl.plugin_instance, sizeof(vl.plugin_instance), "host-%s",
+             host_items[i].name);
+    vl.values[0].derive = (derive_t)host_items[i].sums[TOP_SENDERS_VALUES];
+    plugin_dispatch_values(&vl);
+  }
+
+  sfree(addr_items);
+  sfree(host_items);
+} /* }}} void network_stats_read_top_senders */
+
 static int network_stats_read(void) /* {{{ */
 {
   derive_t copy_octets_rx;
@@ -3035,6 +5553,7 @@ static int network_stats_read(void) /* {{{ */
   derive_t copy_values_sent;
   derive_t copy_values_not_sent;
   derive_t copy_receive_list_length;
+  derive_t copy_drops = 0;
   value_list_t vl = VALUE_LIST_INIT;
   value_t values[2];
 
@@ -3046,7 +5565,12 @@ static int network_stats_read(void) /* {{{ */
   copy_values_not_dispatched = stats_values_not_dispatched;
   copy_values_sent = stats_values_sent;
   copy_values_not_sent = stats_values_not_sent;
-  copy_receive_list_length = receive_list_length;
+  copy_receive_list_length = 0;
+  for (size_t i = 0; i < receive_queues_num; i++)
+    copy_receive_list_length += receive_queues[i].list.length;
+  for (sockent_t *se = listen_sockets; se != NULL; se = se->next)
+    for (size_t i = 0; i < se->data.server.fd_num; i++)
+      copy_drops += (derive_t)se->data.server.rcvbuf[i].drops;
 
   /* Initialize `vl' */
   vl.values = values;
@@ -3086,12 +5610,21 @@ static int network_stats_read(void) /* {{{ */
   sstrncpy(vl.type_instance, "send-rejected", sizeof(vl.type_instance));
   plugin_dispatch_values(&vl);
 
+  /* Datagrams dropped by the kernel because the receive buffer was full */
+  vl.values[0].derive = copy_drops;
+  sstrncpy(vl.type, "if_rx_dropped", sizeof(vl.type));
+  vl.type_instance[0] = 0;
+  plugin_dispatch_values(&vl);
+
   /* Receive queue length */
   vl.values[0].gauge = (gauge_t)copy_receive_list_length;
   sstrncpy(vl.type, "queue_length", sizeof(vl.type));
   vl.type_instance[0] = 0;
   plugin_dispatch_values(&vl);
 
+  if (top_senders_addr != NULL)
+    network_stats_read_top_senders();
+
   return 0;
 } /* }}} int network_stats_read */
 
@@ -3107,15 +5640,72 @@ static int network_init(void) {
   if (network_config_stats)
     plugin_register_read("network", network_stats_read);
 
+  if (network_config_stats && (network_config_top_senders > 0) &&
+      (listen_sockets != NULL)) {
+    /* Tracking more senders than reported keeps the reported ones accurate
+     * when many light senders come and go. */
+    top_senders_addr = topk_create(4 * network_config_top_senders);
+    top_senders_host = topk_create(4 * network_config_top_senders);
+    if ((top_senders_addr == NULL) || (top_senders_host == NULL)) {
+      ERROR("network plugin: Allocating the top senders summaries failed.");
+      topk_destroy(top_senders_addr);
+      top_senders_addr = NULL;
+      topk_destroy(top_senders_host);
+      top_senders_host = NULL;
+    }
+  }
+
   plugin_register_shutdown("network", network_shutdown);
 
-  send_buffer = malloc(network_config_packet_size);
-  if (send_buffer == NULL) {
+  send_batch = malloc(network_config_send_batch * network_config_packet_size);
+  send_batch_len = calloc(network_config_send_batch, sizeof(*send_batch_len));
+  if ((send_batch == NULL) || (send_batch_len == NULL)) {
     ERROR("network plugin: malloc failed.");
+    sfree(send_batch);
+    sfree(send_batch_len);
     return -1;
   }
+  send_batch_num = 0;
+  send_buffer = send_batch;
+  send_buffer_size = network_config_packet_size;
+
+#if HAVE_LZ4_H
+  if (network_config_compress) {
+    if (send_buffer_size > NETWORK_COMPRESS_SEGMENT_SIZE)
+      send_buffer_size = NETWORK_COMPRESS_SEGMENT_SIZE;
+    /* The uncompressed size is transmitted as a 16 bit integer. One more
+     * segment is needed for the one being filled. */
+    compress_segments_max = (UINT16_MAX / send_buffer_size) - 1;
+
+    compress_pending = malloc((compress_segments_max + 1) * send_buffer_size);
+    compress_segment_end =
+        calloc(compress_segments_max, sizeof(*compress_segment_end));
+    if ((compress_pending == NULL) || (compress_segment_end == NULL)) {
+      ERROR("network plugin: malloc failed.");
+      sfree(compress_pending);
+      sfree(compress_segment_end);
+      sfree(send_batch);
+      sfree(send_batch_len);
+      return -1;
+    }
+    compress_pending_len = 0;
+    compress_segments_num = 0;
+    send_buffer = compress_pending;
+  }
+#endif
+
   network_init_buffer();
 
+  if (network_config_forward_passthrough && (sending_sockets == NULL)) {
+    WARNING("network plugin: `ForwardPassthrough' requires a `Server' and "
+            "is ignored.");
+    network_config_forward_passthrough = 0;
+  }
+  /* Values that cannot be passed through are dispatched and need to be
+   * forwarded the usual way. */
+  if (network_config_forward_passthrough)
+    network_config_forward = 1;
+
   /* setup socket(s) and so on */
   if (sending_sockets != NULL) {
     plugin_register_write("network", network_write,
@@ -3125,35 +5715,10 @@ static int network_init(void) {
   }
 
   /* If no threads need to be started, return here. */
-  if ((listen_sockets_num == 0) ||
-      ((dispatch_thread_running != 0) && (receive_thread_running != 0)))
+  if (listen_sockets_num == 0)
     return 0;
 
-  if (dispatch_thread_running == 0) {
-    int status;
-    status = plugin_thread_create(&dispatch_thread_id, NULL /* no attributes */,
-                                  dispatch_thread, NULL /* no argument */,
-                                  "network disp");
-    if (status != 0) {
-      ERROR("network: pthread_create failed: %s", STRERRNO);
-    } else {
-      dispatch_thread_running = 1;
-    }
-  }
-
-  if (receive_thread_running == 0) {
-    int status;
-    status = plugin_thread_create(&receive_thread_id, NULL /* no attributes */,
-                                  receive_thread, NULL /* no argument */,
-                                  "network recv");
-    if (status != 0) {
-      ERROR("network: pthread_create failed: %s", STRERRNO);
-    } else {
-      receive_thread_running = 1;
-    }
-  }
-
-  return 0;
+  return network_start_threads();
 } /* int network_init */
 
 /*
@@ -3169,15 +5734,14 @@ static int network_flush(cdtime_t timeout,
   pthread_mutex_lock(&send_buffer_lock);
 
   if (send_buffer_fill > 0) {
-    if (timeout > 0) {
-      cdtime_t now = cdtime();
-      if ((send_buffer_last_update + timeout) > now) {
-        pthread_mutex_unlock(&send_buffer_lock);
-        return 0;
-      }
-    }
-    flush_buffer();
+    _Bool expired = 1;
+    if (timeout > 0)
+      expired = ((send_buffer_last_update + timeout) <= cdtime());
+    if (expired)
+      flush_buffer();
   }
+  /* Finished packets are never held back by a flush. */
+  network_send_pending();
   pthread_mutex_unlock(&send_buffer_lock);
 
   return 0;
@@ -70,11 +70,20 @@
 #define TYPE_INTERVAL 0x0007
 #define TYPE_INTERVAL_HR 0x0009
 
+/* Compact encoding, see write_part_values_varint() */
+#define TYPE_VALUES_VARINT 0x000a
+#define TYPE_VALUES_DELTA 0x000b
+#define TYPE_TIME_DELTA 0x000c
+
 /* Types to transmit notifications */
 #define TYPE_MESSAGE 0x0100
 #define TYPE_SEVERITY 0x0101
 
 #define TYPE_SIGN_SHA256 0x0200
 #define TYPE_ENCR_AES256 0x0210
+#define TYPE_ENCR_AES256_GCM 0x0220
+
+/* Container for LZ4 compressed parts */
+#define TYPE_COMPRESS_LZ4 0x0300
 
 #endif /* NETWORK_H */
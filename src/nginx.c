@@ -30,6 +30,7 @@
 
 #include "common.h"
 #include "plugin.h"
+#include "utils_curl_engine.h"
 
 #include <curl/curl.h>
 
@@ -40,6 +41,8 @@ static char *verify_peer = NULL;
 static char *verify_host = NULL;
 static char *cacert = NULL;
 static char *timeout = NULL;
+/* The transfer runs on the curl engine's thread. */
+static _Bool nginx_async = 0;
 
 static CURL *curl = NULL;
 
@@ -48,7 +51,8 @@ static size_t nginx_buffer_len = 0;
 static char nginx_curl_error[CURL_ERROR_SIZE];
 
 static const char *config_keys[] = {
-    "URL", "User", "Password", "VerifyPeer", "VerifyHost", "CACert", "Timeout"};
+    "URL",        "User",   "Password", "VerifyPeer",
+    "VerifyHost", "CACert", "Timeout",  "Asynchronous"};
 static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 
 static size_t nginx_curl_callback(void *buf, size_t size, size_t nmemb,
@@ -98,13 +102,18 @@ static int config(const char *key, const char *value) {
     return config_set(&cacert, value);
   else if (strcasecmp(key, "timeout") == 0)
     return config_set(&timeout, value);
-  else
+  else if (strcasecmp(key, "asynchronous") == 0) {
+    nginx_async = IS_TRUE(value);
+    return 0;
+  } else
     return -1;
 } /* int config */
 
 static int init(void) {
-  if (curl != NULL)
+  if (curl != NULL) {
+    curl_engine_cancel(curl);
     curl_easy_cleanup(curl);
+  }
 
   if ((curl = curl_easy_init()) == NULL) {
     ERROR("nginx plugin: curl_easy_init failed.");
@@ -161,6 +170,12 @@ static int init(void) {
   }
 #endif
 
+  if (nginx_async && (curl_engine_acquire() != 0)) {
+    ERROR("nginx plugin: Starting the curl engine failed.");
+    nginx_async = 0;
+    return -1;
+  }
+
   return 0;
 } /* void init */
 
@@ -188,7 +203,8 @@ static void submit(const char *type, const char *inst, long long value) {
   plugin_dispatch_values(&vl);
 } /* void submit */
 
-static int nginx_read(void) {
+/* Parses the status page and dispatches the values. */
+static int nginx_read_done(CURLcode status) {
   char *ptr;
   char *lines[16];
   int lines_num = 0;
@@ -197,16 +213,7 @@ static int nginx_read(void) {
   char *fields[16];
   int fields_num;
 
-  if (curl == NULL)
-    return -1;
-  if (url == NULL)
-    return -1;
-
-  nginx_buffer_len = 0;
-
-  curl_easy_setopt(curl, CURLOPT_URL, url);
-
-  if (curl_easy_perform(curl) != CURLE_OK) {
+  if (status != CURLE_OK) {
     WARNING("nginx plugin: curl_easy_perform failed: %s", nginx_curl_error);
     return -1;
   }
@@ -258,11 +265,52 @@ static int nginx_read(void) {
 
   nginx_buffer_len = 0;
 
+  return 0;
+} /* int nginx_read_done */
+
+/* Called on the curl engine's thread when an asynchronous transfer is done. */
+static void nginx_async_done(CURL *handle, CURLcode status,
+                             void __attribute__((unused)) * user_data) {
+  nginx_read_done(status);
+} /* void nginx_async_done */
+
+static int nginx_read(void) {
+  if (curl == NULL)
+    return -1;
+  if (url == NULL)
+    return -1;
+
+  /* The buffer belongs to the engine until the transfer is done. */
+  if (nginx_async && curl_engine_busy(curl)) {
+    WARNING("nginx plugin: Request for %s still in progress, skipping.", url);
+    return 0;
+  }
+
+  nginx_buffer_len = 0;
+
+  curl_easy_setopt(curl, CURLOPT_URL, url);
+
+  if (!nginx_async)
+    return nginx_read_done(curl_easy_perform(curl));
+
+  int status = curl_engine_submit(curl, nginx_async_done, NULL);
+  if (status != 0) {
+    ERROR("nginx plugin: Submitting request for %s failed: %s", url,
+          STRERROR(status));
+    return -1;
+  }
   return 0;
 } /* int nginx_read */
 
+static int nginx_shutdown(void) {
+  if (nginx_async)
+    curl_engine_release();
+  return 0;
+} /* int nginx_shutdown */
+
 void module_register(void) {
   plugin_register_config("nginx", config, config_keys, config_keys_num);
   plugin_register_init("nginx", init);
   plugin_register_read("nginx", nginx_read);
+  plugin_register_shutdown("nginx", nginx_shutdown);
 } /* void module_register */
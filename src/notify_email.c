@@ -32,18 +32,43 @@
 
 #define MAXSTRING 256
 
-static const char *config_keys[] = {"SMTPServer",   "SMTPPort", "SMTPUser",
-                                    "SMTPPassword", "From",     "Recipient",
-                                    "Subject"};
+/* Maximum number of notifications waiting to be sent. Further notifications
+ * are dropped. */
+#define QUEUE_LIMIT 1000
+
+static const char *config_keys[] = {
+    "SMTPServer", "SMTPPort",  "SMTPUser", "SMTPPassword",
+    "From",       "Recipient", "Subject",  "DigestInterval"};
 static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 
 static char **recipients;
 static int recipients_len = 0;
 
-static smtp_session_t session;
-static pthread_mutex_t session_lock = PTHREAD_MUTEX_INITIALIZER;
-static smtp_message_t message;
 static auth_context_t authctx = NULL;
+static char smtp_server[MAXSTRING];
+static cdtime_t digest_interval = 0;
+
+/* Notifications are formatted by the notification callback and sent by a
+ * separate thread, so that a slow SMTP server doesn't hold up the daemon.
+ * Everything queued by the time the thread wakes up is sent over a single
+ * connection, or as a single digest with "DigestInterval". */
+typedef struct email_item_s {
+  char subject[MAXSTRING];
+  char *body;
+  char *message; /* complete message, set while it is being sent */
+  struct email_item_s *next;
+} email_item_t;
+
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+static email_item_t *queue_head = NULL;
+static email_item_t *queue_tail = NULL;
+static int queue_len = 0;
+static cdtime_t queue_first = 0; /* when the oldest item was queued */
+static uint64_t queue_dropped = 0;
+static _Bool queue_quit = 0;
+static _Bool send_thread_running = 0;
+static pthread_t send_thread;
 
 static int smtp_port = 25;
 static char *smtp_host = NULL;
@@ -55,6 +80,15 @@ static char *email_subject = NULL;
 #define DEFAULT_SMTP_HOST "localhost"
 #define DEFAULT_SMTP_FROM "root@localhost"
 #define DEFAULT_SMTP_SUBJECT "Collectd notify: %s@%s"
+#define DIGEST_SUBJECT "Collectd notify: %i notifications"
+
+#define MESSAGE_FORMAT                                                         \
+  "MIME-Version: 1.0\r\n"                                                      \
+  "Content-Type: text/plain; charset=\"US-ASCII\"\r\n"                         \
+  "Content-Transfer-Encoding: 8bit\r\n"                                        \
+  "Subject: %s\r\n"                                                           \
+  "\r\n"                                                                      \
+  "%s"
 
 /* Callback to get username and password */
 static int authinteract(auth_client_request_t request, char **result,
@@ -101,26 +135,186 @@ static void monitor_cb(const char *buf, int buflen, int writing,
         log_str);
 } /* void monitor_cb */
 
-static int notify_email_init(void) {
-  char server[MAXSTRING];
+/* Callback to report the recipient status of each message */
+static void print_message_status(smtp_message_t message,
+                                 void __attribute__((unused)) * arg) {
+#if COLLECT_DEBUG
+  const smtp_status_t *status;
+  /* Report on the success or otherwise of the mail transfer. */
+  status = smtp_message_transfer_status(message);
+  DEBUG("notify_email plugin: SMTP server report: %d %s", status->code,
+        (status->text != NULL) ? status->text : "\n");
+#endif
+  smtp_enumerate_recipients(message, print_recipient_status, NULL);
+} /* void print_message_status */
+
+static void email_items_free(email_item_t *item) /* {{{ */
+{
+  while (item != NULL) {
+    email_item_t *next = item->next;
+    sfree(item->body);
+    sfree(item->message);
+    sfree(item);
+    item = next;
+  }
+} /* }}} void email_items_free */
 
-  snprintf(server, sizeof(server), "%s:%i",
-           (smtp_host == NULL) ? DEFAULT_SMTP_HOST : smtp_host, smtp_port);
+static smtp_message_t notify_email_add_message(smtp_session_t session,
+                                               const char *text) {
+  smtp_message_t message = smtp_add_message(session);
+  if (message == NULL)
+    return NULL;
+
+  smtp_set_reverse_path(message, email_from);
+  smtp_set_header(message, "To", NULL, NULL);
+  smtp_set_message_str(message, (void *)text);
 
-  pthread_mutex_lock(&session_lock);
+  for (int i = 0; i < recipients_len; i++)
+    smtp_add_recipient(message, recipients[i]);
 
-  auth_client_init();
+  return message;
+} /* smtp_message_t notify_email_add_message */
+
+/* Joins the bodies of all items into one message. */
+static char *notify_email_digest(email_item_t *items) /* {{{ */
+{
+  char subject[MAXSTRING];
+  size_t len = 1;
+  int num = 0;
+
+  for (email_item_t *item = items; item != NULL; item = item->next) {
+    len += strlen(item->body) + 4;
+    num++;
+  }
 
-  session = smtp_create_session();
+  char *body = malloc(len);
+  if (body == NULL)
+    return NULL;
+  body[0] = 0;
+
+  char *ptr = body;
+  for (email_item_t *item = items; item != NULL; item = item->next) {
+    size_t body_len = strlen(item->body);
+    memcpy(ptr, item->body, body_len);
+    ptr += body_len;
+    if (item->next != NULL) {
+      memcpy(ptr, "\r\n\r\n", 4);
+      ptr += 4;
+    }
+  }
+  *ptr = 0;
+
+  snprintf(subject, sizeof(subject), DIGEST_SUBJECT, num);
+  char *message = ssnprintf_alloc(MESSAGE_FORMAT, subject, body);
+  sfree(body);
+  return message;
+} /* }}} char *notify_email_digest */
+
+/* Sends the items over one connection to the SMTP server. libESMTP pipelines
+ * the messages if the server supports it. */
+static void notify_email_send(email_item_t *items) /* {{{ */
+{
+  char errbuf[MAXSTRING];
+  char *digest = NULL;
+  int num = 0;
+
+  smtp_session_t session = smtp_create_session();
   if (session == NULL) {
-    pthread_mutex_unlock(&session_lock);
     ERROR("notify_email plugin: cannot create SMTP session");
-    return -1;
+    return;
   }
 
   smtp_set_monitorcb(session, monitor_cb, NULL, 1);
   smtp_set_hostname(session, hostname_g);
-  smtp_set_server(session, server);
+  smtp_set_server(session, smtp_server);
+
+  if (!smtp_auth_set_context(session, authctx)) {
+    ERROR("notify_email plugin: cannot set SMTP auth context");
+    smtp_destroy_session(session);
+    return;
+  }
+
+  if (digest_interval > 0) {
+    digest = notify_email_digest(items);
+    if ((digest != NULL) && (notify_email_add_message(session, digest) != NULL))
+      num++;
+  } else {
+    for (email_item_t *item = items; item != NULL; item = item->next) {
+      item->message = ssnprintf_alloc(MESSAGE_FORMAT, item->subject,
+                                      item->body);
+      if ((item->message != NULL) &&
+          (notify_email_add_message(session, item->message) != NULL))
+        num++;
+    }
+  }
+
+  if (num == 0) {
+    ERROR("notify_email plugin: cannot set SMTP message");
+  } else if (!smtp_start_session(session)) {
+    /* Initiate a connection to the SMTP server and transfer the messages. */
+    ERROR("notify_email plugin: SMTP server problem: %s",
+          smtp_strerror(smtp_errno(), errbuf, sizeof(errbuf)));
+  } else {
+    smtp_enumerate_messages(session, print_message_status, NULL);
+  }
+
+  smtp_destroy_session(session);
+  sfree(digest);
+} /* }}} void notify_email_send */
+
+static void *notify_email_thread(void __attribute__((unused)) * arg) /* {{{ */
+{
+  pthread_mutex_lock(&queue_lock);
+  while (42) {
+    while ((queue_head == NULL) && !queue_quit)
+      pthread_cond_wait(&queue_cond, &queue_lock);
+
+    if (queue_head == NULL)
+      break;
+
+    /* Collect notifications until the digest is due. */
+    if ((digest_interval > 0) && !queue_quit &&
+        (cdtime() < queue_first + digest_interval)) {
+      struct timespec ts =
+          CDTIME_T_TO_TIMESPEC(queue_first + digest_interval);
+      pthread_cond_timedwait(&queue_cond, &queue_lock, &ts);
+      continue;
+    }
+
+    email_item_t *items = queue_head;
+    uint64_t dropped = queue_dropped;
+    queue_head = queue_tail = NULL;
+    queue_len = 0;
+    queue_dropped = 0;
+    pthread_mutex_unlock(&queue_lock);
+
+    if (dropped > 0)
+      WARNING("notify_email plugin: The queue was full, %" PRIu64
+              " notification%s have been dropped.",
+              dropped, (dropped == 1) ? "" : "s");
+
+    notify_email_send(items);
+    email_items_free(items);
+
+    pthread_mutex_lock(&queue_lock);
+  }
+  pthread_mutex_unlock(&queue_lock);
+
+  return NULL;
+} /* }}} void *notify_email_thread */
+
+static int notify_email_init(void) {
+  snprintf(smtp_server, sizeof(smtp_server), "%s:%i",
+           (smtp_host == NULL) ? DEFAULT_SMTP_HOST : smtp_host, smtp_port);
+
+  pthread_mutex_lock(&queue_lock);
+
+  if (send_thread_running) {
+    pthread_mutex_unlock(&queue_lock);
+    return 0;
+  }
+
+  auth_client_init();
 
   if (smtp_user && smtp_password) {
     authctx = auth_create_context();
@@ -128,22 +322,37 @@ static int notify_email_init(void) {
     auth_set_interact_cb(authctx, authinteract, NULL);
   }
 
-  if (!smtp_auth_set_context(session, authctx)) {
-    pthread_mutex_unlock(&session_lock);
-    ERROR("notify_email plugin: cannot set SMTP auth context");
+  queue_quit = 0;
+  int status = plugin_thread_create(&send_thread, /* attr = */ NULL,
+                                    notify_email_thread, /* arg = */ NULL,
+                                    "notify_email");
+  if (status != 0) {
+    pthread_mutex_unlock(&queue_lock);
+    ERROR("notify_email plugin: cannot start the send thread");
     return -1;
   }
+  send_thread_running = 1;
 
-  pthread_mutex_unlock(&session_lock);
+  pthread_mutex_unlock(&queue_lock);
   return 0;
 } /* int notify_email_init */
 
 static int notify_email_shutdown(void) {
-  pthread_mutex_lock(&session_lock);
+  pthread_mutex_lock(&queue_lock);
+  if (!send_thread_running) {
+    pthread_mutex_unlock(&queue_lock);
+    return 0;
+  }
 
-  if (session != NULL)
-    smtp_destroy_session(session);
-  session = NULL;
+  /* The thread sends what is still queued before it exits. */
+  queue_quit = 1;
+  pthread_cond_signal(&queue_cond);
+  pthread_mutex_unlock(&queue_lock);
+
+  pthread_join(send_thread, NULL);
+
+  pthread_mutex_lock(&queue_lock);
+  send_thread_running = 0;
 
   if (authctx != NULL)
     auth_destroy_context(authctx);
@@ -151,7 +360,7 @@ static int notify_email_shutdown(void) {
 
   auth_client_exit();
 
-  pthread_mutex_unlock(&session_lock);
+  pthread_mutex_unlock(&queue_lock);
   return 0;
 } /* int notify_email_shutdown */
 
@@ -194,6 +403,13 @@ static int notify_email_config(const char *key, const char *value) {
   } else if (0 == strcasecmp(key, "Subject")) {
     sfree(email_subject);
     email_subject = strdup(value);
+  } else if (0 == strcasecmp(key, "DigestInterval")) {
+    double interval = atof(value);
+    if (interval < 0.0) {
+      WARNING("notify_email plugin: Invalid digest interval: %s", value);
+      return 1;
+    }
+    digest_interval = DOUBLE_TO_CDTIME_T(interval);
   } else {
     return -1;
   }
@@ -210,9 +426,6 @@ static int notify_email_notification(const notification_t *n,
   char severity[32];
   char subject[MAXSTRING];
 
-  char buf[4096] = "";
-  int buf_len = sizeof(buf);
-  int i;
 
   snprintf(severity, sizeof(severity), "%s",
            (n->severity == NOTIF_FAILURE)
@@ -230,55 +443,52 @@ static int notify_email_notification(const notification_t *n,
            &timestamp_tm);
   timestamp_str[sizeof(timestamp_str) - 1] = '\0';
 
+  email_item_t *item = calloc(1, sizeof(*item));
+  if (item == NULL) {
+    ERROR("notify_email plugin: calloc failed.");
+    return -1;
+  }
+
+  sstrncpy(item->subject, subject, sizeof(item->subject));
+
   /* Let's make RFC822 message text with \r\n EOLs */
-  snprintf(buf, buf_len, "MIME-Version: 1.0\r\n"
-                         "Content-Type: text/plain; charset=\"US-ASCII\"\r\n"
-                         "Content-Transfer-Encoding: 8bit\r\n"
-                         "Subject: %s\r\n"
-                         "\r\n"
-                         "%s - %s@%s\r\n"
-                         "\r\n"
-                         "Message: %s",
-           subject, timestamp_str, severity, n->host, n->message);
-
-  pthread_mutex_lock(&session_lock);
+  item->body = ssnprintf_alloc("%s - %s@%s\r\n"
+                               "\r\n"
+                               "Message: %s",
+                               timestamp_str, severity, n->host, n->message);
+  if (item->body == NULL) {
+    ERROR("notify_email plugin: ssnprintf_alloc failed.");
+    sfree(item);
+    return -1;
+  }
 
-  if (session == NULL) {
+  pthread_mutex_lock(&queue_lock);
+
+  if (!send_thread_running) {
     /* Initialization failed or we're in the process of shutting down. */
-    pthread_mutex_unlock(&session_lock);
+    pthread_mutex_unlock(&queue_lock);
+    email_items_free(item);
     return -1;
   }
 
-  if (!(message = smtp_add_message(session))) {
-    pthread_mutex_unlock(&session_lock);
-    ERROR("notify_email plugin: cannot set SMTP message");
+  if (queue_len >= QUEUE_LIMIT) {
+    queue_dropped++;
+    pthread_mutex_unlock(&queue_lock);
+    email_items_free(item);
     return -1;
   }
-  smtp_set_reverse_path(message, email_from);
-  smtp_set_header(message, "To", NULL, NULL);
-  smtp_set_message_str(message, buf);
-
-  for (i = 0; i < recipients_len; i++)
-    smtp_add_recipient(message, recipients[i]);
 
-  /* Initiate a connection to the SMTP server and transfer the message. */
-  if (!smtp_start_session(session)) {
-    ERROR("notify_email plugin: SMTP server problem: %s",
-          smtp_strerror(smtp_errno(), buf, sizeof buf));
-    pthread_mutex_unlock(&session_lock);
-    return -1;
+  if (queue_tail == NULL) {
+    queue_head = item;
+    queue_first = cdtime();
   } else {
-#if COLLECT_DEBUG
-    const smtp_status_t *status;
-    /* Report on the success or otherwise of the mail transfer. */
-    status = smtp_message_transfer_status(message);
-    DEBUG("notify_email plugin: SMTP server report: %d %s", status->code,
-          (status->text != NULL) ? status->text : "\n");
-#endif
-    smtp_enumerate_recipients(message, print_recipient_status, NULL);
+    queue_tail->next = item;
   }
+  queue_tail = item;
+  queue_len++;
 
-  pthread_mutex_unlock(&session_lock);
+  pthread_cond_signal(&queue_cond);
+  pthread_mutex_unlock(&queue_lock);
   return 0;
 } /* int notify_email_notification */
 
@@ -28,6 +28,7 @@
 
 #include "common.h"
 #include "plugin.h"
+#include "utils_procfs.h"
 
 #if !KERNEL_LINUX
 #error "No applicable input method."
@@ -39,12 +40,13 @@
 
 static int max_node = -1;
 
-static void numa_dispatch_value(int node, /* {{{ */
+static void numa_dispatch_value(int node, cdtime_t time, /* {{{ */
                                 const char *type_instance, value_t v) {
   value_list_t vl = VALUE_LIST_INIT;
 
   vl.values = &v;
   vl.values_len = 1;
+  vl.time = time;
 
   sstrncpy(vl.plugin, "numa", sizeof(vl.plugin));
   snprintf(vl.plugin_instance, sizeof(vl.plugin_instance), "node%i", node);
@@ -57,44 +59,28 @@ static void numa_dispatch_value(int node, /* {{{ */
 static int numa_read_node(int node) /* {{{ */
 {
   char path[PATH_MAX];
-  FILE *fh;
-  char buffer[128];
-  int status;
-  int success;
+  procfs_snapshot_t *s;
+  procfs_entry_t const *entries;
+  size_t entries_num;
 
   snprintf(path, sizeof(path), NUMA_ROOT_DIR "/node%i/numastat", node);
 
-  fh = fopen(path, "r");
-  if (fh == NULL) {
-    ERROR("numa plugin: Reading node %i failed: open(%s): %s", node, path,
+  s = procfs_snapshot_acquire(path);
+  if (s == NULL) {
+    ERROR("numa plugin: Reading node %i failed: %s: %s", node, path,
           STRERRNO);
     return -1;
   }
 
-  success = 0;
-  while (fgets(buffer, sizeof(buffer), fh) != NULL) {
-    char *fields[4];
-    value_t v;
-
-    status = strsplit(buffer, fields, STATIC_ARRAY_SIZE(fields));
-    if (status != 2) {
-      WARNING("numa plugin: Ignoring line with unexpected "
-              "number of fields (node %i).",
-              node);
-      continue;
-    }
-
-    v.derive = 0;
-    status = parse_value(fields[1], &v, DS_TYPE_DERIVE);
-    if (status != 0)
-      continue;
-
-    numa_dispatch_value(node, fields[0], v);
-    success++;
+  cdtime_t time = procfs_snapshot_time(s);
+  entries = procfs_snapshot_entries(s, &entries_num);
+  for (size_t i = 0; i < entries_num; i++) {
+    value_t v = {.derive = (derive_t)entries[i].value};
+    numa_dispatch_value(node, time, entries[i].key, v);
   }
 
-  fclose(fh);
-  return success ? 0 : -1;
+  procfs_snapshot_release(s);
+  return (entries_num > 0) ? 0 : -1;
 } /* }}} int numa_read_node */
 
 static int numa_read(void) /* {{{ */
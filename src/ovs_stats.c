@@ -29,6 +29,7 @@
  */
 
 #include "common.h"
+#include "utils_avltree.h"
 
 #include "utils_ovs.h" /* OvS helpers */
 
@@ -86,6 +87,7 @@ typedef struct port_s {
   char ex_vm_id[UUID_SIZE];           /* External vm id */
   int64_t stats[IFACE_COUNTER_COUNT]; /* Port statistics */
   struct bridge_list_s *br;           /* Pointer to bridge */
+  char *devname;                      /* Cached "<bridge>.<port>" */
   struct port_s *next;                /* Next port */
 } port_list_t;
 
@@ -139,6 +141,10 @@ static bridge_list_t *g_monitored_bridge_list_head;
 /* entry into the list of network bridges */
 static port_list_t *g_port_list_head;
 
+/* Indices into the port list by Port table _uuid and by port name */
+static c_avl_tree_t *g_port_uuid_tree;
+static c_avl_tree_t *g_port_name_tree;
+
 /* lock for statistics cache */
 static pthread_mutex_t g_stats_lock;
 
@@ -220,25 +226,42 @@ static void ovs_stats_submit_two(const char *dev, const char *type,
 }
 
 static port_list_t *ovs_stats_get_port(const char *uuid) {
-  if (uuid == NULL)
+  port_list_t *port = NULL;
+
+  if ((uuid == NULL) || (g_port_uuid_tree == NULL))
     return NULL;
 
-  for (port_list_t *port = g_port_list_head; port != NULL; port = port->next) {
-    if (strncmp(port->port_uuid, uuid, strlen(port->port_uuid)) == 0)
-      return port;
-  }
-  return NULL;
+  if (c_avl_get(g_port_uuid_tree, uuid, (void *)&port) != 0)
+    return NULL;
+  return port;
 }
 
 static port_list_t *ovs_stats_get_port_by_name(const char *name) {
-  if (name == NULL)
+  port_list_t *port = NULL;
+
+  if ((name == NULL) || (g_port_name_tree == NULL))
     return NULL;
 
-  for (port_list_t *port = g_port_list_head; port != NULL; port = port->next)
-    if ((strncmp(port->name, name, strlen(port->name)) == 0) &&
-        strlen(name) == strlen(port->name))
-      return port;
-  return NULL;
+  if (c_avl_get(g_port_name_tree, name, (void *)&port) != 0)
+    return NULL;
+  return port;
+}
+
+/* Remove port from the name index, if it is the port indexed by its name */
+static void ovs_stats_unindex_port_name(port_list_t *port) {
+  port_list_t *indexed = NULL;
+
+  if ((strlen(port->name) == 0) ||
+      (c_avl_get(g_port_name_tree, port->name, (void *)&indexed) != 0) ||
+      (indexed != port))
+    return;
+  c_avl_remove(g_port_name_tree, port->name, NULL, NULL);
+}
+
+/* Free port together with its cached device name */
+static void ovs_stats_free_port(port_list_t *port) {
+  sfree(port->devname);
+  sfree(port);
 }
 
 /* Create or get port by port uuid */
@@ -255,13 +278,20 @@ static port_list_t *ovs_stats_new_port(bridge_list_t *bridge,
     memset(port->stats, -1, sizeof(int64_t[IFACE_COUNTER_COUNT]));
     sstrncpy(port->port_uuid, uuid, sizeof(port->port_uuid));
     pthread_mutex_lock(&g_stats_lock);
+    if (c_avl_insert(g_port_uuid_tree, port->port_uuid, port) != 0) {
+      pthread_mutex_unlock(&g_stats_lock);
+      ERROR("%s: Error indexing port %s", plugin_name, uuid);
+      sfree(port);
+      return NULL;
+    }
     port->next = g_port_list_head;
     g_port_list_head = port;
     pthread_mutex_unlock(&g_stats_lock);
   }
-  if (bridge != NULL) {
+  if ((bridge != NULL) && (port->br != bridge)) {
     pthread_mutex_lock(&g_stats_lock);
     port->br = bridge;
+    sfree(port->devname);
     pthread_mutex_unlock(&g_stats_lock);
   }
   return port;
@@ -452,10 +482,15 @@ static int ovs_stats_update_port(const char *uuid, yajl_val port) {
         portentry = ovs_stats_get_port(uuid);
         if (portentry == NULL)
           portentry = ovs_stats_new_port(NULL, uuid);
-        if (portentry) {
+        const char *new_name = YAJL_GET_STRING(port_name);
+        if (portentry && (new_name != NULL) &&
+            (strcmp(portentry->name, new_name) != 0)) {
           pthread_mutex_lock(&g_stats_lock);
-          sstrncpy(portentry->name, YAJL_GET_STRING(port_name),
-                   sizeof(portentry->name));
+          ovs_stats_unindex_port_name(portentry);
+          sstrncpy(portentry->name, new_name, sizeof(portentry->name));
+          if (strlen(portentry->name) > 0)
+            c_avl_insert(g_port_name_tree, portentry->name, portentry);
+          sfree(portentry->devname);
           pthread_mutex_unlock(&g_stats_lock);
         }
       }
@@ -469,18 +504,22 @@ static int ovs_stats_update_port(const char *uuid, yajl_val port) {
 
 /* Delete port from global port list */
 static int ovs_stats_del_port(const char *uuid) {
-  port_list_t *prev_port = g_port_list_head;
-  for (port_list_t *port = g_port_list_head; port != NULL;
-       prev_port = port, port = port->next) {
-    if (strncmp(port->port_uuid, uuid, strlen(port->port_uuid)) == 0) {
-      if (port == g_port_list_head)
-        g_port_list_head = port->next;
-      else
-        prev_port->next = port->next;
-      sfree(port);
-      break;
-    }
-  }
+  port_list_t *port = ovs_stats_get_port(uuid);
+  if (port == NULL)
+    return 0;
+
+  ovs_stats_unindex_port_name(port);
+  c_avl_remove(g_port_uuid_tree, port->port_uuid, NULL, NULL);
+
+  if (port == g_port_list_head)
+    g_port_list_head = port->next;
+  else
+    for (port_list_t *prev = g_port_list_head; prev != NULL; prev = prev->next)
+      if (prev->next == port) {
+        prev->next = port->next;
+        break;
+      }
+  ovs_stats_free_port(port);
   return 0;
 }
 
@@ -759,10 +798,21 @@ static int ovs_stats_is_monitored_bridge(const char *br_name) {
 
 /* Delete all ports from port list */
 static void ovs_stats_free_port_list(port_list_t *head) {
+  void *key;
+  void *value;
+
+  /* The indices only point into the list, so just empty them */
+  if (g_port_uuid_tree != NULL)
+    while (c_avl_pick(g_port_uuid_tree, &key, &value) == 0)
+      ;
+  if (g_port_name_tree != NULL)
+    while (c_avl_pick(g_port_name_tree, &key, &value) == 0)
+      ;
+
   for (port_list_t *i = head; i != NULL;) {
     port_list_t *del = i;
     i = i->next;
-    sfree(del);
+    ovs_stats_free_port(del);
   }
 }
 
@@ -863,6 +913,13 @@ static int ovs_stats_plugin_init(void) {
   ovs_db_callback_t cb = {.post_conn_init = ovs_stats_initialize,
                           .post_conn_terminate = ovs_stats_conn_terminate};
 
+  g_port_uuid_tree = c_avl_create((int (*)(const void *, const void *))strcmp);
+  g_port_name_tree = c_avl_create((int (*)(const void *, const void *))strcmp);
+  if ((g_port_uuid_tree == NULL) || (g_port_name_tree == NULL)) {
+    ERROR("%s: plugin: failed to create port indices", plugin_name);
+    return -1;
+  }
+
   INFO("%s: Connecting to OVS DB using address=%s, service=%s, unix=%s",
        plugin_name, ovs_stats_cfg.ovs_db_node, ovs_stats_cfg.ovs_db_serv,
        ovs_stats_cfg.ovs_db_unix);
@@ -886,7 +943,6 @@ static int ovs_stats_plugin_init(void) {
 static int ovs_stats_plugin_read(__attribute__((unused)) user_data_t *ud) {
   bridge_list_t *bridge;
   port_list_t *port;
-  char devname[PORT_NAME_SIZE_MAX * 2];
 
   pthread_mutex_lock(&g_stats_lock);
   for (bridge = g_bridge_list_head; bridge != NULL; bridge = bridge->next) {
@@ -906,7 +962,18 @@ static int ovs_stats_plugin_read(__attribute__((unused)) user_data_t *ud) {
             if (strlen(port->ex_iface_id))
               meta_data_add_string(meta, "iface-id", port->ex_iface_id);
           }
-          snprintf(devname, sizeof(devname), "%s.%s", bridge->name, port->name);
+          /* The device name only changes with the port's name or bridge */
+          if (port->devname == NULL) {
+            char devname[PORT_NAME_SIZE_MAX * 2];
+            snprintf(devname, sizeof(devname), "%s.%s", bridge->name,
+                     port->name);
+            port->devname = strdup(devname);
+            if (port->devname == NULL) {
+              meta_data_destroy(meta);
+              continue;
+            }
+          }
+          const char *devname = port->devname;
           ovs_stats_submit_one(devname, "if_collisions", NULL,
                                port->stats[collisions], meta);
           ovs_stats_submit_two(devname, "if_dropped", NULL,
@@ -980,6 +1047,8 @@ static int ovs_stats_plugin_shutdown(void) {
   ovs_stats_free_bridge_list(g_bridge_list_head);
   ovs_stats_free_bridge_list(g_monitored_bridge_list_head);
   ovs_stats_free_port_list(g_port_list_head);
+  c_avl_destroy(g_port_uuid_tree);
+  c_avl_destroy(g_port_name_tree);
   pthread_mutex_unlock(&g_stats_lock);
   pthread_mutex_destroy(&g_stats_lock);
   return 0;
@@ -104,6 +104,7 @@ void boot_DynaLoader(PerlInterpreter *, CV *);
 
 static XS(Collectd_plugin_register_read);
 static XS(Collectd_plugin_register_write);
+static XS(Collectd__plugin_register_write_batch);
 static XS(Collectd_plugin_register_log);
 static XS(Collectd_plugin_register_notification);
 static XS(Collectd_plugin_register_flush);
@@ -126,6 +127,8 @@ static XS(Collectd_call_by_name);
 static int perl_read(user_data_t *ud);
 static int perl_write(const data_set_t *ds, const value_list_t *vl,
                       user_data_t *user_data);
+static int perl_write_batch(const write_batch_entry_t *entries,
+                            size_t entries_num, user_data_t *user_data);
 static void perl_log(int level, const char *msg, user_data_t *user_data);
 static int perl_notify(const notification_t *notif, user_data_t *user_data);
 static int perl_flush(cdtime_t timeout, const char *identifier,
@@ -140,6 +143,7 @@ typedef struct c_ithread_s {
   PerlInterpreter *interp;
   _Bool running; /* thread is inside Perl interpreter */
   _Bool shutdown;
+  _Bool pooled; /* pre-cloned and not yet claimed by any thread */
   pthread_t pthread;
 
   /* double linked list of threads */
@@ -156,6 +160,9 @@ typedef struct {
   int number_of_threads;
 #endif /* COLLECT_DEBUG */
 
+  /* number of pre-cloned interpreters not claimed yet */
+  size_t pool_num;
+
   pthread_mutex_t mutex;
   pthread_mutexattr_t mutexattr;
 } c_ithread_list_t;
@@ -197,12 +204,17 @@ static char **perl_argv = NULL;
 
 static char base_name[DATA_MAX_NAME_LEN] = "";
 
+/* number of interpreters to clone in advance; -1 means "WriteThreads" */
+static long interpreter_pool_size = -1;
+
 static struct {
   char name[64];
   XS((*f));
 } api[] = {
     {"Collectd::plugin_register_read", Collectd_plugin_register_read},
     {"Collectd::plugin_register_write", Collectd_plugin_register_write},
+    {"Collectd::_plugin_register_write_batch",
+     Collectd__plugin_register_write_batch},
     {"Collectd::plugin_register_log", Collectd_plugin_register_log},
     {"Collectd::plugin_register_notification",
      Collectd_plugin_register_notification},
@@ -929,6 +941,49 @@ static int pplugin_dispatch_values(pTHX_ HV *values) {
   return ret;
 } /* static int pplugin_dispatch_values (char *, HV *) */
 
+/*
+ * Submit an array of value lists at once.
+ */
+static int pplugin_dispatch_values_batch(pTHX_ AV *array) {
+  value_list_t *vl;
+  size_t vl_num, i;
+
+  int ret = 0;
+
+  if (NULL == array)
+    return -1;
+
+  /* av_len returns the highest index, not the actual length. */
+  vl_num = (size_t)(av_len(array) + 1);
+  if (0 == vl_num)
+    return 0;
+
+  vl = calloc(vl_num, sizeof(*vl));
+  if (NULL == vl)
+    return -1;
+
+  for (i = 0; i < vl_num; ++i) {
+    SV **tmp = av_fetch(array, i, 0);
+
+    if ((NULL == tmp) || !(SvROK(*tmp) && (SVt_PVHV == SvTYPE(SvRV(*tmp)))) ||
+        (0 != hv2value_list(aTHX_(HV *) SvRV(*tmp), vl + i))) {
+      log_err("Collectd::plugin_dispatch_values: "
+              "Invalid value list at index %" PRIsz ".",
+              i);
+      ret = -1;
+      break;
+    }
+  }
+
+  if (0 == ret)
+    ret = plugin_dispatch_values_batch(vl, vl_num);
+
+  for (size_t j = 0; j < i; ++j)
+    sfree(vl[j].values);
+  sfree(vl);
+  return ret;
+} /* static int pplugin_dispatch_values_batch (pTHX_ AV *) */
+
 /*
  * Submit the values to a single write function.
  */
@@ -1173,6 +1228,98 @@ static int pplugin_call(pTHX_ int type, ...) {
   return ret;
 } /* static int pplugin_call (int, ...) */
 
+/*
+ * Call a batch write callback.
+ *
+ * $_[0] =
+ * [
+ *   [ $type, $data_set, $value_list ],
+ *   ...
+ * ];
+ *
+ * $data_set and $value_list are the same as the arguments of write
+ * callbacks. Entries of the same type share the same $data_set.
+ */
+static int pplugin_call_write_batch(pTHX_ char *subname,
+                                    const write_batch_entry_t *entries,
+                                    size_t entries_num) {
+  int retvals = 0;
+  int ret = 0;
+
+  AV *batch;
+  HV *data_sets;
+
+  dSP;
+
+  ENTER;
+  SAVETMPS;
+
+  PUSHMARK(SP);
+
+  batch = newAV();
+  data_sets = (HV *)sv_2mortal((SV *)newHV());
+  av_extend(batch, entries_num - 1);
+
+  for (size_t i = 0; i < entries_num; ++i) {
+    data_set_t *ds = (data_set_t *)entries[i].ds;
+    I32 type_len = (I32)strlen(ds->type);
+
+    AV *entry = newAV();
+    HV *pvl = newHV();
+    SV **pds = hv_fetch(data_sets, ds->type, type_len, 0);
+
+    if (NULL == pds) {
+      AV *av = newAV();
+      SV *ref;
+
+      if (-1 == data_set2av(aTHX_ ds, av)) {
+        av_undef(av);
+        SvREFCNT_dec((SV *)av);
+        ref = newSV(0);
+        ret = -1;
+      } else {
+        ref = newRV_noinc((SV *)av);
+      }
+      pds = hv_store(data_sets, ds->type, type_len, ref, 0);
+    }
+
+    av_push(entry, newSVpv(ds->type, 0));
+    av_push(entry, newSVsv(*pds));
+
+    if (-1 == value_list2hv(aTHX_(value_list_t *) entries[i].vl, ds, pvl)) {
+      hv_undef(pvl);
+      SvREFCNT_dec((SV *)pvl);
+      av_push(entry, newSV(0));
+      ret = -1;
+    } else {
+      av_push(entry, newRV_noinc((SV *)pvl));
+    }
+
+    av_push(batch, newRV_noinc((SV *)entry));
+  }
+
+  XPUSHs(sv_2mortal(newRV_noinc((SV *)batch)));
+  PUTBACK;
+
+  retvals = call_pv_locked(aTHX_ subname);
+
+  SPAGAIN;
+  if (SvTRUE(ERRSV)) {
+    ERROR("perl: %s error: %s", subname, SvPV_nolen(ERRSV));
+    ret = -1;
+  } else if (0 < retvals) {
+    SV *tmp = POPs;
+    if (!SvTRUE(tmp))
+      ret = -1;
+  }
+
+  PUTBACK;
+  FREETMPS;
+  LEAVE;
+
+  return ret;
+} /* static int pplugin_call_write_batch (pTHX_ char *, ...) */
+
 /*
  * collectd's Perl interpreter based thread implementation.
  *
@@ -1241,7 +1388,7 @@ static void c_ithread_destructor(void *arg) {
 } /* static void c_ithread_destructor (void *) */
 
 /* must be called with perl_threads->mutex locked */
-static c_ithread_t *c_ithread_create(PerlInterpreter *base) {
+static c_ithread_t *c_ithread_new(PerlInterpreter *base) {
   c_ithread_t *t = NULL;
   dTHXa(NULL);
 
@@ -1274,15 +1421,54 @@ static c_ithread_t *c_ithread_create(PerlInterpreter *base) {
     t->prev = perl_threads->tail;
   }
 
-  t->pthread = pthread_self();
   t->running = 0;
   t->shutdown = 0;
   perl_threads->tail = t;
+  return t;
+} /* static c_ithread_t *c_ithread_new (PerlInterpreter *) */
+
+/* must be called with perl_threads->mutex locked */
+static c_ithread_t *c_ithread_create(PerlInterpreter *base) {
+  c_ithread_t *t = NULL;
+
+  assert(NULL != perl_threads);
+
+  /* Claim a pre-cloned interpreter if there is one left. */
+  if ((NULL != base) && (0 < perl_threads->pool_num)) {
+    for (t = perl_threads->head; NULL != t; t = t->next)
+      if (t->pooled)
+        break;
+    assert(NULL != t);
+
+    t->pooled = 0;
+    --perl_threads->pool_num;
+    PERL_SET_CONTEXT(t->interp);
+  } else {
+    t = c_ithread_new(base);
+  }
+
+  t->pthread = pthread_self();
 
   pthread_setspecific(perl_thr_key, (const void *)t);
   return t;
 } /* static c_ithread_t *c_ithread_create (PerlInterpreter *) */
 
+/* Clones `num' interpreters from `base' in advance, so that threads calling
+ * into Perl for the first time do not have to clone one themselves.
+ * Must be called with perl_threads->mutex locked. */
+static void c_ithread_pool_fill(PerlInterpreter *base, size_t num) {
+  assert(NULL != perl_threads);
+
+  for (size_t i = 0; i < num; ++i) {
+    c_ithread_t *t = c_ithread_new(base);
+    t->pooled = 1;
+    ++perl_threads->pool_num;
+  }
+
+  /* perl_clone() switched the context to the new interpreter. */
+  PERL_SET_CONTEXT(base);
+} /* static void c_ithread_pool_fill (PerlInterpreter *, size_t) */
+
 /*
  * Filter chains implementation.
  */
@@ -1539,7 +1725,11 @@ static int pmatch_match(const data_set_t *ds, const value_list_t *vl,
 } /* static int pmatch_match (const data_set_t *, const value_list_t *,
                 notification_meta_t **, void **) */
 
-static match_proc_t pmatch = {pmatch_create, pmatch_destroy, pmatch_match};
+/* Perl matches may look at anything, so they are never memoized. */
+static match_proc_t pmatch = {.create = pmatch_create,
+                              .destroy = pmatch_destroy,
+                              .match = pmatch_match,
+                              .value_dependent = fc_match_value_dependent};
 
 static int ptarget_create(const oconfig_item_t *ci, void **user_data) {
   return fc_create(FC_TARGET, ci, user_data);
@@ -1649,6 +1839,54 @@ static XS(Collectd_plugin_register_write) {
   return _plugin_register_generic_userdata(aTHX, PLUGIN_WRITE, "write");
 }
 
+/*
+ * Collectd::_plugin_register_write_batch (pluginname, subname, batch_size,
+ *                                          linger).
+ */
+static XS(Collectd__plugin_register_write_batch) {
+  char *pluginname;
+  IV batch_size;
+  NV linger;
+
+  dXSARGS;
+
+  if (4 != items) {
+    log_err("Usage: Collectd::_plugin_register_write_batch(pluginname, "
+            "subname, batch_size, linger)");
+    XSRETURN_EMPTY;
+  }
+
+  if (!SvOK(ST(0)) || !SvOK(ST(1))) {
+    log_err("Collectd::_plugin_register_write_batch: "
+            "Invalid pluginname or subname");
+    XSRETURN_EMPTY;
+  }
+
+  pluginname = SvPV_nolen(ST(0));
+  batch_size = SvOK(ST(2)) ? SvIV(ST(2)) : 0;
+  linger = SvOK(ST(3)) ? SvNV(ST(3)) : 0.0;
+  if ((1 > batch_size) || (0.0 > linger)) {
+    log_err("Collectd::_plugin_register_write_batch: "
+            "Invalid batch_size or linger");
+    XSRETURN_EMPTY;
+  }
+
+  log_debug("Collectd::_plugin_register_write_batch: "
+            "plugin = \"%s\", sub = \"%s\", batch_size = %" PRIsz,
+            pluginname, SvPV_nolen(ST(1)), (size_t)batch_size);
+
+  if (0 == plugin_register_write_batch(pluginname, perl_write_batch,
+                                       (size_t)batch_size,
+                                       DOUBLE_TO_CDTIME_T(linger),
+                                       &(user_data_t){
+                                           .data = strdup(SvPV_nolen(ST(1))),
+                                           .free_func = free,
+                                       }))
+    XSRETURN_YES;
+  else
+    XSRETURN_EMPTY;
+} /* static XS (Collectd__plugin_register_write_batch) */
+
 static XS(Collectd_plugin_register_log) {
   return _plugin_register_generic_userdata(aTHX, PLUGIN_LOG, "log");
 }
@@ -1792,7 +2030,7 @@ static XS(Collectd_plugin_unregister_ds) {
  *   name of the plugin
  *
  * values:
- *   value list to submit
+ *   value list to submit, or a reference to an array of value lists
  */
 static XS(Collectd_plugin_dispatch_values) {
   SV *values = NULL;
@@ -1814,14 +2052,16 @@ static XS(Collectd_plugin_dispatch_values) {
   if (NULL == values)
     XSRETURN_EMPTY;
 
-  /* Make sure the argument is a hash reference. */
-  if (!(SvROK(values) && (SVt_PVHV == SvTYPE(SvRV(values))))) {
+  /* Make sure the argument is a hash or array reference. */
+  if (SvROK(values) && (SVt_PVAV == SvTYPE(SvRV(values)))) {
+    ret = pplugin_dispatch_values_batch(aTHX_(AV *) SvRV(values));
+  } else if (SvROK(values) && (SVt_PVHV == SvTYPE(SvRV(values)))) {
+    ret = pplugin_dispatch_values(aTHX_(HV *) SvRV(values));
+  } else {
     log_err("Collectd::plugin_dispatch_values: Invalid values.");
     XSRETURN_EMPTY;
   }
 
-  ret = pplugin_dispatch_values(aTHX_(HV *) SvRV(values));
-
   if (0 == ret)
     XSRETURN_YES;
   else
@@ -2097,6 +2337,14 @@ static int perl_init(void) {
 
   status = pplugin_call(aTHX_ PLUGIN_INIT);
 
+  if (0 > interpreter_pool_size)
+    interpreter_pool_size = global_option_get_long("WriteThreads", 5);
+  if (0 < interpreter_pool_size) {
+    log_debug("perl_init: Cloning %li interpreters in advance.",
+              interpreter_pool_size);
+    c_ithread_pool_fill(aTHX, (size_t)interpreter_pool_size);
+  }
+
   pthread_mutex_unlock(&perl_threads->mutex);
 
   return status;
@@ -2163,6 +2411,41 @@ static int perl_write(const data_set_t *ds, const value_list_t *vl,
   return status;
 } /* static int perl_write (const data_set_t *, const value_list_t *) */
 
+static int perl_write_batch(const write_batch_entry_t *entries,
+                            size_t entries_num, user_data_t *user_data) {
+  int status;
+  dTHX;
+
+  if (NULL == perl_threads)
+    return 0;
+
+  if (NULL == aTHX) {
+    c_ithread_t *t = NULL;
+
+    pthread_mutex_lock(&perl_threads->mutex);
+    t = c_ithread_create(perl_threads->head->interp);
+    pthread_mutex_unlock(&perl_threads->mutex);
+
+    aTHX = t->interp;
+  }
+
+  /* Lock the base thread if this is not called from one of the read threads
+   * to avoid race conditions with c_ithread_create(). See
+   * https://github.com/collectd/collectd/issues/9 for details. */
+  if (aTHX == perl_threads->head->interp)
+    pthread_mutex_lock(&perl_threads->mutex);
+
+  log_debug("perl_write_batch: c_ithread: interp = %p (entries: %" PRIsz ")",
+            aTHX, entries_num);
+  status =
+      pplugin_call_write_batch(aTHX_ user_data->data, entries, entries_num);
+
+  if (aTHX == perl_threads->head->interp)
+    pthread_mutex_unlock(&perl_threads->mutex);
+
+  return status;
+} /* static int perl_write_batch (const write_batch_entry_t *, size_t) */
+
 static void perl_log(int level, const char *msg, user_data_t *user_data) {
   dTHX;
 
@@ -2700,6 +2983,16 @@ static int perl_config(oconfig_item_t *ci) {
       current_status = perl_config_plugin(aTHX_ c);
     else if (0 == strcasecmp(c->key, "RegisterLegacyFlush"))
       cf_util_get_boolean(c, &register_legacy_flush);
+    else if (0 == strcasecmp(c->key, "InterpreterPoolSize")) {
+      int tmp = 0;
+      current_status = cf_util_get_int(c, &tmp);
+      if ((0 == current_status) && (0 > tmp)) {
+        log_err("InterpreterPoolSize must not be negative.");
+        current_status = 1;
+      }
+      if (0 == current_status)
+        interpreter_pool_size = (long)tmp;
+    }
     else {
       log_warn("Ignoring unknown config key \"%s\".", c->key);
       current_status = 0;
@@ -23,10 +23,13 @@
  *   Florian Forster <octo at collectd.org>
  **/
 
+#define _GNU_SOURCE /* For recvmmsg(2) */
+
 #include "collectd.h"
 
 #include "common.h"
 #include "plugin.h"
+#include "utils_rcvbuf.h"
 
 #include <netdb.h>
 #include <poll.h>
@@ -57,12 +60,24 @@
 #define PINBA_MAX_SOCKETS 16
 #endif
 
+/* Number of datagrams received with one recvmmsg(2) call. */
+#ifndef PINBA_RECEIVE_BATCH
+#define PINBA_RECEIVE_BATCH 16
+#endif
+
+/* Size of the memory block requests are decoded into. Larger requests are
+ * decoded using malloc(3). */
+#ifndef PINBA_ARENA_SIZE
+#define PINBA_ARENA_SIZE 262144
+#endif
+
 /*
  * Private data structures
  */
 /* {{{ */
 struct pinba_socket_s {
   struct pollfd fd[PINBA_MAX_SOCKETS];
+  rcvbuf_t rcvbuf[PINBA_MAX_SOCKETS];
   nfds_t fd_num;
 };
 typedef struct pinba_socket_s pinba_socket_t;
@@ -93,6 +108,39 @@ struct pinba_statnode_s {
   gauge_t mem_peak;
 };
 typedef struct pinba_statnode_s pinba_statnode_t;
+
+/* Statistics of one view gathered by the collector thread without holding
+ * the lock. They are added to the view once per batch of packets. */
+struct pinba_delta_s {
+  derive_t req_count;
+
+  float_counter_t req_time;
+  float_counter_t ru_utime;
+  float_counter_t ru_stime;
+
+  derive_t doc_size;
+  gauge_t mem_peak;
+};
+typedef struct pinba_delta_s pinba_delta_t;
+
+/* Bump allocator for decoding requests. Everything allocated for a request
+ * is released at once by pinba_arena_reset(). */
+struct pinba_arena_s {
+  char *data;
+  size_t used;
+
+  void **large;
+  size_t large_num;
+};
+typedef struct pinba_arena_s pinba_arena_t;
+
+struct pinba_collector_s {
+  uint8_t *buffers; /* PINBA_RECEIVE_BATCH * PINBA_UDP_BUFFER_SIZE bytes */
+  pinba_delta_t *deltas; /* one per element of stat_nodes */
+  pinba_arena_t arena;
+  ProtobufCAllocator allocator;
+};
+typedef struct pinba_collector_s pinba_collector_t;
 /* }}} */
 
 /*
@@ -105,6 +153,13 @@ static pthread_mutex_t stat_nodes_lock;
 
 static char *conf_node = NULL;
 static char *conf_service = NULL;
+static int conf_receive_buffer = 0;
+static _Bool conf_receive_buffer_auto = 1;
+
+/* Datagrams dropped by the kernel. Only reported if drops can be counted for
+ * at least one socket. */
+static uint64_t collector_drops = 0;
+static _Bool collector_drops_enabled = 0;
 
 static _Bool collector_thread_running = 0;
 static _Bool collector_thread_do_shutdown = 0;
@@ -134,6 +189,18 @@ static void float_counter_add(float_counter_t *fc, float val) /* {{{ */
   }
 } /* }}} void float_counter_add */
 
+static void float_counter_merge(float_counter_t *dst, /* {{{ */
+                                const float_counter_t *src) {
+  dst->i += src->i;
+  dst->n += src->n;
+
+  if (dst->n >= 1000000000) {
+    dst->i += 1;
+    dst->n -= 1000000000;
+    assert(dst->n < 1000000000);
+  }
+} /* }}} void float_counter_merge */
+
 static derive_t float_counter_get(const float_counter_t *fc, /* {{{ */
                                   uint64_t factor) {
   derive_t ret;
@@ -221,26 +288,55 @@ static unsigned int service_statnode_collect(pinba_statnode_t *res, /* {{{ */
   return index + 1;
 } /* }}} unsigned int service_statnode_collect */
 
-static void service_statnode_process(pinba_statnode_t *node, /* {{{ */
+static void service_statnode_process(pinba_delta_t *delta, /* {{{ */
                                      Pinba__Request *request) {
-  node->req_count++;
+  delta->req_count++;
 
-  float_counter_add(&node->req_time, request->request_time);
-  float_counter_add(&node->ru_utime, request->ru_utime);
-  float_counter_add(&node->ru_stime, request->ru_stime);
+  float_counter_add(&delta->req_time, request->request_time);
+  float_counter_add(&delta->ru_utime, request->ru_utime);
+  float_counter_add(&delta->ru_stime, request->ru_stime);
 
-  node->doc_size += request->document_size;
+  delta->doc_size += request->document_size;
 
-  if (isnan(node->mem_peak) ||
-      (node->mem_peak < ((gauge_t)request->memory_peak)))
-    node->mem_peak = (gauge_t)request->memory_peak;
+  if (isnan(delta->mem_peak) ||
+      (delta->mem_peak < ((gauge_t)request->memory_peak)))
+    delta->mem_peak = (gauge_t)request->memory_peak;
 
 } /* }}} void service_statnode_process */
 
-static void service_process_request(Pinba__Request *request) /* {{{ */
+/* Adds the statistics gathered by the collector thread to the views and
+ * resets them. */
+static void service_statnode_merge(pinba_delta_t *deltas) /* {{{ */
 {
   pthread_mutex_lock(&stat_nodes_lock);
 
+  for (unsigned int i = 0; i < stat_nodes_num; i++) {
+    pinba_statnode_t *node = stat_nodes + i;
+    pinba_delta_t *delta = deltas + i;
+
+    if (delta->req_count == 0)
+      continue;
+
+    node->req_count += delta->req_count;
+    float_counter_merge(&node->req_time, &delta->req_time);
+    float_counter_merge(&node->ru_utime, &delta->ru_utime);
+    float_counter_merge(&node->ru_stime, &delta->ru_stime);
+    node->doc_size += delta->doc_size;
+
+    if (isnan(node->mem_peak) || (node->mem_peak < delta->mem_peak))
+      node->mem_peak = delta->mem_peak;
+
+    memset(delta, 0, sizeof(*delta));
+    delta->mem_peak = NAN;
+  }
+
+  pthread_mutex_unlock(&stat_nodes_lock);
+} /* }}} void service_statnode_merge */
+
+/* The views are only changed while reading the config, so the collector
+ * thread may match requests against them without holding the lock. */
+static void service_process_request(pinba_delta_t *deltas, /* {{{ */
+                                    Pinba__Request *request) {
   for (unsigned int i = 0; i < stat_nodes_num; i++) {
     if ((stat_nodes[i].host != NULL) &&
         (strcmp(request->hostname, stat_nodes[i].host) != 0))
@@ -254,10 +350,8 @@ static void service_process_request(Pinba__Request *request) /* {{{ */
         (strcmp(request->script_name, stat_nodes[i].script) != 0))
       continue;
 
-    service_statnode_process(&stat_nodes[i], request);
+    service_statnode_process(deltas + i, request);
   }
-
-  pthread_mutex_unlock(&stat_nodes_lock);
 } /* }}} void service_process_request */
 
 static int pb_del_socket(pinba_socket_t *s, /* {{{ */
@@ -272,6 +366,8 @@ static int pb_del_socket(pinba_socket_t *s, /* {{{ */
   if (index < (s->fd_num - 1)) {
     memmove(&s->fd[index], &s->fd[index + 1],
             sizeof(s->fd[0]) * (s->fd_num - (index + 1)));
+    memmove(&s->rcvbuf[index], &s->rcvbuf[index + 1],
+            sizeof(s->rcvbuf[0]) * (s->fd_num - (index + 1)));
   }
 
   s->fd_num--;
@@ -314,6 +410,9 @@ static int pb_add_socket(pinba_socket_t *s, /* {{{ */
   s->fd[s->fd_num].fd = fd;
   s->fd[s->fd_num].events = POLLIN | POLLPRI;
   s->fd[s->fd_num].revents = 0;
+  if (rcvbuf_init(&s->rcvbuf[s->fd_num], fd, conf_receive_buffer,
+                  conf_receive_buffer_auto, "pinba") == 0)
+    collector_drops_enabled = 1;
   s->fd_num++;
 
   return 0;
@@ -382,71 +481,219 @@ static void pinba_socket_free(pinba_socket_t *socket) /* {{{ */
   sfree(socket);
 } /* }}} void pinba_socket_free */
 
-static int pinba_process_stats_packet(const uint8_t *buffer, /* {{{ */
+static void *pinba_arena_alloc(void *data, size_t size) /* {{{ */
+{
+  pinba_arena_t *arena = data;
+
+  /* Keep allocations aligned for any type. */
+  size = (size + 15) & ~((size_t)15);
+
+  if ((arena->data != NULL) && (size <= PINBA_ARENA_SIZE - arena->used)) {
+    void *ret = arena->data + arena->used;
+    arena->used += size;
+    return ret;
+  }
+
+  void **tmp =
+      realloc(arena->large, sizeof(*arena->large) * (arena->large_num + 1));
+  if (tmp == NULL)
+    return NULL;
+  arena->large = tmp;
+
+  void *ret = malloc(size);
+  if (ret == NULL)
+    return NULL;
+
+  arena->large[arena->large_num] = ret;
+  arena->large_num++;
+  return ret;
+} /* }}} void *pinba_arena_alloc */
+
+static void pinba_arena_free(void *data, void *ptr) /* {{{ */
+{
+  /* Memory is released by pinba_arena_reset(). */
+} /* }}} void pinba_arena_free */
+
+static void pinba_arena_reset(pinba_arena_t *arena) /* {{{ */
+{
+  for (size_t i = 0; i < arena->large_num; i++)
+    sfree(arena->large[i]);
+  sfree(arena->large);
+  arena->large_num = 0;
+
+  arena->used = 0;
+} /* }}} void pinba_arena_reset */
+
+static void pinba_collector_destroy(pinba_collector_t *c) /* {{{ */
+{
+  if (c == NULL)
+    return;
+
+  pinba_arena_reset(&c->arena);
+  sfree(c->arena.data);
+  sfree(c->deltas);
+  sfree(c->buffers);
+  sfree(c);
+} /* }}} void pinba_collector_destroy */
+
+static pinba_collector_t *pinba_collector_create(void) /* {{{ */
+{
+  pinba_collector_t *c = calloc(1, sizeof(*c));
+  if (c == NULL)
+    return NULL;
+
+  c->buffers = malloc(PINBA_RECEIVE_BATCH * PINBA_UDP_BUFFER_SIZE);
+  c->deltas = calloc(stat_nodes_num, sizeof(*c->deltas));
+  c->arena.data = malloc(PINBA_ARENA_SIZE);
+  if ((c->buffers == NULL) || (c->deltas == NULL) || (c->arena.data == NULL)) {
+    pinba_collector_destroy(c);
+    return NULL;
+  }
+
+  for (unsigned int i = 0; i < stat_nodes_num; i++)
+    c->deltas[i].mem_peak = NAN;
+
+  c->allocator.alloc = pinba_arena_alloc;
+  c->allocator.free = pinba_arena_free;
+  c->allocator.allocator_data = &c->arena;
+
+  return c;
+} /* }}} pinba_collector_t *pinba_collector_create */
+
+static int pinba_process_stats_packet(pinba_collector_t *c, /* {{{ */
+                                      const uint8_t *buffer,
                                       size_t buffer_size) {
   Pinba__Request *request;
 
-  request = pinba__request__unpack(NULL, buffer_size, buffer);
+  request = pinba__request__unpack(&c->allocator, buffer_size, buffer);
 
-  if (!request)
-    return -1;
+  if (request != NULL)
+    service_process_request(c->deltas, request);
 
-  service_process_request(request);
-  pinba__request__free_unpacked(request, NULL);
+  /* Releases the request, too. */
+  pinba_arena_reset(&c->arena);
 
-  return 0;
+  return (request != NULL) ? 0 : -1;
 } /* }}} int pinba_process_stats_packet */
 
-static int pinba_udp_read_callback_fn(int sock) /* {{{ */
+/* Adds the datagrams the kernel dropped since "drops" was read from "rb" to
+ * the total and grows the receive buffer if needed. */
+static void pinba_account_drops(rcvbuf_t *rb, uint64_t drops) /* {{{ */
 {
-  uint8_t buffer[PINBA_UDP_BUFFER_SIZE];
-  size_t buffer_size;
+  if (rb->drops == drops)
+    return;
+
+  __atomic_fetch_add(&collector_drops, rb->drops - drops, __ATOMIC_RELAXED);
+  rcvbuf_tune(rb);
+} /* }}} void pinba_account_drops */
+
+/* Receives and processes the datagrams waiting on the socket of "rb". */
+static int pinba_udp_read_callback_fn(pinba_collector_t *c, /* {{{ */
+                                      rcvbuf_t *rb) {
+  int sock = rb->fd;
+  uint64_t drops = rb->drops;
+
+#if HAVE_RECVMMSG
+  struct mmsghdr msgs[PINBA_RECEIVE_BATCH];
+  struct iovec iovs[PINBA_RECEIVE_BATCH];
+  char control[PINBA_RECEIVE_BATCH][RCVBUF_CONTROL_SIZE];
   int status;
 
-  while (42) {
-    buffer_size = sizeof(buffer);
-    status = recvfrom(sock, buffer, buffer_size - 1, MSG_DONTWAIT,
-                      /* from = */ NULL, /* from len = */ 0);
-    if (status < 0) {
+  do {
+    memset(msgs, 0, sizeof(msgs));
+    for (size_t i = 0; i < PINBA_RECEIVE_BATCH; i++) {
+      iovs[i].iov_base = c->buffers + i * PINBA_UDP_BUFFER_SIZE;
+      iovs[i].iov_len = PINBA_UDP_BUFFER_SIZE;
+      msgs[i].msg_hdr.msg_iov = iovs + i;
+      msgs[i].msg_hdr.msg_iovlen = 1;
+      msgs[i].msg_hdr.msg_control = control[i];
+      msgs[i].msg_hdr.msg_controllen = sizeof(control[i]);
+    }
 
+    status = recvmmsg(sock, msgs, PINBA_RECEIVE_BATCH, MSG_DONTWAIT,
+                      /* timeout = */ NULL);
+    if (status < 0) {
+      pinba_account_drops(rb, drops);
       if ((errno == EINTR)
 #ifdef EWOULDBLOCK
           || (errno == EWOULDBLOCK)
 #endif
-          || (errno == EAGAIN)) {
-        continue;
-      }
+          || (errno == EAGAIN))
+        return 0;
 
-      WARNING("pinba plugin: recvfrom(2) failed: %s", STRERRNO);
+      WARNING("pinba plugin: recvmmsg(2) failed: %s", STRERRNO);
       return -1;
-    } else if (status == 0) {
-      DEBUG("pinba plugin: recvfrom(2) returned unexpected status zero.");
-      return -1;
-    } else /* if (status > 0) */
-    {
-      assert(((size_t)status) < buffer_size);
-      buffer_size = (size_t)status;
-      buffer[buffer_size] = 0;
+    }
 
-      status = pinba_process_stats_packet(buffer, buffer_size);
-      if (status != 0)
+    for (int i = 0; i < status; i++) {
+      if (pinba_process_stats_packet(c, c->buffers + i * PINBA_UDP_BUFFER_SIZE,
+                                     (size_t)msgs[i].msg_len) != 0)
         DEBUG("pinba plugin: Parsing packet failed.");
-      return status;
     }
-  } /* while (42) */
 
-  /* not reached */
-  assert(23 == 42);
-  return -1;
-} /* }}} void pinba_udp_read_callback_fn */
+    service_statnode_merge(c->deltas);
+
+    /* The drop counter is cumulative, the last datagram has the latest. */
+    if (status > 0)
+      rcvbuf_update(rb, &msgs[status - 1].msg_hdr);
+    /* A full batch suggests that more datagrams are waiting. */
+  } while (status == PINBA_RECEIVE_BATCH);
+
+  pinba_account_drops(rb, drops);
+  return 0;
+#else
+  char control[RCVBUF_CONTROL_SIZE];
+  struct iovec iov = {.iov_base = c->buffers,
+                      .iov_len = PINBA_UDP_BUFFER_SIZE};
+  struct msghdr msg = {.msg_iov = &iov,
+                       .msg_iovlen = 1,
+                       .msg_control = control,
+                       .msg_controllen = sizeof(control)};
+  ssize_t status;
+
+  status = recvmsg(sock, &msg, MSG_DONTWAIT);
+  if (status < 0) {
+    if ((errno == EINTR)
+#ifdef EWOULDBLOCK
+        || (errno == EWOULDBLOCK)
+#endif
+        || (errno == EAGAIN))
+      return 0;
+
+    WARNING("pinba plugin: recvmsg(2) failed: %s", STRERRNO);
+    return -1;
+  } else if (status == 0) {
+    DEBUG("pinba plugin: recvmsg(2) returned unexpected status zero.");
+    return -1;
+  }
+
+  rcvbuf_update(rb, &msg);
+  pinba_account_drops(rb, drops);
+
+  int ret = pinba_process_stats_packet(c, c->buffers, (size_t)status);
+  if (ret != 0)
+    DEBUG("pinba plugin: Parsing packet failed.");
+
+  service_statnode_merge(c->deltas);
+  return ret;
+#endif
+} /* }}} int pinba_udp_read_callback_fn */
 
 static int receive_loop(void) /* {{{ */
 {
   pinba_socket_t *s;
+  pinba_collector_t *c;
+
+  c = pinba_collector_create();
+  if (c == NULL) {
+    ERROR("pinba plugin: Allocating the receive buffers failed.");
+    return -1;
+  }
 
   s = pinba_socket_open(conf_node, conf_service);
   if (s == NULL) {
     ERROR("pinba plugin: Collector thread is exiting prematurely.");
+    pinba_collector_destroy(c);
     return -1;
   }
 
@@ -466,6 +713,7 @@ static int receive_loop(void) /* {{{ */
 
       ERROR("pinba plugin: poll(2) failed: %s", STRERRNO);
       pinba_socket_free(s);
+      pinba_collector_destroy(c);
       return -1;
     }
 
@@ -474,13 +722,14 @@ static int receive_loop(void) /* {{{ */
         pb_del_socket(s, i);
         i--;
       } else if (s->fd[i].revents & (POLLIN | POLLPRI)) {
-        pinba_udp_read_callback_fn(s->fd[i].fd);
+        pinba_udp_read_callback_fn(c, &s->rcvbuf[i]);
       }
     } /* for (s->fd) */
   }   /* while (!collector_thread_do_shutdown) */
 
   pinba_socket_free(s);
   s = NULL;
+  pinba_collector_destroy(c);
 
   return 0;
 } /* }}} int receive_loop */
@@ -554,6 +803,10 @@ static int plugin_config(oconfig_item_t *ci) /* {{{ */
       cf_util_get_service(child, &conf_service);
     else if (strcasecmp("View", child->key) == 0)
       pinba_config_view(child);
+    else if (strcasecmp("ReceiveBufferSize", child->key) == 0)
+      cf_util_get_int(child, &conf_receive_buffer);
+    else if (strcasecmp("ReceiveBufferAutoTune", child->key) == 0)
+      cf_util_get_boolean(child, &conf_receive_buffer_auto);
     else
       WARNING("pinba plugin: Unknown config option: %s", child->key);
   }
@@ -582,7 +835,7 @@ static int plugin_init(void) /* {{{ */
                                 /* attrs = */ NULL, collector_thread,
                                 /* args = */ NULL, "pinba collector");
   if (status != 0) {
-    ERROR("pinba plugin: pthread_create(3) failed: %s", STRERRNO);
+    ERROR("pinba plugin: plugin_thread_create failed: %s", STRERROR(status));
     return -1;
   }
   collector_thread_running = 1;
@@ -660,6 +913,18 @@ static int plugin_read(void) /* {{{ */
     plugin_submit(&data);
   }
 
+  if (collector_drops_enabled) {
+    value_list_t vl = VALUE_LIST_INIT;
+
+    vl.values = &(value_t){
+        .derive = (derive_t)__atomic_load_n(&collector_drops,
+                                            __ATOMIC_RELAXED)};
+    vl.values_len = 1;
+    sstrncpy(vl.plugin, "pinba", sizeof(vl.plugin));
+    sstrncpy(vl.type, "if_rx_dropped", sizeof(vl.type));
+    plugin_dispatch_values(&vl);
+  }
+
   return 0;
 } /* }}} int plugin_read */
 
@@ -24,6 +24,8 @@
  *   Florian octo Forster <octo at collectd.org>
  **/
 
+#define _GNU_SOURCE /* For recvmmsg(2) and sendmmsg(2) */
+
 #include "collectd.h"
 
 #include "common.h"
@@ -41,6 +43,15 @@
 
 #include <oping.h>
 
+#if KERNEL_LINUX && HAVE_RECVMMSG && HAVE_SENDMMSG
+#define PING_HAVE_INTERNAL 1
+#include <netinet/icmp6.h>
+#include <netinet/ip_icmp.h>
+#include <poll.h>
+#else
+#define PING_HAVE_INTERNAL 0
+#endif
+
 #ifndef NI_MAXHOST
 #define NI_MAXHOST 1025
 #endif
@@ -62,6 +73,11 @@ struct hostlist_s {
   double latency_total;
   double latency_squared;
 
+  /* Jitter is the mean difference between consecutive round trip times. */
+  double latency_last;
+  double jitter_total;
+  uint32_t jitter_num;
+
   struct hostlist_s *next;
 };
 typedef struct hostlist_s hostlist_t;
@@ -80,6 +96,7 @@ static int ping_ttl = PING_DEF_TTL;
 static double ping_interval = 1.0;
 static double ping_timeout = 0.9;
 static int ping_max_missed = -1;
+static _Bool ping_engine_internal = 0;
 
 static pthread_mutex_t ping_lock = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t ping_cond = PTHREAD_COND_INITIALIZER;
@@ -92,7 +109,7 @@ static const char *config_keys[] = {"Host",    "SourceAddress",
                                     "Device",
 #endif
                                     "Size",    "TTL",           "Interval",
-                                    "Timeout", "MaxMissed"};
+                                    "Timeout", "MaxMissed",     "Engine"};
 static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 
 /*
@@ -140,6 +157,46 @@ static void time_calc(struct timespec *ts_dest, /* {{{ */
   time_normalize(ts_dest);
 } /* }}} void time_calc */
 
+/* Account for one echo request to `hl'. A negative `latency' means that no
+ * reply has been received. Must be called with `ping_lock' held. Returns true
+ * if the host should be resolved again. */
+static _Bool ping_host_record(hostlist_t *hl, double latency) /* {{{ */
+{
+  hl->pkg_sent++;
+  if (latency >= 0.0) {
+    hl->pkg_recv++;
+    hl->latency_total += latency;
+    hl->latency_squared += (latency * latency);
+
+    if (hl->latency_last >= 0.0) {
+      hl->jitter_total += fabs(latency - hl->latency_last);
+      hl->jitter_num++;
+    }
+    hl->latency_last = latency;
+
+    /* reset missed packages counter */
+    hl->pkg_missed = 0;
+  } else {
+    hl->latency_last = -1.0;
+    hl->pkg_missed++;
+  }
+
+  /* if the host did not answer our last N packages, trigger a resolv. */
+  if ((ping_max_missed < 0) ||
+      (hl->pkg_missed < ((uint32_t)ping_max_missed)))
+    return 0;
+
+  /* we reset the missed package counter here, since we only want to
+   * trigger a resolv every N packages and not every package _AFTER_ N
+   * missed packages */
+  hl->pkg_missed = 0;
+
+  WARNING("ping plugin: host %s has not answered %d PING requests,"
+          " triggering resolve",
+          hl->host, ping_max_missed);
+  return 1;
+} /* }}} _Bool ping_host_record */
+
 static int ping_dispatch_all(pingobj_t *pingobj) /* {{{ */
 {
   hostlist_t *hl;
@@ -183,29 +240,7 @@ static int ping_dispatch_all(pingobj_t *pingobj) /* {{{ */
       continue;
     }
 
-    hl->pkg_sent++;
-    if (latency >= 0.0) {
-      hl->pkg_recv++;
-      hl->latency_total += latency;
-      hl->latency_squared += (latency * latency);
-
-      /* reset missed packages counter */
-      hl->pkg_missed = 0;
-    } else
-      hl->pkg_missed++;
-
-    /* if the host did not answer our last N packages, trigger a resolv. */
-    if ((ping_max_missed >= 0) &&
-        (hl->pkg_missed >= ((uint32_t)ping_max_missed))) { /* {{{ */
-      /* we reset the missed package counter here, since we only want to
-       * trigger a resolv every N packages and not every package _AFTER_ N
-       * missed packages */
-      hl->pkg_missed = 0;
-
-      WARNING("ping plugin: host %s has not answered %d PING requests,"
-              " triggering resolve",
-              hl->host, ping_max_missed);
-
+    if (ping_host_record(hl, latency)) { /* {{{ */
       /* we trigger the resolv simply be removeing and adding the host to our
        * ping object */
       status = ping_host_remove(pingobj, hl->host);
@@ -339,6 +374,653 @@ static void *ping_thread(void *arg) /* {{{ */
   return (void *)0;
 } /* }}} void *ping_thread */
 
+#if PING_HAVE_INTERNAL
+/*
+ * Internal ICMP engine
+ *
+ * All hosts share one socket per address family. Echo requests are spread
+ * evenly over the interval and sent in batches; replies are received in
+ * batches, too. The index of the host is stored in the payload of each
+ * request, so a reply is matched to its host without a lookup.
+ */
+#define PING_BATCH 64
+#define PING_RCVBUF (4 * 1024 * 1024)
+/* Upper bound for one wait, so that a stop request is noticed. */
+#define PING_POLL_MAX_MS 100
+
+struct ping_target_s {
+  hostlist_t *hl;
+  struct sockaddr_storage addr;
+  socklen_t addrlen;
+  uint16_t seq;
+  _Bool outstanding;
+  cdtime_t sent_time;
+};
+typedef struct ping_target_s ping_target_t;
+
+struct ping_engine_s {
+  ping_target_t *targets;
+  size_t targets_num;
+
+  int fd4;
+  _Bool raw4;
+  int fd6;
+  _Bool raw6;
+  uint16_t ident;
+
+  /* Payload appended to the host index in every echo request. */
+  char *data;
+  size_t data_len;
+  size_t packet_len;
+
+  /* Hosts are sent to in index order. Those between `expire_index' and
+   * `send_index' (`in_flight' many) may still have a reply pending. */
+  size_t send_index;
+  size_t expire_index;
+  size_t in_flight;
+  cdtime_t cycle_start;
+};
+typedef struct ping_engine_s ping_engine_t;
+
+/* Resolve the host name of `t' and store its first address. */
+static int ping_target_resolve(ping_target_t *t) /* {{{ */
+{
+  struct addrinfo *ai_list;
+  struct addrinfo ai_hints = {
+      .ai_family = AF_UNSPEC, .ai_socktype = SOCK_RAW,
+  };
+
+  t->addrlen = 0;
+  t->outstanding = 0;
+
+  int status = getaddrinfo(t->hl->host, /* service = */ NULL, &ai_hints,
+                           &ai_list);
+  if (status != 0) {
+    WARNING("ping plugin: Resolving \"%s\" failed: %s", t->hl->host,
+            gai_strerror(status));
+    return -1;
+  }
+
+  for (struct addrinfo *ai = ai_list; ai != NULL; ai = ai->ai_next) {
+    if ((ai->ai_family != AF_INET) && (ai->ai_family != AF_INET6))
+      continue;
+    if (ai->ai_addrlen > sizeof(t->addr))
+      continue;
+
+    memcpy(&t->addr, ai->ai_addr, ai->ai_addrlen);
+    t->addrlen = (socklen_t)ai->ai_addrlen;
+    break;
+  }
+
+  freeaddrinfo(ai_list);
+
+  if (t->addrlen == 0) {
+    WARNING("ping plugin: \"%s\" has no IPv4 or IPv6 address.", t->hl->host);
+    return -1;
+  }
+  return 0;
+} /* }}} int ping_target_resolve */
+
+/* Open an ICMP socket for `family'. Unprivileged ICMP sockets are preferred;
+ * raw sockets, which require CAP_NET_RAW, are used if they are not
+ * permitted. */
+static int ping_socket_open(int family, _Bool *ret_raw) /* {{{ */
+{
+  int proto = (family == AF_INET) ? IPPROTO_ICMP : IPPROTO_ICMPV6;
+  _Bool raw = 0;
+
+  int fd = socket(family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, proto);
+  if (fd < 0) {
+    raw = 1;
+    fd = socket(family, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, proto);
+  }
+  if (fd < 0) {
+    ERROR("ping plugin: Opening an ICMP%s socket failed: %s",
+          (family == AF_INET) ? "" : "v6", STRERRNO);
+    return -1;
+  }
+
+  int rcvbuf = PING_RCVBUF;
+  if (setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf)) != 0)
+    WARNING("ping plugin: setsockopt (SO_RCVBUF) failed: %s", STRERRNO);
+
+#ifdef SO_TIMESTAMPNS
+  /* Let the kernel timestamp replies when they arrive. */
+  int one = 1;
+  if (setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &one, sizeof(one)) != 0)
+    WARNING("ping plugin: setsockopt (SO_TIMESTAMPNS) failed: %s", STRERRNO);
+#endif
+
+  int status;
+  if (family == AF_INET)
+    status = setsockopt(fd, IPPROTO_IP, IP_TTL, &ping_ttl, sizeof(ping_ttl));
+  else
+    status = setsockopt(fd, IPPROTO_IPV6, IPV6_UNICAST_HOPS, &ping_ttl,
+                        sizeof(ping_ttl));
+  if (status != 0)
+    WARNING("ping plugin: Setting the TTL failed: %s", STRERRNO);
+
+  if ((family == AF_INET6) && raw) {
+    struct icmp6_filter filter;
+
+    ICMP6_FILTER_SETBLOCKALL(&filter);
+    ICMP6_FILTER_SETPASS(ICMP6_ECHO_REPLY, &filter);
+    if (setsockopt(fd, IPPROTO_ICMPV6, ICMP6_FILTER, &filter,
+                   sizeof(filter)) != 0)
+      WARNING("ping plugin: setsockopt (ICMP6_FILTER) failed: %s",
+              STRERRNO);
+  }
+
+#ifdef HAVE_OPING_1_3
+  if (ping_device != NULL) {
+    if (setsockopt(fd, SOL_SOCKET, SO_BINDTODEVICE, ping_device,
+                   (socklen_t)(strlen(ping_device) + 1)) != 0)
+      ERROR("ping plugin: Failed to set device: %s", STRERRNO);
+  }
+#endif
+
+  if (ping_source != NULL) {
+    struct addrinfo *ai_list;
+    struct addrinfo ai_hints = {
+        .ai_family = family, .ai_flags = AI_PASSIVE,
+    };
+
+    status = getaddrinfo(ping_source, /* service = */ NULL, &ai_hints,
+                         &ai_list);
+    if (status == 0) {
+      if (bind(fd, ai_list->ai_addr, ai_list->ai_addrlen) != 0)
+        ERROR("ping plugin: Failed to set source address: %s", STRERRNO);
+      freeaddrinfo(ai_list);
+    }
+  }
+
+  *ret_raw = raw;
+  return fd;
+} /* }}} int ping_socket_open */
+
+static uint16_t ping_checksum(const uint8_t *buf, size_t len) /* {{{ */
+{
+  uint32_t sum = 0;
+
+  for (size_t i = 0; i + 1 < len; i += 2)
+    sum += (uint32_t)((buf[i] << 8) | buf[i + 1]);
+  if (len % 2)
+    sum += (uint32_t)(buf[len - 1] << 8);
+
+  while (sum >> 16)
+    sum = (sum & 0xffff) + (sum >> 16);
+
+  return htons((uint16_t)~sum);
+} /* }}} uint16_t ping_checksum */
+
+/* Fill `buf' with an echo request for target number `idx'. */
+static void ping_packet_build(ping_engine_t *e, size_t idx, /* {{{ */
+                              uint8_t *buf) {
+  ping_target_t *t = e->targets + idx;
+  int family = t->addr.ss_family;
+  uint32_t idx_n = htonl((uint32_t)idx);
+  uint16_t tmp;
+
+  memset(buf, 0, 8);
+  buf[0] = (family == AF_INET) ? ICMP_ECHO : ICMP6_ECHO_REQUEST;
+  tmp = htons(e->ident);
+  memcpy(buf + 4, &tmp, sizeof(tmp));
+  tmp = htons(t->seq);
+  memcpy(buf + 6, &tmp, sizeof(tmp));
+  memcpy(buf + 8, &idx_n, sizeof(idx_n));
+  if (e->data_len > 0)
+    memcpy(buf + 8 + sizeof(idx_n), e->data, e->data_len);
+
+  /* The kernel computes the ICMPv6 checksum. */
+  if (family == AF_INET) {
+    tmp = ping_checksum(buf, e->packet_len);
+    memcpy(buf + 2, &tmp, sizeof(tmp));
+  }
+} /* }}} void ping_packet_build */
+
+static int ping_sendmmsg(int fd, struct mmsghdr *msgs, /* {{{ */
+                         size_t msgs_num) {
+  size_t sent = 0;
+
+  while (sent < msgs_num) {
+    int status = sendmmsg(fd, msgs + sent, (unsigned int)(msgs_num - sent),
+                          /* flags = */ 0);
+    if (status < 0) {
+      if (errno == EINTR)
+        continue;
+      /* Skip the message the kernel refused, e.g. because the host is
+       * unreachable, and go on with the rest. */
+      DEBUG("ping plugin: Sending an echo request failed: %s", STRERRNO);
+      sent++;
+      continue;
+    }
+    sent += (size_t)status;
+  }
+
+  return 0;
+} /* }}} int ping_sendmmsg */
+
+/* Send echo requests to all hosts whose turn has come by `now'. */
+static void ping_engine_send(ping_engine_t *e, cdtime_t now, /* {{{ */
+                             cdtime_t interval, uint8_t *buffers) {
+  struct mmsghdr msgs4[PING_BATCH];
+  struct mmsghdr msgs6[PING_BATCH];
+  struct iovec iovs[PING_BATCH];
+
+  while (e->send_index < e->targets_num) {
+    size_t msgs4_num = 0;
+    size_t msgs6_num = 0;
+    size_t batch_num = 0;
+
+    cdtime_t send_time = cdtime();
+
+    while ((batch_num < PING_BATCH) && (e->send_index < e->targets_num)) {
+      /* Wait for the previous request to this host to time out. */
+      if (e->in_flight >= e->targets_num)
+        break;
+
+      cdtime_t slot = e->cycle_start +
+                      (interval * e->send_index) / e->targets_num;
+      if (slot > now)
+        break;
+
+      ping_target_t *t = e->targets + e->send_index;
+      if (t->addrlen == 0) {
+        /* Not resolved, see ping_engine_expire(). */
+        t->outstanding = 1;
+      } else {
+        uint8_t *buf = buffers + batch_num * e->packet_len;
+        struct mmsghdr *m;
+
+        t->seq++;
+        ping_packet_build(e, e->send_index, buf);
+
+        if (t->addr.ss_family == AF_INET)
+          m = msgs4 + msgs4_num++;
+        else
+          m = msgs6 + msgs6_num++;
+
+        iovs[batch_num] = (struct iovec){
+            .iov_base = buf, .iov_len = e->packet_len,
+        };
+        memset(m, 0, sizeof(*m));
+        m->msg_hdr.msg_name = &t->addr;
+        m->msg_hdr.msg_namelen = t->addrlen;
+        m->msg_hdr.msg_iov = iovs + batch_num;
+        m->msg_hdr.msg_iovlen = 1;
+
+        t->outstanding = 1;
+        batch_num++;
+      }
+      t->sent_time = send_time;
+
+      e->send_index++;
+      e->in_flight++;
+    }
+
+    if ((msgs4_num > 0) && (e->fd4 >= 0))
+      ping_sendmmsg(e->fd4, msgs4, msgs4_num);
+    if ((msgs6_num > 0) && (e->fd6 >= 0))
+      ping_sendmmsg(e->fd6, msgs6, msgs6_num);
+
+    if (batch_num < PING_BATCH)
+      break;
+  }
+
+  if (e->send_index >= e->targets_num) {
+    e->send_index = 0;
+    e->cycle_start += interval;
+    /* Don't try to catch up after a stall; start the next cycle now. */
+    if (e->cycle_start + interval < now)
+      e->cycle_start = now;
+  }
+} /* }}} void ping_engine_send */
+
+/* Account for hosts whose timeout has passed without a reply. */
+static void ping_engine_expire(ping_engine_t *e, cdtime_t now, /* {{{ */
+                               cdtime_t timeout) {
+  pthread_mutex_lock(&ping_lock);
+  while (e->in_flight > 0) {
+    ping_target_t *t = e->targets + e->expire_index;
+
+    if (t->sent_time + timeout > now)
+      break;
+
+    if (t->outstanding) {
+      t->outstanding = 0;
+
+      _Bool resolve;
+      if (t->addrlen == 0) {
+        /* Hosts that could not be resolved are neither sent nor lost. */
+        t->hl->pkg_missed++;
+        resolve = (ping_max_missed >= 0) &&
+                  (t->hl->pkg_missed >= ((uint32_t)ping_max_missed));
+        if (resolve)
+          t->hl->pkg_missed = 0;
+      } else {
+        resolve = ping_host_record(t->hl, -1.0);
+      }
+
+      if (resolve) {
+        pthread_mutex_unlock(&ping_lock);
+        ping_target_resolve(t);
+        pthread_mutex_lock(&ping_lock);
+      }
+    }
+
+    e->expire_index = (e->expire_index + 1) % e->targets_num;
+    e->in_flight--;
+  }
+  pthread_mutex_unlock(&ping_lock);
+} /* }}} void ping_engine_expire */
+
+static _Bool ping_addr_equal(const struct sockaddr_storage *a, /* {{{ */
+                             const struct sockaddr_storage *b) {
+  if (a->ss_family != b->ss_family)
+    return 0;
+
+  if (a->ss_family == AF_INET)
+    return ((const struct sockaddr_in *)a)->sin_addr.s_addr ==
+           ((const struct sockaddr_in *)b)->sin_addr.s_addr;
+
+  return memcmp(&((const struct sockaddr_in6 *)a)->sin6_addr,
+                &((const struct sockaddr_in6 *)b)->sin6_addr,
+                sizeof(struct in6_addr)) == 0;
+} /* }}} _Bool ping_addr_equal */
+
+/* Match one received packet to its host. Must be called with `ping_lock'
+ * held. */
+static void ping_engine_handle_reply(ping_engine_t *e, int family, /* {{{ */
+                                     _Bool raw, const uint8_t *buf,
+                                     size_t len,
+                                     const struct sockaddr_storage *from,
+                                     cdtime_t recv_time) {
+  /* Raw IPv4 sockets return the IP header, too. */
+  if ((family == AF_INET) && raw) {
+    if (len < 1)
+      return;
+    size_t hdr_len = (size_t)(buf[0] & 0x0f) * 4;
+    if (len < hdr_len)
+      return;
+    buf += hdr_len;
+    len -= hdr_len;
+  }
+
+  if (len < 8 + sizeof(uint32_t))
+    return;
+
+  if (buf[0] != ((family == AF_INET) ? ICMP_ECHOREPLY : ICMP6_ECHO_REPLY))
+    return;
+
+  uint16_t ident;
+  uint16_t seq;
+  uint32_t idx;
+  memcpy(&ident, buf + 4, sizeof(ident));
+  memcpy(&seq, buf + 6, sizeof(seq));
+  memcpy(&idx, buf + 8, sizeof(idx));
+  idx = ntohl(idx);
+
+  /* The kernel replaces the identifier of unprivileged ICMP sockets and
+   * only passes matching replies. */
+  if (raw && (ntohs(ident) != e->ident))
+    return;
+
+  if (idx >= e->targets_num)
+    return;
+
+  ping_target_t *t = e->targets + idx;
+  if (!t->outstanding || (ntohs(seq) != t->seq) || (t->addrlen == 0) ||
+      !ping_addr_equal(&t->addr, from))
+    return;
+
+  t->outstanding = 0;
+
+  double latency = 0.0;
+  if (recv_time > t->sent_time)
+    latency = 1000.0 * CDTIME_T_TO_DOUBLE(recv_time - t->sent_time);
+
+  if (ping_host_record(t->hl, latency))
+    WARNING("ping plugin: Not resolving \"%s\" again, because it just "
+            "replied.",
+            t->hl->host);
+} /* }}} void ping_engine_handle_reply */
+
+/* Read all pending replies from `fd'. */
+static void ping_engine_receive(ping_engine_t *e, int fd, /* {{{ */
+                                int family, _Bool raw, uint8_t *buffers,
+                                size_t buffer_size) {
+  struct mmsghdr msgs[PING_BATCH];
+  struct iovec iovs[PING_BATCH];
+  struct sockaddr_storage addrs[PING_BATCH];
+#ifdef SO_TIMESTAMPNS
+  char control[PING_BATCH][CMSG_SPACE(sizeof(struct timespec))];
+#endif
+
+  while (42) {
+    memset(msgs, 0, sizeof(msgs));
+    for (size_t i = 0; i < PING_BATCH; i++) {
+      iovs[i].iov_base = buffers + i * buffer_size;
+      iovs[i].iov_len = buffer_size;
+      msgs[i].msg_hdr.msg_iov = iovs + i;
+      msgs[i].msg_hdr.msg_iovlen = 1;
+      msgs[i].msg_hdr.msg_name = addrs + i;
+      msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+#ifdef SO_TIMESTAMPNS
+      msgs[i].msg_hdr.msg_control = control[i];
+      msgs[i].msg_hdr.msg_controllen = sizeof(control[i]);
+#endif
+    }
+
+    int status = recvmmsg(fd, msgs, PING_BATCH, MSG_DONTWAIT,
+                          /* timeout = */ NULL);
+    if (status < 0) {
+      if (errno == EINTR)
+        continue;
+      if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+        WARNING("ping plugin: Receiving replies failed: %s", STRERRNO);
+      return;
+    }
+
+    cdtime_t now = cdtime();
+
+    pthread_mutex_lock(&ping_lock);
+    for (int i = 0; i < status; i++) {
+      cdtime_t recv_time = now;
+
+#ifdef SO_TIMESTAMPNS
+      for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msgs[i].msg_hdr);
+           cmsg != NULL; cmsg = CMSG_NXTHDR(&msgs[i].msg_hdr, cmsg)) {
+        if ((cmsg->cmsg_level == SOL_SOCKET) &&
+            (cmsg->cmsg_type == SCM_TIMESTAMPNS)) {
+          struct timespec ts;
+          memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+          recv_time = TIMESPEC_TO_CDTIME_T(&ts);
+        }
+      }
+#endif
+
+      ping_engine_handle_reply(e, family, raw, iovs[i].iov_base,
+                               (size_t)msgs[i].msg_len, addrs + i, recv_time);
+    }
+    pthread_mutex_unlock(&ping_lock);
+
+    if (status < PING_BATCH)
+      return;
+  }
+} /* }}} void ping_engine_receive */
+
+static void ping_engine_destroy(ping_engine_t *e) /* {{{ */
+{
+  if (e == NULL)
+    return;
+
+  if (e->fd4 >= 0)
+    close(e->fd4);
+  if (e->fd6 >= 0)
+    close(e->fd6);
+  sfree(e->targets);
+  sfree(e->data);
+  sfree(e);
+} /* }}} void ping_engine_destroy */
+
+static ping_engine_t *ping_engine_create(void) /* {{{ */
+{
+  ping_engine_t *e = calloc(1, sizeof(*e));
+  if (e == NULL) {
+    ERROR("ping plugin: calloc failed.");
+    return NULL;
+  }
+  e->fd4 = -1;
+  e->fd6 = -1;
+  e->ident = (uint16_t)(getpid() & 0xffff);
+
+  /* The host index takes the place of the first bytes of the payload. Without
+   * a configured size, the packets are as large as those of liboping. */
+  size_t size = (ping_data != NULL) ? strlen(ping_data) : 56;
+  e->data_len = (size > sizeof(uint32_t)) ? size - sizeof(uint32_t) : 0;
+  e->packet_len = 8 + sizeof(uint32_t) + e->data_len;
+
+  e->data = malloc(e->data_len + 1);
+  if (e->data == NULL) {
+    ERROR("ping plugin: malloc failed.");
+    ping_engine_destroy(e);
+    return NULL;
+  }
+  for (size_t i = 0; i < e->data_len; i++)
+    e->data[i] = (ping_data != NULL) ? ping_data[i] : ('0' + i % 64);
+  e->data[e->data_len] = 0;
+
+  for (hostlist_t *hl = hostlist_head; hl != NULL; hl = hl->next)
+    e->targets_num++;
+
+  e->targets = calloc(e->targets_num, sizeof(*e->targets));
+  if (e->targets == NULL) {
+    ERROR("ping plugin: calloc failed.");
+    ping_engine_destroy(e);
+    return NULL;
+  }
+
+  _Bool need4 = 0;
+  _Bool need6 = 0;
+  size_t i = 0;
+  for (hostlist_t *hl = hostlist_head; hl != NULL; hl = hl->next, i++) {
+    e->targets[i].hl = hl;
+    if (ping_target_resolve(e->targets + i) != 0)
+      continue;
+    if (e->targets[i].addr.ss_family == AF_INET)
+      need4 = 1;
+    else
+      need6 = 1;
+  }
+
+  if (need4)
+    e->fd4 = ping_socket_open(AF_INET, &e->raw4);
+  if (need6)
+    e->fd6 = ping_socket_open(AF_INET6, &e->raw6);
+
+  if ((e->fd4 < 0) && (e->fd6 < 0)) {
+    ERROR("ping plugin: No host could be added to ping object. Giving up.");
+    ping_engine_destroy(e);
+    return NULL;
+  }
+
+  return e;
+} /* }}} ping_engine_t *ping_engine_create */
+
+static void *ping_thread_internal(void *arg) /* {{{ */
+{
+  ping_engine_t *e = ping_engine_create();
+  if (e == NULL) {
+    pthread_mutex_lock(&ping_lock);
+    ping_thread_error = 1;
+    pthread_mutex_unlock(&ping_lock);
+    return (void *)-1;
+  }
+
+  cdtime_t interval = DOUBLE_TO_CDTIME_T(ping_interval);
+  cdtime_t timeout = DOUBLE_TO_CDTIME_T(ping_timeout);
+
+  /* Large enough for an IPv4 header with options in front of the reply. */
+  size_t recv_size = e->packet_len + 60;
+  uint8_t *send_buffers = calloc(PING_BATCH, e->packet_len);
+  uint8_t *recv_buffers = calloc(PING_BATCH, recv_size);
+  if ((send_buffers == NULL) || (recv_buffers == NULL)) {
+    ERROR("ping plugin: calloc failed.");
+    sfree(send_buffers);
+    sfree(recv_buffers);
+    ping_engine_destroy(e);
+    pthread_mutex_lock(&ping_lock);
+    ping_thread_error = 1;
+    pthread_mutex_unlock(&ping_lock);
+    return (void *)-1;
+  }
+
+  struct pollfd fds[2];
+  nfds_t fds_num = 0;
+  if (e->fd4 >= 0)
+    fds[fds_num++] = (struct pollfd){.fd = e->fd4, .events = POLLIN};
+  if (e->fd6 >= 0)
+    fds[fds_num++] = (struct pollfd){.fd = e->fd6, .events = POLLIN};
+
+  e->cycle_start = cdtime();
+
+  pthread_mutex_lock(&ping_lock);
+  while (ping_thread_loop > 0) {
+    pthread_mutex_unlock(&ping_lock);
+
+    cdtime_t now = cdtime();
+    ping_engine_expire(e, now, timeout);
+    ping_engine_send(e, now, interval, send_buffers);
+
+    /* Sleep until the next host is due or a reply arrives. */
+    cdtime_t next = e->cycle_start +
+                    (interval * e->send_index) / e->targets_num;
+    if (e->in_flight > 0) {
+      cdtime_t expire = e->targets[e->expire_index].sent_time + timeout;
+      if (expire < next)
+        next = expire;
+    }
+
+    int wait_ms = 0;
+    now = cdtime();
+    if (next > now)
+      wait_ms = (int)CDTIME_T_TO_MS(next - now) + 1;
+    if (wait_ms > PING_POLL_MAX_MS)
+      wait_ms = PING_POLL_MAX_MS;
+
+    int status = poll(fds, fds_num, wait_ms);
+    if (status < 0) {
+      if (errno != EINTR) {
+        ERROR("ping plugin: poll(2) failed: %s", STRERRNO);
+        pthread_mutex_lock(&ping_lock);
+        ping_thread_error = 1;
+        break;
+      }
+    } else if (status > 0) {
+      for (nfds_t i = 0; i < fds_num; i++) {
+        if ((fds[i].revents & POLLIN) == 0)
+          continue;
+        if (fds[i].fd == e->fd4)
+          ping_engine_receive(e, e->fd4, AF_INET, e->raw4, recv_buffers,
+                              recv_size);
+        else
+          ping_engine_receive(e, e->fd6, AF_INET6, e->raw6, recv_buffers,
+                              recv_size);
+      }
+    }
+
+    pthread_mutex_lock(&ping_lock);
+  } /* while (ping_thread_loop > 0) */
+  pthread_mutex_unlock(&ping_lock);
+
+  sfree(send_buffers);
+  sfree(recv_buffers);
+  ping_engine_destroy(e);
+
+  return (void *)0;
+} /* }}} void *ping_thread_internal */
+#endif /* PING_HAVE_INTERNAL */
+
 static int start_thread(void) /* {{{ */
 {
   int status;
@@ -350,9 +1032,15 @@ static int start_thread(void) /* {{{ */
     return 0;
   }
 
+  void *(*thread_func)(void *) = ping_thread;
+#if PING_HAVE_INTERNAL
+  if (ping_engine_internal)
+    thread_func = ping_thread_internal;
+#endif
+
   ping_thread_loop = 1;
   ping_thread_error = 0;
-  status = plugin_thread_create(&ping_thread_id, /* attr = */ NULL, ping_thread,
+  status = plugin_thread_create(&ping_thread_id, /* attr = */ NULL, thread_func,
                                 /* arg = */ (void *)0, "ping");
   if (status != 0) {
     ping_thread_loop = 0;
@@ -409,7 +1097,9 @@ static int ping_init(void) /* {{{ */
   }
 
 #if defined(HAVE_SYS_CAPABILITY_H) && defined(CAP_NET_RAW)
-  if (check_capability(CAP_NET_RAW) != 0) {
+  /* The internal engine does not need CAP_NET_RAW if unprivileged ICMP
+   * sockets are permitted by "net.ipv4.ping_group_range". */
+  if (!ping_engine_internal && (check_capability(CAP_NET_RAW) != 0)) {
     if (getuid() == 0)
       WARNING("ping plugin: Running collectd as root, but the CAP_NET_RAW "
               "capability is missing. The plugin's read function will probably "
@@ -466,6 +1156,9 @@ static int ping_config(const char *key, const char *value) /* {{{ */
     hl->pkg_missed = 0;
     hl->latency_total = 0.0;
     hl->latency_squared = 0.0;
+    hl->latency_last = -1.0;
+    hl->jitter_total = 0.0;
+    hl->jitter_num = 0;
     hl->next = hostlist_head;
     hostlist_head = hl;
   } else if (strcasecmp(key, "SourceAddress") == 0) {
@@ -534,6 +1227,18 @@ static int ping_config(const char *key, const char *value) /* {{{ */
     ping_max_missed = atoi(value);
     if (ping_max_missed < 0)
       INFO("ping plugin: MaxMissed < 0, disabled re-resolving of hosts");
+  } else if (strcasecmp(key, "Engine") == 0) {
+    if (strcasecmp(value, "liboping") == 0)
+      ping_engine_internal = 0;
+    else if (strcasecmp(value, "internal") == 0) {
+#if PING_HAVE_INTERNAL
+      ping_engine_internal = 1;
+#else
+      WARNING("ping plugin: The internal engine is not available on this "
+              "system. Falling back to liboping.");
+#endif
+    } else
+      WARNING("ping plugin: Ignoring unknown engine \"%s\".", value);
   } else {
     return -1;
   }
@@ -566,6 +1271,9 @@ static int ping_read(void) /* {{{ */
       hl->pkg_recv = 0;
       hl->latency_total = 0.0;
       hl->latency_squared = 0.0;
+      hl->latency_last = -1.0;
+      hl->jitter_total = 0.0;
+      hl->jitter_num = 0;
     }
 
     start_thread();
@@ -579,9 +1287,12 @@ static int ping_read(void) /* {{{ */
     uint32_t pkg_recv;
     double latency_total;
     double latency_squared;
+    double jitter_total;
+    uint32_t jitter_num;
 
     double latency_average;
     double latency_stddev;
+    double jitter;
 
     double droprate;
 
@@ -593,11 +1304,15 @@ static int ping_read(void) /* {{{ */
     pkg_recv = hl->pkg_recv;
     latency_total = hl->latency_total;
     latency_squared = hl->latency_squared;
+    jitter_total = hl->jitter_total;
+    jitter_num = hl->jitter_num;
 
     hl->pkg_sent = 0;
     hl->pkg_recv = 0;
     hl->latency_total = 0.0;
     hl->latency_squared = 0.0;
+    hl->jitter_total = 0.0;
+    hl->jitter_num = 0;
 
     pthread_mutex_unlock(&ping_lock);
 
@@ -623,12 +1338,18 @@ static int ping_read(void) /* {{{ */
                              (latency_total * latency_total)) /
                             ((double)(pkg_recv * (pkg_recv - 1))));
 
+    if (jitter_num == 0)
+      jitter = NAN;
+    else
+      jitter = jitter_total / ((double)jitter_num);
+
     /* Calculate drop rate. */
     droprate = ((double)(pkg_sent - pkg_recv)) / ((double)pkg_sent);
 
     submit(hl->host, "ping", latency_average);
     submit(hl->host, "ping_stddev", latency_stddev);
     submit(hl->host, "ping_droprate", droprate);
+    submit(hl->host, "ping_jitter", jitter);
   } /* }}} for (hl = hostlist_head; hl != NULL; hl = hl->next) */
 
   return 0;
@@ -85,6 +85,16 @@
   ((NULL == (host)) || ('\0' == *(host))) ? DEFAULT_PGSOCKET_DIR : host,       \
       C_PSQL_IS_UNIX_DOMAIN_SOCKET(host) ? "/.s.PGSQL." : ":", port
 
+/* Number of queries sent to the server before waiting for the results when
+ * pipelining the statement of a writer. */
+#define C_PSQL_PIPELINE_DEPTH 128
+
+/* Amount of COPY data buffered before it is passed to libpq. */
+#define C_PSQL_COPY_CHUNK_SIZE 65536
+
+/* Number of columns written by COPY, see c_psql_copy_rows(). */
+#define C_PSQL_COPY_COLUMNS_NUM 9
+
 typedef enum {
   C_PSQL_PARAM_HOST = 1,
   C_PSQL_PARAM_DB,
@@ -102,9 +112,17 @@ typedef struct {
 typedef struct {
   char *name;
   char *statement;
+  /* Set instead of "statement" if the values are streamed into a table. */
+  char *copy_statement;
   _Bool store_rates;
 } c_psql_writer_t;
 
+typedef struct {
+  char *data;
+  size_t size;
+  size_t fill;
+} c_psql_copy_buffer_t;
+
 typedef struct {
   PGconn *conn;
   c_complain_t conn_complaint;
@@ -119,6 +137,10 @@ typedef struct {
   udb_query_t **queries;
   size_t queries_num;
 
+  /* Set if the query has been prepared on the current connection, see
+   * c_psql_exec_query_params(). */
+  _Bool *q_prepared;
+
   c_psql_writer_t **writers;
   size_t writers_num;
 
@@ -132,6 +154,11 @@ typedef struct {
   cdtime_t next_commit;
   cdtime_t expire_delay;
 
+  /* If greater than one, values are written in batches, see
+   * c_psql_write_batch(). */
+  size_t batch_size;
+  cdtime_t batch_linger;
+
   char *host;
   char *port;
   char *database;
@@ -232,6 +259,8 @@ static c_psql_database_t *c_psql_database_new(const char *name) {
   db->queries = NULL;
   db->queries_num = 0;
 
+  db->q_prepared = NULL;
+
   db->writers = NULL;
   db->writers_num = 0;
 
@@ -243,6 +272,9 @@ static c_psql_database_t *c_psql_database_new(const char *name) {
   db->next_commit = 0;
   db->expire_delay = 0;
 
+  db->batch_size = 1;
+  db->batch_linger = TIME_T_TO_CDTIME_T(1);
+
   db->database = sstrdup(name);
   db->host = NULL;
   db->port = NULL;
@@ -284,6 +316,7 @@ static void c_psql_database_delete(void *data) {
     for (size_t i = 0; i < db->queries_num; ++i)
       udb_query_delete_preparation_area(db->q_prep_areas[i]);
   free(db->q_prep_areas);
+  sfree(db->q_prepared);
 
   sfree(db->queries);
   db->queries_num = 0;
@@ -318,6 +351,29 @@ static void c_psql_database_delete(void *data) {
   return;
 } /* c_psql_database_delete */
 
+/* Creates a database object which connects to the same database as `src'.
+ * It is used for the additional connections of the `Connections' option and
+ * only gets queries assigned, see c_psql_config_connections(). */
+static c_psql_database_t *c_psql_database_clone(c_psql_database_t const *src) {
+  c_psql_database_t *db = c_psql_database_new(src->database);
+  if (db == NULL)
+    return NULL;
+
+  sfree(db->instance);
+  db->instance = sstrdup(src->instance);
+  db->host = sstrdup(src->host);
+  db->port = sstrdup(src->port);
+  db->user = sstrdup(src->user);
+  db->password = sstrdup(src->password);
+  db->plugin_name = sstrdup(src->plugin_name);
+  db->sslmode = sstrdup(src->sslmode);
+  db->krbsrvname = sstrdup(src->krbsrvname);
+  db->service = sstrdup(src->service);
+
+  db->interval = src->interval;
+  return db;
+} /* c_psql_database_clone */
+
 static int c_psql_connect(c_psql_database_t *db) {
   char conninfo[4096];
   char *buf = conninfo;
@@ -363,6 +419,10 @@ static int c_psql_check_connection(c_psql_database_t *db) {
   if (CONNECTION_OK != PQstatus(db->conn)) {
     PQreset(db->conn);
 
+    /* prepared statements do not survive a new connection */
+    if (db->q_prepared != NULL)
+      memset(db->q_prepared, 0, db->queries_num * sizeof(*db->q_prepared));
+
     /* trigger c_release() */
     if (0 == db->conn_complaint.interval)
       db->conn_complaint.interval = 1;
@@ -407,17 +467,33 @@ static PGresult *c_psql_exec_query_noparams(c_psql_database_t *db,
   return PQexec(db->conn, udb_query_get_statement(q));
 } /* c_psql_exec_query_noparams */
 
-static PGresult *c_psql_exec_query_params(c_psql_database_t *db, udb_query_t *q,
+/* Executes the statement of the query at index `idx' of `db->queries'. The
+ * statement is prepared on the server the first time it is executed on a
+ * connection, so that it is parsed and planned only once rather than in
+ * every interval. */
+static PGresult *c_psql_exec_query_params(c_psql_database_t *db, size_t idx,
                                           c_psql_user_data_t *data) {
-  const char *params[db->max_params_num];
+  const char *params[db->max_params_num + 1];
+  int params_num = (data != NULL) ? data->params_num : 0;
   char interval[64];
+  char name[64];
 
-  if ((data == NULL) || (data->params_num == 0))
-    return c_psql_exec_query_noparams(db, q);
+  assert(db->max_params_num >= params_num);
 
-  assert(db->max_params_num >= data->params_num);
+  snprintf(name, sizeof(name), "collectd_query_%" PRIsz, idx);
 
-  for (int i = 0; i < data->params_num; ++i) {
+  if (!db->q_prepared[idx]) {
+    PGresult *res =
+        PQprepare(db->conn, name, udb_query_get_statement(db->queries[idx]),
+                  params_num, /* param types = */ NULL);
+    if (PGRES_COMMAND_OK != PQresultStatus(res))
+      return res;
+
+    PQclear(res);
+    db->q_prepared[idx] = 1;
+  }
+
+  for (int i = 0; i < params_num; ++i) {
     switch (data->params[i]) {
     case C_PSQL_PARAM_HOST:
       params[i] =
@@ -443,13 +519,27 @@ static PGresult *c_psql_exec_query_params(c_psql_database_t *db, udb_query_t *q,
     }
   }
 
-  return PQexecParams(db->conn, udb_query_get_statement(q), data->params_num,
-                      NULL, (const char *const *)params, NULL, NULL, 0);
+  return PQexecPrepared(db->conn, name, params_num,
+                        (const char *const *)params, NULL, NULL, 0);
 } /* c_psql_exec_query_params */
 
+/* Drops the prepared statement of a failed query, so that it is prepared
+ * again, e.g. after the tables it refers to have been changed. */
+static void c_psql_deallocate_query(c_psql_database_t *db, size_t idx) {
+  char stmt[64];
+
+  if (!db->q_prepared[idx])
+    return;
+
+  snprintf(stmt, sizeof(stmt), "DEALLOCATE collectd_query_%" PRIsz, idx);
+  PQclear(PQexec(db->conn, stmt));
+  db->q_prepared[idx] = 0;
+} /* c_psql_deallocate_query */
+
 /* db->db_lock must be locked when calling this function */
-static int c_psql_exec_query(c_psql_database_t *db, udb_query_t *q,
-                             udb_query_preparation_area_t *prep_area) {
+static int c_psql_exec_query(c_psql_database_t *db, size_t idx) {
+  udb_query_t *q = db->queries[idx];
+  udb_query_preparation_area_t *prep_area = db->q_prep_areas[idx];
   PGresult *res;
 
   c_psql_user_data_t *data;
@@ -468,7 +558,7 @@ static int c_psql_exec_query(c_psql_database_t *db, udb_query_t *q,
 
   /* Versions up to `3' don't know how to handle parameters. */
   if (3 <= db->proto_version)
-    res = c_psql_exec_query_params(db, q, data);
+    res = c_psql_exec_query_params(db, idx, data);
   else if ((NULL == data) || (0 == data->params_num))
     res = c_psql_exec_query_noparams(db, q);
   else {
@@ -494,12 +584,13 @@ static int c_psql_exec_query(c_psql_database_t *db, udb_query_t *q,
     if ((CONNECTION_OK != PQstatus(db->conn)) &&
         (0 == c_psql_check_connection(db))) {
       PQclear(res);
-      return c_psql_exec_query(db, q, prep_area);
+      return c_psql_exec_query(db, idx);
     }
 
     log_err("Failed to execute SQL query: %s", PQerrorMessage(db->conn));
     log_info("SQL query was: %s", udb_query_get_statement(q));
     PQclear(res);
+    c_psql_deallocate_query(db, idx);
     return -1;
   }
 
@@ -607,17 +698,11 @@ static int c_psql_read(user_data_t *ud) {
   }
 
   for (size_t i = 0; i < db->queries_num; ++i) {
-    udb_query_preparation_area_t *prep_area;
-    udb_query_t *q;
-
-    prep_area = db->q_prep_areas[i];
-    q = db->queries[i];
-
     if ((0 != db->server_version) &&
-        (udb_query_check_version(q, db->server_version) <= 0))
+        (udb_query_check_version(db->queries[i], db->server_version) <= 0))
       continue;
 
-    if (0 == c_psql_exec_query(db, q, prep_area))
+    if (0 == c_psql_exec_query(db, i))
       success = 1;
   }
 
@@ -776,10 +861,26 @@ static char *values_to_sqlarray(const data_set_t *ds, const value_list_t *vl,
   return string;
 } /* values_to_sqlarray */
 
-static int c_psql_write(const data_set_t *ds, const value_list_t *vl,
-                        user_data_t *ud) {
-  c_psql_database_t *db;
+/* Returns true if "vl" is older than the database's ExpireDelay. */
+static _Bool c_psql_value_expired(c_psql_database_t *db,
+                                  const value_list_t *vl) {
+  if ((db->expire_delay == 0) ||
+      (vl->time >= (cdtime() - vl->interval - db->expire_delay)))
+    return 0;
 
+  char time_str[RFC3339NANO_SIZE] = "";
+  char name[6 * DATA_MAX_NAME_LEN];
+  rfc3339nano_local(time_str, sizeof(time_str), vl->time);
+  FORMAT_VL(name, sizeof(name), vl);
+  log_info("c_psql_write: Skipped expired value @ %s - %s", time_str, name);
+  return 1;
+} /* c_psql_value_expired */
+
+/* Executes the statement of "writer" for a single value list, reconnecting
+ * and trying again once if the connection has been lost.
+ * db->db_lock must be locked when calling this function */
+static int c_psql_exec_writer(c_psql_database_t *db, c_psql_writer_t *writer,
+                              const data_set_t *ds, const value_list_t *vl) {
   char time_str[RFC3339NANO_SIZE];
   char values_name_str[1024];
   char values_type_str[1024];
@@ -787,24 +888,19 @@ static int c_psql_write(const data_set_t *ds, const value_list_t *vl,
 
   const char *params[9];
 
-  int success = 0;
-
-  if ((ud == NULL) || (ud->data == NULL)) {
-    log_err("c_psql_write: Invalid user data.");
-    return -1;
-  }
-
-  db = ud->data;
-  assert(db->database != NULL);
-  assert(db->writers != NULL);
+  PGresult *res;
 
   if (rfc3339nano_local(time_str, sizeof(time_str), vl->time) != 0) {
     log_err("c_psql_write: Failed to convert time to RFC 3339 format");
     return -1;
   }
 
-  if (values_name_to_sqlarray(ds, values_name_str, sizeof(values_name_str)) ==
-      NULL)
+  if ((values_name_to_sqlarray(ds, values_name_str, sizeof(values_name_str)) ==
+       NULL) ||
+      (values_type_to_sqlarray(ds, values_type_str, sizeof(values_type_str),
+                               writer->store_rates) == NULL) ||
+      (values_to_sqlarray(ds, vl, values_str, sizeof(values_str),
+                          writer->store_rates) == NULL))
     return -1;
 
 #define VALUE_OR_NULL(v) ((((v) == NULL) || (*(v) == '\0')) ? NULL : (v))
@@ -816,99 +912,449 @@ static int c_psql_write(const data_set_t *ds, const value_list_t *vl,
   params[4] = vl->type;
   params[5] = VALUE_OR_NULL(vl->type_instance);
   params[6] = values_name_str;
+  params[7] = values_type_str;
+  params[8] = values_str;
 
 #undef VALUE_OR_NULL
 
-  if (db->expire_delay > 0 &&
-      vl->time < (cdtime() - vl->interval - db->expire_delay)) {
-    log_info("c_psql_write: Skipped expired value @ %s - %s/%s-%s/%s-%s/%s",
-             params[0], params[1], params[2], params[3], params[4], params[5],
-             params[6]);
-    return 0;
-  }
+  res = PQexecParams(db->conn, writer->statement, STATIC_ARRAY_SIZE(params),
+                     NULL, (const char *const *)params, NULL, NULL,
+                     /* return text data */ 0);
 
-  pthread_mutex_lock(&db->db_lock);
+  if ((PGRES_COMMAND_OK != PQresultStatus(res)) &&
+      (PGRES_TUPLES_OK != PQresultStatus(res))) {
+    PQclear(res);
 
-  if (0 != c_psql_check_connection(db)) {
-    pthread_mutex_unlock(&db->db_lock);
+    if ((CONNECTION_OK != PQstatus(db->conn)) &&
+        (0 == c_psql_check_connection(db))) {
+      /* try again */
+      res = PQexecParams(
+          db->conn, writer->statement, STATIC_ARRAY_SIZE(params), NULL,
+          (const char *const *)params, NULL, NULL, /* return text data */ 0);
+
+      if ((PGRES_COMMAND_OK == PQresultStatus(res)) ||
+          (PGRES_TUPLES_OK == PQresultStatus(res))) {
+        PQclear(res);
+        return 0;
+      }
+    }
+
+    log_err("Failed to execute SQL query: %s", PQerrorMessage(db->conn));
+    log_info("SQL query was: '%s', "
+             "params: %s, %s, %s, %s, %s, %s, %s, %s",
+             writer->statement, params[0], params[1], params[2], params[3],
+             params[4], params[5], params[6], params[7]);
+    PQclear(res);
     return -1;
   }
 
-  if ((db->commit_interval > 0) && (db->next_commit == 0))
-    c_psql_begin(db);
-
-  for (size_t i = 0; i < db->writers_num; ++i) {
-    c_psql_writer_t *writer;
-    PGresult *res;
+  PQclear(res);
+  return 0;
+} /* c_psql_exec_writer */
+
+#ifdef LIBPQ_HAS_PIPELINING
+/* Executes the statement of "writer" for all value lists, sending up to
+ * C_PSQL_PIPELINE_DEPTH executions of the (unnamed) prepared statement
+ * before waiting for the results. The depth is bounded because both ends
+ * block once the results fill up the socket buffers.
+ * db->db_lock must be locked when calling this function */
+static int c_psql_exec_pipeline(c_psql_database_t *db, c_psql_writer_t *writer,
+                                const write_batch_entry_t *entries,
+                                size_t entries_num) {
+  int status = 0;
 
-    writer = db->writers[i];
+  if (PQenterPipelineMode(db->conn) != 1) {
+    for (size_t i = 0; (i < entries_num) && (status == 0); i++)
+      status = c_psql_exec_writer(db, writer, entries[i].ds, entries[i].vl);
+    return status;
+  }
 
-    if (values_type_to_sqlarray(ds, values_type_str, sizeof(values_type_str),
-                                writer->store_rates) == NULL) {
-      pthread_mutex_unlock(&db->db_lock);
-      return -1;
+  for (size_t i = 0; (i < entries_num) && (status == 0);) {
+    if (PQsendPrepare(db->conn, /* stmtName = */ "", writer->statement,
+                      /* nParams = */ 9, /* paramTypes = */ NULL) != 1) {
+      log_err("Failed to prepare SQL query: %s", PQerrorMessage(db->conn));
+      status = -1;
+      break;
     }
 
-    if (values_to_sqlarray(ds, vl, values_str, sizeof(values_str),
-                           writer->store_rates) == NULL) {
-      pthread_mutex_unlock(&db->db_lock);
-      return -1;
+    for (size_t n = 0; (n < C_PSQL_PIPELINE_DEPTH) && (i < entries_num);
+         n++, i++) {
+      const data_set_t *ds = entries[i].ds;
+      const value_list_t *vl = entries[i].vl;
+
+      char time_str[RFC3339NANO_SIZE];
+      char values_name_str[1024];
+      char values_type_str[1024];
+      char values_str[1024];
+
+      if ((rfc3339nano_local(time_str, sizeof(time_str), vl->time) != 0) ||
+          (values_name_to_sqlarray(ds, values_name_str,
+                                   sizeof(values_name_str)) == NULL) ||
+          (values_type_to_sqlarray(ds, values_type_str,
+                                   sizeof(values_type_str),
+                                   writer->store_rates) == NULL) ||
+          (values_to_sqlarray(ds, vl, values_str, sizeof(values_str),
+                              writer->store_rates) == NULL))
+        continue;
+
+#define VALUE_OR_NULL(v) ((((v) == NULL) || (*(v) == '\0')) ? NULL : (v))
+      const char *params[9] = {time_str,
+                               vl->host,
+                               vl->plugin,
+                               VALUE_OR_NULL(vl->plugin_instance),
+                               vl->type,
+                               VALUE_OR_NULL(vl->type_instance),
+                               values_name_str,
+                               values_type_str,
+                               values_str};
+#undef VALUE_OR_NULL
+
+      if (PQsendQueryPrepared(db->conn, /* stmtName = */ "",
+                              STATIC_ARRAY_SIZE(params), params, NULL, NULL,
+                              /* return text data */ 0) != 1) {
+        log_err("Failed to send SQL query: %s", PQerrorMessage(db->conn));
+        status = -1;
+        break;
+      }
     }
 
-    params[7] = values_type_str;
-    params[8] = values_str;
+    if (PQpipelineSync(db->conn) != 1) {
+      log_err("Failed to send SQL queries: %s", PQerrorMessage(db->conn));
+      status = -1;
+      break;
+    }
 
-    res = PQexecParams(db->conn, writer->statement, STATIC_ARRAY_SIZE(params),
-                       NULL, (const char *const *)params, NULL, NULL,
-                       /* return text data */ 0);
+    /* Every query is followed by a NULL result; two NULLs in a row mean that
+     * nothing is pending anymore, which only happens if the connection has
+     * been lost. */
+    _Bool got_null = 0;
+    while (42) {
+      PGresult *res = PQgetResult(db->conn);
+      if (res == NULL) {
+        if (got_null)
+          break;
+        got_null = 1;
+        continue;
+      }
+      got_null = 0;
 
-    if ((PGRES_COMMAND_OK != PQresultStatus(res)) &&
-        (PGRES_TUPLES_OK != PQresultStatus(res))) {
+      ExecStatusType rs = PQresultStatus(res);
+      if (rs == PGRES_PIPELINE_SYNC) {
+        PQclear(res);
+        break;
+      } else if ((rs != PGRES_COMMAND_OK) && (rs != PGRES_TUPLES_OK) &&
+                 (status == 0)) {
+        /* Only the first error is interesting, all following queries
+         * report PGRES_PIPELINE_ABORTED. */
+        log_err("Failed to execute SQL query: %s", PQresultErrorMessage(res));
+        log_info("SQL query was: '%s'", writer->statement);
+        status = -1;
+      }
       PQclear(res);
+    }
+  }
+
+  if (PQexitPipelineMode(db->conn) != 1) {
+    /* Leaves the connection in a state we cannot recover from. */
+    log_err("Failed to leave pipeline mode: %s", PQerrorMessage(db->conn));
+    PQfinish(db->conn);
+    db->conn = NULL;
+    status = -1;
+  }
+  return status;
+} /* c_psql_exec_pipeline */
+#endif /* LIBPQ_HAS_PIPELINING */
+
+static int c_psql_copy_reserve(c_psql_copy_buffer_t *b, size_t len) {
+  if (b->fill + len <= b->size)
+    return 0;
+
+  size_t size = (b->size > 0) ? b->size : 4096;
+  while (size < b->fill + len)
+    size *= 2;
 
-      if ((CONNECTION_OK != PQstatus(db->conn)) &&
-          (0 == c_psql_check_connection(db))) {
-        /* try again */
-        res = PQexecParams(
-            db->conn, writer->statement, STATIC_ARRAY_SIZE(params), NULL,
-            (const char *const *)params, NULL, NULL, /* return text data */ 0);
-
-        if ((PGRES_COMMAND_OK == PQresultStatus(res)) ||
-            (PGRES_TUPLES_OK == PQresultStatus(res))) {
-          PQclear(res);
-          success = 1;
-          continue;
-        }
+  char *tmp = realloc(b->data, size);
+  if (tmp == NULL)
+    return ENOMEM;
+  b->data = tmp;
+  b->size = size;
+  return 0;
+} /* c_psql_copy_reserve */
+
+static int c_psql_copy_uint(c_psql_copy_buffer_t *b, uint64_t v, size_t len) {
+  if (c_psql_copy_reserve(b, len) != 0)
+    return ENOMEM;
+
+  /* network byte order */
+  for (size_t i = 0; i < len; i++)
+    b->data[b->fill + i] = (char)(v >> (8 * (len - i - 1)));
+  b->fill += len;
+  return 0;
+} /* c_psql_copy_uint */
+
+/* Appends a text field; NULL and empty strings become SQL NULL. */
+static int c_psql_copy_text(c_psql_copy_buffer_t *b, const char *s) {
+  if ((s == NULL) || (*s == '\0'))
+    return c_psql_copy_uint(b, (uint32_t)-1, 4);
+
+  size_t len = strlen(s);
+  if ((c_psql_copy_uint(b, len, 4) != 0) || (c_psql_copy_reserve(b, len) != 0))
+    return ENOMEM;
+  memcpy(b->data + b->fill, s, len);
+  b->fill += len;
+  return 0;
+} /* c_psql_copy_text */
+
+/* Appends one row per data source of "vl" in the binary COPY format. */
+static int c_psql_copy_rows(c_psql_copy_buffer_t *b, c_psql_writer_t *writer,
+                            const data_set_t *ds, const value_list_t *vl) {
+  gauge_t *rates = NULL;
+  int status = 0;
+
+  if (writer->store_rates) {
+    for (size_t i = 0; i < ds->ds_num; i++) {
+      if (ds->ds[i].type == DS_TYPE_GAUGE)
+        continue;
+      rates = uc_get_rate(ds, vl);
+      if (rates == NULL) {
+        log_err("c_psql_write: Failed to determine rate");
+        return -1;
       }
+      break;
+    }
+  }
+
+  /* Timestamps are microseconds since 2000-01-01 00:00:00 UTC. */
+  int64_t tstamp =
+      (int64_t)CDTIME_T_TO_US(vl->time) - INT64_C(946684800000000);
+
+  for (size_t i = 0; (i < ds->ds_num) && (status == 0); i++) {
+    gauge_t value;
+    if (ds->ds[i].type == DS_TYPE_GAUGE)
+      value = vl->values[i].gauge;
+    else if (rates != NULL)
+      value = rates[i];
+    else if (ds->ds[i].type == DS_TYPE_COUNTER)
+      value = (gauge_t)vl->values[i].counter;
+    else if (ds->ds[i].type == DS_TYPE_DERIVE)
+      value = (gauge_t)vl->values[i].derive;
+    else
+      value = (gauge_t)vl->values[i].absolute;
+
+    uint64_t value_bits;
+    memcpy(&value_bits, &value, sizeof(value_bits));
+
+    status |= c_psql_copy_uint(b, C_PSQL_COPY_COLUMNS_NUM, 2);
+    status |= c_psql_copy_uint(b, sizeof(tstamp), 4);
+    status |= c_psql_copy_uint(b, (uint64_t)tstamp, sizeof(tstamp));
+    status |= c_psql_copy_text(b, vl->host);
+    status |= c_psql_copy_text(b, vl->plugin);
+    status |= c_psql_copy_text(b, vl->plugin_instance);
+    status |= c_psql_copy_text(b, vl->type);
+    status |= c_psql_copy_text(b, vl->type_instance);
+    status |= c_psql_copy_text(b, ds->ds[i].name);
+    status |= c_psql_copy_text(b, writer->store_rates
+                                      ? "gauge"
+                                      : DS_TYPE_TO_STRING(ds->ds[i].type));
+    status |= c_psql_copy_uint(b, sizeof(value_bits), 4);
+    status |= c_psql_copy_uint(b, value_bits, sizeof(value_bits));
+  }
+
+  sfree(rates);
+  return (status == 0) ? 0 : -1;
+} /* c_psql_copy_rows */
+
+/* Streams one row per data source of all value lists into the table of
+ * "writer" using a single binary COPY.
+ * db->db_lock must be locked when calling this function */
+static int c_psql_copy(c_psql_database_t *db, c_psql_writer_t *writer,
+                       const write_batch_entry_t *entries,
+                       size_t entries_num) {
+  c_psql_copy_buffer_t b = {0};
+  int status = 0;
+
+  PGresult *res = PQexec(db->conn, writer->copy_statement);
+  if (PGRES_COPY_IN != PQresultStatus(res)) {
+    log_err("Failed to start COPY: %s", PQerrorMessage(db->conn));
+    log_info("SQL query was: '%s'", writer->copy_statement);
+    PQclear(res);
+    return -1;
+  }
+  PQclear(res);
+
+  /* signature, flags and header extension length */
+  if (c_psql_copy_reserve(&b, 19) != 0)
+    status = -1;
+  else {
+    memcpy(b.data, "PGCOPY\n\377\r\n\0", 11);
+    b.fill = 11;
+    c_psql_copy_uint(&b, 0, 4);
+    c_psql_copy_uint(&b, 0, 4);
+  }
 
-      log_err("Failed to execute SQL query: %s", PQerrorMessage(db->conn));
-      log_info("SQL query was: '%s', "
-               "params: %s, %s, %s, %s, %s, %s, %s, %s",
-               writer->statement, params[0], params[1], params[2], params[3],
-               params[4], params[5], params[6], params[7]);
+  for (size_t i = 0; (i < entries_num) && (status == 0); i++) {
+    if (c_psql_copy_rows(&b, writer, entries[i].ds, entries[i].vl) != 0)
+      continue;
 
+    if (b.fill >= C_PSQL_COPY_CHUNK_SIZE) {
+      if (PQputCopyData(db->conn, b.data, (int)b.fill) != 1)
+        status = -1;
+      b.fill = 0;
+    }
+  }
+
+  /* file trailer */
+  if ((status == 0) && (c_psql_copy_uint(&b, (uint16_t)-1, 2) != 0))
+    status = -1;
+  if ((status == 0) && (PQputCopyData(db->conn, b.data, (int)b.fill) != 1))
+    status = -1;
+  sfree(b.data);
+
+  if (PQputCopyEnd(db->conn, (status == 0) ? NULL : "collectd: aborted") !=
+      1)
+    status = -1;
+
+  while ((res = PQgetResult(db->conn)) != NULL) {
+    if ((PGRES_COMMAND_OK != PQresultStatus(res)) && (status == 0)) {
+      log_err("Failed to COPY values: %s", PQresultErrorMessage(res));
+      log_info("SQL query was: '%s'", writer->copy_statement);
+      status = -1;
+    }
+    PQclear(res);
+  }
+  if ((status != 0) && (CONNECTION_OK != PQstatus(db->conn)))
+    log_err("Failed to COPY values: %s", PQerrorMessage(db->conn));
+
+  return status;
+} /* c_psql_copy */
+
+/* Passes the value lists to all writers of the database.
+ * db->db_lock must be locked when calling this function */
+static int c_psql_write_entries(c_psql_database_t *db,
+                                const write_batch_entry_t *entries,
+                                size_t entries_num) {
+  for (size_t i = 0; i < db->writers_num; ++i) {
+    c_psql_writer_t *writer = db->writers[i];
+    int status = 0;
+
+    if (writer->copy_statement != NULL)
+      status = c_psql_copy(db, writer, entries, entries_num);
+#ifdef LIBPQ_HAS_PIPELINING
+    else if (entries_num > 1)
+      status = c_psql_exec_pipeline(db, writer, entries, entries_num);
+#endif
+    else
+      for (size_t j = 0; (j < entries_num) && (status == 0); j++)
+        status = c_psql_exec_writer(db, writer, entries[j].ds, entries[j].vl);
+
+    if (status != 0) {
       /* this will abort any current transaction -> restart */
       if (db->next_commit > 0)
         c_psql_commit(db);
-
-      pthread_mutex_unlock(&db->db_lock);
       return -1;
     }
+  }
 
-    PQclear(res);
-    success = 1;
+  return 0;
+} /* c_psql_write_entries */
+
+static int c_psql_write(const data_set_t *ds, const value_list_t *vl,
+                        user_data_t *ud) {
+  c_psql_database_t *db;
+
+  int status;
+
+  if ((ud == NULL) || (ud->data == NULL)) {
+    log_err("c_psql_write: Invalid user data.");
+    return -1;
+  }
+
+  db = ud->data;
+  assert(db->database != NULL);
+  assert(db->writers != NULL);
+
+  if (c_psql_value_expired(db, vl))
+    return 0;
+
+  pthread_mutex_lock(&db->db_lock);
+
+  if (0 != c_psql_check_connection(db)) {
+    pthread_mutex_unlock(&db->db_lock);
+    return -1;
   }
 
+  if ((db->commit_interval > 0) && (db->next_commit == 0))
+    c_psql_begin(db);
+
+  status = c_psql_write_entries(db, &(write_batch_entry_t){.ds = ds, .vl = vl},
+                                /* entries_num = */ 1);
+
   if ((db->next_commit > 0) && (cdtime() > db->next_commit))
     c_psql_commit(db);
 
   pthread_mutex_unlock(&db->db_lock);
 
-  if (!success)
-    return -1;
-  return 0;
+  return status;
 } /* c_psql_write */
 
+/* Writes a batch of value lists in a single transaction, unless a longer
+ * transaction is kept open because of CommitInterval. */
+static int c_psql_write_batch(const write_batch_entry_t *entries,
+                              size_t entries_num, user_data_t *ud) {
+  c_psql_database_t *db;
+
+  write_batch_entry_t *current;
+  size_t current_num = 0;
+
+  int status;
+
+  if ((ud == NULL) || (ud->data == NULL)) {
+    log_err("c_psql_write_batch: Invalid user data.");
+    return -1;
+  }
+
+  db = ud->data;
+  assert(db->database != NULL);
+  assert(db->writers != NULL);
+
+  current = calloc(entries_num, sizeof(*current));
+  if (current == NULL) {
+    log_err("Out of memory.");
+    return -1;
+  }
+
+  for (size_t i = 0; i < entries_num; i++)
+    if (!c_psql_value_expired(db, entries[i].vl))
+      current[current_num++] = entries[i];
+
+  if (current_num == 0) {
+    sfree(current);
+    return 0;
+  }
+
+  pthread_mutex_lock(&db->db_lock);
+
+  if (0 != c_psql_check_connection(db)) {
+    pthread_mutex_unlock(&db->db_lock);
+    sfree(current);
+    return -1;
+  }
+
+  if (db->next_commit == 0)
+    c_psql_begin(db);
+
+  status = c_psql_write_entries(db, current, current_num);
+
+  if ((db->next_commit > 0) &&
+      ((db->commit_interval == 0) || (cdtime() > db->next_commit)))
+    c_psql_commit(db);
+
+  pthread_mutex_unlock(&db->db_lock);
+
+  sfree(current);
+  return status;
+} /* c_psql_write_batch */
+
 /* We cannot flush single identifiers as all we do is to commit the currently
  * running transaction, thus making sure that all written data is actually
  * visible to everybody. */
@@ -1074,10 +1520,64 @@ static int config_add_writer(oconfig_item_t *ci, c_psql_writer_t *src_writers,
   return 0;
 } /* config_add_writer */
 
+/* Returns the COPY statement used for writing into "table". The column
+ * names are quoted, the table name is used verbatim so that it may be
+ * qualified with a schema. */
+static char *config_copy_statement(const char *table, oconfig_item_t *columns) {
+  static const char *const default_columns[C_PSQL_COPY_COLUMNS_NUM] = {
+      "time", "host",    "plugin",  "plugin_instance", "type", "type_instance",
+      "ds_name", "ds_type", "value"};
+  char buffer[4096];
+  size_t len = 0;
+
+  if ((columns != NULL) && (columns->values_num != C_PSQL_COPY_COLUMNS_NUM)) {
+    log_err("`Columns' expects exactly %d column names.",
+            C_PSQL_COPY_COLUMNS_NUM);
+    return NULL;
+  }
+
+  len = (size_t)snprintf(buffer, sizeof(buffer), "COPY %s (", table);
+  for (size_t i = 0; (i < C_PSQL_COPY_COLUMNS_NUM) && (len < sizeof(buffer));
+       i++) {
+    const char *name = default_columns[i];
+    if (columns != NULL) {
+      if (columns->values[i].type != OCONFIG_TYPE_STRING) {
+        log_err("`Columns' expects string arguments.");
+        return NULL;
+      }
+      name = columns->values[i].value.string;
+    }
+
+    if (i > 0)
+      buffer[len++] = ',';
+    buffer[len++] = '"';
+    for (const char *c = name; (*c != '\0') && (len + 2 < sizeof(buffer));
+         c++) {
+      if (*c == '"')
+        buffer[len++] = '"';
+      buffer[len++] = *c;
+    }
+    if (len < sizeof(buffer))
+      buffer[len++] = '"';
+  }
+  if ((len >= sizeof(buffer)) ||
+      ((size_t)snprintf(buffer + len, sizeof(buffer) - len,
+                        ") FROM STDIN WITH (FORMAT binary)") >=
+       sizeof(buffer) - len)) {
+    log_err("The table or column names are too long.");
+    return NULL;
+  }
+
+  return sstrdup(buffer);
+} /* config_copy_statement */
+
 static int c_psql_config_writer(oconfig_item_t *ci) {
   c_psql_writer_t *writer;
   c_psql_writer_t *tmp;
 
+  char *table = NULL;
+  oconfig_item_t *columns = NULL;
+
   int status = 0;
 
   if ((ci->values_num != 1) || (ci->values[0].type != OCONFIG_TYPE_STRING)) {
@@ -1104,14 +1604,35 @@ static int c_psql_config_writer(oconfig_item_t *ci) {
 
     if (strcasecmp("Statement", c->key) == 0)
       status = cf_util_get_string(c, &writer->statement);
+    else if (strcasecmp("Table", c->key) == 0)
+      status = cf_util_get_string(c, &table);
+    else if (strcasecmp("Columns", c->key) == 0)
+      columns = c;
     else if (strcasecmp("StoreRates", c->key) == 0)
       status = cf_util_get_boolean(c, &writer->store_rates);
     else
       log_warn("Ignoring unknown config key \"%s\".", c->key);
   }
 
+  if ((status == 0) && ((writer->statement == NULL) == (table == NULL))) {
+    log_err("Writer \"%s\": Exactly one of `Statement' and `Table' has to "
+            "be specified.",
+            writer->name);
+    status = -1;
+  }
+
+  if ((status == 0) && (table != NULL)) {
+    writer->copy_statement = config_copy_statement(table, columns);
+    if (writer->copy_statement == NULL)
+      status = -1;
+  } else if (columns != NULL)
+    log_warn("Writer \"%s\": `Columns' is only used together with `Table'.",
+             writer->name);
+  sfree(table);
+
   if (status != 0) {
     sfree(writer->statement);
+    sfree(writer->copy_statement);
     sfree(writer->name);
     return status;
   }
@@ -1120,11 +1641,87 @@ static int c_psql_config_writer(oconfig_item_t *ci) {
   return 0;
 } /* c_psql_config_writer */
 
+/* Allocates the per-query state of a database's queries. */
+static int c_psql_config_queries(c_psql_database_t *db) {
+  if (db->queries_num == 0)
+    return 0;
+
+  db->q_prep_areas = (udb_query_preparation_area_t **)calloc(
+      db->queries_num, sizeof(*db->q_prep_areas));
+  db->q_prepared = calloc(db->queries_num, sizeof(*db->q_prepared));
+
+  if ((db->q_prep_areas == NULL) || (db->q_prepared == NULL)) {
+    log_err("Out of memory.");
+    return -1;
+  }
+
+  for (size_t i = 0; i < db->queries_num; ++i) {
+    c_psql_user_data_t *data;
+    data = udb_query_get_user_data(db->queries[i]);
+    if ((data != NULL) && (data->params_num > db->max_params_num))
+      db->max_params_num = data->params_num;
+
+    db->q_prep_areas[i] = udb_query_allocate_preparation_area(db->queries[i]);
+
+    if (db->q_prep_areas[i] == NULL) {
+      log_err("Out of memory.");
+      return -1;
+    }
+  }
+  return 0;
+} /* c_psql_config_queries */
+
+/* Spreads the queries of `db' over `pool_size' connections, each of which is
+ * read by its own callback: `pool[0]' is `db' itself, the other connections
+ * are clones of it. Returns the number of connections created. */
+static size_t c_psql_config_connections(c_psql_database_t *db,
+                                        c_psql_database_t **pool,
+                                        size_t pool_size) {
+  size_t num = 1;
+
+  pool[0] = db;
+
+  if (pool_size > db->queries_num)
+    pool_size = db->queries_num;
+
+  for (; num < pool_size; ++num) {
+    pool[num] = c_psql_database_clone(db);
+    if (pool[num] == NULL) {
+      log_warn("Database %s (%s): Failed to create connection #%" PRIsz
+               "; executing its queries on the other connections.",
+               db->database, db->instance, num + 1);
+      break;
+    }
+
+    pool[num]->queries = calloc(db->queries_num, sizeof(*db->queries));
+    if (pool[num]->queries == NULL) {
+      c_psql_database_delete(pool[num]);
+      break;
+    }
+  }
+
+  if (num < 2)
+    return 1;
+
+  size_t kept = 0;
+  for (size_t i = 0; i < db->queries_num; ++i) {
+    c_psql_database_t *dst = pool[i % num];
+    if (dst == db)
+      db->queries[kept++] = db->queries[i];
+    else
+      dst->queries[dst->queries_num++] = db->queries[i];
+  }
+  db->queries_num = kept;
+
+  return num;
+} /* c_psql_config_connections */
+
 static int c_psql_config_database(oconfig_item_t *ci) {
   c_psql_database_t *db;
 
   char cb_name[DATA_MAX_NAME_LEN];
   static _Bool have_flush = 0;
+  int connections_num = 1;
 
   if ((1 != ci->values_num) || (OCONFIG_TYPE_STRING != ci->values[0].type)) {
     log_err("<Database> expects a single string argument.");
@@ -1168,7 +1765,23 @@ static int c_psql_config_database(oconfig_item_t *ci) {
       cf_util_get_cdtime(c, &db->commit_interval);
     else if (strcasecmp("ExpireDelay", c->key) == 0)
       cf_util_get_cdtime(c, &db->expire_delay);
-    else
+    else if (strcasecmp("BatchSize", c->key) == 0) {
+      int tmp = 0;
+      if (cf_util_get_int(c, &tmp) == 0) {
+        if (tmp < 1)
+          log_warn("`BatchSize' must be at least 1.");
+        else
+          db->batch_size = (size_t)tmp;
+      }
+    } else if (strcasecmp("BatchLinger", c->key) == 0)
+      cf_util_get_cdtime(c, &db->batch_linger);
+    else if (strcasecmp("Connections", c->key) == 0) {
+      if ((cf_util_get_int(c, &connections_num) == 0) &&
+          (connections_num < 1)) {
+        log_warn("`Connections' must be at least 1.");
+        connections_num = 1;
+      }
+    } else
       log_warn("Ignoring unknown config key \"%s\".", c->key);
   }
 
@@ -1179,44 +1792,48 @@ static int c_psql_config_database(oconfig_item_t *ci) {
                                        &db->queries, &db->queries_num);
   }
 
-  if (db->queries_num > 0) {
-    db->q_prep_areas = (udb_query_preparation_area_t **)calloc(
-        db->queries_num, sizeof(*db->q_prep_areas));
+  c_psql_database_t *pool[connections_num];
+  size_t pool_num =
+      c_psql_config_connections(db, pool, (size_t)connections_num);
 
-    if (db->q_prep_areas == NULL) {
-      log_err("Out of memory.");
-      c_psql_database_delete(db);
+  for (size_t i = 0; i < pool_num; ++i) {
+    if (c_psql_config_queries(pool[i]) != 0) {
+      for (size_t j = 0; j < pool_num; ++j)
+        c_psql_database_delete(pool[j]);
       return -1;
     }
   }
 
-  for (int i = 0; (size_t)i < db->queries_num; ++i) {
-    c_psql_user_data_t *data;
-    data = udb_query_get_user_data(db->queries[i]);
-    if ((data != NULL) && (data->params_num > db->max_params_num))
-      db->max_params_num = data->params_num;
+  snprintf(cb_name, sizeof(cb_name), "postgresql-%s", db->instance);
 
-    db->q_prep_areas[i] = udb_query_allocate_preparation_area(db->queries[i]);
+  user_data_t ud = {.data = db, .free_func = c_psql_database_delete};
 
-    if (db->q_prep_areas[i] == NULL) {
-      log_err("Out of memory.");
-      c_psql_database_delete(db);
-      return -1;
-    }
-  }
+  for (size_t i = 0; i < pool_num; ++i) {
+    /* room for the largest possible connection index */
+    char read_name[sizeof(cb_name) + sizeof("-18446744073709551615")];
 
-  snprintf(cb_name, sizeof(cb_name), "postgresql-%s", db->instance);
+    if (pool[i]->queries_num == 0)
+      continue;
 
-  user_data_t ud = {.data = db, .free_func = c_psql_database_delete};
+    if (i == 0)
+      sstrncpy(read_name, cb_name, sizeof(read_name));
+    else
+      snprintf(read_name, sizeof(read_name), "%s-%" PRIsz, cb_name, i);
 
-  if (db->queries_num > 0) {
-    ++db->ref_cnt;
-    plugin_register_complex_read("postgresql", cb_name, c_psql_read,
-                                 /* interval = */ db->interval, &ud);
+    ++pool[i]->ref_cnt;
+    plugin_register_complex_read(
+        "postgresql", read_name, c_psql_read,
+        /* interval = */ db->interval,
+        &(user_data_t){.data = pool[i], .free_func = c_psql_database_delete});
   }
+
   if (db->writers_num > 0) {
     ++db->ref_cnt;
-    plugin_register_write(cb_name, c_psql_write, &ud);
+    if (db->batch_size > 1)
+      plugin_register_write_batch(cb_name, c_psql_write_batch, db->batch_size,
+                                  db->batch_linger, &ud);
+    else
+      plugin_register_write(cb_name, c_psql_write, &ud);
 
     if (!have_flush) {
       /* flush all */
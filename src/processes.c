@@ -99,6 +99,14 @@
 #ifndef CONFIG_HZ
 #define CONFIG_HZ 100
 #endif
+#if HAVE_LINUX_CN_PROC_H
+#include "utils_avltree.h"
+#include <linux/cn_proc.h>
+#include <linux/connector.h>
+#include <linux/netlink.h>
+#include <poll.h>
+#include <sys/socket.h>
+#endif
 /* #endif KERNEL_LINUX */
 
 #elif HAVE_LIBKVM_GETPROCS &&                                                  \
@@ -311,7 +319,40 @@ static mach_msg_type_number_t pset_list_len;
 
 #elif KERNEL_LINUX
 static long pagesize_g;
+/* /proc is held open, so that per-process files are opened relative to it
+ * instead of resolving the whole path every time. */
+static int proc_fd_g = -1;
+/* Number of threads reading processes, including the read thread. */
+static size_t scan_threads_g = 1;
 static void ps_fill_details(const procstat_t *ps, process_entry_t *entry);
+static int ps_scan_init(void);
+
+#if HAVE_LINUX_CN_PROC_H
+/* Receive buffer of the proc connector socket. Events are consumed by a
+ * separate thread, so this only has to absorb bursts of forks. */
+#define PS_EVENTS_RCVBUF (1024 * 1024)
+
+/* A process known from the proc connector. Its name and command line are
+ * only read and matched against the configured processes when the entry is
+ * "dirty", i.e. after the initial scan and after exec(2). */
+typedef struct ps_pid_s {
+  long pid;
+  _Bool dirty;
+  procstat_t **matches;
+  size_t matches_num;
+} ps_pid_t;
+
+static _Bool ps_events = 0;
+static int ps_events_fd = -1;
+static _Bool ps_events_running = 0;
+static _Bool ps_events_shutdown = 0;
+static _Bool ps_events_rescan = 1;
+static pthread_t ps_events_thread_id;
+static pthread_mutex_t ps_events_lock = PTHREAD_MUTEX_INITIALIZER;
+static c_avl_tree_t *ps_events_pids = NULL;
+
+static int ps_events_init(void);
+#endif
 /* #endif KERNEL_LINUX */
 
 #elif HAVE_LIBKVM_GETPROCS &&                                                  \
@@ -506,91 +547,98 @@ static void ps_update_delay(procstat_t *out, procstat_entry_t *prev,
 }
 #endif
 
-/* add process entry to 'instances' of process 'name' (or refresh it) */
-static void ps_list_add(const char *name, const char *cmdline,
-                        process_entry_t *entry) {
+/* add process entry to 'instances' of the process 'ps' (or refresh it) */
+static void ps_list_add_one(procstat_t *ps, process_entry_t *entry) {
   procstat_entry_t *pse;
 
-  if (entry->id == 0)
-    return;
-
-  for (procstat_t *ps = list_head_g; ps != NULL; ps = ps->next) {
-    if ((ps_list_match(name, cmdline, ps)) == 0)
-      continue;
-
 #if KERNEL_LINUX
-    ps_fill_details(ps, entry);
+  ps_fill_details(ps, entry);
 #endif
 
-    for (pse = ps->instances; pse != NULL; pse = pse->next)
-      if ((pse->id == entry->id) || (pse->next == NULL))
-        break;
+  for (pse = ps->instances; pse != NULL; pse = pse->next)
+    if ((pse->id == entry->id) || (pse->next == NULL))
+      break;
 
-    if ((pse == NULL) || (pse->id != entry->id)) {
-      procstat_entry_t *new;
+  if ((pse == NULL) || (pse->id != entry->id)) {
+    procstat_entry_t *new;
 
-      new = calloc(1, sizeof(*new));
-      if (new == NULL)
-        return;
-      new->id = entry->id;
+    new = calloc(1, sizeof(*new));
+    if (new == NULL)
+      return;
+    new->id = entry->id;
 
-      if (pse == NULL)
-        ps->instances = new;
-      else
-        pse->next = new;
+    if (pse == NULL)
+      ps->instances = new;
+    else
+      pse->next = new;
 
-      pse = new;
-    }
+    pse = new;
+  }
 
-    pse->age = 0;
-
-    ps->num_proc += entry->num_proc;
-    ps->num_lwp += entry->num_lwp;
-    ps->num_fd += entry->num_fd;
-    ps->num_maps += entry->num_maps;
-    ps->vmem_size += entry->vmem_size;
-    ps->vmem_rss += entry->vmem_rss;
-    ps->vmem_data += entry->vmem_data;
-    ps->vmem_code += entry->vmem_code;
-    ps->stack_size += entry->stack_size;
-
-    if ((entry->io_rchar != -1) && (entry->io_wchar != -1)) {
-      ps_update_counter(&ps->io_rchar, &pse->io_rchar, entry->io_rchar);
-      ps_update_counter(&ps->io_wchar, &pse->io_wchar, entry->io_wchar);
-    }
+  pse->age = 0;
+
+  ps->num_proc += entry->num_proc;
+  ps->num_lwp += entry->num_lwp;
+  ps->num_fd += entry->num_fd;
+  ps->num_maps += entry->num_maps;
+  ps->vmem_size += entry->vmem_size;
+  ps->vmem_rss += entry->vmem_rss;
+  ps->vmem_data += entry->vmem_data;
+  ps->vmem_code += entry->vmem_code;
+  ps->stack_size += entry->stack_size;
+
+  if ((entry->io_rchar != -1) && (entry->io_wchar != -1)) {
+    ps_update_counter(&ps->io_rchar, &pse->io_rchar, entry->io_rchar);
+    ps_update_counter(&ps->io_wchar, &pse->io_wchar, entry->io_wchar);
+  }
 
-    if ((entry->io_syscr != -1) && (entry->io_syscw != -1)) {
-      ps_update_counter(&ps->io_syscr, &pse->io_syscr, entry->io_syscr);
-      ps_update_counter(&ps->io_syscw, &pse->io_syscw, entry->io_syscw);
-    }
+  if ((entry->io_syscr != -1) && (entry->io_syscw != -1)) {
+    ps_update_counter(&ps->io_syscr, &pse->io_syscr, entry->io_syscr);
+    ps_update_counter(&ps->io_syscw, &pse->io_syscw, entry->io_syscw);
+  }
 
-    if ((entry->io_diskr != -1) && (entry->io_diskw != -1)) {
-      ps_update_counter(&ps->io_diskr, &pse->io_diskr, entry->io_diskr);
-      ps_update_counter(&ps->io_diskw, &pse->io_diskw, entry->io_diskw);
-    }
+  if ((entry->io_diskr != -1) && (entry->io_diskw != -1)) {
+    ps_update_counter(&ps->io_diskr, &pse->io_diskr, entry->io_diskr);
+    ps_update_counter(&ps->io_diskw, &pse->io_diskw, entry->io_diskw);
+  }
 
-    if ((entry->cswitch_vol != -1) && (entry->cswitch_invol != -1)) {
-      ps_update_counter(&ps->cswitch_vol, &pse->cswitch_vol,
-                        entry->cswitch_vol);
-      ps_update_counter(&ps->cswitch_invol, &pse->cswitch_invol,
-                        entry->cswitch_invol);
-    }
+  if ((entry->cswitch_vol != -1) && (entry->cswitch_invol != -1)) {
+    ps_update_counter(&ps->cswitch_vol, &pse->cswitch_vol, entry->cswitch_vol);
+    ps_update_counter(&ps->cswitch_invol, &pse->cswitch_invol,
+                      entry->cswitch_invol);
+  }
 
-    ps_update_counter(&ps->vmem_minflt_counter, &pse->vmem_minflt_counter,
-                      entry->vmem_minflt_counter);
-    ps_update_counter(&ps->vmem_majflt_counter, &pse->vmem_majflt_counter,
-                      entry->vmem_majflt_counter);
+  ps_update_counter(&ps->vmem_minflt_counter, &pse->vmem_minflt_counter,
+                    entry->vmem_minflt_counter);
+  ps_update_counter(&ps->vmem_majflt_counter, &pse->vmem_majflt_counter,
+                    entry->vmem_majflt_counter);
 
-    ps_update_counter(&ps->cpu_user_counter, &pse->cpu_user_counter,
-                      entry->cpu_user_counter);
-    ps_update_counter(&ps->cpu_system_counter, &pse->cpu_system_counter,
-                      entry->cpu_system_counter);
+  ps_update_counter(&ps->cpu_user_counter, &pse->cpu_user_counter,
+                    entry->cpu_user_counter);
+  ps_update_counter(&ps->cpu_system_counter, &pse->cpu_system_counter,
+                    entry->cpu_system_counter);
 
 #if HAVE_LIBTASKSTATS
-    ps_update_delay(ps, pse, entry);
+  ps_update_delay(ps, pse, entry);
 #endif
+} /* void ps_list_add_one */
+
+#if !KERNEL_LINUX
+/* add process entry to 'instances' of process 'name' (or refresh it). On
+ * Linux, processes are matched by ps_scan_pid() instead. */
+static void ps_list_add(const char *name, const char *cmdline,
+                        process_entry_t *entry) {
+  if (entry->id == 0)
+    return;
+
+  for (procstat_t *ps = list_head_g; ps != NULL; ps = ps->next) {
+    if ((ps_list_match(name, cmdline, ps)) == 0)
+      continue;
+
+    ps_list_add_one(ps, entry);
   }
 }
+#endif
 
 /* remove old entries from instances of processes in list_head_g */
 static void ps_list_reset(void) {
@@ -723,6 +771,25 @@ static int ps_config(oconfig_item_t *ci) {
 #else
       WARNING("processes plugin: The plugin has been compiled without support "
               "for the \"CollectDelayAccounting\" option.");
+#endif
+    } else if (strcasecmp(c->key, "ScanThreads") == 0) {
+#if KERNEL_LINUX
+      int tmp = 0;
+      if ((cf_util_get_int(c, &tmp) != 0) || (tmp < 1)) {
+        ERROR("processes plugin: `ScanThreads' expects a positive integer.");
+        continue;
+      }
+      scan_threads_g = (size_t)tmp;
+#else
+      WARNING("processes plugin: The \"ScanThreads\" option is only "
+              "supported on Linux.");
+#endif
+    } else if (strcasecmp(c->key, "ProcessEvents") == 0) {
+#if KERNEL_LINUX && HAVE_LINUX_CN_PROC_H
+      cf_util_get_boolean(c, &ps_events);
+#else
+      WARNING("processes plugin: The plugin has been compiled without support "
+              "for the \"ProcessEvents\" option.");
 #endif
     } else {
       ERROR("processes plugin: The `%s' configuration option is not "
@@ -762,6 +829,17 @@ static int ps_init(void) {
   pagesize_g = sysconf(_SC_PAGESIZE);
   DEBUG("pagesize_g = %li; CONFIG_HZ = %i;", pagesize_g, CONFIG_HZ);
 
+  if (proc_fd_g < 0) {
+    proc_fd_g = open("/proc", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (proc_fd_g < 0)
+      WARNING("processes plugin: Opening /proc failed: %s", STRERRNO);
+  }
+
+  if (ps_scan_init() != 0) {
+    ERROR("processes plugin: Initializing the scan threads failed.");
+    return -1;
+  }
+
 #if HAVE_LIBTASKSTATS
   if (taskstats_handle == NULL) {
     taskstats_handle = ts_create();
@@ -770,6 +848,14 @@ static int ps_init(void) {
     }
   }
 #endif
+
+#if HAVE_LINUX_CN_PROC_H
+  if (ps_events && (ps_events_init() != 0)) {
+    WARNING("processes plugin: Tracking processes with the proc connector "
+            "failed. Falling back to scanning /proc.");
+    ps_events = 0;
+  }
+#endif
 /* #endif KERNEL_LINUX */
 
 #elif HAVE_LIBKVM_GETPROCS &&                                                  \
@@ -968,8 +1054,78 @@ static void ps_submit_fork_rate(derive_t value) {
 
 /* ------- additional functions for KERNEL_LINUX/HAVE_THREAD_INFO ------- */
 #if KERNEL_LINUX
+/* Opens /proc/<pid>/<file> relative to proc_fd_g. */
+static int ps_openat(long pid, const char *file, int flags) {
+  char path[64];
+
+  if (proc_fd_g < 0) {
+    snprintf(path, sizeof(path), "/proc/%li/%s", pid, file);
+    return open(path, flags | O_CLOEXEC);
+  }
+
+  snprintf(path, sizeof(path), "%li/%s", pid, file);
+  return openat(proc_fd_g, path, flags | O_CLOEXEC);
+} /* int ps_openat */
+
+static FILE *ps_fopenat(long pid, const char *file) {
+  FILE *fh;
+  int fd;
+
+  fd = ps_openat(pid, file, O_RDONLY);
+  if (fd < 0)
+    return NULL;
+
+  fh = fdopen(fd, "r");
+  if (fh == NULL)
+    close(fd);
+
+  return fh;
+} /* FILE *ps_fopenat */
+
+static DIR *ps_opendirat(long pid, const char *dir) {
+  DIR *dh;
+  int fd;
+
+  fd = ps_openat(pid, dir, O_RDONLY | O_DIRECTORY);
+  if (fd < 0)
+    return NULL;
+
+  dh = fdopendir(fd);
+  if (dh == NULL)
+    close(fd);
+
+  return dh;
+} /* DIR *ps_opendirat */
+
+/* Reads up to "bufsize" bytes of /proc/<pid>/<file> into "buf". Returns the
+ * number of bytes read or a negative value on error. */
+static ssize_t ps_read_file(long pid, const char *file, char *buf,
+                            size_t bufsize) {
+  ssize_t total = 0;
+  int fd;
+
+  fd = ps_openat(pid, file, O_RDONLY);
+  if (fd < 0)
+    return -1;
+
+  while ((size_t)total < bufsize) {
+    ssize_t status = read(fd, buf + total, bufsize - (size_t)total);
+    if (status < 0) {
+      if (errno == EINTR)
+        continue;
+      close(fd);
+      return -1;
+    }
+    if (status == 0)
+      break;
+    total += status;
+  }
+
+  close(fd);
+  return total;
+} /* ssize_t ps_read_file */
+
 static int ps_read_tasks_status(process_entry_t *ps) {
-  char dirname[64];
   DIR *dh;
   char filename[64];
   FILE *fh;
@@ -980,10 +1136,8 @@ static int ps_read_tasks_status(process_entry_t *ps) {
   char *fields[8];
   int numfields;
 
-  snprintf(dirname, sizeof(dirname), "/proc/%li/task", ps->id);
-
-  if ((dh = opendir(dirname)) == NULL) {
-    DEBUG("Failed to open directory `%s'", dirname);
+  if ((dh = ps_opendirat(ps->id, "task")) == NULL) {
+    DEBUG("Failed to open directory `/proc/%li/task'", ps->id);
     return -1;
   }
 
@@ -995,14 +1149,14 @@ static int ps_read_tasks_status(process_entry_t *ps) {
 
     tpid = ent->d_name;
 
-    if (snprintf(filename, sizeof(filename), "/proc/%li/task/%s/status", ps->id,
-                 tpid) >= sizeof(filename)) {
+    if (snprintf(filename, sizeof(filename), "task/%s/status", tpid) >=
+        sizeof(filename)) {
       DEBUG("Filename too long: `%s'", filename);
       continue;
     }
 
-    if ((fh = fopen(filename, "r")) == NULL) {
-      DEBUG("Failed to open file `%s'", filename);
+    if ((fh = ps_fopenat(ps->id, filename)) == NULL) {
+      DEBUG("Failed to open file `/proc/%li/%s'", ps->id, filename);
       continue;
     }
 
@@ -1047,7 +1201,6 @@ static int ps_read_tasks_status(process_entry_t *ps) {
 static int ps_read_status(long pid, process_entry_t *ps) {
   FILE *fh;
   char buffer[1024];
-  char filename[64];
   unsigned long lib = 0;
   unsigned long exe = 0;
   unsigned long data = 0;
@@ -1055,8 +1208,7 @@ static int ps_read_status(long pid, process_entry_t *ps) {
   char *fields[8];
   int numfields;
 
-  snprintf(filename, sizeof(filename), "/proc/%li/status", pid);
-  if ((fh = fopen(filename, "r")) == NULL)
+  if ((fh = ps_fopenat(pid, "status")) == NULL)
     return -1;
 
   while (fgets(buffer, sizeof(buffer), fh) != NULL) {
@@ -1102,14 +1254,12 @@ static int ps_read_status(long pid, process_entry_t *ps) {
 static int ps_read_io(process_entry_t *ps) {
   FILE *fh;
   char buffer[1024];
-  char filename[64];
 
   char *fields[8];
   int numfields;
 
-  snprintf(filename, sizeof(filename), "/proc/%li/io", ps->id);
-  if ((fh = fopen(filename, "r")) == NULL) {
-    DEBUG("ps_read_io: Failed to open file `%s'", filename);
+  if ((fh = ps_fopenat(ps->id, "io")) == NULL) {
+    DEBUG("ps_read_io: Failed to open file `/proc/%li/io'", ps->id);
     return -1;
   }
 
@@ -1156,12 +1306,10 @@ static int ps_read_io(process_entry_t *ps) {
 static int ps_count_maps(pid_t pid) {
   FILE *fh;
   char buffer[1024];
-  char filename[64];
   int count = 0;
 
-  snprintf(filename, sizeof(filename), "/proc/%d/maps", pid);
-  if ((fh = fopen(filename, "r")) == NULL) {
-    DEBUG("ps_count_maps: Failed to open file `%s'", filename);
+  if ((fh = ps_fopenat(pid, "maps")) == NULL) {
+    DEBUG("ps_count_maps: Failed to open file `/proc/%d/maps'", pid);
     return -1;
   }
 
@@ -1178,15 +1326,12 @@ static int ps_count_maps(pid_t pid) {
 } /* int ps_count_maps (...) */
 
 static int ps_count_fd(int pid) {
-  char dirname[64];
   DIR *dh;
   struct dirent *ent;
   int count = 0;
 
-  snprintf(dirname, sizeof(dirname), "/proc/%i/fd", pid);
-
-  if ((dh = opendir(dirname)) == NULL) {
-    DEBUG("Failed to open directory `%s'", dirname);
+  if ((dh = ps_opendirat(pid, "fd")) == NULL) {
+    DEBUG("Failed to open directory `/proc/%i/fd'", pid);
     return -1;
   }
   while ((ent = readdir(dh)) != NULL) {
@@ -1201,12 +1346,7 @@ static int ps_count_fd(int pid) {
 } /* int ps_count_fd (pid) */
 
 #if HAVE_LIBTASKSTATS
-static int ps_delay(process_entry_t *ps) {
-  if (taskstats_handle == NULL) {
-    return ENOTCONN;
-  }
-
-  int status = ts_delay_by_tgid(taskstats_handle, (uint32_t)ps->id, &ps->delay);
+static void ps_delay_error(int status) {
   if (status == EPERM) {
     static c_complain_t c;
 #if defined(HAVE_SYS_CAPABILITY_H) && defined(CAP_NET_ADMIN)
@@ -1241,9 +1381,19 @@ static int ps_delay(process_entry_t *ps) {
                "Reading Delay Accounting metrics requires root privileges.",
                STRERROR(status));
 #endif
-    return status;
   } else if (status != 0) {
     ERROR("processes plugin: ts_delay_by_tgid failed: %s", STRERROR(status));
+  }
+} /* void ps_delay_error */
+
+static int ps_delay(process_entry_t *ps) {
+  if (taskstats_handle == NULL) {
+    return ENOTCONN;
+  }
+
+  int status = ts_delay_by_tgid(taskstats_handle, (uint32_t)ps->id, &ps->delay);
+  if (status != 0) {
+    ps_delay_error(status);
     return status;
   }
 
@@ -1251,7 +1401,9 @@ static int ps_delay(process_entry_t *ps) {
 }
 #endif
 
-static void ps_fill_details(const procstat_t *ps, process_entry_t *entry) {
+/* Reads the details requested by "ps" from /proc. Delay accounting is read
+ * separately by ps_fill_details() or ps_scan_delay(). */
+static void ps_fill_proc_details(const procstat_t *ps, process_entry_t *entry) {
   if (entry->has_io == 0) {
     ps_read_io(entry);
     entry->has_io = 1;
@@ -1279,6 +1431,10 @@ static void ps_fill_details(const procstat_t *ps, process_entry_t *entry) {
     }
     entry->has_fd = 1;
   }
+} /* void ps_fill_proc_details (...) */
+
+static void ps_fill_details(const procstat_t *ps, process_entry_t *entry) {
+  ps_fill_proc_details(ps, entry);
 
 #if HAVE_LIBTASKSTATS
   if (ps->report_delay && !entry->has_delay) {
@@ -1291,7 +1447,6 @@ static void ps_fill_details(const procstat_t *ps, process_entry_t *entry) {
 
 /* ps_read_process reads process counters on Linux. */
 static int ps_read_process(long pid, process_entry_t *ps, char *state) {
-  char filename[64];
   char buffer[1024];
 
   char *fields[64];
@@ -1312,9 +1467,7 @@ static int ps_read_process(long pid, process_entry_t *ps, char *state) {
 
   ssize_t status;
 
-  snprintf(filename, sizeof(filename), "/proc/%li/stat", pid);
-
-  status = read_file_contents(filename, buffer, sizeof(buffer) - 1);
+  status = ps_read_file(pid, "stat", buffer, sizeof(buffer) - 1);
   if (status <= 0)
     return -1;
   buffer_len = (size_t)status;
@@ -1355,8 +1508,8 @@ static int ps_read_process(long pid, process_entry_t *ps, char *state) {
   fields_len = strsplit(buffer_ptr, fields, STATIC_ARRAY_SIZE(fields));
   if (fields_len < 22) {
     DEBUG("processes plugin: ps_read_process (pid = %li):"
-          " `%s' has only %i fields..",
-          pid, filename, fields_len);
+          " `/proc/%li/stat' has only %i fields..",
+          pid, pid, fields_len);
     return -1;
   }
 
@@ -1442,7 +1595,7 @@ static char *ps_get_cmdline(long pid, char *name, char *buf, size_t buf_len) {
   snprintf(file, sizeof(file), "/proc/%li/cmdline", pid);
 
   errno = 0;
-  fd = open(file, O_RDONLY);
+  fd = ps_openat(pid, "cmdline", O_RDONLY);
   if (fd < 0) {
     /* ENOENT means the process exited while we were handling it.
      * Don't complain about this, it only fills the logs. */
@@ -1517,7 +1670,9 @@ static char *ps_get_cmdline(long pid, char *name, char *buf, size_t buf_len) {
   return buf;
 } /* char *ps_get_cmdline (...) */
 
-static int read_fork_rate(void) {
+/* Reads the fork rate and, if "with_states" is true, the number of running
+ * and blocked tasks from /proc/stat. */
+static int read_fork_rate(_Bool with_states) {
   FILE *proc_stat;
   char buffer[1024];
   value_t value;
@@ -1538,6 +1693,11 @@ static int read_fork_rate(void) {
     if (fields_num != 2)
       continue;
 
+    if (with_states && (strcmp("procs_running", fields[0]) == 0))
+      ps_submit_state("running", atof(fields[1]));
+    else if (with_states && (strcmp("procs_blocked", fields[0]) == 0))
+      ps_submit_state("blocked", atof(fields[1]));
+
     if (strcmp("processes", fields[0]) != 0)
       continue;
 
@@ -1545,7 +1705,8 @@ static int read_fork_rate(void) {
     if (status == 0)
       value_valid = 1;
 
-    break;
+    if (!with_states)
+      break;
   }
   fclose(proc_stat);
 
@@ -1555,6 +1716,898 @@ static int read_fork_rate(void) {
   ps_submit_fork_rate(value.derive);
   return 0;
 }
+
+/* A process which matches at least one of the configured processes. */
+typedef struct {
+  process_entry_t entry;
+  size_t matches_first;
+  size_t matches_num;
+} ps_scan_result_t;
+
+/* State of one scanning thread. The arrays are kept between reads, so that
+ * memory is only allocated when the number of matching processes grows. */
+typedef struct {
+  ps_scan_result_t *results;
+  size_t results_num;
+  size_t results_size;
+
+  procstat_t **matches;
+  size_t matches_num;
+  size_t matches_size;
+
+  int running;
+  int sleeping;
+  int zombies;
+  int stopped;
+  int paging;
+  int blocked;
+
+  char cmdline[CMDLINE_BUFFER_SIZE];
+} ps_scan_shard_t;
+
+/* Number of PIDs a thread takes from the list at once. */
+#define PS_SCAN_CHUNK 32
+
+static ps_scan_shard_t *scan_shards_g = NULL;
+static pthread_t *scan_workers_g = NULL;
+static size_t scan_workers_num_g = 0;
+
+static long *scan_pids_g = NULL;
+static size_t scan_pids_num_g = 0;
+static size_t scan_pids_size_g = 0;
+static size_t scan_next_g = 0;
+
+static pthread_mutex_t scan_lock_g = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t scan_start_cond_g = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t scan_done_cond_g = PTHREAD_COND_INITIALIZER;
+static unsigned long scan_generation_g = 0;
+static size_t scan_busy_g = 0;
+static _Bool scan_shutdown_g = 0;
+
+static int ps_scan_add_match(ps_scan_shard_t *shard, procstat_t *ps) {
+  if (shard->matches_num >= shard->matches_size) {
+    size_t size = (shard->matches_size == 0) ? 16 : 2 * shard->matches_size;
+    procstat_t **tmp = realloc(shard->matches, size * sizeof(*tmp));
+    if (tmp == NULL)
+      return ENOMEM;
+    shard->matches = tmp;
+    shard->matches_size = size;
+  }
+
+  shard->matches[shard->matches_num] = ps;
+  shard->matches_num++;
+  return 0;
+} /* int ps_scan_add_match */
+
+static ps_scan_result_t *ps_scan_add_result(ps_scan_shard_t *shard) {
+  if (shard->results_num >= shard->results_size) {
+    size_t size = (shard->results_size == 0) ? 16 : 2 * shard->results_size;
+    ps_scan_result_t *tmp = realloc(shard->results, size * sizeof(*tmp));
+    if (tmp == NULL)
+      return NULL;
+    shard->results = tmp;
+    shard->results_size = size;
+  }
+
+  shard->results_num++;
+  return shard->results + (shard->results_num - 1);
+} /* ps_scan_result_t *ps_scan_add_result */
+
+/* Reads one process. This runs concurrently in all scanning threads, so it
+ * only modifies "shard". */
+static void ps_scan_pid(ps_scan_shard_t *shard, long pid) {
+  process_entry_t pse = {0};
+  ps_scan_result_t *result;
+  size_t matches_first;
+  char *cmdline;
+  char state;
+
+  pse.id = pid;
+  if (ps_read_process(pid, &pse, &state) != 0) {
+    DEBUG("ps_read_process failed for pid %li", pid);
+    return;
+  }
+
+  switch (state) {
+  case 'R':
+    shard->running++;
+    break;
+  case 'S':
+    shard->sleeping++;
+    break;
+  case 'D':
+    shard->blocked++;
+    break;
+  case 'Z':
+    shard->zombies++;
+    break;
+  case 'T':
+    shard->stopped++;
+    break;
+  case 'W':
+    shard->paging++;
+    break;
+  }
+
+  if (list_head_g == NULL)
+    return;
+
+  cmdline = ps_get_cmdline(pid, pse.name, shard->cmdline,
+                           sizeof(shard->cmdline));
+
+  matches_first = shard->matches_num;
+  for (procstat_t *ps = list_head_g; ps != NULL; ps = ps->next) {
+    if (ps_list_match(pse.name, cmdline, ps) == 0)
+      continue;
+    if (ps_scan_add_match(shard, ps) != 0)
+      break;
+    ps_fill_proc_details(ps, &pse);
+  }
+
+  if (shard->matches_num == matches_first)
+    return;
+
+  result = ps_scan_add_result(shard);
+  if (result == NULL) {
+    shard->matches_num = matches_first;
+    return;
+  }
+
+  result->entry = pse;
+  result->matches_first = matches_first;
+  result->matches_num = shard->matches_num - matches_first;
+} /* void ps_scan_pid */
+
+static void ps_scan_run(ps_scan_shard_t *shard) {
+  shard->results_num = 0;
+  shard->matches_num = 0;
+  shard->running = shard->sleeping = shard->zombies = 0;
+  shard->stopped = shard->paging = shard->blocked = 0;
+
+  while (42) {
+    size_t first =
+        __atomic_fetch_add(&scan_next_g, PS_SCAN_CHUNK, __ATOMIC_RELAXED);
+    size_t last = first + PS_SCAN_CHUNK;
+
+    if (first >= scan_pids_num_g)
+      break;
+    if (last > scan_pids_num_g)
+      last = scan_pids_num_g;
+
+    for (size_t i = first; i < last; i++)
+      ps_scan_pid(shard, scan_pids_g[i]);
+  }
+} /* void ps_scan_run */
+
+static void *ps_scan_worker(void *arg) {
+  ps_scan_shard_t *shard = arg;
+  unsigned long generation = 0;
+
+  pthread_mutex_lock(&scan_lock_g);
+  while (!scan_shutdown_g) {
+    if (generation == scan_generation_g) {
+      pthread_cond_wait(&scan_start_cond_g, &scan_lock_g);
+      continue;
+    }
+    generation = scan_generation_g;
+    pthread_mutex_unlock(&scan_lock_g);
+
+    ps_scan_run(shard);
+
+    pthread_mutex_lock(&scan_lock_g);
+    scan_busy_g--;
+    if (scan_busy_g == 0)
+      pthread_cond_signal(&scan_done_cond_g);
+  }
+  pthread_mutex_unlock(&scan_lock_g);
+
+  return NULL;
+} /* void *ps_scan_worker */
+
+static int ps_scan_init(void) {
+  if (scan_shards_g != NULL)
+    return 0;
+
+  scan_shards_g = calloc(scan_threads_g, sizeof(*scan_shards_g));
+  if (scan_shards_g == NULL)
+    return ENOMEM;
+
+  if (scan_threads_g < 2)
+    return 0;
+
+  scan_workers_g = calloc(scan_threads_g - 1, sizeof(*scan_workers_g));
+  if (scan_workers_g == NULL)
+    return ENOMEM;
+
+  /* The read thread takes the first shard itself. */
+  for (size_t i = 1; i < scan_threads_g; i++) {
+    int status = plugin_thread_create(&scan_workers_g[scan_workers_num_g],
+                                      /* attr = */ NULL, ps_scan_worker,
+                                      scan_shards_g + i, "processes scan");
+    if (status != 0) {
+      WARNING("processes plugin: Starting scan thread #%" PRIsz
+              " failed: %s",
+              i, STRERROR(status));
+      break;
+    }
+    scan_workers_num_g++;
+  }
+
+  return 0;
+} /* int ps_scan_init */
+
+static void ps_scan_destroy(void) {
+  pthread_mutex_lock(&scan_lock_g);
+  scan_shutdown_g = 1;
+  pthread_cond_broadcast(&scan_start_cond_g);
+  pthread_mutex_unlock(&scan_lock_g);
+
+  for (size_t i = 0; i < scan_workers_num_g; i++)
+    pthread_join(scan_workers_g[i], /* retval = */ NULL);
+  sfree(scan_workers_g);
+  scan_workers_num_g = 0;
+
+  for (size_t i = 0; (scan_shards_g != NULL) && (i < scan_threads_g); i++) {
+    sfree(scan_shards_g[i].results);
+    sfree(scan_shards_g[i].matches);
+  }
+  sfree(scan_shards_g);
+
+  sfree(scan_pids_g);
+  scan_pids_num_g = 0;
+  scan_pids_size_g = 0;
+} /* void ps_scan_destroy */
+
+/* Lists the PIDs below /proc into scan_pids_g. */
+static int ps_scan_list_pids(void) {
+  struct dirent *ent;
+  DIR *proc;
+
+  if ((proc = opendir("/proc")) == NULL) {
+    ERROR("Cannot open `/proc': %s", STRERRNO);
+    return -1;
+  }
+
+  scan_pids_num_g = 0;
+  while ((ent = readdir(proc)) != NULL) {
+    long pid;
+
+    if (!isdigit(ent->d_name[0]))
+      continue;
+
+    if ((pid = atol(ent->d_name)) < 1)
+      continue;
+
+    if (scan_pids_num_g >= scan_pids_size_g) {
+      size_t size = (scan_pids_size_g == 0) ? 1024 : 2 * scan_pids_size_g;
+      long *tmp = realloc(scan_pids_g, size * sizeof(*tmp));
+      if (tmp == NULL) {
+        ERROR("processes plugin: realloc failed.");
+        closedir(proc);
+        return ENOMEM;
+      }
+      scan_pids_g = tmp;
+      scan_pids_size_g = size;
+    }
+
+    scan_pids_g[scan_pids_num_g] = pid;
+    scan_pids_num_g++;
+  }
+
+  closedir(proc);
+  return 0;
+} /* int ps_scan_list_pids */
+
+#if HAVE_LIBTASKSTATS
+/* Reads the delay accounting information of all matching processes with
+ * pipelined taskstats requests. */
+static void ps_scan_delay(void) {
+  process_entry_t **entries = NULL;
+  uint32_t *tgids = NULL;
+  ts_delay_t *delays = NULL;
+  int *status = NULL;
+  size_t num = 0;
+  size_t size = 0;
+
+  if (taskstats_handle == NULL)
+    return;
+
+  for (size_t i = 0; i < scan_threads_g; i++)
+    size += scan_shards_g[i].results_num;
+  if (size == 0)
+    return;
+
+  entries = calloc(size, sizeof(*entries));
+  tgids = calloc(size, sizeof(*tgids));
+  delays = calloc(size, sizeof(*delays));
+  status = calloc(size, sizeof(*status));
+  if ((entries == NULL) || (tgids == NULL) || (delays == NULL) ||
+      (status == NULL))
+    goto out;
+
+  for (size_t i = 0; i < scan_threads_g; i++) {
+    ps_scan_shard_t *shard = scan_shards_g + i;
+
+    for (size_t j = 0; j < shard->results_num; j++) {
+      ps_scan_result_t *result = shard->results + j;
+      _Bool want_delay = 0;
+
+      for (size_t k = 0; k < result->matches_num; k++)
+        if (shard->matches[result->matches_first + k]->report_delay)
+          want_delay = 1;
+
+      if (!want_delay)
+        continue;
+
+      /* Don't query the process once more in ps_fill_details(). */
+      result->entry.has_delay = 1;
+
+      entries[num] = &result->entry;
+      tgids[num] = (uint32_t)result->entry.id;
+      num++;
+    }
+  }
+
+  if (num == 0)
+    goto out;
+
+  int err = ts_delay_by_tgids(taskstats_handle, tgids, num, delays, status);
+  if (err != 0) {
+    ps_delay_error(err);
+    goto out;
+  }
+
+  for (size_t i = 0; i < num; i++) {
+    if (status[i] != 0) {
+      ps_delay_error(status[i]);
+      continue;
+    }
+    entries[i]->delay = delays[i];
+  }
+
+out:
+  sfree(entries);
+  sfree(tgids);
+  sfree(delays);
+  sfree(status);
+} /* void ps_scan_delay */
+#endif /* HAVE_LIBTASKSTATS */
+
+/* Reads all processes, using the scan threads if configured, and adds the
+ * matching ones to list_head_g. */
+static int ps_scan(void) {
+  int status;
+
+  if (scan_shards_g == NULL)
+    return -1;
+
+  status = ps_scan_list_pids();
+  if (status != 0)
+    return status;
+
+  pthread_mutex_lock(&scan_lock_g);
+  scan_next_g = 0;
+  scan_busy_g = scan_workers_num_g;
+  scan_generation_g++;
+  pthread_cond_broadcast(&scan_start_cond_g);
+  pthread_mutex_unlock(&scan_lock_g);
+
+  ps_scan_run(scan_shards_g);
+
+  pthread_mutex_lock(&scan_lock_g);
+  while (scan_busy_g > 0)
+    pthread_cond_wait(&scan_done_cond_g, &scan_lock_g);
+  pthread_mutex_unlock(&scan_lock_g);
+
+#if HAVE_LIBTASKSTATS
+  ps_scan_delay();
+#endif
+
+  for (size_t i = 0; i < scan_threads_g; i++) {
+    ps_scan_shard_t *shard = scan_shards_g + i;
+
+    for (size_t j = 0; j < shard->results_num; j++) {
+      ps_scan_result_t *result = shard->results + j;
+
+      for (size_t k = 0; k < result->matches_num; k++)
+        ps_list_add_one(shard->matches[result->matches_first + k],
+                        &result->entry);
+    }
+  }
+
+  return 0;
+} /* int ps_scan */
+
+#if HAVE_LINUX_CN_PROC_H
+static int ps_pid_compare(const void *a, const void *b) {
+  long pid_a = *(const long *)a;
+  long pid_b = *(const long *)b;
+
+  return (pid_a > pid_b) - (pid_a < pid_b);
+} /* int ps_pid_compare */
+
+static void ps_pid_free(ps_pid_t *p) {
+  if (p == NULL)
+    return;
+
+  sfree(p->matches);
+  sfree(p);
+} /* void ps_pid_free */
+
+/* Returns the entry of "pid", creating a dirty one if it is not known yet.
+ * Must be called with ps_events_lock held. */
+static ps_pid_t *ps_pid_get(long pid) {
+  ps_pid_t *p = NULL;
+
+  if (c_avl_get(ps_events_pids, &pid, (void *)&p) == 0)
+    return p;
+
+  p = calloc(1, sizeof(*p));
+  if (p == NULL)
+    return NULL;
+  p->pid = pid;
+  p->dirty = 1;
+
+  if (c_avl_insert(ps_events_pids, &p->pid, p) != 0) {
+    sfree(p);
+    return NULL;
+  }
+
+  return p;
+} /* ps_pid_t *ps_pid_get */
+
+static void ps_pid_remove(long pid) {
+  void *key = NULL;
+  ps_pid_t *p = NULL;
+
+  if (c_avl_remove(ps_events_pids, &pid, &key, (void *)&p) == 0)
+    ps_pid_free(p);
+} /* void ps_pid_remove */
+
+static void ps_pid_clear(void) {
+  void *key = NULL;
+  ps_pid_t *p = NULL;
+
+  while (c_avl_pick(ps_events_pids, &key, (void *)&p) == 0)
+    ps_pid_free(p);
+} /* void ps_pid_clear */
+
+/* Matches a dirty entry against all configured processes. */
+static int ps_pid_match(ps_pid_t *p, const char *name, const char *cmdline) {
+  sfree(p->matches);
+  p->matches_num = 0;
+
+  for (procstat_t *ps = list_head_g; ps != NULL; ps = ps->next) {
+    procstat_t **tmp;
+
+    if (ps_list_match(name, cmdline, ps) == 0)
+      continue;
+
+    tmp = realloc(p->matches, (p->matches_num + 1) * sizeof(*p->matches));
+    if (tmp == NULL)
+      return ENOMEM;
+    p->matches = tmp;
+    p->matches[p->matches_num] = ps;
+    p->matches_num++;
+  }
+
+  p->dirty = 0;
+  return 0;
+} /* int ps_pid_match */
+
+/* A forked child runs the parent's program until it calls exec(2), so it
+ * inherits the parent's matches. */
+static void ps_pid_fork(long parent_pid, long child_pid) {
+  ps_pid_t *parent = NULL;
+  ps_pid_t *child;
+
+  child = ps_pid_get(child_pid);
+  if (child == NULL)
+    return;
+
+  sfree(child->matches);
+  child->matches_num = 0;
+  child->dirty = 1;
+
+  if ((c_avl_get(ps_events_pids, &parent_pid, (void *)&parent) != 0) ||
+      parent->dirty)
+    return;
+
+  if (parent->matches_num > 0) {
+    child->matches = calloc(parent->matches_num, sizeof(*child->matches));
+    if (child->matches == NULL)
+      return;
+    memcpy(child->matches, parent->matches,
+           parent->matches_num * sizeof(*child->matches));
+    child->matches_num = parent->matches_num;
+  }
+
+  child->dirty = 0;
+} /* void ps_pid_fork */
+
+/* Must be called with ps_events_lock held. */
+static void ps_events_handle(const struct proc_event *ev) {
+  ps_pid_t *p;
+
+  switch (ev->what) {
+  case PROC_EVENT_FORK:
+    /* Threads are accounted for with their process. */
+    if (ev->event_data.fork.child_pid != ev->event_data.fork.child_tgid)
+      break;
+    ps_pid_fork(ev->event_data.fork.parent_tgid,
+                ev->event_data.fork.child_pid);
+    break;
+
+  case PROC_EVENT_EXEC:
+    p = ps_pid_get(ev->event_data.exec.process_tgid);
+    if (p != NULL)
+      p->dirty = 1;
+    break;
+
+  case PROC_EVENT_EXIT:
+    if (ev->event_data.exit.process_pid == ev->event_data.exit.process_tgid)
+      ps_pid_remove(ev->event_data.exit.process_pid);
+    break;
+
+  default:
+    break;
+  }
+} /* void ps_events_handle */
+
+/* Calls "callback" for every proc connector event in "buf". Returns EIO if
+ * the kernel reported that events have been lost. */
+static int ps_events_parse(const char *buf, size_t len,
+                           void (*callback)(const struct proc_event *)) {
+  for (const struct nlmsghdr *nlh = (const void *)buf; NLMSG_OK(nlh, len);
+       nlh = NLMSG_NEXT(nlh, len)) {
+    const struct cn_msg *msg;
+
+    if ((nlh->nlmsg_type == NLMSG_ERROR) ||
+        (nlh->nlmsg_type == NLMSG_OVERRUN))
+      return EIO;
+    if (nlh->nlmsg_type == NLMSG_NOOP)
+      continue;
+
+    msg = NLMSG_DATA(nlh);
+    if ((msg->id.idx != CN_IDX_PROC) || (msg->id.val != CN_VAL_PROC) ||
+        (msg->len < sizeof(struct proc_event)))
+      continue;
+
+    callback((const struct proc_event *)msg->data);
+  }
+
+  return 0;
+} /* int ps_events_parse */
+
+static void *ps_events_thread(void __attribute__((unused)) * arg) {
+  char buf[8192] __attribute__((aligned(NLMSG_ALIGNTO)));
+
+  while (42) {
+    struct pollfd pfd = {.fd = ps_events_fd, .events = POLLIN};
+    ssize_t len;
+    int status;
+
+    pthread_mutex_lock(&ps_events_lock);
+    if (ps_events_shutdown) {
+      pthread_mutex_unlock(&ps_events_lock);
+      break;
+    }
+    pthread_mutex_unlock(&ps_events_lock);
+
+    /* Wake up once per second to check for shutdown. */
+    status = poll(&pfd, 1, 1000);
+    if ((status < 0) && (errno != EINTR)) {
+      ERROR("processes plugin: poll failed: %s", STRERRNO);
+      break;
+    } else if (status <= 0) {
+      continue;
+    }
+
+    len = recv(ps_events_fd, buf, sizeof(buf), MSG_DONTWAIT);
+    if (len < 0) {
+      if ((errno == EAGAIN) || (errno == EINTR))
+        continue;
+
+      if (errno == ENOBUFS) {
+        /* Events have been dropped, the process table is incomplete. */
+        pthread_mutex_lock(&ps_events_lock);
+        ps_events_rescan = 1;
+        pthread_mutex_unlock(&ps_events_lock);
+        continue;
+      }
+
+      ERROR("processes plugin: Receiving process events failed: %s",
+            STRERRNO);
+      break;
+    }
+
+    pthread_mutex_lock(&ps_events_lock);
+    if (ps_events_parse(buf, (size_t)len, ps_events_handle) != 0)
+      ps_events_rescan = 1;
+    pthread_mutex_unlock(&ps_events_lock);
+  }
+
+  pthread_mutex_lock(&ps_events_lock);
+  ps_events_running = 0;
+  pthread_mutex_unlock(&ps_events_lock);
+
+  return NULL;
+} /* void *ps_events_thread */
+
+static int ps_events_subscribe(int fd) {
+  char buf[NLMSG_SPACE(sizeof(struct cn_msg) +
+                       sizeof(enum proc_cn_mcast_op))]
+      __attribute__((aligned(NLMSG_ALIGNTO))) = {0};
+  struct nlmsghdr *nlh = (void *)buf;
+  struct cn_msg *msg = NLMSG_DATA(nlh);
+  enum proc_cn_mcast_op op = PROC_CN_MCAST_LISTEN;
+
+  nlh->nlmsg_len = NLMSG_LENGTH(sizeof(*msg) + sizeof(op));
+  nlh->nlmsg_type = NLMSG_DONE;
+  nlh->nlmsg_pid = (__u32)getpid();
+
+  msg->id.idx = CN_IDX_PROC;
+  msg->id.val = CN_VAL_PROC;
+  msg->len = sizeof(op);
+  memcpy(msg->data, &op, sizeof(op));
+
+  if (send(fd, buf, nlh->nlmsg_len, 0) < 0) {
+    ERROR("processes plugin: Subscribing to process events failed: %s",
+          STRERRNO);
+    return -1;
+  }
+
+  return 0;
+} /* int ps_events_subscribe */
+
+static _Bool ps_events_acked;
+static int ps_events_ack_err;
+
+static void ps_events_handle_ack(const struct proc_event *ev) {
+  if (ev->what != PROC_EVENT_NONE)
+    return;
+
+  ps_events_acked = 1;
+  ps_events_ack_err = (int)ev->event_data.ack.err;
+} /* void ps_events_handle_ack */
+
+/* The kernel confirms the subscription with an acknowledgement. It silently
+ * ignores it when collectd runs outside of the initial PID or user namespace
+ * and sends nothing when CAP_NET_ADMIN is missing, so wait for the ack
+ * instead of relying on events to arrive. Events received in the meantime
+ * are covered by the initial scan. */
+static int ps_events_wait_ack(int fd) {
+  char buf[8192] __attribute__((aligned(NLMSG_ALIGNTO)));
+  cdtime_t deadline = cdtime() + TIME_T_TO_CDTIME_T(1);
+
+  ps_events_acked = 0;
+  while (!ps_events_acked) {
+    struct pollfd pfd = {.fd = fd, .events = POLLIN};
+    cdtime_t now = cdtime();
+    ssize_t len;
+
+    if (now >= deadline) {
+      ERROR("processes plugin: The kernel did not confirm the subscription "
+            "to process events. Reading them requires the CAP_NET_ADMIN "
+            "capability in the initial namespace.");
+      return -1;
+    }
+
+    if (poll(&pfd, 1, (int)CDTIME_T_TO_MS(deadline - now)) <= 0)
+      continue;
+
+    len = recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+    if (len < 0) {
+      if ((errno == EAGAIN) || (errno == EINTR) || (errno == ENOBUFS))
+        continue;
+      ERROR("processes plugin: Receiving process events failed: %s",
+            STRERRNO);
+      return -1;
+    }
+
+    ps_events_parse(buf, (size_t)len, ps_events_handle_ack);
+  }
+
+  if (ps_events_ack_err != 0) {
+    ERROR("processes plugin: Subscribing to process events failed: %s",
+          STRERROR(ps_events_ack_err));
+    return -1;
+  }
+
+  return 0;
+} /* int ps_events_wait_ack */
+
+static int ps_events_init(void) {
+  struct sockaddr_nl addr = {
+      .nl_family = AF_NETLINK, .nl_groups = CN_IDX_PROC,
+  };
+  int rcvbuf = PS_EVENTS_RCVBUF;
+  int status;
+
+  if (ps_events_pids == NULL) {
+    ps_events_pids = c_avl_create(ps_pid_compare);
+    if (ps_events_pids == NULL)
+      return -1;
+  }
+
+  ps_events_fd = socket(PF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC,
+                        NETLINK_CONNECTOR);
+  if (ps_events_fd < 0) {
+    ERROR("processes plugin: socket(NETLINK_CONNECTOR) failed: %s", STRERRNO);
+    return -1;
+  }
+
+  if (bind(ps_events_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+    ERROR("processes plugin: Binding the netlink socket failed: %s", STRERRNO);
+    close(ps_events_fd);
+    ps_events_fd = -1;
+    return -1;
+  }
+
+  /* SO_RCVBUFFORCE ignores net.core.rmem_max but requires CAP_NET_ADMIN,
+   * which is needed for the proc connector anyway. */
+  if (setsockopt(ps_events_fd, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf,
+                 sizeof(rcvbuf)) != 0)
+    setsockopt(ps_events_fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+  if ((ps_events_subscribe(ps_events_fd) != 0) ||
+      (ps_events_wait_ack(ps_events_fd) != 0)) {
+    close(ps_events_fd);
+    ps_events_fd = -1;
+    return -1;
+  }
+
+  ps_events_running = 1;
+  ps_events_rescan = 1;
+  status = plugin_thread_create(&ps_events_thread_id, /* attr = */ NULL,
+                                ps_events_thread, /* arg = */ NULL,
+                                "processes events");
+  if (status != 0) {
+    ERROR("processes plugin: Starting the event thread failed: %s",
+          STRERROR(status));
+    ps_events_running = 0;
+    close(ps_events_fd);
+    ps_events_fd = -1;
+    return -1;
+  }
+
+  return 0;
+} /* int ps_events_init */
+
+/* Rebuilds the process table from /proc. Every process is read and matched
+ * once more during the following ps_read_events(). */
+static int ps_events_scan(void) {
+  struct dirent *ent;
+  DIR *proc;
+
+  if ((proc = opendir("/proc")) == NULL) {
+    ERROR("Cannot open `/proc': %s", STRERRNO);
+    return -1;
+  }
+
+  ps_pid_clear();
+
+  while ((ent = readdir(proc)) != NULL) {
+    long pid;
+
+    if (!isdigit(ent->d_name[0]))
+      continue;
+
+    if ((pid = atol(ent->d_name)) < 1)
+      continue;
+
+    ps_pid_get(pid);
+  }
+
+  closedir(proc);
+  return 0;
+} /* int ps_events_scan */
+
+/* Reads only the processes which match one of the configured processes, using
+ * the process table maintained by ps_events_thread(). Returns non-zero if the
+ * table is not available and /proc has to be scanned instead. The number of
+ * processes per state is not available without reading every process; only
+ * the number of running and blocked tasks is reported, from /proc/stat. */
+static int ps_read_events(void) {
+  char cmdline[CMDLINE_BUFFER_SIZE];
+  c_avl_iterator_t *iter;
+  long *gone = NULL;
+  size_t gone_num = 0;
+  void *key;
+  ps_pid_t *p;
+
+  pthread_mutex_lock(&ps_events_lock);
+
+  if (!ps_events_running) {
+    pthread_mutex_unlock(&ps_events_lock);
+    return -1;
+  }
+
+  if (ps_events_rescan) {
+    if (ps_events_scan() != 0) {
+      pthread_mutex_unlock(&ps_events_lock);
+      return -1;
+    }
+    ps_events_rescan = 0;
+  }
+
+  ps_list_reset();
+
+  iter = c_avl_get_iterator(ps_events_pids);
+  while (c_avl_iterator_next(iter, &key, (void *)&p) == 0) {
+    process_entry_t pse = {0};
+    char state;
+
+    if (!p->dirty && (p->matches_num == 0))
+      continue;
+
+    pse.id = p->pid;
+    if (ps_read_process(p->pid, &pse, &state) != 0) {
+      /* The process exited before its exit event arrived, or already before
+       * the scan. */
+      long *tmp = realloc(gone, (gone_num + 1) * sizeof(*gone));
+      if (tmp != NULL) {
+        gone = tmp;
+        gone[gone_num] = p->pid;
+        gone_num++;
+      }
+      continue;
+    }
+
+    if (p->dirty)
+      ps_pid_match(p, pse.name,
+                   ps_get_cmdline(p->pid, pse.name, cmdline, sizeof(cmdline)));
+
+    for (size_t i = 0; i < p->matches_num; i++)
+      ps_list_add_one(p->matches[i], &pse);
+  }
+  c_avl_iterator_destroy(iter);
+
+  for (size_t i = 0; i < gone_num; i++)
+    ps_pid_remove(gone[i]);
+  sfree(gone);
+
+  pthread_mutex_unlock(&ps_events_lock);
+
+  for (procstat_t *ps = list_head_g; ps != NULL; ps = ps->next)
+    ps_submit_proc_list(ps);
+
+  read_fork_rate(/* with_states = */ 1);
+  return 0;
+} /* int ps_read_events */
+
+static void ps_events_destroy(void) {
+  if (!ps_events || (ps_events_fd < 0))
+    return;
+
+  pthread_mutex_lock(&ps_events_lock);
+  ps_events_shutdown = 1;
+  pthread_mutex_unlock(&ps_events_lock);
+
+  pthread_join(ps_events_thread_id, /* retval = */ NULL);
+
+  close(ps_events_fd);
+  ps_events_fd = -1;
+
+  ps_pid_clear();
+  c_avl_destroy(ps_events_pids);
+  ps_events_pids = NULL;
+} /* void ps_events_destroy */
+#endif /* HAVE_LINUX_CN_PROC_H */
+
+static int ps_shutdown(void) {
+#if HAVE_LINUX_CN_PROC_H
+  ps_events_destroy();
+#endif
+  ps_scan_destroy();
+
+  if (proc_fd_g >= 0) {
+    close(proc_fd_g);
+    proc_fd_g = -1;
+  }
+
+  return 0;
+} /* int ps_shutdown */
 #endif /*KERNEL_LINUX */
 
 #if KERNEL_SOLARIS
@@ -2022,67 +3075,30 @@ static int ps_read(void) {
   int paging = 0;
   int blocked = 0;
 
-  struct dirent *ent;
-  DIR *proc;
-  long pid;
-
-  char cmdline[CMDLINE_BUFFER_SIZE];
-
   int status;
-  process_entry_t pse;
-  char state;
-
-  running = sleeping = zombies = stopped = paging = blocked = 0;
-  ps_list_reset();
 
-  if ((proc = opendir("/proc")) == NULL) {
-    ERROR("Cannot open `/proc': %s", STRERRNO);
-    return -1;
+#if HAVE_LINUX_CN_PROC_H
+  if (ps_events && (ps_read_events() == 0)) {
+    want_init = 0;
+    return 0;
   }
+#endif
 
-  while ((ent = readdir(proc)) != NULL) {
-    if (!isdigit(ent->d_name[0]))
-      continue;
-
-    if ((pid = atol(ent->d_name)) < 1)
-      continue;
-
-    memset(&pse, 0, sizeof(pse));
-    pse.id = pid;
-
-    status = ps_read_process(pid, &pse, &state);
-    if (status != 0) {
-      DEBUG("ps_read_process failed: %i", status);
-      continue;
-    }
+  ps_list_reset();
 
-    switch (state) {
-    case 'R':
-      running++;
-      break;
-    case 'S':
-      sleeping++;
-      break;
-    case 'D':
-      blocked++;
-      break;
-    case 'Z':
-      zombies++;
-      break;
-    case 'T':
-      stopped++;
-      break;
-    case 'W':
-      paging++;
-      break;
-    }
+  status = ps_scan();
+  if (status != 0)
+    return -1;
 
-    ps_list_add(pse.name,
-                ps_get_cmdline(pid, pse.name, cmdline, sizeof(cmdline)), &pse);
+  for (size_t i = 0; i < scan_threads_g; i++) {
+    running += scan_shards_g[i].running;
+    sleeping += scan_shards_g[i].sleeping;
+    zombies += scan_shards_g[i].zombies;
+    stopped += scan_shards_g[i].stopped;
+    paging += scan_shards_g[i].paging;
+    blocked += scan_shards_g[i].blocked;
   }
 
-  closedir(proc);
-
   ps_submit_state("running", running);
   ps_submit_state("sleeping", sleeping);
   ps_submit_state("zombies", zombies);
@@ -2093,7 +3109,7 @@ static int ps_read(void) {
   for (procstat_t *ps_ptr = list_head_g; ps_ptr != NULL; ps_ptr = ps_ptr->next)
     ps_submit_proc_list(ps_ptr);
 
-  read_fork_rate();
+  read_fork_rate(/* with_states = */ 0);
 /* #endif KERNEL_LINUX */
 
 #elif HAVE_LIBKVM_GETPROCS && HAVE_STRUCT_KINFO_PROC_FREEBSD
@@ -2641,4 +3657,7 @@ void module_register(void) {
   plugin_register_complex_config("processes", ps_config);
   plugin_register_init("processes", ps_init);
   plugin_register_read("processes", ps_read);
+#if KERNEL_LINUX
+  plugin_register_shutdown("processes", ps_shutdown);
+#endif
 } /* void module_register */
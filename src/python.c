@@ -39,6 +39,8 @@ typedef struct cpy_callback_s {
   char *name;
   PyObject *callback;
   PyObject *data;
+  PyObject *pool; /* list of Values reused by batch write callbacks */
+  cpy_interp_t *interp;
   struct cpy_callback_s *next;
 } cpy_callback_t;
 
@@ -172,6 +174,30 @@ static char reg_write_doc[] =
     "data: The optional data parameter passed to the register function.\n"
     "    If the parameter was omitted it will be omitted here, too.";
 
+static char reg_write_batch_doc[] =
+    "register_write_batch(callback[, data][, name][, batch_size][, linger])\n"
+    "    -> identifier\n"
+    "\n"
+    "Register a callback function to receive values dispatched by other "
+    "plugins\n"
+    "in batches. The arguments are the same as for register_write, plus:\n"
+    "'batch_size' is the maximum number of values passed in one call.\n"
+    "'linger' is the time in seconds to wait for a batch to fill up.\n"
+    "\n"
+    "The callback function will be called with one or two parameters:\n"
+    "values: A list of Values objects. The objects are reused for the next\n"
+    "    batch unless the callback keeps a reference to them.\n"
+    "data: The optional data parameter passed to the register function.\n"
+    "    If the parameter was omitted it will be omitted here, too.";
+
+static char dispatch_many_doc[] =
+    "dispatch_many(values) -> None\n"
+    "\n"
+    "Dispatches a sequence of Values objects to collectd at once. This is\n"
+    "equivalent to calling dispatch() on every object, but a lot faster.\n"
+    "The members of the objects are used as they are; empty host and plugin\n"
+    "members are replaced the same way dispatch() does.";
+
 static char reg_notification_doc[] =
     "register_notification(callback[, data][, name]) -> identifier\n"
     "\n"
@@ -250,29 +276,147 @@ static _Bool do_interactive = 0;
 
 static PyThreadState *state;
 
-static PyObject *sys_path, *cpy_format_exception, *CollectdError;
+/* The main interpreter, followed by the sub-interpreters created by
+ * "Interpreter" blocks. The list is only modified while reading the
+ * configuration. Callbacks remember the interpreter they were registered
+ * from. */
+struct cpy_interp_s {
+  char *name;
+  PyObject *sys_path, *format_exception, *error;
+  cpy_types_t types;
+#if CPY_SUBINTERPRETERS
+  PyInterpreterState *istate;
+  PyThreadState *state; /* thread state the sub-interpreter was created with */
+#endif
+  struct cpy_interp_s *next;
+};
+
+static cpy_interp_t cpy_main = {.name = "main"};
 
 static cpy_callback_t *cpy_config_callbacks;
 static cpy_callback_t *cpy_init_callbacks;
 static cpy_callback_t *cpy_shutdown_callbacks;
 
-/* Make sure to hold the GIL while modifying these. */
+/* Callbacks of different interpreters are registered without a common GIL, so
+ * hold this lock while modifying the lists above or the variables below. */
+static pthread_mutex_t cpy_callbacks_lock = PTHREAD_MUTEX_INITIALIZER;
 static int cpy_shutdown_triggered = 0;
 static int cpy_num_callbacks = 0;
 
+static cpy_interp_t *cpy_interp_current(void) {
+#if CPY_SUBINTERPRETERS
+  PyInterpreterState *istate = PyInterpreterState_Get();
+
+  for (cpy_interp_t *interp = cpy_main.next; interp != NULL;
+       interp = interp->next)
+    if (interp->istate == istate)
+      return interp;
+#endif
+  return &cpy_main;
+}
+
+cpy_types_t const *cpy_types(void) { return &cpy_interp_current()->types; }
+
+#if CPY_SUBINTERPRETERS
+static PyThreadState *cpy_tstate_get(void) {
+#if PY_VERSION_HEX >= 0x030D0000
+  return PyThreadState_GetUnchecked();
+#else
+  return _PyThreadState_UncheckedGet();
+#endif
+}
+
+void cpy_interp_lock(cpy_lock_t *lock, cpy_interp_t *interp) {
+  PyThreadState *current = cpy_tstate_get();
+
+  lock->saved = NULL;
+  lock->tstate = NULL;
+  if (current != NULL &&
+      PyThreadState_GetInterpreter(current) == interp->istate)
+    return;
+
+  if (current != NULL)
+    lock->saved = PyEval_SaveThread();
+  lock->tstate = PyThreadState_New(interp->istate);
+  PyEval_RestoreThread(lock->tstate);
+}
+
+void cpy_interp_unlock(cpy_lock_t *lock) {
+  if (lock->tstate != NULL) {
+    PyThreadState_Clear(lock->tstate);
+    PyThreadState_DeleteCurrent();
+  }
+  if (lock->saved != NULL)
+    PyEval_RestoreThread(lock->saved);
+}
+
+/* Releases the objects of a sub-interpreter. You must hold its GIL. */
+static void cpy_interp_clear(cpy_interp_t *interp) {
+  Py_CLEAR(interp->sys_path);
+  Py_CLEAR(interp->format_exception);
+  Py_CLEAR(interp->error);
+  Py_XDECREF(interp->types.config);
+  Py_XDECREF(interp->types.plugin_data);
+  Py_XDECREF(interp->types.values);
+  Py_XDECREF(interp->types.notification);
+  Py_XDECREF(interp->types.signed_);
+  Py_XDECREF(interp->types.unsigned_);
+  memset(&interp->types, 0, sizeof(interp->types));
+}
+#endif /* CPY_SUBINTERPRETERS */
+
+/* Shuts down all interpreters once the last callback is gone. You must not
+ * hold any GIL. */
+static void cpy_finalize(void) {
+#if CPY_SUBINTERPRETERS
+  cpy_lock_t lock;
+  cpy_interp_t *next;
+
+  for (cpy_interp_t *interp = cpy_main.next; interp != NULL; interp = next) {
+    next = interp->next;
+    PyEval_RestoreThread(interp->state);
+    cpy_interp_clear(interp);
+    Py_EndInterpreter(interp->state);
+    free(interp->name);
+    free(interp);
+  }
+  cpy_main.next = NULL;
+  /* The "threading" module expects to be shut down by the thread state which
+   * imported it. */
+  if (state != NULL)
+    PyEval_RestoreThread(state);
+  else
+    cpy_interp_lock(&lock, &cpy_main);
+#else
+  PyGILState_Ensure();
+#endif
+  Py_Finalize();
+}
+
+static void cpy_callbacks_inc(void) {
+  pthread_mutex_lock(&cpy_callbacks_lock);
+  ++cpy_num_callbacks;
+  pthread_mutex_unlock(&cpy_callbacks_lock);
+}
+
 static void cpy_destroy_user_data(void *data) {
   cpy_callback_t *c = data;
+  _Bool finalize;
+
   free(c->name);
-  CPY_LOCK_THREADS
+  CPY_LOCK_THREADS(c->interp)
   Py_DECREF(c->callback);
   Py_XDECREF(c->data);
+  Py_XDECREF(c->pool);
+  CPY_RELEASE_THREADS
   free(c);
+
+  pthread_mutex_lock(&cpy_callbacks_lock);
   --cpy_num_callbacks;
-  if (!cpy_num_callbacks && cpy_shutdown_triggered) {
-    Py_Finalize();
-    return;
-  }
-  CPY_RELEASE_THREADS
+  finalize = (!cpy_num_callbacks && cpy_shutdown_triggered);
+  pthread_mutex_unlock(&cpy_callbacks_lock);
+  if (finalize)
+    cpy_finalize();
 }
 
 /* You must hold the GIL to call this function!
@@ -309,12 +453,13 @@ void cpy_log_exception(const char *context) {
   int l = 0, collectd_error;
   const char *typename = NULL, *message = NULL;
   PyObject *type, *value, *traceback, *tn, *m, *list;
+  cpy_interp_t *interp = cpy_interp_current();
 
   PyErr_Fetch(&type, &value, &traceback);
   PyErr_NormalizeException(&type, &value, &traceback);
   if (type == NULL)
     return;
-  collectd_error = PyErr_GivenExceptionMatches(value, CollectdError);
+  collectd_error = PyErr_GivenExceptionMatches(value, interp->error);
   tn = PyObject_GetAttrString(type, "__name__"); /* New reference. */
   m = PyObject_Str(value);                       /* New reference. */
   if (tn != NULL)
@@ -335,14 +480,14 @@ void cpy_log_exception(const char *context) {
   Py_END_ALLOW_THREADS;
   Py_XDECREF(tn);
   Py_XDECREF(m);
-  if (!cpy_format_exception || !traceback || collectd_error) {
+  if (!interp->format_exception || !traceback || collectd_error) {
     PyErr_Clear();
     Py_DECREF(type);
     Py_XDECREF(value);
     Py_XDECREF(traceback);
     return;
   }
-  list = PyObject_CallFunction(cpy_format_exception, "NNN", type, value,
+  list = PyObject_CallFunction(interp->format_exception, "NNN", type, value,
                                traceback); /* New reference. Steals references
                                               from "type", "value" and
                                               "traceback". */
@@ -384,7 +529,7 @@ static int cpy_read_callback(user_data_t *data) {
   cpy_callback_t *c = data->data;
   PyObject *ret;
 
-  CPY_LOCK_THREADS
+  CPY_LOCK_THREADS(c->interp)
   ret = PyObject_CallFunctionObjArgs(c->callback, c->data,
                                      (void *)0); /* New reference. */
   if (ret == NULL) {
@@ -398,18 +543,20 @@ static int cpy_read_callback(user_data_t *data) {
   return 0;
 }
 
-static int cpy_write_callback(const data_set_t *ds,
-                              const value_list_t *value_list,
-                              user_data_t *data) {
-  cpy_callback_t *c = data->data;
-  PyObject *ret, *list, *temp, *dict = NULL;
-  Values *v;
-
-  CPY_LOCK_THREADS
-  list = PyList_New(value_list->values_len); /* New reference. */
-  if (list == NULL) {
-    cpy_log_exception("write callback");
-    CPY_RETURN_FROM_THREADS 0;
+/* Fills `v' with a copy of `value_list'. The values list and the meta dict of
+ * `v' are reused if nobody else holds a reference to them. Returns -1 with an
+ * exception set upon failure. You must hold the GIL to call this function. */
+static int cpy_build_write_values(Values *v, const data_set_t *ds,
+                                  const value_list_t *value_list) {
+  PyObject *list = v->values, *dict = v->meta, *temp;
+
+  if (list == NULL || !PyList_CheckExact(list) || Py_REFCNT(list) != 1 ||
+      PyList_GET_SIZE(list) != (Py_ssize_t)value_list->values_len) {
+    list = PyList_New(value_list->values_len); /* New reference. */
+    if (list == NULL)
+      return -1;
+    Py_CLEAR(v->values);
+    v->values = list;
   }
   for (size_t i = 0; i < value_list->values_len; ++i) {
     if (ds->ds[i].type == DS_TYPE_COUNTER) {
@@ -424,19 +571,23 @@ static int cpy_write_callback(const data_set_t *ds,
       PyList_SetItem(
           list, i, PyLong_FromUnsignedLongLong(value_list->values[i].absolute));
     } else {
-      Py_BEGIN_ALLOW_THREADS;
-      ERROR("cpy_write_callback: Unknown value type %d.", ds->ds[i].type);
-      Py_END_ALLOW_THREADS;
-      Py_DECREF(list);
-      CPY_RETURN_FROM_THREADS 0;
-    }
-    if (PyErr_Occurred() != NULL) {
-      cpy_log_exception("value building for write callback");
-      Py_DECREF(list);
-      CPY_RETURN_FROM_THREADS 0;
+      PyErr_Format(PyExc_RuntimeError, "Unknown value type %d.",
+                   ds->ds[i].type);
+      return -1;
     }
+    if (PyErr_Occurred() != NULL)
+      return -1;
+  }
+
+  if (dict == NULL || !PyDict_CheckExact(dict) || Py_REFCNT(dict) != 1) {
+    dict = PyDict_New(); /* New reference. */
+    if (dict == NULL)
+      return -1;
+    Py_CLEAR(v->meta);
+    v->meta = dict;
+  } else {
+    PyDict_Clear(dict);
   }
-  dict = PyDict_New(); /* New reference. */
   if (value_list->meta) {
     char **table = NULL;
     meta_data_t *meta = value_list->meta;
@@ -462,7 +613,8 @@ static int cpy_write_callback(const data_set_t *ds,
         if (meta_data_get_signed_int(meta, table[i], &si))
           continue;
         PyObject *sival = PyLong_FromLongLong(si); /* New reference */
-        temp = PyObject_CallFunctionObjArgs((void *)&SignedType, sival,
+        temp = PyObject_CallFunctionObjArgs((void *)cpy_types()->signed_,
+                                            sival,
                                             (void *)0); /* New reference. */
         PyDict_SetItemString(dict, table[i], temp);
         Py_XDECREF(temp);
@@ -471,7 +623,8 @@ static int cpy_write_callback(const data_set_t *ds,
         if (meta_data_get_unsigned_int(meta, table[i], &ui))
           continue;
         PyObject *uval = PyLong_FromUnsignedLongLong(ui); /* New reference */
-        temp = PyObject_CallFunctionObjArgs((void *)&UnsignedType, uval,
+        temp = PyObject_CallFunctionObjArgs((void *)cpy_types()->unsigned_,
+                                            uval,
                                             (void *)0); /* New reference. */
         PyDict_SetItemString(dict, table[i], temp);
         Py_XDECREF(temp);
@@ -494,7 +647,6 @@ static int cpy_write_callback(const data_set_t *ds,
     }
     free(table);
   }
-  v = (Values *)Values_New(); /* New reference. */
   sstrncpy(v->data.host, value_list->host, sizeof(v->data.host));
   sstrncpy(v->data.type, value_list->type, sizeof(v->data.type));
   sstrncpy(v->data.type_instance, value_list->type_instance,
@@ -504,10 +656,22 @@ static int cpy_write_callback(const data_set_t *ds,
            sizeof(v->data.plugin_instance));
   v->data.time = CDTIME_T_TO_DOUBLE(value_list->time);
   v->interval = CDTIME_T_TO_DOUBLE(value_list->interval);
-  Py_CLEAR(v->values);
-  v->values = list;
-  Py_CLEAR(v->meta);
-  v->meta = dict; /* Steals a reference. */
+  return 0;
+}
+
+static int cpy_write_callback(const data_set_t *ds,
+                              const value_list_t *value_list,
+                              user_data_t *data) {
+  cpy_callback_t *c = data->data;
+  PyObject *ret, *v;
+
+  CPY_LOCK_THREADS(c->interp)
+  v = Values_New(); /* New reference. */
+  if (v == NULL || cpy_build_write_values((Values *)v, ds, value_list) != 0) {
+    cpy_log_exception("value building for write callback");
+    Py_XDECREF(v);
+    CPY_RETURN_FROM_THREADS 0;
+  }
   ret = PyObject_CallFunctionObjArgs(c->callback, v, c->data,
                                      (void *)0); /* New reference. */
   Py_XDECREF(v);
@@ -520,13 +684,70 @@ static int cpy_write_callback(const data_set_t *ds,
   return 0;
 }
 
+/* Hands a whole batch to the callback while taking the GIL only once. The
+ * Values objects are kept in c->pool and refilled for the next batch, unless
+ * the callback kept a reference to them. */
+static int cpy_write_batch_callback(const write_batch_entry_t *entries,
+                                    size_t entries_num, user_data_t *data) {
+  cpy_callback_t *c = data->data;
+  PyObject *ret, *list;
+
+  CPY_LOCK_THREADS(c->interp)
+  if (c->pool == NULL) {
+    c->pool = PyList_New(0); /* New reference. */
+    if (c->pool == NULL) {
+      cpy_log_exception("batch write callback");
+      CPY_RETURN_FROM_THREADS 0;
+    }
+  }
+  for (size_t i = 0; i < entries_num; ++i) {
+    PyObject *v = NULL;
+
+    if ((Py_ssize_t)i < PyList_GET_SIZE(c->pool)) {
+      v = PyList_GET_ITEM(c->pool, i); /* Borrowed reference. */
+      if (Py_REFCNT(v) != 1) {
+        v = Values_New(); /* New reference. */
+        if (v != NULL)
+          PyList_SetItem(c->pool, i, v); /* Steals a reference. */
+      }
+    } else {
+      v = Values_New(); /* New reference. */
+      if (v != NULL) {
+        PyList_Append(c->pool, v);
+        Py_DECREF(v);
+      }
+    }
+    if (v == NULL || PyErr_Occurred() != NULL ||
+        cpy_build_write_values((Values *)v, entries[i].ds, entries[i].vl) !=
+            0) {
+      cpy_log_exception("value building for batch write callback");
+      CPY_RETURN_FROM_THREADS 0;
+    }
+  }
+  list = PyList_GetSlice(c->pool, 0, entries_num); /* New reference. */
+  if (list == NULL) {
+    cpy_log_exception("batch write callback");
+    CPY_RETURN_FROM_THREADS 0;
+  }
+  ret = PyObject_CallFunctionObjArgs(c->callback, list, c->data,
+                                     (void *)0); /* New reference. */
+  Py_DECREF(list);
+  if (ret == NULL) {
+    cpy_log_exception("batch write callback");
+  } else {
+    Py_DECREF(ret);
+  }
+  CPY_RELEASE_THREADS
+  return 0;
+}
+
 static int cpy_notification_callback(const notification_t *notification,
                                      user_data_t *data) {
   cpy_callback_t *c = data->data;
   PyObject *ret, *notify;
   Notification *n;
 
-  CPY_LOCK_THREADS
+  CPY_LOCK_THREADS(c->interp)
   PyObject *dict = PyDict_New(); /* New reference. */
   for (notification_meta_t *meta = notification->meta; meta != NULL;
        meta = meta->next) {
@@ -538,7 +759,7 @@ static int cpy_notification_callback(const notification_t *notification,
       Py_XDECREF(temp);
     } else if (meta->type == NM_TYPE_SIGNED_INT) {
       PyObject *sival = PyLong_FromLongLong(meta->nm_value.nm_signed_int);
-      temp = PyObject_CallFunctionObjArgs((void *)&SignedType, sival,
+      temp = PyObject_CallFunctionObjArgs((void *)cpy_types()->signed_, sival,
                                           (void *)0); /* New reference. */
       PyDict_SetItemString(dict, meta->name, temp);
       Py_XDECREF(temp);
@@ -546,7 +767,7 @@ static int cpy_notification_callback(const notification_t *notification,
     } else if (meta->type == NM_TYPE_UNSIGNED_INT) {
       PyObject *uval =
           PyLong_FromUnsignedLongLong(meta->nm_value.nm_unsigned_int);
-      temp = PyObject_CallFunctionObjArgs((void *)&UnsignedType, uval,
+      temp = PyObject_CallFunctionObjArgs((void *)cpy_types()->unsigned_, uval,
                                           (void *)0); /* New reference. */
       PyDict_SetItemString(dict, meta->name, temp);
       Py_XDECREF(temp);
@@ -591,7 +812,7 @@ static void cpy_log_callback(int severity, const char *message,
   cpy_callback_t *c = data->data;
   PyObject *ret, *text;
 
-  CPY_LOCK_THREADS
+  CPY_LOCK_THREADS(c->interp)
   text = cpy_string_to_unicode_or_bytes(message); /* New reference. */
   if (c->data == NULL)
     ret = PyObject_CallFunction(
@@ -621,7 +842,7 @@ static void cpy_flush_callback(int timeout, const char *id, user_data_t *data) {
   cpy_callback_t *c = data->data;
   PyObject *ret, *text;
 
-  CPY_LOCK_THREADS
+  CPY_LOCK_THREADS(c->interp)
   if (id) {
     text = cpy_string_to_unicode_or_bytes(id);
   } else {
@@ -671,9 +892,12 @@ static PyObject *cpy_register_generic(cpy_callback_t **list_head,
   c->name = strdup(buf);
   c->callback = callback;
   c->data = data;
+  c->interp = cpy_interp_current();
+  pthread_mutex_lock(&cpy_callbacks_lock);
   c->next = *list_head;
   ++cpy_num_callbacks;
   *list_head = c;
+  pthread_mutex_unlock(&cpy_callbacks_lock);
   Py_XDECREF(mod);
   PyMem_Free(name);
   return cpy_string_to_unicode_or_bytes(buf);
@@ -771,6 +995,7 @@ static PyObject *cpy_register_generic_userdata(void *reg, void *handler,
   c->name = strdup(buf);
   c->callback = callback;
   c->data = data;
+  c->interp = cpy_interp_current();
   c->next = NULL;
 
   register_function(buf, handler,
@@ -779,7 +1004,7 @@ static PyObject *cpy_register_generic_userdata(void *reg, void *handler,
                         .free_func = cpy_destroy_user_data,
                     });
 
-  ++cpy_num_callbacks;
+  cpy_callbacks_inc();
   return cpy_string_to_unicode_or_bytes(buf);
 }
 
@@ -813,6 +1038,7 @@ static PyObject *cpy_register_read(PyObject *self, PyObject *args,
   c->name = strdup(buf);
   c->callback = callback;
   c->data = data;
+  c->interp = cpy_interp_current();
   c->next = NULL;
 
   plugin_register_complex_read(
@@ -822,7 +1048,7 @@ static PyObject *cpy_register_read(PyObject *self, PyObject *args,
           .data = c,
           .free_func = cpy_destroy_user_data,
       });
-  ++cpy_num_callbacks;
+  cpy_callbacks_inc();
   return cpy_string_to_unicode_or_bytes(buf);
 }
 
@@ -838,6 +1064,59 @@ static PyObject *cpy_register_write(PyObject *self, PyObject *args,
                                        (void *)cpy_write_callback, args, kwds);
 }
 
+static PyObject *cpy_register_write_batch(PyObject *self, PyObject *args,
+                                          PyObject *kwds) {
+  char buf[512];
+  cpy_callback_t *c = NULL;
+  int batch_size = 1000;
+  double linger = 1.0;
+  char *name = NULL;
+  PyObject *callback = NULL, *data = NULL;
+  static char *kwlist[] = {"callback",   "data",   "name",
+                           "batch_size", "linger", NULL};
+
+  if (PyArg_ParseTupleAndKeywords(args, kwds, "O|Oetid", kwlist, &callback,
+                                  &data, NULL, &name, &batch_size,
+                                  &linger) == 0)
+    return NULL;
+  if (PyCallable_Check(callback) == 0) {
+    PyMem_Free(name);
+    PyErr_SetString(PyExc_TypeError, "callback needs a be a callable object.");
+    return NULL;
+  }
+  if (batch_size <= 0 || linger < 0) {
+    PyMem_Free(name);
+    PyErr_SetString(PyExc_ValueError,
+                    "batch_size must be positive and linger must not be "
+                    "negative.");
+    return NULL;
+  }
+  cpy_build_name(buf, sizeof(buf), callback, name);
+  PyMem_Free(name);
+
+  Py_INCREF(callback);
+  Py_XINCREF(data);
+
+  c = calloc(1, sizeof(*c));
+  if (c == NULL)
+    return NULL;
+
+  c->name = strdup(buf);
+  c->callback = callback;
+  c->data = data;
+  c->interp = cpy_interp_current();
+  c->next = NULL;
+
+  plugin_register_write_batch(buf, cpy_write_batch_callback,
+                              (size_t)batch_size, DOUBLE_TO_CDTIME_T(linger),
+                              &(user_data_t){
+                                  .data = c,
+                                  .free_func = cpy_destroy_user_data,
+                              });
+  cpy_callbacks_inc();
+  return cpy_string_to_unicode_or_bytes(buf);
+}
+
 static PyObject *cpy_register_notification(PyObject *self, PyObject *args,
                                            PyObject *kwds) {
   return cpy_register_generic_userdata((void *)plugin_register_notification,
@@ -933,9 +1212,17 @@ static PyObject *cpy_unregister_generic(cpy_callback_t **list_head,
     cpy_build_name(buf, sizeof(buf), arg, NULL);
     name = buf;
   }
+  pthread_mutex_lock(&cpy_callbacks_lock);
   for (tmp = *list_head; tmp; prev = tmp, tmp = tmp->next)
     if (strcmp(name, tmp->name) == 0)
       break;
+  if (tmp != NULL) {
+    if (prev == NULL)
+      *list_head = tmp->next;
+    else
+      prev->next = tmp->next;
+  }
+  pthread_mutex_unlock(&cpy_callbacks_lock);
 
   Py_DECREF(arg);
   if (tmp == NULL) {
@@ -943,12 +1230,6 @@ static PyObject *cpy_unregister_generic(cpy_callback_t **list_head,
                  desc, name);
     return NULL;
   }
-  /* Yes, this is actually safe. To call this function the caller has to
-   * hold the GIL. Well, safe as long as there is only one GIL anyway ... */
-  if (prev == NULL)
-    *list_head = tmp->next;
-  else
-    prev->next = tmp->next;
   cpy_destroy_user_data(tmp);
   Py_RETURN_NONE;
 }
@@ -1035,6 +1316,7 @@ static PyMethodDef cpy_methods[] = {
     {"error", cpy_error, METH_VARARGS, log_doc},
     {"get_dataset", (PyCFunction)cpy_get_dataset, METH_VARARGS, get_ds_doc},
     {"flush", (PyCFunction)cpy_flush, METH_VARARGS | METH_KEYWORDS, flush_doc},
+    {"dispatch_many", cpy_dispatch_many, METH_VARARGS, dispatch_many_doc},
     {"register_log", (PyCFunction)cpy_register_log,
      METH_VARARGS | METH_KEYWORDS, reg_log_doc},
     {"register_init", (PyCFunction)cpy_register_init,
@@ -1045,6 +1327,8 @@ static PyMethodDef cpy_methods[] = {
      METH_VARARGS | METH_KEYWORDS, reg_read_doc},
     {"register_write", (PyCFunction)cpy_register_write,
      METH_VARARGS | METH_KEYWORDS, reg_write_doc},
+    {"register_write_batch", (PyCFunction)cpy_register_write_batch,
+     METH_VARARGS | METH_KEYWORDS, reg_write_batch_doc},
     {"register_notification", (PyCFunction)cpy_register_notification,
      METH_VARARGS | METH_KEYWORDS, reg_notification_doc},
     {"register_flush", (PyCFunction)cpy_register_flush,
@@ -1064,6 +1348,7 @@ static PyMethodDef cpy_methods[] = {
 
 static int cpy_shutdown(void) {
   PyObject *ret;
+  _Bool finalize;
 
   if (!state) {
     printf(
@@ -1078,31 +1363,27 @@ static int cpy_shutdown(void) {
         "================================================================\n");
   }
 
-  CPY_LOCK_THREADS
-
   for (cpy_callback_t *c = cpy_shutdown_callbacks; c; c = c->next) {
+    CPY_LOCK_THREADS(c->interp)
     ret = PyObject_CallFunctionObjArgs(c->callback, c->data,
                                        (void *)0); /* New reference. */
     if (ret == NULL)
       cpy_log_exception("shutdown callback");
     else
       Py_DECREF(ret);
+    CPY_RELEASE_THREADS
   }
-  PyErr_Print();
 
-  Py_BEGIN_ALLOW_THREADS;
   cpy_unregister_list(&cpy_config_callbacks);
   cpy_unregister_list(&cpy_init_callbacks);
   cpy_unregister_list(&cpy_shutdown_callbacks);
-  cpy_shutdown_triggered = 1;
-  Py_END_ALLOW_THREADS;
 
-  if (!cpy_num_callbacks) {
-    Py_Finalize();
-    return 0;
-  }
-
-  CPY_RELEASE_THREADS
+  pthread_mutex_lock(&cpy_callbacks_lock);
+  cpy_shutdown_triggered = 1;
+  finalize = !cpy_num_callbacks;
+  pthread_mutex_unlock(&cpy_callbacks_lock);
+  if (finalize)
+    cpy_finalize();
   return 0;
 }
 
@@ -1177,16 +1458,16 @@ static int cpy_init(void) {
     PyEval_InitThreads();
     state = PyEval_SaveThread();
   }
-  CPY_LOCK_THREADS
   for (cpy_callback_t *c = cpy_init_callbacks; c; c = c->next) {
+    CPY_LOCK_THREADS(c->interp)
     ret = PyObject_CallFunctionObjArgs(c->callback, c->data,
                                        (void *)0); /* New reference. */
     if (ret == NULL)
       cpy_log_exception("init callback");
     else
       Py_DECREF(ret);
+    CPY_RELEASE_THREADS
   }
-  CPY_RELEASE_THREADS
 
   return 0;
 }
@@ -1212,8 +1493,8 @@ static PyObject *cpy_oconfig_to_pyconfig(oconfig_item_t *ci, PyObject *parent) {
   }
 
   tmp = cpy_string_to_unicode_or_bytes(ci->key);
-  item = PyObject_CallFunction((void *)&ConfigType, "NONO", tmp, parent, values,
-                               Py_None);
+  item = PyObject_CallFunction((void *)cpy_types()->config, "NONO", tmp, parent,
+                               values, Py_None);
   if (item == NULL)
     return NULL;
   children = PyTuple_New(ci->children_num); /* New reference. */
@@ -1227,20 +1508,93 @@ static PyObject *cpy_oconfig_to_pyconfig(oconfig_item_t *ci, PyObject *parent) {
   return item;
 }
 
+static PyObject *cpy_error_new(void) {
+  PyObject *errordict, *doc, *error;
+
+  errordict = PyDict_New();                                /* New reference. */
+  doc = cpy_string_to_unicode_or_bytes(CollectdError_doc); /* New reference. */
+  if (errordict != NULL && doc != NULL)
+    PyDict_SetItemString(errordict, "__doc__", doc);
+  error = PyErr_NewException("collectd.CollectdError", NULL, errordict);
+  Py_XDECREF(doc);
+  Py_XDECREF(errordict);
+  return error;
+}
+
+/* Adds the types, the exception and the constants of the current interpreter
+ * to its "collectd" module. */
+static int cpy_module_add_objects(PyObject *module) {
+  cpy_interp_t *interp = cpy_interp_current();
+  cpy_types_t const *t = &interp->types;
+
+  Py_INCREF(t->config);
+  PyModule_AddObject(module, "Config",
+                     (void *)t->config); /* Steals a reference. */
+  Py_INCREF(t->values);
+  PyModule_AddObject(module, "Values",
+                     (void *)t->values); /* Steals a reference. */
+  Py_INCREF(t->notification);
+  PyModule_AddObject(module, "Notification",
+                     (void *)t->notification); /* Steals a reference. */
+  Py_INCREF(t->signed_);
+  PyModule_AddObject(module, "Signed",
+                     (void *)t->signed_); /* Steals a reference. */
+  Py_INCREF(t->unsigned_);
+  PyModule_AddObject(module, "Unsigned",
+                     (void *)t->unsigned_); /* Steals a reference. */
+  Py_XINCREF(interp->error);
+  PyModule_AddObject(module, "CollectdError",
+                     interp->error); /* Steals a reference. */
+  PyModule_AddIntConstant(module, "LOG_DEBUG", LOG_DEBUG);
+  PyModule_AddIntConstant(module, "LOG_INFO", LOG_INFO);
+  PyModule_AddIntConstant(module, "LOG_NOTICE", LOG_NOTICE);
+  PyModule_AddIntConstant(module, "LOG_WARNING", LOG_WARNING);
+  PyModule_AddIntConstant(module, "LOG_ERROR", LOG_ERR);
+  PyModule_AddIntConstant(module, "NOTIF_FAILURE", NOTIF_FAILURE);
+  PyModule_AddIntConstant(module, "NOTIF_WARNING", NOTIF_WARNING);
+  PyModule_AddIntConstant(module, "NOTIF_OKAY", NOTIF_OKAY);
+  PyModule_AddStringConstant(module, "DS_TYPE_COUNTER",
+                             DS_TYPE_TO_STRING(DS_TYPE_COUNTER));
+  PyModule_AddStringConstant(module, "DS_TYPE_GAUGE",
+                             DS_TYPE_TO_STRING(DS_TYPE_GAUGE));
+  PyModule_AddStringConstant(module, "DS_TYPE_DERIVE",
+                             DS_TYPE_TO_STRING(DS_TYPE_DERIVE));
+  PyModule_AddStringConstant(module, "DS_TYPE_ABSOLUTE",
+                             DS_TYPE_TO_STRING(DS_TYPE_ABSOLUTE));
+  return 0;
+}
+
 #ifdef IS_PY3K
+#if CPY_SUBINTERPRETERS
+/* Multi-phase initialization gives every interpreter its own module object
+ * and is required for interpreters with their own GIL. */
+static PyModuleDef_Slot cpy_module_slots[] = {
+    {Py_mod_exec, cpy_module_add_objects},
+    {Py_mod_multiple_interpreters, Py_MOD_PER_INTERPRETER_GIL_SUPPORTED},
+    {0, NULL}};
+#endif
+
 static struct PyModuleDef collectdmodule = {
     PyModuleDef_HEAD_INIT, "collectd",  /* name of module */
     "The python interface to collectd", /* module documentation, may be NULL */
+#if CPY_SUBINTERPRETERS
+    0, cpy_methods, cpy_module_slots};
+#else
     -1, cpy_methods};
+#endif
 
 PyMODINIT_FUNC PyInit_collectd(void) {
+#if CPY_SUBINTERPRETERS
+  return PyModuleDef_Init(&collectdmodule);
+#else
   return PyModule_Create(&collectdmodule);
+#endif
 }
 #endif
 
 static int cpy_init_python(void) {
   PyOS_sighandler_t cur_sig;
-  PyObject *sys, *errordict;
+  PyObject *sys;
   PyObject *module;
 
 #ifdef IS_PY3K
@@ -1256,6 +1610,9 @@ static int cpy_init_python(void) {
   cur_sig = PyOS_setsig(SIGINT, SIG_DFL);
   Py_Initialize();
   python_sigint_handler = PyOS_setsig(SIGINT, cur_sig);
+#if CPY_SUBINTERPRETERS
+  cpy_main.istate = PyInterpreterState_Get();
+#endif
 
   PyType_Ready(&ConfigType);
   PyType_Ready(&PluginDataType);
@@ -1267,64 +1624,313 @@ static int cpy_init_python(void) {
   PyType_Ready(&SignedType);
   UnsignedType.tp_base = &PyLong_Type;
   PyType_Ready(&UnsignedType);
-  errordict = PyDict_New();
-  PyDict_SetItemString(
-      errordict, "__doc__",
-      cpy_string_to_unicode_or_bytes(CollectdError_doc)); /* New reference. */
-  CollectdError = PyErr_NewException("collectd.CollectdError", NULL, errordict);
+  cpy_main.types = (cpy_types_t){
+      .config = &ConfigType,
+      .plugin_data = &PluginDataType,
+      .values = &ValuesType,
+      .notification = &NotificationType,
+      .signed_ = &SignedType,
+      .unsigned_ = &UnsignedType,
+  };
+  cpy_main.error = cpy_error_new();
   sys = PyImport_ImportModule("sys"); /* New reference. */
   if (sys == NULL) {
     cpy_log_exception("python initialization");
     return 1;
   }
-  sys_path = PyObject_GetAttrString(sys, "path"); /* New reference. */
+  cpy_main.sys_path = PyObject_GetAttrString(sys, "path"); /* New reference. */
   Py_DECREF(sys);
-  if (sys_path == NULL) {
+  if (cpy_main.sys_path == NULL) {
     cpy_log_exception("python initialization");
     return 1;
   }
   PySys_SetArgv(1, &argv);
-  PyList_SetSlice(sys_path, 0, 1, NULL);
+  PyList_SetSlice(cpy_main.sys_path, 0, 1, NULL);
 
 #ifdef IS_PY3K
   module = PyImport_ImportModule("collectd");
 #else
   module = Py_InitModule("collectd", cpy_methods); /* Borrowed reference. */
 #endif
-  PyModule_AddObject(module, "Config",
-                     (void *)&ConfigType); /* Steals a reference. */
-  PyModule_AddObject(module, "Values",
-                     (void *)&ValuesType); /* Steals a reference. */
-  PyModule_AddObject(module, "Notification",
-                     (void *)&NotificationType); /* Steals a reference. */
-  PyModule_AddObject(module, "Signed",
-                     (void *)&SignedType); /* Steals a reference. */
-  PyModule_AddObject(module, "Unsigned",
-                     (void *)&UnsignedType); /* Steals a reference. */
-  Py_XINCREF(CollectdError);
-  PyModule_AddObject(module, "CollectdError",
-                     CollectdError); /* Steals a reference. */
-  PyModule_AddIntConstant(module, "LOG_DEBUG", LOG_DEBUG);
-  PyModule_AddIntConstant(module, "LOG_INFO", LOG_INFO);
-  PyModule_AddIntConstant(module, "LOG_NOTICE", LOG_NOTICE);
-  PyModule_AddIntConstant(module, "LOG_WARNING", LOG_WARNING);
-  PyModule_AddIntConstant(module, "LOG_ERROR", LOG_ERR);
-  PyModule_AddIntConstant(module, "NOTIF_FAILURE", NOTIF_FAILURE);
-  PyModule_AddIntConstant(module, "NOTIF_WARNING", NOTIF_WARNING);
-  PyModule_AddIntConstant(module, "NOTIF_OKAY", NOTIF_OKAY);
-  PyModule_AddStringConstant(module, "DS_TYPE_COUNTER",
-                             DS_TYPE_TO_STRING(DS_TYPE_COUNTER));
-  PyModule_AddStringConstant(module, "DS_TYPE_GAUGE",
-                             DS_TYPE_TO_STRING(DS_TYPE_GAUGE));
-  PyModule_AddStringConstant(module, "DS_TYPE_DERIVE",
-                             DS_TYPE_TO_STRING(DS_TYPE_DERIVE));
-  PyModule_AddStringConstant(module, "DS_TYPE_ABSOLUTE",
-                             DS_TYPE_TO_STRING(DS_TYPE_ABSOLUTE));
+  if (module == NULL) {
+    cpy_log_exception("python initialization");
+    return 1;
+  }
+#if !CPY_SUBINTERPRETERS
+  cpy_module_add_objects(module);
+#endif
   return 0;
 }
 
-static int cpy_config(oconfig_item_t *ci) {
+#if CPY_SUBINTERPRETERS
+static int cpy_types_from_spec(cpy_types_t *t) {
+  t->config = (PyTypeObject *)PyType_FromSpec(&ConfigSpec);
+  t->plugin_data = (PyTypeObject *)PyType_FromSpec(&PluginDataSpec);
+  if (t->config == NULL || t->plugin_data == NULL)
+    return -1;
+  t->values = (PyTypeObject *)PyType_FromSpecWithBases(
+      &ValuesSpec, (PyObject *)t->plugin_data);
+  t->notification = (PyTypeObject *)PyType_FromSpecWithBases(
+      &NotificationSpec, (PyObject *)t->plugin_data);
+  t->signed_ = (PyTypeObject *)PyType_FromSpecWithBases(
+      &SignedSpec, (PyObject *)&PyLong_Type);
+  t->unsigned_ = (PyTypeObject *)PyType_FromSpecWithBases(
+      &UnsignedSpec, (PyObject *)&PyLong_Type);
+  if (t->values == NULL || t->notification == NULL || t->signed_ == NULL ||
+      t->unsigned_ == NULL)
+    return -1;
+  return 0;
+}
+
+/* Creates a sub-interpreter with its own GIL and appends it to the list of
+ * interpreters. The calling thread has to hold the GIL of the main
+ * interpreter, which it holds again when this function returns. */
+static cpy_interp_t *cpy_interp_create(char const *name) {
+  PyInterpreterConfig config = {
+      .use_main_obmalloc = 0,
+      .allow_fork = 0,
+      .allow_exec = 0,
+      .allow_threads = 1,
+      .allow_daemon_threads = 0,
+      .check_multi_interp_extensions = 1,
+      .gil = PyInterpreterConfig_OWN_GIL,
+  };
+  PyThreadState *main_state = PyThreadState_Get();
+  cpy_interp_t *interp, *prev;
+  PyObject *sys, *threading, *module = NULL;
+  PyStatus status;
+
+  interp = calloc(1, sizeof(*interp));
+  if (interp == NULL)
+    return NULL;
+  interp->name = strdup(name);
+  if (interp->name == NULL) {
+    free(interp);
+    return NULL;
+  }
+
+  status = Py_NewInterpreterFromConfig(&interp->state, &config);
+  if (PyStatus_Exception(status)) {
+    ERROR("python plugin: Creating interpreter \"%s\" failed: %s", name,
+          (status.err_msg != NULL) ? status.err_msg : "unknown error");
+    if (cpy_tstate_get() == NULL)
+      PyEval_RestoreThread(main_state);
+    free(interp->name);
+    free(interp);
+    return NULL;
+  }
+  interp->istate = PyThreadState_GetInterpreter(interp->state);
+
+  /* The "collectd" module looks up its types and exception when it is
+   * imported, so the interpreter has to be in the list before that. */
+  for (prev = &cpy_main; prev->next != NULL; prev = prev->next)
+    ;
+  prev->next = interp;
+
+  if (cpy_types_from_spec(&interp->types) == 0)
+    interp->error = cpy_error_new();
+  sys = PyImport_ImportModule("sys"); /* New reference. */
+  if (sys != NULL) {
+    interp->sys_path = PyObject_GetAttrString(sys, "path"); /* New reference. */
+    Py_DECREF(sys);
+  }
+  /* Callbacks run with short-lived thread states. "threading" has to be
+   * imported with the one kept until Py_EndInterpreter(), because it
+   * considers the importing thread the main thread. */
+  threading = PyImport_ImportModule("threading"); /* New reference. */
+  if (interp->error != NULL && interp->sys_path != NULL && threading != NULL)
+    module = PyImport_ImportModule("collectd"); /* New reference. */
+  Py_XDECREF(threading);
+
+  if (module == NULL) {
+    ERROR("python plugin: Initializing interpreter \"%s\" failed.", name);
+    cpy_log_exception("python initialization");
+    prev->next = NULL;
+    cpy_interp_clear(interp);
+    Py_EndInterpreter(interp->state);
+    PyEval_RestoreThread(main_state);
+    free(interp->name);
+    free(interp);
+    return NULL;
+  }
+  Py_DECREF(module);
+
+  PyEval_SaveThread();
+  PyEval_RestoreThread(main_state);
+  return interp;
+}
+#endif /* CPY_SUBINTERPRETERS */
+
+static int cpy_config_log_traces(cpy_interp_t *interp, oconfig_item_t *ci) {
+  _Bool log_traces;
   PyObject *tb;
+
+  if (cf_util_get_boolean(ci, &log_traces) != 0)
+    return 1;
+  if (!log_traces) {
+    Py_CLEAR(interp->format_exception);
+    return 0;
+  }
+  if (interp->format_exception)
+    return 0;
+  tb = PyImport_ImportModule("traceback"); /* New reference. */
+  if (tb == NULL) {
+    cpy_log_exception("python initialization");
+    return 1;
+  }
+  interp->format_exception =
+      PyObject_GetAttrString(tb, "format_exception"); /* New reference. */
+  Py_DECREF(tb);
+  if (interp->format_exception == NULL) {
+    cpy_log_exception("python initialization");
+    return 1;
+  }
+  return 0;
+}
+
+static int cpy_config_module_path(cpy_interp_t *interp, oconfig_item_t *ci) {
+  char *dir = NULL;
+  PyObject *dir_object;
+  int status = 0;
+
+  if (cf_util_get_string(ci, &dir) != 0)
+    return 1;
+  dir_object = cpy_string_to_unicode_or_bytes(dir); /* New reference. */
+  if (dir_object == NULL) {
+    ERROR("python plugin: Unable to convert \"%s\" to "
+          "a python object.",
+          dir);
+    free(dir);
+    cpy_log_exception("python initialization");
+    return 1;
+  }
+  if (PyList_Insert(interp->sys_path, 0, dir_object) != 0) {
+    ERROR("python plugin: Unable to prepend \"%s\" to "
+          "python module path.",
+          dir);
+    cpy_log_exception("python initialization");
+    status = 1;
+  }
+  Py_DECREF(dir_object);
+  free(dir);
+  return status;
+}
+
+static int cpy_config_import(oconfig_item_t *ci) {
+  char *module_name = NULL;
+  PyObject *module;
+  int status = 0;
+
+  if (cf_util_get_string(ci, &module_name) != 0)
+    return 1;
+  module = PyImport_ImportModule(module_name); /* New reference. */
+  if (module == NULL) {
+    ERROR("python plugin: Error importing module \"%s\".", module_name);
+    cpy_log_exception("importing module");
+    status = 1;
+  }
+  free(module_name);
+  Py_XDECREF(module);
+  return status;
+}
+
+/* Passes a "Module" block to the config callback of the module, in the
+ * interpreter the callback was registered from. */
+static int cpy_config_module(oconfig_item_t *ci) {
+  char *name = NULL;
+  cpy_callback_t *c;
+  PyObject *ret;
+  int status = 0;
+
+  if (cf_util_get_string(ci, &name) != 0)
+    return 1;
+  pthread_mutex_lock(&cpy_callbacks_lock);
+  for (c = cpy_config_callbacks; c; c = c->next) {
+    if (strcasecmp(c->name + 7, name) == 0)
+      break;
+  }
+  pthread_mutex_unlock(&cpy_callbacks_lock);
+  if (c == NULL) {
+    WARNING("python plugin: Found a configuration for the \"%s\" plugin, "
+            "but the plugin isn't loaded or didn't register "
+            "a configuration callback.",
+            name);
+    free(name);
+    return 0;
+  }
+  free(name);
+
+  CPY_LOCK_THREADS(c->interp)
+  if (c->data == NULL)
+    ret = PyObject_CallFunction(
+        c->callback, "N",
+        cpy_oconfig_to_pyconfig(ci, NULL)); /* New reference. */
+  else
+    ret = PyObject_CallFunction(c->callback, "NO",
+                                cpy_oconfig_to_pyconfig(ci, NULL),
+                                c->data); /* New reference. */
+  if (ret == NULL) {
+    cpy_log_exception("loading module");
+    status = 1;
+  } else
+    Py_DECREF(ret);
+  CPY_RELEASE_THREADS
+  return status;
+}
+
+/* Handles the options which can be used both globally and in "Interpreter"
+ * blocks. */
+static int cpy_config_item(cpy_interp_t *interp, oconfig_item_t *ci) {
+  int status;
+
+  if (strcasecmp(ci->key, "Module") == 0)
+    return cpy_config_module(ci);
+
+  CPY_LOCK_THREADS(interp)
+  if (strcasecmp(ci->key, "LogTraces") == 0) {
+    status = cpy_config_log_traces(interp, ci);
+  } else if (strcasecmp(ci->key, "ModulePath") == 0) {
+    status = cpy_config_module_path(interp, ci);
+  } else if (strcasecmp(ci->key, "Import") == 0) {
+    status = cpy_config_import(ci);
+  } else {
+    ERROR("python plugin: Unknown config key \"%s\".", ci->key);
+    status = 1;
+  }
+  CPY_RELEASE_THREADS
+  return status;
+}
+
+static int cpy_config_interpreter(oconfig_item_t *ci) {
+#if CPY_SUBINTERPRETERS
+  cpy_interp_t *interp;
+  char *name = NULL;
+  int status = 0;
+
+  if (cf_util_get_string(ci, &name) != 0)
+    return 1;
+  for (interp = cpy_main.next; interp != NULL; interp = interp->next)
+    if (strcasecmp(interp->name, name) == 0)
+      break;
+  if (interp == NULL)
+    interp = cpy_interp_create(name);
+  free(name);
+  if (interp == NULL)
+    return 1;
+
+  for (int i = 0; i < ci->children_num; ++i) {
+    if (cpy_config_item(interp, ci->children + i) != 0)
+      status = 1;
+  }
+  return status;
+#else
+  ERROR("python plugin: The \"Interpreter\" option requires Python 3.12 or "
+        "later.");
+  return 1;
+#endif
+}
+
+static int cpy_config(oconfig_item_t *ci) {
   int status = 0;
 
   /* Ok in theory we shouldn't do initialization at this point
@@ -1365,112 +1971,10 @@ static int cpy_config(oconfig_item_t *ci) {
       }
 #endif
       sfree(encoding);
-    } else if (strcasecmp(item->key, "LogTraces") == 0) {
-      _Bool log_traces;
-      if (cf_util_get_boolean(item, &log_traces) != 0) {
+    } else if (strcasecmp(item->key, "Interpreter") == 0) {
+      if (cpy_config_interpreter(item) != 0)
         status = 1;
-        continue;
-      }
-      if (!log_traces) {
-        Py_XDECREF(cpy_format_exception);
-        cpy_format_exception = NULL;
-        continue;
-      }
-      if (cpy_format_exception)
-        continue;
-      tb = PyImport_ImportModule("traceback"); /* New reference. */
-      if (tb == NULL) {
-        cpy_log_exception("python initialization");
-        status = 1;
-        continue;
-      }
-      cpy_format_exception =
-          PyObject_GetAttrString(tb, "format_exception"); /* New reference. */
-      Py_DECREF(tb);
-      if (cpy_format_exception == NULL) {
-        cpy_log_exception("python initialization");
-        status = 1;
-      }
-    } else if (strcasecmp(item->key, "ModulePath") == 0) {
-      char *dir = NULL;
-      PyObject *dir_object;
-
-      if (cf_util_get_string(item, &dir) != 0) {
-        status = 1;
-        continue;
-      }
-      dir_object = cpy_string_to_unicode_or_bytes(dir); /* New reference. */
-      if (dir_object == NULL) {
-        ERROR("python plugin: Unable to convert \"%s\" to "
-              "a python object.",
-              dir);
-        free(dir);
-        cpy_log_exception("python initialization");
-        status = 1;
-        continue;
-      }
-      if (PyList_Insert(sys_path, 0, dir_object) != 0) {
-        ERROR("python plugin: Unable to prepend \"%s\" to "
-              "python module path.",
-              dir);
-        cpy_log_exception("python initialization");
-        status = 1;
-      }
-      Py_DECREF(dir_object);
-      free(dir);
-    } else if (strcasecmp(item->key, "Import") == 0) {
-      char *module_name = NULL;
-      PyObject *module;
-
-      if (cf_util_get_string(item, &module_name) != 0) {
-        status = 1;
-        continue;
-      }
-      module = PyImport_ImportModule(module_name); /* New reference. */
-      if (module == NULL) {
-        ERROR("python plugin: Error importing module \"%s\".", module_name);
-        cpy_log_exception("importing module");
-        status = 1;
-      }
-      free(module_name);
-      Py_XDECREF(module);
-    } else if (strcasecmp(item->key, "Module") == 0) {
-      char *name = NULL;
-      cpy_callback_t *c;
-      PyObject *ret;
-
-      if (cf_util_get_string(item, &name) != 0) {
-        status = 1;
-        continue;
-      }
-      for (c = cpy_config_callbacks; c; c = c->next) {
-        if (strcasecmp(c->name + 7, name) == 0)
-          break;
-      }
-      if (c == NULL) {
-        WARNING("python plugin: Found a configuration for the \"%s\" plugin, "
-                "but the plugin isn't loaded or didn't register "
-                "a configuration callback.",
-                name);
-        free(name);
-        continue;
-      }
-      free(name);
-      if (c->data == NULL)
-        ret = PyObject_CallFunction(
-            c->callback, "N",
-            cpy_oconfig_to_pyconfig(item, NULL)); /* New reference. */
-      else
-        ret = PyObject_CallFunction(c->callback, "NO",
-                                    cpy_oconfig_to_pyconfig(item, NULL),
-                                    c->data); /* New reference. */
-      if (ret == NULL) {
-        cpy_log_exception("loading module");
-        status = 1;
-      } else
-        Py_DECREF(ret);
-    } else {
-      ERROR("python plugin: Unknown config key \"%s\".", item->key);
+    } else if (cpy_config_item(&cpy_main, item) != 0) {
       status = 1;
     }
   }
@@ -52,65 +52,45 @@ typedef struct {
 
 static PyObject *cpy_common_repr(PyObject *s) {
   PyObject *ret, *tmp;
-  static PyObject *l_type = NULL, *l_type_instance = NULL, *l_plugin = NULL,
-                  *l_plugin_instance = NULL;
-  static PyObject *l_host = NULL, *l_time = NULL;
   PluginData *self = (PluginData *)s;
 
-  if (l_type == NULL)
-    l_type = cpy_string_to_unicode_or_bytes("(type=");
-  if (l_type_instance == NULL)
-    l_type_instance = cpy_string_to_unicode_or_bytes(",type_instance=");
-  if (l_plugin == NULL)
-    l_plugin = cpy_string_to_unicode_or_bytes(",plugin=");
-  if (l_plugin_instance == NULL)
-    l_plugin_instance = cpy_string_to_unicode_or_bytes(",plugin_instance=");
-  if (l_host == NULL)
-    l_host = cpy_string_to_unicode_or_bytes(",host=");
-  if (l_time == NULL)
-    l_time = cpy_string_to_unicode_or_bytes(",time=");
-
-  if (!l_type || !l_type_instance || !l_plugin || !l_plugin_instance ||
-      !l_host || !l_time)
-    return NULL;
-
   ret = cpy_string_to_unicode_or_bytes(s->ob_type->tp_name);
 
-  CPY_STRCAT(&ret, l_type);
+  cpy_strcat_string(&ret, "(type=");
   tmp = cpy_string_to_unicode_or_bytes(self->type);
   CPY_SUBSTITUTE(PyObject_Repr, tmp, tmp);
   CPY_STRCAT_AND_DEL(&ret, tmp);
 
   if (self->type_instance[0] != 0) {
-    CPY_STRCAT(&ret, l_type_instance);
+    cpy_strcat_string(&ret, ",type_instance=");
     tmp = cpy_string_to_unicode_or_bytes(self->type_instance);
     CPY_SUBSTITUTE(PyObject_Repr, tmp, tmp);
     CPY_STRCAT_AND_DEL(&ret, tmp);
   }
 
   if (self->plugin[0] != 0) {
-    CPY_STRCAT(&ret, l_plugin);
+    cpy_strcat_string(&ret, ",plugin=");
     tmp = cpy_string_to_unicode_or_bytes(self->plugin);
     CPY_SUBSTITUTE(PyObject_Repr, tmp, tmp);
     CPY_STRCAT_AND_DEL(&ret, tmp);
   }
 
   if (self->plugin_instance[0] != 0) {
-    CPY_STRCAT(&ret, l_plugin_instance);
+    cpy_strcat_string(&ret, ",plugin_instance=");
     tmp = cpy_string_to_unicode_or_bytes(self->plugin_instance);
     CPY_SUBSTITUTE(PyObject_Repr, tmp, tmp);
     CPY_STRCAT_AND_DEL(&ret, tmp);
   }
 
   if (self->host[0] != 0) {
-    CPY_STRCAT(&ret, l_host);
+    cpy_strcat_string(&ret, ",host=");
     tmp = cpy_string_to_unicode_or_bytes(self->host);
     CPY_SUBSTITUTE(PyObject_Repr, tmp, tmp);
     CPY_STRCAT_AND_DEL(&ret, tmp);
   }
 
   if (self->time != 0) {
-    CPY_STRCAT(&ret, l_time);
+    cpy_strcat_string(&ret, ",time=");
     tmp = PyFloat_FromDouble(self->time);
     CPY_SUBSTITUTE(PyObject_Repr, tmp, tmp);
     CPY_STRCAT_AND_DEL(&ret, tmp);
@@ -203,16 +183,9 @@ static int PluginData_init(PyObject *s, PyObject *args, PyObject *kwds) {
 
 static PyObject *PluginData_repr(PyObject *s) {
   PyObject *ret;
-  static PyObject *l_closing = NULL;
-
-  if (l_closing == NULL)
-    l_closing = cpy_string_to_unicode_or_bytes(")");
-
-  if (l_closing == NULL)
-    return NULL;
 
   ret = cpy_common_repr(s);
-  CPY_STRCAT(&ret, l_closing);
+  cpy_strcat_string(&ret, ")");
   return ret;
 }
 
@@ -326,6 +299,24 @@ PyTypeObject PluginDataType = {
     PluginData_new                                    /* tp_new */
 };
 
+#if CPY_SUBINTERPRETERS
+static PyType_Slot PluginData_slots[] = {
+    {Py_tp_repr, PluginData_repr},
+    {Py_tp_doc, PluginData_doc},
+    {Py_tp_members, PluginData_members},
+    {Py_tp_getset, PluginData_getseters},
+    {Py_tp_init, PluginData_init},
+    {Py_tp_new, PluginData_new},
+    {0, NULL}};
+
+PyType_Spec PluginDataSpec = {
+    .name = "collectd.PluginData",
+    .basicsize = sizeof(PluginData),
+    .flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
+    .slots = PluginData_slots,
+};
+#endif
+
 static char interval_doc[] =
     "The interval is the timespan in seconds between two submits for\n"
     "the same data source. This value has to be a positive integer, so you "
@@ -506,12 +497,12 @@ static int cpy_build_meta_generic(PyObject *meta,
       meta_func->add_boolean(m, keystring, 0);
     } else if (PyFloat_Check(value)) {
       meta_func->add_double(m, keystring, PyFloat_AsDouble(value));
-    } else if (PyObject_TypeCheck(value, &SignedType)) {
+    } else if (PyObject_TypeCheck(value, cpy_types()->signed_)) {
       long long int lli;
       lli = PyLong_AsLongLong(value);
       if (!PyErr_Occurred() && (lli == (int64_t)lli))
         meta_func->add_signed_int(m, keystring, lli);
-    } else if (PyObject_TypeCheck(value, &UnsignedType)) {
+    } else if (PyObject_TypeCheck(value, cpy_types()->unsigned_)) {
       long long unsigned llu;
       llu = PyLong_AsUnsignedLongLong(value);
       if (!PyErr_Occurred() && (llu == (uint64_t)llu))
@@ -587,6 +578,57 @@ static void cpy_build_notification_meta(notification_t *n, PyObject *meta) {
   cpy_build_meta_generic(meta, &cpy_plugin_notification_meta, (void *)n);
 }
 
+/* Converts the list or tuple `values', which has to hold ds->ds_num numbers,
+ * to `value'. Returns -1 with an exception set upon failure. */
+static int cpy_build_values(const data_set_t *ds, PyObject *values,
+                            value_t *value) {
+  for (size_t i = 0; i < ds->ds_num; ++i) {
+    PyObject *item, *num;
+    item = PySequence_Fast_GET_ITEM(values, i); /* Borrowed reference. */
+    switch (ds->ds[i].type) {
+    case DS_TYPE_COUNTER:
+      num = PyNumber_Long(item); /* New reference. */
+      if (num != NULL) {
+        value[i].counter = PyLong_AsUnsignedLongLong(num);
+        Py_XDECREF(num);
+      }
+      break;
+    case DS_TYPE_GAUGE:
+      num = PyNumber_Float(item); /* New reference. */
+      if (num != NULL) {
+        value[i].gauge = PyFloat_AsDouble(num);
+        Py_XDECREF(num);
+      }
+      break;
+    case DS_TYPE_DERIVE:
+      /* This might overflow without raising an exception.
+       * Not much we can do about it */
+      num = PyNumber_Long(item); /* New reference. */
+      if (num != NULL) {
+        value[i].derive = PyLong_AsLongLong(num);
+        Py_XDECREF(num);
+      }
+      break;
+    case DS_TYPE_ABSOLUTE:
+      /* This might overflow without raising an exception.
+       * Not much we can do about it */
+      num = PyNumber_Long(item); /* New reference. */
+      if (num != NULL) {
+        value[i].absolute = PyLong_AsUnsignedLongLong(num);
+        Py_XDECREF(num);
+      }
+      break;
+    default:
+      PyErr_Format(PyExc_RuntimeError, "unknown data type %d for %s",
+                   ds->ds[i].type, ds->type);
+      return -1;
+    }
+    if (PyErr_Occurred() != NULL)
+      return -1;
+  }
+  return 0;
+}
+
 static PyObject *Values_dispatch(Values *self, PyObject *args, PyObject *kwds) {
   int ret;
   const data_set_t *ds;
@@ -647,52 +689,9 @@ static PyObject *Values_dispatch(Values *self, PyObject *args, PyObject *kwds) {
     return NULL;
   }
   value = calloc(size, sizeof(*value));
-  for (size_t i = 0; i < size; ++i) {
-    PyObject *item, *num;
-    item = PySequence_Fast_GET_ITEM(values, (int)i); /* Borrowed reference. */
-    switch (ds->ds[i].type) {
-    case DS_TYPE_COUNTER:
-      num = PyNumber_Long(item); /* New reference. */
-      if (num != NULL) {
-        value[i].counter = PyLong_AsUnsignedLongLong(num);
-        Py_XDECREF(num);
-      }
-      break;
-    case DS_TYPE_GAUGE:
-      num = PyNumber_Float(item); /* New reference. */
-      if (num != NULL) {
-        value[i].gauge = PyFloat_AsDouble(num);
-        Py_XDECREF(num);
-      }
-      break;
-    case DS_TYPE_DERIVE:
-      /* This might overflow without raising an exception.
-       * Not much we can do about it */
-      num = PyNumber_Long(item); /* New reference. */
-      if (num != NULL) {
-        value[i].derive = PyLong_AsLongLong(num);
-        Py_XDECREF(num);
-      }
-      break;
-    case DS_TYPE_ABSOLUTE:
-      /* This might overflow without raising an exception.
-       * Not much we can do about it */
-      num = PyNumber_Long(item); /* New reference. */
-      if (num != NULL) {
-        value[i].absolute = PyLong_AsUnsignedLongLong(num);
-        Py_XDECREF(num);
-      }
-      break;
-    default:
-      free(value);
-      PyErr_Format(PyExc_RuntimeError, "unknown data type %d for %s",
-                   ds->ds[i].type, value_list.type);
-      return NULL;
-    }
-    if (PyErr_Occurred() != NULL) {
-      free(value);
-      return NULL;
-    }
+  if (cpy_build_values(ds, values, value) != 0) {
+    free(value);
+    return NULL;
   }
   value_list.values = value;
   value_list.meta = cpy_build_meta(meta);
@@ -772,52 +771,9 @@ static PyObject *Values_write(Values *self, PyObject *args, PyObject *kwds) {
     return NULL;
   }
   value = calloc(size, sizeof(*value));
-  for (size_t i = 0; i < size; ++i) {
-    PyObject *item, *num;
-    item = PySequence_Fast_GET_ITEM(values, i); /* Borrowed reference. */
-    switch (ds->ds[i].type) {
-    case DS_TYPE_COUNTER:
-      num = PyNumber_Long(item); /* New reference. */
-      if (num != NULL) {
-        value[i].counter = PyLong_AsUnsignedLongLong(num);
-        Py_XDECREF(num);
-      }
-      break;
-    case DS_TYPE_GAUGE:
-      num = PyNumber_Float(item); /* New reference. */
-      if (num != NULL) {
-        value[i].gauge = PyFloat_AsDouble(num);
-        Py_XDECREF(num);
-      }
-      break;
-    case DS_TYPE_DERIVE:
-      /* This might overflow without raising an exception.
-       * Not much we can do about it */
-      num = PyNumber_Long(item); /* New reference. */
-      if (num != NULL) {
-        value[i].derive = PyLong_AsLongLong(num);
-        Py_XDECREF(num);
-      }
-      break;
-    case DS_TYPE_ABSOLUTE:
-      /* This might overflow without raising an exception.
-       * Not much we can do about it */
-      num = PyNumber_Long(item); /* New reference. */
-      if (num != NULL) {
-        value[i].absolute = PyLong_AsUnsignedLongLong(num);
-        Py_XDECREF(num);
-      }
-      break;
-    default:
-      free(value);
-      PyErr_Format(PyExc_RuntimeError, "unknown data type %d for %s",
-                   ds->ds[i].type, value_list.type);
-      return NULL;
-    }
-    if (PyErr_Occurred() != NULL) {
-      free(value);
-      return NULL;
-    }
+  if (cpy_build_values(ds, values, value) != 0) {
+    free(value);
+    return NULL;
   }
   value_list.values = value;
   value_list.values_len = size;
@@ -841,50 +797,205 @@ static PyObject *Values_write(Values *self, PyObject *args, PyObject *kwds) {
   Py_RETURN_NONE;
 }
 
+/* Scratch space of cpy_dispatch_many(), reused between calls. Callers take it
+ * out of these variables while holding dispatch_many_lock, so that concurrent
+ * callers (in other interpreters or with the GIL released) allocate their
+ * own. */
+static pthread_mutex_t dispatch_many_lock = PTHREAD_MUTEX_INITIALIZER;
+static value_list_t *dispatch_many_vl;
+static size_t dispatch_many_vl_size;
+static value_t *dispatch_many_values;
+static size_t dispatch_many_values_size;
+
+static int cpy_dispatch_many_fill(Values *v, value_list_t *vl, value_t **values,
+                                  size_t *values_size, size_t values_num) {
+  const data_set_t *ds;
+  size_t size;
+
+  if (v->data.type[0] == 0) {
+    PyErr_SetString(PyExc_RuntimeError, "type not set");
+    return -1;
+  }
+  ds = plugin_get_ds(v->data.type);
+  if (ds == NULL) {
+    PyErr_Format(PyExc_TypeError, "Dataset %s not found", v->data.type);
+    return -1;
+  }
+  if (v->values == NULL ||
+      (PyTuple_Check(v->values) == 0 && PyList_Check(v->values) == 0)) {
+    PyErr_Format(PyExc_TypeError, "values must be list or tuple");
+    return -1;
+  }
+  if (v->meta != NULL && v->meta != Py_None && !PyDict_Check(v->meta)) {
+    PyErr_Format(PyExc_TypeError, "meta must be a dict");
+    return -1;
+  }
+  size = (size_t)PySequence_Length(v->values);
+  if (size != ds->ds_num) {
+    PyErr_Format(PyExc_RuntimeError,
+                 "type %s needs %" PRIsz " values, got %" PRIsz, v->data.type,
+                 ds->ds_num, size);
+    return -1;
+  }
+
+  if (values_num + size > *values_size) {
+    size_t new_size = 2 * (values_num + size);
+    value_t *tmp = realloc(*values, new_size * sizeof(**values));
+    if (tmp == NULL) {
+      PyErr_NoMemory();
+      return -1;
+    }
+    *values = tmp;
+    *values_size = new_size;
+  }
+  if (cpy_build_values(ds, v->values, *values + values_num) != 0)
+    return -1;
+
+  *vl = (value_list_t){
+      .values_len = size,
+      .time = DOUBLE_TO_CDTIME_T(v->data.time),
+      .interval = DOUBLE_TO_CDTIME_T(v->interval),
+  };
+  sstrncpy(vl->host, v->data.host[0] ? v->data.host : hostname_g,
+           sizeof(vl->host));
+  sstrncpy(vl->plugin, v->data.plugin[0] ? v->data.plugin : "python",
+           sizeof(vl->plugin));
+  sstrncpy(vl->plugin_instance, v->data.plugin_instance,
+           sizeof(vl->plugin_instance));
+  sstrncpy(vl->type, v->data.type, sizeof(vl->type));
+  sstrncpy(vl->type_instance, v->data.type_instance,
+           sizeof(vl->type_instance));
+  vl->meta = cpy_build_meta(v->meta);
+  return 0;
+}
+
+PyObject *cpy_dispatch_many(PyObject *self, PyObject *args) {
+  PyObject *list, *seq;
+  value_list_t *vl;
+  value_t *values;
+  size_t vl_size, values_size, vl_num, values_num = 0;
+  int status = -1;
+
+  if (!PyArg_ParseTuple(args, "O", &list))
+    return NULL;
+  seq = PySequence_Fast(list, "argument must be a sequence of Values");
+  if (seq == NULL)
+    return NULL;
+  vl_num = (size_t)PySequence_Fast_GET_SIZE(seq);
+  if (vl_num == 0) {
+    Py_DECREF(seq);
+    Py_RETURN_NONE;
+  }
+
+  pthread_mutex_lock(&dispatch_many_lock);
+  vl = dispatch_many_vl;
+  vl_size = dispatch_many_vl_size;
+  values = dispatch_many_values;
+  values_size = dispatch_many_values_size;
+  dispatch_many_vl = NULL;
+  dispatch_many_vl_size = 0;
+  dispatch_many_values = NULL;
+  dispatch_many_values_size = 0;
+  pthread_mutex_unlock(&dispatch_many_lock);
+
+  if (vl_num > vl_size) {
+    value_list_t *tmp = realloc(vl, vl_num * sizeof(*vl));
+    if (tmp == NULL) {
+      PyErr_NoMemory();
+      vl_num = 0;
+      goto out;
+    }
+    vl = tmp;
+    vl_size = vl_num;
+  }
+
+  for (size_t i = 0; i < vl_num; ++i) {
+    PyObject *item = PySequence_Fast_GET_ITEM(seq, i); /* Borrowed reference. */
+
+    if (!PyObject_TypeCheck(item, cpy_types()->values)) {
+      PyErr_Format(PyExc_TypeError, "item %" PRIsz " is not a Values object",
+                   i);
+      vl_num = i;
+      goto out;
+    }
+    if (cpy_dispatch_many_fill((Values *)item, vl + i, &values, &values_size,
+                               values_num) != 0) {
+      vl_num = i;
+      goto out;
+    }
+    values_num += vl[i].values_len;
+  }
+
+  /* The values array may have moved while growing. */
+  values_num = 0;
+  for (size_t i = 0; i < vl_num; ++i) {
+    vl[i].values = values + values_num;
+    values_num += vl[i].values_len;
+  }
+
+  Py_BEGIN_ALLOW_THREADS;
+  status = plugin_dispatch_values_batch(vl, vl_num);
+  Py_END_ALLOW_THREADS;
+  if (status != 0)
+    PyErr_SetString(PyExc_RuntimeError,
+                    "error dispatching values, read the logs");
+
+out:
+  for (size_t i = 0; i < vl_num; ++i)
+    meta_data_destroy(vl[i].meta);
+  Py_DECREF(seq);
+
+  pthread_mutex_lock(&dispatch_many_lock);
+  if (dispatch_many_vl == NULL) {
+    dispatch_many_vl = vl;
+    dispatch_many_vl_size = vl_size;
+  } else {
+    free(vl);
+  }
+  if (dispatch_many_values == NULL) {
+    dispatch_many_values = values;
+    dispatch_many_values_size = values_size;
+  } else {
+    free(values);
+  }
+  pthread_mutex_unlock(&dispatch_many_lock);
+
+  if (status != 0)
+    return NULL;
+  Py_RETURN_NONE;
+}
+
 static PyObject *Values_repr(PyObject *s) {
   PyObject *ret, *tmp;
-  static PyObject *l_interval = NULL, *l_values = NULL, *l_meta = NULL,
-                  *l_closing = NULL;
   Values *self = (Values *)s;
 
-  if (l_interval == NULL)
-    l_interval = cpy_string_to_unicode_or_bytes(",interval=");
-  if (l_values == NULL)
-    l_values = cpy_string_to_unicode_or_bytes(",values=");
-  if (l_meta == NULL)
-    l_meta = cpy_string_to_unicode_or_bytes(",meta=");
-  if (l_closing == NULL)
-    l_closing = cpy_string_to_unicode_or_bytes(")");
-
-  if (l_interval == NULL || l_values == NULL || l_meta == NULL ||
-      l_closing == NULL)
-    return NULL;
-
   ret = cpy_common_repr(s);
   if (self->interval != 0) {
-    CPY_STRCAT(&ret, l_interval);
+    cpy_strcat_string(&ret, ",interval=");
     tmp = PyFloat_FromDouble(self->interval);
     CPY_SUBSTITUTE(PyObject_Repr, tmp, tmp);
     CPY_STRCAT_AND_DEL(&ret, tmp);
   }
   if (self->values &&
       (!PyList_Check(self->values) || PySequence_Length(self->values) > 0)) {
-    CPY_STRCAT(&ret, l_values);
+    cpy_strcat_string(&ret, ",values=");
     tmp = PyObject_Repr(self->values);
     CPY_STRCAT_AND_DEL(&ret, tmp);
   }
   if (self->meta &&
       (!PyDict_Check(self->meta) || PyDict_Size(self->meta) > 0)) {
-    CPY_STRCAT(&ret, l_meta);
+    cpy_strcat_string(&ret, ",meta=");
     tmp = PyObject_Repr(self->meta);
     CPY_STRCAT_AND_DEL(&ret, tmp);
   }
-  CPY_STRCAT(&ret, l_closing);
+  cpy_strcat_string(&ret, ")");
   return ret;
 }
 
 static int Values_traverse(PyObject *self, visitproc visit, void *arg) {
   Values *v = (Values *)self;
+  if (cpy_heap_traverse(self, Values_traverse))
+    Py_VISIT(Py_TYPE(self));
   Py_VISIT(v->values);
   Py_VISIT(v->meta);
   return 0;
@@ -898,8 +1009,13 @@ static int Values_clear(PyObject *self) {
 }
 
 static void Values_dealloc(PyObject *self) {
+  PyTypeObject *type = Py_TYPE(self);
+  int heap = cpy_heap_dealloc(self, Values_dealloc);
+
   Values_clear(self);
-  self->ob_type->tp_free(self);
+  type->tp_free(self);
+  if (heap)
+    Py_DECREF(type);
 }
 
 static PyMemberDef Values_members[] = {
@@ -955,6 +1071,28 @@ PyTypeObject ValuesType = {
     Values_new       /* tp_new */
 };
 
+#if CPY_SUBINTERPRETERS
+static PyType_Slot Values_slots[] = {
+    {Py_tp_dealloc, Values_dealloc},
+    {Py_tp_repr, Values_repr},
+    {Py_tp_doc, Values_doc},
+    {Py_tp_traverse, Values_traverse},
+    {Py_tp_clear, Values_clear},
+    {Py_tp_methods, Values_methods},
+    {Py_tp_members, Values_members},
+    {Py_tp_init, Values_init},
+    {Py_tp_new, Values_new},
+    {0, NULL}};
+
+/* The base, PluginData, is passed to PyType_FromSpecWithBases(). */
+PyType_Spec ValuesSpec = {
+    .name = "collectd.Values",
+    .basicsize = sizeof(Values),
+    .flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE | Py_TPFLAGS_HAVE_GC,
+    .slots = Values_slots,
+};
+#endif
+
 static char notification_meta_doc[] =
     "These are the meta data for the Notification object.\n"
     "It has to be a dictionary of numbers, strings or bools. All keys must be\n"
@@ -1146,48 +1284,35 @@ static int Notification_setstring(PyObject *self, PyObject *value, void *data) {
 
 static PyObject *Notification_repr(PyObject *s) {
   PyObject *ret, *tmp;
-  static PyObject *l_severity = NULL, *l_message = NULL, *l_meta = NULL,
-                  *l_closing = NULL;
   Notification *self = (Notification *)s;
 
-  if (l_severity == NULL)
-    l_severity = cpy_string_to_unicode_or_bytes(",severity=");
-  if (l_message == NULL)
-    l_message = cpy_string_to_unicode_or_bytes(",message=");
-  if (l_meta == NULL)
-    l_meta = cpy_string_to_unicode_or_bytes(",meta=");
-  if (l_closing == NULL)
-    l_closing = cpy_string_to_unicode_or_bytes(")");
-
-  if (l_severity == NULL || l_message == NULL || l_meta == NULL ||
-      l_closing == NULL)
-    return NULL;
-
   ret = cpy_common_repr(s);
   if (self->severity != 0) {
-    CPY_STRCAT(&ret, l_severity);
+    cpy_strcat_string(&ret, ",severity=");
     tmp = PyInt_FromLong(self->severity);
     CPY_SUBSTITUTE(PyObject_Repr, tmp, tmp);
     CPY_STRCAT_AND_DEL(&ret, tmp);
   }
   if (self->message[0] != 0) {
-    CPY_STRCAT(&ret, l_message);
+    cpy_strcat_string(&ret, ",message=");
     tmp = cpy_string_to_unicode_or_bytes(self->message);
     CPY_SUBSTITUTE(PyObject_Repr, tmp, tmp);
     CPY_STRCAT_AND_DEL(&ret, tmp);
   }
   if (self->meta &&
       (!PyDict_Check(self->meta) || PyDict_Size(self->meta) > 0)) {
-    CPY_STRCAT(&ret, l_meta);
+    cpy_strcat_string(&ret, ",meta=");
     tmp = PyObject_Repr(self->meta);
     CPY_STRCAT_AND_DEL(&ret, tmp);
   }
-  CPY_STRCAT(&ret, l_closing);
+  cpy_strcat_string(&ret, ")");
   return ret;
 }
 
 static int Notification_traverse(PyObject *self, visitproc visit, void *arg) {
   Notification *n = (Notification *)self;
+  if (cpy_heap_traverse(self, Notification_traverse))
+    Py_VISIT(Py_TYPE(self));
   Py_VISIT(n->meta);
   return 0;
 }
@@ -1199,8 +1324,13 @@ static int Notification_clear(PyObject *self) {
 }
 
 static void Notification_dealloc(PyObject *self) {
+  PyTypeObject *type = Py_TYPE(self);
+  int heap = cpy_heap_dealloc(self, Notification_dealloc);
+
   Notification_clear(self);
-  self->ob_type->tp_free(self);
+  type->tp_free(self);
+  if (heap)
+    Py_DECREF(type);
 }
 
 static PyMethodDef Notification_methods[] = {
@@ -1259,6 +1389,29 @@ PyTypeObject NotificationType = {
     Notification_new        /* tp_new */
 };
 
+#if CPY_SUBINTERPRETERS
+static PyType_Slot Notification_slots[] = {
+    {Py_tp_dealloc, Notification_dealloc},
+    {Py_tp_repr, Notification_repr},
+    {Py_tp_doc, Notification_doc},
+    {Py_tp_traverse, Notification_traverse},
+    {Py_tp_clear, Notification_clear},
+    {Py_tp_methods, Notification_methods},
+    {Py_tp_members, Notification_members},
+    {Py_tp_getset, Notification_getseters},
+    {Py_tp_init, Notification_init},
+    {Py_tp_new, Notification_new},
+    {0, NULL}};
+
+/* The base, PluginData, is passed to PyType_FromSpecWithBases(). */
+PyType_Spec NotificationSpec = {
+    .name = "collectd.Notification",
+    .basicsize = sizeof(Notification),
+    .flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE | Py_TPFLAGS_HAVE_GC,
+    .slots = Notification_slots,
+};
+#endif
+
 static char Signed_doc[] =
     "This is a long by another name. Use it in meta data dicts\n"
     "to choose the way it is stored in the meta data.";
@@ -1286,6 +1439,17 @@ PyTypeObject SignedType = {
     Signed_doc                                /* tp_doc */
 };
 
+#if CPY_SUBINTERPRETERS
+static PyType_Slot Signed_slots[] = {{Py_tp_doc, Signed_doc}, {0, NULL}};
+
+/* The base, int, is passed to PyType_FromSpecWithBases(). */
+PyType_Spec SignedSpec = {
+    .name = "collectd.Signed",
+    .flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
+    .slots = Signed_slots,
+};
+#endif
+
 static char Unsigned_doc[] =
     "This is a long by another name. Use it in meta data dicts\n"
     "to choose the way it is stored in the meta data.";
@@ -1312,3 +1476,14 @@ PyTypeObject UnsignedType = {
     Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE, /* tp_flags */
     Unsigned_doc                              /* tp_doc */
 };
+
+#if CPY_SUBINTERPRETERS
+static PyType_Slot Unsigned_slots[] = {{Py_tp_doc, Unsigned_doc}, {0, NULL}};
+
+/* The base, int, is passed to PyType_FromSpecWithBases(). */
+PyType_Spec UnsignedSpec = {
+    .name = "collectd.Unsigned",
+    .flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
+    .slots = Unsigned_slots,
+};
+#endif
@@ -73,6 +73,7 @@ struct redis_node_s {
   struct timeval timeout;
   redis_query_t *queries;
 
+  redisContext *redisContext;
   redis_node_t *next;
 };
 
@@ -252,6 +253,8 @@ redis_submit(char *plugin_instance, const char *type, const char *type_instance,
   plugin_dispatch_values(&vl);
 } /* }}} */
 
+static int redis_read(user_data_t *user_data);
+
 static int redis_init(void) /* {{{ */
 {
   redis_node_t rn = {.name = "default",
@@ -264,6 +267,21 @@ static int redis_init(void) /* {{{ */
   if (nodes_head == NULL)
     redis_node_add(&rn);
 
+  /* One read callback per node, so that nodes are queried in parallel by
+   * the read threads rather than one after the other. */
+  for (redis_node_t *node = nodes_head; node != NULL; node = node->next) {
+    char cb_name[sizeof("redis/") + MAX_REDIS_NODE_NAME];
+
+    snprintf(cb_name, sizeof(cb_name), "redis/%s", node->name);
+    plugin_register_complex_read(/* group = */ "redis",
+                                 /* name      = */ cb_name,
+                                 /* callback  = */ redis_read,
+                                 /* interval  = */ 0,
+                                 &(user_data_t){
+                                     .data = node,
+                                 });
+  }
+
   return 0;
 } /* }}} int redis_init */
 
@@ -295,10 +313,9 @@ static int redis_handle_info(char *node, char const *info_line,
 
 } /* }}} int redis_handle_info */
 
-static int redis_handle_query(redisContext *rh, redis_node_t *rn,
-                              redis_query_t *rq) /* {{{ */
+static int redis_handle_query(redis_node_t *rn, redis_query_t *rq,
+                              redisReply *rr) /* {{{ */
 {
-  redisReply *rr;
   const data_set_t *ds;
   value_t val;
 
@@ -313,11 +330,6 @@ static int redis_handle_query(redisContext *rh, redis_node_t *rn,
     return -1;
   }
 
-  if ((rr = redisCommand(rh, rq->query)) == NULL) {
-    WARNING("redis plugin: unable to carry out query `%s'.", rq->query);
-    return -1;
-  }
-
   switch (rr->type) {
   case REDIS_REPLY_INTEGER:
     switch (ds->ds[0].type) {
@@ -338,19 +350,16 @@ static int redis_handle_query(redisContext *rh, redis_node_t *rn,
   case REDIS_REPLY_STRING:
     if (parse_value(rr->str, &val, ds->ds[0].type) == -1) {
       WARNING("redis plugin: Unable to parse field `%s'.", rq->type);
-      freeReplyObject(rr);
       return -1;
     }
     break;
   default:
     WARNING("redis plugin: Cannot coerce redis type.");
-    freeReplyObject(rr);
     return -1;
   }
 
   redis_submit(rn->name, rq->type,
                (strlen(rq->instance) > 0) ? rq->instance : NULL, val);
-  freeReplyObject(rr);
   return 0;
 } /* }}} int redis_handle_query */
 
@@ -393,44 +402,98 @@ static int redis_db_stats(char *node, char const *info_line) /* {{{ */
 
 } /* }}} int redis_db_stats */
 
-static int redis_read(void) /* {{{ */
+static void redis_disconnect(redis_node_t *rn) /* {{{ */
 {
-  for (redis_node_t *rn = nodes_head; rn != NULL; rn = rn->next) {
-    redisContext *rh;
-    redisReply *rr;
+  if (rn->redisContext == NULL)
+    return;
 
-    DEBUG("redis plugin: querying info from node `%s' (%s:%d).", rn->name,
-          rn->host, rn->port);
+  redisFree(rn->redisContext);
+  rn->redisContext = NULL;
+} /* }}} void redis_disconnect */
 
-    rh = redisConnectWithTimeout((char *)rn->host, rn->port, rn->timeout);
-    if (rh == NULL) {
-      ERROR("redis plugin: unable to connect to node `%s' (%s:%d).", rn->name,
-            rn->host, rn->port);
-      continue;
-    }
+static int redis_connect(redis_node_t *rn) /* {{{ */
+{
+  redisContext *rh;
+  redisReply *rr;
 
-    if (strlen(rn->passwd) > 0) {
-      DEBUG("redis plugin: authenticating node `%s' passwd(%s).", rn->name,
-            rn->passwd);
+  if (rn->redisContext != NULL)
+    return 0;
 
-      if ((rr = redisCommand(rh, "AUTH %s", rn->passwd)) == NULL) {
-        WARNING("redis plugin: unable to authenticate on node `%s'.", rn->name);
-        goto redis_fail;
-      }
+  rh = redisConnectWithTimeout((char *)rn->host, rn->port, rn->timeout);
+  if (rh == NULL || rh->err != 0) {
+    ERROR("redis plugin: unable to connect to node `%s' (%s:%d): %s.",
+          rn->name, rn->host, rn->port,
+          (rh != NULL) ? rh->errstr : "out of memory");
+    if (rh != NULL)
+      redisFree(rh);
+    return -1;
+  }
+  rn->redisContext = rh;
 
-      if (rr->type != REDIS_REPLY_STATUS) {
-        WARNING("redis plugin: invalid authentication on node `%s'.", rn->name);
-        goto redis_fail;
-      }
+  /* Replies to commands which are queued later on time out instead of
+   * blocking the read thread forever. */
+  redisSetTimeout(rh, rn->timeout);
+
+  if (strlen(rn->passwd) > 0) {
+    DEBUG("redis plugin: authenticating node `%s' passwd(%s).", rn->name,
+          rn->passwd);
 
+    if ((rr = redisCommand(rh, "AUTH %s", rn->passwd)) == NULL) {
+      WARNING("redis plugin: unable to authenticate on node `%s'.", rn->name);
+      redis_disconnect(rn);
+      return -1;
+    }
+
+    if (rr->type != REDIS_REPLY_STATUS) {
+      WARNING("redis plugin: invalid authentication on node `%s'.", rn->name);
       freeReplyObject(rr);
+      redis_disconnect(rn);
+      return -1;
     }
 
-    if ((rr = redisCommand(rh, "INFO")) == NULL) {
-      WARNING("redis plugin: unable to get info from node `%s'.", rn->name);
-      goto redis_fail;
+    freeReplyObject(rr);
+  }
+
+  return 0;
+} /* }}} int redis_connect */
+
+static int redis_read(user_data_t *user_data) /* {{{ */
+{
+  redis_node_t *rn = user_data->data;
+  redisContext *rh;
+  redisReply *rr;
+  int status = 0;
+
+  DEBUG("redis plugin: querying info from node `%s' (%s:%d).", rn->name,
+        rn->host, rn->port);
+
+  if (redis_connect(rn) != 0)
+    return -1;
+  rh = rn->redisContext;
+
+  /* Pipeline INFO and all configured queries, so that a node costs a single
+   * round trip per interval. Replies arrive in the order of the commands. */
+  if (redisAppendCommand(rh, "INFO") != REDIS_OK) {
+    WARNING("redis plugin: unable to get info from node `%s'.", rn->name);
+    redis_disconnect(rn);
+    return -1;
+  }
+  for (redis_query_t *rq = rn->queries; rq != NULL; rq = rq->next) {
+    if (redisAppendCommand(rh, rq->query) != REDIS_OK) {
+      WARNING("redis plugin: unable to carry out query `%s'.", rq->query);
+      redis_disconnect(rn);
+      return -1;
     }
+  }
+
+  if (redisGetReply(rh, (void **)&rr) != REDIS_OK) {
+    WARNING("redis plugin: unable to get info from node `%s': %s.", rn->name,
+            rh->errstr);
+    redis_disconnect(rn);
+    return -1;
+  }
 
+  if (rr->type == REDIS_REPLY_STRING) {
     redis_handle_info(rn->name, rr->str, "uptime", NULL, "uptime_in_seconds",
                       DS_TYPE_GAUGE);
     redis_handle_info(rn->name, rr->str, "current_connections", "clients",
@@ -470,25 +533,40 @@ static int redis_read(void) /* {{{ */
                       "total_net_output_bytes", DS_TYPE_DERIVE);
 
     redis_db_stats(rn->name, rr->str);
+  } else {
+    WARNING("redis plugin: unable to get info from node `%s'.", rn->name);
+    status = -1;
+  }
+  freeReplyObject(rr);
 
-    for (redis_query_t *rq = rn->queries; rq != NULL; rq = rq->next)
-      redis_handle_query(rh, rn, rq);
+  for (redis_query_t *rq = rn->queries; rq != NULL; rq = rq->next) {
+    if (redisGetReply(rh, (void **)&rr) != REDIS_OK) {
+      WARNING("redis plugin: unable to carry out query `%s': %s.", rq->query,
+              rh->errstr);
+      redis_disconnect(rn);
+      return -1;
+    }
 
-  redis_fail:
-    if (rr != NULL)
-      freeReplyObject(rr);
-    redisFree(rh);
+    redis_handle_query(rn, rq, rr);
+    freeReplyObject(rr);
   }
 
+  return status;
+} /* }}} int redis_read */
+
+static int redis_shutdown(void) /* {{{ */
+{
+  for (redis_node_t *rn = nodes_head; rn != NULL; rn = rn->next)
+    redis_disconnect(rn);
+
   return 0;
-}
-/* }}} */
+} /* }}} int redis_shutdown */
 
 void module_register(void) /* {{{ */
 {
   plugin_register_complex_config("redis", redis_config);
   plugin_register_init("redis", redis_init);
-  plugin_register_read("redis", redis_read);
+  plugin_register_shutdown("redis", redis_shutdown);
   /* TODO: plugin_register_write: one redis list per value id with
    * X elements */
 }
@@ -30,15 +30,50 @@
 #include "plugin.h"
 #include "utils_rrdcreate.h"
 
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
 #undef HAVE_CONFIG_H
 #include <rrd.h>
 #include <rrd_client.h>
 
+/* Default port of rrdcached, see rrdcached(1). */
+#define RC_DEFAULT_PORT "42217"
+#define RC_DEFAULT_BATCH_LINGER TIME_T_TO_CDTIME_T_STATIC(1)
+/* Send and receive timeout of the connections used for batching. */
+#define RC_SOCKET_TIMEOUT_SEC 5
+
+/* A connection to one rrdcached instance, used when batching. The client of
+ * librrd only manages a single, global connection, so the plugin speaks the
+ * protocol itself on these. */
+typedef struct {
+  char *address;
+  FILE *fh; /* NULL if not connected */
+  pthread_mutex_t lock;
+} rc_conn_t;
+
+/* The "UPDATE" lines of one batch write destined for one connection. */
+typedef struct {
+  char *data;
+  size_t size;
+  size_t fill;
+  size_t num;
+} rc_batch_t;
+
 /*
  * Private variables
  */
 static char *datadir = NULL;
+/* The first "DaemonAddress". It is used with librrd, i.e. for statistics and
+ * for writing without batching. */
 static char *daemon_address = NULL;
+static char **daemon_addresses = NULL;
+static size_t daemon_addresses_num = 0;
+static size_t batch_size = 1;
+static cdtime_t batch_linger = RC_DEFAULT_BATCH_LINGER;
+static rc_conn_t *conns = NULL;
+static size_t conns_num = 0;
 static _Bool config_create_files = 1;
 static _Bool config_collect_stats = 1;
 static rrdcreate_config_t rrdcreate_config = {
@@ -60,6 +95,9 @@ static rrdcreate_config_t rrdcreate_config = {
  */
 static int rc_write(const data_set_t *ds, const value_list_t *vl,
                     user_data_t __attribute__((unused)) * user_data);
+static int rc_write_batch(const write_batch_entry_t *entries,
+                          size_t entries_num,
+                          user_data_t __attribute__((unused)) * user_data);
 static int rc_flush(__attribute__((unused)) cdtime_t timeout,
                     const char *identifier,
                     __attribute__((unused)) user_data_t *ud);
@@ -201,6 +239,47 @@ static int rc_config_add_timespan(int timespan) {
   return 0;
 } /* int rc_config_add_timespan */
 
+static int rc_config_add_address(oconfig_item_t const *ci) {
+  char *address = NULL;
+  char **tmp;
+  int status;
+
+  status = cf_util_get_string(ci, &address);
+  if (status != 0)
+    return status;
+
+  tmp = realloc(daemon_addresses,
+                sizeof(*daemon_addresses) * (daemon_addresses_num + 1));
+  if (tmp == NULL) {
+    sfree(address);
+    return ENOMEM;
+  }
+  daemon_addresses = tmp;
+
+  daemon_addresses[daemon_addresses_num] = address;
+  daemon_addresses_num++;
+
+  if (daemon_address == NULL)
+    daemon_address = address;
+
+  return 0;
+} /* int rc_config_add_address */
+
+static int rc_config_conns(void) {
+  conns = calloc(daemon_addresses_num, sizeof(*conns));
+  if (conns == NULL)
+    return ENOMEM;
+
+  for (size_t i = 0; i < daemon_addresses_num; i++) {
+    conns[i].address = daemon_addresses[i];
+    conns[i].fh = NULL;
+    pthread_mutex_init(&conns[i].lock, /* attr = */ NULL);
+  }
+  conns_num = daemon_addresses_num;
+
+  return 0;
+} /* int rc_config_conns */
+
 static int rc_config(oconfig_item_t *ci) {
   for (int i = 0; i < ci->children_num; i++) {
     oconfig_item_t const *child = ci->children + i;
@@ -221,7 +300,7 @@ static int rc_config(oconfig_item_t *ci) {
           sfree(datadir);
       }
     } else if (strcasecmp("DaemonAddress", key) == 0)
-      status = cf_util_get_string(child, &daemon_address);
+      status = rc_config_add_address(child);
     else if (strcasecmp("CreateFiles", key) == 0)
       status = cf_util_get_boolean(child, &config_create_files);
     else if (strcasecmp("CreateFilesAsync", key) == 0)
@@ -245,6 +324,14 @@ static int rc_config(oconfig_item_t *ci) {
         status = rc_config_add_timespan(tmp);
     } else if (strcasecmp("XFF", key) == 0)
       status = rc_config_get_xff(child, &rrdcreate_config.xff);
+    else if (strcasecmp("BatchSize", key) == 0) {
+      int tmp = -1;
+
+      status = rc_config_get_int_positive(child, &tmp);
+      if (status == 0)
+        batch_size = (tmp > 0) ? (size_t)tmp : 1;
+    } else if (strcasecmp("BatchLinger", key) == 0)
+      status = cf_util_get_cdtime(child, &batch_linger);
     else {
       WARNING("rrdcached plugin: Ignoring invalid option %s.", key);
       continue;
@@ -254,10 +341,25 @@ static int rc_config(oconfig_item_t *ci) {
       WARNING("rrdcached plugin: Handling the \"%s\" option failed.", key);
   }
 
-  if (daemon_address != NULL) {
+  if (daemon_address == NULL)
+    return 0;
+
+  if (batch_size > 1) {
+    if (rc_config_conns() != 0) {
+      ERROR("rrdcached plugin: calloc failed.");
+      return ENOMEM;
+    }
+    plugin_register_write_batch("rrdcached", rc_write_batch, batch_size,
+                                batch_linger, /* user_data = */ NULL);
+  } else {
+    if (daemon_addresses_num > 1)
+      WARNING("rrdcached plugin: Writing to more than one daemon requires "
+              "\"BatchSize\" to be greater than one. Only \"%s\" will be "
+              "used.",
+              daemon_address);
     plugin_register_write("rrdcached", rc_write, /* user_data = */ NULL);
-    plugin_register_flush("rrdcached", rc_flush, /* user_data = */ NULL);
   }
+  plugin_register_flush("rrdcached", rc_flush, /* user_data = */ NULL);
   return 0;
 } /* int rc_config */
 
@@ -281,6 +383,337 @@ static int try_reconnect(void) {
   return 0;
 } /* int try_reconnect */
 
+static void rc_conn_close(rc_conn_t *conn) {
+  if (conn->fh != NULL)
+    fclose(conn->fh);
+  conn->fh = NULL;
+} /* void rc_conn_close */
+
+static int rc_conn_connect_unix(char const *path) {
+  struct sockaddr_un sa = {.sun_family = AF_UNIX};
+  int fd;
+
+  if (strlen(path) >= sizeof(sa.sun_path))
+    return -1;
+  sstrncpy(sa.sun_path, path, sizeof(sa.sun_path));
+
+  fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0)
+    return -1;
+
+  if (connect(fd, (struct sockaddr *)&sa, sizeof(sa)) != 0) {
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+} /* int rc_conn_connect_unix */
+
+/* Accepts "host", "host:port", "[address]" and "[address]:port", like
+ * rrdc_connect() does. */
+static int rc_conn_connect_inet(char const *address) {
+  char buffer[NI_MAXHOST + 16];
+  char *host = buffer;
+  char *port = NULL;
+  int fd = -1;
+
+  sstrncpy(buffer, address, sizeof(buffer));
+  if (host[0] == '[') {
+    host++;
+    char *end = strchr(host, ']');
+    if (end == NULL)
+      return -1;
+    *end = 0;
+    if (end[1] == ':')
+      port = end + 2;
+  } else {
+    char *colon = strchr(host, ':');
+    /* More than one colon is an IPv6 address without a port. */
+    if ((colon != NULL) && (colon == strrchr(host, ':'))) {
+      *colon = 0;
+      port = colon + 1;
+    }
+  }
+  if ((port == NULL) || (port[0] == 0))
+    port = RC_DEFAULT_PORT;
+
+  struct addrinfo *ai_list;
+  struct addrinfo ai_hints = {.ai_family = AF_UNSPEC,
+                              .ai_flags = AI_ADDRCONFIG,
+                              .ai_socktype = SOCK_STREAM};
+
+  int status = getaddrinfo(host, port, &ai_hints, &ai_list);
+  if (status != 0) {
+    ERROR("rrdcached plugin: getaddrinfo (%s, %s) failed: %s", host, port,
+          gai_strerror(status));
+    return -1;
+  }
+
+  for (struct addrinfo *ai_ptr = ai_list; ai_ptr != NULL;
+       ai_ptr = ai_ptr->ai_next) {
+    fd = socket(ai_ptr->ai_family, ai_ptr->ai_socktype, ai_ptr->ai_protocol);
+    if (fd < 0)
+      continue;
+
+    if (connect(fd, ai_ptr->ai_addr, ai_ptr->ai_addrlen) == 0)
+      break;
+
+    close(fd);
+    fd = -1;
+  }
+
+  freeaddrinfo(ai_list);
+  return fd;
+} /* int rc_conn_connect_inet */
+
+static int rc_conn_connect(rc_conn_t *conn) {
+  char const *path = NULL;
+  int fd;
+
+  if (conn->fh != NULL)
+    return 0;
+
+  if (strncmp("unix:", conn->address, strlen("unix:")) == 0)
+    path = conn->address + strlen("unix:");
+  else if (conn->address[0] == '/')
+    path = conn->address;
+
+  if (path != NULL)
+    fd = rc_conn_connect_unix(path);
+  else
+    fd = rc_conn_connect_inet(conn->address);
+  if (fd < 0) {
+    ERROR("rrdcached plugin: Failed to connect to RRDCacheD at %s: %s",
+          conn->address, STRERRNO);
+    return -1;
+  }
+
+  struct timeval tv = {.tv_sec = RC_SOCKET_TIMEOUT_SEC};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+  conn->fh = fdopen(fd, "r");
+  if (conn->fh == NULL) {
+    ERROR("rrdcached plugin: fdopen failed: %s", STRERRNO);
+    close(fd);
+    return -1;
+  }
+
+  return 0;
+} /* int rc_conn_connect */
+
+static int rc_conn_is_unix(rc_conn_t const *conn) {
+  return (strncmp("unix:", conn->address, strlen("unix:")) == 0) ||
+         (conn->address[0] == '/');
+} /* int rc_conn_is_unix */
+
+/* Reads one response line and returns its status, i.e. the number of lines
+ * following it or a negative value if the command failed. Sets "*ret_failed"
+ * if no response could be read. */
+static int rc_conn_read_status(rc_conn_t *conn, char *buffer,
+                               size_t buffer_size, _Bool *ret_failed) {
+  char *endptr = NULL;
+  long status;
+
+  if (fgets(buffer, (int)buffer_size, conn->fh) == NULL) {
+    *ret_failed = 1;
+    return -1;
+  }
+  strstripnewline(buffer);
+
+  errno = 0;
+  status = strtol(buffer, &endptr, 10);
+  if ((errno != 0) || (endptr == buffer)) {
+    *ret_failed = 1;
+    return -1;
+  }
+
+  return (int)status;
+} /* int rc_conn_read_status */
+
+static int rc_batch_reserve(rc_batch_t *b, size_t len) {
+  if (b->fill + len < b->size)
+    return 0;
+
+  size_t size = (b->size > 0) ? b->size : 4096;
+  while (b->fill + len >= size)
+    size *= 2;
+
+  char *tmp = realloc(b->data, size);
+  if (tmp == NULL)
+    return ENOMEM;
+  b->data = tmp;
+  b->size = size;
+
+  return 0;
+} /* int rc_batch_reserve */
+
+static int rc_batch_append(rc_batch_t *b, char const *str) {
+  size_t len = strlen(str);
+
+  if (rc_batch_reserve(b, len) != 0)
+    return ENOMEM;
+
+  memcpy(b->data + b->fill, str, len + 1);
+  b->fill += len;
+  return 0;
+} /* int rc_batch_append */
+
+/* Appends a file name, escaping spaces and backslashes like librrd does. */
+static int rc_batch_append_filename(rc_batch_t *b, rc_conn_t const *conn,
+                                    char const *filename) {
+  /* rrdcached resolves relative paths against its own base directory, unless
+   * the client is local. librrd makes them absolute in that case, too. */
+  if (rc_conn_is_unix(conn) && (filename[0] != '/')) {
+    char cwd[PATH_MAX];
+
+    if (getcwd(cwd, sizeof(cwd)) == NULL)
+      return errno;
+    if ((rc_batch_append_filename(b, conn, cwd) != 0) ||
+        (rc_batch_append(b, "/") != 0))
+      return ENOMEM;
+  }
+
+  if (rc_batch_reserve(b, 2 * strlen(filename)) != 0)
+    return ENOMEM;
+
+  for (char const *ptr = filename; *ptr != 0; ptr++) {
+    if ((*ptr == ' ') || (*ptr == '\\'))
+      b->data[b->fill++] = '\\';
+    b->data[b->fill++] = *ptr;
+  }
+  b->data[b->fill] = 0;
+
+  return 0;
+} /* int rc_batch_append_filename */
+
+static int rc_batch_add(rc_batch_t *b, rc_conn_t const *conn,
+                        char const *filename, char const *values) {
+  size_t fill = b->fill;
+
+  if ((fill == 0) && (rc_batch_append(b, "BATCH\n") != 0))
+    return ENOMEM;
+
+  if ((rc_batch_append(b, "UPDATE ") != 0) ||
+      (rc_batch_append_filename(b, conn, filename) != 0) ||
+      (rc_batch_append(b, " ") != 0) || (rc_batch_append(b, values) != 0) ||
+      (rc_batch_append(b, "\n") != 0)) {
+    b->fill = fill;
+    return ENOMEM;
+  }
+
+  b->num++;
+  return 0;
+} /* int rc_batch_add */
+
+/* Sends the "BATCH" command in "b" and logs the updates rejected by the
+ * daemon. The command, the updates and the terminating dot are written at
+ * once, so the batch costs a single round-trip. Must be called with
+ * "conn->lock" held. */
+static int rc_conn_send_batch(rc_conn_t *conn, rc_batch_t *b) {
+  char buffer[1024];
+  _Bool retried = 0;
+  _Bool failed;
+  int status = 0;
+
+  if (rc_batch_append(b, ".\n") != 0)
+    return ENOMEM;
+
+  while (42) {
+    failed = (rc_conn_connect(conn) != 0) ||
+             (swrite(fileno(conn->fh), b->data, b->fill) != 0);
+    if (!failed)
+      status = rc_conn_read_status(conn, buffer, sizeof(buffer), &failed);
+    if (!failed && (status == 0))
+      break;
+
+    /* A connection closed by the daemon is only noticed when using it,
+     * hence we'll have to retry upon failed operations. */
+    rc_conn_close(conn);
+    if (!retried) {
+      retried = 1;
+      continue;
+    }
+
+    ERROR("rrdcached plugin: Sending %zu updates to %s failed%s%s.", b->num,
+          conn->address, failed ? "" : ": ", failed ? "" : buffer);
+    return -1;
+  }
+
+  int errors_num = rc_conn_read_status(conn, buffer, sizeof(buffer), &failed);
+  if (failed || (errors_num < 0)) {
+    ERROR("rrdcached plugin: Reading the BATCH response from %s failed.",
+          conn->address);
+    rc_conn_close(conn);
+    return -1;
+  }
+
+  /* Every error is reported as "<command number> <message>". */
+  for (int i = 0; i < errors_num; i++) {
+    if (fgets(buffer, sizeof(buffer), conn->fh) == NULL) {
+      rc_conn_close(conn);
+      break;
+    }
+    strstripnewline(buffer);
+    ERROR("rrdcached plugin: rrdcached at %s rejected update %s",
+          conn->address, buffer);
+  }
+
+  return (errors_num == 0) ? 0 : -1;
+} /* int rc_conn_send_batch */
+
+static int rc_conn_flush(rc_conn_t *conn, char const *filename) {
+  char buffer[1024];
+  rc_batch_t b = {0};
+  _Bool retried = 0;
+  _Bool failed;
+  int status = 0;
+
+  if ((rc_batch_append(&b, "FLUSH ") != 0) ||
+      (rc_batch_append_filename(&b, conn, filename) != 0) ||
+      (rc_batch_append(&b, "\n") != 0)) {
+    sfree(b.data);
+    return ENOMEM;
+  }
+
+  pthread_mutex_lock(&conn->lock);
+  while (42) {
+    failed = (rc_conn_connect(conn) != 0) ||
+             (swrite(fileno(conn->fh), b.data, b.fill) != 0);
+    if (!failed)
+      status = rc_conn_read_status(conn, buffer, sizeof(buffer), &failed);
+    if (!failed)
+      break;
+
+    rc_conn_close(conn);
+    if (retried)
+      break;
+    retried = 1;
+  }
+  /* Skip the lines following the status line. */
+  for (int i = 0; !failed && (i < status); i++) {
+    if (fgets(buffer, sizeof(buffer), conn->fh) == NULL) {
+      rc_conn_close(conn);
+      break;
+    }
+  }
+  pthread_mutex_unlock(&conn->lock);
+
+  sfree(b.data);
+  if (failed || (status < 0)) {
+    ERROR("rrdcached plugin: Flushing %s at %s failed: %s", filename,
+          conn->address, failed ? "no response" : buffer);
+    return -1;
+  }
+  return 0;
+} /* int rc_conn_flush */
+
+static rc_conn_t *rc_conn_get(char const *filename) {
+  if (conns_num == 1)
+    return conns;
+  return conns + (identifier_hash(filename) % conns_num);
+} /* rc_conn_t *rc_conn_get */
+
 static int rc_read(void) {
   int status;
   rrdc_stats_t *head;
@@ -386,38 +819,29 @@ static int rc_init(void) {
   return 0;
 } /* int rc_init */
 
-static int rc_write(const data_set_t *ds, const value_list_t *vl,
-                    user_data_t __attribute__((unused)) * user_data) {
-  char filename[PATH_MAX];
-  char values[512];
-  char *values_array[2];
+/* Determines the file name and the update string of "vl" and creates the file
+ * if necessary. Returns a positive value if the file is being created
+ * asynchronously and the value should be dropped. */
+static int rc_prepare(const data_set_t *ds, const value_list_t *vl,
+                      char *filename, size_t filename_size, char *values,
+                      size_t values_size) {
   int status;
-  _Bool retried = 0;
-
-  if (daemon_address == NULL) {
-    ERROR("rrdcached plugin: daemon_address == NULL.");
-    plugin_unregister_write("rrdcached");
-    return -1;
-  }
 
   if (strcmp(ds->type, vl->type) != 0) {
     ERROR("rrdcached plugin: DS type does not match value list type");
     return -1;
   }
 
-  if (value_list_to_filename(filename, sizeof(filename), vl) != 0) {
+  if (value_list_to_filename(filename, filename_size, vl) != 0) {
     ERROR("rrdcached plugin: value_list_to_filename failed.");
     return -1;
   }
 
-  if (value_list_to_string(values, sizeof(values), ds, vl) != 0) {
+  if (value_list_to_string(values, (int)values_size, ds, vl) != 0) {
     ERROR("rrdcached plugin: value_list_to_string failed.");
     return -1;
   }
 
-  values_array[0] = values;
-  values_array[1] = NULL;
-
   if (config_create_files) {
     struct stat statbuf;
 
@@ -433,10 +857,35 @@ static int rc_write(const data_set_t *ds, const value_list_t *vl,
         ERROR("rrdcached plugin: cu_rrd_create_file (%s) failed.", filename);
         return -1;
       } else if (rrdcreate_config.async)
-        return 0;
+        return 1;
     }
   }
 
+  return 0;
+} /* int rc_prepare */
+
+static int rc_write(const data_set_t *ds, const value_list_t *vl,
+                    user_data_t __attribute__((unused)) * user_data) {
+  char filename[PATH_MAX];
+  char values[512];
+  char *values_array[2];
+  int status;
+  _Bool retried = 0;
+
+  if (daemon_address == NULL) {
+    ERROR("rrdcached plugin: daemon_address == NULL.");
+    plugin_unregister_write("rrdcached");
+    return -1;
+  }
+
+  status = rc_prepare(ds, vl, filename, sizeof(filename), values,
+                      sizeof(values));
+  if (status != 0)
+    return (status > 0) ? 0 : -1;
+
+  values_array[0] = values;
+  values_array[1] = NULL;
+
   rrd_clear_error();
   status = rrdc_connect(daemon_address);
   if (status != 0) {
@@ -469,6 +918,52 @@ static int rc_write(const data_set_t *ds, const value_list_t *vl,
   return 0;
 } /* int rc_write */
 
+/* Groups the value lists by connection and sends one "BATCH" command to each
+ * daemon. */
+static int rc_write_batch(const write_batch_entry_t *entries,
+                          size_t entries_num,
+                          user_data_t __attribute__((unused)) * user_data) {
+  char filename[PATH_MAX];
+  char values[512];
+  int ret = 0;
+
+  rc_batch_t *batches = calloc(conns_num, sizeof(*batches));
+  if (batches == NULL) {
+    ERROR("rrdcached plugin: calloc failed.");
+    return ENOMEM;
+  }
+
+  for (size_t i = 0; i < entries_num; i++) {
+    int status = rc_prepare(entries[i].ds, entries[i].vl, filename,
+                            sizeof(filename), values, sizeof(values));
+    if (status != 0) {
+      if (status < 0)
+        ret = -1;
+      continue;
+    }
+
+    rc_conn_t *conn = rc_conn_get(filename);
+    if (rc_batch_add(batches + (conn - conns), conn, filename, values) != 0) {
+      ERROR("rrdcached plugin: Adding an update for %s failed.", filename);
+      ret = -1;
+    }
+  }
+
+  for (size_t i = 0; i < conns_num; i++) {
+    if (batches[i].num == 0)
+      continue;
+
+    pthread_mutex_lock(&conns[i].lock);
+    if (rc_conn_send_batch(conns + i, batches + i) != 0)
+      ret = -1;
+    pthread_mutex_unlock(&conns[i].lock);
+    sfree(batches[i].data);
+  }
+
+  sfree(batches);
+  return ret;
+} /* int rc_write_batch */
+
 static int rc_flush(__attribute__((unused)) cdtime_t timeout, /* {{{ */
                     const char *identifier,
                     __attribute__((unused)) user_data_t *ud) {
@@ -484,6 +979,9 @@ static int rc_flush(__attribute__((unused)) cdtime_t timeout, /* {{{ */
   else
     snprintf(filename, sizeof(filename), "%s.rrd", identifier);
 
+  if (conns_num > 0)
+    return rc_conn_flush(rc_conn_get(filename), filename);
+
   rrd_clear_error();
   status = rrdc_connect(daemon_address);
   if (status != 0) {
@@ -519,6 +1017,20 @@ static int rc_flush(__attribute__((unused)) cdtime_t timeout, /* {{{ */
 
 static int rc_shutdown(void) {
   rrdc_disconnect();
+
+  for (size_t i = 0; i < conns_num; i++) {
+    rc_conn_close(conns + i);
+    pthread_mutex_destroy(&conns[i].lock);
+  }
+  sfree(conns);
+  conns_num = 0;
+
+  for (size_t i = 0; i < daemon_addresses_num; i++)
+    sfree(daemon_addresses[i]);
+  sfree(daemon_addresses);
+  daemon_addresses_num = 0;
+  daemon_address = NULL;
+
   return 0;
 } /* int rc_shutdown */
 
@@ -33,12 +33,33 @@
 
 #include <rrd.h>
 
+/* Bounds of the delay between two updates of one shard, see
+ * rrd_shard_pace(). */
+#define RRD_MIN_UPDATE_DELAY MS_TO_CDTIME_T(1)
+#define RRD_MAX_UPDATE_DELAY TIME_T_TO_CDTIME_T_STATIC(1)
+
+/* Capacity of the first batch of updates of a file. Later batches start
+ * with the size of the previous one. */
+#define RRD_UPDATES_INITIAL 4
+
 /*
  * Private types
  */
+/* Updates of one file which have not been written yet. They are kept in
+ * binary form and only formatted for rrd_update(). The values of update `i'
+ * start at `values[i * ds_num]'. */
+typedef struct rrd_updates_s {
+  size_t ds_num;
+  int *ds_type;
+  size_t num;
+  size_t size;
+  cdtime_t *time;
+  value_t *values;
+} rrd_updates_t;
+
 typedef struct rrd_cache_s {
-  int values_num;
-  char **values;
+  rrd_updates_t *updates; /* NULL if there are no pending updates */
+  size_t updates_hint;    /* number of updates in the last batch */
   cdtime_t first_value;
   cdtime_t last_value;
   int64_t random_variation;
@@ -54,13 +75,33 @@ struct rrd_queue_s {
 };
 typedef struct rrd_queue_s rrd_queue_t;
 
+/* The update queue is sharded by file name over "WriteThreads" threads, so
+ * every file is always updated by the same thread. Each shard has its own
+ * lock and paces its own updates. */
+struct rrd_shard_s {
+  rrd_queue_t *queue_head;
+  rrd_queue_t *queue_tail;
+  rrd_queue_t *flushq_head;
+  rrd_queue_t *flushq_tail;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  pthread_t thread;
+  _Bool thread_running;
+
+  /* Used by the shard's thread only. */
+  cdtime_t latency;      /* moving average of the update latency */
+  cdtime_t update_delay; /* delay before the next update */
+};
+typedef struct rrd_shard_s rrd_shard_t;
+
 /*
  * Private variables
  */
 static const char *config_keys[] = {
     "CacheTimeout", "CacheFlush",      "CreateFilesAsync", "DataDir",
     "StepSize",     "HeartBeat",       "RRARows",          "RRATimespan",
-    "XFF",          "WritesPerSecond", "RandomTimeout"};
+    "XFF",          "WritesPerSecond", "RandomTimeout",
+    "WriteThreads", "WriteLatencyTarget"};
 static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 
 /* If datadir is zero, the daemon's basedir is used. If stepsize or heartbeat
@@ -68,6 +109,8 @@ static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
  * being used. */
 static char *datadir = NULL;
 static double write_rate = 0.0;
+static size_t queue_threads_num = 1;
+static cdtime_t write_latency_target = 0;
 static rrdcreate_config_t rrdcreate_config = {
     /* stepsize = */ 0,
     /* heartbeat = */ 0,
@@ -82,8 +125,8 @@ static rrdcreate_config_t rrdcreate_config = {
 
     /* async = */ 0};
 
-/* XXX: If you need to lock both, cache_lock and queue_lock, at the same time,
- * ALWAYS lock `cache_lock' first! */
+/* XXX: If you need to lock both, cache_lock and a shard's lock, at the same
+ * time, ALWAYS lock `cache_lock' first! */
 static cdtime_t cache_timeout = 0;
 static cdtime_t cache_flush_timeout = 0;
 static cdtime_t random_timeout = 0;
@@ -91,14 +134,8 @@ static cdtime_t cache_flush_last;
 static c_avl_tree_t *cache = NULL;
 static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
 
-static rrd_queue_t *queue_head = NULL;
-static rrd_queue_t *queue_tail = NULL;
-static rrd_queue_t *flushq_head = NULL;
-static rrd_queue_t *flushq_tail = NULL;
-static pthread_t queue_thread;
-static int queue_thread_running = 1;
-static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
-static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+static rrd_shard_t *shards = NULL;
+static size_t shards_num = 0;
 
 #if !HAVE_THREADSAFE_LIBRRD
 static pthread_mutex_t librrd_lock = PTHREAD_MUTEX_INITIALIZER;
@@ -163,85 +200,131 @@ static int srrd_update(char *filename, char *template, int argc,
 } /* int srrd_update */
 #endif /* !HAVE_THREADSAFE_LIBRRD */
 
-static int value_list_to_string_multiple(char *buffer, int buffer_len,
-                                         const data_set_t *ds,
-                                         const value_list_t *vl) {
-  int offset;
-  int status;
-  time_t tt;
+static rrd_updates_t *rrd_updates_create(const data_set_t *ds, /* {{{ */
+                                         size_t size) {
+  rrd_updates_t *u;
+
+  if (size < RRD_UPDATES_INITIAL)
+    size = RRD_UPDATES_INITIAL;
+
+  u = calloc(1, sizeof(*u));
+  if (u == NULL)
+    return NULL;
+
+  u->ds_num = ds->ds_num;
+  u->size = size;
+  u->ds_type = calloc(ds->ds_num, sizeof(*u->ds_type));
+  u->time = calloc(size, sizeof(*u->time));
+  u->values = calloc(size * ds->ds_num, sizeof(*u->values));
+  if ((u->ds_type == NULL) || (u->time == NULL) || (u->values == NULL)) {
+    sfree(u->ds_type);
+    sfree(u->time);
+    sfree(u->values);
+    sfree(u);
+    return NULL;
+  }
 
-  memset(buffer, '\0', buffer_len);
+  for (size_t i = 0; i < ds->ds_num; i++)
+    u->ds_type[i] = ds->ds[i].type;
 
-  tt = CDTIME_T_TO_TIME_T(vl->time);
-  status = snprintf(buffer, buffer_len, "%u", (unsigned int)tt);
-  if ((status < 1) || (status >= buffer_len))
-    return -1;
-  offset = status;
+  return u;
+} /* }}} rrd_updates_t *rrd_updates_create */
 
-  for (size_t i = 0; i < ds->ds_num; i++) {
-    if ((ds->ds[i].type != DS_TYPE_COUNTER) &&
-        (ds->ds[i].type != DS_TYPE_GAUGE) &&
-        (ds->ds[i].type != DS_TYPE_DERIVE) &&
-        (ds->ds[i].type != DS_TYPE_ABSOLUTE))
-      return -1;
+static void rrd_updates_destroy(rrd_updates_t *u) /* {{{ */
+{
+  if (u == NULL)
+    return;
+
+  sfree(u->ds_type);
+  sfree(u->time);
+  sfree(u->values);
+  sfree(u);
+} /* }}} void rrd_updates_destroy */
+
+static int rrd_updates_append(rrd_updates_t *u, /* {{{ */
+                              const value_list_t *vl) {
+  if (vl->values_len != u->ds_num)
+    return EINVAL;
 
-    if (ds->ds[i].type == DS_TYPE_COUNTER)
-      status = snprintf(buffer + offset, buffer_len - offset, ":%" PRIu64,
-                        (uint64_t)vl->values[i].counter);
-    else if (ds->ds[i].type == DS_TYPE_GAUGE)
-      status = snprintf(buffer + offset, buffer_len - offset, ":" GAUGE_FORMAT,
-                        vl->values[i].gauge);
-    else if (ds->ds[i].type == DS_TYPE_DERIVE)
-      status = snprintf(buffer + offset, buffer_len - offset, ":%" PRIi64,
-                        vl->values[i].derive);
-    else /*if (ds->ds[i].type == DS_TYPE_ABSOLUTE) */
-      status = snprintf(buffer + offset, buffer_len - offset, ":%" PRIu64,
-                        vl->values[i].absolute);
+  if (u->num == u->size) {
+    size_t size = 2 * u->size;
 
-    if ((status < 1) || (status >= (buffer_len - offset)))
-      return -1;
+    cdtime_t *time = realloc(u->time, size * sizeof(*time));
+    if (time == NULL)
+      return ENOMEM;
+    u->time = time;
+
+    value_t *values = realloc(u->values, size * u->ds_num * sizeof(*values));
+    if (values == NULL)
+      return ENOMEM;
+    u->values = values;
+
+    u->size = size;
+  }
 
-    offset += status;
-  } /* for ds->ds_num */
+  u->time[u->num] = vl->time;
+  memcpy(u->values + u->num * u->ds_num, vl->values,
+         u->ds_num * sizeof(*u->values));
+  u->num++;
 
   return 0;
-} /* int value_list_to_string_multiple */
+} /* }}} int rrd_updates_append */
 
-static int value_list_to_string(char *buffer, int buffer_len,
-                                const data_set_t *ds, const value_list_t *vl) {
+/* Formats update `i' as expected by rrd_update(), e.g. "1234567890:1.5". */
+static int rrd_update_to_string(char *buffer, size_t buffer_len, /* {{{ */
+                                const rrd_updates_t *u, size_t i) {
+  const value_t *values = u->values + i * u->ds_num;
+  size_t offset;
   int status;
-  time_t tt;
-
-  if (ds->ds_num != 1)
-    return value_list_to_string_multiple(buffer, buffer_len, ds, vl);
-
-  tt = CDTIME_T_TO_TIME_T(vl->time);
-  switch (ds->ds[0].type) {
-  case DS_TYPE_DERIVE:
-    status = snprintf(buffer, buffer_len, "%u:%" PRIi64, (unsigned)tt,
-                      vl->values[0].derive);
-    break;
-  case DS_TYPE_GAUGE:
-    status = snprintf(buffer, buffer_len, "%u:" GAUGE_FORMAT, (unsigned)tt,
-                      vl->values[0].gauge);
-    break;
-  case DS_TYPE_COUNTER:
-    status = snprintf(buffer, buffer_len, "%u:%" PRIu64, (unsigned)tt,
-                      (uint64_t)vl->values[0].counter);
-    break;
-  case DS_TYPE_ABSOLUTE:
-    status = snprintf(buffer, buffer_len, "%u:%" PRIu64, (unsigned)tt,
-                      vl->values[0].absolute);
-    break;
-  default:
-    return EINVAL;
-  }
 
-  if ((status < 1) || (status >= buffer_len))
+  status = snprintf(buffer, buffer_len, "%u",
+                    (unsigned int)CDTIME_T_TO_TIME_T(u->time[i]));
+  if ((status < 1) || ((size_t)status >= buffer_len))
     return ENOMEM;
+  offset = (size_t)status;
+
+  for (size_t j = 0; j < u->ds_num; j++) {
+    if (u->ds_type[j] == DS_TYPE_COUNTER)
+      status = snprintf(buffer + offset, buffer_len - offset, ":%" PRIu64,
+                        (uint64_t)values[j].counter);
+    else if (u->ds_type[j] == DS_TYPE_GAUGE)
+      status = snprintf(buffer + offset, buffer_len - offset, ":" GAUGE_FORMAT,
+                        values[j].gauge);
+    else if (u->ds_type[j] == DS_TYPE_DERIVE)
+      status = snprintf(buffer + offset, buffer_len - offset, ":%" PRIi64,
+                        values[j].derive);
+    else /* if (u->ds_type[j] == DS_TYPE_ABSOLUTE) */
+      status = snprintf(buffer + offset, buffer_len - offset, ":%" PRIu64,
+                        values[j].absolute);
+
+    if ((status < 1) || ((size_t)status >= (buffer_len - offset)))
+      return ENOMEM;
+    offset += (size_t)status;
+  }
 
   return 0;
-} /* int value_list_to_string */
+} /* }}} int rrd_update_to_string */
+
+/* Returns the updates formatted as arguments for rrd_update(). The strings
+ * are stored in the same allocation as the array. */
+static char **rrd_updates_format(const rrd_updates_t *u) /* {{{ */
+{
+  size_t line_len = 32 * (u->ds_num + 1);
+  char **argv = malloc(u->num * (sizeof(*argv) + line_len));
+  if (argv == NULL)
+    return NULL;
+
+  char *lines = (char *)(argv + u->num);
+  for (size_t i = 0; i < u->num; i++) {
+    argv[i] = lines + i * line_len;
+    if (rrd_update_to_string(argv[i], line_len, u, i) != 0) {
+      sfree(argv);
+      return NULL;
+    }
+  }
+
+  return argv;
+} /* }}} char **rrd_updates_format */
 
 static int value_list_to_filename(char *buffer, size_t buffer_size,
                                   value_list_t const *vl) {
@@ -279,136 +362,161 @@ static int value_list_to_filename(char *buffer, size_t buffer_size,
   return 0;
 } /* int value_list_to_filename */
 
-static void *rrd_queue_thread(void __attribute__((unused)) * data) {
-  struct timeval tv_next_update;
-  struct timeval tv_now;
+/* Adapts the delay between two updates of a shard to the measured update
+ * latency. While the moving average of the latency exceeds
+ * "WriteLatencyTarget", the storage is considered saturated and the delay is
+ * doubled; otherwise it is halved. Delayed files collect more values in the
+ * cache, which are then written by a single update. */
+static void rrd_shard_pace(rrd_shard_t *shard, cdtime_t latency) /* {{{ */
+{
+  /* Exponentially weighted moving average with alpha = 1/8. */
+  if (shard->latency == 0)
+    shard->latency = latency;
+  else
+    shard->latency = shard->latency - (shard->latency / 8) + (latency / 8);
+
+  if (write_latency_target == 0)
+    return;
+
+  if (shard->latency > write_latency_target) {
+    if (shard->update_delay == 0)
+      shard->update_delay = shard->latency;
+    else
+      shard->update_delay *= 2;
+    if (shard->update_delay > RRD_MAX_UPDATE_DELAY)
+      shard->update_delay = RRD_MAX_UPDATE_DELAY;
+  } else {
+    shard->update_delay /= 2;
+    if (shard->update_delay < RRD_MIN_UPDATE_DELAY)
+      shard->update_delay = 0;
+  }
+} /* }}} void rrd_shard_pace */
 
-  gettimeofday(&tv_next_update, /* timezone = */ NULL);
+static void *rrd_queue_thread(void *data) {
+  rrd_shard_t *shard = data;
+  cdtime_t next_update = cdtime_precise();
 
   while (42) {
     rrd_queue_t *queue_entry;
     rrd_cache_t *cache_entry;
-    char **values;
-    int values_num;
+    rrd_updates_t *updates;
     int status;
 
-    values = NULL;
-    values_num = 0;
+    updates = NULL;
 
-    pthread_mutex_lock(&queue_lock);
+    pthread_mutex_lock(&shard->lock);
     /* Wait for values to arrive */
     while (42) {
-      struct timespec ts_wait;
-
-      while ((flushq_head == NULL) && (queue_head == NULL) &&
+      while ((shard->flushq_head == NULL) && (shard->queue_head == NULL) &&
              (do_shutdown == 0))
-        pthread_cond_wait(&queue_cond, &queue_lock);
+        pthread_cond_wait(&shard->cond, &shard->lock);
 
-      if ((flushq_head == NULL) && (queue_head == NULL))
+      if ((shard->flushq_head == NULL) && (shard->queue_head == NULL))
         break;
 
       /* Don't delay if there's something to flush */
-      if (flushq_head != NULL)
+      if (shard->flushq_head != NULL)
         break;
 
       /* Don't delay if we're shutting down */
       if (do_shutdown != 0)
         break;
 
-      /* Don't delay if no delay was configured. */
-      if (write_rate <= 0.0)
-        break;
-
-      gettimeofday(&tv_now, /* timezone = */ NULL);
-      status = timeval_cmp(tv_next_update, tv_now, NULL);
       /* We're good to go */
-      if (status <= 0)
+      if (next_update <= cdtime_precise())
         break;
 
       /* We're supposed to wait a bit with this update, so we'll
        * wait for the next addition to the queue or to the end of
        * the wait period - whichever comes first. */
-      ts_wait.tv_sec = tv_next_update.tv_sec;
-      ts_wait.tv_nsec = 1000 * tv_next_update.tv_usec;
-
-      status = pthread_cond_timedwait(&queue_cond, &queue_lock, &ts_wait);
+      struct timespec ts_wait = CDTIME_T_TO_TIMESPEC(next_update);
+      status = pthread_cond_timedwait(&shard->cond, &shard->lock, &ts_wait);
       if (status == ETIMEDOUT)
         break;
     } /* while (42) */
 
-    /* XXX: If you need to lock both, cache_lock and queue_lock, at
+    /* XXX: If you need to lock both, cache_lock and a shard's lock, at
      * the same time, ALWAYS lock `cache_lock' first! */
 
     /* We're in the shutdown phase */
-    if ((flushq_head == NULL) && (queue_head == NULL)) {
-      pthread_mutex_unlock(&queue_lock);
+    if ((shard->flushq_head == NULL) && (shard->queue_head == NULL)) {
+      pthread_mutex_unlock(&shard->lock);
       break;
     }
 
-    if (flushq_head != NULL) {
+    if (shard->flushq_head != NULL) {
       /* Dequeue the first flush entry */
-      queue_entry = flushq_head;
-      if (flushq_head == flushq_tail)
-        flushq_head = flushq_tail = NULL;
+      queue_entry = shard->flushq_head;
+      if (shard->flushq_head == shard->flushq_tail)
+        shard->flushq_head = shard->flushq_tail = NULL;
       else
-        flushq_head = flushq_head->next;
-    } else /* if (queue_head != NULL) */
+        shard->flushq_head = shard->flushq_head->next;
+    } else /* if (shard->queue_head != NULL) */
     {
       /* Dequeue the first regular entry */
-      queue_entry = queue_head;
-      if (queue_head == queue_tail)
-        queue_head = queue_tail = NULL;
+      queue_entry = shard->queue_head;
+      if (shard->queue_head == shard->queue_tail)
+        shard->queue_head = shard->queue_tail = NULL;
       else
-        queue_head = queue_head->next;
+        shard->queue_head = shard->queue_head->next;
     }
 
     /* Unlock the queue again */
-    pthread_mutex_unlock(&queue_lock);
+    pthread_mutex_unlock(&shard->lock);
 
     /* We now need the cache lock so the entry isn't updated while
-     * we make a copy of its values */
+     * we take its updates */
     pthread_mutex_lock(&cache_lock);
 
     status = c_avl_get(cache, queue_entry->filename, (void *)&cache_entry);
 
     if (status == 0) {
-      values = cache_entry->values;
-      values_num = cache_entry->values_num;
+      updates = cache_entry->updates;
+      if (updates != NULL)
+        cache_entry->updates_hint = updates->num;
 
-      cache_entry->values = NULL;
-      cache_entry->values_num = 0;
+      cache_entry->updates = NULL;
       cache_entry->flags = FLAG_NONE;
     }
 
     pthread_mutex_unlock(&cache_lock);
 
-    if (status != 0) {
+    char **values = NULL;
+    if (updates != NULL) {
+      values = rrd_updates_format(updates);
+      if (values == NULL)
+        ERROR("rrdtool plugin: Formatting %" PRIsz " update%s of %s failed.",
+              updates->num, (updates->num == 1) ? "" : "s",
+              queue_entry->filename);
+    }
+
+    if (values == NULL) {
+      rrd_updates_destroy(updates);
       sfree(queue_entry->filename);
       sfree(queue_entry);
       continue;
     }
 
-    /* Update `tv_next_update' */
+    /* Write the values to the RRD-file */
+    cdtime_t update_start = cdtime_precise();
+    srrd_update(queue_entry->filename, NULL, (int)updates->num,
+                (const char **)values);
+    cdtime_t now = cdtime_precise();
+    DEBUG("rrdtool plugin: queue thread: Wrote %" PRIsz " value%s to %s",
+          updates->num, (updates->num == 1) ? "" : "s", queue_entry->filename);
+
+    /* Update `next_update'. "WritesPerSecond" is shared by all shards. */
+    rrd_shard_pace(shard, now - update_start);
+    cdtime_t delay = shard->update_delay;
     if (write_rate > 0.0) {
-      gettimeofday(&tv_now, /* timezone = */ NULL);
-      tv_next_update.tv_sec = tv_now.tv_sec;
-      tv_next_update.tv_usec =
-          tv_now.tv_usec + ((suseconds_t)(1000000 * write_rate));
-      while (tv_next_update.tv_usec > 1000000) {
-        tv_next_update.tv_sec++;
-        tv_next_update.tv_usec -= 1000000;
-      }
+      cdtime_t interval = DOUBLE_TO_CDTIME_T(write_rate * (double)shards_num);
+      if (interval > delay)
+        delay = interval;
     }
+    next_update = now + delay;
 
-    /* Write the values to the RRD-file */
-    srrd_update(queue_entry->filename, NULL, values_num, (const char **)values);
-    DEBUG("rrdtool plugin: queue thread: Wrote %i value%s to %s", values_num,
-          (values_num == 1) ? "" : "s", queue_entry->filename);
-
-    for (int i = 0; i < values_num; i++) {
-      sfree(values[i]);
-    }
     sfree(values);
+    rrd_updates_destroy(updates);
     sfree(queue_entry->filename);
     sfree(queue_entry);
   } /* while (42) */
@@ -417,8 +525,17 @@ static void *rrd_queue_thread(void __attribute__((unused)) * data) {
   return (void *)0;
 } /* void *rrd_queue_thread */
 
-static int rrd_queue_enqueue(const char *filename, rrd_queue_t **head,
-                             rrd_queue_t **tail) {
+/* Returns the shard which updates "filename". */
+static rrd_shard_t *rrd_shard_get(const char *filename) /* {{{ */
+{
+  if (shards_num == 1)
+    return shards;
+
+  return shards + (identifier_hash(filename) % shards_num);
+} /* }}} rrd_shard_t *rrd_shard_get */
+
+static int rrd_queue_enqueue(rrd_shard_t *shard, const char *filename,
+                             rrd_queue_t **head, rrd_queue_t **tail) {
   rrd_queue_t *queue_entry;
 
   queue_entry = malloc(sizeof(*queue_entry));
@@ -433,7 +550,7 @@ static int rrd_queue_enqueue(const char *filename, rrd_queue_t **head,
 
   queue_entry->next = NULL;
 
-  pthread_mutex_lock(&queue_lock);
+  pthread_mutex_lock(&shard->lock);
 
   if (*tail == NULL)
     *head = queue_entry;
@@ -441,18 +558,18 @@ static int rrd_queue_enqueue(const char *filename, rrd_queue_t **head,
     (*tail)->next = queue_entry;
   *tail = queue_entry;
 
-  pthread_cond_signal(&queue_cond);
-  pthread_mutex_unlock(&queue_lock);
+  pthread_cond_signal(&shard->cond);
+  pthread_mutex_unlock(&shard->lock);
 
   return 0;
 } /* int rrd_queue_enqueue */
 
-static int rrd_queue_dequeue(const char *filename, rrd_queue_t **head,
-                             rrd_queue_t **tail) {
+static int rrd_queue_dequeue(rrd_shard_t *shard, const char *filename,
+                             rrd_queue_t **head, rrd_queue_t **tail) {
   rrd_queue_t *this;
   rrd_queue_t *prev;
 
-  pthread_mutex_lock(&queue_lock);
+  pthread_mutex_lock(&shard->lock);
 
   prev = NULL;
   this = *head;
@@ -466,7 +583,7 @@ static int rrd_queue_dequeue(const char *filename, rrd_queue_t **head,
   }
 
   if (this == NULL) {
-    pthread_mutex_unlock(&queue_lock);
+    pthread_mutex_unlock(&shard->lock);
     return -1;
   }
 
@@ -478,7 +595,7 @@ static int rrd_queue_dequeue(const char *filename, rrd_queue_t **head,
   if (this->next == NULL)
     *tail = prev;
 
-  pthread_mutex_unlock(&queue_lock);
+  pthread_mutex_unlock(&shard->lock);
 
   sfree(this->filename);
   sfree(this);
@@ -510,10 +627,10 @@ static void rrd_cache_flush(cdtime_t timeout) {
     /* timeout == 0  =>  flush everything */
     else if ((timeout != 0) && ((now - rc->first_value) < timeout))
       continue;
-    else if (rc->values_num > 0) {
-      int status;
-
-      status = rrd_queue_enqueue(key, &queue_head, &queue_tail);
+    else if (rc->updates != NULL) {
+      rrd_shard_t *shard = rrd_shard_get(key);
+      int status = rrd_queue_enqueue(shard, key, &shard->queue_head,
+                                     &shard->queue_tail);
       if (status == 0)
         rc->flags = FLAG_QUEUED;
     } else /* ancient and no values -> waste of memory */
@@ -538,8 +655,7 @@ static void rrd_cache_flush(cdtime_t timeout) {
       continue;
     }
 
-    assert(rc->values == NULL);
-    assert(rc->values_num == 0);
+    assert(rc->updates == NULL);
 
     sfree(rc);
     sfree(key);
@@ -579,17 +695,20 @@ static int rrd_cache_flush_identifier(cdtime_t timeout,
     return status;
   }
 
+  rrd_shard_t *shard = rrd_shard_get(key);
   if (rc->flags == FLAG_FLUSHQ) {
     status = 0;
   } else if (rc->flags == FLAG_QUEUED) {
-    rrd_queue_dequeue(key, &queue_head, &queue_tail);
-    status = rrd_queue_enqueue(key, &flushq_head, &flushq_tail);
+    rrd_queue_dequeue(shard, key, &shard->queue_head, &shard->queue_tail);
+    status = rrd_queue_enqueue(shard, key, &shard->flushq_head,
+                               &shard->flushq_tail);
     if (status == 0)
       rc->flags = FLAG_FLUSHQ;
   } else if ((now - rc->first_value) < timeout) {
     status = 0;
-  } else if (rc->values_num > 0) {
-    status = rrd_queue_enqueue(key, &flushq_head, &flushq_tail);
+  } else if (rc->updates != NULL) {
+    status = rrd_queue_enqueue(shard, key, &shard->flushq_head,
+                               &shard->flushq_tail);
     if (status == 0)
       rc->flags = FLAG_FLUSHQ;
   }
@@ -604,11 +723,11 @@ static int64_t rrd_get_random_variation(void) {
   return (int64_t)cdrand_range(-random_timeout, random_timeout);
 } /* int64_t rrd_get_random_variation */
 
-static int rrd_cache_insert(const char *filename, const char *value,
-                            cdtime_t value_time) {
+static int rrd_cache_insert(const char *filename, const data_set_t *ds,
+                            const value_list_t *vl) {
   rrd_cache_t *rc = NULL;
   int new_rc = 0;
-  char **values_new;
+  cdtime_t value_time = vl->time;
 
   pthread_mutex_lock(&cache_lock);
 
@@ -627,8 +746,8 @@ static int rrd_cache_insert(const char *filename, const char *value,
       pthread_mutex_unlock(&cache_lock);
       return -1;
     }
-    rc->values_num = 0;
-    rc->values = NULL;
+    rc->updates = NULL;
+    rc->updates_hint = 0;
     rc->first_value = 0;
     rc->last_value = 0;
     rc->random_variation = rrd_get_random_variation();
@@ -645,28 +764,32 @@ static int rrd_cache_insert(const char *filename, const char *value,
     return -1;
   }
 
-  values_new =
-      realloc((void *)rc->values, (rc->values_num + 1) * sizeof(char *));
-  if (values_new == NULL) {
+  if (rc->updates == NULL)
+    rc->updates = rrd_updates_create(ds, rc->updates_hint);
+
+  status = (rc->updates == NULL) ? ENOMEM : rrd_updates_append(rc->updates, vl);
+  if (status == EINVAL) {
+    pthread_mutex_unlock(&cache_lock);
+    ERROR("rrdtool plugin: The number of values for %s changed from %" PRIsz
+          " to %" PRIsz ".",
+          filename, rc->updates->ds_num, vl->values_len);
+    return -1;
+  } else if (status != 0) {
     void *cache_key = NULL;
 
     c_avl_remove(cache, filename, &cache_key, NULL);
     pthread_mutex_unlock(&cache_lock);
 
-    ERROR("rrdtool plugin: realloc failed: %s", STRERRNO);
+    ERROR("rrdtool plugin: Storing the update of %s failed: %s", filename,
+          STRERROR(status));
 
     sfree(cache_key);
-    sfree(rc->values);
+    rrd_updates_destroy(rc->updates);
     sfree(rc);
     return -1;
   }
-  rc->values = values_new;
-
-  rc->values[rc->values_num] = strdup(value);
-  if (rc->values[rc->values_num] != NULL)
-    rc->values_num++;
 
-  if (rc->values_num == 1)
+  if (rc->updates->num == 1)
     rc->first_value = value_time;
   rc->last_value = value_time;
 
@@ -679,8 +802,7 @@ static int rrd_cache_insert(const char *filename, const char *value,
 
       ERROR("rrdtool plugin: strdup failed: %s", STRERRNO);
 
-      sfree(rc->values[0]);
-      sfree(rc->values);
+      rrd_updates_destroy(rc->updates);
       sfree(rc);
       return -1;
     }
@@ -689,18 +811,18 @@ static int rrd_cache_insert(const char *filename, const char *value,
   }
 
   DEBUG("rrdtool plugin: rrd_cache_insert: file = %s; "
-        "values_num = %i; age = %.3f;",
-        filename, rc->values_num,
+        "values_num = %" PRIsz "; age = %.3f;",
+        filename, rc->updates->num,
         CDTIME_T_TO_DOUBLE(rc->last_value - rc->first_value));
 
   if ((rc->last_value - rc->first_value) >=
       (cache_timeout + rc->random_variation)) {
-    /* XXX: If you need to lock both, cache_lock and queue_lock, at
+    /* XXX: If you need to lock both, cache_lock and a shard's lock, at
      * the same time, ALWAYS lock `cache_lock' first! */
     if (rc->flags == FLAG_NONE) {
-      int status;
-
-      status = rrd_queue_enqueue(filename, &queue_head, &queue_tail);
+      rrd_shard_t *shard = rrd_shard_get(filename);
+      int status = rrd_queue_enqueue(shard, filename, &shard->queue_head,
+                                     &shard->queue_tail);
       if (status == 0)
         rc->flags = FLAG_QUEUED;
 
@@ -742,12 +864,10 @@ static int rrd_cache_destroy(void) /* {{{ */
     rc = value;
     value = NULL;
 
-    if (rc->values_num > 0)
+    if (rc->updates != NULL)
       non_empty++;
 
-    for (int i = 0; i < rc->values_num; i++)
-      sfree(rc->values[i]);
-    sfree(rc->values);
+    rrd_updates_destroy(rc->updates);
     sfree(rc);
   }
 
@@ -793,9 +913,13 @@ static int rrd_write(const data_set_t *ds, const value_list_t *vl,
   if (value_list_to_filename(filename, sizeof(filename), vl) != 0)
     return -1;
 
-  char values[32 * (ds->ds_num + 1)];
-  if (value_list_to_string(values, sizeof(values), ds, vl) != 0)
-    return -1;
+  for (size_t i = 0; i < ds->ds_num; i++) {
+    if ((ds->ds[i].type != DS_TYPE_COUNTER) &&
+        (ds->ds[i].type != DS_TYPE_GAUGE) &&
+        (ds->ds[i].type != DS_TYPE_DERIVE) &&
+        (ds->ds[i].type != DS_TYPE_ABSOLUTE))
+      return -1;
+  }
 
   struct stat statbuf = {0};
   if (stat(filename, &statbuf) == -1) {
@@ -814,7 +938,7 @@ static int rrd_write(const data_set_t *ds, const value_list_t *vl,
     return -1;
   }
 
-  return rrd_cache_insert(filename, values, vl->time);
+  return rrd_cache_insert(filename, ds, vl);
 } /* int rrd_write */
 
 static int rrd_flush(cdtime_t timeout, const char *identifier,
@@ -960,6 +1084,21 @@ static int rrd_config(const char *key, const char *value) {
     } else {
       write_rate = 1.0 / wps;
     }
+  } else if (strcasecmp("WriteThreads", key) == 0) {
+    int tmp = atoi(value);
+    if (tmp < 1) {
+      ERROR("rrdtool plugin: `WriteThreads' must be greater than 0.");
+      return 1;
+    }
+    queue_threads_num = (size_t)tmp;
+  } else if (strcasecmp("WriteLatencyTarget", key) == 0) {
+    double tmp = atof(value);
+    if (tmp < 0.0) {
+      ERROR("rrdtool plugin: `WriteLatencyTarget' must be greater than or "
+            "equal to zero.");
+      return 1;
+    }
+    write_latency_target = DOUBLE_TO_CDTIME_T(tmp);
   } else if (strcasecmp("RandomTimeout", key) == 0) {
     double tmp;
 
@@ -983,26 +1122,39 @@ static int rrd_shutdown(void) {
   rrd_cache_flush(0);
   pthread_mutex_unlock(&cache_lock);
 
-  pthread_mutex_lock(&queue_lock);
-  do_shutdown = 1;
-  pthread_cond_signal(&queue_cond);
-  pthread_mutex_unlock(&queue_lock);
+  _Bool queued = 0;
+  for (size_t i = 0; i < shards_num; i++) {
+    rrd_shard_t *shard = shards + i;
 
-  if ((queue_thread_running != 0) &&
-      ((queue_head != NULL) || (flushq_head != NULL))) {
-    INFO("rrdtool plugin: Shutting down the queue thread. "
+    pthread_mutex_lock(&shard->lock);
+    do_shutdown = 1;
+    if ((shard->queue_head != NULL) || (shard->flushq_head != NULL))
+      queued = 1;
+    pthread_cond_signal(&shard->cond);
+    pthread_mutex_unlock(&shard->lock);
+  }
+
+  if (queued) {
+    INFO("rrdtool plugin: Shutting down the queue threads. "
          "This may take a while.");
-  } else if (queue_thread_running != 0) {
-    INFO("rrdtool plugin: Shutting down the queue thread.");
+  } else if (shards_num > 0) {
+    INFO("rrdtool plugin: Shutting down the queue threads.");
   }
 
   /* Wait for all the values to be written to disk before returning. */
-  if (queue_thread_running != 0) {
-    pthread_join(queue_thread, NULL);
-    memset(&queue_thread, 0, sizeof(queue_thread));
-    queue_thread_running = 0;
-    DEBUG("rrdtool plugin: queue_thread exited.");
+  for (size_t i = 0; i < shards_num; i++) {
+    rrd_shard_t *shard = shards + i;
+
+    if (shard->thread_running) {
+      pthread_join(shard->thread, NULL);
+      shard->thread_running = 0;
+    }
+    pthread_mutex_destroy(&shard->lock);
+    pthread_cond_destroy(&shard->cond);
   }
+  DEBUG("rrdtool plugin: queue threads exited.");
+  sfree(shards);
+  shards_num = 0;
 
   rrd_cache_destroy();
 
@@ -1051,14 +1203,43 @@ static int rrd_init(void) {
 
   pthread_mutex_unlock(&cache_lock);
 
-  int status =
-      plugin_thread_create(&queue_thread, /* attr = */ NULL, rrd_queue_thread,
-                           /* args = */ NULL, "rrdtool queue");
-  if (status != 0) {
-    ERROR("rrdtool plugin: Cannot create queue-thread.");
+#if !HAVE_THREADSAFE_LIBRRD
+  /* Updates are serialized by "librrd_lock" anyway. */
+  if (queue_threads_num > 1) {
+    WARNING("rrdtool plugin: librrd is not thread-safe. Ignoring "
+            "\"WriteThreads %" PRIsz "\".",
+            queue_threads_num);
+    queue_threads_num = 1;
+  }
+#endif
+
+  shards = calloc(queue_threads_num, sizeof(*shards));
+  if (shards == NULL) {
+    ERROR("rrdtool plugin: calloc failed.");
     return -1;
   }
-  queue_thread_running = 1;
+  shards_num = queue_threads_num;
+
+  for (size_t i = 0; i < shards_num; i++) {
+    rrd_shard_t *shard = shards + i;
+    char name[16];
+
+    pthread_mutex_init(&shard->lock, /* attr = */ NULL);
+    pthread_cond_init(&shard->cond, /* attr = */ NULL);
+
+    if (shards_num == 1)
+      sstrncpy(name, "rrdtool queue", sizeof(name));
+    else
+      snprintf(name, sizeof(name), "rrdtool queue%" PRIsz, i);
+
+    int status = plugin_thread_create(&shard->thread, /* attr = */ NULL,
+                                      rrd_queue_thread, shard, name);
+    if (status != 0) {
+      ERROR("rrdtool plugin: Cannot create queue-thread.");
+      return -1;
+    }
+    shard->thread_running = 1;
+  }
 
   DEBUG("rrdtool plugin: rrd_init: datadir = %s; stepsize = %lu;"
         " heartbeat = %i; rrarows = %i; xff = %lf;",
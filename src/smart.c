@@ -28,7 +28,9 @@
 
 #include "common.h"
 #include "plugin.h"
+#include "utils_avltree.h"
 #include "utils_ignorelist.h"
+#include "utils_time.h"
 
 #include <atasmart.h>
 #include <libudev.h>
@@ -38,7 +40,7 @@
 #endif
 
 static const char *config_keys[] = {"Disk", "IgnoreSelected", "IgnoreSleepMode",
-                                    "UseSerial"};
+                                    "ReadThreads", "UseSerial"};
 
 static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 
@@ -46,6 +48,45 @@ static ignorelist_t *ignorelist = NULL;
 static int ignore_sleep_mode = 0;
 static int use_serial = 0;
 
+/*
+ * Disks are kept open between intervals. Opening a disk sends an IDENTIFY
+ * command, which is not free and may wake up a disk in standby, so this is
+ * only done when a disk shows up for the first time or after an error.
+ */
+typedef struct smart_disk_s {
+  char *dev;
+  char *name;
+  SkDisk *d;
+  /* Set if the disk cannot be identified or has no SMART support. Such disks
+   * are not asked again until they disappear. */
+  _Bool unsupported;
+  unsigned long generation;
+} smart_disk_t;
+
+static struct udev *handle_udev = NULL;
+static c_avl_tree_t *disks = NULL;
+static unsigned long disks_generation = 0;
+
+/*
+ * With "ReadThreads", that many disks are read concurrently. The read
+ * callback is one of the threads.
+ */
+static int read_threads_num = 4;
+static pthread_t *read_workers = NULL;
+static size_t read_workers_num = 0;
+
+static pthread_mutex_t read_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t read_start_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t read_done_cond = PTHREAD_COND_INITIALIZER;
+static unsigned long read_generation = 0;
+static size_t read_busy = 0;
+static _Bool read_shutdown = 0;
+
+/* The disks being read and the next one to read */
+static smart_disk_t **read_array = NULL;
+static size_t read_num = 0;
+static size_t read_next = 0;
+
 static int smart_config(const char *key, const char *value) {
   if (ignorelist == NULL)
     ignorelist = ignorelist_create(/* invert = */ 1);
@@ -62,6 +103,13 @@ static int smart_config(const char *key, const char *value) {
   } else if (strcasecmp("IgnoreSleepMode", key) == 0) {
     if (IS_TRUE(value))
       ignore_sleep_mode = 1;
+  } else if (strcasecmp("ReadThreads", key) == 0) {
+    int num = atoi(value);
+    if (num < 1) {
+      ERROR("smart plugin: ReadThreads must be at least 1.");
+      return 1;
+    }
+    read_threads_num = num;
   } else if (strcasecmp("UseSerial", key) == 0) {
     if (IS_TRUE(value))
       use_serial = 1;
@@ -123,16 +171,63 @@ static void handle_attribute(SkDisk *d, const SkSmartAttributeParsedData *a,
   }
 }
 
-static void smart_read_disk(SkDisk *d, char const *name) {
-  SkBool available = FALSE;
-  if (sk_disk_identify_is_available(d, &available) < 0 || !available) {
-    DEBUG("smart plugin: disk %s cannot be identified.", name);
+static void smart_disk_close(smart_disk_t *disk) {
+  if (disk->d != NULL)
+    sk_disk_free(disk->d);
+  disk->d = NULL;
+}
+
+static void smart_disk_free(smart_disk_t *disk) {
+  if (disk == NULL)
     return;
+
+  smart_disk_close(disk);
+  sfree(disk->dev);
+  sfree(disk->name);
+  sfree(disk);
+}
+
+/* Opens the disk if it is not open yet. Returns zero if the disk is open and
+ * supports SMART. */
+static int smart_disk_open(smart_disk_t *disk) {
+  if (disk->unsupported)
+    return -1;
+  if (disk->d != NULL)
+    return 0;
+
+  DEBUG("smart plugin: opening %s.", disk->dev);
+  if (sk_disk_open(disk->dev, &disk->d) < 0) {
+    ERROR("smart plugin: unable to open %s.", disk->dev);
+    disk->d = NULL;
+    return -1;
   }
-  if (sk_disk_smart_is_available(d, &available) < 0 || !available) {
-    DEBUG("smart plugin: disk %s has no SMART support.", name);
-    return;
+
+  SkBool available = FALSE;
+  if (sk_disk_identify_is_available(disk->d, &available) < 0 || !available) {
+    DEBUG("smart plugin: disk %s cannot be identified.", disk->name);
+    smart_disk_close(disk);
+    disk->unsupported = 1;
+    return -1;
+  }
+  if (sk_disk_smart_is_available(disk->d, &available) < 0 || !available) {
+    DEBUG("smart plugin: disk %s has no SMART support.", disk->name);
+    smart_disk_close(disk);
+    disk->unsupported = 1;
+    return -1;
   }
+
+  return 0;
+} /* int smart_disk_open */
+
+static void smart_read_disk(smart_disk_t *disk) {
+  char const *name = disk->name;
+
+  if (smart_disk_open(disk) != 0)
+    return;
+
+  cdtime_t start = cdtime();
+  SkDisk *d = disk->d;
+
   if (!ignore_sleep_mode) {
     SkBool awake = FALSE;
     if (sk_disk_check_sleep_mode(d, &awake) < 0 || !awake) {
@@ -142,6 +237,8 @@ static void smart_read_disk(SkDisk *d, char const *name) {
   }
   if (sk_disk_smart_read_data(d) < 0) {
     ERROR("smart plugin: unable to get SMART data for disk %s.", name);
+    /* The device node may belong to a different disk by now. */
+    smart_disk_close(disk);
     return;
   }
 
@@ -178,10 +275,107 @@ static void smart_read_disk(SkDisk *d, char const *name) {
   if (sk_disk_smart_parse_attributes(d, handle_attribute, (void *)name) < 0) {
     ERROR("smart plugin: unable to handle SMART attributes for %s.", name);
   }
-}
 
-static void smart_handle_disk(const char *dev, const char *serial) {
-  SkDisk *d = NULL;
+  smart_submit(name, "duration", "read",
+               CDTIME_T_TO_DOUBLE(cdtime() - start));
+} /* void smart_read_disk */
+
+static void smart_read_run(void) {
+  while (1) {
+    size_t i = __atomic_fetch_add(&read_next, 1, __ATOMIC_RELAXED);
+    if (i >= read_num)
+      break;
+
+    smart_read_disk(read_array[i]);
+  }
+} /* void smart_read_run */
+
+static void *smart_read_worker(__attribute__((unused)) void *arg) {
+  unsigned long generation = 0;
+
+  pthread_mutex_lock(&read_lock);
+  while (!read_shutdown) {
+    if (generation == read_generation) {
+      pthread_cond_wait(&read_start_cond, &read_lock);
+      continue;
+    }
+    generation = read_generation;
+    pthread_mutex_unlock(&read_lock);
+
+    smart_read_run();
+
+    pthread_mutex_lock(&read_lock);
+    read_busy--;
+    if (read_busy == 0)
+      pthread_cond_signal(&read_done_cond);
+  }
+  pthread_mutex_unlock(&read_lock);
+
+  return NULL;
+} /* void *smart_read_worker */
+
+static void smart_read_workers_start(void) {
+  if (read_threads_num < 2)
+    return;
+
+  read_workers = calloc(read_threads_num - 1, sizeof(*read_workers));
+  if (read_workers == NULL) {
+    ERROR("smart plugin: calloc failed.");
+    return;
+  }
+
+  read_shutdown = 0;
+  for (int i = 1; i < read_threads_num; i++) {
+    int status = plugin_thread_create(&read_workers[read_workers_num],
+                                      /* attr = */ NULL, smart_read_worker,
+                                      /* arg = */ NULL, "smart read");
+    if (status != 0) {
+      WARNING("smart plugin: Starting read thread #%d failed: %s", i,
+              STRERROR(status));
+      break;
+    }
+    read_workers_num++;
+  }
+} /* void smart_read_workers_start */
+
+static void smart_read_workers_stop(void) {
+  pthread_mutex_lock(&read_lock);
+  read_shutdown = 1;
+  pthread_cond_broadcast(&read_start_cond);
+  pthread_mutex_unlock(&read_lock);
+
+  for (size_t i = 0; i < read_workers_num; i++)
+    pthread_join(read_workers[i], /* retval = */ NULL);
+  sfree(read_workers);
+  read_workers_num = 0;
+} /* void smart_read_workers_stop */
+
+/* Reads all disks in `array', using the read threads if there are any. */
+static void smart_read_all(smart_disk_t **array, size_t num) {
+  read_array = array;
+  read_num = num;
+  __atomic_store_n(&read_next, 0, __ATOMIC_RELAXED);
+
+  pthread_mutex_lock(&read_lock);
+  read_busy = read_workers_num;
+  read_generation++;
+  pthread_cond_broadcast(&read_start_cond);
+  pthread_mutex_unlock(&read_lock);
+
+  smart_read_run();
+
+  pthread_mutex_lock(&read_lock);
+  while (read_busy > 0)
+    pthread_cond_wait(&read_done_cond, &read_lock);
+  pthread_mutex_unlock(&read_lock);
+
+  read_array = NULL;
+  read_num = 0;
+} /* void smart_read_all */
+
+/* Looks up or adds the disk for a device node. Returns NULL if the disk is
+ * ignored. */
+static smart_disk_t *smart_disk_get(const char *dev, const char *serial) {
   const char *name;
 
   if (use_serial && serial) {
@@ -189,55 +383,130 @@ static void smart_handle_disk(const char *dev, const char *serial) {
   } else {
     name = strrchr(dev, '/');
     if (!name)
-      return;
+      return NULL;
     name++;
   }
   if (ignorelist_match(ignorelist, name) != 0) {
     DEBUG("smart plugin: ignoring %s.", dev);
-    return;
+    return NULL;
   }
 
-  DEBUG("smart plugin: checking SMART status of %s.", dev);
-  if (sk_disk_open(dev, &d) < 0) {
-    ERROR("smart plugin: unable to open %s.", dev);
-    return;
+  smart_disk_t *disk = NULL;
+  if (c_avl_get(disks, dev, (void *)&disk) == 0) {
+    if (strcmp(disk->name, name) == 0)
+      return disk;
+
+    /* A different disk took over the device node. */
+    c_avl_remove(disks, dev, NULL, NULL);
+    smart_disk_free(disk);
   }
 
-  smart_read_disk(d, name);
-  sk_disk_free(d);
-}
+  disk = calloc(1, sizeof(*disk));
+  if (disk == NULL) {
+    ERROR("smart plugin: calloc failed.");
+    return NULL;
+  }
+  disk->dev = strdup(dev);
+  disk->name = strdup(name);
+  if (disk->dev == NULL || disk->name == NULL ||
+      c_avl_insert(disks, disk->dev, disk) != 0) {
+    ERROR("smart plugin: adding disk %s failed.", dev);
+    smart_disk_free(disk);
+    return NULL;
+  }
+
+  return disk;
+} /* smart_disk_t *smart_disk_get */
+
+/* Closes and forgets about disks that were not seen during the last scan. */
+static void smart_disks_prune(void) {
+  while (1) {
+    c_avl_iterator_t *iter = c_avl_get_iterator(disks);
+    char *dev = NULL;
+    smart_disk_t *disk = NULL;
+    _Bool found = 0;
+
+    while (c_avl_iterator_next(iter, (void *)&dev, (void *)&disk) == 0) {
+      if (disk->generation != disks_generation) {
+        found = 1;
+        break;
+      }
+    }
+    c_avl_iterator_destroy(iter);
+
+    if (!found)
+      break;
+
+    DEBUG("smart plugin: %s is gone.", disk->dev);
+    c_avl_remove(disks, dev, NULL, NULL);
+    smart_disk_free(disk);
+  }
+} /* void smart_disks_prune */
 
 static int smart_read(void) {
-  struct udev *handle_udev;
   struct udev_enumerate *enumerate;
   struct udev_list_entry *devices, *dev_list_entry;
   struct udev_device *dev;
 
-  /* Use udev to get a list of disks */
-  handle_udev = udev_new();
-  if (!handle_udev) {
-    ERROR("smart plugin: unable to initialize udev.");
+  if (handle_udev == NULL) {
+    ERROR("smart plugin: udev is not initialized.");
     return -1;
   }
+
+  /* Use udev to get a list of disks */
   enumerate = udev_enumerate_new(handle_udev);
+  if (enumerate == NULL) {
+    ERROR("smart plugin: unable to enumerate devices.");
+    return -1;
+  }
   udev_enumerate_add_match_subsystem(enumerate, "block");
   udev_enumerate_add_match_property(enumerate, "DEVTYPE", "disk");
   udev_enumerate_scan_devices(enumerate);
   devices = udev_enumerate_get_list_entry(enumerate);
+
+  disks_generation++;
   udev_list_entry_foreach(dev_list_entry, devices) {
     const char *path, *devpath, *serial;
     path = udev_list_entry_get_name(dev_list_entry);
     dev = udev_device_new_from_syspath(handle_udev, path);
+    if (dev == NULL)
+      continue;
     devpath = udev_device_get_devnode(dev);
     serial = udev_device_get_property_value(dev, "ID_SERIAL");
 
-    /* Query status with libatasmart */
-    smart_handle_disk(devpath, serial);
+    smart_disk_t *disk = NULL;
+    if (devpath != NULL)
+      disk = smart_disk_get(devpath, serial);
+    if (disk != NULL)
+      disk->generation = disks_generation;
     udev_device_unref(dev);
   }
-
   udev_enumerate_unref(enumerate);
-  udev_unref(handle_udev);
+
+  smart_disks_prune();
+
+  int num = c_avl_size(disks);
+  if (num <= 0)
+    return 0;
+
+  smart_disk_t **array = calloc(num, sizeof(*array));
+  if (array == NULL) {
+    ERROR("smart plugin: calloc failed.");
+    return -1;
+  }
+
+  c_avl_iterator_t *iter = c_avl_get_iterator(disks);
+  char *key = NULL;
+  smart_disk_t *disk = NULL;
+  size_t array_num = 0;
+  while (c_avl_iterator_next(iter, (void *)&key, (void *)&disk) == 0 &&
+         array_num < (size_t)num)
+    array[array_num++] = disk;
+  c_avl_iterator_destroy(iter);
+
+  /* Query status with libatasmart */
+  smart_read_all(array, array_num);
+  sfree(array);
 
   return 0;
 } /* int smart_read */
@@ -256,11 +525,51 @@ static int smart_init(void) {
               "running \"setcap cap_sys_rawio=ep\" on the collectd binary.");
   }
 #endif
+
+  if (handle_udev == NULL) {
+    handle_udev = udev_new();
+    if (handle_udev == NULL) {
+      ERROR("smart plugin: unable to initialize udev.");
+      return -1;
+    }
+  }
+
+  if (disks == NULL) {
+    disks = c_avl_create((int (*)(const void *, const void *))strcmp);
+    if (disks == NULL) {
+      ERROR("smart plugin: c_avl_create failed.");
+      return -1;
+    }
+  }
+
+  if (read_workers_num == 0)
+    smart_read_workers_start();
+
   return 0;
 } /* int smart_init */
 
+static int smart_shutdown(void) {
+  smart_read_workers_stop();
+
+  if (disks != NULL) {
+    char *dev = NULL;
+    smart_disk_t *disk = NULL;
+    while (c_avl_pick(disks, (void *)&dev, (void *)&disk) == 0)
+      smart_disk_free(disk);
+    c_avl_destroy(disks);
+    disks = NULL;
+  }
+
+  if (handle_udev != NULL)
+    udev_unref(handle_udev);
+  handle_udev = NULL;
+
+  return 0;
+} /* int smart_shutdown */
+
 void module_register(void) {
   plugin_register_config("smart", smart_config, config_keys, config_keys_num);
   plugin_register_init("smart", smart_init);
   plugin_register_read("smart", smart_read);
+  plugin_register_shutdown("smart", smart_shutdown);
 } /* void module_register */
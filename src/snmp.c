@@ -73,6 +73,7 @@ struct host_definition_s {
   int version;
   cdtime_t timeout;
   int retries;
+  int bulk_size; /* max-repetitions for GETBULK; zero uses GETNEXT */
 
   /* snmpv1/2 options */
   char *community;
@@ -93,10 +94,21 @@ struct host_definition_s {
   cdtime_t interval;
   data_definition_t **data_list;
   int data_list_len;
+  int max_in_flight; /* concurrent walks in asynchronous mode */
+
+  /* Asynchronous mode only, protected by `engine_lock'. */
+  _Bool polling; /* listed in `engine_hosts' */
+  _Bool removed; /* waiting in csnmp_engine_remove() */
+  _Bool failed;  /* the session failed, abort the poll */
+  _Bool closing; /* ignore callbacks from snmp_sess_close() */
+  int next_data; /* index of the next walk to start */
+  int in_flight;
+  struct csnmp_walk_s *walks;
+  struct host_definition_s *next;
 };
 typedef struct host_definition_s host_definition_t;
 
-/* These two types are used to cache values in `csnmp_read_table' to handle
+/* These two types are used to cache values in `csnmp_walk_t' to handle
  * gaps in tables. */
 struct csnmp_list_instances_s {
   oid_t suffix;
@@ -112,15 +124,69 @@ struct csnmp_table_values_s {
 };
 typedef struct csnmp_table_values_s csnmp_table_values_t;
 
+/* State of reading one `data_definition_t' from a host. A table walk takes
+ * several round trips: the synchronous reader drives it in a loop, the
+ * asynchronous engine from its response callback. */
+struct csnmp_walk_s {
+  host_definition_t *host;
+  data_definition_t *data;
+  const data_set_t *ds;
+
+  /* Holds the last OID returned by the device. We use this in the GETNEXT
+   * request to proceed. */
+  oid_t *oid_list;
+  /* Set to false when an OID has left its subtree so we don't re-request it
+   * again. */
+  _Bool *oid_list_todo;
+  size_t oid_list_len;
+  /* Maps the variables of the last request to `oid_list'. */
+  size_t *var_idx;
+  size_t var_num;
+
+  /* `value_list_head' and `value_list_tail' implement a linked list for each
+   * value. `instance_list_head' and `instance_list_tail' implement a linked
+   * list of instance names. This is used to jump gaps in the table. */
+  csnmp_list_instances_t *instance_list_head;
+  csnmp_list_instances_t *instance_list_tail;
+  csnmp_table_values_t **value_list_head;
+  csnmp_table_values_t **value_list_tail;
+
+  /* Values of a non-table read. */
+  value_t *values;
+
+  int status;
+  _Bool done;
+  _Bool pending; /* asynchronous mode: a request is outstanding */
+  struct csnmp_walk_s *next;
+};
+typedef struct csnmp_walk_s csnmp_walk_t;
+
+/* Upper bound for sleeping in select(); the sessions' own timers are
+ * honoured before that. */
+#define CSNMP_ENGINE_WAIT_S 1
+
 /*
  * Private variables
  */
 static data_definition_t *data_head = NULL;
 
+/* In asynchronous mode all hosts are polled by one thread, which multiplexes
+ * their sessions. The read callbacks only queue their host. */
+static _Bool csnmp_async = 0;
+static pthread_mutex_t engine_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t engine_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t engine_thread;
+static _Bool engine_running = 0;
+static _Bool engine_stop = 0;
+static int engine_pipe[2] = {-1, -1};
+/* Hosts with a poll queued or in progress. */
+static host_definition_t *engine_hosts = NULL;
+
 /*
  * Prototypes
  */
 static int csnmp_read_host(user_data_t *ud);
+static void csnmp_engine_remove(host_definition_t *host);
 
 /*
  * Private functions
@@ -185,6 +251,7 @@ static void csnmp_host_definition_destroy(void *arg) /* {{{ */
     DEBUG("snmp plugin: Destroying host definition for host `%s'.", hd->name);
   }
 
+  csnmp_engine_remove(hd);
   csnmp_host_close_session(hd);
 
   sfree(hd->name);
@@ -587,6 +654,8 @@ static int csnmp_config_add_host(oconfig_item_t *ci) {
   /* These mean that we have not set a timeout or retry value */
   hd->timeout = 0;
   hd->retries = -1;
+  hd->bulk_size = 0;
+  hd->max_in_flight = 1;
 
   for (int i = 0; i < ci->children_num; i++) {
     oconfig_item_t *option = ci->children + i;
@@ -602,6 +671,10 @@ static int csnmp_config_add_host(oconfig_item_t *ci) {
       cf_util_get_cdtime(option, &hd->timeout);
     else if (strcasecmp("Retries", option->key) == 0)
       cf_util_get_int(option, &hd->retries);
+    else if (strcasecmp("BulkSize", option->key) == 0)
+      status = cf_util_get_int(option, &hd->bulk_size);
+    else if (strcasecmp("MaxInFlight", option->key) == 0)
+      status = cf_util_get_int(option, &hd->max_in_flight);
     else if (strcasecmp("Collect", option->key) == 0)
       csnmp_config_add_host_collect(hd, option);
     else if (strcasecmp("Interval", option->key) == 0)
@@ -637,6 +710,12 @@ static int csnmp_config_add_host(oconfig_item_t *ci) {
       status = -1;
       break;
     }
+    if (hd->max_in_flight < 1) {
+      WARNING("snmp plugin: `MaxInFlight' must be at least 1 for host `%s'",
+              hd->name);
+      status = -1;
+      break;
+    }
     if (hd->community == NULL && hd->version < 3) {
       WARNING("snmp plugin: `Community' not given for host `%s'", hd->name);
       status = -1;
@@ -721,6 +800,8 @@ static int csnmp_config(oconfig_item_t *ci) {
       csnmp_config_add_data(child);
     else if (strcasecmp("Host", child->key) == 0)
       csnmp_config_add_host(child);
+    else if (strcasecmp("Asynchronous", child->key) == 0)
+      cf_util_get_boolean(child, &csnmp_async);
     else {
       WARNING("snmp plugin: Ignoring unknown config option `%s'.", child->key);
     }
@@ -1029,21 +1110,13 @@ static int csnmp_strvbcopy(char *dst, /* {{{ */
 
 static int csnmp_instance_list_add(csnmp_list_instances_t **head,
                                    csnmp_list_instances_t **tail,
-                                   const struct snmp_pdu *res,
+                                   const struct variable_list *vb,
                                    const host_definition_t *hd,
                                    const data_definition_t *dd) {
   csnmp_list_instances_t *il;
-  struct variable_list *vb;
   oid_t vb_name;
   int status;
 
-  /* Set vb on the last variable */
-  for (vb = res->variables; (vb != NULL) && (vb->next_variable != NULL);
-       vb = vb->next_variable)
-    /* do nothing */;
-  if (vb == NULL)
-    return -1;
-
   csnmp_oid_init(&vb_name, vb->name, vb->name_length);
 
   il = calloc(1, sizeof(*il));
@@ -1255,45 +1328,46 @@ static int csnmp_dispatch_table(host_definition_t *host,
   return (0);
 } /* int csnmp_dispatch_table */
 
-static int csnmp_read_table(host_definition_t *host, data_definition_t *data) {
-  struct snmp_pdu *req;
-  struct snmp_pdu *res = NULL;
-  struct variable_list *vb;
-
-  const data_set_t *ds;
-
-  size_t oid_list_len = data->values_len + 1;
-  /* Holds the last OID returned by the device. We use this in the GETNEXT
-   * request to proceed. */
-  oid_t oid_list[oid_list_len];
-  /* Set to false when an OID has left its subtree so we don't re-request it
-   * again. */
-  _Bool oid_list_todo[oid_list_len];
-
-  int status;
-  size_t i;
-
-  /* `value_list_head' and `value_list_tail' implement a linked list for each
-   * value. `instance_list_head' and `instance_list_tail' implement a linked
-   * list of
-   * instance names. This is used to jump gaps in the table. */
-  csnmp_list_instances_t *instance_list_head;
-  csnmp_list_instances_t *instance_list_tail;
-  csnmp_table_values_t **value_list_head;
-  csnmp_table_values_t **value_list_tail;
+static void csnmp_walk_destroy(csnmp_walk_t *w) /* {{{ */
+{
+  if (w == NULL)
+    return;
 
-  DEBUG("snmp plugin: csnmp_read_table (host = %s, data = %s)", host->name,
-        data->name);
+  /* Free all allocated variables here */
+  while (w->instance_list_head != NULL) {
+    csnmp_list_instances_t *next = w->instance_list_head->next;
+    sfree(w->instance_list_head);
+    w->instance_list_head = next;
+  }
 
-  if (host->sess_handle == NULL) {
-    DEBUG("snmp plugin: csnmp_read_table: host->sess_handle == NULL");
-    return -1;
+  if (w->value_list_head != NULL) {
+    for (size_t i = 0; i < w->data->values_len; i++) {
+      while (w->value_list_head[i] != NULL) {
+        csnmp_table_values_t *next = w->value_list_head[i]->next;
+        sfree(w->value_list_head[i]);
+        w->value_list_head[i] = next;
+      }
+    }
   }
 
+  sfree(w->value_list_head);
+  sfree(w->value_list_tail);
+  sfree(w->oid_list);
+  sfree(w->oid_list_todo);
+  sfree(w->var_idx);
+  sfree(w->values);
+  sfree(w);
+} /* }}} void csnmp_walk_destroy */
+
+static csnmp_walk_t *csnmp_walk_create(host_definition_t *host, /* {{{ */
+                                       data_definition_t *data) {
+  const data_set_t *ds;
+  csnmp_walk_t *w;
+
   ds = plugin_get_ds(data->type);
   if (!ds) {
     ERROR("snmp plugin: DataSet `%s' not defined.", data->type);
-    return -1;
+    return NULL;
   }
 
   if (ds->ds_num != data->values_len) {
@@ -1301,362 +1375,663 @@ static int csnmp_read_table(host_definition_t *host, data_definition_t *data) {
           " values, but config talks "
           "about %" PRIsz,
           data->type, ds->ds_num, data->values_len);
-    return -1;
+    return NULL;
   }
   assert(data->values_len > 0);
 
-  /* We need a copy of all the OIDs, because GETNEXT will destroy them. */
-  memcpy(oid_list, data->values, data->values_len * sizeof(oid_t));
-  if (data->instance.oid.oid_len > 0)
-    memcpy(oid_list + data->values_len, &data->instance.oid, sizeof(oid_t));
-  else /* no InstanceFrom option specified. */
-    oid_list_len--;
-
-  for (i = 0; i < oid_list_len; i++)
-    oid_list_todo[i] = 1;
+  w = calloc(1, sizeof(*w));
+  if (w == NULL) {
+    ERROR("snmp plugin: csnmp_walk_create: calloc failed.");
+    return NULL;
+  }
+  w->host = host;
+  w->data = data;
+  w->ds = ds;
+
+  if (!data->is_table) {
+    w->values = malloc(sizeof(*w->values) * data->values_len);
+    if (w->values == NULL) {
+      ERROR("snmp plugin: csnmp_walk_create: malloc failed.");
+      csnmp_walk_destroy(w);
+      return NULL;
+    }
+    for (size_t i = 0; i < data->values_len; i++) {
+      if (ds->ds[i].type == DS_TYPE_COUNTER)
+        w->values[i].counter = 0;
+      else
+        w->values[i].gauge = NAN;
+    }
+    return w;
+  }
 
+  w->oid_list_len = data->values_len + 1;
+  w->oid_list = calloc(w->oid_list_len, sizeof(*w->oid_list));
+  w->oid_list_todo = calloc(w->oid_list_len, sizeof(*w->oid_list_todo));
+  w->var_idx = calloc(w->oid_list_len, sizeof(*w->var_idx));
   /* We're going to construct n linked lists, one for each "value".
    * value_list_head will contain pointers to the heads of these linked lists,
    * value_list_tail will contain pointers to the tail of the lists. */
-  value_list_head = calloc(data->values_len, sizeof(*value_list_head));
-  value_list_tail = calloc(data->values_len, sizeof(*value_list_tail));
-  if ((value_list_head == NULL) || (value_list_tail == NULL)) {
-    ERROR("snmp plugin: csnmp_read_table: calloc failed.");
-    sfree(value_list_head);
-    sfree(value_list_tail);
-    return -1;
+  w->value_list_head = calloc(data->values_len, sizeof(*w->value_list_head));
+  w->value_list_tail = calloc(data->values_len, sizeof(*w->value_list_tail));
+  if ((w->oid_list == NULL) || (w->oid_list_todo == NULL) ||
+      (w->var_idx == NULL) || (w->value_list_head == NULL) ||
+      (w->value_list_tail == NULL)) {
+    ERROR("snmp plugin: csnmp_walk_create: calloc failed.");
+    csnmp_walk_destroy(w);
+    return NULL;
   }
 
-  instance_list_head = NULL;
-  instance_list_tail = NULL;
+  /* We need a copy of all the OIDs, because GETNEXT will destroy them. */
+  memcpy(w->oid_list, data->values, data->values_len * sizeof(oid_t));
+  if (data->instance.oid.oid_len > 0)
+    memcpy(w->oid_list + data->values_len, &data->instance.oid, sizeof(oid_t));
+  else /* no InstanceFrom option specified. */
+    w->oid_list_len--;
+
+  for (size_t i = 0; i < w->oid_list_len; i++)
+    w->oid_list_todo[i] = 1;
 
-  status = 0;
-  while (status == 0) {
-    req = snmp_pdu_create(SNMP_MSG_GETNEXT);
-    if (req == NULL) {
-      ERROR("snmp plugin: snmp_pdu_create failed.");
-      status = -1;
-      break;
-    }
+  return w;
+} /* }}} csnmp_walk_t *csnmp_walk_create */
 
-    size_t oid_list_todo_num = 0;
-    size_t var_idx[oid_list_len];
-    memset(var_idx, 0, sizeof(var_idx));
+/* Returns the next request of the walk, or NULL when the walk is done. */
+static struct snmp_pdu *csnmp_walk_request(csnmp_walk_t *w) /* {{{ */
+{
+  host_definition_t *host = w->host;
+  data_definition_t *data = w->data;
+  struct snmp_pdu *req;
 
-    for (i = 0; i < oid_list_len; i++) {
-      /* Do not rerequest already finished OIDs */
-      if (!oid_list_todo[i])
-        continue;
-      snmp_add_null_var(req, oid_list[i].oid, oid_list[i].oid_len);
-      var_idx[oid_list_todo_num] = i;
-      oid_list_todo_num++;
+  if (w->done)
+    return NULL;
+
+  if (!data->is_table)
+    req = snmp_pdu_create(SNMP_MSG_GET);
+  /* GETBULK returns up to `bulk_size' successors of each OID in one round
+   * trip. It does not exist in SNMPv1. */
+  else if ((host->version > 1) && (host->bulk_size > 0)) {
+    req = snmp_pdu_create(SNMP_MSG_GETBULK);
+    if (req != NULL) {
+      req->non_repeaters = 0;
+      req->max_repetitions = host->bulk_size;
     }
+  } else
+    req = snmp_pdu_create(SNMP_MSG_GETNEXT);
+  if (req == NULL) {
+    ERROR("snmp plugin: snmp_pdu_create failed.");
+    w->status = -1;
+    w->done = 1;
+    return NULL;
+  }
 
-    if (oid_list_todo_num == 0) {
-      /* The request is still empty - so we are finished */
-      DEBUG("snmp plugin: all variables have left their subtree");
-      snmp_free_pdu(req);
-      status = 0;
-      break;
-    }
+  if (!data->is_table) {
+    for (size_t i = 0; i < data->values_len; i++)
+      snmp_add_null_var(req, data->values[i].oid, data->values[i].oid_len);
+    return req;
+  }
 
-    res = NULL;
-    status = snmp_sess_synch_response(host->sess_handle, req, &res);
+  w->var_num = 0;
+  for (size_t i = 0; i < w->oid_list_len; i++) {
+    /* Do not rerequest already finished OIDs */
+    if (!w->oid_list_todo[i])
+      continue;
+    snmp_add_null_var(req, w->oid_list[i].oid, w->oid_list[i].oid_len);
+    w->var_idx[w->var_num] = i;
+    w->var_num++;
+  }
 
-    /* snmp_sess_synch_response always frees our req PDU */
-    req = NULL;
+  if (w->var_num == 0) {
+    /* The request is still empty - so we are finished */
+    DEBUG("snmp plugin: all variables have left their subtree");
+    snmp_free_pdu(req);
+    w->done = 1;
+    return NULL;
+  }
 
-    if ((status != STAT_SUCCESS) || (res == NULL)) {
-      char *errstr = NULL;
+  return req;
+} /* }}} struct snmp_pdu *csnmp_walk_request */
 
-      snmp_sess_error(host->sess_handle, NULL, NULL, &errstr);
+static void csnmp_walk_response_value(csnmp_walk_t *w, /* {{{ */
+                                      struct snmp_pdu *res) {
+  host_definition_t *host = w->host;
+  data_definition_t *data = w->data;
 
-      c_complain(LOG_ERR, &host->complaint,
-                 "snmp plugin: host %s: snmp_sess_synch_response failed: %s",
-                 host->name, (errstr == NULL) ? "Unknown problem" : errstr);
+  for (struct variable_list *vb = res->variables; vb != NULL;
+       vb = vb->next_variable) {
+#if COLLECT_DEBUG
+    char buffer[1024];
+    snprint_variable(buffer, sizeof(buffer), vb->name, vb->name_length, vb);
+    DEBUG("snmp plugin: Got this variable: %s", buffer);
+#endif /* COLLECT_DEBUG */
 
-      if (res != NULL)
-        snmp_free_pdu(res);
-      res = NULL;
+    for (size_t i = 0; i < data->values_len; i++)
+      if (snmp_oid_compare(data->values[i].oid, data->values[i].oid_len,
+                           vb->name, vb->name_length) == 0)
+        w->values[i] =
+            csnmp_value_list_to_value(vb, w->ds->ds[i].type, data->scale,
+                                      data->shift, host->name, data->name);
+  } /* for (res->variables) */
 
-      sfree(errstr);
-      csnmp_host_close_session(host);
+  w->done = 1;
+} /* }}} void csnmp_walk_response_value */
 
-      status = -1;
-      break;
-    }
+static void csnmp_walk_response_table(csnmp_walk_t *w, /* {{{ */
+                                      struct snmp_pdu *res) {
+  host_definition_t *host = w->host;
+  data_definition_t *data = w->data;
+  struct variable_list *vb;
+  size_t i;
 
-    status = 0;
-    assert(res != NULL);
-    c_release(LOG_INFO, &host->complaint,
-              "snmp plugin: host %s: snmp_sess_synch_response successful.",
-              host->name);
+  vb = res->variables;
+  if (vb == NULL) {
+    w->status = -1;
+    w->done = 1;
+    return;
+  }
 
-    vb = res->variables;
-    if (vb == NULL) {
-      status = -1;
-      break;
+  if (res->errstat != SNMP_ERR_NOERROR) {
+    if (res->errindex != 0) {
+      /* Find the OID which caused error */
+      for (i = 1, vb = res->variables; vb != NULL && i != res->errindex;
+           vb = vb->next_variable, i++)
+        /* do nothing */;
     }
 
-    if (res->errstat != SNMP_ERR_NOERROR) {
-      if (res->errindex != 0) {
-        /* Find the OID which caused error */
-        for (i = 1, vb = res->variables; vb != NULL && i != res->errindex;
-             vb = vb->next_variable, i++)
-          /* do nothing */;
-      }
-
-      if ((res->errindex == 0) || (vb == NULL)) {
-        ERROR("snmp plugin: host %s; data %s: response error: %s (%li) ",
-              host->name, data->name, snmp_errstring(res->errstat),
-              res->errstat);
-        status = -1;
-        break;
-      }
+    if ((res->errindex == 0) || (vb == NULL)) {
+      ERROR("snmp plugin: host %s; data %s: response error: %s (%li) ",
+            host->name, data->name, snmp_errstring(res->errstat),
+            res->errstat);
+      w->status = -1;
+      w->done = 1;
+      return;
+    }
 
-      char oid_buffer[1024] = {0};
-      snprint_objid(oid_buffer, sizeof(oid_buffer) - 1, vb->name,
-                    vb->name_length);
-      NOTICE("snmp plugin: host %s; data %s: OID `%s` failed: %s", host->name,
-             data->name, oid_buffer, snmp_errstring(res->errstat));
+    char oid_buffer[1024] = {0};
+    snprint_objid(oid_buffer, sizeof(oid_buffer) - 1, vb->name,
+                  vb->name_length);
+    NOTICE("snmp plugin: host %s; data %s: OID `%s` failed: %s", host->name,
+           data->name, oid_buffer, snmp_errstring(res->errstat));
+
+    /* Get value index from todo list and skip OID found */
+    assert(res->errindex <= w->var_num);
+    i = w->var_idx[res->errindex - 1];
+    assert(i < w->oid_list_len);
+    w->oid_list_todo[i] = 0;
+    return;
+  }
 
-      /* Get value index from todo list and skip OID found */
-      assert(res->errindex <= oid_list_todo_num);
-      i = var_idx[res->errindex - 1];
-      assert(i < oid_list_len);
-      oid_list_todo[i] = 0;
+  /* Variables are returned in the order requested; a GETBULK response
+   * repeats that order once per repetition. */
+  size_t vb_idx = 0;
+  for (vb = res->variables; (vb != NULL); vb = vb->next_variable, vb_idx++) {
+    /* Calculate value index from todo list */
+    i = w->var_idx[vb_idx % w->var_num];
 
-      snmp_free_pdu(res);
-      res = NULL;
+    /* Skip further repetitions of OIDs which left their subtree. */
+    if (!w->oid_list_todo[i])
       continue;
-    }
 
-    for (vb = res->variables, i = 0; (vb != NULL);
-         vb = vb->next_variable, i++) {
-      /* Calculate value index from todo list */
-      while ((i < oid_list_len) && !oid_list_todo[i]) {
-        i++;
+    /* An instance is configured and the res variable we process is the
+     * instance value (last index) */
+    if ((data->instance.oid.oid_len > 0) && (i == data->values_len)) {
+      if ((vb->type == SNMP_ENDOFMIBVIEW) ||
+          (snmp_oid_ncompare(
+               data->instance.oid.oid, data->instance.oid.oid_len, vb->name,
+               vb->name_length, data->instance.oid.oid_len) != 0)) {
+        DEBUG("snmp plugin: host = %s; data = %s; Instance left its subtree.",
+              host->name, data->name);
+        w->oid_list_todo[i] = 0;
+        continue;
       }
-      if (i >= oid_list_len) {
-        break;
+
+      /* Allocate a new `csnmp_list_instances_t', insert the instance name and
+       * add it to the list */
+      if (csnmp_instance_list_add(&w->instance_list_head,
+                                  &w->instance_list_tail, vb, host,
+                                  data) != 0) {
+        ERROR("snmp plugin: host %s: csnmp_instance_list_add failed.",
+              host->name);
+        w->status = -1;
+        w->done = 1;
+        return;
+      }
+    } else /* The variable we are processing is a normal value */
+    {
+      csnmp_table_values_t *vt;
+      oid_t vb_name;
+      oid_t suffix;
+      int ret;
+
+      csnmp_oid_init(&vb_name, vb->name, vb->name_length);
+
+      /* Calculate the current suffix. This is later used to check that the
+       * suffix is increasing. This also checks if we left the subtree */
+      ret = csnmp_oid_suffix(&suffix, &vb_name, data->values + i);
+      if (ret != 0) {
+        DEBUG("snmp plugin: host = %s; data = %s; i = %" PRIsz "; "
+              "Value probably left its subtree.",
+              host->name, data->name, i);
+        w->oid_list_todo[i] = 0;
+        continue;
       }
 
-      /* An instance is configured and the res variable we process is the
-       * instance value (last index) */
-      if ((data->instance.oid.oid_len > 0) && (i == data->values_len)) {
-        if ((vb->type == SNMP_ENDOFMIBVIEW) ||
-            (snmp_oid_ncompare(
-                 data->instance.oid.oid, data->instance.oid.oid_len, vb->name,
-                 vb->name_length, data->instance.oid.oid_len) != 0)) {
-          DEBUG("snmp plugin: host = %s; data = %s; Instance left its subtree.",
-                host->name, data->name);
-          oid_list_todo[i] = 0;
-          continue;
-        }
+      /* Make sure the OIDs returned by the agent are increasing. Otherwise
+       * our
+       * table matching algorithm will get confused. */
+      if ((w->value_list_tail[i] != NULL) &&
+          (csnmp_oid_compare(&suffix, &w->value_list_tail[i]->suffix) <= 0)) {
+        DEBUG("snmp plugin: host = %s; data = %s; i = %" PRIsz "; "
+              "Suffix is not increasing.",
+              host->name, data->name, i);
+        w->oid_list_todo[i] = 0;
+        continue;
+      }
 
-        /* Allocate a new `csnmp_list_instances_t', insert the instance name and
-         * add it to the list */
-        if (csnmp_instance_list_add(&instance_list_head, &instance_list_tail,
-                                    res, host, data) != 0) {
-          ERROR("snmp plugin: host %s: csnmp_instance_list_add failed.",
-                host->name);
-          status = -1;
-          break;
-        }
-      } else /* The variable we are processing is a normal value */
-      {
-        csnmp_table_values_t *vt;
-        oid_t vb_name;
-        oid_t suffix;
-        int ret;
-
-        csnmp_oid_init(&vb_name, vb->name, vb->name_length);
-
-        /* Calculate the current suffix. This is later used to check that the
-         * suffix is increasing. This also checks if we left the subtree */
-        ret = csnmp_oid_suffix(&suffix, &vb_name, data->values + i);
-        if (ret != 0) {
-          DEBUG("snmp plugin: host = %s; data = %s; i = %" PRIsz "; "
-                "Value probably left its subtree.",
-                host->name, data->name, i);
-          oid_list_todo[i] = 0;
-          continue;
-        }
+      vt = calloc(1, sizeof(*vt));
+      if (vt == NULL) {
+        ERROR("snmp plugin: calloc failed.");
+        w->status = -1;
+        w->done = 1;
+        return;
+      }
 
-        /* Make sure the OIDs returned by the agent are increasing. Otherwise
-         * our
-         * table matching algorithm will get confused. */
-        if ((value_list_tail[i] != NULL) &&
-            (csnmp_oid_compare(&suffix, &value_list_tail[i]->suffix) <= 0)) {
-          DEBUG("snmp plugin: host = %s; data = %s; i = %" PRIsz "; "
-                "Suffix is not increasing.",
-                host->name, data->name, i);
-          oid_list_todo[i] = 0;
-          continue;
-        }
+      vt->value =
+          csnmp_value_list_to_value(vb, w->ds->ds[i].type, data->scale,
+                                    data->shift, host->name, data->name);
+      memcpy(&vt->suffix, &suffix, sizeof(vt->suffix));
+      vt->next = NULL;
 
-        vt = calloc(1, sizeof(*vt));
-        if (vt == NULL) {
-          ERROR("snmp plugin: calloc failed.");
-          status = -1;
-          break;
-        }
+      if (w->value_list_tail[i] == NULL)
+        w->value_list_head[i] = vt;
+      else
+        w->value_list_tail[i]->next = vt;
+      w->value_list_tail[i] = vt;
+    }
 
-        vt->value =
-            csnmp_value_list_to_value(vb, ds->ds[i].type, data->scale,
-                                      data->shift, host->name, data->name);
-        memcpy(&vt->suffix, &suffix, sizeof(vt->suffix));
-        vt->next = NULL;
-
-        if (value_list_tail[i] == NULL)
-          value_list_head[i] = vt;
-        else
-          value_list_tail[i]->next = vt;
-        value_list_tail[i] = vt;
-      }
+    /* Copy OID to oid_list[i] */
+    memcpy(w->oid_list[i].oid, vb->name, sizeof(oid) * vb->name_length);
+    w->oid_list[i].oid_len = vb->name_length;
 
-      /* Copy OID to oid_list[i] */
-      memcpy(oid_list[i].oid, vb->name, sizeof(oid) * vb->name_length);
-      oid_list[i].oid_len = vb->name_length;
+  } /* for (vb = res->variables ...) */
+} /* }}} void csnmp_walk_response_table */
 
-    } /* for (vb = res->variables ...) */
+/* Processes the response to the last request of the walk. */
+static void csnmp_walk_response(csnmp_walk_t *w, /* {{{ */
+                                struct snmp_pdu *res) {
+  if (w->data->is_table)
+    csnmp_walk_response_table(w, res);
+  else
+    csnmp_walk_response_value(w, res);
+} /* }}} void csnmp_walk_response */
 
-    if (res != NULL)
-      snmp_free_pdu(res);
-    res = NULL;
-  } /* while (status == 0) */
+static void csnmp_walk_dispatch(csnmp_walk_t *w) /* {{{ */
+{
+  host_definition_t *host = w->host;
+  data_definition_t *data = w->data;
+  value_list_t vl = VALUE_LIST_INIT;
 
-  if (res != NULL)
-    snmp_free_pdu(res);
-  res = NULL;
+  if (data->is_table) {
+    csnmp_dispatch_table(host, data, w->instance_list_head,
+                         w->value_list_head);
+    return;
+  }
 
-  if (status == 0)
-    csnmp_dispatch_table(host, data, instance_list_head, value_list_head);
+  vl.values = w->values;
+  vl.values_len = data->values_len;
 
-  /* Free all allocated variables here */
-  while (instance_list_head != NULL) {
-    csnmp_list_instances_t *next = instance_list_head->next;
-    sfree(instance_list_head);
-    instance_list_head = next;
-  }
+  sstrncpy(vl.host, host->name, sizeof(vl.host));
+  sstrncpy(vl.plugin, "snmp", sizeof(vl.plugin));
+  sstrncpy(vl.type, data->type, sizeof(vl.type));
+  sstrncpy(vl.type_instance, data->instance.string, sizeof(vl.type_instance));
 
-  for (i = 0; i < data->values_len; i++) {
-    while (value_list_head[i] != NULL) {
-      csnmp_table_values_t *next = value_list_head[i]->next;
-      sfree(value_list_head[i]);
-      value_list_head[i] = next;
-    }
-  }
+  vl.interval = host->interval;
+
+  DEBUG("snmp plugin: -> plugin_dispatch_values (&vl);");
+  plugin_dispatch_values(&vl);
+} /* }}} void csnmp_walk_dispatch */
 
-  sfree(value_list_head);
-  sfree(value_list_tail);
+static void csnmp_host_complain(host_definition_t *host, /* {{{ */
+                                char const *func) {
+  char *errstr = NULL;
 
-  return 0;
-} /* int csnmp_read_table */
+  snmp_sess_error(host->sess_handle, NULL, NULL, &errstr);
 
-static int csnmp_read_value(host_definition_t *host, data_definition_t *data) {
-  struct snmp_pdu *req;
-  struct snmp_pdu *res = NULL;
-  struct variable_list *vb;
+  c_complain(LOG_ERR, &host->complaint, "snmp plugin: host %s: %s failed: %s",
+             host->name, func, (errstr == NULL) ? "Unknown problem" : errstr);
 
-  const data_set_t *ds;
-  value_list_t vl = VALUE_LIST_INIT;
+  sfree(errstr);
+} /* }}} void csnmp_host_complain */
 
+static int csnmp_read_data(host_definition_t *host, /* {{{ */
+                           data_definition_t *data) {
+  struct snmp_pdu *req;
+  csnmp_walk_t *w;
   int status;
-  size_t i;
 
-  DEBUG("snmp plugin: csnmp_read_value (host = %s, data = %s)", host->name,
+  DEBUG("snmp plugin: csnmp_read_data (host = %s, data = %s)", host->name,
         data->name);
 
   if (host->sess_handle == NULL) {
-    DEBUG("snmp plugin: csnmp_read_value: host->sess_handle == NULL");
+    DEBUG("snmp plugin: csnmp_read_data: host->sess_handle == NULL");
     return -1;
   }
 
-  ds = plugin_get_ds(data->type);
-  if (!ds) {
-    ERROR("snmp plugin: DataSet `%s' not defined.", data->type);
+  w = csnmp_walk_create(host, data);
+  if (w == NULL)
     return -1;
+
+  while ((req = csnmp_walk_request(w)) != NULL) {
+    struct snmp_pdu *res = NULL;
+
+    /* snmp_sess_synch_response always frees our req PDU */
+    status = snmp_sess_synch_response(host->sess_handle, req, &res);
+    if ((status != STAT_SUCCESS) || (res == NULL)) {
+      csnmp_host_complain(host, "snmp_sess_synch_response");
+      if (res != NULL)
+        snmp_free_pdu(res);
+      csnmp_host_close_session(host);
+      w->status = -1;
+      break;
+    }
+
+    c_release(LOG_INFO, &host->complaint,
+              "snmp plugin: host %s: snmp_sess_synch_response successful.",
+              host->name);
+
+    csnmp_walk_response(w, res);
+    snmp_free_pdu(res);
   }
 
-  if (ds->ds_num != data->values_len) {
-    ERROR("snmp plugin: DataSet `%s' requires %" PRIsz
-          " values, but config talks "
-          "about %" PRIsz,
-          data->type, ds->ds_num, data->values_len);
-    return -1;
+  status = w->status;
+  if (status == 0)
+    csnmp_walk_dispatch(w);
+  csnmp_walk_destroy(w);
+
+  return status;
+} /* }}} int csnmp_read_data */
+
+/* Asynchronous engine. {{{ */
+static void csnmp_engine_wakeup(void) {
+  char c = 0;
+  /* A full pipe already guarantees a wakeup. */
+  if (write(engine_pipe[1], &c, 1) < 0 && errno != EAGAIN)
+    WARNING("snmp plugin: write to wakeup pipe failed: %s", STRERRNO);
+} /* void csnmp_engine_wakeup */
+
+static int csnmp_engine_callback(int operation, netsnmp_session *session,
+                                 int reqid, netsnmp_pdu *pdu, void *magic) {
+  csnmp_walk_t *w = magic;
+  host_definition_t *host = w->host;
+
+  w->pending = 0;
+  if (host->closing)
+    return 1;
+
+  if ((operation != NETSNMP_CALLBACK_OP_RECEIVED_MESSAGE) || (pdu == NULL)) {
+    c_complain(LOG_ERR, &host->complaint,
+               "snmp plugin: host %s: Request timed out.", host->name);
+    w->status = -1;
+    w->done = 1;
+    host->failed = 1;
+    return 1;
   }
 
-  vl.values_len = ds->ds_num;
-  vl.values = malloc(sizeof(*vl.values) * vl.values_len);
-  if (vl.values == NULL)
-    return -1;
-  for (i = 0; i < vl.values_len; i++) {
-    if (ds->ds[i].type == DS_TYPE_COUNTER)
-      vl.values[i].counter = 0;
-    else
-      vl.values[i].gauge = NAN;
+  c_release(LOG_INFO, &host->complaint,
+            "snmp plugin: host %s: Response received.", host->name);
+
+  /* The PDU is freed by net-snmp once we return. */
+  csnmp_walk_response(w, pdu);
+  return 1;
+} /* int csnmp_engine_callback */
+
+/* Closes the session and drops the host's walks without dispatching them. */
+static void csnmp_engine_abort(host_definition_t *host) {
+  /* Depending on the version, snmp_sess_close() reports the outstanding
+   * requests to csnmp_engine_callback(). */
+  host->closing = 1;
+  csnmp_host_close_session(host);
+  host->closing = 0;
+
+  while (host->walks != NULL) {
+    csnmp_walk_t *next = host->walks->next;
+    csnmp_walk_destroy(host->walks);
+    host->walks = next;
   }
 
-  sstrncpy(vl.host, host->name, sizeof(vl.host));
-  sstrncpy(vl.plugin, "snmp", sizeof(vl.plugin));
-  sstrncpy(vl.type, data->type, sizeof(vl.type));
-  sstrncpy(vl.type_instance, data->instance.string, sizeof(vl.type_instance));
+  host->in_flight = 0;
+  host->next_data = host->data_list_len;
+  host->failed = 0;
+} /* void csnmp_engine_abort */
 
-  vl.interval = host->interval;
+/* Sends the next requests of the host's walks and starts new walks, up to
+ * `max_in_flight' at a time. Returns true once the poll is complete. */
+static _Bool csnmp_engine_step(host_definition_t *host) {
+  while (42) {
+    csnmp_walk_t **ptr = &host->walks;
 
-  req = snmp_pdu_create(SNMP_MSG_GET);
-  if (req == NULL) {
-    ERROR("snmp plugin: snmp_pdu_create failed.");
-    sfree(vl.values);
-    return -1;
+    while ((*ptr != NULL) && !host->failed) {
+      csnmp_walk_t *w = *ptr;
+      struct snmp_pdu *req;
+
+      if (w->pending) {
+        ptr = &w->next;
+        continue;
+      }
+
+      req = csnmp_walk_request(w);
+      if (req != NULL) {
+        if (snmp_sess_async_send(host->sess_handle, req, csnmp_engine_callback,
+                                 w) != 0) {
+          w->pending = 1;
+          ptr = &w->next;
+          continue;
+        }
+        csnmp_host_complain(host, "snmp_sess_async_send");
+        snmp_free_pdu(req);
+        host->failed = 1;
+        break;
+      }
+
+      /* The walk is done. */
+      *ptr = w->next;
+      host->in_flight--;
+      if (w->status == 0)
+        csnmp_walk_dispatch(w);
+      csnmp_walk_destroy(w);
+    }
+
+    if (host->failed)
+      csnmp_engine_abort(host);
+
+    if (host->next_data >= host->data_list_len)
+      return host->in_flight == 0;
+    if (host->in_flight >= host->max_in_flight)
+      return 0;
+
+    if (host->sess_handle == NULL)
+      csnmp_host_open_session(host);
+    if (host->sess_handle == NULL) {
+      host->next_data = host->data_list_len;
+      continue;
+    }
+
+    csnmp_walk_t *w = csnmp_walk_create(host, host->data_list[host->next_data]);
+    host->next_data++;
+    if (w == NULL)
+      continue;
+
+    w->next = host->walks;
+    host->walks = w;
+    host->in_flight++;
   }
+} /* _Bool csnmp_engine_step */
+
+static void *csnmp_engine_main(void *arg) {
+  pthread_mutex_lock(&engine_lock);
+  while (!engine_stop) {
+    netsnmp_large_fd_set fdset;
+    struct timeval timeout = {.tv_sec = CSNMP_ENGINE_WAIT_S};
+    int numfds = engine_pipe[0] + 1;
+    int block = 0;
+    int count;
+
+    host_definition_t **ptr = &engine_hosts;
+    while (*ptr != NULL) {
+      host_definition_t *host = *ptr;
+
+      if (host->removed)
+        csnmp_engine_abort(host);
+      if (host->removed || csnmp_engine_step(host)) {
+        *ptr = host->next;
+        host->next = NULL;
+        host->polling = 0;
+        pthread_cond_broadcast(&engine_cond);
+        continue;
+      }
+      ptr = &host->next;
+    }
 
-  for (i = 0; i < data->values_len; i++)
-    snmp_add_null_var(req, data->values[i].oid, data->values[i].oid_len);
+    netsnmp_large_fd_set_init(&fdset, FD_SETSIZE);
+    NETSNMP_LARGE_FD_SET(engine_pipe[0], &fdset);
+    for (host_definition_t *host = engine_hosts; host != NULL;
+         host = host->next)
+      if (host->sess_handle != NULL)
+        snmp_sess_select_info2(host->sess_handle, &numfds, &fdset, &timeout,
+                               &block);
 
-  status = snmp_sess_synch_response(host->sess_handle, req, &res);
+    /* The sessions are only used by this thread. Submitters only touch the
+     * host list, so the lock can be dropped while waiting. */
+    pthread_mutex_unlock(&engine_lock);
 
-  if ((status != STAT_SUCCESS) || (res == NULL)) {
-    char *errstr = NULL;
+    count = netsnmp_large_fd_set_select(numfds, &fdset, NULL, NULL, &timeout);
+    if ((count < 0) && (errno != EINTR))
+      WARNING("snmp plugin: select failed: %s", STRERRNO);
 
-    snmp_sess_error(host->sess_handle, NULL, NULL, &errstr);
-    ERROR("snmp plugin: host %s: snmp_sess_synch_response failed: %s",
-          host->name, (errstr == NULL) ? "Unknown problem" : errstr);
+    char buffer[64];
+    while (read(engine_pipe[0], buffer, sizeof(buffer)) > 0)
+      /* drain */;
 
-    if (res != NULL)
-      snmp_free_pdu(res);
+    pthread_mutex_lock(&engine_lock);
 
-    sfree(errstr);
-    sfree(vl.values);
-    csnmp_host_close_session(host);
+    /* Calls csnmp_engine_callback() for responses and expired requests. */
+    for (host_definition_t *host = engine_hosts; host != NULL;
+         host = host->next) {
+      if (host->sess_handle == NULL)
+        continue;
+      if (count > 0)
+        snmp_sess_read2(host->sess_handle, &fdset);
+      snmp_sess_timeout(host->sess_handle);
+    }
+
+    netsnmp_large_fd_set_cleanup(&fdset);
+  }
+  pthread_mutex_unlock(&engine_lock);
+
+  return NULL;
+} /* void *csnmp_engine_main */
+
+static int csnmp_engine_start(void) {
+  int status;
+
+  if (engine_running)
+    return 0;
 
+  if (pipe(engine_pipe) != 0) {
+    ERROR("snmp plugin: pipe failed: %s", STRERRNO);
+    engine_pipe[0] = engine_pipe[1] = -1;
     return -1;
   }
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(engine_pipe); i++) {
+    fcntl(engine_pipe[i], F_SETFL, O_NONBLOCK);
+    fcntl(engine_pipe[i], F_SETFD, FD_CLOEXEC);
+  }
 
-  for (vb = res->variables; vb != NULL; vb = vb->next_variable) {
-#if COLLECT_DEBUG
-    char buffer[1024];
-    snprint_variable(buffer, sizeof(buffer), vb->name, vb->name_length, vb);
-    DEBUG("snmp plugin: Got this variable: %s", buffer);
-#endif /* COLLECT_DEBUG */
+  status = plugin_thread_create(&engine_thread, /* attr = */ NULL,
+                                csnmp_engine_main, /* arg = */ NULL,
+                                "snmp engine");
+  if (status != 0) {
+    ERROR("snmp plugin: Starting thread failed: %s", STRERROR(status));
+    for (size_t i = 0; i < STATIC_ARRAY_SIZE(engine_pipe); i++) {
+      close(engine_pipe[i]);
+      engine_pipe[i] = -1;
+    }
+    return -1;
+  }
 
-    for (i = 0; i < data->values_len; i++)
-      if (snmp_oid_compare(data->values[i].oid, data->values[i].oid_len,
-                           vb->name, vb->name_length) == 0)
-        vl.values[i] =
-            csnmp_value_list_to_value(vb, ds->ds[i].type, data->scale,
-                                      data->shift, host->name, data->name);
-  } /* for (res->variables) */
+  pthread_mutex_lock(&engine_lock);
+  engine_running = 1;
+  pthread_mutex_unlock(&engine_lock);
+  return 0;
+} /* int csnmp_engine_start */
+
+static void csnmp_engine_stop(void) {
+  pthread_mutex_lock(&engine_lock);
+  if (!engine_running) {
+    pthread_mutex_unlock(&engine_lock);
+    return;
+  }
+  engine_stop = 1;
+  csnmp_engine_wakeup();
+  pthread_mutex_unlock(&engine_lock);
 
-  snmp_free_pdu(res);
+  pthread_join(engine_thread, /* retval = */ NULL);
 
-  DEBUG("snmp plugin: -> plugin_dispatch_values (&vl);");
-  plugin_dispatch_values(&vl);
-  sfree(vl.values);
+  pthread_mutex_lock(&engine_lock);
+  while (engine_hosts != NULL) {
+    host_definition_t *host = engine_hosts;
+
+    engine_hosts = host->next;
+    csnmp_engine_abort(host);
+    host->next = NULL;
+    host->polling = 0;
+  }
+  engine_running = 0;
+  engine_stop = 0;
+  pthread_cond_broadcast(&engine_cond);
+  pthread_mutex_unlock(&engine_lock);
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(engine_pipe); i++) {
+    close(engine_pipe[i]);
+    engine_pipe[i] = -1;
+  }
+} /* void csnmp_engine_stop */
+
+/* Queues a poll of `host'. The engine thread reads the host's data and
+ * dispatches the values. */
+static int csnmp_engine_submit(host_definition_t *host) {
+  pthread_mutex_lock(&engine_lock);
+  if (!engine_running) {
+    pthread_mutex_unlock(&engine_lock);
+    return -1;
+  }
+  if (host->polling) {
+    pthread_mutex_unlock(&engine_lock);
+    WARNING("snmp plugin: host %s: Previous poll still in progress, skipping.",
+            host->name);
+    return 0;
+  }
+
+  host->polling = 1;
+  host->next_data = 0;
+  host->next = engine_hosts;
+  engine_hosts = host;
+  csnmp_engine_wakeup();
+  pthread_mutex_unlock(&engine_lock);
 
   return 0;
-} /* int csnmp_read_value */
+} /* int csnmp_engine_submit */
+
+/* Waits until the engine has dropped `host'. */
+static void csnmp_engine_remove(host_definition_t *host) {
+  pthread_mutex_lock(&engine_lock);
+  while (host->polling) {
+    host->removed = 1;
+    csnmp_engine_wakeup();
+    pthread_cond_wait(&engine_cond, &engine_lock);
+  }
+  host->removed = 0;
+  pthread_mutex_unlock(&engine_lock);
+} /* void csnmp_engine_remove */
+/* }}} End of the asynchronous engine */
 
 static int csnmp_read_host(user_data_t *ud) {
   host_definition_t *host;
@@ -1669,6 +2044,9 @@ static int csnmp_read_host(user_data_t *ud) {
   if (host->interval == 0)
     host->interval = plugin_get_interval();
 
+  if (csnmp_async)
+    return csnmp_engine_submit(host);
+
   if (host->sess_handle == NULL)
     csnmp_host_open_session(host);
 
@@ -1677,13 +2055,7 @@ static int csnmp_read_host(user_data_t *ud) {
 
   success = 0;
   for (i = 0; i < host->data_list_len; i++) {
-    data_definition_t *data = host->data_list[i];
-
-    if (data->is_table)
-      status = csnmp_read_table(host, data);
-    else
-      status = csnmp_read_value(host, data);
-
+    status = csnmp_read_data(host, host->data_list[i]);
     if (status == 0)
       success++;
   }
@@ -1697,6 +2069,9 @@ static int csnmp_read_host(user_data_t *ud) {
 static int csnmp_init(void) {
   call_snmp_init_once();
 
+  if (csnmp_async)
+    return csnmp_engine_start();
+
   return 0;
 } /* int csnmp_init */
 
@@ -1704,6 +2079,9 @@ static int csnmp_shutdown(void) {
   data_definition_t *data_this;
   data_definition_t *data_next;
 
+  /* The engine's walks refer to the data definitions. */
+  csnmp_engine_stop();
+
   /* When we get here, the read threads have been stopped and all the
    * `host_definition_t' will be freed. */
   DEBUG("snmp plugin: Destroying all data definitions.");
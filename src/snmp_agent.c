@@ -54,6 +54,16 @@ struct oid_s {
 };
 typedef struct oid_s oid_t;
 
+/* A row of a table. The suffix is the part of a cell's OID following the
+ * column OID: the numeric index or the length-prefixed instance string. */
+struct table_row_s {
+  oid *suffix;
+  size_t suffix_len;
+  const char *instance; /* owned by instance_index */
+  int index;
+};
+typedef struct table_row_s table_row_t;
+
 struct table_definition_s {
   char *name;
   oid_t index_oid;
@@ -61,6 +71,8 @@ struct table_definition_s {
   llist_t *columns;
   c_avl_tree_t *instance_index;
   c_avl_tree_t *index_instance;
+  table_row_t *rows; /* sorted by suffix, i.e. in SNMP walk order */
+  size_t rows_num;
 };
 typedef struct table_definition_s table_definition_t;
 
@@ -101,10 +113,12 @@ static snmp_agent_ctx_t *g_agent = NULL;
 static int snmp_agent_shutdown(void);
 static void *snmp_agent_thread_run(void *arg);
 static int snmp_agent_register_oid(oid_t *oid, Netsnmp_Node_Handler *handler);
+static int snmp_agent_register_subtree(oid_t *oid,
+                                       Netsnmp_Node_Handler *handler,
+                                       void *handler_data);
 static int snmp_agent_set_vardata(void *dst_buf, size_t *dst_buf_len,
                                   u_char asn_type, double scale, double shift,
                                   const void *value, size_t len, int type);
-static int snmp_agent_unregister_oid_index(oid_t *oid, int index);
 
 static u_char snmp_agent_get_asn_type(oid *oid, size_t oid_len) {
   struct tree *node = get_tree(oid, oid_len, g_agent->tp);
@@ -283,17 +297,6 @@ static int snmp_agent_validate_data(void) {
   return 0;
 }
 
-static void snmp_agent_generate_oid2string(oid_t *oid, size_t offset,
-                                           char *key) {
-  int key_len = oid->oid[offset];
-  int i;
-
-  for (i = 0; i < key_len && offset < oid->oid_len; i++)
-    key[i] = oid->oid[++offset];
-
-  key[i] = '\0';
-}
-
 static int snmp_agent_generate_string2oid(oid_t *oid, const char *key) {
   int key_len = strlen(key);
 
@@ -309,27 +312,93 @@ static int snmp_agent_generate_string2oid(oid_t *oid, const char *key) {
   return 0;
 }
 
-static int snmp_agent_register_oid_string(oid_t *oid, const char *key,
-                                          Netsnmp_Node_Handler *handler) {
-  oid_t new_oid;
+static int snmp_agent_row_suffix(table_definition_t const *td,
+                                 const char *instance, int index,
+                                 oid_t *suffix) {
+  suffix->oid_len = 0;
 
-  memcpy(&new_oid, oid, sizeof(*oid));
-  int ret = snmp_agent_generate_string2oid(&new_oid, key);
-  if (ret != 0)
-    return ret;
+  if (td->index_oid.oid_len) {
+    suffix->oid[suffix->oid_len++] = index;
+    return 0;
+  }
+
+  return snmp_agent_generate_string2oid(suffix, instance);
+}
+
+/* Returns the position of the first row whose suffix is not less than the
+ * given one. */
+static size_t snmp_agent_row_find(table_definition_t const *td,
+                                  const oid *suffix, size_t suffix_len,
+                                  _Bool *found) {
+  size_t lo = 0;
+  size_t hi = td->rows_num;
+
+  *found = 0;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    int cmp = snmp_oid_compare(td->rows[mid].suffix, td->rows[mid].suffix_len,
+                               suffix, suffix_len);
+    if (cmp < 0) {
+      lo = mid + 1;
+    } else {
+      *found = *found || (cmp == 0);
+      hi = mid;
+    }
+  }
 
-  return snmp_agent_register_oid(&new_oid, handler);
+  return lo;
 }
 
-static int snmp_agent_unregister_oid_string(oid_t *oid, const char *key) {
-  oid_t new_oid;
+static int snmp_agent_row_insert(table_definition_t *td, const char *instance,
+                                 int index) {
+  oid_t suffix;
+  _Bool found;
 
-  memcpy(&new_oid, oid, sizeof(*oid));
-  int ret = snmp_agent_generate_string2oid(&new_oid, key);
+  int ret = snmp_agent_row_suffix(td, instance, index, &suffix);
   if (ret != 0)
     return ret;
 
-  return unregister_mib(new_oid.oid, new_oid.oid_len);
+  size_t pos = snmp_agent_row_find(td, suffix.oid, suffix.oid_len, &found);
+  if (found)
+    return 0;
+
+  table_row_t *tmp = realloc(td->rows, sizeof(*td->rows) * (td->rows_num + 1));
+  if (tmp == NULL)
+    return -ENOMEM;
+  td->rows = tmp;
+
+  table_row_t row = {.suffix = calloc(suffix.oid_len, sizeof(oid)),
+                     .suffix_len = suffix.oid_len,
+                     .instance = instance,
+                     .index = index};
+  if (row.suffix == NULL)
+    return -ENOMEM;
+  memcpy(row.suffix, suffix.oid, sizeof(oid) * suffix.oid_len);
+
+  memmove(td->rows + pos + 1, td->rows + pos,
+          sizeof(*td->rows) * (td->rows_num - pos));
+  td->rows[pos] = row;
+  td->rows_num++;
+
+  return 0;
+}
+
+static void snmp_agent_row_remove(table_definition_t *td, const char *instance,
+                                  int index) {
+  oid_t suffix;
+  _Bool found;
+
+  if (snmp_agent_row_suffix(td, instance, index, &suffix) != 0)
+    return;
+
+  size_t pos = snmp_agent_row_find(td, suffix.oid, suffix.oid_len, &found);
+  if (!found)
+    return;
+
+  sfree(td->rows[pos].suffix);
+  memmove(td->rows + pos, td->rows + pos + 1,
+          sizeof(*td->rows) * (td->rows_num - pos - 1));
+  td->rows_num--;
 }
 
 static int snmp_agent_table_row_remove(table_definition_t *td,
@@ -346,22 +415,7 @@ static int snmp_agent_table_row_remove(table_definition_t *td,
       return 0;
   }
 
-  pthread_mutex_lock(&g_agent->agentx_lock);
-
-  if (td->index_oid.oid_len)
-    snmp_agent_unregister_oid_index(&td->index_oid, *index);
-
-  for (llentry_t *de = llist_head(td->columns); de != NULL; de = de->next) {
-    data_definition_t *dd = de->value;
-
-    for (size_t i = 0; i < dd->oids_len; i++)
-      if (td->index_oid.oid_len)
-        snmp_agent_unregister_oid_index(&dd->oids[i], *index);
-      else
-        snmp_agent_unregister_oid_string(&dd->oids[i], ins);
-  }
-
-  pthread_mutex_unlock(&g_agent->agentx_lock);
+  snmp_agent_row_remove(td, ins, (index != NULL) ? *index : 0);
 
   DEBUG(PLUGIN_NAME ": Removed row for '%s' table [%d, %s]", td->name,
         (index != NULL) ? *index : -1, ins);
@@ -442,28 +496,8 @@ static void snmp_agent_free_table_columns(table_definition_t *td) {
   for (llentry_t *de = llist_head(td->columns); de != NULL; de = de->next) {
     data_definition_t *dd = de->value;
 
-    if (td->index_oid.oid_len) {
-      int *index;
-      char *instance;
-
-      c_avl_iterator_t *iter = c_avl_get_iterator(td->index_instance);
-      while (c_avl_iterator_next(iter, (void *)&index, (void *)&instance) ==
-             0) {
-        for (size_t i = 0; i < dd->oids_len; i++)
-          snmp_agent_unregister_oid_index(&dd->oids[i], *index);
-      }
-      c_avl_iterator_destroy(iter);
-    } else {
-      char *instance;
-
-      c_avl_iterator_t *iter = c_avl_get_iterator(dd->table->instance_index);
-      while (c_avl_iterator_next(iter, (void *)&instance, (void *)&instance) ==
-             0) {
-        for (size_t i = 0; i < dd->oids_len; i++)
-          snmp_agent_unregister_oid_string(&dd->oids[i], instance);
-      }
-      c_avl_iterator_destroy(iter);
-    }
+    for (size_t i = 0; i < dd->oids_len; i++)
+      unregister_mib(dd->oids[i].oid, dd->oids[i].oid_len);
 
     snmp_agent_free_data(&dd);
   }
@@ -480,21 +514,17 @@ static void snmp_agent_free_table(table_definition_t **td) {
   if ((*td)->size_oid.oid_len)
     unregister_mib((*td)->size_oid.oid, (*td)->size_oid.oid_len);
 
-  /* Unregister Index OIDs */
-  if ((*td)->index_oid.oid_len) {
-    int *index;
-    char *instance;
-
-    c_avl_iterator_t *iter = c_avl_get_iterator((*td)->index_instance);
-    while (c_avl_iterator_next(iter, (void *)&index, (void *)&instance) == 0)
-      snmp_agent_unregister_oid_index(&(*td)->index_oid, *index);
+  if ((*td)->index_oid.oid_len)
+    unregister_mib((*td)->index_oid.oid, (*td)->index_oid.oid_len);
 
-    c_avl_iterator_destroy(iter);
-  }
-
-  /* Unregister all table columns and their registered OIDs */
+  /* Unregister all table columns */
   snmp_agent_free_table_columns(*td);
 
+  for (size_t i = 0; i < (*td)->rows_num; i++)
+    sfree((*td)->rows[i].suffix);
+  sfree((*td)->rows);
+  (*td)->rows_num = 0;
+
   void *key = NULL;
   void *value = NULL;
 
@@ -565,92 +595,114 @@ static int snmp_agent_form_reply(struct netsnmp_request_info_s *requests,
   return SNMP_ERR_NOERROR;
 }
 
-static int
-snmp_agent_table_oid_handler(struct netsnmp_mib_handler_s *handler,
-                             struct netsnmp_handler_registration_s *reginfo,
-                             struct netsnmp_agent_request_info_s *reqinfo,
-                             struct netsnmp_request_info_s *requests) {
+/* Sets the value of a table cell: the row's index if `dd' is NULL, its
+ * instance or the value of column `oid_index' of `dd' otherwise. */
+static int snmp_agent_table_cell(struct netsnmp_request_info_s *request,
+                                 table_row_t const *row, data_definition_t *dd,
+                                 size_t oid_index) {
+  if (dd == NULL) {
+    request->requestvb->type = ASN_INTEGER;
+    snmp_set_var_typed_value(request->requestvb, request->requestvb->type,
+                             (const u_char *)&row->index, sizeof(row->index));
+    return SNMP_ERR_NOERROR;
+  }
 
-  if (reqinfo->mode != MODE_GET && reqinfo->mode != MODE_GETNEXT) {
-    DEBUG(PLUGIN_NAME ": Not supported request mode (%d)", reqinfo->mode);
+  if (dd->is_instance) {
+    request->requestvb->type = ASN_OCTET_STR;
+    snmp_set_var_typed_value(request->requestvb, request->requestvb->type,
+                             (const u_char *)row->instance,
+                             strlen(row->instance));
     return SNMP_ERR_NOERROR;
   }
 
-  pthread_mutex_lock(&g_agent->lock);
+  return snmp_agent_form_reply(request, dd, (char *)row->instance, oid_index);
+}
 
-  oid_t oid;
-  memcpy(oid.oid, requests->requestvb->name,
-         sizeof(oid.oid[0]) * requests->requestvb->name_length);
-  oid.oid_len = requests->requestvb->name_length;
+/* Serves a request for a cell in the column `column' by looking up the row
+ * index: a GET needs an exact match, a GETNEXT the first row after the
+ * requested OID. */
+static void
+snmp_agent_table_request(struct netsnmp_agent_request_info_s *reqinfo,
+                         struct netsnmp_request_info_s *request,
+                         table_definition_t const *td, oid_t const *column,
+                         data_definition_t *dd, size_t oid_index) {
+  netsnmp_variable_list *vb = request->requestvb;
+  const oid *suffix = NULL;
+  size_t suffix_len = 0;
+  _Bool found;
+
+  if (vb->name_length > column->oid_len) {
+    suffix = vb->name + column->oid_len;
+    suffix_len = vb->name_length - column->oid_len;
+  }
+
+  size_t pos = snmp_agent_row_find(td, suffix, suffix_len, &found);
+
+  if (reqinfo->mode == MODE_GET) {
+    if (!found ||
+        (snmp_agent_table_cell(request, td->rows + pos, dd, oid_index) !=
+         SNMP_ERR_NOERROR))
+      netsnmp_set_request_error(reqinfo, request, SNMP_NOSUCHINSTANCE);
+    return;
+  }
 
-#if COLLECT_DEBUG
-  char oid_str[DATA_MAX_NAME_LEN];
-  snmp_agent_oid_to_string(oid_str, sizeof(oid_str), &oid);
-  DEBUG(PLUGIN_NAME ": Get request received for table OID '%s'", oid_str);
-#endif
+  if (found && !request->inclusive)
+    pos++;
 
-  for (llentry_t *te = llist_head(g_agent->tables); te != NULL; te = te->next) {
-    table_definition_t *td = te->value;
+  for (; pos < td->rows_num; pos++) {
+    table_row_t const *row = td->rows + pos;
+    oid name[MAX_OID_LEN];
 
-    for (llentry_t *de = llist_head(td->columns); de != NULL; de = de->next) {
-      data_definition_t *dd = de->value;
+    if (column->oid_len + row->suffix_len > MAX_OID_LEN)
+      continue;
 
-      for (size_t i = 0; i < dd->oids_len; i++) {
-        int ret = snmp_oid_ncompare(oid.oid, oid.oid_len, dd->oids[i].oid,
-                                    dd->oids[i].oid_len,
-                                    MIN(oid.oid_len, dd->oids[i].oid_len));
-        if (ret != 0)
-          continue;
-
-        char *instance;
-
-        if (!td->index_oid.oid_len) {
-          char key[MAX_OID_LEN];
-
-          memset(key, 0, sizeof(key));
-          snmp_agent_generate_oid2string(
-              &oid, MIN(oid.oid_len, dd->oids[i].oid_len), key);
-
-          ret = c_avl_get(td->instance_index, key, (void **)&instance);
-          if (ret != 0) {
-            DEBUG(PLUGIN_NAME ": Nonexisting index string '%s' requested", key);
-            pthread_mutex_unlock(&g_agent->lock);
-            return SNMP_NOSUCHINSTANCE;
-          }
-        } else {
-          int index = oid.oid[oid.oid_len - 1];
-
-          ret = c_avl_get(td->index_instance, &index, (void **)&instance);
-          if (ret != 0) {
-            DEBUG(PLUGIN_NAME ": Nonexisting index '%d' requested", index);
-            pthread_mutex_unlock(&g_agent->lock);
-            return SNMP_NOSUCHINSTANCE;
-          }
-        }
+    /* skip rows without a value in the cache */
+    if (snmp_agent_table_cell(request, row, dd, oid_index) != SNMP_ERR_NOERROR)
+      continue;
 
-        if (dd->is_instance) {
-          requests->requestvb->type = ASN_OCTET_STR;
-          snmp_set_var_typed_value(
-              requests->requestvb, requests->requestvb->type,
-              (const u_char *)instance, strlen((instance)));
+    memcpy(name, column->oid, sizeof(oid) * column->oid_len);
+    memcpy(name + column->oid_len, row->suffix, sizeof(oid) * row->suffix_len);
+    snmp_set_var_objid(vb, name, column->oid_len + row->suffix_len);
+    return;
+  }
 
-          pthread_mutex_unlock(&g_agent->lock);
+  /* End of the column: leaving the varbind untouched makes the agent
+   * continue with the next registered subtree. */
+}
 
-          return SNMP_ERR_NOERROR;
-        }
+static int
+snmp_agent_table_oid_handler(struct netsnmp_mib_handler_s *handler,
+                             struct netsnmp_handler_registration_s *reginfo,
+                             struct netsnmp_agent_request_info_s *reqinfo,
+                             struct netsnmp_request_info_s *requests) {
+
+  if (reqinfo->mode != MODE_GET && reqinfo->mode != MODE_GETNEXT) {
+    DEBUG(PLUGIN_NAME ": Not supported request mode (%d)", reqinfo->mode);
+    return SNMP_ERR_NOERROR;
+  }
 
-        ret = snmp_agent_form_reply(requests, dd, instance, i);
+  data_definition_t *dd = handler->myvoid;
 
-        pthread_mutex_unlock(&g_agent->lock);
+  pthread_mutex_lock(&g_agent->lock);
 
-        return ret;
-      }
+  for (struct netsnmp_request_info_s *r = requests; r != NULL; r = r->next) {
+    if (r->processed)
+      continue;
+
+    for (size_t i = 0; i < dd->oids_len; i++) {
+      if (netsnmp_oid_is_subtree(dd->oids[i].oid, dd->oids[i].oid_len,
+                                 r->requestvb->name,
+                                 r->requestvb->name_length) != 0)
+        continue;
+
+      snmp_agent_table_request(reqinfo, r, dd->table, &dd->oids[i], dd, i);
+      break;
     }
   }
 
   pthread_mutex_unlock(&g_agent->lock);
 
-  return SNMP_NOSUCHINSTANCE;
+  return SNMP_ERR_NOERROR;
 }
 
 static int snmp_agent_table_index_oid_handler(
@@ -664,45 +716,17 @@ static int snmp_agent_table_index_oid_handler(
     return SNMP_ERR_NOERROR;
   }
 
-  pthread_mutex_lock(&g_agent->lock);
-
-  oid_t oid;
-  memcpy(oid.oid, requests->requestvb->name,
-         sizeof(oid.oid[0]) * requests->requestvb->name_length);
-  oid.oid_len = requests->requestvb->name_length;
-
-  for (llentry_t *te = llist_head(g_agent->tables); te != NULL; te = te->next) {
-    table_definition_t *td = te->value;
-
-    if (td->index_oid.oid_len &&
-        (snmp_oid_ncompare(oid.oid, oid.oid_len, td->index_oid.oid,
-                           td->index_oid.oid_len,
-                           MIN(oid.oid_len, td->index_oid.oid_len)) == 0)) {
+  table_definition_t *td = handler->myvoid;
 
-      DEBUG(PLUGIN_NAME ": Handle '%s' table index OID", td->name);
-
-      int index = oid.oid[oid.oid_len - 1];
-
-      int ret = c_avl_get(td->index_instance, &index, &(void *){NULL});
-      if (ret != 0) {
-        /* nonexisting index requested */
-        pthread_mutex_unlock(&g_agent->lock);
-        return SNMP_NOSUCHINSTANCE;
-      }
-
-      requests->requestvb->type = ASN_INTEGER;
-      snmp_set_var_typed_value(requests->requestvb, requests->requestvb->type,
-                               (const u_char *)&index, sizeof(index));
-
-      pthread_mutex_unlock(&g_agent->lock);
+  pthread_mutex_lock(&g_agent->lock);
 
-      return SNMP_ERR_NOERROR;
-    }
-  }
+  for (struct netsnmp_request_info_s *r = requests; r != NULL; r = r->next)
+    if (!r->processed)
+      snmp_agent_table_request(reqinfo, r, td, &td->index_oid, NULL, 0);
 
   pthread_mutex_unlock(&g_agent->lock);
 
-  return SNMP_NOSUCHINSTANCE;
+  return SNMP_ERR_NOERROR;
 }
 
 static int snmp_agent_table_size_oid_handler(
@@ -814,12 +838,24 @@ static int snmp_agent_register_table_oids(void) {
         return ret;
     }
 
+    if (td->index_oid.oid_len != 0) {
+      int ret = snmp_agent_register_subtree(
+          &td->index_oid, snmp_agent_table_index_oid_handler, td);
+      if (ret != 0)
+        return ret;
+    }
+
     for (llentry_t *de = llist_head(td->columns); de != NULL; de = de->next) {
       data_definition_t *dd = de->value;
 
       for (size_t i = 0; i < dd->oids_len; i++) {
         dd->oids[i].type =
             snmp_agent_get_asn_type(dd->oids[i].oid, dd->oids[i].oid_len);
+
+        int ret = snmp_agent_register_subtree(
+            &dd->oids[i], snmp_agent_table_oid_handler, dd);
+        if (ret != 0)
+          return ret;
       }
     }
   }
@@ -1224,21 +1260,6 @@ static int snmp_agent_set_vardata(void *data, size_t *data_len, u_char asn_type,
   return 0;
 }
 
-static int snmp_agent_register_oid_index(oid_t *oid, int index,
-                                         Netsnmp_Node_Handler *handler) {
-  oid_t new_oid;
-  memcpy(&new_oid, oid, sizeof(*oid));
-  new_oid.oid[new_oid.oid_len++] = index;
-  return snmp_agent_register_oid(&new_oid, handler);
-}
-
-static int snmp_agent_unregister_oid_index(oid_t *oid, int index) {
-  oid_t new_oid;
-  memcpy(&new_oid, oid, sizeof(*oid));
-  new_oid.oid[new_oid.oid_len++] = index;
-  return unregister_mib(new_oid.oid, new_oid.oid_len);
-}
-
 static int snmp_agent_update_index(table_definition_t *td,
                                    const char *instance) {
 
@@ -1279,11 +1300,6 @@ static int snmp_agent_update_index(table_definition_t *td,
       sfree(index);
       return ret;
     }
-
-    ret = snmp_agent_register_oid_index(&td->index_oid, *index,
-                                        snmp_agent_table_index_oid_handler);
-    if (ret != 0)
-      return ret;
   } else {
     /* instance as a key is required for any table */
     ret = c_avl_insert(td->instance_index, ins, ins);
@@ -1293,22 +1309,13 @@ static int snmp_agent_update_index(table_definition_t *td,
     }
   }
 
-  /* register new oids for all columns */
-  for (llentry_t *de = llist_head(td->columns); de != NULL; de = de->next) {
-    data_definition_t *dd = de->value;
-
-    for (size_t i = 0; i < dd->oids_len; i++) {
-      if (td->index_oid.oid_len) {
-        ret = snmp_agent_register_oid_index(&dd->oids[i], *index,
-                                            snmp_agent_table_oid_handler);
-      } else {
-        ret = snmp_agent_register_oid_string(&dd->oids[i], ins,
-                                             snmp_agent_table_oid_handler);
-      }
-
-      if (ret != 0)
-        return ret;
-    }
+  /* The columns are registered as a whole; the new row only needs to be
+   * added to the row index. */
+  ret = snmp_agent_row_insert(td, ins, (index != NULL) ? *index : 0);
+  if (ret != 0) {
+    ERROR(PLUGIN_NAME ": Failed to add row for '%s' to '%s' table", ins,
+          td->name);
+    return ret;
   }
 
   DEBUG(PLUGIN_NAME ": Updated index for '%s' table [%d, %s]", td->name,
@@ -1447,7 +1454,8 @@ static int snmp_agent_init(void) {
   }
 
   /* create a second thread to listen for requests from AgentX*/
-  ret = pthread_create(&g_agent->thread, NULL, &snmp_agent_thread_run, NULL);
+  ret = plugin_thread_create(&g_agent->thread, NULL, &snmp_agent_thread_run,
+                             NULL, "snmp agent");
   if (ret != 0) {
     ERROR(PLUGIN_NAME ": Failed to create a separate thread, err %u", ret);
     return ret;
@@ -1478,9 +1486,14 @@ static void *snmp_agent_thread_run(void __attribute__((unused)) * arg) {
   pthread_exit(0);
 }
 
-static int snmp_agent_register_oid(oid_t *oid, Netsnmp_Node_Handler *handler) {
+/* Registers `handler' for the single instance `oid' or, if `subtree' is
+ * true, for all OIDs below `oid', e.g. for a table column. */
+static int snmp_agent_register_handler(oid_t *oid,
+                                       Netsnmp_Node_Handler *handler,
+                                       void *handler_data, _Bool subtree) {
   netsnmp_handler_registration *reg;
-  char *oid_name = snmp_agent_get_oid_name(oid->oid, oid->oid_len - 1);
+  char *oid_name =
+      snmp_agent_get_oid_name(oid->oid, oid->oid_len - (subtree ? 0 : 1));
   char oid_str[DATA_MAX_NAME_LEN];
 
   snmp_agent_oid_to_string(oid_str, sizeof(oid_str), oid);
@@ -1499,10 +1512,13 @@ static int snmp_agent_register_oid(oid_t *oid, Netsnmp_Node_Handler *handler) {
           oid_str);
     return -1;
   }
+  reg->handler->myvoid = handler_data;
 
   pthread_mutex_lock(&g_agent->agentx_lock);
 
-  if (netsnmp_register_instance(reg) != MIB_REGISTERED_OK) {
+  int ret = subtree ? netsnmp_register_handler(reg)
+                    : netsnmp_register_instance(reg);
+  if (ret != MIB_REGISTERED_OK) {
     ERROR(PLUGIN_NAME ": Failed to register handler for OID (%s)", oid_str);
     pthread_mutex_unlock(&g_agent->agentx_lock);
     return -1;
@@ -1515,6 +1531,17 @@ static int snmp_agent_register_oid(oid_t *oid, Netsnmp_Node_Handler *handler) {
   return 0;
 }
 
+static int snmp_agent_register_oid(oid_t *oid, Netsnmp_Node_Handler *handler) {
+  return snmp_agent_register_handler(oid, handler, NULL, /* subtree = */ 0);
+}
+
+static int snmp_agent_register_subtree(oid_t *oid,
+                                       Netsnmp_Node_Handler *handler,
+                                       void *handler_data) {
+  return snmp_agent_register_handler(oid, handler, handler_data,
+                                     /* subtree = */ 1);
+}
+
 static int snmp_agent_free_config(void) {
 
   if (g_agent == NULL)
@@ -24,12 +24,16 @@
  *   Florian octo Forster <octo at collectd.org>
  */
 
+#define _GNU_SOURCE /* For recvmmsg(2) */
+
 #include "collectd.h"
 
 #include "common.h"
 #include "plugin.h"
 #include "utils_avltree.h"
+#include "utils_fdstore.h"
 #include "utils_latency.h"
+#include "utils_rcvbuf.h"
 
 #include <netdb.h>
 #include <poll.h>
@@ -48,6 +52,16 @@
 #define STATSD_DEFAULT_SERVICE "8125"
 #endif
 
+/* Number of independently locked parts of the metric store. Must be a power
+ * of two. */
+#ifndef STATSD_SHARDS_NUM
+#define STATSD_SHARDS_NUM 64
+#endif
+
+/* Number of datagrams received with one recvmmsg(2) call. */
+#define STATSD_RECEIVE_BATCH 32
+#define STATSD_BUFFER_SIZE 4096
+
 enum metric_type_e { STATSD_COUNTER, STATSD_TIMER, STATSD_GAUGE, STATSD_SET };
 typedef enum metric_type_e metric_type_t;
 
@@ -61,15 +75,30 @@ struct statsd_metric_s {
 };
 typedef struct statsd_metric_s statsd_metric_t;
 
-static c_avl_tree_t *metrics_tree = NULL;
-static pthread_mutex_t metrics_lock = PTHREAD_MUTEX_INITIALIZER;
+/* Metrics are distributed over the shards by the hash of their name, so that
+ * the receive threads and statsd_read() rarely wait for each other. */
+typedef struct {
+  pthread_mutex_t lock;
+  c_avl_tree_t *tree;
+} statsd_shard_t;
 
-static pthread_t network_thread;
-static _Bool network_thread_running = 0;
+static statsd_shard_t metrics_shards[STATSD_SHARDS_NUM];
+static _Bool metrics_initialized = 0;
+
+static pthread_t *network_threads = NULL;
+static size_t network_threads_num = 0;
 static _Bool network_thread_shutdown = 0;
 
+/* Datagrams dropped by the kernel, summed over the sockets of all receive
+ * threads. Only reported if drops can be counted for at least one socket. */
+static uint64_t network_drops = 0;
+static _Bool network_drops_enabled = 0;
+
 static char *conf_node = NULL;
 static char *conf_service = NULL;
+static int conf_receive_threads = 1;
+static int conf_receive_buffer = 0;
+static _Bool conf_receive_buffer_auto = 1;
 
 static _Bool conf_delete_counters = 0;
 static _Bool conf_delete_timers = 0;
@@ -84,10 +113,14 @@ static _Bool conf_timer_lower = 0;
 static _Bool conf_timer_upper = 0;
 static _Bool conf_timer_sum = 0;
 static _Bool conf_timer_count = 0;
-
-/* Must hold metrics_lock when calling this function. */
-static statsd_metric_t *statsd_metric_lookup_unsafe(char const *name, /* {{{ */
-                                                    metric_type_t type) {
+static _Bool conf_timer_sketch = 0;
+
+/* Looks up the metric, creating it if necessary. The lock of the metric's
+ * shard, returned in "ret_shard", is held when this function returns, also
+ * if it fails, and must be released by the caller. */
+static statsd_metric_t *statsd_metric_lookup(char const *name, /* {{{ */
+                                             metric_type_t type,
+                                             statsd_shard_t **ret_shard) {
   char key[DATA_MAX_NAME_LEN + 2];
   char *key_copy;
   statsd_metric_t *metric;
@@ -113,7 +146,12 @@ static statsd_metric_t *statsd_metric_lookup_unsafe(char const *name, /* {{{ */
   key[1] = ':';
   sstrncpy(&key[2], name, sizeof(key) - 2);
 
-  status = c_avl_get(metrics_tree, key, (void *)&metric);
+  statsd_shard_t *shard =
+      &metrics_shards[identifier_hash(key) & (STATSD_SHARDS_NUM - 1)];
+  pthread_mutex_lock(&shard->lock);
+  *ret_shard = shard;
+
+  status = c_avl_get(shard->tree, key, (void *)&metric);
   if (status == 0)
     return metric;
 
@@ -134,7 +172,7 @@ static statsd_metric_t *statsd_metric_lookup_unsafe(char const *name, /* {{{ */
   metric->latency = NULL;
   metric->set = NULL;
 
-  status = c_avl_insert(metrics_tree, key_copy, metric);
+  status = c_avl_insert(shard->tree, key_copy, metric);
   if (status != 0) {
     ERROR("statsd plugin: c_avl_insert failed.");
     sfree(key_copy);
@@ -143,24 +181,23 @@ static statsd_metric_t *statsd_metric_lookup_unsafe(char const *name, /* {{{ */
   }
 
   return metric;
-} /* }}} statsd_metric_lookup_unsafe */
+} /* }}} statsd_metric_lookup */
 
 static int statsd_metric_set(char const *name, double value, /* {{{ */
                              metric_type_t type) {
   statsd_metric_t *metric;
+  statsd_shard_t *shard;
 
-  pthread_mutex_lock(&metrics_lock);
-
-  metric = statsd_metric_lookup_unsafe(name, type);
+  metric = statsd_metric_lookup(name, type, &shard);
   if (metric == NULL) {
-    pthread_mutex_unlock(&metrics_lock);
+    pthread_mutex_unlock(&shard->lock);
     return -1;
   }
 
   metric->value = value;
   metric->updates_num++;
 
-  pthread_mutex_unlock(&metrics_lock);
+  pthread_mutex_unlock(&shard->lock);
 
   return 0;
 } /* }}} int statsd_metric_set */
@@ -168,19 +205,18 @@ static int statsd_metric_set(char const *name, double value, /* {{{ */
 static int statsd_metric_add(char const *name, double delta, /* {{{ */
                              metric_type_t type) {
   statsd_metric_t *metric;
+  statsd_shard_t *shard;
 
-  pthread_mutex_lock(&metrics_lock);
-
-  metric = statsd_metric_lookup_unsafe(name, type);
+  metric = statsd_metric_lookup(name, type, &shard);
   if (metric == NULL) {
-    pthread_mutex_unlock(&metrics_lock);
+    pthread_mutex_unlock(&shard->lock);
     return -1;
   }
 
   metric->value += delta;
   metric->updates_num++;
 
-  pthread_mutex_unlock(&metrics_lock);
+  pthread_mutex_unlock(&shard->lock);
 
   return 0;
 } /* }}} int statsd_metric_add */
@@ -271,6 +307,7 @@ static int statsd_handle_gauge(char const *name, /* {{{ */
 static int statsd_handle_timer(char const *name, /* {{{ */
                                char const *value_str, char const *extra) {
   statsd_metric_t *metric;
+  statsd_shard_t *shard;
   value_t value_ms;
   value_t scale;
   cdtime_t value;
@@ -296,39 +333,37 @@ static int statsd_handle_timer(char const *name, /* {{{ */
 
   value = MS_TO_CDTIME_T(value_ms.gauge / scale.gauge);
 
-  pthread_mutex_lock(&metrics_lock);
-
-  metric = statsd_metric_lookup_unsafe(name, STATSD_TIMER);
+  metric = statsd_metric_lookup(name, STATSD_TIMER, &shard);
   if (metric == NULL) {
-    pthread_mutex_unlock(&metrics_lock);
+    pthread_mutex_unlock(&shard->lock);
     return -1;
   }
 
   if (metric->latency == NULL)
-    metric->latency = latency_counter_create();
+    metric->latency = conf_timer_sketch ? latency_counter_create_sketch()
+                                        : latency_counter_create();
   if (metric->latency == NULL) {
-    pthread_mutex_unlock(&metrics_lock);
+    pthread_mutex_unlock(&shard->lock);
     return -1;
   }
 
   latency_counter_add(metric->latency, value);
   metric->updates_num++;
 
-  pthread_mutex_unlock(&metrics_lock);
+  pthread_mutex_unlock(&shard->lock);
   return 0;
 } /* }}} int statsd_handle_timer */
 
 static int statsd_handle_set(char const *name, /* {{{ */
                              char const *set_key_orig) {
   statsd_metric_t *metric = NULL;
+  statsd_shard_t *shard;
   char *set_key;
   int status;
 
-  pthread_mutex_lock(&metrics_lock);
-
-  metric = statsd_metric_lookup_unsafe(name, STATSD_SET);
+  metric = statsd_metric_lookup(name, STATSD_SET, &shard);
   if (metric == NULL) {
-    pthread_mutex_unlock(&metrics_lock);
+    pthread_mutex_unlock(&shard->lock);
     return -1;
   }
 
@@ -337,21 +372,21 @@ static int statsd_handle_set(char const *name, /* {{{ */
     metric->set = c_avl_create((int (*)(const void *, const void *))strcmp);
 
   if (metric->set == NULL) {
-    pthread_mutex_unlock(&metrics_lock);
+    pthread_mutex_unlock(&shard->lock);
     ERROR("statsd plugin: c_avl_create failed.");
     return -1;
   }
 
   set_key = strdup(set_key_orig);
   if (set_key == NULL) {
-    pthread_mutex_unlock(&metrics_lock);
+    pthread_mutex_unlock(&shard->lock);
     ERROR("statsd plugin: strdup failed.");
     return -1;
   }
 
   status = c_avl_insert(metric->set, set_key, /* value = */ NULL);
   if (status < 0) {
-    pthread_mutex_unlock(&metrics_lock);
+    pthread_mutex_unlock(&shard->lock);
     if (status < 0)
       ERROR("statsd plugin: c_avl_insert (\"%s\") failed with status %i.",
             set_key, status);
@@ -364,7 +399,7 @@ static int statsd_handle_set(char const *name, /* {{{ */
 
   metric->updates_num++;
 
-  pthread_mutex_unlock(&metrics_lock);
+  pthread_mutex_unlock(&shard->lock);
   return 0;
 } /* }}} int statsd_handle_set */
 
@@ -438,33 +473,126 @@ static void statsd_parse_buffer(char *buffer) /* {{{ */
   }
 } /* }}} void statsd_parse_buffer */
 
-static void statsd_network_read(int fd) /* {{{ */
+/* Receives and parses datagrams until the socket has no more data. "buffers"
+ * holds STATSD_RECEIVE_BATCH buffers of STATSD_BUFFER_SIZE bytes. */
+static void statsd_network_read(rcvbuf_t *rb, char *buffers) /* {{{ */
 {
-  char buffer[4096];
-  size_t buffer_size;
+  int fd = rb->fd;
+  uint64_t drops = rb->drops;
+
+#if HAVE_RECVMMSG
+  struct mmsghdr msgs[STATSD_RECEIVE_BATCH];
+  struct iovec iovs[STATSD_RECEIVE_BATCH];
+  char control[STATSD_RECEIVE_BATCH][RCVBUF_CONTROL_SIZE];
+  int status;
+
+  do {
+    memset(msgs, 0, sizeof(msgs));
+    for (size_t i = 0; i < STATSD_RECEIVE_BATCH; i++) {
+      /* Leave room for the terminating null byte. */
+      iovs[i].iov_base = buffers + i * STATSD_BUFFER_SIZE;
+      iovs[i].iov_len = STATSD_BUFFER_SIZE - 1;
+      msgs[i].msg_hdr.msg_iov = iovs + i;
+      msgs[i].msg_hdr.msg_iovlen = 1;
+      msgs[i].msg_hdr.msg_control = control[i];
+      msgs[i].msg_hdr.msg_controllen = sizeof(control[i]);
+    }
+
+    status = recvmmsg(fd, msgs, STATSD_RECEIVE_BATCH, MSG_DONTWAIT,
+                      /* timeout = */ NULL);
+    if (status < 0) {
+      if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR))
+        ERROR("statsd plugin: recvmmsg(2) failed: %s", STRERRNO);
+      break;
+    }
+
+    for (int i = 0; i < status; i++) {
+      char *buffer = buffers + i * STATSD_BUFFER_SIZE;
+      buffer[msgs[i].msg_len] = 0;
+      statsd_parse_buffer(buffer);
+    }
+
+    /* The drop counter is cumulative, the last datagram has the latest. */
+    if (status > 0)
+      rcvbuf_update(rb, &msgs[status - 1].msg_hdr);
+    /* A full batch suggests that more datagrams are waiting. */
+  } while (status == STATSD_RECEIVE_BATCH);
+#else
+  char control[RCVBUF_CONTROL_SIZE];
+  struct iovec iov = {.iov_base = buffers, .iov_len = STATSD_BUFFER_SIZE - 1};
+  struct msghdr msg = {.msg_iov = &iov,
+                       .msg_iovlen = 1,
+                       .msg_control = control,
+                       .msg_controllen = sizeof(control)};
   ssize_t status;
 
-  status = recv(fd, buffer, sizeof(buffer), /* flags = */ MSG_DONTWAIT);
+  status = recvmsg(fd, &msg, /* flags = */ MSG_DONTWAIT);
   if (status < 0) {
 
     if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
       return;
 
-    ERROR("statsd plugin: recv(2) failed: %s", STRERRNO);
+    ERROR("statsd plugin: recvmsg(2) failed: %s", STRERRNO);
     return;
   }
 
-  buffer_size = (size_t)status;
-  if (buffer_size >= sizeof(buffer))
-    buffer_size = sizeof(buffer) - 1;
-  buffer[buffer_size] = 0;
+  buffers[status] = 0;
+  statsd_parse_buffer(buffers);
+  rcvbuf_update(rb, &msg);
+#endif
 
-  statsd_parse_buffer(buffer);
+  if (rb->drops != drops) {
+    __atomic_fetch_add(&network_drops, rb->drops - drops, __ATOMIC_RELAXED);
+    rcvbuf_tune(rb);
+  }
 } /* }}} void statsd_network_read */
 
+static int statsd_network_bind(struct addrinfo const *ai_ptr, /* {{{ */
+                               _Bool reuse_port) {
+  char dbg_node[NI_MAXHOST];
+  char dbg_service[NI_MAXSERV];
+  int status;
+
+  int fd = socket(ai_ptr->ai_family, ai_ptr->ai_socktype, ai_ptr->ai_protocol);
+  if (fd < 0) {
+    ERROR("statsd plugin: socket(2) failed: %s", STRERRNO);
+    return -1;
+  }
+
+  getnameinfo(ai_ptr->ai_addr, ai_ptr->ai_addrlen, dbg_node, sizeof(dbg_node),
+              dbg_service, sizeof(dbg_service),
+              NI_DGRAM | NI_NUMERICHOST | NI_NUMERICSERV);
+  DEBUG("statsd plugin: Trying to bind to [%s]:%s ...", dbg_node, dbg_service);
+
+#ifdef SO_REUSEPORT
+  /* Each receive thread binds its own socket to the address; the kernel
+   * distributes the datagrams among them. */
+  if (reuse_port) {
+    int one = 1;
+    status = setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+    if (status != 0) {
+      ERROR("statsd plugin: setsockopt(SO_REUSEPORT) failed: %s", STRERRNO);
+      close(fd);
+      return -1;
+    }
+  }
+#endif
+
+  status = bind(fd, ai_ptr->ai_addr, ai_ptr->ai_addrlen);
+  if (status != 0) {
+    ERROR("statsd plugin: bind(2) failed: %s", STRERRNO);
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+} /* }}} int statsd_network_bind */
+
 static int statsd_network_init(struct pollfd **ret_fds, /* {{{ */
-                               size_t *ret_fds_num) {
+                               rcvbuf_t **ret_rbs, size_t *ret_fds_num,
+                               _Bool reuse_port, size_t index) {
   struct pollfd *fds = NULL;
+  rcvbuf_t *rbs = NULL;
   size_t fds_num = 0;
 
   struct addrinfo *ai_list;
@@ -490,26 +618,22 @@ static int statsd_network_init(struct pollfd **ret_fds, /* {{{ */
     int fd;
     struct pollfd *tmp;
 
-    char dbg_node[NI_MAXHOST];
-    char dbg_service[NI_MAXSERV];
+    /* Under collectdmon(1) the socket may have been kept open while the
+     * daemon restarted. In that case it is bound already. */
+    char fd_name[FDSTORE_NAME_MAX] = "";
+    if (fdstore_enabled() &&
+        (fdstore_socket_name(fd_name, sizeof(fd_name), "statsd", ai_ptr,
+                             index) != 0))
+      fd_name[0] = 0;
 
-    fd = socket(ai_ptr->ai_family, ai_ptr->ai_socktype, ai_ptr->ai_protocol);
+    fd = (fd_name[0] != 0) ? fdstore_get(fd_name) : -1;
     if (fd < 0) {
-      ERROR("statsd plugin: socket(2) failed: %s", STRERRNO);
-      continue;
-    }
-
-    getnameinfo(ai_ptr->ai_addr, ai_ptr->ai_addrlen, dbg_node, sizeof(dbg_node),
-                dbg_service, sizeof(dbg_service),
-                NI_DGRAM | NI_NUMERICHOST | NI_NUMERICSERV);
-    DEBUG("statsd plugin: Trying to bind to [%s]:%s ...", dbg_node,
-          dbg_service);
+      fd = statsd_network_bind(ai_ptr, reuse_port);
+      if (fd < 0)
+        continue;
 
-    status = bind(fd, ai_ptr->ai_addr, ai_ptr->ai_addrlen);
-    if (status != 0) {
-      ERROR("statsd plugin: bind(2) failed: %s", STRERRNO);
-      close(fd);
-      continue;
+      if (fd_name[0] != 0)
+        fdstore_put(fd_name, fd);
     }
 
     tmp = realloc(fds, sizeof(*fds) * (fds_num + 1));
@@ -519,12 +643,24 @@ static int statsd_network_init(struct pollfd **ret_fds, /* {{{ */
       continue;
     }
     fds = tmp;
-    tmp = fds + fds_num;
-    fds_num++;
 
+    rcvbuf_t *rb = realloc(rbs, sizeof(*rbs) * (fds_num + 1));
+    if (rb == NULL) {
+      ERROR("statsd plugin: realloc failed.");
+      close(fd);
+      continue;
+    }
+    rbs = rb;
+
+    tmp = fds + fds_num;
     memset(tmp, 0, sizeof(*tmp));
     tmp->fd = fd;
     tmp->events = POLLIN | POLLPRI;
+
+    if (rcvbuf_init(rbs + fds_num, fd, conf_receive_buffer,
+                    conf_receive_buffer_auto, "statsd") == 0)
+      network_drops_enabled = 1;
+    fds_num++;
   }
 
   freeaddrinfo(ai_list);
@@ -532,10 +668,13 @@ static int statsd_network_init(struct pollfd **ret_fds, /* {{{ */
   if (fds_num == 0) {
     ERROR("statsd plugin: Unable to create listening socket for [%s]:%s.",
           (node != NULL) ? node : "::", service);
+    sfree(fds);
+    sfree(rbs);
     return ENOENT;
   }
 
   *ret_fds = fds;
+  *ret_rbs = rbs;
   *ret_fds_num = fds_num;
   return 0;
 } /* }}} int statsd_network_init */
@@ -543,15 +682,28 @@ static int statsd_network_init(struct pollfd **ret_fds, /* {{{ */
 static void *statsd_network_thread(void *args) /* {{{ */
 {
   struct pollfd *fds = NULL;
+  rcvbuf_t *rbs = NULL;
   size_t fds_num = 0;
+  char *buffers;
   int status;
 
-  status = statsd_network_init(&fds, &fds_num);
+  status = statsd_network_init(&fds, &rbs, &fds_num, network_threads_num > 1,
+                               (size_t)(uintptr_t)args);
   if (status != 0) {
     ERROR("statsd plugin: Unable to open listening sockets.");
     pthread_exit((void *)0);
   }
 
+  buffers = malloc(STATSD_RECEIVE_BATCH * STATSD_BUFFER_SIZE);
+  if (buffers == NULL) {
+    ERROR("statsd plugin: malloc failed.");
+    for (size_t i = 0; i < fds_num; i++)
+      close(fds[i].fd);
+    sfree(fds);
+    sfree(rbs);
+    pthread_exit((void *)0);
+  }
+
   while (!network_thread_shutdown) {
     status = poll(fds, (nfds_t)fds_num, /* timeout = */ -1);
     if (status < 0) {
@@ -567,7 +719,7 @@ static void *statsd_network_thread(void *args) /* {{{ */
       if ((fds[i].revents & (POLLIN | POLLPRI)) == 0)
         continue;
 
-      statsd_network_read(fds[i].fd);
+      statsd_network_read(rbs + i, buffers);
       fds[i].revents = 0;
     }
   } /* while (!network_thread_shutdown) */
@@ -576,6 +728,8 @@ static void *statsd_network_thread(void *args) /* {{{ */
   for (size_t i = 0; i < fds_num; i++)
     close(fds[i].fd);
   sfree(fds);
+  sfree(rbs);
+  sfree(buffers);
 
   return (void *)0;
 } /* }}} void *statsd_network_thread */
@@ -611,6 +765,30 @@ static int statsd_config_timer_percentile(oconfig_item_t *ci) /* {{{ */
   return 0;
 } /* }}} int statsd_config_timer_percentile */
 
+static int statsd_config_timer_histogram(oconfig_item_t *ci) /* {{{ */
+{
+  char *histogram = NULL;
+  int status;
+
+  status = cf_util_get_string(ci, &histogram);
+  if (status != 0)
+    return status;
+
+  if (strcasecmp("Linear", histogram) == 0)
+    conf_timer_sketch = 0;
+  else if (strcasecmp("LogLinear", histogram) == 0)
+    conf_timer_sketch = 1;
+  else {
+    ERROR("statsd plugin: Invalid argument for \"%s\": \"%s\". Valid "
+          "arguments are \"Linear\" and \"LogLinear\".",
+          ci->key, histogram);
+    status = EINVAL;
+  }
+
+  sfree(histogram);
+  return status;
+} /* }}} int statsd_config_timer_histogram */
+
 static int statsd_config(oconfig_item_t *ci) /* {{{ */
 {
   for (int i = 0; i < ci->children_num; i++) {
@@ -620,6 +798,19 @@ static int statsd_config(oconfig_item_t *ci) /* {{{ */
       cf_util_get_string(child, &conf_node);
     else if (strcasecmp("Port", child->key) == 0)
       cf_util_get_service(child, &conf_service);
+    else if (strcasecmp("ReceiveThreads", child->key) == 0) {
+      int tmp = 0;
+      if ((cf_util_get_int(child, &tmp) != 0) || (tmp < 1))
+        ERROR("statsd plugin: The \"%s\" option requires a positive "
+              "integer.",
+              child->key);
+      else
+        conf_receive_threads = tmp;
+    }
+    else if (strcasecmp("ReceiveBufferSize", child->key) == 0)
+      cf_util_get_int(child, &conf_receive_buffer);
+    else if (strcasecmp("ReceiveBufferAutoTune", child->key) == 0)
+      cf_util_get_boolean(child, &conf_receive_buffer_auto);
     else if (strcasecmp("DeleteCounters", child->key) == 0)
       cf_util_get_boolean(child, &conf_delete_counters);
     else if (strcasecmp("DeleteTimers", child->key) == 0)
@@ -640,6 +831,8 @@ static int statsd_config(oconfig_item_t *ci) /* {{{ */
       cf_util_get_boolean(child, &conf_timer_count);
     else if (strcasecmp("TimerPercentile", child->key) == 0)
       statsd_config_timer_percentile(child);
+    else if (strcasecmp("TimerHistogram", child->key) == 0)
+      statsd_config_timer_histogram(child);
     else
       ERROR("statsd plugin: The \"%s\" config option is not valid.",
             child->key);
@@ -650,30 +843,60 @@ static int statsd_config(oconfig_item_t *ci) /* {{{ */
 
 static int statsd_init(void) /* {{{ */
 {
-  pthread_mutex_lock(&metrics_lock);
-  if (metrics_tree == NULL)
-    metrics_tree = c_avl_create((int (*)(const void *, const void *))strcmp);
+  if (!metrics_initialized) {
+    for (size_t i = 0; i < STATSD_SHARDS_NUM; i++) {
+      pthread_mutex_init(&metrics_shards[i].lock, /* attr = */ NULL);
+      metrics_shards[i].tree =
+          c_avl_create((int (*)(const void *, const void *))strcmp);
+      if (metrics_shards[i].tree == NULL) {
+        ERROR("statsd plugin: c_avl_create failed.");
+        return -1;
+      }
+    }
+    metrics_initialized = 1;
+  }
 
-  if (!network_thread_running) {
-    int status;
+  if (network_threads_num == 0) {
+    size_t threads_num = (size_t)conf_receive_threads;
+#ifndef SO_REUSEPORT
+    if (threads_num > 1) {
+      WARNING("statsd plugin: SO_REUSEPORT is not supported on this system, "
+              "using a single receive thread.");
+      threads_num = 1;
+    }
+#endif
 
-    status = pthread_create(&network_thread,
-                            /* attr = */ NULL, statsd_network_thread,
-                            /* args = */ NULL);
-    if (status != 0) {
-      pthread_mutex_unlock(&metrics_lock);
-      ERROR("statsd plugin: pthread_create failed: %s", STRERRNO);
-      return status;
+    network_threads = calloc(threads_num, sizeof(*network_threads));
+    if (network_threads == NULL) {
+      ERROR("statsd plugin: calloc failed.");
+      return -1;
+    }
+
+    /* The threads check network_threads_num to decide whether to share the
+     * port, so it's set before they are started. */
+    network_threads_num = threads_num;
+    for (size_t i = 0; i < threads_num; i++) {
+      int status = plugin_thread_create(&network_threads[i], /* attr = */ NULL,
+                                        statsd_network_thread,
+                                        /* args = */ (void *)(uintptr_t)i,
+                                        "statsd recv");
+      if (status != 0) {
+        ERROR("statsd plugin: pthread_create failed: %s", STRERROR(status));
+        network_threads_num = i;
+        break;
+      }
     }
-  }
-  network_thread_running = 1;
 
-  pthread_mutex_unlock(&metrics_lock);
+    if (network_threads_num == 0) {
+      sfree(network_threads);
+      return -1;
+    }
+  }
 
   return 0;
 } /* }}} int statsd_init */
 
-/* Must hold metrics_lock when calling this function. */
+/* Must hold the metric's shard lock when calling this function. */
 static int statsd_metric_clear_set_unsafe(statsd_metric_t *metric) /* {{{ */
 {
   void *key;
@@ -693,7 +916,7 @@ static int statsd_metric_clear_set_unsafe(statsd_metric_t *metric) /* {{{ */
   return 0;
 } /* }}} int statsd_metric_clear_set_unsafe */
 
-/* Must hold metrics_lock when calling this function. */
+/* Must hold the metric's shard lock when calling this function. */
 static int statsd_metric_submit_unsafe(char const *name,
                                        statsd_metric_t *metric) /* {{{ */
 {
@@ -809,7 +1032,8 @@ static int statsd_metric_submit_unsafe(char const *name,
   return plugin_dispatch_values(&vl);
 } /* }}} int statsd_metric_submit_unsafe */
 
-static int statsd_read(void) /* {{{ */
+/* Submits and resets the metrics of one shard, holding only its lock. */
+static void statsd_shard_read(statsd_shard_t *shard) /* {{{ */
 {
   c_avl_iterator_t *iter;
   char *name;
@@ -818,14 +1042,9 @@ static int statsd_read(void) /* {{{ */
   char **to_be_deleted = NULL;
   size_t to_be_deleted_num = 0;
 
-  pthread_mutex_lock(&metrics_lock);
-
-  if (metrics_tree == NULL) {
-    pthread_mutex_unlock(&metrics_lock);
-    return 0;
-  }
+  pthread_mutex_lock(&shard->lock);
 
-  iter = c_avl_get_iterator(metrics_tree);
+  iter = c_avl_get_iterator(shard->tree);
   while (c_avl_iterator_next(iter, (void *)&name, (void *)&metric) == 0) {
     if ((metric->updates_num == 0) &&
         ((conf_delete_counters && (metric->type == STATSD_COUNTER)) ||
@@ -851,7 +1070,7 @@ static int statsd_read(void) /* {{{ */
   for (size_t i = 0; i < to_be_deleted_num; i++) {
     int status;
 
-    status = c_avl_remove(metrics_tree, to_be_deleted[i], (void *)&name,
+    status = c_avl_remove(shard->tree, to_be_deleted[i], (void *)&name,
                           (void *)&metric);
     if (status != 0) {
       ERROR("stats plugin: c_avl_remove (\"%s\") failed with status %i.",
@@ -863,9 +1082,30 @@ static int statsd_read(void) /* {{{ */
     statsd_metric_free(metric);
   }
 
-  pthread_mutex_unlock(&metrics_lock);
+  pthread_mutex_unlock(&shard->lock);
 
   strarray_free(to_be_deleted, to_be_deleted_num);
+} /* }}} void statsd_shard_read */
+
+static int statsd_read(void) /* {{{ */
+{
+  if (!metrics_initialized)
+    return 0;
+
+  for (size_t i = 0; i < STATSD_SHARDS_NUM; i++)
+    statsd_shard_read(&metrics_shards[i]);
+
+  if (network_drops_enabled) {
+    value_list_t vl = VALUE_LIST_INIT;
+    value_t v = {
+        .derive = (derive_t)__atomic_load_n(&network_drops, __ATOMIC_RELAXED)};
+
+    vl.values = &v;
+    vl.values_len = 1;
+    sstrncpy(vl.plugin, "statsd", sizeof(vl.plugin));
+    sstrncpy(vl.type, "if_rx_dropped", sizeof(vl.type));
+    plugin_dispatch_values(&vl);
+  }
 
   return 0;
 } /* }}} int statsd_read */
@@ -875,27 +1115,34 @@ static int statsd_shutdown(void) /* {{{ */
   void *key;
   void *value;
 
-  if (network_thread_running) {
-    network_thread_shutdown = 1;
-    pthread_kill(network_thread, SIGTERM);
-    pthread_join(network_thread, /* retval = */ NULL);
-  }
-  network_thread_running = 0;
-
-  pthread_mutex_lock(&metrics_lock);
-
-  while (c_avl_pick(metrics_tree, &key, &value) == 0) {
-    sfree(key);
-    statsd_metric_free(value);
+  network_thread_shutdown = 1;
+  for (size_t i = 0; i < network_threads_num; i++)
+    pthread_kill(network_threads[i], SIGTERM);
+  for (size_t i = 0; i < network_threads_num; i++)
+    pthread_join(network_threads[i], /* retval = */ NULL);
+  sfree(network_threads);
+  network_threads_num = 0;
+
+  if (metrics_initialized) {
+    for (size_t i = 0; i < STATSD_SHARDS_NUM; i++) {
+      statsd_shard_t *shard = &metrics_shards[i];
+
+      pthread_mutex_lock(&shard->lock);
+      while (c_avl_pick(shard->tree, &key, &value) == 0) {
+        sfree(key);
+        statsd_metric_free(value);
+      }
+      c_avl_destroy(shard->tree);
+      shard->tree = NULL;
+      pthread_mutex_unlock(&shard->lock);
+      pthread_mutex_destroy(&shard->lock);
+    }
+    metrics_initialized = 0;
   }
-  c_avl_destroy(metrics_tree);
-  metrics_tree = NULL;
 
   sfree(conf_node);
   sfree(conf_service);
 
-  pthread_mutex_unlock(&metrics_lock);
-
   return 0;
 } /* }}} int statsd_shutdown */
 
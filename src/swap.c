@@ -40,6 +40,10 @@
 #include "common.h"
 #include "plugin.h"
 
+#if KERNEL_LINUX
+#include "utils_procfs.h"
+#endif
+
 #if HAVE_SYS_SWAP_H
 #include <sys/swap.h>
 #endif
@@ -190,13 +194,16 @@ static int swap_init(void) /* {{{ */
   return 0;
 } /* }}} int swap_init */
 
-static void swap_submit_usage(char const *plugin_instance, /* {{{ */
-                              gauge_t used, gauge_t free,
-                              char const *other_name, gauge_t other_value) {
+/* A "time" of zero means the current time. */
+static void swap_submit_usage(cdtime_t time, /* {{{ */
+                              char const *plugin_instance, gauge_t used,
+                              gauge_t free, char const *other_name,
+                              gauge_t other_value) {
   value_list_t vl = VALUE_LIST_INIT;
 
   vl.values = &(value_t){.gauge = NAN};
   vl.values_len = 1;
+  vl.time = time;
   sstrncpy(vl.plugin, "swap", sizeof(vl.plugin));
   if (plugin_instance != NULL)
     sstrncpy(vl.plugin_instance, plugin_instance, sizeof(vl.plugin_instance));
@@ -211,13 +218,14 @@ static void swap_submit_usage(char const *plugin_instance, /* {{{ */
 } /* }}} void swap_submit_usage */
 
 #if KERNEL_LINUX || HAVE_PERFSTAT
-__attribute__((nonnull(1))) static void
-swap_submit_derive(char const *type_instance, /* {{{ */
+__attribute__((nonnull(2))) static void
+swap_submit_derive(cdtime_t time, char const *type_instance, /* {{{ */
                    derive_t value) {
   value_list_t vl = VALUE_LIST_INIT;
 
   vl.values = &(value_t){.derive = value};
   vl.values_len = 1;
+  vl.time = time;
   sstrncpy(vl.plugin, "swap", sizeof(vl.plugin));
   sstrncpy(vl.type, "swap_io", sizeof(vl.type));
   sstrncpy(vl.type_instance, type_instance, sizeof(vl.type_instance));
@@ -269,7 +277,8 @@ static int swap_read_separate(void) /* {{{ */
     if (total < used)
       continue;
 
-    swap_submit_usage(path, used * 1024.0, (total - used) * 1024.0, NULL, NAN);
+    swap_submit_usage(0, path, used * 1024.0, (total - used) * 1024.0, NULL,
+                      NAN);
   }
 
   fclose(fh);
@@ -279,37 +288,29 @@ static int swap_read_separate(void) /* {{{ */
 
 static int swap_read_combined(void) /* {{{ */
 {
-  FILE *fh;
-  char buffer[1024];
+  procfs_snapshot_t *s;
+  procfs_entry_t const *e;
 
   gauge_t swap_used = NAN;
   gauge_t swap_cached = NAN;
   gauge_t swap_free = NAN;
   gauge_t swap_total = NAN;
 
-  fh = fopen("/proc/meminfo", "r");
-  if (fh == NULL) {
-    WARNING("swap plugin: fopen (/proc/meminfo) failed: %s", STRERRNO);
+  s = procfs_snapshot_acquire("/proc/meminfo");
+  if (s == NULL) {
+    WARNING("swap plugin: Reading /proc/meminfo failed: %s", STRERRNO);
     return -1;
   }
 
-  while (fgets(buffer, sizeof(buffer), fh) != NULL) {
-    char *fields[8];
-    int numfields;
-
-    numfields = strsplit(buffer, fields, STATIC_ARRAY_SIZE(fields));
-    if (numfields < 2)
-      continue;
+  if ((e = procfs_snapshot_lookup(s, "SwapTotal")) != NULL)
+    swap_total = (gauge_t)e->value;
+  if ((e = procfs_snapshot_lookup(s, "SwapFree")) != NULL)
+    swap_free = (gauge_t)e->value;
+  if ((e = procfs_snapshot_lookup(s, "SwapCached")) != NULL)
+    swap_cached = (gauge_t)e->value;
 
-    if (strcasecmp(fields[0], "SwapTotal:") == 0)
-      strtogauge(fields[1], &swap_total);
-    else if (strcasecmp(fields[0], "SwapFree:") == 0)
-      strtogauge(fields[1], &swap_free);
-    else if (strcasecmp(fields[0], "SwapCached:") == 0)
-      strtogauge(fields[1], &swap_cached);
-  }
-
-  fclose(fh);
+  cdtime_t time = procfs_snapshot_time(s);
+  procfs_snapshot_release(s);
 
   if (isnan(swap_total) || isnan(swap_free))
     return ENOENT;
@@ -324,7 +325,7 @@ static int swap_read_combined(void) /* {{{ */
   if (swap_used < 0.0)
     return EINVAL;
 
-  swap_submit_usage(NULL, swap_used * 1024.0, swap_free * 1024.0,
+  swap_submit_usage(time, NULL, swap_used * 1024.0, swap_free * 1024.0,
                     isnan(swap_cached) ? NULL : "cached",
                     isnan(swap_cached) ? NAN : swap_cached * 1024.0);
   return 0;
@@ -332,67 +333,35 @@ static int swap_read_combined(void) /* {{{ */
 
 static int swap_read_io(void) /* {{{ */
 {
-  FILE *fh;
-  char buffer[1024];
+  procfs_snapshot_t *s;
+  procfs_entry_t const *in;
+  procfs_entry_t const *out;
 
-  _Bool old_kernel = 0;
-
-  uint8_t have_data = 0;
-  derive_t swap_in = 0;
-  derive_t swap_out = 0;
-
-  fh = fopen("/proc/vmstat", "r");
-  if (fh == NULL) {
-    /* /proc/vmstat does not exist in kernels <2.6 */
-    fh = fopen("/proc/stat", "r");
-    if (fh == NULL) {
-      WARNING("swap: fopen: %s", STRERRNO);
-      return -1;
-    } else
-      old_kernel = 1;
+  s = procfs_snapshot_acquire("/proc/vmstat");
+  if (s == NULL) {
+    WARNING("swap plugin: Reading /proc/vmstat failed: %s", STRERRNO);
+    return -1;
   }
 
-  while (fgets(buffer, sizeof(buffer), fh) != NULL) {
-    char *fields[8];
-    int numfields;
-
-    numfields = strsplit(buffer, fields, STATIC_ARRAY_SIZE(fields));
-
-    if (!old_kernel) {
-      if (numfields != 2)
-        continue;
-
-      if (strcasecmp("pswpin", fields[0]) == 0) {
-        strtoderive(fields[1], &swap_in);
-        have_data |= 0x01;
-      } else if (strcasecmp("pswpout", fields[0]) == 0) {
-        strtoderive(fields[1], &swap_out);
-        have_data |= 0x02;
-      }
-    } else /* if (old_kernel) */
-    {
-      if (numfields != 3)
-        continue;
-
-      if (strcasecmp("page", fields[0]) == 0) {
-        strtoderive(fields[1], &swap_in);
-        strtoderive(fields[2], &swap_out);
-      }
-    }
-  } /* while (fgets) */
-
-  fclose(fh);
-
-  if (have_data != 0x03)
+  in = procfs_snapshot_lookup(s, "pswpin");
+  out = procfs_snapshot_lookup(s, "pswpout");
+  if ((in == NULL) || (out == NULL)) {
+    procfs_snapshot_release(s);
     return ENOENT;
+  }
+
+  derive_t swap_in = (derive_t)in->value;
+  derive_t swap_out = (derive_t)out->value;
+  cdtime_t time = procfs_snapshot_time(s);
+  procfs_snapshot_release(s);
 
   if (report_bytes) {
     swap_in = swap_in * pagesize;
     swap_out = swap_out * pagesize;
   }
 
-  swap_submit_derive("in", swap_in);
-  swap_submit_derive("out", swap_out);
+  swap_submit_derive(time, "in", swap_in);
+  swap_submit_derive(time, "out", swap_out);
 
   return 0;
 } /* }}} int swap_read_io */
@@ -460,7 +429,7 @@ static int swap_read_kstat(void) /* {{{ */
   swap_resv = (gauge_t)((ai.ani_resv + ai.ani_free - ai.ani_max) * pagesize);
   swap_avail = (gauge_t)((ai.ani_max - ai.ani_resv) * pagesize);
 
-  swap_submit_usage(NULL, swap_alloc, swap_avail, "reserved", swap_resv);
+  swap_submit_usage(0, NULL, swap_alloc, swap_avail, "reserved", swap_resv);
   return 0;
 } /* }}} int swap_read_kstat */
   /* #endif 0 && HAVE_LIBKSTAT */
@@ -544,7 +513,8 @@ static int swap_read(void) /* {{{ */
     sstrncpy(path, s->swt_ent[i].ste_path, sizeof(path));
     escape_slashes(path, sizeof(path));
 
-    swap_submit_usage(path, this_total - this_avail, this_avail, NULL, NAN);
+    swap_submit_usage(0, path, this_total - this_avail, this_avail, NULL,
+                      NAN);
   } /* for (swap_num) */
 
   if (total < avail) {
@@ -559,7 +529,7 @@ static int swap_read(void) /* {{{ */
   /* If the "separate" option was specified (report_by_device == 1), all
    * values have already been dispatched from within the loop. */
   if (!report_by_device)
-    swap_submit_usage(NULL, total - avail, avail, NULL, NAN);
+    swap_submit_usage(0, NULL, total - avail, avail, NULL, NAN);
 
   sfree(s_paths);
   sfree(s);
@@ -621,7 +591,7 @@ static int swap_read(void) /* {{{ */
     return -1;
   }
 
-  swap_submit_usage(NULL, used, total - used, NULL, NAN);
+  swap_submit_usage(0, NULL, used, total - used, NULL, NAN);
 
   sfree(swap_entries);
   return 0;
@@ -646,7 +616,7 @@ static int swap_read(void) /* {{{ */
     return -1;
 
   /* The returned values are bytes. */
-  swap_submit_usage(NULL, (gauge_t)sw_usage.xsu_used,
+  swap_submit_usage(0, NULL, (gauge_t)sw_usage.xsu_used,
                     (gauge_t)sw_usage.xsu_avail, NULL, NAN);
 
   return 0;
@@ -676,7 +646,7 @@ static int swap_read(void) /* {{{ */
   total *= (gauge_t)kvm_pagesize;
   used *= (gauge_t)kvm_pagesize;
 
-  swap_submit_usage(NULL, used, total - used, NULL, NAN);
+  swap_submit_usage(0, NULL, used, total - used, NULL, NAN);
 
   return 0;
 } /* }}} int swap_read */
@@ -691,7 +661,8 @@ static int swap_read(void) /* {{{ */
   if (swap == NULL)
     return -1;
 
-  swap_submit_usage(NULL, (gauge_t)swap->used, (gauge_t)swap->free, NULL, NAN);
+  swap_submit_usage(0, NULL, (gauge_t)swap->used, (gauge_t)swap->free, NULL,
+                    NAN);
 
   return 0;
 } /* }}} int swap_read */
@@ -718,11 +689,11 @@ static int swap_read(void) /* {{{ */
   free = (gauge_t)(pmemory.pgsp_free * pagesize);
   reserved = (gauge_t)(pmemory.pgsp_rsvd * pagesize);
 
-  swap_submit_usage(NULL, total - free, free, "reserved", reserved);
+  swap_submit_usage(0, NULL, total - free, free, "reserved", reserved);
 
   if (report_io) {
-    swap_submit_derive("in", (derive_t)pmemory.pgspins * pagesize);
-    swap_submit_derive("out", (derive_t)pmemory.pgspouts * pagesize);
+    swap_submit_derive(0, "in", (derive_t)pmemory.pgspins * pagesize);
+    swap_submit_derive(0, "out", (derive_t)pmemory.pgspouts * pagesize);
   }
 
   return 0;
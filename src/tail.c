@@ -95,6 +95,8 @@ static int ctail_config_add_match_dstype(ctail_config_match_t *cm,
     int status = latency_config(&cm->latency, ci, "tail");
     if (status != 0)
       return status;
+    if (cm->latency.sketch)
+      cm->flags |= UTILS_MATCH_CF_GAUGE_DIST_SKETCH;
   } else if (strncasecmp("Counter", ds_type, strlen("Counter")) == 0) {
     cm->flags = UTILS_MATCH_DS_TYPE_COUNTER;
     if (strcasecmp("CounterSet", ds_type) == 0)
@@ -33,6 +33,11 @@
 #include <sys/mman.h>
 #include <sys/stat.h>
 
+/* Maximum amount of the file mapped at once in `ReadMode MMap'. */
+#define TCSV_MMAP_WINDOW (64 * 1024 * 1024)
+/* Longest field that is extracted in `ReadMode MMap'. */
+#define TCSV_FIELD_SIZE 128
+
 struct metric_definition_s {
   char *name;
   char *type;
@@ -53,6 +58,16 @@ struct instance_definition_s {
   cdtime_t interval;
   ssize_t time_from;
   struct instance_definition_s *next;
+
+  /* `ReadMode MMap' state */
+  _Bool read_mmap;
+  int fd;
+  ino_t ino;
+  off_t offset;
+  size_t fields_max;      /* highest field index referenced, plus one */
+  _Bool *fields_used;     /* fields referenced by ValueFrom / TimeFrom */
+  char **fields;          /* fields of the current line, NULL if unused */
+  char (*fields_buf)[TCSV_FIELD_SIZE];
 };
 typedef struct instance_definition_s instance_definition_t;
 
@@ -206,10 +221,187 @@ static int tcsv_read_buffer(instance_definition_t *id, char *buffer,
   return 0;
 }
 
+static int tcsv_mmap_init(instance_definition_t *id) { /* {{{ */
+  size_t fields_max = 0;
+
+  if (id->time_from >= 0)
+    fields_max = (size_t)id->time_from + 1;
+  for (size_t i = 0; i < id->metric_list_len; i++)
+    if ((size_t)id->metric_list[i]->value_from + 1 > fields_max)
+      fields_max = (size_t)id->metric_list[i]->value_from + 1;
+
+  id->fields_used = calloc(fields_max, sizeof(*id->fields_used));
+  id->fields = calloc(fields_max, sizeof(*id->fields));
+  id->fields_buf = calloc(fields_max, sizeof(*id->fields_buf));
+  if ((id->fields_used == NULL) || (id->fields == NULL) ||
+      (id->fields_buf == NULL)) {
+    ERROR("tail_csv plugin: calloc failed.");
+    sfree(id->fields_used);
+    sfree(id->fields);
+    sfree(id->fields_buf);
+    return ENOMEM;
+  }
+
+  if (id->time_from >= 0)
+    id->fields_used[id->time_from] = 1;
+  for (size_t i = 0; i < id->metric_list_len; i++)
+    id->fields_used[id->metric_list[i]->value_from] = 1;
+
+  id->fields_max = fields_max;
+  return 0;
+} /* }}} int tcsv_mmap_init */
+
+/* Parses one line of a mapped file without modifying it. Only the fields
+ * referenced by the configured metrics are located and copied out; the rest
+ * of the line is skipped with memchr(). */
+static void tcsv_read_mapped_line(instance_definition_t *id, /* {{{ */
+                                  char const *line, size_t line_len) {
+  while ((line_len > 0) && (line[line_len - 1] == '\r'))
+    line_len--;
+
+  /* Ignore empty lines. */
+  if ((line_len == 0) || (line[0] == '#'))
+    return;
+
+  char const *end = line + line_len;
+  char const *ptr = line;
+  size_t fields_num = 0;
+
+  while ((fields_num < id->fields_max) && (ptr != NULL)) {
+    char const *sep = memchr(ptr, ',', (size_t)(end - ptr));
+    size_t len = (size_t)(((sep != NULL) ? sep : end) - ptr);
+
+    id->fields[fields_num] = NULL;
+    if (id->fields_used[fields_num]) {
+      char *buf = id->fields_buf[fields_num];
+      /* Overlong fields cannot be numbers; leave them empty so that parsing
+       * fails. */
+      if (len >= TCSV_FIELD_SIZE)
+        len = 0;
+      memcpy(buf, ptr, len);
+      buf[len] = 0;
+      id->fields[fields_num] = buf;
+    }
+
+    fields_num++;
+    ptr = (sep != NULL) ? sep + 1 : NULL;
+  }
+
+  if ((fields_num == 1) && (ptr == NULL)) {
+    ERROR("tail_csv plugin: last line of `%s' does not contain "
+          "enough values.",
+          id->path);
+    return;
+  }
+
+  for (size_t i = 0; i < id->metric_list_len; ++i) {
+    metric_definition_t *md = id->metric_list[i];
+
+    if (!tcsv_check_index(md->value_from, fields_num, md->name) ||
+        !tcsv_check_index(id->time_from, fields_num, md->name))
+      continue;
+
+    tcsv_read_metric(id, md, id->fields, fields_num);
+  }
+} /* }}} void tcsv_read_mapped_line */
+
+/* Opens the file on first use or after it has been rotated. Like utils_tail,
+ * a file seen for the first time is read from its end. */
+static int tcsv_mmap_reopen(instance_definition_t *id, /* {{{ */
+                            struct stat *ret_stat) {
+  if (stat(id->path, ret_stat) != 0) {
+    ERROR("tail_csv plugin: stat (%s) failed: %s", id->path, STRERRNO);
+    return -1;
+  }
+
+  if ((id->fd >= 0) && (ret_stat->st_ino == id->ino)) {
+    if (ret_stat->st_size < id->offset) {
+      INFO("tail_csv plugin: File `%s' was truncated.", id->path);
+      id->offset = 0;
+    }
+    return 0;
+  }
+
+  int fd = open(id->path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    ERROR("tail_csv plugin: open (%s) failed: %s", id->path, STRERRNO);
+    return -1;
+  }
+
+  /* Re-stat through the descriptor so size and inode match the opened file. */
+  if (fstat(fd, ret_stat) != 0) {
+    ERROR("tail_csv plugin: fstat (%s) failed: %s", id->path, STRERRNO);
+    close(fd);
+    return -1;
+  }
+
+  id->offset = (id->fd < 0 && id->ino == 0) ? ret_stat->st_size : 0;
+  if (id->fd >= 0)
+    close(id->fd);
+  id->fd = fd;
+  id->ino = ret_stat->st_ino;
+  return 0;
+} /* }}} int tcsv_mmap_reopen */
+
+static int tcsv_read_mmap(instance_definition_t *id) { /* {{{ */
+  struct stat statbuf;
+  off_t page_size = (off_t)sysconf(_SC_PAGESIZE);
+
+  if ((id->fields == NULL) && (tcsv_mmap_init(id) != 0))
+    return -1;
+
+  if (tcsv_mmap_reopen(id, &statbuf) != 0)
+    return -1;
+
+  while (id->offset < statbuf.st_size) {
+    off_t map_offset = id->offset - (id->offset % page_size);
+    size_t map_size = (size_t)(statbuf.st_size - map_offset);
+    if (map_size > TCSV_MMAP_WINDOW)
+      map_size = TCSV_MMAP_WINDOW;
+
+    char *map = mmap(NULL, map_size, PROT_READ, MAP_SHARED, id->fd, map_offset);
+    if (map == MAP_FAILED) {
+      ERROR("tail_csv plugin: mmap (%s) failed: %s", id->path, STRERRNO);
+      return -1;
+    }
+#if defined(MADV_SEQUENTIAL)
+    madvise(map, map_size, MADV_SEQUENTIAL);
+#endif
+
+    char const *ptr = map + (id->offset - map_offset);
+    char const *end = map + map_size;
+    while (ptr < end) {
+      char const *nl = memchr(ptr, '\n', (size_t)(end - ptr));
+      if (nl == NULL)
+        break;
+      tcsv_read_mapped_line(id, ptr, (size_t)(nl - ptr));
+      ptr = nl + 1;
+    }
+
+    off_t consumed = (off_t)(ptr - map) + map_offset - id->offset;
+    munmap(map, map_size);
+
+    if (consumed == 0) {
+      /* Incomplete last line: wait for the rest of it. A line that does not
+       * even fit into a full window is skipped. */
+      if (map_size < TCSV_MMAP_WINDOW)
+        break;
+      ERROR("tail_csv plugin: File `%s': skipping overlong line.", id->path);
+      consumed = (off_t)map_size - (id->offset - map_offset);
+    }
+    id->offset += consumed;
+  }
+
+  return 0;
+} /* }}} int tcsv_read_mmap */
+
 static int tcsv_read(user_data_t *ud) {
   instance_definition_t *id;
   id = ud->data;
 
+  if (id->read_mmap)
+    return tcsv_read_mmap(id);
+
   if (id->tail == NULL) {
     id->tail = cu_tail_create(id->path);
     if (id->tail == NULL) {
@@ -360,6 +552,12 @@ static void tcsv_instance_definition_destroy(void *arg) {
     cu_tail_destroy(id->tail);
   id->tail = NULL;
 
+  if (id->fd >= 0)
+    close(id->fd);
+  sfree(id->fields_used);
+  sfree(id->fields);
+  sfree(id->fields_buf);
+
   sfree(id->plugin_name);
   sfree(id->instance);
   sfree(id->path);
@@ -367,6 +565,28 @@ static void tcsv_instance_definition_destroy(void *arg) {
   sfree(id);
 }
 
+static int tcsv_config_get_read_mode(oconfig_item_t *ci, _Bool *ret_mmap) {
+  char *mode = NULL;
+
+  if (cf_util_get_string(ci, &mode) != 0)
+    return -1;
+
+  int status = 0;
+  if (strcasecmp("Line", mode) == 0)
+    *ret_mmap = 0;
+  else if (strcasecmp("MMap", mode) == 0)
+    *ret_mmap = 1;
+  else {
+    WARNING("tail_csv plugin: Invalid `ReadMode' \"%s\"; expected \"Line\" "
+            "or \"MMap\".",
+            mode);
+    status = -1;
+  }
+
+  sfree(mode);
+  return status;
+}
+
 static int tcsv_config_add_instance_collect(instance_definition_t *id,
                                             oconfig_item_t *ci) {
   metric_definition_t *metric;
@@ -429,6 +649,7 @@ static int tcsv_config_add_file(oconfig_item_t *ci) {
   id->metric_list = NULL;
   id->time_from = -1;
   id->next = NULL;
+  id->fd = -1;
 
   status = cf_util_get_string(ci, &id->path);
   if (status != 0) {
@@ -453,6 +674,8 @@ static int tcsv_config_add_file(oconfig_item_t *ci) {
       status = tcsv_config_get_index(option, &id->time_from);
     else if (strcasecmp("Plugin", option->key) == 0)
       status = cf_util_get_string(option, &id->plugin_name);
+    else if (strcasecmp("ReadMode", option->key) == 0)
+      status = tcsv_config_get_read_mode(option, &id->read_mmap);
     else {
       WARNING("tail_csv plugin: Option `%s' not allowed here.", option->key);
       status = -1;
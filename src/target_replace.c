@@ -28,15 +28,22 @@
 
 #include "common.h"
 #include "filter_chain.h"
+#include "utils_name_cache.h"
 #include "utils_subst.h"
 
 #include <regex.h>
 
+/* Maximum number of value lists for which the rewritten fields are cached. */
+#ifndef TR_RESULT_CACHE_SIZE
+#define TR_RESULT_CACHE_SIZE 65536
+#endif
+
 struct tr_action_s;
 typedef struct tr_action_s tr_action_t;
 struct tr_action_s {
   regex_t re;
   char *replacement;
+  size_t replacement_len;
   _Bool may_be_empty;
 
   tr_action_t *next;
@@ -59,6 +66,10 @@ struct tr_data_s {
   /* tr_action_t *type; */
   tr_action_t *type_instance;
   tr_meta_data_action_t *meta;
+
+  /* The fields rewritten by the actions above only depend on the identity of
+   * a value list, so they are cached per identity, see tr_cache_pack(). */
+  name_cache_t *cache;
 };
 typedef struct tr_data_s tr_data_t;
 
@@ -153,6 +164,7 @@ static int tr_config_add_action(tr_action_t **dest, /* {{{ */
     tr_action_destroy(act);
     return -ENOMEM;
   }
+  act->replacement_len = strlen(act->replacement);
 
   /* Insert action at end of list. */
   if (*dest == NULL)
@@ -260,24 +272,44 @@ static int tr_config_add_meta_action(tr_meta_data_action_t **dest, /* {{{ */
   return 0;
 } /* }}} int tr_config_add_meta_action */
 
+/* Replaces buffer[start..end) with `replacement' in place, truncating the
+ * result like subst() does. Returns the new length of the buffer. */
+static size_t tr_splice(char *buffer, size_t buffer_size, /* {{{ */
+                        size_t buffer_len, size_t start, size_t end,
+                        char const *replacement, size_t replacement_len) {
+  size_t back_len = buffer_len - end;
+
+  if ((start + replacement_len) >= buffer_size) {
+    replacement_len = buffer_size - (start + 1);
+    back_len = 0;
+  } else if ((start + replacement_len + back_len) >= buffer_size) {
+    back_len = buffer_size - (start + replacement_len + 1);
+  }
+
+  memmove(buffer + start + replacement_len, buffer + end, back_len);
+  memcpy(buffer + start, replacement, replacement_len);
+  buffer[start + replacement_len + back_len] = 0;
+
+  return start + replacement_len + back_len;
+} /* }}} size_t tr_splice */
+
 static int tr_action_invoke(tr_action_t *act_head, /* {{{ */
                             char *buffer_in, size_t buffer_in_size,
                             _Bool may_be_empty) {
   int status;
   char buffer[DATA_MAX_NAME_LEN];
+  size_t buffer_len;
   regmatch_t matches[8] = {[0] = {0}};
 
   if (act_head == NULL)
     return -EINVAL;
 
   sstrncpy(buffer, buffer_in, sizeof(buffer));
+  buffer_len = strlen(buffer);
 
   DEBUG("target_replace plugin: tr_action_invoke: <- buffer = %s;", buffer);
 
   for (tr_action_t *act = act_head; act != NULL; act = act->next) {
-    char temp[DATA_MAX_NAME_LEN];
-    char *subst_status;
-
     status = regexec(&act->re, buffer, STATIC_ARRAY_SIZE(matches), matches,
                      /* flags = */ 0);
     if (status == REG_NOMATCH)
@@ -291,17 +323,11 @@ static int tr_action_invoke(tr_action_t *act_head, /* {{{ */
       continue;
     }
 
-    subst_status = subst(temp, sizeof(temp), buffer, (size_t)matches[0].rm_so,
-                         (size_t)matches[0].rm_eo, act->replacement);
-    if (subst_status == NULL) {
-      ERROR("Target `replace': subst (buffer = %s, start = %" PRIsz
-            ", end = %" PRIsz ", "
-            "replacement = %s) failed.",
-            buffer, (size_t)matches[0].rm_so, (size_t)matches[0].rm_eo,
-            act->replacement);
-      continue;
-    }
-    sstrncpy(buffer, temp, sizeof(buffer));
+    /* Replacements are literal strings, so they are spliced into the buffer
+     * directly instead of going through subst() and a temporary buffer. */
+    buffer_len = tr_splice(buffer, sizeof(buffer), buffer_len,
+                           (size_t)matches[0].rm_so, (size_t)matches[0].rm_eo,
+                           act->replacement, act->replacement_len);
 
     DEBUG("target_replace plugin: tr_action_invoke: -- buffer = %s;", buffer);
   } /* for (act = act_head; act != NULL; act = act->next) */
@@ -440,6 +466,7 @@ static int tr_destroy(void **user_data) /* {{{ */
   /* tr_action_destroy (data->type); */
   tr_action_destroy(data->type_instance);
   tr_meta_data_action_destroy(data->meta);
+  name_cache_destroy(data->cache);
   sfree(data);
 
   return 0;
@@ -521,10 +548,61 @@ static int tr_create(const oconfig_item_t *ci, void **user_data) /* {{{ */
     return status;
   }
 
+  if ((data->host != NULL) || (data->plugin != NULL) ||
+      (data->plugin_instance != NULL) || (data->type_instance != NULL)) {
+    data->cache = name_cache_create(TR_RESULT_CACHE_SIZE);
+    if (data->cache == NULL)
+      WARNING("Target `replace': Creating the result cache failed. "
+              "Replacements will not be cached.");
+  }
+
   *user_data = data;
   return 0;
 } /* }}} int tr_create */
 
+/* The cached result is the rewritten fields, each prefixed by its length plus
+ * one as a single byte, in the order of tr_invoke(). Fields without actions
+ * are not included. */
+#define TR_CACHE_PACKED_SIZE (4 * (1 + DATA_MAX_NAME_LEN) + 1)
+
+static void tr_cache_pack(tr_data_t const *data, /* {{{ */
+                          value_list_t const *vl, char *buffer) {
+  char *ptr = buffer;
+
+#define PACK_FIELD(f)                                                          \
+  if (data->f != NULL) {                                                       \
+    size_t len = strnlen(vl->f, sizeof(vl->f) - 1);                            \
+    *ptr = (char)(len + 1);                                                    \
+    memcpy(ptr + 1, vl->f, len);                                               \
+    ptr += 1 + len;                                                            \
+  }
+  PACK_FIELD(host);
+  PACK_FIELD(plugin);
+  PACK_FIELD(plugin_instance);
+  PACK_FIELD(type_instance);
+#undef PACK_FIELD
+
+  *ptr = 0;
+} /* }}} void tr_cache_pack */
+
+static void tr_cache_unpack(tr_data_t const *data, /* {{{ */
+                            char const *buffer, value_list_t *vl) {
+  char const *ptr = buffer;
+
+#define UNPACK_FIELD(f)                                                        \
+  if (data->f != NULL) {                                                       \
+    size_t len = (size_t)(unsigned char)ptr[0] - 1;                            \
+    memcpy(vl->f, ptr + 1, len);                                               \
+    vl->f[len] = 0;                                                            \
+    ptr += 1 + len;                                                            \
+  }
+  UNPACK_FIELD(host);
+  UNPACK_FIELD(plugin);
+  UNPACK_FIELD(plugin_instance);
+  UNPACK_FIELD(type_instance);
+#undef UNPACK_FIELD
+} /* }}} void tr_cache_unpack */
+
 static int tr_invoke(const data_set_t *ds, value_list_t *vl, /* {{{ */
                      notification_meta_t __attribute__((unused)) * *meta,
                      void **user_data) {
@@ -543,15 +621,38 @@ static int tr_invoke(const data_set_t *ds, value_list_t *vl, /* {{{ */
     tr_meta_data_action_invoke(data->meta, &(vl->meta));
   }
 
+  if ((data->host == NULL) && (data->plugin == NULL) &&
+      (data->plugin_instance == NULL) && (data->type_instance == NULL))
+    return FC_TARGET_CONTINUE;
+
+  /* The identity is gone if an earlier target changed the value list. */
+  value_list_identity_t const *identity =
+      (data->cache != NULL) ? VALUE_LIST_IDENTITY(vl) : NULL;
+  char packed[TR_CACHE_PACKED_SIZE];
+
+  if ((identity != NULL) &&
+      (name_cache_get(data->cache, identity, NAME_CACHE_KEY_INIT, packed,
+                      sizeof(packed)) == 0)) {
+    tr_cache_unpack(data, packed, vl);
+    VALUE_LIST_IDENTITY_INVALIDATE(vl);
+    return FC_TARGET_CONTINUE;
+  }
+
 #define HANDLE_FIELD(f, e)                                                     \
   if (data->f != NULL)                                                         \
-  tr_action_invoke(data->f, vl->f, sizeof(vl->f), e)
+    tr_action_invoke(data->f, vl->f, sizeof(vl->f), e);
   HANDLE_FIELD(host, 0);
   HANDLE_FIELD(plugin, 0);
   HANDLE_FIELD(plugin_instance, 1);
   /* HANDLE_FIELD (type, 0); */
   HANDLE_FIELD(type_instance, 1);
 
+  if (identity != NULL) {
+    tr_cache_pack(data, vl, packed);
+    name_cache_set(data->cache, identity, NAME_CACHE_KEY_INIT, packed);
+  }
+  VALUE_LIST_IDENTITY_INVALIDATE(vl);
+
   return FC_TARGET_CONTINUE;
 } /* }}} int tr_invoke */
 
@@ -30,6 +30,7 @@
 #include "filter_chain.h"
 
 #include "utils_cache.h"
+#include "utils_ds_select.h"
 
 struct ts_data_s {
   double factor;
@@ -37,6 +38,9 @@ struct ts_data_s {
 
   char **data_sources;
   size_t data_sources_num;
+
+  /* Resolved when the configuration is read. */
+  ds_select_t *select;
 };
 typedef struct ts_data_s ts_data_t;
 
@@ -123,16 +127,6 @@ static int ts_invoke_counter(const data_set_t *ds, value_list_t *vl, /* {{{ */
   return 0;
 } /* }}} int ts_invoke_counter */
 
-static int ts_invoke_gauge(const data_set_t *ds, value_list_t *vl, /* {{{ */
-                           ts_data_t *data, int dsrc_index) {
-  if (!isnan(data->factor))
-    vl->values[dsrc_index].gauge *= data->factor;
-  if (!isnan(data->offset))
-    vl->values[dsrc_index].gauge += data->offset;
-
-  return 0;
-} /* }}} int ts_invoke_gauge */
-
 static int ts_invoke_derive(const data_set_t *ds, value_list_t *vl, /* {{{ */
                             ts_data_t *data, int dsrc_index) {
   int64_t curr_derive;
@@ -344,6 +338,8 @@ static int ts_destroy(void **user_data) /* {{{ */
       sfree(data->data_sources[i]);
     sfree(data->data_sources);
   }
+  if (data != NULL)
+    ds_select_destroy(data->select);
 
   sfree(data);
   *user_data = NULL;
@@ -397,11 +393,26 @@ static int ts_create(const oconfig_item_t *ci, void **user_data) /* {{{ */
     break;
   }
 
+  if ((status == 0) && (data->data_sources_num > 0)) {
+    data->select = ds_select_create(data->data_sources, data->data_sources_num);
+    if (data->select == NULL) {
+      ERROR("Target `scale': ds_select_create failed.");
+      status = -1;
+    }
+  }
+
   if (status != 0) {
     ts_destroy((void *)&data);
     return status;
   }
 
+  /* An unset factor or offset leaves values unchanged, so gauges can be
+   * scaled unconditionally. */
+  if (isnan(data->factor))
+    data->factor = 1.0;
+  if (isnan(data->offset))
+    data->offset = 0.0;
+
   *user_data = data;
   return 0;
 } /* }}} int ts_create */
@@ -420,30 +431,29 @@ static int ts_invoke(const data_set_t *ds, value_list_t *vl, /* {{{ */
     return -EINVAL;
   }
 
+  uint64_t mask = ds_select_mask(data->select, ds);
+
   for (size_t i = 0; i < ds->ds_num; i++) {
-    /* If we've got a list of data sources, is it in the list? */
-    if (data->data_sources) {
-      size_t j;
-      for (j = 0; j < data->data_sources_num; j++)
-        if (strcasecmp(ds->ds[i].name, data->data_sources[j]) == 0)
-          break;
-
-      /* No match, ignore */
-      if (j >= data->data_sources_num)
-        continue;
-    }
+    if (!ds_select_index(data->select, ds, mask, i))
+      continue;
 
-    if (ds->ds[i].type == DS_TYPE_COUNTER)
+    switch (ds->ds[i].type) {
+    case DS_TYPE_GAUGE:
+      vl->values[i].gauge = vl->values[i].gauge * data->factor + data->offset;
+      break;
+    case DS_TYPE_COUNTER:
       ts_invoke_counter(ds, vl, data, i);
-    else if (ds->ds[i].type == DS_TYPE_GAUGE)
-      ts_invoke_gauge(ds, vl, data, i);
-    else if (ds->ds[i].type == DS_TYPE_DERIVE)
+      break;
+    case DS_TYPE_DERIVE:
       ts_invoke_derive(ds, vl, data, i);
-    else if (ds->ds[i].type == DS_TYPE_ABSOLUTE)
+      break;
+    case DS_TYPE_ABSOLUTE:
       ts_invoke_absolute(ds, vl, data, i);
-    else
+      break;
+    default:
       ERROR("Target `scale': Ignoring unknown data source type %i",
             ds->ds[i].type);
+    }
   }
 
   return FC_TARGET_CONTINUE;
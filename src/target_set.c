@@ -29,7 +29,6 @@
 #include "common.h"
 #include "filter_chain.h"
 #include "meta_data.h"
-#include "utils_subst.h"
 
 struct ts_key_list_s {
   char *key;
@@ -50,17 +49,163 @@ static void ts_key_list_free(ts_key_list_t *l) /* {{{ */
   sfree(l);
 } /* }}} void ts_name_list_free */
 
+/* Strings are compiled into a list of segments when the configuration is
+ * read, so that setting a field is a series of copies instead of a search for
+ * every placeholder. */
+enum ts_segment_type_e {
+  TS_SEGMENT_TEXT,
+  TS_SEGMENT_HOST,
+  TS_SEGMENT_PLUGIN,
+  TS_SEGMENT_PLUGIN_INSTANCE,
+  TS_SEGMENT_TYPE,
+  TS_SEGMENT_TYPE_INSTANCE,
+  TS_SEGMENT_META
+};
+
+struct ts_segment_s {
+  enum ts_segment_type_e type;
+  /* The literal text or, for meta data, the placeholder itself, which is
+   * kept if the value list has no such meta data. */
+  char *text;
+  size_t text_len;
+  char *key; /* TS_SEGMENT_META only */
+};
+typedef struct ts_segment_s ts_segment_t;
+
+struct ts_template_s {
+  ts_segment_t *segments;
+  size_t segments_num;
+};
+typedef struct ts_template_s ts_template_t;
+
+struct ts_meta_template_s {
+  char *key;
+  ts_template_t *value;
+};
+typedef struct ts_meta_template_s ts_meta_template_t;
+
 struct ts_data_s {
-  char *host;
-  char *plugin;
-  char *plugin_instance;
-  /* char *type; */
-  char *type_instance;
+  ts_template_t *host;
+  ts_template_t *plugin;
+  ts_template_t *plugin_instance;
+  /* ts_template_t *type; */
+  ts_template_t *type_instance;
   meta_data_t *meta;
+  ts_meta_template_t *meta_templates;
+  size_t meta_templates_num;
   ts_key_list_t *meta_delete;
 };
 typedef struct ts_data_s ts_data_t;
 
+static void ts_template_destroy(ts_template_t *t) /* {{{ */
+{
+  if (t == NULL)
+    return;
+
+  for (size_t i = 0; i < t->segments_num; i++) {
+    sfree(t->segments[i].text);
+    sfree(t->segments[i].key);
+  }
+  sfree(t->segments);
+  sfree(t);
+} /* }}} void ts_template_destroy */
+
+static int ts_template_append(ts_template_t *t, /* {{{ */
+                              enum ts_segment_type_e type, char const *text,
+                              size_t text_len, char const *key) {
+  ts_segment_t *tmp =
+      realloc(t->segments, (t->segments_num + 1) * sizeof(*t->segments));
+  if (tmp == NULL)
+    return ENOMEM;
+  t->segments = tmp;
+
+  ts_segment_t *seg = t->segments + t->segments_num;
+  seg->type = type;
+  seg->text_len = text_len;
+  seg->text = malloc(text_len + 1);
+  seg->key = (key != NULL) ? strdup(key) : NULL;
+  if ((seg->text == NULL) || ((key != NULL) && (seg->key == NULL))) {
+    sfree(seg->text);
+    sfree(seg->key);
+    return ENOMEM;
+  }
+  memcpy(seg->text, text, text_len);
+  seg->text[text_len] = 0;
+
+  t->segments_num++;
+  return 0;
+} /* }}} int ts_template_append */
+
+/* Splits `string' into literal text and the placeholders understood by
+ * ts_template_expand(). Unknown placeholders are kept as text. */
+static ts_template_t *ts_template_compile(char const *string) /* {{{ */
+{
+  struct {
+    char const *name;
+    enum ts_segment_type_e type;
+  } const fields[] = {
+      {"host", TS_SEGMENT_HOST},
+      {"plugin", TS_SEGMENT_PLUGIN},
+      {"plugin_instance", TS_SEGMENT_PLUGIN_INSTANCE},
+      {"type", TS_SEGMENT_TYPE},
+      {"type_instance", TS_SEGMENT_TYPE_INSTANCE},
+  };
+
+  ts_template_t *t = calloc(1, sizeof(*t));
+  if (t == NULL)
+    return NULL;
+
+  char const *text = string;
+  char const *ptr = string;
+  int status = 0;
+  while ((status == 0) && ((ptr = strstr(ptr, "%{")) != NULL)) {
+    char const *name = ptr + 2;
+    char const *end = strchr(name, '}');
+    if (end == NULL)
+      break;
+
+    size_t name_len = (size_t)(end - name);
+    enum ts_segment_type_e type = TS_SEGMENT_TEXT;
+    char key[DATA_MAX_NAME_LEN] = "";
+
+    for (size_t i = 0; i < STATIC_ARRAY_SIZE(fields); i++) {
+      if ((strlen(fields[i].name) == name_len) &&
+          (strncmp(fields[i].name, name, name_len) == 0)) {
+        type = fields[i].type;
+        break;
+      }
+    }
+    if ((type == TS_SEGMENT_TEXT) && (name_len > strlen("meta:")) &&
+        (strncmp("meta:", name, strlen("meta:")) == 0) &&
+        (name_len - strlen("meta:") < sizeof(key))) {
+      type = TS_SEGMENT_META;
+      sstrncpy(key, name + strlen("meta:"), name_len - strlen("meta:") + 1);
+    }
+
+    if (type == TS_SEGMENT_TEXT) {
+      ptr = name;
+      continue;
+    }
+
+    if (ptr != text)
+      status = ts_template_append(t, TS_SEGMENT_TEXT, text,
+                                  (size_t)(ptr - text), NULL);
+    if (status == 0)
+      status = ts_template_append(t, type, ptr, (size_t)(end + 1 - ptr),
+                                  (type == TS_SEGMENT_META) ? key : NULL);
+    text = ptr = end + 1;
+  }
+
+  if ((status == 0) && (text[0] != 0))
+    status = ts_template_append(t, TS_SEGMENT_TEXT, text, strlen(text), NULL);
+
+  if (status != 0) {
+    ts_template_destroy(t);
+    return NULL;
+  }
+  return t;
+} /* }}} ts_template_t *ts_template_compile */
+
 static int ts_util_get_key_and_string_wo_strdup(const oconfig_item_t *ci,
                                                 char **ret_key,
                                                 char **ret_string) /* {{{ */
@@ -79,7 +224,7 @@ static int ts_util_get_key_and_string_wo_strdup(const oconfig_item_t *ci,
   return 0;
 } /* }}} int ts_util_get_key_and_string_wo_strdup */
 
-static int ts_config_add_string(char **dest, /* {{{ */
+static int ts_config_add_string(ts_template_t **dest, /* {{{ */
                                 const oconfig_item_t *ci, int may_be_empty) {
   char *tmp = NULL;
   int status;
@@ -95,7 +240,15 @@ static int ts_config_add_string(char **dest, /* {{{ */
     return -1;
   }
 
-  *dest = tmp;
+  ts_template_t *t = ts_template_compile(tmp);
+  sfree(tmp);
+  if (t == NULL) {
+    ERROR("Target `set': Compiling `%s' failed.", ci->key);
+    return -ENOMEM;
+  }
+
+  ts_template_destroy(*dest);
+  *dest = t;
   return 0;
 } /* }}} int ts_config_add_string */
 
@@ -163,48 +316,92 @@ static int ts_config_add_meta_delete(ts_key_list_t **dest, /* {{{ */
   return 0;
 } /* }}} int ts_config_add_meta_delete */
 
-static void ts_subst(char *dest, size_t size, const char *string, /* {{{ */
-                     const value_list_t *vl) {
-  char temp[DATA_MAX_NAME_LEN];
-
-  /* Initialize the field with the template. */
-  sstrncpy(dest, string, size);
+static void ts_template_expand(char *dest, size_t size, /* {{{ */
+                               ts_template_t const *t,
+                               const value_list_t *vl) {
+  size_t len = 0;
 
-  if (strchr(dest, '%') == NULL)
-    return;
+  for (size_t i = 0; i < t->segments_num; i++) {
+    ts_segment_t const *seg = t->segments + i;
+    char const *str = seg->text;
+    char *meta_str = NULL;
 
-#define REPLACE_FIELD(t, v)                                                    \
-  if (subst_string(temp, sizeof(temp), dest, t, v) != NULL)                    \
-    sstrncpy(dest, temp, size);
-  REPLACE_FIELD("%{host}", vl->host);
-  REPLACE_FIELD("%{plugin}", vl->plugin);
-  REPLACE_FIELD("%{plugin_instance}", vl->plugin_instance);
-  REPLACE_FIELD("%{type}", vl->type);
-  REPLACE_FIELD("%{type_instance}", vl->type_instance);
-
-  if (vl->meta != NULL) {
-    char **meta_toc = NULL;
-    int status = meta_data_toc(vl->meta, &meta_toc);
-    if (status <= 0)
-      return;
-    size_t meta_entries = (size_t)status;
-
-    for (size_t i = 0; i < meta_entries; i++) {
-      char meta_name[DATA_MAX_NAME_LEN];
-      char *value_str;
-      const char *key = meta_toc[i];
-
-      snprintf(meta_name, sizeof(meta_name), "%%{meta:%s}", key);
-      if (meta_data_as_string(vl->meta, key, &value_str) != 0)
-        continue;
-
-      REPLACE_FIELD(meta_name, value_str);
-      sfree(value_str);
+    switch (seg->type) {
+    case TS_SEGMENT_TEXT:
+      break;
+    case TS_SEGMENT_HOST:
+      str = vl->host;
+      break;
+    case TS_SEGMENT_PLUGIN:
+      str = vl->plugin;
+      break;
+    case TS_SEGMENT_PLUGIN_INSTANCE:
+      str = vl->plugin_instance;
+      break;
+    case TS_SEGMENT_TYPE:
+      str = vl->type;
+      break;
+    case TS_SEGMENT_TYPE_INSTANCE:
+      str = vl->type_instance;
+      break;
+    case TS_SEGMENT_META:
+      if ((vl->meta != NULL) &&
+          (meta_data_as_string(vl->meta, seg->key, &meta_str) == 0))
+        str = meta_str;
+      break;
     }
 
-    strarray_free(meta_toc, (size_t)meta_entries);
+    size_t str_len = (str == seg->text) ? seg->text_len : strlen(str);
+    if (str_len > size - 1 - len)
+      str_len = size - 1 - len;
+    memcpy(dest + len, str, str_len);
+    len += str_len;
+
+    sfree(meta_str);
+  }
+
+  dest[len] = 0;
+} /* }}} void ts_template_expand */
+
+/* Compiles the values of data->meta, which must all be strings. */
+static int ts_meta_compile(ts_data_t *data) /* {{{ */
+{
+  char **meta_toc = NULL;
+  int status = meta_data_toc(data->meta, &meta_toc);
+  if (status < 0)
+    return status;
+  size_t meta_entries = (size_t)status;
+
+  data->meta_templates = calloc(meta_entries, sizeof(*data->meta_templates));
+  if ((data->meta_templates == NULL) && (meta_entries != 0)) {
+    strarray_free(meta_toc, meta_entries);
+    return -ENOMEM;
   }
-} /* }}} int ts_subst */
+
+  status = 0;
+  for (size_t i = 0; i < meta_entries; i++) {
+    ts_meta_template_t *mt = data->meta_templates + i;
+    char *string = NULL;
+
+    status = meta_data_get_string(data->meta, meta_toc[i], &string);
+    if (status != 0)
+      break;
+
+    mt->key = meta_toc[i];
+    meta_toc[i] = NULL;
+    mt->value = ts_template_compile(string);
+    sfree(string);
+    data->meta_templates_num++;
+
+    if (mt->value == NULL) {
+      status = -ENOMEM;
+      break;
+    }
+  }
+
+  strarray_free(meta_toc, meta_entries);
+  return status;
+} /* }}} int ts_meta_compile */
 
 static int ts_destroy(void **user_data) /* {{{ */
 {
@@ -217,12 +414,17 @@ static int ts_destroy(void **user_data) /* {{{ */
   if (data == NULL)
     return 0;
 
-  free(data->host);
-  free(data->plugin);
-  free(data->plugin_instance);
-  /* free (data->type); */
-  free(data->type_instance);
+  ts_template_destroy(data->host);
+  ts_template_destroy(data->plugin);
+  ts_template_destroy(data->plugin_instance);
+  /* ts_template_destroy (data->type); */
+  ts_template_destroy(data->type_instance);
   meta_data_destroy(data->meta);
+  for (size_t i = 0; i < data->meta_templates_num; i++) {
+    sfree(data->meta_templates[i].key);
+    ts_template_destroy(data->meta_templates[i].value);
+  }
+  sfree(data->meta_templates);
   ts_key_list_free(data->meta_delete);
   free(data);
 
@@ -314,6 +516,12 @@ static int ts_create(const oconfig_item_t *ci, void **user_data) /* {{{ */
     break;
   }
 
+  if ((status == 0) && (data->meta != NULL)) {
+    status = ts_meta_compile(data);
+    if (status != 0)
+      ERROR("Target `set': Compiling the meta data failed.");
+  }
+
   if (status != 0) {
     ts_destroy((void *)&data);
     return status;
@@ -341,61 +549,37 @@ static int ts_invoke(const data_set_t *ds, value_list_t *vl, /* {{{ */
 
   orig = *vl;
 
-  if (data->meta != NULL) {
+  if (data->meta_templates_num > 0) {
     char temp[DATA_MAX_NAME_LEN * 2];
-    char **meta_toc;
 
     if ((new_meta = meta_data_create()) == NULL) {
       ERROR("Target `set': failed to create replacement metadata.");
       return -ENOMEM;
     }
 
-    int status = meta_data_toc(data->meta, &meta_toc);
-    if (status < 0) {
-      ERROR("Target `set': meta_data_toc failed with status %d.", status);
-      meta_data_destroy(new_meta);
-      return status;
-    }
-    size_t meta_entries = (size_t)status;
+    for (size_t i = 0; i < data->meta_templates_num; i++) {
+      ts_meta_template_t const *mt = data->meta_templates + i;
 
-    for (size_t i = 0; i < meta_entries; i++) {
-      const char *key = meta_toc[i];
-      char *string;
-      int status;
-
-      status = meta_data_get_string(data->meta, key, &string);
-      if (status) {
-        ERROR("Target `set': Unable to get replacement metadata value `%s'.",
-              key);
-        strarray_free(meta_toc, meta_entries);
-        meta_data_destroy(new_meta);
-        return status;
-      }
-
-      ts_subst(temp, sizeof(temp), string, &orig);
+      ts_template_expand(temp, sizeof(temp), mt->value, &orig);
 
       DEBUG("target_set: ts_invoke: setting metadata value for key `%s': "
             "`%s'.",
-            key, temp);
-
-      sfree(string);
+            mt->key, temp);
 
-      status = meta_data_add_string(new_meta, key, temp);
+      int status = meta_data_add_string(new_meta, mt->key, temp);
       if (status) {
-        ERROR("Target `set': Unable to set metadata value `%s'.", key);
-        strarray_free(meta_toc, meta_entries);
+        ERROR("Target `set': Unable to set metadata value `%s'.", mt->key);
         meta_data_destroy(new_meta);
         return status;
       }
     }
-
-    strarray_free(meta_toc, meta_entries);
   }
 
 #define SUBST_FIELD(f)                                                         \
   if (data->f != NULL) {                                                       \
-    ts_subst(vl->f, sizeof(vl->f), data->f, &orig);                            \
+    ts_template_expand(vl->f, sizeof(vl->f), data->f, &orig);                  \
     DEBUG("target_set: ts_invoke: setting " #f ": `%s'.", vl->f);              \
+    VALUE_LIST_IDENTITY_INVALIDATE(vl);                                        \
   }
   SUBST_FIELD(host);
   SUBST_FIELD(plugin);
@@ -40,6 +40,7 @@ static void v5_swap_instances(value_list_t *vl) /* {{{ */
   memcpy(tmp, vl->plugin_instance, sizeof(tmp));
   memcpy(vl->plugin_instance, vl->type_instance, sizeof(tmp));
   memcpy(vl->type_instance, tmp, sizeof(tmp));
+  VALUE_LIST_IDENTITY_INVALIDATE(vl);
 } /* }}} void v5_swap_instances */
 
 /*
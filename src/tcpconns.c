@@ -78,6 +78,7 @@
 #if KERNEL_LINUX
 #include <asm/types.h>
 #include <linux/netlink.h>
+#include <linux/rtnetlink.h>
 #if HAVE_LINUX_INET_DIAG_H
 #include <linux/inet_diag.h>
 #endif
@@ -265,6 +266,8 @@ static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 static int port_collect_listening = 0;
 static int port_collect_total = 0;
 static port_entry_t *port_list_head = NULL;
+/* Direct lookup of the entries in port_list_head, indexed by port number. */
+static port_entry_t *port_table[UINT16_MAX + 1];
 static uint32_t count_total[TCP_STATE_MAX + 1];
 
 #if KERNEL_LINUX
@@ -273,6 +276,11 @@ static uint32_t count_total[TCP_STATE_MAX + 1];
  * sequence_number is useless and we get a compilation warning.
  */
 static uint32_t sequence_number = 0;
+
+/* Socket filter passed to the kernel along with each dump request, see
+ * conn_build_filter(). NULL if every socket needs to be looked at. */
+static struct inet_diag_bc_op *diag_filter = NULL;
+static size_t diag_filter_len = 0;
 #endif
 
 static enum { SRC_DUNNO, SRC_NETLINK, SRC_PROC } linux_source = SRC_DUNNO;
@@ -345,14 +353,7 @@ static void conn_submit_all(void) {
 } /* void conn_submit_all */
 
 static port_entry_t *conn_get_port_entry(uint16_t port, int create) {
-  port_entry_t *ret;
-
-  ret = port_list_head;
-  while (ret != NULL) {
-    if (ret->port == port)
-      break;
-    ret = ret->next;
-  }
+  port_entry_t *ret = port_table[port];
 
   if ((ret == NULL) && (create != 0)) {
     ret = calloc(1, sizeof(*ret));
@@ -362,6 +363,7 @@ static port_entry_t *conn_get_port_entry(uint16_t port, int create) {
     ret->port = port;
     ret->next = port_list_head;
     port_list_head = ret;
+    port_table[port] = ret;
   }
 
   return ret;
@@ -391,6 +393,7 @@ static void conn_reset_port_entry(void) {
       else
         prev->next = next;
 
+      port_table[pe->port] = NULL;
       sfree(pe);
       pe = next;
 
@@ -451,7 +454,9 @@ static int conn_read_netlink(void) {
 #if HAVE_STRUCT_LINUX_INET_DIAG_REQ
   int fd;
   struct inet_diag_msg *r;
-  char buf[8192];
+  /* The kernel fills up to 32 KiB per message if the reader's buffer is
+   * large enough, which saves syscalls on hosts with many sockets. */
+  char buf[32768];
 
   /* If this fails, it's likely a permission problem. We'll fall back to
    * reading this information from files below. */
@@ -481,13 +486,25 @@ static int conn_read_netlink(void) {
       .r.idiag_states = 0xfff,
       .r.idiag_ext = 0};
 
-  struct iovec iov = {.iov_base = &req, .iov_len = sizeof(req)};
+  struct rtattr rta = {.rta_type = INET_DIAG_REQ_BYTECODE,
+                       .rta_len = RTA_LENGTH(diag_filter_len)};
+
+  struct iovec req_iov[] = {
+      {.iov_base = &req, .iov_len = sizeof(req)},
+      {.iov_base = &rta, .iov_len = sizeof(rta)},
+      {.iov_base = diag_filter, .iov_len = diag_filter_len},
+  };
 
   struct msghdr msg = {.msg_name = (void *)&nladdr,
                        .msg_namelen = sizeof(nladdr),
-                       .msg_iov = &iov,
+                       .msg_iov = req_iov,
                        .msg_iovlen = 1};
 
+  if (diag_filter != NULL) {
+    req.nlh.nlmsg_len += RTA_LENGTH(diag_filter_len);
+    msg.msg_iovlen = STATIC_ARRAY_SIZE(req_iov);
+  }
+
   if (sendmsg(fd, &msg, 0) < 0) {
     ERROR("tcpconns plugin: conn_read_netlink: sendmsg(2) failed: %s",
           STRERRNO);
@@ -495,8 +512,7 @@ static int conn_read_netlink(void) {
     return -1;
   }
 
-  iov.iov_base = buf;
-  iov.iov_len = sizeof(buf);
+  struct iovec iov = {.iov_base = buf, .iov_len = sizeof(buf)};
 
   while (1) {
     int status;
@@ -679,10 +695,82 @@ static int conn_config(const char *key, const char *value) {
 } /* int conn_config */
 
 #if KERNEL_LINUX
+#if HAVE_STRUCT_LINUX_INET_DIAG_REQ
+/* Compiles the configured ports into an inet_diag bytecode program, so that
+ * the kernel only dumps the sockets which are going to be counted. This is
+ * not possible if "ListeningPorts" or "AllPortsSummary" need to see every
+ * socket. Each configured port is matched by
+ *   S_GE port; S_LE port; JMP <accept>
+ * (D_GE and D_LE for remote ports). If either comparison fails, execution
+ * continues with the next port. The final JMP goes beyond the end of the
+ * program, which rejects the socket. */
+static void conn_build_filter(void) {
+  struct inet_diag_bc_op *op;
+  size_t conds_num = 0;
+  size_t ops_num;
+
+  sfree(diag_filter);
+  diag_filter_len = 0;
+
+  if (port_collect_total || port_collect_listening)
+    return;
+
+  for (port_entry_t *pe = port_list_head; pe != NULL; pe = pe->next) {
+    if (pe->flags & PORT_COLLECT_LOCAL)
+      conds_num++;
+    if (pe->flags & PORT_COLLECT_REMOTE)
+      conds_num++;
+  }
+
+  /* Two comparisons, two port operands and a jump per port, plus the final
+   * reject. Jump offsets are limited to 16 bits. */
+  ops_num = 5 * conds_num + 1;
+  if ((conds_num == 0) || (ops_num * sizeof(*op) > UINT16_MAX))
+    return;
+
+  diag_filter = calloc(ops_num, sizeof(*diag_filter));
+  if (diag_filter == NULL)
+    return;
+  diag_filter_len = ops_num * sizeof(*op);
+
+  op = diag_filter;
+  for (port_entry_t *pe = port_list_head; pe != NULL; pe = pe->next) {
+    for (int remote = 0; remote < 2; remote++) {
+      if (!(pe->flags & (remote ? PORT_COLLECT_REMOTE : PORT_COLLECT_LOCAL)))
+        continue;
+
+      op[0] = (struct inet_diag_bc_op){
+          .code = remote ? INET_DIAG_BC_D_GE : INET_DIAG_BC_S_GE,
+          .yes = 2 * sizeof(*op),
+          .no = 5 * sizeof(*op)};
+      op[1].no = pe->port;
+      op[2] = (struct inet_diag_bc_op){
+          .code = remote ? INET_DIAG_BC_D_LE : INET_DIAG_BC_S_LE,
+          .yes = 2 * sizeof(*op),
+          .no = 3 * sizeof(*op)};
+      op[3].no = pe->port;
+      /* Jumping exactly to the end of the program accepts the socket. */
+      op[4] = (struct inet_diag_bc_op){
+          .code = INET_DIAG_BC_JMP,
+          .yes = sizeof(*op),
+          .no = diag_filter_len - (size_t)(op + 4 - diag_filter) * sizeof(*op)};
+      op += 5;
+    }
+  }
+
+  *op = (struct inet_diag_bc_op){
+      .code = INET_DIAG_BC_JMP, .yes = sizeof(*op), .no = 2 * sizeof(*op)};
+} /* void conn_build_filter */
+#endif /* HAVE_STRUCT_LINUX_INET_DIAG_REQ */
+
 static int conn_init(void) {
   if (port_collect_total == 0 && port_list_head == NULL)
     port_collect_listening = 1;
 
+#if HAVE_STRUCT_LINUX_INET_DIAG_REQ
+  conn_build_filter();
+#endif
+
   return 0;
 } /* int conn_init */
 
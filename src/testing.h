@@ -120,7 +120,7 @@ static int check_count__ = 0;
 
 #define CHECK_NOT_NULL(expr)                                                   \
   do {                                                                         \
-    void *ptr_;                                                                \
+    void const *ptr_;                                                          \
     ptr_ = (expr);                                                             \
     OK1(ptr_ != NULL, #expr);                                                  \
   } while (0)
@@ -66,14 +66,14 @@ static int thermal_sysfs_device_read(const char __attribute__((unused)) * dir,
     return -1;
 
   snprintf(filename, sizeof(filename), "%s/%s/temp", dirname_sysfs, name);
-  if (parse_value_file(filename, &value, DS_TYPE_GAUGE) == 0) {
+  if (parse_value_file_cached(filename, &value, DS_TYPE_GAUGE) == 0) {
     value.gauge /= 1000.0;
     thermal_submit(name, TEMP, value);
     success = 1;
   }
 
   snprintf(filename, sizeof(filename), "%s/%s/cur_state", dirname_sysfs, name);
-  if (parse_value_file(filename, &value, DS_TYPE_GAUGE) == 0) {
+  if (parse_value_file_cached(filename, &value, DS_TYPE_GAUGE) == 0) {
     thermal_submit(name, COOLING_DEV, value);
     success = 1;
   }
@@ -103,7 +103,7 @@ static int thermal_procfs_device_read(const char __attribute__((unused)) * dir,
   if ((len < 0) || ((size_t)len >= sizeof(filename)))
     return -1;
 
-  len = (ssize_t)read_file_contents(filename, data, sizeof(data));
+  len = (ssize_t)read_file_cached(filename, data, sizeof(data));
   if ((len > 0) && ((size_t)len > sizeof(str_temp)) && (data[--len] == '\n') &&
       (!strncmp(data, str_temp, sizeof(str_temp) - 1))) {
     char *endptr = NULL;
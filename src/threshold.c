@@ -29,8 +29,34 @@
 #include "plugin.h"
 #include "utils_avltree.h"
 #include "utils_cache.h"
+#include "utils_complain.h"
+#include "utils_ring.h"
 #include "utils_threshold.h"
 
+/*
+ * Asynchronous checks
+ * ===================
+ * With "Asynchronous" enabled, the write callback only looks up whether a
+ * threshold applies to the value list, which is remembered per series by
+ * threshold_search(). Matching value lists are handed to a worker thread
+ * through a lock-free ring, so the write threads don't calculate rates,
+ * update states or dispatch notifications.
+ */
+typedef struct {
+  const data_set_t *ds;
+  value_list_t *vl; /* see plugin_value_list_retain() */
+} ut_queue_entry_t;
+
+static _Bool ut_async = 0;
+static int ut_queue_length = 65536;
+static c_ring_t *ut_queue = NULL;
+static c_complain_t ut_queue_complaint = C_COMPLAIN_INIT_STATIC;
+
+static pthread_t ut_thread;
+static _Bool ut_loop = 0;
+static pthread_mutex_t ut_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ut_cond = PTHREAD_COND_INITIALIZER;
+
 /*
  * Threshold management
  * ====================
@@ -746,6 +772,117 @@ static int ut_check_threshold(const data_set_t *ds, const value_list_t *vl,
   return 0;
 } /* }}} int ut_check_threshold */
 
+/*
+ * int ut_enqueue_threshold
+ *
+ * Write callback used in asynchronous mode. Hands the value list to the worker
+ * thread if a threshold applies to it.
+ */
+static int ut_enqueue_threshold(const data_set_t *ds, const value_list_t *vl,
+                                user_data_t *ud) { /* {{{ */
+  c_ring_t *queue = ut_queue;
+  threshold_t *th;
+
+  if (queue == NULL)
+    return ut_check_threshold(ds, vl, ud);
+
+  if (threshold_tree == NULL)
+    return 0;
+
+  pthread_mutex_lock(&threshold_lock);
+  th = threshold_search(vl);
+  pthread_mutex_unlock(&threshold_lock);
+  if (th == NULL)
+    return 0;
+
+  ut_queue_entry_t e = {.ds = ds, .vl = plugin_value_list_retain(vl)};
+  if (e.vl == NULL)
+    return ENOMEM;
+
+  if (c_ring_push(queue, &e) != 0) {
+    plugin_value_list_release(e.vl);
+    c_complain(LOG_WARNING, &ut_queue_complaint,
+               "threshold plugin: The queue is full, values are not checked. "
+               "Consider increasing \"QueueLength\".");
+    return ENOBUFS;
+  }
+  c_release(LOG_INFO, &ut_queue_complaint,
+            "threshold plugin: The queue accepts values again.");
+
+  /* Signalled without holding the lock, so a wakeup may be missed
+   * occasionally. The worker's timeout bounds the delay in that case. */
+  pthread_cond_signal(&ut_cond);
+  return 0;
+} /* }}} int ut_enqueue_threshold */
+
+static void *ut_worker(void __attribute__((unused)) * arg) /* {{{ */
+{
+  ut_queue_entry_t e;
+
+  while (42) {
+    while (c_ring_pop(ut_queue, &e) == 0) {
+      ut_check_threshold(e.ds, e.vl, /* user data = */ NULL);
+      plugin_value_list_release(e.vl);
+    }
+
+    pthread_mutex_lock(&ut_lock);
+    if (!ut_loop && c_ring_empty(ut_queue)) {
+      pthread_mutex_unlock(&ut_lock);
+      break;
+    }
+    if (c_ring_empty(ut_queue))
+      pthread_cond_timedwait(
+          &ut_cond, &ut_lock,
+          &CDTIME_T_TO_TIMESPEC(cdtime() + MS_TO_CDTIME_T(100)));
+    pthread_mutex_unlock(&ut_lock);
+  }
+
+  return NULL;
+} /* }}} void *ut_worker */
+
+static int ut_init(void) { /* {{{ */
+  if (!ut_async || (c_avl_size(threshold_tree) == 0) || (ut_queue != NULL))
+    return 0;
+
+  c_ring_t *queue = c_ring_create((size_t)ut_queue_length,
+                                  sizeof(ut_queue_entry_t));
+  if (queue == NULL) {
+    ERROR("threshold plugin: c_ring_create failed.");
+    return -1;
+  }
+
+  ut_loop = 1;
+  int status = plugin_thread_create(&ut_thread, /* attr = */ NULL, ut_worker,
+                                    /* arg = */ NULL, "threshold");
+  if (status != 0) {
+    c_ring_destroy(queue);
+    ERROR("threshold plugin: Starting the worker thread failed: %s",
+          STRERROR(status));
+    return -1;
+  }
+
+  /* Write callbacks check values synchronously until the queue is set. */
+  ut_queue = queue;
+  return 0;
+} /* }}} int ut_init */
+
+static int ut_shutdown(void) { /* {{{ */
+  if (ut_queue == NULL)
+    return 0;
+
+  pthread_mutex_lock(&ut_lock);
+  ut_loop = 0;
+  pthread_cond_broadcast(&ut_cond);
+  pthread_mutex_unlock(&ut_lock);
+
+  pthread_join(ut_thread, NULL);
+
+  c_ring_t *queue = ut_queue;
+  ut_queue = NULL;
+  c_ring_destroy(queue);
+  return 0;
+} /* }}} int ut_shutdown */
+
 /*
  * int ut_missing
  *
@@ -762,7 +899,9 @@ static int ut_missing(const value_list_t *vl,
   if (threshold_tree == NULL)
     return 0;
 
+  pthread_mutex_lock(&threshold_lock);
   th = threshold_search(vl);
+  pthread_mutex_unlock(&threshold_lock);
   /* dispatch notifications for "interesting" values only */
   if ((th == NULL) || ((th->flags & UT_FLAG_INTERESTING) == 0))
     return 0;
@@ -811,7 +950,15 @@ static int ut_config(oconfig_item_t *ci) { /* {{{ */
       status = ut_config_plugin(&th, option);
     else if (strcasecmp("Host", option->key) == 0)
       status = ut_config_host(&th, option);
-    else {
+    else if (strcasecmp("Asynchronous", option->key) == 0)
+      status = cf_util_get_boolean(option, &ut_async);
+    else if (strcasecmp("QueueLength", option->key) == 0) {
+      status = cf_util_get_int(option, &ut_queue_length);
+      if ((status == 0) && (ut_queue_length < 1)) {
+        WARNING("threshold values: \"QueueLength\" must be positive.");
+        status = -1;
+      }
+    } else {
       WARNING("threshold values: Option `%s' not allowed here.", option->key);
       status = -1;
     }
@@ -824,7 +971,7 @@ static int ut_config(oconfig_item_t *ci) { /* {{{ */
   if ((old_size == 0) && (c_avl_size(threshold_tree) > 0)) {
     plugin_register_missing("threshold", ut_missing,
                             /* user data = */ NULL);
-    plugin_register_write("threshold", ut_check_threshold,
+    plugin_register_write("threshold", ut_enqueue_threshold,
                           /* user data = */ NULL);
   }
 
@@ -833,4 +980,6 @@ static int ut_config(oconfig_item_t *ci) { /* {{{ */
 
 void module_register(void) {
   plugin_register_complex_config("threshold", ut_config);
+  plugin_register_init("threshold", ut_init);
+  plugin_register_shutdown("threshold", ut_shutdown);
 }
@@ -151,9 +151,16 @@ static double rapl_energy_units;
 /* 0x642 MSR_PP1_POLICY */
 #define TJMAX_DEFAULT 100
 
-static cpu_set_t *cpu_present_set, *cpu_affinity_set, *cpu_saved_affinity_set;
+static cpu_set_t *cpu_present_set, *cpu_saved_affinity_set;
 static size_t cpu_present_setsize, cpu_affinity_setsize,
     cpu_saved_affinity_setsize;
+/* Affinity of the thread reading a package, indexed by package id */
+static cpu_set_t **cpu_affinity_sets;
+static unsigned int cpu_affinity_sets_num;
+
+/* MSR devices, indexed by CPU id. They are kept open between reads. */
+static int *msr_fds;
+static unsigned int msr_fds_num;
 
 static struct thread_data {
   unsigned long long tsc;
@@ -233,39 +240,60 @@ static const char *config_keys[] = {
     "TCCActivationTemp",
     "RunningAveragePowerLimit",
     "LogicalCoreNames",
+    "PackageThreads",
 };
 static const int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 
+/*
+ * With "PackageThreads", each package is read by its own thread, so that all
+ * CPUs are sampled at about the same time. The read callback reads one of the
+ * packages itself.
+ */
+static _Bool config_package_threads;
+static pthread_t *package_workers;
+static size_t package_workers_num;
+
+static pthread_mutex_t package_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t package_start_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t package_done_cond = PTHREAD_COND_INITIALIZER;
+static unsigned long package_generation;
+static size_t package_busy;
+static _Bool package_shutdown;
+
+/* The counters being read and the next package to read */
+static struct thread_data *package_thread_base;
+static struct core_data *package_core_base;
+static struct pkg_data *package_pkg_base;
+static unsigned int package_next;
+static int package_status;
+
 /*****************************
  *  MSR Manipulation helpers *
  *****************************/
 
 /*
- * Open a MSR device for reading
- * Can change the scheduling affinity of the current process if multiple_read is
- * 1
+ * Migrate the calling thread to the CPU before doing multiple reads.
+ * Otherwise, we would lose time calling functions on another CPU.
+ * `set' must not be used by other threads at the same time.
  */
 static int __attribute__((warn_unused_result))
-open_msr(unsigned int cpu, _Bool multiple_read) {
+migrate_to_cpu(unsigned int cpu, cpu_set_t *set) {
+  CPU_ZERO_S(cpu_affinity_setsize, set);
+  CPU_SET_S(cpu, cpu_affinity_setsize, set);
+  if (sched_setaffinity(0, cpu_affinity_setsize, set) == -1) {
+    ERROR("turbostat plugin: Could not migrate to CPU %d", cpu);
+    return -1;
+  }
+  return 0;
+}
+
+/*
+ * Open a MSR device for reading
+ */
+static int __attribute__((warn_unused_result)) open_msr(unsigned int cpu) {
   char pathname[32];
   int fd;
 
-  /*
-   * If we need to do multiple read, let's migrate to the CPU
-   * Otherwise, we would lose time calling functions on another CPU
-   *
-   * If we are not yet initialized (cpu_affinity_setsize = 0),
-   * we need to skip this optimisation.
-   */
-  if (multiple_read && cpu_affinity_setsize) {
-    CPU_ZERO_S(cpu_affinity_setsize, cpu_affinity_set);
-    CPU_SET_S(cpu, cpu_affinity_setsize, cpu_affinity_set);
-    if (sched_setaffinity(0, cpu_affinity_setsize, cpu_affinity_set) == -1) {
-      ERROR("turbostat plugin: Could not migrate to CPU %d", cpu);
-      return -1;
-    }
-  }
-
   snprintf(pathname, sizeof(pathname), "/dev/cpu/%d/msr", cpu);
   fd = open(pathname, O_RDONLY);
   if (fd < 0) {
@@ -301,7 +329,7 @@ get_msr(unsigned int cpu, off_t offset, unsigned long long *msr) {
   ssize_t retval;
   int fd;
 
-  fd = open_msr(cpu, 0);
+  fd = open_msr(cpu);
   if (fd < 0)
     return fd;
   retval = read_msr(fd, offset, msr);
@@ -309,6 +337,27 @@ get_msr(unsigned int cpu, off_t offset, unsigned long long *msr) {
   return retval;
 }
 
+/*
+ * Return the MSR device of a CPU, opening it on first use
+ */
+static int __attribute__((warn_unused_result)) get_msr_fd(unsigned int cpu) {
+  if (cpu >= msr_fds_num)
+    return -1;
+
+  if (msr_fds[cpu] < 0)
+    msr_fds[cpu] = open_msr(cpu);
+  return msr_fds[cpu];
+}
+
+static void close_msr_fds(void) {
+  for (unsigned int i = 0; i < msr_fds_num; i++) {
+    if (msr_fds[i] >= 0)
+      close(msr_fds[i]);
+  }
+  sfree(msr_fds);
+  msr_fds_num = 0;
+}
+
 /********************************
  * Raw data acquisition (1 CPU) *
  ********************************/
@@ -330,7 +379,12 @@ get_counters(struct thread_data *t, struct core_data *c, struct pkg_data *p) {
   int msr_fd;
   int retval = 0;
 
-  msr_fd = open_msr(cpu, 1);
+  if (p->package_id >= cpu_affinity_sets_num)
+    return -1;
+  if (migrate_to_cpu(cpu, cpu_affinity_sets[p->package_id]) != 0)
+    return -1;
+
+  msr_fd = get_msr_fd(cpu);
   if (msr_fd < 0)
     return msr_fd;
 
@@ -414,7 +468,6 @@ get_counters(struct thread_data *t, struct core_data *c, struct pkg_data *p) {
   }
 
 out:
-  close(msr_fd);
   return retval;
 }
 
@@ -655,6 +708,42 @@ static int cpu_is_not_present(unsigned int cpu) {
   return !CPU_ISSET_S(cpu, cpu_present_setsize, cpu_present_set);
 }
 
+/*
+ * Loop on all CPUs of one package in topological order
+ *
+ * Skip non-present cpus
+ * Return the error code at the first error or 0
+ */
+static int __attribute__((warn_unused_result))
+for_package_cpus(int(func)(struct thread_data *, struct core_data *,
+                           struct pkg_data *),
+                 struct thread_data *thread_base, struct core_data *core_base,
+                 struct pkg_data *pkg_base, unsigned int pkg_no) {
+  int retval;
+
+  for (unsigned int core_no = 0; core_no < topology.num_cores; ++core_no) {
+    for (unsigned int thread_no = 0; thread_no < topology.num_threads;
+         ++thread_no) {
+      struct thread_data *t;
+      struct core_data *c;
+      struct pkg_data *p;
+
+      t = GET_THREAD(thread_base, thread_no, core_no, pkg_no);
+
+      if (cpu_is_not_present(t->cpu_id))
+        continue;
+
+      c = GET_CORE(core_base, core_no, pkg_no);
+      p = GET_PKG(pkg_base, pkg_no);
+
+      retval = func(t, c, p);
+      if (retval)
+        return retval;
+    }
+  }
+  return 0;
+}
+
 /*
  * Loop on all CPUs in topological order
  *
@@ -669,28 +758,120 @@ for_all_cpus(int(func)(struct thread_data *, struct core_data *,
   int retval;
 
   for (unsigned int pkg_no = 0; pkg_no < topology.num_packages; ++pkg_no) {
-    for (unsigned int core_no = 0; core_no < topology.num_cores; ++core_no) {
-      for (unsigned int thread_no = 0; thread_no < topology.num_threads;
-           ++thread_no) {
-        struct thread_data *t;
-        struct core_data *c;
-        struct pkg_data *p;
+    retval = for_package_cpus(func, thread_base, core_base, pkg_base, pkg_no);
+    if (retval)
+      return retval;
+  }
+  return 0;
+}
 
-        t = GET_THREAD(thread_base, thread_no, core_no, pkg_no);
+/*
+ * Read packages until none is left. Runs in the read callback and in all
+ * package threads.
+ */
+static void read_packages_run(void) {
+  while (42) {
+    unsigned int pkg_no =
+        __atomic_fetch_add(&package_next, 1, __ATOMIC_RELAXED);
+    if (pkg_no >= topology.num_packages)
+      break;
 
-        if (cpu_is_not_present(t->cpu_id))
-          continue;
+    int retval = for_package_cpus(get_counters, package_thread_base,
+                                  package_core_base, package_pkg_base, pkg_no);
+    if (retval)
+      __atomic_store_n(&package_status, retval, __ATOMIC_RELAXED);
+  }
+}
 
-        c = GET_CORE(core_base, core_no, pkg_no);
-        p = GET_PKG(pkg_base, pkg_no);
+static void *package_worker(__attribute__((unused)) void *arg) {
+  unsigned long generation = 0;
 
-        retval = func(t, c, p);
-        if (retval)
-          return retval;
-      }
+  pthread_mutex_lock(&package_lock);
+  while (!package_shutdown) {
+    if (generation == package_generation) {
+      pthread_cond_wait(&package_start_cond, &package_lock);
+      continue;
     }
+    generation = package_generation;
+    pthread_mutex_unlock(&package_lock);
+
+    read_packages_run();
+
+    pthread_mutex_lock(&package_lock);
+    package_busy--;
+    if (package_busy == 0)
+      pthread_cond_signal(&package_done_cond);
   }
-  return 0;
+  pthread_mutex_unlock(&package_lock);
+
+  return NULL;
+}
+
+static void package_workers_start(void) {
+  if (!config_package_threads || (topology.num_packages < 2))
+    return;
+
+  package_workers =
+      calloc(topology.num_packages - 1, sizeof(*package_workers));
+  if (package_workers == NULL) {
+    ERROR("turbostat plugin: calloc failed");
+    return;
+  }
+
+  package_shutdown = 0;
+  for (unsigned int i = 1; i < topology.num_packages; i++) {
+    int status = plugin_thread_create(&package_workers[package_workers_num],
+                                      /* attr = */ NULL, package_worker,
+                                      /* arg = */ NULL, "turbostat pkg");
+    if (status != 0) {
+      WARNING("turbostat plugin: Starting package thread #%u failed: %s", i,
+              STRERROR(status));
+      break;
+    }
+    package_workers_num++;
+  }
+}
+
+static void package_workers_stop(void) {
+  pthread_mutex_lock(&package_lock);
+  package_shutdown = 1;
+  pthread_cond_broadcast(&package_start_cond);
+  pthread_mutex_unlock(&package_lock);
+
+  for (size_t i = 0; i < package_workers_num; i++)
+    pthread_join(package_workers[i], /* retval = */ NULL);
+  sfree(package_workers);
+  package_workers_num = 0;
+}
+
+/*
+ * Read the counters of all CPUs, one package per thread
+ *
+ * Return the error code of a failed read or 0
+ */
+static int __attribute__((warn_unused_result))
+read_all_packages(struct thread_data *thread_base, struct core_data *core_base,
+                  struct pkg_data *pkg_base) {
+  package_thread_base = thread_base;
+  package_core_base = core_base;
+  package_pkg_base = pkg_base;
+  __atomic_store_n(&package_next, 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&package_status, 0, __ATOMIC_RELAXED);
+
+  pthread_mutex_lock(&package_lock);
+  package_busy = package_workers_num;
+  package_generation++;
+  pthread_cond_broadcast(&package_start_cond);
+  pthread_mutex_unlock(&package_lock);
+
+  read_packages_run();
+
+  pthread_mutex_lock(&package_lock);
+  while (package_busy > 0)
+    pthread_cond_wait(&package_done_cond, &package_lock);
+  pthread_mutex_unlock(&package_lock);
+
+  return __atomic_load_n(&package_status, __ATOMIC_RELAXED);
 }
 
 /*
@@ -1180,9 +1361,6 @@ static int __attribute__((warn_unused_result)) topology_probe(void) {
   }
 
   ret = allocate_cpu_set(&cpu_present_set, &cpu_present_setsize);
-  if (ret != 0)
-    goto err;
-  ret = allocate_cpu_set(&cpu_affinity_set, &cpu_affinity_setsize);
   if (ret != 0)
     goto err;
   ret = allocate_cpu_set(&cpu_saved_affinity_set, &cpu_saved_affinity_setsize);
@@ -1251,6 +1429,30 @@ static int __attribute__((warn_unused_result)) topology_probe(void) {
   topology.num_cores = max_core_id + 1;
   topology.num_threads = max_threads;
 
+  cpu_affinity_sets =
+      calloc(topology.num_packages, sizeof(*cpu_affinity_sets));
+  if (cpu_affinity_sets == NULL) {
+    ERROR("turbostat plugin: Unable to allocate CPU state");
+    ret = -1;
+    goto err;
+  }
+  cpu_affinity_sets_num = topology.num_packages;
+  for (unsigned int i = 0; i < topology.num_packages; i++) {
+    ret = allocate_cpu_set(&cpu_affinity_sets[i], &cpu_affinity_setsize);
+    if (ret != 0)
+      goto err;
+  }
+
+  msr_fds = calloc(topology.max_cpu_id + 1, sizeof(*msr_fds));
+  if (msr_fds == NULL) {
+    ERROR("turbostat plugin: Unable to allocate MSR devices");
+    ret = -1;
+    goto err;
+  }
+  msr_fds_num = topology.max_cpu_id + 1;
+  for (unsigned int i = 0; i < msr_fds_num; i++)
+    msr_fds[i] = -1;
+
   return 0;
 err:
   free(topology.cpus);
@@ -1345,10 +1547,14 @@ static void free_all_buffers(void) {
   cpu_present_set = NULL;
   cpu_present_setsize = 0;
 
-  CPU_FREE(cpu_affinity_set);
-  cpu_affinity_set = NULL;
+  for (unsigned int i = 0; i < cpu_affinity_sets_num; i++)
+    CPU_FREE(cpu_affinity_sets[i]);
+  sfree(cpu_affinity_sets);
+  cpu_affinity_sets_num = 0;
   cpu_affinity_setsize = 0;
 
+  close_msr_fds();
+
   CPU_FREE(cpu_saved_affinity_set);
   cpu_saved_affinity_set = NULL;
   cpu_saved_affinity_setsize = 0;
@@ -1434,7 +1640,7 @@ static int turbostat_read(void) {
   }
 
   if (!initialized) {
-    if ((ret = for_all_cpus(get_counters, EVEN_COUNTERS)) < 0)
+    if ((ret = read_all_packages(EVEN_COUNTERS)) < 0)
       goto out;
     time_even = cdtime();
     is_even = 1;
@@ -1444,7 +1650,7 @@ static int turbostat_read(void) {
   }
 
   if (is_even) {
-    if ((ret = for_all_cpus(get_counters, ODD_COUNTERS)) < 0)
+    if ((ret = read_all_packages(ODD_COUNTERS)) < 0)
       goto out;
     time_odd = cdtime();
     is_even = 0;
@@ -1454,7 +1660,7 @@ static int turbostat_read(void) {
     if ((ret = for_all_cpus(submit_counters, DELTA_COUNTERS)) < 0)
       goto out;
   } else {
-    if ((ret = for_all_cpus(get_counters, EVEN_COUNTERS)) < 0)
+    if ((ret = read_all_packages(EVEN_COUNTERS)) < 0)
       goto out;
     time_even = cdtime();
     is_even = 1;
@@ -1535,6 +1741,8 @@ static int turbostat_init(void) {
 
   DO_OR_GOTO_ERR(setup_all_buffers());
 
+  package_workers_start();
+
   plugin_register_read(PLUGIN_NAME, turbostat_read);
 
   return 0;
@@ -1574,6 +1782,8 @@ static int turbostat_config(const char *key, const char *value) {
     apply_config_ptm = 1;
   } else if (strcasecmp("LogicalCoreNames", key) == 0) {
     config_lcn = IS_TRUE(value);
+  } else if (strcasecmp("PackageThreads", key) == 0) {
+    config_package_threads = IS_TRUE(value);
   } else if (strcasecmp("RunningAveragePowerLimit", key) == 0) {
     tmp_val = strtoul(value, &end, 0);
     if (*end != '\0' || tmp_val > UINT_MAX) {
@@ -1596,8 +1806,15 @@ static int turbostat_config(const char *key, const char *value) {
   return 0;
 }
 
+static int turbostat_shutdown(void) {
+  package_workers_stop();
+  free_all_buffers();
+  return 0;
+}
+
 void module_register(void) {
   plugin_register_init(PLUGIN_NAME, turbostat_init);
+  plugin_register_shutdown(PLUGIN_NAME, turbostat_shutdown);
   plugin_register_config(PLUGIN_NAME, turbostat_config, config_keys,
                          config_keys_num);
 }
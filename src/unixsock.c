@@ -29,17 +29,31 @@
 #include "common.h"
 #include "plugin.h"
 
+#include "utils_cmd_binary.h"
+#include "utils_cmd_dispatchstats.h"
 #include "utils_cmd_flush.h"
 #include "utils_cmd_getthreshold.h"
 #include "utils_cmd_getval.h"
 #include "utils_cmd_listval.h"
 #include "utils_cmd_putnotif.h"
 #include "utils_cmd_putval.h"
+#include "utils_cmd_readstats.h"
+#include "utils_cmd_reload.h"
+#include "utils_cmd_stats.h"
+#include "utils_cmd_subscribe.h"
+#include "utils_cmd_topsenders.h"
 
+#include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/un.h>
+#if HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
 
+#include <fcntl.h>
+#include <fnmatch.h>
 #include <grp.h>
+#include <poll.h>
 
 #ifndef UNIX_PATH_MAX
 #define UNIX_PATH_MAX sizeof(((struct sockaddr_un *)0)->sun_path)
@@ -51,8 +65,10 @@
  * Private variables
  */
 /* valid configuration file keys */
-static const char *config_keys[] = {"SocketFile", "SocketGroup", "SocketPerms",
-                                    "DeleteSocket"};
+static const char *config_keys[] = {
+    "SocketFile",   "SocketGroup",          "SocketPerms",
+    "DeleteSocket", "SubscribeQueueLength", "SubscribeMaxDropped",
+    "EventLoop",    "EventThreads",         "MaxConnections"};
 static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 
 static int loop = 0;
@@ -66,6 +82,46 @@ static _Bool delete_socket = 0;
 
 static pthread_t listen_thread = (pthread_t)0;
 
+/* connection handling */
+static _Bool event_loop = 0;
+static int event_threads_num = 1;
+static int max_connections = 0; /* zero means unlimited */
+static pthread_attr_t client_attr;
+
+static pthread_mutex_t connections_lock = PTHREAD_MUTEX_INITIALIZER;
+static int connections_num = 0;
+static uint64_t connections_refused = 0;
+
+/* A client which issued SUBSCRIBE. Matching value lists are formatted as
+ * PUTVAL lines by the write callback and queued here until the client's
+ * thread writes them to the socket. All members are protected by
+ * subscribers_lock. */
+typedef struct us_subscriber_s us_subscriber_t;
+struct us_subscriber_s {
+  char *pattern;
+  int fd;
+
+  char **queue; /* ring of subscribe_queue_length lines */
+  size_t queue_head;
+  size_t queue_num;
+  pthread_cond_t cond;
+
+  uint64_t sent;
+  uint64_t dropped;        /* because the queue was full */
+  uint64_t dropped_recent; /* since the queue was last drained */
+  _Bool too_slow;
+
+  us_subscriber_t *next;
+};
+
+static size_t subscribe_queue_length = 1024;
+static uint64_t subscribe_max_dropped = 0;
+
+static pthread_mutex_t subscribers_lock = PTHREAD_MUTEX_INITIALIZER;
+static us_subscriber_t *subscribers = NULL;
+static uint64_t subscribers_disconnected = 0;
+static uint64_t subscribe_values_dropped = 0;
+
 /*
  * Functions
  */
@@ -113,7 +169,7 @@ static int us_open_socket(void) {
     return -1;
   }
 
-  status = listen(sock_fd, 8);
+  status = listen(sock_fd, SOMAXCONN);
   if (status != 0) {
     ERROR("unixsock plugin: listen failed: %s", STRERRNO);
     close(sock_fd);
@@ -158,13 +214,420 @@ static int us_open_socket(void) {
   return 0;
 } /* int us_open_socket */
 
+static int us_write(const data_set_t *ds, const value_list_t *vl, /* {{{ */
+                    user_data_t __attribute__((unused)) * ud) {
+  char name[6 * DATA_MAX_NAME_LEN];
+  char line[2048];
+  _Bool have_line = 0;
+
+  pthread_mutex_lock(&subscribers_lock);
+  if ((subscribers == NULL) || (FORMAT_VL(name, sizeof(name), vl) != 0)) {
+    pthread_mutex_unlock(&subscribers_lock);
+    return 0;
+  }
+
+  for (us_subscriber_t *s = subscribers; s != NULL; s = s->next) {
+    if (s->too_slow || (fnmatch(s->pattern, name, /* flags = */ 0) != 0))
+      continue;
+
+    /* Format the line once, no matter how many clients subscribed to it. */
+    if (!have_line) {
+      if (cmd_create_putval(line, sizeof(line), ds, vl) != 0)
+        break;
+      have_line = 1;
+    }
+
+    if (s->queue_num >= subscribe_queue_length) {
+      s->dropped++;
+      s->dropped_recent++;
+      subscribe_values_dropped++;
+
+      /* Disconnecting the client also wakes up its thread if it is blocked
+       * writing to the socket. */
+      if ((subscribe_max_dropped > 0) &&
+          (s->dropped_recent >= subscribe_max_dropped)) {
+        s->too_slow = 1;
+        shutdown(s->fd, SHUT_RDWR);
+        pthread_cond_signal(&s->cond);
+      }
+      continue;
+    }
+
+    char *copy = strdup(line);
+    if (copy == NULL)
+      continue;
+
+    s->queue[(s->queue_head + s->queue_num) % subscribe_queue_length] = copy;
+    s->queue_num++;
+    pthread_cond_signal(&s->cond);
+  }
+  pthread_mutex_unlock(&subscribers_lock);
+
+  return 0;
+} /* }}} int us_write */
+
+static void us_subscriber_free(us_subscriber_t *s) /* {{{ */
+{
+  if (s == NULL)
+    return;
+
+  for (size_t i = 0; i < s->queue_num; i++)
+    sfree(s->queue[(s->queue_head + i) % subscribe_queue_length]);
+  sfree(s->queue);
+  sfree(s->pattern);
+  pthread_cond_destroy(&s->cond);
+  sfree(s);
+} /* }}} void us_subscriber_free */
+
+/* Returns true if the client closed the connection. Anything it sends after
+ * SUBSCRIBE is discarded. */
+static _Bool us_peer_closed(int fd) /* {{{ */
+{
+  struct pollfd pfd = {.fd = fd, .events = POLLIN};
+  char buffer[256];
+
+  if (poll(&pfd, 1, /* timeout = */ 0) <= 0)
+    return 0;
+  if (pfd.revents & (POLLERR | POLLNVAL))
+    return 1;
+
+  ssize_t status = read(fd, buffer, sizeof(buffer));
+  if (status == 0)
+    return 1;
+  if (status < 0)
+    return (errno != EINTR) && (errno != EAGAIN);
+  return 0;
+} /* }}} _Bool us_peer_closed */
+
+/* Streams PUTVAL lines matching the pattern to the client until it closes the
+ * connection, is disconnected for being too slow, or the daemon shuts down.
+ * Returns zero if the command could not be parsed and the connection may
+ * accept further commands. */
+static int us_subscribe(FILE *fhin, FILE *fhout, char *buffer) /* {{{ */
+{
+  cmd_error_handler_t err = {cmd_error_fh, fhout};
+  cmd_t cmd;
+
+  if (cmd_parse(buffer, &cmd, NULL, &err) != CMD_OK)
+    return 0;
+  if (cmd.type != CMD_SUBSCRIBE) {
+    cmd_error(CMD_UNKNOWN_COMMAND, &err, "Unexpected command: `%s'.",
+              CMD_TO_STRING(cmd.type));
+    cmd_destroy(&cmd);
+    return 0;
+  }
+
+  us_subscriber_t *s = calloc(1, sizeof(*s));
+  char **batch = calloc(subscribe_queue_length, sizeof(*batch));
+  if (s != NULL)
+    s->queue = calloc(subscribe_queue_length, sizeof(*s->queue));
+  if ((s == NULL) || (s->queue == NULL) || (batch == NULL)) {
+    cmd_error(CMD_ERROR, &err, "calloc failed.");
+    if (s != NULL)
+      sfree(s->queue);
+    sfree(s);
+    sfree(batch);
+    cmd_destroy(&cmd);
+    return 0;
+  }
+  s->pattern = cmd.cmd.subscribe.pattern;
+  cmd.cmd.subscribe.pattern = NULL;
+  cmd_destroy(&cmd);
+  s->fd = fileno(fhout);
+  pthread_cond_init(&s->cond, NULL);
+
+  /* Link the subscriber before acknowledging, so that no value dispatched
+   * after the client received the status line is missed. */
+  pthread_mutex_lock(&subscribers_lock);
+  s->next = subscribers;
+  subscribers = s;
+  pthread_mutex_unlock(&subscribers_lock);
+
+  _Bool failed = 0;
+  if (fprintf(fhout, "0 Subscribed to `%s'\n", s->pattern) < 0)
+    failed = 1;
+
+  while ((loop != 0) && !failed) {
+    size_t batch_num = 0;
+
+    pthread_mutex_lock(&subscribers_lock);
+    if ((s->queue_num == 0) && !s->too_slow) {
+      struct timespec deadline =
+          CDTIME_T_TO_TIMESPEC(cdtime() + TIME_T_TO_CDTIME_T(1));
+      pthread_cond_timedwait(&s->cond, &subscribers_lock, &deadline);
+    }
+    while (s->queue_num > 0) {
+      batch[batch_num++] = s->queue[s->queue_head];
+      s->queue_head = (s->queue_head + 1) % subscribe_queue_length;
+      s->queue_num--;
+    }
+    s->dropped_recent = 0;
+    failed = s->too_slow;
+    pthread_mutex_unlock(&subscribers_lock);
+
+    /* Write without holding the lock, so a slow client only delays itself. */
+    for (size_t i = 0; i < batch_num; i++) {
+      if (!failed && (fprintf(fhout, "%s\n", batch[i]) < 0))
+        failed = 1;
+      sfree(batch[i]);
+    }
+    s->sent += batch_num;
+
+    if (!failed)
+      failed = us_peer_closed(fileno(fhin));
+  }
+
+  pthread_mutex_lock(&subscribers_lock);
+  for (us_subscriber_t **ptr = &subscribers; *ptr != NULL;
+       ptr = &(*ptr)->next) {
+    if (*ptr == s) {
+      *ptr = s->next;
+      break;
+    }
+  }
+  if (s->too_slow)
+    subscribers_disconnected++;
+  pthread_mutex_unlock(&subscribers_lock);
+
+  if (s->too_slow)
+    WARNING("unixsock plugin: Disconnected slow subscriber to `%s' after "
+            "%" PRIu64 " values (%" PRIu64 " dropped).",
+            s->pattern, s->sent, s->dropped);
+  else if (s->dropped > 0)
+    NOTICE("unixsock plugin: Subscription to `%s' ended after %" PRIu64
+           " values (%" PRIu64 " dropped).",
+           s->pattern, s->sent, s->dropped);
+
+  us_subscriber_free(s);
+  sfree(batch);
+  return -1;
+} /* }}} int us_subscribe */
+
+/* Returned by us_handle_command() for SUBSCRIBE, which switches the
+ * connection to streaming and is therefore handled by the caller. */
+#define US_SUBSCRIBE 1
+/* Returned by us_handle_command() after the connection switched to binary
+ * mode. All further input is decoded with cmd_binary_part(). */
+#define US_BINARY 2
+
+/* Decodes parts from the client until it closes the connection. After an
+ * error, the reason is sent to the client before the connection is closed. */
+static int us_binary(FILE *fhin, FILE *fhout) /* {{{ */
+{
+  cmd_error_handler_t err = {cmd_error_fh, fhout};
+  char part[CMD_BINARY_PART_MAX];
+  cmd_binary_t b;
+
+  cmd_binary_init(&b);
+
+  /* Reading whole parts lets stdio do the buffering and never blocks for
+   * more input than the current part. */
+  while (fread(part, 1, CMD_BINARY_HEADER_SIZE, fhin) ==
+         CMD_BINARY_HEADER_SIZE) {
+    size_t part_size;
+
+    if (cmd_binary_part_size(part, CMD_BINARY_HEADER_SIZE, &part_size, &err) !=
+        CMD_OK)
+      break;
+
+    size_t payload_size = part_size - CMD_BINARY_HEADER_SIZE;
+    if (fread(part + CMD_BINARY_HEADER_SIZE, 1, payload_size, fhin) !=
+        payload_size)
+      break;
+
+    if (cmd_binary_part(&b, part, part_size, &err) != CMD_OK)
+      break;
+  }
+
+  return -1;
+} /* }}} int us_binary */
+
+static int us_connection_acquire(void) /* {{{ */
+{
+  int status = 0;
+
+  pthread_mutex_lock(&connections_lock);
+  if ((max_connections > 0) && (connections_num >= max_connections)) {
+    connections_refused++;
+    status = -1;
+  } else {
+    connections_num++;
+  }
+  pthread_mutex_unlock(&connections_lock);
+
+  return status;
+} /* }}} int us_connection_acquire */
+
+static void us_connection_release(void) /* {{{ */
+{
+  pthread_mutex_lock(&connections_lock);
+  connections_num--;
+  pthread_mutex_unlock(&connections_lock);
+} /* }}} void us_connection_release */
+
+/* Maximum number of lines of a PUTVALS or GETVALS command. */
+#define US_BULK_MAX 10000
+
+/* Lines of a PUTVALS or GETVALS command received so far. */
+typedef struct {
+  cmd_type_t type; /* CMD_PUTVAL or CMD_GETVAL; CMD_UNKNOWN if inactive */
+  char **lines;
+  size_t lines_num;
+  size_t expected;
+} us_bulk_t;
+
+static void us_bulk_reset(us_bulk_t *bulk) /* {{{ */
+{
+  for (size_t i = 0; i < bulk->lines_num; i++)
+    sfree(bulk->lines[i]);
+  sfree(bulk->lines);
+  memset(bulk, 0, sizeof(*bulk));
+} /* }}} void us_bulk_reset */
+
+/* Parses the header of a PUTVALS or GETVALS command, "<command> <num>". */
+static void us_bulk_start(FILE *fhout, us_bulk_t *bulk, /* {{{ */
+                          cmd_type_t type, char **fields, int fields_num) {
+  char *endptr = NULL;
+  unsigned long num = 0;
+
+  if (fields_num == 2) {
+    errno = 0;
+    num = strtoul(fields[1], &endptr, 10);
+    if ((errno != 0) || (endptr == fields[1]) || (*endptr != 0))
+      num = 0;
+  }
+
+  if ((num < 1) || (num > US_BULK_MAX)) {
+    fprintf(fhout, "-1 Expected the number of lines (1-%i) after %s.\n",
+            US_BULK_MAX, fields[0]);
+    return;
+  }
+
+  bulk->lines = calloc(num, sizeof(*bulk->lines));
+  if (bulk->lines == NULL) {
+    fprintf(fhout, "-1 calloc failed.\n");
+    return;
+  }
+  bulk->type = type;
+  bulk->lines_num = 0;
+  bulk->expected = (size_t)num;
+} /* }}} void us_bulk_start */
+
+/* Adds a line to a PUTVALS or GETVALS command and executes the command once
+ * all lines have been received. */
+static int us_bulk_add(FILE *fhout, us_bulk_t *bulk, /* {{{ */
+                       char const *buffer) {
+  char *line = strdup(buffer);
+  if (line == NULL) {
+    fprintf(fhout, "-1 strdup failed.\n");
+    return -1;
+  }
+  bulk->lines[bulk->lines_num++] = line;
+
+  if (bulk->lines_num < bulk->expected)
+    return 0;
+
+  if (bulk->type == CMD_PUTVAL)
+    cmd_handle_putvals(fhout, bulk->lines, bulk->lines_num);
+  else
+    cmd_handle_getvals(fhout, bulk->lines, bulk->lines_num);
+  us_bulk_reset(bulk);
+
+  return 0;
+} /* }}} int us_bulk_add */
+
+/* Executes one line read from a client and writes the response to fhout.
+ * Lines following a PUTVALS or GETVALS command are collected in bulk.
+ * Returns zero to continue reading commands, US_SUBSCRIBE if the line is a
+ * SUBSCRIBE command, which has not been executed, US_BINARY if the client
+ * switched to binary mode, or a negative value if the connection has to be
+ * closed. */
+static int us_handle_command(FILE *fhout, char *buffer, /* {{{ */
+                             us_bulk_t *bulk) {
+  char buffer_copy[1024];
+  char *fields[128];
+  int fields_num;
+  int len;
+
+  len = strlen(buffer);
+  while ((len > 0) &&
+         ((buffer[len - 1] == '\n') || (buffer[len - 1] == '\r')))
+    buffer[--len] = '\0';
+
+  if (len == 0)
+    return 0;
+
+  if (bulk->expected > 0)
+    return us_bulk_add(fhout, bulk, buffer);
+
+  sstrncpy(buffer_copy, buffer, sizeof(buffer_copy));
+
+  fields_num =
+      strsplit(buffer_copy, fields, sizeof(fields) / sizeof(fields[0]));
+  if (fields_num < 1) {
+    fprintf(fhout, "-1 Internal error\n");
+    return -1;
+  }
+
+  if (strcasecmp(fields[0], "getval") == 0) {
+    cmd_handle_getval(fhout, buffer);
+  } else if (strcasecmp(fields[0], "getthreshold") == 0) {
+    handle_getthreshold(fhout, buffer);
+  } else if (strcasecmp(fields[0], "putval") == 0) {
+    cmd_handle_putval(fhout, buffer);
+  } else if (strcasecmp(fields[0], "listval") == 0) {
+    cmd_handle_listval(fhout, buffer);
+  } else if (strcasecmp(fields[0], "putnotif") == 0) {
+    handle_putnotif(fhout, buffer);
+  } else if (strcasecmp(fields[0], "flush") == 0) {
+    cmd_handle_flush(fhout, buffer);
+  } else if (strcasecmp(fields[0], "dispatchstats") == 0) {
+    handle_dispatchstats(fhout, buffer);
+  } else if (strcasecmp(fields[0], "readstats") == 0) {
+    handle_readstats(fhout, buffer);
+  } else if (strcasecmp(fields[0], "reload") == 0) {
+    handle_reload(fhout, buffer);
+  } else if (strcasecmp(fields[0], "stats") == 0) {
+    handle_stats(fhout, buffer);
+  } else if (strcasecmp(fields[0], "topsenders") == 0) {
+    handle_topsenders(fhout, buffer);
+  } else if (strcasecmp(fields[0], "putvals") == 0) {
+    us_bulk_start(fhout, bulk, CMD_PUTVAL, fields, fields_num);
+  } else if (strcasecmp(fields[0], "getvals") == 0) {
+    us_bulk_start(fhout, bulk, CMD_GETVAL, fields, fields_num);
+  } else if (strcasecmp(fields[0], "subscribe") == 0) {
+    return US_SUBSCRIBE;
+  } else if (strcasecmp(fields[0], "binary") == 0) {
+    if (handle_binary(fhout, buffer) == 0)
+      return US_BINARY;
+  } else {
+    if (fprintf(fhout, "-1 Unknown command: %s\n", fields[0]) < 0) {
+      WARNING("unixsock plugin: failed to write to socket #%i: %s",
+              fileno(fhout), STRERRNO);
+      return -1;
+    }
+  }
+
+  return 0;
+} /* }}} int us_handle_command */
+
+/* Argument of us_handle_client(). If command is not NULL, it is executed
+ * before anything is read from the socket. */
+typedef struct {
+  int fd;
+  char *command;
+} us_client_t;
+
 static void *us_handle_client(void *arg) {
+  us_client_t *client = arg;
   int fdin;
   int fdout;
   FILE *fhin, *fhout;
+  char *command;
 
-  fdin = *((int *)arg);
-  free(arg);
+  fdin = client->fd;
+  command = client->command;
+  free(client);
   arg = NULL;
 
   DEBUG("unixsock plugin: us_handle_client: Reading from fd #%i", fdin);
@@ -173,6 +636,8 @@ static void *us_handle_client(void *arg) {
   if (fdout < 0) {
     ERROR("unixsock plugin: dup failed: %s", STRERRNO);
     close(fdin);
+    sfree(command);
+    us_connection_release();
     pthread_exit((void *)1);
   }
 
@@ -181,6 +646,8 @@ static void *us_handle_client(void *arg) {
     ERROR("unixsock plugin: fdopen failed: %s", STRERRNO);
     close(fdin);
     close(fdout);
+    sfree(command);
+    us_connection_release();
     pthread_exit((void *)1);
     return (void *)1;
   }
@@ -190,6 +657,8 @@ static void *us_handle_client(void *arg) {
     ERROR("unixsock plugin: fdopen failed: %s", STRERRNO);
     fclose(fhin); /* this closes fdin as well */
     close(fdout);
+    sfree(command);
+    us_connection_release();
     pthread_exit((void *)1);
     return (void *)1;
   }
@@ -199,86 +668,488 @@ static void *us_handle_client(void *arg) {
     ERROR("unixsock plugin: setvbuf failed: %s", STRERRNO);
     fclose(fhin);
     fclose(fhout);
+    sfree(command);
+    us_connection_release();
     pthread_exit((void *)1);
     return (void *)0;
   }
 
+  us_bulk_t bulk = {0};
   while (42) {
     char buffer[1024];
-    char buffer_copy[1024];
-    char *fields[128];
-    int fields_num;
-    int len;
+    int status;
 
-    errno = 0;
-    if (fgets(buffer, sizeof(buffer), fhin) == NULL) {
-      if ((errno == EINTR) || (errno == EAGAIN))
+    if (command != NULL) {
+      sstrncpy(buffer, command, sizeof(buffer));
+      sfree(command);
+    } else {
+      errno = 0;
+      if (fgets(buffer, sizeof(buffer), fhin) == NULL) {
+        if ((errno == EINTR) || (errno == EAGAIN))
+          continue;
+
+        if (errno != 0) {
+          WARNING("unixsock plugin: failed to read from socket #%i: %s",
+                  fileno(fhin), STRERRNO);
+        }
+        break;
+      }
+    }
+
+    status = us_handle_command(fhout, buffer, &bulk);
+    if (status == US_SUBSCRIBE)
+      status = us_subscribe(fhin, fhout, buffer);
+    else if (status == US_BINARY)
+      status = us_binary(fhin, fhout);
+    if (status != 0)
+      break;
+  } /* while (fgets) */
+  us_bulk_reset(&bulk);
+
+  DEBUG("unixsock plugin: us_handle_client: Exiting..");
+  fclose(fhin);
+  fclose(fhout);
+  us_connection_release();
+
+  pthread_exit((void *)0);
+  return (void *)0;
+} /* void *us_handle_client */
+
+static int us_spawn_client(int fd, char *command) /* {{{ */
+{
+  pthread_t th;
+  int status;
+
+  us_client_t *client = malloc(sizeof(*client));
+  if (client == NULL) {
+    WARNING("unixsock plugin: malloc failed: %s", STRERRNO);
+    return -1;
+  }
+  client->fd = fd;
+  client->command = command;
+
+  DEBUG("Spawning child to handle connection on fd #%i", fd);
+
+  status = plugin_thread_create(&th, &client_attr, us_handle_client,
+                                (void *)client, "unixsock conn");
+  if (status != 0) {
+    WARNING("unixsock plugin: pthread_create failed: %s", STRERRNO);
+    free(client);
+    return -1;
+  }
+
+  return 0;
+} /* }}} int us_spawn_client */
+
+#if HAVE_SYS_EPOLL_H
+/* A connection served by an event thread. The buffers are only accessed by
+ * the thread owning the connection. */
+typedef struct us_conn_s us_conn_t;
+struct us_conn_s {
+  int fd;
+
+  char in[CMD_BINARY_PART_MAX]; /* holds a line or a part of binary mode */
+  size_t in_len;
+
+  char *out;
+  size_t out_len;
+  size_t out_off;
+  uint32_t events; /* currently registered with epoll */
+
+  us_bulk_t bulk;
+
+  /* Set once the client switched to binary mode. */
+  cmd_binary_t *binary;
+
+  /* Close the connection once the output has been written. */
+  _Bool closing;
+
+  us_conn_t *prev;
+  us_conn_t *next;
+};
+
+typedef struct {
+  int efd;
+  pthread_t thread;
+
+  /* Connections owned by this thread, so they can be closed on shutdown.
+   * The listen thread adds new connections here. */
+  pthread_mutex_t lock;
+  us_conn_t *conns;
+} us_event_thread_t;
+
+static us_event_thread_t *event_threads = NULL;
+static size_t event_threads_started = 0;
+
+static void us_conn_unlink(us_event_thread_t *et, us_conn_t *c) /* {{{ */
+{
+  pthread_mutex_lock(&et->lock);
+  if (c->prev != NULL)
+    c->prev->next = c->next;
+  else
+    et->conns = c->next;
+  if (c->next != NULL)
+    c->next->prev = c->prev;
+  pthread_mutex_unlock(&et->lock);
+
+  c->prev = c->next = NULL;
+} /* }}} void us_conn_unlink */
+
+static void us_conn_close(us_event_thread_t *et, us_conn_t *c) /* {{{ */
+{
+  us_conn_unlink(et, c);
+  epoll_ctl(et->efd, EPOLL_CTL_DEL, c->fd, NULL);
+  close(c->fd);
+  us_bulk_reset(&c->bulk);
+  sfree(c->binary);
+  sfree(c->out);
+  sfree(c);
+  us_connection_release();
+} /* }}} void us_conn_close */
+
+/* Writes as much of the pending output as the socket accepts. Returns zero if
+ * everything has been written, a positive value if output is pending and a
+ * negative value on error. */
+static int us_conn_flush(us_conn_t *c) /* {{{ */
+{
+  while (c->out_off < c->out_len) {
+    ssize_t status = write(c->fd, c->out + c->out_off, c->out_len - c->out_off);
+    if (status < 0) {
+      if (errno == EINTR)
         continue;
+      if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+        return 1;
+      return -1;
+    }
+    c->out_off += (size_t)status;
+  }
 
-      if (errno != 0) {
-        WARNING("unixsock plugin: failed to read from socket #%i: %s",
-                fileno(fhin), STRERRNO);
-      }
+  sfree(c->out);
+  c->out_len = c->out_off = 0;
+  return 0;
+} /* }}} int us_conn_flush */
+
+static int us_conn_append(us_conn_t *c, char const *buffer, /* {{{ */
+                          size_t buffer_len) {
+  if (buffer_len == 0)
+    return 0;
+
+  char *tmp = realloc(c->out, c->out_len + buffer_len);
+  if (tmp == NULL)
+    return ENOMEM;
+  c->out = tmp;
+  memcpy(c->out + c->out_len, buffer, buffer_len);
+  c->out_len += buffer_len;
+
+  return 0;
+} /* }}} int us_conn_append */
+
+/* Error handler of binary mode: appends the status line to the output. */
+static void us_conn_error(void *ud, cmd_status_t status, /* {{{ */
+                          const char *format, va_list ap) {
+  us_conn_t *c = ud;
+  char buffer[1024];
+
+  int len =
+      snprintf(buffer, sizeof(buffer), "%i ", (status == CMD_OK) ? 0 : -1);
+  /* Leave room for the newline. */
+  vsnprintf(buffer + len, sizeof(buffer) - len - 1, format, ap);
+  sstrncpy(buffer + strlen(buffer), "\n", 2);
+  us_conn_append(c, buffer, strlen(buffer));
+} /* }}} void us_conn_error */
+
+/* Decodes all complete parts in the input buffer in place. */
+static void us_conn_process_binary(us_conn_t *c) /* {{{ */
+{
+  cmd_error_handler_t err = {us_conn_error, c};
+  size_t offset = 0;
+
+  while (!c->closing) {
+    size_t part_size;
+
+    if (cmd_binary_part_size(c->in + offset, c->in_len - offset, &part_size,
+                             &err) != CMD_OK) {
+      c->closing = 1;
       break;
     }
+    if ((part_size == 0) || (part_size > c->in_len - offset))
+      break;
+
+    if (cmd_binary_part(c->binary, c->in + offset, part_size, &err) != CMD_OK)
+      c->closing = 1;
+    offset += part_size;
+  }
 
-    len = strlen(buffer);
-    while ((len > 0) &&
-           ((buffer[len - 1] == '\n') || (buffer[len - 1] == '\r')))
-      buffer[--len] = '\0';
+  c->in_len -= offset;
+  memmove(c->in, c->in + offset, c->in_len);
+} /* }}} void us_conn_process_binary */
+
+/* Executes all complete lines in the input buffer. The handlers write their
+ * response to a memory stream, which is appended to the output buffer. On
+ * SUBSCRIBE, the command is copied to subscribe and US_SUBSCRIBE returned. */
+static int us_conn_process(us_conn_t *c, char *subscribe, /* {{{ */
+                           size_t subscribe_size) {
+  while (!c->closing) {
+    if (c->binary != NULL) {
+      us_conn_process_binary(c);
+      break;
+    }
 
-    if (len == 0)
-      continue;
+    char line[sizeof(c->in)];
+    size_t line_len;
+    char *newline = memchr(c->in, '\n', c->in_len);
 
-    sstrncpy(buffer_copy, buffer, sizeof(buffer_copy));
+    if (newline != NULL)
+      line_len = (size_t)(newline - c->in) + 1;
+    else if (c->in_len >= sizeof(c->in) - 1) /* split long lines like fgets */
+      line_len = c->in_len;
+    else
+      break;
 
-    fields_num =
-        strsplit(buffer_copy, fields, sizeof(fields) / sizeof(fields[0]));
-    if (fields_num < 1) {
-      fprintf(fhout, "-1 Internal error\n");
-      fclose(fhin);
-      fclose(fhout);
-      pthread_exit((void *)1);
-      return (void *)1;
+    memcpy(line, c->in, line_len);
+    line[line_len] = 0;
+    c->in_len -= line_len;
+    memmove(c->in, c->in + line_len, c->in_len);
+
+    char *response = NULL;
+    size_t response_len = 0;
+    FILE *fh = open_memstream(&response, &response_len);
+    if (fh == NULL) {
+      ERROR("unixsock plugin: open_memstream failed: %s", STRERRNO);
+      return -1;
     }
 
-    if (strcasecmp(fields[0], "getval") == 0) {
-      cmd_handle_getval(fhout, buffer);
-    } else if (strcasecmp(fields[0], "getthreshold") == 0) {
-      handle_getthreshold(fhout, buffer);
-    } else if (strcasecmp(fields[0], "putval") == 0) {
-      cmd_handle_putval(fhout, buffer);
-    } else if (strcasecmp(fields[0], "listval") == 0) {
-      cmd_handle_listval(fhout, buffer);
-    } else if (strcasecmp(fields[0], "putnotif") == 0) {
-      handle_putnotif(fhout, buffer);
-    } else if (strcasecmp(fields[0], "flush") == 0) {
-      cmd_handle_flush(fhout, buffer);
-    } else {
-      if (fprintf(fhout, "-1 Unknown command: %s\n", fields[0]) < 0) {
-        WARNING("unixsock plugin: failed to write to socket #%i: %s",
-                fileno(fhout), STRERRNO);
-        break;
+    int status = us_handle_command(fh, line, &c->bulk);
+    fclose(fh);
+    if (us_conn_append(c, response, response_len) != 0)
+      status = -1;
+    sfree(response);
+
+    if (status == US_SUBSCRIBE) {
+      sstrncpy(subscribe, line, subscribe_size);
+      return US_SUBSCRIBE;
+    } else if (status == US_BINARY) {
+      c->binary = malloc(sizeof(*c->binary));
+      if (c->binary == NULL) {
+        ERROR("unixsock plugin: malloc failed.");
+        return -1;
       }
+      cmd_binary_init(c->binary);
+    } else if (status != 0) {
+      c->closing = 1;
     }
-  } /* while (fgets) */
+  }
 
-  DEBUG("unixsock plugin: us_handle_client: Exiting..");
-  fclose(fhin);
-  fclose(fhout);
+  return 0;
+} /* }}} int us_conn_process */
+
+/* Hands a connection over to its own thread for streaming. The pending output
+ * is written first, blocking. */
+static void us_conn_subscribe(us_event_thread_t *et, us_conn_t *c, /* {{{ */
+                              char const *command) {
+  int fd = c->fd;
+  char *copy = strdup(command);
+
+  us_conn_unlink(et, c);
+  epoll_ctl(et->efd, EPOLL_CTL_DEL, fd, NULL);
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+
+  int status = (copy == NULL) ? -1 : us_conn_flush(c);
+  us_bulk_reset(&c->bulk);
+  sfree(c->out);
+  sfree(c);
+
+  /* On success, the client thread releases the connection. */
+  if ((status != 0) || (us_spawn_client(fd, copy) != 0)) {
+    sfree(copy);
+    close(fd);
+    us_connection_release();
+  }
+} /* }}} void us_conn_subscribe */
+
+static void us_conn_handle_event(us_event_thread_t *et, /* {{{ */
+                                 us_conn_t *c, uint32_t events) {
+  if (events & EPOLLERR) {
+    us_conn_close(et, c);
+    return;
+  }
+
+  /* Level triggered: read once per event, so busy clients don't starve the
+   * other connections of this thread. */
+  if ((events & (EPOLLIN | EPOLLHUP)) && !c->closing) {
+    /* Lines are null-terminated, parts of binary mode use the whole buffer. */
+    size_t in_size = (c->binary != NULL) ? sizeof(c->in) : sizeof(c->in) - 1;
+    ssize_t status = read(c->fd, c->in + c->in_len, in_size - c->in_len);
+    if (status > 0) {
+      char command[sizeof(c->in)];
+
+      c->in_len += (size_t)status;
+      status = us_conn_process(c, command, sizeof(command));
+      if (status == US_SUBSCRIBE) {
+        us_conn_subscribe(et, c, command);
+        return;
+      } else if (status != 0) {
+        us_conn_close(et, c);
+        return;
+      }
+    } else if (status == 0) {
+      /* Like fgets, execute a last line without a newline. An incomplete
+       * part of binary mode is discarded. */
+      if ((c->in_len > 0) && (c->binary == NULL)) {
+        char command[sizeof(c->in)];
+
+        c->in[c->in_len++] = '\n';
+        status = us_conn_process(c, command, sizeof(command));
+        if (status == US_SUBSCRIBE) {
+          us_conn_subscribe(et, c, command);
+          return;
+        }
+      }
+      c->closing = 1;
+    } else if ((errno != EINTR) && (errno != EAGAIN) &&
+               (errno != EWOULDBLOCK)) {
+      us_conn_close(et, c);
+      return;
+    }
+  }
+
+  int status = us_conn_flush(c);
+  if ((status < 0) || ((status == 0) && c->closing)) {
+    us_conn_close(et, c);
+    return;
+  }
+
+  /* Stop reading while output is pending, so the output buffer of a client
+   * that doesn't read its responses doesn't grow without bounds. */
+  uint32_t want = (status > 0) ? EPOLLOUT : EPOLLIN;
+  if (want != c->events) {
+    struct epoll_event ev = {.events = want, .data.ptr = c};
+    if (epoll_ctl(et->efd, EPOLL_CTL_MOD, c->fd, &ev) != 0) {
+      ERROR("unixsock plugin: epoll_ctl failed: %s", STRERRNO);
+      us_conn_close(et, c);
+      return;
+    }
+    c->events = want;
+  }
+} /* }}} void us_conn_handle_event */
+
+static void *us_event_thread(void *arg) /* {{{ */
+{
+  us_event_thread_t *et = arg;
+  struct epoll_event events[64];
+
+  while (loop != 0) {
+    int num = epoll_wait(et->efd, events, STATIC_ARRAY_SIZE(events),
+                         /* timeout = */ 1000);
+    if (num < 0) {
+      if (errno == EINTR)
+        continue;
+      ERROR("unixsock plugin: epoll_wait failed: %s", STRERRNO);
+      break;
+    }
+
+    for (int i = 0; i < num; i++)
+      us_conn_handle_event(et, events[i].data.ptr, events[i].events);
+  }
+
+  while (42) {
+    pthread_mutex_lock(&et->lock);
+    us_conn_t *c = et->conns;
+    pthread_mutex_unlock(&et->lock);
+    if (c == NULL)
+      break;
+    us_conn_close(et, c);
+  }
 
-  pthread_exit((void *)0);
   return (void *)0;
-} /* void *us_handle_client */
+} /* }}} void *us_event_thread */
+
+static int us_event_add(int fd) /* {{{ */
+{
+  static size_t next = 0;
+  us_event_thread_t *et = event_threads + (next++ % event_threads_started);
+
+  if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) != 0) {
+    WARNING("unixsock plugin: fcntl failed: %s", STRERRNO);
+    return -1;
+  }
+
+  us_conn_t *c = calloc(1, sizeof(*c));
+  if (c == NULL) {
+    WARNING("unixsock plugin: calloc failed: %s", STRERRNO);
+    return -1;
+  }
+  c->fd = fd;
+  c->events = EPOLLIN;
+
+  pthread_mutex_lock(&et->lock);
+  c->next = et->conns;
+  if (et->conns != NULL)
+    et->conns->prev = c;
+  et->conns = c;
+  pthread_mutex_unlock(&et->lock);
+
+  struct epoll_event ev = {.events = c->events, .data.ptr = c};
+  if (epoll_ctl(et->efd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+    WARNING("unixsock plugin: epoll_ctl failed: %s", STRERRNO);
+    us_conn_unlink(et, c);
+    sfree(c);
+    return -1;
+  }
+
+  return 0;
+} /* }}} int us_event_add */
+
+static int us_event_start(void) /* {{{ */
+{
+  event_threads = calloc((size_t)event_threads_num, sizeof(*event_threads));
+  if (event_threads == NULL) {
+    ERROR("unixsock plugin: calloc failed.");
+    return -1;
+  }
+
+  for (int i = 0; i < event_threads_num; i++) {
+    us_event_thread_t *et = event_threads + event_threads_started;
+
+    et->efd = epoll_create1(EPOLL_CLOEXEC);
+    if (et->efd < 0) {
+      ERROR("unixsock plugin: epoll_create1 failed: %s", STRERRNO);
+      break;
+    }
+    pthread_mutex_init(&et->lock, NULL);
+
+    if (plugin_thread_create(&et->thread, NULL, us_event_thread, et,
+                             "unixsock event") != 0) {
+      ERROR("unixsock plugin: pthread_create failed: %s", STRERRNO);
+      pthread_mutex_destroy(&et->lock);
+      close(et->efd);
+      break;
+    }
+    event_threads_started++;
+  }
+
+  if (event_threads_started == 0) {
+    sfree(event_threads);
+    return -1;
+  }
+  return 0;
+} /* }}} int us_event_start */
+
+static void us_event_stop(void) /* {{{ */
+{
+  for (size_t i = 0; i < event_threads_started; i++) {
+    pthread_join(event_threads[i].thread, NULL);
+    pthread_mutex_destroy(&event_threads[i].lock);
+    close(event_threads[i].efd);
+  }
+  event_threads_started = 0;
+  sfree(event_threads);
+} /* }}} void us_event_stop */
+#endif /* HAVE_SYS_EPOLL_H */
 
 static void *us_server_thread(void __attribute__((unused)) * arg) {
   int status;
-  int *remote_fd;
-  pthread_t th;
-  pthread_attr_t th_attr;
-
-  pthread_attr_init(&th_attr);
-  pthread_attr_setdetachstate(&th_attr, PTHREAD_CREATE_DETACHED);
+  int remote_fd;
 
   if (us_open_socket() != 0)
     pthread_exit((void *)1);
@@ -294,33 +1165,33 @@ static void *us_server_thread(void __attribute__((unused)) * arg) {
       ERROR("unixsock plugin: accept failed: %s", STRERRNO);
       close(sock_fd);
       sock_fd = -1;
-      pthread_attr_destroy(&th_attr);
       pthread_exit((void *)1);
     }
+    remote_fd = status;
 
-    remote_fd = malloc(sizeof(*remote_fd));
-    if (remote_fd == NULL) {
-      WARNING("unixsock plugin: malloc failed: %s", STRERRNO);
-      close(status);
+    if (us_connection_acquire() != 0) {
+      static char const msg[] = "-1 Too many connections\n";
+      if (write(remote_fd, msg, sizeof(msg) - 1) < 0)
+        DEBUG("unixsock plugin: write failed: %s", STRERRNO);
+      close(remote_fd);
       continue;
     }
-    *remote_fd = status;
-
-    DEBUG("Spawning child to handle connection on fd #%i", *remote_fd);
 
-    status = plugin_thread_create(&th, &th_attr, us_handle_client,
-                                  (void *)remote_fd, "unixsock conn");
+#if HAVE_SYS_EPOLL_H
+    if (event_threads_started > 0)
+      status = us_event_add(remote_fd);
+    else
+#endif
+      status = us_spawn_client(remote_fd, /* command = */ NULL);
     if (status != 0) {
-      WARNING("unixsock plugin: pthread_create failed: %s", STRERRNO);
-      close(*remote_fd);
-      free(remote_fd);
+      close(remote_fd);
+      us_connection_release();
       continue;
     }
   } /* while (loop) */
 
   close(sock_fd);
   sock_fd = -1;
-  pthread_attr_destroy(&th_attr);
 
   status = unlink((sock_file != NULL) ? sock_file : US_DEFAULT_PATH);
   if (status != 0) {
@@ -353,6 +1224,34 @@ static int us_config(const char *key, const char *val) {
       delete_socket = 1;
     else
       delete_socket = 0;
+  } else if (strcasecmp(key, "SubscribeQueueLength") == 0) {
+    long tmp = atol(val);
+    if (tmp < 1) {
+      WARNING("unixsock plugin: SubscribeQueueLength must be positive.");
+      return 1;
+    }
+    subscribe_queue_length = (size_t)tmp;
+  } else if (strcasecmp(key, "SubscribeMaxDropped") == 0) {
+    long long tmp = atoll(val);
+    subscribe_max_dropped = (tmp > 0) ? (uint64_t)tmp : 0;
+  } else if (strcasecmp(key, "EventLoop") == 0) {
+#if HAVE_SYS_EPOLL_H
+    event_loop = IS_TRUE(val) ? 1 : 0;
+#else
+    if (IS_TRUE(val))
+      WARNING("unixsock plugin: EventLoop is not supported on this system; "
+              "using one thread per connection.");
+#endif
+  } else if (strcasecmp(key, "EventThreads") == 0) {
+    int tmp = atoi(val);
+    if (tmp < 1) {
+      WARNING("unixsock plugin: EventThreads must be positive.");
+      return 1;
+    }
+    event_threads_num = tmp;
+  } else if (strcasecmp(key, "MaxConnections") == 0) {
+    int tmp = atoi(val);
+    max_connections = (tmp > 0) ? tmp : 0;
   } else {
     return -1;
   }
@@ -372,6 +1271,15 @@ static int us_init(void) {
 
   loop = 1;
 
+  pthread_attr_init(&client_attr);
+  pthread_attr_setdetachstate(&client_attr, PTHREAD_CREATE_DETACHED);
+
+#if HAVE_SYS_EPOLL_H
+  if (event_loop && (us_event_start() != 0))
+    WARNING("unixsock plugin: Starting the event threads failed; "
+            "using one thread per connection.");
+#endif
+
   status = plugin_thread_create(&listen_thread, NULL, us_server_thread, NULL,
                                 "unixsock listen");
   if (status != 0) {
@@ -387,13 +1295,37 @@ static int us_shutdown(void) {
 
   loop = 0;
 
+  /* Wake up subscribers blocked on the socket; their threads clean up. */
+  pthread_mutex_lock(&subscribers_lock);
+  for (us_subscriber_t *s = subscribers; s != NULL; s = s->next) {
+    shutdown(s->fd, SHUT_RDWR);
+    pthread_cond_signal(&s->cond);
+  }
+  if ((subscribers_disconnected > 0) || (subscribe_values_dropped > 0))
+    INFO("unixsock plugin: %" PRIu64 " slow subscribers were disconnected, "
+         "%" PRIu64 " values were dropped.",
+         subscribers_disconnected, subscribe_values_dropped);
+  pthread_mutex_unlock(&subscribers_lock);
+
   if (listen_thread != (pthread_t)0) {
     pthread_kill(listen_thread, SIGTERM);
     pthread_join(listen_thread, &ret);
     listen_thread = (pthread_t)0;
   }
 
+#if HAVE_SYS_EPOLL_H
+  us_event_stop();
+#endif
+
+  pthread_mutex_lock(&connections_lock);
+  if (connections_refused > 0)
+    INFO("unixsock plugin: %" PRIu64 " connections were refused because "
+         "MaxConnections was reached.",
+         connections_refused);
+  pthread_mutex_unlock(&connections_lock);
+
   plugin_unregister_init("unixsock");
+  plugin_unregister_write("unixsock");
   plugin_unregister_shutdown("unixsock");
 
   return 0;
@@ -402,5 +1334,6 @@ static int us_shutdown(void) {
 void module_register(void) {
   plugin_register_config("unixsock", us_config, config_keys, config_keys_num);
   plugin_register_init("unixsock", us_init);
+  plugin_register_write("unixsock", us_write, /* user data = */ NULL);
   plugin_register_shutdown("unixsock", us_shutdown);
 } /* void module_register (void) */
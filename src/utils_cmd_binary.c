@@ -0,0 +1,264 @@
+/**
+ * collectd - src/utils_cmd_binary.c
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "common.h"
+#include "network.h" /* for the part types */
+#include "plugin.h"
+
+#include "utils_cmd_binary.h"
+#include "utils_parse_option.h" /* for `parse_string' */
+
+#if HAVE_ARPA_INET_H
+#include <arpa/inet.h>
+#endif
+
+#define print_to_socket(fh, ...)                                               \
+  do {                                                                         \
+    if (fprintf(fh, __VA_ARGS__) < 0) {                                        \
+      WARNING("handle_binary: failed to write to socket #%i: %s", fileno(fh),  \
+              STRERRNO);                                                       \
+      return -1;                                                               \
+    }                                                                          \
+  } while (0)
+
+void cmd_binary_init(cmd_binary_t *b) /* {{{ */
+{
+  memset(b, 0, sizeof(*b));
+  b->vl.values = b->values;
+} /* }}} void cmd_binary_init */
+
+cmd_status_t cmd_binary_part_size(void const *buffer, /* {{{ */
+                                  size_t buffer_size, size_t *ret_size,
+                                  cmd_error_handler_t *err) {
+  uint16_t tmp16;
+
+  *ret_size = 0;
+  if (buffer_size < CMD_BINARY_HEADER_SIZE)
+    return CMD_OK;
+
+  memcpy(&tmp16, (char const *)buffer + sizeof(tmp16), sizeof(tmp16));
+  size_t size = (size_t)ntohs(tmp16);
+  if ((size < CMD_BINARY_HEADER_SIZE) || (size > CMD_BINARY_PART_MAX)) {
+    cmd_error(CMD_PARSE_ERROR, err,
+              "Invalid part size %" PRIsz " (expected %i-%i bytes).", size,
+              CMD_BINARY_HEADER_SIZE, CMD_BINARY_PART_MAX);
+    return CMD_PARSE_ERROR;
+  }
+
+  *ret_size = size;
+  return CMD_OK;
+} /* }}} cmd_status_t cmd_binary_part_size */
+
+static cmd_status_t cmd_binary_string(char *output, /* {{{ */
+                                      size_t output_size, char const *payload,
+                                      size_t payload_size,
+                                      cmd_error_handler_t *err) {
+  if ((payload_size == 0) || (payload_size > output_size) ||
+      (payload[payload_size - 1] != 0)) {
+    cmd_error(CMD_PARSE_ERROR, err,
+              "Invalid string part: expected a null-terminated string of at "
+              "most %" PRIsz " bytes.",
+              output_size);
+    return CMD_PARSE_ERROR;
+  }
+
+  memcpy(output, payload, payload_size);
+  return CMD_OK;
+} /* }}} cmd_status_t cmd_binary_string */
+
+static cmd_status_t cmd_binary_number(uint64_t *ret_value, /* {{{ */
+                                      char const *payload, size_t payload_size,
+                                      cmd_error_handler_t *err) {
+  uint64_t tmp64;
+
+  if (payload_size != sizeof(tmp64)) {
+    cmd_error(CMD_PARSE_ERROR, err,
+              "Invalid number part: expected %" PRIsz " bytes, got %" PRIsz
+              ".",
+              sizeof(tmp64), payload_size);
+    return CMD_PARSE_ERROR;
+  }
+
+  memcpy(&tmp64, payload, sizeof(tmp64));
+  *ret_value = ntohll(tmp64);
+  return CMD_OK;
+} /* }}} cmd_status_t cmd_binary_number */
+
+static cmd_status_t cmd_binary_values(cmd_binary_t *b, /* {{{ */
+                                      char const *payload, size_t payload_size,
+                                      cmd_error_handler_t *err) {
+  uint16_t tmp16;
+  size_t num = 0;
+
+  if (payload_size >= sizeof(tmp16)) {
+    memcpy(&tmp16, payload, sizeof(tmp16));
+    num = (size_t)ntohs(tmp16);
+  }
+  if ((num == 0) || (num > STATIC_ARRAY_SIZE(b->values)) ||
+      (payload_size != sizeof(tmp16) + num * (1 + sizeof(value_t)))) {
+    cmd_error(CMD_PARSE_ERROR, err,
+              "Invalid values part: size and number of values don't match.");
+    return CMD_PARSE_ERROR;
+  }
+
+  uint8_t const *types = (uint8_t const *)(payload + sizeof(tmp16));
+  char const *values = payload + sizeof(tmp16) + num;
+  for (size_t i = 0; i < num; i++) {
+    uint64_t tmp64;
+
+    memcpy(&tmp64, values + i * sizeof(tmp64), sizeof(tmp64));
+    switch (types[i]) {
+    case DS_TYPE_COUNTER:
+      b->values[i].counter = (counter_t)ntohll(tmp64);
+      break;
+    case DS_TYPE_DERIVE:
+      b->values[i].derive = (derive_t)ntohll(tmp64);
+      break;
+    case DS_TYPE_ABSOLUTE:
+      b->values[i].absolute = (absolute_t)ntohll(tmp64);
+      break;
+    case DS_TYPE_GAUGE:
+      /* Gauges are sent in x86 byte order, see htond(). */
+      memcpy(&b->values[i].gauge, &tmp64, sizeof(tmp64));
+      b->values[i].gauge = ntohd(b->values[i].gauge);
+      break;
+    default:
+      cmd_error(CMD_PARSE_ERROR, err, "Unknown data source type %" PRIu8 ".",
+                types[i]);
+      return CMD_PARSE_ERROR;
+    }
+  }
+  b->vl.values_len = num;
+
+  /* Errors, e.g. unknown types, are logged by the daemon. Like PUTVAL, they
+   * don't end the connection. */
+  plugin_dispatch_values(&b->vl);
+  return CMD_OK;
+} /* }}} cmd_status_t cmd_binary_values */
+
+cmd_status_t cmd_binary_part(cmd_binary_t *b, void const *part, /* {{{ */
+                             size_t part_size, cmd_error_handler_t *err) {
+  char const *payload = (char const *)part + CMD_BINARY_HEADER_SIZE;
+  size_t payload_size;
+  uint16_t tmp16;
+  uint64_t tmp64 = 0;
+  cmd_status_t status;
+
+  size_t size;
+  status = cmd_binary_part_size(part, part_size, &size, err);
+  if (status != CMD_OK)
+    return status;
+  if (size != part_size) {
+    cmd_error(CMD_PARSE_ERROR, err,
+              "Part size mismatch: header claims %" PRIsz " bytes, got %" PRIsz
+              ".",
+              size, part_size);
+    return CMD_PARSE_ERROR;
+  }
+  payload_size = part_size - CMD_BINARY_HEADER_SIZE;
+
+  memcpy(&tmp16, part, sizeof(tmp16));
+  switch (ntohs(tmp16)) {
+  case TYPE_HOST:
+    return cmd_binary_string(b->vl.host, sizeof(b->vl.host), payload,
+                             payload_size, err);
+  case TYPE_PLUGIN:
+    return cmd_binary_string(b->vl.plugin, sizeof(b->vl.plugin), payload,
+                             payload_size, err);
+  case TYPE_PLUGIN_INSTANCE:
+    return cmd_binary_string(b->vl.plugin_instance,
+                             sizeof(b->vl.plugin_instance), payload,
+                             payload_size, err);
+  case TYPE_TYPE:
+    status = cmd_binary_string(b->vl.type, sizeof(b->vl.type), payload,
+                               payload_size, err);
+    /* Resolve the data set once per type part, not once per value list. */
+    if (status == CMD_OK)
+      b->vl.type_id = plugin_get_ds_id(b->vl.type);
+    return status;
+  case TYPE_TYPE_INSTANCE:
+    return cmd_binary_string(b->vl.type_instance, sizeof(b->vl.type_instance),
+                             payload, payload_size, err);
+  case TYPE_TIME:
+    status = cmd_binary_number(&tmp64, payload, payload_size, err);
+    if (status == CMD_OK)
+      b->vl.time = TIME_T_TO_CDTIME_T(tmp64);
+    return status;
+  case TYPE_TIME_HR:
+    status = cmd_binary_number(&tmp64, payload, payload_size, err);
+    if (status == CMD_OK)
+      b->vl.time = (cdtime_t)tmp64;
+    return status;
+  case TYPE_INTERVAL:
+    status = cmd_binary_number(&tmp64, payload, payload_size, err);
+    if (status == CMD_OK)
+      b->vl.interval = TIME_T_TO_CDTIME_T(tmp64);
+    return status;
+  case TYPE_INTERVAL_HR:
+    status = cmd_binary_number(&tmp64, payload, payload_size, err);
+    if (status == CMD_OK)
+      b->vl.interval = (cdtime_t)tmp64;
+    return status;
+  case TYPE_VALUES:
+    return cmd_binary_values(b, payload, payload_size, err);
+  default:
+    return CMD_OK;
+  }
+} /* }}} cmd_status_t cmd_binary_part */
+
+int handle_binary(FILE *fh, char *buffer) /* {{{ */
+{
+  char *command;
+  int status;
+
+  if ((fh == NULL) || (buffer == NULL))
+    return -1;
+
+  DEBUG("utils_cmd_binary: handle_binary (fh = %p, buffer = %s);", (void *)fh,
+        buffer);
+
+  command = NULL;
+  status = parse_string(&buffer, &command);
+  if (status != 0) {
+    print_to_socket(fh, "-1 Cannot parse command.\n");
+    return -1;
+  }
+  assert(command != NULL);
+
+  if (strcasecmp("BINARY", command) != 0) {
+    print_to_socket(fh, "-1 Unexpected command: `%s'.\n", command);
+    return -1;
+  }
+
+  if (*buffer != 0) {
+    print_to_socket(fh, "-1 Garbage after end of command: %s\n", buffer);
+    return -1;
+  }
+
+  print_to_socket(fh, "0 Switching to binary mode\n");
+  fflush(fh);
+
+  return 0;
+} /* }}} int handle_binary */
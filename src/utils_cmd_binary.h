@@ -0,0 +1,103 @@
+/**
+ * collectd - src/utils_cmd_binary.h
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef UTILS_CMD_BINARY_H
+#define UTILS_CMD_BINARY_H 1
+
+#include "plugin.h"
+#include "utils_cmds.h"
+
+#include <stdio.h>
+
+/* Maximum size of a part, including its header. Limits the number of values
+ * of a TYPE_VALUES part to 113. */
+#define CMD_BINARY_PART_MAX 1024
+
+/* Size of a part's header, the type and the length. */
+#define CMD_BINARY_HEADER_SIZE 4
+
+/*
+ * NAME
+ *   cmd_binary_t
+ *
+ * DESCRIPTION
+ *   The decoding state of a connection in binary mode. Like in a network
+ *   packet, the identifier, time and interval set by previous parts apply to
+ *   all following TYPE_VALUES parts. After a TYPE_VALUES part has been
+ *   handled, `vl' holds the value list that was dispatched.
+ */
+typedef struct {
+  value_list_t vl;
+  value_t values[(CMD_BINARY_PART_MAX - 6) / 9];
+} cmd_binary_t;
+
+void cmd_binary_init(cmd_binary_t *b);
+
+/*
+ * NAME
+ *   cmd_binary_part_size
+ *
+ * DESCRIPTION
+ *   Reads the size of the part starting at `buffer' from its header.
+ *
+ * RETURN VALUE
+ *   CMD_OK on success, with the size, including the header, stored in
+ *   `ret_size'. Zero is stored if `buffer_size' is smaller than the header.
+ *   CMD_PARSE_ERROR, which is reported to `err', if the size is invalid.
+ */
+cmd_status_t cmd_binary_part_size(void const *buffer, size_t buffer_size,
+                                  size_t *ret_size, cmd_error_handler_t *err);
+
+/*
+ * NAME
+ *   cmd_binary_part
+ *
+ * DESCRIPTION
+ *   Decodes a complete part, as sent by the network plugin, and dispatches
+ *   the values of TYPE_VALUES parts. Strings and numbers are read directly
+ *   from `part' and no memory is allocated. Parts of unknown types, as well
+ *   as signatures, encryption and compression, are skipped.
+ *
+ * RETURN VALUE
+ *   CMD_OK on success. CMD_PARSE_ERROR, which is reported to `err', if the
+ *   part is malformed and the connection has to be closed. Values that could
+ *   not be dispatched, e.g. because of an unknown type, are not an error.
+ */
+cmd_status_t cmd_binary_part(cmd_binary_t *b, void const *part,
+                             size_t part_size, cmd_error_handler_t *err);
+
+/*
+ * NAME
+ *   handle_binary
+ *
+ * DESCRIPTION
+ *   Handles the BINARY command, which switches a connection to binary mode.
+ *   On success, "0 Switching to binary mode" is written to `fh' and the
+ *   caller decodes all further input with cmd_binary_part().
+ *
+ * RETURN VALUE
+ *   Zero if the connection switches to binary mode, non-zero otherwise.
+ */
+int handle_binary(FILE *fh, char *buffer);
+
+#endif /* UTILS_CMD_BINARY_H */
@@ -0,0 +1,99 @@
+/**
+ * collectd - src/utils_cmd_dispatchstats.c
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "common.h"
+#include "plugin.h"
+
+#include "utils_cmd_dispatchstats.h"
+#include "utils_parse_option.h" /* for `parse_string' */
+
+#define print_to_socket(fh, ...)                                               \
+  do {                                                                         \
+    if (fprintf(fh, __VA_ARGS__) < 0) {                                        \
+      WARNING("handle_dispatchstats: failed to write to socket #%i: %s",       \
+              fileno(fh), STRERRNO);                                           \
+      plugin_dispatch_stats_free(stats, stats_num);                            \
+      return -1;                                                               \
+    }                                                                          \
+  } while (0)
+
+int handle_dispatchstats(FILE *fh, char *buffer) {
+  plugin_dispatch_stats_t *stats = NULL;
+  size_t stats_num = 0;
+  char *command;
+  int status;
+
+  if ((fh == NULL) || (buffer == NULL))
+    return -1;
+
+  DEBUG("utils_cmd_dispatchstats: handle_dispatchstats (fh = %p, "
+        "buffer = %s);",
+        (void *)fh, buffer);
+
+  command = NULL;
+  status = parse_string(&buffer, &command);
+  if (status != 0) {
+    print_to_socket(fh, "-1 Cannot parse command.\n");
+    return -1;
+  }
+  assert(command != NULL);
+
+  if (strcasecmp("DISPATCHSTATS", command) != 0) {
+    print_to_socket(fh, "-1 Unexpected command: `%s'.\n", command);
+    return -1;
+  }
+
+  if (*buffer != 0) {
+    print_to_socket(fh, "-1 Garbage after end of command: %s\n", buffer);
+    return -1;
+  }
+
+  status = plugin_get_dispatch_stats(&stats, &stats_num);
+  if (status == ENOTSUP) {
+    print_to_socket(fh, "-1 Dispatch latency sampling is disabled, "
+                        "see the DispatchLatencySampling option.\n");
+    return -1;
+  } else if (status != 0) {
+    print_to_socket(fh, "-1 Error while collecting dispatch statistics: %i\n",
+                    status);
+    return -1;
+  }
+
+  print_to_socket(fh, "%i Stage%s found\n", (int)stats_num,
+                  (stats_num == 1) ? "" : "s");
+  for (size_t i = 0; i < stats_num; i++) {
+    plugin_dispatch_stats_t *st = stats + i;
+
+    print_to_socket(fh,
+                    "%s samples=%" PRIsz " average=%.6f max=%.6f p99=%.6f\n",
+                    st->name, st->num, CDTIME_T_TO_DOUBLE(st->average),
+                    CDTIME_T_TO_DOUBLE(st->max), CDTIME_T_TO_DOUBLE(st->p99));
+  }
+
+  plugin_dispatch_stats_free(stats, stats_num);
+  fflush(fh);
+
+  return 0;
+} /* int handle_dispatchstats */
@@ -95,6 +95,31 @@ cmd_status_t cmd_parse_flush(size_t argc, char **argv, cmd_flush_t *ret_flush,
       } else if (ret_flush->timeout < 0.0) {
         ret_flush->timeout = 0.0;
       }
+    } else if (strcasecmp("deadline", opt_key) == 0) {
+      char *endptr;
+
+      errno = 0;
+      endptr = NULL;
+      ret_flush->deadline = strtod(opt_value, &endptr);
+
+      if ((endptr == opt_value) || (errno != 0) ||
+          (!isfinite(ret_flush->deadline)) || (ret_flush->deadline <= 0.0)) {
+        cmd_error(CMD_PARSE_ERROR, err,
+                  "Invalid value for option `deadline': %s", opt_value);
+        cmd_destroy_flush(ret_flush);
+        return CMD_PARSE_ERROR;
+      }
+    } else if (strcasecmp("report", opt_key) == 0) {
+      if (IS_TRUE(opt_value)) {
+        ret_flush->report = 1;
+      } else if (IS_FALSE(opt_value)) {
+        ret_flush->report = 0;
+      } else {
+        cmd_error(CMD_PARSE_ERROR, err,
+                  "Invalid value for option `report': %s", opt_value);
+        cmd_destroy_flush(ret_flush);
+        return CMD_PARSE_ERROR;
+      }
     } else {
       cmd_error(CMD_PARSE_ERROR, err, "Cannot parse option `%s'.", opt_key);
       cmd_destroy_flush(ret_flush);
@@ -105,6 +130,32 @@ cmd_status_t cmd_parse_flush(size_t argc, char **argv, cmd_flush_t *ret_flush,
   return CMD_OK;
 } /* cmd_status_t cmd_parse_flush */
 
+#define print_to_socket(fh, ...)                                               \
+  do {                                                                         \
+    if (fprintf(fh, __VA_ARGS__) < 0) {                                        \
+      WARNING("cmd_handle_flush: failed to write to socket #%i: %s",           \
+              fileno(fh), STRERRNO);                                           \
+      strarray_free(lines, lines_num);                                         \
+      cmd_destroy(&cmd);                                                       \
+      return CMD_ERROR;                                                        \
+    }                                                                          \
+    fflush(fh);                                                                \
+  } while (0)
+
+static const char *flush_outcome(int status) /* {{{ */
+{
+  switch (status) {
+  case 0:
+    return "ok";
+  case EBUSY:
+    return "busy";
+  case ETIMEDOUT:
+    return "timeout";
+  default:
+    return "error";
+  }
+} /* }}} const char *flush_outcome */
+
 cmd_status_t cmd_handle_flush(FILE *fh, char *buffer) {
   cmd_error_handler_t err = {cmd_error_fh, fh};
   cmd_t cmd;
@@ -113,6 +164,10 @@ cmd_status_t cmd_handle_flush(FILE *fh, char *buffer) {
   int error = 0;
   int status;
 
+  /* One line per flush callback that has been called. */
+  char **lines = NULL;
+  size_t lines_num = 0;
+
   if ((fh == NULL) || (buffer == NULL))
     return -1;
 
@@ -128,6 +183,8 @@ cmd_status_t cmd_handle_flush(FILE *fh, char *buffer) {
     return CMD_UNKNOWN_COMMAND;
   }
 
+  cdtime_t deadline = DOUBLE_TO_CDTIME_T(cmd.cmd.flush.deadline);
+
   for (size_t i = 0; (i == 0) || (i < cmd.cmd.flush.plugins_num); i++) {
     char *plugin = NULL;
 
@@ -149,19 +206,48 @@ cmd_status_t cmd_handle_flush(FILE *fh, char *buffer) {
         identifier = buf;
       }
 
-      if (plugin_flush(plugin, DOUBLE_TO_CDTIME_T(cmd.cmd.flush.timeout),
-                       identifier) == 0)
-        success++;
-      else
+      plugin_flush_result_t *results = NULL;
+      size_t results_num = 0;
+      if (plugin_flush_results(plugin,
+                               DOUBLE_TO_CDTIME_T(cmd.cmd.flush.timeout),
+                               identifier, deadline, &results,
+                               &results_num) != 0) {
         error++;
+        continue;
+      }
+
+      for (size_t k = 0; k < results_num; k++) {
+        char line[1536];
+
+        if (results[k].status == 0)
+          success++;
+        else
+          error++;
+
+        if (!cmd.cmd.flush.report)
+          continue;
+
+        snprintf(line, sizeof(line), "%s%s%s outcome=%s status=%i "
+                                     "duration=%.3f",
+                 results[k].name, (identifier != NULL) ? " identifier=" : "",
+                 (identifier != NULL) ? identifier : "",
+                 flush_outcome(results[k].status), results[k].status,
+                 CDTIME_T_TO_DOUBLE(results[k].duration));
+        strarray_add(&lines, &lines_num, line);
+      }
+      plugin_flush_results_free(results, results_num);
     }
   }
 
-  cmd_error(CMD_OK, &err, "Done: %i successful, %i errors", success, error);
+  print_to_socket(fh, "%" PRIsz " Done: %i successful, %i errors\n", lines_num,
+                  success, error);
+  for (size_t i = 0; i < lines_num; i++)
+    print_to_socket(fh, "%s\n", lines[i]);
 
+  strarray_free(lines, lines_num);
   cmd_destroy(&cmd);
   return 0;
-#undef PRINT_TO_SOCK
+#undef print_to_socket
 } /* cmd_status_t cmd_handle_flush */
 
 void cmd_destroy_flush(cmd_flush_t *flush) {
@@ -85,12 +85,52 @@ cmd_status_t cmd_parse_getval(size_t argc, char **argv,
     fflush(fh);                                                                \
   } while (0)
 
+/* Looks up the values of a parsed GETVAL command in the cache. On failure, a
+ * single line describing the error is reported via err. */
+static cmd_status_t getval_lookup(cmd_getval_t *getval, /* {{{ */
+                                  const data_set_t **ret_ds,
+                                  gauge_t **ret_values,
+                                  cmd_error_handler_t *err) {
+  const data_set_t *ds;
+  gauge_t *values = NULL;
+  size_t values_num = 0;
+  int status;
+
+  ds = plugin_get_ds(getval->identifier.type);
+  if (ds == NULL) {
+    DEBUG("cmd_handle_getval: plugin_get_ds (%s) == NULL;",
+          getval->identifier.type);
+    cmd_error(CMD_ERROR, err, "Type `%s' is unknown.",
+              getval->identifier.type);
+    return CMD_ERROR;
+  }
+
+  status = uc_get_rate_by_name(getval->raw_identifier, &values, &values_num);
+  if (status != 0) {
+    cmd_error(CMD_ERROR, err, "No such value.");
+    return CMD_ERROR;
+  }
+
+  if (ds->ds_num != values_num) {
+    ERROR("ds[%s]->ds_num = %" PRIsz ", "
+          "but uc_get_rate_by_name returned %" PRIsz " values.",
+          ds->type, ds->ds_num, values_num);
+    cmd_error(CMD_ERROR, err, "Error reading value from cache.");
+    sfree(values);
+    return CMD_ERROR;
+  }
+
+  *ret_ds = ds;
+  *ret_values = values;
+  return CMD_OK;
+} /* }}} cmd_status_t getval_lookup */
+
 cmd_status_t cmd_handle_getval(FILE *fh, char *buffer) {
   cmd_error_handler_t err = {cmd_error_fh, fh};
   cmd_status_t status;
   cmd_t cmd;
 
-  gauge_t *values;
+  gauge_t *values = NULL;
   size_t values_num;
 
   const data_set_t *ds;
@@ -110,35 +150,12 @@ cmd_status_t cmd_handle_getval(FILE *fh, char *buffer) {
     return CMD_UNKNOWN_COMMAND;
   }
 
-  ds = plugin_get_ds(cmd.cmd.getval.identifier.type);
-  if (ds == NULL) {
-    DEBUG("cmd_handle_getval: plugin_get_ds (%s) == NULL;",
-          cmd.cmd.getval.identifier.type);
-    cmd_error(CMD_ERROR, &err, "Type `%s' is unknown.\n",
-              cmd.cmd.getval.identifier.type);
-    cmd_destroy(&cmd);
-    return -1;
-  }
-
-  values = NULL;
-  values_num = 0;
-  status =
-      uc_get_rate_by_name(cmd.cmd.getval.raw_identifier, &values, &values_num);
-  if (status != 0) {
-    cmd_error(CMD_ERROR, &err, "No such value.");
-    cmd_destroy(&cmd);
-    return CMD_ERROR;
-  }
-
-  if (ds->ds_num != values_num) {
-    ERROR("ds[%s]->ds_num = %" PRIsz ", "
-          "but uc_get_rate_by_name returned %" PRIsz " values.",
-          ds->type, ds->ds_num, values_num);
-    cmd_error(CMD_ERROR, &err, "Error reading value from cache.");
-    sfree(values);
+  status = getval_lookup(&cmd.cmd.getval, &ds, &values, &err);
+  if (status != CMD_OK) {
     cmd_destroy(&cmd);
-    return CMD_ERROR;
+    return status;
   }
+  values_num = ds->ds_num;
 
   print_to_socket(fh, "%" PRIsz " Value%s found\n", values_num,
                   (values_num == 1) ? "" : "s");
@@ -157,6 +174,66 @@ cmd_status_t cmd_handle_getval(FILE *fh, char *buffer) {
   return CMD_OK;
 } /* cmd_status_t cmd_handle_getval */
 
+cmd_status_t cmd_handle_getvals(FILE *fh, char **lines, /* {{{ */
+                                size_t lines_num) {
+  cmd_error_handler_t err = {cmd_error_fh, fh};
+
+  if ((fh == NULL) || ((lines == NULL) && (lines_num > 0)))
+    return -1;
+
+  DEBUG("utils_cmd_getval: cmd_handle_getvals (fh = %p, lines_num = %" PRIsz
+        ");",
+        (void *)fh, lines_num);
+
+  if (fprintf(fh, "%" PRIsz " Result%s follow\n", lines_num,
+              (lines_num == 1) ? "" : "s") < 0)
+    goto write_error;
+
+  /* One line per identifier: the number of values followed by name=value
+   * pairs, or the error status and message. */
+  for (size_t i = 0; i < lines_num; i++) {
+    char buffer[1024];
+    const data_set_t *ds;
+    gauge_t *values = NULL;
+    cmd_t cmd;
+
+    snprintf(buffer, sizeof(buffer), "GETVAL %s", lines[i]);
+    if (cmd_parse(buffer, &cmd, NULL, &err) != CMD_OK)
+      continue;
+    if (cmd.type != CMD_GETVAL) {
+      cmd_error(CMD_UNKNOWN_COMMAND, &err, "Unexpected command: `%s'.",
+                CMD_TO_STRING(cmd.type));
+      cmd_destroy(&cmd);
+      continue;
+    }
+
+    if (getval_lookup(&cmd.cmd.getval, &ds, &values, &err) != CMD_OK) {
+      cmd_destroy(&cmd);
+      continue;
+    }
+    cmd_destroy(&cmd);
+
+    int status = fprintf(fh, "%" PRIsz, ds->ds_num);
+    for (size_t j = 0; (status >= 0) && (j < ds->ds_num); j++) {
+      if (isnan(values[j]))
+        status = fprintf(fh, " %s=NaN", ds->ds[j].name);
+      else
+        status = fprintf(fh, " %s=%e", ds->ds[j].name, values[j]);
+    }
+    sfree(values);
+    if ((status < 0) || (fprintf(fh, "\n") < 0))
+      goto write_error;
+  }
+
+  fflush(fh);
+  return CMD_OK;
+
+write_error:
+  WARNING("cmd_handle_getvals: failed to write to socket #%i: %s",
+          fileno(fh), STRERRNO);
+  return CMD_ERROR;
+} /* }}} cmd_status_t cmd_handle_getvals */
+
 void cmd_destroy_getval(cmd_getval_t *getval) {
   if (getval == NULL)
     return;
@@ -38,6 +38,10 @@ cmd_status_t cmd_parse_getval(size_t argc, char **argv,
 
 cmd_status_t cmd_handle_getval(FILE *fh, char *buffer);
 
+/* Handles the lines of a GETVALS command. Each line holds the argument of one
+ * GETVAL command, i.e. an identifier. */
+cmd_status_t cmd_handle_getvals(FILE *fh, char **lines, size_t lines_num);
+
 void cmd_destroy_getval(cmd_getval_t *getval);
 
 #endif /* UTILS_CMD_GETVAL_H */
@@ -33,29 +33,41 @@
 #include "utils_cmd_listval.h"
 #include "utils_parse_option.h"
 
+#include <fnmatch.h>
+
 cmd_status_t cmd_parse_listval(size_t argc, char **argv,
-                               cmd_listval_t *ret_listval
-                               __attribute__((unused)),
+                               cmd_listval_t *ret_listval,
                                const cmd_options_t *opts
                                __attribute__((unused)),
                                cmd_error_handler_t *err) {
-  if (argc != 0) {
+  if (argc > 1) {
     cmd_error(CMD_PARSE_ERROR, err, "Garbage after end of command: `%s'.",
-              argv[0]);
+              argv[1]);
     return CMD_PARSE_ERROR;
   }
 
+  if (argc == 0)
+    return CMD_OK;
+
+  if (argv[0][0] == 0) {
+    cmd_error(CMD_PARSE_ERROR, err, "Empty identifier pattern.");
+    return CMD_PARSE_ERROR;
+  }
+
+  ret_listval->pattern = strdup(argv[0]);
+  if (ret_listval->pattern == NULL) {
+    cmd_error(CMD_ERROR, err, "strdup failed.");
+    return CMD_ERROR;
+  }
+
   return CMD_OK;
 } /* cmd_status_t cmd_parse_listval */
 
 #define free_everything_and_return(status)                                     \
   do {                                                                         \
-    for (size_t j = 0; j < number; j++) {                                      \
-      sfree(names[j]);                                                         \
-      names[j] = NULL;                                                         \
-    }                                                                          \
-    sfree(names);                                                              \
-    sfree(times);                                                              \
+    cmd_destroy(&cmd);                                                         \
+    uc_snapshot_destroy(snapshot);                                             \
+    sfree(listed);                                                             \
     return status;                                                             \
   } while (0)
 
@@ -66,18 +78,21 @@ cmd_status_t cmd_parse_listval(size_t argc, char **argv,
               STRERRNO);                                                       \
       free_everything_and_return(CMD_ERROR);                                   \
     }                                                                          \
-    fflush(fh);                                                                \
   } while (0)
 
 cmd_status_t cmd_handle_listval(FILE *fh, char *buffer) {
   cmd_error_handler_t err = {cmd_error_fh, fh};
   cmd_status_t status;
-  cmd_t cmd;
+  cmd_t cmd = {0};
 
-  char **names = NULL;
-  cdtime_t *times = NULL;
+  uc_snapshot_t *snapshot = NULL;
+  uint8_t *listed = NULL; /* one bit per snapshot entry */
   size_t number = 0;
 
+  const char *name;
+  cdtime_t time;
+  int state;
+
   DEBUG("utils_cmd_listval: handle_listval (fh = %p, buffer = %s);", (void *)fh,
         buffer);
 
@@ -89,21 +104,49 @@ cmd_status_t cmd_handle_listval(FILE *fh, char *buffer) {
     free_everything_and_return(CMD_UNKNOWN_COMMAND);
   }
 
-  status = uc_get_names(&names, &times, &number);
-  if (status != 0) {
-    DEBUG("command listval: uc_get_names failed with status %i", status);
-    cmd_error(CMD_ERROR, &err, "uc_get_names failed.");
+  /* Stream the names from a snapshot of the cache instead of copying them.
+   * The number of values has to be sent first, so the snapshot is iterated
+   * twice. Which values are listed is decided in the first pass, because
+   * their state may change in between. */
+  snapshot = uc_snapshot_create();
+  if (snapshot != NULL)
+    listed = calloc(uc_snapshot_size(snapshot) / 8 + 1, sizeof(*listed));
+  if ((snapshot == NULL) || (listed == NULL)) {
+    DEBUG("command listval: Creating a snapshot of the cache failed.");
+    cmd_error(CMD_ERROR, &err, "uc_snapshot_create failed.");
     free_everything_and_return(CMD_ERROR);
   }
 
+  for (size_t i = 0; (i < uc_snapshot_size(snapshot)) &&
+                     (uc_snapshot_next(snapshot, &name, NULL, &state) == 0);
+       i++) {
+    if (state == STATE_MISSING)
+      continue;
+    /* Filtering here saves sending names the client would discard. */
+    if ((cmd.cmd.listval.pattern != NULL) &&
+        (fnmatch(cmd.cmd.listval.pattern, name, /* flags = */ 0) != 0))
+      continue;
+    listed[i / 8] |= (uint8_t)(1 << (i % 8));
+    number++;
+  }
+  uc_snapshot_rewind(snapshot);
+
   print_to_socket(fh, "%i Value%s found\n", (int)number,
                   (number == 1) ? "" : "s");
-  for (size_t i = 0; i < number; i++)
-    print_to_socket(fh, "%.3f %s\n", CDTIME_T_TO_DOUBLE(times[i]), names[i]);
+  for (size_t i = 0; (i < uc_snapshot_size(snapshot)) &&
+                     (uc_snapshot_next(snapshot, &name, &time, NULL) == 0);
+       i++) {
+    if (listed[i / 8] & (1 << (i % 8)))
+      print_to_socket(fh, "%.3f %s\n", CDTIME_T_TO_DOUBLE(time), name);
+  }
+  fflush(fh);
 
   free_everything_and_return(CMD_OK);
 } /* cmd_status_t cmd_handle_listval */
 
-void cmd_destroy_listval(cmd_listval_t *listval __attribute__((unused))) {
-  /* nothing to do */
+void cmd_destroy_listval(cmd_listval_t *listval) {
+  if (listval == NULL)
+    return;
+
+  sfree(listval->pattern);
 } /* void cmd_destroy_listval */
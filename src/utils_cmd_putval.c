@@ -259,6 +259,63 @@ cmd_status_t cmd_handle_putval(FILE *fh, char *buffer) {
   return CMD_OK;
 } /* int cmd_handle_putval */
 
+cmd_status_t cmd_handle_putvals(FILE *fh, char **lines, /* {{{ */
+                                size_t lines_num) {
+  char *vector;
+  size_t failed = 0;
+
+  if ((fh == NULL) || ((lines == NULL) && (lines_num > 0)))
+    return -1;
+
+  DEBUG("utils_cmd_putval: cmd_handle_putvals (fh = %p, lines_num = %" PRIsz
+        ");",
+        (void *)fh, lines_num);
+
+  /* The status vector has one character per line: '0' if the values were
+   * dispatched and '1' if the line could not be parsed. */
+  vector = malloc(lines_num + 1);
+  if (vector == NULL) {
+    cmd_error_handler_t err = {cmd_error_fh, fh};
+    cmd_error(CMD_ERROR, &err, "malloc failed.");
+    return CMD_ERROR;
+  }
+
+  for (size_t i = 0; i < lines_num; i++) {
+    char buffer[1024];
+    cmd_t cmd;
+
+    vector[i] = '1';
+    snprintf(buffer, sizeof(buffer), "PUTVAL %s", lines[i]);
+    if (cmd_parse(buffer, &cmd, NULL, /* err = */ NULL) != CMD_OK) {
+      failed++;
+      continue;
+    }
+    if (cmd.type != CMD_PUTVAL) {
+      failed++;
+      cmd_destroy(&cmd);
+      continue;
+    }
+
+    for (size_t j = 0; j < cmd.cmd.putval.vl_num; ++j)
+      plugin_dispatch_values(&cmd.cmd.putval.vl[j]);
+    vector[i] = '0';
+    cmd_destroy(&cmd);
+  }
+  vector[lines_num] = 0;
+
+  if (fprintf(fh, "1 Dispatched %" PRIsz " of %" PRIsz " lines\n%s\n",
+              lines_num - failed, lines_num, vector) < 0) {
+    WARNING("cmd_handle_putvals: failed to write to socket #%i: %s",
+            fileno(fh), STRERRNO);
+    sfree(vector);
+    return CMD_ERROR;
+  }
+  fflush(fh);
+
+  sfree(vector);
+  return CMD_OK;
+} /* }}} cmd_status_t cmd_handle_putvals */
+
 int cmd_create_putval(char *ret, size_t ret_len, /* {{{ */
                       const data_set_t *ds, const value_list_t *vl) {
   char buffer_ident[6 * DATA_MAX_NAME_LEN];
@@ -39,6 +39,10 @@ cmd_status_t cmd_parse_putval(size_t argc, char **argv,
 
 cmd_status_t cmd_handle_putval(FILE *fh, char *buffer);
 
+/* Handles the lines of a PUTVALS command. Each line holds the arguments of one
+ * PUTVAL command, i.e. an identifier, options and values. */
+cmd_status_t cmd_handle_putvals(FILE *fh, char **lines, size_t lines_num);
+
 void cmd_destroy_putval(cmd_putval_t *putval);
 
 int cmd_create_putval(char *ret, size_t ret_len, const data_set_t *ds,
@@ -0,0 +1,101 @@
+/**
+ * collectd - src/utils_cmd_readstats.c
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "common.h"
+#include "plugin.h"
+
+#include "utils_cmd_readstats.h"
+#include "utils_parse_option.h" /* for `parse_string' */
+
+#define print_to_socket(fh, ...)                                               \
+  do {                                                                         \
+    if (fprintf(fh, __VA_ARGS__) < 0) {                                        \
+      WARNING("handle_readstats: failed to write to socket #%i: %s",           \
+              fileno(fh), STRERRNO);                                           \
+      plugin_read_stats_free(stats, stats_num);                                \
+      return -1;                                                               \
+    }                                                                          \
+  } while (0)
+
+int handle_readstats(FILE *fh, char *buffer) {
+  plugin_read_stats_t *stats = NULL;
+  size_t stats_num = 0;
+  char *command;
+  int status;
+
+  if ((fh == NULL) || (buffer == NULL))
+    return -1;
+
+  DEBUG("utils_cmd_readstats: handle_readstats (fh = %p, buffer = %s);",
+        (void *)fh, buffer);
+
+  command = NULL;
+  status = parse_string(&buffer, &command);
+  if (status != 0) {
+    print_to_socket(fh, "-1 Cannot parse command.\n");
+    return -1;
+  }
+  assert(command != NULL);
+
+  if (strcasecmp("READSTATS", command) != 0) {
+    print_to_socket(fh, "-1 Unexpected command: `%s'.\n", command);
+    return -1;
+  }
+
+  if (*buffer != 0) {
+    print_to_socket(fh, "-1 Garbage after end of command: %s\n", buffer);
+    return -1;
+  }
+
+  status = plugin_get_read_stats(&stats, &stats_num);
+  if (status != 0) {
+    print_to_socket(fh, "-1 Error while collecting read statistics: %i\n",
+                    status);
+    return -1;
+  }
+
+  print_to_socket(fh, "%i Read callback%s found\n", (int)stats_num,
+                  (stats_num == 1) ? "" : "s");
+  for (size_t i = 0; i < stats_num; i++) {
+    plugin_read_stats_t *st = stats + i;
+
+    print_to_socket(fh,
+                    "%s interval=%.3f effective_interval=%.3f reads=%" PRIu64
+                    " overruns=%" PRIu64 " skipped=%" PRIu64
+                    " duration_average=%.6f duration_max=%.6f"
+                    " duration_p99=%.6f\n",
+                    st->name, CDTIME_T_TO_DOUBLE(st->interval),
+                    CDTIME_T_TO_DOUBLE(st->effective_interval), st->reads,
+                    st->overruns, st->skipped,
+                    CDTIME_T_TO_DOUBLE(st->duration_average),
+                    CDTIME_T_TO_DOUBLE(st->duration_max),
+                    CDTIME_T_TO_DOUBLE(st->duration_p99));
+  }
+
+  plugin_read_stats_free(stats, stats_num);
+  fflush(fh);
+
+  return 0;
+} /* int handle_readstats */
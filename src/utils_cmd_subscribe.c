@@ -0,0 +1,62 @@
+/**
+ * collectd - src/utils_cmd_subscribe.c
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "common.h"
+#include "utils_cmd_subscribe.h"
+
+cmd_status_t cmd_parse_subscribe(size_t argc, char **argv,
+                                 cmd_subscribe_t *ret_subscribe,
+                                 const cmd_options_t *opts
+                                 __attribute__((unused)),
+                                 cmd_error_handler_t *err) {
+  if (argc != 1) {
+    if (argc == 0)
+      cmd_error(CMD_PARSE_ERROR, err, "Missing identifier pattern.");
+    else
+      cmd_error(CMD_PARSE_ERROR, err, "Garbage after end of command: `%s'.",
+                argv[1]);
+    return CMD_PARSE_ERROR;
+  }
+
+  if (argv[0][0] == 0) {
+    cmd_error(CMD_PARSE_ERROR, err, "Empty identifier pattern.");
+    return CMD_PARSE_ERROR;
+  }
+
+  ret_subscribe->pattern = strdup(argv[0]);
+  if (ret_subscribe->pattern == NULL) {
+    cmd_error(CMD_ERROR, err, "strdup failed.");
+    return CMD_ERROR;
+  }
+
+  return CMD_OK;
+} /* cmd_status_t cmd_parse_subscribe */
+
+void cmd_destroy_subscribe(cmd_subscribe_t *subscribe) {
+  if (subscribe == NULL)
+    return;
+
+  sfree(subscribe->pattern);
+} /* void cmd_destroy_subscribe */
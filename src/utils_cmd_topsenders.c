@@ -0,0 +1,235 @@
+/**
+ * collectd - src/utils_cmd_topsenders.c
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "common.h"
+#include "plugin.h"
+#include "utils_cache.h"
+
+#include "utils_cmd_topsenders.h"
+#include "utils_parse_option.h" /* for `parse_string' */
+
+/* Lists the heaviest senders reported by the network plugin's
+ * "ReportTopSenders" option. The values are read from the value cache, so
+ * this works without access to the network plugin's state. */
+
+#define print_to_socket(fh, ...)                                               \
+  do {                                                                         \
+    if (fprintf(fh, __VA_ARGS__) < 0) {                                        \
+      WARNING("handle_topsenders: failed to write to socket #%i: %s",          \
+              fileno(fh), STRERRNO);                                           \
+      topsenders_free(senders, names, times, names_num);                       \
+      return -1;                                                               \
+    }                                                                          \
+  } while (0)
+
+typedef struct {
+  char host[DATA_MAX_NAME_LEN];
+  char plugin_instance[DATA_MAX_NAME_LEN];
+  cdtime_t time;
+  gauge_t packets;
+  gauge_t octets;
+  gauge_t values;
+} topsender_t;
+
+static void topsenders_free(topsender_t *senders, char **names, /* {{{ */
+                            cdtime_t *times, size_t names_num) {
+  sfree(senders);
+  for (size_t i = 0; i < names_num; i++)
+    sfree(names[i]);
+  sfree(names);
+  sfree(times);
+} /* }}} void topsenders_free */
+
+static void topsenders_copy(char *dst, size_t dst_size, /* {{{ */
+                            char const *begin, char const *end) {
+  size_t len = (size_t)(end - begin);
+
+  if (len >= dst_size)
+    len = dst_size - 1;
+  memcpy(dst, begin, len);
+  dst[len] = 0;
+} /* }}} void topsenders_copy */
+
+/* Returns the rate of the first data source of "host/plugin_instance/type", or
+ * NAN if it is not available. */
+static gauge_t topsenders_rate(topsender_t const *s, /* {{{ */
+                               char const *type) {
+  char name[6 * DATA_MAX_NAME_LEN];
+  gauge_t *rates = NULL;
+  size_t rates_num = 0;
+
+  snprintf(name, sizeof(name), "%s/network-%s/%s", s->host,
+           s->plugin_instance, type);
+  if (uc_get_rate_by_name(name, &rates, &rates_num) != 0)
+    return NAN;
+
+  gauge_t rate = (rates_num > 0) ? rates[0] : NAN;
+  sfree(rates);
+  return rate;
+} /* }}} gauge_t topsenders_rate */
+
+static int topsenders_compare(void const *a, void const *b) /* {{{ */
+{
+  gauge_t ra = ((topsender_t const *)a)->packets;
+  gauge_t rb = ((topsender_t const *)b)->packets;
+
+  if (isnan(ra))
+    return isnan(rb) ? 0 : 1;
+  else if (isnan(rb))
+    return -1;
+  return (ra < rb) ? 1 : (ra > rb) ? -1 : 0;
+} /* }}} int topsenders_compare */
+
+int handle_topsenders(FILE *fh, char *buffer) {
+  topsender_t *senders = NULL;
+  size_t senders_num = 0;
+  char **names = NULL;
+  cdtime_t *times = NULL;
+  size_t names_num = 0;
+  char *command;
+  int status;
+
+  if ((fh == NULL) || (buffer == NULL))
+    return -1;
+
+  DEBUG("utils_cmd_topsenders: handle_topsenders (fh = %p, buffer = %s);",
+        (void *)fh, buffer);
+
+  command = NULL;
+  status = parse_string(&buffer, &command);
+  if (status != 0) {
+    print_to_socket(fh, "-1 Cannot parse command.\n");
+    return -1;
+  }
+  assert(command != NULL);
+
+  if (strcasecmp("TOPSENDERS", command) != 0) {
+    print_to_socket(fh, "-1 Unexpected command: `%s'.\n", command);
+    return -1;
+  }
+
+  _Bool by_host = 0;
+  if (*buffer != 0) {
+    char *by = NULL;
+    status = parse_string(&buffer, &by);
+    if (status != 0) {
+      print_to_socket(fh, "-1 Cannot parse argument.\n");
+      return -1;
+    }
+
+    if (strcasecmp("host", by) == 0)
+      by_host = 1;
+    else if (strcasecmp("address", by) != 0) {
+      print_to_socket(fh, "-1 Unknown argument: `%s'.\n", by);
+      return -1;
+    }
+  }
+
+  if (*buffer != 0) {
+    print_to_socket(fh, "-1 Garbage after end of command: %s\n", buffer);
+    return -1;
+  }
+
+  status = uc_get_names(&names, &times, &names_num);
+  if (status != 0) {
+    print_to_socket(fh, "-1 uc_get_names failed.\n");
+    return -1;
+  }
+
+  senders = calloc(names_num + 1, sizeof(*senders));
+  if (senders == NULL) {
+    print_to_socket(fh, "-1 calloc failed.\n");
+    return -1;
+  }
+
+  char const *prefix = by_host ? "host-" : "sender-";
+  char const *type = by_host ? "total_values-dispatch-accepted" : "if_rx_packets";
+  cdtime_t newest = 0;
+
+  for (size_t i = 0; i < names_num; i++) {
+    topsender_t *s = senders + senders_num;
+    char *plugin = strchr(names[i], '/');
+    char *type_part = (plugin != NULL) ? strchr(plugin + 1, '/') : NULL;
+
+    if ((type_part == NULL) || (strcmp(type_part + 1, type) != 0) ||
+        (strncmp(plugin + 1, "network-", strlen("network-")) != 0))
+      continue;
+    plugin += 1 + strlen("network-");
+    if (strncmp(plugin, prefix, strlen(prefix)) != 0)
+      continue;
+
+    topsenders_copy(s->host, sizeof(s->host), names[i],
+                    plugin - 1 - strlen("network-"));
+    topsenders_copy(s->plugin_instance, sizeof(s->plugin_instance), plugin,
+                    type_part);
+    s->time = times[i];
+
+    if (s->time > newest)
+      newest = s->time;
+    senders_num++;
+  }
+
+  /* Senders which dropped out of the network plugin's summary are no longer
+   * updated but stay in the cache until they time out. Skip them. */
+  cdtime_t interval = plugin_get_interval();
+  size_t j = 0;
+  for (size_t i = 0; i < senders_num; i++) {
+    topsender_t *s = senders + i;
+
+    if ((s->time + interval / 2) < newest)
+      continue;
+
+    if (by_host) {
+      s->values = topsenders_rate(s, type);
+      s->packets = s->values;
+    } else {
+      s->packets = topsenders_rate(s, "if_rx_packets");
+      s->octets = topsenders_rate(s, "if_rx_octets");
+      s->values = topsenders_rate(s, "total_values-dispatch-accepted");
+    }
+    senders[j++] = *s;
+  }
+  senders_num = j;
+
+  qsort(senders, senders_num, sizeof(*senders), topsenders_compare);
+
+  print_to_socket(fh, "%" PRIsz " Sender%s found\n", senders_num,
+                  (senders_num == 1) ? "" : "s");
+  for (size_t i = 0; i < senders_num; i++) {
+    topsender_t *s = senders + i;
+    char const *name = s->plugin_instance + strlen(prefix);
+
+    if (by_host)
+      print_to_socket(fh, "%s values=%.3f\n", name, s->values);
+    else
+      print_to_socket(fh, "%s packets=%.3f octets=%.3f values=%.3f\n", name,
+                      s->packets, s->octets, s->values);
+  }
+
+  topsenders_free(senders, names, times, names_num);
+  fflush(fh);
+
+  return 0;
+} /* int handle_topsenders */
@@ -31,6 +31,7 @@
 #include "utils_cmd_getval.h"
 #include "utils_cmd_listval.h"
 #include "utils_cmd_putval.h"
+#include "utils_cmd_subscribe.h"
 #include "utils_cmds.h"
 #include "utils_parse_option.h"
 
@@ -111,8 +112,11 @@ static cmd_status_t cmd_split(char *buffer, size_t *ret_len, char ***ret_fields,
 
       if (in_quotes) {
         /* end of quoted field */
-        if (!in_field) /* empty quoted string */
+        if (!in_field) { /* empty quoted string */
           NEW_FIELD();
+          /* terminate at the closing quote, not the character after it */
+          field = string;
+        }
         END_FIELD();
         in_quotes = false;
         continue;
@@ -212,6 +216,10 @@ cmd_status_t cmd_parsev(size_t argc, char **argv, cmd_t *ret_cmd,
     ret_cmd->type = CMD_PUTVAL;
     status =
         cmd_parse_putval(argc - 1, argv + 1, &ret_cmd->cmd.putval, opts, err);
+  } else if (strcasecmp("SUBSCRIBE", command) == 0) {
+    ret_cmd->type = CMD_SUBSCRIBE;
+    status = cmd_parse_subscribe(argc - 1, argv + 1, &ret_cmd->cmd.subscribe,
+                                 opts, err);
   } else {
     ret_cmd->type = CMD_UNKNOWN;
     cmd_error(CMD_UNKNOWN_COMMAND, err, "Unknown command `%s'.", command);
@@ -257,6 +265,9 @@ void cmd_destroy(cmd_t *cmd) {
   case CMD_PUTVAL:
     cmd_destroy_putval(&cmd->cmd.putval);
     break;
+  case CMD_SUBSCRIBE:
+    cmd_destroy_subscribe(&cmd->cmd.subscribe);
+    break;
   }
 } /* void cmd_destroy */
 
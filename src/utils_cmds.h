@@ -37,6 +37,7 @@ typedef enum {
   CMD_GETVAL = 2,
   CMD_LISTVAL = 3,
   CMD_PUTVAL = 4,
+  CMD_SUBSCRIBE = 5,
 } cmd_type_t;
 #define CMD_TO_STRING(type)                                                    \
   ((type) == CMD_FLUSH) ? "FLUSH" : ((type) == CMD_GETVAL)                     \
@@ -45,10 +46,14 @@ typedef enum {
                                               ? "LISTVAL"                      \
                                               : ((type) == CMD_PUTVAL)         \
                                                     ? "PUTVAL"                 \
-                                                    : "UNKNOWN"
+                                                    : ((type) == CMD_SUBSCRIBE)\
+                                                          ? "SUBSCRIBE"        \
+                                                          : "UNKNOWN"
 
 typedef struct {
   double timeout;
+  double deadline; /* zero means "FlushDeadline" */
+  _Bool report;    /* one line per flush callback in the response */
 
   char **plugins;
   size_t plugins_num;
@@ -62,6 +67,8 @@ typedef struct {
 } cmd_getval_t;
 
 typedef struct {
+  /* Shell glob matched against the identifiers to list, or NULL for all. */
+  char *pattern;
 } cmd_listval_t;
 
 typedef struct {
@@ -74,6 +81,11 @@ typedef struct {
   size_t vl_num;
 } cmd_putval_t;
 
+typedef struct {
+  /* Shell glob matched against the identifier of each value list. */
+  char *pattern;
+} cmd_subscribe_t;
+
 /*
  * NAME
  *   cmd_t
@@ -88,6 +100,7 @@ typedef struct {
     cmd_getval_t getval;
     cmd_listval_t listval;
     cmd_putval_t putval;
+    cmd_subscribe_t subscribe;
   } cmd;
 } cmd_t;
 
@@ -26,6 +26,8 @@
 
 #include "common.h"
 #include "testing.h"
+#include "utils_cmd_binary.h"
+#include "utils_cmd_putval.h"
 #include "utils_cmds.h"
 
 static void error_cb(void *ud, cmd_status_t status, const char *format,
@@ -62,6 +64,9 @@ static struct {
     {
         "FLUSH timeout=123 plugin=\"A\"", NULL, CMD_OK, CMD_FLUSH,
     },
+    {
+        "FLUSH deadline=5 report=true plugin=\"A\"", NULL, CMD_OK, CMD_FLUSH,
+    },
     /* Invalid FLUSH commands. */
     {
         /* Missing hostname; no default. */
@@ -75,6 +80,14 @@ static struct {
         /* Invalid timeout. */
         "FLUSH timeout=A", NULL, CMD_PARSE_ERROR, CMD_UNKNOWN,
     },
+    {
+        /* Invalid deadline. */
+        "FLUSH deadline=0", NULL, CMD_PARSE_ERROR, CMD_UNKNOWN,
+    },
+    {
+        /* Invalid report flag. */
+        "FLUSH report=maybe", NULL, CMD_PARSE_ERROR, CMD_UNKNOWN,
+    },
     {
         /* Invalid identifier. */
         "FLUSH identifier=invalid", NULL, CMD_PARSE_ERROR, CMD_UNKNOWN,
@@ -107,10 +120,35 @@ static struct {
     {
         "LISTVAL", NULL, CMD_OK, CMD_LISTVAL,
     },
+    {
+        "LISTVAL myhost/cpu-*/cpu-*", NULL, CMD_OK, CMD_LISTVAL,
+    },
 
     /* Invalid LISTVAL commands. */
     {
-        "LISTVAL invalid", NULL, CMD_PARSE_ERROR, CMD_UNKNOWN,
+        "LISTVAL */load/load garbage", NULL, CMD_PARSE_ERROR, CMD_UNKNOWN,
+    },
+    {
+        "LISTVAL \"\"", NULL, CMD_PARSE_ERROR, CMD_UNKNOWN,
+    },
+    {
+        "LISTVAL \"\" garbage", NULL, CMD_PARSE_ERROR, CMD_UNKNOWN,
+    },
+
+    /* Valid SUBSCRIBE commands. */
+    {
+        "SUBSCRIBE myhost/cpu-*/cpu-*", NULL, CMD_OK, CMD_SUBSCRIBE,
+    },
+    {
+        "SUBSCRIBE \"*/load/load\"", NULL, CMD_OK, CMD_SUBSCRIBE,
+    },
+
+    /* Invalid SUBSCRIBE commands. */
+    {
+        "SUBSCRIBE", NULL, CMD_PARSE_ERROR, CMD_UNKNOWN,
+    },
+    {
+        "SUBSCRIBE */load/load garbage", NULL, CMD_PARSE_ERROR, CMD_UNKNOWN,
     },
 
     /* Valid PUTVAL commands. */
@@ -218,7 +256,84 @@ DEF_TEST(parse) {
   return test_result;
 }
 
+DEF_TEST(putvals) {
+  char *lines[] = {
+      "myhost/magic/MAGIC N:42", "myhost/magic/UNKNOWN N:42", "invalid",
+      "myhost/magic/MAGIC interval=10 1234:42",
+  };
+  char *output = NULL;
+  size_t output_size = 0;
+
+  FILE *fh = open_memstream(&output, &output_size);
+  CHECK_NOT_NULL(fh);
+  EXPECT_EQ_INT(CMD_OK,
+                cmd_handle_putvals(fh, lines, STATIC_ARRAY_SIZE(lines)));
+  fclose(fh);
+
+  EXPECT_EQ_STR("1 Dispatched 2 of 4 lines\n0110\n", output);
+  free(output);
+
+  return 0;
+}
+
+DEF_TEST(binary) {
+  cmd_error_handler_t err = {error_cb, NULL};
+  char const host[] = {0x00, 0x00, 0x00, 0x06, 'h', 0};
+  char const type[] = {0x00, 0x04, 0x00, 0x0a, 'M', 'A', 'G', 'I', 'C', 0};
+  /* 1234 seconds in cdtime_t */
+  char const time_hr[] = {0x00, 0x08, 0x00, 0x0c, 0x00, 0x00,
+                          0x01, 0x34, 0x80, 0x00, 0x00, 0x00};
+  char const values[] = {0x00, 0x06, 0x00, 0x0f, 0x00, 0x01, DS_TYPE_DERIVE,
+                         0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x2a};
+  char const unknown[] = {0x12, 0x34, 0x00, 0x05, 0x00};
+  cmd_binary_t b;
+  size_t size;
+
+  cmd_binary_init(&b);
+
+  EXPECT_EQ_INT(CMD_OK, cmd_binary_part_size(values, 3, &size, &err));
+  EXPECT_EQ_UINT64(0, size);
+  EXPECT_EQ_INT(CMD_OK,
+                cmd_binary_part_size(values, sizeof(values), &size, &err));
+  EXPECT_EQ_UINT64(sizeof(values), size);
+  EXPECT_EQ_INT(CMD_PARSE_ERROR,
+                cmd_binary_part_size("\0\0\0\3", 4, &size, &err));
+
+  EXPECT_EQ_INT(CMD_OK, cmd_binary_part(&b, host, sizeof(host), &err));
+  EXPECT_EQ_INT(CMD_OK, cmd_binary_part(&b, type, sizeof(type), &err));
+  EXPECT_EQ_INT(CMD_OK, cmd_binary_part(&b, time_hr, sizeof(time_hr), &err));
+  EXPECT_EQ_INT(CMD_OK, cmd_binary_part(&b, unknown, sizeof(unknown), &err));
+  EXPECT_EQ_INT(CMD_OK, cmd_binary_part(&b, values, sizeof(values), &err));
+
+  EXPECT_EQ_STR("h", b.vl.host);
+  EXPECT_EQ_STR("MAGIC", b.vl.type);
+  EXPECT_EQ_UINT64(1, b.vl.type_id);
+  EXPECT_EQ_UINT64(TIME_T_TO_CDTIME_T(1234), b.vl.time);
+  EXPECT_EQ_UINT64(1, b.vl.values_len);
+  EXPECT_EQ_UINT64(42, b.vl.values[0].derive);
+
+  /* Truncated parts and strings without a null byte are rejected. */
+  EXPECT_EQ_INT(CMD_PARSE_ERROR,
+                cmd_binary_part(&b, values, sizeof(values) - 1, &err));
+  EXPECT_EQ_INT(CMD_PARSE_ERROR,
+                cmd_binary_part(&b, "\0\0\0\5h", 5, &err));
+
+  char *output = NULL;
+  size_t output_size = 0;
+  FILE *fh = open_memstream(&output, &output_size);
+  CHECK_NOT_NULL(fh);
+  char command[] = "BINARY";
+  EXPECT_EQ_INT(0, handle_binary(fh, command));
+  fclose(fh);
+  EXPECT_EQ_STR("0 Switching to binary mode\n", output);
+  free(output);
+
+  return 0;
+}
+
 int main(int argc, char **argv) {
   RUN_TEST(parse);
+  RUN_TEST(putvals);
+  RUN_TEST(binary);
   END_TEST;
 }
@@ -0,0 +1,383 @@
+/**
+ * collectd - src/utils_compress.c
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "common.h"
+#include "utils_compress.h"
+
+#if HAVE_ZLIB_H
+#include <zlib.h>
+#endif
+#if HAVE_ZSTD_H
+#include <zstd.h>
+#endif
+#if HAVE_SNAPPY_C_H
+#include <snappy-c.h>
+#endif
+
+#define COMPRESS_ZSTD_LEVEL 3
+
+/* ZSTD_compressStream2() has been added in version 1.4.0. */
+#if HAVE_ZSTD_H && defined(ZSTD_VERSION_NUMBER) && ZSTD_VERSION_NUMBER >= 10400
+#define COMPRESS_HAVE_ZSTD_STREAM 1
+#endif
+
+/* The output buffer of a stream starts out with this size, unless a larger
+ * size hint has been given. */
+#define COMPRESS_MIN_OUT_SIZE 4096
+
+struct compress_s {
+  compress_method_t method;
+#if HAVE_ZLIB_H
+  z_stream zs;
+#endif
+#if HAVE_ZSTD_H
+  ZSTD_CCtx *cctx;
+#endif
+
+  char *out;
+  size_t out_size;
+  size_t out_fill; /* used by streams only */
+};
+
+int compress_method_parse(char const *name, /* {{{ */
+                          compress_method_t *ret_method) {
+  if ((name == NULL) || (ret_method == NULL))
+    return EINVAL;
+
+  if (strcasecmp("none", name) == 0) {
+    *ret_method = COMPRESS_NONE;
+    return 0;
+  } else if (strcasecmp("gzip", name) == 0) {
+#if HAVE_ZLIB_H
+    *ret_method = COMPRESS_GZIP;
+    return 0;
+#else
+    return ENOTSUP;
+#endif
+  } else if (strcasecmp("zstd", name) == 0) {
+#if HAVE_ZSTD_H
+    *ret_method = COMPRESS_ZSTD;
+    return 0;
+#else
+    return ENOTSUP;
+#endif
+  } else if (strcasecmp("snappy", name) == 0) {
+#if HAVE_SNAPPY_C_H
+    *ret_method = COMPRESS_SNAPPY;
+    return 0;
+#else
+    return ENOTSUP;
+#endif
+  }
+
+  return EINVAL;
+} /* }}} int compress_method_parse */
+
+char const *compress_encoding(compress_method_t method) /* {{{ */
+{
+  switch (method) {
+  case COMPRESS_GZIP:
+    return "gzip";
+  case COMPRESS_ZSTD:
+    return "zstd";
+  case COMPRESS_SNAPPY:
+    return "snappy";
+  default:
+    return NULL;
+  }
+} /* }}} char const *compress_encoding */
+
+static size_t compress_bound(compress_t *c, size_t in_size) /* {{{ */
+{
+  switch (c->method) {
+#if HAVE_ZLIB_H
+  case COMPRESS_GZIP:
+    return (size_t)deflateBound(&c->zs, (uLong)in_size);
+#endif
+#if HAVE_ZSTD_H
+  case COMPRESS_ZSTD:
+    return ZSTD_compressBound(in_size);
+#endif
+#if HAVE_SNAPPY_C_H
+  case COMPRESS_SNAPPY:
+    return snappy_max_compressed_length(in_size);
+#endif
+  default:
+    return 0;
+  }
+} /* }}} size_t compress_bound */
+
+static int compress_grow(compress_t *c, size_t size) /* {{{ */
+{
+  if (size <= c->out_size)
+    return 0;
+
+  char *out = realloc(c->out, size);
+  if (out == NULL)
+    return ENOMEM;
+
+  c->out = out;
+  c->out_size = size;
+  return 0;
+} /* }}} int compress_grow */
+
+/* Makes sure the output buffer can hold the compressed form of "in_size"
+ * bytes. */
+static int compress_reserve(compress_t *c, size_t in_size) /* {{{ */
+{
+  return compress_grow(c, compress_bound(c, in_size));
+} /* }}} int compress_reserve */
+
+compress_t *compress_create(compress_method_t method, /* {{{ */
+                            size_t size_hint) {
+  compress_t *c = calloc(1, sizeof(*c));
+  if (c == NULL)
+    return NULL;
+  c->method = method;
+
+  switch (method) {
+#if HAVE_ZLIB_H
+  case COMPRESS_GZIP:
+    /* 16 + MAX_WBITS writes a gzip header and trailer instead of a zlib
+     * one. */
+    if (deflateInit2(&c->zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                     16 + MAX_WBITS, /* memLevel = */ 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+      sfree(c);
+      return NULL;
+    }
+    break;
+#endif
+#if HAVE_ZSTD_H
+  case COMPRESS_ZSTD:
+    c->cctx = ZSTD_createCCtx();
+    if (c->cctx == NULL) {
+      sfree(c);
+      return NULL;
+    }
+    break;
+#endif
+#if HAVE_SNAPPY_C_H
+  case COMPRESS_SNAPPY:
+    /* snappy keeps no state between buffers. */
+    break;
+#endif
+  default:
+    sfree(c);
+    return NULL;
+  }
+
+  if ((size_hint > 0) && (compress_reserve(c, size_hint) != 0)) {
+    compress_destroy(c);
+    return NULL;
+  }
+
+  return c;
+} /* }}} compress_t *compress_create */
+
+void compress_destroy(compress_t *c) /* {{{ */
+{
+  if (c == NULL)
+    return;
+
+#if HAVE_ZLIB_H
+  if (c->method == COMPRESS_GZIP)
+    deflateEnd(&c->zs);
+#endif
+#if HAVE_ZSTD_H
+  if (c->method == COMPRESS_ZSTD)
+    ZSTD_freeCCtx(c->cctx);
+#endif
+
+  sfree(c->out);
+  sfree(c);
+} /* }}} void compress_destroy */
+
+int compress_buffer(compress_t *c, void const *in, size_t in_size, /* {{{ */
+                    void const **ret_out, size_t *ret_out_size) {
+  if ((c == NULL) || ((in == NULL) && (in_size > 0)) || (ret_out == NULL) ||
+      (ret_out_size == NULL))
+    return EINVAL;
+
+  int status = compress_reserve(c, in_size);
+  if (status != 0)
+    return status;
+
+  switch (c->method) {
+#if HAVE_ZLIB_H
+  case COMPRESS_GZIP:
+    /* The output buffer is large enough to finish in one call. */
+    c->zs.next_in = (Bytef *)in;
+    c->zs.avail_in = (uInt)in_size;
+    c->zs.next_out = (Bytef *)c->out;
+    c->zs.avail_out = (uInt)c->out_size;
+    status = deflate(&c->zs, Z_FINISH);
+    *ret_out_size = (size_t)c->zs.total_out;
+    deflateReset(&c->zs);
+    if (status != Z_STREAM_END)
+      return EIO;
+    break;
+#endif
+#if HAVE_ZSTD_H
+  case COMPRESS_ZSTD: {
+    size_t size = ZSTD_compressCCtx(c->cctx, c->out, c->out_size, in, in_size,
+                                    COMPRESS_ZSTD_LEVEL);
+    if (ZSTD_isError(size))
+      return EIO;
+    *ret_out_size = size;
+    break;
+  }
+#endif
+#if HAVE_SNAPPY_C_H
+  case COMPRESS_SNAPPY: {
+    size_t size = c->out_size;
+    if (snappy_compress(in, in_size, c->out, &size) != SNAPPY_OK)
+      return EIO;
+    *ret_out_size = size;
+    break;
+  }
+#endif
+  default:
+    return EINVAL;
+  }
+
+  *ret_out = c->out;
+  return 0;
+} /* }}} int compress_buffer */
+
+int compress_stream_begin(compress_t *c) /* {{{ */
+{
+  if (c == NULL)
+    return EINVAL;
+
+  int status = compress_grow(c, COMPRESS_MIN_OUT_SIZE);
+  if (status != 0)
+    return status;
+  c->out_fill = 0;
+
+  switch (c->method) {
+#if HAVE_ZLIB_H
+  case COMPRESS_GZIP:
+    /* Also discards what is left of a failed stream. */
+    deflateReset(&c->zs);
+    return 0;
+#endif
+#if COMPRESS_HAVE_ZSTD_STREAM
+  case COMPRESS_ZSTD:
+    ZSTD_CCtx_reset(c->cctx, ZSTD_reset_session_only);
+    if (ZSTD_isError(ZSTD_CCtx_setParameter(
+            c->cctx, ZSTD_c_compressionLevel, COMPRESS_ZSTD_LEVEL)))
+      return EINVAL;
+    return 0;
+#endif
+  default:
+    return ENOTSUP;
+  }
+} /* }}} int compress_stream_begin */
+
+/* Compresses "in_size" bytes at "in", or finishes the stream if "finish" is
+ * true, growing the output buffer as needed. */
+static int compress_stream(compress_t *c, void const *in, /* {{{ */
+                           size_t in_size, _Bool finish) {
+  switch (c->method) {
+#if HAVE_ZLIB_H
+  case COMPRESS_GZIP: {
+    c->zs.next_in = (Bytef *)in;
+    c->zs.avail_in = (uInt)in_size;
+
+    while (42) {
+      if (c->out_fill >= c->out_size) {
+        int status = compress_grow(c, 2 * c->out_size);
+        if (status != 0)
+          return status;
+      }
+      c->zs.next_out = (Bytef *)c->out + c->out_fill;
+      c->zs.avail_out = (uInt)(c->out_size - c->out_fill);
+
+      int status = deflate(&c->zs, finish ? Z_FINISH : Z_NO_FLUSH);
+      c->out_fill = c->out_size - (size_t)c->zs.avail_out;
+      if (status == Z_STREAM_END)
+        return 0;
+      if ((status != Z_OK) && (status != Z_BUF_ERROR))
+        return EIO;
+      /* Without Z_FINISH, deflate() is done when it stops filling the output
+       * buffer. */
+      if (!finish && (c->zs.avail_in == 0) && (c->zs.avail_out > 0))
+        return 0;
+    }
+  }
+#endif
+#if COMPRESS_HAVE_ZSTD_STREAM
+  case COMPRESS_ZSTD: {
+    ZSTD_inBuffer input = {.src = in, .size = in_size, .pos = 0};
+
+    while (42) {
+      if (c->out_fill >= c->out_size) {
+        int status = compress_grow(c, 2 * c->out_size);
+        if (status != 0)
+          return status;
+      }
+      ZSTD_outBuffer output = {
+          .dst = c->out, .size = c->out_size, .pos = c->out_fill,
+      };
+
+      size_t remaining = ZSTD_compressStream2(
+          c->cctx, &output, &input, finish ? ZSTD_e_end : ZSTD_e_continue);
+      c->out_fill = output.pos;
+      if (ZSTD_isError(remaining))
+        return EIO;
+      if (finish ? (remaining == 0) : (input.pos == input.size))
+        return 0;
+    }
+  }
+#endif
+  default:
+    return ENOTSUP;
+  }
+} /* }}} int compress_stream */
+
+int compress_stream_write(compress_t *c, void const *in, /* {{{ */
+                          size_t in_size) {
+  if ((c == NULL) || ((in == NULL) && (in_size > 0)))
+    return EINVAL;
+  if (in_size == 0)
+    return 0;
+
+  return compress_stream(c, in, in_size, /* finish = */ 0);
+} /* }}} int compress_stream_write */
+
+int compress_stream_end(compress_t *c, void const **ret_out, /* {{{ */
+                        size_t *ret_out_size) {
+  if ((c == NULL) || (ret_out == NULL) || (ret_out_size == NULL))
+    return EINVAL;
+
+  int status = compress_stream(c, NULL, 0, /* finish = */ 1);
+  if (status != 0)
+    return status;
+
+  *ret_out = c->out;
+  *ret_out_size = c->out_fill;
+  return 0;
+} /* }}} int compress_stream_end */
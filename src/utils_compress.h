@@ -0,0 +1,122 @@
+/**
+ * collectd - src/utils_compress.h
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef UTILS_COMPRESS_H
+#define UTILS_COMPRESS_H 1
+
+#include "collectd.h"
+
+typedef enum {
+  COMPRESS_NONE = 0,
+  COMPRESS_GZIP,
+  COMPRESS_ZSTD,
+  COMPRESS_SNAPPY,
+} compress_method_t;
+
+struct compress_s;
+typedef struct compress_s compress_t;
+
+/*
+ * NAME
+ *   compress_method_parse
+ *
+ * DESCRIPTION
+ *   Parses the name of a compression method, i.e. "none", "gzip",
+ *   "zstd" or "snappy".
+ *
+ * RETURN VALUE
+ *   Zero upon success, EINVAL if the name is unknown or ENOTSUP if collectd
+ *   has been built without support for the method.
+ */
+int compress_method_parse(char const *name, compress_method_t *ret_method);
+
+/*
+ * NAME
+ *   compress_encoding
+ *
+ * DESCRIPTION
+ *   Returns the HTTP content coding of `method', for use in the
+ *   "Content-Encoding" and "Accept-Encoding" headers, or NULL for
+ *   COMPRESS_NONE.
+ */
+char const *compress_encoding(compress_method_t method);
+
+/*
+ * NAME
+ *   compress_create
+ *
+ * DESCRIPTION
+ *   Allocates a compressor. The compression state and the output buffer are
+ *   kept and reused by compress_buffer(), so compressing many buffers of
+ *   similar size does not allocate memory. A compressor is not thread-safe.
+ *
+ * PARAMETERS
+ *   `method'     Compression method, other than COMPRESS_NONE.
+ *   `size_hint'  Expected size of the input, used to preallocate the output
+ *                buffer. May be zero.
+ *
+ * RETURN VALUE
+ *   A compress_t-pointer upon success or NULL upon failure.
+ */
+compress_t *compress_create(compress_method_t method, size_t size_hint);
+
+void compress_destroy(compress_t *c);
+
+/*
+ * NAME
+ *   compress_buffer
+ *
+ * DESCRIPTION
+ *   Compresses `in_size' bytes at `in' into a single gzip member, zstd
+ *   frame or snappy block. Upon success, `ret_out' points to the compressed
+ *   data, which stays valid until the next call with the same compressor.
+ *
+ * RETURN VALUE
+ *   Zero upon success or an errno value upon failure.
+ */
+int compress_buffer(compress_t *c, void const *in, size_t in_size,
+                    void const **ret_out, size_t *ret_out_size);
+
+/*
+ * NAME
+ *   compress_stream_begin, compress_stream_write, compress_stream_end
+ *
+ * DESCRIPTION
+ *   Compress data which is not available in one piece. compress_stream_begin()
+ *   starts a new gzip member or zstd frame, compress_stream_write() adds
+ *   `in_size' bytes to it and compress_stream_end() finishes it. Upon success,
+ *   `ret_out' points to the compressed data, which stays valid until the
+ *   compressor is used again. After a failure, the stream has to be started
+ *   again.
+ *
+ * RETURN VALUE
+ *   Zero upon success or an errno value upon failure. ENOTSUP is returned if
+ *   the library is too old to compress streams and for snappy, which is only
+ *   used for whole buffers.
+ */
+int compress_stream_begin(compress_t *c);
+int compress_stream_write(compress_t *c, void const *in, size_t in_size);
+int compress_stream_end(compress_t *c, void const **ret_out,
+                        size_t *ret_out_size);
+
+#endif /* UTILS_COMPRESS_H */
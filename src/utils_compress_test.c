@@ -0,0 +1,269 @@
+/**
+ * collectd - src/utils_compress_test.c
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "testing.h"
+#include "utils_compress.h"
+
+#if HAVE_ZLIB_H
+#include <zlib.h>
+#endif
+#if HAVE_ZSTD_H
+#include <zstd.h>
+#endif
+#if HAVE_SNAPPY_C_H
+#include <snappy-c.h>
+#endif
+
+/* Builds a buffer which looks like the output of the JSON formatter. */
+static size_t fill_input(char *buffer, size_t size) {
+  size_t fill = 0;
+
+  for (int i = 0; fill + 128 < size; i++)
+    fill += (size_t)snprintf(
+        buffer + fill, size - fill,
+        ",{\"values\":[%d],\"dstypes\":[\"gauge\"],\"host\":\"example.com\"}",
+        i);
+  return fill;
+}
+
+DEF_TEST(parse) {
+  compress_method_t method = COMPRESS_GZIP;
+
+  EXPECT_EQ_INT(0, compress_method_parse("None", &method));
+  EXPECT_EQ_INT(COMPRESS_NONE, method);
+  EXPECT_EQ_INT(EINVAL, compress_method_parse("bzip2", &method));
+  OK(compress_encoding(COMPRESS_NONE) == NULL);
+
+#if HAVE_ZLIB_H
+  EXPECT_EQ_INT(0, compress_method_parse("GZip", &method));
+  EXPECT_EQ_INT(COMPRESS_GZIP, method);
+  EXPECT_EQ_STR("gzip", compress_encoding(method));
+#else
+  EXPECT_EQ_INT(ENOTSUP, compress_method_parse("gzip", &method));
+#endif
+#if HAVE_ZSTD_H
+  EXPECT_EQ_INT(0, compress_method_parse("zstd", &method));
+  EXPECT_EQ_INT(COMPRESS_ZSTD, method);
+  EXPECT_EQ_STR("zstd", compress_encoding(method));
+#else
+  EXPECT_EQ_INT(ENOTSUP, compress_method_parse("zstd", &method));
+#endif
+#if HAVE_SNAPPY_C_H
+  EXPECT_EQ_INT(0, compress_method_parse("snappy", &method));
+  EXPECT_EQ_INT(COMPRESS_SNAPPY, method);
+  EXPECT_EQ_STR("snappy", compress_encoding(method));
+#else
+  EXPECT_EQ_INT(ENOTSUP, compress_method_parse("snappy", &method));
+#endif
+
+  return 0;
+}
+
+#if HAVE_ZLIB_H
+DEF_TEST(gzip) {
+  char in[8192];
+  char check[sizeof(in)];
+  size_t in_size = fill_input(in, sizeof(in));
+  /* Starts out too small, so the output buffer has to grow. */
+  compress_t *c = compress_create(COMPRESS_GZIP, 16);
+
+  CHECK_NOT_NULL(c);
+
+  /* The compressor is reset after every buffer. */
+  for (int i = 0; i < 2; i++) {
+    void const *out = NULL;
+    size_t out_size = 0;
+
+    CHECK_ZERO(compress_buffer(c, in, in_size, &out, &out_size));
+    OK(out_size < in_size / 4);
+
+    z_stream zs = {
+        .next_in = (Bytef *)out, .avail_in = (uInt)out_size,
+    };
+    CHECK_ZERO(inflateInit2(&zs, 16 + MAX_WBITS));
+    zs.next_out = (Bytef *)check;
+    zs.avail_out = sizeof(check);
+    EXPECT_EQ_INT(Z_STREAM_END, inflate(&zs, Z_FINISH));
+    EXPECT_EQ_UINT64(in_size, zs.total_out);
+    inflateEnd(&zs);
+    OK(memcmp(in, check, in_size) == 0);
+  }
+
+  compress_destroy(c);
+  return 0;
+}
+#endif
+
+#if HAVE_ZSTD_H
+DEF_TEST(zstd) {
+  char in[8192];
+  char check[sizeof(in)];
+  size_t in_size = fill_input(in, sizeof(in));
+  compress_t *c = compress_create(COMPRESS_ZSTD, sizeof(in));
+
+  CHECK_NOT_NULL(c);
+
+  for (int i = 0; i < 2; i++) {
+    void const *out = NULL;
+    size_t out_size = 0;
+
+    CHECK_ZERO(compress_buffer(c, in, in_size, &out, &out_size));
+    OK(out_size < in_size / 4);
+
+    size_t check_size = ZSTD_decompress(check, sizeof(check), out, out_size);
+    OK(!ZSTD_isError(check_size));
+    EXPECT_EQ_UINT64(in_size, check_size);
+    OK(memcmp(in, check, in_size) == 0);
+  }
+
+  compress_destroy(c);
+  return 0;
+}
+#endif
+
+#if HAVE_SNAPPY_C_H
+DEF_TEST(snappy) {
+  char in[8192];
+  char check[sizeof(in)];
+  size_t in_size = fill_input(in, sizeof(in));
+  compress_t *c = compress_create(COMPRESS_SNAPPY, 0);
+
+  CHECK_NOT_NULL(c);
+
+  for (int i = 0; i < 2; i++) {
+    void const *out = NULL;
+    size_t out_size = 0;
+
+    CHECK_ZERO(compress_buffer(c, in, in_size, &out, &out_size));
+    OK(out_size < in_size / 2);
+
+    size_t check_size = sizeof(check);
+    EXPECT_EQ_INT(SNAPPY_OK,
+                  snappy_uncompress(out, out_size, check, &check_size));
+    EXPECT_EQ_UINT64(in_size, check_size);
+    OK(memcmp(in, check, in_size) == 0);
+  }
+
+  /* snappy only compresses whole buffers. */
+  EXPECT_EQ_INT(ENOTSUP, compress_stream_begin(c));
+
+  compress_destroy(c);
+  return 0;
+}
+#endif
+
+/* Compresses "in" in small pieces, so the output buffer has to grow several
+ * times. */
+static int compress_pieces(compress_t *c, char const *in, size_t in_size,
+                           void const **ret_out, size_t *ret_out_size) {
+  int status = compress_stream_begin(c);
+  if (status != 0)
+    return status;
+
+  for (size_t pos = 0; pos < in_size; pos += 100) {
+    size_t size = (in_size - pos < 100) ? in_size - pos : 100;
+    status = compress_stream_write(c, in + pos, size);
+    if (status != 0)
+      return status;
+  }
+
+  return compress_stream_end(c, ret_out, ret_out_size);
+}
+
+DEF_TEST(stream) {
+  char in[65536];
+  char check[sizeof(in)];
+  size_t in_size = fill_input(in, sizeof(in));
+
+#if HAVE_ZLIB_H
+  compress_t *c = compress_create(COMPRESS_GZIP, 0);
+  CHECK_NOT_NULL(c);
+
+  for (int i = 0; i < 2; i++) {
+    void const *out = NULL;
+    size_t out_size = 0;
+
+    CHECK_ZERO(compress_pieces(c, in, in_size, &out, &out_size));
+    OK(out_size < in_size / 4);
+
+    z_stream zs = {
+        .next_in = (Bytef *)out, .avail_in = (uInt)out_size,
+    };
+    CHECK_ZERO(inflateInit2(&zs, 16 + MAX_WBITS));
+    zs.next_out = (Bytef *)check;
+    zs.avail_out = sizeof(check);
+    EXPECT_EQ_INT(Z_STREAM_END, inflate(&zs, Z_FINISH));
+    EXPECT_EQ_UINT64(in_size, zs.total_out);
+    inflateEnd(&zs);
+    OK(memcmp(in, check, in_size) == 0);
+  }
+
+  /* An empty stream is still a valid gzip member. */
+  void const *out = NULL;
+  size_t out_size = 0;
+  CHECK_ZERO(compress_pieces(c, in, 0, &out, &out_size));
+  OK(out_size > 0);
+
+  compress_destroy(c);
+#endif
+
+#if HAVE_ZSTD_H
+  compress_t *z = compress_create(COMPRESS_ZSTD, 0);
+  CHECK_NOT_NULL(z);
+
+  void const *zout = NULL;
+  size_t zout_size = 0;
+  int status = compress_pieces(z, in, in_size, &zout, &zout_size);
+  if (status != ENOTSUP) {
+    EXPECT_EQ_INT(0, status);
+    size_t check_size = ZSTD_decompress(check, sizeof(check), zout, zout_size);
+    OK(!ZSTD_isError(check_size));
+    EXPECT_EQ_UINT64(in_size, check_size);
+    OK(memcmp(in, check, in_size) == 0);
+  }
+
+  compress_destroy(z);
+#endif
+
+  /* Streams need a compression method. */
+  EXPECT_EQ_INT(EINVAL, compress_stream_begin(NULL));
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(parse);
+#if HAVE_ZLIB_H
+  RUN_TEST(gzip);
+#endif
+#if HAVE_ZSTD_H
+  RUN_TEST(zstd);
+#endif
+#if HAVE_SNAPPY_C_H
+  RUN_TEST(snappy);
+#endif
+  RUN_TEST(stream);
+
+  END_TEST;
+}
@@ -0,0 +1,505 @@
+/**
+ * collectd - src/utils_curl_engine.c
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "common.h"
+#include "plugin.h"
+#include "utils_curl_engine.h"
+
+/* Upper bound for sleeping in curl_multi_wait(); libcurl's own timers are
+ * honoured before that. */
+#define CURL_ENGINE_WAIT_MS 1000
+
+/* Name of the engine in the daemon's registry of shared objects. The layout
+ * of curl_engine_t is part of the name, so bump the version when changing
+ * it. */
+#define CURL_ENGINE_SHARED_NAME "utils_curl_engine/1"
+
+typedef struct curl_engine_request_s {
+  CURL *curl;
+  curl_engine_done_cb *done;
+  void *user_data;
+  plugin_ctx_t ctx;
+  _Bool added;  /* added to the multi handle */
+  _Bool cancel; /* remove without calling `done' */
+  struct curl_engine_request_s *next;
+} curl_engine_request_t;
+
+/* A plugin using the engine. */
+typedef struct curl_engine_user_s {
+  plugin_ctx_t ctx;
+  /* The copy of engine_main() compiled into the plugin. */
+  void *(*main)(void *);
+  size_t refs;
+  struct curl_engine_user_s *next;
+} curl_engine_user_t;
+
+/* The engine shared by all plugins. The engine thread runs the code of one of
+ * the plugins linking this file, its "owner", so everything it uses lives in
+ * here rather than in static variables. When the owner releases the engine,
+ * the thread is restarted on behalf of another user, so that the owner can be
+ * unloaded. */
+typedef struct curl_engine_s {
+  /* Serializes acquiring and releasing, which may stop and start the thread.
+   * The engine thread never takes it. */
+  pthread_mutex_t users_lock;
+  curl_engine_user_t *users;
+  curl_engine_user_t *owner; /* NULL while the thread is not running */
+
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  pthread_t thread;
+  _Bool running;
+  _Bool stop;
+
+  CURLM *multi;
+  int pipe[2];
+  curl_engine_request_t *requests;
+} curl_engine_t;
+
+/* Set while this plugin holds a reference to the engine. */
+static curl_engine_t *engine = NULL;
+static size_t engine_refs = 0;
+
+/* Must be called with e->lock held. */
+static curl_engine_request_t **engine_find(curl_engine_t *e, /* {{{ */
+                                           CURL *curl) {
+  curl_engine_request_t **ptr = &e->requests;
+  while ((*ptr != NULL) && ((*ptr)->curl != curl))
+    ptr = &(*ptr)->next;
+  return ptr;
+} /* }}} curl_engine_request_t **engine_find */
+
+/* Must be called with e->lock held. */
+static void engine_remove(curl_engine_t *e, /* {{{ */
+                          curl_engine_request_t **ptr) {
+  curl_engine_request_t *r = *ptr;
+
+  if (r->added)
+    curl_multi_remove_handle(e->multi, r->curl);
+  *ptr = r->next;
+  sfree(r);
+  pthread_cond_broadcast(&e->cond);
+} /* }}} void engine_remove */
+
+static void engine_wakeup(curl_engine_t *e) /* {{{ */
+{
+  char c = 0;
+  /* A full pipe already guarantees a wakeup. */
+  if (write(e->pipe[1], &c, 1) < 0 && errno != EAGAIN)
+    WARNING("utils_curl_engine: write to wakeup pipe failed: %s", STRERRNO);
+} /* }}} void engine_wakeup */
+
+/* Adds new requests to the multi handle and drops cancelled ones. Must be
+ * called with e->lock held. */
+static void engine_sync_requests(curl_engine_t *e) /* {{{ */
+{
+  curl_engine_request_t **ptr = &e->requests;
+
+  while (*ptr != NULL) {
+    curl_engine_request_t *r = *ptr;
+
+    if (r->cancel) {
+      engine_remove(e, ptr);
+      continue;
+    }
+
+    if (!r->added) {
+      CURLMcode status = curl_multi_add_handle(e->multi, r->curl);
+      if (status != CURLM_OK) {
+        ERROR("utils_curl_engine: curl_multi_add_handle failed: %s",
+              curl_multi_strerror(status));
+        plugin_ctx_t old_ctx = plugin_set_ctx(r->ctx);
+        r->done(r->curl, CURLE_FAILED_INIT, r->user_data);
+        plugin_set_ctx(old_ctx);
+        engine_remove(e, ptr);
+        continue;
+      }
+      r->added = 1;
+    }
+
+    ptr = &r->next;
+  }
+} /* }}} void engine_sync_requests */
+
+/* Calls the `done' callbacks of finished transfers. Must be called with
+ * e->lock held. */
+static void engine_collect_done(curl_engine_t *e) /* {{{ */
+{
+  CURLMsg *msg;
+  int remaining;
+
+  while ((msg = curl_multi_info_read(e->multi, &remaining)) != NULL) {
+    if (msg->msg != CURLMSG_DONE)
+      continue;
+
+    curl_engine_request_t **ptr = engine_find(e, msg->easy_handle);
+    if (*ptr == NULL)
+      continue;
+
+    curl_engine_request_t *r = *ptr;
+    CURL *curl = r->curl;
+    CURLcode result = msg->data.result;
+    curl_engine_done_cb *done = r->done;
+    void *user_data = r->user_data;
+    plugin_ctx_t ctx = r->ctx;
+
+    /* `msg' is invalid once the handle has been removed. */
+    engine_remove(e, ptr);
+
+    plugin_ctx_t old_ctx = plugin_set_ctx(ctx);
+    done(curl, result, user_data);
+    plugin_set_ctx(old_ctx);
+  }
+} /* }}} void engine_collect_done */
+
+static void *engine_main(void *arg) /* {{{ */
+{
+  curl_engine_t *e = arg;
+
+  pthread_mutex_lock(&e->lock);
+  while (!e->stop) {
+    int running = 0;
+
+    engine_sync_requests(e);
+    curl_multi_perform(e->multi, &running);
+    engine_collect_done(e);
+
+    /* curl_multi_wait() must not run concurrently with any other use of the
+     * multi handle. Submitters only touch the request list, so the lock can be
+     * dropped while waiting. */
+    pthread_mutex_unlock(&e->lock);
+
+    struct curl_waitfd wakeup = {
+        .fd = e->pipe[0], .events = CURL_WAIT_POLLIN,
+    };
+    curl_multi_wait(e->multi, &wakeup, 1, CURL_ENGINE_WAIT_MS,
+                    /* numfds = */ NULL);
+
+    char buffer[64];
+    while (read(e->pipe[0], buffer, sizeof(buffer)) > 0)
+      /* drain */;
+
+    pthread_mutex_lock(&e->lock);
+  }
+  pthread_mutex_unlock(&e->lock);
+
+  return NULL;
+} /* }}} void *engine_main */
+
+static void engine_free(curl_engine_t *e) /* {{{ */
+{
+  while (e->requests != NULL)
+    engine_remove(e, &e->requests);
+
+  if (e->multi != NULL)
+    curl_multi_cleanup(e->multi);
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(e->pipe); i++)
+    if (e->pipe[i] >= 0)
+      close(e->pipe[i]);
+
+  pthread_mutex_destroy(&e->users_lock);
+  pthread_mutex_destroy(&e->lock);
+  pthread_cond_destroy(&e->cond);
+  sfree(e);
+} /* }}} void engine_free */
+
+/* Called by plugin_shared_acquire() for the first user of the engine. The
+ * thread is started by engine_start(). */
+static void *engine_create(void) /* {{{ */
+{
+  curl_engine_t *e = calloc(1, sizeof(*e));
+  if (e == NULL) {
+    ERROR("utils_curl_engine: calloc failed.");
+    return NULL;
+  }
+  pthread_mutex_init(&e->users_lock, /* attr = */ NULL);
+  pthread_mutex_init(&e->lock, /* attr = */ NULL);
+  pthread_cond_init(&e->cond, /* attr = */ NULL);
+  e->pipe[0] = e->pipe[1] = -1;
+
+  if (pipe(e->pipe) != 0) {
+    ERROR("utils_curl_engine: pipe failed: %s", STRERRNO);
+    e->pipe[0] = e->pipe[1] = -1;
+    engine_free(e);
+    return NULL;
+  }
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(e->pipe); i++) {
+    fcntl(e->pipe[i], F_SETFL, O_NONBLOCK);
+    fcntl(e->pipe[i], F_SETFD, FD_CLOEXEC);
+  }
+
+  e->multi = curl_multi_init();
+  if (e->multi == NULL) {
+    ERROR("utils_curl_engine: curl_multi_init failed.");
+    engine_free(e);
+    return NULL;
+  }
+
+  return e;
+} /* }}} void *engine_create */
+
+/* Starts the engine thread on behalf of `user', so that it counts as one of
+ * the user's threads. Must be called with e->users_lock held. */
+static int engine_start(curl_engine_t *e, /* {{{ */
+                        curl_engine_user_t *user) {
+  /* Set beforehand, so that engine_cancel() leaves the multi handle alone. */
+  pthread_mutex_lock(&e->lock);
+  e->running = 1;
+  pthread_mutex_unlock(&e->lock);
+
+  plugin_ctx_t old_ctx = plugin_set_ctx(user->ctx);
+  int status = plugin_thread_create(&e->thread, /* attr = */ NULL,
+                                    user->main, e, "curl engine");
+  plugin_set_ctx(old_ctx);
+  if (status != 0) {
+    ERROR("utils_curl_engine: Starting thread failed: %s", STRERROR(status));
+    pthread_mutex_lock(&e->lock);
+    e->running = 0;
+    pthread_cond_broadcast(&e->cond);
+    pthread_mutex_unlock(&e->lock);
+    return status;
+  }
+
+  e->owner = user;
+  return 0;
+} /* }}} int engine_start */
+
+/* Must be called with e->users_lock held. */
+static void engine_stop(curl_engine_t *e) /* {{{ */
+{
+  if (e->owner == NULL)
+    return;
+
+  pthread_mutex_lock(&e->lock);
+  e->stop = 1;
+  engine_wakeup(e);
+  pthread_mutex_unlock(&e->lock);
+
+  pthread_join(e->thread, /* retval = */ NULL);
+
+  pthread_mutex_lock(&e->lock);
+  e->running = 0;
+  e->stop = 0;
+  /* Lets engine_cancel() remove the requests itself. */
+  pthread_cond_broadcast(&e->cond);
+  pthread_mutex_unlock(&e->lock);
+  e->owner = NULL;
+} /* }}} void engine_stop */
+
+static _Bool engine_same_plugin(char const *a, char const *b) /* {{{ */
+{
+  if ((a == NULL) || (b == NULL))
+    return a == b;
+  return strcmp(a, b) == 0;
+} /* }}} _Bool engine_same_plugin */
+
+/* Removes the requests matching `curl', or all requests submitted by the
+ * plugin `plugin' if `curl' is NULL, and waits until none of their callbacks
+ * is running. */
+static void engine_cancel(curl_engine_t *e, CURL *curl, /* {{{ */
+                          char const *plugin) {
+  pthread_mutex_lock(&e->lock);
+
+  _Bool pending = 1;
+  while (pending) {
+    pending = 0;
+    for (curl_engine_request_t *r = e->requests; r != NULL; r = r->next) {
+      if ((curl != NULL) ? (r->curl != curl)
+                         : !engine_same_plugin(r->ctx.name, plugin))
+        continue;
+      r->cancel = 1;
+      pending = 1;
+    }
+
+    if (pending && !e->running) {
+      curl_engine_request_t **ptr = &e->requests;
+      while (*ptr != NULL) {
+        if ((*ptr)->cancel)
+          engine_remove(e, ptr);
+        else
+          ptr = &(*ptr)->next;
+      }
+      break;
+    }
+
+    /* The engine thread removes the requests outside of any callback. */
+    if (pending) {
+      engine_wakeup(e);
+      pthread_cond_wait(&e->cond, &e->lock);
+    }
+  }
+
+  pthread_mutex_unlock(&e->lock);
+} /* }}} void engine_cancel */
+
+/* Drops a reference of the calling plugin. Once the plugin has none left, its
+ * transfers are aborted and, if the engine thread runs its code, the thread is
+ * handed over to another user. */
+static void engine_release(curl_engine_t *e) /* {{{ */
+{
+  char const *name = plugin_get_ctx().name;
+
+  pthread_mutex_lock(&e->users_lock);
+
+  curl_engine_user_t **ptr = &e->users;
+  while ((*ptr != NULL) && !engine_same_plugin((*ptr)->ctx.name, name))
+    ptr = &(*ptr)->next;
+
+  curl_engine_user_t *user = *ptr;
+  if ((user != NULL) && (--user->refs == 0)) {
+    engine_cancel(e, /* curl = */ NULL, name);
+
+    *ptr = user->next;
+    if (e->owner == user) {
+      engine_stop(e);
+      /* Transfers of the remaining users carry on where they were. */
+      for (curl_engine_user_t *u = e->users; u != NULL; u = u->next)
+        if (engine_start(e, u) == 0)
+          break;
+      if ((e->owner == NULL) && (e->users != NULL))
+        ERROR("utils_curl_engine: Restarting the engine thread failed. "
+              "Transfers of other plugins are stalled.");
+    }
+    sfree(user);
+  }
+
+  pthread_mutex_unlock(&e->users_lock);
+
+  if (plugin_shared_release(CURL_ENGINE_SHARED_NAME) != NULL) {
+    engine_stop(e);
+    engine_free(e);
+  }
+} /* }}} void engine_release */
+
+int curl_engine_acquire(void) /* {{{ */
+{
+  curl_engine_t *e =
+      plugin_shared_acquire(CURL_ENGINE_SHARED_NAME, engine_create);
+  if (e == NULL)
+    return -1;
+
+  plugin_ctx_t ctx = plugin_get_ctx();
+
+  pthread_mutex_lock(&e->users_lock);
+
+  curl_engine_user_t *user = e->users;
+  while ((user != NULL) && !engine_same_plugin(user->ctx.name, ctx.name))
+    user = user->next;
+
+  if (user == NULL) {
+    user = calloc(1, sizeof(*user));
+    if (user == NULL) {
+      pthread_mutex_unlock(&e->users_lock);
+      ERROR("utils_curl_engine: calloc failed.");
+      if (plugin_shared_release(CURL_ENGINE_SHARED_NAME) != NULL)
+        engine_free(e);
+      return -1;
+    }
+    user->ctx = ctx;
+    user->main = engine_main;
+    user->next = e->users;
+    e->users = user;
+  }
+  user->refs++;
+
+  if ((e->owner == NULL) && (engine_start(e, user) != 0)) {
+    pthread_mutex_unlock(&e->users_lock);
+    engine_release(e);
+    return -1;
+  }
+
+  pthread_mutex_unlock(&e->users_lock);
+
+  engine = e;
+  engine_refs++;
+  return 0;
+} /* }}} int curl_engine_acquire */
+
+void curl_engine_release(void) /* {{{ */
+{
+  if (engine_refs == 0)
+    return;
+
+  curl_engine_t *e = engine;
+  engine_refs--;
+  if (engine_refs == 0)
+    engine = NULL;
+
+  engine_release(e);
+} /* }}} void curl_engine_release */
+
+int curl_engine_submit(CURL *curl, curl_engine_done_cb *done, /* {{{ */
+                       void *user_data) {
+  curl_engine_t *e = engine;
+
+  if ((curl == NULL) || (done == NULL) || (e == NULL))
+    return EINVAL;
+
+  pthread_mutex_lock(&e->lock);
+
+  if (*engine_find(e, curl) != NULL) {
+    pthread_mutex_unlock(&e->lock);
+    return EBUSY;
+  }
+
+  curl_engine_request_t *r = calloc(1, sizeof(*r));
+  if (r == NULL) {
+    pthread_mutex_unlock(&e->lock);
+    return ENOMEM;
+  }
+  r->curl = curl;
+  r->done = done;
+  r->user_data = user_data;
+  r->ctx = plugin_get_ctx();
+  r->next = e->requests;
+  e->requests = r;
+
+  engine_wakeup(e);
+  pthread_mutex_unlock(&e->lock);
+  return 0;
+} /* }}} int curl_engine_submit */
+
+_Bool curl_engine_busy(CURL *curl) /* {{{ */
+{
+  curl_engine_t *e = engine;
+
+  if (e == NULL)
+    return 0;
+
+  pthread_mutex_lock(&e->lock);
+  _Bool busy = (*engine_find(e, curl) != NULL);
+  pthread_mutex_unlock(&e->lock);
+  return busy;
+} /* }}} _Bool curl_engine_busy */
+
+void curl_engine_cancel(CURL *curl) /* {{{ */
+{
+  curl_engine_t *e = engine;
+
+  if ((e == NULL) || (curl == NULL))
+    return;
+
+  engine_cancel(e, curl, /* plugin = */ NULL);
+} /* }}} void curl_engine_cancel */
@@ -0,0 +1,108 @@
+/**
+ * collectd - src/utils_curl_engine.h
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef UTILS_CURL_ENGINE_H
+#define UTILS_CURL_ENGINE_H 1
+
+#include <curl/curl.h>
+
+/*
+ * A transfer engine running all submitted cURL easy handles on one thread
+ * through a single multi handle. Handles submitted this way share the multi
+ * handle's connection cache and DNS cache, so keep-alive connections are
+ * reused across URLs of the same host.
+ *
+ * There is one engine per process, shared by all plugins linking this file
+ * through `plugin_shared_acquire'. The engine thread is started by the first
+ * plugin calling `curl_engine_acquire' and runs its code, so that plugin can
+ * only be unloaded once the other plugins have released the engine as well.
+ */
+
+/*
+ * Called on the engine thread once the transfer of `curl' has finished.
+ * `status' is the transfer's result. The handle belongs to the caller again.
+ * The callback must not call any of the curl_engine_* functions.
+ */
+typedef void curl_engine_done_cb(CURL *curl, CURLcode status, void *user_data);
+
+/*
+ * NAME
+ *   curl_engine_acquire
+ *
+ * DESCRIPTION
+ *   Takes a reference to the engine, starting it if this is the first one.
+ *   Plugins call this from their init callback before submitting transfers.
+ *
+ * RETURN VALUE
+ *   Zero on success, non-zero otherwise.
+ */
+int curl_engine_acquire(void);
+
+/*
+ * NAME
+ *   curl_engine_release
+ *
+ * DESCRIPTION
+ *   Drops a reference taken with `curl_engine_acquire'. Once the calling
+ *   plugin has released all of its references, its transfers are aborted.
+ *   The engine thread is stopped when the last plugin releases the engine.
+ */
+void curl_engine_release(void);
+
+/*
+ * NAME
+ *   curl_engine_submit
+ *
+ * DESCRIPTION
+ *   Starts the transfer of `curl' on the engine thread and returns
+ *   immediately. The write and header callbacks of `curl' as well as `done'
+ *   are called on the engine thread in the plugin context of the caller.
+ *
+ * RETURN VALUE
+ *   Zero on success, EBUSY if `curl' is still being transferred, EINVAL if
+ *   the engine has not been acquired, another errno value otherwise.
+ */
+int curl_engine_submit(CURL *curl, curl_engine_done_cb *done, void *user_data);
+
+/*
+ * NAME
+ *   curl_engine_busy
+ *
+ * DESCRIPTION
+ *   Returns true if `curl' has been submitted and `done' has not been called
+ *   yet.
+ */
+_Bool curl_engine_busy(CURL *curl);
+
+/*
+ * NAME
+ *   curl_engine_cancel
+ *
+ * DESCRIPTION
+ *   Aborts the transfer of `curl', if any. When this function returns, no
+ *   callback for `curl' is running and none will be called, so the handle and
+ *   its user data may be freed.
+ */
+void curl_engine_cancel(CURL *curl);
+
+#endif /* UTILS_CURL_ENGINE_H */
@@ -50,13 +50,19 @@ struct curl_stats_s {
   bool redirect_count;
   bool num_connects;
   bool appconnect_time;
+  bool compression;
+
+  /* Totals reported by curl_stats_account_compression(). */
+  uint64_t uncompressed_bytes;
+  uint64_t compressed_bytes;
 };
 
 /*
  * Private functions
  */
 
-static int dispatch_gauge(CURL *curl, CURLINFO info, value_list_t *vl) {
+static int dispatch_gauge(curl_stats_t __attribute__((unused)) * s,
+                          CURL *curl, CURLINFO info, value_list_t *vl) {
   CURLcode code;
   value_t v;
 
@@ -71,7 +77,8 @@ static int dispatch_gauge(CURL *curl, CURLINFO info, value_list_t *vl) {
 } /* dispatch_gauge */
 
 /* dispatch a speed, in bytes/second */
-static int dispatch_speed(CURL *curl, CURLINFO info, value_list_t *vl) {
+static int dispatch_speed(curl_stats_t __attribute__((unused)) * s,
+                          CURL *curl, CURLINFO info, value_list_t *vl) {
   CURLcode code;
   value_t v;
 
@@ -88,7 +95,8 @@ static int dispatch_speed(CURL *curl, CURLINFO info, value_list_t *vl) {
 } /* dispatch_speed */
 
 /* dispatch a size/count, reported as a long value */
-static int dispatch_size(CURL *curl, CURLINFO info, value_list_t *vl) {
+static int dispatch_size(curl_stats_t __attribute__((unused)) * s,
+                         CURL *curl, CURLINFO info, value_list_t *vl) {
   CURLcode code;
   value_t v;
   long raw;
@@ -105,12 +113,30 @@ static int dispatch_size(CURL *curl, CURLINFO info, value_list_t *vl) {
   return plugin_dispatch_values(vl);
 } /* dispatch_size */
 
+/* dispatch the bytes passed to curl_stats_account_compression() */
+static int dispatch_compression(curl_stats_t *s,
+                                CURL __attribute__((unused)) * curl,
+                                CURLINFO __attribute__((unused)) info,
+                                value_list_t *vl) {
+  value_t v[2];
+
+  v[0].derive =
+      (derive_t)__atomic_load_n(&s->uncompressed_bytes, __ATOMIC_RELAXED);
+  v[1].derive =
+      (derive_t)__atomic_load_n(&s->compressed_bytes, __ATOMIC_RELAXED);
+
+  vl->values = v;
+  vl->values_len = STATIC_ARRAY_SIZE(v);
+
+  return plugin_dispatch_values(vl);
+} /* dispatch_compression */
+
 static struct {
   const char *name;
   const char *config_key;
   size_t offset;
 
-  int (*dispatcher)(CURL *, CURLINFO, value_list_t *);
+  int (*dispatcher)(curl_stats_t *, CURL *, CURLINFO, value_list_t *);
   const char *type;
   CURLINFO info;
 } field_specs[] = {
@@ -153,6 +179,8 @@ static struct {
     SPEC(appconnect_time, "AppconnectTime", dispatch_gauge, "duration",
          CURLINFO_APPCONNECT_TIME),
 #endif
+    SPEC(compression, "Compression", dispatch_compression, "compression",
+         CURLINFO_NONE),
 
 #undef SPEC
 };
@@ -243,10 +271,20 @@ int curl_stats_dispatch(curl_stats_t *s, CURL *curl, const char *hostname,
 
     vl.values = NULL;
     vl.values_len = 0;
-    status = field_specs[field].dispatcher(curl, field_specs[field].info, &vl);
+    status =
+        field_specs[field].dispatcher(s, curl, field_specs[field].info, &vl);
     if (status < 0)
       return status;
   }
 
   return 0;
 } /* curl_stats_dispatch */
+
+void curl_stats_account_compression(curl_stats_t *s, uint64_t uncompressed,
+                                    uint64_t compressed) {
+  if (s == NULL)
+    return;
+
+  __atomic_add_fetch(&s->uncompressed_bytes, uncompressed, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&s->compressed_bytes, compressed, __ATOMIC_RELAXED);
+} /* curl_stats_account_compression */
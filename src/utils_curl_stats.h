@@ -53,4 +53,12 @@ void curl_stats_destroy(curl_stats_t *s);
 int curl_stats_dispatch(curl_stats_t *s, CURL *curl, const char *hostname,
                         const char *plugin, const char *plugin_instance);
 
+/*
+ * curl_stats_account_compression adds to the byte counters reported by the
+ * "Compression" field: "uncompressed" bytes of payload have been sent as
+ * "compressed" bytes. It may be called from any thread.
+ */
+void curl_stats_account_compression(curl_stats_t *s, uint64_t uncompressed,
+                                    uint64_t compressed);
+
 #endif /* UTILS_CURL_STATS_H */
@@ -71,6 +71,7 @@ struct udb_result_preparation_area_s /* {{{ */
   char **values_buffer;
   char **metadata_buffer;
   char *plugin_instance;
+  value_t *values;
 
   struct udb_result_preparation_area_s *next;
 }; /* }}} */
@@ -86,6 +87,12 @@ struct udb_query_preparation_area_s /* {{{ */
 
   cdtime_t interval;
 
+  /* Column names the result mappings were resolved for, stored one after
+   * another with their terminating null bytes. As long as a query returns
+   * the same columns, the mappings are reused rather than resolved again. */
+  char *columns;
+  size_t columns_num;
+
   udb_result_preparation_area_t *result_prep_areas;
 }; /* }}} */
 
@@ -192,11 +199,7 @@ static int udb_result_submit(udb_result_t *r, /* {{{ */
   assert(((size_t)r_area->ds->ds_num) == r->values_num);
   assert(r->values_num > 0);
 
-  vl.values = calloc(r->values_num, sizeof(*vl.values));
-  if (vl.values == NULL) {
-    ERROR("db query utils: calloc failed.");
-    return -1;
-  }
+  vl.values = r_area->values;
   vl.values_len = r_area->ds->ds_num;
 
   for (size_t i = 0; i < r->values_num; i++) {
@@ -206,7 +209,6 @@ static int udb_result_submit(udb_result_t *r, /* {{{ */
       ERROR("db query utils: udb_result_submit: Parsing `%s' as %s failed.",
             value_str, DS_TYPE_TO_STRING(r_area->ds->ds[i].type));
       errno = EINVAL;
-      free(vl.values);
       return -1;
     }
   }
@@ -290,7 +292,6 @@ static int udb_result_submit(udb_result_t *r, /* {{{ */
     meta_data_destroy(vl.meta);
     vl.meta = NULL;
   }
-  sfree(vl.values);
   return 0;
 } /* }}} void udb_result_submit */
 
@@ -306,6 +307,7 @@ static void udb_result_finish_result(udb_result_t const *r, /* {{{ */
   sfree(prep_area->instances_buffer);
   sfree(prep_area->values_buffer);
   sfree(prep_area->metadata_buffer);
+  sfree(prep_area->values);
 } /* }}} void udb_result_finish_result */
 
 static int udb_result_handle_result(udb_result_t *r, /* {{{ */
@@ -344,6 +346,7 @@ static int udb_result_prepare_result(udb_result_t const *r, /* {{{ */
   sfree(prep_area->instances_buffer);                                          \
   sfree(prep_area->values_buffer);                                             \
   sfree(prep_area->metadata_buffer);                                           \
+  sfree(prep_area->values);                                                    \
   return (status)
 
   /* Make sure previous preparations are cleaned up. */
@@ -401,6 +404,12 @@ static int udb_result_prepare_result(udb_result_t const *r, /* {{{ */
     BAIL_OUT(-ENOMEM);
   }
 
+  prep_area->values = calloc(r->values_num, sizeof(*prep_area->values));
+  if (prep_area->values == NULL) {
+    ERROR("db query utils: udb_result_prepare_result: calloc failed.");
+    BAIL_OUT(-ENOMEM);
+  }
+
   prep_area->metadata_pos = (size_t *)calloc(r->metadata_num, sizeof(size_t));
   if (prep_area->metadata_pos == NULL) {
     ERROR("db query utils: udb_result_prepare_result: calloc failed.");
@@ -846,14 +855,13 @@ int udb_query_check_version(udb_query_t *q, unsigned int version) /* {{{ */
   return 1;
 } /* }}} int udb_query_check_version */
 
-void udb_query_finish_result(udb_query_t const *q, /* {{{ */
-                             udb_query_preparation_area_t *prep_area) {
+/* Frees the result mappings and the cached column names, so that the next
+ * call to udb_query_prepare_result() resolves the columns again. */
+static void udb_query_reset_result(udb_query_t const *q, /* {{{ */
+                                   udb_query_preparation_area_t *prep_area) {
   udb_result_preparation_area_t *r_area;
   udb_result_t *r;
 
-  if ((q == NULL) || (prep_area == NULL))
-    return;
-
   prep_area->column_num = 0;
   sfree(prep_area->host);
   sfree(prep_area->plugin);
@@ -861,6 +869,9 @@ void udb_query_finish_result(udb_query_t const *q, /* {{{ */
 
   prep_area->interval = 0;
 
+  sfree(prep_area->columns);
+  prep_area->columns_num = 0;
+
   for (r = q->results, r_area = prep_area->result_prep_areas; r != NULL;
        r = r->next, r_area = r_area->next) {
     /* this may happen during error conditions of the caller */
@@ -868,6 +879,67 @@ void udb_query_finish_result(udb_query_t const *q, /* {{{ */
       break;
     udb_result_finish_result(r, r_area);
   }
+} /* }}} void udb_query_reset_result */
+
+/* Returns true if the result mappings of `prep_area' have been resolved for
+ * exactly these columns and identifiers. */
+static _Bool
+udb_query_result_cached(udb_query_preparation_area_t *prep_area, /* {{{ */
+                        const char *host, const char *plugin,
+                        const char *db_name, char **column_names,
+                        size_t column_num, cdtime_t interval) {
+  if ((prep_area->columns == NULL) || (prep_area->columns_num != column_num))
+    return 0;
+
+  if ((prep_area->interval != interval) ||
+      (strcmp(prep_area->host, host) != 0) ||
+      (strcmp(prep_area->plugin, plugin) != 0) ||
+      (strcmp(prep_area->db_name, db_name) != 0))
+    return 0;
+
+  const char *name = prep_area->columns;
+  for (size_t i = 0; i < column_num; i++) {
+    if (strcmp(name, column_names[i]) != 0)
+      return 0;
+    name += strlen(name) + 1;
+  }
+
+  return 1;
+} /* }}} _Bool udb_query_result_cached */
+
+/* Remembers the column names the result mappings have been resolved for. */
+static int
+udb_query_cache_columns(udb_query_preparation_area_t *prep_area, /* {{{ */
+                        char **column_names, size_t column_num) {
+  size_t size = 0;
+
+  for (size_t i = 0; i < column_num; i++)
+    size += strlen(column_names[i]) + 1;
+
+  prep_area->columns = malloc(size);
+  if (prep_area->columns == NULL)
+    return ENOMEM;
+
+  char *ptr = prep_area->columns;
+  for (size_t i = 0; i < column_num; i++) {
+    size_t len = strlen(column_names[i]) + 1;
+    memcpy(ptr, column_names[i], len);
+    ptr += len;
+  }
+
+  prep_area->columns_num = column_num;
+  return 0;
+} /* }}} int udb_query_cache_columns */
+
+void udb_query_finish_result(udb_query_t const *q, /* {{{ */
+                             udb_query_preparation_area_t *prep_area) {
+  if ((q == NULL) || (prep_area == NULL))
+    return;
+
+  /* The result mappings are kept for the next interval. Resetting
+   * `column_num' makes udb_query_handle_result() refuse to use them until
+   * the query has been prepared again. */
+  prep_area->column_num = 0;
 } /* }}} void udb_query_finish_result */
 
 int udb_query_handle_result(udb_query_t const *q, /* {{{ */
@@ -929,7 +1001,13 @@ int udb_query_prepare_result(udb_query_t const *q, /* {{{ */
   if ((q == NULL) || (prep_area == NULL))
     return -EINVAL;
 
-  udb_query_finish_result(q, prep_area);
+  if (udb_query_result_cached(prep_area, host, plugin, db_name, column_names,
+                              column_num, interval)) {
+    prep_area->column_num = column_num;
+    return 0;
+  }
+
+  udb_query_reset_result(q, prep_area);
 
   prep_area->column_num = column_num;
   prep_area->host = strdup(host);
@@ -942,7 +1020,7 @@ int udb_query_prepare_result(udb_query_t const *q, /* {{{ */
       (prep_area->db_name == NULL)) {
     ERROR("db query utils: Query `%s': Prepare failed: Out of memory.",
           q->name);
-    udb_query_finish_result(q, prep_area);
+    udb_query_reset_result(q, prep_area);
     return -ENOMEM;
   }
 
@@ -971,7 +1049,7 @@ int udb_query_prepare_result(udb_query_t const *q, /* {{{ */
       ERROR("db query utils: udb_query_prepare_result: "
             "Column `%s' from `PluginInstanceFrom' could not be found.",
             q->plugin_instance_from);
-      udb_query_finish_result(q, prep_area);
+      udb_query_reset_result(q, prep_area);
       return -ENOENT;
     }
   }
@@ -983,17 +1061,24 @@ int udb_query_prepare_result(udb_query_t const *q, /* {{{ */
       ERROR("db query utils: Query `%s': Invalid number of result "
             "preparation areas.",
             q->name);
-      udb_query_finish_result(q, prep_area);
+      udb_query_reset_result(q, prep_area);
       return -EINVAL;
     }
 
     status = udb_result_prepare_result(r, r_area, column_names, column_num);
     if (status != 0) {
-      udb_query_finish_result(q, prep_area);
+      udb_query_reset_result(q, prep_area);
       return status;
     }
   }
 
+  if (udb_query_cache_columns(prep_area, column_names, column_num) != 0) {
+    ERROR("db query utils: Query `%s': Prepare failed: Out of memory.",
+          q->name);
+    udb_query_reset_result(q, prep_area);
+    return -ENOMEM;
+  }
+
   return 0;
 } /* }}} int udb_query_prepare_result */
 
@@ -1049,14 +1134,18 @@ void udb_query_delete_preparation_area(
 
     sfree(area->instances_pos);
     sfree(area->values_pos);
+    sfree(area->metadata_pos);
     sfree(area->instances_buffer);
     sfree(area->values_buffer);
+    sfree(area->metadata_buffer);
+    sfree(area->values);
     free(area);
   }
 
   sfree(q_area->host);
   sfree(q_area->plugin);
   sfree(q_area->db_name);
+  sfree(q_area->columns);
 
   free(q_area);
 } /* }}} void udb_query_delete_preparation_area */
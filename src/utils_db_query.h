@@ -67,6 +67,13 @@ void *udb_query_get_user_data(udb_query_t *q);
  */
 int udb_query_check_version(udb_query_t *q, unsigned int version);
 
+/*
+ * udb_query_prepare_result
+ *
+ * Maps the columns of a result to the configured instances, values and meta
+ * data. The mapping is kept in `prep_area' by udb_query_finish_result() and
+ * reused as long as the query returns the same columns.
+ */
 int udb_query_prepare_result(udb_query_t const *q,
                              udb_query_preparation_area_t *prep_area,
                              const char *host, const char *plugin,
@@ -165,14 +165,6 @@ static ip_list_t *IgnoreList = NULL;
 
 #if HAVE_PCAP_H
 static void (*Callback)(const rfc1035_header_t *) = NULL;
-
-static int query_count_intvl = 0;
-static int query_count_total = 0;
-#ifdef __OpenBSD__
-static struct bpf_timeval last_ts;
-#else
-static struct timeval last_ts;
-#endif /* __OpenBSD__ */
 #endif /* HAVE_PCAP_H */
 
 static int cmp_in6_addr(const struct in6_addr *a, const struct in6_addr *b) {
@@ -615,52 +607,43 @@ static int handle_linux_sll(const u_char *pkt, int len) {
 /* public function */
 void handle_pcap(u_char *udata, const struct pcap_pkthdr *hdr,
                  const u_char *pkt) {
-  int status;
+  pcap_t *po = (udata != NULL) ? (pcap_t *)udata : pcap_obj;
 
   if (hdr->caplen < ETHER_HDR_LEN)
     return;
 
-  switch (pcap_datalink(pcap_obj)) {
+  switch (pcap_datalink(po)) {
   case DLT_EN10MB:
-    status = handle_ether(pkt, hdr->caplen);
+    handle_ether(pkt, hdr->caplen);
     break;
 #if HAVE_NET_IF_PPP_H
   case DLT_PPP:
-    status = handle_ppp(pkt, hdr->caplen);
+    handle_ppp(pkt, hdr->caplen);
     break;
 #endif
 #ifdef DLT_LOOP
   case DLT_LOOP:
-    status = handle_loop(pkt, hdr->caplen);
+    handle_loop(pkt, hdr->caplen);
     break;
 #endif
 #ifdef DLT_RAW
   case DLT_RAW:
-    status = handle_raw(pkt, hdr->caplen);
+    handle_raw(pkt, hdr->caplen);
     break;
 #endif
 #ifdef DLT_LINUX_SLL
   case DLT_LINUX_SLL:
-    status = handle_linux_sll(pkt, hdr->caplen);
+    handle_linux_sll(pkt, hdr->caplen);
     break;
 #endif
   case DLT_NULL:
-    status = handle_null(pkt, hdr->caplen);
+    handle_null(pkt, hdr->caplen);
     break;
 
   default:
-    ERROR("handle_pcap: unsupported data link type %d",
-          pcap_datalink(pcap_obj));
-    status = 0;
+    ERROR("handle_pcap: unsupported data link type %d", pcap_datalink(po));
     break;
-  } /* switch (pcap_datalink(pcap_obj)) */
-
-  if (0 == status)
-    return;
-
-  query_count_intvl++;
-  query_count_total++;
-  last_ts = hdr->ts;
+  } /* switch (pcap_datalink(po)) */
 }
 #endif /* HAVE_PCAP_H */
 
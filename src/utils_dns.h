@@ -80,6 +80,8 @@ void dnstop_set_callback(void (*cb)(const rfc1035_header_t *));
 
 void ignore_list_add_name(const char *name);
 #if HAVE_PCAP_H
+/* `udata' may point to the pcap_t the packet was captured from. Otherwise the
+ * object passed to dnstop_set_pcap_obj() is used. */
 void handle_pcap(u_char *udata, const struct pcap_pkthdr *hdr,
                  const u_char *pkt);
 #endif
@@ -0,0 +1,156 @@
+/**
+ * collectd - src/utils_ds_select.c
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "common.h"
+#include "utils_avltree.h"
+#include "utils_ds_select.h"
+
+struct ds_select_entry_s {
+  size_t ds_num;
+  uint64_t mask;
+};
+typedef struct ds_select_entry_s ds_select_entry_t;
+
+struct ds_select_s {
+  char **names;
+  size_t names_num;
+
+  pthread_mutex_t lock;
+  c_avl_tree_t *masks; /* type -> ds_select_entry_t */
+};
+
+static _Bool ds_select_name(ds_select_t const *sel, /* {{{ */
+                            char const *name) {
+  for (size_t i = 0; i < sel->names_num; i++)
+    if (strcasecmp(name, sel->names[i]) == 0)
+      return 1;
+  return 0;
+} /* }}} _Bool ds_select_name */
+
+static uint64_t ds_select_resolve(ds_select_t const *sel, /* {{{ */
+                                  data_set_t const *ds) {
+  uint64_t mask = 0;
+
+  for (size_t i = 0; (i < ds->ds_num) && (i < DS_SELECT_MASK_BITS); i++)
+    if (ds_select_name(sel, ds->ds[i].name))
+      mask |= ((uint64_t)1) << i;
+
+  return mask;
+} /* }}} uint64_t ds_select_resolve */
+
+ds_select_t *ds_select_create(char **names, size_t names_num) /* {{{ */
+{
+  if ((names == NULL) || (names_num == 0))
+    return NULL;
+
+  ds_select_t *sel = calloc(1, sizeof(*sel));
+  if (sel == NULL)
+    return NULL;
+
+  sel->names = calloc(names_num, sizeof(*sel->names));
+  sel->masks = c_avl_create((int (*)(const void *, const void *))strcmp);
+  if ((sel->names == NULL) || (sel->masks == NULL)) {
+    ds_select_destroy(sel);
+    return NULL;
+  }
+  pthread_mutex_init(&sel->lock, /* attr = */ NULL);
+
+  for (size_t i = 0; i < names_num; i++) {
+    sel->names[i] = strdup(names[i]);
+    if (sel->names[i] == NULL) {
+      ds_select_destroy(sel);
+      return NULL;
+    }
+    sel->names_num++;
+  }
+
+  return sel;
+} /* }}} ds_select_t *ds_select_create */
+
+void ds_select_destroy(ds_select_t *sel) /* {{{ */
+{
+  if (sel == NULL)
+    return;
+
+  if (sel->masks != NULL) {
+    void *key;
+    void *value;
+
+    while (c_avl_pick(sel->masks, &key, &value) == 0) {
+      sfree(key);
+      sfree(value);
+    }
+    c_avl_destroy(sel->masks);
+    pthread_mutex_destroy(&sel->lock);
+  }
+
+  strarray_free(sel->names, sel->names_num);
+  sfree(sel);
+} /* }}} void ds_select_destroy */
+
+uint64_t ds_select_mask(ds_select_t *sel, data_set_t const *ds) /* {{{ */
+{
+  if (sel == NULL)
+    return DS_SELECT_ALL;
+
+  ds_select_entry_t *e = NULL;
+
+  pthread_mutex_lock(&sel->lock);
+  if (c_avl_get(sel->masks, ds->type, (void *)&e) == 0) {
+    /* A data set may be replaced by one with different data sources. */
+    if (e->ds_num != ds->ds_num) {
+      e->ds_num = ds->ds_num;
+      e->mask = ds_select_resolve(sel, ds);
+    }
+    uint64_t mask = e->mask;
+    pthread_mutex_unlock(&sel->lock);
+    return mask;
+  }
+
+  uint64_t mask = ds_select_resolve(sel, ds);
+
+  char *type = strdup(ds->type);
+  e = malloc(sizeof(*e));
+  if (e != NULL)
+    *e = (ds_select_entry_t){.ds_num = ds->ds_num, .mask = mask};
+  if ((type == NULL) || (e == NULL) ||
+      (c_avl_insert(sel->masks, type, e) != 0)) {
+    /* Not an error, the mask is just resolved again next time. */
+    sfree(type);
+    sfree(e);
+  }
+  pthread_mutex_unlock(&sel->lock);
+
+  return mask;
+} /* }}} uint64_t ds_select_mask */
+
+_Bool ds_select_index(ds_select_t const *sel, /* {{{ */
+                      data_set_t const *ds, uint64_t mask, size_t index) {
+  if (index < DS_SELECT_MASK_BITS)
+    return (mask >> index) & 1;
+  if (sel == NULL)
+    return 1;
+  return ds_select_name(sel, ds->ds[index].name);
+} /* }}} _Bool ds_select_index */
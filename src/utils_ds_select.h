@@ -0,0 +1,81 @@
+/**
+ * collectd - src/utils_ds_select.h
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef UTILS_DS_SELECT_H
+#define UTILS_DS_SELECT_H 1
+
+#include "collectd.h"
+
+#include "plugin.h"
+
+/* Selects all data sources, see ds_select_mask(). */
+#define DS_SELECT_ALL UINT64_MAX
+
+/* Number of data sources covered by a mask. */
+#define DS_SELECT_MASK_BITS 64
+
+struct ds_select_s;
+typedef struct ds_select_s ds_select_t;
+
+/*
+ * NAME
+ *   ds_select_create
+ *
+ * DESCRIPTION
+ *   Creates a selection of data sources by name, as configured with the
+ *   "DataSource" option of matches and targets. Names are compared case
+ *   insensitively. The names are copied.
+ *
+ * RETURN VALUE
+ *   The selection, or NULL if `names_num' is zero or on failure. A NULL
+ *   selection selects all data sources.
+ */
+ds_select_t *ds_select_create(char **names, size_t names_num);
+
+void ds_select_destroy(ds_select_t *sel);
+
+/*
+ * NAME
+ *   ds_select_mask
+ *
+ * DESCRIPTION
+ *   Returns the selected data sources of `ds' as a bit mask, bit `i' standing
+ *   for `ds->ds[i]'. The mask is resolved once per data set and then looked
+ *   up by type, so that the names don't have to be compared for every value
+ *   list. Data sources beyond the first DS_SELECT_MASK_BITS are checked with
+ *   ds_select_index().
+ */
+uint64_t ds_select_mask(ds_select_t *sel, data_set_t const *ds);
+
+/*
+ * NAME
+ *   ds_select_index
+ *
+ * DESCRIPTION
+ *   Returns true if the data source `index' of `ds' is selected, given the
+ *   `mask' returned by ds_select_mask().
+ */
+_Bool ds_select_index(ds_select_t const *sel, data_set_t const *ds,
+                      uint64_t mask, size_t index);
+
+#endif /* UTILS_DS_SELECT_H */
@@ -0,0 +1,78 @@
+/**
+ * collectd - src/utils_ds_select_test.c
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "common.h"
+#include "testing.h"
+#include "utils_ds_select.h"
+
+static data_source_t if_octets_dsrc[] = {
+    {"rx", DS_TYPE_DERIVE, 0, NAN}, {"tx", DS_TYPE_DERIVE, 0, NAN},
+};
+static data_set_t const if_octets = {"if_octets", 2, if_octets_dsrc};
+
+static data_source_t load_dsrc[] = {
+    {"shortterm", DS_TYPE_GAUGE, 0, NAN},
+    {"midterm", DS_TYPE_GAUGE, 0, NAN},
+    {"longterm", DS_TYPE_GAUGE, 0, NAN},
+};
+static data_set_t const load = {"load", 3, load_dsrc};
+
+DEF_TEST(mask) {
+  char *names[] = {"TX", "midterm", "longterm"};
+  ds_select_t *sel = ds_select_create(names, STATIC_ARRAY_SIZE(names));
+
+  CHECK_NOT_NULL(sel);
+  /* The second lookup is served from the cache. */
+  for (int i = 0; i < 2; i++) {
+    EXPECT_EQ_UINT64(0x2, ds_select_mask(sel, &if_octets));
+    EXPECT_EQ_UINT64(0x6, ds_select_mask(sel, &load));
+  }
+
+  uint64_t mask = ds_select_mask(sel, &load);
+  OK(!ds_select_index(sel, &load, mask, 0));
+  OK(ds_select_index(sel, &load, mask, 1));
+
+  /* A data set replaced by one with other data sources is resolved again. */
+  data_set_t const if_rx = {"if_octets", 1, if_octets_dsrc};
+  EXPECT_EQ_UINT64(0x0, ds_select_mask(sel, &if_rx));
+
+  ds_select_destroy(sel);
+  return 0;
+}
+
+DEF_TEST(all) {
+  OK(ds_select_create(NULL, 0) == NULL);
+  EXPECT_EQ_UINT64(DS_SELECT_ALL, ds_select_mask(NULL, &load));
+  OK(ds_select_index(NULL, &load, DS_SELECT_ALL, 2));
+
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(mask);
+  RUN_TEST(all);
+
+  END_TEST;
+}
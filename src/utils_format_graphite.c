@@ -28,9 +28,21 @@
 
 #include "utils_cache.h"
 #include "utils_format_graphite.h"
+#include "utils_name_cache.h"
 
 #define GRAPHITE_FORBIDDEN " \t\"\\:!/()\n\r"
 
+/* Flags which change the metric name. */
+#define GRAPHITE_NAME_FLAGS                                                    \
+  (GRAPHITE_SEPARATE_INSTANCES | GRAPHITE_DROP_DUPE_FIELDS |                   \
+   GRAPHITE_PRESERVE_SEPARATOR)
+
+/* Number of metric names cached, see gr_name_cache_key(). */
+#define GRAPHITE_NAME_CACHE_SIZE 131072
+
+static name_cache_t *gr_name_cache;
+static pthread_once_t gr_name_cache_once = PTHREAD_ONCE_INIT;
+
 /* Utils functions to format data sets in graphite format.
  * Largely taken from write_graphite.c as it remains the same formatting */
 
@@ -172,6 +184,24 @@ static void escape_graphite_string(char *buffer, char escape_char) {
     *head = escape_char;
 }
 
+static void gr_name_cache_init(void) {
+  gr_name_cache = name_cache_create(GRAPHITE_NAME_CACHE_SIZE);
+}
+
+/* The metric names are cached by the value list's identity. The key holds
+ * everything else the name depends on, so that callers with different
+ * settings can share the cache. */
+static uint64_t gr_name_cache_key(char const *prefix, char const *postfix,
+                                  char const escape_char, unsigned int flags) {
+  char const options[] = {escape_char,
+                          (char)('A' + (flags & GRAPHITE_NAME_FLAGS)), '\0'};
+  uint64_t key = NAME_CACHE_KEY_INIT;
+
+  key = name_cache_key(key, prefix);
+  key = name_cache_key(key, postfix);
+  return name_cache_key(key, options);
+}
+
 int format_graphite(char *buffer, size_t buffer_size, data_set_t const *ds,
                     value_list_t const *vl, char const *prefix,
                     char const *postfix, char const escape_char,
@@ -179,6 +209,17 @@ int format_graphite(char *buffer, size_t buffer_size, data_set_t const *ds,
   int status = 0;
   int buffer_pos = 0;
 
+  /* Repeated value lists only need their values formatted. */
+  value_list_identity_t const *identity = VALUE_LIST_IDENTITY(vl);
+  uint64_t cache_key = 0;
+  if (identity != NULL) {
+    pthread_once(&gr_name_cache_once, gr_name_cache_init);
+    if (gr_name_cache == NULL)
+      identity = NULL;
+    else
+      cache_key = gr_name_cache_key(prefix, postfix, escape_char, flags);
+  }
+
   gauge_t *rates = NULL;
   if (flags & GRAPHITE_STORE_RATES) {
     rates = uc_get_rate(ds, vl);
@@ -198,16 +239,27 @@ int format_graphite(char *buffer, size_t buffer_size, data_set_t const *ds,
     if ((flags & GRAPHITE_ALWAYS_APPEND_DS) || (ds->ds_num > 1))
       ds_name = ds->ds[i].name;
 
-    /* Copy the identifier to `key' and escape it. */
-    status = gr_format_name(key, sizeof(key), vl, ds_name, prefix, postfix,
-                            escape_char, flags);
-    if (status != 0) {
-      ERROR("format_graphite: error with gr_format_name");
-      sfree(rates);
-      return status;
+    uint64_t ds_key = 0;
+    if (identity != NULL)
+      ds_key = name_cache_key(cache_key, ds_name);
+
+    if ((identity == NULL) ||
+        (name_cache_get(gr_name_cache, identity, ds_key, key, sizeof(key)) !=
+         0)) {
+      /* Copy the identifier to `key' and escape it. */
+      status = gr_format_name(key, sizeof(key), vl, ds_name, prefix, postfix,
+                              escape_char, flags);
+      if (status != 0) {
+        ERROR("format_graphite: error with gr_format_name");
+        sfree(rates);
+        return status;
+      }
+
+      escape_graphite_string(key, escape_char);
+      if (identity != NULL)
+        name_cache_set(gr_name_cache, identity, ds_key, key);
     }
 
-    escape_graphite_string(key, escape_char);
     /* Convert the values to an ASCII representation and put that into
      * `values'. */
     status = gr_format_values(values, sizeof(values), i, ds, vl, rates);
@@ -152,6 +152,20 @@ DEF_TEST(metric_name) {
                                      cases[i].prefix, cases[i].suffix, '@',
                                      cases[i].flags));
     EXPECT_EQ_STR(want, got);
+
+    /* With an identity, the name is cached. Cases which only differ in their
+     * options must not get each other's names. */
+    value_list_identity_t identity;
+    CHECK_ZERO(FORMAT_VL(identity.name, sizeof(identity.name), &vl));
+    identity.hash = identifier_hash(identity.name);
+    vl.identity = &identity;
+    vl.identity_owner = &vl;
+    for (int j = 0; j < 2; j++) {
+      EXPECT_EQ_INT(0, format_graphite(got, sizeof(got), &ds_single, &vl,
+                                       cases[i].prefix, cases[i].suffix, '@',
+                                       cases[i].flags));
+      EXPECT_EQ_STR(want, got);
+    }
   }
 
   return 0;
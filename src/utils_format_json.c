@@ -32,6 +32,13 @@
 #include "plugin.h"
 #include "utils_cache.h"
 
+#include <limits.h>
+#include <stdarg.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #if HAVE_LIBYAJL
 #include <yajl/yajl_common.h>
 #include <yajl/yajl_gen.h>
@@ -43,79 +50,228 @@
 #endif
 #endif
 
-static int json_escape_string(char *buffer, size_t buffer_size, /* {{{ */
-                              const char *string) {
-  size_t dst_pos;
+/* A byte has to be escaped if it is a quote, a backslash or a control
+ * character. Control characters are replaced by a question mark. Where char
+ * is signed, this includes all bytes >= 0x80. */
+#define JSON_NEEDS_ESCAPE(c) (((c) == '"') || ((c) == '\\') || ((c) <= 0x001F))
 
-  if ((buffer == NULL) || (string == NULL))
-    return -EINVAL;
+static int json_buffer_reserve(json_buffer_t *b, size_t len) /* {{{ */
+{
+  /* Room for the terminating null byte is always kept. */
+  if (b->fill + len < b->size)
+    return 0;
 
-  if (buffer_size < 3)
+  if (b->fixed)
     return -ENOMEM;
 
-  dst_pos = 0;
+  size_t size = (b->size > 0) ? b->size : 1024;
+  while (size <= b->fill + len)
+    size *= 2;
 
-#define BUFFER_ADD(c)                                                          \
-  do {                                                                         \
-    if (dst_pos >= (buffer_size - 1)) {                                        \
-      buffer[buffer_size - 1] = 0;                                             \
-      return -ENOMEM;                                                          \
-    }                                                                          \
-    buffer[dst_pos] = (c);                                                     \
-    dst_pos++;                                                                 \
-  } while (0)
+  char *tmp = realloc(b->data, size);
+  if (tmp == NULL)
+    return -ENOMEM;
+  b->data = tmp;
+  b->size = size;
+  return 0;
+} /* }}} int json_buffer_reserve */
 
-  /* Escape special characters */
-  BUFFER_ADD('"');
-  for (size_t src_pos = 0; string[src_pos] != 0; src_pos++) {
-    if ((string[src_pos] == '"') || (string[src_pos] == '\\')) {
-      BUFFER_ADD('\\');
-      BUFFER_ADD(string[src_pos]);
-    } else if (string[src_pos] <= 0x001F)
-      BUFFER_ADD('?');
-    else
-      BUFFER_ADD(string[src_pos]);
-  } /* for */
-  BUFFER_ADD('"');
-  buffer[dst_pos] = 0;
+static int json_buffer_add(json_buffer_t *b, /* {{{ */
+                           const char *data, size_t len) {
+  if (json_buffer_reserve(b, len) != 0)
+    return -ENOMEM;
 
-#undef BUFFER_ADD
+  memcpy(b->data + b->fill, data, len);
+  b->fill += len;
+  b->data[b->fill] = 0;
+  return 0;
+} /* }}} int json_buffer_add */
+
+#define json_buffer_add_literal(b, str) json_buffer_add(b, str, sizeof(str) - 1)
+
+/* Same as printf("%" PRIu64), but much cheaper. */
+static int json_buffer_add_uint(json_buffer_t *b, uint64_t value) /* {{{ */
+{
+  char tmp[24];
+  size_t pos = sizeof(tmp);
+
+  do {
+    tmp[--pos] = (char)('0' + (value % 10));
+    value /= 10;
+  } while (value > 0);
+
+  return json_buffer_add(b, tmp + pos, sizeof(tmp) - pos);
+} /* }}} int json_buffer_add_uint */
 
+static int json_buffer_add_int(json_buffer_t *b, int64_t value) /* {{{ */
+{
+  if (value >= 0)
+    return json_buffer_add_uint(b, (uint64_t)value);
+
+  if (json_buffer_add_literal(b, "-") != 0)
+    return -ENOMEM;
+  /* Negate in unsigned arithmetic, which also works for INT64_MIN. */
+  return json_buffer_add_uint(b, -(uint64_t)value);
+} /* }}} int json_buffer_add_int */
+
+/* Same as printf("%.3f", CDTIME_T_TO_DOUBLE(t)), but much cheaper. The
+ * conversion to double is exact up to the rounding of `t' to 53 significant
+ * bits, which is done the same way. The milliseconds are rounded half to
+ * even, like printf does for exactly representable values. */
+static int json_buffer_add_time(json_buffer_t *b, cdtime_t t) /* {{{ */
+{
+  uint64_t u = (uint64_t)(double)t;
+  uint64_t seconds = u >> 30;
+  uint64_t frac = (u & 0x3fffffff) * 1000;
+  uint64_t ms = frac >> 30;
+  uint64_t rem = frac & 0x3fffffff;
+
+  if ((rem > 0x20000000) || ((rem == 0x20000000) && ((ms & 1) != 0)))
+    ms++;
+  if (ms == 1000) {
+    seconds++;
+    ms = 0;
+  }
+
+  char tmp[4] = {'.', (char)('0' + ms / 100), (char)('0' + (ms / 10) % 10),
+                 (char)('0' + ms % 10)};
+  if (json_buffer_add_uint(b, seconds) != 0)
+    return -ENOMEM;
+  return json_buffer_add(b, tmp, sizeof(tmp));
+} /* }}} int json_buffer_add_time */
+
+/* Appends `"str"' without escaping. */
+static int json_buffer_add_quoted(json_buffer_t *b, const char *str) /* {{{ */
+{
+  size_t len = strlen(str);
+
+  if (json_buffer_reserve(b, len + 2) != 0)
+    return -ENOMEM;
+  b->data[b->fill++] = '"';
+  memcpy(b->data + b->fill, str, len);
+  b->fill += len;
+  b->data[b->fill++] = '"';
+  b->data[b->fill] = 0;
   return 0;
-} /* }}} int json_escape_string */
+} /* }}} int json_buffer_add_quoted */
+
+__attribute__((format(printf, 2, 3))) static int
+json_buffer_printf(json_buffer_t *b, const char *format, ...) /* {{{ */
+{
+  while (42) {
+    size_t avail = (b->size > b->fill) ? (b->size - b->fill) : 0;
+    va_list ap;
 
-static int values_to_json(char *buffer, size_t buffer_size, /* {{{ */
+    va_start(ap, format);
+    int status = vsnprintf((avail > 0) ? b->data + b->fill : NULL, avail,
+                           format, ap);
+    va_end(ap);
+
+    if (status < 1)
+      return -1;
+    if ((size_t)status < avail) {
+      b->fill += (size_t)status;
+      return 0;
+    }
+
+    /* Don't leave a truncated string behind. */
+    if (avail > 0)
+      b->data[b->fill] = 0;
+    if (json_buffer_reserve(b, (size_t)status) != 0)
+      return -ENOMEM;
+  }
+} /* }}} int json_buffer_printf */
+
+/* Returns the position of the first byte in [pos, len) which has to be
+ * escaped, or len. */
+static size_t json_escape_scan(const char *str, size_t pos, /* {{{ */
+                               size_t len) {
+#if defined(__SSE2__) && defined(__GNUC__) && (CHAR_MIN < 0)
+  /* The signed comparison with 0x20 catches both the control characters and
+   * the bytes with the high bit set, just like JSON_NEEDS_ESCAPE. */
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  const __m128i space = _mm_set1_epi8(0x20);
+
+  for (; pos + 16 <= len; pos += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(str + pos));
+    __m128i m = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)),
+        _mm_cmplt_epi8(v, space));
+    int mask = _mm_movemask_epi8(m);
+    if (mask != 0)
+      return pos + (size_t)__builtin_ctz((unsigned int)mask);
+  }
+#endif
+
+  for (; pos < len; pos++)
+    if (JSON_NEEDS_ESCAPE(str[pos]))
+      break;
+  return pos;
+} /* }}} size_t json_escape_scan */
+
+/* Appends `string' as a quoted JSON string. If `escape' is false, the caller
+ * has made sure that `string' doesn't need escaping. */
+static int json_buffer_add_string(json_buffer_t *b, /* {{{ */
+                                  const char *string, _Bool escape) {
+  size_t len = strlen(string);
+
+  /* Reserve the room needed without any escaping up front. */
+  if (json_buffer_reserve(b, len + 2) != 0)
+    return -ENOMEM;
+  b->data[b->fill++] = '"';
+
+  size_t pos = 0;
+  while (pos < len) {
+    size_t end = escape ? json_escape_scan(string, pos, len) : len;
+
+    memcpy(b->data + b->fill, string + pos, end - pos);
+    b->fill += end - pos;
+    if (end >= len)
+      break;
+
+    char c = string[end];
+    if ((c == '"') || (c == '\\')) {
+      /* one more byte than reserved */
+      if (json_buffer_reserve(b, (len - end) + 2) != 0)
+        return -ENOMEM;
+      b->data[b->fill++] = '\\';
+      b->data[b->fill++] = c;
+    } else
+      b->data[b->fill++] = '?';
+    pos = end + 1;
+  }
+
+  b->data[b->fill++] = '"';
+  b->data[b->fill] = 0;
+  return 0;
+} /* }}} int json_buffer_add_string */
+
+static int values_to_json(json_buffer_t *b, /* {{{ */
                           const data_set_t *ds, const value_list_t *vl,
                           int store_rates) {
-  size_t offset = 0;
   gauge_t *rates = NULL;
 
-  memset(buffer, 0, buffer_size);
-
-#define BUFFER_ADD(...)                                                        \
+#define BUFFER_ADD_CALL(cmd)                                                   \
   do {                                                                         \
-    int status;                                                                \
-    status = snprintf(buffer + offset, buffer_size - offset, __VA_ARGS__);     \
-    if (status < 1) {                                                          \
-      sfree(rates);                                                            \
-      return -1;                                                               \
-    } else if (((size_t)status) >= (buffer_size - offset)) {                   \
+    int status = (cmd);                                                        \
+    if (status != 0) {                                                         \
       sfree(rates);                                                            \
-      return -ENOMEM;                                                          \
-    } else                                                                     \
-      offset += ((size_t)status);                                              \
+      return status;                                                           \
+    }                                                                          \
   } while (0)
+#define BUFFER_ADD(...) BUFFER_ADD_CALL(json_buffer_printf(b, __VA_ARGS__))
 
-  BUFFER_ADD("[");
+  BUFFER_ADD_CALL(json_buffer_add_literal(b, "["));
   for (size_t i = 0; i < ds->ds_num; i++) {
     if (i > 0)
-      BUFFER_ADD(",");
+      BUFFER_ADD_CALL(json_buffer_add_literal(b, ","));
 
     if (ds->ds[i].type == DS_TYPE_GAUGE) {
       if (isfinite(vl->values[i].gauge))
         BUFFER_ADD(JSON_GAUGE_FORMAT, vl->values[i].gauge);
       else
-        BUFFER_ADD("null");
+        BUFFER_ADD_CALL(json_buffer_add_literal(b, "null"));
     } else if (store_rates) {
       if (rates == NULL)
         rates = uc_get_rate(ds, vl);
@@ -128,177 +284,133 @@ static int values_to_json(char *buffer, size_t buffer_size, /* {{{ */
       if (isfinite(rates[i]))
         BUFFER_ADD(JSON_GAUGE_FORMAT, rates[i]);
       else
-        BUFFER_ADD("null");
+        BUFFER_ADD_CALL(json_buffer_add_literal(b, "null"));
     } else if (ds->ds[i].type == DS_TYPE_COUNTER)
-      BUFFER_ADD("%" PRIu64, (uint64_t)vl->values[i].counter);
+      BUFFER_ADD_CALL(
+          json_buffer_add_uint(b, (uint64_t)vl->values[i].counter));
     else if (ds->ds[i].type == DS_TYPE_DERIVE)
-      BUFFER_ADD("%" PRIi64, vl->values[i].derive);
+      BUFFER_ADD_CALL(json_buffer_add_int(b, vl->values[i].derive));
     else if (ds->ds[i].type == DS_TYPE_ABSOLUTE)
-      BUFFER_ADD("%" PRIu64, vl->values[i].absolute);
+      BUFFER_ADD_CALL(json_buffer_add_uint(b, vl->values[i].absolute));
     else {
       ERROR("format_json: Unknown data source type: %i", ds->ds[i].type);
       sfree(rates);
       return -1;
     }
   } /* for ds->ds_num */
-  BUFFER_ADD("]");
+  BUFFER_ADD_CALL(json_buffer_add_literal(b, "]"));
 
 #undef BUFFER_ADD
+#undef BUFFER_ADD_CALL
 
-  DEBUG("format_json: values_to_json: buffer = %s;", buffer);
   sfree(rates);
   return 0;
 } /* }}} int values_to_json */
 
-static int dstypes_to_json(char *buffer, size_t buffer_size, /* {{{ */
-                           const data_set_t *ds) {
-  size_t offset = 0;
-
-  memset(buffer, 0, buffer_size);
-
-#define BUFFER_ADD(...)                                                        \
-  do {                                                                         \
-    int status;                                                                \
-    status = snprintf(buffer + offset, buffer_size - offset, __VA_ARGS__);     \
-    if (status < 1)                                                            \
-      return -1;                                                               \
-    else if (((size_t)status) >= (buffer_size - offset))                       \
-      return -ENOMEM;                                                          \
-    else                                                                       \
-      offset += ((size_t)status);                                              \
-  } while (0)
+static int dstypes_to_json(json_buffer_t *b, const data_set_t *ds) /* {{{ */
+{
+  int status = json_buffer_add_literal(b, "[");
 
-  BUFFER_ADD("[");
-  for (size_t i = 0; i < ds->ds_num; i++) {
+  for (size_t i = 0; (i < ds->ds_num) && (status == 0); i++) {
     if (i > 0)
-      BUFFER_ADD(",");
-
-    BUFFER_ADD("\"%s\"", DS_TYPE_TO_STRING(ds->ds[i].type));
-  } /* for ds->ds_num */
-  BUFFER_ADD("]");
-
-#undef BUFFER_ADD
-
-  DEBUG("format_json: dstypes_to_json: buffer = %s;", buffer);
+      status = json_buffer_add_literal(b, ",");
+    if (status == 0)
+      status = json_buffer_add_quoted(b, DS_TYPE_TO_STRING(ds->ds[i].type));
+  }
 
-  return 0;
+  if (status == 0)
+    status = json_buffer_add_literal(b, "]");
+  return status;
 } /* }}} int dstypes_to_json */
 
-static int dsnames_to_json(char *buffer, size_t buffer_size, /* {{{ */
-                           const data_set_t *ds) {
-  size_t offset = 0;
-
-  memset(buffer, 0, buffer_size);
-
-#define BUFFER_ADD(...)                                                        \
-  do {                                                                         \
-    int status;                                                                \
-    status = snprintf(buffer + offset, buffer_size - offset, __VA_ARGS__);     \
-    if (status < 1)                                                            \
-      return -1;                                                               \
-    else if (((size_t)status) >= (buffer_size - offset))                       \
-      return -ENOMEM;                                                          \
-    else                                                                       \
-      offset += ((size_t)status);                                              \
-  } while (0)
+static int dsnames_to_json(json_buffer_t *b, const data_set_t *ds) /* {{{ */
+{
+  int status = json_buffer_add_literal(b, "[");
 
-  BUFFER_ADD("[");
-  for (size_t i = 0; i < ds->ds_num; i++) {
+  for (size_t i = 0; (i < ds->ds_num) && (status == 0); i++) {
     if (i > 0)
-      BUFFER_ADD(",");
-
-    BUFFER_ADD("\"%s\"", ds->ds[i].name);
-  } /* for ds->ds_num */
-  BUFFER_ADD("]");
-
-#undef BUFFER_ADD
-
-  DEBUG("format_json: dsnames_to_json: buffer = %s;", buffer);
+      status = json_buffer_add_literal(b, ",");
+    if (status == 0)
+      status = json_buffer_add_quoted(b, ds->ds[i].name);
+  }
 
-  return 0;
+  if (status == 0)
+    status = json_buffer_add_literal(b, "]");
+  return status;
 } /* }}} int dsnames_to_json */
 
-static int meta_data_keys_to_json(char *buffer, size_t buffer_size, /* {{{ */
+/* Appends `,"meta":{...}'. Nothing is appended if none of the keys has a
+ * type which can be represented. */
+static int meta_data_keys_to_json(json_buffer_t *b, /* {{{ */
                                   meta_data_t *meta, char **keys,
                                   size_t keys_num) {
-  size_t offset = 0;
-  int status;
+  size_t start = b->fill;
+  _Bool empty = 1;
+  int status = 0;
 
-  buffer[0] = 0;
-
-#define BUFFER_ADD(...)                                                        \
-  do {                                                                         \
-    status = snprintf(buffer + offset, buffer_size - offset, __VA_ARGS__);     \
-    if (status < 1)                                                            \
-      return -1;                                                               \
-    else if (((size_t)status) >= (buffer_size - offset))                       \
-      return -ENOMEM;                                                          \
-    else                                                                       \
-      offset += ((size_t)status);                                              \
-  } while (0)
-
-  for (size_t i = 0; i < keys_num; ++i) {
+  for (size_t i = 0; (i < keys_num) && (status == 0); ++i) {
     int type;
     char *key = keys[i];
+    const char *prefix = empty ? ",\"meta\":{" : ",";
 
     type = meta_data_type(meta, key);
     if (type == MD_TYPE_STRING) {
       char *value = NULL;
-      if (meta_data_get_string(meta, key, &value) == 0) {
-        char temp[512] = "";
-
-        status = json_escape_string(temp, sizeof(temp), value);
-        sfree(value);
-        if (status != 0)
-          return status;
-
-        BUFFER_ADD(",\"%s\":%s", key, temp);
-      }
+      if (meta_data_get_string(meta, key, &value) != 0)
+        continue;
+      status = json_buffer_printf(b, "%s\"%s\":", prefix, key);
+      if (status == 0)
+        status = json_buffer_add_string(b, value, /* escape = */ 1);
+      sfree(value);
     } else if (type == MD_TYPE_SIGNED_INT) {
       int64_t value = 0;
-      if (meta_data_get_signed_int(meta, key, &value) == 0)
-        BUFFER_ADD(",\"%s\":%" PRIi64, key, value);
+      if (meta_data_get_signed_int(meta, key, &value) != 0)
+        continue;
+      status = json_buffer_printf(b, "%s\"%s\":%" PRIi64, prefix, key, value);
     } else if (type == MD_TYPE_UNSIGNED_INT) {
       uint64_t value = 0;
-      if (meta_data_get_unsigned_int(meta, key, &value) == 0)
-        BUFFER_ADD(",\"%s\":%" PRIu64, key, value);
+      if (meta_data_get_unsigned_int(meta, key, &value) != 0)
+        continue;
+      status = json_buffer_printf(b, "%s\"%s\":%" PRIu64, prefix, key, value);
     } else if (type == MD_TYPE_DOUBLE) {
       double value = 0.0;
-      if (meta_data_get_double(meta, key, &value) == 0)
-        BUFFER_ADD(",\"%s\":%f", key, value);
+      if (meta_data_get_double(meta, key, &value) != 0)
+        continue;
+      status = json_buffer_printf(b, "%s\"%s\":%f", prefix, key, value);
     } else if (type == MD_TYPE_BOOLEAN) {
       _Bool value = 0;
-      if (meta_data_get_boolean(meta, key, &value) == 0)
-        BUFFER_ADD(",\"%s\":%s", key, value ? "true" : "false");
-    }
+      if (meta_data_get_boolean(meta, key, &value) != 0)
+        continue;
+      status = json_buffer_printf(b, "%s\"%s\":%s", prefix, key,
+                                  value ? "true" : "false");
+    } else
+      continue;
+
+    empty = 0;
   } /* for (keys) */
 
-  if (offset == 0)
-    return ENOENT;
-
-  buffer[0] = '{'; /* replace leading ',' */
-  BUFFER_ADD("}");
+  if ((status == 0) && !empty)
+    status = json_buffer_add_literal(b, "}");
 
-#undef BUFFER_ADD
-
-  return 0;
+  if (status != 0) {
+    b->fill = start;
+    b->data[b->fill] = 0;
+  }
+  return status;
 } /* }}} int meta_data_keys_to_json */
 
-static int meta_data_to_json(char *buffer, size_t buffer_size, /* {{{ */
-                             meta_data_t *meta) {
+static int meta_data_to_json(json_buffer_t *b, meta_data_t *meta) /* {{{ */
+{
   char **keys = NULL;
   size_t keys_num;
   int status;
 
-  if ((buffer == NULL) || (buffer_size == 0) || (meta == NULL))
-    return EINVAL;
-
   status = meta_data_toc(meta, &keys);
   if (status <= 0)
     return status;
   keys_num = (size_t)status;
 
-  status = meta_data_keys_to_json(buffer, buffer_size, meta, keys, keys_num);
+  status = meta_data_keys_to_json(b, meta, keys, keys_num);
 
   for (size_t i = 0; i < keys_num; ++i)
     sfree(keys[i]);
@@ -307,54 +419,52 @@ static int meta_data_to_json(char *buffer, size_t buffer_size, /* {{{ */
   return status;
 } /* }}} int meta_data_to_json */
 
-static int value_list_to_json(char *buffer, size_t buffer_size, /* {{{ */
+static int value_list_to_json(json_buffer_t *b, /* {{{ */
                               const data_set_t *ds, const value_list_t *vl,
                               int store_rates) {
-  char temp[512];
-  size_t offset = 0;
   int status;
 
-  memset(buffer, 0, buffer_size);
-
 #define BUFFER_ADD(...)                                                        \
   do {                                                                         \
-    status = snprintf(buffer + offset, buffer_size - offset, __VA_ARGS__);     \
-    if (status < 1)                                                            \
-      return -1;                                                               \
-    else if (((size_t)status) >= (buffer_size - offset))                       \
-      return -ENOMEM;                                                          \
-    else                                                                       \
-      offset += ((size_t)status);                                              \
+    status = json_buffer_printf(b, __VA_ARGS__);                               \
+    if (status != 0)                                                           \
+      return status;                                                           \
+  } while (0)
+
+#define BUFFER_ADD_CALL(cmd)                                                   \
+  do {                                                                         \
+    status = (cmd);                                                            \
+    if (status != 0)                                                           \
+      return status;                                                           \
   } while (0)
 
   /* All value lists have a leading comma. The first one will be replaced with
    * a square bracket in `format_json_finalize'. */
-  BUFFER_ADD(",{");
-
-  status = values_to_json(temp, sizeof(temp), ds, vl, store_rates);
-  if (status != 0)
-    return status;
-  BUFFER_ADD("\"values\":%s", temp);
-
-  status = dstypes_to_json(temp, sizeof(temp), ds);
-  if (status != 0)
-    return status;
-  BUFFER_ADD(",\"dstypes\":%s", temp);
-
-  status = dsnames_to_json(temp, sizeof(temp), ds);
-  if (status != 0)
-    return status;
-  BUFFER_ADD(",\"dsnames\":%s", temp);
-
-  BUFFER_ADD(",\"time\":%.3f", CDTIME_T_TO_DOUBLE(vl->time));
-  BUFFER_ADD(",\"interval\":%.3f", CDTIME_T_TO_DOUBLE(vl->interval));
+  BUFFER_ADD_CALL(json_buffer_add_literal(b, ",{\"values\":"));
+  BUFFER_ADD_CALL(values_to_json(b, ds, vl, store_rates));
+  BUFFER_ADD_CALL(json_buffer_add_literal(b, ",\"dstypes\":"));
+  BUFFER_ADD_CALL(dstypes_to_json(b, ds));
+  BUFFER_ADD_CALL(json_buffer_add_literal(b, ",\"dsnames\":"));
+  BUFFER_ADD_CALL(dsnames_to_json(b, ds));
+
+  BUFFER_ADD_CALL(json_buffer_add_literal(b, ",\"time\":"));
+  BUFFER_ADD_CALL(json_buffer_add_time(b, vl->time));
+  BUFFER_ADD_CALL(json_buffer_add_literal(b, ",\"interval\":"));
+  BUFFER_ADD_CALL(json_buffer_add_time(b, vl->interval));
+
+  /* The cached identity holds all five fields, so a single scan tells
+   * whether any of them needs escaping. */
+  _Bool escape = 1;
+  value_list_identity_t const *identity = VALUE_LIST_IDENTITY(vl);
+  if (identity != NULL) {
+    size_t len = strlen(identity->name);
+    escape = (json_escape_scan(identity->name, 0, len) < len);
+  }
 
 #define BUFFER_ADD_KEYVAL(key, value)                                          \
   do {                                                                         \
-    status = json_escape_string(temp, sizeof(temp), (value));                  \
-    if (status != 0)                                                           \
-      return status;                                                           \
-    BUFFER_ADD(",\"%s\":%s", (key), temp);                                     \
+    BUFFER_ADD_CALL(json_buffer_add_literal(b, ",\"" key "\":"));              \
+    BUFFER_ADD_CALL(json_buffer_add_string(b, (value), escape));               \
   } while (0)
 
   BUFFER_ADD_KEYVAL("host", vl->host);
@@ -363,46 +473,73 @@ static int value_list_to_json(char *buffer, size_t buffer_size, /* {{{ */
   BUFFER_ADD_KEYVAL("type", vl->type);
   BUFFER_ADD_KEYVAL("type_instance", vl->type_instance);
 
-  if (vl->meta != NULL) {
-    char meta_buffer[buffer_size];
-    memset(meta_buffer, 0, sizeof(meta_buffer));
-    status = meta_data_to_json(meta_buffer, sizeof(meta_buffer), vl->meta);
-    if (status != 0)
-      return status;
+  if (vl->meta != NULL)
+    BUFFER_ADD_CALL(meta_data_to_json(b, vl->meta));
 
-    BUFFER_ADD(",\"meta\":%s", meta_buffer);
-  } /* if (vl->meta != NULL) */
-
-  BUFFER_ADD("}");
+  BUFFER_ADD_CALL(json_buffer_add_literal(b, "}"));
 
 #undef BUFFER_ADD_KEYVAL
+#undef BUFFER_ADD_CALL
 #undef BUFFER_ADD
 
-  DEBUG("format_json: value_list_to_json: buffer = %s;", buffer);
-
   return 0;
 } /* }}} int value_list_to_json */
 
-static int format_json_value_list_nocheck(char *buffer, /* {{{ */
-                                          size_t *ret_buffer_fill,
-                                          size_t *ret_buffer_free,
-                                          const data_set_t *ds,
-                                          const value_list_t *vl,
-                                          int store_rates, size_t temp_size) {
-  char temp[temp_size];
-  int status;
+int format_json_value_list_append(json_buffer_t *b, /* {{{ */
+                                  const data_set_t *ds, const value_list_t *vl,
+                                  int store_rates) {
+  if ((b == NULL) || (ds == NULL) || (vl == NULL))
+    return -EINVAL;
 
-  status = value_list_to_json(temp, sizeof(temp), ds, vl, store_rates);
-  if (status != 0)
+  size_t start = b->fill;
+  int status = value_list_to_json(b, ds, vl, store_rates);
+  if (status != 0) {
+    /* Remove the partial value list. */
+    b->fill = start;
+    if (b->size > start)
+      b->data[start] = 0;
     return status;
-  temp_size = strlen(temp);
+  }
 
-  memcpy(buffer + (*ret_buffer_fill), temp, temp_size + 1);
-  (*ret_buffer_fill) += temp_size;
-  (*ret_buffer_free) -= temp_size;
+  DEBUG("format_json: value_list_to_json: buffer = %s;", b->data + start);
+  return 0;
+} /* }}} int format_json_value_list_append */
+
+int format_json_buffer_finalize(json_buffer_t *b) /* {{{ */
+{
+  if ((b == NULL) || (b->fill == 0) || (b->data[0] != ','))
+    return -EINVAL;
+
+  if (json_buffer_reserve(b, 1) != 0)
+    return -ENOMEM;
 
+  /* Replace the leading comma added in `value_list_to_json' with a square
+   * bracket. */
+  b->data[0] = '[';
+  b->data[b->fill++] = ']';
+  b->data[b->fill] = 0;
   return 0;
-} /* }}} int format_json_value_list_nocheck */
+} /* }}} int format_json_buffer_finalize */
+
+void format_json_buffer_reset(json_buffer_t *b) /* {{{ */
+{
+  if (b == NULL)
+    return;
+
+  b->fill = 0;
+  if (b->size > 0)
+    b->data[0] = 0;
+} /* }}} void format_json_buffer_reset */
+
+void format_json_buffer_free(json_buffer_t *b) /* {{{ */
+{
+  if ((b == NULL) || b->fixed)
+    return;
+
+  sfree(b->data);
+  b->size = 0;
+  b->fill = 0;
+} /* }}} void format_json_buffer_free */
 
 int format_json_initialize(char *buffer, /* {{{ */
                            size_t *ret_buffer_fill, size_t *ret_buffer_free) {
@@ -467,9 +604,22 @@ int format_json_value_list(char *buffer, /* {{{ */
   if (*ret_buffer_free < 3)
     return -ENOMEM;
 
-  return format_json_value_list_nocheck(buffer, ret_buffer_fill,
-                                        ret_buffer_free, ds, vl, store_rates,
-                                        (*ret_buffer_free) - 2);
+  /* Format right into the caller's buffer, keeping two bytes for
+   * `format_json_finalize'. */
+  json_buffer_t b = {
+      .data = buffer,
+      .size = (*ret_buffer_fill) + (*ret_buffer_free) - 2,
+      .fill = *ret_buffer_fill,
+      .fixed = 1,
+  };
+
+  int status = format_json_value_list_append(&b, ds, vl, store_rates);
+  if (status != 0)
+    return status;
+
+  (*ret_buffer_free) -= b.fill - (*ret_buffer_fill);
+  (*ret_buffer_fill) = b.fill;
+  return 0;
 } /* }}} int format_json_value_list */
 
 #if HAVE_LIBYAJL
@@ -35,6 +35,27 @@
 #define JSON_GAUGE_FORMAT GAUGE_FORMAT
 #endif
 
+/* Output buffer of format_json_value_list_append(). Zero-initialize it to
+ * start with an empty buffer which grows as needed. If "fixed" is set, "data"
+ * is provided by the caller and has room for "size" bytes. */
+struct json_buffer_s {
+  char *data;
+  size_t size;
+  size_t fill;
+  _Bool fixed;
+};
+typedef struct json_buffer_s json_buffer_t;
+
+/* Appends the JSON object of a value list to "b", preceded by a comma. The
+ * buffer is always null-terminated. Upon failure, nothing is appended.
+ * format_json_buffer_finalize() turns the objects into an array. */
+int format_json_value_list_append(json_buffer_t *b, const data_set_t *ds,
+                                  const value_list_t *vl, int store_rates);
+int format_json_buffer_finalize(json_buffer_t *b);
+void format_json_buffer_reset(json_buffer_t *b);
+void format_json_buffer_free(json_buffer_t *b);
+
+/* Formats into a caller-provided buffer of fixed size. */
 int format_json_initialize(char *buffer, size_t *ret_buffer_fill,
                            size_t *ret_buffer_free);
 int format_json_value_list(char *buffer, size_t *ret_buffer_fill,
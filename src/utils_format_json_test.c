@@ -176,8 +176,71 @@ DEF_TEST(notification) {
   return expect_json_labels(got, labels, STATIC_ARRAY_SIZE(labels));
 }
 
+DEF_TEST(value_list) {
+  data_source_t dsrc[] = {
+      {"rx", DS_TYPE_DERIVE, 0, NAN},
+      {"tx", DS_TYPE_GAUGE, 0, NAN},
+  };
+  data_set_t ds = {"if_octets", STATIC_ARRAY_SIZE(dsrc), dsrc};
+  value_t values[] = {{.derive = -42}, {.gauge = 0.5}};
+  value_list_t vl = {
+      .values = values,
+      .values_len = STATIC_ARRAY_SIZE(values),
+      .time = 1555083754651779072ULL,
+      .interval = TIME_T_TO_CDTIME_T(10),
+      .host = "example.com",
+      .plugin = "unit",
+      .type = "if_octets",
+      .type_instance = "a\"b\\c\td",
+  };
+  char const *obj =
+      "{\"values\":[-42,0.5],\"dstypes\":[\"derive\",\"gauge\"],"
+      "\"dsnames\":[\"rx\",\"tx\"],\"time\":1448284606.125,"
+      "\"interval\":10.000,\"host\":\"example.com\",\"plugin\":\"unit\","
+      "\"plugin_instance\":\"\",\"type\":\"if_octets\","
+      "\"type_instance\":\"a\\\"b\\\\c?d\"}";
+  char want[1024];
+  snprintf(want, sizeof(want), "[%s,%s]", obj, obj);
+
+  char got[1024];
+  size_t fill = 0;
+  size_t free = sizeof(got);
+  CHECK_ZERO(format_json_initialize(got, &fill, &free));
+  CHECK_ZERO(format_json_value_list(got, &fill, &free, &ds, &vl, 0));
+  CHECK_ZERO(format_json_value_list(got, &fill, &free, &ds, &vl, 0));
+  CHECK_ZERO(format_json_finalize(got, &fill, &free));
+  EXPECT_EQ_STR(want, got);
+
+  /* Too small for the second value list: the first one stays intact. */
+  char small[320];
+  fill = 0;
+  free = sizeof(small);
+  CHECK_ZERO(format_json_initialize(small, &fill, &free));
+  CHECK_ZERO(format_json_value_list(small, &fill, &free, &ds, &vl, 0));
+  EXPECT_EQ_INT(-ENOMEM,
+                format_json_value_list(small, &fill, &free, &ds, &vl, 0));
+  EXPECT_EQ_INT((int)(strlen(obj) + 1), (int)fill);
+
+  /* The growable buffer produces the same output. */
+  json_buffer_t b = {0};
+  for (int i = 0; i < 2; i++)
+    CHECK_ZERO(format_json_value_list_append(&b, &ds, &vl, 0));
+  CHECK_ZERO(format_json_buffer_finalize(&b));
+  EXPECT_EQ_STR(want, b.data);
+
+  format_json_buffer_reset(&b);
+  CHECK_ZERO(format_json_value_list_append(&b, &ds, &vl, 0));
+  CHECK_ZERO(format_json_buffer_finalize(&b));
+  snprintf(want, sizeof(want), "[%s]", obj);
+  EXPECT_EQ_STR(want, b.data);
+
+  format_json_buffer_free(&b);
+  return 0;
+}
+
 int main(void) {
   RUN_TEST(notification);
+  RUN_TEST(value_list);
 
   END_TEST;
 }
@@ -29,6 +29,7 @@
 #include "common.h"
 #include "plugin.h"
 
+#include "utils_avltree.h"
 #include "utils_cache.h"
 #include "utils_format_kairosdb.h"
 
@@ -40,7 +41,8 @@
  *     "name":"collectd.vmem"
  *     "datapoints":
  *       [
- *         [1453897164060, 97.000000]
+ *         [1453897164060, 97.000000],
+ *         [1453897174060, 98.000000]
  *       ],
  *      "tags":
  *        {
@@ -54,6 +56,47 @@
  * ]
  */
 
+/* Large enough for a timestamp and any value. */
+#define KAIROSDB_POINT_SIZE 64
+
+/* The metric object of one data source of a series. "head" and "tail" are
+ * the parts of the object before and after the datapoints. "points" holds
+ * the datapoints added since the batch was finalized the last time; the
+ * metric is part of the batch if it isn't empty. */
+typedef struct {
+  char *head;
+  size_t head_len;
+  char *tail;
+  size_t tail_len;
+  char *points;
+  size_t points_len;
+  size_t points_size;
+} kairosdb_metric_t;
+
+typedef struct {
+  char *key;
+  data_set_t const *ds;
+  kairosdb_metric_t *metrics; /* one per data source */
+  cdtime_t used;
+} kairosdb_series_t;
+
+struct format_kairosdb_s {
+  char **attrs;
+  size_t attrs_num;
+  int data_ttl;
+  char *metrics_prefix;
+
+  c_avl_tree_t *series;
+  cdtime_t expire;
+  cdtime_t next_expire;
+
+  /* The metrics in the batch, in the order they were added. */
+  kairosdb_metric_t **batch;
+  size_t batch_num;
+  size_t batch_size;
+  size_t size; /* length of the serialized batch */
+};
+
 static int kairosdb_escape_string(char *buffer, size_t buffer_size, /* {{{ */
                                   const char *string) {
   size_t dst_pos;
@@ -92,269 +135,455 @@ static int kairosdb_escape_string(char *buffer, size_t buffer_size, /* {{{ */
   return 0;
 } /* }}} int kairosdb_escape_string */
 
-static int values_to_kairosdb(char *buffer, size_t buffer_size, /* {{{ */
-                              const data_set_t *ds, const value_list_t *vl,
-                              int store_rates, size_t ds_idx) {
-  size_t offset = 0;
-  gauge_t *rates = NULL;
-
-  memset(buffer, 0, buffer_size);
-
-#define BUFFER_ADD(...)                                                        \
-  do {                                                                         \
-    int status;                                                                \
-    status = snprintf(buffer + offset, buffer_size - offset, __VA_ARGS__);     \
-    if (status < 1) {                                                          \
-      sfree(rates);                                                            \
-      return -1;                                                               \
-    } else if (((size_t)status) >= (buffer_size - offset)) {                   \
-      sfree(rates);                                                            \
-      return -ENOMEM;                                                          \
-    } else                                                                     \
-      offset += ((size_t)status);                                              \
-  } while (0)
+/* Appends formatted output to the string "*str", which is reallocated as
+ * needed. */
+__attribute__((format(printf, 3, 4))) static int /* {{{ */
+kairosdb_append(char **str, size_t *len, char const *format, ...) {
+  va_list ap;
 
-  if (ds->ds[ds_idx].type == DS_TYPE_GAUGE) {
-    if (isfinite(vl->values[ds_idx].gauge)) {
-      BUFFER_ADD("[[");
-      BUFFER_ADD("%" PRIu64, CDTIME_T_TO_MS(vl->time));
-      BUFFER_ADD(",");
-      BUFFER_ADD(JSON_GAUGE_FORMAT, vl->values[ds_idx].gauge);
-    } else {
-      DEBUG("utils_format_kairosdb: invalid vl->values[ds_idx].gauge for "
-            "%s|%s|%s|%s|%s",
-            vl->plugin, vl->plugin_instance, vl->type, vl->type_instance,
-            ds->ds[ds_idx].name);
-      return -1;
-    }
-  } else if (store_rates) {
-    if (rates == NULL)
-      rates = uc_get_rate(ds, vl);
-    if (rates == NULL) {
-      WARNING("utils_format_kairosdb: uc_get_rate failed for %s|%s|%s|%s|%s",
-              vl->plugin, vl->plugin_instance, vl->type, vl->type_instance,
-              ds->ds[ds_idx].name);
-
-      return -1;
-    }
+  va_start(ap, format);
+  int status = vsnprintf(NULL, 0, format, ap);
+  va_end(ap);
+  if (status < 0)
+    return EINVAL;
 
-    if (isfinite(rates[ds_idx])) {
-      BUFFER_ADD("[[");
-      BUFFER_ADD("%" PRIu64, CDTIME_T_TO_MS(vl->time));
-      BUFFER_ADD(",");
-      BUFFER_ADD(JSON_GAUGE_FORMAT, rates[ds_idx]);
-    } else {
-      WARNING("utils_format_kairosdb: invalid rates[ds_idx] for %s|%s|%s|%s|%s",
-              vl->plugin, vl->plugin_instance, vl->type, vl->type_instance,
-              ds->ds[ds_idx].name);
-      sfree(rates);
-      return -1;
-    }
-  } else if (ds->ds[ds_idx].type == DS_TYPE_COUNTER) {
-    BUFFER_ADD("[[");
-    BUFFER_ADD("%" PRIu64, CDTIME_T_TO_MS(vl->time));
-    BUFFER_ADD(",");
-    BUFFER_ADD("%" PRIu64, (uint64_t)vl->values[ds_idx].counter);
-  } else if (ds->ds[ds_idx].type == DS_TYPE_DERIVE) {
-    BUFFER_ADD("[[");
-    BUFFER_ADD("%" PRIu64, CDTIME_T_TO_MS(vl->time));
-    BUFFER_ADD(",");
-    BUFFER_ADD("%" PRIi64, vl->values[ds_idx].derive);
-  } else if (ds->ds[ds_idx].type == DS_TYPE_ABSOLUTE) {
-    BUFFER_ADD("[[");
-    BUFFER_ADD("%" PRIu64, CDTIME_T_TO_MS(vl->time));
-    BUFFER_ADD(",");
-    BUFFER_ADD("%" PRIu64, vl->values[ds_idx].absolute);
-  } else {
-    ERROR("format_kairosdb: Unknown data source type: %i", ds->ds[ds_idx].type);
-    sfree(rates);
-    return -1;
-  }
-  BUFFER_ADD("]]");
+  char *tmp = realloc(*str, *len + (size_t)status + 1);
+  if (tmp == NULL)
+    return ENOMEM;
+  *str = tmp;
 
-#undef BUFFER_ADD
+  va_start(ap, format);
+  vsnprintf(*str + *len, (size_t)status + 1, format, ap);
+  va_end(ap);
+  *len += (size_t)status;
 
-  DEBUG("format_kairosdb: values_to_kairosdb: buffer = %s;", buffer);
-  sfree(rates);
   return 0;
-} /* }}} int values_to_kairosdb */
-
-static int value_list_to_kairosdb(char *buffer, size_t buffer_size, /* {{{ */
-                                  const data_set_t *ds, const value_list_t *vl,
-                                  int store_rates,
-                                  char const *const *http_attrs,
-                                  size_t http_attrs_num, int data_ttl,
-                                  char const *metrics_prefix) {
-  char temp[512];
-  size_t offset = 0;
-  int status;
-
-  memset(buffer, 0, buffer_size);
+} /* }}} int kairosdb_append */
 
-#define BUFFER_ADD(...)                                                        \
-  do {                                                                         \
-    status = snprintf(buffer + offset, buffer_size - offset, __VA_ARGS__);     \
-    if (status < 1)                                                            \
-      return -1;                                                               \
-    else if (((size_t)status) >= (buffer_size - offset))                       \
-      return -ENOMEM;                                                          \
-    else                                                                       \
-      offset += ((size_t)status);                                              \
-  } while (0)
+static int kairosdb_append_tag(char **str, size_t *len, /* {{{ */
+                               char const *key, char const *value) {
+  char temp[2 * DATA_MAX_NAME_LEN];
 
-#define BUFFER_ADD_KEYVAL(key, value)                                          \
-  do {                                                                         \
-    status = kairosdb_escape_string(temp, sizeof(temp), (value));              \
-    if (status != 0)                                                           \
-      return status;                                                           \
-    BUFFER_ADD(",\"%s\": %s", (key), temp);                                    \
-  } while (0)
+  int status = kairosdb_escape_string(temp, sizeof(temp), value);
+  if (status != 0)
+    return -status;
+  return kairosdb_append(str, len, ",\"%s\":%s", key, temp);
+} /* }}} int kairosdb_append_tag */
+
+static int kairosdb_metric_init(format_kairosdb_t *fk, /* {{{ */
+                                kairosdb_metric_t *m, data_set_t const *ds,
+                                value_list_t const *vl, size_t ds_index) {
+  int status = kairosdb_append(&m->head, &m->head_len, "{\"name\":\"%s%s%s\"",
+                               (fk->metrics_prefix != NULL)
+                                   ? fk->metrics_prefix
+                                   : "",
+                               (fk->metrics_prefix != NULL) ? "." : "",
+                               vl->plugin);
+  if (status == 0)
+    status = kairosdb_append(&m->head, &m->head_len, ",\"datapoints\":[");
+
+  if (status == 0)
+    status = kairosdb_append(&m->tail, &m->tail_len, "]");
+  if ((status == 0) && (fk->data_ttl != 0))
+    status = kairosdb_append(&m->tail, &m->tail_len, ",\"ttl\":%i",
+                             fk->data_ttl);
+
+  if (status == 0)
+    status = kairosdb_append(&m->tail, &m->tail_len,
+                             ",\"tags\":{\"host\":\"%s\"", vl->host);
+  for (size_t i = 0; (status == 0) && (i + 1 < fk->attrs_num); i += 2)
+    status = kairosdb_append(&m->tail, &m->tail_len, ",\"%s\":\"%s\"",
+                             fk->attrs[i], fk->attrs[i + 1]);
+
+  if ((status == 0) && (strlen(vl->plugin_instance) != 0))
+    status = kairosdb_append_tag(&m->tail, &m->tail_len, "plugin_instance",
+                                 vl->plugin_instance);
+  if (status == 0)
+    status = kairosdb_append_tag(&m->tail, &m->tail_len, "type", vl->type);
+  if ((status == 0) && (strlen(vl->type_instance) != 0))
+    status = kairosdb_append_tag(&m->tail, &m->tail_len, "type_instance",
+                                 vl->type_instance);
+  if ((status == 0) && (ds->ds_num != 1))
+    status = kairosdb_append_tag(&m->tail, &m->tail_len, "ds",
+                                 ds->ds[ds_index].name);
+  if (status == 0)
+    status = kairosdb_append(&m->tail, &m->tail_len, "}}");
+
+  return status;
+} /* }}} int kairosdb_metric_init */
+
+static void kairosdb_series_destroy(kairosdb_series_t *s) /* {{{ */
+{
+  if (s == NULL)
+    return;
+
+  if (s->metrics != NULL) {
+    for (size_t i = 0; i < s->ds->ds_num; i++) {
+      sfree(s->metrics[i].head);
+      sfree(s->metrics[i].tail);
+      sfree(s->metrics[i].points);
+    }
+    sfree(s->metrics);
+  }
+  sfree(s->key);
+  sfree(s);
+} /* }}} void kairosdb_series_destroy */
+
+static kairosdb_series_t * /* {{{ */
+kairosdb_series_create(format_kairosdb_t *fk, char const *key,
+                       data_set_t const *ds, value_list_t const *vl) {
+  kairosdb_series_t *s = calloc(1, sizeof(*s));
+  if (s == NULL)
+    return NULL;
+
+  s->ds = ds;
+  s->key = strdup(key);
+  s->metrics = calloc(ds->ds_num, sizeof(*s->metrics));
+  if ((s->key == NULL) || (s->metrics == NULL)) {
+    kairosdb_series_destroy(s);
+    return NULL;
+  }
 
   for (size_t i = 0; i < ds->ds_num; i++) {
-    /* All value lists have a leading comma. The first one will be replaced with
-     * a square bracket in `format_kairosdb_finalize'. */
-    BUFFER_ADD(",{\"name\":\"");
-
-    if (metrics_prefix != NULL) {
-      BUFFER_ADD("%s.", metrics_prefix);
+    if (kairosdb_metric_init(fk, s->metrics + i, ds, vl, i) != 0) {
+      kairosdb_series_destroy(s);
+      return NULL;
     }
+  }
 
-    BUFFER_ADD("%s", vl->plugin);
+  return s;
+} /* }}} kairosdb_series_t *kairosdb_series_create */
 
-    status = values_to_kairosdb(temp, sizeof(temp), ds, vl, store_rates, i);
-    if (status != 0)
-      return status;
+static _Bool kairosdb_series_pending(kairosdb_series_t const *s) /* {{{ */
+{
+  for (size_t i = 0; i < s->ds->ds_num; i++)
+    if (s->metrics[i].points_len != 0)
+      return 1;
+  return 0;
+} /* }}} _Bool kairosdb_series_pending */
+
+/* Removes the series which haven't been used since "before". Must only be
+ * called while the batch is empty. */
+static void kairosdb_expire(format_kairosdb_t *fk, cdtime_t before) /* {{{ */
+{
+  char **keys = NULL;
+  size_t keys_num = 0;
+
+  c_avl_iterator_t *iter = c_avl_get_iterator(fk->series);
+  char *key;
+  kairosdb_series_t *s;
+  while (c_avl_iterator_next(iter, (void *)&key, (void *)&s) == 0) {
+    if (s->used >= before)
+      continue;
+
+    char **tmp = realloc(keys, (keys_num + 1) * sizeof(*keys));
+    if (tmp == NULL)
+      break;
+    keys = tmp;
+    keys[keys_num++] = key;
+  }
+  c_avl_iterator_destroy(iter);
 
-    BUFFER_ADD("\", \"datapoints\": %s", temp);
+  for (size_t i = 0; i < keys_num; i++) {
+    if (c_avl_remove(fk->series, keys[i], (void *)&key, (void *)&s) == 0)
+      kairosdb_series_destroy(s);
+  }
+  sfree(keys);
+} /* }}} void kairosdb_expire */
+
+/* Looks up the series of "vl", creating it if necessary. */
+static int kairosdb_series_get(format_kairosdb_t *fk, /* {{{ */
+                               data_set_t const *ds, value_list_t const *vl,
+                               kairosdb_series_t **ret_series) {
+  char buffer[6 * DATA_MAX_NAME_LEN];
+  char const *key = buffer;
+
+  value_list_identity_t const *identity = VALUE_LIST_IDENTITY(vl);
+  if (identity != NULL)
+    key = identity->name;
+  else if (FORMAT_VL(buffer, sizeof(buffer), vl) != 0)
+    return EINVAL;
+
+  cdtime_t now = cdtime();
+  kairosdb_series_t *s = NULL;
+  if (c_avl_get(fk->series, key, (void *)&s) == 0) {
+    if (s->ds == ds) {
+      s->used = now;
+      *ret_series = s;
+      return 0;
+    }
 
-    /*
-     * Now adds meta data to metric as tags
-     */
+    /* The data set has been replaced. The metrics of the old one may still
+     * be part of the batch, in which case it has to be finalized first. */
+    if (kairosdb_series_pending(s))
+      return ENOMEM;
 
-    memset(temp, 0, sizeof(temp));
+    char *old_key;
+    c_avl_remove(fk->series, key, (void *)&old_key, (void *)&s);
+    kairosdb_series_destroy(s);
+  }
 
-    if (data_ttl != 0)
-      BUFFER_ADD(", \"ttl\": %i", data_ttl);
+  s = kairosdb_series_create(fk, key, ds, vl);
+  if (s == NULL)
+    return ENOMEM;
+  if (c_avl_insert(fk->series, s->key, s) != 0) {
+    kairosdb_series_destroy(s);
+    return ENOMEM;
+  }
 
-    BUFFER_ADD(", \"tags\":\{");
+  s->used = now;
+  *ret_series = s;
+  return 0;
+} /* }}} int kairosdb_series_get */
+
+/* Formats the datapoint of data source "ds_index" into "buffer" and returns
+ * its length, or zero if the value can't be represented. */
+static size_t kairosdb_format_point(char *buffer, size_t buffer_size, /* {{{ */
+                                    data_set_t const *ds,
+                                    value_list_t const *vl,
+                                    gauge_t const *rates, size_t ds_index) {
+  uint64_t time_ms = CDTIME_T_TO_MS(vl->time);
+  value_t v = vl->values[ds_index];
+  int status;
 
-    BUFFER_ADD("\"host\": \"%s\"", vl->host);
-    for (size_t j = 0; j < http_attrs_num; j += 2) {
-      BUFFER_ADD(", \"%s\":", http_attrs[j]);
-      BUFFER_ADD(" \"%s\"", http_attrs[j + 1]);
+  if ((ds->ds[ds_index].type == DS_TYPE_GAUGE) || (rates != NULL)) {
+    gauge_t g = (ds->ds[ds_index].type == DS_TYPE_GAUGE) ? v.gauge
+                                                         : rates[ds_index];
+    if (!isfinite(g)) {
+      DEBUG("utils_format_kairosdb: Skipping non-finite value of "
+            "%s|%s|%s|%s|%s",
+            vl->plugin, vl->plugin_instance, vl->type, vl->type_instance,
+            ds->ds[ds_index].name);
+      return 0;
     }
+    status = snprintf(buffer, buffer_size,
+                      "[%" PRIu64 "," JSON_GAUGE_FORMAT "]", time_ms, g);
+  } else if (ds->ds[ds_index].type == DS_TYPE_COUNTER)
+    status = snprintf(buffer, buffer_size, "[%" PRIu64 ",%" PRIu64 "]",
+                      time_ms, (uint64_t)v.counter);
+  else if (ds->ds[ds_index].type == DS_TYPE_DERIVE)
+    status = snprintf(buffer, buffer_size, "[%" PRIu64 ",%" PRIi64 "]",
+                      time_ms, v.derive);
+  else if (ds->ds[ds_index].type == DS_TYPE_ABSOLUTE)
+    status = snprintf(buffer, buffer_size, "[%" PRIu64 ",%" PRIu64 "]",
+                      time_ms, v.absolute);
+  else {
+    ERROR("format_kairosdb: Unknown data source type: %i",
+          ds->ds[ds_index].type);
+    return 0;
+  }
 
-    if (strlen(vl->plugin_instance))
-      BUFFER_ADD_KEYVAL("plugin_instance", vl->plugin_instance);
-    BUFFER_ADD_KEYVAL("type", vl->type);
-    if (strlen(vl->type_instance))
-      BUFFER_ADD_KEYVAL("type_instance", vl->type_instance);
-    if (ds->ds_num != 1)
-      BUFFER_ADD_KEYVAL("ds", ds->ds[i].name);
-    BUFFER_ADD("}}");
-  } /* for ds->ds_num */
-
-#undef BUFFER_ADD_KEYVAL
-#undef BUFFER_ADD
-
-  DEBUG("format_kairosdb: value_list_to_kairosdb: buffer = %s;", buffer);
+  if ((status < 0) || ((size_t)status >= buffer_size))
+    return 0;
+  return (size_t)status;
+} /* }}} size_t kairosdb_format_point */
+
+format_kairosdb_t *format_kairosdb_create(char const *const *attrs, /* {{{ */
+                                          size_t attrs_num, int data_ttl,
+                                          char const *metrics_prefix,
+                                          cdtime_t expire) {
+  format_kairosdb_t *fk = calloc(1, sizeof(*fk));
+  if (fk == NULL)
+    return NULL;
+
+  fk->data_ttl = data_ttl;
+  fk->series = c_avl_create((int (*)(const void *, const void *))strcmp);
+  if (fk->series == NULL) {
+    sfree(fk);
+    return NULL;
+  }
 
-  return 0;
-} /* }}} int value_list_to_kairosdb */
-
-static int format_kairosdb_value_list_nocheck(
-    char *buffer, /* {{{ */
-    size_t *ret_buffer_fill, size_t *ret_buffer_free, const data_set_t *ds,
-    const value_list_t *vl, int store_rates, size_t temp_size,
-    char const *const *http_attrs, size_t http_attrs_num, int data_ttl,
-    char const *metrics_prefix) {
-  char temp[temp_size];
-  int status;
+  int status = 0;
+  for (size_t i = 0; (status == 0) && (i + 1 < attrs_num); i += 2) {
+    status = strarray_add(&fk->attrs, &fk->attrs_num, attrs[i]);
+    if (status == 0)
+      status = strarray_add(&fk->attrs, &fk->attrs_num, attrs[i + 1]);
+  }
+  if ((status == 0) && (metrics_prefix != NULL)) {
+    fk->metrics_prefix = strdup(metrics_prefix);
+    if (fk->metrics_prefix == NULL)
+      status = ENOMEM;
+  }
+  if (status != 0) {
+    format_kairosdb_destroy(fk);
+    return NULL;
+  }
+  fk->expire = expire;
+  fk->next_expire = cdtime() + expire;
+
+  return fk;
+} /* }}} format_kairosdb_t *format_kairosdb_create */
+
+void format_kairosdb_destroy(format_kairosdb_t *fk) /* {{{ */
+{
+  if (fk == NULL)
+    return;
+
+  char *key;
+  kairosdb_series_t *s;
+  while (c_avl_pick(fk->series, (void *)&key, (void *)&s) == 0)
+    kairosdb_series_destroy(s);
+  c_avl_destroy(fk->series);
+
+  sfree(fk->batch);
+  strarray_free(fk->attrs, fk->attrs_num);
+  sfree(fk->metrics_prefix);
+  sfree(fk);
+} /* }}} void format_kairosdb_destroy */
+
+int format_kairosdb_value_list(format_kairosdb_t *fk, /* {{{ */
+                               const data_set_t *ds, const value_list_t *vl,
+                               int store_rates, size_t size_max) {
+  if ((fk == NULL) || (ds == NULL) || (vl == NULL) ||
+      (ds->ds_num != vl->values_len))
+    return -EINVAL;
 
-  status = value_list_to_kairosdb(temp, sizeof(temp), ds, vl, store_rates,
-                                  http_attrs, http_attrs_num, data_ttl,
-                                  metrics_prefix);
+  kairosdb_series_t *s = NULL;
+  int status = kairosdb_series_get(fk, ds, vl, &s);
   if (status != 0)
-    return status;
-  temp_size = strlen(temp);
+    return -status;
 
-  memcpy(buffer + (*ret_buffer_fill), temp, temp_size + 1);
-  (*ret_buffer_fill) += temp_size;
-  (*ret_buffer_free) -= temp_size;
-
-  return 0;
-} /* }}} int format_kairosdb_value_list_nocheck */
-
-int format_kairosdb_initialize(char *buffer, /* {{{ */
-                               size_t *ret_buffer_fill,
-                               size_t *ret_buffer_free) {
-  size_t buffer_fill;
-  size_t buffer_free;
+  gauge_t *rates = NULL;
+  if (store_rates) {
+    for (size_t i = 0; i < ds->ds_num; i++)
+      if (ds->ds[i].type != DS_TYPE_GAUGE) {
+        rates = uc_get_rate(ds, vl);
+        if (rates == NULL) {
+          WARNING("utils_format_kairosdb: uc_get_rate failed for "
+                  "%s|%s|%s|%s",
+                  vl->plugin, vl->plugin_instance, vl->type,
+                  vl->type_instance);
+          return -ENOENT;
+        }
+        break;
+      }
+  }
 
-  if ((buffer == NULL) || (ret_buffer_fill == NULL) ||
-      (ret_buffer_free == NULL))
-    return -EINVAL;
+  char points[ds->ds_num][KAIROSDB_POINT_SIZE];
+  size_t points_len[ds->ds_num];
+  size_t batch_new = 0;
+  size_t needed = 0;
 
-  buffer_fill = *ret_buffer_fill;
-  buffer_free = *ret_buffer_free;
+  for (size_t i = 0; i < ds->ds_num; i++) {
+    points_len[i] =
+        kairosdb_format_point(points[i], sizeof(points[i]), ds, vl, rates, i);
+    if (points_len[i] == 0)
+      continue;
+
+    kairosdb_metric_t *m = s->metrics + i;
+    if (m->points_len != 0) {
+      needed += 1 + points_len[i];
+      continue;
+    }
 
-  buffer_free = buffer_fill + buffer_free;
-  buffer_fill = 0;
+    /* The metric object is added to the batch, separated by a comma from the
+     * previous one. */
+    needed += m->head_len + points_len[i] + m->tail_len;
+    if (fk->batch_num + batch_new > 0)
+      needed++;
+    batch_new++;
+  }
+  sfree(rates);
 
-  if (buffer_free < 3)
+  /* An empty batch still needs the brackets of the array. */
+  size_t size = ((fk->size != 0) ? fk->size : 2) + needed;
+  if (size + 1 > size_max)
     return -ENOMEM;
 
-  memset(buffer, 0, buffer_free);
-  *ret_buffer_fill = buffer_fill;
-  *ret_buffer_free = buffer_free;
+  /* Allocate everything before anything is added. */
+  if (fk->batch_num + batch_new > fk->batch_size) {
+    size_t batch_size = 2 * fk->batch_size;
+    if (batch_size < fk->batch_num + batch_new)
+      batch_size = fk->batch_num + batch_new + 16;
+    kairosdb_metric_t **tmp =
+        realloc(fk->batch, batch_size * sizeof(*fk->batch));
+    if (tmp == NULL)
+      return -ENOMEM;
+    fk->batch = tmp;
+    fk->batch_size = batch_size;
+  }
+  for (size_t i = 0; i < ds->ds_num; i++) {
+    kairosdb_metric_t *m = s->metrics + i;
+    size_t points_size = m->points_len + 1 + points_len[i];
+    if ((points_len[i] == 0) || (points_size <= m->points_size))
+      continue;
+
+    if (points_size < 2 * m->points_size)
+      points_size = 2 * m->points_size;
+    char *tmp = realloc(m->points, points_size);
+    if (tmp == NULL)
+      return -ENOMEM;
+    m->points = tmp;
+    m->points_size = points_size;
+  }
+
+  for (size_t i = 0; i < ds->ds_num; i++) {
+    kairosdb_metric_t *m = s->metrics + i;
+    if (points_len[i] == 0)
+      continue;
+
+    if (m->points_len == 0)
+      fk->batch[fk->batch_num++] = m;
+    else
+      m->points[m->points_len++] = ',';
+    memcpy(m->points + m->points_len, points[i], points_len[i]);
+    m->points_len += points_len[i];
+  }
+  if (needed > 0)
+    fk->size = size;
 
   return 0;
-} /* }}} int format_kairosdb_initialize */
+} /* }}} int format_kairosdb_value_list */
 
-int format_kairosdb_finalize(char *buffer, /* {{{ */
-                             size_t *ret_buffer_fill, size_t *ret_buffer_free) {
-  size_t pos;
+size_t format_kairosdb_size(format_kairosdb_t const *fk) /* {{{ */
+{
+  return (fk != NULL) ? fk->size : 0;
+} /* }}} size_t format_kairosdb_size */
 
-  if ((buffer == NULL) || (ret_buffer_fill == NULL) ||
+int format_kairosdb_finalize(format_kairosdb_t *fk, char *buffer, /* {{{ */
+                             size_t *ret_buffer_fill,
+                             size_t *ret_buffer_free) {
+  if ((fk == NULL) || (buffer == NULL) || (ret_buffer_fill == NULL) ||
       (ret_buffer_free == NULL))
     return -EINVAL;
 
-  if (*ret_buffer_free < 2)
+  size_t size = (fk->size != 0) ? fk->size : 2;
+  if (size + 1 > *ret_buffer_free)
     return -ENOMEM;
 
-  /* Replace the leading comma added in `value_list_to_kairosdb' with a square
-   * bracket. */
-  if (buffer[0] != ',')
-    return -EINVAL;
-  buffer[0] = '[';
+  char *ptr = buffer + *ret_buffer_fill;
+  *(ptr++) = '[';
+  for (size_t i = 0; i < fk->batch_num; i++) {
+    kairosdb_metric_t *m = fk->batch[i];
+
+    if (i != 0)
+      *(ptr++) = ',';
+    memcpy(ptr, m->head, m->head_len);
+    ptr += m->head_len;
+    memcpy(ptr, m->points, m->points_len);
+    ptr += m->points_len;
+    memcpy(ptr, m->tail, m->tail_len);
+    ptr += m->tail_len;
+
+    m->points_len = 0;
+  }
+  *(ptr++) = ']';
+  *ptr = 0;
 
-  pos = *ret_buffer_fill;
-  buffer[pos] = ']';
-  buffer[pos + 1] = 0;
+  assert((size_t)(ptr - (buffer + *ret_buffer_fill)) == size);
+  *ret_buffer_fill += size;
+  *ret_buffer_free -= size;
 
-  (*ret_buffer_fill)++;
-  (*ret_buffer_free)--;
+  fk->batch_num = 0;
+  fk->size = 0;
+
+  cdtime_t now = cdtime();
+  if ((fk->expire > 0) && (now >= fk->next_expire)) {
+    kairosdb_expire(fk, now - fk->expire);
+    fk->next_expire = now + fk->expire;
+  }
 
   return 0;
 } /* }}} int format_kairosdb_finalize */
 
-int format_kairosdb_value_list(char *buffer, /* {{{ */
-                               size_t *ret_buffer_fill, size_t *ret_buffer_free,
-                               const data_set_t *ds, const value_list_t *vl,
-                               int store_rates, char const *const *http_attrs,
-                               size_t http_attrs_num, int data_ttl,
-                               char const *metrics_prefix) {
-  if ((buffer == NULL) || (ret_buffer_fill == NULL) ||
-      (ret_buffer_free == NULL) || (ds == NULL) || (vl == NULL))
-    return -EINVAL;
-
-  if (*ret_buffer_free < 3)
-    return -ENOMEM;
-
-  return format_kairosdb_value_list_nocheck(
-      buffer, ret_buffer_fill, ret_buffer_free, ds, vl, store_rates,
-      (*ret_buffer_free) - 2, http_attrs, http_attrs_num, data_ttl,
-      metrics_prefix);
-} /* }}} int format_kairosdb_value_list */
-
 /* vim: set sw=2 sts=2 et fdm=marker : */
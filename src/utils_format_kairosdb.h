@@ -35,15 +35,82 @@
 #define JSON_GAUGE_FORMAT GAUGE_FORMAT
 #endif
 
-int format_kairosdb_initialize(char *buffer, size_t *ret_buffer_fill,
-                               size_t *ret_buffer_free);
-int format_kairosdb_value_list(char *buffer, size_t *ret_buffer_fill,
-                               size_t *ret_buffer_free, const data_set_t *ds,
+struct format_kairosdb_s;
+typedef struct format_kairosdb_s format_kairosdb_t;
+
+/*
+ * NAME
+ *   format_kairosdb_create
+ *
+ * DESCRIPTION
+ *   Creates a serializer which collects value lists into a batch for the
+ *   KairosDB REST API. The batch holds one metric object per series and data
+ *   source, and all values added for the same series and data source are
+ *   sent as the datapoints of that single object. The name and tags of each
+ *   series are serialized once and cached; entries which haven't been used
+ *   for `expire' are removed. A serializer is not thread-safe.
+ *
+ * PARAMETERS
+ *   `attrs'           Pairs of names and values which are added as tags to
+ *                     all metrics. The strings are copied.
+ *   `attrs_num'       Number of elements in `attrs', i.e. twice the number
+ *                     of tags.
+ *   `data_ttl'        Time to live of the datapoints in seconds or zero.
+ *   `metrics_prefix'  Prefix of the metric names or NULL.
+ *   `expire'          Time after which unused series are removed from the
+ *                     cache or zero to keep them forever.
+ *
+ * RETURN VALUE
+ *   A format_kairosdb_t-pointer upon success or NULL upon failure.
+ */
+format_kairosdb_t *format_kairosdb_create(char const *const *attrs,
+                                          size_t attrs_num, int data_ttl,
+                                          char const *metrics_prefix,
+                                          cdtime_t expire);
+
+void format_kairosdb_destroy(format_kairosdb_t *fk);
+
+/*
+ * NAME
+ *   format_kairosdb_value_list
+ *
+ * DESCRIPTION
+ *   Adds one datapoint per data source of `vl' to the batch. Values which
+ *   are not finite are skipped. If `store_rates' is true, counters, derives
+ *   and absolute values are sent as rates.
+ *
+ * RETURN VALUE
+ *   Zero on success. -ENOMEM if the serialized batch would no longer fit
+ *   into `size_max' bytes including the terminating null byte, in which case
+ *   nothing has been added and the batch has to be finalized first. Another
+ *   negative errno value upon failure.
+ */
+int format_kairosdb_value_list(format_kairosdb_t *fk, const data_set_t *ds,
                                const value_list_t *vl, int store_rates,
-                               char const *const *http_attrs,
-                               size_t http_attrs_num, int data_ttl,
-                               char const *metrics_prefix);
-int format_kairosdb_finalize(char *buffer, size_t *ret_buffer_fill,
-                             size_t *ret_buffer_free);
+                               size_t size_max);
+
+/*
+ * NAME
+ *   format_kairosdb_size
+ *
+ * DESCRIPTION
+ *   Returns the length of the serialized batch, not including the
+ *   terminating null byte, or zero if the batch is empty.
+ */
+size_t format_kairosdb_size(format_kairosdb_t const *fk);
+
+/*
+ * NAME
+ *   format_kairosdb_finalize
+ *
+ * DESCRIPTION
+ *   Appends the batch as a JSON array to `buffer' and empties it.
+ *
+ * RETURN VALUE
+ *   Zero on success, -ENOMEM if the batch doesn't fit into the buffer or
+ *   another negative errno value.
+ */
+int format_kairosdb_finalize(format_kairosdb_t *fk, char *buffer,
+                             size_t *ret_buffer_fill, size_t *ret_buffer_free);
 
 #endif /* UTILS_FORMAT_KAIROSDB_H */
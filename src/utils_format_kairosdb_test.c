@@ -0,0 +1,180 @@
+/**
+ * collectd - src/utils_format_kairosdb_test.c
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "common.h"
+#include "testing.h"
+#include "utils_format_kairosdb.h"
+
+static data_set_t ds_single = {
+    .type = "load",
+    .ds_num = 1,
+    .ds = &(data_source_t){"value", DS_TYPE_GAUGE, NAN, NAN},
+};
+
+static data_set_t ds_double = {
+    .type = "if_octets",
+    .ds_num = 2,
+    .ds =
+        (data_source_t[]){
+            {"rx", DS_TYPE_DERIVE, 0, NAN}, {"tx", DS_TYPE_DERIVE, 0, NAN},
+        },
+};
+
+static void make_vl(value_list_t *vl, value_t *values, /* {{{ */
+                    size_t values_num, char const *plugin,
+                    char const *plugin_instance, char const *type,
+                    cdtime_t time) {
+  *vl = (value_list_t)VALUE_LIST_INIT;
+  vl->values = values;
+  vl->values_len = values_num;
+  vl->time = time;
+  sstrncpy(vl->host, "example.com", sizeof(vl->host));
+  sstrncpy(vl->plugin, plugin, sizeof(vl->plugin));
+  sstrncpy(vl->plugin_instance, plugin_instance, sizeof(vl->plugin_instance));
+  sstrncpy(vl->type, type, sizeof(vl->type));
+} /* }}} void make_vl */
+
+DEF_TEST(batch) {
+  char const *attrs[] = {"dc", "eu-1"};
+  format_kairosdb_t *fk;
+  value_list_t vl;
+  value_t values[2];
+  char buffer[1024];
+  size_t fill = 0;
+  size_t free_bytes = sizeof(buffer);
+
+  CHECK_NOT_NULL(fk = format_kairosdb_create(attrs, STATIC_ARRAY_SIZE(attrs),
+                                             /* data_ttl = */ 3600, "collectd",
+                                             /* expire = */ 0));
+  EXPECT_EQ_UINT64(0, format_kairosdb_size(fk));
+
+  /* Both value lists of a series end up in the same metric object. */
+  values[0].gauge = 1.5;
+  make_vl(&vl, values, 1, "load", "", "load", MS_TO_CDTIME_T(1000));
+  EXPECT_EQ_INT(0, format_kairosdb_value_list(fk, &ds_single, &vl, 0,
+                                              sizeof(buffer)));
+  values[0].derive = 10;
+  values[1].derive = 20;
+  make_vl(&vl, values, 2, "interface", "Eth0", "if_octets",
+          MS_TO_CDTIME_T(1000));
+  EXPECT_EQ_INT(0, format_kairosdb_value_list(fk, &ds_double, &vl, 0,
+                                              sizeof(buffer)));
+  values[0].gauge = 2.5;
+  make_vl(&vl, values, 1, "load", "", "load", MS_TO_CDTIME_T(2000));
+  EXPECT_EQ_INT(0, format_kairosdb_value_list(fk, &ds_single, &vl, 0,
+                                              sizeof(buffer)));
+
+  /* Values which aren't finite are skipped. */
+  values[0].gauge = NAN;
+  make_vl(&vl, values, 1, "load", "", "load", MS_TO_CDTIME_T(3000));
+  EXPECT_EQ_INT(0, format_kairosdb_value_list(fk, &ds_single, &vl, 0,
+                                              sizeof(buffer)));
+
+  char const *want =
+      "[{\"name\":\"collectd.load\",\"datapoints\":[[1000,1.5],[2000,2.5]],"
+      "\"ttl\":3600,\"tags\":{\"host\":\"example.com\",\"dc\":\"eu-1\","
+      "\"type\":\"load\"}},"
+      "{\"name\":\"collectd.interface\",\"datapoints\":[[1000,10]],"
+      "\"ttl\":3600,\"tags\":{\"host\":\"example.com\",\"dc\":\"eu-1\","
+      "\"plugin_instance\":\"eth0\",\"type\":\"if_octets\",\"ds\":\"rx\"}},"
+      "{\"name\":\"collectd.interface\",\"datapoints\":[[1000,20]],"
+      "\"ttl\":3600,\"tags\":{\"host\":\"example.com\",\"dc\":\"eu-1\","
+      "\"plugin_instance\":\"eth0\",\"type\":\"if_octets\",\"ds\":\"tx\"}}]";
+  EXPECT_EQ_UINT64(strlen(want), format_kairosdb_size(fk));
+
+  EXPECT_EQ_INT(0, format_kairosdb_finalize(fk, buffer, &fill, &free_bytes));
+  EXPECT_EQ_STR(want, buffer);
+  EXPECT_EQ_UINT64(strlen(want), fill);
+  EXPECT_EQ_UINT64(sizeof(buffer) - strlen(want), free_bytes);
+  EXPECT_EQ_UINT64(0, format_kairosdb_size(fk));
+
+  /* The cached series start over with the next batch. */
+  values[0].gauge = 3.5;
+  make_vl(&vl, values, 1, "load", "", "load", MS_TO_CDTIME_T(4000));
+  EXPECT_EQ_INT(0, format_kairosdb_value_list(fk, &ds_single, &vl, 0,
+                                              sizeof(buffer)));
+  fill = 0;
+  free_bytes = sizeof(buffer);
+  EXPECT_EQ_INT(0, format_kairosdb_finalize(fk, buffer, &fill, &free_bytes));
+  EXPECT_EQ_STR("[{\"name\":\"collectd.load\",\"datapoints\":[[4000,3.5]],"
+                "\"ttl\":3600,\"tags\":{\"host\":\"example.com\","
+                "\"dc\":\"eu-1\",\"type\":\"load\"}}]",
+                buffer);
+
+  format_kairosdb_destroy(fk);
+  return 0;
+}
+
+DEF_TEST(size_limit) {
+  format_kairosdb_t *fk;
+  value_list_t vl;
+  value_t values[1];
+  char buffer[256];
+  size_t fill = 0;
+  size_t free_bytes = sizeof(buffer);
+
+  CHECK_NOT_NULL(fk = format_kairosdb_create(NULL, 0, 0, NULL, 0));
+
+  /* Add datapoints until the batch is full. */
+  int status = 0;
+  size_t added = 0;
+  while (status == 0) {
+    size_t size = format_kairosdb_size(fk);
+
+    values[0].gauge = (gauge_t)added;
+    make_vl(&vl, values, 1, "load", "", "load",
+            MS_TO_CDTIME_T(1000 * (added + 1)));
+    status = format_kairosdb_value_list(fk, &ds_single, &vl, 0, sizeof(buffer));
+    if (status == 0) {
+      OK(format_kairosdb_size(fk) < sizeof(buffer));
+      added++;
+    } else {
+      /* Nothing has been added. */
+      EXPECT_EQ_UINT64(size, format_kairosdb_size(fk));
+    }
+  }
+  EXPECT_EQ_INT(-ENOMEM, status);
+  OK(added > 1);
+
+  /* The batch doesn't fit into a smaller buffer. */
+  free_bytes = format_kairosdb_size(fk);
+  EXPECT_EQ_INT(-ENOMEM,
+                format_kairosdb_finalize(fk, buffer, &fill, &free_bytes));
+
+  free_bytes = sizeof(buffer);
+  EXPECT_EQ_INT(0, format_kairosdb_finalize(fk, buffer, &fill, &free_bytes));
+  EXPECT_EQ_UINT64(strlen(buffer), fill);
+  EXPECT_EQ_INT(']', buffer[fill - 1]);
+
+  format_kairosdb_destroy(fk);
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(batch);
+  RUN_TEST(size_limit);
+
+  END_TEST;
+}
@@ -0,0 +1,626 @@
+/**
+ * collectd - src/utils_format_prometheus.c
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "utils_format_prometheus.h"
+
+#include "common.h"
+#include "plugin.h"
+#include "utils_avltree.h"
+#include "utils_cache.h"
+
+/* Protocol buffer tags of the "remote write" messages:
+ *
+ *   message WriteRequest { repeated TimeSeries timeseries = 1; }
+ *   message TimeSeries { repeated Label labels = 1;
+ *                        repeated Sample samples = 2; }
+ *   message Label { string name = 1; string value = 2; }
+ *   message Sample { double value = 1; int64 timestamp = 2; }
+ */
+#define RW_TAG_TIMESERIES 0x0a /* field 1, length delimited */
+#define RW_TAG_LABELS 0x0a     /* field 1, length delimited */
+#define RW_TAG_SAMPLES 0x12    /* field 2, length delimited */
+#define RW_TAG_NAME 0x0a       /* field 1, length delimited */
+#define RW_TAG_VALUE 0x12      /* field 2, length delimited */
+#define RW_TAG_SAMPLE_VALUE 0x09     /* field 1, 64 bit */
+#define RW_TAG_SAMPLE_TIMESTAMP 0x10 /* field 2, varint */
+
+#define RW_VARINT_MAX 10
+
+/* A label, encoded as a "labels" field of the "TimeSeries" message. */
+typedef struct {
+  char *name; /* sanitized, for sorting */
+  uint8_t *encoded;
+  size_t encoded_len;
+} rw_label_t;
+
+/* The cached labels of a series. "labels" holds the labels of the identifier
+ * and one "__name__" label per data source. "sorted" holds, for each data
+ * source, the labels sent with it, sorted by name. */
+typedef struct {
+  char *key;
+  data_set_t const *ds;
+  _Bool rates;
+  rw_label_t *labels;
+  size_t labels_num;
+  rw_label_t const ***sorted;
+  size_t sorted_num; /* same for all data sources */
+  cdtime_t used;
+} rw_series_t;
+
+struct format_remote_write_s {
+  c_avl_tree_t *series;
+  cdtime_t expire;
+  cdtime_t next_expire;
+};
+
+int format_prometheus_name(char *buffer, size_t buffer_size, /* {{{ */
+                           data_set_t const *ds, value_list_t const *vl,
+                           size_t ds_index, _Bool rates) {
+  char const *fields[5] = {"collectd"};
+  size_t fields_num = 1;
+
+  if (strcmp(vl->plugin, vl->type) != 0) {
+    fields[fields_num] = vl->plugin;
+    fields_num++;
+  }
+  fields[fields_num] = vl->type;
+  fields_num++;
+
+  if (strcmp("value", ds->ds[ds_index].name) != 0) {
+    fields[fields_num] = ds->ds[ds_index].name;
+    fields_num++;
+  }
+
+  /* Prometheus best practices:
+   * cumulative metrics should have a "total" suffix. */
+  if (!rates && ((ds->ds[ds_index].type == DS_TYPE_COUNTER) ||
+                 (ds->ds[ds_index].type == DS_TYPE_DERIVE))) {
+    fields[fields_num] = "total";
+    fields_num++;
+  }
+
+  int status =
+      strjoin(buffer, buffer_size, (char **)fields, fields_num, "_");
+  if (status < 0)
+    return EINVAL;
+  if ((size_t)status >= buffer_size)
+    return ENOBUFS;
+  return 0;
+} /* }}} int format_prometheus_name */
+
+size_t format_prometheus_labels( /* {{{ */
+    value_list_t const *vl,
+    format_prometheus_label_t labels[FORMAT_PROMETHEUS_LABELS_MAX]) {
+  size_t num = 0;
+
+  if (vl->plugin_instance[0] != 0) {
+    labels[num].name = vl->plugin;
+    labels[num].value = vl->plugin_instance;
+    num++;
+  }
+
+  if (vl->type_instance[0] != 0) {
+    labels[num].name = (vl->plugin_instance[0] != 0) ? "type" : vl->plugin;
+    labels[num].value = vl->type_instance;
+    num++;
+  }
+
+  labels[num].name = "instance";
+  labels[num].value = vl->host;
+  num++;
+
+  return num;
+} /* }}} size_t format_prometheus_labels */
+
+static size_t rw_varint(uint8_t buffer[static RW_VARINT_MAX], /* {{{ */
+                        uint64_t value) {
+  size_t i = 0;
+
+  while (value >= 0x80) {
+    buffer[i++] = (uint8_t)(value | 0x80);
+    value >>= 7;
+  }
+  buffer[i++] = (uint8_t)value;
+  return i;
+} /* }}} size_t rw_varint */
+
+static size_t rw_varint_len(uint64_t value) /* {{{ */
+{
+  size_t len = 1;
+
+  while (value >= 0x80) {
+    value >>= 7;
+    len++;
+  }
+  return len;
+} /* }}} size_t rw_varint_len */
+
+/* Replaces characters which aren't allowed in label names, i.e. anything but
+ * letters, digits and underscores, and a leading digit. "allow_colon" permits
+ * colons, which are allowed in metric names. */
+static char *rw_sanitize(char const *name, _Bool allow_colon) /* {{{ */
+{
+  size_t len = strlen(name);
+  _Bool digit = isdigit((unsigned char)name[0]) != 0;
+
+  char *ret = malloc(len + (digit ? 2 : 1));
+  if (ret == NULL)
+    return NULL;
+
+  char *ptr = ret;
+  if (digit)
+    *(ptr++) = '_';
+  for (size_t i = 0; i < len; i++) {
+    char c = name[i];
+    *(ptr++) = (isalnum((unsigned char)c) || (c == '_') ||
+                (allow_colon && (c == ':')))
+                   ? c
+                   : '_';
+  }
+  *ptr = 0;
+
+  return ret;
+} /* }}} char *rw_sanitize */
+
+static void rw_label_reset(rw_label_t *l) /* {{{ */
+{
+  sfree(l->name);
+  sfree(l->encoded);
+  l->encoded_len = 0;
+} /* }}} void rw_label_reset */
+
+/* Encodes the label "name"="value". Labels with an empty name or value are
+ * left empty, because Prometheus treats empty labels as absent. */
+static int rw_label_init(rw_label_t *l, char const *name, /* {{{ */
+                         char const *value, _Bool is_metric_name) {
+  memset(l, 0, sizeof(*l));
+  if ((name[0] == 0) || (value[0] == 0))
+    return 0;
+
+  l->name = is_metric_name ? strdup(name) : rw_sanitize(name, 0);
+  char *sanitized_value = is_metric_name ? rw_sanitize(value, 1) : NULL;
+  if ((l->name == NULL) || (is_metric_name && (sanitized_value == NULL))) {
+    sfree(sanitized_value);
+    rw_label_reset(l);
+    return ENOMEM;
+  }
+  if (is_metric_name)
+    value = sanitized_value;
+
+  size_t name_len = strlen(l->name);
+  size_t value_len = strlen(value);
+  size_t msg_len = 1 + rw_varint_len(name_len) + name_len + 1 +
+                   rw_varint_len(value_len) + value_len;
+
+  l->encoded = malloc(1 + rw_varint_len(msg_len) + msg_len);
+  if (l->encoded == NULL) {
+    sfree(sanitized_value);
+    rw_label_reset(l);
+    return ENOMEM;
+  }
+
+  uint8_t *ptr = l->encoded;
+  *(ptr++) = RW_TAG_LABELS;
+  ptr += rw_varint(ptr, msg_len);
+  *(ptr++) = RW_TAG_NAME;
+  ptr += rw_varint(ptr, name_len);
+  memcpy(ptr, l->name, name_len);
+  ptr += name_len;
+  *(ptr++) = RW_TAG_VALUE;
+  ptr += rw_varint(ptr, value_len);
+  memcpy(ptr, value, value_len);
+  ptr += value_len;
+  l->encoded_len = (size_t)(ptr - l->encoded);
+
+  sfree(sanitized_value);
+  return 0;
+} /* }}} int rw_label_init */
+
+static int rw_label_compare(void const *a, void const *b) /* {{{ */
+{
+  rw_label_t const *l_a = *((rw_label_t const *const *)a);
+  rw_label_t const *l_b = *((rw_label_t const *const *)b);
+
+  return strcmp(l_a->name, l_b->name);
+} /* }}} int rw_label_compare */
+
+/* Sorts the "num" labels at "labels" by name, removing empty labels and all
+ * but the first label of any name, and returns the remaining number. */
+static size_t rw_labels_sort(rw_label_t const **labels, size_t num) /* {{{ */
+{
+  size_t n = 0;
+  for (size_t i = 0; i < num; i++)
+    if (labels[i]->encoded != NULL)
+      labels[n++] = labels[i];
+
+  /* qsort() isn't stable, but the labels are few. */
+  for (size_t i = 1; i < n; i++)
+    for (size_t j = i; (j > 0) && (rw_label_compare(labels + j - 1,
+                                                     labels + j) > 0);
+         j--) {
+      rw_label_t const *tmp = labels[j];
+      labels[j] = labels[j - 1];
+      labels[j - 1] = tmp;
+    }
+
+  size_t unique = 0;
+  for (size_t i = 0; i < n; i++)
+    if ((unique == 0) || (strcmp(labels[unique - 1]->name, labels[i]->name)))
+      labels[unique++] = labels[i];
+
+  return unique;
+} /* }}} size_t rw_labels_sort */
+
+static void rw_series_destroy(rw_series_t *s) /* {{{ */
+{
+  if (s == NULL)
+    return;
+
+  for (size_t i = 0; i < s->labels_num; i++)
+    rw_label_reset(s->labels + i);
+  sfree(s->labels);
+  if (s->sorted != NULL)
+    for (size_t i = 0; i < s->ds->ds_num; i++)
+      sfree(s->sorted[i]);
+  sfree(s->sorted);
+  sfree(s->key);
+  sfree(s);
+} /* }}} void rw_series_destroy */
+
+static rw_series_t *rw_series_create(char const *key, /* {{{ */
+                                     data_set_t const *ds,
+                                     value_list_t const *vl, _Bool rates) {
+  rw_series_t *s = calloc(1, sizeof(*s));
+  if (s == NULL)
+    return NULL;
+  s->ds = ds;
+  s->rates = rates;
+
+  format_prometheus_label_t labels[FORMAT_PROMETHEUS_LABELS_MAX];
+  size_t labels_num = format_prometheus_labels(vl, labels);
+
+  s->key = strdup(key);
+  s->labels = calloc(labels_num + ds->ds_num, sizeof(*s->labels));
+  s->sorted = calloc(ds->ds_num, sizeof(*s->sorted));
+  if ((s->key == NULL) || (s->labels == NULL) || (s->sorted == NULL)) {
+    rw_series_destroy(s);
+    return NULL;
+  }
+
+  for (size_t i = 0; i < labels_num; i++) {
+    if (rw_label_init(s->labels + s->labels_num, labels[i].name,
+                      labels[i].value, /* is_metric_name = */ 0) != 0) {
+      rw_series_destroy(s);
+      return NULL;
+    }
+    s->labels_num++;
+  }
+
+  for (size_t i = 0; i < ds->ds_num; i++) {
+    char name[5 * DATA_MAX_NAME_LEN];
+    format_prometheus_name(name, sizeof(name), ds, vl, i, rates);
+    if (rw_label_init(s->labels + s->labels_num, "__name__", name,
+                      /* is_metric_name = */ 1) != 0) {
+      rw_series_destroy(s);
+      return NULL;
+    }
+    s->labels_num++;
+  }
+
+  for (size_t i = 0; i < ds->ds_num; i++) {
+    s->sorted[i] = calloc(labels_num + 1, sizeof(*s->sorted[i]));
+    if (s->sorted[i] == NULL) {
+      rw_series_destroy(s);
+      return NULL;
+    }
+
+    /* The name goes first, so it wins over a label called "__name__". */
+    s->sorted[i][0] = s->labels + labels_num + i;
+    for (size_t j = 0; j < labels_num; j++)
+      s->sorted[i][j + 1] = s->labels + j;
+    s->sorted_num = rw_labels_sort(s->sorted[i], labels_num + 1);
+  }
+
+  return s;
+} /* }}} rw_series_t *rw_series_create */
+
+format_remote_write_t *format_remote_write_create(cdtime_t expire) /* {{{ */
+{
+  format_remote_write_t *fr = calloc(1, sizeof(*fr));
+  if (fr == NULL)
+    return NULL;
+
+  fr->series = c_avl_create((int (*)(const void *, const void *))strcmp);
+  if (fr->series == NULL) {
+    sfree(fr);
+    return NULL;
+  }
+  fr->expire = expire;
+  fr->next_expire = cdtime() + expire;
+
+  return fr;
+} /* }}} format_remote_write_t *format_remote_write_create */
+
+void format_remote_write_destroy(format_remote_write_t *fr) /* {{{ */
+{
+  if (fr == NULL)
+    return;
+
+  char *key;
+  rw_series_t *s;
+  while (c_avl_pick(fr->series, (void *)&key, (void *)&s) == 0)
+    rw_series_destroy(s);
+  c_avl_destroy(fr->series);
+
+  sfree(fr);
+} /* }}} void format_remote_write_destroy */
+
+/* Removes the series which haven't been used since "before". */
+static void rw_expire(format_remote_write_t *fr, cdtime_t before) /* {{{ */
+{
+  char **keys = NULL;
+  size_t keys_num = 0;
+
+  c_avl_iterator_t *iter = c_avl_get_iterator(fr->series);
+  char *key;
+  rw_series_t *s;
+  while (c_avl_iterator_next(iter, (void *)&key, (void *)&s) == 0) {
+    if (s->used >= before)
+      continue;
+
+    char **tmp = realloc(keys, (keys_num + 1) * sizeof(*keys));
+    if (tmp == NULL)
+      break;
+    keys = tmp;
+    keys[keys_num++] = key;
+  }
+  c_avl_iterator_destroy(iter);
+
+  for (size_t i = 0; i < keys_num; i++) {
+    if (c_avl_remove(fr->series, keys[i], (void *)&key, (void *)&s) == 0)
+      rw_series_destroy(s);
+  }
+  sfree(keys);
+} /* }}} void rw_expire */
+
+static rw_series_t *rw_series_get(format_remote_write_t *fr, /* {{{ */
+                                  data_set_t const *ds, value_list_t const *vl,
+                                  _Bool rates) {
+  char buffer[6 * DATA_MAX_NAME_LEN];
+  char const *key = buffer;
+
+  value_list_identity_t const *identity = VALUE_LIST_IDENTITY(vl);
+  if (identity != NULL)
+    key = identity->name;
+  else if (FORMAT_VL(buffer, sizeof(buffer), vl) != 0)
+    return NULL;
+
+  cdtime_t now = cdtime();
+  if ((fr->expire > 0) && (now >= fr->next_expire)) {
+    rw_expire(fr, now - fr->expire);
+    fr->next_expire = now + fr->expire;
+  }
+
+  rw_series_t *s = NULL;
+  if (c_avl_get(fr->series, key, (void *)&s) == 0) {
+    if ((s->ds == ds) && (s->rates == rates)) {
+      s->used = now;
+      return s;
+    }
+
+    /* The data set has been replaced or the rates setting changed. */
+    char *old_key;
+    c_avl_remove(fr->series, key, (void *)&old_key, (void *)&s);
+    rw_series_destroy(s);
+  }
+
+  s = rw_series_create(key, ds, vl, rates);
+  if (s == NULL)
+    return NULL;
+  if (c_avl_insert(fr->series, s->key, s) != 0) {
+    rw_series_destroy(s);
+    return NULL;
+  }
+
+  s->used = now;
+  return s;
+} /* }}} rw_series_t *rw_series_get */
+
+/* Encodes the string meta data entries of "vl" as labels. */
+static int rw_meta_labels(meta_data_t *meta, rw_label_t **ret_labels, /* {{{ */
+                          size_t *ret_labels_num) {
+  *ret_labels = NULL;
+  *ret_labels_num = 0;
+  if (meta == NULL)
+    return 0;
+
+  char **toc = NULL;
+  int toc_num = meta_data_toc(meta, &toc);
+  if (toc_num <= 0)
+    return 0;
+
+  rw_label_t *labels = calloc((size_t)toc_num, sizeof(*labels));
+  if (labels == NULL) {
+    strarray_free(toc, (size_t)toc_num);
+    return ENOMEM;
+  }
+
+  size_t labels_num = 0;
+  int status = 0;
+  for (int i = 0; (i < toc_num) && (status == 0); i++) {
+    char *value = NULL;
+    if ((meta_data_type(meta, toc[i]) != MD_TYPE_STRING) ||
+        (meta_data_get_string(meta, toc[i], &value) != 0))
+      continue;
+
+    status = rw_label_init(labels + labels_num, toc[i], value,
+                           /* is_metric_name = */ 0);
+    if ((status == 0) && (labels[labels_num].encoded != NULL))
+      labels_num++;
+    sfree(value);
+  }
+  strarray_free(toc, (size_t)toc_num);
+
+  if (status != 0) {
+    for (size_t i = 0; i < labels_num; i++)
+      rw_label_reset(labels + i);
+    sfree(labels);
+    return status;
+  }
+
+  *ret_labels = labels;
+  *ret_labels_num = labels_num;
+  return 0;
+} /* }}} int rw_meta_labels */
+
+int format_remote_write_value_list( /* {{{ */
+    format_remote_write_t *fr, char *buffer, size_t *ret_buffer_fill,
+    size_t *ret_buffer_free, data_set_t const *ds, value_list_t const *vl,
+    _Bool store_rates) {
+  if ((fr == NULL) || (buffer == NULL) || (ret_buffer_fill == NULL) ||
+      (ret_buffer_free == NULL) || (ds == NULL) || (vl == NULL) ||
+      (ds->ds_num != vl->values_len))
+    return -EINVAL;
+
+  rw_series_t *s = rw_series_get(fr, ds, vl, store_rates);
+  if (s == NULL)
+    return -ENOMEM;
+
+  rw_label_t *meta_labels = NULL;
+  size_t meta_labels_num = 0;
+  int status = rw_meta_labels(vl->meta, &meta_labels, &meta_labels_num);
+  if (status != 0)
+    return -status;
+
+  /* The labels of the identifier come first, so they win over meta data
+   * entries of the same name. */
+  size_t labels_max = s->sorted_num + meta_labels_num;
+  rw_label_t const *labels_buffer[16];
+  rw_label_t const **labels = labels_buffer;
+  if (labels_max > STATIC_ARRAY_SIZE(labels_buffer))
+    labels = calloc(labels_max, sizeof(*labels));
+
+  gauge_t *rates = NULL;
+  if (store_rates) {
+    for (size_t i = 0; i < ds->ds_num; i++)
+      if (ds->ds[i].type != DS_TYPE_GAUGE) {
+        rates = uc_get_rate(ds, vl);
+        if (rates == NULL)
+          status = ENOENT;
+        break;
+      }
+  }
+
+  if ((labels == NULL) || (status != 0)) {
+    for (size_t i = 0; i < meta_labels_num; i++)
+      rw_label_reset(meta_labels + i);
+    sfree(meta_labels);
+    if (labels != labels_buffer)
+      sfree(labels);
+    sfree(rates);
+    return (status != 0) ? -status : -ENOMEM;
+  }
+
+  int64_t timestamp = (int64_t)CDTIME_T_TO_MS(vl->time);
+  size_t sample_len = 1 + 8 + 1 + rw_varint_len((uint64_t)timestamp);
+
+  /* Check that all series fit before appending any of them. */
+  size_t needed = 0;
+  size_t labels_nums[ds->ds_num];
+  for (size_t i = 0; i < ds->ds_num; i++) {
+    size_t n = 0;
+    for (size_t j = 0; j < s->sorted_num; j++)
+      labels[n++] = s->sorted[i][j];
+    for (size_t j = 0; j < meta_labels_num; j++)
+      labels[n++] = meta_labels + j;
+    labels_nums[i] = rw_labels_sort(labels, n);
+
+    size_t series_len = 1 + rw_varint_len(sample_len) + sample_len;
+    for (size_t j = 0; j < labels_nums[i]; j++)
+      series_len += labels[j]->encoded_len;
+    needed += 1 + rw_varint_len(series_len) + series_len;
+  }
+
+  if (needed > *ret_buffer_free) {
+    status = ENOMEM;
+  } else {
+    uint8_t *ptr = (uint8_t *)buffer + *ret_buffer_fill;
+
+    for (size_t i = 0; i < ds->ds_num; i++) {
+      size_t n = 0;
+      for (size_t j = 0; j < s->sorted_num; j++)
+        labels[n++] = s->sorted[i][j];
+      for (size_t j = 0; j < meta_labels_num; j++)
+        labels[n++] = meta_labels + j;
+      rw_labels_sort(labels, n);
+
+      size_t series_len = 1 + rw_varint_len(sample_len) + sample_len;
+      for (size_t j = 0; j < labels_nums[i]; j++)
+        series_len += labels[j]->encoded_len;
+
+      *(ptr++) = RW_TAG_TIMESERIES;
+      ptr += rw_varint(ptr, series_len);
+      for (size_t j = 0; j < labels_nums[i]; j++) {
+        memcpy(ptr, labels[j]->encoded, labels[j]->encoded_len);
+        ptr += labels[j]->encoded_len;
+      }
+
+      double value;
+      if (ds->ds[i].type == DS_TYPE_GAUGE)
+        value = (double)vl->values[i].gauge;
+      else if (rates != NULL)
+        value = (double)rates[i];
+      else if (ds->ds[i].type == DS_TYPE_COUNTER)
+        value = (double)vl->values[i].counter;
+      else if (ds->ds[i].type == DS_TYPE_DERIVE)
+        value = (double)vl->values[i].derive;
+      else
+        value = (double)vl->values[i].absolute;
+
+      uint64_t bits;
+      memcpy(&bits, &value, sizeof(bits));
+
+      *(ptr++) = RW_TAG_SAMPLES;
+      ptr += rw_varint(ptr, sample_len);
+      *(ptr++) = RW_TAG_SAMPLE_VALUE;
+      for (size_t j = 0; j < 8; j++)
+        *(ptr++) = (uint8_t)(bits >> (8 * j));
+      *(ptr++) = RW_TAG_SAMPLE_TIMESTAMP;
+      ptr += rw_varint(ptr, (uint64_t)timestamp);
+    }
+
+    *ret_buffer_fill += needed;
+    *ret_buffer_free -= needed;
+  }
+
+  for (size_t i = 0; i < meta_labels_num; i++)
+    rw_label_reset(meta_labels + i);
+  sfree(meta_labels);
+  if (labels != labels_buffer)
+    sfree(labels);
+  sfree(rates);
+
+  return -status;
+} /* }}} int format_remote_write_value_list */
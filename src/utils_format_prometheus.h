@@ -0,0 +1,124 @@
+/**
+ * collectd - src/utils_format_prometheus.h
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef UTILS_FORMAT_PROMETHEUS_H
+#define UTILS_FORMAT_PROMETHEUS_H 1
+
+#include "collectd.h"
+
+#include "plugin.h"
+
+/* Number of labels format_prometheus_labels() returns at most. */
+#define FORMAT_PROMETHEUS_LABELS_MAX 3
+
+typedef struct {
+  char const *name;
+  char const *value;
+} format_prometheus_label_t;
+
+/*
+ * NAME
+ *   format_prometheus_name
+ *
+ * DESCRIPTION
+ *   Formats the name of the metric family of the data source `ds_index' of
+ *   `vl' into `buffer'. This is done in the same way as by the
+ *   "collectd_exporter" for best possible compatibility: the plugin, type and
+ *   data source name go into the name, while host, plugin instance and type
+ *   instance go into the labels, see format_prometheus_labels(). Names of
+ *   cumulative metrics, i.e. counters and derives, get the suffix "_total",
+ *   unless `rates' is true.
+ *
+ * RETURN VALUE
+ *   Zero on success, ENOBUFS if the name has been truncated.
+ */
+int format_prometheus_name(char *buffer, size_t buffer_size,
+                           data_set_t const *ds, value_list_t const *vl,
+                           size_t ds_index, _Bool rates);
+
+/*
+ * NAME
+ *   format_prometheus_labels
+ *
+ * DESCRIPTION
+ *   Stores the labels of `vl' in `labels' and returns their number. The
+ *   labels always appear in the same order:
+ *
+ *     <plugin>="<plugin instance>"   unless the plugin instance is empty
+ *     type="<type instance>"         unless the type instance is empty; the
+ *                                    name is <plugin> if the plugin instance
+ *                                    is empty
+ *     instance="<host>"
+ *
+ *   The names and values point into `vl'.
+ */
+size_t format_prometheus_labels(
+    value_list_t const *vl,
+    format_prometheus_label_t labels[FORMAT_PROMETHEUS_LABELS_MAX]);
+
+struct format_remote_write_s;
+typedef struct format_remote_write_s format_remote_write_t;
+
+/*
+ * NAME
+ *   format_remote_write_create
+ *
+ * DESCRIPTION
+ *   Creates a serializer for the Prometheus "remote write" protocol. The
+ *   serializer caches the encoded label sets of the series it has formatted,
+ *   so that they are built only once per series. Entries which haven't been
+ *   used for `expire' are removed. A serializer is not thread-safe.
+ *
+ * RETURN VALUE
+ *   A format_remote_write_t-pointer upon success or NULL upon failure.
+ */
+format_remote_write_t *format_remote_write_create(cdtime_t expire);
+
+void format_remote_write_destroy(format_remote_write_t *fr);
+
+/*
+ * NAME
+ *   format_remote_write_value_list
+ *
+ * DESCRIPTION
+ *   Appends one "TimeSeries" message per data source of `vl' to `buffer',
+ *   each holding one sample. A buffer of such messages is a serialized
+ *   "WriteRequest" message, which has to be compressed with snappy before
+ *   it is posted. Besides the labels returned by format_prometheus_labels(),
+ *   the label "__name__" is set to the name returned by
+ *   format_prometheus_name() and each string meta data entry of `vl' is
+ *   added as a label. Characters which aren't allowed in label and metric
+ *   names are replaced with underscores. If `store_rates' is true, counters,
+ *   derives and absolute values are sent as rates.
+ *
+ * RETURN VALUE
+ *   Zero on success, -ENOMEM if the messages don't fit into the buffer, in
+ *   which case nothing has been appended, or another negative errno value.
+ */
+int format_remote_write_value_list(format_remote_write_t *fr, char *buffer,
+                                   size_t *ret_buffer_fill,
+                                   size_t *ret_buffer_free,
+                                   data_set_t const *ds,
+                                   value_list_t const *vl, _Bool store_rates);
+
+#endif /* UTILS_FORMAT_PROMETHEUS_H */
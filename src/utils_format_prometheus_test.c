@@ -0,0 +1,252 @@
+/**
+ * collectd - src/utils_format_prometheus_test.c
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "common.h"
+#include "testing.h"
+#include "utils_format_prometheus.h"
+
+static data_set_t ds_single = {
+    .type = "single",
+    .ds_num = 1,
+    .ds = &(data_source_t){"value", DS_TYPE_GAUGE, NAN, NAN},
+};
+
+static data_set_t ds_double = {
+    .type = "if_octets",
+    .ds_num = 2,
+    .ds =
+        (data_source_t[]){
+            {"rx", DS_TYPE_DERIVE, 0, NAN}, {"tx", DS_TYPE_DERIVE, 0, NAN},
+        },
+};
+
+static void make_vl(value_list_t *vl, char const *plugin, /* {{{ */
+                    char const *plugin_instance, char const *type,
+                    char const *type_instance) {
+  *vl = (value_list_t)VALUE_LIST_INIT;
+  sstrncpy(vl->host, "example.com", sizeof(vl->host));
+  sstrncpy(vl->plugin, plugin, sizeof(vl->plugin));
+  sstrncpy(vl->plugin_instance, plugin_instance, sizeof(vl->plugin_instance));
+  sstrncpy(vl->type, type, sizeof(vl->type));
+  sstrncpy(vl->type_instance, type_instance, sizeof(vl->type_instance));
+} /* }}} void make_vl */
+
+/* Reads a varint and advances `*ptr'. */
+static uint64_t read_varint(uint8_t const **ptr) /* {{{ */
+{
+  uint64_t value = 0;
+  for (int shift = 0;; shift += 7) {
+    uint8_t b = *((*ptr)++);
+    value |= ((uint64_t)(b & 0x7f)) << shift;
+    if ((b & 0x80) == 0)
+      return value;
+  }
+} /* }}} uint64_t read_varint */
+
+/* Decodes the labels of the TimeSeries message at `*ptr' into `buffer' as
+ * "name=value,name=value" and its sample, and advances `*ptr' past it. */
+static int read_series(uint8_t const **ptr, char *buffer, /* {{{ */
+                       size_t buffer_size, double *ret_value,
+                       int64_t *ret_timestamp) {
+  EXPECT_EQ_INT(0x0a, **ptr);
+  (*ptr)++;
+  size_t series_len = (size_t)read_varint(ptr);
+  uint8_t const *end = *ptr + series_len;
+
+  buffer[0] = 0;
+  while (*ptr < end) {
+    uint8_t tag = *((*ptr)++);
+    size_t len = (size_t)read_varint(ptr);
+    uint8_t const *msg = *ptr;
+    *ptr += len;
+
+    if (tag == 0x0a) {
+      EXPECT_EQ_INT(0x0a, *(msg++));
+      size_t name_len = (size_t)read_varint(&msg);
+      char const *name = (char const *)msg;
+      msg += name_len;
+      EXPECT_EQ_INT(0x12, *(msg++));
+      size_t value_len = (size_t)read_varint(&msg);
+
+      size_t fill = strlen(buffer);
+      snprintf(buffer + fill, buffer_size - fill, "%s%.*s=%.*s",
+               (fill == 0) ? "" : ",", (int)name_len, name, (int)value_len,
+               (char const *)msg);
+    } else {
+      EXPECT_EQ_INT(0x12, tag);
+      EXPECT_EQ_INT(0x09, *(msg++));
+      uint64_t bits = 0;
+      for (size_t i = 0; i < 8; i++)
+        bits |= ((uint64_t)msg[i]) << (8 * i);
+      memcpy(ret_value, &bits, sizeof(*ret_value));
+      msg += 8;
+      EXPECT_EQ_INT(0x10, *(msg++));
+      *ret_timestamp = (int64_t)read_varint(&msg);
+    }
+  }
+
+  return 0;
+} /* }}} int read_series */
+
+DEF_TEST(name) {
+  struct {
+    char const *plugin;
+    char const *type;
+    data_set_t *ds;
+    size_t ds_index;
+    _Bool rates;
+    char const *want;
+  } cases[] = {
+      {"cpu", "single", &ds_single, 0, 0, "collectd_cpu_single"},
+      {"single", "single", &ds_single, 0, 0, "collectd_single"},
+      {"interface", "if_octets", &ds_double, 0, 0,
+       "collectd_interface_if_octets_rx_total"},
+      {"interface", "if_octets", &ds_double, 1, 1,
+       "collectd_interface_if_octets_tx"},
+  };
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(cases); i++) {
+    value_list_t vl;
+    char got[5 * DATA_MAX_NAME_LEN];
+
+    make_vl(&vl, cases[i].plugin, "", cases[i].type, "");
+    EXPECT_EQ_INT(0, format_prometheus_name(got, sizeof(got), cases[i].ds,
+                                            &vl, cases[i].ds_index,
+                                            cases[i].rates));
+    EXPECT_EQ_STR(cases[i].want, got);
+  }
+
+  value_list_t vl;
+  char small[8];
+  make_vl(&vl, "cpu", "", "single", "");
+  EXPECT_EQ_INT(ENOBUFS, format_prometheus_name(small, sizeof(small),
+                                                &ds_single, &vl, 0, 0));
+
+  return 0;
+}
+
+DEF_TEST(labels) {
+  struct {
+    char const *plugin_instance;
+    char const *type_instance;
+    char const *want;
+  } cases[] = {
+      {"", "", "instance=example.com"},
+      {"0", "", "cpu=0,instance=example.com"},
+      {"", "idle", "cpu=idle,instance=example.com"},
+      {"0", "idle", "cpu=0,type=idle,instance=example.com"},
+  };
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(cases); i++) {
+    value_list_t vl;
+    format_prometheus_label_t labels[FORMAT_PROMETHEUS_LABELS_MAX];
+    char got[256] = "";
+
+    make_vl(&vl, "cpu", cases[i].plugin_instance, "percent",
+            cases[i].type_instance);
+    size_t num = format_prometheus_labels(&vl, labels);
+    for (size_t j = 0; j < num; j++) {
+      size_t fill = strlen(got);
+      snprintf(got + fill, sizeof(got) - fill, "%s%s=%s",
+               (j == 0) ? "" : ",", labels[j].name, labels[j].value);
+    }
+    EXPECT_EQ_STR(cases[i].want, got);
+  }
+
+  return 0;
+}
+
+DEF_TEST(remote_write) {
+  format_remote_write_t *fr;
+  value_list_t vl;
+  char buffer[1024];
+  size_t fill = 0;
+  size_t buffer_free = sizeof(buffer);
+
+  CHECK_NOT_NULL(fr = format_remote_write_create(TIME_T_TO_CDTIME_T(300)));
+
+  make_vl(&vl, "interface", "eth-0", "if_octets", "");
+  vl.values = (value_t[]){{.derive = 42}, {.derive = 23}};
+  vl.values_len = 2;
+  vl.time = MS_TO_CDTIME_T(1500000000123);
+  CHECK_NOT_NULL(vl.meta = meta_data_create());
+  meta_data_add_string(vl.meta, "zone", "eu-1");
+  meta_data_add_string(vl.meta, "instance", "ignored");
+  meta_data_add_string(vl.meta, "bad label", "x");
+  meta_data_add_signed_int(vl.meta, "not_a_string", 1);
+
+  /* Formatting the same value list twice uses the cached labels. */
+  for (int round = 0; round < 2; round++) {
+    fill = 0;
+    buffer_free = sizeof(buffer);
+    EXPECT_EQ_INT(0, format_remote_write_value_list(fr, buffer, &fill,
+                                                    &buffer_free, &ds_double,
+                                                    &vl, 0));
+    EXPECT_EQ_INT(sizeof(buffer), fill + buffer_free);
+
+    uint8_t const *ptr = (uint8_t const *)buffer;
+    char const *want_names[] = {"collectd_interface_if_octets_rx_total",
+                                "collectd_interface_if_octets_tx_total"};
+    double want_values[] = {42, 23};
+    for (size_t i = 0; i < STATIC_ARRAY_SIZE(want_names); i++) {
+      char got[512];
+      char want[512];
+      double value = NAN;
+      int64_t timestamp = 0;
+
+      CHECK_ZERO(read_series(&ptr, got, sizeof(got), &value, &timestamp));
+      snprintf(want, sizeof(want),
+               "__name__=%s,bad_label=x,instance=example.com,"
+               "interface=eth-0,zone=eu-1",
+               want_names[i]);
+      EXPECT_EQ_STR(want, got);
+      EXPECT_EQ_DOUBLE(want_values[i], value);
+      EXPECT_EQ_UINT64(1500000000123, (uint64_t)timestamp);
+    }
+    EXPECT_EQ_INT(fill, (size_t)(ptr - (uint8_t const *)buffer));
+  }
+
+  /* Nothing is appended if the series don't fit. */
+  size_t full_fill = fill;
+  fill = 0;
+  buffer_free = full_fill - 1;
+  EXPECT_EQ_INT(-ENOMEM,
+                format_remote_write_value_list(fr, buffer, &fill, &buffer_free,
+                                               &ds_double, &vl, 0));
+  EXPECT_EQ_INT(0, fill);
+  EXPECT_EQ_INT(full_fill - 1, buffer_free);
+
+  meta_data_destroy(vl.meta);
+  format_remote_write_destroy(fr);
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(name);
+  RUN_TEST(labels);
+  RUN_TEST(remote_write);
+
+  END_TEST;
+}
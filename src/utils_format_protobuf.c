@@ -0,0 +1,381 @@
+/**
+ * collectd - src/utils_format_protobuf.c
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "utils_format_protobuf.h"
+
+#include "common.h"
+#include "plugin.h"
+#include "utils_cache.h"
+
+/* Tags of the fields used, i.e. (field number << 3) | wire type. Wire type 0
+ * is a varint, 1 a 64 bit value and 2 is length delimited. */
+#define PB_VALUE_LISTS 0x0a /* ValueLists.value_lists */
+
+#define PB_VL_VALUES 0x0a /* ValueList.values */
+#define PB_VL_TIME 0x12
+#define PB_VL_INTERVAL 0x1a
+#define PB_VL_IDENTIFIER 0x22
+#define PB_VL_DS_NAMES 0x2a
+#define PB_VL_META_DATA 0x32
+
+#define PB_VALUE_COUNTER 0x08 /* Value */
+#define PB_VALUE_GAUGE 0x11
+#define PB_VALUE_DERIVE 0x18
+#define PB_VALUE_ABSOLUTE 0x20
+
+#define PB_SECONDS 0x08 /* google.protobuf.Timestamp and Duration */
+#define PB_NANOS 0x10
+
+#define PB_ID_HOST 0x0a /* Identifier */
+#define PB_ID_PLUGIN 0x12
+#define PB_ID_PLUGIN_INSTANCE 0x1a
+#define PB_ID_TYPE 0x22
+#define PB_ID_TYPE_INSTANCE 0x2a
+
+#define PB_MAP_KEY 0x0a /* map entries */
+#define PB_MAP_VALUE 0x12
+
+#define PB_MD_STRING 0x0a /* MetadataValue */
+#define PB_MD_INT64 0x10
+#define PB_MD_UINT64 0x18
+#define PB_MD_DOUBLE 0x21
+#define PB_MD_BOOL 0x28
+
+/* Writes into a buffer of fixed size. Once something didn't fit, "overflow"
+ * is set and nothing more is written. */
+typedef struct {
+  uint8_t *ptr;
+  uint8_t *end;
+  _Bool overflow;
+} pb_writer_t;
+
+static size_t pb_varint_len(uint64_t value) /* {{{ */
+{
+  size_t len = 1;
+
+  while (value >= 0x80) {
+    value >>= 7;
+    len++;
+  }
+  return len;
+} /* }}} size_t pb_varint_len */
+
+/* Size of a length delimited field of "len" bytes. All tags fit into one
+ * byte. */
+static size_t pb_field_len(size_t len) /* {{{ */
+{
+  return 1 + pb_varint_len(len) + len;
+} /* }}} size_t pb_field_len */
+
+/* Size of a string field, which is left out if empty. */
+static size_t pb_string_len(char const *s) /* {{{ */
+{
+  size_t len = strlen(s);
+  return (len > 0) ? pb_field_len(len) : 0;
+} /* }}} size_t pb_string_len */
+
+static void pb_put(pb_writer_t *w, void const *data, size_t len) /* {{{ */
+{
+  if (w->overflow || ((size_t)(w->end - w->ptr) < len)) {
+    w->overflow = 1;
+    return;
+  }
+  memcpy(w->ptr, data, len);
+  w->ptr += len;
+} /* }}} void pb_put */
+
+static void pb_put_varint(pb_writer_t *w, uint64_t value) /* {{{ */
+{
+  uint8_t buffer[10];
+  size_t len = 0;
+
+  while (value >= 0x80) {
+    buffer[len++] = (uint8_t)(value | 0x80);
+    value >>= 7;
+  }
+  buffer[len++] = (uint8_t)value;
+  pb_put(w, buffer, len);
+} /* }}} void pb_put_varint */
+
+static void pb_put_tag(pb_writer_t *w, uint8_t tag) /* {{{ */
+{
+  pb_put(w, &tag, 1);
+} /* }}} void pb_put_tag */
+
+static void pb_put_double(pb_writer_t *w, uint8_t tag, double d) /* {{{ */
+{
+  uint64_t bits;
+  uint8_t buffer[8];
+
+  memcpy(&bits, &d, sizeof(bits));
+  for (size_t i = 0; i < sizeof(buffer); i++)
+    buffer[i] = (uint8_t)(bits >> (8 * i));
+
+  pb_put_tag(w, tag);
+  pb_put(w, buffer, sizeof(buffer));
+} /* }}} void pb_put_double */
+
+static void pb_put_bytes(pb_writer_t *w, uint8_t tag, /* {{{ */
+                         void const *data, size_t len) {
+  pb_put_tag(w, tag);
+  pb_put_varint(w, len);
+  pb_put(w, data, len);
+} /* }}} void pb_put_bytes */
+
+static void pb_put_string(pb_writer_t *w, uint8_t tag, /* {{{ */
+                          char const *s) {
+  size_t len = strlen(s);
+  if (len > 0)
+    pb_put_bytes(w, tag, s, len);
+} /* }}} void pb_put_string */
+
+/* Encodes a google.protobuf.Timestamp or Duration. */
+static size_t pb_time_len(cdtime_t t) /* {{{ */
+{
+  uint64_t ns = CDTIME_T_TO_NS(t);
+  uint64_t seconds = ns / 1000000000;
+  uint64_t nanos = ns % 1000000000;
+
+  return ((seconds > 0) ? 1 + pb_varint_len(seconds) : 0) +
+         ((nanos > 0) ? 1 + pb_varint_len(nanos) : 0);
+} /* }}} size_t pb_time_len */
+
+static void pb_put_time(pb_writer_t *w, uint8_t tag, cdtime_t t) /* {{{ */
+{
+  uint64_t ns = CDTIME_T_TO_NS(t);
+  uint64_t seconds = ns / 1000000000;
+  uint64_t nanos = ns % 1000000000;
+
+  pb_put_tag(w, tag);
+  pb_put_varint(w, pb_time_len(t));
+  if (seconds > 0) {
+    pb_put_tag(w, PB_SECONDS);
+    pb_put_varint(w, seconds);
+  }
+  if (nanos > 0) {
+    pb_put_tag(w, PB_NANOS);
+    pb_put_varint(w, nanos);
+  }
+} /* }}} void pb_put_time */
+
+static void pb_put_identifier(pb_writer_t *w, /* {{{ */
+                              value_list_t const *vl) {
+  size_t len = pb_string_len(vl->host) + pb_string_len(vl->plugin) +
+               pb_string_len(vl->plugin_instance) + pb_string_len(vl->type) +
+               pb_string_len(vl->type_instance);
+
+  pb_put_tag(w, PB_VL_IDENTIFIER);
+  pb_put_varint(w, len);
+  pb_put_string(w, PB_ID_HOST, vl->host);
+  pb_put_string(w, PB_ID_PLUGIN, vl->plugin);
+  pb_put_string(w, PB_ID_PLUGIN_INSTANCE, vl->plugin_instance);
+  pb_put_string(w, PB_ID_TYPE, vl->type);
+  pb_put_string(w, PB_ID_TYPE_INSTANCE, vl->type_instance);
+} /* }}} void pb_put_identifier */
+
+static void pb_put_value(pb_writer_t *w, int ds_type, /* {{{ */
+                         value_t v) {
+  /* Fields of a "oneof" are encoded even if they are zero. */
+  switch (ds_type) {
+  case DS_TYPE_GAUGE:
+    pb_put_tag(w, PB_VL_VALUES);
+    pb_put_varint(w, 9);
+    pb_put_double(w, PB_VALUE_GAUGE, (double)v.gauge);
+    break;
+  case DS_TYPE_COUNTER:
+    pb_put_tag(w, PB_VL_VALUES);
+    pb_put_varint(w, 1 + pb_varint_len((uint64_t)v.counter));
+    pb_put_tag(w, PB_VALUE_COUNTER);
+    pb_put_varint(w, (uint64_t)v.counter);
+    break;
+  case DS_TYPE_DERIVE:
+    /* Negative int64 values are encoded as ten byte varints. */
+    pb_put_tag(w, PB_VL_VALUES);
+    pb_put_varint(w, 1 + pb_varint_len((uint64_t)v.derive));
+    pb_put_tag(w, PB_VALUE_DERIVE);
+    pb_put_varint(w, (uint64_t)v.derive);
+    break;
+  case DS_TYPE_ABSOLUTE:
+    pb_put_tag(w, PB_VL_VALUES);
+    pb_put_varint(w, 1 + pb_varint_len((uint64_t)v.absolute));
+    pb_put_tag(w, PB_VALUE_ABSOLUTE);
+    pb_put_varint(w, (uint64_t)v.absolute);
+    break;
+  }
+} /* }}} void pb_put_value */
+
+/* Encodes one entry of the "meta_data" map. Entries of unknown types are
+ * skipped. */
+static int pb_put_meta_entry(pb_writer_t *w, meta_data_t *meta, /* {{{ */
+                             char const *key) {
+  uint8_t value_buffer[16];
+  pb_writer_t value = {.ptr = value_buffer,
+                       .end = value_buffer + sizeof(value_buffer)};
+  char *string = NULL;
+
+  switch (meta_data_type(meta, key)) {
+  case MD_TYPE_STRING:
+    if (meta_data_get_string(meta, key, &string) != 0)
+      return -1;
+    break;
+  case MD_TYPE_SIGNED_INT: {
+    int64_t i = 0;
+    if (meta_data_get_signed_int(meta, key, &i) != 0)
+      return -1;
+    pb_put_tag(&value, PB_MD_INT64);
+    pb_put_varint(&value, (uint64_t)i);
+    break;
+  }
+  case MD_TYPE_UNSIGNED_INT: {
+    uint64_t u = 0;
+    if (meta_data_get_unsigned_int(meta, key, &u) != 0)
+      return -1;
+    pb_put_tag(&value, PB_MD_UINT64);
+    pb_put_varint(&value, u);
+    break;
+  }
+  case MD_TYPE_DOUBLE: {
+    double d = 0.0;
+    if (meta_data_get_double(meta, key, &d) != 0)
+      return -1;
+    pb_put_double(&value, PB_MD_DOUBLE, d);
+    break;
+  }
+  case MD_TYPE_BOOLEAN: {
+    _Bool b = 0;
+    if (meta_data_get_boolean(meta, key, &b) != 0)
+      return -1;
+    pb_put_tag(&value, PB_MD_BOOL);
+    pb_put_varint(&value, b ? 1 : 0);
+    break;
+  }
+  default:
+    return 0;
+  }
+
+  size_t value_len = (string != NULL) ? pb_field_len(strlen(string))
+                                      : (size_t)(value.ptr - value_buffer);
+  size_t entry_len = pb_field_len(strlen(key)) + pb_field_len(value_len);
+
+  pb_put_tag(w, PB_VL_META_DATA);
+  pb_put_varint(w, entry_len);
+  pb_put_bytes(w, PB_MAP_KEY, key, strlen(key));
+  pb_put_tag(w, PB_MAP_VALUE);
+  pb_put_varint(w, value_len);
+  if (string != NULL)
+    pb_put_bytes(w, PB_MD_STRING, string, strlen(string));
+  else
+    pb_put(w, value_buffer, value_len);
+
+  sfree(string);
+  return 0;
+} /* }}} int pb_put_meta_entry */
+
+/* Encodes the fields of the ValueList message. */
+static int pb_put_value_list(pb_writer_t *w, data_set_t const *ds, /* {{{ */
+                             value_list_t const *vl, gauge_t const *rates) {
+  for (size_t i = 0; i < ds->ds_num; i++) {
+    if ((rates != NULL) && (ds->ds[i].type != DS_TYPE_GAUGE))
+      pb_put_value(w, DS_TYPE_GAUGE, (value_t){.gauge = rates[i]});
+    else
+      pb_put_value(w, ds->ds[i].type, vl->values[i]);
+  }
+
+  pb_put_time(w, PB_VL_TIME, vl->time);
+  pb_put_time(w, PB_VL_INTERVAL, vl->interval);
+  pb_put_identifier(w, vl);
+
+  for (size_t i = 0; i < ds->ds_num; i++)
+    pb_put_bytes(w, PB_VL_DS_NAMES, ds->ds[i].name, strlen(ds->ds[i].name));
+
+  if (vl->meta == NULL)
+    return 0;
+
+  char **toc = NULL;
+  int toc_num = meta_data_toc(vl->meta, &toc);
+  if (toc_num < 0)
+    return -1;
+
+  int status = 0;
+  for (int i = 0; (i < toc_num) && (status == 0); i++)
+    status = pb_put_meta_entry(w, vl->meta, toc[i]);
+  strarray_free(toc, (size_t)toc_num);
+
+  return status;
+} /* }}} int pb_put_value_list */
+
+int format_protobuf_value_list(char *buffer, /* {{{ */
+                               size_t *ret_buffer_fill,
+                               size_t *ret_buffer_free, data_set_t const *ds,
+                               value_list_t const *vl, _Bool store_rates) {
+  if ((buffer == NULL) || (ret_buffer_fill == NULL) ||
+      (ret_buffer_free == NULL) || (ds == NULL) || (vl == NULL) ||
+      (ds->ds_num != vl->values_len))
+    return -EINVAL;
+
+  gauge_t *rates = NULL;
+  if (store_rates) {
+    for (size_t i = 0; i < ds->ds_num; i++)
+      if (ds->ds[i].type != DS_TYPE_GAUGE) {
+        rates = uc_get_rate(ds, vl);
+        if (rates == NULL) {
+          WARNING("utils_format_protobuf: uc_get_rate failed.");
+          return -1;
+        }
+        break;
+      }
+  }
+
+  /* The length of the value list is known only once it has been encoded.
+   * It is encoded after room for the largest length prefix and moved in
+   * place afterwards. */
+  size_t header_max = 1 + pb_varint_len(SIZE_MAX);
+  if (*ret_buffer_free <= header_max) {
+    sfree(rates);
+    return -ENOMEM;
+  }
+
+  uint8_t *start = (uint8_t *)buffer + *ret_buffer_fill;
+  pb_writer_t w = {.ptr = start + header_max,
+                   .end = start + *ret_buffer_free};
+  int status = pb_put_value_list(&w, ds, vl, rates);
+  sfree(rates);
+  if (status != 0)
+    return -EINVAL;
+
+  size_t len = (size_t)(w.ptr - (start + header_max));
+  size_t header_len = 1 + pb_varint_len(len);
+  if (w.overflow)
+    return -ENOMEM;
+
+  pb_writer_t header = {.ptr = start, .end = start + header_len};
+  pb_put_tag(&header, PB_VALUE_LISTS);
+  pb_put_varint(&header, len);
+  memmove(start + header_len, start + header_max, len);
+
+  *ret_buffer_fill += header_len + len;
+  *ret_buffer_free -= header_len + len;
+  return 0;
+} /* }}} int format_protobuf_value_list */
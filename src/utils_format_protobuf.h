@@ -0,0 +1,53 @@
+/**
+ * collectd - src/utils_format_protobuf.h
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef UTILS_FORMAT_PROTOBUF_H
+#define UTILS_FORMAT_PROTOBUF_H 1
+
+#include "collectd.h"
+
+#include "plugin.h"
+
+/*
+ * NAME
+ *   format_protobuf_value_list
+ *
+ * DESCRIPTION
+ *   Appends `vl' to `buffer' as one element of the "value_lists" field of the
+ *   "collectd.types.ValueLists" message defined in proto/types.proto. A
+ *   buffer holding one or more such elements, simply concatenated, is a
+ *   serialized "ValueLists" message, so batches don't need a header or
+ *   trailer. The value list carries its identifier, time, interval, values,
+ *   data source names and meta data, like the "ValueList" messages of the
+ *   gRPC plugin. If `store_rates' is true, counters, derives and absolute
+ *   values are converted to rates and sent as gauges.
+ *
+ * RETURN VALUE
+ *   Zero on success, -ENOMEM if the value list doesn't fit into the buffer,
+ *   in which case nothing has been appended, or another negative errno value.
+ */
+int format_protobuf_value_list(char *buffer, size_t *ret_buffer_fill,
+                               size_t *ret_buffer_free, data_set_t const *ds,
+                               value_list_t const *vl, _Bool store_rates);
+
+#endif /* UTILS_FORMAT_PROTOBUF_H */
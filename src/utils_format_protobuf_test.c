@@ -0,0 +1,220 @@
+/**
+ * collectd - src/utils_format_protobuf_test.c
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "common.h"
+#include "testing.h"
+#include "utils_format_protobuf.h"
+
+static data_set_t ds_test = {
+    .type = "test",
+    .ds_num = 3,
+    .ds =
+        (data_source_t[]){
+            {"gauge", DS_TYPE_GAUGE, NAN, NAN},
+            {"derive", DS_TYPE_DERIVE, 0, NAN},
+            {"counter", DS_TYPE_COUNTER, 0, NAN},
+        },
+};
+
+typedef struct {
+  uint8_t const *ptr;
+  uint8_t const *end;
+} reader_t;
+
+static uint64_t read_varint(reader_t *r) /* {{{ */
+{
+  uint64_t value = 0;
+  for (int shift = 0; r->ptr < r->end; shift += 7) {
+    uint8_t b = *(r->ptr++);
+    value |= ((uint64_t)(b & 0x7f)) << shift;
+    if ((b & 0x80) == 0)
+      break;
+  }
+  return value;
+} /* }}} uint64_t read_varint */
+
+/* Reads a length delimited field and returns a reader for its content. */
+static reader_t read_message(reader_t *r) /* {{{ */
+{
+  size_t len = (size_t)read_varint(r);
+  reader_t sub = {.ptr = r->ptr, .end = r->ptr + len};
+  r->ptr += len;
+  return sub;
+} /* }}} reader_t read_message */
+
+static double read_double(reader_t *r) /* {{{ */
+{
+  uint64_t bits = 0;
+  double d;
+
+  for (size_t i = 0; i < 8; i++)
+    bits |= ((uint64_t)r->ptr[i]) << (8 * i);
+  r->ptr += 8;
+  memcpy(&d, &bits, sizeof(d));
+  return d;
+} /* }}} double read_double */
+
+/* Appends the string field at "r" to "buffer", separated by a comma. */
+static void read_string(reader_t *r, char *buffer, size_t buffer_size) /* {{{ */
+{
+  reader_t s = read_message(r);
+  size_t fill = strlen(buffer);
+
+  snprintf(buffer + fill, buffer_size - fill, "%s%.*s",
+           (fill == 0) ? "" : ",", (int)(s.end - s.ptr), (char const *)s.ptr);
+} /* }}} void read_string */
+
+DEF_TEST(value_list) {
+  value_list_t vl = VALUE_LIST_INIT;
+  char buffer[1024];
+  size_t fill = 0;
+  size_t buffer_free = sizeof(buffer);
+
+  vl.values = (value_t[]){{.gauge = 4.5}, {.derive = -3}, {.counter = 300}};
+  vl.values_len = 3;
+  vl.time = MS_TO_CDTIME_T(1500000000250);
+  vl.interval = TIME_T_TO_CDTIME_T(10);
+  sstrncpy(vl.host, "example.com", sizeof(vl.host));
+  sstrncpy(vl.plugin, "test", sizeof(vl.plugin));
+  sstrncpy(vl.type, "test", sizeof(vl.type));
+  sstrncpy(vl.type_instance, "ti", sizeof(vl.type_instance));
+  CHECK_NOT_NULL(vl.meta = meta_data_create());
+  meta_data_add_string(vl.meta, "key", "value");
+  meta_data_add_signed_int(vl.meta, "int", -7);
+
+  /* Two value lists make a batch. */
+  for (int i = 0; i < 2; i++)
+    EXPECT_EQ_INT(0, format_protobuf_value_list(buffer, &fill, &buffer_free,
+                                                &ds_test, &vl, 0));
+  EXPECT_EQ_INT(sizeof(buffer), fill + buffer_free);
+
+  reader_t batch = {.ptr = (uint8_t const *)buffer,
+                    .end = (uint8_t const *)buffer + fill};
+  for (int i = 0; i < 2; i++) {
+    EXPECT_EQ_INT(0x0a, *(batch.ptr++));
+    reader_t msg = read_message(&batch);
+
+    double values[3] = {0};
+    size_t values_num = 0;
+    uint64_t time[2][2] = {{0}};
+    char identifier[256] = "";
+    char ds_names[256] = "";
+    char meta[256] = "";
+
+    while (msg.ptr < msg.end) {
+      uint8_t tag = *(msg.ptr++);
+      reader_t sub = read_message(&msg);
+
+      switch (tag) {
+      case 0x0a: { /* values */
+        uint8_t value_tag = *(sub.ptr++);
+        if (value_tag == 0x11)
+          values[values_num] = read_double(&sub);
+        else if (value_tag == 0x18)
+          values[values_num] = (double)(int64_t)read_varint(&sub);
+        else if (value_tag == 0x08)
+          values[values_num] = (double)read_varint(&sub);
+        values_num++;
+        break;
+      }
+      case 0x12: /* time */
+      case 0x1a: /* interval */
+        while (sub.ptr < sub.end) {
+          uint8_t field = *(sub.ptr++);
+          time[tag == 0x1a][field == 0x10] = read_varint(&sub);
+        }
+        break;
+      case 0x22: /* identifier */
+        while (sub.ptr < sub.end) {
+          sub.ptr++;
+          read_string(&sub, identifier, sizeof(identifier));
+        }
+        break;
+      case 0x2a: { /* ds_names */
+        size_t len = strlen(ds_names);
+        snprintf(ds_names + len, sizeof(ds_names) - len, "%s%.*s",
+                 (len == 0) ? "" : ",", (int)(sub.end - sub.ptr),
+                 (char const *)sub.ptr);
+        break;
+      }
+      case 0x32: { /* meta_data */
+        EXPECT_EQ_INT(0x0a, *(sub.ptr++));
+        read_string(&sub, meta, sizeof(meta));
+        EXPECT_EQ_INT(0x12, *(sub.ptr++));
+        reader_t value = read_message(&sub);
+        uint8_t value_tag = *(value.ptr++);
+        size_t len = strlen(meta);
+        if (value_tag == 0x0a) {
+          reader_t s = read_message(&value);
+          snprintf(meta + len, sizeof(meta) - len, "=%.*s",
+                   (int)(s.end - s.ptr), (char const *)s.ptr);
+        } else {
+          EXPECT_EQ_INT(0x10, value_tag);
+          snprintf(meta + len, sizeof(meta) - len, "=%" PRIi64,
+                   (int64_t)read_varint(&value));
+        }
+        break;
+      }
+      default:
+        printf("# unexpected tag %#x\n", tag);
+        return -1;
+      }
+    }
+
+    EXPECT_EQ_INT(3, values_num);
+    EXPECT_EQ_DOUBLE(4.5, values[0]);
+    EXPECT_EQ_DOUBLE(-3, values[1]);
+    EXPECT_EQ_DOUBLE(300, values[2]);
+    EXPECT_EQ_UINT64(1500000000, time[0][0]);
+    /* cdtime_t has a resolution of about one nanosecond. */
+    OK((time[0][1] >= 249999999) && (time[0][1] <= 250000001));
+    EXPECT_EQ_UINT64(10, time[1][0]);
+    EXPECT_EQ_UINT64(0, time[1][1]);
+    EXPECT_EQ_STR("example.com,test,test,ti", identifier);
+    EXPECT_EQ_STR("gauge,derive,counter", ds_names);
+    OK((strcmp("key=value,int=-7", meta) == 0) ||
+       (strcmp("int=-7,key=value", meta) == 0));
+  }
+  EXPECT_EQ_INT(fill, (size_t)(batch.ptr - (uint8_t const *)buffer));
+
+  /* Nothing is appended if the value list doesn't fit. */
+  size_t single = fill / 2;
+  fill = 0;
+  buffer_free = single - 1;
+  EXPECT_EQ_INT(-ENOMEM, format_protobuf_value_list(buffer, &fill,
+                                                    &buffer_free, &ds_test,
+                                                    &vl, 0));
+  EXPECT_EQ_INT(0, fill);
+  EXPECT_EQ_INT(single - 1, buffer_free);
+
+  meta_data_destroy(vl.meta);
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(value_list);
+
+  END_TEST;
+}
@@ -0,0 +1,595 @@
+/**
+ * collectd - src/utils_gorilla.c
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "common.h"
+#include "utils_gorilla.h"
+
+#include <sys/mman.h>
+
+/* Marks a data source which has no leading and trailing zero counts yet. */
+#define GORILLA_NO_WINDOW 0xff
+
+/* Upper bounds of the bits used by one sample. */
+#define GORILLA_TIME_BITS_MAX (4 + 64)
+#define GORILLA_VALUE_BITS_MAX (2 + 6 + 6 + 64)
+
+struct gorilla_segment_s {
+  uint8_t *map;
+  size_t size;
+  size_t pos;
+  uint64_t partition_start;
+  uint64_t partition_length;
+  _Bool failed;
+};
+
+/*
+ * Bit streams, most significant bit first.
+ */
+static int chunk_reserve(gorilla_chunk_t *c, size_t bits) /* {{{ */
+{
+  size_t need = (c->bits + bits + 7) / 8;
+  if (need <= c->data_size)
+    return 0;
+
+  size_t size = (c->data_size > 0) ? c->data_size : 64;
+  while (size < need)
+    size *= 2;
+
+  uint8_t *tmp = realloc(c->data, size);
+  if (tmp == NULL)
+    return ENOMEM;
+  /* Bits are ORed into the bytes, so new bytes have to be zero. */
+  memset(tmp + c->data_size, 0, size - c->data_size);
+  c->data = tmp;
+  c->data_size = size;
+  return 0;
+} /* }}} int chunk_reserve */
+
+/* Appends the lower `n' bits of `v'. Room must have been reserved. */
+static void chunk_put(gorilla_chunk_t *c, uint64_t v, unsigned n) /* {{{ */
+{
+  while (n > 0) {
+    unsigned offset = (unsigned)(c->bits % 8);
+    unsigned take = 8 - offset;
+    if (take > n)
+      take = n;
+
+    uint8_t part = (uint8_t)((v >> (n - take)) & ((1u << take) - 1));
+    c->data[c->bits / 8] |= (uint8_t)(part << (8 - offset - take));
+    c->bits += take;
+    n -= take;
+  }
+} /* }}} void chunk_put */
+
+static int decoder_get(gorilla_decoder_t *d, unsigned n, /* {{{ */
+                       uint64_t *ret) {
+  uint64_t v = 0;
+
+  if ((d->bits - d->pos) < n)
+    return EINVAL;
+
+  while (n > 0) {
+    unsigned offset = (unsigned)(d->pos % 8);
+    unsigned take = 8 - offset;
+    if (take > n)
+      take = n;
+
+    uint8_t part = (uint8_t)(d->data[d->pos / 8] >> (8 - offset - take));
+    v = (v << take) | (part & ((1u << take) - 1));
+    d->pos += take;
+    n -= take;
+  }
+
+  *ret = v;
+  return 0;
+} /* }}} int decoder_get */
+
+/*
+ * Chunks
+ */
+int gorilla_chunk_init(gorilla_chunk_t *c, size_t ds_num) /* {{{ */
+{
+  if ((c == NULL) || (ds_num == 0))
+    return EINVAL;
+
+  memset(c, 0, sizeof(*c));
+  c->ds = calloc(ds_num, sizeof(*c->ds));
+  if (c->ds == NULL)
+    return ENOMEM;
+  c->ds_num = ds_num;
+  return 0;
+} /* }}} int gorilla_chunk_init */
+
+void gorilla_chunk_reset(gorilla_chunk_t *c) /* {{{ */
+{
+  if (c->data != NULL)
+    memset(c->data, 0, (c->bits + 7) / 8);
+  c->bits = 0;
+  c->samples_num = 0;
+} /* }}} void gorilla_chunk_reset */
+
+void gorilla_chunk_destroy(gorilla_chunk_t *c) /* {{{ */
+{
+  if (c == NULL)
+    return;
+
+  sfree(c->data);
+  sfree(c->ds);
+  memset(c, 0, sizeof(*c));
+} /* }}} void gorilla_chunk_destroy */
+
+static void chunk_put_time(gorilla_chunk_t *c, uint64_t time) /* {{{ */
+{
+  int64_t delta = (int64_t)(time - c->time);
+  int64_t dod = delta - c->delta;
+
+  if (dod == 0)
+    chunk_put(c, 0, 1);
+  else if ((dod >= -63) && (dod <= 64)) {
+    chunk_put(c, 0x2, 2);
+    chunk_put(c, (uint64_t)(dod + 63), 7);
+  } else if ((dod >= -255) && (dod <= 256)) {
+    chunk_put(c, 0x6, 3);
+    chunk_put(c, (uint64_t)(dod + 255), 9);
+  } else if ((dod >= -2047) && (dod <= 2048)) {
+    chunk_put(c, 0xe, 4);
+    chunk_put(c, (uint64_t)(dod + 2047), 12);
+  } else {
+    chunk_put(c, 0xf, 4);
+    chunk_put(c, (uint64_t)dod, 64);
+  }
+
+  c->delta = delta;
+  c->time = time;
+} /* }}} void chunk_put_time */
+
+static void chunk_put_value(gorilla_chunk_t *c, /* {{{ */
+                            struct gorilla_ds_state_s *ds, uint64_t value) {
+  uint64_t xor = value ^ ds->value;
+
+  ds->value = value;
+  if (xor == 0) {
+    chunk_put(c, 0, 1);
+    return;
+  }
+
+  unsigned leading = (unsigned)__builtin_clzll(xor);
+  unsigned trailing = (unsigned)__builtin_ctzll(xor);
+
+  if ((ds->leading != GORILLA_NO_WINDOW) && (leading >= ds->leading) &&
+      (trailing >= ds->trailing)) {
+    /* The meaningful bits fit into the previous window. */
+    chunk_put(c, 0x2, 2);
+    chunk_put(c, xor >> ds->trailing, 64 - ds->leading - ds->trailing);
+    return;
+  }
+
+  unsigned len = 64 - leading - trailing;
+  chunk_put(c, 0x3, 2);
+  chunk_put(c, leading, 6);
+  chunk_put(c, len - 1, 6);
+  chunk_put(c, xor >> trailing, len);
+  ds->leading = (uint8_t)leading;
+  ds->trailing = (uint8_t)trailing;
+} /* }}} void chunk_put_value */
+
+int gorilla_chunk_append(gorilla_chunk_t *c, uint64_t time, /* {{{ */
+                         uint64_t const *values) {
+  if ((c == NULL) || (values == NULL))
+    return EINVAL;
+
+  if (chunk_reserve(c, GORILLA_TIME_BITS_MAX +
+                           c->ds_num * GORILLA_VALUE_BITS_MAX) != 0)
+    return ENOMEM;
+
+  if (c->samples_num == 0) {
+    chunk_put(c, time, 64);
+    c->first_time = time;
+    c->time = time;
+    c->delta = 0;
+    for (size_t i = 0; i < c->ds_num; i++) {
+      chunk_put(c, values[i], 64);
+      c->ds[i].value = values[i];
+      c->ds[i].leading = GORILLA_NO_WINDOW;
+      c->ds[i].trailing = 0;
+    }
+  } else {
+    chunk_put_time(c, time);
+    for (size_t i = 0; i < c->ds_num; i++)
+      chunk_put_value(c, c->ds + i, values[i]);
+  }
+
+  c->samples_num++;
+  return 0;
+} /* }}} int gorilla_chunk_append */
+
+size_t gorilla_chunk_size(gorilla_chunk_t const *c) /* {{{ */
+{
+  return (c->bits + 7) / 8;
+} /* }}} size_t gorilla_chunk_size */
+
+uint64_t gorilla_value_to_raw(value_t v, int ds_type) /* {{{ */
+{
+  uint64_t raw = 0;
+
+  switch (ds_type) {
+  case DS_TYPE_GAUGE:
+    memcpy(&raw, &v.gauge, sizeof(raw));
+    break;
+  case DS_TYPE_DERIVE:
+    raw = (uint64_t)v.derive;
+    break;
+  case DS_TYPE_COUNTER:
+    raw = (uint64_t)v.counter;
+    break;
+  case DS_TYPE_ABSOLUTE:
+    raw = (uint64_t)v.absolute;
+    break;
+  }
+
+  return raw;
+} /* }}} uint64_t gorilla_value_to_raw */
+
+value_t gorilla_raw_to_value(uint64_t raw, int ds_type) /* {{{ */
+{
+  value_t v = {0};
+
+  switch (ds_type) {
+  case DS_TYPE_GAUGE:
+    memcpy(&v.gauge, &raw, sizeof(raw));
+    break;
+  case DS_TYPE_DERIVE:
+    v.derive = (derive_t)raw;
+    break;
+  case DS_TYPE_COUNTER:
+    v.counter = (counter_t)raw;
+    break;
+  case DS_TYPE_ABSOLUTE:
+    v.absolute = (absolute_t)raw;
+    break;
+  }
+
+  return v;
+} /* }}} value_t gorilla_raw_to_value */
+
+/*
+ * Decoding
+ */
+int gorilla_decoder_init(gorilla_decoder_t *d, uint8_t const *data, /* {{{ */
+                         size_t data_size, size_t ds_num,
+                         size_t samples_num) {
+  if ((d == NULL) || ((data == NULL) && (data_size > 0)) || (ds_num == 0))
+    return EINVAL;
+
+  memset(d, 0, sizeof(*d));
+  d->ds = calloc(ds_num, sizeof(*d->ds));
+  if (d->ds == NULL)
+    return ENOMEM;
+
+  d->data = data;
+  d->bits = 8 * data_size;
+  d->ds_num = ds_num;
+  d->samples_left = samples_num;
+  return 0;
+} /* }}} int gorilla_decoder_init */
+
+static int decoder_get_time(gorilla_decoder_t *d) /* {{{ */
+{
+  /* The prefix is up to four one bits, terminated by a zero bit. */
+  static unsigned const widths[] = {0, 7, 9, 12, 64};
+  static int64_t const bias[] = {0, 63, 255, 2047, 0};
+  unsigned ones = 0;
+  uint64_t bit;
+  uint64_t v = 0;
+
+  while (ones < 4) {
+    if (decoder_get(d, 1, &bit) != 0)
+      return EINVAL;
+    if (bit == 0)
+      break;
+    ones++;
+  }
+
+  if ((widths[ones] > 0) && (decoder_get(d, widths[ones], &v) != 0))
+    return EINVAL;
+
+  int64_t dod = (int64_t)v - bias[ones];
+  d->delta += dod;
+  d->time += (uint64_t)d->delta;
+  return 0;
+} /* }}} int decoder_get_time */
+
+static int decoder_get_value(gorilla_decoder_t *d, /* {{{ */
+                             struct gorilla_ds_state_s *ds) {
+  uint64_t control;
+  uint64_t v;
+
+  if (decoder_get(d, 1, &control) != 0)
+    return EINVAL;
+  if (control == 0)
+    return 0;
+
+  if (decoder_get(d, 1, &control) != 0)
+    return EINVAL;
+
+  if (control == 1) {
+    uint64_t leading;
+    uint64_t len;
+
+    if ((decoder_get(d, 6, &leading) != 0) || (decoder_get(d, 6, &len) != 0))
+      return EINVAL;
+    len++;
+    if (leading + len > 64)
+      return EINVAL;
+    ds->leading = (uint8_t)leading;
+    ds->trailing = (uint8_t)(64 - leading - len);
+  } else if (ds->leading == GORILLA_NO_WINDOW) {
+    return EINVAL;
+  }
+
+  if (decoder_get(d, 64 - ds->leading - ds->trailing, &v) != 0)
+    return EINVAL;
+  ds->value ^= v << ds->trailing;
+  return 0;
+} /* }}} int decoder_get_value */
+
+int gorilla_decoder_next(gorilla_decoder_t *d, uint64_t *time, /* {{{ */
+                         uint64_t *values) {
+  if ((d == NULL) || (time == NULL) || (values == NULL))
+    return EINVAL;
+  if (d->samples_left == 0)
+    return ENOENT;
+
+  if (d->samples_done == 0) {
+    if (decoder_get(d, 64, &d->time) != 0)
+      return EINVAL;
+    for (size_t i = 0; i < d->ds_num; i++) {
+      if (decoder_get(d, 64, &d->ds[i].value) != 0)
+        return EINVAL;
+      d->ds[i].leading = GORILLA_NO_WINDOW;
+    }
+  } else {
+    if (decoder_get_time(d) != 0)
+      return EINVAL;
+    for (size_t i = 0; i < d->ds_num; i++)
+      if (decoder_get_value(d, d->ds + i) != 0)
+        return EINVAL;
+  }
+
+  *time = d->time;
+  for (size_t i = 0; i < d->ds_num; i++)
+    values[i] = d->ds[i].value;
+
+  d->samples_left--;
+  d->samples_done++;
+  return 0;
+} /* }}} int gorilla_decoder_next */
+
+void gorilla_decoder_destroy(gorilla_decoder_t *d) /* {{{ */
+{
+  if (d == NULL)
+    return;
+  sfree(d->ds);
+} /* }}} void gorilla_decoder_destroy */
+
+/*
+ * Segment files
+ */
+static void put_le(uint8_t *buffer, uint64_t v, size_t n) /* {{{ */
+{
+  for (size_t i = 0; i < n; i++)
+    buffer[i] = (uint8_t)(v >> (8 * i));
+} /* }}} void put_le */
+
+static uint64_t get_le(uint8_t const *buffer, size_t n) /* {{{ */
+{
+  uint64_t v = 0;
+  for (size_t i = 0; i < n; i++)
+    v |= ((uint64_t)buffer[i]) << (8 * i);
+  return v;
+} /* }}} uint64_t get_le */
+
+/* FNV-1a, to detect records which were only partially written. */
+static uint32_t record_checksum(uint8_t const *data, size_t size) /* {{{ */
+{
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < size; i++) {
+    hash ^= data[i];
+    hash *= 16777619u;
+  }
+  return hash;
+} /* }}} uint32_t record_checksum */
+
+void gorilla_segment_header(uint8_t *buffer, /* {{{ */
+                            uint64_t partition_start,
+                            uint64_t partition_length) {
+  memcpy(buffer, GORILLA_SEGMENT_MAGIC, 8);
+  put_le(buffer + 8, GORILLA_SEGMENT_VERSION, 4);
+  put_le(buffer + 12, GORILLA_SEGMENT_HEADER_SIZE, 4);
+  put_le(buffer + 16, partition_start, 8);
+  put_le(buffer + 24, partition_length, 8);
+} /* }}} void gorilla_segment_header */
+
+size_t gorilla_record_size(size_t name_len, /* {{{ */
+                           gorilla_chunk_t const *c) {
+  return GORILLA_RECORD_HEADER_SIZE + 2 + name_len + 2 + c->ds_num + 4 + 4 +
+         gorilla_chunk_size(c);
+} /* }}} size_t gorilla_record_size */
+
+size_t gorilla_record_write(uint8_t *buffer, char const *name, /* {{{ */
+                            size_t name_len, int const *ds_types,
+                            gorilla_chunk_t const *c) {
+  size_t data_size = gorilla_chunk_size(c);
+  size_t size = gorilla_record_size(name_len, c);
+  uint8_t *ptr = buffer + GORILLA_RECORD_HEADER_SIZE;
+
+  put_le(ptr, name_len, 2);
+  ptr += 2;
+  memcpy(ptr, name, name_len);
+  ptr += name_len;
+  put_le(ptr, c->ds_num, 2);
+  ptr += 2;
+  for (size_t i = 0; i < c->ds_num; i++)
+    *(ptr++) = (uint8_t)ds_types[i];
+  put_le(ptr, c->samples_num, 4);
+  ptr += 4;
+  put_le(ptr, data_size, 4);
+  ptr += 4;
+  if (data_size > 0)
+    memcpy(ptr, c->data, data_size);
+
+  uint8_t *payload = buffer + GORILLA_RECORD_HEADER_SIZE;
+  size_t payload_size = size - GORILLA_RECORD_HEADER_SIZE;
+  put_le(buffer, GORILLA_RECORD_MAGIC, 4);
+  put_le(buffer + 4, payload_size, 4);
+  put_le(buffer + 8, record_checksum(payload, payload_size), 4);
+
+  return size;
+} /* }}} size_t gorilla_record_write */
+
+gorilla_segment_t *gorilla_segment_open(char const *path) /* {{{ */
+{
+  struct stat statbuf;
+
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return NULL;
+
+  if (fstat(fd, &statbuf) != 0) {
+    int status = errno;
+    close(fd);
+    errno = status;
+    return NULL;
+  }
+  if (statbuf.st_size < GORILLA_SEGMENT_HEADER_SIZE) {
+    close(fd);
+    errno = EINVAL;
+    return NULL;
+  }
+
+  size_t size = (size_t)statbuf.st_size;
+  void *map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  int status = errno;
+  close(fd);
+  if (map == MAP_FAILED) {
+    errno = status;
+    return NULL;
+  }
+
+  gorilla_segment_t *s = calloc(1, sizeof(*s));
+  if (s == NULL) {
+    munmap(map, size);
+    errno = ENOMEM;
+    return NULL;
+  }
+  s->map = map;
+  s->size = size;
+
+  if ((memcmp(s->map, GORILLA_SEGMENT_MAGIC, 8) != 0) ||
+      (get_le(s->map + 8, 4) != GORILLA_SEGMENT_VERSION) ||
+      (get_le(s->map + 12, 4) < GORILLA_SEGMENT_HEADER_SIZE) ||
+      (get_le(s->map + 12, 4) > size)) {
+    gorilla_segment_close(s);
+    errno = EINVAL;
+    return NULL;
+  }
+
+  s->pos = (size_t)get_le(s->map + 12, 4);
+  s->partition_start = get_le(s->map + 16, 8);
+  s->partition_length = get_le(s->map + 24, 8);
+  return s;
+} /* }}} gorilla_segment_t *gorilla_segment_open */
+
+void gorilla_segment_partition(gorilla_segment_t const *s, /* {{{ */
+                               uint64_t *partition_start,
+                               uint64_t *partition_length) {
+  *partition_start = s->partition_start;
+  *partition_length = s->partition_length;
+} /* }}} void gorilla_segment_partition */
+
+int gorilla_segment_next(gorilla_segment_t *s, gorilla_record_t *r) /* {{{ */
+{
+  if ((s == NULL) || (r == NULL))
+    return EINVAL;
+  if (s->failed)
+    return EINVAL;
+  if (s->pos == s->size)
+    return ENOENT;
+
+  s->failed = 1;
+
+  size_t left = s->size - s->pos;
+  uint8_t const *ptr = s->map + s->pos;
+  if ((left < GORILLA_RECORD_HEADER_SIZE) ||
+      (get_le(ptr, 4) != GORILLA_RECORD_MAGIC))
+    return EINVAL;
+
+  size_t payload_size = (size_t)get_le(ptr + 4, 4);
+  if (payload_size > left - GORILLA_RECORD_HEADER_SIZE)
+    return EINVAL;
+
+  uint8_t const *payload = ptr + GORILLA_RECORD_HEADER_SIZE;
+  if (get_le(ptr + 8, 4) != record_checksum(payload, payload_size))
+    return EINVAL;
+
+  /* The fixed size fields come to 12 bytes beside the name, data source types
+   * and data. */
+  size_t pos = 0;
+  if (payload_size < 12)
+    return EINVAL;
+  r->name_len = (size_t)get_le(payload, 2);
+  pos = 2;
+  if (r->name_len > payload_size - 12)
+    return EINVAL;
+  r->name = (char const *)(payload + pos);
+  pos += r->name_len;
+
+  r->ds_num = (size_t)get_le(payload + pos, 2);
+  pos += 2;
+  if (r->ds_num > payload_size - pos - 8)
+    return EINVAL;
+  r->ds_types = payload + pos;
+  pos += r->ds_num;
+
+  r->samples_num = (size_t)get_le(payload + pos, 4);
+  r->data_size = (size_t)get_le(payload + pos + 4, 4);
+  pos += 8;
+  if (r->data_size != payload_size - pos)
+    return EINVAL;
+  r->data = payload + pos;
+
+  s->pos += GORILLA_RECORD_HEADER_SIZE + payload_size;
+  s->failed = 0;
+  return 0;
+} /* }}} int gorilla_segment_next */
+
+void gorilla_segment_close(gorilla_segment_t *s) /* {{{ */
+{
+  if (s == NULL)
+    return;
+
+  munmap(s->map, s->size);
+  sfree(s);
+} /* }}} void gorilla_segment_close */
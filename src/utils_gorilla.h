@@ -0,0 +1,226 @@
+/**
+ * collectd - src/utils_gorilla.h
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef UTILS_GORILLA_H
+#define UTILS_GORILLA_H 1
+
+#include "collectd.h"
+
+#include "plugin.h" /* for DS_TYPE_* */
+
+/*
+ * Chunks hold the samples of one series in the compressed format described in
+ * "Gorilla: A Fast, Scalable, In-Memory Time Series Database" (Pelkonen et
+ * al., 2015): timestamps as delta-of-delta, values as the XOR with their
+ * predecessor. Timestamps are milliseconds. Values are the raw 64 bits of the
+ * value_t member, so integers are stored exactly.
+ *
+ * Segment files are a header followed by records, each of which holds one
+ * chunk and the name and data source types of its series. All integers are
+ * little endian.
+ */
+
+#define GORILLA_SEGMENT_MAGIC "CDGORSEG"
+#define GORILLA_SEGMENT_VERSION 1
+#define GORILLA_SEGMENT_HEADER_SIZE 32
+#define GORILLA_RECORD_MAGIC 0x4b4e4843 /* "CHNK" */
+#define GORILLA_RECORD_HEADER_SIZE 12
+
+struct gorilla_ds_state_s {
+  uint64_t value;
+  uint8_t leading;
+  uint8_t trailing;
+};
+
+struct gorilla_chunk_s {
+  uint8_t *data;
+  size_t data_size;
+  size_t bits;
+  size_t samples_num;
+  size_t ds_num;
+  uint64_t first_time;
+  uint64_t time;
+  int64_t delta;
+  struct gorilla_ds_state_s *ds;
+};
+typedef struct gorilla_chunk_s gorilla_chunk_t;
+
+struct gorilla_decoder_s {
+  uint8_t const *data;
+  size_t bits;
+  size_t pos;
+  size_t samples_left;
+  size_t samples_done;
+  size_t ds_num;
+  uint64_t time;
+  int64_t delta;
+  struct gorilla_ds_state_s *ds;
+};
+typedef struct gorilla_decoder_s gorilla_decoder_t;
+
+/* A record found by gorilla_segment_next(). The pointers refer to the mapped
+ * segment and are valid until gorilla_segment_close(). The name isn't null
+ * terminated. */
+struct gorilla_record_s {
+  char const *name;
+  size_t name_len;
+  uint8_t const *ds_types;
+  size_t ds_num;
+  size_t samples_num;
+  uint8_t const *data;
+  size_t data_size;
+};
+typedef struct gorilla_record_s gorilla_record_t;
+
+struct gorilla_segment_s;
+typedef struct gorilla_segment_s gorilla_segment_t;
+
+/*
+ * NAME
+ *   gorilla_chunk_init
+ *
+ * DESCRIPTION
+ *   Initializes an empty chunk for samples with `ds_num' values.
+ *
+ * RETURN VALUE
+ *   Zero upon success or an errno value upon failure.
+ */
+int gorilla_chunk_init(gorilla_chunk_t *c, size_t ds_num);
+
+/* Removes all samples but keeps the memory. */
+void gorilla_chunk_reset(gorilla_chunk_t *c);
+
+void gorilla_chunk_destroy(gorilla_chunk_t *c);
+
+/*
+ * NAME
+ *   gorilla_chunk_append
+ *
+ * DESCRIPTION
+ *   Appends a sample. `values' holds `ds_num' raw values, see
+ *   gorilla_value_to_raw().
+ *
+ * RETURN VALUE
+ *   Zero upon success or ENOMEM. The chunk is unchanged upon failure.
+ */
+int gorilla_chunk_append(gorilla_chunk_t *c, uint64_t time,
+                         uint64_t const *values);
+
+/* Returns the number of bytes used by the chunk's data. */
+size_t gorilla_chunk_size(gorilla_chunk_t const *c);
+
+uint64_t gorilla_value_to_raw(value_t v, int ds_type);
+value_t gorilla_raw_to_value(uint64_t raw, int ds_type);
+
+/*
+ * NAME
+ *   gorilla_decoder_init
+ *
+ * DESCRIPTION
+ *   Prepares decoding `samples_num' samples with `ds_num' values each from
+ *   `data'. gorilla_decoder_destroy() must be called afterwards.
+ *
+ * RETURN VALUE
+ *   Zero upon success or an errno value upon failure.
+ */
+int gorilla_decoder_init(gorilla_decoder_t *d, uint8_t const *data,
+                         size_t data_size, size_t ds_num, size_t samples_num);
+
+/*
+ * NAME
+ *   gorilla_decoder_next
+ *
+ * DESCRIPTION
+ *   Decodes the next sample into `time' and `values', which has room for
+ *   `ds_num' raw values.
+ *
+ * RETURN VALUE
+ *   Zero upon success, ENOENT after the last sample and EINVAL if the data is
+ *   truncated.
+ */
+int gorilla_decoder_next(gorilla_decoder_t *d, uint64_t *time,
+                         uint64_t *values);
+
+void gorilla_decoder_destroy(gorilla_decoder_t *d);
+
+/* Writes the segment file header to `buffer', which must have room for
+ * GORILLA_SEGMENT_HEADER_SIZE bytes. */
+void gorilla_segment_header(uint8_t *buffer, uint64_t partition_start,
+                            uint64_t partition_length);
+
+/* Returns the size of the record for a chunk of a series called `name'. */
+size_t gorilla_record_size(size_t name_len, gorilla_chunk_t const *c);
+
+/*
+ * NAME
+ *   gorilla_record_write
+ *
+ * DESCRIPTION
+ *   Writes the record of chunk `c' to `buffer', which must have room for
+ *   gorilla_record_size() bytes. `ds_types' holds the chunk's ds_num data
+ *   source types.
+ *
+ * RETURN VALUE
+ *   The number of bytes written.
+ */
+size_t gorilla_record_write(uint8_t *buffer, char const *name,
+                            size_t name_len, int const *ds_types,
+                            gorilla_chunk_t const *c);
+
+/*
+ * NAME
+ *   gorilla_segment_open
+ *
+ * DESCRIPTION
+ *   Maps a segment file into memory for reading. The file may be appended to
+ *   by the writer at the same time; records written after the file was
+ *   opened are not seen.
+ *
+ * RETURN VALUE
+ *   A gorilla_segment_t-pointer upon success or NULL upon failure, in which
+ *   case errno is set.
+ */
+gorilla_segment_t *gorilla_segment_open(char const *path);
+
+/* Returns the partition of the segment as given to gorilla_segment_header. */
+void gorilla_segment_partition(gorilla_segment_t const *s,
+                               uint64_t *partition_start,
+                               uint64_t *partition_length);
+
+/*
+ * NAME
+ *   gorilla_segment_next
+ *
+ * DESCRIPTION
+ *   Returns the next record of the segment.
+ *
+ * RETURN VALUE
+ *   Zero upon success, ENOENT after the last record and EINVAL if the next
+ *   record is damaged, e.g. because it was only partially written. No more
+ *   records are returned after an error.
+ */
+int gorilla_segment_next(gorilla_segment_t *s, gorilla_record_t *r);
+
+void gorilla_segment_close(gorilla_segment_t *s);
+
+#endif /* UTILS_GORILLA_H */
@@ -0,0 +1,175 @@
+/**
+ * collectd - src/utils_gorilla_test.c
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "common.h"
+#include "testing.h"
+#include "utils_gorilla.h"
+
+#define SAMPLES_NUM 1000
+
+static uint64_t sample_time(size_t i) {
+  /* Ten second steps with a few milliseconds of jitter and one long gap. */
+  uint64_t t = 1500000000000ULL + 10000 * i + (i * 7919) % 5;
+  if (i >= SAMPLES_NUM / 2)
+    t += 86400000ULL;
+  return t;
+}
+
+static void sample_values(size_t i, uint64_t values[3]) {
+  values[0] = gorilla_value_to_raw((value_t){.gauge = 20.0 + (i % 17) * 0.25},
+                                   DS_TYPE_GAUGE);
+  values[1] = gorilla_value_to_raw(
+      (value_t){.derive = (derive_t)(1000 * i) - 5000}, DS_TYPE_DERIVE);
+  /* NAN, infinities and repeated values. */
+  gauge_t g = (i % 100 == 0) ? NAN : (i % 101 == 0) ? -INFINITY : i / 10;
+  values[2] = gorilla_value_to_raw((value_t){.gauge = g}, DS_TYPE_GAUGE);
+}
+
+DEF_TEST(chunk) {
+  gorilla_chunk_t c;
+  gorilla_decoder_t d;
+  uint64_t values[3];
+  uint64_t got[3];
+  uint64_t time;
+
+  CHECK_ZERO(gorilla_chunk_init(&c, 3));
+  for (size_t i = 0; i < SAMPLES_NUM; i++) {
+    sample_values(i, values);
+    CHECK_ZERO(gorilla_chunk_append(&c, sample_time(i), values));
+  }
+  EXPECT_EQ_UINT64(SAMPLES_NUM, c.samples_num);
+  /* Uncompressed, a sample takes 32 bytes. */
+  OK(gorilla_chunk_size(&c) < SAMPLES_NUM * 32 / 3);
+
+  /* Every sample is restored bit for bit. */
+  CHECK_ZERO(gorilla_decoder_init(&d, c.data, gorilla_chunk_size(&c), 3,
+                                  SAMPLES_NUM));
+  int errors = 0;
+  for (size_t i = 0; i < SAMPLES_NUM; i++) {
+    sample_values(i, values);
+    if ((gorilla_decoder_next(&d, &time, got) != 0) ||
+        (time != sample_time(i)) || (memcmp(values, got, sizeof(got)) != 0))
+      errors++;
+  }
+  EXPECT_EQ_INT(0, errors);
+  EXPECT_EQ_INT(ENOENT, gorilla_decoder_next(&d, &time, got));
+  gorilla_decoder_destroy(&d);
+
+  /* Truncated data is detected. */
+  CHECK_ZERO(gorilla_decoder_init(&d, c.data, gorilla_chunk_size(&c) / 2, 3,
+                                  SAMPLES_NUM));
+  int status;
+  while ((status = gorilla_decoder_next(&d, &time, got)) == 0)
+    ;
+  EXPECT_EQ_INT(EINVAL, status);
+  gorilla_decoder_destroy(&d);
+
+  /* A reset chunk starts over. */
+  gorilla_chunk_reset(&c);
+  sample_values(1, values);
+  CHECK_ZERO(gorilla_chunk_append(&c, 42, values));
+  CHECK_ZERO(gorilla_decoder_init(&d, c.data, gorilla_chunk_size(&c), 3, 1));
+  CHECK_ZERO(gorilla_decoder_next(&d, &time, got));
+  EXPECT_EQ_UINT64(42, time);
+  EXPECT_EQ_UINT64(values[1], got[1]);
+  gorilla_decoder_destroy(&d);
+
+  gorilla_chunk_destroy(&c);
+  return 0;
+}
+
+DEF_TEST(segment) {
+  char path[] = "/tmp/collectd-gorilla-test-XXXXXX";
+  int ds_types[] = {DS_TYPE_COUNTER};
+  gorilla_chunk_t c;
+  uint8_t header[GORILLA_SEGMENT_HEADER_SIZE];
+
+  int fd = mkstemp(path);
+  OK(fd >= 0);
+
+  gorilla_segment_header(header, 7200000, 3600000);
+  OK(write(fd, header, sizeof(header)) == sizeof(header));
+
+  CHECK_ZERO(gorilla_chunk_init(&c, 1));
+  for (uint64_t i = 0; i < 3; i++) {
+    uint64_t v = 10 * i;
+    CHECK_ZERO(gorilla_chunk_append(&c, 7200000 + 10000 * i, &v));
+  }
+  size_t size = gorilla_record_size(strlen("host/plugin/type"), &c);
+  uint8_t *record = malloc(size);
+  CHECK_NOT_NULL(record);
+  EXPECT_EQ_UINT64(size, gorilla_record_write(record, "host/plugin/type",
+                                              strlen("host/plugin/type"),
+                                              ds_types, &c));
+  OK(write(fd, record, size) == (ssize_t)size);
+  /* A partially written record at the end. */
+  OK(write(fd, record, size - 1) == (ssize_t)(size - 1));
+  close(fd);
+
+  gorilla_segment_t *s = gorilla_segment_open(path);
+  CHECK_NOT_NULL(s);
+
+  uint64_t start;
+  uint64_t length;
+  gorilla_segment_partition(s, &start, &length);
+  EXPECT_EQ_UINT64(7200000, start);
+  EXPECT_EQ_UINT64(3600000, length);
+
+  gorilla_record_t r;
+  CHECK_ZERO(gorilla_segment_next(s, &r));
+  EXPECT_EQ_INT(16, (int)r.name_len);
+  OK(memcmp("host/plugin/type", r.name, r.name_len) == 0);
+  EXPECT_EQ_INT(1, (int)r.ds_num);
+  EXPECT_EQ_INT(DS_TYPE_COUNTER, r.ds_types[0]);
+  EXPECT_EQ_INT(3, (int)r.samples_num);
+
+  gorilla_decoder_t d;
+  uint64_t time;
+  uint64_t v;
+  CHECK_ZERO(gorilla_decoder_init(&d, r.data, r.data_size, r.ds_num,
+                                  r.samples_num));
+  for (uint64_t i = 0; i < 3; i++) {
+    CHECK_ZERO(gorilla_decoder_next(&d, &time, &v));
+    EXPECT_EQ_UINT64(7200000 + 10000 * i, time);
+    EXPECT_EQ_UINT64(10 * i,
+                     gorilla_raw_to_value(v, DS_TYPE_COUNTER).counter);
+  }
+  gorilla_decoder_destroy(&d);
+
+  EXPECT_EQ_INT(EINVAL, gorilla_segment_next(s, &r));
+  gorilla_segment_close(s);
+
+  sfree(record);
+  gorilla_chunk_destroy(&c);
+  unlink(path);
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(chunk);
+  RUN_TEST(segment);
+
+  END_TEST;
+}
@@ -56,39 +56,210 @@
 #include "plugin.h"
 #include "utils_ignorelist.h"
 
+/*
+ * Literal entries are kept in a hash set, so matching them costs one hash
+ * lookup regardless of the list size. Regular expressions are combined into
+ * a single alternation which is compiled lazily, and the outcome of matching
+ * a name against them is memoized, because the same names are matched again
+ * in every interval.
+ */
+#define IGNORELIST_HASH_MIN_SIZE 16
+/* Upper bound on memoized names; the memo is flushed when it is reached, e.g.
+ * on hosts where interface names are generated continuously. */
+#define IGNORELIST_MEMO_MAX 16384
+
 /*
  * private prototypes
  */
-struct ignorelist_item_s {
-#if HAVE_REGEX_H
-  regex_t *rmatch; /* regular expression entry identification */
-#endif
-  char *smatch; /* string entry identification */
-  struct ignorelist_item_s *next;
+struct ignorelist_slot_s {
+  char *key;
+  uint32_t hash;
+  int value;
+};
+typedef struct ignorelist_slot_s ignorelist_slot_t;
+
+/* open addressing hash table with linear probing */
+struct ignorelist_hash_s {
+  ignorelist_slot_t *slots;
+  size_t size; /* number of slots, always a power of two */
+  size_t used; /* number of occupied slots */
 };
-typedef struct ignorelist_item_s ignorelist_item_t;
+typedef struct ignorelist_hash_s ignorelist_hash_t;
 
 struct ignorelist_s {
-  int ignore;              /* ignore entries */
-  ignorelist_item_t *head; /* pointer to the first entry */
+  int ignore;                /* ignore entries */
+  ignorelist_hash_t strings; /* string entries */
+#if HAVE_REGEX_H
+  char **re_strings;  /* regular expression entries, as configured */
+  regex_t **re_items; /* compiled regular expression entries */
+  size_t re_num;
+  regex_t *re_combined; /* all entries in one regex, NULL if unavailable */
+  _Bool re_combined_done;
+  ignorelist_hash_t memo; /* name -> result of matching the regexes */
+  pthread_mutex_t lock;   /* protects re_combined and memo */
+#endif
 };
 
 /* *** *** *** ********************************************* *** *** *** */
 /* *** *** *** *** *** ***   private functions   *** *** *** *** *** *** */
 /* *** *** *** ********************************************* *** *** *** */
 
-static inline void ignorelist_append(ignorelist_t *il,
-                                     ignorelist_item_t *item) {
-  assert((il != NULL) && (item != NULL));
+/* FNV-1a */
+static uint32_t ignorelist_hash_string(const char *str) {
+  uint32_t hash = 2166136261U;
+
+  for (const unsigned char *ptr = (const unsigned char *)str; *ptr != 0;
+       ptr++) {
+    hash ^= *ptr;
+    hash *= 16777619U;
+  }
+
+  return hash;
+} /* uint32_t ignorelist_hash_string */
+
+static ignorelist_slot_t *ignorelist_hash_lookup(ignorelist_hash_t *h,
+                                                 const char *key,
+                                                 uint32_t hash) {
+  if (h->size == 0)
+    return NULL;
+
+  for (size_t i = hash & (h->size - 1);; i = (i + 1) & (h->size - 1)) {
+    ignorelist_slot_t *slot = h->slots + i;
+
+    if (slot->key == NULL)
+      return NULL;
+    if ((slot->hash == hash) && (strcmp(slot->key, key) == 0))
+      return slot;
+  }
+} /* ignorelist_slot_t *ignorelist_hash_lookup */
+
+/* Places `key' into the first free slot. The key must not be in the table
+ * yet and the table must have at least one free slot. */
+static void ignorelist_hash_place(ignorelist_hash_t *h, char *key,
+                                  uint32_t hash, int value) {
+  size_t i = hash & (h->size - 1);
+
+  while (h->slots[i].key != NULL)
+    i = (i + 1) & (h->size - 1);
+
+  h->slots[i] = (ignorelist_slot_t){.key = key, .hash = hash, .value = value};
+  h->used++;
+} /* void ignorelist_hash_place */
+
+static int ignorelist_hash_grow(ignorelist_hash_t *h) {
+  ignorelist_hash_t new = {0};
+
+  new.size = (h->size == 0) ? IGNORELIST_HASH_MIN_SIZE : 2 * h->size;
+  new.slots = calloc(new.size, sizeof(*new.slots));
+  if (new.slots == NULL)
+    return ENOMEM;
+
+  for (size_t i = 0; i < h->size; i++)
+    if (h->slots[i].key != NULL)
+      ignorelist_hash_place(&new, h->slots[i].key, h->slots[i].hash,
+                            h->slots[i].value);
+
+  sfree(h->slots);
+  *h = new;
+  return 0;
+} /* int ignorelist_hash_grow */
+
+/* Inserts a copy of `key'. Inserting a key which is already present is not
+ * an error; its value is left unchanged. */
+static int ignorelist_hash_insert(ignorelist_hash_t *h, const char *key,
+                                  uint32_t hash, int value) {
+  char *copy;
+
+  if (ignorelist_hash_lookup(h, key, hash) != NULL)
+    return 0;
 
-  item->next = il->head;
-  il->head = item;
-}
+  /* keep the load factor below 3/4 */
+  if (4 * (h->used + 1) > 3 * h->size) {
+    int status = ignorelist_hash_grow(h);
+    if (status != 0)
+      return status;
+  }
+
+  copy = strdup(key);
+  if (copy == NULL)
+    return ENOMEM;
+
+  ignorelist_hash_place(h, copy, hash, value);
+  return 0;
+} /* int ignorelist_hash_insert */
+
+static void ignorelist_hash_clear(ignorelist_hash_t *h) {
+  for (size_t i = 0; i < h->size; i++)
+    sfree(h->slots[i].key);
+  sfree(h->slots);
+  h->size = 0;
+  h->used = 0;
+} /* void ignorelist_hash_clear */
 
 #if HAVE_REGEX_H
+static void ignorelist_reset_combined(ignorelist_t *il) {
+  if (il->re_combined != NULL) {
+    regfree(il->re_combined);
+    sfree(il->re_combined);
+  }
+  il->re_combined_done = 0;
+  ignorelist_hash_clear(&il->memo);
+} /* void ignorelist_reset_combined */
+
+/* Compiles "(re_1)|(re_2)|...", so that a name is matched against all
+ * regular expressions in one pass. Expressions with back-references cannot
+ * be combined, because the alternation renumbers the subexpressions; if
+ * there are any, or the combined expression does not compile, the entries
+ * are matched one by one. */
+static void ignorelist_compile_combined(ignorelist_t *il) {
+  size_t size = 1;
+  char *str;
+  regex_t *re;
+
+  il->re_combined_done = 1;
+
+  if (il->re_num < 2)
+    return;
+
+  for (size_t i = 0; i < il->re_num; i++) {
+    for (const char *ptr = il->re_strings[i]; *ptr != 0; ptr++)
+      if ((ptr[0] == '\\') && isdigit((unsigned char)ptr[1]))
+        return;
+    size += strlen(il->re_strings[i]) + strlen("()|");
+  }
+
+  str = malloc(size);
+  re = calloc(1, sizeof(*re));
+  if ((str == NULL) || (re == NULL)) {
+    sfree(str);
+    sfree(re);
+    return;
+  }
+
+  str[0] = 0;
+  for (size_t i = 0; i < il->re_num; i++) {
+    if (i != 0)
+      strcat(str, "|");
+    strcat(str, "(");
+    strcat(str, il->re_strings[i]);
+    strcat(str, ")");
+  }
+
+  if (regcomp(re, str, REG_EXTENDED | REG_NOSUB) != 0) {
+    DEBUG("utils_ignorelist: Combining %zu regular expressions failed; "
+          "matching them one by one.",
+          il->re_num);
+    sfree(re);
+  } else {
+    il->re_combined = re;
+  }
+
+  sfree(str);
+} /* void ignorelist_compile_combined */
+
 static int ignorelist_append_regex(ignorelist_t *il, const char *re_str) {
   regex_t *re;
-  ignorelist_item_t *entry;
+  char *copy;
   int status;
 
   re = calloc(1, sizeof(*re));
@@ -109,66 +280,80 @@ static int ignorelist_append_regex(ignorelist_t *il, const char *re_str) {
     return status;
   }
 
-  entry = calloc(1, sizeof(*entry));
-  if (entry == NULL) {
-    ERROR("ignorelist_append_regex: calloc failed.");
+  copy = strdup(re_str);
+  regex_t **items = realloc(il->re_items, (il->re_num + 1) * sizeof(*items));
+  if (items != NULL)
+    il->re_items = items;
+  char **strings =
+      realloc(il->re_strings, (il->re_num + 1) * sizeof(*strings));
+  if (strings != NULL)
+    il->re_strings = strings;
+  if ((copy == NULL) || (items == NULL) || (strings == NULL)) {
+    ERROR("ignorelist_append_regex: realloc failed.");
+    sfree(copy);
     regfree(re);
     sfree(re);
     return ENOMEM;
   }
-  entry->rmatch = re;
 
-  ignorelist_append(il, entry);
-  return 0;
-} /* int ignorelist_append_regex */
-#endif
-
-static int ignorelist_append_string(ignorelist_t *il, const char *entry) {
-  ignorelist_item_t *new;
-
-  /* create new entry */
-  if ((new = calloc(1, sizeof(*new))) == NULL) {
-    ERROR("cannot allocate new entry");
-    return 1;
-  }
-  new->smatch = sstrdup(entry);
-
-  /* append new entry */
-  ignorelist_append(il, new);
+  pthread_mutex_lock(&il->lock);
+  il->re_items[il->re_num] = re;
+  il->re_strings[il->re_num] = copy;
+  il->re_num++;
+  ignorelist_reset_combined(il);
+  pthread_mutex_unlock(&il->lock);
 
   return 0;
-} /* int ignorelist_append_string(ignorelist_t *il, const char *entry) */
+} /* int ignorelist_append_regex */
 
-#if HAVE_REGEX_H
 /*
  * check list for entry regex match
  * return 1 if found
+ * must be called with il->lock held
  */
-static int ignorelist_match_regex(ignorelist_item_t *item, const char *entry) {
-  assert((item != NULL) && (item->rmatch != NULL) && (entry != NULL) &&
-         (strlen(entry) > 0));
+static int ignorelist_match_regex(ignorelist_t *il, const char *entry,
+                                  uint32_t hash) {
+  ignorelist_slot_t *slot;
+  int matched = 0;
+
+  assert((il != NULL) && (entry != NULL) && (strlen(entry) > 0));
+
+  slot = ignorelist_hash_lookup(&il->memo, entry, hash);
+  if (slot != NULL)
+    return slot->value;
+
+  if (!il->re_combined_done)
+    ignorelist_compile_combined(il);
+
+  if (il->re_combined != NULL) {
+    matched = (regexec(il->re_combined, entry, 0, NULL, 0) == 0);
+  } else {
+    for (size_t i = 0; i < il->re_num; i++) {
+      if (regexec(il->re_items[i], entry, 0, NULL, 0) == 0) {
+        matched = 1;
+        break;
+      }
+    }
+  }
 
-  /* match regex */
-  if (regexec(item->rmatch, entry, 0, NULL, 0) == 0)
-    return 1;
+  if (il->memo.used >= IGNORELIST_MEMO_MAX)
+    ignorelist_hash_clear(&il->memo);
+  /* failing to memoize is harmless: the regexes are evaluated again */
+  (void)ignorelist_hash_insert(&il->memo, entry, hash, matched);
 
-  return 0;
-} /* int ignorelist_match_regex (ignorelist_item_t *item, const char *entry) */
+  return matched;
+} /* int ignorelist_match_regex */
 #endif
 
-/*
- * check list for entry string match
- * return 1 if found
- */
-static int ignorelist_match_string(ignorelist_item_t *item, const char *entry) {
-  assert((item != NULL) && (item->smatch != NULL) && (entry != NULL) &&
-         (strlen(entry) > 0));
-
-  if (strcmp(entry, item->smatch) == 0)
+static int ignorelist_append_string(ignorelist_t *il, const char *entry) {
+  if (ignorelist_hash_insert(&il->strings, entry,
+                             ignorelist_hash_string(entry), 1) != 0) {
+    ERROR("cannot allocate new entry");
     return 1;
+  }
 
   return 0;
-} /* int ignorelist_match_string (ignorelist_item_t *item, const char *entry) */
+} /* int ignorelist_append_string(ignorelist_t *il, const char *entry) */
 
 /* *** *** *** ******************************************** *** *** *** */
 /* *** *** *** *** *** ***   public functions   *** *** *** *** *** *** */
@@ -190,6 +375,9 @@ ignorelist_t *ignorelist_create(int invert) {
    * ->ignore == 1  =>  ignore
    */
   il->ignore = invert ? 0 : 1;
+#if HAVE_REGEX_H
+  pthread_mutex_init(&il->lock, /* attr = */ NULL);
+#endif
 
   return il;
 } /* ignorelist_t *ignorelist_create (int ignore) */
@@ -198,27 +386,22 @@ ignorelist_t *ignorelist_create(int invert) {
  * free memory used by ignorelist_t
  */
 void ignorelist_free(ignorelist_t *il) {
-  ignorelist_item_t *this;
-  ignorelist_item_t *next;
-
   if (il == NULL)
     return;
 
-  for (this = il->head; this != NULL; this = next) {
-    next = this->next;
+  ignorelist_hash_clear(&il->strings);
+
 #if HAVE_REGEX_H
-    if (this->rmatch != NULL) {
-      regfree(this->rmatch);
-      sfree(this->rmatch);
-      this->rmatch = NULL;
-    }
-#endif
-    if (this->smatch != NULL) {
-      sfree(this->smatch);
-      this->smatch = NULL;
-    }
-    sfree(this);
+  ignorelist_reset_combined(il);
+  for (size_t i = 0; i < il->re_num; i++) {
+    regfree(il->re_items[i]);
+    sfree(il->re_items[i]);
+    sfree(il->re_strings[i]);
   }
+  sfree(il->re_items);
+  sfree(il->re_strings);
+  pthread_mutex_destroy(&il->lock);
+#endif
 
   sfree(il);
 } /* void ignorelist_destroy (ignorelist_t *il) */
@@ -283,27 +466,38 @@ int ignorelist_add(ignorelist_t *il, const char *entry) {
  * return 1 for ignored entry
  */
 int ignorelist_match(ignorelist_t *il, const char *entry) {
+  uint32_t hash;
+  size_t re_num = 0;
+
+  if (il == NULL)
+    return 0;
+#if HAVE_REGEX_H
+  re_num = il->re_num;
+#endif
+
   /* if no entries, collect all */
-  if ((il == NULL) || (il->head == NULL))
+  if ((il->strings.used == 0) && (re_num == 0))
     return 0;
 
   if ((entry == NULL) || (strlen(entry) == 0))
     return 0;
 
-  /* traverse list and check entries */
-  for (ignorelist_item_t *traverse = il->head; traverse != NULL;
-       traverse = traverse->next) {
+  hash = ignorelist_hash_string(entry);
+  if (ignorelist_hash_lookup(&il->strings, entry, hash) != NULL)
+    return il->ignore;
+
 #if HAVE_REGEX_H
-    if (traverse->rmatch != NULL) {
-      if (ignorelist_match_regex(traverse, entry))
-        return il->ignore;
-    } else
+  if (re_num > 0) {
+    int matched;
+
+    pthread_mutex_lock(&il->lock);
+    matched = ignorelist_match_regex(il, entry, hash);
+    pthread_mutex_unlock(&il->lock);
+
+    if (matched)
+      return il->ignore;
+  }
 #endif
-    {
-      if (ignorelist_match_string(traverse, entry))
-        return il->ignore;
-    }
-  } /* for traverse */
 
   return 1 - il->ignore;
 } /* int ignorelist_match (ignorelist_t *il, const char *entry) */
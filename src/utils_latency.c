@@ -42,6 +42,12 @@
 #define HISTOGRAM_DEFAULT_BIN_WIDTH 1048576
 #endif
 
+#ifndef SKETCH_BITS
+/* 2^7 = 128 bins per power of two, i.e. a relative bin width of < 0.8% */
+#define SKETCH_BITS 7
+#endif
+#define SKETCH_SUB_BINS (((size_t)1) << SKETCH_BITS)
+
 struct latency_counter_s {
   cdtime_t start_time;
 
@@ -51,8 +57,17 @@ struct latency_counter_s {
   cdtime_t min;
   cdtime_t max;
 
+  _Bool sketch;
+
+  /* Linear histogram: HISTOGRAM_NUM_BINS bins of bin_width each. */
   cdtime_t bin_width;
-  int histogram[HISTOGRAM_NUM_BINS];
+
+  /* Log-linear histogram: histogram[i] counts the values of sketch bin
+   * (histogram_offset + i), see below. */
+  size_t histogram_offset;
+
+  size_t histogram_num;
+  int *histogram;
 };
 
 /*
@@ -72,19 +87,8 @@ struct latency_counter_s {
 * So, if the required bin width is 300, then new bin width will be 512 as it is
 * the next nearest power of 2.
 */
-static void change_bin_width(latency_counter_t *lc, cdtime_t latency) /* {{{ */
+static void rebin(latency_counter_t *lc, cdtime_t new_bin_width) /* {{{ */
 {
-  /* This function is called because the new value is above histogram's range.
-   * First find the required bin width:
-   *           requiredBinWidth = (value + 1) / numBins
-   * then get the next nearest power of 2
-   *           newBinWidth = 2^(ceil(log2(requiredBinWidth)))
-   */
-  double required_bin_width =
-      ((double)(latency + 1)) / ((double)HISTOGRAM_NUM_BINS);
-  double required_bin_width_logbase2 = log(required_bin_width) / log(2.0);
-  cdtime_t new_bin_width =
-      (cdtime_t)(pow(2.0, ceil(required_bin_width_logbase2)) + .5);
   cdtime_t old_bin_width = lc->bin_width;
 
   lc->bin_width = new_bin_width;
@@ -106,14 +110,98 @@ static void change_bin_width(latency_counter_t *lc, cdtime_t latency) /* {{{ */
       lc->histogram[i] = 0;
     }
   }
+} /* }}} void rebin */
+
+static void change_bin_width(latency_counter_t *lc, cdtime_t latency) /* {{{ */
+{
+  /* This function is called because the new value is above histogram's range.
+   * First find the required bin width:
+   *           requiredBinWidth = (value + 1) / numBins
+   * then get the next nearest power of 2
+   *           newBinWidth = 2^(ceil(log2(requiredBinWidth)))
+   */
+  double required_bin_width =
+      ((double)(latency + 1)) / ((double)HISTOGRAM_NUM_BINS);
+  double required_bin_width_logbase2 = log(required_bin_width) / log(2.0);
+  cdtime_t new_bin_width =
+      (cdtime_t)(pow(2.0, ceil(required_bin_width_logbase2)) + .5);
 
   DEBUG("utils_latency: change_bin_width: latency = %.3f; "
         "old_bin_width = %.3f; new_bin_width = %.3f;",
-        CDTIME_T_TO_DOUBLE(latency), CDTIME_T_TO_DOUBLE(old_bin_width),
+        CDTIME_T_TO_DOUBLE(latency), CDTIME_T_TO_DOUBLE(lc->bin_width),
         CDTIME_T_TO_DOUBLE(new_bin_width));
+
+  rebin(lc, new_bin_width);
 } /* }}} void change_bin_width */
 
-latency_counter_t *latency_counter_create(void) /* {{{ */
+/*
+ * The log-linear histogram ("sketch") splits every power of two into
+ * SKETCH_SUB_BINS bins of equal width, like HdrHistogram does. Values below
+ * SKETCH_SUB_BINS get a bin of their own. A value v >= SKETCH_SUB_BINS with its
+ * highest bit set at position m lands in the bins of the (m - SKETCH_BITS + 1)th
+ * power of two, which are 2^(m - SKETCH_BITS) wide. A bin is therefore never
+ * wider than 1/SKETCH_SUB_BINS of the values it holds, independent of their
+ * magnitude, and finding the bin only takes a few bit operations.
+ *
+ * Only the range of bins between the smallest and the largest value seen is
+ * allocated. Two sketches can be merged by adding their bins.
+ */
+static size_t sketch_bin(cdtime_t latency) /* {{{ */
+{
+  if (latency < SKETCH_SUB_BINS)
+    return (size_t)latency;
+
+  int shift = 63 - __builtin_clzll(latency) - SKETCH_BITS;
+  return ((size_t)shift + 1) * SKETCH_SUB_BINS +
+         (size_t)((latency >> shift) - SKETCH_SUB_BINS);
+} /* }}} size_t sketch_bin */
+
+/* Returns the smallest value in sketch bin "bin". */
+static cdtime_t sketch_bin_lower(size_t bin) /* {{{ */
+{
+  if (bin < SKETCH_SUB_BINS)
+    return (cdtime_t)bin;
+
+  size_t shift = bin / SKETCH_SUB_BINS - 1;
+  return ((cdtime_t)(SKETCH_SUB_BINS + bin % SKETCH_SUB_BINS)) << shift;
+} /* }}} cdtime_t sketch_bin_lower */
+
+/* Makes sure sketch bins "first" to "last" are allocated. The allocated range
+ * is aligned to full powers of two to avoid frequent reallocations. */
+static int sketch_reserve(latency_counter_t *lc, size_t first, /* {{{ */
+                          size_t last) {
+  size_t histogram_end = lc->histogram_offset + lc->histogram_num;
+
+  if ((lc->histogram_num > 0) && (first >= lc->histogram_offset) &&
+      (last < histogram_end))
+    return 0;
+
+  if (lc->histogram_num > 0) {
+    if (first > lc->histogram_offset)
+      first = lc->histogram_offset;
+    if (last < histogram_end - 1)
+      last = histogram_end - 1;
+  }
+  first -= first % SKETCH_SUB_BINS;
+  last += SKETCH_SUB_BINS - 1 - (last % SKETCH_SUB_BINS);
+
+  size_t num = last - first + 1;
+  int *histogram = calloc(num, sizeof(*histogram));
+  if (histogram == NULL)
+    return ENOMEM;
+
+  if (lc->histogram_num > 0)
+    memcpy(histogram + (lc->histogram_offset - first), lc->histogram,
+           lc->histogram_num * sizeof(*histogram));
+
+  sfree(lc->histogram);
+  lc->histogram = histogram;
+  lc->histogram_offset = first;
+  lc->histogram_num = num;
+  return 0;
+} /* }}} int sketch_reserve */
+
+static latency_counter_t *latency_counter_alloc(_Bool sketch) /* {{{ */
 {
   latency_counter_t *lc;
 
@@ -121,13 +209,37 @@ latency_counter_t *latency_counter_create(void) /* {{{ */
   if (lc == NULL)
     return NULL;
 
+  lc->sketch = sketch;
+  if (!sketch) {
+    lc->histogram = calloc(HISTOGRAM_NUM_BINS, sizeof(*lc->histogram));
+    if (lc->histogram == NULL) {
+      sfree(lc);
+      return NULL;
+    }
+    lc->histogram_num = HISTOGRAM_NUM_BINS;
+  }
+
   lc->bin_width = HISTOGRAM_DEFAULT_BIN_WIDTH;
   latency_counter_reset(lc);
   return lc;
+} /* }}} latency_counter_t *latency_counter_alloc */
+
+latency_counter_t *latency_counter_create(void) /* {{{ */
+{
+  return latency_counter_alloc(/* sketch = */ 0);
 } /* }}} latency_counter_t *latency_counter_create */
 
+latency_counter_t *latency_counter_create_sketch(void) /* {{{ */
+{
+  return latency_counter_alloc(/* sketch = */ 1);
+} /* }}} latency_counter_t *latency_counter_create_sketch */
+
 void latency_counter_destroy(latency_counter_t *lc) /* {{{ */
 {
+  if (lc == NULL)
+    return;
+
+  sfree(lc->histogram);
   sfree(lc);
 } /* }}} void latency_counter_destroy */
 
@@ -138,6 +250,14 @@ void latency_counter_add(latency_counter_t *lc, cdtime_t latency) /* {{{ */
   if ((lc == NULL) || (latency == 0) || (latency > ((cdtime_t)LLONG_MAX)))
     return;
 
+  if (lc->sketch) {
+    bin = sketch_bin(latency);
+    if (sketch_reserve(lc, bin, bin) != 0) {
+      ERROR("utils_latency: latency_counter_add: sketch_reserve failed.");
+      return;
+    }
+  }
+
   lc->sum += latency;
   lc->num++;
 
@@ -148,6 +268,11 @@ void latency_counter_add(latency_counter_t *lc, cdtime_t latency) /* {{{ */
   if (lc->max < latency)
     lc->max = latency;
 
+  if (lc->sketch) {
+    lc->histogram[bin - lc->histogram_offset]++;
+    return;
+  }
+
   /* A latency of _exactly_ 1.0 ms is stored in the buffer 0, so
    * subtract one from the cdtime_t value so that exactly 1.0 ms get sorted
    * accordingly. */
@@ -168,6 +293,18 @@ void latency_counter_reset(latency_counter_t *lc) /* {{{ */
   if (lc == NULL)
     return;
 
+  /* The sketch keeps its allocated bins, the next interval is likely to see
+   * values of the same magnitude. */
+  if (lc->sketch) {
+    memset(lc->histogram, 0, lc->histogram_num * sizeof(*lc->histogram));
+    lc->sum = 0;
+    lc->num = 0;
+    lc->min = 0;
+    lc->max = 0;
+    lc->start_time = cdtime();
+    return;
+  }
+
   cdtime_t bin_width = lc->bin_width;
   cdtime_t max_bin = (lc->max - 1) / lc->bin_width;
 
@@ -188,7 +325,11 @@ void latency_counter_reset(latency_counter_t *lc) /* {{{ */
           CDTIME_T_TO_DOUBLE(lc->bin_width), CDTIME_T_TO_DOUBLE(bin_width));
   }
 
-  memset(lc, 0, sizeof(*lc));
+  memset(lc->histogram, 0, HISTOGRAM_NUM_BINS * sizeof(*lc->histogram));
+  lc->sum = 0;
+  lc->num = 0;
+  lc->min = 0;
+  lc->max = 0;
 
   /* preserve bin width */
   lc->bin_width = bin_width;
@@ -234,6 +375,38 @@ cdtime_t latency_counter_get_average(latency_counter_t *lc) /* {{{ */
   return DOUBLE_TO_CDTIME_T(average);
 } /* }}} cdtime_t latency_counter_get_average */
 
+static cdtime_t sketch_get_percentile(latency_counter_t *lc, /* {{{ */
+                                      double percent) {
+  /* Number of values less than or equal to the percentile. */
+  double rank = percent * ((double)lc->num) / 100.0;
+  double sum = 0;
+
+  for (size_t i = 0; i < lc->histogram_num; i++) {
+    if (lc->histogram[i] == 0)
+      continue;
+
+    double sum_before = sum;
+    sum += lc->histogram[i];
+    if (sum < rank)
+      continue;
+
+    /* Interpolate linearly within the bin and stay within the values actually
+     * seen. */
+    cdtime_t lower = sketch_bin_lower(lc->histogram_offset + i);
+    cdtime_t upper = sketch_bin_lower(lc->histogram_offset + i + 1);
+    double p = (rank - sum_before) / ((double)lc->histogram[i]);
+    cdtime_t latency = lower + (cdtime_t)(p * ((double)(upper - lower)));
+
+    if (latency < lc->min)
+      latency = lc->min;
+    if (latency > lc->max)
+      latency = lc->max;
+    return latency;
+  }
+
+  return lc->max;
+} /* }}} cdtime_t sketch_get_percentile */
+
 cdtime_t latency_counter_get_percentile(latency_counter_t *lc, /* {{{ */
                                         double percent) {
   double percent_upper;
@@ -247,6 +420,9 @@ cdtime_t latency_counter_get_percentile(latency_counter_t *lc, /* {{{ */
   if ((lc == NULL) || (lc->num == 0) || !((percent > 0.0) && (percent < 100.0)))
     return 0;
 
+  if (lc->sketch)
+    return sketch_get_percentile(lc, percent);
+
   /* Find index i so that at least "percent" events are within i+1 ms. */
   percent_upper = 0.0;
   percent_lower = 0.0;
@@ -283,6 +459,34 @@ cdtime_t latency_counter_get_percentile(latency_counter_t *lc, /* {{{ */
   return latency_interpolated;
 } /* }}} cdtime_t latency_counter_get_percentile */
 
+/* Returns the (approximate) number of values in (lower, upper]. Bins that are
+ * only partially covered are counted proportionally. */
+static double sketch_get_count(const latency_counter_t *lc, /* {{{ */
+                               cdtime_t lower, cdtime_t upper) {
+  double sum = 0;
+
+  for (size_t i = 0; i < lc->histogram_num; i++) {
+    if (lc->histogram[i] == 0)
+      continue;
+
+    /* The bin holds the values in [bin_lower, bin_upper). */
+    cdtime_t bin_lower = sketch_bin_lower(lc->histogram_offset + i);
+    cdtime_t bin_upper = sketch_bin_lower(lc->histogram_offset + i + 1);
+
+    cdtime_t from = (bin_lower > lower) ? bin_lower : lower + 1;
+    cdtime_t to = bin_upper;
+    if (upper && (upper + 1 < to))
+      to = upper + 1;
+    if (to <= from)
+      continue;
+
+    sum += ((double)lc->histogram[i]) * ((double)(to - from)) /
+           ((double)(bin_upper - bin_lower));
+  }
+
+  return sum;
+} /* }}} double sketch_get_count */
+
 double latency_counter_get_rate(const latency_counter_t *lc, /* {{{ */
                                 cdtime_t lower, cdtime_t upper,
                                 const cdtime_t now) {
@@ -294,6 +498,10 @@ double latency_counter_get_rate(const latency_counter_t *lc, /* {{{ */
   if (lower == upper)
     return 0;
 
+  if (lc->sketch)
+    return sketch_get_count(lc, lower, upper) /
+           (CDTIME_T_TO_DOUBLE(now - lc->start_time));
+
   /* Buckets have an exclusive lower bound and an inclusive upper bound. That
    * means that the first bucket, index 0, represents (0-bin_width]. That means
    * that latency==bin_width needs to result in bin=0, that's why we need to
@@ -342,3 +550,45 @@ double latency_counter_get_rate(const latency_counter_t *lc, /* {{{ */
 
   return sum / (CDTIME_T_TO_DOUBLE(now - lc->start_time));
 } /* }}} double latency_counter_get_rate */
+
+int latency_counter_merge(latency_counter_t *dst, /* {{{ */
+                          const latency_counter_t *src) {
+  if ((dst == NULL) || (src == NULL) || (dst->sketch != src->sketch))
+    return EINVAL;
+
+  if (src->num == 0)
+    return 0;
+
+  if (dst->sketch) {
+    int status =
+        sketch_reserve(dst, src->histogram_offset,
+                       src->histogram_offset + src->histogram_num - 1);
+    if (status != 0)
+      return status;
+
+    for (size_t i = 0; i < src->histogram_num; i++)
+      dst->histogram[src->histogram_offset - dst->histogram_offset + i] +=
+          src->histogram[i];
+  } else {
+    /* Bin widths are powers of two, so every bin of the narrower histogram
+     * maps to exactly one bin of the wider one. */
+    if (dst->bin_width < src->bin_width)
+      rebin(dst, src->bin_width);
+
+    for (size_t i = 0; i < HISTOGRAM_NUM_BINS; i++) {
+      size_t bin = (size_t)((i * src->bin_width) / dst->bin_width);
+      dst->histogram[bin] += src->histogram[i];
+    }
+  }
+
+  if ((dst->num == 0) || (dst->min > src->min))
+    dst->min = src->min;
+  if (dst->max < src->max)
+    dst->max = src->max;
+  if (dst->start_time > src->start_time)
+    dst->start_time = src->start_time;
+  dst->sum += src->sum;
+  dst->num += src->num;
+
+  return 0;
+} /* }}} int latency_counter_merge */
@@ -36,6 +36,10 @@ struct latency_counter_s;
 typedef struct latency_counter_s latency_counter_t;
 
 latency_counter_t *latency_counter_create(void);
+/* Creates a counter backed by a log-linear histogram: the relative error of
+ * percentiles is bounded by 1/128 regardless of the magnitude of the values,
+ * adding a value takes constant time and counters can be merged. */
+latency_counter_t *latency_counter_create_sketch(void);
 void latency_counter_destroy(latency_counter_t *lc);
 
 void latency_counter_add(latency_counter_t *lc, cdtime_t latency);
@@ -61,3 +65,14 @@ cdtime_t latency_counter_get_percentile(latency_counter_t *lc, double percent);
  */
 double latency_counter_get_rate(const latency_counter_t *lc, cdtime_t lower,
                                 cdtime_t upper, const cdtime_t now);
+
+/*
+ * NAME
+ *  latency_counter_merge(dst,src)
+ *
+ * DESCRIPTION
+ *   Adds all values of "src" to "dst". Both counters must have been created by
+ *   the same function. Returns zero on success, EINVAL if the counters are of
+ *   different kinds and ENOMEM if memory allocation fails.
+ */
+int latency_counter_merge(latency_counter_t *dst, const latency_counter_t *src);
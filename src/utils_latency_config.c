@@ -94,6 +94,28 @@ static int latency_config_add_bucket(latency_config_t *conf, oconfig_item_t *ci,
   return 0;
 } /* int latency_config_add_bucket */
 
+static int latency_config_histogram(latency_config_t *conf, oconfig_item_t *ci,
+                                    const char *plugin) {
+  if ((ci->values_num != 1) || (ci->values[0].type != OCONFIG_TYPE_STRING)) {
+    ERROR("%s plugin: \"%s\" requires exactly one string argument.", plugin,
+          ci->key);
+    return EINVAL;
+  }
+
+  if (strcasecmp("Linear", ci->values[0].value.string) == 0)
+    conf->sketch = 0;
+  else if (strcasecmp("LogLinear", ci->values[0].value.string) == 0)
+    conf->sketch = 1;
+  else {
+    ERROR("%s plugin: Invalid argument for \"%s\": \"%s\". Valid arguments "
+          "are \"Linear\" and \"LogLinear\".",
+          plugin, ci->key, ci->values[0].value.string);
+    return EINVAL;
+  }
+
+  return 0;
+} /* int latency_config_histogram */
+
 int latency_config(latency_config_t *conf, oconfig_item_t *ci,
                    char const *plugin) {
   int status = 0;
@@ -107,6 +129,8 @@ int latency_config(latency_config_t *conf, oconfig_item_t *ci,
       status = latency_config_add_bucket(conf, child, plugin);
     else if (strcasecmp("BucketType", child->key) == 0)
       status = cf_util_get_string(child, &conf->bucket_type);
+    else if (strcasecmp("Histogram", child->key) == 0)
+      status = latency_config_histogram(conf, child, plugin);
     else
       WARNING("%s plugin: \"%s\" is not a valid option within a \"%s\" block.",
               plugin, child->key, ci->key);
@@ -128,7 +152,9 @@ int latency_config(latency_config_t *conf, oconfig_item_t *ci,
 
 int latency_config_copy(latency_config_t *dst, const latency_config_t src) {
   *dst = (latency_config_t){
-      .percentile_num = src.percentile_num, .buckets_num = src.buckets_num,
+      .percentile_num = src.percentile_num,
+      .buckets_num = src.buckets_num,
+      .sketch = src.sketch,
   };
 
   dst->percentile = calloc(dst->percentile_num, sizeof(*dst->percentile));
@@ -46,6 +46,9 @@ typedef struct {
   size_t buckets_num;
   char *bucket_type;
 
+  /* Use a log-linear histogram, see latency_counter_create_sketch(). */
+  _Bool sketch;
+
   /*
   _Bool lower;
   _Bool upper;
@@ -109,8 +109,11 @@ DEF_TEST(get_rate) {
     size_t num;
     cdtime_t min;
     cdtime_t max;
+    _Bool sketch;
     cdtime_t bin_width;
-    int histogram[HISTOGRAM_NUM_BINS];
+    size_t histogram_offset;
+    size_t histogram_num;
+    int *histogram;
   } * peek;
   latency_counter_t *l;
 
@@ -225,10 +228,102 @@ DEF_TEST(get_rate) {
   return 0;
 }
 
+DEF_TEST(sketch_percentile) {
+  latency_counter_t *l;
+
+  CHECK_NOT_NULL(l = latency_counter_create_sketch());
+
+  /* One very large value must not cost the small ones their precision. */
+  for (size_t i = 0; i < 99; i++) {
+    latency_counter_add(l, MS_TO_CDTIME_T(((uint64_t)i) + 1));
+  }
+  latency_counter_add(l, TIME_T_TO_CDTIME_T(3600));
+
+  EXPECT_EQ_DOUBLE(0.001, CDTIME_T_TO_DOUBLE(latency_counter_get_min(l)));
+  EXPECT_EQ_DOUBLE(3600.0, CDTIME_T_TO_DOUBLE(latency_counter_get_max(l)));
+  EXPECT_EQ_UINT64(100, latency_counter_get_num(l));
+
+  double percents[] = {1.0, 10.0, 50.0, 80.0, 95.0, 99.0};
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(percents); i++) {
+    double want = percents[i] / 1000.0;
+    double got = CDTIME_T_TO_DOUBLE(latency_counter_get_percentile(l, percents[i]));
+    printf("# percentile %g: want %g, got %g\n", percents[i], want, got);
+    OK(fabs(got - want) <= want / 128.0);
+  }
+  EXPECT_EQ_DOUBLE(3600.0,
+                   CDTIME_T_TO_DOUBLE(latency_counter_get_percentile(l, 99.9)));
+
+  /* Rates over bin boundaries are exact. start_time is the first member of
+   * the counter. */
+  cdtime_t now = *((cdtime_t *)l) + TIME_T_TO_CDTIME_T(1);
+  EXPECT_EQ_DOUBLE(99.0,
+                   latency_counter_get_rate(l, 0, TIME_T_TO_CDTIME_T(1), now));
+  EXPECT_EQ_DOUBLE(1.0,
+                   latency_counter_get_rate(l, TIME_T_TO_CDTIME_T(1), 0, now));
+
+  /* Allocated bins are kept on reset. */
+  latency_counter_reset(l);
+  EXPECT_EQ_UINT64(0, latency_counter_get_num(l));
+  CHECK_ZERO(latency_counter_get_percentile(l, 50.0));
+
+  latency_counter_destroy(l);
+  return 0;
+}
+
+DEF_TEST(merge) {
+  latency_counter_t *a;
+  latency_counter_t *b;
+  latency_counter_t *linear;
+
+  CHECK_NOT_NULL(a = latency_counter_create_sketch());
+  CHECK_NOT_NULL(b = latency_counter_create_sketch());
+  CHECK_NOT_NULL(linear = latency_counter_create());
+
+  for (time_t i = 1; i <= 50; i++) {
+    latency_counter_add(a, TIME_T_TO_CDTIME_T(i));
+    latency_counter_add(b, TIME_T_TO_CDTIME_T(i + 50));
+  }
+
+  EXPECT_EQ_INT(EINVAL, latency_counter_merge(a, linear));
+  CHECK_ZERO(latency_counter_merge(a, b));
+
+  EXPECT_EQ_UINT64(100, latency_counter_get_num(a));
+  EXPECT_EQ_DOUBLE(1.0, CDTIME_T_TO_DOUBLE(latency_counter_get_min(a)));
+  EXPECT_EQ_DOUBLE(100.0, CDTIME_T_TO_DOUBLE(latency_counter_get_max(a)));
+  EXPECT_EQ_DOUBLE(100.0 * 101.0 / 2.0,
+                   CDTIME_T_TO_DOUBLE(latency_counter_get_sum(a)));
+
+  double got = CDTIME_T_TO_DOUBLE(latency_counter_get_percentile(a, 80.0));
+  OK(fabs(got - 80.0) <= 80.0 / 128.0);
+
+  /* Linear histograms with different bin widths can be merged, too. */
+  latency_counter_t *small;
+  CHECK_NOT_NULL(small = latency_counter_create());
+  for (time_t i = 1; i <= 100; i++) {
+    latency_counter_add(linear, TIME_T_TO_CDTIME_T(i));
+  }
+  latency_counter_add(small, DOUBLE_TO_CDTIME_T(0.5));
+
+  CHECK_ZERO(latency_counter_merge(small, linear));
+  EXPECT_EQ_UINT64(101, latency_counter_get_num(small));
+  EXPECT_EQ_DOUBLE(0.5, CDTIME_T_TO_DOUBLE(latency_counter_get_min(small)));
+  /* Within one bin of the wider histogram, i.e. 0.125 seconds. */
+  got = CDTIME_T_TO_DOUBLE(latency_counter_get_percentile(small, 50.0));
+  OK(fabs(got - 50.0) <= 0.125);
+
+  latency_counter_destroy(small);
+  latency_counter_destroy(linear);
+  latency_counter_destroy(b);
+  latency_counter_destroy(a);
+  return 0;
+}
+
 int main(void) {
   RUN_TEST(simple);
   RUN_TEST(percentile);
   RUN_TEST(get_rate);
+  RUN_TEST(sketch_percentile);
+  RUN_TEST(merge);
 
   END_TEST;
 }
@@ -40,6 +40,7 @@ struct cu_match_s {
   regex_t regex;
   regex_t excluderegex;
   int flags;
+  char *regex_str;
 
   int (*callback)(const char *str, char *const *matches, size_t matches_num,
                   void *user_data);
@@ -47,6 +48,25 @@ struct cu_match_s {
   void (*free)(void *user_data);
 };
 
+/* A node of a match set covers the matches [begin, end). Inner nodes hold the
+ * alternation of their matches' regular expressions. The nodes are stored
+ * like a binary heap: the children of node i are 2i+1 and 2i+2. */
+struct cu_match_set_node_s {
+  regex_t regex;
+  _Bool have_regex; /* if not, the children are always looked at */
+  size_t begin;
+  size_t end;
+};
+typedef struct cu_match_set_node_s cu_match_set_node_t;
+
+struct cu_match_set_s {
+  cu_match_t **matches;
+  size_t matches_num;
+
+  cu_match_set_node_t *nodes;
+  size_t nodes_num;
+};
+
 /*
  * Private functions
  */
@@ -237,11 +257,20 @@ match_create_callback(const char *regex, const char *excluderegex,
   }
   obj->flags |= UTILS_MATCH_FLAGS_REGEX;
 
+  obj->regex_str = strdup(regex);
+  if (obj->regex_str == NULL) {
+    regfree(&obj->regex);
+    sfree(obj);
+    return NULL;
+  }
+
   if (excluderegex && strcmp(excluderegex, "") != 0) {
     status = regcomp(&obj->excluderegex, excluderegex, REG_EXTENDED);
     if (status != 0) {
       ERROR("Compiling the excluding regular expression \"%s\" failed.",
             excluderegex);
+      regfree(&obj->regex);
+      sfree(obj->regex_str);
       sfree(obj);
       return NULL;
     }
@@ -267,9 +296,12 @@ cu_match_t *match_create_simple(const char *regex, const char *excluderegex,
 
   if ((match_ds_type & UTILS_MATCH_DS_TYPE_GAUGE) &&
       (match_ds_type & UTILS_MATCH_CF_GAUGE_DIST)) {
-    user_data->latency = latency_counter_create();
+    if (match_ds_type & UTILS_MATCH_CF_GAUGE_DIST_SKETCH)
+      user_data->latency = latency_counter_create_sketch();
+    else
+      user_data->latency = latency_counter_create();
     if (user_data->latency == NULL) {
-      ERROR("match_create_simple(): latency_counter_create() failed.");
+      ERROR("match_create_simple(): Creating the latency counter failed.");
       free(user_data);
       return NULL;
     }
@@ -310,6 +342,7 @@ void match_destroy(cu_match_t *obj) {
   if ((obj->user_data != NULL) && (obj->free != NULL))
     (*obj->free)(obj->user_data);
 
+  sfree(obj->regex_str);
   sfree(obj);
 } /* void match_destroy */
 
@@ -374,3 +407,131 @@ void *match_get_user_data(cu_match_t *obj) {
     return NULL;
   return obj->user_data;
 } /* void *match_get_user_data */
+
+/* Compiles the alternation of the regular expressions of matches [begin, end)
+ * into "node". Back-references would refer to the wrong group once the
+ * expressions are combined, so nodes covering one are left without a regex. */
+static void match_set_node_init(cu_match_set_t *set, /* {{{ */
+                                cu_match_set_node_t *node, size_t begin,
+                                size_t end) {
+  size_t len = 0;
+
+  node->begin = begin;
+  node->end = end;
+  node->have_regex = 0;
+
+  for (size_t i = begin; i < end; i++) {
+    char const *re = set->matches[i]->regex_str;
+    for (char const *c = strchr(re, '\\'); c != NULL;
+         c = strchr(c + 2, '\\')) {
+      if (isdigit((unsigned char)c[1]))
+        return;
+      if (c[1] == 0)
+        break;
+    }
+    len += strlen(re) + strlen("()|");
+  }
+
+  char *combined = malloc(len + 1);
+  if (combined == NULL)
+    return;
+
+  size_t offset = 0;
+  for (size_t i = begin; i < end; i++)
+    offset += (size_t)snprintf(combined + offset, len + 1 - offset, "%s(%s)",
+                               (i == begin) ? "" : "|",
+                               set->matches[i]->regex_str);
+
+  int status = regcomp(&node->regex, combined,
+                       REG_EXTENDED | REG_NEWLINE | REG_NOSUB);
+  if (status == 0)
+    node->have_regex = 1;
+  else
+    DEBUG("utils_match: match_set_node_init: Compiling \"%s\" failed.",
+          combined);
+
+  sfree(combined);
+} /* }}} void match_set_node_init */
+
+static void match_set_build(cu_match_set_t *set, size_t idx, /* {{{ */
+                            size_t begin, size_t end) {
+  /* Leaves are handled by match_apply() directly. */
+  if (end - begin < 2)
+    return;
+
+  match_set_node_init(set, &set->nodes[idx], begin, end);
+
+  size_t mid = begin + (end - begin) / 2;
+  match_set_build(set, 2 * idx + 1, begin, mid);
+  match_set_build(set, 2 * idx + 2, mid, end);
+} /* }}} void match_set_build */
+
+static int match_set_apply_node(cu_match_set_t *set, size_t idx, /* {{{ */
+                                size_t begin, size_t end, const char *str) {
+  if (end - begin == 1)
+    return (match_apply(set->matches[begin], str) != 0) ? 1 : 0;
+
+  cu_match_set_node_t *node = &set->nodes[idx];
+  if (node->have_regex &&
+      (regexec(&node->regex, str, /* nmatch = */ 0, /* pmatch = */ NULL,
+               /* eflags = */ 0) != 0))
+    return 0;
+
+  size_t mid = begin + (end - begin) / 2;
+  return match_set_apply_node(set, 2 * idx + 1, begin, mid, str) +
+         match_set_apply_node(set, 2 * idx + 2, mid, end, str);
+} /* }}} int match_set_apply_node */
+
+cu_match_set_t *match_set_create(cu_match_t *const *matches, /* {{{ */
+                                 size_t matches_num) {
+  cu_match_set_t *set = calloc(1, sizeof(*set));
+  if (set == NULL)
+    return NULL;
+
+  set->matches = calloc(matches_num + 1, sizeof(*set->matches));
+  if (set->matches == NULL) {
+    sfree(set);
+    return NULL;
+  }
+  memcpy(set->matches, matches, matches_num * sizeof(*matches));
+  set->matches_num = matches_num;
+
+  /* A tree over n leaves needs at most 4n heap slots. */
+  set->nodes_num = 4 * matches_num;
+  if (set->nodes_num > 0) {
+    set->nodes = calloc(set->nodes_num, sizeof(*set->nodes));
+    if (set->nodes == NULL) {
+      sfree(set->matches);
+      sfree(set);
+      return NULL;
+    }
+    match_set_build(set, 0, 0, matches_num);
+  }
+
+  return set;
+} /* }}} cu_match_set_t *match_set_create */
+
+void match_set_destroy(cu_match_set_t *set) /* {{{ */
+{
+  if (set == NULL)
+    return;
+
+  for (size_t i = 0; i < set->nodes_num; i++)
+    if (set->nodes[i].have_regex)
+      regfree(&set->nodes[i].regex);
+
+  sfree(set->nodes);
+  sfree(set->matches);
+  sfree(set);
+} /* }}} void match_set_destroy */
+
+int match_set_apply(cu_match_set_t *set, const char *str) /* {{{ */
+{
+  if ((set == NULL) || (str == NULL))
+    return -1;
+
+  if (set->matches_num == 0)
+    return 0;
+
+  return match_set_apply_node(set, 0, 0, set->matches_num, str);
+} /* }}} int match_set_apply */
@@ -49,6 +49,8 @@
 #define UTILS_MATCH_CF_GAUGE_ADD 0x20
 #define UTILS_MATCH_CF_GAUGE_PERSIST 0x40
 #define UTILS_MATCH_CF_GAUGE_DIST 0x80
+/* Modifies UTILS_MATCH_CF_GAUGE_DIST: use a log-linear histogram. */
+#define UTILS_MATCH_CF_GAUGE_DIST_SKETCH 0x100
 
 #define UTILS_MATCH_CF_COUNTER_SET 0x01
 #define UTILS_MATCH_CF_COUNTER_ADD 0x02
@@ -68,6 +70,9 @@
 struct cu_match_s;
 typedef struct cu_match_s cu_match_t;
 
+struct cu_match_set_s;
+typedef struct cu_match_set_s cu_match_set_t;
+
 struct cu_match_value_s {
   int ds_type;
   value_t value;
@@ -166,6 +171,43 @@ void match_destroy(cu_match_t *obj);
  */
 int match_apply(cu_match_t *obj, const char *str);
 
+/*
+ * NAME
+ *  match_set_create
+ *
+ * DESCRIPTION
+ *  Creates a set of the matches in `matches', which must outlive the set. The
+ *  regular expressions are combined into a tree of alternations, so that
+ *  `match_set_apply' finds all matches a string belongs to with a few
+ *  regexec() calls: a string matching none of the regular expressions is
+ *  ruled out by a single call.
+ *
+ * RETURN VALUE
+ *  A `cu_match_set_t' pointer or NULL if memory allocation fails.
+ */
+cu_match_set_t *match_set_create(cu_match_t *const *matches,
+                                 size_t matches_num);
+
+/*
+ * NAME
+ *  match_set_destroy
+ *
+ * DESCRIPTION
+ *  Destroys the set, but not the matches it was created from.
+ */
+void match_set_destroy(cu_match_set_t *set);
+
+/*
+ * NAME
+ *  match_set_apply
+ *
+ * DESCRIPTION
+ *  Calls `match_apply' for each match of the set whose regular expression
+ *  matches `str', in the order the matches were passed to `match_set_create'.
+ *  Returns the number of failed `match_apply' calls.
+ */
+int match_set_apply(cu_match_set_t *set, const char *str);
+
 /*
  * NAME
  *  match_get_user_data
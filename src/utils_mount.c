@@ -39,6 +39,10 @@
 #include "common.h" /* sstrncpy() et alii */
 #include "plugin.h" /* ERROR() macro */
 
+#if KERNEL_LINUX
+#include <poll.h>
+#endif
+
 #if HAVE_GETVFSSTAT
 #if HAVE_SYS_TYPES_H
 #include <sys/types.h>
@@ -686,6 +690,82 @@ void cu_mount_freelist(cu_mount_t *list) {
   }
 } /* void cu_mount_freelist(cu_mount_t *list) */
 
+struct _cu_mount_cache_t {
+  cu_mount_t *list;
+  _Bool stale;
+#if KERNEL_LINUX
+  int fd;
+#endif
+};
+
+cu_mount_cache_t *cu_mount_cache_create(void) {
+  cu_mount_cache_t *cache = calloc(1, sizeof(*cache));
+  if (cache == NULL)
+    return NULL;
+
+  cache->stale = 1;
+#if KERNEL_LINUX
+  /* The kernel signals POLLPRI on this file whenever a mount point of the
+   * namespace is added, removed or changed. */
+  cache->fd = open("/proc/self/mounts", O_RDONLY | O_CLOEXEC);
+  if (cache->fd < 0)
+    WARNING("utils_mount: Opening /proc/self/mounts failed: %s. The mount "
+            "table will be read on every call.",
+            STRERRNO);
+#endif
+
+  return cache;
+} /* cu_mount_cache_t *cu_mount_cache_create(void) */
+
+void cu_mount_cache_destroy(cu_mount_cache_t *cache) {
+  if (cache == NULL)
+    return;
+
+#if KERNEL_LINUX
+  if (cache->fd >= 0)
+    close(cache->fd);
+#endif
+  cu_mount_freelist(cache->list);
+  sfree(cache);
+} /* void cu_mount_cache_destroy(cu_mount_cache_t *cache) */
+
+cu_mount_t *cu_mount_cache_get(cu_mount_cache_t *cache, _Bool *ret_changed) {
+  cu_mount_t *list = NULL;
+  _Bool changed = 1;
+
+  if ((cache == NULL) || (ret_changed == NULL))
+    return NULL;
+
+#if KERNEL_LINUX
+  if (!cache->stale && (cache->fd >= 0)) {
+    struct pollfd pfd = {.fd = cache->fd, .events = POLLPRI};
+
+    /* Polling acknowledges the change, so a change while the list is being
+     * read is reported by the next call. */
+    if ((poll(&pfd, 1, /* timeout = */ 0) == 0) ||
+        ((pfd.revents & (POLLPRI | POLLERR)) == 0))
+      changed = 0;
+  }
+#endif
+
+  if (!changed) {
+    *ret_changed = 0;
+    return cache->list;
+  }
+
+  if (cu_mount_getlist(&list) == NULL) {
+    cache->stale = 1;
+    return NULL;
+  }
+
+  cu_mount_freelist(cache->list);
+  cache->list = list;
+  cache->stale = 0;
+
+  *ret_changed = 1;
+  return list;
+} /* cu_mount_t *cu_mount_cache_get(cu_mount_cache_t *cache, _Bool *) */
+
 char *cu_mount_checkoption(char *line, const char *keyword, int full) {
   char *line2, *l2, *p1, *p2;
   int l;
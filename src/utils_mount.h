@@ -113,6 +113,36 @@ void cu_mount_freelist(cu_mount_t *list);
         allocated by *list and *list itself as well.
 */
 
+typedef struct _cu_mount_cache_t cu_mount_cache_t;
+
+cu_mount_cache_t *cu_mount_cache_create(void);
+void cu_mount_cache_destroy(cu_mount_cache_t *cache);
+cu_mount_t *cu_mount_cache_get(cu_mount_cache_t *cache, _Bool *ret_changed);
+/*
+  DESCRIPTION
+        The cu_mount_cache_get() function returns the list of all
+        mountpoints, like cu_mount_getlist(). The list is kept in
+        the cache and only read again when the mount table has
+        changed. On Linux, changes are detected by poll()ing
+        /proc/self/mounts, which does not require reading it. On
+        other systems, the list is read on every call.
+
+        *ret_changed is set to true if the list has been read
+        again, i.e. if entries returned by an earlier call are no
+        longer valid.
+
+  RETURN VALUE
+        The cu_mount_cache_get() function returns a pointer to
+        the first entry of the list, or NULL if an error has
+        occured.
+
+  NOTES
+        The list belongs to the cache. Do *not* free it, and do
+        not use it after the next call of cu_mount_cache_get()
+        which sets *ret_changed, or after
+        cu_mount_cache_destroy().
+*/
+
 char *cu_mount_checkoption(char *line, const char *keyword, int full);
 /*
   DESCRIPTION
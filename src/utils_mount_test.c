@@ -103,9 +103,33 @@ DEF_TEST(cu_mount_getoptionvalue) {
   return 0;
 }
 
+DEF_TEST(cu_mount_cache) {
+  cu_mount_cache_t *cache;
+  cu_mount_t *first;
+  cu_mount_t *second;
+  _Bool changed = 0;
+
+  CHECK_NOT_NULL(cache = cu_mount_cache_create());
+
+  CHECK_NOT_NULL(first = cu_mount_cache_get(cache, &changed));
+  OK(changed);
+
+  CHECK_NOT_NULL(second = cu_mount_cache_get(cache, &changed));
+#if KERNEL_LINUX
+  /* Unless the mount table changes in the meantime, the cached list is
+   * returned. */
+  OK(!changed);
+  OK(first == second);
+#endif
+
+  cu_mount_cache_destroy(cache);
+  return 0;
+}
+
 int main(void) {
   RUN_TEST(cu_mount_checkoption);
   RUN_TEST(cu_mount_getoptionvalue);
+  RUN_TEST(cu_mount_cache);
 
   END_TEST;
 }
@@ -0,0 +1,260 @@
+/**
+ * collectd - src/utils_name_cache.c
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "common.h"
+#include "utils_name_cache.h"
+
+#define NAME_CACHE_MIN_BUCKETS 64
+
+/* Once the cache is full, only one in this many new names replaces an entry,
+ * see name_cache_set(). */
+#define NAME_CACHE_REPLACE_RATE 16
+
+struct name_cache_entry_s;
+typedef struct name_cache_entry_s name_cache_entry_t;
+struct name_cache_entry_s {
+  name_cache_entry_t *next;
+  uint64_t identity_hash;
+  uint64_t key;
+  size_t identity_len;
+  size_t name_len;
+  /* The identity followed by the name, both null terminated. */
+  char data[];
+};
+
+struct name_cache_s {
+  pthread_mutex_t lock;
+  name_cache_entry_t **buckets;
+  size_t buckets_num; /* power of two */
+  size_t entries_num;
+  size_t entries_max;
+  size_t evict_index; /* bucket to look at first when replacing an entry */
+  size_t misses_full; /* new names seen while the cache was full */
+};
+
+static size_t name_cache_bucket(name_cache_t const *nc, /* {{{ */
+                                uint64_t identity_hash, uint64_t key) {
+  uint64_t h = identity_hash ^ (key * 0x9E3779B97F4A7C15ULL);
+  h ^= h >> 29;
+  return (size_t)(h & (nc->buckets_num - 1));
+} /* }}} size_t name_cache_bucket */
+
+/* Doubles the number of buckets. Failing to do so is not an error, the chains
+ * just get longer. */
+static void name_cache_grow(name_cache_t *nc) /* {{{ */
+{
+  size_t old_num = nc->buckets_num;
+  name_cache_entry_t **old = nc->buckets;
+
+  name_cache_entry_t **tmp = calloc(2 * old_num, sizeof(*tmp));
+  if (tmp == NULL)
+    return;
+
+  nc->buckets = tmp;
+  nc->buckets_num = 2 * old_num;
+  for (size_t i = 0; i < old_num; i++) {
+    while (old[i] != NULL) {
+      name_cache_entry_t *e = old[i];
+      old[i] = e->next;
+
+      size_t b = name_cache_bucket(nc, e->identity_hash, e->key);
+      e->next = nc->buckets[b];
+      nc->buckets[b] = e;
+    }
+  }
+  sfree(old);
+} /* }}} void name_cache_grow */
+
+/* Removes the first entry of the next non-empty bucket. Since the buckets are
+ * in hash order, this replaces a more or less random entry. */
+static void name_cache_evict(name_cache_t *nc) /* {{{ */
+{
+  for (size_t i = 0; i < nc->buckets_num; i++) {
+    size_t b = (nc->evict_index + i) & (nc->buckets_num - 1);
+    name_cache_entry_t *e = nc->buckets[b];
+    if (e == NULL)
+      continue;
+
+    nc->buckets[b] = e->next;
+    nc->entries_num--;
+    nc->evict_index = b + 1;
+    sfree(e);
+    return;
+  }
+} /* }}} void name_cache_evict */
+
+static name_cache_entry_t **
+name_cache_lookup(name_cache_t *nc, /* {{{ */
+                  value_list_identity_t const *identity, uint64_t key) {
+  size_t b = name_cache_bucket(nc, identity->hash, key);
+
+  for (name_cache_entry_t **e = &nc->buckets[b]; *e != NULL; e = &(*e)->next)
+    if (((*e)->identity_hash == identity->hash) && ((*e)->key == key) &&
+        (strcmp((*e)->data, identity->name) == 0))
+      return e;
+
+  return NULL;
+} /* }}} name_cache_entry_t **name_cache_lookup */
+
+name_cache_t *name_cache_create(size_t max_entries) /* {{{ */
+{
+  if (max_entries == 0)
+    return NULL;
+
+  name_cache_t *nc = calloc(1, sizeof(*nc));
+  if (nc == NULL)
+    return NULL;
+
+  nc->buckets = calloc(NAME_CACHE_MIN_BUCKETS, sizeof(*nc->buckets));
+  if (nc->buckets == NULL) {
+    sfree(nc);
+    return NULL;
+  }
+  nc->buckets_num = NAME_CACHE_MIN_BUCKETS;
+  nc->entries_max = max_entries;
+  pthread_mutex_init(&nc->lock, /* attr = */ NULL);
+
+  return nc;
+} /* }}} name_cache_t *name_cache_create */
+
+void name_cache_destroy(name_cache_t *nc) /* {{{ */
+{
+  if (nc == NULL)
+    return;
+
+  for (size_t i = 0; i < nc->buckets_num; i++) {
+    while (nc->buckets[i] != NULL) {
+      name_cache_entry_t *e = nc->buckets[i];
+      nc->buckets[i] = e->next;
+      sfree(e);
+    }
+  }
+  sfree(nc->buckets);
+  pthread_mutex_destroy(&nc->lock);
+  sfree(nc);
+} /* }}} void name_cache_destroy */
+
+uint64_t name_cache_key(uint64_t key, char const *str) /* {{{ */
+{
+  /* FNV-1a, like identifier_hash(). The terminating null byte is included so
+   * that "ab" + "c" and "a" + "bc" differ. */
+  if (str == NULL) {
+    key ^= 0x100;
+    key *= 1099511628211ULL;
+    return key;
+  }
+
+  for (unsigned char const *c = (unsigned char const *)str;; c++) {
+    key ^= (uint64_t)*c;
+    key *= 1099511628211ULL;
+    if (*c == 0)
+      break;
+  }
+
+  return key;
+} /* }}} uint64_t name_cache_key */
+
+int name_cache_get(name_cache_t *nc, /* {{{ */
+                   value_list_identity_t const *identity, uint64_t key,
+                   char *buffer, size_t buffer_size) {
+  if ((nc == NULL) || (identity == NULL) || (buffer == NULL))
+    return EINVAL;
+
+  pthread_mutex_lock(&nc->lock);
+  name_cache_entry_t **e = name_cache_lookup(nc, identity, key);
+  if (e == NULL) {
+    pthread_mutex_unlock(&nc->lock);
+    return ENOENT;
+  }
+
+  size_t name_len = (*e)->name_len;
+  if (name_len >= buffer_size) {
+    pthread_mutex_unlock(&nc->lock);
+    return ERANGE;
+  }
+  memcpy(buffer, (*e)->data + (*e)->identity_len + 1, name_len + 1);
+  pthread_mutex_unlock(&nc->lock);
+
+  return 0;
+} /* }}} int name_cache_get */
+
+int name_cache_set(name_cache_t *nc, /* {{{ */
+                   value_list_identity_t const *identity, uint64_t key,
+                   char const *name) {
+  if ((nc == NULL) || (identity == NULL) || (name == NULL))
+    return EINVAL;
+
+  size_t identity_len = strlen(identity->name);
+  size_t name_len = strlen(name);
+
+  pthread_mutex_lock(&nc->lock);
+
+  /* With many more names than entries, replacing an entry for every new name
+   * costs more than the cache saves. Replacing only some still lets the cache
+   * follow a changing set of names. */
+  if ((nc->entries_num >= nc->entries_max) &&
+      ((nc->misses_full++ % NAME_CACHE_REPLACE_RATE) != 0)) {
+    pthread_mutex_unlock(&nc->lock);
+    return 0;
+  }
+
+  name_cache_entry_t **e = name_cache_lookup(nc, identity, key);
+
+  name_cache_entry_t *new =
+      malloc(sizeof(*new) + identity_len + 1 + name_len + 1);
+  if (new == NULL) {
+    pthread_mutex_unlock(&nc->lock);
+    return ENOMEM;
+  }
+  new->identity_hash = identity->hash;
+  new->key = key;
+  new->identity_len = identity_len;
+  new->name_len = name_len;
+  memcpy(new->data, identity->name, identity_len + 1);
+  memcpy(new->data + identity_len + 1, name, name_len + 1);
+
+  /* Replace an existing entry in place. */
+  if (e != NULL) {
+    name_cache_entry_t *old = *e;
+    new->next = old->next;
+    *e = new;
+    pthread_mutex_unlock(&nc->lock);
+    sfree(old);
+    return 0;
+  }
+
+  if (nc->entries_num >= nc->entries_max)
+    name_cache_evict(nc);
+  else if (nc->entries_num >= nc->buckets_num)
+    name_cache_grow(nc);
+
+  size_t b = name_cache_bucket(nc, identity->hash, key);
+  new->next = nc->buckets[b];
+  nc->buckets[b] = new;
+  nc->entries_num++;
+
+  pthread_mutex_unlock(&nc->lock);
+  return 0;
+} /* }}} int name_cache_set */
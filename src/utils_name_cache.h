@@ -0,0 +1,93 @@
+/**
+ * collectd - src/utils_name_cache.h
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef UTILS_NAME_CACHE_H
+#define UTILS_NAME_CACHE_H 1
+
+#include "collectd.h"
+
+#include "plugin.h" /* for value_list_identity_t */
+
+/* Initial value for name_cache_key(). */
+#define NAME_CACHE_KEY_INIT 14695981039346656037ULL
+
+struct name_cache_s;
+typedef struct name_cache_s name_cache_t;
+
+/*
+ * NAME
+ *   name_cache_create
+ *
+ * DESCRIPTION
+ *   Allocates a cache for names formatted from a value list's identity, e.g.
+ *   Graphite metric paths. A series may have several names, which are told
+ *   apart by a key summarizing everything else the name depends on, see
+ *   name_cache_key(). The cache is thread-safe. Once it holds `max_entries'
+ *   names, only some of the new names replace existing ones.
+ *
+ * RETURN VALUE
+ *   A name_cache_t-pointer upon success or NULL upon failure.
+ */
+name_cache_t *name_cache_create(size_t max_entries);
+
+void name_cache_destroy(name_cache_t *nc);
+
+/*
+ * NAME
+ *   name_cache_key
+ *
+ * DESCRIPTION
+ *   Folds the string `str' into `key', which is NAME_CACHE_KEY_INIT
+ *   initially. A NULL pointer and the empty string are told apart.
+ */
+uint64_t name_cache_key(uint64_t key, char const *str);
+
+/*
+ * NAME
+ *   name_cache_get
+ *
+ * DESCRIPTION
+ *   Copies the name stored for `identity' and `key' to `buffer'.
+ *
+ * RETURN VALUE
+ *   Zero upon success, ENOENT if no such name is cached and ERANGE if the
+ *   buffer is too small.
+ */
+int name_cache_get(name_cache_t *nc, value_list_identity_t const *identity,
+                   uint64_t key, char *buffer, size_t buffer_size);
+
+/*
+ * NAME
+ *   name_cache_set
+ *
+ * DESCRIPTION
+ *   Stores `name' for `identity' and `key', replacing any previous name.
+ *   If the cache is full, the name may not be stored.
+ *
+ * RETURN VALUE
+ *   Zero upon success or an errno value upon failure.
+ */
+int name_cache_set(name_cache_t *nc, value_list_identity_t const *identity,
+                   uint64_t key, char const *name);
+
+#endif /* UTILS_NAME_CACHE_H */
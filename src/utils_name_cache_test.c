@@ -0,0 +1,120 @@
+/**
+ * collectd - src/utils_name_cache_test.c
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "common.h"
+#include "testing.h"
+#include "utils_name_cache.h"
+
+static void identity_init(value_list_identity_t *identity, char const *name) {
+  sstrncpy(identity->name, name, sizeof(identity->name));
+  identity->hash = identifier_hash(identity->name);
+}
+
+DEF_TEST(get_set) {
+  name_cache_t *nc = name_cache_create(16);
+  value_list_identity_t a, b;
+  char buffer[64];
+
+  CHECK_NOT_NULL(nc);
+  identity_init(&a, "host/cpu-0/cpu-idle");
+  identity_init(&b, "host/cpu-1/cpu-idle");
+
+  uint64_t key = name_cache_key(NAME_CACHE_KEY_INIT, "collectd.");
+  EXPECT_EQ_INT(ENOENT, name_cache_get(nc, &a, key, buffer, sizeof(buffer)));
+
+  CHECK_ZERO(name_cache_set(nc, &a, key, "collectd.host.cpu-0.cpu-idle"));
+  CHECK_ZERO(name_cache_get(nc, &a, key, buffer, sizeof(buffer)));
+  EXPECT_EQ_STR("collectd.host.cpu-0.cpu-idle", buffer);
+  EXPECT_EQ_INT(ERANGE, name_cache_get(nc, &a, key, buffer, 8));
+
+  /* Other identities and keys don't match. */
+  EXPECT_EQ_INT(ENOENT, name_cache_get(nc, &b, key, buffer, sizeof(buffer)));
+  EXPECT_EQ_INT(ENOENT,
+                name_cache_get(nc, &a, key + 1, buffer, sizeof(buffer)));
+
+  /* Neither does an identity with the same hash but a different name. */
+  value_list_identity_t c = a;
+  c.name[0] = 'H';
+  EXPECT_EQ_INT(ENOENT, name_cache_get(nc, &c, key, buffer, sizeof(buffer)));
+
+  CHECK_ZERO(name_cache_set(nc, &a, key, "replaced"));
+  CHECK_ZERO(name_cache_get(nc, &a, key, buffer, sizeof(buffer)));
+  EXPECT_EQ_STR("replaced", buffer);
+
+  name_cache_destroy(nc);
+  return 0;
+}
+
+DEF_TEST(key) {
+  uint64_t k = NAME_CACHE_KEY_INIT;
+
+  OK(name_cache_key(k, NULL) != name_cache_key(k, ""));
+  OK(name_cache_key(name_cache_key(k, "ab"), "c") !=
+     name_cache_key(name_cache_key(k, "a"), "bc"));
+  EXPECT_EQ_UINT64(name_cache_key(k, "abc"), name_cache_key(k, "abc"));
+
+  return 0;
+}
+
+DEF_TEST(limit) {
+  name_cache_t *nc = name_cache_create(100);
+  value_list_identity_t identity;
+  char name[DATA_MAX_NAME_LEN];
+  char buffer[DATA_MAX_NAME_LEN];
+  int status = 0;
+
+  CHECK_NOT_NULL(nc);
+
+  for (int i = 0; i < 1000; i++) {
+    snprintf(name, sizeof(name), "host/plugin/type-%d", i);
+    identity_init(&identity, name);
+    status |= name_cache_set(nc, &identity, NAME_CACHE_KEY_INIT, name);
+  }
+  EXPECT_EQ_INT(0, status);
+
+  /* At most 100 names are kept, and whatever is found must be correct. */
+  int found = 0;
+  for (int i = 0; i < 1000; i++) {
+    snprintf(name, sizeof(name), "host/plugin/type-%d", i);
+    identity_init(&identity, name);
+    if (name_cache_get(nc, &identity, NAME_CACHE_KEY_INIT, buffer,
+                       sizeof(buffer)) != 0)
+      continue;
+    EXPECT_EQ_STR(name, buffer);
+    found++;
+  }
+  EXPECT_EQ_INT(100, found);
+
+  name_cache_destroy(nc);
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(get_set);
+  RUN_TEST(key);
+  RUN_TEST(limit);
+
+  END_TEST;
+}
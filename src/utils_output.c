@@ -0,0 +1,694 @@
+/**
+ * collectd - src/utils_output.c
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "common.h"
+#include "plugin.h"
+#include "utils_complain.h"
+#include "utils_output.h"
+
+#include <netdb.h>
+#include <poll.h>
+#include <sys/uio.h>
+
+/* Number of buffers written with one sendmsg(2) call. */
+#define OUTPUT_IOV_MAX 64
+
+#define OUTPUT_MIN_RECONNECT_INTERVAL TIME_T_TO_CDTIME_T_STATIC(1)
+#define OUTPUT_MAX_RECONNECT_INTERVAL TIME_T_TO_CDTIME_T_STATIC(64)
+
+/* How long connecting and sending may stall before the connection is
+ * considered broken. */
+#define OUTPUT_SEND_TIMEOUT TIME_T_TO_CDTIME_T_STATIC(10)
+
+typedef struct {
+  size_t fill;
+  char data[];
+} output_buffer_t;
+
+/* One connection to the endpoint. Writers append to "current" and queue it
+ * when it is full; the connection's sender thread sends the queued buffers. */
+typedef struct {
+  output_t *out;
+
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  pthread_t thread;
+  _Bool thread_running;
+  _Bool shutdown;
+
+  output_buffer_t *current;
+  cdtime_t current_init_time;
+
+  /* Ring of full buffers waiting to be sent. */
+  output_buffer_t **queue;
+  size_t queue_head;
+  size_t queue_num;
+
+  /* Buffers not in use. Buffers being sent are neither here nor queued. */
+  output_buffer_t **spare;
+  size_t spare_num;
+
+  c_complain_t drop_complaint;
+
+  /* Updated atomically. */
+  uint64_t bytes_sent;
+  uint64_t bytes_dropped;
+  uint64_t connects;
+  uint64_t connect_failures;
+
+  /* Only used by the sender thread. */
+  int fd;
+  c_complain_t init_complaint;
+  cdtime_t connect_backoff;
+  cdtime_t connect_time;
+} output_conn_t;
+
+struct output_s {
+  char *plugin;
+  char *node;
+  char *service;
+  int socktype;
+  size_t buffer_size;
+  size_t queue_size; /* backlog_size / buffer_size */
+  cdtime_t reconnect_interval;
+  _Bool log_send_errors;
+  output_connect_cb *connect;
+  void *connect_data;
+
+  output_conn_t *conns;
+  size_t conns_num;
+};
+
+static char const *output_protocol(output_t const *out) /* {{{ */
+{
+  return (out->socktype == SOCK_DGRAM) ? "udp" : "tcp";
+} /* }}} char const *output_protocol */
+
+static void output_conn_close(output_conn_t *conn) /* {{{ */
+{
+  if (conn->fd < 0)
+    return;
+
+  close(conn->fd);
+  conn->fd = -1;
+} /* }}} void output_conn_close */
+
+/* Waits for "events" on the connection's socket. Returns zero if the socket is
+ * ready and a non-zero value upon error or timeout. */
+static int output_conn_poll(output_conn_t *conn, short events, /* {{{ */
+                            cdtime_t deadline) {
+  while (42) {
+    cdtime_t now = cdtime();
+    if (now >= deadline) {
+      errno = ETIMEDOUT;
+      return -1;
+    }
+
+    struct pollfd pfd = {.fd = conn->fd, .events = events};
+    int status = poll(&pfd, 1, (int)CDTIME_T_TO_MS(deadline - now) + 1);
+    if (status > 0)
+      return 0;
+    if ((status < 0) && (errno != EINTR))
+      return -1;
+  }
+} /* }}} int output_conn_poll */
+
+static int output_set_nonblocking(int fd) /* {{{ */
+{
+  int flags = fcntl(fd, F_GETFL);
+  if ((flags == -1) || (fcntl(fd, F_SETFL, flags | O_NONBLOCK) != 0))
+    return errno;
+  return 0;
+} /* }}} int output_set_nonblocking */
+
+static int output_conn_resolve_connect(output_conn_t *conn) /* {{{ */
+{
+  output_t *out = conn->out;
+  struct addrinfo *ai_list;
+  char connerr[1024] = "";
+
+  struct addrinfo ai_hints = {.ai_family = AF_UNSPEC,
+                              .ai_flags = AI_ADDRCONFIG,
+                              .ai_socktype = out->socktype};
+
+  int status = getaddrinfo(out->node, out->service, &ai_hints, &ai_list);
+  if (status != 0) {
+    c_complain(LOG_ERR, &conn->init_complaint,
+               "%s plugin: getaddrinfo (%s, %s, %s) failed: %s", out->plugin,
+               out->node, out->service, output_protocol(out),
+               gai_strerror(status));
+    return -1;
+  }
+
+  for (struct addrinfo *ai = ai_list; ai != NULL; ai = ai->ai_next) {
+    conn->fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (conn->fd < 0) {
+      snprintf(connerr, sizeof(connerr), "failed to open socket: %s", STRERRNO);
+      continue;
+    }
+
+    set_sock_opts(conn->fd);
+
+    status = output_set_nonblocking(conn->fd);
+    if (status != 0) {
+      snprintf(connerr, sizeof(connerr), "fcntl failed: %s", STRERROR(status));
+      output_conn_close(conn);
+      continue;
+    }
+
+    status = connect(conn->fd, ai->ai_addr, ai->ai_addrlen);
+    if ((status != 0) && (errno == EINPROGRESS)) {
+      int error = 0;
+
+      status =
+          output_conn_poll(conn, POLLOUT, cdtime() + OUTPUT_SEND_TIMEOUT);
+      if ((status == 0) &&
+          (getsockopt(conn->fd, SOL_SOCKET, SO_ERROR, &error,
+                      &(socklen_t){sizeof(error)}) == 0) &&
+          (error != 0)) {
+        errno = error;
+        status = -1;
+      }
+    }
+    if (status != 0) {
+      snprintf(connerr, sizeof(connerr), "failed to connect to remote host: %s",
+               STRERRNO);
+      output_conn_close(conn);
+      continue;
+    }
+
+    break;
+  }
+
+  freeaddrinfo(ai_list);
+
+  if (conn->fd < 0) {
+    c_complain(LOG_ERR, &conn->init_complaint,
+               "%s plugin: Connecting to %s:%s via %s failed. "
+               "The last error was: %s",
+               out->plugin, out->node, out->service, output_protocol(out),
+               connerr);
+    return -1;
+  }
+
+  return 0;
+} /* }}} int output_conn_resolve_connect */
+
+static int output_conn_connect(output_conn_t *conn) /* {{{ */
+{
+  output_t *out = conn->out;
+  int status;
+
+  if (out->connect != NULL) {
+    conn->fd = out->connect(out->connect_data);
+    if ((conn->fd >= 0) && (output_set_nonblocking(conn->fd) != 0))
+      output_conn_close(conn);
+    status = (conn->fd >= 0) ? 0 : -1;
+  } else {
+    status = output_conn_resolve_connect(conn);
+  }
+
+  if (status != 0) {
+    __atomic_add_fetch(&conn->connect_failures, 1, __ATOMIC_RELAXED);
+    return status;
+  }
+
+  c_release(LOG_INFO, &conn->init_complaint,
+            "%s plugin: Successfully connected to %s:%s via %s.", out->plugin,
+            out->node, out->service, output_protocol(out));
+  __atomic_add_fetch(&conn->connects, 1, __ATOMIC_RELAXED);
+  conn->connect_time = cdtime();
+  return 0;
+} /* }}} int output_conn_connect */
+
+/* Sends `bufs', connecting first if necessary. Stream sockets get all buffers
+ * with one sendmsg(2) call, datagram sockets one datagram per buffer. The
+ * socket is non-blocking; if the endpoint doesn't accept data within
+ * OUTPUT_SEND_TIMEOUT, the connection is closed. Returns the number of
+ * buffers sent completely. */
+static size_t output_conn_send(output_conn_t *conn, /* {{{ */
+                               output_buffer_t **bufs, size_t bufs_num) {
+  output_t *out = conn->out;
+  cdtime_t deadline = cdtime() + OUTPUT_SEND_TIMEOUT;
+  size_t done = 0;
+  size_t offset = 0; /* into bufs[done] */
+
+  if ((conn->fd < 0) && (output_conn_connect(conn) != 0))
+    return 0;
+
+  while (done < bufs_num) {
+    struct iovec iov[OUTPUT_IOV_MAX];
+    size_t iov_num = 0;
+
+    for (size_t i = done; (i < bufs_num) && (iov_num < OUTPUT_IOV_MAX); i++) {
+      size_t skip = (i == done) ? offset : 0;
+      iov[iov_num] = (struct iovec){.iov_base = bufs[i]->data + skip,
+                                    .iov_len = bufs[i]->fill - skip};
+      iov_num++;
+      if (out->socktype == SOCK_DGRAM)
+        break;
+    }
+
+    struct msghdr msg = {.msg_iov = iov, .msg_iovlen = iov_num};
+    ssize_t status = sendmsg(conn->fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (status >= 0) {
+      size_t sent = (size_t)status;
+
+      __atomic_add_fetch(&conn->bytes_sent, (uint64_t)sent, __ATOMIC_RELAXED);
+      if (out->socktype == SOCK_DGRAM) {
+        done++;
+        continue;
+      }
+
+      while ((done < bufs_num) && (sent >= bufs[done]->fill - offset)) {
+        sent -= bufs[done]->fill - offset;
+        offset = 0;
+        done++;
+      }
+      offset += sent;
+      continue;
+    }
+
+    if (errno == EINTR)
+      continue;
+    if (((errno == EAGAIN) || (errno == EWOULDBLOCK)) &&
+        (output_conn_poll(conn, POLLOUT, deadline) == 0))
+      continue;
+
+    if (out->log_send_errors)
+      ERROR("%s plugin: send to %s:%s (%s) failed: %s", out->plugin,
+            out->node, out->service, output_protocol(out), STRERRNO);
+    output_conn_close(conn);
+    break;
+  }
+
+  return done;
+} /* }}} size_t output_conn_send */
+
+/* Closes the connection when it was open for longer than the reconnect
+ * interval. Only called between two batches, so no data is lost. */
+static void output_conn_reconnect_check(output_conn_t *conn) /* {{{ */
+{
+  output_t *out = conn->out;
+
+  if ((out->reconnect_interval == 0) || (conn->fd < 0))
+    return;
+
+  cdtime_t now = cdtime();
+  if ((now - conn->connect_time) < out->reconnect_interval)
+    return;
+
+  output_conn_close(conn);
+
+  INFO("%s plugin: Connection closed after %.3f seconds.", out->plugin,
+       CDTIME_T_TO_DOUBLE(now - conn->connect_time));
+} /* }}} void output_conn_reconnect_check */
+
+/* Appends the current buffer to the send queue. If the queue is full, the
+ * oldest buffer is dropped. Must hold conn->lock. */
+static void output_queue_current(output_conn_t *conn) /* {{{ */
+{
+  output_t *out = conn->out;
+  size_t queue_size = out->queue_size;
+
+  if (conn->current->fill == 0) {
+    conn->current_init_time = cdtime();
+    return;
+  }
+
+  if (conn->queue_num == queue_size) {
+    /* Reuse the oldest queued buffer for new data. */
+    output_buffer_t *oldest = conn->queue[conn->queue_head];
+    __atomic_add_fetch(&conn->bytes_dropped, (uint64_t)oldest->fill,
+                       __ATOMIC_RELAXED);
+    conn->spare[conn->spare_num++] = oldest;
+    conn->queue_head = (conn->queue_head + 1) % queue_size;
+    conn->queue_num--;
+    c_complain(LOG_WARNING, &conn->drop_complaint,
+               "%s plugin: The backlog of %s:%s is full, dropping data.",
+               out->plugin, out->node, out->service);
+  }
+
+  conn->queue[(conn->queue_head + conn->queue_num) % queue_size] =
+      conn->current;
+  conn->queue_num++;
+  pthread_cond_signal(&conn->cond);
+
+  /* The queue and the spare list have room for all buffers, and the buffers
+   * being sent are in neither, so there is always a spare buffer here. */
+  assert(conn->spare_num > 0);
+  conn->current = conn->spare[--conn->spare_num];
+  conn->current->fill = 0;
+  conn->current_init_time = cdtime();
+} /* }}} void output_queue_current */
+
+static void *output_send_thread(void *arg) /* {{{ */
+{
+  output_conn_t *conn = arg;
+  output_t *out = conn->out;
+  size_t queue_size = out->queue_size;
+  output_buffer_t *bufs[OUTPUT_IOV_MAX];
+
+  pthread_mutex_lock(&conn->lock);
+  while (42) {
+    while (!conn->shutdown && (conn->queue_num == 0))
+      pthread_cond_wait(&conn->cond, &conn->lock);
+    if (conn->queue_num == 0)
+      break;
+
+    size_t bufs_num = 0;
+    while ((conn->queue_num > 0) && (bufs_num < OUTPUT_IOV_MAX)) {
+      bufs[bufs_num++] = conn->queue[conn->queue_head];
+      conn->queue_head = (conn->queue_head + 1) % queue_size;
+      conn->queue_num--;
+    }
+    pthread_mutex_unlock(&conn->lock);
+
+    output_conn_reconnect_check(conn);
+
+    /* Retry until everything has been sent, so nothing is lost while the
+     * endpoint is unreachable; the writers drop the oldest queued data
+     * instead. A buffer which was sent partially is sent again as a whole. */
+    size_t done = 0;
+    while ((done += output_conn_send(conn, bufs + done, bufs_num - done)) <
+           bufs_num) {
+      if (conn->connect_backoff == 0)
+        conn->connect_backoff = OUTPUT_MIN_RECONNECT_INTERVAL;
+      else if ((2 * conn->connect_backoff) < OUTPUT_MAX_RECONNECT_INTERVAL)
+        conn->connect_backoff *= 2;
+      else
+        conn->connect_backoff = OUTPUT_MAX_RECONNECT_INTERVAL;
+      struct timespec ts =
+          CDTIME_T_TO_TIMESPEC(cdtime() + conn->connect_backoff);
+
+      pthread_mutex_lock(&conn->lock);
+      for (size_t i = 0; i < done; i++)
+        conn->spare[conn->spare_num++] = bufs[i];
+      memmove(bufs, bufs + done, (bufs_num - done) * sizeof(*bufs));
+      bufs_num -= done;
+      done = 0;
+
+      /* Writers signal the condition for every queued buffer, so wait until
+       * the backoff has actually passed. */
+      while (!conn->shutdown &&
+             (pthread_cond_timedwait(&conn->cond, &conn->lock, &ts) !=
+              ETIMEDOUT))
+        ;
+      if (conn->shutdown) {
+        /* Don't delay the shutdown, drop everything. */
+        uint64_t dropped = 0;
+        for (size_t i = 0; i < bufs_num; i++) {
+          dropped += bufs[i]->fill;
+          conn->spare[conn->spare_num++] = bufs[i];
+        }
+        for (size_t i = 0; i < conn->queue_num; i++) {
+          output_buffer_t *buf =
+              conn->queue[(conn->queue_head + i) % queue_size];
+          dropped += buf->fill;
+          conn->spare[conn->spare_num++] = buf;
+        }
+        conn->queue_num = 0;
+        __atomic_add_fetch(&conn->bytes_dropped, dropped, __ATOMIC_RELAXED);
+        goto out;
+      }
+      pthread_mutex_unlock(&conn->lock);
+    }
+    conn->connect_backoff = 0;
+
+    pthread_mutex_lock(&conn->lock);
+    for (size_t i = 0; i < bufs_num; i++)
+      conn->spare[conn->spare_num++] = bufs[i];
+  }
+
+out:
+  pthread_mutex_unlock(&conn->lock);
+  output_conn_close(conn);
+  return NULL;
+} /* }}} void *output_send_thread */
+
+/* Number of buffers which may be sent at once. */
+static size_t output_inflight_max(output_t const *out) /* {{{ */
+{
+  return (out->queue_size < OUTPUT_IOV_MAX) ? out->queue_size : OUTPUT_IOV_MAX;
+} /* }}} size_t output_inflight_max */
+
+static int output_conn_init(output_t *out, output_conn_t *conn) /* {{{ */
+{
+  /* Room for the full queue, the current buffer and the ones being sent. */
+  size_t buffers_num = out->queue_size + output_inflight_max(out) + 1;
+
+  conn->out = out;
+  conn->fd = -1;
+  pthread_mutex_init(&conn->lock, /* attr = */ NULL);
+  pthread_cond_init(&conn->cond, /* attr = */ NULL);
+  C_COMPLAIN_INIT(&conn->init_complaint);
+  C_COMPLAIN_INIT(&conn->drop_complaint);
+
+  conn->queue = calloc(out->queue_size, sizeof(*conn->queue));
+  conn->spare = calloc(buffers_num, sizeof(*conn->spare));
+  if ((conn->queue == NULL) || (conn->spare == NULL))
+    return ENOMEM;
+
+  for (size_t i = 0; i < buffers_num; i++) {
+    output_buffer_t *buf = malloc(sizeof(*buf) + out->buffer_size);
+    if (buf == NULL)
+      return ENOMEM;
+    buf->fill = 0;
+    conn->spare[conn->spare_num++] = buf;
+  }
+
+  conn->current = conn->spare[--conn->spare_num];
+  conn->current_init_time = cdtime();
+  return 0;
+} /* }}} int output_conn_init */
+
+static void output_conn_destroy(output_conn_t *conn) /* {{{ */
+{
+  if (conn->out == NULL)
+    return;
+
+  pthread_mutex_lock(&conn->lock);
+  if (conn->current != NULL)
+    output_queue_current(conn);
+  conn->shutdown = 1;
+  pthread_cond_signal(&conn->cond);
+  pthread_mutex_unlock(&conn->lock);
+
+  if (conn->thread_running)
+    pthread_join(conn->thread, /* retval = */ NULL);
+
+  output_t *out = conn->out;
+  if (conn->bytes_dropped > 0)
+    WARNING("%s plugin: %" PRIu64 " bytes for %s:%s have been dropped.",
+            out->plugin, conn->bytes_dropped, out->node, out->service);
+
+  if (conn->queue != NULL)
+    for (size_t i = 0; i < conn->queue_num; i++)
+      sfree(conn->queue[(conn->queue_head + i) % out->queue_size]);
+  if (conn->spare != NULL)
+    for (size_t i = 0; i < conn->spare_num; i++)
+      sfree(conn->spare[i]);
+  sfree(conn->current);
+  sfree(conn->queue);
+  sfree(conn->spare);
+
+  pthread_mutex_destroy(&conn->lock);
+  pthread_cond_destroy(&conn->cond);
+} /* }}} void output_conn_destroy */
+
+/* The sender threads are started by the first write, because the daemon may
+ * fork after the configuration has been read. Must hold conn->lock. */
+static int output_conn_start(output_conn_t *conn) /* {{{ */
+{
+  if (conn->thread_running)
+    return 0;
+
+  int status = plugin_thread_create(&conn->thread, /* attr = */ NULL,
+                                    output_send_thread, conn, "output send");
+  if (status != 0) {
+    ERROR("%s plugin: Starting a sender thread failed.", conn->out->plugin);
+    return status;
+  }
+
+  conn->thread_running = 1;
+  return 0;
+} /* }}} int output_conn_start */
+
+output_t *output_create(output_config_t const *conf) /* {{{ */
+{
+  if ((conf == NULL) || (conf->buffer_size == 0) ||
+      (conf->connections_num == 0))
+    return NULL;
+
+  output_t *out = calloc(1, sizeof(*out));
+  if (out == NULL)
+    return NULL;
+
+  out->plugin = strdup((conf->plugin != NULL) ? conf->plugin : "output");
+  out->node = strdup((conf->node != NULL) ? conf->node : "localhost");
+  out->service = strdup((conf->service != NULL) ? conf->service : "");
+  out->socktype = (conf->socktype == SOCK_DGRAM) ? SOCK_DGRAM : SOCK_STREAM;
+  out->buffer_size = conf->buffer_size;
+  /* At least one buffer can be queued while another one is being sent. */
+  out->queue_size = conf->backlog_size / conf->buffer_size;
+  if (out->queue_size == 0)
+    out->queue_size = 1;
+  out->reconnect_interval = conf->reconnect_interval;
+  out->log_send_errors = conf->log_send_errors;
+  out->connect = conf->connect;
+  out->connect_data = conf->connect_data;
+
+  out->conns = calloc(conf->connections_num, sizeof(*out->conns));
+  if ((out->plugin == NULL) || (out->node == NULL) ||
+      (out->service == NULL) || (out->conns == NULL)) {
+    output_destroy(out);
+    return NULL;
+  }
+  out->conns_num = conf->connections_num;
+
+  for (size_t i = 0; i < out->conns_num; i++) {
+    if (output_conn_init(out, out->conns + i) != 0) {
+      output_destroy(out);
+      return NULL;
+    }
+  }
+
+  return out;
+} /* }}} output_t *output_create */
+
+void output_destroy(output_t *out) /* {{{ */
+{
+  if (out == NULL)
+    return;
+
+  if (out->conns != NULL)
+    for (size_t i = 0; i < out->conns_num; i++)
+      output_conn_destroy(out->conns + i);
+  sfree(out->conns);
+
+  sfree(out->plugin);
+  sfree(out->node);
+  sfree(out->service);
+  sfree(out);
+} /* }}} void output_destroy */
+
+int output_write(output_t *out, uint64_t key, char const *data, /* {{{ */
+                 size_t len) {
+  if ((out == NULL) || (data == NULL))
+    return EINVAL;
+  if (len > out->buffer_size)
+    return EMSGSIZE;
+
+  output_conn_t *conn = out->conns + (key % out->conns_num);
+
+  pthread_mutex_lock(&conn->lock);
+
+  int status = output_conn_start(conn);
+  if (status != 0) {
+    pthread_mutex_unlock(&conn->lock);
+    return status;
+  }
+
+  if (len > (out->buffer_size - conn->current->fill))
+    output_queue_current(conn);
+
+  memcpy(conn->current->data + conn->current->fill, data, len);
+  conn->current->fill += len;
+
+  pthread_mutex_unlock(&conn->lock);
+  return 0;
+} /* }}} int output_write */
+
+void output_flush(output_t *out, cdtime_t timeout) /* {{{ */
+{
+  if (out == NULL)
+    return;
+
+  for (size_t i = 0; i < out->conns_num; i++) {
+    output_conn_t *conn = out->conns + i;
+
+    pthread_mutex_lock(&conn->lock);
+    /* timeout == 0  => flush unconditionally */
+    if ((timeout == 0) || ((conn->current_init_time + timeout) <= cdtime()))
+      output_queue_current(conn);
+    pthread_mutex_unlock(&conn->lock);
+  }
+} /* }}} void output_flush */
+
+void output_stats(output_t *out, output_stats_t *ret) /* {{{ */
+{
+  *ret = (output_stats_t){0};
+  if (out == NULL)
+    return;
+
+  for (size_t i = 0; i < out->conns_num; i++) {
+    output_conn_t *conn = out->conns + i;
+
+    ret->bytes_sent += __atomic_load_n(&conn->bytes_sent, __ATOMIC_RELAXED);
+    ret->bytes_dropped +=
+        __atomic_load_n(&conn->bytes_dropped, __ATOMIC_RELAXED);
+    ret->connects += __atomic_load_n(&conn->connects, __ATOMIC_RELAXED);
+    ret->connect_failures +=
+        __atomic_load_n(&conn->connect_failures, __ATOMIC_RELAXED);
+
+    pthread_mutex_lock(&conn->lock);
+    ret->buffers_queued += conn->queue_num;
+    pthread_mutex_unlock(&conn->lock);
+  }
+} /* }}} void output_stats */
+
+static void output_submit(char const *plugin, /* {{{ */
+                          char const *plugin_instance, char const *type,
+                          char const *type_instance, value_t value) {
+  value_list_t vl = VALUE_LIST_INIT;
+
+  vl.values = &value;
+  vl.values_len = 1;
+  sstrncpy(vl.plugin, plugin, sizeof(vl.plugin));
+  sstrncpy(vl.plugin_instance, plugin_instance, sizeof(vl.plugin_instance));
+  sstrncpy(vl.type, type, sizeof(vl.type));
+  if (type_instance != NULL)
+    sstrncpy(vl.type_instance, type_instance, sizeof(vl.type_instance));
+
+  plugin_dispatch_values(&vl);
+} /* }}} void output_submit */
+
+void output_submit_stats(output_t *out, char const *plugin, /* {{{ */
+                         char const *plugin_instance) {
+  output_stats_t stats;
+
+  output_stats(out, &stats);
+
+  output_submit(plugin, plugin_instance, "total_bytes", "sent",
+                (value_t){.derive = (derive_t)stats.bytes_sent});
+  output_submit(plugin, plugin_instance, "total_bytes", "dropped",
+                (value_t){.derive = (derive_t)stats.bytes_dropped});
+  output_submit(plugin, plugin_instance, "total_connections", "established",
+                (value_t){.derive = (derive_t)stats.connects});
+  output_submit(plugin, plugin_instance, "total_connections", "failed",
+                (value_t){.derive = (derive_t)stats.connect_failures});
+  output_submit(plugin, plugin_instance, "queue_length", NULL,
+                (value_t){.gauge = (gauge_t)stats.buffers_queued});
+} /* }}} void output_submit_stats */
@@ -0,0 +1,150 @@
+/**
+ * collectd - src/utils_output.h
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef UTILS_OUTPUT_H
+#define UTILS_OUTPUT_H 1
+
+#include "plugin.h"
+
+/*
+ * A stream of text or datagrams to one endpoint, shared by the writers of
+ * line based protocols. Data is appended to buffers which are queued for a
+ * sender thread, so a slow or unreachable endpoint never blocks the write
+ * thread. The sender keeps the connection open, writes all queued buffers
+ * with one sendmsg(2) call and reconnects with exponential backoff.
+ *
+ * An output may use a pool of several connections, each with its own
+ * buffers and sender thread. Data written with the same key always uses the
+ * same connection, so its order is kept.
+ */
+
+struct output_s;
+typedef struct output_s output_t;
+
+/*
+ * Opens a connected socket. Called on a sender thread instead of the built-in
+ * resolver, e.g. by plugins caching the address information. Returns the
+ * socket or a negative value upon failure, which the callback has logged.
+ */
+typedef int output_connect_cb(void *user_data);
+
+typedef struct {
+  char const *plugin; /* Prefix of log messages, e.g. "write_graphite". */
+  char const *node;
+  char const *service;
+  int socktype; /* SOCK_STREAM or SOCK_DGRAM */
+
+  /* Size of a buffer, i.e. of a datagram with SOCK_DGRAM. */
+  size_t buffer_size;
+  /* Bytes queued per connection. When exceeded, the oldest buffer is
+   * dropped. */
+  size_t backlog_size;
+  size_t connections_num;
+  /* When non-zero, connections are closed and reopened after this time. */
+  cdtime_t reconnect_interval;
+  _Bool log_send_errors;
+
+  output_connect_cb *connect;
+  void *connect_data;
+} output_config_t;
+
+typedef struct {
+  uint64_t bytes_sent;
+  uint64_t bytes_dropped;
+  uint64_t connects;
+  uint64_t connect_failures;
+  size_t buffers_queued;
+} output_stats_t;
+
+/*
+ * NAME
+ *   output_create
+ *
+ * DESCRIPTION
+ *   Allocates the buffers of all connections described by `conf'. The
+ *   strings in `conf' are copied. No connection is opened and no thread is
+ *   started until data is written, because the daemon may fork after the
+ *   configuration has been read.
+ *
+ * RETURN VALUE
+ *   An output_t-pointer upon success or NULL upon failure.
+ */
+output_t *output_create(output_config_t const *conf);
+
+/*
+ * NAME
+ *   output_destroy
+ *
+ * DESCRIPTION
+ *   Sends all buffered data, stops the sender threads and frees `out'. Data
+ *   which cannot be sent because the endpoint is unreachable is dropped.
+ */
+void output_destroy(output_t *out);
+
+/*
+ * NAME
+ *   output_write
+ *
+ * DESCRIPTION
+ *   Appends `len' bytes to the current buffer of the connection selected by
+ *   `key'. With SOCK_DGRAM, data passed in one call is never split across
+ *   two datagrams.
+ *
+ * RETURN VALUE
+ *   Zero on success, an errno value otherwise, e.g. EMSGSIZE if `len' exceeds
+ *   the buffer size.
+ */
+int output_write(output_t *out, uint64_t key, char const *data, size_t len);
+
+/*
+ * NAME
+ *   output_flush
+ *
+ * DESCRIPTION
+ *   Queues the current buffers which are older than `timeout', or all of them
+ *   if `timeout' is zero. Returns without waiting for them to be sent.
+ */
+void output_flush(output_t *out, cdtime_t timeout);
+
+/*
+ * NAME
+ *   output_stats
+ *
+ * DESCRIPTION
+ *   Stores the counters of all connections of `out' in `ret'.
+ */
+void output_stats(output_t *out, output_stats_t *ret);
+
+/*
+ * NAME
+ *   output_submit_stats
+ *
+ * DESCRIPTION
+ *   Dispatches the statistics of `out' as values of `plugin' and
+ *   `plugin_instance': the bytes sent and dropped, the connections
+ *   established and failed, and the number of queued buffers.
+ */
+void output_submit_stats(output_t *out, char const *plugin,
+                         char const *plugin_instance);
+
+#endif /* UTILS_OUTPUT_H */
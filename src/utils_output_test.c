@@ -0,0 +1,290 @@
+/**
+ * collectd - src/utils_output_test.c
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "common.h"
+#include "testing.h"
+#include "utils_output.h"
+
+#include <netinet/in.h>
+
+#define LINES_NUM 1000
+
+typedef struct {
+  int fd;
+  int socktype;
+  size_t conns_num;
+  /* Per connection or, with datagrams, in total. */
+  char *data[2];
+  size_t size[2];
+  /* Largest datagram received. */
+  size_t max_datagram;
+} receiver_t;
+
+static int listen_local(int socktype, char *port, size_t port_size) /* {{{ */
+{
+  struct sockaddr_in sa = {.sin_family = AF_INET,
+                           .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+  socklen_t sa_len = sizeof(sa);
+
+  int fd = socket(AF_INET, socktype, 0);
+  if (fd < 0)
+    return -1;
+
+  if ((bind(fd, (struct sockaddr *)&sa, sizeof(sa)) != 0) ||
+      ((socktype == SOCK_STREAM) && (listen(fd, 4) != 0)) ||
+      (getsockname(fd, (struct sockaddr *)&sa, &sa_len) != 0)) {
+    close(fd);
+    return -1;
+  }
+
+  snprintf(port, port_size, "%d", (int)ntohs(sa.sin_port));
+  return fd;
+} /* }}} int listen_local */
+
+static void append(receiver_t *r, size_t index, char const *buf, /* {{{ */
+                   size_t len) {
+  r->data[index] = realloc(r->data[index], r->size[index] + len + 1);
+  memcpy(r->data[index] + r->size[index], buf, len);
+  r->size[index] += len;
+  r->data[index][r->size[index]] = 0;
+} /* }}} void append */
+
+/* Reads everything sent to `r->fd' until the connections are closed or, with
+ * datagrams, until an empty datagram arrives. */
+static void *receiver_thread(void *arg) /* {{{ */
+{
+  receiver_t *r = arg;
+  char buf[65536];
+
+  if (r->socktype == SOCK_DGRAM) {
+    ssize_t len;
+    while ((len = recv(r->fd, buf, sizeof(buf), 0)) > 0) {
+      if ((size_t)len > r->max_datagram)
+        r->max_datagram = (size_t)len;
+      append(r, 0, buf, (size_t)len);
+    }
+    return NULL;
+  }
+
+  int fds[2];
+  for (size_t i = 0; i < r->conns_num; i++)
+    fds[i] = accept(r->fd, NULL, NULL);
+
+  for (size_t i = 0; i < r->conns_num; i++) {
+    ssize_t len;
+    while ((len = recv(fds[i], buf, sizeof(buf), 0)) > 0)
+      append(r, i, buf, (size_t)len);
+    close(fds[i]);
+  }
+  return NULL;
+} /* }}} void *receiver_thread */
+
+/* Checks that `data' holds the lines of `key' in order. */
+static int check_lines(char const *data, uint64_t key, /* {{{ */
+                       uint64_t keys_num) {
+  uint64_t want = key;
+  char const *ptr = data;
+
+  while ((ptr != NULL) && (*ptr != 0)) {
+    char line[32];
+    snprintf(line, sizeof(line), "line %" PRIu64 "\n", want);
+    if (strncmp(ptr, line, strlen(line)) != 0)
+      break;
+    ptr += strlen(line);
+    want += keys_num;
+  }
+
+  EXPECT_EQ_UINT64(LINES_NUM + key, want);
+  return 0;
+} /* }}} int check_lines */
+
+static int write_lines(output_t *out, uint64_t keys_num, /* {{{ */
+                       uint64_t *ret_bytes) {
+  *ret_bytes = 0;
+  for (uint64_t i = 0; i < LINES_NUM; i++) {
+    char line[32];
+    snprintf(line, sizeof(line), "line %" PRIu64 "\n", i);
+    int status = output_write(out, i % keys_num, line, strlen(line));
+    if (status != 0)
+      EXPECT_EQ_INT(0, status);
+    *ret_bytes += strlen(line);
+  }
+  return 0;
+} /* }}} int write_lines */
+
+DEF_TEST(stream) {
+  char port[16];
+  receiver_t r = {.socktype = SOCK_STREAM, .conns_num = 2};
+  pthread_t tid;
+
+  OK(output_create(&(output_config_t){0}) == NULL);
+
+  r.fd = listen_local(SOCK_STREAM, port, sizeof(port));
+  OK(r.fd >= 0);
+
+  output_config_t conf = {
+      .plugin = "test",
+      .node = "127.0.0.1",
+      .service = port,
+      .socktype = SOCK_STREAM,
+      .buffer_size = 64,
+      .backlog_size = 1024 * 1024,
+      .connections_num = 2,
+  };
+  output_t *out;
+  CHECK_NOT_NULL(out = output_create(&conf));
+
+  char big[66] = {0};
+  memset(big, 'x', sizeof(big) - 1);
+  EXPECT_EQ_INT(EMSGSIZE, output_write(out, 0, big, strlen(big)));
+
+  uint64_t bytes;
+  CHECK_ZERO(pthread_create(&tid, NULL, receiver_thread, &r));
+  CHECK_ZERO(write_lines(out, 2, &bytes));
+
+  output_flush(out, 0);
+  output_stats_t stats;
+  do {
+    usleep(1000);
+    output_stats(out, &stats);
+  } while (stats.bytes_sent < bytes);
+  EXPECT_EQ_UINT64(bytes, stats.bytes_sent);
+  EXPECT_EQ_UINT64(2, stats.connects);
+  EXPECT_EQ_UINT64(0, stats.buffers_queued);
+  EXPECT_EQ_UINT64(0, stats.bytes_dropped);
+
+  /* Destroying sends what is left and closes the connections. */
+  output_destroy(out);
+  pthread_join(tid, NULL);
+  close(r.fd);
+
+  /* Each key uses one connection, in the order of the writes. */
+  if (strncmp("line 1\n", r.data[0], strlen("line 1\n")) == 0) {
+    char *tmp = r.data[0];
+    r.data[0] = r.data[1];
+    r.data[1] = tmp;
+  }
+  CHECK_ZERO(check_lines(r.data[0], 0, 2));
+  CHECK_ZERO(check_lines(r.data[1], 1, 2));
+
+  sfree(r.data[0]);
+  sfree(r.data[1]);
+  return 0;
+}
+
+DEF_TEST(datagram) {
+  char port[16];
+  receiver_t r = {.socktype = SOCK_DGRAM};
+  pthread_t tid;
+
+  r.fd = listen_local(SOCK_DGRAM, port, sizeof(port));
+  OK(r.fd >= 0);
+
+  output_config_t conf = {
+      .plugin = "test",
+      .node = "127.0.0.1",
+      .service = port,
+      .socktype = SOCK_DGRAM,
+      .buffer_size = 100,
+      .backlog_size = 1024 * 1024,
+      .connections_num = 1,
+  };
+  output_t *out;
+  CHECK_NOT_NULL(out = output_create(&conf));
+
+  uint64_t bytes;
+  CHECK_ZERO(pthread_create(&tid, NULL, receiver_thread, &r));
+  CHECK_ZERO(write_lines(out, 1, &bytes));
+  output_destroy(out);
+
+  /* An empty datagram stops the receiver. */
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  struct sockaddr_in sa = {.sin_family = AF_INET,
+                           .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+                           .sin_port = htons((uint16_t)atoi(port))};
+  sendto(fd, "", 0, 0, (struct sockaddr *)&sa, sizeof(sa));
+  close(fd);
+
+  pthread_join(tid, NULL);
+  close(r.fd);
+
+  EXPECT_EQ_UINT64(bytes, r.size[0]);
+  OK(r.max_datagram <= 100);
+  CHECK_ZERO(check_lines(r.data[0], 0, 1));
+
+  sfree(r.data[0]);
+  return 0;
+}
+
+DEF_TEST(unreachable) {
+  char port[16];
+  struct sockaddr_in sa = {.sin_family = AF_INET,
+                           .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+  socklen_t sa_len = sizeof(sa);
+
+  /* Connections to a bound socket which doesn't listen are refused. */
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  OK(fd >= 0);
+  CHECK_ZERO(bind(fd, (struct sockaddr *)&sa, sizeof(sa)));
+  CHECK_ZERO(getsockname(fd, (struct sockaddr *)&sa, &sa_len));
+  snprintf(port, sizeof(port), "%d", (int)ntohs(sa.sin_port));
+
+  output_config_t conf = {
+      .plugin = "test",
+      .node = "127.0.0.1",
+      .service = port,
+      .socktype = SOCK_STREAM,
+      .buffer_size = 64,
+      .backlog_size = 256,
+      .connections_num = 1,
+  };
+  output_t *out;
+  CHECK_NOT_NULL(out = output_create(&conf));
+  uint64_t bytes;
+  CHECK_ZERO(write_lines(out, 1, &bytes));
+
+  /* The backlog holds four buffers, older ones have been dropped. */
+  output_stats_t stats;
+  do {
+    usleep(1000);
+    output_stats(out, &stats);
+  } while (stats.connect_failures == 0);
+  EXPECT_EQ_UINT64(0, stats.connects);
+  EXPECT_EQ_UINT64(0, stats.bytes_sent);
+  OK(stats.bytes_dropped > 0);
+  OK(stats.buffers_queued <= 4);
+
+  output_destroy(out);
+  close(fd);
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(stream);
+  RUN_TEST(datagram);
+  RUN_TEST(unreachable);
+
+  END_TEST;
+}
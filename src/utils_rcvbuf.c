@@ -0,0 +1,134 @@
+/**
+ * collectd - src/utils_rcvbuf.c
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "common.h"
+#include "plugin.h"
+#include "utils_rcvbuf.h"
+
+#define RCVBUF_RMEM_MAX_FILE "/proc/sys/net/core/rmem_max"
+#define RCVBUF_RESIZE_INTERVAL TIME_T_TO_CDTIME_T(1)
+
+static int rcvbuf_get_size(int fd) /* {{{ */
+{
+  int size = 0;
+  socklen_t size_len = sizeof(size);
+
+  if (getsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, &size_len) != 0)
+    return 0;
+  return size;
+} /* }}} int rcvbuf_get_size */
+
+int rcvbuf_init(rcvbuf_t *rb, int fd, int size, _Bool auto_tune, /* {{{ */
+                char const *plugin) {
+  *rb = (rcvbuf_t){.fd = fd, .plugin = plugin};
+
+  if ((size > 0) &&
+      (setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size)) != 0))
+    WARNING("%s plugin: Setting the receive buffer size to %d failed: %s",
+            plugin, size, STRERRNO);
+  rb->size = rcvbuf_get_size(fd);
+
+  if (auto_tune) {
+    value_t rmem_max;
+    /* The kernel doubles the requested size to account for overhead and
+     * reports the doubled size. */
+    if ((parse_value_file(RCVBUF_RMEM_MAX_FILE, &rmem_max, DS_TYPE_GAUGE) ==
+         0) &&
+        (rmem_max.gauge > 0) && (2.0 * rmem_max.gauge <= (gauge_t)INT_MAX))
+      rb->size_max = 2 * (int)rmem_max.gauge;
+  }
+
+#ifdef SO_RXQ_OVFL
+  int one = 1;
+  if (setsockopt(fd, SOL_SOCKET, SO_RXQ_OVFL, &one, sizeof(one)) != 0) {
+    int status = errno;
+    INFO("%s plugin: Enabling SO_RXQ_OVFL failed: %s", plugin,
+         STRERROR(status));
+    return status;
+  }
+  return 0;
+#else
+  return ENOTSUP;
+#endif
+} /* }}} int rcvbuf_init */
+
+void rcvbuf_update(rcvbuf_t *rb, struct msghdr const *msg) /* {{{ */
+{
+#ifdef SO_RXQ_OVFL
+  if (msg->msg_controllen == 0)
+    return;
+
+  /* CMSG_NXTHDR takes a non-const pointer on some systems. */
+  struct msghdr *m = (struct msghdr *)msg;
+  for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(m); cmsg != NULL;
+       cmsg = CMSG_NXTHDR(m, cmsg)) {
+    if ((cmsg->cmsg_level != SOL_SOCKET) || (cmsg->cmsg_type != SO_RXQ_OVFL))
+      continue;
+
+    uint32_t counter;
+    memcpy(&counter, CMSG_DATA(cmsg), sizeof(counter));
+    /* The kernel's counter is cumulative and wraps around. */
+    rb->drops += (uint64_t)(uint32_t)(counter - rb->counter);
+    rb->counter = counter;
+  }
+#else
+  (void)rb;
+  (void)msg;
+#endif
+} /* }}} void rcvbuf_update */
+
+void rcvbuf_tune(rcvbuf_t *rb) /* {{{ */
+{
+  if ((rb->drops == rb->drops_resized) || (rb->size >= rb->size_max))
+    return;
+
+  cdtime_t now = cdtime();
+  if ((rb->resized != 0) && ((now - rb->resized) < RCVBUF_RESIZE_INTERVAL))
+    return;
+
+  /* "size" is the doubled size, so requesting it doubles the buffer. */
+  int size = rb->size;
+  if (size > rb->size_max / 2)
+    size = rb->size_max / 2;
+
+  if (setsockopt(rb->fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size)) != 0) {
+    WARNING("%s plugin: Growing the receive buffer failed: %s", rb->plugin,
+            STRERRNO);
+    rb->size_max = 0;
+    return;
+  }
+
+  int old_size = rb->size;
+  rb->size = rcvbuf_get_size(rb->fd);
+  if (rb->size <= old_size)
+    rb->size_max = 0;
+
+  INFO("%s plugin: %" PRIu64 " datagrams have been dropped so far. Grew the "
+       "receive buffer of socket %d from %d to %d bytes.",
+       rb->plugin, rb->drops, rb->fd, old_size, rb->size);
+
+  rb->drops_resized = rb->drops;
+  rb->resized = now;
+} /* }}} void rcvbuf_tune */
@@ -0,0 +1,95 @@
+/**
+ * collectd - src/utils_rcvbuf.h
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef UTILS_RCVBUF_H
+#define UTILS_RCVBUF_H 1
+
+#include "collectd.h"
+
+#include "utils_time.h"
+
+#include <sys/socket.h>
+
+/* Space needed in the control buffer of every received message for the drop
+ * counter. */
+#define RCVBUF_CONTROL_SIZE 64
+
+/* Receive buffer and drop counter of a datagram socket. The counter is
+ * updated by the thread receiving from the socket and may be read by other
+ * threads without locking. */
+struct rcvbuf_s {
+  int fd;
+  char const *plugin;
+  /* Size of the receive buffer as reported by the kernel and upper limit for
+   * growing it. "size_max" is zero if the size is not tuned. */
+  int size;
+  int size_max;
+  /* Datagrams dropped by the kernel because the buffer was full. */
+  uint64_t drops;
+  uint32_t counter;
+  uint64_t drops_resized;
+  cdtime_t resized;
+};
+typedef struct rcvbuf_s rcvbuf_t;
+
+/*
+ * NAME
+ *   rcvbuf_init
+ *
+ * DESCRIPTION
+ *   Enables drop accounting (SO_RXQ_OVFL) for the datagram socket `fd' and
+ *   sets its receive buffer to `size' bytes unless `size' is zero. With
+ *   `auto_tune', the buffer is doubled by rcvbuf_tune() whenever datagrams
+ *   have been dropped, up to the "net.core.rmem_max" limit of the kernel.
+ *   `plugin', which must be a static string, is used in log messages.
+ *
+ * RETURN VALUE
+ *   Zero if drops can be counted for the socket, an errno value otherwise.
+ *   The socket can be used in either case.
+ */
+int rcvbuf_init(rcvbuf_t *rb, int fd, int size, _Bool auto_tune,
+                char const *plugin);
+
+/*
+ * NAME
+ *   rcvbuf_update
+ *
+ * DESCRIPTION
+ *   Updates the drop counter from the control messages of `msg', which has
+ *   been received from the socket with a control buffer of at least
+ *   RCVBUF_CONTROL_SIZE bytes. When several messages have been received at
+ *   once, it is sufficient to pass the last one.
+ */
+void rcvbuf_update(rcvbuf_t *rb, struct msghdr const *msg);
+
+/*
+ * NAME
+ *   rcvbuf_tune
+ *
+ * DESCRIPTION
+ *   Grows the receive buffer if datagrams have been dropped since it was
+ *   last grown, at most once per second. Call this after receiving.
+ */
+void rcvbuf_tune(rcvbuf_t *rb);
+
+#endif /* UTILS_RCVBUF_H */
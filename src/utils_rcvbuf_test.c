@@ -0,0 +1,108 @@
+/**
+ * collectd - src/utils_rcvbuf_test.c
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "common.h"
+#include "testing.h"
+#include "utils_rcvbuf.h"
+
+#include <netinet/in.h>
+
+DEF_TEST(drops) {
+  struct sockaddr_in addr = {.sin_family = AF_INET,
+                             .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+  socklen_t addr_len = sizeof(addr);
+  rcvbuf_t rb;
+  char buffer[1024] = {0};
+
+  int rfd = socket(AF_INET, SOCK_DGRAM, 0);
+  int sfd = socket(AF_INET, SOCK_DGRAM, 0);
+  OK((rfd >= 0) && (sfd >= 0));
+  CHECK_ZERO(bind(rfd, (struct sockaddr *)&addr, sizeof(addr)));
+  CHECK_ZERO(getsockname(rfd, (struct sockaddr *)&addr, &addr_len));
+
+  int status = rcvbuf_init(&rb, rfd, 4096, /* auto_tune = */ 1, "test");
+  if (status != 0) {
+    printf("ok - # SKIP drop accounting is not available: %s\n",
+           STRERROR(status));
+    close(rfd);
+    close(sfd);
+    return 0;
+  }
+  OK(rb.size > 0);
+
+  /* Overflow the small buffer. */
+  int sent = 0;
+  for (int i = 0; i < 256; i++)
+    if (sendto(sfd, buffer, sizeof(buffer), MSG_DONTWAIT,
+               (struct sockaddr *)&addr, sizeof(addr)) > 0)
+      sent++;
+
+  char control[RCVBUF_CONTROL_SIZE];
+  struct iovec iov = {.iov_base = buffer, .iov_len = sizeof(buffer)};
+  struct msghdr msg = {.msg_iov = &iov,
+                       .msg_iovlen = 1,
+                       .msg_control = control,
+                       .msg_controllen = sizeof(control)};
+
+  /* The counter is attached when a datagram is queued, so only datagrams
+   * queued after the drops carry them. */
+  int received = 0;
+  while (recvmsg(rfd, &msg, MSG_DONTWAIT) > 0) {
+    rcvbuf_update(&rb, &msg);
+    msg.msg_controllen = sizeof(control);
+    received++;
+  }
+  OK(received > 0);
+  EXPECT_EQ_UINT64(0, rb.drops);
+
+  sendto(sfd, buffer, sizeof(buffer), 0, (struct sockaddr *)&addr,
+         sizeof(addr));
+  OK(recvmsg(rfd, &msg, 0) > 0);
+  rcvbuf_update(&rb, &msg);
+  EXPECT_EQ_UINT64(sent - received, rb.drops);
+
+  int size = rb.size;
+  rcvbuf_tune(&rb);
+  if (rb.size_max > size)
+    OK(rb.size > size);
+  else
+    EXPECT_EQ_INT(size, rb.size);
+  EXPECT_EQ_UINT64(rb.drops, rb.drops_resized);
+
+  /* Not grown again without new drops. */
+  size = rb.size;
+  rcvbuf_tune(&rb);
+  EXPECT_EQ_INT(size, rb.size);
+
+  close(rfd);
+  close(sfd);
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(drops);
+
+  END_TEST;
+}
@@ -554,9 +554,14 @@ static int srrd_create_async(const char *filename, /* {{{ */
     return -1;
   }
 
-  status = pthread_create(&thread, &attr, srrd_create_thread, args);
+  /* Started like the plugin's other threads, so that the plugin is not
+   * unloaded while files are still being created. The thread is detached and
+   * may be gone by the time this returns, so it isn't named. */
+  status = plugin_thread_create(&thread, &attr, srrd_create_thread, args,
+                                /* name = */ NULL);
   if (status != 0) {
-    ERROR("srrd_create_async: pthread_create failed: %s", STRERROR(status));
+    ERROR("srrd_create_async: plugin_thread_create failed: %s",
+          STRERROR(status));
     pthread_attr_destroy(&attr);
     srrd_create_args_destroy(args);
     return status;
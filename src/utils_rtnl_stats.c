@@ -0,0 +1,492 @@
+/**
+ * collectd - src/utils_rtnl_stats.c
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+#include "utils_rtnl_stats.h"
+
+#include "common.h"
+#include "plugin.h"
+
+#include <linux/if_link.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+#include <libmnl/libmnl.h>
+
+#if defined(RTM_GETSTATS) && defined(IFLA_STATS_FILTER_BIT) &&               \
+    HAVE_RTNL_LINK_STATS64
+#define HAVE_RTM_GETSTATS 1
+#endif
+
+/* The kernel puts as many messages into one datagram as fit into the buffer
+ * the reader used last, up to 32 KiB. With a page sized buffer, dumping
+ * thousands of links takes ten times as many system calls. */
+#define RTNL_STATS_BUFFER_SIZE 32768
+
+/* Receive buffer of the notification socket, large enough to hold the
+ * notifications of many links being created at once. */
+#define RTNL_STATS_EVENTS_BUFFER (1024 * 1024)
+
+struct rtnl_stats_s {
+  struct mnl_socket *nl;     /* requests */
+  struct mnl_socket *events; /* RTMGRP_LINK notifications, may be NULL */
+  unsigned int portid;
+  unsigned int seq;
+  char *buffer;
+
+  _Bool getstats; /* the kernel supports RTM_GETSTATS */
+
+  /* Interface names, indexed by the interface index. RTM_GETSTATS does not
+   * report names, so they are taken from a RTM_GETLINK dump once and kept up
+   * to date using notifications. */
+  char **names;
+  size_t names_num;
+  _Bool names_valid;
+};
+
+typedef struct {
+  rtnl_stats_t *rs;
+  rtnl_stats_callback_t callback; /* NULL when only updating names */
+  void *user_data;
+} rtnl_stats_ctx_t;
+
+#define RTNL_STATS_COPY(dst, src)                                              \
+  do {                                                                         \
+    (dst)->rx_packets = (src)->rx_packets;                                     \
+    (dst)->tx_packets = (src)->tx_packets;                                     \
+    (dst)->rx_bytes = (src)->rx_bytes;                                         \
+    (dst)->tx_bytes = (src)->tx_bytes;                                         \
+    (dst)->rx_errors = (src)->rx_errors;                                       \
+    (dst)->tx_errors = (src)->tx_errors;                                       \
+    (dst)->rx_dropped = (src)->rx_dropped;                                     \
+    (dst)->tx_dropped = (src)->tx_dropped;                                     \
+    (dst)->multicast = (src)->multicast;                                       \
+    (dst)->collisions = (src)->collisions;                                     \
+    (dst)->rx_length_errors = (src)->rx_length_errors;                         \
+    (dst)->rx_over_errors = (src)->rx_over_errors;                             \
+    (dst)->rx_crc_errors = (src)->rx_crc_errors;                               \
+    (dst)->rx_frame_errors = (src)->rx_frame_errors;                           \
+    (dst)->rx_fifo_errors = (src)->rx_fifo_errors;                             \
+    (dst)->rx_missed_errors = (src)->rx_missed_errors;                         \
+    (dst)->tx_aborted_errors = (src)->tx_aborted_errors;                       \
+    (dst)->tx_carrier_errors = (src)->tx_carrier_errors;                       \
+    (dst)->tx_fifo_errors = (src)->tx_fifo_errors;                             \
+    (dst)->tx_heartbeat_errors = (src)->tx_heartbeat_errors;                   \
+    (dst)->tx_window_errors = (src)->tx_window_errors;                         \
+  } while (0)
+
+static void rtnl_stats_set_name(rtnl_stats_t *rs, int ifindex, /* {{{ */
+                                char const *name) {
+  if (ifindex < 0)
+    return;
+
+  if ((size_t)ifindex >= rs->names_num) {
+    char **tmp;
+    size_t num;
+
+    if (name == NULL)
+      return;
+
+    num = (size_t)ifindex + 1;
+    tmp = realloc(rs->names, num * sizeof(*tmp));
+    if (tmp == NULL) {
+      ERROR("utils_rtnl_stats: realloc failed.");
+      rs->names_valid = 0;
+      return;
+    }
+    memset(tmp + rs->names_num, 0, (num - rs->names_num) * sizeof(*tmp));
+    rs->names = tmp;
+    rs->names_num = num;
+  }
+
+  if ((name != NULL) && (rs->names[ifindex] != NULL) &&
+      (strcmp(rs->names[ifindex], name) == 0))
+    return;
+
+  sfree(rs->names[ifindex]);
+  if (name != NULL) {
+    rs->names[ifindex] = strdup(name);
+    if (rs->names[ifindex] == NULL)
+      rs->names_valid = 0;
+  }
+} /* }}} void rtnl_stats_set_name */
+
+/* Handles RTM_NEWLINK and RTM_DELLINK messages, from dumps as well as from
+ * notifications. */
+static int rtnl_stats_link_cb(const struct nlmsghdr *nlh, /* {{{ */
+                              void *data) {
+  rtnl_stats_ctx_t *ctx = data;
+  struct ifinfomsg *ifm = mnl_nlmsg_get_payload(nlh);
+  struct nlattr *attr;
+  char const *name = NULL;
+  rtnl_stats_link_t stats;
+  _Bool have_stats = 0;
+
+  if (nlh->nlmsg_type == RTM_DELLINK) {
+    rtnl_stats_set_name(ctx->rs, ifm->ifi_index, NULL);
+    return MNL_CB_OK;
+  }
+  if (nlh->nlmsg_type != RTM_NEWLINK)
+    return MNL_CB_OK;
+
+  mnl_attr_for_each(attr, nlh, sizeof(*ifm)) {
+    uint16_t type = mnl_attr_get_type(attr);
+
+    if (type == IFLA_IFNAME) {
+      if (mnl_attr_validate(attr, MNL_TYPE_STRING) < 0) {
+        ERROR("utils_rtnl_stats: IFLA_IFNAME mnl_attr_validate failed.");
+        return MNL_CB_ERROR;
+      }
+      name = mnl_attr_get_str(attr);
+    }
+#ifdef HAVE_RTNL_LINK_STATS64
+    else if (type == IFLA_STATS64) {
+      struct rtnl_link_stats64 *s64;
+
+      if (mnl_attr_validate2(attr, MNL_TYPE_UNSPEC, sizeof(*s64)) < 0) {
+        ERROR("utils_rtnl_stats: IFLA_STATS64 mnl_attr_validate2 failed: %s",
+              STRERRNO);
+        return MNL_CB_ERROR;
+      }
+      s64 = mnl_attr_get_payload(attr);
+      RTNL_STATS_COPY(&stats, s64);
+      have_stats = 1;
+    }
+#endif
+    else if ((type == IFLA_STATS) && !have_stats) {
+      struct rtnl_link_stats *s32;
+
+      if (mnl_attr_validate2(attr, MNL_TYPE_UNSPEC, sizeof(*s32)) < 0) {
+        ERROR("utils_rtnl_stats: IFLA_STATS mnl_attr_validate2 failed: %s",
+              STRERRNO);
+        return MNL_CB_ERROR;
+      }
+      s32 = mnl_attr_get_payload(attr);
+      RTNL_STATS_COPY(&stats, s32);
+      have_stats = 1;
+    }
+  }
+
+  if (name == NULL) {
+    ERROR("utils_rtnl_stats: Link #%i has no name.", ifm->ifi_index);
+    return MNL_CB_ERROR;
+  }
+
+  rtnl_stats_set_name(ctx->rs, ifm->ifi_index, name);
+
+  if (ctx->callback == NULL)
+    return MNL_CB_OK;
+
+  if (!have_stats) {
+    DEBUG("utils_rtnl_stats: No statistics for interface %s.", name);
+    return MNL_CB_OK;
+  }
+
+  ctx->callback(ifm->ifi_index, name, &stats, ctx->user_data);
+  return MNL_CB_OK;
+} /* }}} int rtnl_stats_link_cb */
+
+#if HAVE_RTM_GETSTATS
+static int rtnl_stats_stats_cb(const struct nlmsghdr *nlh, /* {{{ */
+                               void *data) {
+  rtnl_stats_ctx_t *ctx = data;
+  rtnl_stats_t *rs = ctx->rs;
+  struct if_stats_msg *ifsm = mnl_nlmsg_get_payload(nlh);
+  struct nlattr *attr;
+
+  if (nlh->nlmsg_type != RTM_NEWSTATS)
+    return MNL_CB_OK;
+
+  mnl_attr_for_each(attr, nlh, sizeof(*ifsm)) {
+    struct rtnl_link_stats64 *s64;
+    rtnl_stats_link_t stats;
+    char const *name = NULL;
+
+    if (mnl_attr_get_type(attr) != IFLA_STATS_LINK_64)
+      continue;
+
+    if (mnl_attr_validate2(attr, MNL_TYPE_UNSPEC, sizeof(*s64)) < 0) {
+      ERROR("utils_rtnl_stats: IFLA_STATS_LINK_64 mnl_attr_validate2 failed: "
+            "%s",
+            STRERRNO);
+      return MNL_CB_ERROR;
+    }
+
+    if ((ifsm->ifindex > 0) && ((size_t)ifsm->ifindex < rs->names_num))
+      name = rs->names[ifsm->ifindex];
+    if (name == NULL) {
+      /* Created after the names have been dumped and the notification has
+       * not been read yet. Reported from the next interval on. */
+      DEBUG("utils_rtnl_stats: No name for interface #%" PRIu32 ".",
+            ifsm->ifindex);
+      if (rs->events == NULL)
+        rs->names_valid = 0;
+      return MNL_CB_OK;
+    }
+
+    s64 = mnl_attr_get_payload(attr);
+    RTNL_STATS_COPY(&stats, s64);
+    ctx->callback((int)ifsm->ifindex, name, &stats, ctx->user_data);
+    break;
+  }
+
+  return MNL_CB_OK;
+} /* }}} int rtnl_stats_stats_cb */
+#endif /* HAVE_RTM_GETSTATS */
+
+/* Reads and discards the rest of an aborted dump, so that it is not mistaken
+ * for the response to the next request. */
+static void rtnl_stats_drain(rtnl_stats_t *rs) /* {{{ */
+{
+  int fd = mnl_socket_get_fd(rs->nl);
+
+  while (recv(fd, rs->buffer, RTNL_STATS_BUFFER_SIZE, MSG_DONTWAIT) > 0)
+    /* continue */;
+} /* }}} void rtnl_stats_drain */
+
+/* Sends the dump request `nlh' and passes all responses to `cb'. Returns zero
+ * upon success or an errno value, e.g. the error reported by the kernel. */
+static int rtnl_stats_dump(rtnl_stats_t *rs, /* {{{ */
+                           struct nlmsghdr *nlh, mnl_cb_t cb, void *data) {
+  unsigned int seq = ++rs->seq;
+  ssize_t ret;
+
+  nlh->nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+  nlh->nlmsg_seq = seq;
+
+  if (mnl_socket_sendto(rs->nl, nlh, nlh->nlmsg_len) < 0) {
+    int status = errno;
+    ERROR("utils_rtnl_stats: mnl_socket_sendto failed: %s", STRERRNO);
+    return status;
+  }
+
+  while (42) {
+    ret = mnl_socket_recvfrom(rs->nl, rs->buffer, RTNL_STATS_BUFFER_SIZE);
+    if (ret < 0) {
+      int status = errno;
+      ERROR("utils_rtnl_stats: mnl_socket_recvfrom failed: %s", STRERRNO);
+      return status;
+    }
+
+    errno = 0;
+    ret = mnl_cb_run(rs->buffer, (size_t)ret, seq, rs->portid, cb, data);
+    if (ret < 0) {
+      int status = (errno != 0) ? errno : EPROTO;
+      rtnl_stats_drain(rs);
+      return status;
+    }
+    if (ret == MNL_CB_STOP)
+      return 0;
+  }
+} /* }}} int rtnl_stats_dump */
+
+static int rtnl_stats_dump_links(rtnl_stats_t *rs, /* {{{ */
+                                 rtnl_stats_ctx_t *ctx) {
+  struct nlmsghdr *nlh;
+  struct rtgenmsg *rt;
+
+  nlh = mnl_nlmsg_put_header(rs->buffer);
+  nlh->nlmsg_type = RTM_GETLINK;
+  rt = mnl_nlmsg_put_extra_header(nlh, sizeof(*rt));
+  rt->rtgen_family = AF_PACKET;
+
+  return rtnl_stats_dump(rs, nlh, rtnl_stats_link_cb, ctx);
+} /* }}} int rtnl_stats_dump_links */
+
+#if HAVE_RTM_GETSTATS
+static int rtnl_stats_dump_stats(rtnl_stats_t *rs, /* {{{ */
+                                 rtnl_stats_ctx_t *ctx) {
+  struct nlmsghdr *nlh;
+  struct if_stats_msg *ifsm;
+
+  nlh = mnl_nlmsg_put_header(rs->buffer);
+  nlh->nlmsg_type = RTM_GETSTATS;
+  ifsm = mnl_nlmsg_put_extra_header(nlh, sizeof(*ifsm));
+  ifsm->family = AF_UNSPEC;
+  ifsm->filter_mask = IFLA_STATS_FILTER_BIT(IFLA_STATS_LINK_64);
+
+  return rtnl_stats_dump(rs, nlh, rtnl_stats_stats_cb, ctx);
+} /* }}} int rtnl_stats_dump_stats */
+#endif
+
+/* Applies all pending link notifications to the list of names. */
+static void rtnl_stats_read_events(rtnl_stats_t *rs) /* {{{ */
+{
+  rtnl_stats_ctx_t ctx = {.rs = rs};
+
+  if (rs->events == NULL)
+    return;
+
+  while (42) {
+    ssize_t ret =
+        mnl_socket_recvfrom(rs->events, rs->buffer, RTNL_STATS_BUFFER_SIZE);
+    if (ret < 0) {
+      if (errno == ENOBUFS) {
+        /* Notifications have been lost; dump all links again. */
+        rs->names_valid = 0;
+        continue;
+      }
+      if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+        WARNING("utils_rtnl_stats: Reading link notifications failed: %s",
+                STRERRNO);
+      return;
+    }
+
+    /* seq and portid are zero in notifications */
+    mnl_cb_run(rs->buffer, (size_t)ret, 0, 0, rtnl_stats_link_cb, &ctx);
+  }
+} /* }}} void rtnl_stats_read_events */
+
+static struct mnl_socket *rtnl_stats_open_events(void) /* {{{ */
+{
+  struct mnl_socket *nl;
+  int fd;
+  int size = RTNL_STATS_EVENTS_BUFFER;
+
+  nl = mnl_socket_open(NETLINK_ROUTE);
+  if (nl == NULL) {
+    WARNING("utils_rtnl_stats: mnl_socket_open failed: %s", STRERRNO);
+    return NULL;
+  }
+
+  if (mnl_socket_bind(nl, RTMGRP_LINK, MNL_SOCKET_AUTOPID) < 0) {
+    WARNING("utils_rtnl_stats: Subscribing to link notifications failed: %s",
+            STRERRNO);
+    mnl_socket_close(nl);
+    return NULL;
+  }
+
+  fd = mnl_socket_get_fd(nl);
+  if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) != 0) {
+    WARNING("utils_rtnl_stats: fcntl failed: %s", STRERRNO);
+    mnl_socket_close(nl);
+    return NULL;
+  }
+
+  /* SO_RCVBUFFORCE exceeds net.core.rmem_max but requires CAP_NET_ADMIN. */
+  if (setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size)) != 0)
+    (void)setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+
+  return nl;
+} /* }}} struct mnl_socket *rtnl_stats_open_events */
+
+rtnl_stats_t *rtnl_stats_create(void) /* {{{ */
+{
+  rtnl_stats_t *rs;
+
+  rs = calloc(1, sizeof(*rs));
+  if (rs == NULL) {
+    ERROR("utils_rtnl_stats: calloc failed.");
+    return NULL;
+  }
+
+  rs->buffer = malloc(RTNL_STATS_BUFFER_SIZE);
+  if (rs->buffer == NULL) {
+    ERROR("utils_rtnl_stats: malloc failed.");
+    rtnl_stats_destroy(rs);
+    return NULL;
+  }
+
+  rs->nl = mnl_socket_open(NETLINK_ROUTE);
+  if (rs->nl == NULL) {
+    ERROR("utils_rtnl_stats: mnl_socket_open failed: %s", STRERRNO);
+    rtnl_stats_destroy(rs);
+    return NULL;
+  }
+
+  if (mnl_socket_bind(rs->nl, 0, MNL_SOCKET_AUTOPID) < 0) {
+    ERROR("utils_rtnl_stats: mnl_socket_bind failed: %s", STRERRNO);
+    rtnl_stats_destroy(rs);
+    return NULL;
+  }
+
+  rs->portid = mnl_socket_get_portid(rs->nl);
+  rs->seq = (unsigned int)time(NULL);
+#if HAVE_RTM_GETSTATS
+  rs->getstats = 1;
+  rs->events = rtnl_stats_open_events();
+#endif
+
+  return rs;
+} /* }}} rtnl_stats_t *rtnl_stats_create */
+
+void rtnl_stats_destroy(rtnl_stats_t *rs) /* {{{ */
+{
+  if (rs == NULL)
+    return;
+
+  if (rs->nl != NULL)
+    mnl_socket_close(rs->nl);
+  if (rs->events != NULL)
+    mnl_socket_close(rs->events);
+
+  for (size_t i = 0; i < rs->names_num; i++)
+    sfree(rs->names[i]);
+  sfree(rs->names);
+  sfree(rs->buffer);
+  sfree(rs);
+} /* }}} void rtnl_stats_destroy */
+
+int rtnl_stats_read(rtnl_stats_t *rs, /* {{{ */
+                    rtnl_stats_callback_t callback, void *user_data) {
+  rtnl_stats_ctx_t ctx = {
+      .rs = rs, .callback = callback, .user_data = user_data,
+  };
+
+  if ((rs == NULL) || (callback == NULL))
+    return EINVAL;
+
+#if HAVE_RTM_GETSTATS
+  if (rs->getstats) {
+    int status;
+
+    rtnl_stats_read_events(rs);
+
+    if (!rs->names_valid) {
+      rtnl_stats_ctx_t names_ctx = {.rs = rs};
+
+      /* Cleared again if memory runs out while updating. */
+      rs->names_valid = 1;
+      status = rtnl_stats_dump_links(rs, &names_ctx);
+      if (status != 0) {
+        rs->names_valid = 0;
+        return status;
+      }
+    }
+
+    status = rtnl_stats_dump_stats(rs, &ctx);
+    if ((status != EOPNOTSUPP) && (status != EINVAL))
+      return status;
+
+    INFO("utils_rtnl_stats: RTM_GETSTATS is not supported by the kernel; "
+         "using RTM_GETLINK instead.");
+    rs->getstats = 0;
+    if (rs->events != NULL) {
+      mnl_socket_close(rs->events);
+      rs->events = NULL;
+    }
+  }
+#endif
+
+  return rtnl_stats_dump_links(rs, &ctx);
+} /* }}} int rtnl_stats_read */
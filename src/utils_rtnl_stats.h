@@ -0,0 +1,99 @@
+/**
+ * collectd - src/utils_rtnl_stats.h
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef UTILS_RTNL_STATS_H
+#define UTILS_RTNL_STATS_H 1
+
+#include "collectd.h"
+
+struct rtnl_stats_s;
+typedef struct rtnl_stats_s rtnl_stats_t;
+
+/* Link statistics, independent of whether the kernel reported them as struct
+ * rtnl_link_stats64 or as the 32 bit struct rtnl_link_stats. */
+typedef struct {
+  uint64_t rx_packets;
+  uint64_t tx_packets;
+  uint64_t rx_bytes;
+  uint64_t tx_bytes;
+  uint64_t rx_errors;
+  uint64_t tx_errors;
+
+  uint64_t rx_dropped;
+  uint64_t tx_dropped;
+  uint64_t multicast;
+  uint64_t collisions;
+
+  uint64_t rx_length_errors;
+  uint64_t rx_over_errors;
+  uint64_t rx_crc_errors;
+  uint64_t rx_frame_errors;
+  uint64_t rx_fifo_errors;
+  uint64_t rx_missed_errors;
+
+  uint64_t tx_aborted_errors;
+  uint64_t tx_carrier_errors;
+  uint64_t tx_fifo_errors;
+  uint64_t tx_heartbeat_errors;
+  uint64_t tx_window_errors;
+} rtnl_stats_link_t;
+
+typedef void (*rtnl_stats_callback_t)(int ifindex, char const *name,
+                                      rtnl_stats_link_t const *stats,
+                                      void *user_data);
+
+/*
+ * NAME
+ *   rtnl_stats_create
+ *
+ * DESCRIPTION
+ *   Opens the netlink sockets used to query link statistics. One socket is
+ *   used for requests, a second one receives link notifications, so that the
+ *   names of the interfaces can be kept up to date without dumping all links
+ *   in every interval.
+ *
+ * RETURN VALUE
+ *   A rtnl_stats_t-pointer upon success or NULL upon failure.
+ */
+rtnl_stats_t *rtnl_stats_create(void);
+
+void rtnl_stats_destroy(rtnl_stats_t *rs);
+
+/*
+ * NAME
+ *   rtnl_stats_read
+ *
+ * DESCRIPTION
+ *   Dumps the statistics of all links and calls `callback' once for each
+ *   link. If the kernel supports it (Linux 4.7 and later), a single
+ *   RTM_GETSTATS dump restricted to IFLA_STATS_LINK_64 is used, which is a
+ *   fraction of the size of a RTM_GETLINK dump. Otherwise, the statistics are
+ *   taken from a RTM_GETLINK dump.
+ *
+ * RETURN VALUE
+ *   Zero upon success or an errno value upon failure.
+ */
+int rtnl_stats_read(rtnl_stats_t *rs, rtnl_stats_callback_t callback,
+                    void *user_data);
+
+#endif /* UTILS_RTNL_STATS_H */
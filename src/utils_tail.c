@@ -35,18 +35,152 @@
 #include "common.h"
 #include "utils_tail.h"
 
+#if HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif
+
+/* Size of the block read from the file in one go. Lines are split inside this
+ * buffer, so a busy file costs one read(2) per block rather than per line. */
+#define CU_TAIL_BLOCK_SIZE 65536
+
 struct cu_tail_s {
   char *file;
-  FILE *fh;
+  int fd;
   struct stat stat;
+
+  char *block;
+  size_t block_pos;
+  size_t block_fill;
+
+#if HAVE_SYS_INOTIFY_H
+  /* The file's inode is watched for writes, moves and removal; its directory
+   * for a new file appearing under the same name. As long as no event was
+   * seen, the file cannot have been rotated or truncated and stat(2) is
+   * skipped. */
+  int inotify_fd;
+  int file_wd;
+  char *basename;
+  _Bool changed;
+#endif
 };
 
+#if HAVE_SYS_INOTIFY_H
+static void cu_tail_watch_init(cu_tail_t *obj) /* {{{ */
+{
+  char *dir = strdup(obj->file);
+  if (dir == NULL)
+    return;
+
+  char *slash = strrchr(dir, '/');
+  const char *base;
+  if (slash == NULL) {
+    base = obj->file;
+    sstrncpy(dir, ".", strlen(dir) + 1);
+  } else {
+    base = obj->file + (slash - dir) + 1;
+    if (slash == dir)
+      slash[1] = 0;
+    else
+      slash[0] = 0;
+  }
+
+  obj->basename = strdup(base);
+  obj->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if ((obj->basename == NULL) || (obj->inotify_fd < 0)) {
+    WARNING("utils_tail: inotify_init1 failed, falling back to polling "
+            "\"%s\": %s",
+            obj->file, STRERRNO);
+    goto fail;
+  }
+
+  if (inotify_add_watch(obj->inotify_fd, dir, IN_CREATE | IN_MOVED_TO) < 0) {
+    WARNING("utils_tail: Watching directory \"%s\" failed, falling back to "
+            "polling: %s",
+            dir, STRERRNO);
+    goto fail;
+  }
+
+  sfree(dir);
+  return;
+
+fail:
+  if (obj->inotify_fd >= 0)
+    close(obj->inotify_fd);
+  obj->inotify_fd = -1;
+  sfree(obj->basename);
+  sfree(dir);
+} /* }}} void cu_tail_watch_init */
+
+static void cu_tail_watch_file(cu_tail_t *obj) /* {{{ */
+{
+  if (obj->inotify_fd < 0)
+    return;
+
+  if (obj->file_wd >= 0)
+    inotify_rm_watch(obj->inotify_fd, obj->file_wd);
+
+  obj->file_wd = inotify_add_watch(obj->inotify_fd, obj->file,
+                                   IN_MODIFY | IN_MOVE_SELF | IN_DELETE_SELF);
+  /* Without a watch on the file every EOF has to be checked with stat(2). */
+  obj->changed = 1;
+} /* }}} void cu_tail_watch_file */
+
+/* Drains pending events and returns true if any of them may mean the file was
+ * rotated or truncated. */
+static _Bool cu_tail_watch_changed(cu_tail_t *obj) /* {{{ */
+{
+  if (obj->inotify_fd < 0)
+    return 1;
+
+  char buffer[4096]
+      __attribute__((aligned(__alignof__(struct inotify_event))));
+
+  while (42) {
+    ssize_t len = read(obj->inotify_fd, buffer, sizeof(buffer));
+    if (len <= 0)
+      break;
+
+    for (char *ptr = buffer; ptr < buffer + len;) {
+      struct inotify_event const *ev = (struct inotify_event const *)ptr;
+
+      if (ev->wd == obj->file_wd)
+        obj->changed = 1;
+      else if ((ev->mask & IN_Q_OVERFLOW) ||
+               ((ev->len > 0) && (strcmp(ev->name, obj->basename) == 0)))
+        obj->changed = 1;
+
+      ptr += sizeof(*ev) + ev->len;
+    }
+  }
+
+  if (obj->file_wd < 0)
+    obj->changed = 1;
+
+  _Bool changed = obj->changed;
+  obj->changed = 0;
+  return changed;
+} /* }}} _Bool cu_tail_watch_changed */
+#endif /* HAVE_SYS_INOTIFY_H */
+
+static void cu_tail_close(cu_tail_t *obj) {
+  if (obj->fd >= 0)
+    close(obj->fd);
+  obj->fd = -1;
+  obj->block_pos = 0;
+  obj->block_fill = 0;
+} /* void cu_tail_close */
+
 static int cu_tail_reopen(cu_tail_t *obj) {
   int seek_end = 0;
-  FILE *fh;
+  int fd;
   struct stat stat_buf = {0};
   int status;
 
+#if HAVE_SYS_INOTIFY_H
+  if ((obj->fd >= 0) && !cu_tail_watch_changed(obj))
+    return 1;
+#endif
+
   status = stat(obj->file, &stat_buf);
   if (status != 0) {
     ERROR("utils_tail: stat (%s) failed: %s", obj->file, STRERRNO);
@@ -54,17 +188,20 @@ static int cu_tail_reopen(cu_tail_t *obj) {
   }
 
   /* The file is already open.. */
-  if ((obj->fh != NULL) && (stat_buf.st_ino == obj->stat.st_ino)) {
+  if ((obj->fd >= 0) && (stat_buf.st_ino == obj->stat.st_ino)) {
     /* Seek to the beginning if file was truncated */
-    if (stat_buf.st_size < obj->stat.st_size) {
+    off_t offset = lseek(obj->fd, 0, SEEK_CUR);
+    if ((offset >= 0) && (stat_buf.st_size < offset)) {
       INFO("utils_tail: File `%s' was truncated.", obj->file);
-      status = fseek(obj->fh, 0, SEEK_SET);
-      if (status != 0) {
-        ERROR("utils_tail: fseek (%s) failed: %s", obj->file, STRERRNO);
-        fclose(obj->fh);
-        obj->fh = NULL;
+      if (lseek(obj->fd, 0, SEEK_SET) != 0) {
+        ERROR("utils_tail: lseek (%s) failed: %s", obj->file, STRERRNO);
+        cu_tail_close(obj);
         return -1;
       }
+      obj->block_pos = 0;
+      obj->block_fill = 0;
+      memcpy(&obj->stat, &stat_buf, sizeof(struct stat));
+      return 0;
     }
     memcpy(&obj->stat, &stat_buf, sizeof(struct stat));
     return 1;
@@ -75,25 +212,26 @@ static int cu_tail_reopen(cu_tail_t *obj) {
   if ((obj->stat.st_ino == 0) || (obj->stat.st_ino == stat_buf.st_ino))
     seek_end = 1;
 
-  fh = fopen(obj->file, "r");
-  if (fh == NULL) {
-    ERROR("utils_tail: fopen (%s) failed: %s", obj->file, STRERRNO);
+  fd = open(obj->file, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    ERROR("utils_tail: open (%s) failed: %s", obj->file, STRERRNO);
     return -1;
   }
 
   if (seek_end != 0) {
-    status = fseek(fh, 0, SEEK_END);
-    if (status != 0) {
-      ERROR("utils_tail: fseek (%s) failed: %s", obj->file, STRERRNO);
-      fclose(fh);
+    if (lseek(fd, 0, SEEK_END) < 0) {
+      ERROR("utils_tail: lseek (%s) failed: %s", obj->file, STRERRNO);
+      close(fd);
       return -1;
     }
   }
 
-  if (obj->fh != NULL)
-    fclose(obj->fh);
-  obj->fh = fh;
+  cu_tail_close(obj);
+  obj->fd = fd;
   memcpy(&obj->stat, &stat_buf, sizeof(struct stat));
+#if HAVE_SYS_INOTIFY_H
+  cu_tail_watch_file(obj);
+#endif
 
   return 0;
 } /* int cu_tail_reopen */
@@ -106,25 +244,115 @@ cu_tail_t *cu_tail_create(const char *file) {
     return NULL;
 
   obj->file = strdup(file);
-  if (obj->file == NULL) {
+  obj->block = malloc(CU_TAIL_BLOCK_SIZE);
+  if ((obj->file == NULL) || (obj->block == NULL)) {
+    free(obj->file);
+    free(obj->block);
     free(obj);
     return NULL;
   }
 
-  obj->fh = NULL;
+  obj->fd = -1;
+
+#if HAVE_SYS_INOTIFY_H
+  obj->inotify_fd = -1;
+  obj->file_wd = -1;
+  cu_tail_watch_init(obj);
+#endif
 
   return obj;
 } /* cu_tail_t *cu_tail_create */
 
 int cu_tail_destroy(cu_tail_t *obj) {
-  if (obj->fh != NULL)
-    fclose(obj->fh);
+  cu_tail_close(obj);
+#if HAVE_SYS_INOTIFY_H
+  if (obj->inotify_fd >= 0)
+    close(obj->inotify_fd);
+  free(obj->basename);
+#endif
+  free(obj->block);
   free(obj->file);
   free(obj);
 
   return 0;
 } /* int cu_tail_destroy */
 
+/* Copies the next line, or as much of it as fits, from the block buffer to
+ * `buf'. If `partial' is false, only complete lines are returned. Returns true
+ * if a line was copied. */
+static _Bool cu_tail_take_line(cu_tail_t *obj, char *buf, int buflen,
+                               _Bool partial) {
+  char *start = obj->block + obj->block_pos;
+  size_t avail = obj->block_fill - obj->block_pos;
+  size_t max = (size_t)buflen - 1;
+
+  if (avail == 0)
+    return 0;
+
+  char *nl = memchr(start, '\n', (avail < max) ? avail : max);
+  size_t len;
+  if (nl != NULL)
+    len = (size_t)(nl - start) + 1;
+  else if ((avail >= max) || partial)
+    len = (avail < max) ? avail : max;
+  else
+    return 0;
+
+  memcpy(buf, start, len);
+  buf[len] = 0;
+  obj->block_pos += len;
+  return 1;
+} /* _Bool cu_tail_take_line */
+
+/* Reads the next block from the file, keeping any incomplete line at the start
+ * of the buffer. Returns the number of bytes read, zero on EOF and less than
+ * zero on error. */
+static ssize_t cu_tail_fill(cu_tail_t *obj) {
+  size_t rest = obj->block_fill - obj->block_pos;
+
+  if ((rest > 0) && (obj->block_pos > 0))
+    memmove(obj->block, obj->block + obj->block_pos, rest);
+  obj->block_pos = 0;
+  obj->block_fill = rest;
+
+  if (rest >= CU_TAIL_BLOCK_SIZE)
+    return 0;
+
+  ssize_t status;
+  do {
+    status = read(obj->fd, obj->block + rest, CU_TAIL_BLOCK_SIZE - rest);
+  } while ((status < 0) && (errno == EINTR));
+
+  if (status > 0)
+    obj->block_fill += (size_t)status;
+  return status;
+} /* ssize_t cu_tail_fill */
+
+/* Returns the next line, reading blocks as needed. Sets `buf' to the empty
+ * string on EOF. */
+static int cu_tail_next_line(cu_tail_t *obj, char *buf, int buflen) {
+  while (42) {
+    if (cu_tail_take_line(obj, buf, buflen, /* partial = */ 0))
+      return 0;
+
+    ssize_t status = cu_tail_fill(obj);
+    if (status > 0)
+      continue;
+
+    if (status < 0) {
+      WARNING("utils_tail: read (%s) returned an error: %s", obj->file,
+              STRERRNO);
+      cu_tail_close(obj);
+      return -1;
+    }
+
+    /* EOF: hand out what is left, even without a trailing newline. */
+    if (!cu_tail_take_line(obj, buf, buflen, /* partial = */ 1))
+      buf[0] = 0;
+    return 0;
+  }
+} /* int cu_tail_next_line */
+
 int cu_tail_readline(cu_tail_t *obj, char *buf, int buflen) {
   int status;
 
@@ -133,27 +361,19 @@ int cu_tail_readline(cu_tail_t *obj, char *buf, int buflen) {
     return -1;
   }
 
-  if (obj->fh == NULL) {
+  if (obj->fd < 0) {
     status = cu_tail_reopen(obj);
     if (status < 0)
       return status;
   }
-  assert(obj->fh != NULL);
+  assert(obj->fd >= 0);
 
-  /* Try to read from the filehandle. If that succeeds, everything appears to
-   * be fine and we can return. */
-  clearerr(obj->fh);
-  if (fgets(buf, buflen, obj->fh) != NULL) {
-    buf[buflen - 1] = 0;
+  /* Try to read from the file. If that yields a line, everything appears to
+   * be fine and we can return. On error the file has been closed and
+   * `cu_tail_reopen' opens it again. */
+  status = cu_tail_next_line(obj, buf, buflen);
+  if ((status == 0) && (buf[0] != 0))
     return 0;
-  }
-
-  /* Check if we encountered an error */
-  if (ferror(obj->fh) != 0) {
-    /* Jupp, error. Force `cu_tail_reopen' to reopen the file.. */
-    fclose(obj->fh);
-    obj->fh = NULL;
-  }
   /* else: eof -> check if the file was moved away and reopen the new file if
    * so.. */
 
@@ -167,24 +387,9 @@ int cu_tail_readline(cu_tail_t *obj, char *buf, int buflen) {
     return 0;
   }
 
-  /* If we get here: file was re-opened and there may be more to read.. Let's
-   * try again. */
-  if (fgets(buf, buflen, obj->fh) != NULL) {
-    buf[buflen - 1] = 0;
-    return 0;
-  }
-
-  if (ferror(obj->fh) != 0) {
-    WARNING("utils_tail: fgets (%s) returned an error: %s", obj->file,
-            STRERRNO);
-    fclose(obj->fh);
-    obj->fh = NULL;
-    return -1;
-  }
-
-  /* EOf, well, apparently the new file is empty.. */
-  buf[0] = 0;
-  return 0;
+  /* If we get here: file was re-opened or rewound and there may be more to
+   * read.. Let's try again. An empty buffer means the new file is empty. */
+  return cu_tail_next_line(obj, buf, buflen);
 } /* int cu_tail_readline */
 
 int cu_tail_read(cu_tail_t *obj, char *buf, int buflen, tailfunc_t *callback,
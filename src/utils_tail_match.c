@@ -63,6 +63,9 @@ struct cu_tail_match_s {
   cdtime_t interval;
   cu_tail_match_match_t *matches;
   size_t matches_num;
+
+  /* All matches combined, created on the first line read. */
+  cu_match_set_t *match_set;
 };
 
 /*
@@ -177,6 +180,21 @@ static int tail_callback(void *data, char *buf,
                          int __attribute__((unused)) buflen) {
   cu_tail_match_t *obj = (cu_tail_match_t *)data;
 
+  if ((obj->match_set == NULL) && (obj->matches_num > 1)) {
+    cu_match_t **matches = calloc(obj->matches_num, sizeof(*matches));
+    if (matches != NULL) {
+      for (size_t i = 0; i < obj->matches_num; i++)
+        matches[i] = obj->matches[i].match;
+      obj->match_set = match_set_create(matches, obj->matches_num);
+      sfree(matches);
+    }
+  }
+
+  if (obj->match_set != NULL) {
+    match_set_apply(obj->match_set, buf);
+    return 0;
+  }
+
   for (size_t i = 0; i < obj->matches_num; i++)
     match_apply(obj->matches[i].match, buf);
 
@@ -217,6 +235,9 @@ void tail_match_destroy(cu_tail_match_t *obj) {
     obj->tail = NULL;
   }
 
+  match_set_destroy(obj->match_set);
+  obj->match_set = NULL;
+
   for (size_t i = 0; i < obj->matches_num; i++) {
     cu_tail_match_match_t *match = obj->matches + i;
     if (match->match != NULL) {
@@ -248,6 +269,9 @@ int tail_match_add_match(cu_tail_match_t *obj, cu_match_t *match,
   obj->matches = temp;
   obj->matches_num++;
 
+  match_set_destroy(obj->match_set);
+  obj->match_set = NULL;
+
   DEBUG("tail_match_add_match interval %lf",
         CDTIME_T_TO_DOUBLE(((cu_tail_match_simple_t *)user_data)->interval));
   temp = obj->matches + (obj->matches_num - 1);
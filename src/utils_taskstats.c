@@ -31,6 +31,13 @@
 #include <linux/genetlink.h>
 #include <linux/taskstats.h>
 
+/* Number of requests sent to the kernel before reading the responses. Each
+ * response has to fit into the socket's receive buffer until it is read. */
+#define TS_PIPELINE_DEPTH 32
+
+/* Upper bound of the size of a single TASKSTATS_CMD_GET request. */
+#define TS_REQUEST_SIZE 64
+
 struct ts_s {
   struct mnl_socket *nl;
   pid_t pid;
@@ -61,9 +68,11 @@ static int get_taskstats_attr_cb(const struct nlattr *attr, void *data) {
   uint16_t type = mnl_attr_get_type(attr);
   switch (type) {
   case TASKSTATS_TYPE_STATS:
-    if (mnl_attr_get_payload_len(attr) != sizeof(*ret_taskstats)) {
+    /* struct taskstats is only ever extended, so newer kernels may send more
+     * data than we know about. */
+    if (mnl_attr_get_payload_len(attr) < sizeof(*ret_taskstats)) {
       ERROR("utils_taskstats: mnl_attr_get_payload_len(attr) = %" PRIu32
-            ", want %zu",
+            ", want at least %zu",
             mnl_attr_get_payload_len(attr), sizeof(*ret_taskstats));
       return MNL_CB_ERROR;
     }
@@ -93,12 +102,11 @@ static int get_taskstats_msg_cb(const struct nlmsghdr *nlh, void *data) {
                         data);
 }
 
-static int get_taskstats(ts_t *ts, uint32_t tgid,
-                         struct taskstats *ret_taskstats) {
-  char buffer[MNL_SOCKET_BUFFER_SIZE];
-  uint32_t seq = ts->seq++;
-
-  struct nlmsghdr *nlh = mnl_nlmsg_put_header(buffer);
+/* put_taskstats_request appends a TASKSTATS_CMD_GET request for tgid to buf
+ * and returns it. */
+static struct nlmsghdr *put_taskstats_request(ts_t *ts, void *buf,
+                                              uint32_t seq, uint32_t tgid) {
+  struct nlmsghdr *nlh = mnl_nlmsg_put_header(buf);
   *nlh = (struct nlmsghdr){
       .nlmsg_len = nlh->nlmsg_len,
       .nlmsg_type = ts->genl_id_taskstats,
@@ -116,35 +124,79 @@ static int get_taskstats(ts_t *ts, uint32_t tgid,
   // mnl_attr_put_u32(nlh, TASKSTATS_CMD_ATTR_PID, tgid);
   mnl_attr_put_u32(nlh, TASKSTATS_CMD_ATTR_TGID, tgid);
 
-  if (mnl_socket_sendto(ts->nl, nlh, nlh->nlmsg_len) < 0) {
-    int status = errno;
-    ERROR("utils_taskstats: mnl_socket_sendto() = %s", STRERROR(status));
-    return status;
-  }
+  return nlh;
+}
 
-  int status = mnl_socket_recvfrom(ts->nl, buffer, sizeof(buffer));
-  if (status < 0) {
-    status = errno;
-    ERROR("utils_taskstats: mnl_socket_recvfrom() = %s", STRERROR(status));
-    return status;
-  } else if (status == 0) {
-    ERROR("utils_taskstats: mnl_socket_recvfrom() = 0");
-    return ECONNABORTED;
+/* get_taskstats_batch sends the requests for up to TS_PIPELINE_DEPTH tasks in
+ * a single datagram and then collects the responses, which are matched to the
+ * requests by their sequence number. */
+static int get_taskstats_batch(ts_t *ts, uint32_t const *tgids, size_t num,
+                               ts_delay_t *out, int *ret_status) {
+  char request[TS_PIPELINE_DEPTH * TS_REQUEST_SIZE];
+  char buffer[MNL_SOCKET_BUFFER_SIZE];
+  uint32_t seq = ts->seq;
+  size_t request_size = 0;
+  size_t pending = num;
+
+  assert(num <= TS_PIPELINE_DEPTH);
+  ts->seq += (uint32_t)num;
+
+  for (size_t i = 0; i < num; i++) {
+    struct nlmsghdr *nlh = put_taskstats_request(
+        ts, request + request_size, seq + (uint32_t)i, tgids[i]);
+    request_size += nlh->nlmsg_len;
+    ret_status[i] = EINPROGRESS;
   }
-  size_t buffer_size = (size_t)status;
 
-  if ((status = nlmsg_errno((void *)buffer, buffer_size)) != 0) {
-    ERROR("utils_taskstats: TASKSTATS_CMD_GET(TASKSTATS_CMD_ATTR_TGID = "
-          "%" PRIu32 ") = %s",
-          (uint32_t)tgid, STRERROR(status));
+  if (mnl_socket_sendto(ts->nl, request, request_size) < 0) {
+    int status = errno;
+    ERROR("utils_taskstats: mnl_socket_sendto() = %s", STRERROR(status));
     return status;
   }
 
-  status = mnl_cb_run(buffer, buffer_size, seq, ts->port_id,
-                      get_taskstats_msg_cb, ret_taskstats);
-  if (status < MNL_CB_STOP) {
-    ERROR("utils_taskstats: Parsing message failed.");
-    return EPROTO;
+  while (pending > 0) {
+    int status = mnl_socket_recvfrom(ts->nl, buffer, sizeof(buffer));
+    if (status < 0) {
+      status = errno;
+      ERROR("utils_taskstats: mnl_socket_recvfrom() = %s", STRERROR(status));
+      return status;
+    } else if (status == 0) {
+      ERROR("utils_taskstats: mnl_socket_recvfrom() = 0");
+      return ECONNABORTED;
+    }
+    int len = status;
+
+    for (struct nlmsghdr *nlh = (void *)buffer; mnl_nlmsg_ok(nlh, len);
+         nlh = mnl_nlmsg_next(nlh, &len)) {
+      /* Responses to requests of an earlier, aborted batch are skipped. */
+      uint32_t idx = nlh->nlmsg_seq - seq;
+      if ((idx >= num) || (ret_status[idx] != EINPROGRESS) ||
+          (nlh->nlmsg_pid != ts->port_id)) {
+        continue;
+      }
+      pending--;
+
+      if (nlh->nlmsg_type == NLMSG_ERROR) {
+        status = nlmsg_errno(nlh, (size_t)len);
+        ret_status[idx] = (status != 0) ? status : EPROTO;
+        continue;
+      }
+
+      struct taskstats raw = {0};
+      if (get_taskstats_msg_cb(nlh, &raw) < MNL_CB_STOP) {
+        ERROR("utils_taskstats: Parsing message failed.");
+        ret_status[idx] = EPROTO;
+        continue;
+      }
+
+      out[idx] = (ts_delay_t){
+          .cpu_ns = raw.cpu_delay_total,
+          .blkio_ns = raw.blkio_delay_total,
+          .swapin_ns = raw.swapin_delay_total,
+          .freepages_ns = raw.freepages_delay_total,
+      };
+      ret_status[idx] = 0;
+    }
   }
 
   return 0;
@@ -289,18 +341,39 @@ int ts_delay_by_tgid(ts_t *ts, uint32_t tgid, ts_delay_t *out) {
     return EINVAL;
   }
 
-  struct taskstats raw = {0};
-
-  int status = get_taskstats(ts, tgid, &raw);
+  int ret_status = 0;
+  int status = get_taskstats_batch(ts, &tgid, 1, out, &ret_status);
   if (status != 0) {
     return status;
   }
 
-  *out = (ts_delay_t){
-      .cpu_ns = raw.cpu_delay_total,
-      .blkio_ns = raw.blkio_delay_total,
-      .swapin_ns = raw.swapin_delay_total,
-      .freepages_ns = raw.freepages_delay_total,
-  };
+  return ret_status;
+}
+
+int ts_delay_by_tgids(ts_t *ts, uint32_t const *tgids, size_t tgids_num,
+                      ts_delay_t *out, int *ret_status) {
+  if ((ts == NULL) || (tgids == NULL) || (out == NULL) ||
+      (ret_status == NULL)) {
+    return EINVAL;
+  }
+
+  for (size_t offset = 0; offset < tgids_num; offset += TS_PIPELINE_DEPTH) {
+    size_t num = tgids_num - offset;
+    if (num > TS_PIPELINE_DEPTH) {
+      num = TS_PIPELINE_DEPTH;
+    }
+
+    int status = get_taskstats_batch(ts, tgids + offset, num, out + offset,
+                                     ret_status + offset);
+    if (status != 0) {
+      for (size_t i = offset; i < tgids_num; i++) {
+        if ((i >= offset + num) || (ret_status[i] == EINPROGRESS)) {
+          ret_status[i] = status;
+        }
+      }
+      return status;
+    }
+  }
+
   return 0;
 }
@@ -44,4 +44,12 @@ void ts_destroy(ts_t *);
  * identified by tgid. Returns zero on success and an errno otherwise. */
 int ts_delay_by_tgid(ts_t *ts, uint32_t tgid, ts_delay_t *out);
 
+/* ts_delay_by_tgids returns delay accounting information for tgids_num tasks.
+ * The requests are pipelined, i.e. several requests are sent before reading
+ * the responses. ret_status[i] is set to zero if out[i] has been filled and
+ * to an errno otherwise. Returns zero unless communicating with the kernel
+ * failed. */
+int ts_delay_by_tgids(ts_t *ts, uint32_t const *tgids, size_t tgids_num,
+                      ts_delay_t *out, int *ret_status);
+
 #endif /* UTILS_TASKSTATS_H */
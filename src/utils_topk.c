@@ -0,0 +1,200 @@
+/**
+ * collectd - src/utils_topk.c
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "common.h"
+#include "utils_avltree.h"
+#include "utils_topk.h"
+
+/* The items are kept in a binary min-heap ordered by count, so the item to
+ * replace is always at the root. Each item knows its position in the heap,
+ * which allows moving it down after its count has been increased. */
+typedef struct {
+  topk_item_t item;
+  size_t heap_index;
+} topk_entry_t;
+
+struct topk_s {
+  topk_entry_t *entries;
+  topk_entry_t **heap;
+  size_t num;
+  size_t capacity;
+  c_avl_tree_t *index; /* name -> topk_entry_t */
+};
+
+static void topk_swap(topk_t *t, size_t a, size_t b) /* {{{ */
+{
+  topk_entry_t *tmp = t->heap[a];
+  t->heap[a] = t->heap[b];
+  t->heap[b] = tmp;
+  t->heap[a]->heap_index = a;
+  t->heap[b]->heap_index = b;
+} /* }}} void topk_swap */
+
+static void topk_sift_up(topk_t *t, size_t i) /* {{{ */
+{
+  while (i > 0) {
+    size_t parent = (i - 1) / 2;
+    if (t->heap[parent]->item.count <= t->heap[i]->item.count)
+      break;
+    topk_swap(t, i, parent);
+    i = parent;
+  }
+} /* }}} void topk_sift_up */
+
+static void topk_sift_down(topk_t *t, size_t i) /* {{{ */
+{
+  while (42) {
+    size_t min = i;
+    size_t left = 2 * i + 1;
+    size_t right = left + 1;
+
+    if ((left < t->num) &&
+        (t->heap[left]->item.count < t->heap[min]->item.count))
+      min = left;
+    if ((right < t->num) &&
+        (t->heap[right]->item.count < t->heap[min]->item.count))
+      min = right;
+    if (min == i)
+      break;
+
+    topk_swap(t, i, min);
+    i = min;
+  }
+} /* }}} void topk_sift_down */
+
+topk_t *topk_create(size_t capacity) /* {{{ */
+{
+  if (capacity == 0)
+    return NULL;
+
+  topk_t *t = calloc(1, sizeof(*t));
+  if (t == NULL)
+    return NULL;
+
+  t->entries = calloc(capacity, sizeof(*t->entries));
+  t->heap = calloc(capacity, sizeof(*t->heap));
+  t->index = c_avl_create((int (*)(const void *, const void *))strcmp);
+  if ((t->entries == NULL) || (t->heap == NULL) || (t->index == NULL)) {
+    topk_destroy(t);
+    return NULL;
+  }
+  t->capacity = capacity;
+
+  return t;
+} /* }}} topk_t *topk_create */
+
+void topk_destroy(topk_t *t) /* {{{ */
+{
+  if (t == NULL)
+    return;
+
+  /* The keys point into the entries and are not freed separately. */
+  if (t->index != NULL)
+    c_avl_destroy(t->index);
+  sfree(t->heap);
+  sfree(t->entries);
+  sfree(t);
+} /* }}} void topk_destroy */
+
+int topk_add(topk_t *t, char const *name, uint64_t weight, /* {{{ */
+             uint64_t const sums[TOPK_SUMS_NUM]) {
+  topk_entry_t *e = NULL;
+
+  if ((t == NULL) || (name == NULL))
+    return EINVAL;
+
+  if (c_avl_get(t->index, name, (void *)&e) != 0) {
+    if (t->num < t->capacity) {
+      e = t->entries + t->num;
+      e->heap_index = t->num;
+      t->heap[t->num] = e;
+      t->num++;
+    } else {
+      /* Replace the lightest item. Its count becomes the error bound of the
+       * new item. */
+      e = t->heap[0];
+      c_avl_remove(t->index, e->item.name, /* key = */ NULL,
+                   /* value = */ NULL);
+      e->item.error = e->item.count;
+    }
+
+    sstrncpy(e->item.name, name, sizeof(e->item.name));
+    memset(e->item.sums, 0, sizeof(e->item.sums));
+    if (c_avl_insert(t->index, e->item.name, e) != 0)
+      return ENOMEM;
+
+    /* A new entry at the end of the heap has a count of zero. */
+    topk_sift_up(t, e->heap_index);
+  }
+
+  e->item.count += weight;
+  if (sums != NULL)
+    for (size_t i = 0; i < TOPK_SUMS_NUM; i++)
+      e->item.sums[i] += sums[i];
+
+  topk_sift_down(t, e->heap_index);
+  return 0;
+} /* }}} int topk_add */
+
+void topk_decay(topk_t *t) /* {{{ */
+{
+  if (t == NULL)
+    return;
+
+  /* Halving is monotonic, so the heap order is preserved. */
+  for (size_t i = 0; i < t->num; i++) {
+    t->entries[i].item.count /= 2;
+    t->entries[i].item.error /= 2;
+  }
+} /* }}} void topk_decay */
+
+static int topk_compare_desc(const void *a, const void *b) /* {{{ */
+{
+  uint64_t ca = ((const topk_item_t *)a)->count;
+  uint64_t cb = ((const topk_item_t *)b)->count;
+
+  return (ca < cb) ? 1 : (ca > cb) ? -1 : 0;
+} /* }}} int topk_compare_desc */
+
+size_t topk_get(topk_t *t, topk_item_t *items, size_t num) /* {{{ */
+{
+  if ((t == NULL) || (items == NULL) || (num == 0) || (t->num == 0))
+    return 0;
+
+  topk_item_t *all = calloc(t->num, sizeof(*all));
+  if (all == NULL)
+    return 0;
+
+  for (size_t i = 0; i < t->num; i++)
+    all[i] = t->entries[i].item;
+  qsort(all, t->num, sizeof(*all), topk_compare_desc);
+
+  if (num > t->num)
+    num = t->num;
+  memcpy(items, all, num * sizeof(*items));
+
+  sfree(all);
+  return num;
+} /* }}} size_t topk_get */
@@ -0,0 +1,105 @@
+/**
+ * collectd - src/utils_topk.h
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef UTILS_TOPK_H
+#define UTILS_TOPK_H 1
+
+#include "collectd.h"
+
+#include "plugin.h" /* for DATA_MAX_NAME_LEN */
+
+/* Number of exact sums kept for every item, see topk_add(). */
+#define TOPK_SUMS_NUM 3
+
+struct topk_s;
+typedef struct topk_s topk_t;
+
+struct topk_item_s {
+  char name[DATA_MAX_NAME_LEN];
+  /* Estimated weight. The true weight is between count - error and count. */
+  uint64_t count;
+  uint64_t error;
+  /* Exact sums since the item (re-)entered the summary. */
+  uint64_t sums[TOPK_SUMS_NUM];
+};
+typedef struct topk_item_s topk_item_t;
+
+/*
+ * NAME
+ *   topk_create
+ *
+ * DESCRIPTION
+ *   Allocates a "Space-Saving" summary which tracks the heaviest items of a
+ *   stream in a fixed amount of memory. Every item whose weight exceeds
+ *   1/capacity of the total weight is guaranteed to be in the summary. The
+ *   summary is not thread-safe.
+ *
+ * PARAMETERS
+ *   `capacity'  Number of items tracked.
+ *
+ * RETURN VALUE
+ *   A topk_t-pointer upon success or NULL upon failure.
+ */
+topk_t *topk_create(size_t capacity);
+
+void topk_destroy(topk_t *t);
+
+/*
+ * NAME
+ *   topk_add
+ *
+ * DESCRIPTION
+ *   Adds `weight' to the item `name'. If the item is not tracked and the
+ *   summary is full, it replaces the lightest item and inherits its count as
+ *   error. `sums' is added to the item's sums; it may be NULL.
+ *
+ * RETURN VALUE
+ *   Zero upon success or an errno value upon failure.
+ */
+int topk_add(topk_t *t, char const *name, uint64_t weight,
+             uint64_t const sums[TOPK_SUMS_NUM]);
+
+/*
+ * NAME
+ *   topk_decay
+ *
+ * DESCRIPTION
+ *   Halves the count and error of all items, so that recent weight counts
+ *   more than old weight. The sums are not changed.
+ */
+void topk_decay(topk_t *t);
+
+/*
+ * NAME
+ *   topk_get
+ *
+ * DESCRIPTION
+ *   Copies up to `num' of the heaviest items to `items', ordered by
+ *   decreasing count.
+ *
+ * RETURN VALUE
+ *   The number of items copied.
+ */
+size_t topk_get(topk_t *t, topk_item_t *items, size_t num);
+
+#endif /* UTILS_TOPK_H */
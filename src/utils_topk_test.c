@@ -0,0 +1,105 @@
+/**
+ * collectd - src/utils_topk_test.c
+ * Copyright (C) 2026       collectd contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "testing.h"
+#include "utils_topk.h"
+
+DEF_TEST(exact) {
+  topk_t *t = topk_create(4);
+  topk_item_t items[4];
+  uint64_t sums[TOPK_SUMS_NUM] = {1, 100, 3};
+
+  CHECK_NOT_NULL(t);
+  EXPECT_EQ_INT(0, (int)topk_get(t, items, 4));
+
+  for (int i = 0; i < 5; i++)
+    CHECK_ZERO(topk_add(t, "a", 1, sums));
+  CHECK_ZERO(topk_add(t, "b", 7, NULL));
+  CHECK_ZERO(topk_add(t, "c", 2, sums));
+
+  EXPECT_EQ_INT(3, (int)topk_get(t, items, 4));
+  EXPECT_EQ_STR("b", items[0].name);
+  EXPECT_EQ_UINT64(7, items[0].count);
+  EXPECT_EQ_STR("a", items[1].name);
+  EXPECT_EQ_UINT64(5, items[1].count);
+  EXPECT_EQ_UINT64(0, items[1].error);
+  EXPECT_EQ_UINT64(500, items[1].sums[1]);
+  EXPECT_EQ_UINT64(3, items[2].sums[2]);
+
+  EXPECT_EQ_INT(1, (int)topk_get(t, items, 1));
+  EXPECT_EQ_STR("b", items[0].name);
+
+  topk_decay(t);
+  EXPECT_EQ_INT(3, (int)topk_get(t, items, 4));
+  EXPECT_EQ_UINT64(3, items[0].count);
+  EXPECT_EQ_UINT64(2, items[1].count);
+  EXPECT_EQ_UINT64(500, items[1].sums[1]);
+
+  topk_destroy(t);
+  return 0;
+}
+
+DEF_TEST(heavy_hitters) {
+  topk_t *t = topk_create(64);
+  topk_item_t items[3];
+  char name[DATA_MAX_NAME_LEN];
+
+  int status = 0;
+
+  CHECK_NOT_NULL(t);
+
+  /* Three heavy senders hidden among 10000 light ones. */
+  for (int i = 0; i < 10000; i++) {
+    snprintf(name, sizeof(name), "light-%d", i);
+    status |= topk_add(t, name, 1, NULL);
+    if ((i % 10) == 0)
+      status |= topk_add(t, "heavy-1", 1, NULL);
+    if ((i % 4) == 0)
+      status |= topk_add(t, "heavy-0", 1, NULL);
+    if ((i % 20) == 0)
+      status |= topk_add(t, "heavy-2", 1, NULL);
+  }
+  EXPECT_EQ_INT(0, status);
+
+  /* The true weight lies within [count - error, count]. */
+  uint64_t want[3] = {2500, 1000, 500};
+  EXPECT_EQ_INT(3, (int)topk_get(t, items, 3));
+  for (int i = 0; i < 3; i++) {
+    snprintf(name, sizeof(name), "heavy-%d", i);
+    EXPECT_EQ_STR(name, items[i].name);
+    OK(items[i].count >= want[i]);
+    OK(items[i].count - items[i].error <= want[i]);
+  }
+
+  topk_destroy(t);
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(exact);
+  RUN_TEST(heavy_hitters);
+
+  END_TEST;
+}
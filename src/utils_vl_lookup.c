@@ -47,6 +47,17 @@ kstat_ctl_t *kc;
   } while (0)
 #endif
 
+/* The cache remembers which user objects match a series, see lu_cache_get().
+ * It is split into shards with a lock each, so that concurrent searches rarely
+ * contend. */
+#define LU_CACHE_SHARDS_NUM 16
+#define LU_CACHE_MIN_BUCKETS 64
+#ifndef LU_CACHE_MAX_ENTRIES
+#define LU_CACHE_MAX_ENTRIES 65536
+#endif
+/* Series matching more user objects than this are not cached. */
+#define LU_CACHE_MAX_MATCHES 16
+
 /*
  * Types
  */
@@ -54,6 +65,11 @@ struct part_match_s {
   char str[DATA_MAX_NAME_LEN];
   regex_t regex;
   _Bool is_regex;
+
+  /* Literals every string matching the regex starts with / contains, see
+   * lu_part_prefilter(). Empty if unknown. */
+  char prefix[DATA_MAX_NAME_LEN];
+  char substr[DATA_MAX_NAME_LEN];
 };
 typedef struct part_match_s part_match_t;
 
@@ -68,17 +84,48 @@ struct identifier_match_s {
 };
 typedef struct identifier_match_s identifier_match_t;
 
+struct user_class_s;
+typedef struct user_class_s user_class_t;
+struct user_obj_s;
+typedef struct user_obj_s user_obj_t;
+
+/* A user object a value list was found to belong to. */
+struct lu_match_s {
+  user_class_t *user_class;
+  user_obj_t *user_obj;
+};
+typedef struct lu_match_s lu_match_t;
+
+struct lu_cache_entry_s;
+typedef struct lu_cache_entry_s lu_cache_entry_t;
+struct lu_cache_entry_s {
+  lu_cache_entry_t *next;
+  uint64_t identity_hash;
+  size_t matches_num;
+  lu_match_t matches[LU_CACHE_MAX_MATCHES];
+  char name[]; /* the identity */
+};
+
+struct lu_cache_shard_s {
+  pthread_mutex_t lock;
+  lu_cache_entry_t **buckets;
+  size_t buckets_num; /* power of two */
+  size_t entries_num;
+  size_t evict_index; /* bucket to look at first when evicting an entry */
+};
+typedef struct lu_cache_shard_s lu_cache_shard_t;
+
 struct lookup_s {
   c_avl_tree_t *by_type_tree;
 
+  lu_cache_shard_t cache[LU_CACHE_SHARDS_NUM];
+
   lookup_class_callback_t cb_user_class;
   lookup_obj_callback_t cb_user_obj;
   lookup_free_class_callback_t cb_free_class;
   lookup_free_obj_callback_t cb_free_obj;
 };
 
-struct user_obj_s;
-typedef struct user_obj_s user_obj_t;
 struct user_obj_s {
   void *user_obj;
   lookup_identifier_t ident;
@@ -92,7 +139,6 @@ struct user_class_s {
   identifier_match_t match;
   user_obj_t *user_obj_list; /* list of user_obj */
 };
-typedef struct user_class_s user_class_t;
 
 struct user_class_list_s;
 typedef struct user_class_list_s user_class_list_t;
@@ -117,6 +163,12 @@ static _Bool lu_part_matches(part_match_t const *match, /* {{{ */
     if (strcmp(".*", match->str) == 0)
       return 1;
 
+    if ((match->prefix[0] != 0) &&
+        (strncmp(str, match->prefix, strlen(match->prefix)) != 0))
+      return 0;
+    if ((match->substr[0] != 0) && (strstr(str, match->substr) == NULL))
+      return 0;
+
     int status = regexec(&match->regex, str,
                          /* nmatch = */ 0, /* pmatch = */ NULL,
                          /* flags = */ 0);
@@ -130,6 +182,113 @@ static _Bool lu_part_matches(part_match_t const *match, /* {{{ */
     return 0;
 } /* }}} _Bool lu_part_matches */
 
+/* Ends the current run of literal characters in lu_part_prefilter(). */
+static void lu_part_prefilter_run(part_match_t *match, /* {{{ */
+                                  char *run, size_t *run_len,
+                                  _Bool *run_is_prefix) {
+  run[*run_len] = 0;
+  if (*run_is_prefix)
+    sstrncpy(match->prefix, run, sizeof(match->prefix));
+  if (*run_len > strlen(match->substr))
+    sstrncpy(match->substr, run, sizeof(match->substr));
+
+  *run_len = 0;
+  *run_is_prefix = 0;
+} /* }}} void lu_part_prefilter_run */
+
+/* Extracts literals from the extended regular expression, which every string
+ * it matches must start with ("prefix", only if the regex is anchored) or
+ * contain ("substr", the longest one). These let lu_part_matches() reject most
+ * non-matching strings without calling regexec(). Regexes with alternations
+ * are left alone; groups, bracket expressions and optional characters end a
+ * literal. */
+static void lu_part_prefilter(part_match_t *match) /* {{{ */
+{
+  char const *re = match->str;
+  char run[DATA_MAX_NAME_LEN];
+  size_t run_len = 0;
+  _Bool run_is_prefix = 0;
+  int depth = 0;
+
+  match->prefix[0] = 0;
+  match->substr[0] = 0;
+
+  if (strchr(re, '|') != NULL)
+    return;
+
+  size_t i = 0;
+  if (re[0] == '^') {
+    run_is_prefix = 1;
+    i++;
+  }
+
+  while (re[i] != 0) {
+    char c = re[i];
+    _Bool literal = 0;
+    size_t len = 1;
+
+    if (c == '\\') {
+      if (re[i + 1] == 0)
+        break;
+      literal = (strchr(".[]()*+?{}|^$\\", re[i + 1]) != NULL);
+      c = re[i + 1];
+      len = 2;
+    } else if (c == '[') {
+      /* Skip the bracket expression. A ']' right after the opening '[' or
+       * "[^" is part of the list, as are the ones closing "[:", "[." and
+       * "[=". */
+      size_t j = i + 1;
+      if (re[j] == '^')
+        j++;
+      if (re[j] == ']')
+        j++;
+      while ((re[j] != 0) && (re[j] != ']')) {
+        if ((re[j] == '[') && (strchr(":.=", re[j + 1]) != NULL) &&
+            (re[j + 1] != 0)) {
+          char const *end = strchr(re + j + 2, ']');
+          if (end == NULL)
+            break;
+          j = (size_t)(end - re);
+        }
+        j++;
+      }
+      len = (re[j] == ']') ? (j - i + 1) : (j - i);
+    } else if (c == '{') {
+      char const *end = strchr(re + i, '}');
+      len = (end != NULL) ? ((size_t)(end - re) - i + 1) : strlen(re + i);
+    } else if (c == '(') {
+      depth++;
+    } else if (c == ')') {
+      depth--;
+    } else {
+      literal = (strchr(".*+?^$", c) == NULL);
+    }
+
+    if (!literal || (depth > 0)) {
+      lu_part_prefilter_run(match, run, &run_len, &run_is_prefix);
+      i += len;
+      continue;
+    }
+
+    /* A character followed by '*', '?' or an interval may not be there at
+     * all. One followed by '+' is there, but may be repeated. */
+    char next = re[i + len];
+    if ((next == '*') || (next == '?') || (next == '{')) {
+      lu_part_prefilter_run(match, run, &run_len, &run_is_prefix);
+      i += len;
+      continue;
+    }
+
+    if (run_len < sizeof(run) - 1)
+      run[run_len++] = c;
+    if (next == '+')
+      lu_part_prefilter_run(match, run, &run_len, &run_is_prefix);
+    i += len;
+  }
+
+  lu_part_prefilter_run(match, run, &run_len, &run_is_prefix);
+} /* }}} void lu_part_prefilter */
+
 static int lu_copy_ident_to_match_part(part_match_t *match_part, /* {{{ */
                                        char const *ident_part) {
   size_t len = strlen(ident_part);
@@ -157,6 +316,7 @@ static int lu_copy_ident_to_match_part(part_match_t *match_part, /* {{{ */
     return EINVAL;
   }
   match_part->is_regex = 1;
+  lu_part_prefilter(match_part);
 
   return 0;
 } /* }}} int lu_copy_ident_to_match_part */
@@ -265,11 +425,14 @@ static user_obj_t *lu_find_user_obj(user_class_t *user_class, /* {{{ */
   return NULL;
 } /* }}} user_obj_t *lu_find_user_obj */
 
-static int lu_handle_user_class(lookup_t *obj, /* {{{ */
-                                data_set_t const *ds, value_list_t const *vl,
-                                user_class_t *user_class) {
+/* Appends the user object of "user_class" the value list belongs to to
+ * "matches", creating it if necessary. Returns 1 if the value list doesn't
+ * match the user class. */
+static int lu_match_user_class(lookup_t *obj, /* {{{ */
+                               data_set_t const *ds, value_list_t const *vl,
+                               user_class_t *user_class, lu_match_t **matches,
+                               size_t *matches_num) {
   user_obj_t *user_obj;
-  int status;
 
   assert(strcmp(vl->type, user_class->match.type.str) == 0);
   assert(user_class->match.plugin.is_regex ||
@@ -282,6 +445,13 @@ static int lu_handle_user_class(lookup_t *obj, /* {{{ */
       !lu_part_matches(&user_class->match.host, vl->host))
     return 1;
 
+  lu_match_t *tmp = realloc(*matches, (*matches_num + 1) * sizeof(**matches));
+  if (tmp == NULL) {
+    ERROR("utils_vl_lookup: realloc failed.");
+    return -1;
+  }
+  *matches = tmp;
+
   pthread_mutex_lock(&user_class->lock);
   user_obj = lu_find_user_obj(user_class, vl);
   if (user_obj == NULL) {
@@ -295,39 +465,219 @@ static int lu_handle_user_class(lookup_t *obj, /* {{{ */
   }
   pthread_mutex_unlock(&user_class->lock);
 
-  status = obj->cb_user_obj(ds, vl, user_class->user_class, user_obj->user_obj);
-  if (status != 0) {
-    ERROR("utils_vl_lookup: The user object callback failed with status %i.",
-          status);
-    /* Returning a negative value means: abort! */
+  (*matches)[*matches_num] =
+      (lu_match_t){.user_class = user_class, .user_obj = user_obj};
+  (*matches_num)++;
+
+  return 0;
+} /* }}} int lu_match_user_class */
+
+static int lu_match_user_class_list(lookup_t *obj, /* {{{ */
+                                    data_set_t const *ds,
+                                    value_list_t const *vl,
+                                    user_class_list_t *user_class_list,
+                                    lu_match_t **matches,
+                                    size_t *matches_num) {
+  for (user_class_list_t *ptr = user_class_list; ptr != NULL;
+       ptr = ptr->next) {
+    int status =
+        lu_match_user_class(obj, ds, vl, &ptr->entry, matches, matches_num);
     if (status < 0)
       return status;
-    else
-      return 1;
   }
 
   return 0;
-} /* }}} int lu_handle_user_class */
+} /* }}} int lu_match_user_class_list */
 
-static int lu_handle_user_class_list(lookup_t *obj, /* {{{ */
-                                     data_set_t const *ds,
-                                     value_list_t const *vl,
-                                     user_class_list_t *user_class_list) {
-  user_class_list_t *ptr;
+/* Calls the user object callback for each match. Returns the number of
+ * successful calls or a negative value if a callback asked to abort. */
+static int lu_handle_matches(lookup_t *obj, /* {{{ */
+                             data_set_t const *ds, value_list_t const *vl,
+                             lu_match_t const *matches, size_t matches_num) {
   int retval = 0;
 
-  for (ptr = user_class_list; ptr != NULL; ptr = ptr->next) {
-    int status;
-
-    status = lu_handle_user_class(obj, ds, vl, &ptr->entry);
-    if (status < 0)
-      return status;
-    else if (status == 0)
-      retval++;
+  for (size_t i = 0; i < matches_num; i++) {
+    int status = obj->cb_user_obj(ds, vl, matches[i].user_class->user_class,
+                                  matches[i].user_obj->user_obj);
+    if (status != 0) {
+      ERROR("utils_vl_lookup: The user object callback failed with status %i.",
+            status);
+      /* Returning a negative value means: abort! */
+      if (status < 0)
+        return status;
+      continue;
+    }
+    retval++;
   }
 
   return retval;
-} /* }}} int lu_handle_user_class_list */
+} /* }}} int lu_handle_matches */
+
+/*
+ * Match cache
+ *
+ * Remembers the matches of a value list by its identity, including "no
+ * matches". User classes and objects are only freed by lookup_destroy(), so
+ * the cached pointers stay valid. lookup_add() clears the cache.
+ * {{{ */
+static size_t lu_cache_bucket(lu_cache_shard_t const *shard, /* {{{ */
+                              uint64_t hash) {
+  /* The low bits select the shard. */
+  return (size_t)((hash >> 4) & (shard->buckets_num - 1));
+} /* }}} size_t lu_cache_bucket */
+
+static lu_cache_shard_t *lu_cache_shard(lookup_t *obj, /* {{{ */
+                                        uint64_t hash) {
+  return &obj->cache[hash % LU_CACHE_SHARDS_NUM];
+} /* }}} lu_cache_shard_t *lu_cache_shard */
+
+/* Doubles the number of buckets. Failing to do so is not an error, the chains
+ * just get longer. */
+static void lu_cache_grow(lu_cache_shard_t *shard) /* {{{ */
+{
+  size_t old_num = shard->buckets_num;
+  lu_cache_entry_t **old = shard->buckets;
+
+  lu_cache_entry_t **tmp = calloc(2 * old_num, sizeof(*tmp));
+  if (tmp == NULL)
+    return;
+
+  shard->buckets = tmp;
+  shard->buckets_num = 2 * old_num;
+  for (size_t i = 0; i < old_num; i++) {
+    while (old[i] != NULL) {
+      lu_cache_entry_t *e = old[i];
+      old[i] = e->next;
+
+      size_t b = lu_cache_bucket(shard, e->identity_hash);
+      e->next = shard->buckets[b];
+      shard->buckets[b] = e;
+    }
+  }
+  sfree(old);
+} /* }}} void lu_cache_grow */
+
+/* Removes the first entry of the next non-empty bucket, i.e. a more or less
+ * random entry. */
+static void lu_cache_evict(lu_cache_shard_t *shard) /* {{{ */
+{
+  for (size_t i = 0; i < shard->buckets_num; i++) {
+    size_t b = (shard->evict_index + i) & (shard->buckets_num - 1);
+    lu_cache_entry_t *e = shard->buckets[b];
+    if (e == NULL)
+      continue;
+
+    shard->buckets[b] = e->next;
+    shard->entries_num--;
+    shard->evict_index = b + 1;
+    sfree(e);
+    return;
+  }
+} /* }}} void lu_cache_evict */
+
+static void lu_cache_clear(lookup_t *obj) /* {{{ */
+{
+  for (size_t i = 0; i < LU_CACHE_SHARDS_NUM; i++) {
+    lu_cache_shard_t *shard = &obj->cache[i];
+
+    pthread_mutex_lock(&shard->lock);
+    for (size_t b = 0; b < shard->buckets_num; b++) {
+      while (shard->buckets[b] != NULL) {
+        lu_cache_entry_t *e = shard->buckets[b];
+        shard->buckets[b] = e->next;
+        sfree(e);
+      }
+    }
+    shard->entries_num = 0;
+    pthread_mutex_unlock(&shard->lock);
+  }
+} /* }}} void lu_cache_clear */
+
+/* shard->lock must be held when calling this function */
+static lu_cache_entry_t **
+lu_cache_lookup(lu_cache_shard_t *shard, /* {{{ */
+                value_list_identity_t const *identity) {
+  if (shard->buckets == NULL)
+    return NULL;
+
+  size_t b = lu_cache_bucket(shard, identity->hash);
+  for (lu_cache_entry_t **e = &shard->buckets[b]; *e != NULL; e = &(*e)->next)
+    if (((*e)->identity_hash == identity->hash) &&
+        (strcmp((*e)->name, identity->name) == 0))
+      return e;
+
+  return NULL;
+} /* }}} lu_cache_entry_t **lu_cache_lookup */
+
+/* Copies the cached matches of "identity" to "matches", which must have room
+ * for LU_CACHE_MAX_MATCHES elements. Returns ENOENT if there are none. */
+static int lu_cache_get(lookup_t *obj, /* {{{ */
+                        value_list_identity_t const *identity,
+                        lu_match_t *matches, size_t *matches_num) {
+  lu_cache_shard_t *shard = lu_cache_shard(obj, identity->hash);
+
+  pthread_mutex_lock(&shard->lock);
+  lu_cache_entry_t **e = lu_cache_lookup(shard, identity);
+  if (e == NULL) {
+    pthread_mutex_unlock(&shard->lock);
+    return ENOENT;
+  }
+
+  *matches_num = (*e)->matches_num;
+  memcpy(matches, (*e)->matches, *matches_num * sizeof(*matches));
+  pthread_mutex_unlock(&shard->lock);
+
+  return 0;
+} /* }}} int lu_cache_get */
+
+static void lu_cache_set(lookup_t *obj, /* {{{ */
+                         value_list_identity_t const *identity,
+                         lu_match_t const *matches, size_t matches_num) {
+  if (matches_num > LU_CACHE_MAX_MATCHES)
+    return;
+
+  size_t name_len = strlen(identity->name);
+  lu_cache_entry_t *new = calloc(1, sizeof(*new) + name_len + 1);
+  if (new == NULL)
+    return;
+  new->identity_hash = identity->hash;
+  new->matches_num = matches_num;
+  memcpy(new->matches, matches, matches_num * sizeof(*matches));
+  memcpy(new->name, identity->name, name_len + 1);
+
+  lu_cache_shard_t *shard = lu_cache_shard(obj, identity->hash);
+  pthread_mutex_lock(&shard->lock);
+
+  if (shard->buckets == NULL) {
+    shard->buckets = calloc(LU_CACHE_MIN_BUCKETS, sizeof(*shard->buckets));
+    if (shard->buckets == NULL) {
+      pthread_mutex_unlock(&shard->lock);
+      sfree(new);
+      return;
+    }
+    shard->buckets_num = LU_CACHE_MIN_BUCKETS;
+  }
+
+  /* Another thread may have added the same series in the meantime. */
+  if (lu_cache_lookup(shard, identity) != NULL) {
+    pthread_mutex_unlock(&shard->lock);
+    sfree(new);
+    return;
+  }
+
+  if (shard->entries_num >= LU_CACHE_MAX_ENTRIES / LU_CACHE_SHARDS_NUM)
+    lu_cache_evict(shard);
+  else if (shard->entries_num >= shard->buckets_num)
+    lu_cache_grow(shard);
+
+  size_t b = lu_cache_bucket(shard, identity->hash);
+  new->next = shard->buckets[b];
+  shard->buckets[b] = new;
+  shard->entries_num++;
+
+  pthread_mutex_unlock(&shard->lock);
+} /* }}} void lu_cache_set */
+/* }}} */
 
 static by_type_entry_t *lu_search_by_type(lookup_t *obj, /* {{{ */
                                           char const *type,
@@ -532,6 +882,9 @@ lookup_t *lookup_create(lookup_class_callback_t cb_user_class, /* {{{ */
     return NULL;
   }
 
+  for (size_t i = 0; i < LU_CACHE_SHARDS_NUM; i++)
+    pthread_mutex_init(&obj->cache[i].lock, /* attr = */ NULL);
+
   obj->cb_user_class = cb_user_class;
   obj->cb_user_obj = cb_user_obj;
   obj->cb_free_class = cb_free_class;
@@ -563,6 +916,12 @@ void lookup_destroy(lookup_t *obj) /* {{{ */
   c_avl_destroy(obj->by_type_tree);
   obj->by_type_tree = NULL;
 
+  lu_cache_clear(obj);
+  for (size_t i = 0; i < LU_CACHE_SHARDS_NUM; i++) {
+    sfree(obj->cache[i].buckets);
+    pthread_mutex_destroy(&obj->cache[i].lock);
+  }
+
   sfree(obj);
 } /* }}} void lookup_destroy */
 
@@ -587,6 +946,9 @@ int lookup_add(lookup_t *obj, /* {{{ */
   user_class_obj->entry.user_obj_list = NULL;
   user_class_obj->next = NULL;
 
+  /* Cached results don't know about the new user class. */
+  lu_cache_clear(obj);
+
   return lu_add_by_plugin(by_type, user_class_obj);
 } /* }}} int lookup_add */
 
@@ -595,32 +957,48 @@ int lookup_search(lookup_t *obj, /* {{{ */
                   data_set_t const *ds, value_list_t const *vl) {
   by_type_entry_t *by_type = NULL;
   user_class_list_t *user_class_list = NULL;
-  int retval = 0;
+  lu_match_t *matches = NULL;
+  size_t matches_num = 0;
   int status;
 
   if ((obj == NULL) || (ds == NULL) || (vl == NULL))
     return -EINVAL;
 
-  by_type = lu_search_by_type(obj, vl->type, /* allocate = */ 0);
-  if (by_type == NULL)
-    return 0;
+  value_list_identity_t const *identity = VALUE_LIST_IDENTITY(vl);
+  if (identity != NULL) {
+    lu_match_t cached[LU_CACHE_MAX_MATCHES];
+    size_t cached_num = 0;
 
-  status =
-      c_avl_get(by_type->by_plugin_tree, vl->plugin, (void *)&user_class_list);
-  if (status == 0) {
-    status = lu_handle_user_class_list(obj, ds, vl, user_class_list);
-    if (status < 0)
-      return status;
-    retval += status;
+    if (lu_cache_get(obj, identity, cached, &cached_num) == 0)
+      return lu_handle_matches(obj, ds, vl, cached, cached_num);
   }
 
-  if (by_type->wildcard_plugin_list != NULL) {
-    status =
-        lu_handle_user_class_list(obj, ds, vl, by_type->wildcard_plugin_list);
-    if (status < 0)
+  by_type = lu_search_by_type(obj, vl->type, /* allocate = */ 0);
+  if (by_type != NULL) {
+    status = c_avl_get(by_type->by_plugin_tree, vl->plugin,
+                       (void *)&user_class_list);
+    if (status == 0) {
+      status = lu_match_user_class_list(obj, ds, vl, user_class_list, &matches,
+                                        &matches_num);
+      if (status < 0) {
+        sfree(matches);
+        return status;
+      }
+    }
+
+    status = lu_match_user_class_list(obj, ds, vl,
+                                      by_type->wildcard_plugin_list, &matches,
+                                      &matches_num);
+    if (status < 0) {
+      sfree(matches);
       return status;
-    retval += status;
+    }
   }
 
-  return retval;
+  if (identity != NULL)
+    lu_cache_set(obj, identity, matches, matches_num);
+
+  status = lu_handle_matches(obj, ds, vl, matches, matches_num);
+  sfree(matches);
+  return status;
 } /* }}} lookup_search */
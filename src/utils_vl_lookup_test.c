@@ -25,6 +25,7 @@
  **/
 
 #include "collectd.h"
+#include "common.h" /* for STATIC_ARRAY_SIZE */
 
 #include "testing.h"
 #include "utils_vl_lookup.h"
@@ -102,12 +103,29 @@ static int checked_lookup_add(lookup_t *obj, /* {{{ */
   return 0;
 } /* }}} int checked_lookup_add */
 
-static int checked_lookup_search(lookup_t *obj, char const *host,
-                                 char const *plugin,
-                                 char const *plugin_instance, char const *type,
-                                 char const *type_instance, _Bool expect_new) {
+/* Sets the identity the daemon computes when dispatching a value list, so
+ * that lookup_search() caches its result. */
+static void set_identity(value_list_t *vl, value_list_identity_t *identity) {
+  snprintf(identity->name, sizeof(identity->name), "%s/%s-%s/%s-%s", vl->host,
+           vl->plugin, vl->plugin_instance, vl->type, vl->type_instance);
+  identity->hash = 14695981039346656037ULL;
+  for (char const *c = identity->name; *c != 0; c++)
+    identity->hash = (identity->hash ^ (uint8_t)*c) * 1099511628211ULL;
+
+  vl->identity = identity;
+  vl->identity_owner = vl;
+}
+
+static int checked_lookup_search_identity(lookup_t *obj, char const *host,
+                                          char const *plugin,
+                                          char const *plugin_instance,
+                                          char const *type,
+                                          char const *type_instance,
+                                          _Bool expect_new,
+                                          _Bool with_identity) {
   int status;
   value_list_t vl = VALUE_LIST_INIT;
+  value_list_identity_t identity;
   data_set_t const *ds = &ds_unknown;
 
   strncpy(vl.host, host, sizeof(vl.host));
@@ -116,6 +134,9 @@ static int checked_lookup_search(lookup_t *obj, char const *host,
   strncpy(vl.type, type, sizeof(vl.type));
   strncpy(vl.type_instance, type_instance, sizeof(vl.type_instance));
 
+  if (with_identity)
+    set_identity(&vl, &identity);
+
   if (strcmp(vl.type, "test") == 0)
     ds = &ds_test;
 
@@ -126,6 +147,25 @@ static int checked_lookup_search(lookup_t *obj, char const *host,
   return status;
 }
 
+static int checked_lookup_search(lookup_t *obj, char const *host,
+                                 char const *plugin,
+                                 char const *plugin_instance, char const *type,
+                                 char const *type_instance, _Bool expect_new) {
+  return checked_lookup_search_identity(obj, host, plugin, plugin_instance,
+                                        type, type_instance, expect_new,
+                                        /* with_identity = */ 0);
+}
+
+static int count_obj_callback(data_set_t const *ds, value_list_t const *vl,
+                              void *user_class, void *user_obj) {
+  return 0;
+}
+
+static void *count_class_callback(data_set_t const *ds, value_list_t const *vl,
+                                  void *user_class) {
+  return malloc(1);
+}
+
 DEF_TEST(group_by_specific_host) {
   lookup_t *obj;
   CHECK_NOT_NULL(obj = lookup_create(lookup_class_callback, lookup_obj_callback,
@@ -231,12 +271,136 @@ DEF_TEST(regex) {
   return 0;
 }
 
+DEF_TEST(regex_prefilter) {
+  struct {
+    char const *regex;
+    char const *host;
+    _Bool want;
+  } cases[] = {
+      {"/^db[0-9]\\.example/", "db0.example.com", 1},
+      {"/^db[0-9]\\.example/", "xdb0.example.com", 0},
+      {"/^db[0-9]\\.example/", "db0-example.com", 0},
+      {"/colou?r/", "color", 1},
+      {"/colou?r/", "colour", 1},
+      {"/colou?r/", "colr", 0},
+      {"/^a+b/", "aaab", 1},
+      {"/^x*web/", "web", 1},
+      {"/[[:digit:]]]/", "1]", 1},
+      {"/[]a]bc/", "]bc", 1},
+      {"/(ab)?cd/", "cd", 1},
+      {"/web|db/", "db", 1},
+      {"/example\\.com$/", "example.com", 1},
+      {"/example\\.com$/", "example.org", 0},
+      {"/^web-[0-9]{2}-prod/", "web-01-prod", 1},
+      {"/^web-[0-9]{2}-prod/", "web-01-test", 0},
+  };
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(cases); i++) {
+    lookup_t *obj;
+    CHECK_NOT_NULL(obj = lookup_create(lookup_class_callback,
+                                       lookup_obj_callback, (void *)free,
+                                       (void *)free));
+
+    printf("# regex %s, host %s\n", cases[i].regex, cases[i].host);
+    checked_lookup_add(obj, cases[i].regex, "test", "", "test", "/.*/",
+                       LU_GROUP_BY_HOST);
+    EXPECT_EQ_INT(cases[i].want ? 1 : 0,
+                  checked_lookup_search(obj, cases[i].host, "test", "", "test",
+                                        "0", /* expect new = */ cases[i].want));
+
+    lookup_destroy(obj);
+  }
+
+  return 0;
+}
+
+DEF_TEST(cache) {
+  lookup_t *obj;
+  CHECK_NOT_NULL(obj = lookup_create(lookup_class_callback, lookup_obj_callback,
+                                     (void *)free, (void *)free));
+
+  checked_lookup_add(obj, "/.*/", "test", "", "test", "/.*/", LU_GROUP_BY_HOST);
+  EXPECT_EQ_INT(1, checked_lookup_search_identity(
+                       obj, "host0", "test", "", "test", "0",
+                       /* expect new = */ 1, /* with identity = */ 1));
+  /* Served from the cache. */
+  EXPECT_EQ_INT(1, checked_lookup_search_identity(
+                       obj, "host0", "test", "", "test", "0",
+                       /* expect new = */ 0, /* with identity = */ 1));
+  EXPECT_EQ_INT(0, checked_lookup_search_identity(
+                       obj, "host0", "other", "", "test", "0",
+                       /* expect new = */ 0, /* with identity = */ 1));
+  EXPECT_EQ_INT(0, checked_lookup_search_identity(
+                       obj, "host0", "other", "", "test", "0",
+                       /* expect new = */ 0, /* with identity = */ 1));
+
+  /* Adding a user class invalidates the cache. */
+  checked_lookup_add(obj, "/.*/", "/.*/", "", "test", "/.*/", 0);
+  EXPECT_EQ_INT(1, checked_lookup_search_identity(
+                       obj, "host0", "other", "", "test", "0",
+                       /* expect new = */ 1, /* with identity = */ 1));
+  EXPECT_EQ_INT(2, checked_lookup_search_identity(
+                       obj, "host0", "test", "", "test", "0",
+                       /* expect new = */ 0, /* with identity = */ 1));
+
+  lookup_destroy(obj);
+  return 0;
+}
+
+DEF_TEST(throughput) {
+  lookup_t *obj;
+  CHECK_NOT_NULL(obj = lookup_create(count_class_callback, count_obj_callback,
+                                     (void *)free, (void *)free));
+
+  checked_lookup_add(obj, "/^host[0-9]+$/", "/^cpu/", "/.*/", "test",
+                     "/^(user|system)$/", LU_GROUP_BY_HOST);
+  checked_lookup_add(obj, "/^db/", "/.*/", "/.*/", "test", "/.*/",
+                     LU_GROUP_BY_HOST);
+
+  enum { SERIES_NUM = 1000, ROUNDS_NUM = 100 };
+  static value_list_t vls[SERIES_NUM];
+  static value_list_identity_t identities[SERIES_NUM];
+  for (size_t i = 0; i < SERIES_NUM; i++) {
+    value_list_t *vl = &vls[i];
+    *vl = (value_list_t)VALUE_LIST_INIT;
+    snprintf(vl->host, sizeof(vl->host), "host%zu", i % 100);
+    snprintf(vl->plugin, sizeof(vl->plugin), "cpu");
+    snprintf(vl->plugin_instance, sizeof(vl->plugin_instance), "%zu", i / 100);
+    snprintf(vl->type, sizeof(vl->type), "test");
+    snprintf(vl->type_instance, sizeof(vl->type_instance), "%s",
+             (i % 2) ? "user" : "idle");
+    set_identity(vl, &identities[i]);
+  }
+
+  struct timespec begin;
+  struct timespec end;
+  clock_gettime(CLOCK_MONOTONIC, &begin);
+
+  int matches = 0;
+  for (size_t round = 0; round < ROUNDS_NUM; round++)
+    for (size_t i = 0; i < SERIES_NUM; i++)
+      matches += lookup_search(obj, &ds_test, &vls[i]);
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  double elapsed = (double)(end.tv_sec - begin.tv_sec) +
+                   1e-9 * (double)(end.tv_nsec - begin.tv_nsec);
+  printf("# %d searches in %.3f s\n", SERIES_NUM * ROUNDS_NUM, elapsed);
+
+  EXPECT_EQ_INT(SERIES_NUM * ROUNDS_NUM / 2, matches);
+
+  lookup_destroy(obj);
+  return 0;
+}
+
 int main(int argc, char **argv) /* {{{ */
 {
   RUN_TEST(group_by_specific_host);
   RUN_TEST(group_by_any_host);
   RUN_TEST(multiple_lookups);
   RUN_TEST(regex);
+  RUN_TEST(regex_prefilter);
+  RUN_TEST(cache);
+  RUN_TEST(throughput);
 
   END_TEST;
 } /* }}} int main */
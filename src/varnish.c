@@ -46,6 +46,19 @@ typedef struct VSC_C_main c_varnish_stats_t;
 typedef struct varnish_stats c_varnish_stats_t;
 #endif
 
+#if HAVE_VARNISH_V3 || HAVE_VARNISH_V4 || HAVE_VARNISH_V5
+/* A counter in Varnish's shared memory and how it is submitted. The strings
+ * are literals. */
+struct varnish_counter_s {
+  const volatile uint64_t *ptr;
+  int ds_type;
+  const char *category;
+  const char *type;
+  const char *type_instance;
+};
+typedef struct varnish_counter_s varnish_counter_t;
+#endif
+
 /* {{{ user_config_s */
 struct user_config_s {
   char *instance;
@@ -90,6 +103,23 @@ struct user_config_s {
   _Bool collect_vbe;
   _Bool collect_mse;
 #endif
+
+#if HAVE_VARNISH_V3 || HAVE_VARNISH_V4 || HAVE_VARNISH_V5
+  /* The shared memory stays attached between reads. The counters are
+   * resolved when attaching and read directly from shared memory. */
+#if HAVE_VARNISH_V3 || HAVE_VARNISH_V4
+  struct VSM_data *vd;
+#elif HAVE_VARNISH_V5
+  struct vsm *vd;
+  struct vsc *vsc;
+#endif
+#if HAVE_VARNISH_V4
+  struct VSM_fantom main_fantom;
+#endif
+  varnish_counter_t *counters;
+  size_t counters_num;
+  size_t counters_size;
+#endif
 };
 typedef struct user_config_s user_config_t; /* }}} */
 
@@ -139,11 +169,53 @@ static int varnish_submit_derive(const char *plugin_instance, /* {{{ */
 } /* }}} int varnish_submit_derive */
 
 #if HAVE_VARNISH_V3 || HAVE_VARNISH_V4 || HAVE_VARNISH_V5
-static int varnish_monitor(void *priv,
+static int varnish_bind(user_config_t *conf, int ds_type, /* {{{ */
+                        const char *category, const char *type,
+                        const char *type_instance, const volatile void *ptr) {
+  if (conf->counters_num >= conf->counters_size) {
+    size_t size = (conf->counters_size == 0) ? 64 : 2 * conf->counters_size;
+    varnish_counter_t *tmp = realloc(conf->counters, size * sizeof(*tmp));
+    if (tmp == NULL) {
+      ERROR("varnish plugin: realloc failed.");
+      return ENOMEM;
+    }
+    conf->counters = tmp;
+    conf->counters_size = size;
+  }
+
+  conf->counters[conf->counters_num] = (varnish_counter_t){
+      .ptr = ptr,
+      .ds_type = ds_type,
+      .category = category,
+      .type = type,
+      .type_instance = type_instance,
+  };
+  conf->counters_num++;
+  return 0;
+} /* }}} int varnish_bind */
+
+static int varnish_bind_gauge(user_config_t *conf, /* {{{ */
+                              const char *category, const char *type,
+                              const char *type_instance,
+                              const volatile void *ptr) {
+  return varnish_bind(conf, DS_TYPE_GAUGE, category, type, type_instance, ptr);
+} /* }}} int varnish_bind_gauge */
+
+static int varnish_bind_derive(user_config_t *conf, /* {{{ */
+                               const char *category, const char *type,
+                               const char *type_instance,
+                               const volatile void *ptr) {
+  return varnish_bind(conf, DS_TYPE_DERIVE, category, type, type_instance,
+                      ptr);
+} /* }}} int varnish_bind_derive */
+
+/* Called by VSC_Iter() when attaching. Records the counters selected by the
+ * configuration, so that reading them doesn't require iterating over all
+ * counters and comparing their names. */
+static int varnish_resolve(void *priv,
                            const struct VSC_point *const pt) /* {{{ */
 {
-  uint64_t val;
-  const user_config_t *conf;
+  user_config_t *conf;
   const char *name;
 
   if (pt == NULL)
@@ -173,820 +245,795 @@ static int varnish_monitor(void *priv,
   name = pt->name;
 #endif
 
-  val = *(const volatile uint64_t *)pt->ptr;
-
   if (conf->collect_cache) {
     if (strcmp(name, "cache_hit") == 0)
-      return varnish_submit_derive(conf->instance, "cache", "cache_result",
-                                   "hit", val);
+      return varnish_bind_derive(conf, "cache", "cache_result", "hit", pt->ptr);
     else if (strcmp(name, "cache_miss") == 0)
-      return varnish_submit_derive(conf->instance, "cache", "cache_result",
-                                   "miss", val);
+      return varnish_bind_derive(conf, "cache", "cache_result", "miss",
+                                 pt->ptr);
     else if (strcmp(name, "cache_hitpass") == 0)
-      return varnish_submit_derive(conf->instance, "cache", "cache_result",
-                                   "hitpass", val);
+      return varnish_bind_derive(conf, "cache", "cache_result", "hitpass",
+                                 pt->ptr);
   }
 
   if (conf->collect_connections) {
     if (strcmp(name, "client_conn") == 0)
-      return varnish_submit_derive(conf->instance, "connections", "connections",
-                                   "accepted", val);
+      return varnish_bind_derive(conf, "connections", "connections", "accepted",
+                                 pt->ptr);
     else if (strcmp(name, "client_drop") == 0)
-      return varnish_submit_derive(conf->instance, "connections", "connections",
-                                   "dropped", val);
+      return varnish_bind_derive(conf, "connections", "connections", "dropped",
+                                 pt->ptr);
     else if (strcmp(name, "client_req") == 0)
-      return varnish_submit_derive(conf->instance, "connections", "connections",
-                                   "received", val);
+      return varnish_bind_derive(conf, "connections", "connections", "received",
+                                 pt->ptr);
 #if HAVE_VARNISH_V4 || HAVE_VARNISH_V5
     else if (strcmp(name, "client_req_400") == 0)
-      return varnish_submit_derive(conf->instance, "connections", "connections",
-                                   "error_400", val);
+      return varnish_bind_derive(conf, "connections", "connections",
+                                 "error_400", pt->ptr);
     else if (strcmp(name, "client_req_417") == 0)
-      return varnish_submit_derive(conf->instance, "connections", "connections",
-                                   "error_417", val);
+      return varnish_bind_derive(conf, "connections", "connections",
+                                 "error_417", pt->ptr);
 #endif
   }
 
 #ifdef HAVE_VARNISH_V3
   if (conf->collect_dirdns) {
     if (strcmp(name, "dir_dns_lookups") == 0)
-      return varnish_submit_derive(conf->instance, "dirdns", "cache_operation",
-                                   "lookups", val);
+      return varnish_bind_derive(conf, "dirdns", "cache_operation", "lookups",
+                                 pt->ptr);
     else if (strcmp(name, "dir_dns_failed") == 0)
-      return varnish_submit_derive(conf->instance, "dirdns", "cache_result",
-                                   "failed", val);
+      return varnish_bind_derive(conf, "dirdns", "cache_result", "failed",
+                                 pt->ptr);
     else if (strcmp(name, "dir_dns_hit") == 0)
-      return varnish_submit_derive(conf->instance, "dirdns", "cache_result",
-                                   "hits", val);
+      return varnish_bind_derive(conf, "dirdns", "cache_result", "hits",
+                                 pt->ptr);
     else if (strcmp(name, "dir_dns_cache_full") == 0)
-      return varnish_submit_derive(conf->instance, "dirdns", "cache_result",
-                                   "cache_full", val);
+      return varnish_bind_derive(conf, "dirdns", "cache_result", "cache_full",
+                                 pt->ptr);
   }
 #endif
 
   if (conf->collect_esi) {
     if (strcmp(name, "esi_errors") == 0)
-      return varnish_submit_derive(conf->instance, "esi", "total_operations",
-                                   "error", val);
+      return varnish_bind_derive(conf, "esi", "total_operations", "error",
+                                 pt->ptr);
     else if (strcmp(name, "esi_parse") == 0)
-      return varnish_submit_derive(conf->instance, "esi", "total_operations",
-                                   "parsed", val);
+      return varnish_bind_derive(conf, "esi", "total_operations", "parsed",
+                                 pt->ptr);
     else if (strcmp(name, "esi_warnings") == 0)
-      return varnish_submit_derive(conf->instance, "esi", "total_operations",
-                                   "warning", val);
+      return varnish_bind_derive(conf, "esi", "total_operations", "warning",
+                                 pt->ptr);
     else if (strcmp(name, "esi_maxdepth") == 0)
-      return varnish_submit_derive(conf->instance, "esi", "total_operations",
-                                   "max_depth", val);
+      return varnish_bind_derive(conf, "esi", "total_operations", "max_depth",
+                                 pt->ptr);
   }
 
   if (conf->collect_backend) {
     if (strcmp(name, "backend_conn") == 0)
-      return varnish_submit_derive(conf->instance, "backend", "connections",
-                                   "success", val);
+      return varnish_bind_derive(conf, "backend", "connections", "success",
+                                 pt->ptr);
     else if (strcmp(name, "backend_unhealthy") == 0)
-      return varnish_submit_derive(conf->instance, "backend", "connections",
-                                   "not-attempted", val);
+      return varnish_bind_derive(conf, "backend", "connections",
+                                 "not-attempted", pt->ptr);
     else if (strcmp(name, "backend_busy") == 0)
-      return varnish_submit_derive(conf->instance, "backend", "connections",
-                                   "too-many", val);
+      return varnish_bind_derive(conf, "backend", "connections", "too-many",
+                                 pt->ptr);
     else if (strcmp(name, "backend_fail") == 0)
-      return varnish_submit_derive(conf->instance, "backend", "connections",
-                                   "failures", val);
+      return varnish_bind_derive(conf, "backend", "connections", "failures",
+                                 pt->ptr);
     else if (strcmp(name, "backend_reuse") == 0)
-      return varnish_submit_derive(conf->instance, "backend", "connections",
-                                   "reuses", val);
+      return varnish_bind_derive(conf, "backend", "connections", "reuses",
+                                 pt->ptr);
     else if (strcmp(name, "backend_toolate") == 0)
-      return varnish_submit_derive(conf->instance, "backend", "connections",
-                                   "was-closed", val);
+      return varnish_bind_derive(conf, "backend", "connections", "was-closed",
+                                 pt->ptr);
     else if (strcmp(name, "backend_recycle") == 0)
-      return varnish_submit_derive(conf->instance, "backend", "connections",
-                                   "recycled", val);
+      return varnish_bind_derive(conf, "backend", "connections", "recycled",
+                                 pt->ptr);
     else if (strcmp(name, "backend_unused") == 0)
-      return varnish_submit_derive(conf->instance, "backend", "connections",
-                                   "unused", val);
+      return varnish_bind_derive(conf, "backend", "connections", "unused",
+                                 pt->ptr);
     else if (strcmp(name, "backend_retry") == 0)
-      return varnish_submit_derive(conf->instance, "backend", "connections",
-                                   "retries", val);
+      return varnish_bind_derive(conf, "backend", "connections", "retries",
+                                 pt->ptr);
     else if (strcmp(name, "backend_req") == 0)
-      return varnish_submit_derive(conf->instance, "backend", "http_requests",
-                                   "requests", val);
+      return varnish_bind_derive(conf, "backend", "http_requests", "requests",
+                                 pt->ptr);
     else if (strcmp(name, "n_backend") == 0)
-      return varnish_submit_gauge(conf->instance, "backend", "backends",
-                                  "n_backends", val);
+      return varnish_bind_gauge(conf, "backend", "backends", "n_backends",
+                                pt->ptr);
   }
 
   if (conf->collect_fetch) {
     if (strcmp(name, "fetch_head") == 0)
-      return varnish_submit_derive(conf->instance, "fetch", "http_requests",
-                                   "head", val);
+      return varnish_bind_derive(conf, "fetch", "http_requests", "head",
+                                 pt->ptr);
     else if (strcmp(name, "fetch_length") == 0)
-      return varnish_submit_derive(conf->instance, "fetch", "http_requests",
-                                   "length", val);
+      return varnish_bind_derive(conf, "fetch", "http_requests", "length",
+                                 pt->ptr);
     else if (strcmp(name, "fetch_chunked") == 0)
-      return varnish_submit_derive(conf->instance, "fetch", "http_requests",
-                                   "chunked", val);
+      return varnish_bind_derive(conf, "fetch", "http_requests", "chunked",
+                                 pt->ptr);
     else if (strcmp(name, "fetch_eof") == 0)
-      return varnish_submit_derive(conf->instance, "fetch", "http_requests",
-                                   "eof", val);
+      return varnish_bind_derive(conf, "fetch", "http_requests", "eof",
+                                 pt->ptr);
     else if (strcmp(name, "fetch_bad") == 0)
-      return varnish_submit_derive(conf->instance, "fetch", "http_requests",
-                                   "bad_headers", val);
+      return varnish_bind_derive(conf, "fetch", "http_requests", "bad_headers",
+                                 pt->ptr);
     else if (strcmp(name, "fetch_close") == 0)
-      return varnish_submit_derive(conf->instance, "fetch", "http_requests",
-                                   "close", val);
+      return varnish_bind_derive(conf, "fetch", "http_requests", "close",
+                                 pt->ptr);
     else if (strcmp(name, "fetch_oldhttp") == 0)
-      return varnish_submit_derive(conf->instance, "fetch", "http_requests",
-                                   "oldhttp", val);
+      return varnish_bind_derive(conf, "fetch", "http_requests", "oldhttp",
+                                 pt->ptr);
     else if (strcmp(name, "fetch_zero") == 0)
-      return varnish_submit_derive(conf->instance, "fetch", "http_requests",
-                                   "zero", val);
+      return varnish_bind_derive(conf, "fetch", "http_requests", "zero",
+                                 pt->ptr);
     else if (strcmp(name, "fetch_failed") == 0)
-      return varnish_submit_derive(conf->instance, "fetch", "http_requests",
-                                   "failed", val);
+      return varnish_bind_derive(conf, "fetch", "http_requests", "failed",
+                                 pt->ptr);
     else if (strcmp(name, "fetch_1xx") == 0)
-      return varnish_submit_derive(conf->instance, "fetch", "http_requests",
-                                   "no_body_1xx", val);
+      return varnish_bind_derive(conf, "fetch", "http_requests", "no_body_1xx",
+                                 pt->ptr);
     else if (strcmp(name, "fetch_204") == 0)
-      return varnish_submit_derive(conf->instance, "fetch", "http_requests",
-                                   "no_body_204", val);
+      return varnish_bind_derive(conf, "fetch", "http_requests", "no_body_204",
+                                 pt->ptr);
     else if (strcmp(name, "fetch_304") == 0)
-      return varnish_submit_derive(conf->instance, "fetch", "http_requests",
-                                   "no_body_304", val);
+      return varnish_bind_derive(conf, "fetch", "http_requests", "no_body_304",
+                                 pt->ptr);
 #if HAVE_VARNISH_V4 || HAVE_VARNISH_V5
     else if (strcmp(name, "fetch_no_thread") == 0)
-      return varnish_submit_derive(conf->instance, "fetch", "http_requests",
-                                   "no_thread", val);
+      return varnish_bind_derive(conf, "fetch", "http_requests", "no_thread",
+                                 pt->ptr);
     else if (strcmp(name, "fetch_none") == 0)
-      return varnish_submit_derive(conf->instance, "fetch", "http_requests",
-                                   "none", val);
+      return varnish_bind_derive(conf, "fetch", "http_requests", "none",
+                                 pt->ptr);
     else if (strcmp(name, "busy_sleep") == 0)
-      return varnish_submit_derive(conf->instance, "fetch", "http_requests",
-                                   "busy_sleep", val);
+      return varnish_bind_derive(conf, "fetch", "http_requests", "busy_sleep",
+                                 pt->ptr);
     else if (strcmp(name, "busy_wakeup") == 0)
-      return varnish_submit_derive(conf->instance, "fetch", "http_requests",
-                                   "busy_wakeup", val);
+      return varnish_bind_derive(conf, "fetch", "http_requests", "busy_wakeup",
+                                 pt->ptr);
 #endif
   }
 
   if (conf->collect_hcb) {
     if (strcmp(name, "hcb_nolock") == 0)
-      return varnish_submit_derive(conf->instance, "hcb", "cache_operation",
-                                   "lookup_nolock", val);
+      return varnish_bind_derive(conf, "hcb", "cache_operation",
+                                 "lookup_nolock", pt->ptr);
     else if (strcmp(name, "hcb_lock") == 0)
-      return varnish_submit_derive(conf->instance, "hcb", "cache_operation",
-                                   "lookup_lock", val);
+      return varnish_bind_derive(conf, "hcb", "cache_operation", "lookup_lock",
+                                 pt->ptr);
     else if (strcmp(name, "hcb_insert") == 0)
-      return varnish_submit_derive(conf->instance, "hcb", "cache_operation",
-                                   "insert", val);
+      return varnish_bind_derive(conf, "hcb", "cache_operation", "insert",
+                                 pt->ptr);
   }
 
   if (conf->collect_objects) {
     if (strcmp(name, "n_expired") == 0)
-      return varnish_submit_derive(conf->instance, "objects", "total_objects",
-                                   "expired", val);
+      return varnish_bind_derive(conf, "objects", "total_objects", "expired",
+                                 pt->ptr);
     else if (strcmp(name, "n_lru_nuked") == 0)
-      return varnish_submit_derive(conf->instance, "objects", "total_objects",
-                                   "lru_nuked", val);
+      return varnish_bind_derive(conf, "objects", "total_objects", "lru_nuked",
+                                 pt->ptr);
     else if (strcmp(name, "n_lru_saved") == 0)
-      return varnish_submit_derive(conf->instance, "objects", "total_objects",
-                                   "lru_saved", val);
+      return varnish_bind_derive(conf, "objects", "total_objects", "lru_saved",
+                                 pt->ptr);
     else if (strcmp(name, "n_lru_moved") == 0)
-      return varnish_submit_derive(conf->instance, "objects", "total_objects",
-                                   "lru_moved", val);
+      return varnish_bind_derive(conf, "objects", "total_objects", "lru_moved",
+                                 pt->ptr);
     else if (strcmp(name, "n_deathrow") == 0)
-      return varnish_submit_derive(conf->instance, "objects", "total_objects",
-                                   "deathrow", val);
+      return varnish_bind_derive(conf, "objects", "total_objects", "deathrow",
+                                 pt->ptr);
     else if (strcmp(name, "losthdr") == 0)
-      return varnish_submit_derive(conf->instance, "objects", "total_objects",
-                                   "header_overflow", val);
+      return varnish_bind_derive(conf, "objects", "total_objects",
+                                 "header_overflow", pt->ptr);
     else if (strcmp(name, "n_obj_purged") == 0)
-      return varnish_submit_derive(conf->instance, "objects", "total_objects",
-                                   "purged", val);
+      return varnish_bind_derive(conf, "objects", "total_objects", "purged",
+                                 pt->ptr);
     else if (strcmp(name, "n_objsendfile") == 0)
-      return varnish_submit_derive(conf->instance, "objects", "total_objects",
-                                   "sent_sendfile", val);
+      return varnish_bind_derive(conf, "objects", "total_objects",
+                                 "sent_sendfile", pt->ptr);
     else if (strcmp(name, "n_objwrite") == 0)
-      return varnish_submit_derive(conf->instance, "objects", "total_objects",
-                                   "sent_write", val);
+      return varnish_bind_derive(conf, "objects", "total_objects", "sent_write",
+                                 pt->ptr);
     else if (strcmp(name, "n_objoverflow") == 0)
-      return varnish_submit_derive(conf->instance, "objects", "total_objects",
-                                   "workspace_overflow", val);
+      return varnish_bind_derive(conf, "objects", "total_objects",
+                                 "workspace_overflow", pt->ptr);
 #if HAVE_VARNISH_V4 || HAVE_VARNISH_V5
     else if (strcmp(name, "exp_mailed") == 0)
-      return varnish_submit_gauge(conf->instance, "struct", "objects",
-                                  "exp_mailed", val);
+      return varnish_bind_gauge(conf, "struct", "objects", "exp_mailed",
+                                pt->ptr);
     else if (strcmp(name, "exp_received") == 0)
-      return varnish_submit_gauge(conf->instance, "struct", "objects",
-                                  "exp_received", val);
+      return varnish_bind_gauge(conf, "struct", "objects", "exp_received",
+                                pt->ptr);
 #endif
   }
 
 #if HAVE_VARNISH_V3
   if (conf->collect_ban) {
     if (strcmp(name, "n_ban") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_operations",
-                                   "total", val);
+      return varnish_bind_derive(conf, "ban", "total_operations", "total",
+                                 pt->ptr);
     else if (strcmp(name, "n_ban_add") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_operations",
-                                   "added", val);
+      return varnish_bind_derive(conf, "ban", "total_operations", "added",
+                                 pt->ptr);
     else if (strcmp(name, "n_ban_retire") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_operations",
-                                   "deleted", val);
+      return varnish_bind_derive(conf, "ban", "total_operations", "deleted",
+                                 pt->ptr);
     else if (strcmp(name, "n_ban_obj_test") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_operations",
-                                   "objects_tested", val);
+      return varnish_bind_derive(conf, "ban", "total_operations",
+                                 "objects_tested", pt->ptr);
     else if (strcmp(name, "n_ban_re_test") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_operations",
-                                   "regexps_tested", val);
+      return varnish_bind_derive(conf, "ban", "total_operations",
+                                 "regexps_tested", pt->ptr);
     else if (strcmp(name, "n_ban_dups") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_operations",
-                                   "duplicate", val);
+      return varnish_bind_derive(conf, "ban", "total_operations", "duplicate",
+                                 pt->ptr);
   }
 #endif
 #if HAVE_VARNISH_V4 || HAVE_VARNISH_V5
   if (conf->collect_ban) {
     if (strcmp(name, "bans") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_operations",
-                                   "total", val);
+      return varnish_bind_derive(conf, "ban", "total_operations", "total",
+                                 pt->ptr);
     else if (strcmp(name, "bans_added") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_operations",
-                                   "added", val);
+      return varnish_bind_derive(conf, "ban", "total_operations", "added",
+                                 pt->ptr);
     else if (strcmp(name, "bans_obj") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_operations",
-                                   "obj", val);
+      return varnish_bind_derive(conf, "ban", "total_operations", "obj",
+                                 pt->ptr);
     else if (strcmp(name, "bans_req") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_operations",
-                                   "req", val);
+      return varnish_bind_derive(conf, "ban", "total_operations", "req",
+                                 pt->ptr);
     else if (strcmp(name, "bans_completed") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_operations",
-                                   "completed", val);
+      return varnish_bind_derive(conf, "ban", "total_operations", "completed",
+                                 pt->ptr);
     else if (strcmp(name, "bans_deleted") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_operations",
-                                   "deleted", val);
+      return varnish_bind_derive(conf, "ban", "total_operations", "deleted",
+                                 pt->ptr);
     else if (strcmp(name, "bans_tested") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_operations",
-                                   "tested", val);
+      return varnish_bind_derive(conf, "ban", "total_operations", "tested",
+                                 pt->ptr);
     else if (strcmp(name, "bans_dups") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_operations",
-                                   "duplicate", val);
+      return varnish_bind_derive(conf, "ban", "total_operations", "duplicate",
+                                 pt->ptr);
     else if (strcmp(name, "bans_tested") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_operations",
-                                   "tested", val);
+      return varnish_bind_derive(conf, "ban", "total_operations", "tested",
+                                 pt->ptr);
     else if (strcmp(name, "bans_lurker_contention") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_operations",
-                                   "lurker_contention", val);
+      return varnish_bind_derive(conf, "ban", "total_operations",
+                                 "lurker_contention", pt->ptr);
     else if (strcmp(name, "bans_lurker_obj_killed") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_operations",
-                                   "lurker_obj_killed", val);
+      return varnish_bind_derive(conf, "ban", "total_operations",
+                                 "lurker_obj_killed", pt->ptr);
     else if (strcmp(name, "bans_lurker_tested") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_operations",
-                                   "lurker_tested", val);
+      return varnish_bind_derive(conf, "ban", "total_operations",
+                                 "lurker_tested", pt->ptr);
     else if (strcmp(name, "bans_lurker_tests_tested") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_operations",
-                                   "lurker_tests_tested", val);
+      return varnish_bind_derive(conf, "ban", "total_operations",
+                                 "lurker_tests_tested", pt->ptr);
     else if (strcmp(name, "bans_obj_killed") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_operations",
-                                   "obj_killed", val);
+      return varnish_bind_derive(conf, "ban", "total_operations", "obj_killed",
+                                 pt->ptr);
     else if (strcmp(name, "bans_persisted_bytes") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_bytes",
-                                   "persisted_bytes", val);
+      return varnish_bind_derive(conf, "ban", "total_bytes", "persisted_bytes",
+                                 pt->ptr);
     else if (strcmp(name, "bans_persisted_fragmentation") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_bytes",
-                                   "persisted_fragmentation", val);
+      return varnish_bind_derive(conf, "ban", "total_bytes",
+                                 "persisted_fragmentation", pt->ptr);
     else if (strcmp(name, "bans_tests_tested") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_operations",
-                                   "tests_tested", val);
+      return varnish_bind_derive(conf, "ban", "total_operations",
+                                 "tests_tested", pt->ptr);
   }
 #endif
 
   if (conf->collect_session) {
     if (strcmp(name, "sess_closed") == 0)
-      return varnish_submit_derive(conf->instance, "session",
-                                   "total_operations", "closed", val);
+      return varnish_bind_derive(conf, "session", "total_operations", "closed",
+                                 pt->ptr);
     else if (strcmp(name, "sess_pipeline") == 0)
-      return varnish_submit_derive(conf->instance, "session",
-                                   "total_operations", "pipeline", val);
+      return varnish_bind_derive(conf, "session", "total_operations",
+                                 "pipeline", pt->ptr);
     else if (strcmp(name, "sess_readahead") == 0)
-      return varnish_submit_derive(conf->instance, "session",
-                                   "total_operations", "readahead", val);
+      return varnish_bind_derive(conf, "session", "total_operations",
+                                 "readahead", pt->ptr);
     else if (strcmp(name, "sess_conn") == 0)
-      return varnish_submit_derive(conf->instance, "session",
-                                   "total_operations", "accepted", val);
+      return varnish_bind_derive(conf, "session", "total_operations",
+                                 "accepted", pt->ptr);
     else if (strcmp(name, "sess_drop") == 0)
-      return varnish_submit_derive(conf->instance, "session",
-                                   "total_operations", "dropped", val);
+      return varnish_bind_derive(conf, "session", "total_operations", "dropped",
+                                 pt->ptr);
     else if (strcmp(name, "sess_fail") == 0)
-      return varnish_submit_derive(conf->instance, "session",
-                                   "total_operations", "failed", val);
+      return varnish_bind_derive(conf, "session", "total_operations", "failed",
+                                 pt->ptr);
     else if (strcmp(name, "sess_pipe_overflow") == 0)
-      return varnish_submit_derive(conf->instance, "session",
-                                   "total_operations", "overflow", val);
+      return varnish_bind_derive(conf, "session", "total_operations",
+                                 "overflow", pt->ptr);
     else if (strcmp(name, "sess_queued") == 0)
-      return varnish_submit_derive(conf->instance, "session",
-                                   "total_operations", "queued", val);
+      return varnish_bind_derive(conf, "session", "total_operations", "queued",
+                                 pt->ptr);
     else if (strcmp(name, "sess_linger") == 0)
-      return varnish_submit_derive(conf->instance, "session",
-                                   "total_operations", "linger", val);
+      return varnish_bind_derive(conf, "session", "total_operations", "linger",
+                                 pt->ptr);
     else if (strcmp(name, "sess_herd") == 0)
-      return varnish_submit_derive(conf->instance, "session",
-                                   "total_operations", "herd", val);
+      return varnish_bind_derive(conf, "session", "total_operations", "herd",
+                                 pt->ptr);
 #if HAVE_VARNISH_V4 || HAVE_VARNISH_V5
     else if (strcmp(name, "sess_closed_err") == 0)
-      return varnish_submit_derive(conf->instance, "session",
-                                   "total_operations", "closed_err", val);
+      return varnish_bind_derive(conf, "session", "total_operations",
+                                 "closed_err", pt->ptr);
     else if (strcmp(name, "sess_dropped") == 0)
-      return varnish_submit_derive(conf->instance, "session",
-                                   "total_operations", "dropped_for_thread",
-                                   val);
+      return varnish_bind_derive(conf, "session", "total_operations",
+                                 "dropped_for_thread", pt->ptr);
 #endif
   }
 
   if (conf->collect_shm) {
     if (strcmp(name, "shm_records") == 0)
-      return varnish_submit_derive(conf->instance, "shm", "total_operations",
-                                   "records", val);
+      return varnish_bind_derive(conf, "shm", "total_operations", "records",
+                                 pt->ptr);
     else if (strcmp(name, "shm_writes") == 0)
-      return varnish_submit_derive(conf->instance, "shm", "total_operations",
-                                   "writes", val);
+      return varnish_bind_derive(conf, "shm", "total_operations", "writes",
+                                 pt->ptr);
     else if (strcmp(name, "shm_flushes") == 0)
-      return varnish_submit_derive(conf->instance, "shm", "total_operations",
-                                   "flushes", val);
+      return varnish_bind_derive(conf, "shm", "total_operations", "flushes",
+                                 pt->ptr);
     else if (strcmp(name, "shm_cont") == 0)
-      return varnish_submit_derive(conf->instance, "shm", "total_operations",
-                                   "contention", val);
+      return varnish_bind_derive(conf, "shm", "total_operations", "contention",
+                                 pt->ptr);
     else if (strcmp(name, "shm_cycles") == 0)
-      return varnish_submit_derive(conf->instance, "shm", "total_operations",
-                                   "cycles", val);
+      return varnish_bind_derive(conf, "shm", "total_operations", "cycles",
+                                 pt->ptr);
   }
 
   if (conf->collect_sms) {
     if (strcmp(name, "sms_nreq") == 0)
-      return varnish_submit_derive(conf->instance, "sms", "total_requests",
-                                   "allocator", val);
+      return varnish_bind_derive(conf, "sms", "total_requests", "allocator",
+                                 pt->ptr);
     else if (strcmp(name, "sms_nobj") == 0)
-      return varnish_submit_gauge(conf->instance, "sms", "requests",
-                                  "outstanding", val);
+      return varnish_bind_gauge(conf, "sms", "requests", "outstanding",
+                                pt->ptr);
     else if (strcmp(name, "sms_nbytes") == 0)
-      return varnish_submit_gauge(conf->instance, "sms", "bytes", "outstanding",
-                                  val);
+      return varnish_bind_gauge(conf, "sms", "bytes", "outstanding", pt->ptr);
     else if (strcmp(name, "sms_balloc") == 0)
-      return varnish_submit_derive(conf->instance, "sms", "total_bytes",
-                                   "allocated", val);
+      return varnish_bind_derive(conf, "sms", "total_bytes", "allocated",
+                                 pt->ptr);
     else if (strcmp(name, "sms_bfree") == 0)
-      return varnish_submit_derive(conf->instance, "sms", "total_bytes", "free",
-                                   val);
+      return varnish_bind_derive(conf, "sms", "total_bytes", "free", pt->ptr);
   }
 
   if (conf->collect_struct) {
     if (strcmp(name, "n_sess_mem") == 0)
-      return varnish_submit_gauge(conf->instance, "struct", "current_sessions",
-                                  "sess_mem", val);
+      return varnish_bind_gauge(conf, "struct", "current_sessions", "sess_mem",
+                                pt->ptr);
     else if (strcmp(name, "n_sess") == 0)
-      return varnish_submit_gauge(conf->instance, "struct", "current_sessions",
-                                  "sess", val);
+      return varnish_bind_gauge(conf, "struct", "current_sessions", "sess",
+                                pt->ptr);
     else if (strcmp(name, "n_object") == 0)
-      return varnish_submit_gauge(conf->instance, "struct", "objects", "object",
-                                  val);
+      return varnish_bind_gauge(conf, "struct", "objects", "object", pt->ptr);
     else if (strcmp(name, "n_vampireobject") == 0)
-      return varnish_submit_gauge(conf->instance, "struct", "objects",
-                                  "vampireobject", val);
+      return varnish_bind_gauge(conf, "struct", "objects", "vampireobject",
+                                pt->ptr);
     else if (strcmp(name, "n_objectcore") == 0)
-      return varnish_submit_gauge(conf->instance, "struct", "objects",
-                                  "objectcore", val);
+      return varnish_bind_gauge(conf, "struct", "objects", "objectcore",
+                                pt->ptr);
     else if (strcmp(name, "n_waitinglist") == 0)
-      return varnish_submit_gauge(conf->instance, "struct", "objects",
-                                  "waitinglist", val);
+      return varnish_bind_gauge(conf, "struct", "objects", "waitinglist",
+                                pt->ptr);
     else if (strcmp(name, "n_objecthead") == 0)
-      return varnish_submit_gauge(conf->instance, "struct", "objects",
-                                  "objecthead", val);
+      return varnish_bind_gauge(conf, "struct", "objects", "objecthead",
+                                pt->ptr);
     else if (strcmp(name, "n_smf") == 0)
-      return varnish_submit_gauge(conf->instance, "struct", "objects", "smf",
-                                  val);
+      return varnish_bind_gauge(conf, "struct", "objects", "smf", pt->ptr);
     else if (strcmp(name, "n_smf_frag") == 0)
-      return varnish_submit_gauge(conf->instance, "struct", "objects",
-                                  "smf_frag", val);
+      return varnish_bind_gauge(conf, "struct", "objects", "smf_frag", pt->ptr);
     else if (strcmp(name, "n_smf_large") == 0)
-      return varnish_submit_gauge(conf->instance, "struct", "objects",
-                                  "smf_large", val);
+      return varnish_bind_gauge(conf, "struct", "objects", "smf_large",
+                                pt->ptr);
     else if (strcmp(name, "n_vbe_conn") == 0)
-      return varnish_submit_gauge(conf->instance, "struct", "objects",
-                                  "vbe_conn", val);
+      return varnish_bind_gauge(conf, "struct", "objects", "vbe_conn", pt->ptr);
   }
 
   if (conf->collect_totals) {
     if (strcmp(name, "s_sess") == 0)
-      return varnish_submit_derive(conf->instance, "totals", "total_sessions",
-                                   "sessions", val);
+      return varnish_bind_derive(conf, "totals", "total_sessions", "sessions",
+                                 pt->ptr);
     else if (strcmp(name, "s_req") == 0)
-      return varnish_submit_derive(conf->instance, "totals", "total_requests",
-                                   "requests", val);
+      return varnish_bind_derive(conf, "totals", "total_requests", "requests",
+                                 pt->ptr);
     else if (strcmp(name, "s_pipe") == 0)
-      return varnish_submit_derive(conf->instance, "totals", "total_operations",
-                                   "pipe", val);
+      return varnish_bind_derive(conf, "totals", "total_operations", "pipe",
+                                 pt->ptr);
     else if (strcmp(name, "s_pass") == 0)
-      return varnish_submit_derive(conf->instance, "totals", "total_operations",
-                                   "pass", val);
+      return varnish_bind_derive(conf, "totals", "total_operations", "pass",
+                                 pt->ptr);
     else if (strcmp(name, "s_fetch") == 0)
-      return varnish_submit_derive(conf->instance, "totals", "total_operations",
-                                   "fetches", val);
+      return varnish_bind_derive(conf, "totals", "total_operations", "fetches",
+                                 pt->ptr);
     else if (strcmp(name, "s_synth") == 0)
-      return varnish_submit_derive(conf->instance, "totals", "total_bytes",
-                                   "synth", val);
+      return varnish_bind_derive(conf, "totals", "total_bytes", "synth",
+                                 pt->ptr);
     else if (strcmp(name, "s_req_hdrbytes") == 0)
-      return varnish_submit_derive(conf->instance, "totals", "total_bytes",
-                                   "req_header", val);
+      return varnish_bind_derive(conf, "totals", "total_bytes", "req_header",
+                                 pt->ptr);
     else if (strcmp(name, "s_req_bodybytes") == 0)
-      return varnish_submit_derive(conf->instance, "totals", "total_bytes",
-                                   "req_body", val);
+      return varnish_bind_derive(conf, "totals", "total_bytes", "req_body",
+                                 pt->ptr);
     else if (strcmp(name, "s_req_protobytes") == 0)
-      return varnish_submit_derive(conf->instance, "totals", "total_bytes",
-                                   "req_proto", val);
+      return varnish_bind_derive(conf, "totals", "total_bytes", "req_proto",
+                                 pt->ptr);
     else if (strcmp(name, "s_resp_hdrbytes") == 0)
-      return varnish_submit_derive(conf->instance, "totals", "total_bytes",
-                                   "resp_header", val);
+      return varnish_bind_derive(conf, "totals", "total_bytes", "resp_header",
+                                 pt->ptr);
     else if (strcmp(name, "s_resp_bodybytes") == 0)
-      return varnish_submit_derive(conf->instance, "totals", "total_bytes",
-                                   "resp_body", val);
+      return varnish_bind_derive(conf, "totals", "total_bytes", "resp_body",
+                                 pt->ptr);
     else if (strcmp(name, "s_resp_protobytes") == 0)
-      return varnish_submit_derive(conf->instance, "totals", "total_bytes",
-                                   "resp_proto", val);
+      return varnish_bind_derive(conf, "totals", "total_bytes", "resp_proto",
+                                 pt->ptr);
     else if (strcmp(name, "s_pipe_hdrbytes") == 0)
-      return varnish_submit_derive(conf->instance, "totals", "total_bytes",
-                                   "pipe_header", val);
+      return varnish_bind_derive(conf, "totals", "total_bytes", "pipe_header",
+                                 pt->ptr);
     else if (strcmp(name, "s_pipe_in") == 0)
-      return varnish_submit_derive(conf->instance, "totals", "total_bytes",
-                                   "pipe_in", val);
+      return varnish_bind_derive(conf, "totals", "total_bytes", "pipe_in",
+                                 pt->ptr);
     else if (strcmp(name, "s_pipe_out") == 0)
-      return varnish_submit_derive(conf->instance, "totals", "total_bytes",
-                                   "pipe_out", val);
+      return varnish_bind_derive(conf, "totals", "total_bytes", "pipe_out",
+                                 pt->ptr);
     else if (strcmp(name, "n_purges") == 0)
-      return varnish_submit_derive(conf->instance, "totals", "total_operations",
-                                   "purges", val);
+      return varnish_bind_derive(conf, "totals", "total_operations", "purges",
+                                 pt->ptr);
     else if (strcmp(name, "s_hdrbytes") == 0)
-      return varnish_submit_derive(conf->instance, "totals", "total_bytes",
-                                   "header-bytes", val);
+      return varnish_bind_derive(conf, "totals", "total_bytes", "header-bytes",
+                                 pt->ptr);
     else if (strcmp(name, "s_bodybytes") == 0)
-      return varnish_submit_derive(conf->instance, "totals", "total_bytes",
-                                   "body-bytes", val);
+      return varnish_bind_derive(conf, "totals", "total_bytes", "body-bytes",
+                                 pt->ptr);
     else if (strcmp(name, "n_gzip") == 0)
-      return varnish_submit_derive(conf->instance, "totals", "total_operations",
-                                   "gzip", val);
+      return varnish_bind_derive(conf, "totals", "total_operations", "gzip",
+                                 pt->ptr);
     else if (strcmp(name, "n_gunzip") == 0)
-      return varnish_submit_derive(conf->instance, "totals", "total_operations",
-                                   "gunzip", val);
+      return varnish_bind_derive(conf, "totals", "total_operations", "gunzip",
+                                 pt->ptr);
   }
 
   if (conf->collect_uptime) {
     if (strcmp(name, "uptime") == 0)
-      return varnish_submit_gauge(conf->instance, "uptime", "uptime",
-                                  "client_uptime", val);
+      return varnish_bind_gauge(conf, "uptime", "uptime", "client_uptime",
+                                pt->ptr);
   }
 
   if (conf->collect_vcl) {
     if (strcmp(name, "n_vcl") == 0)
-      return varnish_submit_gauge(conf->instance, "vcl", "vcl", "total_vcl",
-                                  val);
+      return varnish_bind_gauge(conf, "vcl", "vcl", "total_vcl", pt->ptr);
     else if (strcmp(name, "n_vcl_avail") == 0)
-      return varnish_submit_gauge(conf->instance, "vcl", "vcl", "avail_vcl",
-                                  val);
+      return varnish_bind_gauge(conf, "vcl", "vcl", "avail_vcl", pt->ptr);
     else if (strcmp(name, "n_vcl_discard") == 0)
-      return varnish_submit_gauge(conf->instance, "vcl", "vcl", "discarded_vcl",
-                                  val);
+      return varnish_bind_gauge(conf, "vcl", "vcl", "discarded_vcl", pt->ptr);
     else if (strcmp(name, "vmods") == 0)
-      return varnish_submit_gauge(conf->instance, "vcl", "objects", "vmod",
-                                  val);
+      return varnish_bind_gauge(conf, "vcl", "objects", "vmod", pt->ptr);
   }
 
   if (conf->collect_workers) {
     if (strcmp(name, "threads") == 0)
-      return varnish_submit_gauge(conf->instance, "workers", "threads",
-                                  "worker", val);
+      return varnish_bind_gauge(conf, "workers", "threads", "worker", pt->ptr);
     else if (strcmp(name, "threads_created") == 0)
-      return varnish_submit_derive(conf->instance, "workers", "total_threads",
-                                   "created", val);
+      return varnish_bind_derive(conf, "workers", "total_threads", "created",
+                                 pt->ptr);
     else if (strcmp(name, "threads_failed") == 0)
-      return varnish_submit_derive(conf->instance, "workers", "total_threads",
-                                   "failed", val);
+      return varnish_bind_derive(conf, "workers", "total_threads", "failed",
+                                 pt->ptr);
     else if (strcmp(name, "threads_limited") == 0)
-      return varnish_submit_derive(conf->instance, "workers", "total_threads",
-                                   "limited", val);
+      return varnish_bind_derive(conf, "workers", "total_threads", "limited",
+                                 pt->ptr);
     else if (strcmp(name, "threads_destroyed") == 0)
-      return varnish_submit_derive(conf->instance, "workers", "total_threads",
-                                   "dropped", val);
+      return varnish_bind_derive(conf, "workers", "total_threads", "dropped",
+                                 pt->ptr);
     else if (strcmp(name, "thread_queue_len") == 0)
-      return varnish_submit_gauge(conf->instance, "workers", "queue_length",
-                                  "threads", val);
+      return varnish_bind_gauge(conf, "workers", "queue_length", "threads",
+                                pt->ptr);
     else if (strcmp(name, "n_wrk") == 0)
-      return varnish_submit_gauge(conf->instance, "workers", "threads",
-                                  "worker", val);
+      return varnish_bind_gauge(conf, "workers", "threads", "worker", pt->ptr);
     else if (strcmp(name, "n_wrk_create") == 0)
-      return varnish_submit_derive(conf->instance, "workers", "total_threads",
-                                   "created", val);
+      return varnish_bind_derive(conf, "workers", "total_threads", "created",
+                                 pt->ptr);
     else if (strcmp(name, "n_wrk_failed") == 0)
-      return varnish_submit_derive(conf->instance, "workers", "total_threads",
-                                   "failed", val);
+      return varnish_bind_derive(conf, "workers", "total_threads", "failed",
+                                 pt->ptr);
     else if (strcmp(name, "n_wrk_max") == 0)
-      return varnish_submit_derive(conf->instance, "workers", "total_threads",
-                                   "limited", val);
+      return varnish_bind_derive(conf, "workers", "total_threads", "limited",
+                                 pt->ptr);
     else if (strcmp(name, "n_wrk_drop") == 0)
-      return varnish_submit_derive(conf->instance, "workers", "total_threads",
-                                   "dropped", val);
+      return varnish_bind_derive(conf, "workers", "total_threads", "dropped",
+                                 pt->ptr);
     else if (strcmp(name, "n_wrk_queue") == 0)
-      return varnish_submit_derive(conf->instance, "workers", "total_requests",
-                                   "queued", val);
+      return varnish_bind_derive(conf, "workers", "total_requests", "queued",
+                                 pt->ptr);
     else if (strcmp(name, "n_wrk_overflow") == 0)
-      return varnish_submit_derive(conf->instance, "workers", "total_requests",
-                                   "overflowed", val);
+      return varnish_bind_derive(conf, "workers", "total_requests",
+                                 "overflowed", pt->ptr);
     else if (strcmp(name, "n_wrk_queued") == 0)
-      return varnish_submit_derive(conf->instance, "workers", "total_requests",
-                                   "queued", val);
+      return varnish_bind_derive(conf, "workers", "total_requests", "queued",
+                                 pt->ptr);
     else if (strcmp(name, "n_wrk_lqueue") == 0)
-      return varnish_submit_derive(conf->instance, "workers", "total_requests",
-                                   "queue_length", val);
+      return varnish_bind_derive(conf, "workers", "total_requests",
+                                 "queue_length", pt->ptr);
 #if HAVE_VARNISH_V4 || HAVE_VARNISH_V5
     else if (strcmp(name, "pools") == 0)
-      return varnish_submit_gauge(conf->instance, "workers", "pools", "pools",
-                                  val);
+      return varnish_bind_gauge(conf, "workers", "pools", "pools", pt->ptr);
     else if (strcmp(name, "busy_killed") == 0)
-      return varnish_submit_derive(conf->instance, "workers", "http_requests",
-                                   "busy_killed", val);
+      return varnish_bind_derive(conf, "workers", "http_requests",
+                                 "busy_killed", pt->ptr);
 #endif
   }
 
 #if HAVE_VARNISH_V4 || HAVE_VARNISH_V5
   if (conf->collect_vsm) {
     if (strcmp(name, "vsm_free") == 0)
-      return varnish_submit_gauge(conf->instance, "vsm", "bytes", "free", val);
+      return varnish_bind_gauge(conf, "vsm", "bytes", "free", pt->ptr);
     else if (strcmp(name, "vsm_used") == 0)
-      return varnish_submit_gauge(conf->instance, "vsm", "bytes", "used", val);
+      return varnish_bind_gauge(conf, "vsm", "bytes", "used", pt->ptr);
     else if (strcmp(name, "vsm_cooling") == 0)
-      return varnish_submit_gauge(conf->instance, "vsm", "bytes", "cooling",
-                                  val);
+      return varnish_bind_gauge(conf, "vsm", "bytes", "cooling", pt->ptr);
     else if (strcmp(name, "vsm_overflow") == 0)
-      return varnish_submit_gauge(conf->instance, "vsm", "bytes", "overflow",
-                                  val);
+      return varnish_bind_gauge(conf, "vsm", "bytes", "overflow", pt->ptr);
     else if (strcmp(name, "vsm_overflowed") == 0)
-      return varnish_submit_derive(conf->instance, "vsm", "total_bytes",
-                                   "overflowed", val);
+      return varnish_bind_derive(conf, "vsm", "total_bytes", "overflowed",
+                                 pt->ptr);
   }
 
   if (conf->collect_vbe) {
     /* @TODO figure out the collectd type for bitmap
     if (strcmp(name, "happy") == 0)
-      return varnish_submit_derive(conf->instance, "vbe",
-                                   "bitmap", "happy_hprobes", val);
+      return varnish_bind_derive(conf, "vbe", "bitmap", "happy_hprobes",
+                                 pt->ptr);
     */
     if (strcmp(name, "bereq_hdrbytes") == 0)
-      return varnish_submit_derive(conf->instance, "vbe", "total_bytes",
-                                   "bereq_hdrbytes", val);
+      return varnish_bind_derive(conf, "vbe", "total_bytes", "bereq_hdrbytes",
+                                 pt->ptr);
     else if (strcmp(name, "bereq_bodybytes") == 0)
-      return varnish_submit_derive(conf->instance, "vbe", "total_bytes",
-                                   "bereq_bodybytes", val);
+      return varnish_bind_derive(conf, "vbe", "total_bytes", "bereq_bodybytes",
+                                 pt->ptr);
     else if (strcmp(name, "bereq_protobytes") == 0)
-      return varnish_submit_derive(conf->instance, "vbe", "total_bytes",
-                                   "bereq_protobytes", val);
+      return varnish_bind_derive(conf, "vbe", "total_bytes", "bereq_protobytes",
+                                 pt->ptr);
     else if (strcmp(name, "beresp_hdrbytes") == 0)
-      return varnish_submit_derive(conf->instance, "vbe", "total_bytes",
-                                   "beresp_hdrbytes", val);
+      return varnish_bind_derive(conf, "vbe", "total_bytes", "beresp_hdrbytes",
+                                 pt->ptr);
     else if (strcmp(name, "beresp_bodybytes") == 0)
-      return varnish_submit_derive(conf->instance, "vbe", "total_bytes",
-                                   "beresp_bodybytes", val);
+      return varnish_bind_derive(conf, "vbe", "total_bytes", "beresp_bodybytes",
+                                 pt->ptr);
     else if (strcmp(name, "beresp_protobytes") == 0)
-      return varnish_submit_derive(conf->instance, "vbe", "total_bytes",
-                                   "beresp_protobytes", val);
+      return varnish_bind_derive(conf, "vbe", "total_bytes",
+                                 "beresp_protobytes", pt->ptr);
     else if (strcmp(name, "pipe_hdrbytes") == 0)
-      return varnish_submit_derive(conf->instance, "vbe", "total_bytes",
-                                   "pipe_hdrbytes", val);
+      return varnish_bind_derive(conf, "vbe", "total_bytes", "pipe_hdrbytes",
+                                 pt->ptr);
     else if (strcmp(name, "pipe_out") == 0)
-      return varnish_submit_derive(conf->instance, "vbe", "total_bytes",
-                                   "pipe_out", val);
+      return varnish_bind_derive(conf, "vbe", "total_bytes", "pipe_out",
+                                 pt->ptr);
     else if (strcmp(name, "pipe_in") == 0)
-      return varnish_submit_derive(conf->instance, "vbe", "total_bytes",
-                                   "pipe_in", val);
+      return varnish_bind_derive(conf, "vbe", "total_bytes", "pipe_in",
+                                 pt->ptr);
     else if (strcmp(name, "conn") == 0)
-      return varnish_submit_derive(conf->instance, "vbe", "connections",
-                                   "c_conns", val);
+      return varnish_bind_derive(conf, "vbe", "connections", "c_conns",
+                                 pt->ptr);
     else if (strcmp(name, "req") == 0)
-      return varnish_submit_derive(conf->instance, "vbe", "http_requests",
-                                   "b_reqs", val);
+      return varnish_bind_derive(conf, "vbe", "http_requests", "b_reqs",
+                                 pt->ptr);
   }
 
   /* All Stevedores support these counters */
   if (conf->collect_sma || conf->collect_smf || conf->collect_mse) {
 
-    char category[4];
+    const char *category;
     if (conf->collect_sma)
-      strncpy(category, "sma", 4);
+      category = "sma";
     else if (conf->collect_smf)
-      strncpy(category, "smf", 4);
+      category = "smf";
     else
-      strncpy(category, "mse", 4);
+      category = "mse";
 
     if (strcmp(name, "c_req") == 0)
-      return varnish_submit_derive(conf->instance, category, "total_operations",
-                                   "alloc_req", val);
+      return varnish_bind_derive(conf, category, "total_operations",
+                                 "alloc_req", pt->ptr);
     else if (strcmp(name, "c_fail") == 0)
-      return varnish_submit_derive(conf->instance, category, "total_operations",
-                                   "alloc_fail", val);
+      return varnish_bind_derive(conf, category, "total_operations",
+                                 "alloc_fail", pt->ptr);
     else if (strcmp(name, "c_bytes") == 0)
-      return varnish_submit_derive(conf->instance, category, "total_bytes",
-                                   "bytes_allocated", val);
+      return varnish_bind_derive(conf, category, "total_bytes",
+                                 "bytes_allocated", pt->ptr);
     else if (strcmp(name, "c_freed") == 0)
-      return varnish_submit_derive(conf->instance, category, "total_bytes",
-                                   "bytes_freed", val);
+      return varnish_bind_derive(conf, category, "total_bytes", "bytes_freed",
+                                 pt->ptr);
     else if (strcmp(name, "g_alloc") == 0)
-      return varnish_submit_derive(conf->instance, category, "total_operations",
-                                   "alloc_outstanding", val);
+      return varnish_bind_derive(conf, category, "total_operations",
+                                 "alloc_outstanding", pt->ptr);
     else if (strcmp(name, "g_bytes") == 0)
-      return varnish_submit_gauge(conf->instance, category, "bytes",
-                                  "bytes_outstanding", val);
+      return varnish_bind_gauge(conf, category, "bytes", "bytes_outstanding",
+                                pt->ptr);
     else if (strcmp(name, "g_space") == 0)
-      return varnish_submit_gauge(conf->instance, category, "bytes",
-                                  "bytes_available", val);
+      return varnish_bind_gauge(conf, category, "bytes", "bytes_available",
+                                pt->ptr);
   }
 
   /* No SMA specific counters */
 
   if (conf->collect_smf) {
     if (strcmp(name, "g_smf") == 0)
-      return varnish_submit_gauge(conf->instance, "smf", "objects",
-                                  "n_struct_smf", val);
+      return varnish_bind_gauge(conf, "smf", "objects", "n_struct_smf",
+                                pt->ptr);
     else if (strcmp(name, "g_smf_frag") == 0)
-      return varnish_submit_gauge(conf->instance, "smf", "objects",
-                                  "n_small_free_smf", val);
+      return varnish_bind_gauge(conf, "smf", "objects", "n_small_free_smf",
+                                pt->ptr);
     else if (strcmp(name, "g_smf_large") == 0)
-      return varnish_submit_gauge(conf->instance, "smf", "objects",
-                                  "n_large_free_smf", val);
+      return varnish_bind_gauge(conf, "smf", "objects", "n_large_free_smf",
+                                pt->ptr);
   }
 
   if (conf->collect_mgt) {
     if (strcmp(name, "uptime") == 0)
-      return varnish_submit_gauge(conf->instance, "mgt", "uptime",
-                                  "mgt_proc_uptime", val);
+      return varnish_bind_gauge(conf, "mgt", "uptime", "mgt_proc_uptime",
+                                pt->ptr);
     else if (strcmp(name, "child_start") == 0)
-      return varnish_submit_derive(conf->instance, "mgt", "total_operations",
-                                   "child_start", val);
+      return varnish_bind_derive(conf, "mgt", "total_operations", "child_start",
+                                 pt->ptr);
     else if (strcmp(name, "child_exit") == 0)
-      return varnish_submit_derive(conf->instance, "mgt", "total_operations",
-                                   "child_exit", val);
+      return varnish_bind_derive(conf, "mgt", "total_operations", "child_exit",
+                                 pt->ptr);
     else if (strcmp(name, "child_stop") == 0)
-      return varnish_submit_derive(conf->instance, "mgt", "total_operations",
-                                   "child_stop", val);
+      return varnish_bind_derive(conf, "mgt", "total_operations", "child_stop",
+                                 pt->ptr);
     else if (strcmp(name, "child_died") == 0)
-      return varnish_submit_derive(conf->instance, "mgt", "total_operations",
-                                   "child_died", val);
+      return varnish_bind_derive(conf, "mgt", "total_operations", "child_died",
+                                 pt->ptr);
     else if (strcmp(name, "child_dump") == 0)
-      return varnish_submit_derive(conf->instance, "mgt", "total_operations",
-                                   "child_dump", val);
+      return varnish_bind_derive(conf, "mgt", "total_operations", "child_dump",
+                                 pt->ptr);
     else if (strcmp(name, "child_panic") == 0)
-      return varnish_submit_derive(conf->instance, "mgt", "total_operations",
-                                   "child_panic", val);
+      return varnish_bind_derive(conf, "mgt", "total_operations", "child_panic",
+                                 pt->ptr);
   }
 
   if (conf->collect_lck) {
     if (strcmp(name, "creat") == 0)
-      return varnish_submit_gauge(conf->instance, "lck", "objects", "created",
-                                  val);
+      return varnish_bind_gauge(conf, "lck", "objects", "created", pt->ptr);
     else if (strcmp(name, "destroy") == 0)
-      return varnish_submit_gauge(conf->instance, "lck", "objects", "destroyed",
-                                  val);
+      return varnish_bind_gauge(conf, "lck", "objects", "destroyed", pt->ptr);
     else if (strcmp(name, "locks") == 0)
-      return varnish_submit_derive(conf->instance, "lck", "total_operations",
-                                   "lock_ops", val);
+      return varnish_bind_derive(conf, "lck", "total_operations", "lock_ops",
+                                 pt->ptr);
   }
 
   if (conf->collect_mempool) {
     if (strcmp(name, "live") == 0)
-      return varnish_submit_gauge(conf->instance, "mempool", "objects",
-                                  "in_use", val);
+      return varnish_bind_gauge(conf, "mempool", "objects", "in_use", pt->ptr);
     else if (strcmp(name, "pool") == 0)
-      return varnish_submit_gauge(conf->instance, "mempool", "objects",
-                                  "in_pool", val);
+      return varnish_bind_gauge(conf, "mempool", "objects", "in_pool", pt->ptr);
     else if (strcmp(name, "sz_wanted") == 0)
-      return varnish_submit_gauge(conf->instance, "mempool", "bytes",
-                                  "size_requested", val);
+      return varnish_bind_gauge(conf, "mempool", "bytes", "size_requested",
+                                pt->ptr);
     else if (strcmp(name, "sz_actual") == 0)
-      return varnish_submit_gauge(conf->instance, "mempool", "bytes",
-                                  "size_allocated", val);
+      return varnish_bind_gauge(conf, "mempool", "bytes", "size_allocated",
+                                pt->ptr);
     else if (strcmp(name, "allocs") == 0)
-      return varnish_submit_derive(conf->instance, "mempool",
-                                   "total_operations", "allocations", val);
+      return varnish_bind_derive(conf, "mempool", "total_operations",
+                                 "allocations", pt->ptr);
     else if (strcmp(name, "frees") == 0)
-      return varnish_submit_derive(conf->instance, "mempool",
-                                   "total_operations", "frees", val);
+      return varnish_bind_derive(conf, "mempool", "total_operations", "frees",
+                                 pt->ptr);
     else if (strcmp(name, "recycle") == 0)
-      return varnish_submit_gauge(conf->instance, "mempool", "objects",
-                                  "recycled", val);
+      return varnish_bind_gauge(conf, "mempool", "objects", "recycled",
+                                pt->ptr);
     else if (strcmp(name, "timeout") == 0)
-      return varnish_submit_gauge(conf->instance, "mempool", "objects",
-                                  "timed_out", val);
+      return varnish_bind_gauge(conf, "mempool", "objects", "timed_out",
+                                pt->ptr);
     else if (strcmp(name, "toosmall") == 0)
-      return varnish_submit_gauge(conf->instance, "mempool", "objects",
-                                  "too_small", val);
+      return varnish_bind_gauge(conf, "mempool", "objects", "too_small",
+                                pt->ptr);
     else if (strcmp(name, "surplus") == 0)
-      return varnish_submit_gauge(conf->instance, "mempool", "objects",
-                                  "surplus", val);
+      return varnish_bind_gauge(conf, "mempool", "objects", "surplus", pt->ptr);
     else if (strcmp(name, "randry") == 0)
-      return varnish_submit_gauge(conf->instance, "mempool", "objects",
-                                  "ran_dry", val);
+      return varnish_bind_gauge(conf, "mempool", "objects", "ran_dry", pt->ptr);
   }
 
   if (conf->collect_mse) {
     if (strcmp(name, "c_full") == 0)
-      return varnish_submit_derive(conf->instance, "mse", "total_operations",
-                                   "full_allocs", val);
+      return varnish_bind_derive(conf, "mse", "total_operations", "full_allocs",
+                                 pt->ptr);
     else if (strcmp(name, "c_truncated") == 0)
-      return varnish_submit_derive(conf->instance, "mse", "total_operations",
-                                   "truncated_allocs", val);
+      return varnish_bind_derive(conf, "mse", "total_operations",
+                                 "truncated_allocs", pt->ptr);
     else if (strcmp(name, "c_expanded") == 0)
-      return varnish_submit_derive(conf->instance, "mse", "total_operations",
-                                   "expanded_allocs", val);
+      return varnish_bind_derive(conf, "mse", "total_operations",
+                                 "expanded_allocs", pt->ptr);
     else if (strcmp(name, "c_failed") == 0)
-      return varnish_submit_derive(conf->instance, "mse", "total_operations",
-                                   "failed_allocs", val);
+      return varnish_bind_derive(conf, "mse", "total_operations",
+                                 "failed_allocs", pt->ptr);
     else if (strcmp(name, "c_bytes") == 0)
-      return varnish_submit_derive(conf->instance, "mse", "total_bytes",
-                                   "bytes_allocated", val);
+      return varnish_bind_derive(conf, "mse", "total_bytes", "bytes_allocated",
+                                 pt->ptr);
     else if (strcmp(name, "c_freed") == 0)
-      return varnish_submit_derive(conf->instance, "mse", "total_bytes",
-                                   "bytes_freed", val);
+      return varnish_bind_derive(conf, "mse", "total_bytes", "bytes_freed",
+                                 pt->ptr);
     else if (strcmp(name, "g_fo_alloc") == 0)
-      return varnish_submit_derive(conf->instance, "mse", "total_operations",
-                                   "fo_allocs_outstanding", val);
+      return varnish_bind_derive(conf, "mse", "total_operations",
+                                 "fo_allocs_outstanding", pt->ptr);
     else if (strcmp(name, "g_fo_bytes") == 0)
-      return varnish_submit_gauge(conf->instance, "mse", "bytes",
-                                  "fo_bytes_outstanding", val);
+      return varnish_bind_gauge(conf, "mse", "bytes", "fo_bytes_outstanding",
+                                pt->ptr);
     else if (strcmp(name, "g_membuf_alloc") == 0)
-      return varnish_submit_gauge(conf->instance, "mse", "objects",
-                                  "membufs_allocated", val);
+      return varnish_bind_gauge(conf, "mse", "objects", "membufs_allocated",
+                                pt->ptr);
     else if (strcmp(name, "g_membuf_inuse") == 0)
-      return varnish_submit_gauge(conf->instance, "mse", "objects",
-                                  "membufs_inuse", val);
+      return varnish_bind_gauge(conf, "mse", "objects", "membufs_inuse",
+                                pt->ptr);
     else if (strcmp(name, "g_bans_bytes") == 0)
-      return varnish_submit_gauge(conf->instance, "mse", "bytes",
-                                  "persisted_banspace_used", val);
+      return varnish_bind_gauge(conf, "mse", "bytes", "persisted_banspace_used",
+                                pt->ptr);
     else if (strcmp(name, "g_bans_space") == 0)
-      return varnish_submit_gauge(conf->instance, "mse", "bytes",
-                                  "persisted_banspace_available", val);
+      return varnish_bind_gauge(conf, "mse", "bytes",
+                                "persisted_banspace_available", pt->ptr);
     else if (strcmp(name, "g_bans_persisted") == 0)
-      return varnish_submit_derive(conf->instance, "mse", "total_operations",
-                                   "bans_persisted", val);
+      return varnish_bind_derive(conf, "mse", "total_operations",
+                                 "bans_persisted", pt->ptr);
     else if (strcmp(name, "g_bans_lost") == 0)
-      return varnish_submit_derive(conf->instance, "mse", "total_operations",
-                                   "bans_lost", val);
+      return varnish_bind_derive(conf, "mse", "total_operations", "bans_lost",
+                                 pt->ptr);
 
     /* mse seg */
     else if (strcmp(name, "g_journal_bytes") == 0)
-      return varnish_submit_gauge(conf->instance, "mse_reg", "bytes",
-                                  "journal_bytes_used", val);
+      return varnish_bind_gauge(conf, "mse_reg", "bytes", "journal_bytes_used",
+                                pt->ptr);
     else if (strcmp(name, "g_journal_space") == 0)
-      return varnish_submit_gauge(conf->instance, "mse_reg", "bytes",
-                                  "journal_bytes_free", val);
+      return varnish_bind_gauge(conf, "mse_reg", "bytes", "journal_bytes_free",
+                                pt->ptr);
 
     /* mse segagg */
     else if (strcmp(name, "g_bigspace") == 0)
-      return varnish_submit_gauge(conf->instance, "mse_segagg", "bytes",
-                                  "big_extents_bytes_available", val);
+      return varnish_bind_gauge(conf, "mse_segagg", "bytes",
+                                "big_extents_bytes_available", pt->ptr);
     else if (strcmp(name, "g_extfree") == 0)
-      return varnish_submit_gauge(conf->instance, "mse_segagg", "objects",
-                                  "free_extents", val);
+      return varnish_bind_gauge(conf, "mse_segagg", "objects", "free_extents",
+                                pt->ptr);
     else if (strcmp(name, "g_sparenode") == 0)
-      return varnish_submit_gauge(conf->instance, "mse_segagg", "objects",
-                                  "spare_nodes_available", val);
+      return varnish_bind_gauge(conf, "mse_segagg", "objects",
+                                "spare_nodes_available", pt->ptr);
     else if (strcmp(name, "g_objnode") == 0)
-      return varnish_submit_gauge(conf->instance, "mse_segagg", "objects",
-                                  "object_nodes_in_use", val);
+      return varnish_bind_gauge(conf, "mse_segagg", "objects",
+                                "object_nodes_in_use", pt->ptr);
     else if (strcmp(name, "g_extnode") == 0)
-      return varnish_submit_gauge(conf->instance, "mse_segagg", "objects",
-                                  "extent_nodes_in_use", val);
+      return varnish_bind_gauge(conf, "mse_segagg", "objects",
+                                "extent_nodes_in_use", pt->ptr);
     else if (strcmp(name, "g_bigextfree") == 0)
-      return varnish_submit_gauge(conf->instance, "mse_segagg", "objects",
-                                  "free_big_extents", val);
+      return varnish_bind_gauge(conf, "mse_segagg", "objects",
+                                "free_big_extents", pt->ptr);
     else if (strcmp(name, "c_pruneloop") == 0)
-      return varnish_submit_derive(conf->instance, "mse_segagg",
-                                   "total_operations", "prune_loops", val);
+      return varnish_bind_derive(conf, "mse_segagg", "total_operations",
+                                 "prune_loops", pt->ptr);
     else if (strcmp(name, "c_pruned") == 0)
-      return varnish_submit_derive(conf->instance, "mse_segagg",
-                                   "total_objects", "pruned_objects", val);
+      return varnish_bind_derive(conf, "mse_segagg", "total_objects",
+                                 "pruned_objects", pt->ptr);
     else if (strcmp(name, "c_spared") == 0)
-      return varnish_submit_derive(conf->instance, "mse_segagg",
-                                   "total_operations", "spared_objects", val);
+      return varnish_bind_derive(conf, "mse_segagg", "total_operations",
+                                 "spared_objects", pt->ptr);
     else if (strcmp(name, "c_skipped") == 0)
-      return varnish_submit_derive(conf->instance, "mse_segagg",
-                                   "total_operations", "missed_objects", val);
+      return varnish_bind_derive(conf, "mse_segagg", "total_operations",
+                                 "missed_objects", pt->ptr);
     else if (strcmp(name, "c_nuked") == 0)
-      return varnish_submit_derive(conf->instance, "mse_segagg",
-                                   "total_operations", "nuked_objects", val);
+      return varnish_bind_derive(conf, "mse_segagg", "total_operations",
+                                 "nuked_objects", pt->ptr);
     else if (strcmp(name, "c_sniped") == 0)
-      return varnish_submit_derive(conf->instance, "mse_segagg",
-                                   "total_operations", "sniped_objects", val);
+      return varnish_bind_derive(conf, "mse_segagg", "total_operations",
+                                 "sniped_objects", pt->ptr);
   }
 
 #endif
 
   return 0;
 
-} /* }}} static int varnish_monitor */
+} /* }}} int varnish_resolve */
 #else /* if HAVE_VARNISH_V2 */
 static void varnish_monitor(const user_config_t *conf, /* {{{ */
                             const c_varnish_stats_t *stats) {
@@ -1327,51 +1374,52 @@ static void varnish_monitor(const user_config_t *conf, /* {{{ */
 #endif
 
 #if HAVE_VARNISH_V3 || HAVE_VARNISH_V4 || HAVE_VARNISH_V5
-static int varnish_read(user_data_t *ud) /* {{{ */
+static void varnish_detach(user_config_t *conf) /* {{{ */
+{
+#if HAVE_VARNISH_V3 || HAVE_VARNISH_V4
+  if (conf->vd != NULL)
+    VSM_Delete(conf->vd);
+#elif HAVE_VARNISH_V5
+  if (conf->vsc != NULL)
+    VSC_Destroy(&conf->vsc, conf->vd);
+  if (conf->vd != NULL)
+    VSM_Destroy(&conf->vd);
+  conf->vsc = NULL;
+#endif
+  conf->vd = NULL;
+  conf->counters_num = 0;
+} /* }}} void varnish_detach */
+
+static int varnish_attach(user_config_t *conf) /* {{{ */
 {
 #if HAVE_VARNISH_V3 || HAVE_VARNISH_V4
-  struct VSM_data *vd;
   _Bool ok;
   const c_varnish_stats_t *stats;
 #elif HAVE_VARNISH_V5
-  struct vsm *vd;
-  struct vsc *vsc;
   int vsm_status;
 #endif
 
-  user_config_t *conf;
-
-  if ((ud == NULL) || (ud->data == NULL))
-    return EINVAL;
-
-  conf = ud->data;
-
-  vd = VSM_New();
+  conf->vd = VSM_New();
 
 #if HAVE_VARNISH_V5
-  vsc = VSC_New();
+  conf->vsc = VSC_New();
 #endif
 
 #if HAVE_VARNISH_V3
-  VSC_Setup(vd);
+  VSC_Setup(conf->vd);
 #endif
 
   if (conf->instance != NULL) {
     int status;
 
 #if HAVE_VARNISH_V3 || HAVE_VARNISH_V4
-    status = VSM_n_Arg(vd, conf->instance);
+    status = VSM_n_Arg(conf->vd, conf->instance);
 #elif HAVE_VARNISH_V5
-    status = VSM_Arg(vd, 'n', conf->instance);
+    status = VSM_Arg(conf->vd, 'n', conf->instance);
 #endif
 
     if (status < 0) {
-#if HAVE_VARNISH_V3 || HAVE_VARNISH_V4
-      VSM_Delete(vd);
-#elif HAVE_VARNISH_V5
-      VSC_Destroy(&vsc, vd);
-      VSM_Destroy(&vd);
-#endif
+      varnish_detach(conf);
       ERROR("varnish plugin: VSM_Arg (\"%s\") failed "
             "with status %i.",
             conf->instance, status);
@@ -1380,62 +1428,106 @@ static int varnish_read(user_data_t *ud) /* {{{ */
   }
 
 #if HAVE_VARNISH_V3
-  ok = (VSC_Open(vd, /* diag = */ 1) == 0);
+  ok = (VSC_Open(conf->vd, /* diag = */ 1) == 0);
 #elif HAVE_VARNISH_V4
-  ok = (VSM_Open(vd) == 0);
+  ok = (VSM_Open(conf->vd) == 0);
 #endif
 #if HAVE_VARNISH_V3 || HAVE_VARNISH_V4
   if (!ok) {
-    VSM_Delete(vd);
+    varnish_detach(conf);
     ERROR("varnish plugin: Unable to open connection.");
     return -1;
   }
 #endif
 
 #if HAVE_VARNISH_V3
-  stats = VSC_Main(vd);
+  stats = VSC_Main(conf->vd);
 #elif HAVE_VARNISH_V4
-  stats = VSC_Main(vd, NULL);
+  stats = VSC_Main(conf->vd, &conf->main_fantom);
 #endif
 #if HAVE_VARNISH_V3 || HAVE_VARNISH_V4
   if (!stats) {
-    VSM_Delete(vd);
+    varnish_detach(conf);
     ERROR("varnish plugin: Unable to get statistics.");
     return -1;
   }
 #endif
 
 #if HAVE_VARNISH_V5
-  if (VSM_Attach(vd, STDERR_FILENO)) {
-    ERROR("varnish plugin: Cannot attach to varnish. %s", VSM_Error(vd));
-    VSC_Destroy(&vsc, vd);
-    VSM_Destroy(&vd);
+  if (VSM_Attach(conf->vd, STDERR_FILENO)) {
+    ERROR("varnish plugin: Cannot attach to varnish. %s", VSM_Error(conf->vd));
+    varnish_detach(conf);
     return -1;
   }
 
-  vsm_status = VSM_Status(vd);
+  vsm_status = VSM_Status(conf->vd);
   if (vsm_status & ~(VSM_MGT_RUNNING | VSM_WRK_RUNNING)) {
     ERROR("varnish plugin: Unable to get statistics.");
-    VSC_Destroy(&vsc, vd);
-    VSM_Destroy(&vd);
+    varnish_detach(conf);
     return -1;
   }
 #endif
 
+  conf->counters_num = 0;
 #if HAVE_VARNISH_V3
-  VSC_Iter(vd, varnish_monitor, conf);
+  VSC_Iter(conf->vd, varnish_resolve, conf);
 #elif HAVE_VARNISH_V4
-  VSC_Iter(vd, NULL, varnish_monitor, conf);
+  VSC_Iter(conf->vd, NULL, varnish_resolve, conf);
 #elif HAVE_VARNISH_V5
-  VSC_Iter(vsc, vd, varnish_monitor, conf);
+  VSC_Iter(conf->vsc, conf->vd, varnish_resolve, conf);
 #endif
 
-#if HAVE_VARNISH_V3 || HAVE_VARNISH_V4
-  VSM_Delete(vd);
+  DEBUG("varnish plugin: Found %" PRIsz " counters for instance \"%s\".",
+        conf->counters_num,
+        (conf->instance == NULL) ? "localhost" : conf->instance);
+  return 0;
+} /* }}} int varnish_attach */
+
+/* Returns true if the shared memory has been abandoned or remapped since
+ * attaching, e.g. because Varnish has been restarted, which invalidates the
+ * counter pointers. */
+static _Bool varnish_changed(user_config_t *conf) /* {{{ */
+{
+#if HAVE_VARNISH_V3
+  return VSM_ReOpen(conf->vd, /* diag = */ 0) != 0;
+#elif HAVE_VARNISH_V4
+  return VSM_Abandoned(conf->vd) ||
+         !VSM_StillValid(conf->vd, &conf->main_fantom);
 #elif HAVE_VARNISH_V5
-  VSC_Destroy(&vsc, vd);
-  VSM_Destroy(&vd);
+  return (VSM_Status(conf->vd) & ~(VSM_MGT_RUNNING | VSM_WRK_RUNNING)) != 0;
 #endif
+} /* }}} _Bool varnish_changed */
+
+static int varnish_read(user_data_t *ud) /* {{{ */
+{
+  user_config_t *conf;
+
+  if ((ud == NULL) || (ud->data == NULL))
+    return EINVAL;
+
+  conf = ud->data;
+
+  if ((conf->vd != NULL) && varnish_changed(conf)) {
+    INFO("varnish plugin: Shared memory of instance \"%s\" changed, "
+         "attaching again.",
+         (conf->instance == NULL) ? "localhost" : conf->instance);
+    varnish_detach(conf);
+  }
+
+  if ((conf->vd == NULL) && (varnish_attach(conf) != 0))
+    return -1;
+
+  for (size_t i = 0; i < conf->counters_num; i++) {
+    varnish_counter_t const *c = conf->counters + i;
+    uint64_t val = *c->ptr;
+
+    if (c->ds_type == DS_TYPE_GAUGE)
+      varnish_submit_gauge(conf->instance, c->category, c->type,
+                           c->type_instance, val);
+    else
+      varnish_submit_derive(conf->instance, c->category, c->type,
+                            c->type_instance, val);
+  }
 
   return 0;
 } /* }}} */
@@ -1471,6 +1563,10 @@ static void varnish_config_free(void *ptr) /* {{{ */
   if (conf == NULL)
     return;
 
+#if HAVE_VARNISH_V3 || HAVE_VARNISH_V4 || HAVE_VARNISH_V5
+  varnish_detach(conf);
+  sfree(conf->counters);
+#endif
   sfree(conf->instance);
   sfree(conf);
 } /* }}} */
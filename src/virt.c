@@ -67,6 +67,10 @@
 #define HAVE_DOM_REASON_PAUSED_CRASHED 1
 #endif
 
+#if LIBVIR_CHECK_VERSION(1, 2, 8)
+#define HAVE_LIST_GET_STATS 1
+#endif
+
 #if LIBVIR_CHECK_VERSION(1, 2, 9)
 #define HAVE_JOB_STATS 1
 #endif
@@ -108,6 +112,7 @@ static const char *config_keys[] = {"Connection",
 
                                     "Instances",
                                     "ExtraStats",
+                                    "BulkStats",
                                     NULL};
 
 const char *domain_states[] = {
@@ -405,6 +410,9 @@ _Bool blockdevice_format_basename = 0;
 static enum bd_field blockdevice_format = target;
 static enum if_field interface_format = if_name;
 
+/* BulkStats */
+static _Bool bulk_stats = 0;
+
 /* Time that we last refreshed. */
 static time_t last_refresh = (time_t)0;
 
@@ -1070,6 +1078,17 @@ static int lv_config(const char *key, const char *value) {
     }
   }
 
+  if (strcasecmp(key, "BulkStats") == 0) {
+#ifdef HAVE_LIST_GET_STATS
+    bulk_stats = IS_TRUE(value);
+#else
+    if (IS_TRUE(value))
+      WARNING(PLUGIN_NAME " plugin: BulkStats requires libvirt 1.2.8 or "
+                          "later and is ignored.");
+#endif
+    return 0;
+  }
+
   /* Unrecognised option. */
   return -1;
 }
@@ -1578,6 +1597,449 @@ static int get_if_dev_stats(struct interface_device *if_dev) {
   return 0;
 }
 
+#ifdef HAVE_LIST_GET_STATS
+/* BulkStats: the counters of all domains of a reader instance are fetched
+ * with a single virDomainListGetStats() call instead of separate calls for
+ * each domain, block device and interface. */
+
+struct lv_bulk_device {
+  const char *name; /* "block.<n>.name" or "net.<n>.name" */
+  const char *path; /* "block.<n>.path" */
+  struct lv_block_info binfo;
+  virDomainInterfaceStatsStruct istats;
+};
+
+static int lv_param_get_ull(const virTypedParameter *param,
+                            unsigned long long *ret) {
+  switch (param->type) {
+  case VIR_TYPED_PARAM_INT:
+    *ret = (unsigned long long)param->value.i;
+    return 0;
+  case VIR_TYPED_PARAM_UINT:
+    *ret = param->value.ui;
+    return 0;
+  case VIR_TYPED_PARAM_LLONG:
+    *ret = (unsigned long long)param->value.l;
+    return 0;
+  case VIR_TYPED_PARAM_ULLONG:
+    *ret = param->value.ul;
+    return 0;
+  default:
+    return -1;
+  }
+}
+
+/* Splits a field such as "block.2.rd.bytes" into the index (2) and the
+ * remainder ("rd.bytes"). Returns NULL if `field' does not start with
+ * `prefix' followed by an index below `count'. */
+static const char *lv_param_device_field(const char *field,
+                                         const char *prefix, size_t count,
+                                         size_t *ret_index) {
+  size_t prefix_len = strlen(prefix);
+  char *endptr = NULL;
+  unsigned long index;
+
+  if (strncmp(field, prefix, prefix_len) != 0)
+    return NULL;
+
+  errno = 0;
+  index = strtoul(field + prefix_len, &endptr, 10);
+  if ((errno != 0) || (endptr == field + prefix_len) || (*endptr != '.') ||
+      (index >= count))
+    return NULL;
+
+  *ret_index = (size_t)index;
+  return endptr + 1;
+}
+
+static void lv_bulk_block_param(struct lv_bulk_device *dev, const char *field,
+                                const virTypedParameter *param) {
+  static const struct {
+    const char *field;
+    size_t offset;
+  } fields[] = {
+      {"rd.reqs", offsetof(struct lv_block_info, bi.rd_req)},
+      {"rd.bytes", offsetof(struct lv_block_info, bi.rd_bytes)},
+      {"rd.times", offsetof(struct lv_block_info, rd_total_times)},
+      {"wr.reqs", offsetof(struct lv_block_info, bi.wr_req)},
+      {"wr.bytes", offsetof(struct lv_block_info, bi.wr_bytes)},
+      {"wr.times", offsetof(struct lv_block_info, wr_total_times)},
+      {"fl.reqs", offsetof(struct lv_block_info, fl_req)},
+      {"fl.times", offsetof(struct lv_block_info, fl_total_times)},
+  };
+  unsigned long long value;
+
+  if (strcmp(field, "name") == 0) {
+    if (param->type == VIR_TYPED_PARAM_STRING)
+      dev->name = param->value.s;
+    return;
+  } else if (strcmp(field, "path") == 0) {
+    if (param->type == VIR_TYPED_PARAM_STRING)
+      dev->path = param->value.s;
+    return;
+  }
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(fields); i++) {
+    if (strcmp(field, fields[i].field) != 0)
+      continue;
+    if (lv_param_get_ull(param, &value) == 0)
+      *(long long *)((char *)&dev->binfo + fields[i].offset) =
+          (long long)value;
+    return;
+  }
+}
+
+static void lv_bulk_interface_param(struct lv_bulk_device *dev,
+                                    const char *field,
+                                    const virTypedParameter *param) {
+  static const struct {
+    const char *field;
+    size_t offset;
+  } fields[] = {
+      {"rx.bytes", offsetof(virDomainInterfaceStatsStruct, rx_bytes)},
+      {"rx.pkts", offsetof(virDomainInterfaceStatsStruct, rx_packets)},
+      {"rx.errs", offsetof(virDomainInterfaceStatsStruct, rx_errs)},
+      {"rx.drop", offsetof(virDomainInterfaceStatsStruct, rx_drop)},
+      {"tx.bytes", offsetof(virDomainInterfaceStatsStruct, tx_bytes)},
+      {"tx.pkts", offsetof(virDomainInterfaceStatsStruct, tx_packets)},
+      {"tx.errs", offsetof(virDomainInterfaceStatsStruct, tx_errs)},
+      {"tx.drop", offsetof(virDomainInterfaceStatsStruct, tx_drop)},
+  };
+  unsigned long long value;
+
+  if (strcmp(field, "name") == 0) {
+    if (param->type == VIR_TYPED_PARAM_STRING)
+      dev->name = param->value.s;
+    return;
+  }
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(fields); i++) {
+    if (strcmp(field, fields[i].field) != 0)
+      continue;
+    if (lv_param_get_ull(param, &value) == 0)
+      *(long long *)((char *)&dev->istats + fields[i].offset) =
+          (long long)value;
+    return;
+  }
+}
+
+static struct lv_bulk_device *lv_bulk_devices_alloc(size_t count) {
+  struct lv_bulk_device *devs = calloc(count, sizeof(*devs));
+  if (devs == NULL) {
+    ERROR(PLUGIN_NAME " plugin: calloc failed.");
+    return NULL;
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    init_block_info(&devs[i].binfo);
+    memset(&devs[i].istats, 0xff, sizeof(devs[i].istats)); /* all -1 */
+  }
+  return devs;
+}
+
+/* Submits the block device and interface counters of `domain', matching the
+ * devices of the record to those selected by refresh_lists(). */
+static void lv_bulk_devices_submit(struct lv_read_state *state,
+                                   domain_t *domain,
+                                   struct lv_bulk_device *blocks,
+                                   size_t blocks_num,
+                                   struct lv_bulk_device *ifaces,
+                                   size_t ifaces_num) {
+  for (int i = 0; i < state->nr_block_devices; ++i) {
+    struct block_device *block_dev = &state->block_devices[i];
+
+    if (block_dev->dom != domain->ptr)
+      continue;
+
+    for (size_t j = 0; j < blocks_num; j++) {
+      const char *name =
+          (blockdevice_format == source) ? blocks[j].path : blocks[j].name;
+      if ((name != NULL) && (strcmp(name, block_dev->path) == 0)) {
+        disk_submit(&blocks[j].binfo, domain->ptr, block_dev->path);
+        break;
+      }
+    }
+  }
+
+  for (int i = 0; i < state->nr_interface_devices; ++i) {
+    struct interface_device *if_dev = &state->interface_devices[i];
+    virDomainInterfaceStatsStruct *stats = NULL;
+    char *display_name;
+
+    if (if_dev->dom != domain->ptr)
+      continue;
+
+    for (size_t j = 0; j < ifaces_num; j++) {
+      if ((ifaces[j].name != NULL) &&
+          (strcmp(ifaces[j].name, if_dev->path) == 0)) {
+        stats = &ifaces[j].istats;
+        break;
+      }
+    }
+    if (stats == NULL)
+      continue;
+
+    switch (interface_format) {
+    case if_address:
+      display_name = if_dev->address;
+      break;
+    case if_number:
+      display_name = if_dev->number;
+      break;
+    case if_name:
+    default:
+      display_name = if_dev->path;
+    }
+
+    if ((stats->rx_bytes != -1) && (stats->tx_bytes != -1))
+      submit_derive2("if_octets", (derive_t)stats->rx_bytes,
+                     (derive_t)stats->tx_bytes, if_dev->dom, display_name);
+    if ((stats->rx_packets != -1) && (stats->tx_packets != -1))
+      submit_derive2("if_packets", (derive_t)stats->rx_packets,
+                     (derive_t)stats->tx_packets, if_dev->dom, display_name);
+    if ((stats->rx_errs != -1) && (stats->tx_errs != -1))
+      submit_derive2("if_errors", (derive_t)stats->rx_errs,
+                     (derive_t)stats->tx_errs, if_dev->dom, display_name);
+    if ((stats->rx_drop != -1) && (stats->tx_drop != -1))
+      submit_derive2("if_dropped", (derive_t)stats->rx_drop,
+                     (derive_t)stats->tx_drop, if_dev->dom, display_name);
+  }
+}
+
+/* Submits the metrics of one domain from its stats record. The metrics are
+ * the same as those submitted by get_domain_metrics(), get_block_stats() and
+ * get_if_dev_stats(). */
+static int lv_bulk_record_submit(struct lv_read_state *state,
+                                 domain_t *domain,
+                                 virDomainStatsRecordPtr record) {
+  /* In the order of the tags of memory_stats_submit(). */
+  static const char *balloon_fields[] = {
+      "balloon.swap_in",     "balloon.swap_out", "balloon.major_fault",
+      "balloon.minor_fault", "balloon.unused",   "balloon.available",
+      "balloon.current",     "balloon.rss",      "balloon.usable",
+      "balloon.last-update"};
+  struct lv_bulk_device *blocks = NULL;
+  struct lv_bulk_device *ifaces = NULL;
+  size_t blocks_num = 0;
+  size_t ifaces_num = 0;
+  int dom_state = VIR_DOMAIN_NOSTATE;
+  int dom_reason = 0;
+  unsigned long long value;
+
+  /* The device counts precede the device fields. */
+  for (int i = 0; i < record->nparams; ++i) {
+    const virTypedParameter *param = &record->params[i];
+
+    if (strcmp(param->field, "state.state") == 0) {
+      if (lv_param_get_ull(param, &value) == 0)
+        dom_state = (int)value;
+    } else if (strcmp(param->field, "state.reason") == 0) {
+      if (lv_param_get_ull(param, &value) == 0)
+        dom_reason = (int)value;
+    } else if ((strcmp(param->field, "block.count") == 0) &&
+               (blocks == NULL)) {
+      if ((lv_param_get_ull(param, &value) == 0) && (value > 0)) {
+        blocks = lv_bulk_devices_alloc((size_t)value);
+        if (blocks != NULL)
+          blocks_num = (size_t)value;
+      }
+    } else if ((strcmp(param->field, "net.count") == 0) && (ifaces == NULL)) {
+      if ((lv_param_get_ull(param, &value) == 0) && (value > 0)) {
+        ifaces = lv_bulk_devices_alloc((size_t)value);
+        if (ifaces != NULL)
+          ifaces_num = (size_t)value;
+      }
+    }
+  }
+
+  if (extra_stats & ex_stats_domain_state)
+    domain_state_submit(domain->ptr, dom_state, dom_reason);
+
+  /* Gather remaining stats only for running domains */
+  if (dom_state != VIR_DOMAIN_RUNNING) {
+    sfree(blocks);
+    sfree(ifaces);
+    return 0;
+  }
+
+  unsigned long long cpu_time = 0;
+  unsigned long long cpu_user = 0;
+  unsigned long long cpu_system = 0;
+  _Bool have_cpu_time = 0;
+  _Bool have_cpu_user = 0;
+  _Bool have_cpu_system = 0;
+  unsigned short nr_virt_cpu = 0;
+
+  for (int i = 0; i < record->nparams; ++i) {
+    const virTypedParameter *param = &record->params[i];
+    const char *field = param->field;
+    const char *dev_field;
+    size_t index;
+
+    if (strcmp(field, "cpu.time") == 0) {
+      have_cpu_time = (lv_param_get_ull(param, &cpu_time) == 0);
+    } else if (strcmp(field, "cpu.user") == 0) {
+      have_cpu_user = (lv_param_get_ull(param, &cpu_user) == 0);
+    } else if (strcmp(field, "cpu.system") == 0) {
+      have_cpu_system = (lv_param_get_ull(param, &cpu_system) == 0);
+    } else if (strcmp(field, "vcpu.current") == 0) {
+      if (lv_param_get_ull(param, &value) == 0)
+        nr_virt_cpu = (unsigned short)value;
+    } else if ((strncmp(field, "vcpu.", strlen("vcpu.")) == 0) &&
+               !(extra_stats & ex_stats_vcpupin)) {
+      /* With vcpupin, get_vcpu_stats() submits the vCPU times. */
+      char *endptr = NULL;
+      long vcpu = strtol(field + strlen("vcpu."), &endptr, 10);
+      if ((endptr != NULL) && (strcmp(endptr, ".time") == 0) &&
+          (lv_param_get_ull(param, &value) == 0))
+        vcpu_submit((derive_t)value, domain->ptr, (int)vcpu, "virt_vcpu");
+    } else if (strncmp(field, "balloon.", strlen("balloon.")) == 0) {
+      if (lv_param_get_ull(param, &value) != 0)
+        continue;
+      if (strcmp(field, "balloon.current") == 0)
+        memory_submit(domain->ptr, (gauge_t)value * 1024);
+      for (size_t j = 0; j < STATIC_ARRAY_SIZE(balloon_fields); j++) {
+        if (strcmp(field, balloon_fields[j]) == 0) {
+          memory_stats_submit((gauge_t)value * 1024, domain->ptr, (int)j);
+          break;
+        }
+      }
+    } else if ((dev_field = lv_param_device_field(field, "block.", blocks_num,
+                                                  &index)) != NULL) {
+      lv_bulk_block_param(blocks + index, dev_field, param);
+    } else if ((dev_field = lv_param_device_field(field, "net.", ifaces_num,
+                                                  &index)) != NULL) {
+      lv_bulk_interface_param(ifaces + index, dev_field, param);
+    }
+  }
+
+#ifdef HAVE_CPU_STATS
+  if (have_cpu_user && have_cpu_system && (extra_stats & ex_stats_pcpu))
+    submit_derive2("ps_cputime", (derive_t)cpu_user, (derive_t)cpu_system,
+                   domain->ptr, NULL);
+#endif /* HAVE_CPU_STATS */
+
+  if (have_cpu_time) {
+    cpu_submit(domain, cpu_time);
+    /* Cached for the next cpu_submit(). */
+    domain->info.cpuTime = cpu_time;
+  }
+
+  lv_bulk_devices_submit(state, domain, blocks, blocks_num, ifaces,
+                         ifaces_num);
+  sfree(blocks);
+  sfree(ifaces);
+
+#ifdef HAVE_PERF_STATS
+  if (extra_stats & ex_stats_perf) {
+    /* perf_submit() submits all parameters of the record it is given. */
+    virDomainStatsRecord perf_record = {.dom = domain->ptr};
+
+    perf_record.params = calloc(record->nparams, sizeof(*perf_record.params));
+    if (perf_record.params != NULL) {
+      for (int i = 0; i < record->nparams; ++i)
+        if (strncmp(record->params[i].field, "perf.", strlen("perf.")) == 0)
+          perf_record.params[perf_record.nparams++] = record->params[i];
+      perf_submit(&perf_record);
+      sfree(perf_record.params);
+    }
+  }
+#endif
+
+  /* Statistics which are not part of the records. */
+  int status;
+  if ((extra_stats & ex_stats_vcpupin) && (nr_virt_cpu > 0))
+    GET_STATS(get_vcpu_stats, "vcpu stats", domain->ptr, nr_virt_cpu);
+
+#ifdef HAVE_FS_INFO
+  if (extra_stats & ex_stats_fs_info)
+    GET_STATS(get_fs_info, "file system info", domain->ptr);
+#endif
+
+#ifdef HAVE_DISK_ERR
+  if (extra_stats & ex_stats_disk_err)
+    GET_STATS(get_disk_err, "disk errors", domain->ptr);
+#endif
+
+#ifdef HAVE_JOB_STATS
+  if (extra_stats &
+      (ex_stats_job_stats_completed | ex_stats_job_stats_background))
+    GET_STATS(get_job_stats, "job stats", domain->ptr);
+#endif
+
+  return 0;
+}
+
+/* Returns the domain of `state' the record `dom' belongs to. Records are
+ * usually returned in the order the domains were passed in, so `hint' is
+ * checked first. */
+static domain_t *lv_bulk_find_domain(struct lv_read_state *state,
+                                     virDomainPtr dom, int hint) {
+  unsigned char uuid[VIR_UUID_BUFLEN];
+  unsigned char other[VIR_UUID_BUFLEN];
+
+  if (virDomainGetUUID(dom, uuid) != 0)
+    return NULL;
+
+  for (int i = 0; i < state->nr_domains; ++i) {
+    int j = (hint + i) % state->nr_domains;
+    if ((virDomainGetUUID(state->domains[j].ptr, other) == 0) &&
+        (memcmp(uuid, other, sizeof(uuid)) == 0))
+      return &state->domains[j];
+  }
+
+  return NULL;
+}
+
+static int lv_read_bulk(struct lv_read_state *state) {
+  virDomainStatsRecordPtr *records = NULL;
+  unsigned int stats = VIR_DOMAIN_STATS_STATE | VIR_DOMAIN_STATS_CPU_TOTAL |
+                       VIR_DOMAIN_STATS_BALLOON | VIR_DOMAIN_STATS_VCPU;
+  int records_num;
+
+  if (state->nr_domains == 0)
+    return 0;
+
+  if (state->nr_block_devices > 0)
+    stats |= VIR_DOMAIN_STATS_BLOCK;
+  if (state->nr_interface_devices > 0)
+    stats |= VIR_DOMAIN_STATS_INTERFACE;
+#ifdef HAVE_PERF_STATS
+  if (extra_stats & ex_stats_perf)
+    stats |= VIR_DOMAIN_STATS_PERF;
+#endif
+
+  /* virDomainListGetStats requires a NULL terminated list of domains */
+  virDomainPtr *doms = calloc(state->nr_domains + 1, sizeof(*doms));
+  if (doms == NULL) {
+    ERROR(PLUGIN_NAME " plugin: calloc failed.");
+    return -1;
+  }
+  for (int i = 0; i < state->nr_domains; ++i)
+    doms[i] = state->domains[i].ptr;
+
+  records_num = virDomainListGetStats(doms, stats, &records, 0);
+  sfree(doms);
+  if (records_num < 0) {
+    VIRT_ERROR(conn, "virDomainListGetStats");
+    return -1;
+  }
+
+  for (int i = 0; i < records_num; ++i) {
+    domain_t *domain = lv_bulk_find_domain(state, records[i]->dom, i);
+    if (domain == NULL)
+      continue;
+
+    if (lv_bulk_record_submit(state, domain, records[i]) != 0)
+      ERROR(PLUGIN_NAME " failed to get metrics for domain=%s",
+            virDomainGetName(domain->ptr));
+  }
+
+  virDomainStatsRecordListFree(records);
+  return 0;
+}
+#endif /* HAVE_LIST_GET_STATS */
+
 static int lv_read(user_data_t *ud) {
   time_t t;
   struct lv_read_instance *inst = NULL;
@@ -1622,6 +2084,11 @@ static int lv_read(user_data_t *ud) {
                  interface_devices[i].path);
 #endif
 
+#ifdef HAVE_LIST_GET_STATS
+  if (bulk_stats)
+    return lv_read_bulk(state);
+#endif
+
   /* Get domains' metrics */
   for (int i = 0; i < state->nr_domains; ++i) {
     int status = get_domain_metrics(&state->domains[i]);
@@ -2180,6 +2647,6 @@ static int lv_shutdown(void) {
 
 void module_register(void) {
   plugin_register_config(PLUGIN_NAME, lv_config, config_keys, NR_CONFIG_KEYS);
-  plugin_register_init(PLUGIN_NAME, lv_init);
+  plugin_register_init_parallel(PLUGIN_NAME, lv_init);
   plugin_register_shutdown(PLUGIN_NAME, lv_shutdown);
 }
@@ -29,6 +29,10 @@
 #include "common.h"
 #include "plugin.h"
 
+#if KERNEL_LINUX
+#include "utils_procfs.h"
+#endif
+
 #if KERNEL_LINUX
 static const char *config_keys[] = {"Verbose"};
 static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
@@ -40,12 +44,14 @@ static int verbose_output = 0;
 #error "No applicable input method."
 #endif /* HAVE_LIBSTATGRAB */
 
-static void submit(const char *plugin_instance, const char *type,
-                   const char *type_instance, value_t *values, int values_len) {
+static void submit(cdtime_t time, const char *plugin_instance,
+                   const char *type, const char *type_instance, value_t *values,
+                   int values_len) {
   value_list_t vl = VALUE_LIST_INIT;
 
   vl.values = values;
   vl.values_len = values_len;
+  vl.time = time;
 
   sstrncpy(vl.plugin, "vmem", sizeof(vl.plugin));
   if (plugin_instance != NULL)
@@ -57,19 +63,21 @@ static void submit(const char *plugin_instance, const char *type,
   plugin_dispatch_values(&vl);
 } /* void vmem_submit */
 
-static void submit_two(const char *plugin_instance, const char *type,
-                       const char *type_instance, derive_t c0, derive_t c1) {
+static void submit_two(cdtime_t time, const char *plugin_instance,
+                       const char *type, const char *type_instance, derive_t c0,
+                       derive_t c1) {
   value_t values[] = {
       {.derive = c0}, {.derive = c1},
   };
 
-  submit(plugin_instance, type, type_instance, values,
+  submit(time, plugin_instance, type, type_instance, values,
          STATIC_ARRAY_SIZE(values));
 } /* void submit_one */
 
-static void submit_one(const char *plugin_instance, const char *type,
-                       const char *type_instance, value_t value) {
-  submit(plugin_instance, type, type_instance, &value, 1);
+static void submit_one(cdtime_t time, const char *plugin_instance,
+                       const char *type, const char *type_instance,
+                       value_t value) {
+  submit(time, plugin_instance, type, type_instance, &value, 1);
 } /* void submit_one */
 
 static int vmem_config(const char *key, const char *value) {
@@ -99,38 +107,22 @@ static int vmem_read(void) {
   derive_t pgmajfault = 0;
   int pgfaultvalid = 0;
 
-  FILE *fh;
-  char buffer[1024];
+  procfs_snapshot_t *s;
+  procfs_entry_t const *entries;
+  size_t entries_num;
 
-  fh = fopen("/proc/vmstat", "r");
-  if (fh == NULL) {
-    ERROR("vmem plugin: fopen (/proc/vmstat) failed: %s", STRERRNO);
+  s = procfs_snapshot_acquire("/proc/vmstat");
+  if (s == NULL) {
+    ERROR("vmem plugin: Reading /proc/vmstat failed: %s", STRERRNO);
     return -1;
   }
 
-  while (fgets(buffer, sizeof(buffer), fh) != NULL) {
-    char *fields[4];
-    int fields_num;
-    char *key;
-    char *endptr;
-    derive_t counter;
-    gauge_t gauge;
-
-    fields_num = strsplit(buffer, fields, STATIC_ARRAY_SIZE(fields));
-    if (fields_num != 2)
-      continue;
-
-    key = fields[0];
-
-    endptr = NULL;
-    counter = strtoll(fields[1], &endptr, 10);
-    if (fields[1] == endptr)
-      continue;
-
-    endptr = NULL;
-    gauge = strtod(fields[1], &endptr);
-    if (fields[1] == endptr)
-      continue;
+  cdtime_t t = procfs_snapshot_time(s);
+  entries = procfs_snapshot_entries(s, &entries_num);
+  for (size_t i = 0; i < entries_num; i++) {
+    char const *key = entries[i].key;
+    derive_t counter = (derive_t)entries[i].value;
+    gauge_t gauge = (gauge_t)entries[i].value;
 
     /*
      * Number of pages
@@ -138,13 +130,13 @@ static int vmem_read(void) {
      * The total number of {inst} pages, e. g dirty pages.
      */
     if (strncmp("nr_", key, strlen("nr_")) == 0) {
-      char *inst = key + strlen("nr_");
+      char const *inst = key + strlen("nr_");
       if (strcmp(inst, "dirtied") == 0 || strcmp(inst, "written") == 0) {
         value_t value = {.derive = counter};
-        submit_one(NULL, "vmpage_action", inst, value);
+        submit_one(t, NULL, "vmpage_action", inst, value);
       } else {
         value_t value = {.gauge = gauge};
-        submit_one(NULL, "vmpage_number", inst, value);
+        submit_one(t, NULL, "vmpage_number", inst, value);
       }
     }
 
@@ -187,37 +179,37 @@ static int vmem_read(void) {
      * ``per zone'', i. e. for DMA, DMA32, normal and possibly highmem.
      */
     else if (strncmp("pgalloc_", key, strlen("pgalloc_")) == 0) {
-      char *inst = key + strlen("pgalloc_");
+      char const *inst = key + strlen("pgalloc_");
       value_t value = {.derive = counter};
-      submit_one(inst, "vmpage_action", "alloc", value);
+      submit_one(t, inst, "vmpage_action", "alloc", value);
     } else if (strncmp("pgrefill_", key, strlen("pgrefill_")) == 0) {
-      char *inst = key + strlen("pgrefill_");
+      char const *inst = key + strlen("pgrefill_");
       value_t value = {.derive = counter};
-      submit_one(inst, "vmpage_action", "refill", value);
+      submit_one(t, inst, "vmpage_action", "refill", value);
     } else if (strncmp("pgsteal_kswapd_", key, strlen("pgsteal_kswapd_")) ==
                0) {
-      char *inst = key + strlen("pgsteal_kswapd_");
+      char const *inst = key + strlen("pgsteal_kswapd_");
       value_t value = {.derive = counter};
-      submit_one(inst, "vmpage_action", "steal_kswapd", value);
+      submit_one(t, inst, "vmpage_action", "steal_kswapd", value);
     } else if (strncmp("pgsteal_direct_", key, strlen("pgsteal_direct_")) ==
                0) {
-      char *inst = key + strlen("pgsteal_direct_");
+      char const *inst = key + strlen("pgsteal_direct_");
       value_t value = {.derive = counter};
-      submit_one(inst, "vmpage_action", "steal_direct", value);
+      submit_one(t, inst, "vmpage_action", "steal_direct", value);
     }
     /* For backwards compatibility (somewhen before 4.2.3) */
     else if (strncmp("pgsteal_", key, strlen("pgsteal_")) == 0) {
-      char *inst = key + strlen("pgsteal_");
+      char const *inst = key + strlen("pgsteal_");
       value_t value = {.derive = counter};
-      submit_one(inst, "vmpage_action", "steal", value);
+      submit_one(t, inst, "vmpage_action", "steal", value);
     } else if (strncmp("pgscan_kswapd_", key, strlen("pgscan_kswapd_")) == 0) {
-      char *inst = key + strlen("pgscan_kswapd_");
+      char const *inst = key + strlen("pgscan_kswapd_");
       value_t value = {.derive = counter};
-      submit_one(inst, "vmpage_action", "scan_kswapd", value);
+      submit_one(t, inst, "vmpage_action", "scan_kswapd", value);
     } else if (strncmp("pgscan_direct_", key, strlen("pgscan_direct_")) == 0) {
-      char *inst = key + strlen("pgscan_direct_");
+      char const *inst = key + strlen("pgscan_direct_");
       value_t value = {.derive = counter};
-      submit_one(inst, "vmpage_action", "scan_direct", value);
+      submit_one(t, inst, "vmpage_action", "scan_direct", value);
     }
 
     /*
@@ -228,27 +220,26 @@ static int vmem_read(void) {
      */
     else if (strcmp("pgfree", key) == 0) {
       value_t value = {.derive = counter};
-      submit_one(NULL, "vmpage_action", "free", value);
+      submit_one(t, NULL, "vmpage_action", "free", value);
     } else if (strcmp("pgactivate", key) == 0) {
       value_t value = {.derive = counter};
-      submit_one(NULL, "vmpage_action", "activate", value);
+      submit_one(t, NULL, "vmpage_action", "activate", value);
     } else if (strcmp("pgdeactivate", key) == 0) {
       value_t value = {.derive = counter};
-      submit_one(NULL, "vmpage_action", "deactivate", value);
+      submit_one(t, NULL, "vmpage_action", "deactivate", value);
     }
-  } /* while (fgets) */
+  } /* for (entries) */
 
-  fclose(fh);
-  fh = NULL;
+  procfs_snapshot_release(s);
 
   if (pgfaultvalid == 0x03)
-    submit_two(NULL, "vmpage_faults", NULL, pgfault, pgmajfault);
+    submit_two(t, NULL, "vmpage_faults", NULL, pgfault, pgmajfault);
 
   if (pgpgvalid == 0x03)
-    submit_two(NULL, "vmpage_io", "memory", pgpgin, pgpgout);
+    submit_two(t, NULL, "vmpage_io", "memory", pgpgin, pgpgout);
 
   if (pswpvalid == 0x03)
-    submit_two(NULL, "vmpage_io", "swap", pswpin, pswpout);
+    submit_two(t, NULL, "vmpage_io", "swap", pswpin, pswpout);
 #endif /* KERNEL_LINUX */
 
   return 0;
@@ -38,6 +38,9 @@
  *     Protocol "udp"
  *     LogSendErrors true
  *     Prefix "collectd"
+ *     SendBufferSize 65536
+ *     Connections 4
+ *     ReportStats true
  *   </Carbon>
  * </Plugin>
  */
@@ -47,10 +50,8 @@
 #include "common.h"
 #include "plugin.h"
 
-#include "utils_complain.h"
 #include "utils_format_graphite.h"
-
-#include <netdb.h>
+#include "utils_output.h"
 
 #ifndef WG_DEFAULT_NODE
 #define WG_DEFAULT_NODE "localhost"
@@ -77,16 +78,19 @@
 #define WG_SEND_BUF_SIZE 1428
 #endif
 
-#ifndef WG_MIN_RECONNECT_INTERVAL
-#define WG_MIN_RECONNECT_INTERVAL TIME_T_TO_CDTIME_T(1)
+/* The largest payload of a UDP datagram. */
+#define WG_MAX_DATAGRAM_SIZE 65507
+
+#ifndef WG_DEFAULT_BACKLOG_SIZE
+#define WG_DEFAULT_BACKLOG_SIZE (1024 * 1024)
 #endif
 
+#define WG_MAX_CONNECTIONS 64
+
 /*
  * Private variables
  */
 struct wg_callback {
-  int sock_fd;
-
   char *name;
 
   char *node;
@@ -99,186 +103,21 @@ struct wg_callback {
 
   unsigned int format_flags;
 
-  char send_buf[WG_SEND_BUF_SIZE];
-  size_t send_buf_free;
-  size_t send_buf_fill;
-  cdtime_t send_buf_init_time;
-
-  pthread_mutex_t send_lock;
-  c_complain_t init_complaint;
-  cdtime_t last_connect_time;
+  size_t send_buf_size;
+  size_t backlog_size;
+  size_t connections_num;
 
   /* Force reconnect useful for load balanced environments */
-  cdtime_t last_reconnect_time;
   cdtime_t reconnect_interval;
-  _Bool reconnect_interval_reached;
-};
-
-/* wg_force_reconnect_check closes cb->sock_fd when it was open for longer
- * than cb->reconnect_interval. Must hold cb->send_lock when calling. */
-static void wg_force_reconnect_check(struct wg_callback *cb) {
-  cdtime_t now;
-
-  if (cb->reconnect_interval == 0)
-    return;
-
-  /* check if address changes if addr_timeout */
-  now = cdtime();
-  if ((now - cb->last_reconnect_time) < cb->reconnect_interval)
-    return;
 
-  /* here we should close connection on next */
-  close(cb->sock_fd);
-  cb->sock_fd = -1;
-  cb->last_reconnect_time = now;
-  cb->reconnect_interval_reached = 1;
+  _Bool report_stats;
 
-  INFO("write_graphite plugin: Connection closed after %.3f seconds.",
-       CDTIME_T_TO_DOUBLE(now - cb->last_reconnect_time));
-}
+  output_t *output;
+};
 
 /*
  * Functions
  */
-static void wg_reset_buffer(struct wg_callback *cb) {
-  memset(cb->send_buf, 0, sizeof(cb->send_buf));
-  cb->send_buf_free = sizeof(cb->send_buf);
-  cb->send_buf_fill = 0;
-  cb->send_buf_init_time = cdtime();
-}
-
-static int wg_send_buffer(struct wg_callback *cb) {
-  ssize_t status;
-
-  if (cb->sock_fd < 0)
-    return -1;
-
-  status = swrite(cb->sock_fd, cb->send_buf, strlen(cb->send_buf));
-  if (status != 0) {
-    if (cb->log_send_errors) {
-      ERROR("write_graphite plugin: send to %s:%s (%s) failed with status %zi "
-            "(%s)",
-            cb->node, cb->service, cb->protocol, status, STRERRNO);
-    }
-
-    close(cb->sock_fd);
-    cb->sock_fd = -1;
-
-    return -1;
-  }
-
-  return 0;
-}
-
-/* NOTE: You must hold cb->send_lock when calling this function! */
-static int wg_flush_nolock(cdtime_t timeout, struct wg_callback *cb) {
-  int status;
-
-  DEBUG("write_graphite plugin: wg_flush_nolock: timeout = %.3f; "
-        "send_buf_fill = %" PRIsz ";",
-        (double)timeout, cb->send_buf_fill);
-
-  /* timeout == 0  => flush unconditionally */
-  if (timeout > 0) {
-    cdtime_t now;
-
-    now = cdtime();
-    if ((cb->send_buf_init_time + timeout) > now)
-      return 0;
-  }
-
-  if (cb->send_buf_fill == 0) {
-    cb->send_buf_init_time = cdtime();
-    return 0;
-  }
-
-  status = wg_send_buffer(cb);
-  wg_reset_buffer(cb);
-
-  return status;
-}
-
-static int wg_callback_init(struct wg_callback *cb) {
-  struct addrinfo *ai_list;
-  cdtime_t now;
-  int status;
-
-  char connerr[1024] = "";
-
-  if (cb->sock_fd > 0)
-    return 0;
-
-  /* Don't try to reconnect too often. By default, one reconnection attempt
-   * is made per second. */
-  now = cdtime();
-  if ((now - cb->last_connect_time) < WG_MIN_RECONNECT_INTERVAL)
-    return EAGAIN;
-  cb->last_connect_time = now;
-
-  struct addrinfo ai_hints = {.ai_family = AF_UNSPEC,
-                              .ai_flags = AI_ADDRCONFIG};
-
-  if (0 == strcasecmp("tcp", cb->protocol))
-    ai_hints.ai_socktype = SOCK_STREAM;
-  else
-    ai_hints.ai_socktype = SOCK_DGRAM;
-
-  status = getaddrinfo(cb->node, cb->service, &ai_hints, &ai_list);
-  if (status != 0) {
-    ERROR("write_graphite plugin: getaddrinfo (%s, %s, %s) failed: %s",
-          cb->node, cb->service, cb->protocol, gai_strerror(status));
-    return -1;
-  }
-
-  assert(ai_list != NULL);
-  for (struct addrinfo *ai_ptr = ai_list; ai_ptr != NULL;
-       ai_ptr = ai_ptr->ai_next) {
-    cb->sock_fd =
-        socket(ai_ptr->ai_family, ai_ptr->ai_socktype, ai_ptr->ai_protocol);
-    if (cb->sock_fd < 0) {
-      snprintf(connerr, sizeof(connerr), "failed to open socket: %s", STRERRNO);
-      continue;
-    }
-
-    set_sock_opts(cb->sock_fd);
-
-    status = connect(cb->sock_fd, ai_ptr->ai_addr, ai_ptr->ai_addrlen);
-    if (status != 0) {
-      snprintf(connerr, sizeof(connerr), "failed to connect to remote host: %s",
-               STRERRNO);
-      close(cb->sock_fd);
-      cb->sock_fd = -1;
-      continue;
-    }
-
-    break;
-  }
-
-  freeaddrinfo(ai_list);
-
-  if (cb->sock_fd < 0) {
-    c_complain(LOG_ERR, &cb->init_complaint,
-               "write_graphite plugin: Connecting to %s:%s via %s failed. "
-               "The last error was: %s",
-               cb->node, cb->service, cb->protocol, connerr);
-    return -1;
-  } else {
-    c_release(LOG_INFO, &cb->init_complaint,
-              "write_graphite plugin: Successfully connected to %s:%s via %s.",
-              cb->node, cb->service, cb->protocol);
-  }
-
-  /* wg_force_reconnect_check does not flush the buffer before closing a
-   * sending socket, so only call wg_reset_buffer() if the socket was closed
-   * for a different reason (tracked in cb->reconnect_interval_reached). */
-  if (!cb->reconnect_interval_reached || (cb->send_buf_free == 0))
-    wg_reset_buffer(cb);
-  else
-    cb->reconnect_interval_reached = 0;
-
-  return 0;
-}
-
 static void wg_callback_free(void *data) {
   struct wg_callback *cb;
 
@@ -287,14 +126,7 @@ static void wg_callback_free(void *data) {
 
   cb = data;
 
-  pthread_mutex_lock(&cb->send_lock);
-
-  wg_flush_nolock(/* timeout = */ 0, cb);
-
-  if (cb->sock_fd >= 0) {
-    close(cb->sock_fd);
-    cb->sock_fd = -1;
-  }
+  output_destroy(cb->output);
 
   sfree(cb->name);
   sfree(cb->node);
@@ -303,9 +135,6 @@ static void wg_callback_free(void *data) {
   sfree(cb->prefix);
   sfree(cb->postfix);
 
-  pthread_mutex_unlock(&cb->send_lock);
-  pthread_mutex_destroy(&cb->send_lock);
-
   sfree(cb);
 }
 
@@ -313,76 +142,41 @@ static int wg_flush(cdtime_t timeout,
                     const char *identifier __attribute__((unused)),
                     user_data_t *user_data) {
   struct wg_callback *cb;
-  int status;
 
   if (user_data == NULL)
     return -EINVAL;
 
   cb = user_data->data;
 
-  pthread_mutex_lock(&cb->send_lock);
+  /* Queues the buffers for sending and returns without waiting for them. */
+  output_flush(cb->output, timeout);
 
-  if (cb->sock_fd < 0) {
-    status = wg_callback_init(cb);
-    if (status != 0) {
-      /* An error message has already been printed. */
-      pthread_mutex_unlock(&cb->send_lock);
-      return -1;
-    }
-  }
-
-  status = wg_flush_nolock(timeout, cb);
-  pthread_mutex_unlock(&cb->send_lock);
-
-  return status;
+  return 0;
 }
 
-static int wg_send_message(char const *message, struct wg_callback *cb) {
-  int status;
-  size_t message_len;
-
-  message_len = strlen(message);
-
-  pthread_mutex_lock(&cb->send_lock);
-
-  wg_force_reconnect_check(cb);
-
-  if (cb->sock_fd < 0) {
-    status = wg_callback_init(cb);
-    if (status != 0) {
-      /* An error message has already been printed. */
-      pthread_mutex_unlock(&cb->send_lock);
-      return -1;
-    }
-  }
-
-  if (message_len >= cb->send_buf_free) {
-    status = wg_flush_nolock(/* timeout = */ 0, cb);
-    if (status != 0) {
-      pthread_mutex_unlock(&cb->send_lock);
-      return status;
-    }
-  }
-
-  /* Assert that we have enough space for this message. */
-  assert(message_len < cb->send_buf_free);
+/* wg_read dispatches the statistics of the connections. */
+static int wg_read(user_data_t *user_data) {
+  struct wg_callback *cb = user_data->data;
 
-  /* `message_len + 1' because `message_len' does not include the
-   * trailing null byte. Neither does `send_buffer_fill'. */
-  memcpy(cb->send_buf + cb->send_buf_fill, message, message_len + 1);
-  cb->send_buf_fill += message_len;
-  cb->send_buf_free -= message_len;
+  output_submit_stats(cb->output, "write_graphite",
+                      (cb->name != NULL) ? cb->name : cb->node);
+  return 0;
+}
 
-  DEBUG("write_graphite plugin: [%s]:%s (%s) buf %" PRIsz "/%" PRIsz
-        " (%.1f %%) \"%s\"",
-        cb->node, cb->service, cb->protocol, cb->send_buf_fill,
-        sizeof(cb->send_buf),
-        100.0 * ((double)cb->send_buf_fill) / ((double)sizeof(cb->send_buf)),
-        message);
+/* All values of a value list, and every update of a series, use the same
+ * connection, so their order is kept. */
+static uint64_t wg_connection_key(struct wg_callback *cb,
+                                  const value_list_t *vl) {
+  if (cb->connections_num == 1)
+    return 0;
 
-  pthread_mutex_unlock(&cb->send_lock);
+  value_list_identity_t const *identity = VALUE_LIST_IDENTITY(vl);
+  if (identity != NULL)
+    return identity->hash;
 
-  return 0;
+  char name[6 * DATA_MAX_NAME_LEN];
+  FORMAT_VL(name, sizeof(name), vl);
+  return identifier_hash(name);
 }
 
 static int wg_write_messages(const data_set_t *ds, const value_list_t *vl,
@@ -402,9 +196,19 @@ static int wg_write_messages(const data_set_t *ds, const value_list_t *vl,
     return status;
 
   /* Send the message to graphite */
-  status = wg_send_message(buffer, cb);
-  if (status != 0) /* error message has been printed already. */
-    return status;
+  size_t message_len = strlen(buffer);
+  status = output_write(cb->output, wg_connection_key(cb, vl), buffer,
+                        message_len);
+  if (status == EMSGSIZE) {
+    ERROR("write_graphite plugin: A message of %" PRIsz " bytes does not fit "
+          "into the send buffer of %" PRIsz " bytes.",
+          message_len, cb->send_buf_size);
+    return -1;
+  } else if (status != 0) {
+    ERROR("write_graphite plugin: Queueing the message failed: %s",
+          STRERROR(status));
+    return -1;
+  }
 
   return 0;
 } /* int wg_write_messages */
@@ -449,6 +253,26 @@ static int config_set_char(char *dest, oconfig_item_t *ci) {
   return 0;
 }
 
+static int config_set_size(size_t *dest, oconfig_item_t *ci, size_t min,
+                           size_t max) {
+  int tmp = 0;
+  int status;
+
+  status = cf_util_get_int(ci, &tmp);
+  if (status != 0)
+    return status;
+
+  if ((tmp < 0) || ((size_t)tmp < min) || ((size_t)tmp > max)) {
+    ERROR("write_graphite plugin: The \"%s\" option must be between %" PRIsz
+          " and %" PRIsz ".",
+          ci->key, min, max);
+    return -1;
+  }
+
+  *dest = (size_t)tmp;
+  return 0;
+}
+
 static int wg_config_node(oconfig_item_t *ci) {
   struct wg_callback *cb;
   char callback_name[DATA_MAX_NAME_LEN];
@@ -459,19 +283,19 @@ static int wg_config_node(oconfig_item_t *ci) {
     ERROR("write_graphite plugin: calloc failed.");
     return -1;
   }
-  cb->sock_fd = -1;
   cb->name = NULL;
   cb->node = strdup(WG_DEFAULT_NODE);
   cb->service = strdup(WG_DEFAULT_SERVICE);
   cb->protocol = strdup(WG_DEFAULT_PROTOCOL);
-  cb->last_reconnect_time = cdtime();
   cb->reconnect_interval = 0;
-  cb->reconnect_interval_reached = 0;
   cb->log_send_errors = WG_DEFAULT_LOG_SEND_ERRORS;
   cb->prefix = NULL;
   cb->postfix = NULL;
   cb->escape_char = WG_DEFAULT_ESCAPE;
   cb->format_flags = GRAPHITE_STORE_RATES;
+  cb->send_buf_size = WG_SEND_BUF_SIZE;
+  cb->backlog_size = WG_DEFAULT_BACKLOG_SIZE;
+  cb->connections_num = 1;
 
   /* FIXME: Legacy configuration syntax. */
   if (strcasecmp("Carbon", ci->key) != 0) {
@@ -482,9 +306,6 @@ static int wg_config_node(oconfig_item_t *ci) {
     }
   }
 
-  pthread_mutex_init(&cb->send_lock, /* attr = */ NULL);
-  C_COMPLAIN_INIT(&cb->init_complaint);
-
   for (int i = 0; i < ci->children_num; i++) {
     oconfig_item_t *child = ci->children + i;
 
@@ -520,6 +341,16 @@ static int wg_config_node(oconfig_item_t *ci) {
       cf_util_get_flag(child, &cb->format_flags, GRAPHITE_DROP_DUPE_FIELDS);
     else if (strcasecmp("EscapeCharacter", child->key) == 0)
       config_set_char(&cb->escape_char, child);
+    else if (strcasecmp("SendBufferSize", child->key) == 0)
+      status = config_set_size(&cb->send_buf_size, child, WG_SEND_BUF_SIZE,
+                               16 * 1024 * 1024);
+    else if (strcasecmp("BacklogSize", child->key) == 0)
+      status = config_set_size(&cb->backlog_size, child, 0, SIZE_MAX);
+    else if (strcasecmp("Connections", child->key) == 0)
+      status = config_set_size(&cb->connections_num, child, 1,
+                               WG_MAX_CONNECTIONS);
+    else if (strcasecmp("ReportStats", child->key) == 0)
+      status = cf_util_get_boolean(child, &cb->report_stats);
     else {
       ERROR("write_graphite plugin: Invalid configuration "
             "option: %s.",
@@ -531,6 +362,34 @@ static int wg_config_node(oconfig_item_t *ci) {
       break;
   }
 
+  if ((status == 0) && (strcasecmp("UDP", cb->protocol) == 0) &&
+      (cb->send_buf_size > WG_MAX_DATAGRAM_SIZE)) {
+    WARNING("write_graphite plugin: Limiting the SendBufferSize to %d bytes, "
+            "the largest UDP datagram.",
+            WG_MAX_DATAGRAM_SIZE);
+    cb->send_buf_size = WG_MAX_DATAGRAM_SIZE;
+  }
+
+  if (status == 0) {
+    output_config_t conf = {
+        .plugin = "write_graphite",
+        .node = cb->node,
+        .service = cb->service,
+        .socktype = (strcasecmp("UDP", cb->protocol) == 0) ? SOCK_DGRAM
+                                                             : SOCK_STREAM,
+        .buffer_size = cb->send_buf_size,
+        .backlog_size = cb->backlog_size,
+        .connections_num = cb->connections_num,
+        .reconnect_interval = cb->reconnect_interval,
+        .log_send_errors = cb->log_send_errors,
+    };
+    cb->output = output_create(&conf);
+    if (cb->output == NULL) {
+      ERROR("write_graphite plugin: Allocating the send buffers failed.");
+      status = ENOMEM;
+    }
+  }
+
   if (status != 0) {
     wg_callback_free(cb);
     return status;
@@ -551,6 +410,11 @@ static int wg_config_node(oconfig_item_t *ci) {
 
   plugin_register_flush(callback_name, wg_flush, &(user_data_t){.data = cb});
 
+  if (cb->report_stats)
+    plugin_register_complex_read(/* group = */ NULL, callback_name, wg_read,
+                                 /* interval = */ 0,
+                                 &(user_data_t){.data = cb});
+
   return 0;
 }
 
@@ -27,11 +27,19 @@
 
 #include "common.h"
 #include "plugin.h"
+#include "utils_complain.h"
+#include "utils_compress.h"
+#include "utils_curl_stats.h"
 #include "utils_format_json.h"
 #include "utils_format_kairosdb.h"
+#include "utils_format_prometheus.h"
 
 #include <curl/curl.h>
 
+/* Number of intervals after which the labels or tags of a series which isn't
+ * written any more are dropped from the cache. */
+#define WH_SERIES_EXPIRE_INTERVALS 10
+
 #ifndef WRITE_HTTP_DEFAULT_BUFFER_SIZE
 #define WRITE_HTTP_DEFAULT_BUFFER_SIZE 4096
 #endif
@@ -40,9 +48,60 @@
 #define WRITE_HTTP_DEFAULT_PREFIX "collectd"
 #endif
 
+#ifndef WRITE_HTTP_DEFAULT_MAX_IN_FLIGHT
+#define WRITE_HTTP_DEFAULT_MAX_IN_FLIGHT 4
+#endif
+
+#ifndef WRITE_HTTP_DEFAULT_RETRY_QUEUE_SIZE
+#define WRITE_HTTP_DEFAULT_RETRY_QUEUE_SIZE 16
+#endif
+
+#define WH_MAX_IN_FLIGHT 64
+
+/* A post which failed this often is dropped. */
+#define WH_MAX_ATTEMPTS 8
+
+#define WH_MIN_RETRY_INTERVAL TIME_T_TO_CDTIME_T_STATIC(1)
+#define WH_MAX_RETRY_INTERVAL TIME_T_TO_CDTIME_T_STATIC(64)
+
+/* curl_multi_wakeup() lets the writers interrupt curl_multi_poll(). Without
+ * it, the sender thread has to look for new buffers more often. */
+#if LIBCURL_VERSION_NUM >= 0x074400
+#define WH_HAVE_MULTI_WAKEUP 1
+#define WH_POLL_TIMEOUT_MS 1000
+#else
+#define WH_POLL_TIMEOUT_MS 100
+#endif
+
 /*
  * Private variables
  */
+/* A filled send buffer in asynchronous mode. */
+struct wh_buffer_s {
+  size_t fill;
+  int attempts;
+  char data[];
+};
+typedef struct wh_buffer_s wh_buffer_t;
+
+/* Ring buffer of send buffers. */
+struct wh_queue_s {
+  wh_buffer_t **buffers;
+  size_t size;
+  size_t head;
+  size_t num;
+};
+typedef struct wh_queue_s wh_queue_t;
+
+/* One of the requests the sender thread can have in flight. */
+struct wh_request_s {
+  CURL *curl;
+  wh_buffer_t *buffer; /* NULL if the request is unused */
+  compress_t *compress;
+  char curl_errbuf[CURL_ERROR_SIZE];
+};
+typedef struct wh_request_s wh_request_t;
+
 struct wh_callback_s {
   char *name;
 
@@ -67,13 +126,25 @@ struct wh_callback_s {
 #define WH_FORMAT_COMMAND 0
 #define WH_FORMAT_JSON 1
 #define WH_FORMAT_KAIROSDB 2
+#define WH_FORMAT_REMOTE_WRITE 3
   int format;
+  /* Caches the labels of the series sent with WH_FORMAT_REMOTE_WRITE. */
+  format_remote_write_t *remote_write;
+  /* Collects the value lists sent with WH_FORMAT_KAIROSDB until the send
+   * buffer is flushed. */
+  format_kairosdb_t *kairosdb;
   _Bool send_metrics;
   _Bool send_notifications;
 
   CURL *curl;
   struct curl_slist *headers;
   char curl_errbuf[CURL_ERROR_SIZE];
+  curl_stats_t *stats;
+
+  /* The asynchronous requests have compressors of their own, "compress" is
+   * used for the posts made with "curl". */
+  compress_method_t compression;
+  compress_t *compress;
 
   char *send_buffer;
   size_t send_buffer_size;
@@ -85,6 +156,32 @@ struct wh_callback_s {
 
   int data_ttl;
   char *metrics_prefix;
+
+  /* Asynchronous mode: the writers format into "current", which
+   * "send_buffer" points into, and hand filled buffers to a sender thread.
+   * The sender thread posts up to "max_in_flight" buffers in parallel using
+   * "multi" and keeps failed posts in the "retry" queue. All of this except
+   * "current" is protected by "queue_lock". */
+  _Bool async;
+  int max_in_flight;
+  int retry_queue_size;
+  wh_buffer_t *current;
+  pthread_mutex_t queue_lock;
+  pthread_cond_t queue_cond;
+  pthread_t thread;
+  _Bool thread_running;
+  _Bool shutdown;
+  CURLM *multi;
+  wh_request_t *requests;
+  int in_flight;
+  wh_queue_t pending;
+  wh_queue_t retry;
+  wh_buffer_t **spare;
+  size_t spare_num;
+  cdtime_t retry_interval; /* zero while posting succeeds */
+  cdtime_t retry_time;
+  uint64_t dropped;
+  c_complain_t drop_complaint;
 };
 typedef struct wh_callback_s wh_callback_t;
 
@@ -113,22 +210,53 @@ static void wh_reset_buffer(wh_callback_t *cb) /* {{{ */
   cb->send_buffer_fill = 0;
   cb->send_buffer_init_time = cdtime();
 
-  if (cb->format == WH_FORMAT_JSON || cb->format == WH_FORMAT_KAIROSDB) {
+  if (cb->format == WH_FORMAT_JSON) {
     format_json_initialize(cb->send_buffer, &cb->send_buffer_fill,
                            &cb->send_buffer_free);
   }
 } /* }}} wh_reset_buffer */
 
+/* Compresses the "size" bytes at "data" with "c", unless compression is
+ * disabled, and returns the body to post. */
+static int wh_compress(wh_callback_t *cb, compress_t *c, /* {{{ */
+                       char const *data, size_t size, void const **ret_body,
+                       size_t *ret_body_size) {
+  if (c == NULL) {
+    *ret_body = data;
+    *ret_body_size = size;
+    return 0;
+  }
+
+  int status = compress_buffer(c, data, size, ret_body, ret_body_size);
+  if (status != 0) {
+    ERROR("write_http plugin: Compressing %" PRIsz " bytes for \"%s\" "
+          "failed: %s",
+          size, cb->name, STRERROR(status));
+    return status;
+  }
+
+  curl_stats_account_compression(cb->stats, size, *ret_body_size);
+  return 0;
+} /* }}} int wh_compress */
+
 /* must hold cb->send_lock when calling */
-static int wh_post_nolock(wh_callback_t *cb, char const *data) /* {{{ */
-{
+static int wh_post_nolock(wh_callback_t *cb, char const *data, /* {{{ */
+                          size_t size) {
+  void const *body;
+  size_t body_size;
   int status = 0;
 
+  status = wh_compress(cb, cb->compress, data, size, &body, &body_size);
+  if (status != 0)
+    return status;
+
   curl_easy_setopt(cb->curl, CURLOPT_URL, cb->location);
-  curl_easy_setopt(cb->curl, CURLOPT_POSTFIELDS, data);
+  curl_easy_setopt(cb->curl, CURLOPT_POSTFIELDSIZE, (long)body_size);
+  curl_easy_setopt(cb->curl, CURLOPT_POSTFIELDS, body);
   status = curl_easy_perform(cb->curl);
 
   wh_log_http_error(cb);
+  curl_stats_dispatch(cb->stats, cb->curl, NULL, "write_http", cb->name);
 
   if (status != CURLE_OK) {
     ERROR("write_http plugin: curl_easy_perform failed with "
@@ -138,10 +266,93 @@ static int wh_post_nolock(wh_callback_t *cb, char const *data) /* {{{ */
   return status;
 } /* }}} wh_post_nolock */
 
+/* Applies the node's options to "curl". */
+static int wh_curl_setopt(wh_callback_t *cb, CURL *curl, /* {{{ */
+                          char *errbuf) {
+  if (cb->low_speed_limit > 0 && cb->low_speed_time > 0) {
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT,
+                     (long)(cb->low_speed_limit * cb->low_speed_time));
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, (long)cb->low_speed_time);
+  }
+
+#ifdef HAVE_CURLOPT_TIMEOUT_MS
+  if (cb->timeout > 0)
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, (long)cb->timeout);
+#endif
+
+  curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+  curl_easy_setopt(curl, CURLOPT_USERAGENT, COLLECTD_USERAGENT);
+  curl_easy_setopt(curl, CURLOPT_HTTPHEADER, cb->headers);
+
+  curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, errbuf);
+  curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+  curl_easy_setopt(curl, CURLOPT_MAXREDIRS, 50L);
+
+  if (cb->user != NULL) {
+#ifdef HAVE_CURLOPT_USERNAME
+    curl_easy_setopt(curl, CURLOPT_USERNAME, cb->user);
+    curl_easy_setopt(curl, CURLOPT_PASSWORD,
+                     (cb->pass == NULL) ? "" : cb->pass);
+#else
+    if (cb->credentials == NULL) {
+      size_t credentials_size;
+
+      credentials_size = strlen(cb->user) + 2;
+      if (cb->pass != NULL)
+        credentials_size += strlen(cb->pass);
+
+      cb->credentials = malloc(credentials_size);
+      if (cb->credentials == NULL) {
+        ERROR("curl plugin: malloc failed.");
+        return -1;
+      }
+
+      snprintf(cb->credentials, credentials_size, "%s:%s", cb->user,
+               (cb->pass == NULL) ? "" : cb->pass);
+    }
+    curl_easy_setopt(curl, CURLOPT_USERPWD, cb->credentials);
+#endif
+    curl_easy_setopt(curl, CURLOPT_HTTPAUTH, CURLAUTH_ANY);
+  }
+
+  curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, (long)cb->verify_peer);
+  curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, cb->verify_host ? 2L : 0L);
+  curl_easy_setopt(curl, CURLOPT_SSLVERSION, cb->sslversion);
+  if (cb->cacert != NULL)
+    curl_easy_setopt(curl, CURLOPT_CAINFO, cb->cacert);
+  if (cb->capath != NULL)
+    curl_easy_setopt(curl, CURLOPT_CAPATH, cb->capath);
+
+  if (cb->clientkey != NULL && cb->clientcert != NULL) {
+    curl_easy_setopt(curl, CURLOPT_SSLKEY, cb->clientkey);
+    curl_easy_setopt(curl, CURLOPT_SSLCERT, cb->clientcert);
+
+    if (cb->clientkeypass != NULL)
+      curl_easy_setopt(curl, CURLOPT_SSLKEYPASSWD, cb->clientkeypass);
+  }
+
+  return 0;
+} /* }}} int wh_curl_setopt */
+
+static int wh_async_start(wh_callback_t *cb);
+
 static int wh_callback_init(wh_callback_t *cb) /* {{{ */
 {
   if (cb->curl != NULL)
-    return 0;
+    return wh_async_start(cb);
+
+  /* Created here rather than when reading the configuration, so that the
+   * "Attribute" options of all nodes have been read. */
+  if ((cb->format == WH_FORMAT_KAIROSDB) && (cb->kairosdb == NULL)) {
+    cb->kairosdb = format_kairosdb_create(
+        (char const *const *)http_attrs, http_attrs_num, cb->data_ttl,
+        cb->metrics_prefix,
+        WH_SERIES_EXPIRE_INTERVALS * plugin_get_interval());
+    if (cb->kairosdb == NULL) {
+      ERROR("write_http plugin: format_kairosdb_create failed.");
+      return -1;
+    }
+  }
 
   cb->curl = curl_easy_init();
   if (cb->curl == NULL) {
@@ -149,79 +360,425 @@ static int wh_callback_init(wh_callback_t *cb) /* {{{ */
     return -1;
   }
 
-  if (cb->low_speed_limit > 0 && cb->low_speed_time > 0) {
-    curl_easy_setopt(cb->curl, CURLOPT_LOW_SPEED_LIMIT,
-                     (long)(cb->low_speed_limit * cb->low_speed_time));
-    curl_easy_setopt(cb->curl, CURLOPT_LOW_SPEED_TIME,
-                     (long)cb->low_speed_time);
-  }
-
-#ifdef HAVE_CURLOPT_TIMEOUT_MS
-  if (cb->timeout > 0)
-    curl_easy_setopt(cb->curl, CURLOPT_TIMEOUT_MS, (long)cb->timeout);
-#endif
-
-  curl_easy_setopt(cb->curl, CURLOPT_NOSIGNAL, 1L);
-  curl_easy_setopt(cb->curl, CURLOPT_USERAGENT, COLLECTD_USERAGENT);
-
   cb->headers = curl_slist_append(cb->headers, "Accept:  */*");
   if (cb->format == WH_FORMAT_JSON || cb->format == WH_FORMAT_KAIROSDB)
     cb->headers =
         curl_slist_append(cb->headers, "Content-Type: application/json");
-  else
+  else if (cb->format == WH_FORMAT_REMOTE_WRITE) {
+    cb->headers =
+        curl_slist_append(cb->headers, "Content-Type: application/x-protobuf");
+    cb->headers = curl_slist_append(
+        cb->headers, "X-Prometheus-Remote-Write-Version: 0.1.0");
+  } else
     cb->headers = curl_slist_append(cb->headers, "Content-Type: text/plain");
   cb->headers = curl_slist_append(cb->headers, "Expect:");
-  curl_easy_setopt(cb->curl, CURLOPT_HTTPHEADER, cb->headers);
+  if (cb->compression != COMPRESS_NONE) {
+    char header[64];
+    snprintf(header, sizeof(header), "Content-Encoding: %s",
+             compress_encoding(cb->compression));
+    cb->headers = curl_slist_append(cb->headers, header);
+  }
 
-  curl_easy_setopt(cb->curl, CURLOPT_ERRORBUFFER, cb->curl_errbuf);
-  curl_easy_setopt(cb->curl, CURLOPT_FOLLOWLOCATION, 1L);
-  curl_easy_setopt(cb->curl, CURLOPT_MAXREDIRS, 50L);
+  if (wh_curl_setopt(cb, cb->curl, cb->curl_errbuf) != 0)
+    return -1;
 
-  if (cb->user != NULL) {
-#ifdef HAVE_CURLOPT_USERNAME
-    curl_easy_setopt(cb->curl, CURLOPT_USERNAME, cb->user);
-    curl_easy_setopt(cb->curl, CURLOPT_PASSWORD,
-                     (cb->pass == NULL) ? "" : cb->pass);
+  wh_reset_buffer(cb);
+
+  return wh_async_start(cb);
+} /* }}} int wh_callback_init */
+
+static void wh_queue_push(wh_queue_t *q, wh_buffer_t *buffer) /* {{{ */
+{
+  assert(q->num < q->size);
+  q->buffers[(q->head + q->num) % q->size] = buffer;
+  q->num++;
+} /* }}} void wh_queue_push */
+
+static wh_buffer_t *wh_queue_pop(wh_queue_t *q) /* {{{ */
+{
+  if (q->num == 0)
+    return NULL;
+
+  wh_buffer_t *buffer = q->buffers[q->head];
+  q->head = (q->head + 1) % q->size;
+  q->num--;
+  return buffer;
+} /* }}} wh_buffer_t *wh_queue_pop */
+
+/* Must hold cb->queue_lock. */
+static void wh_async_drop(wh_callback_t *cb, wh_buffer_t *buffer) /* {{{ */
+{
+  cb->dropped++;
+  c_complain(LOG_WARNING, &cb->drop_complaint,
+             "write_http plugin: Dropping data which could not be posted to "
+             "\"%s\".",
+             cb->name);
+  cb->spare[cb->spare_num++] = buffer;
+} /* }}} void wh_async_drop */
+
+/* Appends "buffer" to the retry queue, dropping the oldest buffer if the queue
+ * is full. Must hold cb->queue_lock. */
+static void wh_async_retry(wh_callback_t *cb, wh_buffer_t *buffer) /* {{{ */
+{
+  if (cb->retry.size == 0) {
+    wh_async_drop(cb, buffer);
+    return;
+  }
+
+  if (cb->retry.num >= cb->retry.size)
+    wh_async_drop(cb, wh_queue_pop(&cb->retry));
+  wh_queue_push(&cb->retry, buffer);
+} /* }}} void wh_async_retry */
+
+static void wh_async_wakeup(wh_callback_t *cb) /* {{{ */
+{
+#ifdef WH_HAVE_MULTI_WAKEUP
+  curl_multi_wakeup(cb->multi);
+#endif
+} /* }}} void wh_async_wakeup */
+
+/* Starts posting "buffer" using an unused request. Must hold cb->queue_lock,
+ * which is released while compressing. */
+static void wh_async_post(wh_callback_t *cb, wh_buffer_t *buffer) /* {{{ */
+{
+  wh_request_t *r = NULL;
+
+  for (int i = 0; i < cb->max_in_flight; i++) {
+    if (cb->requests[i].buffer == NULL) {
+      r = cb->requests + i;
+      break;
+    }
+  }
+  assert(r != NULL);
+
+  /* Only the sender thread uses the requests and "buffer" is no longer
+   * queued, so the writers can go on meanwhile. */
+  void const *body;
+  size_t body_size;
+  pthread_mutex_unlock(&cb->queue_lock);
+  int compress_status = wh_compress(cb, r->compress, buffer->data,
+                                    buffer->fill, &body, &body_size);
+  pthread_mutex_lock(&cb->queue_lock);
+  if (compress_status != 0) {
+    wh_async_drop(cb, buffer);
+    return;
+  }
+
+  curl_easy_setopt(r->curl, CURLOPT_POSTFIELDSIZE, (long)body_size);
+  curl_easy_setopt(r->curl, CURLOPT_POSTFIELDS, (void *)body);
+
+  CURLMcode status = curl_multi_add_handle(cb->multi, r->curl);
+  if (status != CURLM_OK) {
+    ERROR("write_http plugin: curl_multi_add_handle failed: %s",
+          curl_multi_strerror(status));
+    wh_async_retry(cb, buffer);
+    return;
+  }
+
+  r->buffer = buffer;
+  cb->in_flight++;
+} /* }}} void wh_async_post */
+
+/* Handles a finished request. Failed posts are retried later, after a delay
+ * which grows while the failures continue. Must hold cb->queue_lock. */
+static void wh_async_done(wh_callback_t *cb, CURL *curl, /* {{{ */
+                          CURLcode result) {
+  char *private = NULL;
+  long http_code = 0;
+
+  curl_easy_getinfo(curl, CURLINFO_PRIVATE, &private);
+  curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
+  curl_multi_remove_handle(cb->multi, curl);
+
+  wh_request_t *r = (wh_request_t *)private;
+  wh_buffer_t *buffer = r->buffer;
+  r->buffer = NULL;
+  cb->in_flight--;
+
+  if (cb->log_http_error && (http_code != 200))
+    INFO("write_http plugin: HTTP Error code: %lu", http_code);
+
+  if (result != CURLE_OK)
+    ERROR("write_http plugin: Posting to \"%s\" failed with status %i: %s",
+          cb->name, result, r->curl_errbuf);
+
+  /* Server errors may go away, client errors won't. */
+  if ((result == CURLE_OK) && (http_code < 500) && (http_code != 429)) {
+    cb->retry_interval = 0;
+    c_release(LOG_INFO, &cb->drop_complaint,
+              "write_http plugin: Posting to \"%s\" succeeded again.",
+              cb->name);
+    cb->spare[cb->spare_num++] = buffer;
+    return;
+  }
+
+  if (cb->retry_interval == 0)
+    cb->retry_interval = WH_MIN_RETRY_INTERVAL;
+  else if ((2 * cb->retry_interval) < WH_MAX_RETRY_INTERVAL)
+    cb->retry_interval *= 2;
+  else
+    cb->retry_interval = WH_MAX_RETRY_INTERVAL;
+  cb->retry_time = cdtime() + cb->retry_interval;
+
+  buffer->attempts++;
+  if (cb->shutdown) {
+    /* Don't delay the shutdown for a server which is failing. */
+    wh_async_drop(cb, buffer);
+    while ((buffer = wh_queue_pop(&cb->pending)) != NULL)
+      wh_async_drop(cb, buffer);
+    while ((buffer = wh_queue_pop(&cb->retry)) != NULL)
+      wh_async_drop(cb, buffer);
+  } else if (buffer->attempts >= WH_MAX_ATTEMPTS)
+    wh_async_drop(cb, buffer);
+  else
+    wh_async_retry(cb, buffer);
+} /* }}} void wh_async_done */
+
+static void *wh_async_thread(void *arg) /* {{{ */
+{
+  wh_callback_t *cb = arg;
+
+  pthread_mutex_lock(&cb->queue_lock);
+  while (!cb->shutdown || (cb->in_flight > 0) || (cb->pending.num > 0) ||
+         (cb->retry.num > 0)) {
+    cdtime_t now = cdtime();
+
+    /* On shutdown, everything left is tried once more. */
+    if (!cb->shutdown && (now < cb->retry_time)) {
+      /* Keep the writers going while waiting for the server. */
+      if (cb->pending.num > 0) {
+        wh_buffer_t *buffer;
+        while ((buffer = wh_queue_pop(&cb->pending)) != NULL)
+          wh_async_retry(cb, buffer);
+        pthread_cond_broadcast(&cb->queue_cond);
+      }
+    } else {
+      /* After a failure, a single request probes the server. Failed posts
+       * are older, so they go first. */
+      int max = (cb->retry_interval != 0) ? 1 : cb->max_in_flight;
+      while (cb->in_flight < max) {
+        wh_buffer_t *buffer = wh_queue_pop(&cb->retry);
+        if (buffer == NULL)
+          buffer = wh_queue_pop(&cb->pending);
+        if (buffer == NULL)
+          break;
+
+        wh_async_post(cb, buffer);
+        pthread_cond_broadcast(&cb->queue_cond);
+      }
+    }
+    pthread_mutex_unlock(&cb->queue_lock);
+
+    int running = 0;
+    curl_multi_perform(cb->multi, &running);
+
+    CURLMsg *msg;
+    int msgs_left = 0;
+    _Bool done = 0;
+    while ((msg = curl_multi_info_read(cb->multi, &msgs_left)) != NULL) {
+      if (msg->msg != CURLMSG_DONE)
+        continue;
+
+      CURL *curl = msg->easy_handle;
+      CURLcode result = msg->data.result;
+      curl_stats_dispatch(cb->stats, curl, NULL, "write_http", cb->name);
+      pthread_mutex_lock(&cb->queue_lock);
+      wh_async_done(cb, curl, result);
+      pthread_mutex_unlock(&cb->queue_lock);
+      done = 1;
+    }
+
+    /* Start the next requests right away. */
+    if (done) {
+      pthread_mutex_lock(&cb->queue_lock);
+      continue;
+    }
+
+    long timeout_ms = WH_POLL_TIMEOUT_MS;
+    long curl_timeout_ms = -1;
+    curl_multi_timeout(cb->multi, &curl_timeout_ms);
+    if ((curl_timeout_ms >= 0) && (curl_timeout_ms < timeout_ms))
+      timeout_ms = curl_timeout_ms;
+    if ((now < cb->retry_time) &&
+        (CDTIME_T_TO_MS(cb->retry_time - now) < (uint64_t)timeout_ms))
+      timeout_ms = (long)CDTIME_T_TO_MS(cb->retry_time - now);
+
+#ifdef WH_HAVE_MULTI_WAKEUP
+    curl_multi_poll(cb->multi, NULL, 0, (int)timeout_ms, NULL);
 #else
-    size_t credentials_size;
+    curl_multi_wait(cb->multi, NULL, 0, (int)timeout_ms, NULL);
+#endif
 
-    credentials_size = strlen(cb->user) + 2;
-    if (cb->pass != NULL)
-      credentials_size += strlen(cb->pass);
+    pthread_mutex_lock(&cb->queue_lock);
+  }
+  pthread_mutex_unlock(&cb->queue_lock);
 
-    cb->credentials = malloc(credentials_size);
-    if (cb->credentials == NULL) {
-      ERROR("curl plugin: malloc failed.");
+  return NULL;
+} /* }}} void *wh_async_thread */
+
+/* Allocates the buffers for asynchronous mode. */
+static int wh_async_init(wh_callback_t *cb) /* {{{ */
+{
+  /* Room for the current buffer and full pending, in-flight and retry
+   * queues, so the writers always find a spare buffer. */
+  size_t buffers_num =
+      1 + 2 * (size_t)cb->max_in_flight + (size_t)cb->retry_queue_size;
+
+  cb->requests = calloc(cb->max_in_flight, sizeof(*cb->requests));
+  cb->pending.buffers = calloc(cb->max_in_flight, sizeof(wh_buffer_t *));
+  cb->retry.buffers = calloc(cb->retry_queue_size + 1, sizeof(wh_buffer_t *));
+  cb->spare = calloc(buffers_num, sizeof(*cb->spare));
+  if ((cb->requests == NULL) || (cb->pending.buffers == NULL) ||
+      (cb->retry.buffers == NULL) || (cb->spare == NULL))
+    return ENOMEM;
+  cb->pending.size = (size_t)cb->max_in_flight;
+  cb->retry.size = (size_t)cb->retry_queue_size;
+
+  if (cb->compression != COMPRESS_NONE) {
+    for (int i = 0; i < cb->max_in_flight; i++) {
+      cb->requests[i].compress =
+          compress_create(cb->compression, cb->send_buffer_size);
+      if (cb->requests[i].compress == NULL)
+        return ENOMEM;
+    }
+  }
+
+  for (size_t i = 0; i < buffers_num; i++) {
+    wh_buffer_t *buffer = malloc(sizeof(*buffer) + cb->send_buffer_size);
+    if (buffer == NULL)
+      return ENOMEM;
+    cb->spare[cb->spare_num++] = buffer;
+  }
+
+  cb->current = cb->spare[--cb->spare_num];
+  cb->send_buffer = cb->current->data;
+  return 0;
+} /* }}} int wh_async_init */
+
+/* The sender thread is started by the first write, because the daemon may
+ * fork after the configuration has been read. Must hold cb->send_lock. */
+static int wh_async_start(wh_callback_t *cb) /* {{{ */
+{
+  if (!cb->async || cb->thread_running)
+    return 0;
+
+  if (cb->multi == NULL) {
+    cb->multi = curl_multi_init();
+    if (cb->multi == NULL) {
+      ERROR("write_http plugin: curl_multi_init failed.");
       return -1;
     }
+    curl_multi_setopt(cb->multi, CURLMOPT_MAXCONNECTS, (long)cb->max_in_flight);
+  }
 
-    snprintf(cb->credentials, credentials_size, "%s:%s", cb->user,
-             (cb->pass == NULL) ? "" : cb->pass);
-    curl_easy_setopt(cb->curl, CURLOPT_USERPWD, cb->credentials);
-#endif
-    curl_easy_setopt(cb->curl, CURLOPT_HTTPAUTH, CURLAUTH_ANY);
+  for (int i = 0; i < cb->max_in_flight; i++) {
+    wh_request_t *r = cb->requests + i;
+    if (r->curl != NULL)
+      continue;
+
+    r->curl = curl_easy_init();
+    if (r->curl == NULL) {
+      ERROR("write_http plugin: curl_easy_init failed.");
+      return -1;
+    }
+    if (wh_curl_setopt(cb, r->curl, r->curl_errbuf) != 0)
+      return -1;
+    curl_easy_setopt(r->curl, CURLOPT_URL, cb->location);
+    curl_easy_setopt(r->curl, CURLOPT_PRIVATE, r);
   }
 
-  curl_easy_setopt(cb->curl, CURLOPT_SSL_VERIFYPEER, (long)cb->verify_peer);
-  curl_easy_setopt(cb->curl, CURLOPT_SSL_VERIFYHOST, cb->verify_host ? 2L : 0L);
-  curl_easy_setopt(cb->curl, CURLOPT_SSLVERSION, cb->sslversion);
-  if (cb->cacert != NULL)
-    curl_easy_setopt(cb->curl, CURLOPT_CAINFO, cb->cacert);
-  if (cb->capath != NULL)
-    curl_easy_setopt(cb->curl, CURLOPT_CAPATH, cb->capath);
+  int status = plugin_thread_create(&cb->thread, /* attr = */ NULL,
+                                    wh_async_thread, cb, "wh send");
+  if (status != 0) {
+    ERROR("write_http plugin: Starting the sender thread failed.");
+    return status;
+  }
 
-  if (cb->clientkey != NULL && cb->clientcert != NULL) {
-    curl_easy_setopt(cb->curl, CURLOPT_SSLKEY, cb->clientkey);
-    curl_easy_setopt(cb->curl, CURLOPT_SSLCERT, cb->clientcert);
+  cb->thread_running = 1;
+  return 0;
+} /* }}} int wh_async_start */
 
-    if (cb->clientkeypass != NULL)
-      curl_easy_setopt(cb->curl, CURLOPT_SSLKEYPASSWD, cb->clientkeypass);
+/* Posts whatever is left and frees the asynchronous mode's resources. */
+static void wh_async_stop(wh_callback_t *cb) /* {{{ */
+{
+  if (cb->thread_running) {
+    pthread_mutex_lock(&cb->queue_lock);
+    cb->shutdown = 1;
+    pthread_mutex_unlock(&cb->queue_lock);
+    wh_async_wakeup(cb);
+
+    pthread_join(cb->thread, /* retval = */ NULL);
+    cb->thread_running = 0;
   }
 
+  if (cb->dropped > 0)
+    WARNING("write_http plugin: %" PRIu64 " buffers for \"%s\" have been "
+            "dropped.",
+            cb->dropped, cb->name);
+
+  if (cb->requests != NULL)
+    for (int i = 0; i < cb->max_in_flight; i++) {
+      if (cb->requests[i].curl != NULL)
+        curl_easy_cleanup(cb->requests[i].curl);
+      compress_destroy(cb->requests[i].compress);
+    }
+  if (cb->multi != NULL)
+    curl_multi_cleanup(cb->multi);
+  cb->multi = NULL;
+
+  wh_buffer_t *buffer;
+  while ((buffer = wh_queue_pop(&cb->pending)) != NULL)
+    sfree(buffer);
+  while ((buffer = wh_queue_pop(&cb->retry)) != NULL)
+    sfree(buffer);
+  for (size_t i = 0; i < cb->spare_num; i++)
+    sfree(cb->spare[i]);
+  sfree(cb->current);
+  cb->send_buffer = NULL;
+
+  sfree(cb->requests);
+  sfree(cb->pending.buffers);
+  sfree(cb->retry.buffers);
+  sfree(cb->spare);
+} /* }}} void wh_async_stop */
+
+/* Hands the send buffer to the sender thread and makes a spare buffer the
+ * send buffer. Must hold cb->send_lock. */
+static void wh_async_queue_nolock(wh_callback_t *cb) /* {{{ */
+{
+  wh_buffer_t *buffer = cb->current;
+  buffer->fill = cb->send_buffer_fill;
+  buffer->attempts = 0;
+
+  pthread_mutex_lock(&cb->queue_lock);
+  /* While the server fails, the pending buffers are moved to the retry queue,
+   * so this only waits for a server which is slow. */
+  while (cb->pending.num >= cb->pending.size)
+    pthread_cond_wait(&cb->queue_cond, &cb->queue_lock);
+  wh_queue_push(&cb->pending, buffer);
+
+  assert(cb->spare_num > 0);
+  cb->current = cb->spare[--cb->spare_num];
+  pthread_mutex_unlock(&cb->queue_lock);
+  wh_async_wakeup(cb);
+
+  cb->send_buffer = cb->current->data;
   wh_reset_buffer(cb);
+} /* }}} void wh_async_queue_nolock */
 
-  return 0;
-} /* }}} int wh_callback_init */
+/* Posts the send buffer, or hands it to the sender thread in asynchronous
+ * mode, and resets it. Must hold cb->send_lock. */
+static int wh_send_buffer_nolock(wh_callback_t *cb) /* {{{ */
+{
+  if (cb->async) {
+    wh_async_queue_nolock(cb);
+    return 0;
+  }
+
+  int status = wh_post_nolock(cb, cb->send_buffer, cb->send_buffer_fill);
+  wh_reset_buffer(cb);
+  return status;
+} /* }}} int wh_send_buffer_nolock */
 
 static int wh_flush_nolock(cdtime_t timeout, wh_callback_t *cb) /* {{{ */
 {
@@ -240,15 +797,32 @@ static int wh_flush_nolock(cdtime_t timeout, wh_callback_t *cb) /* {{{ */
       return 0;
   }
 
-  if (cb->format == WH_FORMAT_COMMAND) {
+  if (cb->format == WH_FORMAT_COMMAND ||
+      cb->format == WH_FORMAT_REMOTE_WRITE) {
     if (cb->send_buffer_fill == 0) {
       cb->send_buffer_init_time = cdtime();
       return 0;
     }
 
-    status = wh_post_nolock(cb, cb->send_buffer);
-    wh_reset_buffer(cb);
-  } else if (cb->format == WH_FORMAT_JSON || cb->format == WH_FORMAT_KAIROSDB) {
+    status = wh_send_buffer_nolock(cb);
+  } else if (cb->format == WH_FORMAT_KAIROSDB) {
+    if (format_kairosdb_size(cb->kairosdb) == 0) {
+      cb->send_buffer_init_time = cdtime();
+      return 0;
+    }
+
+    status = format_kairosdb_finalize(cb->kairosdb, cb->send_buffer,
+                                      &cb->send_buffer_fill,
+                                      &cb->send_buffer_free);
+    if (status != 0) {
+      ERROR("write_http: wh_flush_nolock: "
+            "format_kairosdb_finalize failed.");
+      wh_reset_buffer(cb);
+      return status;
+    }
+
+    status = wh_send_buffer_nolock(cb);
+  } else if (cb->format == WH_FORMAT_JSON) {
     if (cb->send_buffer_fill <= 2) {
       cb->send_buffer_init_time = cdtime();
       return 0;
@@ -263,8 +837,7 @@ static int wh_flush_nolock(cdtime_t timeout, wh_callback_t *cb) /* {{{ */
       return status;
     }
 
-    status = wh_post_nolock(cb, cb->send_buffer);
-    wh_reset_buffer(cb);
+    status = wh_send_buffer_nolock(cb);
   } else {
     ERROR("write_http: wh_flush_nolock: "
           "Unknown format: %i",
@@ -312,6 +885,9 @@ static void wh_callback_free(void *data) /* {{{ */
   if (cb->send_buffer != NULL)
     wh_flush_nolock(/* timeout = */ 0, cb);
 
+  if (cb->async)
+    wh_async_stop(cb);
+
   if (cb->curl != NULL) {
     curl_easy_cleanup(cb->curl);
     cb->curl = NULL;
@@ -322,6 +898,11 @@ static void wh_callback_free(void *data) /* {{{ */
     cb->headers = NULL;
   }
 
+  compress_destroy(cb->compress);
+  format_remote_write_destroy(cb->remote_write);
+  format_kairosdb_destroy(cb->kairosdb);
+  curl_stats_destroy(cb->stats);
+
   sfree(cb->name);
   sfree(cb->location);
   sfree(cb->user);
@@ -332,9 +913,14 @@ static void wh_callback_free(void *data) /* {{{ */
   sfree(cb->clientkey);
   sfree(cb->clientcert);
   sfree(cb->clientkeypass);
-  sfree(cb->send_buffer);
+  if (!cb->async)
+    sfree(cb->send_buffer);
   sfree(cb->metrics_prefix);
 
+  pthread_mutex_destroy(&cb->send_lock);
+  pthread_mutex_destroy(&cb->queue_lock);
+  pthread_cond_destroy(&cb->queue_cond);
+
   sfree(cb);
 } /* }}} void wh_callback_free */
 
@@ -469,20 +1055,56 @@ static int wh_write_kairosdb(const data_set_t *ds,
   int status;
 
   pthread_mutex_lock(&cb->send_lock);
+  if (wh_callback_init(cb) != 0) {
+    ERROR("write_http plugin: wh_callback_init failed.");
+    pthread_mutex_unlock(&cb->send_lock);
+    return -1;
+  }
 
-  if (cb->curl == NULL) {
-    status = wh_callback_init(cb);
+  /* The batch is serialized into the send buffer when it is flushed, so it
+   * is limited to the size of the send buffer. */
+  status = format_kairosdb_value_list(cb->kairosdb, ds, vl, cb->store_rates,
+                                      cb->send_buffer_size);
+  if (status == -ENOMEM) {
+    status = wh_flush_nolock(/* timeout = */ 0, cb);
     if (status != 0) {
-      ERROR("write_http plugin: wh_callback_init failed.");
+      wh_reset_buffer(cb);
       pthread_mutex_unlock(&cb->send_lock);
-      return -1;
+      return status;
     }
+
+    status = format_kairosdb_value_list(cb->kairosdb, ds, vl,
+                                        cb->store_rates, cb->send_buffer_size);
   }
+  if (status != 0) {
+    pthread_mutex_unlock(&cb->send_lock);
+    return status;
+  }
+
+  DEBUG("write_http plugin: <%s> batch %" PRIsz "/%" PRIsz " (%g%%)",
+        cb->location, format_kairosdb_size(cb->kairosdb), cb->send_buffer_size,
+        100.0 * ((double)format_kairosdb_size(cb->kairosdb)) /
+            ((double)cb->send_buffer_size));
 
-  status = format_kairosdb_value_list(
-      cb->send_buffer, &cb->send_buffer_fill, &cb->send_buffer_free, ds, vl,
-      cb->store_rates, (char const *const *)http_attrs, http_attrs_num,
-      cb->data_ttl, cb->metrics_prefix);
+  pthread_mutex_unlock(&cb->send_lock);
+
+  return 0;
+} /* }}} int wh_write_kairosdb */
+
+static int wh_write_remote_write(const data_set_t *ds, /* {{{ */
+                                 const value_list_t *vl, wh_callback_t *cb) {
+  int status;
+
+  pthread_mutex_lock(&cb->send_lock);
+  if (wh_callback_init(cb) != 0) {
+    ERROR("write_http plugin: wh_callback_init failed.");
+    pthread_mutex_unlock(&cb->send_lock);
+    return -1;
+  }
+
+  status = format_remote_write_value_list(
+      cb->remote_write, cb->send_buffer, &cb->send_buffer_fill,
+      &cb->send_buffer_free, ds, vl, cb->store_rates);
   if (status == -ENOMEM) {
     status = wh_flush_nolock(/* timeout = */ 0, cb);
     if (status != 0) {
@@ -491,10 +1113,9 @@ static int wh_write_kairosdb(const data_set_t *ds,
       return status;
     }
 
-    status = format_kairosdb_value_list(
-        cb->send_buffer, &cb->send_buffer_fill, &cb->send_buffer_free, ds, vl,
-        cb->store_rates, (char const *const *)http_attrs, http_attrs_num,
-        cb->data_ttl, cb->metrics_prefix);
+    status = format_remote_write_value_list(
+        cb->remote_write, cb->send_buffer, &cb->send_buffer_fill,
+        &cb->send_buffer_free, ds, vl, cb->store_rates);
   }
   if (status != 0) {
     pthread_mutex_unlock(&cb->send_lock);
@@ -506,11 +1127,10 @@ static int wh_write_kairosdb(const data_set_t *ds,
         100.0 * ((double)cb->send_buffer_fill) /
             ((double)cb->send_buffer_size));
 
-  /* Check if we have enough space for this command. */
   pthread_mutex_unlock(&cb->send_lock);
 
   return 0;
-} /* }}} int wh_write_kairosdb */
+} /* }}} int wh_write_remote_write */
 
 static int wh_write(const data_set_t *ds, const value_list_t *vl, /* {{{ */
                     user_data_t *user_data) {
@@ -530,6 +1150,9 @@ static int wh_write(const data_set_t *ds, const value_list_t *vl, /* {{{ */
   case WH_FORMAT_KAIROSDB:
     status = wh_write_kairosdb(ds, vl, cb);
     break;
+  case WH_FORMAT_REMOTE_WRITE:
+    status = wh_write_remote_write(ds, vl, cb);
+    break;
   default:
     status = wh_write_command(ds, vl, cb);
     break;
@@ -562,7 +1185,7 @@ static int wh_notify(notification_t const *n, user_data_t *ud) /* {{{ */
     return -1;
   }
 
-  status = wh_post_nolock(cb, alert);
+  status = wh_post_nolock(cb, alert, strlen(alert));
   pthread_mutex_unlock(&cb->send_lock);
 
   return status;
@@ -586,6 +1209,8 @@ static int config_set_format(wh_callback_t *cb, /* {{{ */
     cb->format = WH_FORMAT_JSON;
   else if (strcasecmp("KAIROSDB", string) == 0)
     cb->format = WH_FORMAT_KAIROSDB;
+  else if (strcasecmp("PrometheusRemoteWrite", string) == 0)
+    cb->format = WH_FORMAT_REMOTE_WRITE;
   else {
     ERROR("write_http plugin: Invalid format string: %s", string);
     return -1;
@@ -594,6 +1219,27 @@ static int config_set_format(wh_callback_t *cb, /* {{{ */
   return 0;
 } /* }}} int config_set_format */
 
+static int config_set_compression(wh_callback_t *cb, /* {{{ */
+                                  oconfig_item_t *ci) {
+  char *string = NULL;
+  int status;
+
+  status = cf_util_get_string(ci, &string);
+  if (status != 0)
+    return status;
+
+  status = compress_method_parse(string, &cb->compression);
+  if (status == ENOTSUP)
+    ERROR("write_http plugin: collectd has been built without support for "
+          "%s compression.",
+          string);
+  else if (status != 0)
+    ERROR("write_http plugin: Invalid compression method: %s", string);
+
+  sfree(string);
+  return status;
+} /* }}} int config_set_compression */
+
 static int wh_config_append_string(const char *name,
                                    struct curl_slist **dest, /* {{{ */
                                    oconfig_item_t *ci) {
@@ -643,7 +1289,13 @@ static int wh_config_node(oconfig_item_t *ci) /* {{{ */
     return -1;
   }
 
+  cb->max_in_flight = WRITE_HTTP_DEFAULT_MAX_IN_FLIGHT;
+  cb->retry_queue_size = WRITE_HTTP_DEFAULT_RETRY_QUEUE_SIZE;
+  C_COMPLAIN_INIT(&cb->drop_complaint);
+
   pthread_mutex_init(&cb->send_lock, /* attr = */ NULL);
+  pthread_mutex_init(&cb->queue_lock, /* attr = */ NULL);
+  pthread_cond_init(&cb->queue_cond, /* attr = */ NULL);
 
   cf_util_get_string(ci, &cb->name);
 
@@ -755,7 +1407,20 @@ static int wh_config_node(oconfig_item_t *ci) /* {{{ */
       status = cf_util_get_int(child, &cb->data_ttl);
     } else if (strcasecmp("Prefix", child->key) == 0) {
       status = cf_util_get_string(child, &cb->metrics_prefix);
-    } else {
+    } else if (strcasecmp("Async", child->key) == 0)
+      status = cf_util_get_boolean(child, &cb->async);
+    else if (strcasecmp("MaxInFlight", child->key) == 0)
+      status = cf_util_get_int(child, &cb->max_in_flight);
+    else if (strcasecmp("RetryQueueSize", child->key) == 0)
+      status = cf_util_get_int(child, &cb->retry_queue_size);
+    else if (strcasecmp("Compression", child->key) == 0)
+      status = config_set_compression(cb, child);
+    else if (strcasecmp("Statistics", child->key) == 0) {
+      cb->stats = curl_stats_from_config(child);
+      if (cb->stats == NULL)
+        status = -1;
+    }
+    else {
       ERROR("write_http plugin: Invalid configuration "
             "option: %s.",
             child->key);
@@ -785,6 +1450,42 @@ static int wh_config_node(oconfig_item_t *ci) /* {{{ */
     return -1;
   }
 
+  if (cb->format == WH_FORMAT_REMOTE_WRITE) {
+    /* The remote write protocol requires snappy compression. */
+    if ((cb->compression != COMPRESS_NONE) &&
+        (cb->compression != COMPRESS_SNAPPY)) {
+      ERROR("write_http plugin: The PrometheusRemoteWrite format requires "
+            "snappy compression (instance \"%s\").",
+            cb->name);
+      wh_callback_free(cb);
+      return -1;
+    }
+    if (compress_method_parse("snappy", &cb->compression) != 0) {
+      ERROR("write_http plugin: collectd has been built without support for "
+            "snappy compression, which the PrometheusRemoteWrite format "
+            "requires.");
+      wh_callback_free(cb);
+      return -1;
+    }
+    if (cb->send_notifications) {
+      ERROR("write_http plugin: Notifications can't be sent in the "
+            "PrometheusRemoteWrite format (instance \"%s\").",
+            cb->name);
+      wh_callback_free(cb);
+      return -1;
+    }
+
+    /* Series which haven't been written for a while are dropped from the
+     * label cache. */
+    cb->remote_write = format_remote_write_create(
+        WH_SERIES_EXPIRE_INTERVALS * plugin_get_interval());
+    if (cb->remote_write == NULL) {
+      ERROR("write_http plugin: format_remote_write_create failed.");
+      wh_callback_free(cb);
+      return -1;
+    }
+  }
+
   if (strlen(cb->metrics_prefix) == 0)
     sfree(cb->metrics_prefix);
 
@@ -799,17 +1500,48 @@ static int wh_config_node(oconfig_item_t *ci) /* {{{ */
     ERROR("write_http plugin: Ignoring invalid BufferSize setting (%d).",
           buffer_size);
 
+  if ((cb->max_in_flight < 1) || (cb->max_in_flight > WH_MAX_IN_FLIGHT)) {
+    ERROR("write_http plugin: Ignoring invalid MaxInFlight setting (%d).",
+          cb->max_in_flight);
+    cb->max_in_flight = WRITE_HTTP_DEFAULT_MAX_IN_FLIGHT;
+  }
+  if (cb->retry_queue_size < 0) {
+    ERROR("write_http plugin: Ignoring invalid RetryQueueSize setting (%d).",
+          cb->retry_queue_size);
+    cb->retry_queue_size = WRITE_HTTP_DEFAULT_RETRY_QUEUE_SIZE;
+  }
+  /* Notifications are always posted synchronously. */
+  if (!cb->send_metrics)
+    cb->async = 0;
+
   /* Allocate the buffer. */
-  cb->send_buffer = malloc(cb->send_buffer_size);
-  if (cb->send_buffer == NULL) {
-    ERROR("write_http plugin: malloc(%" PRIsz ") failed.",
-          cb->send_buffer_size);
-    wh_callback_free(cb);
-    return -1;
+  if (cb->async) {
+    if (wh_async_init(cb) != 0) {
+      ERROR("write_http plugin: Allocating the buffers failed.");
+      wh_callback_free(cb);
+      return -1;
+    }
+  } else {
+    cb->send_buffer = malloc(cb->send_buffer_size);
+    if (cb->send_buffer == NULL) {
+      ERROR("write_http plugin: malloc(%" PRIsz ") failed.",
+            cb->send_buffer_size);
+      wh_callback_free(cb);
+      return -1;
+    }
   }
   /* Nulls the buffer and sets ..._free and ..._fill. */
   wh_reset_buffer(cb);
 
+  if (cb->compression != COMPRESS_NONE) {
+    cb->compress = compress_create(cb->compression, cb->send_buffer_size);
+    if (cb->compress == NULL) {
+      ERROR("write_http plugin: Creating the compressor failed.");
+      wh_callback_free(cb);
+      return -1;
+    }
+  }
+
   snprintf(callback_name, sizeof(callback_name), "write_http/%s", cb->name);
   DEBUG("write_http: Registering write callback '%s' with URL '%s'",
         callback_name, cb->location);
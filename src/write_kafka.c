@@ -31,16 +31,33 @@
 #include "utils_cmd_putval.h"
 #include "utils_format_graphite.h"
 #include "utils_format_json.h"
+#include "utils_format_protobuf.h"
 #include "utils_random.h"
 
 #include <errno.h>
 #include <librdkafka/rdkafka.h>
 #include <stdint.h>
 
+#define KAFKA_DEFAULT_BATCH_LINGER TIME_T_TO_CDTIME_T_STATIC(1)
+
+/* Time the plugin waits for queued messages to be delivered on shutdown. */
+#define KAFKA_SHUTDOWN_TIMEOUT_MS 5000
+
+/* A message waiting in a batch. The payload and the key are stored in the
+ * batch's data buffer, which may be moved by realloc(), hence the offsets. */
+typedef struct {
+  size_t payload;
+  size_t len;
+  size_t key;
+  size_t key_len;
+  void *opaque;
+} kafka_batch_entry_t;
+
 struct kafka_topic_context {
 #define KAFKA_FORMAT_JSON 0
 #define KAFKA_FORMAT_COMMAND 1
 #define KAFKA_FORMAT_GRAPHITE 2
+#define KAFKA_FORMAT_PROTOBUF 3
   uint8_t format;
   unsigned int graphite_flags;
   _Bool store_rates;
@@ -53,7 +70,31 @@ struct kafka_topic_context {
   char *postfix;
   char escape_char;
   char *topic_name;
+  _Bool key_identity;
   pthread_mutex_t lock;
+
+  /* Batching, protected by "lock". A batch is produced once it holds
+   * "batch_size" messages or is older than "batch_linger". */
+  size_t batch_size;
+  cdtime_t batch_linger;
+  kafka_batch_entry_t *batch;
+  rd_kafka_message_t *batch_messages;
+  size_t batch_num;
+  cdtime_t batch_start;
+  char *batch_data;
+  size_t batch_data_size;
+  size_t batch_data_fill;
+
+  /* Statistics, updated atomically by the writers and by the delivery report
+   * callback. The "previous" latency values belong to kafka_read(). */
+  _Bool report_stats;
+  uint64_t stats_delivered;
+  uint64_t stats_failed;
+  uint64_t stats_rejected;
+  uint64_t stats_latency_sum; /* in microseconds */
+  uint64_t stats_latency_num;
+  uint64_t stats_latency_sum_previous;
+  uint64_t stats_latency_num_previous;
 };
 
 static int kafka_handle(struct kafka_topic_context *);
@@ -93,10 +134,16 @@ static char *kafka_random_key(char buffer[static KAFKA_RANDOM_KEY_SIZE]) {
   return buffer;
 }
 
+/* With the "Identity" key, the message opaque holds the identifier hash of the
+ * value list, so the key doesn't have to be hashed again. All updates of a
+ * series end up in the same partition. */
 static int32_t kafka_partition(const rd_kafka_topic_t *rkt, const void *keydata,
                                size_t keylen, int32_t partition_cnt, void *p,
                                void *m) {
-  uint32_t key = kafka_hash(keydata, keylen);
+  struct kafka_topic_context *ctx = p;
+  uint32_t key = ((ctx != NULL) && ctx->key_identity)
+                     ? (uint32_t)(uintptr_t)m
+                     : kafka_hash(keydata, keylen);
   uint32_t target = key % partition_cnt;
   int32_t i = partition_cnt;
 
@@ -106,6 +153,27 @@ static int32_t kafka_partition(const rd_kafka_topic_t *rkt, const void *keydata,
   return target;
 }
 
+static void kafka_delivery_report(rd_kafka_t *rk, /* {{{ */
+                                  const rd_kafka_message_t *rkmessage,
+                                  void *opaque) {
+  struct kafka_topic_context *ctx = opaque;
+
+  if (rkmessage->err != RD_KAFKA_RESP_ERR_NO_ERROR) {
+    __atomic_add_fetch(&ctx->stats_failed, 1, __ATOMIC_RELAXED);
+    return;
+  }
+  __atomic_add_fetch(&ctx->stats_delivered, 1, __ATOMIC_RELAXED);
+
+#ifdef HAVE_LIBRDKAFKA_MESSAGE_LATENCY
+  int64_t latency = rd_kafka_message_latency(rkmessage);
+  if (latency >= 0) {
+    __atomic_add_fetch(&ctx->stats_latency_sum, (uint64_t)latency,
+                       __ATOMIC_RELAXED);
+    __atomic_add_fetch(&ctx->stats_latency_num, 1, __ATOMIC_RELAXED);
+  }
+#endif
+} /* }}} void kafka_delivery_report */
+
 static int kafka_handle(struct kafka_topic_context *ctx) /* {{{ */
 {
   char errbuf[1024];
@@ -162,6 +230,79 @@ static int kafka_handle(struct kafka_topic_context *ctx) /* {{{ */
 
 } /* }}} int kafka_handle */
 
+/* Appends a message to the batch. "lock" must be held. */
+static int kafka_batch_add(struct kafka_topic_context *ctx, /* {{{ */
+                           void const *payload, size_t len, void const *key,
+                           size_t key_len, void *opaque) {
+  size_t need = ctx->batch_data_fill + len + key_len;
+  if (need > ctx->batch_data_size) {
+    size_t size = (ctx->batch_data_size > 0) ? ctx->batch_data_size : 4096;
+    while (size < need)
+      size *= 2;
+
+    char *data = realloc(ctx->batch_data, size);
+    if (data == NULL) {
+      ERROR("write_kafka plugin: realloc failed.");
+      return ENOMEM;
+    }
+    ctx->batch_data = data;
+    ctx->batch_data_size = size;
+  }
+
+  if (ctx->batch_num == 0)
+    ctx->batch_start = cdtime();
+
+  kafka_batch_entry_t *e = ctx->batch + ctx->batch_num;
+  e->payload = ctx->batch_data_fill;
+  e->len = len;
+  memcpy(ctx->batch_data + e->payload, payload, len);
+  e->key = e->payload + len;
+  e->key_len = key_len;
+  memcpy(ctx->batch_data + e->key, key, key_len);
+  e->opaque = opaque;
+
+  ctx->batch_data_fill = need;
+  ctx->batch_num++;
+  return 0;
+} /* }}} int kafka_batch_add */
+
+/* Hands the batch to librdkafka with a single call, which enqueues all
+ * messages while taking the library's locks only once. "lock" must be held. */
+static void kafka_batch_produce(struct kafka_topic_context *ctx) /* {{{ */
+{
+  if ((ctx->batch_num == 0) || (ctx->topic == NULL))
+    return;
+
+  for (size_t i = 0; i < ctx->batch_num; i++) {
+    kafka_batch_entry_t *e = ctx->batch + i;
+    ctx->batch_messages[i] = (rd_kafka_message_t){
+        .payload = ctx->batch_data + e->payload,
+        .len = e->len,
+        .key = ctx->batch_data + e->key,
+        .key_len = e->key_len,
+        ._private = e->opaque,
+    };
+  }
+
+  int num = (int)ctx->batch_num;
+  int produced =
+      rd_kafka_produce_batch(ctx->topic, RD_KAFKA_PARTITION_UA,
+                             RD_KAFKA_MSG_F_COPY, ctx->batch_messages, num);
+  if (produced < num) {
+    rd_kafka_resp_err_t err = RD_KAFKA_RESP_ERR_NO_ERROR;
+    for (int i = 0; (i < num) && (err == RD_KAFKA_RESP_ERR_NO_ERROR); i++)
+      err = ctx->batch_messages[i].err;
+    ERROR("write_kafka plugin: Producing %d of %d messages to topic \"%s\" "
+          "failed: %s",
+          num - produced, num, ctx->topic_name, rd_kafka_err2str(err));
+    __atomic_add_fetch(&ctx->stats_rejected, (uint64_t)(num - produced),
+                       __ATOMIC_RELAXED);
+  }
+
+  ctx->batch_num = 0;
+  ctx->batch_data_fill = 0;
+} /* }}} void kafka_batch_produce */
+
 static int kafka_write(const data_set_t *ds, /* {{{ */
                        const value_list_t *vl, user_data_t *ud) {
   int status = 0;
@@ -211,21 +352,156 @@ static int kafka_write(const data_set_t *ds, /* {{{ */
     }
     blen = strlen(buffer);
     break;
+  case KAFKA_FORMAT_PROTOBUF:
+    /* Each message is a ValueLists message holding one value list, so that
+     * the message key still identifies the value list. */
+    status = format_protobuf_value_list(buffer, &bfill, &bfree, ds, vl,
+                                        ctx->store_rates);
+    if (status != 0) {
+      ERROR("write_kafka plugin: format_protobuf_value_list failed with "
+            "status %i.",
+            status);
+      return status;
+    }
+    blen = bfill;
+    break;
   default:
     ERROR("write_kafka plugin: invalid format %i.", ctx->format);
     return -1;
   }
 
-  key =
-      (ctx->key != NULL) ? ctx->key : kafka_random_key(KAFKA_RANDOM_KEY_BUFFER);
+  char name[6 * DATA_MAX_NAME_LEN];
+  void *opaque = NULL;
+  if (ctx->key_identity) {
+    value_list_identity_t const *identity = VALUE_LIST_IDENTITY(vl);
+    uint64_t hash;
+    if (identity != NULL) {
+      sstrncpy(name, identity->name, sizeof(name));
+      hash = identity->hash;
+    } else {
+      FORMAT_VL(name, sizeof(name), vl);
+      hash = identifier_hash(name);
+    }
+    key = name;
+    opaque = (void *)(uintptr_t)hash;
+  } else {
+    key = (ctx->key != NULL) ? ctx->key
+                             : kafka_random_key(KAFKA_RANDOM_KEY_BUFFER);
+  }
   keylen = strlen(key);
 
-  rd_kafka_produce(ctx->topic, RD_KAFKA_PARTITION_UA, RD_KAFKA_MSG_F_COPY,
-                   buffer, blen, key, keylen, NULL);
+  if (ctx->batch_size > 1) {
+    pthread_mutex_lock(&ctx->lock);
+    status = kafka_batch_add(ctx, buffer, blen, key, keylen, opaque);
+    if ((status == 0) &&
+        ((ctx->batch_num >= ctx->batch_size) ||
+         ((cdtime() - ctx->batch_start) >= ctx->batch_linger)))
+      kafka_batch_produce(ctx);
+    pthread_mutex_unlock(&ctx->lock);
+  } else if (rd_kafka_produce(ctx->topic, RD_KAFKA_PARTITION_UA,
+                              RD_KAFKA_MSG_F_COPY, buffer, blen, key, keylen,
+                              opaque) != 0) {
+    __atomic_add_fetch(&ctx->stats_rejected, 1, __ATOMIC_RELAXED);
+  }
+
+  /* Serves the delivery reports. */
+  if (ctx->report_stats)
+    rd_kafka_poll(ctx->kafka, /* timeout_ms = */ 0);
 
   return status;
 } /* }}} int kafka_write */
 
+static int kafka_flush(cdtime_t timeout, /* {{{ */
+                       const char *identifier __attribute__((unused)),
+                       user_data_t *ud) {
+  struct kafka_topic_context *ctx = ud->data;
+
+  pthread_mutex_lock(&ctx->lock);
+  /* timeout == 0  => flush unconditionally */
+  if ((ctx->batch_num > 0) &&
+      ((timeout == 0) || ((cdtime() - ctx->batch_start) >= timeout)))
+    kafka_batch_produce(ctx);
+  pthread_mutex_unlock(&ctx->lock);
+
+  return 0;
+} /* }}} int kafka_flush */
+
+static void kafka_submit_derive(struct kafka_topic_context *ctx, /* {{{ */
+                                char const *type, char const *type_instance,
+                                derive_t value) {
+  value_list_t vl = VALUE_LIST_INIT;
+
+  vl.values = &(value_t){.derive = value};
+  vl.values_len = 1;
+  sstrncpy(vl.plugin, "write_kafka", sizeof(vl.plugin));
+  sstrncpy(vl.plugin_instance, ctx->topic_name, sizeof(vl.plugin_instance));
+  sstrncpy(vl.type, type, sizeof(vl.type));
+  sstrncpy(vl.type_instance, type_instance, sizeof(vl.type_instance));
+
+  plugin_dispatch_values(&vl);
+} /* }}} void kafka_submit_derive */
+
+static void kafka_submit_gauge(struct kafka_topic_context *ctx, /* {{{ */
+                               char const *type, gauge_t value) {
+  value_list_t vl = VALUE_LIST_INIT;
+
+  vl.values = &(value_t){.gauge = value};
+  vl.values_len = 1;
+  sstrncpy(vl.plugin, "write_kafka", sizeof(vl.plugin));
+  sstrncpy(vl.plugin_instance, ctx->topic_name, sizeof(vl.plugin_instance));
+  sstrncpy(vl.type, type, sizeof(vl.type));
+
+  plugin_dispatch_values(&vl);
+} /* }}} void kafka_submit_gauge */
+
+/* kafka_read produces batches which have been waiting for longer than the
+ * linger time, serves the delivery reports and dispatches the statistics. */
+static int kafka_read(user_data_t *ud) /* {{{ */
+{
+  struct kafka_topic_context *ctx = ud->data;
+
+  pthread_mutex_lock(&ctx->lock);
+  rd_kafka_t *kafka = ctx->kafka;
+  if ((ctx->batch_num > 0) &&
+      ((cdtime() - ctx->batch_start) >= ctx->batch_linger))
+    kafka_batch_produce(ctx);
+  pthread_mutex_unlock(&ctx->lock);
+
+  /* The handle is created by the first write. */
+  if (kafka == NULL)
+    return 0;
+
+  rd_kafka_poll(kafka, /* timeout_ms = */ 0);
+  if (!ctx->report_stats)
+    return 0;
+
+  kafka_submit_derive(
+      ctx, "total_values", "delivered",
+      (derive_t)__atomic_load_n(&ctx->stats_delivered, __ATOMIC_RELAXED));
+  kafka_submit_derive(
+      ctx, "total_values", "failed",
+      (derive_t)__atomic_load_n(&ctx->stats_failed, __ATOMIC_RELAXED));
+  kafka_submit_derive(
+      ctx, "total_values", "rejected",
+      (derive_t)__atomic_load_n(&ctx->stats_rejected, __ATOMIC_RELAXED));
+  kafka_submit_gauge(ctx, "queue_length", (gauge_t)rd_kafka_outq_len(kafka));
+
+#ifdef HAVE_LIBRDKAFKA_MESSAGE_LATENCY
+  /* Average latency of the messages delivered since the last read. */
+  uint64_t num = __atomic_load_n(&ctx->stats_latency_num, __ATOMIC_RELAXED);
+  uint64_t sum = __atomic_load_n(&ctx->stats_latency_sum, __ATOMIC_RELAXED);
+  if (num > ctx->stats_latency_num_previous)
+    kafka_submit_gauge(ctx, "latency",
+                       (gauge_t)(sum - ctx->stats_latency_sum_previous) /
+                           (gauge_t)(num - ctx->stats_latency_num_previous) /
+                           1000000.0);
+  ctx->stats_latency_num_previous = num;
+  ctx->stats_latency_sum_previous = sum;
+#endif
+
+  return 0;
+} /* }}} int kafka_read */
+
 static void kafka_topic_context_free(void *p) /* {{{ */
 {
   struct kafka_topic_context *ctx = p;
@@ -233,6 +509,13 @@ static void kafka_topic_context_free(void *p) /* {{{ */
   if (ctx == NULL)
     return;
 
+  kafka_batch_produce(ctx);
+  /* Give the queued messages a chance to be delivered. */
+  for (int i = 0; (ctx->kafka != NULL) && (rd_kafka_outq_len(ctx->kafka) > 0) &&
+                  (i < KAFKA_SHUTDOWN_TIMEOUT_MS / 100);
+       i++)
+    rd_kafka_poll(ctx->kafka, /* timeout_ms = */ 100);
+
   if (ctx->topic_name != NULL)
     sfree(ctx->topic_name);
   if (ctx->topic != NULL)
@@ -244,6 +527,13 @@ static void kafka_topic_context_free(void *p) /* {{{ */
   if (ctx->kafka != NULL)
     rd_kafka_destroy(ctx->kafka);
 
+  sfree(ctx->key);
+  sfree(ctx->prefix);
+  sfree(ctx->postfix);
+  sfree(ctx->batch);
+  sfree(ctx->batch_messages);
+  sfree(ctx->batch_data);
+  pthread_mutex_destroy(&ctx->lock);
   sfree(ctx);
 } /* }}} void kafka_topic_context_free */
 
@@ -268,6 +558,8 @@ static void kafka_config_topic(rd_kafka_conf_t *conf,
   tctx->store_rates = 1;
   tctx->format = KAFKA_FORMAT_JSON;
   tctx->key = NULL;
+  tctx->batch_size = 1;
+  tctx->batch_linger = KAFKA_DEFAULT_BATCH_LINGER;
 
   if ((tctx->kafka_conf = rd_kafka_conf_dup(conf)) == NULL) {
     sfree(tctx);
@@ -335,6 +627,9 @@ static void kafka_config_topic(rd_kafka_conf_t *conf,
       if (strcasecmp("Random", tctx->key) == 0) {
         sfree(tctx->key);
         tctx->key = strdup(kafka_random_key(KAFKA_RANDOM_KEY_BUFFER));
+      } else if (strcasecmp("Identity", tctx->key) == 0) {
+        sfree(tctx->key);
+        tctx->key_identity = 1;
       }
     } else if (strcasecmp("Format", child->key) == 0) {
       status = cf_util_get_string(child, &key);
@@ -352,6 +647,9 @@ static void kafka_config_topic(rd_kafka_conf_t *conf,
       } else if (strcasecmp(key, "Json") == 0) {
         tctx->format = KAFKA_FORMAT_JSON;
 
+      } else if (strcasecmp(key, "Protobuf") == 0) {
+        tctx->format = KAFKA_FORMAT_PROTOBUF;
+
       } else {
         WARNING("write_kafka plugin: Invalid format string: %s", key);
       }
@@ -387,6 +685,19 @@ static void kafka_config_topic(rd_kafka_conf_t *conf,
                 "only one character. Others will be ignored.");
       tctx->escape_char = tmp_buff[0];
       sfree(tmp_buff);
+    } else if (strcasecmp("BatchSize", child->key) == 0) {
+      int tmp = 0;
+      status = cf_util_get_int(child, &tmp);
+      if ((status == 0) && (tmp < 1)) {
+        WARNING("write_kafka plugin: BatchSize must be positive.");
+        status = -1;
+      }
+      if (status == 0)
+        tctx->batch_size = (size_t)tmp;
+    } else if (strcasecmp("BatchLinger", child->key) == 0) {
+      status = cf_util_get_cdtime(child, &tctx->batch_linger);
+    } else if (strcasecmp("ReportStats", child->key) == 0) {
+      status = cf_util_get_boolean(child, &tctx->report_stats);
     } else {
       WARNING("write_kafka plugin: Invalid directive: %s.", child->key);
     }
@@ -398,6 +709,23 @@ static void kafka_config_topic(rd_kafka_conf_t *conf,
   rd_kafka_topic_conf_set_partitioner_cb(tctx->conf, kafka_partition);
   rd_kafka_topic_conf_set_opaque(tctx->conf, tctx);
 
+  if (tctx->report_stats) {
+    rd_kafka_conf_set_dr_msg_cb(tctx->kafka_conf, kafka_delivery_report);
+    rd_kafka_conf_set_opaque(tctx->kafka_conf, tctx);
+  }
+
+  if (tctx->batch_size > 1) {
+    tctx->batch = calloc(tctx->batch_size, sizeof(*tctx->batch));
+    tctx->batch_messages =
+        calloc(tctx->batch_size, sizeof(*tctx->batch_messages));
+    if ((tctx->batch == NULL) || (tctx->batch_messages == NULL)) {
+      ERROR("write_kafka plugin: calloc failed.");
+      goto errout;
+    }
+  }
+
+  pthread_mutex_init(&tctx->lock, /* attr = */ NULL);
+
   snprintf(callback_name, sizeof(callback_name), "write_kafka/%s",
            tctx->topic_name);
 
@@ -410,10 +738,18 @@ static void kafka_config_topic(rd_kafka_conf_t *conf,
     WARNING("write_kafka plugin: plugin_register_write (\"%s\") "
             "failed with status %i.",
             callback_name, status);
+    pthread_mutex_destroy(&tctx->lock);
     goto errout;
   }
 
-  pthread_mutex_init(&tctx->lock, /* attr = */ NULL);
+  /* The write callback owns the context; the other callbacks share it. */
+  if (tctx->batch_size > 1)
+    plugin_register_flush(callback_name, kafka_flush,
+                          &(user_data_t){.data = tctx});
+  if ((tctx->batch_size > 1) || tctx->report_stats)
+    plugin_register_complex_read(/* group = */ NULL, callback_name, kafka_read,
+                                 /* interval = */ 0,
+                                 &(user_data_t){.data = tctx});
 
   return;
 errout:
@@ -423,6 +759,9 @@ errout:
     rd_kafka_topic_conf_destroy(tctx->conf);
   if (tctx->kafka_conf != NULL)
     rd_kafka_conf_destroy(tctx->kafka_conf);
+  sfree(tctx->key);
+  sfree(tctx->batch);
+  sfree(tctx->batch_messages);
   sfree(tctx);
 } /* }}} int kafka_config_topic */
 
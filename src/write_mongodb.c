@@ -34,10 +34,30 @@
 
 #include "common.h"
 #include "plugin.h"
+#include "utils_avltree.h"
 #include "utils_cache.h"
 
 #include <mongoc.h>
 
+#define WM_DEFAULT_BATCH_LINGER TIME_T_TO_CDTIME_T_STATIC(1)
+
+/* A document waiting to be inserted in bulk. */
+struct wm_doc_s {
+  char collection[DATA_MAX_NAME_LEN];
+  bson_t *doc;
+};
+typedef struct wm_doc_s wm_doc_t;
+
+/* All samples of one series in a batch, see wm_bucket_add(). The "samples"
+ * array is kept open until the batch is written. */
+struct wm_bucket_s {
+  char collection[DATA_MAX_NAME_LEN];
+  bson_t doc;
+  bson_t samples;
+  size_t samples_num;
+};
+typedef struct wm_bucket_s wm_bucket_t;
+
 struct wm_node_s {
   char name[DATA_MAX_NAME_LEN];
 
@@ -53,6 +73,20 @@ struct wm_node_s {
   _Bool store_rates;
   _Bool connected;
 
+  /* If "batch_size" is greater than one, documents are collected and
+   * inserted with one bulk operation per collection once "batch_size" value
+   * lists have been written or the oldest one is older than "batch_linger".
+   * With "bucket", the samples of each series are combined into a single
+   * document per batch. */
+  int batch_size;
+  cdtime_t batch_linger;
+  _Bool bucket;
+  wm_doc_t *docs;
+  size_t docs_num;
+  c_avl_tree_t *buckets; /* identifier -> wm_bucket_t */
+  size_t batch_num;
+  cdtime_t batch_start;
+
   mongoc_client_t *client;
   mongoc_database_t *database;
   pthread_mutex_t lock;
@@ -62,37 +96,22 @@ typedef struct wm_node_s wm_node_t;
 /*
  * Functions
  */
-static bson_t *wm_create_bson(const data_set_t *ds, /* {{{ */
-                              const value_list_t *vl, _Bool store_rates) {
-  bson_t *ret;
+static int wm_append_values(bson_t *ret, const data_set_t *ds, /* {{{ */
+                            const value_list_t *vl, _Bool store_rates) {
   bson_t subarray;
   gauge_t *rates;
 
-  ret = bson_new();
-  if (!ret) {
-    ERROR("write_mongodb plugin: bson_new failed.");
-    return NULL;
-  }
-
   if (store_rates) {
     rates = uc_get_rate(ds, vl);
     if (rates == NULL) {
       ERROR("write_mongodb plugin: uc_get_rate() failed.");
-      bson_destroy(ret);
-      return NULL;
+      return -1;
     }
   } else {
     rates = NULL;
   }
 
-  BSON_APPEND_DATE_TIME(ret, "timestamp", CDTIME_T_TO_MS(vl->time));
-  BSON_APPEND_UTF8(ret, "host", vl->host);
-  BSON_APPEND_UTF8(ret, "plugin", vl->plugin);
-  BSON_APPEND_UTF8(ret, "plugin_instance", vl->plugin_instance);
-  BSON_APPEND_UTF8(ret, "type", vl->type);
-  BSON_APPEND_UTF8(ret, "type_instance", vl->type_instance);
-
-  BSON_APPEND_ARRAY_BEGIN(ret, "values", &subarray); /* {{{ */
+  BSON_APPEND_ARRAY_BEGIN(ret, "values", &subarray);
   for (size_t i = 0; i < ds->ds_num; i++) {
     char key[16];
 
@@ -111,11 +130,30 @@ static bson_t *wm_create_bson(const data_set_t *ds, /* {{{ */
     else {
       ERROR("write_mongodb plugin: Unknown ds_type %d for index %" PRIsz,
             ds->ds[i].type, i);
-      bson_destroy(ret);
-      return NULL;
+      bson_append_array_end(ret, &subarray);
+      sfree(rates);
+      return -1;
     }
   }
-  bson_append_array_end(ret, &subarray); /* }}} values */
+  bson_append_array_end(ret, &subarray);
+
+  sfree(rates);
+  return 0;
+} /* }}} int wm_append_values */
+
+static void wm_append_identifier(bson_t *ret, /* {{{ */
+                                 const value_list_t *vl) {
+  BSON_APPEND_UTF8(ret, "host", vl->host);
+  BSON_APPEND_UTF8(ret, "plugin", vl->plugin);
+  BSON_APPEND_UTF8(ret, "plugin_instance", vl->plugin_instance);
+  BSON_APPEND_UTF8(ret, "type", vl->type);
+  BSON_APPEND_UTF8(ret, "type_instance", vl->type_instance);
+} /* }}} void wm_append_identifier */
+
+/* Appends the types and names of the data sources. */
+static void wm_append_data_sources(bson_t *ret, /* {{{ */
+                                   const data_set_t *ds, _Bool store_rates) {
+  bson_t subarray;
 
   BSON_APPEND_ARRAY_BEGIN(ret, "dstypes", &subarray); /* {{{ */
   for (size_t i = 0; i < ds->ds_num; i++) {
@@ -138,14 +176,39 @@ static bson_t *wm_create_bson(const data_set_t *ds, /* {{{ */
     BSON_APPEND_UTF8(&subarray, key, ds->ds[i].name);
   }
   bson_append_array_end(ret, &subarray); /* }}} dsnames */
+} /* }}} void wm_append_data_sources */
 
-  sfree(rates);
-
+static _Bool wm_validate(bson_t const *doc) /* {{{ */
+{
   size_t error_location;
-  if (!bson_validate(ret, BSON_VALIDATE_UTF8, &error_location)) {
+  if (!bson_validate(doc, BSON_VALIDATE_UTF8, &error_location)) {
     ERROR("write_mongodb plugin: Error in generated BSON document "
           "at byte %" PRIsz,
           error_location);
+    return 0;
+  }
+  return 1;
+} /* }}} _Bool wm_validate */
+
+static bson_t *wm_create_bson(const data_set_t *ds, /* {{{ */
+                              const value_list_t *vl, _Bool store_rates) {
+  bson_t *ret;
+
+  ret = bson_new();
+  if (!ret) {
+    ERROR("write_mongodb plugin: bson_new failed.");
+    return NULL;
+  }
+
+  BSON_APPEND_DATE_TIME(ret, "timestamp", CDTIME_T_TO_MS(vl->time));
+  wm_append_identifier(ret, vl);
+  if (wm_append_values(ret, ds, vl, store_rates) != 0) {
+    bson_destroy(ret);
+    return NULL;
+  }
+  wm_append_data_sources(ret, ds, store_rates);
+
+  if (!wm_validate(ret)) {
     bson_destroy(ret);
     return NULL;
   }
@@ -218,6 +281,216 @@ static int wm_initialize(wm_node_t *node) /* {{{ */
   return 0;
 } /* }}} int wm_initialize */
 
+static void wm_disconnect(wm_node_t *node) /* {{{ */
+{
+  mongoc_database_destroy(node->database);
+  mongoc_client_destroy(node->client);
+  node->database = NULL;
+  node->client = NULL;
+  node->connected = 0;
+} /* }}} void wm_disconnect */
+
+/* Adds "doc" to the bulk operation of "collection_name" in "bulks", which is
+ * created if necessary. */
+static int wm_bulk_insert(wm_node_t *node, c_avl_tree_t *bulks, /* {{{ */
+                          char const *collection_name, bson_t const *doc) {
+  mongoc_bulk_operation_t *bulk = NULL;
+
+  if (c_avl_get(bulks, collection_name, (void *)&bulk) != 0) {
+    mongoc_collection_t *collection =
+        mongoc_client_get_collection(node->client, "collectd", collection_name);
+    if (!collection) {
+      ERROR("write_mongodb plugin: error creating/getting collection");
+      return -1;
+    }
+
+    /* Unordered, so that one failing document does not stop the others. */
+#if MONGOC_CHECK_VERSION(1, 9, 0)
+    bson_t opts = BSON_INITIALIZER;
+    BSON_APPEND_BOOL(&opts, "ordered", false);
+    bulk = mongoc_collection_create_bulk_operation_with_opts(collection, &opts);
+    bson_destroy(&opts);
+#else
+    bulk = mongoc_collection_create_bulk_operation(
+        collection, /* ordered = */ false, /* write_concern = */ NULL);
+#endif
+    mongoc_collection_destroy(collection);
+
+    char *key = strdup(collection_name);
+    if ((bulk == NULL) || (key == NULL) || (c_avl_insert(bulks, key, bulk) != 0)) {
+      ERROR("write_mongodb plugin: error creating bulk operation");
+      if (bulk != NULL)
+        mongoc_bulk_operation_destroy(bulk);
+      sfree(key);
+      return -1;
+    }
+  }
+
+  mongoc_bulk_operation_insert(bulk, doc);
+  return 0;
+} /* }}} int wm_bulk_insert */
+
+/* Inserts all pending documents, using one bulk operation per collection.
+ * The documents are discarded afterwards, even if the insert failed. Must be
+ * called with node->lock held. */
+static int wm_batch_flush(wm_node_t *node) /* {{{ */
+{
+  c_avl_tree_t *bulks;
+  int status = 0;
+
+  if (node->batch_num == 0)
+    return 0;
+
+  bulks = c_avl_create((int (*)(const void *, const void *))strcmp);
+  if (bulks == NULL)
+    status = ENOMEM;
+  else if (wm_initialize(node) < 0) {
+    ERROR("write_mongodb plugin: error making connection to server");
+    status = -1;
+  }
+
+  for (size_t i = 0; i < node->docs_num; i++) {
+    if (status == 0)
+      status = wm_bulk_insert(node, bulks, node->docs[i].collection,
+                              node->docs[i].doc);
+    bson_destroy(node->docs[i].doc);
+  }
+  node->docs_num = 0;
+
+  char *ident;
+  wm_bucket_t *b;
+  while ((node->buckets != NULL) &&
+         (c_avl_pick(node->buckets, (void *)&ident, (void *)&b) == 0)) {
+    bson_append_array_end(&b->doc, &b->samples);
+    if ((status == 0) && wm_validate(&b->doc))
+      status = wm_bulk_insert(node, bulks, b->collection, &b->doc);
+    bson_destroy(&b->doc);
+    sfree(b);
+    sfree(ident);
+  }
+
+  char *name;
+  mongoc_bulk_operation_t *bulk;
+  while ((bulks != NULL) &&
+         (c_avl_pick(bulks, (void *)&name, (void *)&bulk) == 0)) {
+    bson_t reply;
+    bson_error_t error;
+
+    if (!mongoc_bulk_operation_execute(bulk, &reply, &error)) {
+      ERROR("write_mongodb plugin: error inserting records into \"%s\": %s",
+            name, error.message);
+      status = -1;
+    }
+    bson_destroy(&reply);
+    mongoc_bulk_operation_destroy(bulk);
+    sfree(name);
+  }
+  if (bulks != NULL)
+    c_avl_destroy(bulks);
+
+  if (status != 0)
+    wm_disconnect(node);
+
+  node->batch_num = 0;
+  return status;
+} /* }}} int wm_batch_flush */
+
+/* Appends one sample to the bucket of the series of "vl". Must be called with
+ * node->lock held. */
+static int wm_bucket_add(wm_node_t *node, const data_set_t *ds, /* {{{ */
+                         const value_list_t *vl) {
+  char ident[6 * DATA_MAX_NAME_LEN];
+  char key[24];
+  wm_bucket_t *b = NULL;
+
+  if (FORMAT_VL(ident, sizeof(ident), vl) != 0)
+    return -1;
+
+  bson_t sample = BSON_INITIALIZER;
+  BSON_APPEND_DATE_TIME(&sample, "timestamp", CDTIME_T_TO_MS(vl->time));
+  if (wm_append_values(&sample, ds, vl, node->store_rates) != 0) {
+    bson_destroy(&sample);
+    return -1;
+  }
+
+  if (c_avl_get(node->buckets, ident, (void *)&b) != 0) {
+    char *ident_copy = strdup(ident);
+    b = calloc(1, sizeof(*b));
+    if ((ident_copy == NULL) || (b == NULL)) {
+      ERROR("write_mongodb plugin: calloc failed.");
+      sfree(ident_copy);
+      sfree(b);
+      bson_destroy(&sample);
+      return ENOMEM;
+    }
+
+    sstrncpy(b->collection, vl->plugin, sizeof(b->collection));
+    bson_init(&b->doc);
+    BSON_APPEND_DATE_TIME(&b->doc, "timestamp", CDTIME_T_TO_MS(vl->time));
+    wm_append_identifier(&b->doc, vl);
+    wm_append_data_sources(&b->doc, ds, node->store_rates);
+    BSON_APPEND_ARRAY_BEGIN(&b->doc, "samples", &b->samples);
+
+    if (c_avl_insert(node->buckets, ident_copy, b) != 0) {
+      ERROR("write_mongodb plugin: c_avl_insert failed.");
+      bson_append_array_end(&b->doc, &b->samples);
+      bson_destroy(&b->doc);
+      sfree(ident_copy);
+      sfree(b);
+      bson_destroy(&sample);
+      return ENOMEM;
+    }
+  }
+
+  snprintf(key, sizeof(key), "%" PRIsz, b->samples_num);
+  BSON_APPEND_DOCUMENT(&b->samples, key, &sample);
+  b->samples_num++;
+
+  bson_destroy(&sample);
+  return 0;
+} /* }}} int wm_bucket_add */
+
+static int wm_write_batch(wm_node_t *node, const data_set_t *ds, /* {{{ */
+                          const value_list_t *vl) {
+  bson_t *bson_record = NULL;
+  int status = 0;
+
+  if (!node->bucket) {
+    bson_record = wm_create_bson(ds, vl, node->store_rates);
+    if (!bson_record) {
+      ERROR("write_mongodb plugin: error making insert bson");
+      return -1;
+    }
+  }
+
+  pthread_mutex_lock(&node->lock);
+
+  if (node->batch_num == 0)
+    node->batch_start = cdtime();
+
+  if (node->bucket) {
+    status = wm_bucket_add(node, ds, vl);
+  } else {
+    wm_doc_t *d = node->docs + node->docs_num;
+    sstrncpy(d->collection, vl->plugin, sizeof(d->collection));
+    d->doc = bson_record;
+    node->docs_num++;
+  }
+  if (status == 0)
+    node->batch_num++;
+
+  if ((node->batch_num >= (size_t)node->batch_size) ||
+      ((node->batch_num > 0) &&
+       ((cdtime() - node->batch_start) >= node->batch_linger))) {
+    int flush_status = wm_batch_flush(node);
+    if (status == 0)
+      status = flush_status;
+  }
+
+  pthread_mutex_unlock(&node->lock);
+  return status;
+} /* }}} int wm_write_batch */
+
 static int wm_write(const data_set_t *ds, /* {{{ */
                     const value_list_t *vl, user_data_t *ud) {
   wm_node_t *node = ud->data;
@@ -226,6 +499,9 @@ static int wm_write(const data_set_t *ds, /* {{{ */
   bson_error_t error;
   int status;
 
+  if (node->batch_size > 1)
+    return wm_write_batch(node, ds, vl);
+
   bson_record = wm_create_bson(ds, vl, node->store_rates);
   if (!bson_record) {
     ERROR("write_mongodb plugin: error making insert bson");
@@ -280,6 +556,30 @@ static int wm_write(const data_set_t *ds, /* {{{ */
   return 0;
 } /* }}} int wm_write */
 
+static int wm_flush(cdtime_t timeout, /* {{{ */
+                    __attribute__((unused)) const char *identifier,
+                    user_data_t *ud) {
+  wm_node_t *node = ud->data;
+  int status = 0;
+
+  pthread_mutex_lock(&node->lock);
+  if ((node->batch_num > 0) &&
+      ((timeout == 0) || ((cdtime() - node->batch_start) >= timeout)))
+    status = wm_batch_flush(node);
+  pthread_mutex_unlock(&node->lock);
+
+  return status;
+} /* }}} int wm_flush */
+
+/* wm_read inserts batches which have been waiting for longer than the linger
+ * time, so that the values of an idle node are not held back. */
+static int wm_read(user_data_t *ud) /* {{{ */
+{
+  wm_node_t *node = ud->data;
+
+  return wm_flush(node->batch_linger, /* identifier = */ NULL, ud);
+} /* }}} int wm_read */
+
 static void wm_config_free(void *ptr) /* {{{ */
 {
   wm_node_t *node = ptr;
@@ -287,6 +587,12 @@ static void wm_config_free(void *ptr) /* {{{ */
   if (node == NULL)
     return;
 
+  if (node->batch_num > 0)
+    wm_batch_flush(node);
+  sfree(node->docs);
+  if (node->buckets != NULL)
+    c_avl_destroy(node->buckets);
+
   mongoc_database_destroy(node->database);
   mongoc_client_destroy(node->client);
   node->database = NULL;
@@ -313,6 +619,8 @@ static int wm_config_node(oconfig_item_t *ci) /* {{{ */
   }
   node->port = MONGOC_DEFAULT_PORT;
   node->store_rates = 1;
+  node->batch_size = 1;
+  node->batch_linger = WM_DEFAULT_BATCH_LINGER;
   pthread_mutex_init(&node->lock, /* attr = */ NULL);
 
   status = cf_util_get_string_buffer(ci, node->name, sizeof(node->name));
@@ -344,6 +652,12 @@ static int wm_config_node(oconfig_item_t *ci) /* {{{ */
       status = cf_util_get_string(child, &node->user);
     else if (strcasecmp("Password", child->key) == 0)
       status = cf_util_get_string(child, &node->passwd);
+    else if (strcasecmp("BatchSize", child->key) == 0)
+      status = cf_util_get_int(child, &node->batch_size);
+    else if (strcasecmp("BatchLinger", child->key) == 0)
+      status = cf_util_get_cdtime(child, &node->batch_linger);
+    else if (strcasecmp("BucketSamples", child->key) == 0)
+      status = cf_util_get_boolean(child, &node->bucket);
     else
       WARNING("write_mongodb plugin: Ignoring unknown config option \"%s\".",
               child->key);
@@ -365,6 +679,22 @@ static int wm_config_node(oconfig_item_t *ci) /* {{{ */
     }
   }
 
+  if ((status == 0) && node->bucket && (node->batch_size <= 1)) {
+    WARNING("write_mongodb plugin: \"BucketSamples\" requires \"BatchSize\" "
+            "to be greater than one and will be ignored.");
+    node->bucket = 0;
+  }
+
+  if ((status == 0) && (node->batch_size > 1)) {
+    if (node->bucket)
+      node->buckets =
+          c_avl_create((int (*)(const void *, const void *))strcmp);
+    else
+      node->docs = calloc(node->batch_size, sizeof(*node->docs));
+    if ((node->buckets == NULL) && (node->docs == NULL))
+      status = ENOMEM;
+  }
+
   if (status == 0) {
     char cb_name[sizeof("write_mongodb/") + DATA_MAX_NAME_LEN];
 
@@ -377,6 +707,14 @@ static int wm_config_node(oconfig_item_t *ci) /* {{{ */
                               });
     INFO("write_mongodb plugin: registered write plugin %s %d", cb_name,
          status);
+
+    if ((status == 0) && (node->batch_size > 1)) {
+      /* The write callback owns the node and frees it. */
+      plugin_register_flush(cb_name, wm_flush, &(user_data_t){.data = node});
+      plugin_register_complex_read(/* group = */ NULL, cb_name, wm_read,
+                                   node->batch_linger,
+                                   &(user_data_t){.data = node});
+    }
   }
 
   if (status != 0)
@@ -30,6 +30,8 @@
 #include "plugin.h"
 #include "utils_avltree.h"
 #include "utils_complain.h"
+#include "utils_compress.h"
+#include "utils_format_prometheus.h"
 #include "utils_time.h"
 
 #include "prometheus.pb-c.h"
@@ -51,10 +53,105 @@
   "encoding=delimited"
 #define CONTENT_TYPE_TEXT "text/plain; version=0.0.4"
 
+#ifndef MHD_CONTENT_READER_END_OF_STREAM
+#define MHD_CONTENT_READER_END_OF_STREAM ((ssize_t)-1)
+#define MHD_CONTENT_READER_END_WITH_ERROR ((ssize_t)-2)
+#endif
+
+#ifndef PROMETHEUS_DEFAULT_THREADS
+#define PROMETHEUS_DEFAULT_THREADS 2
+#endif
+
+#if HAVE_ZLIB_H
+#define PROMETHEUS_DEFAULT_COMPRESSION COMPRESS_GZIP
+#else
+#define PROMETHEUS_DEFAULT_COMPRESSION COMPRESS_NONE
+#endif
+
+/* MHD_USE_SELECT_INTERNALLY has been renamed in version 0.9.53. */
+#ifndef MHD_USE_INTERNAL_POLLING_THREAD
+#define MHD_USE_INTERNAL_POLLING_THREAD MHD_USE_SELECT_INTERNALLY
+#endif
+
+#define PROM_VALUE_SIZE 128
+
+#define PROM_FORMAT_TEXT 0
+#define PROM_FORMAT_PROTO 1
+#define PROM_FORMATS_NUM 2
+
+/* prom_chunk_t is an immutable piece of the exposition, such as the rendered
+ * text of one metric family. It is shared by the family which produced it and
+ * the snapshots being served, and freed when the last reference is dropped. */
+typedef struct {
+  uint64_t refs;
+  size_t len;
+  uint8_t data[];
+} prom_chunk_t;
+
+/* prom_snapshot_t is an immutable exposition in one of the formats, made up
+ * of the families' chunks. Scrapes are served from snapshots, so the metrics
+ * are not locked while the response is sent. The compressed exposition is
+ * created by the first scrape asking for it and shared by all others. */
+typedef struct {
+  uint64_t refs;
+  uint64_t generation;
+  size_t len;
+
+  pthread_mutex_t compressed_lock;
+  prom_chunk_t *compressed; /* protected by compressed_lock */
+  _Bool compress_failed;    /* protected by compressed_lock */
+
+  size_t chunks_num;
+  prom_chunk_t *chunks[];
+} prom_snapshot_t;
+
+typedef struct prom_metric_s prom_metric_t;
+
+/* prom_family_t extends a metric family with its rendered chunks. A chunk is
+ * current if its generation equals the family's generation, which is increased
+ * whenever a metric of the family changes.
+ *
+ * The metrics are looked up by the hash of their label set, see
+ * metric_hash(), in a chained hash table with "buckets_num" buckets. The
+ * "metric" array is kept in insertion order and grows geometrically. */
+typedef struct {
+  Io__Prometheus__Client__MetricFamily pb; /* must be the first member */
+  uint64_t generation;
+  prom_chunk_t *chunks[PROM_FORMATS_NUM];
+  uint64_t chunk_generation[PROM_FORMATS_NUM];
+
+  size_t metric_alloc;
+  prom_metric_t **buckets;
+  size_t buckets_num; /* zero or a power of two */
+} prom_family_t;
+
+/* prom_metric_t extends a metric with its line in the text format. The line
+ * starts with the metric name and the escaped labels, which are rendered once
+ * when the metric is created. Only the value and the timestamp that follow are
+ * rendered by metric_update(). */
+struct prom_metric_s {
+  Io__Prometheus__Client__Metric pb; /* must be the first member */
+  char *line;
+  size_t line_len;
+  size_t prefix_len;
+  size_t line_size;
+
+  uint64_t hash;
+  prom_metric_t *hash_next;
+};
+
 static c_avl_tree_t *metrics;
 static pthread_mutex_t metrics_lock = PTHREAD_MUTEX_INITIALIZER;
 
+/* Protected by metrics_lock. "metrics_generation" is increased with every
+ * change to "metrics", so that unchanged snapshots can be served again. */
+static uint64_t metrics_generation = 1;
+static prom_snapshot_t *snapshots[PROM_FORMATS_NUM];
+static prom_chunk_t *text_footer;
+
 static unsigned short httpd_port = 9103;
+static unsigned int httpd_threads = PROMETHEUS_DEFAULT_THREADS;
+static compress_method_t compression = PROMETHEUS_DEFAULT_COMPRESSION;
 static struct MHD_Daemon *httpd;
 
 static cdtime_t staleness_delta = PROMETHEUS_DEFAULT_STALENESS_DELTA;
@@ -76,31 +173,66 @@ static size_t varint(uint8_t buffer[static VARINT_UINT32_BYTES],
   return 0;
 }
 
-/* format_protobuf iterates over all metric families in "metrics" and adds them
- * to a buffer in ProtoBuf format. It prefixes each protobuf with its encoded
- * size, the so called "delimited" format. */
-static void format_protobuf(ProtobufCBuffer *buffer) {
-  pthread_mutex_lock(&metrics_lock);
+static prom_chunk_t *chunk_create(size_t len) /* {{{ */
+{
+  prom_chunk_t *c = malloc(sizeof(*c) + len);
+  if (c == NULL)
+    return NULL;
 
-  char *unused_name;
-  Io__Prometheus__Client__MetricFamily *fam;
-  c_avl_iterator_t *iter = c_avl_get_iterator(metrics);
-  while (c_avl_iterator_next(iter, (void *)&unused_name, (void *)&fam) == 0) {
-    /* Prometheus uses a message length prefix to determine where one
-     * MetricFamily ends and the next begins. This delimiter is encoded as a
-     * "varint", which is common in Protobufs. */
-    uint8_t delim[VARINT_UINT32_BYTES] = {0};
-    size_t delim_len = varint(
-        delim,
-        (uint32_t)io__prometheus__client__metric_family__get_packed_size(fam));
-    buffer->append(buffer, delim_len, delim);
-
-    io__prometheus__client__metric_family__pack_to_buffer(fam, buffer);
-  }
-  c_avl_iterator_destroy(iter);
+  c->refs = 1;
+  c->len = len;
+  return c;
+} /* }}} prom_chunk_t *chunk_create */
 
-  pthread_mutex_unlock(&metrics_lock);
-}
+static prom_chunk_t *chunk_ref(prom_chunk_t *c) /* {{{ */
+{
+  __atomic_add_fetch(&c->refs, 1, __ATOMIC_RELAXED);
+  return c;
+} /* }}} prom_chunk_t *chunk_ref */
+
+static void chunk_unref(prom_chunk_t *c) /* {{{ */
+{
+  if (c == NULL)
+    return;
+
+  if (__atomic_sub_fetch(&c->refs, 1, __ATOMIC_ACQ_REL) == 0)
+    free(c);
+} /* }}} void chunk_unref */
+
+static void snapshot_unref(prom_snapshot_t *snap) /* {{{ */
+{
+  if (snap == NULL)
+    return;
+
+  if (__atomic_sub_fetch(&snap->refs, 1, __ATOMIC_ACQ_REL) != 0)
+    return;
+
+  for (size_t i = 0; i < snap->chunks_num; i++)
+    chunk_unref(snap->chunks[i]);
+  chunk_unref(snap->compressed);
+  pthread_mutex_destroy(&snap->compressed_lock);
+  free(snap);
+} /* }}} void snapshot_unref */
+
+/* format_protobuf packs a metric family in ProtoBuf format. It prefixes the
+ * protobuf with its encoded size, the so called "delimited" format. */
+static prom_chunk_t *format_protobuf(prom_family_t *pf) /* {{{ */
+{
+  /* Prometheus uses a message length prefix to determine where one
+   * MetricFamily ends and the next begins. This delimiter is encoded as a
+   * "varint", which is common in Protobufs. */
+  size_t size = io__prometheus__client__metric_family__get_packed_size(&pf->pb);
+  uint8_t delim[VARINT_UINT32_BYTES] = {0};
+  size_t delim_len = varint(delim, (uint32_t)size);
+
+  prom_chunk_t *c = chunk_create(delim_len + size);
+  if (c == NULL)
+    return NULL;
+
+  memcpy(c->data, delim, delim_len);
+  io__prometheus__client__metric_family__pack(&pf->pb, c->data + delim_len);
+  return c;
+} /* }}} prom_chunk_t *format_protobuf */
 
 static char const *escape_label_value(char *buffer, size_t buffer_size,
                                       char const *value) {
@@ -171,57 +303,267 @@ static char *format_labels(char *buffer, size_t buffer_size,
   return buffer;
 }
 
-/* format_protobuf iterates over all metric families in "metrics" and adds them
- * to a buffer in plain text format. */
-static void format_text(ProtobufCBuffer *buffer) {
+/* format_text renders a metric family in plain text format by joining the
+ * lines of its metrics, see metric_format(). */
+static prom_chunk_t *format_text(prom_family_t *pf) /* {{{ */
+{
+  Io__Prometheus__Client__MetricFamily *fam = &pf->pb;
+  char header[2048];
+
+  int header_len = snprintf(
+      header, sizeof(header), "# HELP %s %s\n# TYPE %s %s\n", fam->name,
+      fam->help, fam->name,
+      (fam->type == IO__PROMETHEUS__CLIENT__METRIC_TYPE__GAUGE) ? "gauge"
+                                                                : "counter");
+  if ((header_len < 0) || ((size_t)header_len >= sizeof(header)))
+    header_len = 0;
+
+  size_t len = (size_t)header_len;
+  for (size_t i = 0; i < fam->n_metric; i++)
+    len += ((prom_metric_t *)fam->metric[i])->line_len;
+
+  prom_chunk_t *c = chunk_create(len);
+  if (c == NULL)
+    return NULL;
+
+  memcpy(c->data, header, (size_t)header_len);
+  size_t pos = (size_t)header_len;
+  for (size_t i = 0; i < fam->n_metric; i++) {
+    prom_metric_t *pm = (prom_metric_t *)fam->metric[i];
+    memcpy(c->data + pos, pm->line, pm->line_len);
+    pos += pm->line_len;
+  }
+
+  return c;
+} /* }}} prom_chunk_t *format_text */
+
+/* snapshot_get returns a snapshot of "metrics" in the requested format. Only
+ * the families which changed since the last snapshot are rendered again, and
+ * if nothing changed at all, the last snapshot is returned. metrics_lock is
+ * held for rendering only; the snapshot is sent without it. */
+static prom_snapshot_t *snapshot_get(int format) /* {{{ */
+{
+  prom_snapshot_t *snap = NULL;
+
   pthread_mutex_lock(&metrics_lock);
 
+  if ((snapshots[format] != NULL) &&
+      (snapshots[format]->generation == metrics_generation)) {
+    snap = snapshots[format];
+    __atomic_add_fetch(&snap->refs, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&metrics_lock);
+    return snap;
+  }
+
+  if ((format == PROM_FORMAT_TEXT) && (text_footer == NULL)) {
+    char footer[1024];
+    snprintf(footer, sizeof(footer), "\n# collectd/write_prometheus %s at %s\n",
+             PACKAGE_VERSION, hostname_g);
+    text_footer = chunk_create(strlen(footer));
+    if (text_footer == NULL) {
+      pthread_mutex_unlock(&metrics_lock);
+      return NULL;
+    }
+    memcpy(text_footer->data, footer, text_footer->len);
+  }
+
+  size_t chunks_max = (size_t)c_avl_size(metrics) + 1;
+  snap = calloc(1, sizeof(*snap) + chunks_max * sizeof(snap->chunks[0]));
+  if (snap == NULL) {
+    pthread_mutex_unlock(&metrics_lock);
+    return NULL;
+  }
+  snap->refs = 1;
+  snap->generation = metrics_generation;
+  pthread_mutex_init(&snap->compressed_lock, /* attr = */ NULL);
+
   char *unused_name;
-  Io__Prometheus__Client__MetricFamily *fam;
+  prom_family_t *pf;
   c_avl_iterator_t *iter = c_avl_get_iterator(metrics);
-  while (c_avl_iterator_next(iter, (void *)&unused_name, (void *)&fam) == 0) {
-    char line[1024]; /* 4x DATA_MAX_NAME_LEN? */
-
-    snprintf(line, sizeof(line), "# HELP %s %s\n", fam->name, fam->help);
-    buffer->append(buffer, strlen(line), (uint8_t *)line);
-
-    snprintf(line, sizeof(line), "# TYPE %s %s\n", fam->name,
-             (fam->type == IO__PROMETHEUS__CLIENT__METRIC_TYPE__GAUGE)
-                 ? "gauge"
-                 : "counter");
-    buffer->append(buffer, strlen(line), (uint8_t *)line);
-
-    for (size_t i = 0; i < fam->n_metric; i++) {
-      Io__Prometheus__Client__Metric *m = fam->metric[i];
-
-      char labels[1024];
-
-      char timestamp_ms[24] = "";
-      if (m->has_timestamp_ms)
-        snprintf(timestamp_ms, sizeof(timestamp_ms), " %" PRIi64,
-                 m->timestamp_ms);
-
-      if (fam->type == IO__PROMETHEUS__CLIENT__METRIC_TYPE__GAUGE)
-        snprintf(line, sizeof(line), "%s{%s} " GAUGE_FORMAT "%s\n", fam->name,
-                 format_labels(labels, sizeof(labels), m), m->gauge->value,
-                 timestamp_ms);
-      else /* if (fam->type == IO__PROMETHEUS__CLIENT__METRIC_TYPE__COUNTER) */
-        snprintf(line, sizeof(line), "%s{%s} %.0f%s\n", fam->name,
-                 format_labels(labels, sizeof(labels), m), m->counter->value,
-                 timestamp_ms);
-
-      buffer->append(buffer, strlen(line), (uint8_t *)line);
+  while (c_avl_iterator_next(iter, (void *)&unused_name, (void *)&pf) == 0) {
+    if ((pf->chunks[format] == NULL) ||
+        (pf->chunk_generation[format] != pf->generation)) {
+      prom_chunk_t *c = (format == PROM_FORMAT_PROTO) ? format_protobuf(pf)
+                                                      : format_text(pf);
+      if (c == NULL) {
+        ERROR("write_prometheus plugin: Rendering metric family \"%s\" "
+              "failed.",
+              pf->pb.name);
+        continue;
+      }
+      chunk_unref(pf->chunks[format]);
+      pf->chunks[format] = c;
+      pf->chunk_generation[format] = pf->generation;
     }
+
+    snap->chunks[snap->chunks_num++] = chunk_ref(pf->chunks[format]);
+    snap->len += pf->chunks[format]->len;
   }
   c_avl_iterator_destroy(iter);
 
-  char server[1024];
-  snprintf(server, sizeof(server), "\n# collectd/write_prometheus %s at %s\n",
-           PACKAGE_VERSION, hostname_g);
-  buffer->append(buffer, strlen(server), (uint8_t *)server);
+  if (format == PROM_FORMAT_TEXT) {
+    snap->chunks[snap->chunks_num++] = chunk_ref(text_footer);
+    snap->len += text_footer->len;
+  }
+
+  /* Keep the snapshot for the next scrape. */
+  snapshot_unref(snapshots[format]);
+  snapshots[format] = snap;
+  __atomic_add_fetch(&snap->refs, 1, __ATOMIC_RELAXED);
 
   pthread_mutex_unlock(&metrics_lock);
-}
+  return snap;
+} /* }}} prom_snapshot_t *snapshot_get */
+
+/* snapshot_compress compresses the snapshot's chunks into a single chunk. */
+static prom_chunk_t *snapshot_compress(prom_snapshot_t const *snap) /* {{{ */
+{
+  compress_t *c = compress_create(compression, snap->len / 4);
+  if (c == NULL)
+    return NULL;
+
+  int status = compress_stream_begin(c);
+  for (size_t i = 0; (status == 0) && (i < snap->chunks_num); i++)
+    status = compress_stream_write(c, snap->chunks[i]->data,
+                                   snap->chunks[i]->len);
+
+  void const *out = NULL;
+  size_t out_size = 0;
+  if (status == 0)
+    status = compress_stream_end(c, &out, &out_size);
+
+  prom_chunk_t *ret = NULL;
+  if (status == 0)
+    ret = chunk_create(out_size);
+  if (ret != NULL)
+    memcpy(ret->data, out, out_size);
+  else
+    ERROR("write_prometheus plugin: Compressing the response failed with "
+          "status %d.",
+          status);
+
+  compress_destroy(c);
+  return ret;
+} /* }}} prom_chunk_t *snapshot_compress */
+
+/* snapshot_get_compressed returns the compressed exposition of a snapshot, or
+ * NULL if it cannot be compressed. Only the first caller compresses; others
+ * wait for it and share the result. metrics_lock is not held. */
+static prom_chunk_t *
+snapshot_get_compressed(prom_snapshot_t *snap) /* {{{ */
+{
+  prom_chunk_t *ret = NULL;
+
+  pthread_mutex_lock(&snap->compressed_lock);
+  if ((snap->compressed == NULL) && !snap->compress_failed) {
+    snap->compressed = snapshot_compress(snap);
+    snap->compress_failed = (snap->compressed == NULL);
+  }
+  if (snap->compressed != NULL)
+    ret = chunk_ref(snap->compressed);
+  pthread_mutex_unlock(&snap->compressed_lock);
+
+  return ret;
+} /* }}} prom_chunk_t *snapshot_get_compressed */
+
+/* accepts_encoding returns true if the "Accept-Encoding" header lists
+ * "encoding", or "*", with a non-zero quality value. */
+static _Bool accepts_encoding(char const *header, /* {{{ */
+                              char const *encoding) {
+  if ((header == NULL) || (encoding == NULL))
+    return 0;
+
+  size_t encoding_len = strlen(encoding);
+  char const *ptr = header;
+  while (*ptr != 0) {
+    while ((*ptr == ' ') || (*ptr == '\t') || (*ptr == ','))
+      ptr++;
+    char const *token = ptr;
+    while ((*ptr != 0) && (*ptr != ',') && (*ptr != ';') && (*ptr != ' ') &&
+           (*ptr != '\t'))
+      ptr++;
+    size_t token_len = (size_t)(ptr - token);
+
+    /* Look for a "q=0" parameter, which means "not acceptable". */
+    _Bool rejected = 0;
+    while ((*ptr != 0) && (*ptr != ',')) {
+      if ((ptr[0] == ';') || (ptr[0] == ' ') || (ptr[0] == '\t')) {
+        ptr++;
+        continue;
+      }
+      if (((ptr[0] == 'q') || (ptr[0] == 'Q')) && (ptr[1] == '=')) {
+        char *end = NULL;
+        rejected = (strtod(ptr + 2, &end) <= 0.0);
+        ptr = end;
+        continue;
+      }
+      ptr++;
+    }
+
+    _Bool match = ((token_len == encoding_len) &&
+                   (strncasecmp(token, encoding, encoding_len) == 0)) ||
+                  ((token_len == 1) && (token[0] == '*'));
+    if (match && !rejected)
+      return 1;
+  }
+
+  return 0;
+} /* }}} _Bool accepts_encoding */
+
+/* prom_response_t is the state of a response being sent from a snapshot,
+ * either from its chunks or from its compressed exposition. */
+typedef struct {
+  prom_snapshot_t *snap;
+  prom_chunk_t *compressed;
+
+  prom_chunk_t *const *chunks;
+  size_t chunks_num;
+
+  uint64_t pos;
+  size_t chunk;
+  size_t chunk_pos;
+} prom_response_t;
+
+/* response_read is called by microhttpd to fill its send buffer. It reads the
+ * chunks in order; microhttpd reads the response sequentially. */
+static ssize_t response_read(void *cls, uint64_t pos, char *buf, /* {{{ */
+                             size_t max) {
+  prom_response_t *r = cls;
+
+  if (pos != r->pos)
+    return MHD_CONTENT_READER_END_WITH_ERROR;
+
+  size_t len = 0;
+  while ((len < max) && (r->chunk < r->chunks_num)) {
+    prom_chunk_t *c = r->chunks[r->chunk];
+    size_t n = c->len - r->chunk_pos;
+    if (n > (max - len))
+      n = max - len;
+
+    memcpy(buf + len, c->data + r->chunk_pos, n);
+    len += n;
+    r->chunk_pos += n;
+    if (r->chunk_pos >= c->len) {
+      r->chunk++;
+      r->chunk_pos = 0;
+    }
+  }
+
+  if (len == 0)
+    return MHD_CONTENT_READER_END_OF_STREAM;
+
+  r->pos += len;
+  return (ssize_t)len;
+} /* }}} ssize_t response_read */
+
+static void response_free(void *cls) /* {{{ */
+{
+  prom_response_t *r = cls;
+
+  chunk_unref(r->compressed);
+  snapshot_unref(r->snap);
+  free(r);
+} /* }}} void response_free */
 
 /* http_handler is the callback called by the microhttpd library. It essentially
  * handles all HTTP request aspects and creates an HTTP response. */
@@ -248,29 +590,47 @@ static int http_handler(void *cls, struct MHD_Connection *connection,
       (accept != NULL) &&
       (strstr(accept, "application/vnd.google.protobuf") != NULL);
 
-  uint8_t scratch[4096] = {0};
-  ProtobufCBufferSimple simple = PROTOBUF_C_BUFFER_SIMPLE_INIT(scratch);
-  ProtobufCBuffer *buffer = (ProtobufCBuffer *)&simple;
+  prom_response_t *r = calloc(1, sizeof(*r));
+  if (r == NULL)
+    return MHD_NO;
 
-  if (want_proto)
-    format_protobuf(buffer);
-  else
-    format_text(buffer);
+  r->snap = snapshot_get(want_proto ? PROM_FORMAT_PROTO : PROM_FORMAT_TEXT);
+  if (r->snap == NULL) {
+    free(r);
+    return MHD_NO;
+  }
+  r->chunks = r->snap->chunks;
+  r->chunks_num = r->snap->chunks_num;
+  uint64_t len = r->snap->len;
+
+  char const *encoding = compress_encoding(compression);
+  char const *accept_encoding = MHD_lookup_connection_value(
+      connection, MHD_HEADER_KIND, MHD_HTTP_HEADER_ACCEPT_ENCODING);
+  if ((encoding != NULL) && accepts_encoding(accept_encoding, encoding))
+    r->compressed = snapshot_get_compressed(r->snap);
+  if (r->compressed != NULL) {
+    r->chunks = &r->compressed;
+    r->chunks_num = 1;
+    len = r->compressed->len;
+  }
 
-#if defined(MHD_VERSION) && MHD_VERSION >= 0x00090500
-  struct MHD_Response *res = MHD_create_response_from_buffer(
-      simple.len, simple.data, MHD_RESPMEM_MUST_COPY);
-#else
-  struct MHD_Response *res = MHD_create_response_from_data(
-      simple.len, simple.data, /* must_free = */ 0, /* must_copy = */ 1);
-#endif
+  struct MHD_Response *res = MHD_create_response_from_callback(
+      len, /* block_size = */ 64 * 1024, response_read, r, response_free);
+  if (res == NULL) {
+    response_free(r);
+    return MHD_NO;
+  }
   MHD_add_response_header(res, MHD_HTTP_HEADER_CONTENT_TYPE,
                           want_proto ? CONTENT_TYPE_PROTO : CONTENT_TYPE_TEXT);
+  if (encoding != NULL)
+    MHD_add_response_header(res, MHD_HTTP_HEADER_VARY,
+                            MHD_HTTP_HEADER_ACCEPT_ENCODING);
+  if (r->compressed != NULL)
+    MHD_add_response_header(res, MHD_HTTP_HEADER_CONTENT_ENCODING, encoding);
 
   int status = MHD_queue_response(connection, MHD_HTTP_OK, res);
 
   MHD_destroy_response(res);
-  PROTOBUF_C_BUFFER_SIMPLE_CLEAR(&simple);
   return status;
 }
 
@@ -332,11 +692,13 @@ static void metric_destroy(Io__Prometheus__Client__Metric *msg) {
   sfree(msg->gauge);
   sfree(msg->counter);
 
+  sfree(((prom_metric_t *)msg)->line);
   sfree(msg);
 }
 
 /* metric_cmp compares two metrics. It's prototype makes it easy to use with
- * qsort(3) and bsearch(3). */
+ * qsort(3) and bsearch(3). The hash index only uses it to tell apart label
+ * sets with the same metric_hash(). */
 static int metric_cmp(void const *a, void const *b) {
   Io__Prometheus__Client__Metric const *m_a =
       *((Io__Prometheus__Client__Metric **)a);
@@ -404,31 +766,23 @@ static int metric_cmp(void const *a, void const *b) {
 
 #define METRIC_ADD_LABELS(m, vl)                                               \
   do {                                                                         \
-    if (strlen((vl)->plugin_instance) != 0) {                                  \
-      (m)->label[(m)->n_label]->name = (char *)(vl)->plugin;                   \
-      (m)->label[(m)->n_label]->value = (char *)(vl)->plugin_instance;         \
-      (m)->n_label++;                                                          \
-    }                                                                          \
-                                                                               \
-    if (strlen((vl)->type_instance) != 0) {                                    \
-      (m)->label[(m)->n_label]->name = "type";                                 \
-      if (strlen((vl)->plugin_instance) == 0)                                  \
-        (m)->label[(m)->n_label]->name = (char *)(vl)->plugin;                 \
-      (m)->label[(m)->n_label]->value = (char *)(vl)->type_instance;           \
+    format_prometheus_label_t labels[FORMAT_PROMETHEUS_LABELS_MAX];            \
+    size_t labels_num = format_prometheus_labels((vl), labels);                \
+    for (size_t i = 0; i < labels_num; i++) {                                  \
+      (m)->label[(m)->n_label]->name = (char *)labels[i].name;                 \
+      (m)->label[(m)->n_label]->value = (char *)labels[i].value;               \
       (m)->n_label++;                                                          \
     }                                                                          \
-                                                                               \
-    (m)->label[(m)->n_label]->name = "instance";                               \
-    (m)->label[(m)->n_label]->value = (char *)(vl)->host;                      \
-    (m)->n_label++;                                                            \
   } while (0)
 
-/* metric_clone allocates and initializes a new metric based on orig. */
+/* metric_clone allocates and initializes a new metric of the metric family
+ * "name" based on orig. */
 static Io__Prometheus__Client__Metric *
-metric_clone(Io__Prometheus__Client__Metric const *orig) {
-  Io__Prometheus__Client__Metric *copy = calloc(1, sizeof(*copy));
-  if (copy == NULL)
+metric_clone(char const *name, Io__Prometheus__Client__Metric const *orig) {
+  prom_metric_t *pm = calloc(1, sizeof(*pm));
+  if (pm == NULL)
     return NULL;
+  Io__Prometheus__Client__Metric *copy = &pm->pb;
   io__prometheus__client__metric__init(copy);
 
   copy->n_label = orig->n_label;
@@ -446,9 +800,52 @@ metric_clone(Io__Prometheus__Client__Metric const *orig) {
     }
   }
 
+  /* The labels never change, so they are escaped only once. */
+  char labels[1024];
+  char prefix[2048];
+  snprintf(prefix, sizeof(prefix), "%s{%s} ", name,
+           format_labels(labels, sizeof(labels), copy));
+
+  pm->prefix_len = strlen(prefix);
+  pm->line_size = pm->prefix_len + PROM_VALUE_SIZE;
+  pm->line = malloc(pm->line_size);
+  if (pm->line == NULL) {
+    metric_destroy(copy);
+    return NULL;
+  }
+  memcpy(pm->line, prefix, pm->prefix_len);
+
   return copy;
 }
 
+/* metric_format renders the value and timestamp of m after the prefix of its
+ * line in the text format. */
+static void metric_format(Io__Prometheus__Client__Metric *m) {
+  prom_metric_t *pm = (prom_metric_t *)m;
+
+  char timestamp_ms[24] = "";
+  if (m->has_timestamp_ms)
+    snprintf(timestamp_ms, sizeof(timestamp_ms), " %" PRIi64, m->timestamp_ms);
+
+  char *value = pm->line + pm->prefix_len;
+  size_t value_size = pm->line_size - pm->prefix_len;
+  int status;
+  if (m->gauge != NULL)
+    status = snprintf(value, value_size, GAUGE_FORMAT "%s\n", m->gauge->value,
+                      timestamp_ms);
+  else
+    status = snprintf(value, value_size, "%.0f%s\n", m->counter->value,
+                      timestamp_ms);
+
+  if ((status < 0) || ((size_t)status >= value_size)) {
+    /* Keep the line terminated, even if the value is absurdly long. */
+    pm->line_len = pm->line_size - 1;
+    pm->line[pm->line_len - 1] = '\n';
+    return;
+  }
+  pm->line_len = pm->prefix_len + (size_t)status;
+}
+
 /* metric_update stores the new value and timestamp in m. */
 static int metric_update(Io__Prometheus__Client__Metric *m, value_t value,
                          int ds_type, cdtime_t t, cdtime_t interval) {
@@ -506,24 +903,100 @@ static int metric_update(Io__Prometheus__Client__Metric *m, value_t value,
     m->has_timestamp_ms = 0;
   }
 
+  metric_format(m);
+  return 0;
+}
+
+/* metric_hash hashes the label values of m, using 64 bit FNV-1a. Like
+ * metric_cmp(), it ignores the label names, which are the same for all metrics
+ * in a metric family. */
+static uint64_t metric_hash(Io__Prometheus__Client__Metric const *m) {
+  uint64_t hash = 14695981039346656037ULL;
+
+  for (size_t i = 0; i < m->n_label; i++) {
+    /* Include the terminating null byte, so that {"ab","c"} and {"a","bc"}
+     * differ. */
+    for (unsigned char const *c = (unsigned char const *)m->label[i]->value;;
+         c++) {
+      hash ^= (uint64_t)*c;
+      hash *= 1099511628211ULL;
+      if (*c == 0)
+        break;
+    }
+  }
+
+  return hash;
+}
+
+/* metric_family_index_grow doubles the number of buckets of the hash index of
+ * pf and rehashes its metrics. */
+static int metric_family_index_grow(prom_family_t *pf) {
+  size_t buckets_num = (pf->buckets_num == 0) ? 16 : 2 * pf->buckets_num;
+  prom_metric_t **buckets = calloc(buckets_num, sizeof(*buckets));
+  if (buckets == NULL)
+    return ENOMEM;
+
+  for (size_t i = 0; i < pf->pb.n_metric; i++) {
+    prom_metric_t *pm = (prom_metric_t *)pf->pb.metric[i];
+    size_t b = (size_t)(pm->hash & (buckets_num - 1));
+    pm->hash_next = buckets[b];
+    buckets[b] = pm;
+  }
+
+  sfree(pf->buckets);
+  pf->buckets = buckets;
+  pf->buckets_num = buckets_num;
   return 0;
 }
 
-/* metric_family_add_metric adds m to the metric list of fam. */
+/* metric_family_find looks up the metric with the same labels as key, whose
+ * metric_hash() is hash. */
+static prom_metric_t *
+metric_family_find(prom_family_t *pf, Io__Prometheus__Client__Metric *key,
+                   uint64_t hash) {
+  if (pf->buckets_num == 0)
+    return NULL;
+
+  prom_metric_t *pm = pf->buckets[hash & (pf->buckets_num - 1)];
+  for (; pm != NULL; pm = pm->hash_next) {
+    Io__Prometheus__Client__Metric *m = &pm->pb;
+    if ((pm->hash == hash) && (metric_cmp(&key, &m) == 0))
+      return pm;
+  }
+
+  return NULL;
+}
+
+/* metric_family_add_metric adds m to the metric list and the hash index of
+ * fam. Both grow geometrically, so that adding many metrics takes linear
+ * time. */
 static int metric_family_add_metric(Io__Prometheus__Client__MetricFamily *fam,
                                     Io__Prometheus__Client__Metric *m) {
-  Io__Prometheus__Client__Metric **tmp =
-      realloc(fam->metric, (fam->n_metric + 1) * sizeof(*fam->metric));
-  if (tmp == NULL)
+  prom_family_t *pf = (prom_family_t *)fam;
+  prom_metric_t *pm = (prom_metric_t *)m;
+
+  if (fam->n_metric >= pf->metric_alloc) {
+    size_t alloc = (pf->metric_alloc == 0) ? 4 : 2 * pf->metric_alloc;
+    Io__Prometheus__Client__Metric **tmp =
+        realloc(fam->metric, alloc * sizeof(*fam->metric));
+    if (tmp == NULL)
+      return ENOMEM;
+    fam->metric = tmp;
+    pf->metric_alloc = alloc;
+  }
+
+  /* Keep at most one metric per bucket on average. */
+  if ((fam->n_metric >= pf->buckets_num) &&
+      (metric_family_index_grow(pf) != 0))
     return ENOMEM;
-  fam->metric = tmp;
+
+  size_t b = (size_t)(pm->hash & (pf->buckets_num - 1));
+  pm->hash_next = pf->buckets[b];
+  pf->buckets[b] = pm;
 
   fam->metric[fam->n_metric] = m;
   fam->n_metric++;
 
-  /* Sort the metrics so that lookup is fast. */
-  qsort(fam->metric, fam->n_metric, sizeof(*fam->metric), metric_cmp);
-
   return 0;
 }
 
@@ -532,17 +1005,27 @@ static int metric_family_add_metric(Io__Prometheus__Client__MetricFamily *fam,
 static int
 metric_family_delete_metric(Io__Prometheus__Client__MetricFamily *fam,
                             value_list_t const *vl) {
+  prom_family_t *pf = (prom_family_t *)fam;
   Io__Prometheus__Client__Metric *key = METRIC_INIT;
   METRIC_ADD_LABELS(key, vl);
 
+  prom_metric_t *pm = metric_family_find(pf, key, metric_hash(key));
+  if (pm == NULL)
+    return ENOENT;
+
+  prom_metric_t **next = &pf->buckets[pm->hash & (pf->buckets_num - 1)];
+  while (*next != pm)
+    next = &(*next)->hash_next;
+  *next = pm->hash_next;
+
   size_t i;
   for (i = 0; i < fam->n_metric; i++) {
-    if (metric_cmp(&key, &fam->metric[i]) == 0)
+    if (fam->metric[i] == &pm->pb)
       break;
   }
+  assert(i < fam->n_metric);
 
-  if (i >= fam->n_metric)
-    return ENOENT;
+  pf->generation++;
 
   metric_destroy(fam->metric[i]);
   if ((fam->n_metric - 1) > i)
@@ -550,16 +1033,6 @@ metric_family_delete_metric(Io__Prometheus__Client__MetricFamily *fam,
             ((fam->n_metric - 1) - i) * sizeof(fam->metric[i]));
   fam->n_metric--;
 
-  if (fam->n_metric == 0) {
-    sfree(fam->metric);
-    return 0;
-  }
-
-  Io__Prometheus__Client__Metric **tmp =
-      realloc(fam->metric, fam->n_metric * sizeof(*fam->metric));
-  if (tmp != NULL)
-    fam->metric = tmp;
-
   return 0;
 }
 
@@ -571,18 +1044,16 @@ metric_family_get_metric(Io__Prometheus__Client__MetricFamily *fam,
   Io__Prometheus__Client__Metric *key = METRIC_INIT;
   METRIC_ADD_LABELS(key, vl);
 
-  /* Metrics are sorted in metric_family_add_metric() so that we can do a binary
-   * search here. */
-  Io__Prometheus__Client__Metric **m = bsearch(
-      &key, fam->metric, fam->n_metric, sizeof(*fam->metric), metric_cmp);
-
-  if (m != NULL) {
-    return *m;
+  uint64_t hash = metric_hash(key);
+  prom_metric_t *pm = metric_family_find((prom_family_t *)fam, key, hash);
+  if (pm != NULL) {
+    return &pm->pb;
   }
 
-  Io__Prometheus__Client__Metric *new_metric = metric_clone(key);
+  Io__Prometheus__Client__Metric *new_metric = metric_clone(fam->name, key);
   if (new_metric == NULL)
     return NULL;
+  ((prom_metric_t *)new_metric)->hash = hash;
 
   DEBUG("write_prometheus plugin: created new metric in family");
   int status = metric_family_add_metric(fam, new_metric);
@@ -603,6 +1074,8 @@ static int metric_family_update(Io__Prometheus__Client__MetricFamily *fam,
   if (m == NULL)
     return -1;
 
+  ((prom_family_t *)fam)->generation++;
+
   return metric_update(m, vl->values[ds_index], ds->ds[ds_index].type, vl->time,
                        vl->interval);
 }
@@ -620,6 +1093,10 @@ static void metric_family_destroy(Io__Prometheus__Client__MetricFamily *msg) {
   }
   sfree(msg->metric);
 
+  sfree(((prom_family_t *)msg)->buckets);
+  for (size_t i = 0; i < PROM_FORMATS_NUM; i++)
+    chunk_unref(((prom_family_t *)msg)->chunks[i]);
+
   sfree(msg);
 }
 
@@ -627,9 +1104,10 @@ static void metric_family_destroy(Io__Prometheus__Client__MetricFamily *msg) {
 static Io__Prometheus__Client__MetricFamily *
 metric_family_create(char *name, data_set_t const *ds, value_list_t const *vl,
                      size_t ds_index) {
-  Io__Prometheus__Client__MetricFamily *msg = calloc(1, sizeof(*msg));
-  if (msg == NULL)
+  prom_family_t *pf = calloc(1, sizeof(*pf));
+  if (pf == NULL)
     return NULL;
+  Io__Prometheus__Client__MetricFamily *msg = &pf->pb;
   io__prometheus__client__metric_family__init(msg);
 
   msg->name = name;
@@ -650,38 +1128,13 @@ metric_family_create(char *name, data_set_t const *ds, value_list_t const *vl,
   return msg;
 }
 
-/* metric_family_name creates a metric family's name from a data source. This is
- * done in the same way as done by the "collectd_exporter" for best possible
- * compatibility. In essence, the plugin, type and data source name go in the
- * metric family name, while hostname, plugin instance and type instance go into
- * the labels of a metric. */
+/* metric_family_name creates a metric family's name from a data source, see
+ * format_prometheus_name(). */
 static char *metric_family_name(data_set_t const *ds, value_list_t const *vl,
                                 size_t ds_index) {
-  char const *fields[5] = {"collectd"};
-  size_t fields_num = 1;
-
-  if (strcmp(vl->plugin, vl->type) != 0) {
-    fields[fields_num] = vl->plugin;
-    fields_num++;
-  }
-  fields[fields_num] = vl->type;
-  fields_num++;
-
-  if (strcmp("value", ds->ds[ds_index].name) != 0) {
-    fields[fields_num] = ds->ds[ds_index].name;
-    fields_num++;
-  }
-
-  /* Prometheus best practices:
-   * cumulative metrics should have a "total" suffix. */
-  if ((ds->ds[ds_index].type == DS_TYPE_COUNTER) ||
-      (ds->ds[ds_index].type == DS_TYPE_DERIVE)) {
-    fields[fields_num] = "total";
-    fields_num++;
-  }
-
   char name[5 * DATA_MAX_NAME_LEN];
-  strjoin(name, sizeof(name), (char **)fields, fields_num, "_");
+  format_prometheus_name(name, sizeof(name), ds, vl, ds_index,
+                         /* rates = */ 0);
   return strdup(name);
 }
 
@@ -795,11 +1248,11 @@ static struct MHD_Daemon *prom_start_daemon() {
   }
 
   struct MHD_Daemon *d = MHD_start_daemon(
-      MHD_USE_THREAD_PER_CONNECTION | MHD_USE_DEBUG, httpd_port,
+      MHD_USE_INTERNAL_POLLING_THREAD | MHD_USE_DEBUG, httpd_port,
       /* MHD_AcceptPolicyCallback = */ NULL,
       /* MHD_AcceptPolicyCallback arg = */ NULL, http_handler, NULL,
-      MHD_OPTION_LISTEN_SOCKET, fd, MHD_OPTION_EXTERNAL_LOGGER, prom_logger,
-      NULL, MHD_OPTION_END);
+      MHD_OPTION_LISTEN_SOCKET, fd, MHD_OPTION_THREAD_POOL_SIZE, httpd_threads,
+      MHD_OPTION_EXTERNAL_LOGGER, prom_logger, NULL, MHD_OPTION_END);
   if (d == NULL) {
     ERROR("write_prometheus plugin: MHD_start_daemon() failed.");
     close(fd);
@@ -812,10 +1265,11 @@ static struct MHD_Daemon *prom_start_daemon() {
 static struct MHD_Daemon *prom_start_daemon() {
   /* {{{ */
   struct MHD_Daemon *d = MHD_start_daemon(
-      MHD_USE_THREAD_PER_CONNECTION | MHD_USE_DEBUG, httpd_port,
+      MHD_USE_INTERNAL_POLLING_THREAD | MHD_USE_DEBUG, httpd_port,
       /* MHD_AcceptPolicyCallback = */ NULL,
       /* MHD_AcceptPolicyCallback arg = */ NULL, http_handler, NULL,
-      MHD_OPTION_EXTERNAL_LOGGER, prom_logger, NULL, MHD_OPTION_END);
+      MHD_OPTION_THREAD_POOL_SIZE, httpd_threads, MHD_OPTION_EXTERNAL_LOGGER,
+      prom_logger, NULL, MHD_OPTION_END);
   if (d == NULL) {
     ERROR("write_prometheus plugin: MHD_start_daemon() failed.");
     return NULL;
@@ -838,6 +1292,27 @@ static int prom_config(oconfig_item_t *ci) {
         httpd_port = (unsigned short)status;
     } else if (strcasecmp("StalenessDelta", child->key) == 0) {
       cf_util_get_cdtime(child, &staleness_delta);
+    } else if (strcasecmp("Threads", child->key) == 0) {
+      int threads = 0;
+      if ((cf_util_get_int(child, &threads) == 0) && (threads > 0))
+        httpd_threads = (unsigned int)threads;
+      else
+        ERROR("write_prometheus plugin: The \"Threads\" option requires a "
+              "positive integer.");
+    } else if (strcasecmp("Compression", child->key) == 0) {
+      char *string = NULL;
+      if (cf_util_get_string(child, &string) != 0)
+        continue;
+
+      int status = compress_method_parse(string, &compression);
+      if (status == ENOTSUP)
+        ERROR("write_prometheus plugin: collectd has been built without "
+              "support for %s compression.",
+              string);
+      else if (status != 0)
+        ERROR("write_prometheus plugin: Invalid compression method: %s",
+              string);
+      sfree(string);
     } else {
       WARNING("write_prometheus plugin: Ignoring unknown configuration option "
               "\"%s\".",
@@ -873,6 +1348,7 @@ static int prom_init() {
 static int prom_write(data_set_t const *ds, value_list_t const *vl,
                       __attribute__((unused)) user_data_t *ud) {
   pthread_mutex_lock(&metrics_lock);
+  metrics_generation++;
 
   for (size_t i = 0; i < ds->ds_num; i++) {
     Io__Prometheus__Client__MetricFamily *fam =
@@ -900,6 +1376,7 @@ static int prom_missing(value_list_t const *vl,
     return ENOENT;
 
   pthread_mutex_lock(&metrics_lock);
+  metrics_generation++;
 
   for (size_t i = 0; i < ds->ds_num; i++) {
     Io__Prometheus__Client__MetricFamily *fam =
@@ -951,6 +1428,13 @@ static int prom_shutdown() {
     c_avl_destroy(metrics);
     metrics = NULL;
   }
+
+  for (size_t i = 0; i < PROM_FORMATS_NUM; i++) {
+    snapshot_unref(snapshots[i]);
+    snapshots[i] = NULL;
+  }
+  chunk_unref(text_footer);
+  text_footer = NULL;
   pthread_mutex_unlock(&metrics_lock);
 
   return 0;
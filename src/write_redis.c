@@ -28,6 +28,7 @@
 
 #include "common.h"
 #include "plugin.h"
+#include "utils_avltree.h"
 
 #include <hiredis/hiredis.h>
 #include <sys/time.h>
@@ -36,6 +37,8 @@
 #define REDIS_DEFAULT_PREFIX "collectd/"
 #endif
 
+#define REDIS_DEFAULT_FLUSH_INTERVAL TIME_T_TO_CDTIME_T_STATIC(1)
+
 struct wr_node_s {
   char name[DATA_MAX_NAME_LEN];
 
@@ -48,6 +51,18 @@ struct wr_node_s {
   int max_set_duration;
   _Bool store_rates;
 
+  /* If greater than one, commands are queued with redisAppendCommand() and
+   * their replies are read once "pipeline_depth" values have been written or
+   * the oldest value is older than "flush_interval". */
+  int pipeline_depth;
+  cdtime_t flush_interval;
+  int pipeline_values;
+  int pipeline_replies;
+  cdtime_t pipeline_start;
+  /* Identifiers written since the last flush, mapped to the time of their
+   * newest value. SADD and trimming are done once per key and flush. */
+  c_avl_tree_t *pipeline_keys;
+
   redisContext *conn;
   pthread_mutex_t lock;
 };
@@ -56,6 +71,164 @@ typedef struct wr_node_s wr_node_t;
 /*
  * Functions
  */
+/* Must be called with node->lock held. */
+static int wr_connect(wr_node_t *node) /* {{{ */
+{
+  redisReply *rr;
+
+  if (node->conn != NULL)
+    return 0;
+
+  node->conn =
+      redisConnectWithTimeout((char *)node->host, node->port, node->timeout);
+  if (node->conn == NULL) {
+    ERROR("write_redis plugin: Connecting to host \"%s\" (port %i) failed: "
+          "Unknown reason",
+          (node->host != NULL) ? node->host : "localhost",
+          (node->port != 0) ? node->port : 6379);
+    return -1;
+  } else if (node->conn->err) {
+    ERROR("write_redis plugin: Connecting to host \"%s\" (port %i) failed: %s",
+          (node->host != NULL) ? node->host : "localhost",
+          (node->port != 0) ? node->port : 6379, node->conn->errstr);
+    redisFree(node->conn);
+    node->conn = NULL;
+    return -1;
+  }
+
+  rr = redisCommand(node->conn, "SELECT %d", node->database);
+  if (rr == NULL)
+    WARNING("SELECT command error. database:%d message:%s", node->database,
+            node->conn->errstr);
+  else
+    freeReplyObject(rr);
+
+  return 0;
+} /* }}} int wr_connect */
+
+/* Reads the replies of all queued commands. If the connection fails, the
+ * remaining replies are lost and the connection is re-established by the next
+ * write. Must be called with node->lock held. */
+static int wr_pipeline_drain(wr_node_t *node) /* {{{ */
+{
+  int errors = 0;
+
+  while (node->pipeline_replies > 0) {
+    redisReply *rr = NULL;
+
+    if (redisGetReply(node->conn, (void **)&rr) != REDIS_OK) {
+      ERROR("write_redis plugin: Reading %d replies from node \"%s\" "
+            "failed: %s",
+            node->pipeline_replies, node->name, node->conn->errstr);
+      redisFree(node->conn);
+      node->conn = NULL;
+      node->pipeline_replies = 0;
+      return -1;
+    }
+
+    if ((rr != NULL) && (rr->type == REDIS_REPLY_ERROR)) {
+      if (errors == 0)
+        WARNING("write_redis plugin: Node \"%s\" returned an error: %s",
+                node->name, rr->str);
+      errors++;
+    }
+    if (rr != NULL)
+      freeReplyObject(rr);
+    node->pipeline_replies--;
+  }
+
+  if (errors > 1)
+    WARNING("write_redis plugin: Node \"%s\" returned %d errors in total.",
+            node->name, errors);
+  return (errors == 0) ? 0 : -1;
+} /* }}} int wr_pipeline_drain */
+
+static void wr_pipeline_append(wr_node_t *node, char const *command, /* {{{ */
+                               char const *key, int status) {
+  if (status == REDIS_OK)
+    node->pipeline_replies++;
+  else
+    WARNING("%s command error. key:%s message:%s", command, key,
+            node->conn->errstr);
+} /* }}} void wr_pipeline_append */
+
+/* Queues SADD and the trimming commands for all keys written since the last
+ * flush and reads all outstanding replies. Must be called with node->lock
+ * held. */
+static int wr_pipeline_flush(wr_node_t *node) /* {{{ */
+{
+  char const *prefix =
+      (node->prefix != NULL) ? node->prefix : REDIS_DEFAULT_PREFIX;
+  char *ident;
+  time_t *last;
+
+  while (c_avl_pick(node->pipeline_keys, (void *)&ident, (void *)&last) == 0) {
+    if (node->conn != NULL) {
+      char key[512];
+      snprintf(key, sizeof(key), "%s%s", prefix, ident);
+
+      if (node->max_set_size >= 0)
+        wr_pipeline_append(node, "ZREMRANGEBYRANK", key,
+                           redisAppendCommand(node->conn,
+                                              "ZREMRANGEBYRANK %s %d %d", key,
+                                              0, (-1 * node->max_set_size) - 1));
+      if (node->max_set_duration > 0)
+        wr_pipeline_append(
+            node, "ZREMRANGEBYSCORE", key,
+            redisAppendCommand(node->conn, "ZREMRANGEBYSCORE %s -1 (%ld", key,
+                               (long)(*last - node->max_set_duration) + 1));
+      wr_pipeline_append(
+          node, "SADD", ident,
+          redisAppendCommand(node->conn, "SADD %svalues %s", prefix, ident));
+    }
+    sfree(ident);
+    sfree(last);
+  }
+
+  node->pipeline_values = 0;
+  if (node->conn == NULL)
+    return -1;
+
+  return wr_pipeline_drain(node);
+} /* }}} int wr_pipeline_flush */
+
+/* Must be called with node->lock held. */
+static int wr_pipeline_write(wr_node_t *node, char const *ident, /* {{{ */
+                             char const *key, char const *time,
+                             char const *value, time_t t) {
+  time_t *last = NULL;
+
+  if (c_avl_get(node->pipeline_keys, ident, (void *)&last) != 0) {
+    char *ident_copy = strdup(ident);
+    last = malloc(sizeof(*last));
+    if ((ident_copy == NULL) || (last == NULL) ||
+        (c_avl_insert(node->pipeline_keys, ident_copy, last) != 0)) {
+      ERROR("write_redis plugin: Adding \"%s\" to the pipeline failed.",
+            ident);
+      sfree(ident_copy);
+      sfree(last);
+      return ENOMEM;
+    }
+    *last = t;
+  }
+  if (t > *last)
+    *last = t;
+
+  wr_pipeline_append(
+      node, "ZADD", key,
+      redisAppendCommand(node->conn, "ZADD %s %s %s", key, time, value));
+
+  if (node->pipeline_values == 0)
+    node->pipeline_start = cdtime();
+  node->pipeline_values++;
+
+  if ((node->pipeline_values >= node->pipeline_depth) ||
+      ((cdtime() - node->pipeline_start) >= node->flush_interval))
+    return wr_pipeline_flush(node);
+
+  return 0;
+} /* }}} int wr_pipeline_write */
+
 static int wr_write(const data_set_t *ds, /* {{{ */
                     const value_list_t *vl, user_data_t *ud) {
   wr_node_t *node = ud->data;
@@ -83,31 +256,16 @@ static int wr_write(const data_set_t *ds, /* {{{ */
 
   pthread_mutex_lock(&node->lock);
 
-  if (node->conn == NULL) {
-    node->conn =
-        redisConnectWithTimeout((char *)node->host, node->port, node->timeout);
-    if (node->conn == NULL) {
-      ERROR("write_redis plugin: Connecting to host \"%s\" (port %i) failed: "
-            "Unknown reason",
-            (node->host != NULL) ? node->host : "localhost",
-            (node->port != 0) ? node->port : 6379);
-      pthread_mutex_unlock(&node->lock);
-      return -1;
-    } else if (node->conn->err) {
-      ERROR(
-          "write_redis plugin: Connecting to host \"%s\" (port %i) failed: %s",
-          (node->host != NULL) ? node->host : "localhost",
-          (node->port != 0) ? node->port : 6379, node->conn->errstr);
-      pthread_mutex_unlock(&node->lock);
-      return -1;
-    }
+  if (wr_connect(node) != 0) {
+    pthread_mutex_unlock(&node->lock);
+    return -1;
+  }
 
-    rr = redisCommand(node->conn, "SELECT %d", node->database);
-    if (rr == NULL)
-      WARNING("SELECT command error. database:%d message:%s", node->database,
-              node->conn->errstr);
-    else
-      freeReplyObject(rr);
+  if (node->pipeline_depth > 1) {
+    status = wr_pipeline_write(node, ident, key, time, value,
+                               CDTIME_T_TO_TIME_T(vl->time));
+    pthread_mutex_unlock(&node->lock);
+    return status;
   }
 
   rr = redisCommand(node->conn, "ZADD %s %s %s", key, time, value);
@@ -131,8 +289,10 @@ static int wr_write(const data_set_t *ds, /* {{{ */
      * remove element, scored less than 'current-max_set_duration'
      * '(%d' indicates 'less than' in redis CLI.
      */
-    rr = redisCommand(node->conn, "ZREMRANGEBYSCORE %s -1 (%d", key,
-                      (time - node->max_set_duration) + 1);
+    rr = redisCommand(node->conn, "ZREMRANGEBYSCORE %s -1 (%ld", key,
+                      (long)(CDTIME_T_TO_TIME_T(vl->time) -
+                             node->max_set_duration) +
+                          1);
     if (rr == NULL)
       WARNING("ZREMRANGEBYSCORE command error. key:%s message:%s", key,
               node->conn->errstr);
@@ -157,6 +317,30 @@ static int wr_write(const data_set_t *ds, /* {{{ */
   return 0;
 } /* }}} int wr_write */
 
+static int wr_flush(cdtime_t timeout, /* {{{ */
+                    __attribute__((unused)) const char *identifier,
+                    user_data_t *ud) {
+  wr_node_t *node = ud->data;
+  int status = 0;
+
+  pthread_mutex_lock(&node->lock);
+  if ((node->pipeline_values > 0) &&
+      ((timeout == 0) || ((cdtime() - node->pipeline_start) >= timeout)))
+    status = wr_pipeline_flush(node);
+  pthread_mutex_unlock(&node->lock);
+
+  return status;
+} /* }}} int wr_flush */
+
+/* wr_read flushes pipelines which have been waiting for longer than the flush
+ * interval, so that the values of an idle node are not held back. */
+static int wr_read(user_data_t *ud) /* {{{ */
+{
+  wr_node_t *node = ud->data;
+
+  return wr_flush(node->flush_interval, /* identifier = */ NULL, ud);
+} /* }}} int wr_read */
+
 static void wr_config_free(void *ptr) /* {{{ */
 {
   wr_node_t *node = ptr;
@@ -164,6 +348,19 @@ static void wr_config_free(void *ptr) /* {{{ */
   if (node == NULL)
     return;
 
+  if (node->pipeline_keys != NULL) {
+    if ((node->conn != NULL) && (node->pipeline_values > 0))
+      wr_pipeline_flush(node);
+
+    void *key;
+    void *value;
+    while (c_avl_pick(node->pipeline_keys, &key, &value) == 0) {
+      sfree(key);
+      sfree(value);
+    }
+    c_avl_destroy(node->pipeline_keys);
+  }
+
   if (node->conn != NULL) {
     redisFree(node->conn);
     node->conn = NULL;
@@ -192,6 +389,8 @@ static int wr_config_node(oconfig_item_t *ci) /* {{{ */
   node->max_set_size = -1;
   node->max_set_duration = -1;
   node->store_rates = 1;
+  node->pipeline_depth = 1;
+  node->flush_interval = REDIS_DEFAULT_FLUSH_INTERVAL;
   pthread_mutex_init(&node->lock, /* attr = */ NULL);
 
   status = cf_util_get_string_buffer(ci, node->name, sizeof(node->name));
@@ -225,6 +424,10 @@ static int wr_config_node(oconfig_item_t *ci) /* {{{ */
       status = cf_util_get_int(child, &node->max_set_duration);
     } else if (strcasecmp("StoreRates", child->key) == 0) {
       status = cf_util_get_boolean(child, &node->store_rates);
+    } else if (strcasecmp("PipelineDepth", child->key) == 0) {
+      status = cf_util_get_int(child, &node->pipeline_depth);
+    } else if (strcasecmp("FlushInterval", child->key) == 0) {
+      status = cf_util_get_cdtime(child, &node->flush_interval);
     } else
       WARNING("write_redis plugin: Ignoring unknown config option \"%s\".",
               child->key);
@@ -233,6 +436,13 @@ static int wr_config_node(oconfig_item_t *ci) /* {{{ */
       break;
   } /* for (i = 0; i < ci->children_num; i++) */
 
+  if ((status == 0) && (node->pipeline_depth > 1)) {
+    node->pipeline_keys =
+        c_avl_create((int (*)(const void *, const void *))strcmp);
+    if (node->pipeline_keys == NULL)
+      status = ENOMEM;
+  }
+
   if (status == 0) {
     char cb_name[sizeof("write_redis/") + DATA_MAX_NAME_LEN];
 
@@ -243,6 +453,14 @@ static int wr_config_node(oconfig_item_t *ci) /* {{{ */
                               &(user_data_t){
                                   .data = node, .free_func = wr_config_free,
                               });
+
+    if ((status == 0) && (node->pipeline_depth > 1)) {
+      /* The write callback owns the node and frees it. */
+      plugin_register_flush(cb_name, wr_flush, &(user_data_t){.data = node});
+      plugin_register_complex_read(/* group = */ NULL, cb_name, wr_read,
+                                   node->flush_interval,
+                                   &(user_data_t){.data = node});
+    }
   }
 
   if (status != 0)
@@ -32,6 +32,7 @@
 
 #include "common.h"
 #include "plugin.h"
+#include "utils_avltree.h"
 #include "utils_cache.h"
 #include "utils_complain.h"
 #include "write_riemann_threshold.h"
@@ -42,6 +43,43 @@
 #define RIEMANN_PORT 5555
 #define RIEMANN_TTL_FACTOR 2.0
 #define RIEMANN_BATCH_MAX 8192
+/* Writers block once this many times BatchMaxSize are waiting to be sent. */
+#define RIEMANN_BATCH_QUEUE_FACTOR 4
+#define RIEMANN_SERIES_MAX 131072
+/* Series are forgotten when they haven't been written for this many
+ * intervals. The check runs once per RIEMANN_SERIES_SWEEP_INTERVAL. */
+#define RIEMANN_SERIES_TIMEOUT_FACTOR 10
+#define RIEMANN_SERIES_SWEEP_INTERVAL TIME_T_TO_CDTIME_T(60)
+/* Upper bound of the packed size of the fields set per value (time, metric and
+ * state) plus the framing of an event within a message. */
+#define RIEMANN_EVENT_OVERHEAD 48
+
+/* The events of a series with everything but the time, metric and state
+ * filled in. They are built once and copied into batches. */
+typedef struct {
+  char *name; /* identity; key of riemann_host.series */
+  riemann_event_t **events;
+  size_t events_num;
+  size_t *packed_size;
+  cdtime_t interval;
+  cdtime_t last_used;
+  uint64_t batch_id; /* last batch which copied the events */
+} wrr_series_t;
+
+/* The events are shallow copies, so their strings and attributes belong to a
+ * series or to one of the batch's own events. */
+typedef struct {
+  riemann_event_t *events;
+  riemann_event_t **events_ptr;
+  size_t events_num;
+  size_t events_size;
+  riemann_event_t **owned;
+  size_t owned_num;
+  size_t owned_size;
+  size_t packed_size;
+  cdtime_t init;
+  uint64_t id;
+} wrr_batch_t;
 
 struct riemann_host {
   c_complain_t init_complaint;
@@ -58,15 +96,30 @@ struct riemann_host {
   riemann_client_type_t client_type;
   riemann_client_t *client;
   double ttl_factor;
-  cdtime_t batch_init;
   int batch_max;
   int batch_timeout;
   int reference_count;
-  riemann_message_t *batch_msg;
   char *tls_ca_file;
   char *tls_cert_file;
   char *tls_key_file;
   struct timeval timeout;
+
+  /* Protected by "lock". "send_batch" belongs to the sender thread while it
+   * is sending. */
+  c_avl_tree_t *series;
+  cdtime_t next_sweep;
+  uint64_t last_batch_id;
+  wrr_batch_t fill_batch;
+  wrr_batch_t send_batch;
+  _Bool flush_requested;
+  _Bool shutdown;
+  _Bool thread_running;
+  pthread_t thread;
+  pthread_cond_t send_cond;
+  pthread_cond_t fill_cond;
+
+  /* Protects "client". Acquired after "lock" if both are needed. */
+  pthread_mutex_t send_lock;
 };
 
 static char **riemann_tags;
@@ -74,7 +127,7 @@ static size_t riemann_tags_num;
 static char **riemann_attrs;
 static size_t riemann_attrs_num;
 
-/* host->lock must be held when calling this function. */
+/* host->send_lock must be held when calling this function. */
 static int wrr_connect(struct riemann_host *host) /* {{{ */
 {
   char const *node;
@@ -121,7 +174,7 @@ static int wrr_connect(struct riemann_host *host) /* {{{ */
   return 0;
 } /* }}} int wrr_connect */
 
-/* host->lock must be held when calling this function. */
+/* host->send_lock must be held when calling this function. */
 static int wrr_disconnect(struct riemann_host *host) /* {{{ */
 {
   if (!host->client)
@@ -136,7 +189,8 @@ static int wrr_disconnect(struct riemann_host *host) /* {{{ */
 /**
  * Function to send messages to riemann.
  *
- * Acquires the host lock, disconnects on errors.
+ * host->send_lock must be held when calling this function. Disconnects on
+ * errors.
  */
 static int wrr_send_nolock(struct riemann_host *host,
                            riemann_message_t *msg) /* {{{ */
@@ -175,9 +229,9 @@ static int wrr_send_nolock(struct riemann_host *host,
 static int wrr_send(struct riemann_host *host, riemann_message_t *msg) {
   int status = 0;
 
-  pthread_mutex_lock(&host->lock);
+  pthread_mutex_lock(&host->send_lock);
   status = wrr_send_nolock(host, msg);
-  pthread_mutex_unlock(&host->lock);
+  pthread_mutex_unlock(&host->send_lock);
   return status;
 }
 
@@ -273,10 +327,12 @@ wrr_notification_to_message(struct riemann_host *host, /* {{{ */
   return msg;
 } /* }}} riemann_message_t *wrr_notification_to_message */
 
+/* Creates an event with the fields which only depend on the series and data
+ * source, i.e. everything but the time, metric and state. */
 static riemann_event_t *
 wrr_value_to_event(struct riemann_host const *host, /* {{{ */
                    data_set_t const *ds, value_list_t const *vl, size_t index,
-                   gauge_t const *rates, int status) {
+                   gauge_t const *rates) {
   riemann_event_t *event;
   char name_buffer[5 * DATA_MAX_NAME_LEN];
   char service_buffer[6 * DATA_MAX_NAME_LEN];
@@ -293,11 +349,12 @@ wrr_value_to_event(struct riemann_host const *host, /* {{{ */
               vl->type_instance);
   if (host->always_append_ds || (ds->ds_num > 1)) {
     if (host->event_service_prefix == NULL)
-      snprintf(service_buffer, sizeof(service_buffer), "%s/%s", &name_buffer[1],
-               ds->ds[index].name);
+      snprintf(service_buffer, sizeof(service_buffer), "%s/%s",
+               &name_buffer[1], ds->ds[index].name);
     else
       snprintf(service_buffer, sizeof(service_buffer), "%s%s/%s",
-               host->event_service_prefix, &name_buffer[1], ds->ds[index].name);
+               host->event_service_prefix, &name_buffer[1],
+               ds->ds[index].name);
   } else {
     if (host->event_service_prefix == NULL)
       sstrncpy(service_buffer, &name_buffer[1], sizeof(service_buffer));
@@ -307,40 +364,12 @@ wrr_value_to_event(struct riemann_host const *host, /* {{{ */
   }
 
   riemann_event_set(
-      event, RIEMANN_EVENT_FIELD_HOST, vl->host, RIEMANN_EVENT_FIELD_TIME,
-      (int64_t)CDTIME_T_TO_TIME_T(vl->time), RIEMANN_EVENT_FIELD_TTL,
+      event, RIEMANN_EVENT_FIELD_HOST, vl->host, RIEMANN_EVENT_FIELD_TTL,
       (float)CDTIME_T_TO_DOUBLE(vl->interval) * host->ttl_factor,
       RIEMANN_EVENT_FIELD_STRING_ATTRIBUTES, "plugin", vl->plugin, "type",
       vl->type, "ds_name", ds->ds[index].name, NULL,
       RIEMANN_EVENT_FIELD_SERVICE, service_buffer, RIEMANN_EVENT_FIELD_NONE);
 
-#if RCC_VERSION_NUMBER >= 0x010A00
-  riemann_event_set(event, RIEMANN_EVENT_FIELD_TIME_MICROS,
-                    (int64_t)CDTIME_T_TO_US(vl->time));
-#endif
-
-  if (host->check_thresholds) {
-    const char *state = NULL;
-
-    switch (status) {
-    case STATE_OKAY:
-      state = "ok";
-      break;
-    case STATE_ERROR:
-      state = "critical";
-      break;
-    case STATE_WARNING:
-      state = "warning";
-      break;
-    case STATE_MISSING:
-      state = "unknown";
-      break;
-    }
-    if (state)
-      riemann_event_set(event, RIEMANN_EVENT_FIELD_STATE, state,
-                        RIEMANN_EVENT_FIELD_NONE);
-  }
-
   if (vl->plugin_instance[0] != 0)
     riemann_event_string_attribute_add(event, "plugin_instance",
                                        vl->plugin_instance);
@@ -373,106 +402,328 @@ wrr_value_to_event(struct riemann_host const *host, /* {{{ */
   for (i = 0; i < riemann_tags_num; i++)
     riemann_event_tag_add(event, riemann_tags[i]);
 
+  return event;
+} /* }}} riemann_event_t *wrr_value_to_event */
+
+/* Sets the time, metric and state of a copy of an event created by
+ * wrr_value_to_event(). The state points to a string constant, so the copy
+ * must not be freed with riemann_event_free(). */
+static void wrr_event_set_value(struct riemann_host const *host, /* {{{ */
+                                riemann_event_t *event, data_set_t const *ds,
+                                value_list_t const *vl, size_t index,
+                                gauge_t const *rates, int status) {
+  event->has_time = 1;
+  event->time = (int64_t)CDTIME_T_TO_TIME_T(vl->time);
+#if RCC_VERSION_NUMBER >= 0x010A00
+  event->has_time_micros = 1;
+  event->time_micros = (int64_t)CDTIME_T_TO_US(vl->time);
+#endif
+
+  if (host->check_thresholds) {
+    switch (status) {
+    case STATE_OKAY:
+      event->state = "ok";
+      break;
+    case STATE_ERROR:
+      event->state = "critical";
+      break;
+    case STATE_WARNING:
+      event->state = "warning";
+      break;
+    case STATE_MISSING:
+      event->state = "unknown";
+      break;
+    }
+  }
+
   if (ds->ds[index].type == DS_TYPE_GAUGE) {
-    riemann_event_set(event, RIEMANN_EVENT_FIELD_METRIC_D,
-                      (double)vl->values[index].gauge,
-                      RIEMANN_EVENT_FIELD_NONE);
+    event->has_metric_d = 1;
+    event->metric_d = (double)vl->values[index].gauge;
   } else if (rates != NULL) {
-    riemann_event_set(event, RIEMANN_EVENT_FIELD_METRIC_D, (double)rates[index],
-                      RIEMANN_EVENT_FIELD_NONE);
+    event->has_metric_d = 1;
+    event->metric_d = (double)rates[index];
   } else {
-    int64_t metric;
-
+    event->has_metric_sint64 = 1;
     if (ds->ds[index].type == DS_TYPE_DERIVE)
-      metric = (int64_t)vl->values[index].derive;
+      event->metric_sint64 = (int64_t)vl->values[index].derive;
     else if (ds->ds[index].type == DS_TYPE_ABSOLUTE)
-      metric = (int64_t)vl->values[index].absolute;
+      event->metric_sint64 = (int64_t)vl->values[index].absolute;
     else
-      metric = (int64_t)vl->values[index].counter;
+      event->metric_sint64 = (int64_t)vl->values[index].counter;
+  }
+} /* }}} void wrr_event_set_value */
+
+static void wrr_series_free_events(wrr_series_t *s) /* {{{ */
+{
+  for (size_t i = 0; i < s->events_num; i++)
+    riemann_event_free(s->events[i]);
+  sfree(s->events);
+  sfree(s->packed_size);
+  s->events_num = 0;
+} /* }}} void wrr_series_free_events */
+
+static void wrr_series_free(wrr_series_t *s) /* {{{ */
+{
+  if (s == NULL)
+    return;
 
-    riemann_event_set(event, RIEMANN_EVENT_FIELD_METRIC_S64, (int64_t)metric,
-                      RIEMANN_EVENT_FIELD_NONE);
+  wrr_series_free_events(s);
+  sfree(s->name);
+  sfree(s);
+} /* }}} void wrr_series_free */
+
+static int wrr_series_build(struct riemann_host const *host, /* {{{ */
+                            wrr_series_t *s, data_set_t const *ds,
+                            value_list_t const *vl, gauge_t const *rates) {
+  s->events = calloc(ds->ds_num, sizeof(*s->events));
+  s->packed_size = calloc(ds->ds_num, sizeof(*s->packed_size));
+  if ((s->events == NULL) || (s->packed_size == NULL)) {
+    wrr_series_free_events(s);
+    return ENOMEM;
   }
 
-  DEBUG("write_riemann plugin: Successfully created message for metric: "
-        "host = \"%s\", service = \"%s\"",
-        event->host, event->service);
-  return event;
-} /* }}} riemann_event_t *wrr_value_to_event */
+  for (size_t i = 0; i < ds->ds_num; i++) {
+    s->events[i] = wrr_value_to_event(host, ds, vl, i, rates);
+    if (s->events[i] == NULL) {
+      wrr_series_free_events(s);
+      return -1;
+    }
+    s->events_num++;
+    s->packed_size[i] =
+        event__get_packed_size(s->events[i]) + RIEMANN_EVENT_OVERHEAD;
+  }
 
-static riemann_message_t *
-wrr_value_list_to_message(struct riemann_host const *host, /* {{{ */
-                          data_set_t const *ds, value_list_t const *vl,
-                          int *statuses) {
-  riemann_message_t *msg;
-  size_t i;
-  gauge_t *rates = NULL;
+  s->interval = vl->interval;
+  return 0;
+} /* }}} int wrr_series_build */
+
+/* A series' events may only be changed or freed while no batch refers to
+ * them. */
+static _Bool wrr_series_in_use(struct riemann_host const *host, /* {{{ */
+                               wrr_series_t const *s) {
+  return (s->batch_id != 0) && ((s->batch_id == host->fill_batch.id) ||
+                                (s->batch_id == host->send_batch.id));
+} /* }}} _Bool wrr_series_in_use */
+
+/* host->lock must be held when calling this function. Returns NULL if the
+ * value list's events can't be cached. */
+static wrr_series_t *wrr_series_get(struct riemann_host *host, /* {{{ */
+                                    data_set_t const *ds,
+                                    value_list_t const *vl,
+                                    gauge_t const *rates) {
+  value_list_identity_t const *identity = VALUE_LIST_IDENTITY(vl);
+  wrr_series_t *s = NULL;
 
-  /* Initialize the Msg structure. */
-  msg = riemann_message_new();
-  if (msg == NULL) {
-    ERROR("write_riemann plugin: riemann_message_new failed.");
+  if ((identity == NULL) || (host->series == NULL))
     return NULL;
-  }
 
-  if (host->store_rates) {
-    rates = uc_get_rate(ds, vl);
-    if (rates == NULL) {
-      ERROR("write_riemann plugin: uc_get_rate failed.");
-      riemann_message_free(msg);
+  if (c_avl_get(host->series, identity->name, (void *)&s) == 0) {
+    if ((s->events_num == ds->ds_num) && (s->interval == vl->interval))
+      return s;
+
+    /* The interval (and thus the TTL) or the data set has changed. */
+    if (wrr_series_in_use(host, s))
       return NULL;
-    }
+    wrr_series_free_events(s);
+    if (wrr_series_build(host, s, ds, vl, rates) != 0)
+      return NULL;
+    return s;
   }
 
-  for (i = 0; i < vl->values_len; i++) {
-    riemann_event_t *event;
+  if (c_avl_size(host->series) >= RIEMANN_SERIES_MAX)
+    return NULL;
 
-    event = wrr_value_to_event(host, ds, vl, (int)i, rates, statuses[i]);
-    if (event == NULL) {
-      riemann_message_free(msg);
-      sfree(rates);
-      return NULL;
+  s = calloc(1, sizeof(*s));
+  if (s == NULL)
+    return NULL;
+  s->name = strdup(identity->name);
+  if ((s->name == NULL) || (wrr_series_build(host, s, ds, vl, rates) != 0) ||
+      (c_avl_insert(host->series, s->name, s) != 0)) {
+    wrr_series_free(s);
+    return NULL;
+  }
+
+  return s;
+} /* }}} wrr_series_t *wrr_series_get */
+
+/* host->lock must be held when calling this function. */
+static void wrr_series_expire(struct riemann_host *host, /* {{{ */
+                              cdtime_t now) {
+  c_avl_iterator_t *iter;
+  char *key;
+  wrr_series_t *s;
+  char **keys = NULL;
+  size_t keys_num = 0;
+
+  if ((host->series == NULL) || (now < host->next_sweep))
+    return;
+  host->next_sweep = now + RIEMANN_SERIES_SWEEP_INTERVAL;
+
+  iter = c_avl_get_iterator(host->series);
+  while (c_avl_iterator_next(iter, (void *)&key, (void *)&s) == 0) {
+    cdtime_t timeout = RIEMANN_SERIES_TIMEOUT_FACTOR *
+                       ((s->interval > 0) ? s->interval : plugin_get_interval());
+    if (wrr_series_in_use(host, s) || ((s->last_used + timeout) > now))
+      continue;
+
+    char **tmp = realloc(keys, (keys_num + 1) * sizeof(*keys));
+    if (tmp == NULL)
+      break;
+    keys = tmp;
+    keys[keys_num] = key;
+    keys_num++;
+  }
+  c_avl_iterator_destroy(iter);
+
+  for (size_t i = 0; i < keys_num; i++) {
+    if (c_avl_remove(host->series, keys[i], NULL, (void *)&s) == 0)
+      wrr_series_free(s);
+  }
+  sfree(keys);
+} /* }}} void wrr_series_expire */
+
+static void wrr_batch_reset(wrr_batch_t *b) /* {{{ */
+{
+  for (size_t i = 0; i < b->owned_num; i++)
+    riemann_event_free(b->owned[i]);
+  b->owned_num = 0;
+  b->events_num = 0;
+  b->packed_size = 0;
+  b->id = 0;
+} /* }}} void wrr_batch_reset */
+
+static void wrr_batch_destroy(wrr_batch_t *b) /* {{{ */
+{
+  wrr_batch_reset(b);
+  sfree(b->events);
+  sfree(b->events_ptr);
+  sfree(b->owned);
+  b->events_size = 0;
+  b->owned_size = 0;
+} /* }}} void wrr_batch_destroy */
+
+static int wrr_batch_reserve(wrr_batch_t *b, size_t events_num) /* {{{ */
+{
+  size_t need = b->events_num + events_num;
+  if (need <= b->events_size)
+    return 0;
+
+  size_t size = (b->events_size > 0) ? b->events_size : 64;
+  while (size < need)
+    size *= 2;
+
+  riemann_event_t *events = realloc(b->events, size * sizeof(*events));
+  if (events == NULL)
+    return ENOMEM;
+  b->events = events;
+
+  riemann_event_t **events_ptr =
+      realloc(b->events_ptr, size * sizeof(*events_ptr));
+  if (events_ptr == NULL)
+    return ENOMEM;
+  b->events_ptr = events_ptr;
+
+  b->events_size = size;
+  return 0;
+} /* }}} int wrr_batch_reserve */
+
+/* Takes ownership of "event", which is freed when the batch is reset. */
+static int wrr_batch_own(wrr_batch_t *b, riemann_event_t *event) /* {{{ */
+{
+  if (b->owned_num >= b->owned_size) {
+    size_t size = (b->owned_size > 0) ? (2 * b->owned_size) : 16;
+    riemann_event_t **tmp = realloc(b->owned, size * sizeof(*tmp));
+    if (tmp == NULL) {
+      riemann_event_free(event);
+      return ENOMEM;
     }
-    riemann_message_append_events(msg, event, NULL);
+    b->owned = tmp;
+    b->owned_size = size;
   }
 
-  sfree(rates);
-  return msg;
-} /* }}} riemann_message_t *wrr_value_list_to_message */
+  b->owned[b->owned_num] = event;
+  b->owned_num++;
+  return 0;
+} /* }}} int wrr_batch_own */
+
+/* host->lock must be held when calling this function. Appends one event per
+ * data source; the events of known series are copied from the cache. */
+static int wrr_batch_add(struct riemann_host *host, /* {{{ */
+                         wrr_batch_t *b, data_set_t const *ds,
+                         value_list_t const *vl, gauge_t const *rates,
+                         int const *statuses) {
+  if (wrr_batch_reserve(b, ds->ds_num) != 0) {
+    ERROR("write_riemann plugin: out of memory");
+    return ENOMEM;
+  }
 
-/*
- * Always call while holding host->lock !
- */
-static int wrr_batch_flush_nolock(cdtime_t timeout, struct riemann_host *host) {
-  cdtime_t now;
-  int status = 0;
+  if (b->events_num == 0)
+    b->init = cdtime();
 
-  now = cdtime();
-  if (timeout > 0) {
-    if ((host->batch_init + timeout) > now) {
-      return status;
+  wrr_series_t *s = wrr_series_get(host, ds, vl, rates);
+  if (s != NULL) {
+    s->last_used = cdtime();
+    s->batch_id = b->id;
+  }
+
+  for (size_t i = 0; i < ds->ds_num; i++) {
+    riemann_event_t *tmpl;
+    size_t packed_size;
+
+    if (s != NULL) {
+      tmpl = s->events[i];
+      packed_size = s->packed_size[i];
+    } else {
+      tmpl = wrr_value_to_event(host, ds, vl, i, rates);
+      if ((tmpl == NULL) || (wrr_batch_own(b, tmpl) != 0)) {
+        ERROR("write_riemann plugin: Creating an event failed.");
+        return -1;
+      }
+      packed_size = event__get_packed_size(tmpl) + RIEMANN_EVENT_OVERHEAD;
     }
+
+    riemann_event_t *event = b->events + b->events_num;
+    *event = *tmpl;
+    wrr_event_set_value(host, event, ds, vl, i, rates, statuses[i]);
+    b->events_num++;
+    b->packed_size += packed_size;
   }
-  wrr_send_nolock(host, host->batch_msg);
-  riemann_message_free(host->batch_msg);
 
-  host->batch_init = now;
-  host->batch_msg = NULL;
-  return status;
-}
+  return 0;
+} /* }}} int wrr_batch_add */
 
-static int wrr_batch_flush(cdtime_t timeout,
-                           const char *identifier __attribute__((unused)),
-                           user_data_t *user_data) {
-  struct riemann_host *host;
+/* Sends the batch. The series referenced by the batch must not change while
+ * this function runs. */
+static int wrr_batch_send(struct riemann_host *host, /* {{{ */
+                          wrr_batch_t *b) {
+  riemann_message_t *msg;
   int status;
 
-  if (user_data == NULL)
-    return -EINVAL;
+  if (b->events_num == 0)
+    return 0;
+
+  msg = riemann_message_new();
+  if (msg == NULL) {
+    ERROR("write_riemann plugin: riemann_message_new failed.");
+    return ENOMEM;
+  }
+
+  /* The pointers are set up here because the events may have moved while
+   * the batch was growing. */
+  for (size_t i = 0; i < b->events_num; i++)
+    b->events_ptr[i] = b->events + i;
+  msg->n_events = b->events_num;
+  msg->events = b->events_ptr;
+
+  pthread_mutex_lock(&host->send_lock);
+  status = wrr_send_nolock(host, msg);
+  pthread_mutex_unlock(&host->send_lock);
+
+  /* The events belong to the batch. */
+  msg->n_events = 0;
+  msg->events = NULL;
+  riemann_message_free(msg);
 
-  host = user_data->data;
-  pthread_mutex_lock(&host->lock);
-  status = wrr_batch_flush_nolock(timeout, host);
   if (status != 0)
     c_complain(
         LOG_ERR, &host->init_complaint,
@@ -482,57 +733,138 @@ static int wrr_batch_flush(cdtime_t timeout,
     c_release(LOG_DEBUG, &host->init_complaint,
               "write_riemann plugin: batch sent.");
 
-  pthread_mutex_unlock(&host->lock);
   return status;
-}
+} /* }}} int wrr_batch_send */
 
-static int wrr_batch_add_value_list(struct riemann_host *host, /* {{{ */
-                                    data_set_t const *ds,
-                                    value_list_t const *vl, int *statuses) {
-  riemann_message_t *msg;
-  size_t len;
-  int ret;
-  cdtime_t timeout;
+/* host->lock must be held when calling this function. */
+static _Bool wrr_batch_is_due(struct riemann_host const *host, /* {{{ */
+                              cdtime_t now) {
+  wrr_batch_t const *b = &host->fill_batch;
 
-  msg = wrr_value_list_to_message(host, ds, vl, statuses);
-  if (msg == NULL)
-    return -1;
+  if (b->events_num == 0)
+    return 0;
+  if (host->flush_requested || host->shutdown || (host->batch_max < 0) ||
+      (b->packed_size >= (size_t)host->batch_max))
+    return 1;
+  if ((host->batch_timeout > 0) &&
+      ((b->init + TIME_T_TO_CDTIME_T((time_t)host->batch_timeout)) <= now))
+    return 1;
+  return 0;
+} /* }}} _Bool wrr_batch_is_due */
+
+/* Sends the batches filled by wrr_write(). While one batch is being sent, the
+ * next one is filled. */
+static void *wrr_send_thread(void *arg) /* {{{ */
+{
+  struct riemann_host *host = arg;
 
   pthread_mutex_lock(&host->lock);
+  while (42) {
+    cdtime_t now = cdtime();
 
-  if (host->batch_msg == NULL) {
-    host->batch_msg = msg;
-  } else {
-    int status;
+    if (!wrr_batch_is_due(host, now)) {
+      if (host->shutdown)
+        break;
 
-    status = riemann_message_append_events_n(host->batch_msg, msg->n_events,
-                                             msg->events);
-    msg->n_events = 0;
-    msg->events = NULL;
+      if ((host->batch_timeout > 0) && (host->fill_batch.events_num > 0)) {
+        struct timespec ts = CDTIME_T_TO_TIMESPEC(
+            host->fill_batch.init +
+            TIME_T_TO_CDTIME_T((time_t)host->batch_timeout));
+        pthread_cond_timedwait(&host->send_cond, &host->lock, &ts);
+      } else {
+        pthread_cond_wait(&host->send_cond, &host->lock);
+      }
+      continue;
+    }
 
-    riemann_message_free(msg);
+    /* The previous send_batch has been reset and is empty. */
+    wrr_batch_t tmp = host->send_batch;
+    host->send_batch = host->fill_batch;
+    host->fill_batch = tmp;
+    host->fill_batch.id = ++host->last_batch_id;
+    host->flush_requested = 0;
+    pthread_cond_broadcast(&host->fill_cond);
+    pthread_mutex_unlock(&host->lock);
 
-    if (status != 0) {
-      pthread_mutex_unlock(&host->lock);
-      ERROR("write_riemann plugin: out of memory");
-      return -1;
-    }
+    wrr_batch_send(host, &host->send_batch);
+
+    pthread_mutex_lock(&host->lock);
+    wrr_batch_reset(&host->send_batch);
+    wrr_series_expire(host, now);
   }
+  pthread_mutex_unlock(&host->lock);
 
-  len = riemann_message_get_packed_size(host->batch_msg);
-  ret = 0;
-  if ((host->batch_max < 0) || (((size_t)host->batch_max) <= len)) {
-    ret = wrr_batch_flush_nolock(0, host);
-  } else {
-    if (host->batch_timeout > 0) {
-      timeout = TIME_T_TO_CDTIME_T((time_t)host->batch_timeout);
-      ret = wrr_batch_flush_nolock(timeout, host);
-    }
+  return NULL;
+} /* }}} void *wrr_send_thread */
+
+/* host->lock must be held when calling this function. The thread is started
+ * with the first value rather than during configuration, so that it survives
+ * the daemon forking into the background. */
+static int wrr_start_thread(struct riemann_host *host) /* {{{ */
+{
+  if (host->thread_running)
+    return 0;
+
+  int status = plugin_thread_create(&host->thread, /* attr = */ NULL,
+                                    wrr_send_thread, host, "write_riemann");
+  if (status != 0) {
+    ERROR("write_riemann plugin: Starting the sender thread failed: %s",
+          STRERROR(status));
+    return status;
+  }
+
+  host->thread_running = 1;
+  return 0;
+} /* }}} int wrr_start_thread */
+
+static int wrr_batch_flush(cdtime_t timeout,
+                           const char *identifier __attribute__((unused)),
+                           user_data_t *user_data) {
+  struct riemann_host *host;
+
+  if (user_data == NULL)
+    return -EINVAL;
+
+  host = user_data->data;
+  pthread_mutex_lock(&host->lock);
+  if ((host->fill_batch.events_num > 0) &&
+      ((timeout == 0) || ((host->fill_batch.init + timeout) <= cdtime()))) {
+    host->flush_requested = 1;
+    pthread_cond_signal(&host->send_cond);
+  }
+  pthread_mutex_unlock(&host->lock);
+
+  return 0;
+}
+
+static int wrr_batch_add_value_list(struct riemann_host *host, /* {{{ */
+                                    data_set_t const *ds,
+                                    value_list_t const *vl,
+                                    gauge_t const *rates, int *statuses) {
+  size_t queue_max = RIEMANN_BATCH_QUEUE_FACTOR *
+                     ((host->batch_max > 0) ? (size_t)host->batch_max
+                                            : RIEMANN_BATCH_MAX);
+  int status;
+
+  pthread_mutex_lock(&host->lock);
+
+  status = wrr_start_thread(host);
+  if (status != 0) {
+    pthread_mutex_unlock(&host->lock);
+    return status;
   }
 
+  /* Block while the sender can't keep up. */
+  while (!host->shutdown && (host->fill_batch.packed_size >= queue_max))
+    pthread_cond_wait(&host->fill_cond, &host->lock);
+
+  status = wrr_batch_add(host, &host->fill_batch, ds, vl, rates, statuses);
+  if (wrr_batch_is_due(host, cdtime()))
+    pthread_cond_signal(&host->send_cond);
+
   pthread_mutex_unlock(&host->lock);
-  return ret;
-} /* }}} riemann_message_t *wrr_batch_add_value_list */
+  return status;
+} /* }}} int wrr_batch_add_value_list */
 
 static int wrr_notification(const notification_t *n, user_data_t *ud) /* {{{ */
 {
@@ -569,7 +901,7 @@ static int wrr_write(const data_set_t *ds, /* {{{ */
   int status = 0;
   int statuses[vl->values_len];
   struct riemann_host *host = ud->data;
-  riemann_message_t *msg;
+  gauge_t *rates = NULL;
 
   if (host->check_thresholds) {
     status = write_riemann_threshold_check(ds, vl, statuses);
@@ -579,17 +911,31 @@ static int wrr_write(const data_set_t *ds, /* {{{ */
     memset(statuses, 0, sizeof(statuses));
   }
 
-  if (host->client_type != RIEMANN_CLIENT_UDP && host->batch_mode) {
-    wrr_batch_add_value_list(host, ds, vl, statuses);
-  } else {
-    msg = wrr_value_list_to_message(host, ds, vl, statuses);
-    if (msg == NULL)
+  if (host->store_rates) {
+    rates = uc_get_rate(ds, vl);
+    if (rates == NULL) {
+      ERROR("write_riemann plugin: uc_get_rate failed.");
       return -1;
+    }
+  }
 
-    status = wrr_send(host, msg);
+  if (host->client_type != RIEMANN_CLIENT_UDP && host->batch_mode) {
+    status = wrr_batch_add_value_list(host, ds, vl, rates, statuses);
+  } else {
+    wrr_batch_t b = {0};
+
+    pthread_mutex_lock(&host->lock);
+    b.id = ++host->last_batch_id;
+    status = wrr_batch_add(host, &b, ds, vl, rates, statuses);
+    if (status == 0)
+      status = wrr_batch_send(host, &b);
+    wrr_series_expire(host, cdtime());
+    pthread_mutex_unlock(&host->lock);
 
-    riemann_message_free(msg);
+    wrr_batch_destroy(&b);
   }
+
+  sfree(rates);
   return status;
 } /* }}} int wrr_write */
 
@@ -608,10 +954,39 @@ static void wrr_free(void *p) /* {{{ */
     return;
   }
 
+  /* The sender thread sends what is left before it exits. */
+  _Bool thread_running = host->thread_running;
+  host->shutdown = 1;
+  pthread_cond_broadcast(&host->send_cond);
+  pthread_cond_broadcast(&host->fill_cond);
+  pthread_mutex_unlock(&host->lock);
+
+  if (thread_running)
+    pthread_join(host->thread, NULL);
+
   wrr_disconnect(host);
 
-  pthread_mutex_lock(&host->lock);
+  wrr_batch_destroy(&host->fill_batch);
+  wrr_batch_destroy(&host->send_batch);
+  if (host->series != NULL) {
+    void *key;
+    wrr_series_t *s;
+
+    while (c_avl_pick(host->series, &key, (void *)&s) == 0)
+      wrr_series_free(s);
+    c_avl_destroy(host->series);
+  }
+
+  pthread_cond_destroy(&host->fill_cond);
+  pthread_cond_destroy(&host->send_cond);
+  pthread_mutex_destroy(&host->send_lock);
   pthread_mutex_destroy(&host->lock);
+  sfree(host->name);
+  sfree(host->event_service_prefix);
+  sfree(host->node);
+  sfree(host->tls_ca_file);
+  sfree(host->tls_cert_file);
+  sfree(host->tls_key_file);
   sfree(host);
 } /* }}} void wrr_free */
 
@@ -628,6 +1003,9 @@ static int wrr_config_node(oconfig_item_t *ci) /* {{{ */
     return ENOMEM;
   }
   pthread_mutex_init(&host->lock, NULL);
+  pthread_mutex_init(&host->send_lock, NULL);
+  pthread_cond_init(&host->send_cond, NULL);
+  pthread_cond_init(&host->fill_cond, NULL);
   C_COMPLAIN_INIT(&host->init_complaint);
   host->reference_count = 1;
   host->node = NULL;
@@ -638,13 +1016,15 @@ static int wrr_config_node(oconfig_item_t *ci) /* {{{ */
   host->always_append_ds = 0;
   host->batch_mode = 1;
   host->batch_max = RIEMANN_BATCH_MAX; /* typical MSS */
-  host->batch_init = cdtime();
   host->batch_timeout = 0;
+  host->fill_batch.id = ++host->last_batch_id;
   host->ttl_factor = RIEMANN_TTL_FACTOR;
   host->client = NULL;
   host->client_type = RIEMANN_CLIENT_TCP;
   host->timeout.tv_sec = 0;
   host->timeout.tv_usec = 0;
+  /* Without the cache, events are built from scratch every time. */
+  host->series = c_avl_create((int (*)(const void *, const void *))strcmp);
 
   status = cf_util_get_string(ci, &host->name);
   if (status != 0) {
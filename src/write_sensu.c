@@ -41,6 +41,13 @@
 #define SENSU_HOST "localhost"
 #define SENSU_PORT "3030"
 
+#define SENSU_QUEUE_LIMIT 10000
+/* The client answers every check result immediately. The timeout only guards
+ * against clients that don't answer at all. */
+#define SENSU_REPLY_TIMEOUT 2
+#define SENSU_RETRY_MIN TIME_T_TO_CDTIME_T(1)
+#define SENSU_RETRY_MAX TIME_T_TO_CDTIME_T(60)
+
 #ifdef HAVE_ASPRINTF
 #define my_asprintf asprintf
 #define my_vasprintf vasprintf
@@ -99,6 +106,16 @@ struct str_list {
   char **strs;
 };
 
+typedef struct sensu_msg_s {
+  char *msg;
+  struct sensu_msg_s *next;
+} sensu_msg_t;
+
+/* Check results are formatted by the write and notification callbacks and
+ * queued. A per-node send thread writes them to a connection which is kept
+ * open, and reconnects with exponential backoff when the client is not
+ * reachable. The socket and the resolved address are only used by that
+ * thread. */
 struct sensu_host {
   char *name;
   char *event_service_prefix;
@@ -117,6 +134,17 @@ struct sensu_host {
   int s;
   struct addrinfo *res;
   int reference_count;
+
+  /* Protected by `lock'. */
+  sensu_msg_t *queue_head;
+  sensu_msg_t *queue_tail;
+  int queue_len;
+  int queue_limit;
+  uint64_t queue_dropped;
+  _Bool queue_quit;
+  pthread_cond_t queue_cond;
+  _Bool thread_running;
+  pthread_t thread;
 };
 
 static char *sensu_tags = NULL;
@@ -181,7 +209,6 @@ static int sensu_connect(struct sensu_host *host) /* {{{ */
     host->flags |= F_READY;
   }
 
-  struct linger so_linger;
   host->s = -1;
   for (struct addrinfo *ai = host->res; ai != NULL; ai = ai->ai_next) {
     // create the socket
@@ -190,12 +217,9 @@ static int sensu_connect(struct sensu_host *host) /* {{{ */
       continue;
     }
 
-    // Set very low close() lingering
-    so_linger.l_onoff = 1;
-    so_linger.l_linger = 3;
-    if (setsockopt(host->s, SOL_SOCKET, SO_LINGER, &so_linger,
-                   sizeof so_linger) != 0)
-      WARNING("write_sensu plugin: failed to set socket close() lingering");
+    struct timeval tv = {.tv_sec = SENSU_REPLY_TIMEOUT};
+    if (setsockopt(host->s, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) != 0)
+      WARNING("write_sensu plugin: failed to set the receive timeout");
 
     set_sock_opts(host->s);
 
@@ -865,36 +889,64 @@ static char *sensu_notification_to_json(struct sensu_host *host, /* {{{ */
   return ret_str;
 } /* }}} char *sensu_notification_to_json */
 
+/* Writes one check result to the persistent connection, connecting first if
+ * required, and waits for the client to acknowledge it. Results are not
+ * concatenated into one write: the client socket parses everything it has
+ * received as a single JSON document. */
 static int sensu_send_msg(struct sensu_host *host, const char *msg) /* {{{ */
 {
   int status = 0;
-  size_t buffer_len;
-
-  status = sensu_connect(host);
-  if (status != 0)
-    return status;
+  char reply[32];
+  ssize_t reply_len;
 
-  buffer_len = strlen(msg);
-
-  status = (int)swrite(host->s, msg, buffer_len);
-  sensu_close_socket(host);
+  if (host->s < 0) {
+    status = sensu_connect(host);
+    if (status != 0)
+      return status;
+  }
 
+  status = (int)swrite(host->s, msg, strlen(msg));
   if (status != 0) {
-    ERROR("write_sensu plugin: Sending to Sensu at %s:%s failed: %s",
-          (host->node != NULL) ? host->node : SENSU_HOST,
-          (host->service != NULL) ? host->service : SENSU_PORT, STRERRNO);
-    return -1;
+    status = errno;
+    sensu_close_socket(host);
+    return status;
+  }
+
+  reply_len = recv(host->s, reply, sizeof(reply) - 1, /* flags = */ 0);
+  if (reply_len <= 0) {
+    /* The result has been written, but the client closed the connection or
+     * didn't answer. Continue with a new connection. */
+    DEBUG("write_sensu plugin: No reply from the Sensu client, reconnecting.");
+    sensu_close_socket(host);
+    return 0;
   }
 
+  reply[reply_len] = 0;
+  if (strncmp("ok", reply, strlen("ok")) != 0)
+    WARNING("write_sensu plugin: The Sensu client at %s:%s rejected a check "
+            "result: %s",
+            (host->node != NULL) ? host->node : SENSU_HOST,
+            (host->service != NULL) ? host->service : SENSU_PORT, reply);
+
   return 0;
 } /* }}} int sensu_send_msg */
 
 static int sensu_send(struct sensu_host *host, char const *msg) /* {{{ */
 {
-  int status = 0;
+  _Bool reused = (host->s >= 0);
+  int status = sensu_send_msg(host, msg);
+
+  /* The client may have closed the connection while it was idle. Try once
+   * more with a new connection before giving up. */
+  if ((status != 0) && reused)
+    status = sensu_send_msg(host, msg);
 
-  status = sensu_send_msg(host, msg);
   if (status != 0) {
+    if (status > 0)
+      ERROR("write_sensu plugin: Sending to Sensu at %s:%s failed: %s",
+            (host->node != NULL) ? host->node : SENSU_HOST,
+            (host->service != NULL) ? host->service : SENSU_PORT,
+            STRERROR(status));
     host->flags &= ~F_READY;
     if (host->res != NULL) {
       freeaddrinfo(host->res);
@@ -906,6 +958,139 @@ static int sensu_send(struct sensu_host *host, char const *msg) /* {{{ */
   return 0;
 } /* }}} int sensu_send */
 
+static void sensu_msg_free(sensu_msg_t *m) /* {{{ */
+{
+  while (m != NULL) {
+    sensu_msg_t *next = m->next;
+    sfree(m->msg);
+    sfree(m);
+    m = next;
+  }
+} /* }}} void sensu_msg_free */
+
+static void *sensu_thread(void *arg) /* {{{ */
+{
+  struct sensu_host *host = arg;
+  cdtime_t retry_interval = SENSU_RETRY_MIN;
+
+  pthread_mutex_lock(&host->lock);
+  while (42) {
+    while ((host->queue_head == NULL) && !host->queue_quit)
+      pthread_cond_wait(&host->queue_cond, &host->lock);
+
+    if (host->queue_head == NULL)
+      break;
+
+    sensu_msg_t *batch = host->queue_head;
+    _Bool quit = host->queue_quit;
+    uint64_t dropped = host->queue_dropped;
+    host->queue_head = host->queue_tail = NULL;
+    host->queue_len = 0;
+    host->queue_dropped = 0;
+    pthread_mutex_unlock(&host->lock);
+
+    if (dropped > 0)
+      WARNING("write_sensu plugin: Node \"%s\": The queue was full, %" PRIu64
+              " check result(s) have been dropped.",
+              host->name, dropped);
+
+    while (batch != NULL) {
+      if (sensu_send(host, batch->msg) != 0)
+        break;
+
+      sensu_msg_t *next = batch->next;
+      batch->next = NULL;
+      sensu_msg_free(batch);
+      batch = next;
+    }
+
+    if (batch == NULL) {
+      retry_interval = SENSU_RETRY_MIN;
+      pthread_mutex_lock(&host->lock);
+      continue;
+    }
+
+    int unsent = 0;
+    sensu_msg_t *last = batch;
+    for (sensu_msg_t *m = batch; m != NULL; m = m->next) {
+      unsent++;
+      last = m;
+    }
+
+    if (quit) {
+      WARNING("write_sensu plugin: Node \"%s\": Dropping %d unsent check "
+              "result(s) on shutdown.",
+              host->name, unsent);
+      sensu_msg_free(batch);
+      pthread_mutex_lock(&host->lock);
+      continue;
+    }
+
+    /* Put the unsent results back in front of the queue and wait before
+     * connecting again. */
+    pthread_mutex_lock(&host->lock);
+    last->next = host->queue_head;
+    if (host->queue_tail == NULL)
+      host->queue_tail = last;
+    host->queue_head = batch;
+    host->queue_len += unsent;
+
+    cdtime_t until = cdtime() + retry_interval;
+    struct timespec ts = CDTIME_T_TO_TIMESPEC(until);
+    while (!host->queue_quit && (cdtime() < until))
+      pthread_cond_timedwait(&host->queue_cond, &host->lock, &ts);
+
+    retry_interval *= 2;
+    if (retry_interval > SENSU_RETRY_MAX)
+      retry_interval = SENSU_RETRY_MAX;
+  }
+  pthread_mutex_unlock(&host->lock);
+
+  sensu_close_socket(host);
+  return NULL;
+} /* }}} void *sensu_thread */
+
+/* Appends `msg' to the queue and takes ownership of it. The caller must hold
+ * `host->lock'. */
+static int sensu_enqueue(struct sensu_host *host, char *msg) /* {{{ */
+{
+  if (!host->thread_running) {
+    host->queue_quit = 0;
+    int status = plugin_thread_create(&host->thread, /* attr = */ NULL,
+                                      sensu_thread, host, "write_sensu");
+    if (status != 0) {
+      ERROR("write_sensu plugin: Starting the send thread failed.");
+      free(msg);
+      return -1;
+    }
+    host->thread_running = 1;
+  }
+
+  if (host->queue_len >= host->queue_limit) {
+    host->queue_dropped++;
+    free(msg);
+    return 0;
+  }
+
+  sensu_msg_t *m = calloc(1, sizeof(*m));
+  if (m == NULL) {
+    ERROR("write_sensu plugin: calloc failed.");
+    free(msg);
+    return ENOMEM;
+  }
+  m->msg = msg;
+
+  if (host->queue_tail == NULL)
+    host->queue_head = m;
+  else
+    host->queue_tail->next = m;
+  host->queue_tail = m;
+  host->queue_len++;
+
+  pthread_cond_signal(&host->queue_cond);
+  return 0;
+} /* }}} int sensu_enqueue */
+
 static int sensu_write(const data_set_t *ds, /* {{{ */
                        const value_list_t *vl, user_data_t *ud) {
   int status = 0;
@@ -932,10 +1117,8 @@ static int sensu_write(const data_set_t *ds, /* {{{ */
       pthread_mutex_unlock(&host->lock);
       return -1;
     }
-    status = sensu_send(host, msg);
-    free(msg);
+    status = sensu_enqueue(host, msg);
     if (status != 0) {
-      ERROR("write_sensu plugin: sensu_send failed with status %i", status);
       pthread_mutex_unlock(&host->lock);
       sfree(rates);
       return status;
@@ -961,10 +1144,7 @@ static int sensu_notification(const notification_t *n,
     return -1;
   }
 
-  status = sensu_send(host, msg);
-  free(msg);
-  if (status != 0)
-    ERROR("write_sensu plugin: sensu_send failed with status %i", status);
+  status = sensu_enqueue(host, msg);
   pthread_mutex_unlock(&host->lock);
 
   return status;
@@ -985,6 +1165,19 @@ static void sensu_free(void *p) /* {{{ */
     return;
   }
 
+  /* The thread sends what is still queued before it exits. Nobody else holds
+   * a reference, so the lock can be released while waiting for it. */
+  if (host->thread_running) {
+    host->queue_quit = 1;
+    pthread_cond_signal(&host->queue_cond);
+    pthread_mutex_unlock(&host->lock);
+    pthread_join(host->thread, NULL);
+    pthread_mutex_lock(&host->lock);
+    host->thread_running = 0;
+  }
+  sensu_msg_free(host->queue_head);
+  host->queue_head = host->queue_tail = NULL;
+
   sensu_close_socket(host);
   if (host->res != NULL) {
     freeaddrinfo(host->res);
@@ -1000,6 +1193,7 @@ static void sensu_free(void *p) /* {{{ */
 
   pthread_mutex_unlock(&host->lock);
   pthread_mutex_destroy(&host->lock);
+  pthread_cond_destroy(&host->queue_cond);
 
   sfree(host);
 } /* }}} void sensu_free */
@@ -1016,7 +1210,10 @@ static int sensu_config_node(oconfig_item_t *ci) /* {{{ */
     return ENOMEM;
   }
   pthread_mutex_init(&host->lock, NULL);
+  pthread_cond_init(&host->queue_cond, NULL);
   host->reference_count = 1;
+  host->s = -1;
+  host->queue_limit = SENSU_QUEUE_LIMIT;
   host->node = NULL;
   host->service = NULL;
   host->notifications = 0;
@@ -1099,6 +1296,15 @@ static int sensu_config_node(oconfig_item_t *ci) /* {{{ */
       status = cf_util_get_boolean(child, &host->always_append_ds);
       if (status != 0)
         break;
+    } else if (strcasecmp("QueueLimit", child->key) == 0) {
+      status = cf_util_get_int(child, &host->queue_limit);
+      if (status != 0)
+        break;
+      if (host->queue_limit < 1) {
+        ERROR("write_sensu plugin: \"QueueLimit\" must be at least 1.");
+        status = -1;
+        break;
+      }
     } else {
       WARNING("write_sensu plugin: ignoring unknown config "
               "option: \"%s\"",
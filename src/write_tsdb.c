@@ -46,6 +46,9 @@
 #include "common.h"
 #include "plugin.h"
 #include "utils_cache.h"
+#include "utils_compress.h"
+#include "utils_name_cache.h"
+#include "utils_output.h"
 #include "utils_random.h"
 
 #include <netdb.h>
@@ -67,13 +70,45 @@
 #define WT_SEND_BUF_SIZE 1428
 #endif
 
+#ifndef WT_DEFAULT_BACKLOG_SIZE
+#define WT_DEFAULT_BACKLOG_SIZE (1024 * 1024)
+#endif
+
+/* Number of metric names cached per node. */
+#ifndef WT_NAME_CACHE_SIZE
+#define WT_NAME_CACHE_SIZE 131072
+#endif
+
+/* Defaults of the HTTP protocol, see wt_http_send(). */
+#define WT_HTTP_PATH "/api/put"
+#define WT_HTTP_DEFAULT_BATCH_SIZE 5000
+#define WT_HTTP_DEFAULT_BATCH_LINGER TIME_T_TO_CDTIME_T_STATIC(1)
+#define WT_HTTP_DEFAULT_THREADS 4
+#define WT_HTTP_DEFAULT_QUEUE_LIMIT 64
+#define WT_HTTP_DEFAULT_MAX_RETRIES 3
+#define WT_HTTP_TIMEOUT_SEC 10
+/* A failed batch is retried after 100ms, 200ms, 400ms, ..., at most 5s. */
+#define WT_HTTP_RETRY_DELAY_MS 100
+#define WT_HTTP_RETRY_DELAY_MAX_MS 5000
+
+/* A JSON array of data points for the HTTP API. */
+struct wt_batch {
+  char *data;
+  size_t size;
+  size_t fill;
+  size_t points_num;
+  cdtime_t start;
+  int retries;
+  struct wt_batch *next;
+};
+typedef struct wt_batch wt_batch_t;
+
 /*
  * Private variables
  */
 struct wt_callback {
   struct addrinfo *ai;
   cdtime_t ai_last_update;
-  int sock_fd;
 
   char *node;
   char *service;
@@ -82,16 +117,45 @@ struct wt_callback {
   _Bool store_rates;
   _Bool always_append_ds;
 
-  char send_buf[WT_SEND_BUF_SIZE];
-  size_t send_buf_free;
-  size_t send_buf_fill;
-  cdtime_t send_buf_init_time;
+  name_cache_t *name_cache;
+
+  /* With the Telnet protocol, lines are sent by "output", which connects
+   * with wt_connect() on its sender thread. */
+  size_t send_buf_size;
+  size_t backlog_size;
+  _Bool report_stats;
+  output_t *output;
 
   pthread_mutex_t send_lock;
 
   _Bool connect_failed_log_enabled;
   int connect_dns_failed_attempts_remaining;
   cdtime_t next_random_ttl;
+
+  /* With the HTTP protocol, data points are collected in "batch" (protected
+   * by send_lock) and full batches are queued for the sender threads, each
+   * of which has its own connection. The address information above is
+   * protected by ai_lock. */
+  _Bool http;
+  char *http_host_tags; /* HostTags as JSON members */
+  size_t batch_size;
+  cdtime_t batch_linger;
+  compress_method_t compression;
+  size_t max_retries;
+  wt_batch_t *batch;
+
+  pthread_mutex_t ai_lock;
+  pthread_mutex_t queue_lock;
+  pthread_cond_t queue_cond;
+  wt_batch_t *queue_head;
+  wt_batch_t *queue_tail;
+  size_t queue_len;
+  size_t queue_limit;
+  _Bool queue_shutdown;
+  pthread_t *threads;
+  size_t threads_num;
+  size_t threads_running;
+  _Bool threads_started;
 };
 
 static cdtime_t resolve_interval = 0;
@@ -100,58 +164,6 @@ static cdtime_t resolve_jitter = 0;
 /*
  * Functions
  */
-static void wt_reset_buffer(struct wt_callback *cb) {
-  memset(cb->send_buf, 0, sizeof(cb->send_buf));
-  cb->send_buf_free = sizeof(cb->send_buf);
-  cb->send_buf_fill = 0;
-  cb->send_buf_init_time = cdtime();
-}
-
-static int wt_send_buffer(struct wt_callback *cb) {
-  ssize_t status = 0;
-
-  status = swrite(cb->sock_fd, cb->send_buf, strlen(cb->send_buf));
-  if (status != 0) {
-    ERROR("write_tsdb plugin: send failed with status %zi (%s)", status,
-          STRERRNO);
-
-    close(cb->sock_fd);
-    cb->sock_fd = -1;
-
-    return -1;
-  }
-
-  return 0;
-}
-
-/* NOTE: You must hold cb->send_lock when calling this function! */
-static int wt_flush_nolock(cdtime_t timeout, struct wt_callback *cb) {
-  int status;
-
-  DEBUG("write_tsdb plugin: wt_flush_nolock: timeout = %.3f; "
-        "send_buf_fill = %" PRIsz ";",
-        (double)timeout, cb->send_buf_fill);
-
-  /* timeout == 0  => flush unconditionally */
-  if (timeout > 0) {
-    cdtime_t now;
-
-    now = cdtime();
-    if ((cb->send_buf_init_time + timeout) > now)
-      return 0;
-  }
-
-  if (cb->send_buf_fill == 0) {
-    cb->send_buf_init_time = cdtime();
-    return 0;
-  }
-
-  status = wt_send_buffer(cb);
-  wt_reset_buffer(cb);
-
-  return status;
-}
-
 static cdtime_t new_random_ttl() {
   if (resolve_jitter == 0)
     return 0;
@@ -159,16 +171,15 @@ static cdtime_t new_random_ttl() {
   return (cdtime_t)cdrand_range(0, (long)resolve_jitter);
 }
 
-static int wt_callback_init(struct wt_callback *cb) {
+/* Connects to the TSD, using the cached address information if possible. */
+static int wt_connect(struct wt_callback *cb, int *ret_fd) {
   int status;
   cdtime_t now;
+  int fd = -1;
 
   const char *node = cb->node ? cb->node : WT_DEFAULT_NODE;
   const char *service = cb->service ? cb->service : WT_DEFAULT_SERVICE;
 
-  if (cb->sock_fd > 0)
-    return 0;
-
   now = cdtime();
   if (cb->ai) {
     /* When we are here, we still have the IP in cache.
@@ -180,9 +191,8 @@ static int wt_callback_init(struct wt_callback *cb) {
     if ((cb->ai_last_update + resolve_interval + cb->next_random_ttl) < now) {
       cb->next_random_ttl = new_random_ttl();
       if (cb->connect_dns_failed_attempts_remaining > 0) {
-        /* Warning : this is run under send_lock mutex.
-         * This is why we do not use another mutex here.
-         * */
+        /* Warning : this is run under ai_lock. This is why we do not use
+         * another mutex here. */
         cb->ai_last_update = now;
         cb->connect_dns_failed_attempts_remaining--;
       } else {
@@ -224,23 +234,23 @@ static int wt_callback_init(struct wt_callback *cb) {
 
   assert(cb->ai != NULL);
   for (struct addrinfo *ai = cb->ai; ai != NULL; ai = ai->ai_next) {
-    cb->sock_fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
-    if (cb->sock_fd < 0)
+    fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (fd < 0)
       continue;
 
-    set_sock_opts(cb->sock_fd);
+    set_sock_opts(fd);
 
-    status = connect(cb->sock_fd, ai->ai_addr, ai->ai_addrlen);
+    status = connect(fd, ai->ai_addr, ai->ai_addrlen);
     if (status != 0) {
-      close(cb->sock_fd);
-      cb->sock_fd = -1;
+      close(fd);
+      fd = -1;
       continue;
     }
 
     break;
   }
 
-  if (cb->sock_fd < 0) {
+  if (fd < 0) {
     ERROR("write_tsdb plugin: Connecting to %s:%s failed. "
           "The last error was: %s",
           node, service, STRERRNO);
@@ -253,11 +263,485 @@ static int wt_callback_init(struct wt_callback *cb) {
   }
   cb->connect_dns_failed_attempts_remaining = 1;
 
-  wt_reset_buffer(cb);
+  *ret_fd = fd;
+  return 0;
+}
+
+/* Connects the output of the Telnet protocol. Called on its sender thread. */
+static int wt_output_connect(void *arg) {
+  struct wt_callback *cb = arg;
+  int fd = -1;
+
+  pthread_mutex_lock(&cb->ai_lock);
+  int status = wt_connect(cb, &fd);
+  pthread_mutex_unlock(&cb->ai_lock);
+
+  return (status == 0) ? fd : -1;
+}
+
+static int wt_batch_reserve(wt_batch_t *b, size_t len) {
+  if (b->fill + len < b->size)
+    return 0;
+
+  size_t size = (b->size > 0) ? b->size : 4096;
+  while (b->fill + len >= size)
+    size *= 2;
+
+  char *tmp = realloc(b->data, size);
+  if (tmp == NULL)
+    return ENOMEM;
+  b->data = tmp;
+  b->size = size;
 
   return 0;
 }
 
+static int wt_batch_append(wt_batch_t *b, const char *str, size_t len) {
+  if (wt_batch_reserve(b, len) != 0)
+    return ENOMEM;
+
+  memcpy(b->data + b->fill, str, len);
+  b->fill += len;
+  b->data[b->fill] = 0;
+  return 0;
+}
+
+/* Appends a JSON string, escaping quotes, backslashes and control
+ * characters. */
+static int wt_batch_append_string(wt_batch_t *b, const char *str,
+                                  size_t len) {
+  if (wt_batch_reserve(b, 2 + 6 * len) != 0)
+    return ENOMEM;
+
+  b->data[b->fill++] = '"';
+  for (size_t i = 0; i < len; i++) {
+    unsigned char c = (unsigned char)str[i];
+
+    if ((c == '"') || (c == '\\')) {
+      b->data[b->fill++] = '\\';
+      b->data[b->fill++] = (char)c;
+    } else if (c < 0x20) {
+      b->fill += (size_t)snprintf(b->data + b->fill, b->size - b->fill,
+                                  "\\u%04x", c);
+    } else {
+      b->data[b->fill++] = (char)c;
+    }
+  }
+  b->data[b->fill++] = '"';
+  b->data[b->fill] = 0;
+
+  return 0;
+}
+
+/* Converts "name=value name=value" tags as used by the line protocol to JSON
+ * object members, each preceded by a comma. */
+static int wt_batch_append_tags(wt_batch_t *b, const char *tags) {
+  const char *ptr = tags;
+
+  while (*ptr != 0) {
+    while (isspace((unsigned char)*ptr))
+      ptr++;
+    size_t len = 0;
+    while ((ptr[len] != 0) && !isspace((unsigned char)ptr[len]))
+      len++;
+    if (len == 0)
+      break;
+
+    const char *eq = memchr(ptr, '=', len);
+    if ((eq != NULL) && (eq != ptr)) {
+      if ((wt_batch_append(b, ",", 1) != 0) ||
+          (wt_batch_append_string(b, ptr, (size_t)(eq - ptr)) != 0) ||
+          (wt_batch_append(b, ":", 1) != 0) ||
+          (wt_batch_append_string(b, eq + 1, len - (size_t)(eq - ptr) - 1) !=
+           0))
+        return ENOMEM;
+    }
+    ptr += len;
+  }
+
+  return 0;
+}
+
+static void wt_batch_free(wt_batch_t *b) {
+  if (b == NULL)
+    return;
+  sfree(b->data);
+  sfree(b);
+}
+
+static void *wt_http_thread(void *arg);
+
+/* Queues the current batch for the sender threads, which are started by the
+ * first batch. If the queue is full, the oldest batch is dropped. Must be
+ * called with cb->send_lock held. */
+static int wt_http_enqueue(struct wt_callback *cb) {
+  wt_batch_t *b = cb->batch;
+  wt_batch_t *dropped = NULL;
+
+  if ((b == NULL) || (b->points_num == 0))
+    return 0;
+
+  if (wt_batch_append(b, "]", 1) != 0)
+    return ENOMEM;
+  cb->batch = NULL;
+
+  pthread_mutex_lock(&cb->queue_lock);
+  if (!cb->threads_started) {
+    cb->threads_started = 1;
+    for (size_t i = 0; i < cb->threads_num; i++) {
+      int status = plugin_thread_create(cb->threads + i, /* attr = */ NULL,
+                                        wt_http_thread, cb, "write_tsdb");
+      if (status != 0) {
+        ERROR("write_tsdb plugin: Starting a sender thread failed: %s",
+              STRERROR(status));
+        break;
+      }
+      cb->threads_running++;
+    }
+  }
+
+  if (cb->queue_len >= cb->queue_limit) {
+    dropped = cb->queue_head;
+    cb->queue_head = dropped->next;
+    if (cb->queue_head == NULL)
+      cb->queue_tail = NULL;
+    cb->queue_len--;
+  }
+
+  b->next = NULL;
+  if (cb->queue_tail == NULL)
+    cb->queue_head = b;
+  else
+    cb->queue_tail->next = b;
+  cb->queue_tail = b;
+  cb->queue_len++;
+
+  pthread_cond_signal(&cb->queue_cond);
+  pthread_mutex_unlock(&cb->queue_lock);
+
+  if (dropped != NULL) {
+    WARNING("write_tsdb plugin: [%s]:%s: The send queue is full. Dropping "
+            "%" PRIsz " data points.",
+            cb->node, cb->service, dropped->points_num);
+    wt_batch_free(dropped);
+  }
+
+  return 0;
+}
+
+/* Adds one data point to the current batch. Must be called with
+ * cb->send_lock held. */
+static int wt_http_add(struct wt_callback *cb, const char *key,
+                       const char *value, cdtime_t time, const char *host,
+                       const char *tags) {
+  char buffer[64];
+
+  /* JSON has no representation of infinity. */
+  if (strchr(value, 'i') != NULL)
+    return 0;
+
+  if (cb->batch == NULL) {
+    cb->batch = calloc(1, sizeof(*cb->batch));
+    if ((cb->batch == NULL) || (wt_batch_append(cb->batch, "[", 1) != 0)) {
+      ERROR("write_tsdb plugin: Allocating a batch failed.");
+      wt_batch_free(cb->batch);
+      cb->batch = NULL;
+      return ENOMEM;
+    }
+    cb->batch->start = cdtime();
+  }
+
+  wt_batch_t *b = cb->batch;
+  size_t fill = b->fill;
+  int status = 0;
+
+  snprintf(buffer, sizeof(buffer), ",\"timestamp\":%.0f,\"value\":",
+           CDTIME_T_TO_DOUBLE(time));
+
+  if (b->points_num > 0)
+    status |= wt_batch_append(b, ",", 1);
+  status |= wt_batch_append(b, "{\"metric\":", strlen("{\"metric\":"));
+  status |= wt_batch_append_string(b, key, strlen(key));
+  status |= wt_batch_append(b, buffer, strlen(buffer));
+  status |= wt_batch_append(b, value, strlen(value));
+  status |= wt_batch_append(b, ",\"tags\":{\"fqdn\":", strlen(",\"tags\":{\"fqdn\":"));
+  status |= wt_batch_append_string(b, host, strlen(host));
+  status |= wt_batch_append_tags(b, tags);
+  if (cb->http_host_tags != NULL)
+    status |= wt_batch_append(b, cb->http_host_tags,
+                              strlen(cb->http_host_tags));
+  status |= wt_batch_append(b, "}}", 2);
+  if (status != 0) {
+    ERROR("write_tsdb plugin: Adding a data point to the batch failed.");
+    b->fill = fill;
+    b->data[fill] = 0;
+    return ENOMEM;
+  }
+  b->points_num++;
+
+  if (b->points_num >= cb->batch_size)
+    return wt_http_enqueue(cb);
+
+  return 0;
+}
+
+/* Reads the response to a request. Returns the HTTP status code or a negative
+ * value if no valid response was received. "*ret_close" is set if the
+ * connection cannot be reused. The beginning of the body is copied to
+ * "body". */
+static int wt_http_read_response(int fd, _Bool *ret_close, char *body,
+                                 size_t body_size) {
+  char buffer[4096];
+  size_t fill = 0;
+  char *end = NULL;
+
+  body[0] = 0;
+
+  while (end == NULL) {
+    if (fill >= sizeof(buffer) - 1)
+      return -1;
+    ssize_t n = read(fd, buffer + fill, sizeof(buffer) - 1 - fill);
+    if (n <= 0) {
+      if ((n < 0) && (errno == EINTR))
+        continue;
+      return -1;
+    }
+    fill += (size_t)n;
+    buffer[fill] = 0;
+    end = strstr(buffer, "\r\n\r\n");
+  }
+  *end = 0;
+  char *payload = end + strlen("\r\n\r\n");
+  size_t payload_len = fill - (size_t)(payload - buffer);
+
+  int code = 0;
+  if ((sscanf(buffer, "HTTP/%*d.%*d %d", &code) != 1) || (code < 100))
+    return -1;
+
+  long content_length = -1;
+  _Bool close_requested = 0;
+  char *saveptr = NULL;
+  for (char *line = strtok_r(buffer, "\r\n", &saveptr); line != NULL;
+       line = strtok_r(NULL, "\r\n", &saveptr)) {
+    if (strncasecmp("Content-Length:", line, strlen("Content-Length:")) == 0)
+      content_length = atol(line + strlen("Content-Length:"));
+    else if (strncasecmp("Connection:", line, strlen("Connection:")) == 0) {
+      char const *value = line + strlen("Connection:");
+      while (isspace((unsigned char)*value))
+        value++;
+      if (strncasecmp("close", value, strlen("close")) == 0)
+        close_requested = 1;
+    }
+  }
+
+  /* Without a length, the end of the body cannot be found. */
+  if ((content_length < 0) && (code != 204) && (code != 304))
+    close_requested = 1;
+  if (content_length < 0)
+    content_length = 0;
+
+  size_t copy = (payload_len < body_size - 1) ? payload_len : body_size - 1;
+  memcpy(body, payload, copy);
+  body[copy] = 0;
+
+  /* Discard the rest of the body. */
+  size_t remaining = ((size_t)content_length > payload_len)
+                         ? (size_t)content_length - payload_len
+                         : 0;
+  while (remaining > 0) {
+    ssize_t n = read(fd, buffer,
+                     (remaining < sizeof(buffer)) ? remaining : sizeof(buffer));
+    if (n <= 0) {
+      if ((n < 0) && (errno == EINTR))
+        continue;
+      close_requested = 1;
+      break;
+    }
+    remaining -= (size_t)n;
+  }
+
+  *ret_close = close_requested;
+  return code;
+}
+
+/* Posts a batch to the TSD. Returns zero upon success, a positive value if
+ * the request should be retried and a negative value if the TSD rejected
+ * it. */
+static int wt_http_send(struct wt_callback *cb, int *fd, compress_t *c,
+                        wt_batch_t *b) {
+  const char *node = cb->node ? cb->node : WT_DEFAULT_NODE;
+  const char *service = cb->service ? cb->service : WT_DEFAULT_SERVICE;
+  char const *encoding = NULL;
+  void const *body = b->data;
+  size_t body_len = b->fill;
+  char header[512];
+  char response[512];
+  int code = -1;
+
+  if (c != NULL) {
+    void const *out = NULL;
+    size_t out_len = 0;
+    int status = compress_buffer(c, b->data, b->fill, &out, &out_len);
+    if (status == 0) {
+      body = out;
+      body_len = out_len;
+      encoding = compress_encoding(cb->compression);
+    } else {
+      WARNING("write_tsdb plugin: Compressing the request failed: %s",
+              STRERROR(status));
+    }
+  }
+
+  snprintf(header, sizeof(header),
+           "POST " WT_HTTP_PATH " HTTP/1.1\r\n"
+           "Host: %s:%s\r\n"
+           "Content-Type: application/json\r\n"
+           "Content-Length: %" PRIsz "\r\n"
+           "%s%s%s"
+           "\r\n",
+           node, service, body_len, (encoding != NULL) ? "Content-Encoding: " : "",
+           (encoding != NULL) ? encoding : "", (encoding != NULL) ? "\r\n" : "");
+
+  /* A connection kept alive may have been closed by the TSD in the
+   * meantime, so a failure on a reused connection gets a second chance. */
+  for (int attempt = 0; attempt < 2; attempt++) {
+    _Bool reused = (*fd >= 0);
+
+    if (*fd < 0) {
+      pthread_mutex_lock(&cb->ai_lock);
+      int status = wt_connect(cb, fd);
+      pthread_mutex_unlock(&cb->ai_lock);
+      if (status != 0)
+        return 1;
+
+      struct timeval tv = {.tv_sec = WT_HTTP_TIMEOUT_SEC};
+      setsockopt(*fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+      setsockopt(*fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    }
+
+    _Bool must_close = 1;
+    if ((swrite(*fd, header, strlen(header)) == 0) &&
+        (swrite(*fd, body, body_len) == 0))
+      code = wt_http_read_response(*fd, &must_close, response,
+                                   sizeof(response));
+
+    if ((code < 0) || must_close) {
+      close(*fd);
+      *fd = -1;
+    }
+    if (code >= 0)
+      break;
+    if (!reused) {
+      ERROR("write_tsdb plugin: [%s]:%s: Sending %" PRIsz
+            " data points failed.",
+            node, service, b->points_num);
+      return 1;
+    }
+  }
+  if (code < 0)
+    return 1;
+
+  if ((code >= 200) && (code < 300))
+    return 0;
+
+  /* Client errors other than timeouts and throttling will not go away. */
+  _Bool retry = (code >= 500) || (code == 408) || (code == 429);
+  ERROR("write_tsdb plugin: [%s]:%s: The TSD responded with status %d to "
+        "%" PRIsz " data points%s: %s",
+        node, service, code, b->points_num, retry ? "" : ", dropping them",
+        response);
+  return retry ? 1 : -1;
+}
+
+static void *wt_http_thread(void *arg) {
+  struct wt_callback *cb = arg;
+  compress_t *c = NULL;
+  int fd = -1;
+
+  if (cb->compression != COMPRESS_NONE) {
+    c = compress_create(cb->compression, /* size_hint = */ 0);
+    if (c == NULL)
+      ERROR("write_tsdb plugin: compress_create failed. The thread will send "
+            "uncompressed requests.");
+  }
+
+  pthread_mutex_lock(&cb->queue_lock);
+  while (42) {
+    while ((cb->queue_head == NULL) && !cb->queue_shutdown)
+      pthread_cond_wait(&cb->queue_cond, &cb->queue_lock);
+    if (cb->queue_head == NULL)
+      break;
+
+    wt_batch_t *b = cb->queue_head;
+    cb->queue_head = b->next;
+    if (cb->queue_head == NULL)
+      cb->queue_tail = NULL;
+    cb->queue_len--;
+    pthread_mutex_unlock(&cb->queue_lock);
+
+    int status = wt_http_send(cb, &fd, c, b);
+
+    pthread_mutex_lock(&cb->queue_lock);
+    /* Upon shutdown, every batch is only tried once more. */
+    if ((status > 0) && !cb->queue_shutdown &&
+        ((size_t)b->retries < cb->max_retries)) {
+      long delay_ms = WT_HTTP_RETRY_DELAY_MS << b->retries;
+      if (delay_ms > WT_HTTP_RETRY_DELAY_MAX_MS)
+        delay_ms = WT_HTTP_RETRY_DELAY_MAX_MS;
+      b->retries++;
+      pthread_mutex_unlock(&cb->queue_lock);
+
+      nanosleep(&CDTIME_T_TO_TIMESPEC(MS_TO_CDTIME_T(delay_ms)), NULL);
+
+      pthread_mutex_lock(&cb->queue_lock);
+      b->next = cb->queue_head;
+      cb->queue_head = b;
+      if (cb->queue_tail == NULL)
+        cb->queue_tail = b;
+      cb->queue_len++;
+      continue;
+    }
+
+    if (status > 0)
+      ERROR("write_tsdb plugin: [%s]:%s: Giving up on %" PRIsz
+            " data points after %d retries.",
+            cb->node, cb->service, b->points_num, b->retries);
+    wt_batch_free(b);
+  }
+  pthread_mutex_unlock(&cb->queue_lock);
+
+  if (fd >= 0)
+    close(fd);
+  compress_destroy(c);
+  return NULL;
+}
+
+/* Sends the pending batches and stops the sender threads. */
+static void wt_http_shutdown(struct wt_callback *cb) {
+  pthread_mutex_lock(&cb->send_lock);
+  wt_http_enqueue(cb);
+  pthread_mutex_unlock(&cb->send_lock);
+
+  pthread_mutex_lock(&cb->queue_lock);
+  cb->queue_shutdown = 1;
+  pthread_cond_broadcast(&cb->queue_cond);
+  pthread_mutex_unlock(&cb->queue_lock);
+
+  for (size_t i = 0; i < cb->threads_running; i++)
+    pthread_join(cb->threads[i], NULL);
+
+  while (cb->queue_head != NULL) {
+    wt_batch_t *b = cb->queue_head;
+    cb->queue_head = b->next;
+    wt_batch_free(b);
+  }
+  cb->queue_tail = NULL;
+  cb->queue_len = 0;
+
+  wt_batch_free(cb->batch);
+  cb->batch = NULL;
+}
+
 static void wt_callback_free(void *data) {
   struct wt_callback *cb;
 
@@ -266,19 +750,30 @@ static void wt_callback_free(void *data) {
 
   cb = data;
 
-  pthread_mutex_lock(&cb->send_lock);
+  if (cb->http)
+    wt_http_shutdown(cb);
 
-  wt_flush_nolock(0, cb);
+  /* Sends what is still buffered. */
+  output_destroy(cb->output);
 
-  close(cb->sock_fd);
-  cb->sock_fd = -1;
+  pthread_mutex_lock(&cb->send_lock);
 
   sfree(cb->node);
   sfree(cb->service);
   sfree(cb->host_tags);
+  sfree(cb->http_host_tags);
+  sfree(cb->threads);
+
+  name_cache_destroy(cb->name_cache);
+
+  if (cb->ai != NULL)
+    freeaddrinfo(cb->ai);
 
   pthread_mutex_unlock(&cb->send_lock);
   pthread_mutex_destroy(&cb->send_lock);
+  pthread_mutex_destroy(&cb->ai_lock);
+  pthread_mutex_destroy(&cb->queue_lock);
+  pthread_cond_destroy(&cb->queue_cond);
 
   sfree(cb);
 }
@@ -294,23 +789,36 @@ static int wt_flush(cdtime_t timeout,
 
   cb = user_data->data;
 
-  pthread_mutex_lock(&cb->send_lock);
-
-  if (cb->sock_fd < 0) {
-    status = wt_callback_init(cb);
-    if (status != 0) {
-      ERROR("write_tsdb plugin: wt_callback_init failed.");
-      pthread_mutex_unlock(&cb->send_lock);
-      return -1;
-    }
+  if (!cb->http) {
+    /* Queues the buffers for sending and returns without waiting for them. */
+    output_flush(cb->output, timeout);
+    return 0;
   }
 
-  status = wt_flush_nolock(timeout, cb);
+  pthread_mutex_lock(&cb->send_lock);
+  status = 0;
+  if ((cb->batch != NULL) &&
+      ((timeout == 0) || ((cb->batch->start + timeout) <= cdtime())))
+    status = wt_http_enqueue(cb);
   pthread_mutex_unlock(&cb->send_lock);
 
   return status;
 }
 
+/* wt_read queues batches which have been waiting for longer than the linger
+ * time, so that the values of an idle node are not held back, and dispatches
+ * the statistics of the Telnet connection. */
+static int wt_read(user_data_t *user_data) {
+  struct wt_callback *cb = user_data->data;
+
+  if (cb->http)
+    return wt_flush(cb->batch_linger, /* identifier = */ NULL, user_data);
+
+  output_submit_stats(cb->output, "write_tsdb",
+                      cb->node != NULL ? cb->node : WT_DEFAULT_NODE);
+  return 0;
+}
+
 static int wt_format_values(char *ret, size_t ret_len, int ds_num,
                             const data_set_t *ds, const value_list_t *vl,
                             _Bool store_rates) {
@@ -365,25 +873,8 @@ static int wt_format_values(char *ret, size_t ret_len, int ds_num,
   return 0;
 }
 
-static int wt_format_name(char *ret, int ret_len, const value_list_t *vl,
-                          const struct wt_callback *cb, const char *ds_name) {
-  int status;
-  char *temp = NULL;
-  const char *prefix = "";
-  const char *meta_prefix = "tsdb_prefix";
-
-  if (vl->meta) {
-    status = meta_data_get_string(vl->meta, meta_prefix, &temp);
-    if (status == -ENOENT) {
-      /* defaults to empty string */
-    } else if (status < 0) {
-      sfree(temp);
-      return status;
-    } else {
-      prefix = temp;
-    }
-  }
-
+static void wt_format_name(char *ret, int ret_len, const value_list_t *vl,
+                           const char *prefix, const char *ds_name) {
   if (ds_name != NULL) {
     if (vl->plugin_instance[0] == '\0') {
       if (vl->type_instance[0] == '\0') {
@@ -420,9 +911,6 @@ static int wt_format_name(char *ret, int ret_len, const value_list_t *vl,
       }
     }
   }
-
-  sfree(temp);
-  return 0;
 }
 
 static int wt_send_message(const char *key, const char *value, cdtime_t time,
@@ -447,13 +935,20 @@ static int wt_send_message(const char *key, const char *value, cdtime_t time,
     } else if (status < 0) {
       ERROR("write_tsdb plugin: tags metadata get failure");
       sfree(temp);
-      pthread_mutex_unlock(&cb->send_lock);
       return status;
     } else {
       tags = temp;
     }
   }
 
+  if (cb->http) {
+    pthread_mutex_lock(&cb->send_lock);
+    status = wt_http_add(cb, key, value, time, host, tags);
+    pthread_mutex_unlock(&cb->send_lock);
+    sfree(temp);
+    return status;
+  }
+
   status =
       snprintf(message, sizeof(message), "put %s %.0f %s fqdn=%s %s %s\r\n",
                key, CDTIME_T_TO_DOUBLE(time), value, host, tags, host_tags);
@@ -469,41 +964,14 @@ static int wt_send_message(const char *key, const char *value, cdtime_t time,
     return -1;
   }
 
-  pthread_mutex_lock(&cb->send_lock);
-
-  if (cb->sock_fd < 0) {
-    status = wt_callback_init(cb);
-    if (status != 0) {
-      ERROR("write_tsdb plugin: wt_callback_init failed.");
-      pthread_mutex_unlock(&cb->send_lock);
-      return -1;
-    }
-  }
-
-  if (message_len >= cb->send_buf_free) {
-    status = wt_flush_nolock(0, cb);
-    if (status != 0) {
-      pthread_mutex_unlock(&cb->send_lock);
-      return status;
-    }
+  status = output_write(cb->output, /* key = */ 0, message, message_len);
+  if (status != 0) {
+    ERROR("write_tsdb plugin: Queueing the message failed: %s",
+          STRERROR(status));
+    return -1;
   }
 
-  /* Assert that we have enough space for this message. */
-  assert(message_len < cb->send_buf_free);
-
-  /* `message_len + 1' because `message_len' does not include the
-   * trailing null byte. Neither does `send_buffer_fill'. */
-  memcpy(cb->send_buf + cb->send_buf_fill, message, message_len + 1);
-  cb->send_buf_fill += message_len;
-  cb->send_buf_free -= message_len;
-
-  DEBUG("write_tsdb plugin: [%s]:%s buf %" PRIsz "/%" PRIsz " (%.1f %%) \"%s\"",
-        cb->node, cb->service, cb->send_buf_fill, sizeof(cb->send_buf),
-        100.0 * ((double)cb->send_buf_fill) / ((double)sizeof(cb->send_buf)),
-        message);
-
-  pthread_mutex_unlock(&cb->send_lock);
-
+  DEBUG("write_tsdb plugin: [%s]:%s \"%s\"", cb->node, cb->service, message);
   return 0;
 }
 
@@ -511,6 +979,9 @@ static int wt_write_messages(const data_set_t *ds, const value_list_t *vl,
                              struct wt_callback *cb) {
   char key[10 * DATA_MAX_NAME_LEN];
   char values[512];
+  char *temp = NULL;
+  const char *prefix = "";
+  const char *meta_prefix = "tsdb_prefix";
 
   int status;
 
@@ -520,20 +991,41 @@ static int wt_write_messages(const data_set_t *ds, const value_list_t *vl,
     return -1;
   }
 
+  if (vl->meta) {
+    status = meta_data_get_string(vl->meta, meta_prefix, &temp);
+    if (status == -ENOENT) {
+      /* defaults to empty string */
+    } else if (status < 0) {
+      ERROR("write_tsdb plugin: error with format_name");
+      sfree(temp);
+      return status;
+    } else {
+      prefix = temp;
+    }
+  }
+
+  /* The names are cached by identity, prefix and data source name, so
+   * repeated value lists only need their values formatted. */
+  value_list_identity_t const *identity = VALUE_LIST_IDENTITY(vl);
+  uint64_t prefix_key = name_cache_key(NAME_CACHE_KEY_INIT, prefix);
+
   for (size_t i = 0; i < ds->ds_num; i++) {
     const char *ds_name = NULL;
 
     if (cb->always_append_ds || (ds->ds_num > 1))
       ds_name = ds->ds[i].name;
 
-    /* Copy the identifier to 'key' and escape it. */
-    status = wt_format_name(key, sizeof(key), vl, cb, ds_name);
-    if (status != 0) {
-      ERROR("write_tsdb plugin: error with format_name");
-      return status;
+    uint64_t name_key = name_cache_key(prefix_key, ds_name);
+    if ((identity == NULL) ||
+        (name_cache_get(cb->name_cache, identity, name_key, key,
+                        sizeof(key)) != 0)) {
+      /* Copy the identifier to 'key' and escape it. */
+      wt_format_name(key, sizeof(key), vl, prefix, ds_name);
+      escape_string(key, sizeof(key));
+      if (identity != NULL)
+        name_cache_set(cb->name_cache, identity, name_key, key);
     }
 
-    escape_string(key, sizeof(key));
     /* Convert the values to an ASCII representation and put that into
      * 'values'. */
     status =
@@ -541,6 +1033,7 @@ static int wt_write_messages(const data_set_t *ds, const value_list_t *vl,
     if (status != 0) {
       ERROR("write_tsdb plugin: error with "
             "wt_format_values");
+      sfree(temp);
       return status;
     }
 
@@ -549,10 +1042,12 @@ static int wt_write_messages(const data_set_t *ds, const value_list_t *vl,
     if (status != 0) {
       ERROR("write_tsdb plugin: error with "
             "wt_send_message");
+      sfree(temp);
       return status;
     }
   }
 
+  sfree(temp);
   return 0;
 }
 
@@ -580,11 +1075,24 @@ static int wt_config_tsd(oconfig_item_t *ci) {
     ERROR("write_tsdb plugin: calloc failed.");
     return -1;
   }
-  cb->sock_fd = -1;
   cb->connect_failed_log_enabled = 1;
   cb->next_random_ttl = new_random_ttl();
+  /* Without the cache, names are formatted every time. */
+  cb->name_cache = name_cache_create(WT_NAME_CACHE_SIZE);
+
+  cb->batch_size = WT_HTTP_DEFAULT_BATCH_SIZE;
+  cb->batch_linger = WT_HTTP_DEFAULT_BATCH_LINGER;
+  cb->compression = COMPRESS_NONE;
+  cb->max_retries = WT_HTTP_DEFAULT_MAX_RETRIES;
+  cb->queue_limit = WT_HTTP_DEFAULT_QUEUE_LIMIT;
+  cb->threads_num = WT_HTTP_DEFAULT_THREADS;
+  cb->send_buf_size = WT_SEND_BUF_SIZE;
+  cb->backlog_size = WT_DEFAULT_BACKLOG_SIZE;
 
   pthread_mutex_init(&cb->send_lock, NULL);
+  pthread_mutex_init(&cb->ai_lock, NULL);
+  pthread_mutex_init(&cb->queue_lock, NULL);
+  pthread_cond_init(&cb->queue_cond, NULL);
 
   for (int i = 0; i < ci->children_num; i++) {
     oconfig_item_t *child = ci->children + i;
@@ -599,7 +1107,56 @@ static int wt_config_tsd(oconfig_item_t *ci) {
       cf_util_get_boolean(child, &cb->store_rates);
     else if (strcasecmp("AlwaysAppendDS", child->key) == 0)
       cf_util_get_boolean(child, &cb->always_append_ds);
-    else {
+    else if (strcasecmp("Protocol", child->key) == 0) {
+      char protocol[16];
+      if (cf_util_get_string_buffer(child, protocol, sizeof(protocol)) != 0)
+        continue;
+      if (strcasecmp("HTTP", protocol) == 0)
+        cb->http = 1;
+      else if (strcasecmp("Telnet", protocol) == 0)
+        cb->http = 0;
+      else
+        ERROR("write_tsdb plugin: Invalid protocol: %s", protocol);
+    } else if (strcasecmp("BatchSize", child->key) == 0) {
+      int tmp = 0;
+      if ((cf_util_get_int(child, &tmp) == 0) && (tmp > 0))
+        cb->batch_size = (size_t)tmp;
+    } else if (strcasecmp("BatchLinger", child->key) == 0)
+      cf_util_get_cdtime(child, &cb->batch_linger);
+    else if (strcasecmp("Compression", child->key) == 0) {
+      char method[16];
+      if (cf_util_get_string_buffer(child, method, sizeof(method)) != 0)
+        continue;
+      int status = compress_method_parse(method, &cb->compression);
+      if (status == ENOTSUP)
+        ERROR("write_tsdb plugin: collectd has been built without support "
+              "for %s compression.",
+              method);
+      else if (status != 0)
+        ERROR("write_tsdb plugin: Invalid compression method: %s", method);
+    } else if (strcasecmp("RequestsInFlight", child->key) == 0) {
+      int tmp = 0;
+      if ((cf_util_get_int(child, &tmp) == 0) && (tmp > 0))
+        cb->threads_num = (size_t)tmp;
+    } else if (strcasecmp("MaxRetries", child->key) == 0) {
+      int tmp = -1;
+      if ((cf_util_get_int(child, &tmp) == 0) && (tmp >= 0))
+        cb->max_retries = (size_t)tmp;
+    } else if (strcasecmp("QueueLimit", child->key) == 0) {
+      int tmp = 0;
+      if ((cf_util_get_int(child, &tmp) == 0) && (tmp > 0))
+        cb->queue_limit = (size_t)tmp;
+    } else if (strcasecmp("SendBufferSize", child->key) == 0) {
+      int tmp = 0;
+      if ((cf_util_get_int(child, &tmp) == 0) && (tmp >= WT_SEND_BUF_SIZE))
+        cb->send_buf_size = (size_t)tmp;
+    } else if (strcasecmp("BacklogSize", child->key) == 0) {
+      int tmp = 0;
+      if ((cf_util_get_int(child, &tmp) == 0) && (tmp >= 0))
+        cb->backlog_size = (size_t)tmp;
+    } else if (strcasecmp("ReportStats", child->key) == 0) {
+      cf_util_get_boolean(child, &cb->report_stats);
+    } else {
       ERROR("write_tsdb plugin: Invalid configuration "
             "option: %s.",
             child->key);
@@ -610,6 +1167,39 @@ static int wt_config_tsd(oconfig_item_t *ci) {
            cb->node != NULL ? cb->node : WT_DEFAULT_NODE,
            cb->service != NULL ? cb->service : WT_DEFAULT_SERVICE);
 
+  if (cb->http) {
+    wt_batch_t tags = {0};
+    cb->threads = calloc(cb->threads_num, sizeof(*cb->threads));
+    if ((cb->threads == NULL) ||
+        ((cb->host_tags != NULL) &&
+         (wt_batch_append_tags(&tags, cb->host_tags) != 0))) {
+      ERROR("write_tsdb plugin: calloc failed.");
+      sfree(tags.data);
+      wt_callback_free(cb);
+      return -1;
+    }
+    cb->http_host_tags = tags.data;
+  } else {
+    output_config_t conf = {
+        .plugin = "write_tsdb",
+        .node = cb->node != NULL ? cb->node : WT_DEFAULT_NODE,
+        .service = cb->service != NULL ? cb->service : WT_DEFAULT_SERVICE,
+        .socktype = SOCK_STREAM,
+        .buffer_size = cb->send_buf_size,
+        .backlog_size = cb->backlog_size,
+        .connections_num = 1,
+        .log_send_errors = 1,
+        .connect = wt_output_connect,
+        .connect_data = cb,
+    };
+    cb->output = output_create(&conf);
+    if (cb->output == NULL) {
+      ERROR("write_tsdb plugin: Allocating the send buffers failed.");
+      wt_callback_free(cb);
+      return -1;
+    }
+  }
+
   user_data_t user_data = {.data = cb, .free_func = wt_callback_free};
 
   plugin_register_write(callback_name, wt_write, &user_data);
@@ -617,6 +1207,13 @@ static int wt_config_tsd(oconfig_item_t *ci) {
   user_data.free_func = NULL;
   plugin_register_flush(callback_name, wt_flush, &user_data);
 
+  if (cb->http)
+    plugin_register_complex_read(/* group = */ NULL, callback_name, wt_read,
+                                 cb->batch_linger, &user_data);
+  else if (cb->report_stats)
+    plugin_register_complex_read(/* group = */ NULL, callback_name, wt_read,
+                                 /* interval = */ 0, &user_data);
+
   return 0;
 }
 
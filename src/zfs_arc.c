@@ -43,6 +43,8 @@ static value_to_rate_state_t l2_misses_state;
 #if defined(KERNEL_LINUX)
 #include "utils_llist.h"
 #define ZOL_ARCSTATS_FILE "/proc/spl/kstat/zfs/arcstats"
+/* arcstats has about 120 lines of up to 50 bytes each. */
+#define ZOL_ARCSTATS_SIZE 16384
 
 typedef llist_t kstat_t;
 
@@ -197,41 +199,46 @@ static int za_read(void) {
   kstat_t *ksp = NULL;
 
 #if defined(KERNEL_LINUX)
-  FILE *fh;
-  char buffer[1024];
-
-  fh = fopen(ZOL_ARCSTATS_FILE, "r");
-  if (fh == NULL) {
-    ERROR("zfs_arc plugin: Opening \"%s\" failed: %s", ZOL_ARCSTATS_FILE,
+  char buffer[ZOL_ARCSTATS_SIZE];
+  char *line;
+  char *saveptr = NULL;
+  ssize_t len;
+
+  len = read_file_cached(ZOL_ARCSTATS_FILE, buffer, sizeof(buffer) - 1);
+  if (len < 0) {
+    ERROR("zfs_arc plugin: Reading \"%s\" failed: %s", ZOL_ARCSTATS_FILE,
           STRERRNO);
     return -1;
+  } else if ((size_t)len == sizeof(buffer) - 1) {
+    ERROR("zfs_arc plugin: \"%s\" is larger than %zu bytes.",
+          ZOL_ARCSTATS_FILE, sizeof(buffer) - 1);
+    return -1;
   }
+  buffer[len] = '\0';
 
   /* Ignore the first two lines because they contain information about the rest
    * of the file.
    * See kstat_seq_show_headers module/spl/spl-kstat.c of the spl kernel module.
    */
-  if ((fgets(buffer, sizeof(buffer), fh) == NULL) ||
-      (fgets(buffer, sizeof(buffer), fh) == NULL)) {
+  if ((strtok_r(buffer, "\n", &saveptr) == NULL) ||
+      (strtok_r(NULL, "\n", &saveptr) == NULL)) {
     ERROR("zfs_arc plugin: \"%s\" does not contain at least two lines.",
           ZOL_ARCSTATS_FILE);
-    fclose(fh);
     return -1;
   }
 
   ksp = llist_create();
   if (ksp == NULL) {
     ERROR("zfs_arc plugin: `llist_create' failed.");
-    fclose(fh);
     return -1;
   }
 
-  while (fgets(buffer, sizeof(buffer), fh) != NULL) {
+  while ((line = strtok_r(NULL, "\n", &saveptr)) != NULL) {
     char *fields[3];
     value_t v;
     int status;
 
-    status = strsplit(buffer, fields, STATIC_ARRAY_SIZE(fields));
+    status = strsplit(line, fields, STATIC_ARRAY_SIZE(fields));
     if (status != 3)
       continue;
 
@@ -242,8 +249,6 @@ static int za_read(void) {
     put_zfs_value(ksp, fields[0], v);
   }
 
-  fclose(fh);
-
 #elif defined(KERNEL_SOLARIS)
   get_kstat(&ksp, "zfs", 0, "arcstats");
   if (ksp == NULL) {